@@ -0,0 +1,93 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/main.h"
+#include "xenia/cache_pack.h"
+
+DEFINE_transient_string(cache_pack_mode, "",
+                        "export to write a cache pack, import to extract the "
+                        "caches from one.",
+                        "Cache Pack");
+DEFINE_transient_path(cache_pack_file, "", "Cache pack to write or to read.",
+                      "Cache Pack");
+DEFINE_transient_string(cache_pack_title_id, "",
+                        "Hexadecimal ID of the title to export the caches of.",
+                        "Cache Pack");
+DEFINE_transient_path(cache_pack_storage_root, "",
+                      "Storage root of the emulator containing the shader, "
+                      "pipeline and guest code storage.",
+                      "Cache Pack");
+DEFINE_transient_path(cache_pack_texture_cache, "",
+                      "Converted texture cache directory of the emulator "
+                      "(d3d12_texture_disk_cache_path), or empty to skip the "
+                      "converted textures.",
+                      "Cache Pack");
+DEFINE_transient_path(cache_pack_file_access_traces, "",
+                      "File access trace directory of the emulator "
+                      "(file_access_trace_path), or empty to skip the file "
+                      "access trace.",
+                      "Cache Pack");
+DEFINE_transient_path(cache_pack_target, "",
+                      "The .xex or .iso the title is launched from, to export "
+                      "the file access trace of.",
+                      "Cache Pack");
+
+namespace xe {
+namespace app {
+
+int cache_pack_main(const std::vector<std::string>& args) {
+  if (cvars::cache_pack_file.empty()) {
+    XELOGE("No cache pack specified");
+    return 1;
+  }
+  cache_pack::CacheRoots roots;
+  roots.storage_root = cvars::cache_pack_storage_root;
+  roots.texture_cache_root = cvars::cache_pack_texture_cache;
+  roots.file_access_trace_root = cvars::cache_pack_file_access_traces;
+
+  if (cvars::cache_pack_mode == "export") {
+    char* title_id_end = nullptr;
+    unsigned long title_id =
+        std::strtoul(cvars::cache_pack_title_id.c_str(), &title_id_end, 16);
+    if (cvars::cache_pack_title_id.empty() || *title_id_end) {
+      XELOGE("No valid title ID specified with --cache_pack_title_id");
+      return 1;
+    }
+    std::filesystem::path file_access_trace_file_name;
+    if (!cvars::cache_pack_target.empty()) {
+      file_access_trace_file_name =
+          cache_pack::GetFileAccessTraceFileName(cvars::cache_pack_target);
+    }
+    return cache_pack::Export(roots, uint32_t(title_id),
+                              file_access_trace_file_name,
+                              cvars::cache_pack_file)
+               ? 0
+               : 1;
+  }
+  if (cvars::cache_pack_mode == "import") {
+    return cache_pack::Import(cvars::cache_pack_file, roots) ? 0 : 1;
+  }
+  XELOGE("Unknown mode '{}', use export or import", cvars::cache_pack_mode);
+  return 1;
+}
+
+}  // namespace app
+}  // namespace xe
+
+DEFINE_ENTRY_POINT("xenia-cache-pack", xe::app::cache_pack_main,
+                   "[export|import] [pack]", "cache_pack_mode",
+                   "cache_pack_file");
@@ -35,6 +35,10 @@ DECLARE_bool(debug);
 
 DEFINE_int32(window_height, 720, "Window height", "UI");
 DEFINE_int32(window_width, 1280, "Window width", "UI");
+DEFINE_bool(show_performance_hud, false,
+            "Show the performance HUD with the FPS and the load of the "
+            "emulated subsystems (toggled with Shift+F3).",
+            "UI");
 
 namespace xe {
 namespace app {
@@ -50,7 +54,8 @@ const std::string kBaseTitle = "xenia-canary";
 EmulatorWindow::EmulatorWindow(Emulator* emulator)
     : emulator_(emulator),
       loop_(ui::Loop::Create()),
-      window_(ui::Window::Create(loop_.get(), kBaseTitle)) {
+      window_(ui::Window::Create(loop_.get(), kBaseTitle)),
+      performance_hud_(emulator) {
   base_title_ = kBaseTitle +
 #ifdef DEBUG
 #if _NO_DEBUG_HEAP == 1
@@ -123,7 +128,11 @@ bool EmulatorWindow::Initialize() {
       } break;
 
       case 0x72: {  // F3
-        Profiler::ToggleDisplay();
+        if (e->is_shift_pressed()) {
+          TogglePerformanceHud();
+        } else {
+          Profiler::ToggleDisplay();
+        }
       } break;
 
       case 0x73: {  // VK_F4
@@ -136,13 +145,36 @@ bool EmulatorWindow::Initialize() {
         // Save to file
         // TODO: Choose path based on user input, or from options
         // TODO: Spawn a new thread to do this.
-        emulator()->SaveToFile("test.sav");
+        if (e->is_ctrl_pressed()) {
+          emulator()->SaveStreamingToFile("test.xst");
+        } else if (e->is_shift_pressed()) {
+          emulator()->SaveCheckpointToFile(
+              fmt::format("test.{}.chk", emulator()->checkpoint_index()));
+        } else {
+          emulator()->SaveToFile("test.sav");
+        }
       } break;
       case 0x77: {  // VK_F8
         // Restore from file
         // TODO: Choose path from user
         // TODO: Spawn a new thread to do this.
-        emulator()->RestoreFromFile("test.sav");
+        if (e->is_ctrl_pressed()) {
+          emulator()->RestoreStreamingFromFile("test.xst");
+        } else if (e->is_shift_pressed()) {
+          // Restore from the latest checkpoint in the chain.
+          std::vector<std::filesystem::path> paths;
+          for (;;) {
+            std::filesystem::path path =
+                fmt::format("test.{}.chk", paths.size());
+            if (!std::filesystem::exists(path)) {
+              break;
+            }
+            paths.push_back(path);
+          }
+          emulator()->RestoreFromCheckpoints(paths);
+        } else {
+          emulator()->RestoreFromFile("test.sav");
+        }
       } break;
       case 0x7A: {  // VK_F11
         ToggleFullscreen();
@@ -190,7 +222,11 @@ bool EmulatorWindow::Initialize() {
     e->set_handled(false);
   });
 
-  window_->on_paint.AddListener([this](UIEvent* e) { CheckHideCursor(); });
+  performance_hud_.set_visible(cvars::show_performance_hud);
+  window_->on_paint.AddListener([this](UIEvent* e) {
+    CheckHideCursor();
+    performance_hud_.Paint();
+  });
 
   // Main menu.
   // FIXME: This code is really messy.
@@ -262,6 +298,9 @@ bool EmulatorWindow::Initialize() {
     cpu_menu->AddChild(MenuItem::Create(MenuItem::Type::kString,
                                         "&Pause/Resume Profiler", "`",
                                         []() { Profiler::TogglePause(); }));
+    cpu_menu->AddChild(
+        MenuItem::Create(MenuItem::Type::kString, "&Export Profiler Trace",
+                         []() { Profiler::RequestTraceExport(); }));
   }
   cpu_menu->AddChild(MenuItem::Create(MenuItem::Type::kSeparator));
   {
@@ -296,6 +335,9 @@ bool EmulatorWindow::Initialize() {
     window_menu->AddChild(
         MenuItem::Create(MenuItem::Type::kString, "&Fullscreen", "F11",
                          std::bind(&EmulatorWindow::ToggleFullscreen, this)));
+    window_menu->AddChild(MenuItem::Create(
+        MenuItem::Type::kString, "Performance &HUD", "Shift+F3",
+        std::bind(&EmulatorWindow::TogglePerformanceHud, this)));
   }
   main_menu->AddChild(std::move(window_menu));
 
@@ -389,8 +431,8 @@ void EmulatorWindow::FileOpen() {
   file_picker->set_multi_selection(false);
   file_picker->set_title("Select Content Package");
   file_picker->set_extensions({
-      {"Supported Files", "*.iso;*.xex;*.xcp;*.*"},
-      {"Disc Image (*.iso)", "*.iso"},
+      {"Supported Files", "*.iso;*.xcdi;*.xex;*.xcp;*.*"},
+      {"Disc Image (*.iso, *.xcdi)", "*.iso;*.xcdi"},
       {"Xbox Executable (*.xex)", "*.xex"},
       //{"Content Package (*.xcp)", "*.xcp" },
       {"All Files (*.*)", "*.*"},
@@ -509,6 +551,11 @@ void EmulatorWindow::GpuClearCaches() {
   emulator()->graphics_system()->ClearCaches();
 }
 
+void EmulatorWindow::TogglePerformanceHud() {
+  performance_hud_.ToggleVisible();
+  window_->Invalidate();
+}
+
 void EmulatorWindow::ToggleFullscreen() {
   window_->ToggleFullscreen(!window_->is_fullscreen());
 
@@ -13,6 +13,7 @@
 #include <memory>
 #include <string>
 
+#include "xenia/app/performance_hud.h"
 #include "xenia/ui/loop.h"
 #include "xenia/ui/menu_item.h"
 #include "xenia/ui/window.h"
@@ -58,12 +59,14 @@ class EmulatorWindow {
   void CpuBreakIntoHostDebugger();
   void GpuTraceFrame();
   void GpuClearCaches();
+  void TogglePerformanceHud();
   void ShowHelpWebsite();
   void ShowCommitID();
 
   Emulator* emulator_;
   std::unique_ptr<ui::Loop> loop_;
   std::unique_ptr<ui::Window> window_;
+  PerformanceHud performance_hud_;
   std::string base_title_;
   std::filesystem::path global_recent_paths_[10];
   uint64_t cursor_hide_time_ = 0;
@@ -0,0 +1,159 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/app/performance_hud.h"
+
+#include <algorithm>
+
+#include "third_party/imgui/imgui.h"
+#include "xenia/apu/audio_driver.h"
+#include "xenia/base/clock.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/emulator.h"
+#include "xenia/gpu/command_processor.h"
+#include "xenia/gpu/graphics_system.h"
+#include "xenia/memory.h"
+
+namespace xe {
+namespace app {
+
+PerformanceHud::PerformanceHud(Emulator* emulator) : emulator_(emulator) {}
+
+void PerformanceHud::Paint() {
+  if (!visible_) {
+    // Start averaging anew when shown again.
+    interval_started_ = false;
+    return;
+  }
+
+  Sample sample = TakeSample();
+  if (!interval_started_) {
+    interval_start_ = sample;
+    interval_started_ = true;
+    interval_paints_ = 0;
+    interval_max_paint_ticks_ = 0;
+  } else {
+    ++interval_paints_;
+    interval_max_paint_ticks_ = std::max(interval_max_paint_ticks_,
+                                         sample.host_ticks - last_paint_ticks_);
+    if (sample.host_ticks - interval_start_.host_ticks >=
+        Clock::QueryHostTickFrequency() * kUpdateIntervalMs / 1000) {
+      UpdateValues(sample);
+      interval_start_ = sample;
+      interval_paints_ = 0;
+      interval_max_paint_ticks_ = 0;
+    }
+  }
+  last_paint_ticks_ = sample.host_ticks;
+
+  Draw();
+}
+
+PerformanceHud::Sample PerformanceHud::TakeSample() const {
+  Sample sample;
+  sample.host_ticks = Clock::QueryHostTickCount();
+  gpu::GraphicsSystem* graphics_system = emulator_->graphics_system();
+  gpu::CommandProcessor* command_processor =
+      graphics_system ? graphics_system->command_processor() : nullptr;
+  if (command_processor) {
+    const gpu::BenchmarkCounters& counters =
+        command_processor->benchmark_counters();
+    sample.guest_swaps = counters.swap_count.load(std::memory_order_relaxed);
+    sample.draws = counters.draw_count.load(std::memory_order_relaxed);
+    sample.resolves = counters.resolve_count.load(std::memory_order_relaxed);
+    sample.command_processor_idle_ticks =
+        counters.idle_ticks.load(std::memory_order_relaxed);
+    sample.texture_upload_bytes =
+        counters.texture_upload_bytes.load(std::memory_order_relaxed);
+  }
+  cpu::Processor* processor = emulator_->processor();
+  if (processor) {
+    sample.functions_compiled = processor->functions_compiled();
+  }
+  Memory* memory = emulator_->memory();
+  if (memory) {
+    sample.watch_access_violations = memory->watch_access_violation_count();
+  }
+  return sample;
+}
+
+void PerformanceHud::UpdateValues(const Sample& sample) {
+  const Sample& start = interval_start_;
+  double tick_frequency = double(Clock::QueryHostTickFrequency());
+  double seconds =
+      double(sample.host_ticks - start.host_ticks) / tick_frequency;
+  uint64_t guest_swaps = sample.guest_swaps - start.guest_swaps;
+  // Per guest frame values, per interval if the guest hasn't presented.
+  double frames = double(std::max(guest_swaps, uint64_t(1)));
+
+  guest_fps_ = double(guest_swaps) / seconds;
+  present_interval_ms_ =
+      interval_paints_ ? seconds * 1000.0 / double(interval_paints_) : 0.0;
+  present_interval_max_ms_ =
+      double(interval_max_paint_ticks_) * 1000.0 / tick_frequency;
+  double idle_seconds = double(sample.command_processor_idle_ticks -
+                               start.command_processor_idle_ticks) /
+                        tick_frequency;
+  command_processor_busy_percent_ =
+      100.0 * (1.0 - std::min(idle_seconds / seconds, 1.0));
+  // The draw count includes resolves.
+  uint64_t draws = sample.draws - start.draws;
+  uint64_t resolves = sample.resolves - start.resolves;
+  draws_per_frame_ = double(draws - std::min(draws, resolves)) / frames;
+  resolves_per_frame_ = double(resolves) / frames;
+  texture_upload_mb_per_frame_ =
+      double(sample.texture_upload_bytes - start.texture_upload_bytes) /
+      (1024.0 * 1024.0) / frames;
+  functions_compiled_per_second_ =
+      double(sample.functions_compiled - start.functions_compiled) / seconds;
+  watch_access_violations_per_frame_ =
+      double(sample.watch_access_violations - start.watch_access_violations) /
+      frames;
+
+  // Current values rather than rates.
+  gpu::GraphicsSystem* graphics_system = emulator_->graphics_system();
+  gpu::CommandProcessor* command_processor =
+      graphics_system ? graphics_system->command_processor() : nullptr;
+  pending_pipeline_creations_ =
+      command_processor
+          ? command_processor->benchmark_counters()
+                .pending_pipeline_creations.load(std::memory_order_relaxed)
+          : 0;
+  audio_queued_frames_ = apu::AudioFrameQueueDepth::total_queued_frames();
+}
+
+void PerformanceHud::Draw() const {
+  ImGuiIO& io = ImGui::GetIO();
+  ImGui::SetNextWindowPos(ImVec2(io.DisplaySize.x - 8.0f, 8.0f),
+                          ImGuiCond_Always, ImVec2(1.0f, 0.0f));
+  ImGui::SetNextWindowBgAlpha(0.6f);
+  ImGui::Begin("Performance", nullptr,
+               ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize |
+                   ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoScrollbar |
+                   ImGuiWindowFlags_NoSavedSettings |
+                   ImGuiWindowFlags_NoInputs |
+                   ImGuiWindowFlags_AlwaysAutoResize |
+                   ImGuiWindowFlags_NoFocusOnAppearing);
+  ImGui::Text("Guest FPS:            %6.1f", guest_fps_);
+  ImGui::Text("Present interval:     %6.1f ms (max %.1f)", present_interval_ms_,
+              present_interval_max_ms_);
+  ImGui::Text("GPU CP busy:          %6.1f%%", command_processor_busy_percent_);
+  ImGui::Text("Draws / frame:        %6.0f", draws_per_frame_);
+  ImGui::Text("Resolves / frame:     %6.1f", resolves_per_frame_);
+  ImGui::Text("Pipelines pending:    %6u", pending_pipeline_creations_);
+  ImGui::Text("Texture MB / frame:   %6.2f", texture_upload_mb_per_frame_);
+  ImGui::Text("JIT functions / s:    %6.0f", functions_compiled_per_second_);
+  ImGui::Text("Watch faults / frame: %6.1f",
+              watch_access_violations_per_frame_);
+  ImGui::Text("Audio queued frames:  %6u", audio_queued_frames_);
+  ImGui::End();
+}
+
+}  // namespace app
+}  // namespace xe
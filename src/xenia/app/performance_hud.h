@@ -0,0 +1,81 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_APP_PERFORMANCE_HUD_H_
+#define XENIA_APP_PERFORMANCE_HUD_H_
+
+#include <cstdint>
+
+namespace xe {
+class Emulator;
+}  // namespace xe
+
+namespace xe {
+namespace app {
+
+// Small overlay with the performance of the emulated subsystems, readable
+// enough for players to report. The counters are atomic and are sampled once
+// per painted frame, with the displayed values averaged over a short interval
+// so they don't flicker.
+class PerformanceHud {
+ public:
+  explicit PerformanceHud(Emulator* emulator);
+
+  bool is_visible() const { return visible_; }
+  void set_visible(bool visible) { visible_ = visible; }
+  void ToggleVisible() { visible_ = !visible_; }
+
+  // Must be called on every paint, between ImGui::NewFrame and ImGui::Render.
+  void Paint();
+
+ private:
+  static constexpr uint64_t kUpdateIntervalMs = 500;
+
+  struct Sample {
+    uint64_t host_ticks = 0;
+    uint64_t guest_swaps = 0;
+    uint64_t draws = 0;
+    uint64_t resolves = 0;
+    uint64_t command_processor_idle_ticks = 0;
+    uint64_t texture_upload_bytes = 0;
+    uint64_t functions_compiled = 0;
+    uint64_t watch_access_violations = 0;
+  };
+  Sample TakeSample() const;
+  void UpdateValues(const Sample& sample);
+  void Draw() const;
+
+  Emulator* emulator_;
+  bool visible_ = false;
+
+  // Sample at the beginning of the current averaging interval.
+  Sample interval_start_;
+  bool interval_started_ = false;
+  uint64_t last_paint_ticks_ = 0;
+  uint32_t interval_paints_ = 0;
+  uint64_t interval_max_paint_ticks_ = 0;
+
+  // Displayed values.
+  double guest_fps_ = 0.0;
+  double present_interval_ms_ = 0.0;
+  double present_interval_max_ms_ = 0.0;
+  double command_processor_busy_percent_ = 0.0;
+  double draws_per_frame_ = 0.0;
+  double resolves_per_frame_ = 0.0;
+  uint32_t pending_pipeline_creations_ = 0;
+  double texture_upload_mb_per_frame_ = 0.0;
+  double functions_compiled_per_second_ = 0.0;
+  double watch_access_violations_per_frame_ = 0.0;
+  uint32_t audio_queued_frames_ = 0;
+};
+
+}  // namespace app
+}  // namespace xe
+
+#endif  // XENIA_APP_PERFORMANCE_HUD_H_
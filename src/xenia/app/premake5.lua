@@ -93,3 +93,24 @@ project("xenia-app")
       debugargs({
       })
     end
+
+project("xenia-cache-pack")
+  uuid("5c0f8e2a-6b3d-4e71-9a4c-2d8b7f1e3a56")
+  kind("ConsoleApp")
+  language("C++")
+  links({
+    "fmt",
+    "snappy",
+    "xenia-base",
+    "xenia-core",
+    "xxhash",
+  })
+  files({
+    "cache_pack_main.cc",
+    "../base/main_"..platform_suffix..".cc",
+  })
+  filter("platforms:Windows")
+    debugdir(project_root)
+
+    -- xenia-base needs this
+    links({"xenia-ui"})
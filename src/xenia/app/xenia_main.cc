@@ -18,6 +18,7 @@
 #include "xenia/config.h"
 #include "xenia/debug/ui/debug_window.h"
 #include "xenia/emulator.h"
+#include "xenia/kernel/kernel_flags.h"
 #include "xenia/ui/file_picker.h"
 #include "xenia/vfs/virtual_file_system.h"
 #include "xenia/vfs/devices/host_path_device.h"
@@ -166,6 +167,9 @@ std::unique_ptr<apu::AudioSystem> CreateAudioSystem(cpu::Processor* processor) {
 #endif  // XE_PLATFORM_WIN32
   factory.Add<apu::sdl::SDLAudioSystem>("sdl");
   factory.Add<apu::nop::NopAudioSystem>("nop");
+  if (cvars::apu == "any" && cvars::headless && cvars::headless_unthrottled) {
+    return factory.Create("nop", processor);
+  }
   return factory.Create(cvars::apu, processor);
 }
 
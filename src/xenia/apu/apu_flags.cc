@@ -10,3 +10,16 @@
 #include "xenia/apu/apu_flags.h"
 
 DEFINE_bool(mute, false, "Mutes all audio output.", "APU")
+DEFINE_bool(apu_low_latency, false,
+            "Keep as few audio frames queued for playback as the timing of "
+            "the game allows, growing the queue when playback runs out of "
+            "frames and shrinking it when the queue doesn't run low for "
+            "some time, instead of always letting the game queue up to 64 "
+            "frames (about 340 ms).",
+            "APU")
+DEFINE_int32(apu_timing_log_interval, 0,
+             "Interval in seconds between logging the statistics of audio "
+             "timing - XMA frame decoding, guest audio callbacks, the time "
+             "from a driver requesting a frame to its submission, and the "
+             "queue depth - or 0 not to log them.",
+             "APU")
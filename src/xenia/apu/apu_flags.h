@@ -12,5 +12,7 @@
 
 #include "xenia/base/cvar.h"
 DECLARE_bool(mute)
+DECLARE_bool(apu_low_latency)
+DECLARE_int32(apu_timing_log_interval)
 
 #endif  // XENIA_APU_APU_FLAGS_H_
@@ -0,0 +1,283 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/audio_conversion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/memory.h"
+#include "xenia/base/platform.h"
+
+#if XE_ARCH_AMD64
+#if XE_COMPILER_MSVC
+#include <intrin.h>
+#else
+#include <immintrin.h>
+#endif  // XE_COMPILER_MSVC
+#endif  // XE_ARCH_AMD64
+
+namespace xe {
+namespace apu {
+namespace conversion {
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+constexpr float kDownmixCenterScale = 0.70710678f;
+constexpr float kDownmixSurroundScale = 0.70710678f;
+
+#if XE_ARCH_AMD64
+
+// The vector paths return the number of samples per channel processed, a
+// multiple of 4, the rest is left to the scalar paths.
+
+uint32_t Downmix6To2SSE2(float* output, uint32_t output_stride,
+                         const float* input, uint32_t input_stride,
+                         uint32_t channel_samples) {
+  const __m128 center_scale = _mm_set1_ps(kDownmixCenterScale);
+  const __m128 surround_scale = _mm_set1_ps(kDownmixSurroundScale);
+  uint32_t i = 0;
+  for (; i + 4 <= channel_samples; i += 4) {
+    __m128 center =
+        _mm_mul_ps(_mm_loadu_ps(input + 2 * input_stride + i), center_scale);
+    __m128 left = _mm_add_ps(
+        _mm_add_ps(_mm_loadu_ps(input + i), center),
+        _mm_mul_ps(_mm_loadu_ps(input + 4 * input_stride + i), surround_scale));
+    __m128 right = _mm_add_ps(
+        _mm_add_ps(_mm_loadu_ps(input + input_stride + i), center),
+        _mm_mul_ps(_mm_loadu_ps(input + 5 * input_stride + i), surround_scale));
+    _mm_storeu_ps(output + i, left);
+    _mm_storeu_ps(output + output_stride + i, right);
+  }
+  return i;
+}
+
+uint32_t Interleave2SSE2(float* output, const float* input,
+                         uint32_t input_stride, uint32_t channel_samples) {
+  uint32_t i = 0;
+  for (; i + 4 <= channel_samples; i += 4) {
+    __m128 left = _mm_loadu_ps(input + i);
+    __m128 right = _mm_loadu_ps(input + input_stride + i);
+    _mm_storeu_ps(output + i * 2, _mm_unpacklo_ps(left, right));
+    _mm_storeu_ps(output + i * 2 + 4, _mm_unpackhi_ps(left, right));
+  }
+  return i;
+}
+
+uint32_t Interleave6SSE2(float* output, const float* input,
+                         uint32_t input_stride, uint32_t channel_samples) {
+  uint32_t i = 0;
+  for (; i + 4 <= channel_samples; i += 4) {
+    __m128 a = _mm_loadu_ps(input + i);
+    __m128 b = _mm_loadu_ps(input + input_stride + i);
+    __m128 c = _mm_loadu_ps(input + 2 * input_stride + i);
+    __m128 d = _mm_loadu_ps(input + 3 * input_stride + i);
+    __m128 e = _mm_loadu_ps(input + 4 * input_stride + i);
+    __m128 f = _mm_loadu_ps(input + 5 * input_stride + i);
+    // a0 b0 a1 b1, a2 b2 a3 b3 and the same for the other pairs.
+    __m128 ab_low = _mm_unpacklo_ps(a, b), ab_high = _mm_unpackhi_ps(a, b);
+    __m128 cd_low = _mm_unpacklo_ps(c, d), cd_high = _mm_unpackhi_ps(c, d);
+    __m128 ef_low = _mm_unpacklo_ps(e, f), ef_high = _mm_unpackhi_ps(e, f);
+    float* sample_output = output + i * 6;
+    // a0 b0 c0 d0 | e0 f0 a1 b1 | c1 d1 e1 f1
+    _mm_storeu_ps(sample_output, _mm_movelh_ps(ab_low, cd_low));
+    _mm_storeu_ps(sample_output + 4,
+                  _mm_shuffle_ps(ef_low, ab_low, _MM_SHUFFLE(3, 2, 1, 0)));
+    _mm_storeu_ps(sample_output + 8, _mm_movehl_ps(ef_low, cd_low));
+    // a2 b2 c2 d2 | e2 f2 a3 b3 | c3 d3 e3 f3
+    _mm_storeu_ps(sample_output + 12, _mm_movelh_ps(ab_high, cd_high));
+    _mm_storeu_ps(sample_output + 16,
+                  _mm_shuffle_ps(ef_high, ab_high, _MM_SHUFFLE(3, 2, 1, 0)));
+    _mm_storeu_ps(sample_output + 20, _mm_movehl_ps(ef_high, cd_high));
+  }
+  return i;
+}
+
+#endif  // XE_ARCH_AMD64
+
+float DotProduct(const float* coefficients, const float* samples,
+                 uint32_t count) {
+  uint32_t i = 0;
+  float sum = 0.0f;
+#if XE_ARCH_AMD64
+  __m128 sum_vector = _mm_setzero_ps();
+  for (; i + 4 <= count; i += 4) {
+    sum_vector = _mm_add_ps(
+        sum_vector, _mm_mul_ps(_mm_loadu_ps(coefficients + i),
+                               _mm_loadu_ps(samples + i)));
+  }
+  sum_vector = _mm_add_ps(sum_vector, _mm_movehl_ps(sum_vector, sum_vector));
+  sum_vector = _mm_add_ss(
+      sum_vector,
+      _mm_shuffle_ps(sum_vector, sum_vector, _MM_SHUFFLE(1, 1, 1, 1)));
+  sum = _mm_cvtss_f32(sum_vector);
+#endif  // XE_ARCH_AMD64
+  for (; i < count; ++i) {
+    sum += coefficients[i] * samples[i];
+  }
+  return sum;
+}
+
+}  // namespace
+
+void SwapGuestFrame(float* output, const float* guest_frame) {
+  xe::copy_and_swap_32_unaligned(output, guest_frame,
+                                 kGuestChannels * kGuestChannelSamples);
+}
+
+void Downmix6To2(float* output, uint32_t output_stride, const float* input,
+                 uint32_t input_stride, uint32_t channel_samples) {
+  uint32_t i = 0;
+#if XE_ARCH_AMD64
+  i = Downmix6To2SSE2(output, output_stride, input, input_stride,
+                      channel_samples);
+#endif  // XE_ARCH_AMD64
+  for (; i < channel_samples; ++i) {
+    float center = input[2 * input_stride + i] * kDownmixCenterScale;
+    output[i] = input[i] + center +
+                input[4 * input_stride + i] * kDownmixSurroundScale;
+    output[output_stride + i] = input[input_stride + i] + center +
+                                input[5 * input_stride + i] *
+                                    kDownmixSurroundScale;
+  }
+}
+
+void Interleave(float* output, const float* input, uint32_t input_stride,
+                uint32_t channel_count, uint32_t channel_samples) {
+  uint32_t i = 0;
+#if XE_ARCH_AMD64
+  if (channel_count == 2) {
+    i = Interleave2SSE2(output, input, input_stride, channel_samples);
+  } else if (channel_count == 6) {
+    i = Interleave6SSE2(output, input, input_stride, channel_samples);
+  }
+#endif  // XE_ARCH_AMD64
+  for (; i < channel_samples; ++i) {
+    for (uint32_t channel = 0; channel < channel_count; ++channel) {
+      output[i * channel_count + channel] = input[channel * input_stride + i];
+    }
+  }
+}
+
+bool PolyphaseResampler::Initialize(uint32_t input_rate, uint32_t output_rate,
+                                    uint32_t channel_count) {
+  if (!input_rate || !output_rate || !channel_count) {
+    return false;
+  }
+  uint32_t divisor = std::gcd(input_rate, output_rate);
+  phase_count_ = output_rate / divisor;
+  input_step_ = input_rate / divisor;
+  if (phase_count_ > kMaxPhases) {
+    return false;
+  }
+  channel_count_ = channel_count;
+
+  // Low-pass prototype filter at the input rate upsampled by phase_count_,
+  // with the Blackman window transition band (about 5.5 / kTaps of the input
+  // rate wide) ending near the Nyquist frequency of the lower of the rates.
+  uint32_t length = kTaps * phase_count_;
+  double cutoff = 0.91 * 0.5 *
+                  std::min(1.0, double(phase_count_) / double(input_step_)) /
+                  double(phase_count_);
+  double center = double(length - 1) * 0.5;
+  coefficients_.resize(length);
+  for (uint32_t phase = 0; phase < phase_count_; ++phase) {
+    float* phase_coefficients = coefficients_.data() + phase * kTaps;
+    double sum = 0.0;
+    for (uint32_t tap = 0; tap < kTaps; ++tap) {
+      uint32_t n = phase + tap * phase_count_;
+      double x = double(n) - center;
+      double sinc = x != 0.0 ? std::sin(2.0 * kPi * cutoff * x) /
+                                   (kPi * x)
+                             : 2.0 * cutoff;
+      double window_x = 2.0 * kPi * double(n) / double(length - 1);
+      double window =
+          0.42 - 0.5 * std::cos(window_x) + 0.08 * std::cos(2.0 * window_x);
+      double coefficient = sinc * window;
+      // Tap 0 is applied to the newest sample.
+      phase_coefficients[kTaps - 1 - tap] = float(coefficient);
+      sum += coefficient;
+    }
+    // Unity gain for every phase, so there's no ripple at the phase rate.
+    for (uint32_t tap = 0; tap < kTaps; ++tap) {
+      phase_coefficients[tap] = float(phase_coefficients[tap] / sum);
+    }
+  }
+
+  window_.clear();
+  position_ = 0;
+  return true;
+}
+
+uint32_t PolyphaseResampler::GetMaxOutputSamples(
+    uint32_t input_samples) const {
+  // Plus one for the fractional position carried from the previous call.
+  return uint32_t((uint64_t(input_samples) * phase_count_ + input_step_ - 1) /
+                  input_step_) +
+         1;
+}
+
+uint32_t PolyphaseResampler::Resample(float* output, uint32_t output_stride,
+                                      const float* input,
+                                      uint32_t input_stride,
+                                      uint32_t input_samples) {
+  assert_not_zero(phase_count_);
+  const uint32_t history_samples = kTaps - 1;
+  uint32_t window_stride = history_samples + input_samples;
+  size_t window_size = size_t(channel_count_) * window_stride;
+  if (window_.empty()) {
+    window_.resize(window_size);
+  } else if (window_.size() != window_size) {
+    // Only the history of the previous call (at the beginning of each
+    // channel) is needed, move it to the new positions of the channels.
+    size_t old_window_stride = window_.size() / channel_count_;
+    std::vector<float> new_window(window_size);
+    for (uint32_t channel = 0; channel < channel_count_; ++channel) {
+      std::memcpy(new_window.data() + channel * window_stride,
+                  window_.data() + channel * old_window_stride,
+                  sizeof(float) * history_samples);
+    }
+    window_ = std::move(new_window);
+  }
+
+  uint64_t end = uint64_t(input_samples) * phase_count_;
+  uint32_t output_samples =
+      position_ < end
+          ? uint32_t((end - position_ + input_step_ - 1) / input_step_)
+          : 0;
+  for (uint32_t channel = 0; channel < channel_count_; ++channel) {
+    float* channel_window = window_.data() + channel * window_stride;
+    std::memcpy(channel_window + history_samples,
+                input + channel * input_stride, sizeof(float) * input_samples);
+    float* channel_output = output + channel * output_stride;
+    uint64_t position = position_;
+    for (uint32_t i = 0; i < output_samples; ++i) {
+      uint32_t base = uint32_t(position / phase_count_);
+      uint32_t phase = uint32_t(position % phase_count_);
+      channel_output[i] = DotProduct(coefficients_.data() + phase * kTaps,
+                                     channel_window + base, kTaps);
+      position += input_step_;
+    }
+    // The history for the next call.
+    std::memmove(channel_window, channel_window + input_samples,
+                 sizeof(float) * history_samples);
+  }
+  position_ += uint64_t(output_samples) * input_step_;
+  position_ -= end;
+  return output_samples;
+}
+
+}  // namespace conversion
+}  // namespace apu
+}  // namespace xe
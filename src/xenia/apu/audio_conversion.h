@@ -0,0 +1,84 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_APU_AUDIO_CONVERSION_H_
+#define XENIA_APU_AUDIO_CONVERSION_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace xe {
+namespace apu {
+namespace conversion {
+
+// Guest frames have 6 channels - front left, front right, front center, low
+// frequency, back left and back right - at 48 kHz, stored sequentially (all
+// samples of the first channel, then of the second, and so on) as big-endian
+// floats.
+constexpr uint32_t kGuestChannels = 6;
+constexpr uint32_t kGuestChannelSamples = 256;
+constexpr uint32_t kGuestSampleRate = 48000;
+
+// The functions take sequential channels with the specified distance in
+// samples between the beginnings of the channels.
+
+// Converts a guest frame to host-endian sequential channels.
+void SwapGuestFrame(float* output, const float* guest_frame);
+
+// Mixes 6 sequential channels down to 2 (stereo) sequential channels with the
+// ITU-R BS.775 coefficients, dropping the low frequency channel.
+void Downmix6To2(float* output, uint32_t output_stride, const float* input,
+                 uint32_t input_stride, uint32_t channel_samples);
+
+// Interleaves 2 or 6 sequential channels.
+void Interleave(float* output, const float* input, uint32_t input_stride,
+                uint32_t channel_count, uint32_t channel_samples);
+
+// Windowed sinc polyphase resampler of sequential channels by a rational
+// ratio, keeping the history between calls so consecutive frames are resampled
+// as one continuous stream.
+class PolyphaseResampler {
+ public:
+  // Returns false if the ratio of the rates would need too many phases.
+  bool Initialize(uint32_t input_rate, uint32_t output_rate,
+                  uint32_t channel_count);
+
+  // Maximum number of samples per channel Resample may produce from the
+  // specified number of input samples per channel.
+  uint32_t GetMaxOutputSamples(uint32_t input_samples) const;
+
+  // Returns the number of samples produced per channel.
+  uint32_t Resample(float* output, uint32_t output_stride, const float* input,
+                    uint32_t input_stride, uint32_t input_samples);
+
+ private:
+  // Per phase, a multiple of 4 for the vector dot product. Enough for a
+  // transition band of about 4 kHz at 48 kHz.
+  static constexpr uint32_t kTaps = 64;
+  static constexpr uint32_t kMaxPhases = 1024;
+
+  uint32_t phase_count_ = 0;
+  uint32_t input_step_ = 0;
+  uint32_t channel_count_ = 0;
+  // kTaps coefficients for each phase, in the order of the input samples they
+  // are multiplied by.
+  std::vector<float> coefficients_;
+  // For each channel, kTaps - 1 samples of the previous input followed by the
+  // current input.
+  std::vector<float> window_;
+  // Position of the next output sample relative to the beginning of the
+  // current input, in 1/phase_count_ input samples.
+  uint64_t position_ = 0;
+};
+
+}  // namespace conversion
+}  // namespace apu
+}  // namespace xe
+
+#endif  // XENIA_APU_AUDIO_CONVERSION_H_
@@ -9,9 +9,132 @@
 
 #include "xenia/apu/audio_driver.h"
 
+#include <algorithm>
+
+#include "xenia/apu/apu_flags.h"
+#include "xenia/base/assert.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/profiling.h"
+
 namespace xe {
 namespace apu {
 
+std::atomic<uint32_t> AudioFrameQueueDepth::total_queued_frames_{0};
+
+uint32_t AudioFrameQueueDepth::GetInitialDepth() {
+  return cvars::apu_low_latency ? kLowLatencyInitialDepth : kMaximumDepth;
+}
+
+AudioFrameQueueDepth::AudioFrameQueueDepth(
+    xe::threading::Semaphore* semaphore)
+    : semaphore_(semaphore),
+      low_latency_(cvars::apu_low_latency),
+      depth_(GetInitialDepth()) {}
+
+AudioFrameQueueDepth::~AudioFrameQueueDepth() {
+  total_queued_frames_.fetch_sub(queued_, std::memory_order_relaxed);
+}
+
+void AudioFrameQueueDepth::OnFrameSubmitted() {
+  uint32_t release_count = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!queued_ && played_since_empty_) {
+      // Playback has consumed everything before this frame arrived.
+      ++underrun_count_;
+      played_since_empty_ = false;
+      if (low_latency_ && depth_ < kMaximumDepth) {
+        // Grow faster than shrinking, a single underrun is already audible.
+        uint32_t growth = std::min(uint32_t(2), kMaximumDepth - depth_);
+        depth_ += growth;
+        // Cancel pending shrinking before letting more frames be queued.
+        uint32_t withheld_cancelled = std::min(withheld_, growth);
+        withheld_ -= withheld_cancelled;
+        release_count = growth - withheld_cancelled;
+      }
+      window_frames_ = 0;
+      window_minimum_queued_ = UINT32_MAX;
+    }
+    queued_frames_on_submit_.Record(queued_);
+    if (!request_times_.empty()) {
+      request_to_submit_timing_.Record(HostTicksToMicroseconds(
+          Clock::QueryHostTickCount() - request_times_.front()));
+      request_times_.pop_front();
+    }
+    ++queued_;
+    total_queued_frames_.fetch_add(1, std::memory_order_relaxed);
+    ExportCounters();
+    RecordRequests(release_count);
+  }
+  if (release_count) {
+    auto ret = semaphore_->Release(int(release_count), nullptr);
+    assert_true(ret);
+  }
+}
+
+void AudioFrameQueueDepth::OnFramePlayed() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (queued_) {
+      --queued_;
+      total_queued_frames_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    played_since_empty_ = true;
+    if (low_latency_) {
+      window_minimum_queued_ = std::min(window_minimum_queued_, queued_);
+      if (++window_frames_ >= kShrinkWindowFrames) {
+        // The guest was ahead of playback by at least two frames throughout
+        // the window - one of them isn't needed to absorb its jitter.
+        if (window_minimum_queued_ >= 2 && depth_ > kLowLatencyMinimumDepth) {
+          --depth_;
+          ++withheld_;
+        }
+        window_frames_ = 0;
+        window_minimum_queued_ = UINT32_MAX;
+      }
+    }
+    ExportCounters();
+    if (withheld_) {
+      --withheld_;
+      return;
+    }
+    RecordRequests(1);
+  }
+  auto ret = semaphore_->Release(1, nullptr);
+  assert_true(ret);
+}
+
+uint32_t AudioFrameQueueDepth::depth() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return depth_;
+}
+
+uint64_t AudioFrameQueueDepth::underrun_count() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return underrun_count_;
+}
+
+void AudioFrameQueueDepth::RecordRequests(uint32_t count) {
+  if (!count) {
+    return;
+  }
+  uint64_t time = Clock::QueryHostTickCount();
+  request_times_.insert(request_times_.end(), count, time);
+  // Not to grow without bounds if the semaphore is drained elsewhere.
+  while (request_times_.size() > kMaximumDepth) {
+    request_times_.pop_front();
+  }
+}
+
+void AudioFrameQueueDepth::ExportCounters() const {
+  COUNT_profile_set("apu/queue/depth_frames", int64_t(depth_));
+  COUNT_profile_set("apu/queue/queued_frames", int64_t(queued_));
+  COUNT_profile_set(
+      "apu/queue/latency_us",
+      int64_t(uint64_t(queued_) * kSamplesPerFrame * 1000000 / kSampleRate));
+  COUNT_profile_set("apu/queue/underruns", int64_t(underrun_count_));
+}
+
 AudioDriver::AudioDriver(Memory* memory) : memory_(memory) {}
 
 AudioDriver::~AudioDriver() = default;
@@ -10,12 +10,96 @@
 #ifndef XENIA_APU_AUDIO_DRIVER_H_
 #define XENIA_APU_AUDIO_DRIVER_H_
 
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+#include "xenia/apu/audio_timing.h"
+#include "xenia/base/threading.h"
 #include "xenia/memory.h"
 #include "xenia/xbox.h"
 
 namespace xe {
 namespace apu {
 
+// Controls how many frames a client may have queued for playback through the
+// client semaphore the guest waits on before producing each frame. With
+// apu_low_latency, the depth adapts to the jitter of submissions: it grows when
+// playback runs out of frames and shrinks when the queue hasn't gone below two
+// frames for a while. Exports the queue state to the profiler.
+class AudioFrameQueueDepth {
+ public:
+  static const uint32_t kMaximumDepth = 64;
+  static const uint32_t kLowLatencyMinimumDepth = 2;
+  static const uint32_t kLowLatencyInitialDepth = 4;
+
+  // Number of frames the client semaphore must be released for when a client
+  // is created.
+  static uint32_t GetInitialDepth();
+
+  explicit AudioFrameQueueDepth(xe::threading::Semaphore* semaphore);
+  ~AudioFrameQueueDepth();
+
+  // Called when the guest has submitted a frame.
+  void OnFrameSubmitted();
+  // Called, possibly on a device thread, when a frame has finished playing and
+  // its place in the queue can be given back to the guest.
+  void OnFramePlayed();
+
+  uint32_t depth() const;
+  uint64_t underrun_count() const;
+  // Frames submitted and not played yet in the queues of all the clients,
+  // without locking.
+  static uint32_t total_queued_frames() {
+    return total_queued_frames_.load(std::memory_order_relaxed);
+  }
+
+  // Microseconds from releasing the semaphore for a frame to the guest
+  // submitting it.
+  AudioTimingHistogram& request_to_submit_timing() {
+    return request_to_submit_timing_;
+  }
+  // Frames already queued when a frame is submitted.
+  AudioTimingHistogram& queued_frames_on_submit() {
+    return queued_frames_on_submit_;
+  }
+
+ private:
+  // Frames played between the checks whether the depth can be lowered, about
+  // two seconds of 256-sample frames at 48 kHz.
+  static const uint32_t kShrinkWindowFrames = 375;
+  static const uint32_t kSamplesPerFrame = 256;
+  static const uint32_t kSampleRate = 48000;
+
+  void ExportCounters() const;
+  // Must be called with mutex_ locked, before releasing the semaphore.
+  void RecordRequests(uint32_t count);
+
+  xe::threading::Semaphore* semaphore_;
+  bool low_latency_;
+
+  mutable std::mutex mutex_;
+  uint32_t depth_;
+  // Submitted and not played yet.
+  uint32_t queued_ = 0;
+  // Played frames not to release the semaphore for, to lower the depth.
+  uint32_t withheld_ = 0;
+  // Whether a frame has been played since the queue was last found empty, so
+  // an idle client isn't counted as continuously underrunning.
+  bool played_since_empty_ = false;
+  uint64_t underrun_count_ = 0;
+  uint32_t window_frames_ = 0;
+  uint32_t window_minimum_queued_ = UINT32_MAX;
+  // Host tick counts of the semaphore releases not matched by submissions yet
+  // (not including the initial ones for the time before playback starts).
+  std::deque<uint64_t> request_times_;
+
+  AudioTimingHistogram request_to_submit_timing_;
+  AudioTimingHistogram queued_frames_on_submit_;
+  static std::atomic<uint32_t> total_queued_frames_;
+};
+
 class AudioDriver {
  public:
   explicit AudioDriver(Memory* memory);
@@ -23,6 +107,9 @@ class AudioDriver {
 
   virtual void SubmitFrame(uint32_t samples_ptr) = 0;
 
+  // The queue of the frames submitted by the client, if the driver has one.
+  virtual AudioFrameQueueDepth* queue_depth() { return nullptr; }
+
  protected:
   inline uint8_t* TranslatePhysical(uint32_t guest_address) const {
     return memory_->TranslatePhysical(guest_address);
@@ -13,6 +13,7 @@
 #include "xenia/apu/audio_driver.h"
 #include "xenia/apu/xma_decoder.h"
 #include "xenia/base/byte_stream.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
@@ -77,6 +78,8 @@ X_STATUS AudioSystem::Setup(kernel::KernelState* kernel_state) {
   worker_thread_->set_can_debugger_suspend(true);
   worker_thread_->set_name("Audio Worker");
   worker_thread_->Create();
+  xe::threading::ApplyThreadRole(worker_thread_->thread(),
+                                 xe::threading::ThreadRole::kAudio);
 
   return X_STATUS_SUCCESS;
 }
@@ -120,12 +123,16 @@ void AudioSystem::WorkerThreadMain() {
 
       if (client_callback) {
         SCOPE_profile_cpu_i("apu", "xe::apu::AudioSystem->client_callback");
+        uint64_t callback_start_time = Clock::QueryHostTickCount();
         uint64_t args[] = {client_callback_arg};
         processor_->Execute(worker_thread_->thread_state(), client_callback,
                             args, xe::countof(args));
+        client_callback_timing_[index].Record(HostTicksToMicroseconds(
+            Clock::QueryHostTickCount() - callback_start_time));
       }
 
       pumped = true;
+      MaybeLogTimingSummary();
     }
 
     if (!worker_running_) {
@@ -142,6 +149,40 @@ void AudioSystem::WorkerThreadMain() {
   // TODO(benvanik): call module API to kill?
 }
 
+void AudioSystem::MaybeLogTimingSummary() {
+  if (cvars::apu_timing_log_interval <= 0) {
+    return;
+  }
+  uint64_t time_ms = Clock::QueryHostUptimeMillis();
+  if (time_ms - timing_log_last_time_ms_ <
+      uint64_t(cvars::apu_timing_log_interval) * 1000) {
+    return;
+  }
+  timing_log_last_time_ms_ = time_ms;
+  xma_decoder_->LogTimingSummary();
+  auto global_lock = global_critical_region_.Acquire();
+  for (size_t i = 0; i < kMaximumClientCount; ++i) {
+    AudioTimingHistogram::Summary callback_summary =
+        client_callback_timing_[i].TakeSummary();
+    if (!clients_[i].in_use) {
+      continue;
+    }
+    XELOGI("Audio client {} guest callback: {}", i,
+           callback_summary.Format("us"));
+    AudioFrameQueueDepth* queue_depth =
+        clients_[i].driver ? clients_[i].driver->queue_depth() : nullptr;
+    if (!queue_depth) {
+      continue;
+    }
+    XELOGI("Audio client {} frame request to submission: {}", i,
+           queue_depth->request_to_submit_timing().TakeSummary().Format("us"));
+    XELOGI("Audio client {} queued frames on submission: {}", i,
+           queue_depth->queued_frames_on_submit().TakeSummary().Format(""));
+    XELOGI("Audio client {} queue depth {} frames, {} underruns in total", i,
+           queue_depth->depth(), queue_depth->underrun_count());
+  }
+}
+
 int AudioSystem::FindFreeClient() {
   for (int i = 0; i < kMaximumClientCount; i++) {
     auto& client = clients_[i];
@@ -172,7 +213,8 @@ X_STATUS AudioSystem::RegisterClient(uint32_t callback, uint32_t callback_arg,
   assert_true(index >= 0);
 
   auto client_semaphore = client_semaphores_[index].get();
-  auto ret = client_semaphore->Release(kMaximumQueuedFrames, nullptr);
+  auto ret = client_semaphore->Release(
+      int(AudioFrameQueueDepth::GetInitialDepth()), nullptr);
   assert_true(ret);
 
   AudioDriver* driver;
@@ -275,7 +317,8 @@ bool AudioSystem::Restore(ByteStream* stream) {
     client.in_use = true;
 
     auto client_semaphore = client_semaphores_[id].get();
-    auto ret = client_semaphore->Release(kMaximumQueuedFrames, nullptr);
+    auto ret = client_semaphore->Release(
+        int(AudioFrameQueueDepth::GetInitialDepth()), nullptr);
     assert_true(ret);
 
     AudioDriver* driver = nullptr;
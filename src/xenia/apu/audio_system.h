@@ -13,6 +13,7 @@
 #include <atomic>
 #include <queue>
 
+#include "xenia/apu/audio_timing.h"
 #include "xenia/base/mutex.h"
 #include "xenia/base/threading.h"
 #include "xenia/cpu/processor.h"
@@ -55,6 +56,9 @@ class AudioSystem {
   virtual void Initialize();
 
   void WorkerThreadMain();
+  // Logs the timing statistics if apu_timing_log_interval has passed since they
+  // were last logged.
+  void MaybeLogTimingSummary();
 
   virtual X_STATUS CreateDriver(size_t index,
                                 xe::threading::Semaphore* semaphore,
@@ -63,6 +67,8 @@ class AudioSystem {
 
   // TODO(gibbed): respect XAUDIO2_MAX_QUEUED_BUFFERS somehow (ie min(64,
   // XAUDIO2_MAX_QUEUED_BUFFERS))
+  // The number of frames actually allowed to be queued is controlled by each
+  // driver's AudioFrameQueueDepth, up to this.
   static const size_t kMaximumQueuedFrames = 64;
 
   Memory* memory_ = nullptr;
@@ -86,6 +92,9 @@ class AudioSystem {
 
   std::unique_ptr<xe::threading::Semaphore>
       client_semaphores_[kMaximumClientCount];
+  // Microseconds each guest callback took.
+  AudioTimingHistogram client_callback_timing_[kMaximumClientCount];
+  uint64_t timing_log_last_time_ms_ = 0;
   // Event is always there in case we have no clients.
   std::unique_ptr<xe::threading::Event> shutdown_event_;
   xe::threading::WaitHandle* wait_handles_[kMaximumClientCount + 1];
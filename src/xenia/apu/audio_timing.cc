@@ -0,0 +1,84 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/audio_timing.h"
+
+#include <algorithm>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/math.h"
+
+namespace xe {
+namespace apu {
+
+void AudioTimingHistogram::Summary::Add(const Summary& other) {
+  for (uint32_t i = 0; i < kBucketCount; ++i) {
+    buckets[i] += other.buckets[i];
+  }
+  count += other.count;
+  sum += other.sum;
+  max = std::max(max, other.max);
+}
+
+uint64_t AudioTimingHistogram::Summary::GetPercentileBound(
+    double percentile) const {
+  if (!count) {
+    return 0;
+  }
+  uint64_t rank = std::max(uint64_t(count * percentile + 0.5), uint64_t(1));
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < kBucketCount; ++i) {
+    seen += buckets[i];
+    if (seen >= rank) {
+      if (i + 1 >= kBucketCount) {
+        break;
+      }
+      return std::min(i ? (uint64_t(1) << i) - 1 : uint64_t(0), max);
+    }
+  }
+  return max;
+}
+
+std::string AudioTimingHistogram::Summary::Format(const char* unit) const {
+  return fmt::format("count={} mean={}{} p50<={}{} p99<={}{} max={}{}", count,
+                     count ? sum / count : 0, unit, GetPercentileBound(0.5),
+                     unit, GetPercentileBound(0.99), unit, max, unit);
+}
+
+void AudioTimingHistogram::Record(uint64_t value) {
+  uint32_t bucket =
+      std::min(uint32_t(64 - xe::lzcnt(value)), kBucketCount - 1);
+  buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+  uint64_t max = max_.load(std::memory_order_relaxed);
+  while (value > max && !max_.compare_exchange_weak(
+                            max, value, std::memory_order_relaxed)) {
+  }
+}
+
+AudioTimingHistogram::Summary AudioTimingHistogram::TakeSummary() {
+  Summary summary;
+  for (uint32_t i = 0; i < kBucketCount; ++i) {
+    summary.buckets[i] = buckets_[i].exchange(0, std::memory_order_relaxed);
+    summary.count += summary.buckets[i];
+  }
+  summary.sum = sum_.exchange(0, std::memory_order_relaxed);
+  summary.max = max_.exchange(0, std::memory_order_relaxed);
+  return summary;
+}
+
+uint64_t HostTicksToMicroseconds(uint64_t ticks) {
+  static const uint64_t frequency = Clock::QueryHostTickFrequency();
+  // Split to avoid overflowing for long durations.
+  return ticks / frequency * 1000000 + ticks % frequency * 1000000 / frequency;
+}
+
+}  // namespace apu
+}  // namespace xe
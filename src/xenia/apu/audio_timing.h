@@ -0,0 +1,58 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_APU_AUDIO_TIMING_H_
+#define XENIA_APU_AUDIO_TIMING_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace xe {
+namespace apu {
+
+// Histogram of values (usually durations in microseconds) with power-of-two
+// buckets, recorded without locking from any thread, for finding which part of
+// audio output is late when it crackles.
+class AudioTimingHistogram {
+ public:
+  // Bucket 0 is for 0, bucket i is for [2^(i-1), 2^i), the last one is for
+  // everything larger.
+  static const uint32_t kBucketCount = 32;
+
+  struct Summary {
+    uint64_t buckets[kBucketCount] = {};
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+
+    void Add(const Summary& other);
+    // Upper bound of the bucket containing the percentile (0 to 1).
+    uint64_t GetPercentileBound(double percentile) const;
+    // "count=N mean=M p50<=A p99<=B max=C" with the unit after each value.
+    std::string Format(const char* unit) const;
+  };
+
+  void Record(uint64_t value);
+  // Returns the values recorded since the previous call and starts over.
+  Summary TakeSummary();
+
+ private:
+  std::atomic<uint64_t> buckets_[kBucketCount] = {};
+  std::atomic<uint64_t> sum_ = {0};
+  std::atomic<uint64_t> max_ = {0};
+};
+
+// Converts a difference of Clock::QueryHostTickCount values to microseconds.
+uint64_t HostTicksToMicroseconds(uint64_t ticks);
+
+}  // namespace apu
+}  // namespace xe
+
+#endif  // XENIA_APU_AUDIO_TIMING_H_
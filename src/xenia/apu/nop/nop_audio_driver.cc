@@ -0,0 +1,29 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/nop/nop_audio_driver.h"
+
+namespace xe {
+namespace apu {
+namespace nop {
+
+NopAudioDriver::NopAudioDriver(Memory* memory,
+                               xe::threading::Semaphore* semaphore)
+    : AudioDriver(memory), queue_depth_(semaphore) {}
+
+NopAudioDriver::~NopAudioDriver() = default;
+
+void NopAudioDriver::SubmitFrame(uint32_t frame_ptr) {
+  queue_depth_.OnFrameSubmitted();
+  queue_depth_.OnFramePlayed();
+}
+
+}  // namespace nop
+}  // namespace apu
+}  // namespace xe
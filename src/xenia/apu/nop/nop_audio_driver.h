@@ -0,0 +1,38 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_APU_NOP_NOP_AUDIO_DRIVER_H_
+#define XENIA_APU_NOP_NOP_AUDIO_DRIVER_H_
+
+#include "xenia/apu/audio_driver.h"
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace apu {
+namespace nop {
+
+// Discards the frames as soon as they're submitted, giving their place in the
+// queue back to the guest right away, so the guest never waits for playback.
+class NopAudioDriver : public AudioDriver {
+ public:
+  NopAudioDriver(Memory* memory, xe::threading::Semaphore* semaphore);
+  ~NopAudioDriver() override;
+
+  void SubmitFrame(uint32_t frame_ptr) override;
+  AudioFrameQueueDepth* queue_depth() override { return &queue_depth_; }
+
+ private:
+  AudioFrameQueueDepth queue_depth_;
+};
+
+}  // namespace nop
+}  // namespace apu
+}  // namespace xe
+
+#endif  // XENIA_APU_NOP_NOP_AUDIO_DRIVER_H_
@@ -10,6 +10,8 @@
 #include "xenia/apu/nop/nop_audio_system.h"
 
 #include "xenia/apu/apu_flags.h"
+#include "xenia/apu/nop/nop_audio_driver.h"
+#include "xenia/kernel/kernel_flags.h"
 
 namespace xe {
 namespace apu {
@@ -27,10 +29,22 @@ NopAudioSystem::~NopAudioSystem() = default;
 X_STATUS NopAudioSystem::CreateDriver(size_t index,
                                       xe::threading::Semaphore* semaphore,
                                       AudioDriver** out_driver) {
-  return X_STATUS_NOT_IMPLEMENTED;
+  // Normally titles see no audio device, but when running unthrottled, they
+  // get one that consumes the audio instantly, so they don't wait for it.
+  if (!cvars::headless || !cvars::headless_unthrottled) {
+    return X_STATUS_NOT_IMPLEMENTED;
+  }
+  assert_not_null(out_driver);
+  *out_driver = new NopAudioDriver(memory(), semaphore);
+  return X_STATUS_SUCCESS;
 }
 
-void NopAudioSystem::DestroyDriver(AudioDriver* driver) { assert_always(); }
+void NopAudioSystem::DestroyDriver(AudioDriver* driver) {
+  assert_not_null(driver);
+  auto nop_driver = dynamic_cast<NopAudioDriver*>(driver);
+  assert_not_null(nop_driver);
+  delete nop_driver;
+}
 
 }  // namespace nop
 }  // namespace apu
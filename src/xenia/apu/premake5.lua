@@ -10,6 +10,7 @@ project("xenia-apu")
     "libavcodec",
     "libavutil",
     "xenia-base",
+    "xxhash",
   })
   defines({
   })
@@ -17,3 +18,33 @@ project("xenia-apu")
     project_root.."/third_party/libav/",
   })
   local_platform_files()
+
+group("tests")
+project("xenia-apu-xma-bench")
+  uuid("b3e1c7a4-92d6-4f08-a5c1-7d2e9f6b4a13")
+  kind("ConsoleApp")
+  language("C++")
+  links({
+    "fmt",
+    "libavcodec",
+    "libavutil",
+    "mspack",
+    "snappy",
+    "xenia-apu",
+    "xenia-base",
+    "xenia-core",
+    "xenia-cpu",
+    "xxhash",
+  })
+  includedirs({
+    project_root.."/third_party/libav/",
+  })
+  files({
+    "xma_bench_main.cc",
+    "../base/main_"..platform_suffix..".cc",
+  })
+  filter("platforms:Windows")
+    debugdir(project_root)
+
+    -- xenia-base needs this
+    links({"xenia-ui"})
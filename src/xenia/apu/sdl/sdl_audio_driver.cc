@@ -9,7 +9,9 @@
 
 #include "xenia/apu/sdl/sdl_audio_driver.h"
 
+#include <algorithm>
 #include <array>
+#include <cstring>
 
 #include "xenia/apu/apu_flags.h"
 #include "xenia/base/logging.h"
@@ -21,7 +23,7 @@ namespace sdl {
 
 SDLAudioDriver::SDLAudioDriver(Memory* memory,
                                xe::threading::Semaphore* semaphore)
-    : AudioDriver(memory), semaphore_(semaphore) {}
+    : AudioDriver(memory), semaphore_(semaphore), queue_depth_(semaphore) {}
 
 SDLAudioDriver::~SDLAudioDriver() {
   assert_true(frames_queued_.empty());
@@ -46,70 +48,141 @@ bool SDLAudioDriver::Initialize() {
   }
   sdl_initialized_ = true;
 
-  SDL_AudioCallback audio_callback = [](void* userdata, Uint8* stream,
-                                        int len) -> void {
-    assert_true(len == frame_size_);
-    const auto driver = static_cast<SDLAudioDriver*>(userdata);
-
-    std::unique_lock<std::mutex> guard(driver->frames_mutex_);
-    if (driver->frames_queued_.empty()) {
-      memset(stream, 0, len);
-    } else {
-      auto buffer = driver->frames_queued_.front();
-      driver->frames_queued_.pop();
-      if (cvars::mute) {
-        memset(stream, 0, len);
-      } else {
-        memcpy(stream, buffer, len);
-      }
-      driver->frames_unused_.push(buffer);
-
-      auto ret = driver->semaphore_->Release(1, nullptr);
-      assert_true(ret);
-    }
-  };
-
   SDL_AudioSpec wanted_spec = {};
   wanted_spec.freq = frame_frequency_;
   wanted_spec.format = AUDIO_F32;
   wanted_spec.channels = frame_channels_;
   wanted_spec.samples = channel_samples_;
-  wanted_spec.callback = audio_callback;
+  wanted_spec.callback = AudioCallback;
   wanted_spec.userdata = this;
-  sdl_device_id_ = SDL_OpenAudioDevice(nullptr, 0, &wanted_spec, nullptr, 0);
+  // Downmixing and resampling to what the device actually has is done here,
+  // with vector code, rather than by SDL's converters.
+  SDL_AudioSpec obtained_spec;
+  sdl_device_id_ = SDL_OpenAudioDevice(
+      nullptr, 0, &wanted_spec, &obtained_spec,
+      SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE);
+  if (sdl_device_id_ > 0 && obtained_spec.channels != frame_channels_ &&
+      obtained_spec.channels != 2) {
+    // Other layouts are left to SDL.
+    SDL_CloseAudioDevice(sdl_device_id_);
+    sdl_device_id_ = SDL_OpenAudioDevice(
+        nullptr, 0, &wanted_spec, &obtained_spec,
+        SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+  }
   if (sdl_device_id_ <= 0) {
     XELOGE("SDL_OpenAudioDevice() failed.");
     return false;
   }
+
+  host_channels_ = obtained_spec.channels;
+  uint32_t host_channel_samples = channel_samples_;
+  resampling_ = uint32_t(obtained_spec.freq) != frame_frequency_;
+  if (resampling_) {
+    if (!resampler_.Initialize(frame_frequency_, uint32_t(obtained_spec.freq),
+                               host_channels_)) {
+      XELOGE("SDL audio: Unsupported device sample rate {}",
+             obtained_spec.freq);
+      SDL_CloseAudioDevice(sdl_device_id_);
+      sdl_device_id_ = -1;
+      return false;
+    }
+    host_channel_samples = resampler_.GetMaxOutputSamples(channel_samples_);
+    resampled_channel_stride_ = host_channel_samples;
+    resampled_frame_.resize(host_channels_ * host_channel_samples);
+  }
+  frame_capacity_ = host_channels_ * host_channel_samples;
+  swapped_frame_.resize(frame_channels_ * channel_samples_);
+  if (host_channels_ != frame_channels_) {
+    downmixed_frame_.resize(host_channels_ * channel_samples_);
+  }
+  XELOGI("SDL audio: {} channels at {} Hz{}{}", host_channels_,
+         obtained_spec.freq,
+         host_channels_ != frame_channels_ ? ", downmixed" : "",
+         resampling_ ? ", resampled" : "");
+
   SDL_PauseAudioDevice(sdl_device_id_, 0);
 
   return true;
 }
 
+void SDLAudioDriver::AudioCallback(void* userdata, Uint8* stream, int len) {
+  const auto driver = static_cast<SDLAudioDriver*>(userdata);
+  auto output = reinterpret_cast<float*>(stream);
+  uint32_t remaining = uint32_t(len) / sizeof(float);
+  uint32_t frames_played = 0;
+
+  {
+    std::unique_lock<std::mutex> guard(driver->frames_mutex_);
+    // Device buffers don't match the frames when resampling, so frames may be
+    // played across multiple callbacks.
+    while (remaining && !driver->frames_queued_.empty()) {
+      const Frame& frame = driver->frames_queued_.front();
+      uint32_t count = std::min(
+          remaining, frame.sample_count - driver->frame_played_samples_);
+      if (cvars::mute) {
+        std::memset(output, 0, sizeof(float) * count);
+      } else {
+        std::memcpy(output, frame.samples + driver->frame_played_samples_,
+                    sizeof(float) * count);
+      }
+      output += count;
+      remaining -= count;
+      driver->frame_played_samples_ += count;
+      if (driver->frame_played_samples_ >= frame.sample_count) {
+        driver->frames_unused_.push(frame.samples);
+        driver->frames_queued_.pop();
+        driver->frame_played_samples_ = 0;
+        ++frames_played;
+      }
+    }
+  }
+  if (remaining) {
+    std::memset(output, 0, sizeof(float) * remaining);
+  }
+
+  for (uint32_t i = 0; i < frames_played; ++i) {
+    driver->queue_depth_.OnFramePlayed();
+  }
+}
+
 void SDLAudioDriver::SubmitFrame(uint32_t frame_ptr) {
-  const auto input_frame = memory_->TranslateVirtual<float*>(frame_ptr);
   float* output_frame;
   {
     std::unique_lock<std::mutex> guard(frames_mutex_);
     if (frames_unused_.empty()) {
-      output_frame = new float[frame_samples_];
+      output_frame = new float[frame_capacity_];
     } else {
       output_frame = frames_unused_.top();
       frames_unused_.pop();
     }
   }
 
-  // interleave the data
-  for (size_t index = 0, o = 0; index < channel_samples_; ++index) {
-    for (size_t channel = 0, table = 0; channel < frame_channels_;
-         ++channel, table += channel_samples_) {
-      output_frame[o++] = xe::byte_swap(input_frame[table + index]);
-    }
+  // Sequential big-endian guest channels to interleaved host channels.
+  conversion::SwapGuestFrame(
+      swapped_frame_.data(), memory_->TranslateVirtual<float*>(frame_ptr));
+  const float* channels = swapped_frame_.data();
+  if (host_channels_ != frame_channels_) {
+    conversion::Downmix6To2(downmixed_frame_.data(), channel_samples_, channels,
+                            channel_samples_, channel_samples_);
+    channels = downmixed_frame_.data();
+  }
+  uint32_t channel_stride = channel_samples_;
+  uint32_t host_channel_samples = channel_samples_;
+  if (resampling_) {
+    host_channel_samples = resampler_.Resample(
+        resampled_frame_.data(), resampled_channel_stride_, channels,
+        channel_samples_, channel_samples_);
+    channels = resampled_frame_.data();
+    channel_stride = resampled_channel_stride_;
   }
+  conversion::Interleave(output_frame, channels, channel_stride,
+                         host_channels_, host_channel_samples);
 
   {
+    // Before the frame can be played.
+    queue_depth_.OnFrameSubmitted();
     std::unique_lock<std::mutex> guard(frames_mutex_);
-    frames_queued_.push(output_frame);
+    frames_queued_.push({output_frame, host_channels_ * host_channel_samples});
   }
 }
 
@@ -128,9 +201,10 @@ void SDLAudioDriver::Shutdown() {
     frames_unused_.pop();
   };
   while (!frames_queued_.empty()) {
-    delete[] frames_queued_.front();
+    delete[] frames_queued_.front().samples;
     frames_queued_.pop();
   };
+  frame_played_samples_ = 0;
 }
 
 }  // namespace sdl
@@ -13,8 +13,10 @@
 #include <mutex>
 #include <queue>
 #include <stack>
+#include <vector>
 
 #include "SDL.h"
+#include "xenia/apu/audio_conversion.h"
 #include "xenia/apu/audio_driver.h"
 #include "xenia/base/threading.h"
 
@@ -29,10 +31,21 @@ class SDLAudioDriver : public AudioDriver {
 
   bool Initialize();
   void SubmitFrame(uint32_t frame_ptr) override;
+  AudioFrameQueueDepth* queue_depth() override { return &queue_depth_; }
   void Shutdown();
 
  protected:
   xe::threading::Semaphore* semaphore_ = nullptr;
+  AudioFrameQueueDepth queue_depth_;
+
+  // Converted frame ready to be played.
+  struct Frame {
+    float* samples;
+    // Interleaved samples of all channels.
+    uint32_t sample_count;
+  };
+
+  static void AudioCallback(void* userdata, Uint8* stream, int len);
 
   SDL_AudioDeviceID sdl_device_id_ = -1;
   bool sdl_initialized_ = false;
@@ -40,9 +53,24 @@ class SDLAudioDriver : public AudioDriver {
   static const uint32_t frame_frequency_ = 48000;
   static const uint32_t frame_channels_ = 6;
   static const uint32_t channel_samples_ = 256;
-  static const uint32_t frame_samples_ = frame_channels_ * channel_samples_;
-  static const uint32_t frame_size_ = sizeof(float) * frame_samples_;
-  std::queue<float*> frames_queued_ = {};
+
+  // The host format, chosen when opening the device: 6 or 2 channels, at the
+  // guest rate or resampled to the device rate.
+  uint32_t host_channels_ = frame_channels_;
+  bool resampling_ = false;
+  conversion::PolyphaseResampler resampler_;
+  // Floats in every frame buffer.
+  uint32_t frame_capacity_ = 0;
+  // Guest frame swapped to host endianness, and downmixed or resampled data,
+  // as sequential channels.
+  std::vector<float> swapped_frame_;
+  std::vector<float> downmixed_frame_;
+  std::vector<float> resampled_frame_;
+  uint32_t resampled_channel_stride_ = 0;
+
+  std::queue<Frame> frames_queued_ = {};
+  // Samples of the first queued frame already played.
+  uint32_t frame_played_samples_ = 0;
   std::stack<float*> frames_unused_ = {};
   std::mutex frames_mutex_ = {};
 };
@@ -13,6 +13,7 @@
 #include "xenia/base/platform_win.h"
 
 #include "xenia/apu/apu_flags.h"
+#include "xenia/apu/audio_conversion.h"
 #include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 
@@ -22,35 +23,32 @@ namespace xaudio2 {
 
 class XAudio2AudioDriver::VoiceCallback : public api::IXAudio2VoiceCallback {
  public:
-  explicit VoiceCallback(xe::threading::Semaphore* semaphore)
-      : semaphore_(semaphore) {}
+  explicit VoiceCallback(AudioFrameQueueDepth* queue_depth)
+      : queue_depth_(queue_depth) {}
   ~VoiceCallback() {}
 
   void OnStreamEnd() {}
   void OnVoiceProcessingPassEnd() {}
   void OnVoiceProcessingPassStart(uint32_t samples_required) {}
-  void OnBufferEnd(void* context) {
-    auto ret = semaphore_->Release(1, nullptr);
-    assert_true(ret);
-  }
+  void OnBufferEnd(void* context) { queue_depth_->OnFramePlayed(); }
   void OnBufferStart(void* context) {}
   void OnLoopEnd(void* context) {}
   void OnVoiceError(void* context, HRESULT result) {}
 
  private:
-  xe::threading::Semaphore* semaphore_ = nullptr;
+  AudioFrameQueueDepth* queue_depth_ = nullptr;
 };
 
 XAudio2AudioDriver::XAudio2AudioDriver(Memory* memory,
                                        xe::threading::Semaphore* semaphore)
-    : AudioDriver(memory), semaphore_(semaphore) {}
+    : AudioDriver(memory), semaphore_(semaphore), queue_depth_(semaphore) {}
 
 XAudio2AudioDriver::~XAudio2AudioDriver() = default;
 
 bool XAudio2AudioDriver::Initialize() {
   HRESULT hr;
 
-  voice_callback_ = new VoiceCallback(semaphore_);
+  voice_callback_ = new VoiceCallback(&queue_depth_);
 
   // Load the XAudio2 DLL dynamically. Needed both for 2.7 and for
   // differentiating between 2.8 and later versions. Windows 8.1 SDK references
@@ -203,17 +201,14 @@ void XAudio2AudioDriver::SubmitFrame(uint32_t frame_ptr) {
   }
   assert_true(state.BuffersQueued < frame_count_);
 
-  auto input_frame = memory_->TranslateVirtual<float*>(frame_ptr);
   auto output_frame = reinterpret_cast<float*>(frames_[current_frame_]);
-  auto interleave_channels = frame_channels_;
 
-  // interleave the data
-  for (uint32_t index = 0, o = 0; index < channel_samples_; ++index) {
-    for (uint32_t channel = 0, table = 0; channel < interleave_channels;
-         ++channel, table += channel_samples_) {
-      output_frame[o++] = xe::byte_swap(input_frame[table + index]);
-    }
-  }
+  // Interleave the data. Downmixing and resampling to the device format are
+  // done by the mastering voice.
+  conversion::SwapGuestFrame(swapped_frame_,
+                             memory_->TranslateVirtual<float*>(frame_ptr));
+  conversion::Interleave(output_frame, swapped_frame_, channel_samples_,
+                         frame_channels_, channel_samples_);
 
   api::XAUDIO2_BUFFER buffer;
   buffer.Flags = 0;
@@ -225,6 +220,8 @@ void XAudio2AudioDriver::SubmitFrame(uint32_t frame_ptr) {
   buffer.LoopLength = 0;
   buffer.LoopCount = 0;
   buffer.pContext = 0;
+  // Before the buffer can be played.
+  queue_depth_.OnFrameSubmitted();
   if (api_minor_version_ >= 8) {
     hr = objects_.api_2_8.pcm_voice->SubmitSourceBuffer(&buffer);
   } else {
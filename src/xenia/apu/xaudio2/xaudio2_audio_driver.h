@@ -29,6 +29,7 @@ class XAudio2AudioDriver : public AudioDriver {
 
   bool Initialize();
   void SubmitFrame(uint32_t frame_ptr) override;
+  AudioFrameQueueDepth* queue_depth() override { return &queue_depth_; }
   void Shutdown();
 
  private:
@@ -52,6 +53,7 @@ class XAudio2AudioDriver : public AudioDriver {
     } api_2_8;
   } objects_ = {};
   xe::threading::Semaphore* semaphore_ = nullptr;
+  AudioFrameQueueDepth queue_depth_;
 
   class VoiceCallback;
   VoiceCallback* voice_callback_ = nullptr;
@@ -62,6 +64,7 @@ class XAudio2AudioDriver : public AudioDriver {
   static const uint32_t frame_samples_ = frame_channels_ * channel_samples_;
   static const uint32_t frame_size_ = sizeof(float) * frame_samples_;
   float frames_[frame_count_][frame_samples_];
+  float swapped_frame_[frame_samples_];
   uint32_t current_frame_ = 0;
 };
 
@@ -0,0 +1,291 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "xenia/apu/audio_timing.h"
+#include "xenia/apu/xma_context.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/main.h"
+#include "xenia/memory.h"
+
+DEFINE_transient_path(xma_bench_input, "",
+                      "XMA context dump written with --xma_dump_path, or a "
+                      "directory of them to replay one after another.",
+                      "APU");
+DEFINE_int32(xma_bench_repeat, 10,
+             "Number of times to replay every dump. The first replay is "
+             "included in the results.",
+             "APU");
+
+// Counts the allocations made through operator new so that regressions adding
+// allocations to the decode loop are visible. Allocations made by libav with
+// av_malloc are not counted.
+namespace {
+std::atomic<uint64_t> allocation_count_ = {0};
+}  // namespace
+
+void* operator new(size_t size) {
+  allocation_count_.fetch_add(1, std::memory_order_relaxed);
+  void* ptr = std::malloc(size ? size : 1);
+  if (!ptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t size) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t size) noexcept { std::free(ptr); }
+
+namespace xe {
+namespace apu {
+namespace bench {
+
+struct DumpRecord {
+  XmaContextDumpRecord header;
+  std::vector<uint8_t> input_buffer_0;
+  std::vector<uint8_t> input_buffer_1;
+};
+
+bool LoadDump(const std::filesystem::path& path,
+              std::vector<DumpRecord>& records_out) {
+  records_out.clear();
+  FILE* file = xe::filesystem::OpenFile(path, "rb");
+  if (!file) {
+    XELOGE("Unable to open {}", xe::path_to_utf8(path));
+    return false;
+  }
+  while (true) {
+    DumpRecord record;
+    if (fread(&record.header, sizeof(record.header), 1, file) != 1) {
+      break;
+    }
+    if (record.header.magic != XmaContextDumpRecord::kMagic) {
+      XELOGE("{} is not an XMA context dump", xe::path_to_utf8(path));
+      fclose(file);
+      return false;
+    }
+    record.input_buffer_0.resize(record.header.input_buffer_0_size);
+    record.input_buffer_1.resize(record.header.input_buffer_1_size);
+    if ((!record.input_buffer_0.empty() &&
+         fread(record.input_buffer_0.data(), record.input_buffer_0.size(), 1,
+               file) != 1) ||
+        (!record.input_buffer_1.empty() &&
+         fread(record.input_buffer_1.data(), record.input_buffer_1.size(), 1,
+               file) != 1)) {
+      XELOGW("{} is truncated", xe::path_to_utf8(path));
+      break;
+    }
+    records_out.push_back(std::move(record));
+  }
+  fclose(file);
+  return true;
+}
+
+// Number of packets the read offset has moved by during a decode.
+uint32_t GetPacketsAdvanced(const XMA_CONTEXT_DATA& before,
+                            const XMA_CONTEXT_DATA& after) {
+  const uint32_t kBitsPerPacket = XmaContext::kBytesPerPacket * 8;
+  uint32_t packet_before = before.input_buffer_read_offset / kBitsPerPacket;
+  uint32_t packet_after = after.input_buffer_read_offset / kBitsPerPacket;
+  if (before.current_buffer == after.current_buffer) {
+    return packet_after > packet_before ? packet_after - packet_before : 0;
+  }
+  uint32_t packet_count = before.current_buffer
+                              ? before.input_buffer_1_packet_count
+                              : before.input_buffer_0_packet_count;
+  return (packet_count > packet_before ? packet_count - packet_before : 0) +
+         packet_after;
+}
+
+struct Results {
+  uint64_t host_ticks = 0;
+  uint64_t samples = 0;
+  uint64_t packets = 0;
+  uint64_t allocations = 0;
+  AudioTimingHistogram::Summary frame_timing;
+
+  void Add(const Results& other) {
+    host_ticks += other.host_ticks;
+    samples += other.samples;
+    packets += other.packets;
+    allocations += other.allocations;
+    frame_timing.Add(other.frame_timing);
+  }
+
+  void Log(const std::string& name) const {
+    double seconds =
+        double(host_ticks) / double(Clock::QueryHostTickFrequency());
+    XELOGI("{}:", name);
+    XELOGI("  {:.0f} samples/s, {:.2f} us/packet, {:.2f} allocations/frame",
+           seconds > 0.0 ? double(samples) / seconds : 0.0,
+           packets ? seconds * 1000000.0 / double(packets) : 0.0,
+           frame_timing.count
+               ? double(allocations) / double(frame_timing.count)
+               : 0.0);
+    XELOGI("  frames: {}", frame_timing.Format("us"));
+  }
+};
+
+class BenchRunner {
+ public:
+  bool Setup() {
+    memory_.reset(new Memory());
+    if (!memory_->Initialize()) {
+      XELOGE("Unable to initialize the guest memory");
+      return false;
+    }
+    context_ptr_ = memory_->SystemHeapAlloc(sizeof(XMA_CONTEXT_DATA), 256,
+                                            kSystemHeapPhysical);
+    output_ptr_ = memory_->SystemHeapAlloc(XmaContext::kOutputMaxSizeBytes,
+                                           256, kSystemHeapPhysical);
+    return context_ptr_ && output_ptr_;
+  }
+
+  bool Run(const std::vector<DumpRecord>& records, Results& results_out) {
+    // Input buffers of the largest size in the dump, reused by all records.
+    uint32_t input_buffer_sizes[2] = {};
+    for (const DumpRecord& record : records) {
+      input_buffer_sizes[0] =
+          std::max(input_buffer_sizes[0], record.header.input_buffer_0_size);
+      input_buffer_sizes[1] =
+          std::max(input_buffer_sizes[1], record.header.input_buffer_1_size);
+    }
+    uint32_t input_buffer_ptrs[2] = {};
+    for (uint32_t i = 0; i < 2; ++i) {
+      if (input_buffer_sizes[i]) {
+        input_buffer_ptrs[i] = memory_->SystemHeapAlloc(
+            input_buffer_sizes[i], 4096, kSystemHeapPhysical);
+        if (!input_buffer_ptrs[i]) {
+          XELOGE("Unable to allocate a {} byte input buffer",
+                 input_buffer_sizes[i]);
+          return false;
+        }
+      }
+    }
+
+    // A fresh context per replay, as after an allocation by the title.
+    XmaContext context;
+    if (context.Setup(0, memory_.get(), context_ptr_)) {
+      XELOGE("Unable to set up the XMA context");
+      return false;
+    }
+    context.set_is_allocated(true);
+    uint8_t* context_data = memory_->TranslateVirtual(context_ptr_);
+    Results results;
+    for (const DumpRecord& record : records) {
+      if (record.header.input_buffer_0_size) {
+        std::memcpy(memory_->TranslateVirtual(input_buffer_ptrs[0]),
+                    record.input_buffer_0.data(),
+                    record.input_buffer_0.size());
+      }
+      if (record.header.input_buffer_1_size) {
+        std::memcpy(memory_->TranslateVirtual(input_buffer_ptrs[1]),
+                    record.input_buffer_1.data(),
+                    record.input_buffer_1.size());
+      }
+      XMA_CONTEXT_DATA data(record.header.context_data);
+      data.input_buffer_0_ptr =
+          memory_->GetPhysicalAddress(input_buffer_ptrs[0]);
+      data.input_buffer_1_ptr =
+          memory_->GetPhysicalAddress(input_buffer_ptrs[1]);
+      data.output_buffer_ptr = memory_->GetPhysicalAddress(output_ptr_);
+      data.Store(context_data);
+      context.set_is_enabled(true);
+
+      uint64_t allocations_before = allocation_count_;
+      uint64_t start = Clock::QueryHostTickCount();
+      context.Work();
+      results.host_ticks += Clock::QueryHostTickCount() - start;
+      results.allocations += allocation_count_ - allocations_before;
+
+      XMA_CONTEXT_DATA data_after(context_data);
+      results.packets += GetPacketsAdvanced(data, data_after);
+    }
+    context.set_is_allocated(false);
+    results.frame_timing = context.decode_timing().TakeSummary();
+    results.samples = results.frame_timing.count * XmaContext::kSamplesPerFrame;
+
+    for (uint32_t i = 0; i < 2; ++i) {
+      if (input_buffer_ptrs[i]) {
+        memory_->SystemHeapFree(input_buffer_ptrs[i]);
+      }
+    }
+    results_out.Add(results);
+    return true;
+  }
+
+ private:
+  std::unique_ptr<Memory> memory_;
+  uint32_t context_ptr_ = 0;
+  uint32_t output_ptr_ = 0;
+};
+
+int main(const std::vector<std::string>& args) {
+  if (cvars::xma_bench_input.empty()) {
+    XELOGE("No dump specified, use --xma_dump_path to capture one");
+    return 1;
+  }
+  std::vector<std::filesystem::path> paths;
+  if (std::filesystem::is_directory(cvars::xma_bench_input)) {
+    for (const auto& entry :
+         std::filesystem::directory_iterator(cvars::xma_bench_input)) {
+      if (entry.is_regular_file() && entry.path().extension() == ".bin") {
+        paths.push_back(entry.path());
+      }
+    }
+    std::sort(paths.begin(), paths.end());
+  } else {
+    paths.push_back(cvars::xma_bench_input);
+  }
+
+  BenchRunner runner;
+  if (!runner.Setup()) {
+    return 1;
+  }
+  Results total_results;
+  std::vector<DumpRecord> records;
+  for (const auto& path : paths) {
+    if (!LoadDump(path, records) || records.empty()) {
+      continue;
+    }
+    Results results;
+    for (int32_t i = 0; i < std::max(cvars::xma_bench_repeat, 1); ++i) {
+      if (!runner.Run(records, results)) {
+        return 1;
+      }
+    }
+    results.Log(xe::path_to_utf8(path.filename()));
+    total_results.Add(results);
+  }
+  if (paths.size() > 1) {
+    total_results.Log("Total");
+  }
+  return total_results.frame_timing.count ? 0 : 1;
+}
+
+}  // namespace bench
+}  // namespace apu
+}  // namespace xe
+
+DEFINE_ENTRY_POINT("xenia-apu-xma-bench", xe::apu::bench::main, "[dump]",
+                   "xma_bench_input");
@@ -11,13 +11,32 @@
 
 #include <algorithm>
 #include <cstring>
+#include <list>
+#include <unordered_map>
 
 #include "xenia/apu/xma_decoder.h"
 #include "xenia/apu/xma_helpers.h"
 #include "xenia/base/bit_stream.h"
+#include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/platform.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/ring_buffer.h"
+#include "third_party/fmt/include/fmt/format.h"
+#include "third_party/xxhash/xxhash.h"
+
+#if XE_ARCH_AMD64
+#if XE_COMPILER_MSVC
+#include <intrin.h>
+#define XE_TARGET_AVX2
+#else
+#include <immintrin.h>
+#define XE_TARGET_AVX2 __attribute__((target("avx2")))
+#endif  // XE_COMPILER_MSVC
+#endif  // XE_ARCH_AMD64
 
 extern "C" {
 #include "third_party/libav/libavcodec/avcodec.h"
@@ -30,9 +49,232 @@ extern AVCodec ff_xma2_decoder;
 // Credits for most of this code goes to:
 // https://github.com/koolkdev/libertyv/blob/master/libav_wrapper/xma2dec.c
 
+DEFINE_int32(xma_decoded_frame_cache_size, 0,
+             "Size of the cache of decoded XMA frames shared by all contexts, "
+             "in megabytes, so looping music and ambience don't have to be "
+             "decoded again every time they repeat. 0 to disable.",
+             "APU");
+DEFINE_path(xma_dump_path, "",
+            "Directory to write the context data and the input buffers of "
+            "every XMA context to each time it's decoded, one file per "
+            "allocation, for replaying in xenia-apu-xma-bench.",
+            "APU");
+
 namespace xe {
 namespace apu {
 
+namespace {
+
+// Converts a sample from a [-1, 1] float to a big-endian 16-bit integer.
+inline uint16_t ConvertSample(float sample) {
+  float scaled_sample = xe::saturate(sample) * ((1 << 15) - 1);
+  return xe::byte_swap(uint16_t(static_cast<int>(scaled_sample)));
+}
+
+// Converts and interleaves samples [first_sample, num_samples) of all channels.
+void ConvertSamplesScalar(const float* const* samples, int num_channels,
+                          int first_sample, int num_samples,
+                          uint16_t* output) {
+  output += first_sample * num_channels;
+  for (int i = first_sample; i < num_samples; ++i) {
+    for (int j = 0; j < num_channels; ++j) {
+      *(output++) = ConvertSample(samples[j][i]);
+    }
+  }
+}
+
+#if XE_ARCH_AMD64
+
+// The vector paths produce the same results as ConvertSample - clamping before
+// scaling with the same multiplication, truncating toward zero, and packing
+// with signed saturation, which never clamps anything after that.
+
+inline __m128i ScaleSamplesSSE2(__m128 samples) {
+  samples = _mm_max_ps(_mm_min_ps(samples, _mm_set1_ps(1.0f)),
+                       _mm_set1_ps(-1.0f));
+  return _mm_cvttps_epi32(_mm_mul_ps(samples, _mm_set1_ps(32767.0f)));
+}
+
+inline __m128i SwapSamplesSSE2(__m128i samples) {
+  return _mm_or_si128(_mm_slli_epi16(samples, 8), _mm_srli_epi16(samples, 8));
+}
+
+// Returns the number of samples converted, a multiple of 8, the rest is left
+// to the scalar path.
+int ConvertSamplesSSE2(const float* const* samples, int num_channels,
+                       int num_samples, uint16_t* output) {
+  int i = 0;
+  auto output_vector = reinterpret_cast<__m128i*>(output);
+  if (num_channels == 1) {
+    const float* channel = samples[0];
+    for (; i + 8 <= num_samples; i += 8) {
+      __m128i low = ScaleSamplesSSE2(_mm_loadu_ps(channel + i));
+      __m128i high = ScaleSamplesSSE2(_mm_loadu_ps(channel + i + 4));
+      _mm_storeu_si128(output_vector++,
+                       SwapSamplesSSE2(_mm_packs_epi32(low, high)));
+    }
+  } else if (num_channels == 2) {
+    const float* left_channel = samples[0];
+    const float* right_channel = samples[1];
+    for (; i + 8 <= num_samples; i += 8) {
+      for (int j = 0; j < 8; j += 4) {
+        __m128i left = ScaleSamplesSSE2(_mm_loadu_ps(left_channel + i + j));
+        __m128i right = ScaleSamplesSSE2(_mm_loadu_ps(right_channel + i + j));
+        _mm_storeu_si128(output_vector++,
+                         SwapSamplesSSE2(_mm_packs_epi32(
+                             _mm_unpacklo_epi32(left, right),
+                             _mm_unpackhi_epi32(left, right))));
+      }
+    }
+  }
+  return i;
+}
+
+XE_TARGET_AVX2 inline __m256i ScaleSamplesAVX2(__m256 samples) {
+  samples = _mm256_max_ps(_mm256_min_ps(samples, _mm256_set1_ps(1.0f)),
+                          _mm256_set1_ps(-1.0f));
+  return _mm256_cvttps_epi32(_mm256_mul_ps(samples, _mm256_set1_ps(32767.0f)));
+}
+
+XE_TARGET_AVX2 inline __m256i SwapSamplesAVX2(__m256i samples) {
+  return _mm256_or_si256(_mm256_slli_epi16(samples, 8),
+                         _mm256_srli_epi16(samples, 8));
+}
+
+// Returns the number of samples converted, a multiple of 16.
+XE_TARGET_AVX2 int ConvertSamplesAVX2(const float* const* samples,
+                                      int num_channels, int num_samples,
+                                      uint16_t* output) {
+  int i = 0;
+  auto output_vector = reinterpret_cast<__m256i*>(output);
+  if (num_channels == 1) {
+    const float* channel = samples[0];
+    for (; i + 16 <= num_samples; i += 16) {
+      __m256i low = ScaleSamplesAVX2(_mm256_loadu_ps(channel + i));
+      __m256i high = ScaleSamplesAVX2(_mm256_loadu_ps(channel + i + 8));
+      // Packing works within 128-bit lanes, giving 0-3, 8-11, 4-7, 12-15.
+      _mm256_storeu_si256(
+          output_vector++,
+          SwapSamplesAVX2(_mm256_permute4x64_epi64(
+              _mm256_packs_epi32(low, high), _MM_SHUFFLE(3, 1, 2, 0))));
+    }
+  } else if (num_channels == 2) {
+    const float* left_channel = samples[0];
+    const float* right_channel = samples[1];
+    for (; i + 16 <= num_samples; i += 16) {
+      for (int j = 0; j < 16; j += 8) {
+        __m256i left = ScaleSamplesAVX2(_mm256_loadu_ps(left_channel + i + j));
+        __m256i right =
+            ScaleSamplesAVX2(_mm256_loadu_ps(right_channel + i + j));
+        // Unpacking and packing within 128-bit lanes keeps the interleaved
+        // pairs in order - 0-3 in the low lane, 4-7 in the high one.
+        _mm256_storeu_si256(output_vector++,
+                            SwapSamplesAVX2(_mm256_packs_epi32(
+                                _mm256_unpacklo_epi32(left, right),
+                                _mm256_unpackhi_epi32(left, right))));
+      }
+    }
+  }
+  return i;
+}
+
+bool IsAVX2Supported() {
+#if XE_COMPILER_MSVC
+  int registers[4];
+  __cpuid(registers, 0);
+  if (registers[0] < 7) {
+    return false;
+  }
+  __cpuid(registers, 1);
+  // The OS must save the YMM registers.
+  if (!(registers[2] & (1 << 27)) || (_xgetbv(0) & 0x6) != 0x6) {
+    return false;
+  }
+  __cpuidex(registers, 7, 0);
+  return (registers[1] & (1 << 5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif  // XE_COMPILER_MSVC
+}
+
+using ConvertSamplesVectorFunction = int (*)(const float* const* samples,
+                                             int num_channels, int num_samples,
+                                             uint16_t* output);
+const ConvertSamplesVectorFunction convert_samples_vector_ =
+    IsAVX2Supported() ? ConvertSamplesAVX2 : ConvertSamplesSSE2;
+
+#endif  // XE_ARCH_AMD64
+
+// Converted frames keyed by the hash of their input and of the input of the
+// frame decoded before them, with least recently used eviction.
+class DecodedFrameCache {
+ public:
+  static DecodedFrameCache& Get() {
+    static DecodedFrameCache cache;
+    return cache;
+  }
+
+  bool Lookup(uint64_t key, uint8_t* samples_out, size_t samples_size,
+              int& length_out, int& frame_size_out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = frame_map_.find(key);
+    if (it == frame_map_.end() ||
+        it->second->samples.size() != samples_size) {
+      return false;
+    }
+    frames_.splice(frames_.begin(), frames_, it->second);
+    const Frame& frame = *it->second;
+    std::memcpy(samples_out, frame.samples.data(), samples_size);
+    length_out = frame.length;
+    frame_size_out = frame.frame_size;
+    return true;
+  }
+
+  void Insert(uint64_t key, const uint8_t* samples, size_t samples_size,
+              int length, int frame_size) {
+    size_t max_size =
+        size_t(std::max(cvars::xma_decoded_frame_cache_size, 0)) << 20;
+    size_t entry_size = samples_size + kEntryOverhead;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entry_size > max_size || frame_map_.count(key)) {
+      return;
+    }
+    while (total_size_ + entry_size > max_size) {
+      const Frame& oldest = frames_.back();
+      total_size_ -= oldest.samples.size() + kEntryOverhead;
+      frame_map_.erase(oldest.key);
+      frames_.pop_back();
+    }
+    frames_.emplace_front();
+    Frame& frame = frames_.front();
+    frame.key = key;
+    frame.samples.assign(samples, samples + samples_size);
+    frame.length = length;
+    frame.frame_size = frame_size;
+    frame_map_.emplace(key, frames_.begin());
+    total_size_ += entry_size;
+  }
+
+ private:
+  // Approximate bookkeeping memory of an entry, counted towards the limit.
+  static constexpr size_t kEntryOverhead = 96;
+
+  struct Frame {
+    uint64_t key;
+    std::vector<uint8_t> samples;
+    int length;
+    int frame_size;
+  };
+
+  std::mutex mutex_;
+  // Most recently used first.
+  std::list<Frame> frames_;
+  std::unordered_map<uint64_t, std::list<Frame>::iterator> frame_map_;
+  size_t total_size_ = 0;
+};
+
+}  // namespace
+
 XmaContext::XmaContext() = default;
 
 XmaContext::~XmaContext() {
@@ -48,6 +290,9 @@ XmaContext::~XmaContext() {
   if (current_frame_) {
     delete[] current_frame_;
   }
+  if (dump_file_) {
+    fclose(dump_file_);
+  }
 }
 
 int XmaContext::Setup(uint32_t id, Memory* memory, uint32_t guest_ptr) {
@@ -99,6 +344,7 @@ int XmaContext::Setup(uint32_t id, Memory* memory, uint32_t guest_ptr) {
 }
 
 bool XmaContext::Work() {
+  SCOPE_profile_cpu_f("apu");
   std::lock_guard<std::mutex> lock(lock_);
   if (!is_allocated() || !is_enabled()) {
     return false;
@@ -108,6 +354,9 @@ bool XmaContext::Work() {
 
   auto context_ptr = memory()->TranslateVirtual(guest_ptr());
   XMA_CONTEXT_DATA data(context_ptr);
+  if (!cvars::xma_dump_path.empty()) {
+    DumpWork(context_ptr, data);
+  }
   DecodePackets(&data);
   data.Store(context_ptr);
   return true;
@@ -172,6 +421,48 @@ void XmaContext::Release() {
   set_is_allocated(false);
   auto context_ptr = memory()->TranslateVirtual(guest_ptr());
   std::memset(context_ptr, 0, sizeof(XMA_CONTEXT_DATA));  // Zero it.
+
+  if (dump_file_) {
+    fclose(dump_file_);
+    dump_file_ = nullptr;
+    ++dump_allocation_index_;
+  }
+}
+
+void XmaContext::DumpWork(const uint8_t* context_ptr,
+                          const XMA_CONTEXT_DATA& data) {
+  if (!dump_file_) {
+    auto path = cvars::xma_dump_path /
+                fmt::format("xma_context_{:03}_{:04}.bin", id(),
+                            dump_allocation_index_);
+    xe::filesystem::CreateParentFolder(path);
+    dump_file_ = xe::filesystem::OpenFile(path, "wb");
+    if (!dump_file_) {
+      XELOGE("XmaContext {}: failed to open {} for dumping", id(),
+             xe::path_to_utf8(path));
+      return;
+    }
+  }
+  XmaContextDumpRecord record = {};
+  record.magic = XmaContextDumpRecord::kMagic;
+  if (data.input_buffer_0_valid) {
+    record.input_buffer_0_size =
+        data.input_buffer_0_packet_count * kBytesPerPacket;
+  }
+  if (data.input_buffer_1_valid) {
+    record.input_buffer_1_size =
+        data.input_buffer_1_packet_count * kBytesPerPacket;
+  }
+  std::memcpy(record.context_data, context_ptr, sizeof(record.context_data));
+  fwrite(&record, sizeof(record), 1, dump_file_);
+  if (record.input_buffer_0_size) {
+    fwrite(memory()->TranslatePhysical(data.input_buffer_0_ptr),
+           record.input_buffer_0_size, 1, dump_file_);
+  }
+  if (record.input_buffer_1_size) {
+    fwrite(memory()->TranslatePhysical(data.input_buffer_1_ptr),
+           record.input_buffer_1_size, 1, dump_file_);
+  }
 }
 
 int XmaContext::GetSampleRate(int id) {
@@ -500,9 +791,49 @@ void XmaContext::DecodePackets(XMA_CONTEXT_DATA* data) {
     int invalid_frame = 0;  // invalid frame?
     int got_frame = 0;      // successfully decoded a frame?
     int frame_size = 0;
-    int len =
-        xma2_decode_frame(context_, packet_, decoded_frame_, &got_frame,
-                          &invalid_frame, &frame_size, !partial, bit_offset);
+    uint64_t decode_start_time = Clock::QueryHostTickCount();
+
+    // The output of a frame depends on the overlap with the previous one, so
+    // the previous frame is a part of the cache key.
+    uint64_t frame_input_hash = kFrameInputHashUnknown;
+    size_t frame_input_offset = 0, frame_input_size = 0;
+    uint64_t frame_cache_key = 0;
+    if (cvars::xma_decoded_frame_cache_size > 0 && !partial) {
+      frame_input_hash =
+          HashFrameInput(current_input_buffer, current_input_size, bit_offset,
+                         frame_input_offset, frame_input_size);
+      if (frame_input_hash != kFrameInputHashUnknown &&
+          previous_frame_input_hash_ != kFrameInputHashUnknown) {
+        uint64_t key_data[] = {
+            frame_input_hash, previous_frame_input_hash_,
+            uint64_t(data->sample_rate) | (uint64_t(num_channels) << 32)};
+        frame_cache_key = XXH64(key_data, sizeof(key_data), 0);
+      }
+    }
+    int len = 0;
+    bool frame_cached =
+        frame_cache_key &&
+        DecodedFrameCache::Get().Lookup(frame_cache_key, current_frame_,
+                                        kBytesPerFrame * num_channels, len,
+                                        frame_size);
+    if (frame_cached) {
+      got_frame = 1;
+      decoder_state_stale_ = true;
+    } else {
+      if (decoder_state_stale_) {
+        RestoreDecoderState();
+      }
+      len = xma2_decode_frame(context_, packet_, decoded_frame_, &got_frame,
+                              &invalid_frame, &frame_size, !partial,
+                              bit_offset);
+    }
+    previous_frame_input_hash_ = frame_input_hash;
+    if (frame_input_hash != kFrameInputHashUnknown) {
+      previous_frame_input_.assign(
+          current_input_buffer + frame_input_offset,
+          current_input_buffer + frame_input_offset + frame_input_size);
+      previous_frame_bit_offset_ = bit_offset - frame_input_offset * 8;
+    }
     if (!partial && len == 0) {
       // Got the last frame of a packet. Advance the read offset to the next
       // packet.
@@ -573,19 +904,30 @@ void XmaContext::DecodePackets(XMA_CONTEXT_DATA* data) {
       // Copy to the output buffer.
       size_t written_bytes = 0;
 
-      // Validity checks.
-      assert(decoded_frame_->nb_samples <= kSamplesPerFrame);
-      assert(context_->sample_fmt == AV_SAMPLE_FMT_FLTP);
-
-      // Check the returned buffer size.
-      assert(av_samples_get_buffer_size(NULL, context_->channels,
-                                        decoded_frame_->nb_samples,
-                                        context_->sample_fmt, 1) ==
-             context_->channels * decoded_frame_->nb_samples * sizeof(float));
-
-      // Convert the frame.
-      ConvertFrame((const uint8_t**)decoded_frame_->data, context_->channels,
-                   decoded_frame_->nb_samples, current_frame_);
+      if (!frame_cached) {
+        // Validity checks.
+        assert(decoded_frame_->nb_samples <= kSamplesPerFrame);
+        assert(context_->sample_fmt == AV_SAMPLE_FMT_FLTP);
+
+        // Check the returned buffer size.
+        assert(av_samples_get_buffer_size(NULL, context_->channels,
+                                          decoded_frame_->nb_samples,
+                                          context_->sample_fmt, 1) ==
+               context_->channels * decoded_frame_->nb_samples *
+                   sizeof(float));
+
+        // Convert the frame.
+        ConvertFrame((const uint8_t**)decoded_frame_->data,
+                     context_->channels, decoded_frame_->nb_samples,
+                     current_frame_);
+        if (frame_cache_key && len >= 0) {
+          DecodedFrameCache::Get().Insert(frame_cache_key, current_frame_,
+                                          kBytesPerFrame * num_channels, len,
+                                          frame_size);
+        }
+      }
+      decode_timing_.Record(HostTicksToMicroseconds(
+          Clock::QueryHostTickCount() - decode_start_time));
 
       assert_true(output_remaining_bytes >= kBytesPerFrame * num_channels);
       output_rb.Write(current_frame_, kBytesPerFrame * num_channels);
@@ -640,6 +982,11 @@ int XmaContext::PrepareDecoder(uint8_t* block, size_t size, int sample_rate,
       XELOGE("XmaContext: Failed to reopen libav context");
       return 1;
     }
+
+    // Nothing to overlap with in a freshly opened decoder.
+    previous_frame_input_hash_ = kFrameInputHashFreshDecoder;
+    previous_frame_input_.clear();
+    decoder_state_stale_ = false;
   }
 
   av_frame_unref(decoded_frame_);
@@ -647,28 +994,75 @@ int XmaContext::PrepareDecoder(uint8_t* block, size_t size, int sample_rate,
   return 0;
 }
 
+uint64_t XmaContext::HashFrameInput(uint8_t* block, size_t size,
+                                    size_t bit_offset, size_t& offset_out,
+                                    size_t& size_out) {
+  size_t packet_count = size / kBytesPerPacket;
+  size_t first_packet = bit_offset / (kBytesPerPacket * 8);
+  if (first_packet >= packet_count) {
+    return kFrameInputHashUnknown;
+  }
+  size_t hashed_packet_count =
+      std::min(packet_count - first_packet, size_t(2));
+  size_t packet_bit_offset = bit_offset - first_packet * kBytesPerPacket * 8;
+  BitStream stream(block, size * 8);
+  stream.SetOffset(bit_offset);
+  if (stream.BitsRemaining() < 15) {
+    return kFrameInputHashUnknown;
+  }
+  size_t frame_size_bits = size_t(stream.Read(15));
+  // The frame, the size of the next one and the packet headers must all be
+  // within the hashed packets for the hash to cover everything the decoder
+  // reads.
+  if (packet_bit_offset + frame_size_bits + 15 + 32 * hashed_packet_count >
+      hashed_packet_count * kBytesPerPacket * 8) {
+    return kFrameInputHashUnknown;
+  }
+  offset_out = first_packet * kBytesPerPacket;
+  size_out = hashed_packet_count * kBytesPerPacket;
+  uint64_t hash = XXH64(block + offset_out, size_out, packet_bit_offset);
+  // Keep the special values for special cases.
+  if (hash <= kFrameInputHashUnknown) {
+    hash += kFrameInputHashUnknown + 1;
+  }
+  return hash;
+}
+
+void XmaContext::RestoreDecoderState() {
+  decoder_state_stale_ = false;
+  if (previous_frame_input_.empty()) {
+    return;
+  }
+  // Decode the previous frame again, discarding the output, so the decoder
+  // has the overlap with it as if the frames from the cache were decoded.
+  uint8_t* data = packet_->data;
+  int size = packet_->size;
+  packet_->data = previous_frame_input_.data();
+  packet_->size = int(previous_frame_input_.size());
+  int got_frame = 0, invalid_frame = 0, frame_size = 0;
+  xma2_decode_frame(context_, packet_, decoded_frame_, &got_frame,
+                    &invalid_frame, &frame_size, true,
+                    previous_frame_bit_offset_);
+  av_frame_unref(decoded_frame_);
+  packet_->data = data;
+  packet_->size = size;
+}
+
 bool XmaContext::ConvertFrame(const uint8_t** samples, int num_channels,
                               int num_samples, uint8_t* output_buffer) {
-  // Loop through every sample, convert and drop it into the output array.
-  // If more than one channel, we need to interleave the samples from each
-  // channel next to each other.
-  // TODO: This can definitely be optimized with AVX/SSE intrinsics!
-  uint32_t o = 0;
-  for (int i = 0; i < num_samples; i++) {
-    for (int j = 0; j < num_channels; j++) {
-      // Select the appropriate array based on the current channel.
-      auto sample_array = reinterpret_cast<const float*>(samples[j]);
-
-      // Raw sample should be within [-1, 1].
-      // Clamp it, just in case.
-      float raw_sample = xe::saturate(sample_array[i]);
-
-      // Convert the sample and output it in big endian.
-      float scaled_sample = raw_sample * ((1 << 15) - 1);
-      int sample = static_cast<int>(scaled_sample);
-      xe::store_and_swap<uint16_t>(&output_buffer[o++ * 2], sample & 0xFFFF);
-    }
-  }
+  // Convert every sample to big-endian 16-bit and drop it into the output
+  // array. If more than one channel, we need to interleave the samples from
+  // each channel next to each other.
+  auto channel_samples = reinterpret_cast<const float* const*>(samples);
+  auto output = reinterpret_cast<uint16_t*>(output_buffer);
+  int first_scalar_sample = 0;
+#if XE_ARCH_AMD64
+  first_scalar_sample =
+      convert_samples_vector_(channel_samples, num_channels, num_samples,
+                              output);
+#endif  // XE_ARCH_AMD64
+  ConvertSamplesScalar(channel_samples, num_channels, first_scalar_sample,
+                       num_samples, output);
 
   return true;
 }
@@ -11,10 +11,12 @@
 #define XENIA_APU_XMA_CONTEXT_H_
 
 #include <atomic>
+#include <cstdio>
 #include <mutex>
 #include <queue>
 #include <vector>
 
+#include "xenia/apu/audio_timing.h"
 #include "xenia/memory.h"
 #include "xenia/xbox.h"
 
@@ -131,6 +133,20 @@ struct WmaProExtraData {
 static_assert_size(WmaProExtraData, 18);
 #pragma pack(pop)
 
+// Record written to XMA context dumps (see the xma_dump_path cvar) every time
+// a context is worked on, followed by the input buffers that are valid. Host
+// byte order except for the context data, which is stored as in guest memory.
+struct XmaContextDumpRecord {
+  static const uint32_t kMagic = 0x44414D58;  // 'XMAD'
+
+  uint32_t magic;
+  uint32_t input_buffer_0_size;
+  uint32_t input_buffer_1_size;
+  uint32_t reserved;
+  uint8_t context_data[sizeof(XMA_CONTEXT_DATA)];
+};
+static_assert_size(XmaContextDumpRecord, 80);
+
 class XmaContext {
  public:
   static const uint32_t kBytesPerPacket = 2048;
@@ -167,6 +183,9 @@ class XmaContext {
   void set_is_allocated(bool is_allocated) { is_allocated_ = is_allocated; }
   void set_is_enabled(bool is_enabled) { is_enabled_ = is_enabled; }
 
+  // Microseconds spent decoding and converting each frame.
+  AudioTimingHistogram& decode_timing() { return decode_timing_; }
+
  private:
   static int GetSampleRate(int id);
 
@@ -178,10 +197,18 @@ class XmaContext {
   uint32_t GetFramePacketNumber(uint8_t* block, size_t size, size_t bit_offset);
   int PrepareDecoder(uint8_t* block, size_t size, int sample_rate,
                      int channels);
+  void DumpWork(const uint8_t* context_ptr, const XMA_CONTEXT_DATA& data);
 
   bool ConvertFrame(const uint8_t** samples, int num_channels, int num_samples,
                     uint8_t* output_buffer);
 
+  // Hashes the packets containing the frame at bit_offset for the decoded
+  // frame cache, or returns kFrameInputHashUnknown if it can't be cached.
+  uint64_t HashFrameInput(uint8_t* block, size_t size, size_t bit_offset,
+                          size_t& offset_out, size_t& size_out);
+  // Brings the decoder up to date after frames were taken from the cache.
+  void RestoreDecoderState();
+
   int StartPacket(XMA_CONTEXT_DATA* data);
 
   int PreparePacket(uint8_t* input, size_t seq_offset, size_t size,
@@ -199,6 +226,20 @@ class XmaContext {
   bool is_allocated_ = false;
   bool is_enabled_ = false;
 
+  AudioTimingHistogram decode_timing_;
+
+  // Special values of frame input hashes for the decoded frame cache.
+  static const uint64_t kFrameInputHashFreshDecoder = 0;
+  static const uint64_t kFrameInputHashUnknown = 1;
+  // Hash of the input of the last frame, or one of the special values.
+  uint64_t previous_frame_input_hash_ = kFrameInputHashUnknown;
+  // The packets of the last frame and its offset in them, for restoring the
+  // decoder state.
+  std::vector<uint8_t> previous_frame_input_;
+  size_t previous_frame_bit_offset_ = 0;
+  // Whether frames were taken from the cache since the last libav decode.
+  bool decoder_state_stale_ = false;
+
   // libav structures
   AVCodec* codec_ = nullptr;
   AVCodecContext* context_ = nullptr;
@@ -214,6 +255,10 @@ class XmaContext {
   std::vector<uint8_t> partial_frame_buffer_;
 
   uint8_t* current_frame_ = nullptr;
+
+  // Dump of the current allocation of the context, opened on the first work.
+  FILE* dump_file_ = nullptr;
+  uint32_t dump_allocation_index_ = 0;
 };
 
 }  // namespace apu
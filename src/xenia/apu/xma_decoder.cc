@@ -9,6 +9,9 @@
 
 #include "xenia/apu/xma_decoder.h"
 
+#include <algorithm>
+#include <string>
+
 #include "xenia/apu/xma_context.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
@@ -16,6 +19,7 @@
 #include "xenia/base/profiling.h"
 #include "xenia/base/ring_buffer.h"
 #include "xenia/base/string_buffer.h"
+#include "xenia/base/threading.h"
 #include "xenia/cpu/processor.h"
 #include "xenia/cpu/thread_state.h"
 #include "xenia/kernel/xthread.h"
@@ -50,12 +54,20 @@ extern "C" {
 
 DEFINE_bool(libav_verbose, false, "Verbose libav output (debug and above)",
             "APU");
+DEFINE_int32(xma_decoder_threads, 0,
+             "Number of threads decoding XMA contexts in parallel, or 0 to "
+             "choose from the number of host logical processors.",
+             "APU");
 
 namespace xe {
 namespace apu {
 
 XmaDecoder::XmaDecoder(cpu::Processor* processor)
-    : memory_(processor->memory()), processor_(processor) {}
+    : memory_(processor->memory()), processor_(processor) {
+  for (uint32_t i = 0; i < kReadyQueueSize; ++i) {
+    ready_queue_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
 
 XmaDecoder::~XmaDecoder() = default;
 
@@ -137,72 +149,157 @@ X_STATUS XmaDecoder::Setup(kernel::KernelState* kernel_state) {
   register_file_[XE_XMA_REG_NEXT_CONTEXT_INDEX].u32 = 1;
   context_bitmap_.Resize(kContextCount);
 
+  // Contexts are decoded independently (each under its own lock), so they
+  // can be spread across multiple threads.
+  uint32_t worker_thread_count;
+  if (cvars::xma_decoder_threads > 0) {
+    worker_thread_count = uint32_t(cvars::xma_decoder_threads);
+  } else {
+    worker_thread_count = std::min(
+        std::max(xe::threading::logical_processor_count() / 4, uint32_t(1)),
+        uint32_t(4));
+  }
   worker_running_ = true;
-  work_event_ = xe::threading::Event::CreateAutoResetEvent(false);
-  worker_thread_ = kernel::object_ref<kernel::XHostThread>(
-      new kernel::XHostThread(kernel_state, 128 * 1024, 0, [this]() {
-        WorkerThreadMain();
-        return 0;
-      }));
-  worker_thread_->set_name("XMA Decoder Worker");
-  worker_thread_->set_can_debugger_suspend(true);
-  worker_thread_->Create();
+  for (uint32_t i = 0; i < worker_thread_count; ++i) {
+    auto worker_thread = kernel::object_ref<kernel::XHostThread>(
+        new kernel::XHostThread(kernel_state, 128 * 1024, 0, [this]() {
+          WorkerThreadMain();
+          return 0;
+        }));
+    worker_thread->set_name(i ? fmt::format("XMA Decoder Worker {}", i)
+                              : std::string("XMA Decoder Worker"));
+    worker_thread->set_can_debugger_suspend(true);
+    worker_thread->Create();
+    xe::threading::ApplyThreadRole(worker_thread->thread(),
+                                   xe::threading::ThreadRole::kAudio);
+    worker_threads_.push_back(std::move(worker_thread));
+  }
 
   return X_STATUS_SUCCESS;
 }
 
-void XmaDecoder::WorkerThreadMain() {
-  uint32_t idle_loop_count = 0;
-  while (worker_running_) {
-    // Okay, let's loop through XMA contexts to find ones we need to decode!
-    bool did_work = false;
-    for (uint32_t n = 0; n < kContextCount; n++) {
-      XmaContext& context = contexts_[n];
-      did_work = context.Work() || did_work;
-
-      // TODO: Need thread safety to do this.
-      // Probably not too important though.
-      // registers_.current_context = n;
-      // registers_.next_context = (n + 1) % kContextCount;
+void XmaDecoder::QueueContexts(uint32_t register_index,
+                               uint32_t context_bits) {
+  // Only queue the contexts not in the queue already.
+  context_bits &= ~queued_contexts_[register_index].fetch_or(
+      context_bits, std::memory_order_relaxed);
+  if (!context_bits) {
+    return;
+  }
+  bool multiple_contexts = (context_bits & (context_bits - 1)) != 0;
+  while (context_bits) {
+    uint32_t context_id = register_index * 32 + xe::tzcnt(context_bits);
+    context_bits &= context_bits - 1;
+    uint32_t position =
+        ready_queue_enqueue_position_.load(std::memory_order_relaxed);
+    ReadyQueueCell* cell;
+    for (;;) {
+      cell = &ready_queue_[position & (kReadyQueueSize - 1)];
+      int32_t sequence_difference = int32_t(
+          cell->sequence.load(std::memory_order_acquire) - position);
+      if (!sequence_difference) {
+        if (ready_queue_enqueue_position_.compare_exchange_weak(
+                position, position + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else {
+        // Another thread has enqueued at this position.
+        assert_true(sequence_difference > 0);
+        position =
+            ready_queue_enqueue_position_.load(std::memory_order_relaxed);
+      }
     }
-
-    if (paused_) {
-      pause_fence_.Signal();
-      resume_fence_.Wait();
+    cell->context_id = context_id;
+    cell->sequence.store(position + 1, std::memory_order_release);
+  }
+  // Paired with incrementing waiting_worker_count_ before checking the queue,
+  // so either the worker sees the new contexts or they see the worker waiting.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (waiting_worker_count_.load(std::memory_order_relaxed)) {
+    {
+      // Not to notify between a worker checking for work and starting to wait.
+      std::lock_guard<std::mutex> lock(worker_mutex_);
     }
-
-    if (!did_work) {
-      idle_loop_count++;
+    if (multiple_contexts) {
+      worker_cond_.notify_all();
     } else {
-      idle_loop_count = 0;
+      worker_cond_.notify_one();
     }
+  }
+}
 
-    if (idle_loop_count > 500) {
-      // Idle for an extended period. Introduce a 20ms wait.
-      xe::threading::Wait(work_event_.get(), false,
-                          std::chrono::milliseconds(20));
+bool XmaDecoder::DequeueContext(uint32_t& context_id_out) {
+  uint32_t position =
+      ready_queue_dequeue_position_.load(std::memory_order_relaxed);
+  ReadyQueueCell* cell;
+  for (;;) {
+    cell = &ready_queue_[position & (kReadyQueueSize - 1)];
+    int32_t sequence_difference =
+        int32_t(cell->sequence.load(std::memory_order_acquire) - position - 1);
+    if (!sequence_difference) {
+      if (ready_queue_dequeue_position_.compare_exchange_weak(
+              position, position + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (sequence_difference < 0) {
+      // Empty, or the context at the position is still being written.
+      return false;
+    } else {
+      position = ready_queue_dequeue_position_.load(std::memory_order_relaxed);
     }
-
-    xe::threading::MaybeYield();
   }
+  uint32_t context_id = cell->context_id;
+  cell->sequence.store(position + kReadyQueueSize, std::memory_order_release);
+  // If kicked again from now on, the context needs to be decoded again.
+  queued_contexts_[context_id >> 5].fetch_and(
+      ~(uint32_t(1) << (context_id & 31)), std::memory_order_relaxed);
+  context_id_out = context_id;
+  return true;
 }
 
-void XmaDecoder::Shutdown() {
-  worker_running_ = false;
+void XmaDecoder::WorkerThreadMain() {
+  while (worker_running_) {
+    // Only the contexts kicked since they were last decoded can have anything
+    // to decode - Work disables the context after decoding. If a context is
+    // kicked again while another worker is decoding it, Work waits for its
+    // lock.
+    uint32_t context_id;
+    while (worker_running_ && !paused_ && DequeueContext(context_id)) {
+      contexts_[context_id].Work();
+    }
 
-  if (work_event_) {
-    work_event_->Set();
+    std::unique_lock<std::mutex> lock(worker_mutex_);
+    if (paused_) {
+      ++paused_worker_count_;
+      worker_cond_.notify_all();
+      worker_cond_.wait(lock,
+                        [this]() { return !paused_ || !worker_running_; });
+      --paused_worker_count_;
+      continue;
+    }
+    waiting_worker_count_.fetch_add(1, std::memory_order_seq_cst);
+    worker_cond_.wait(lock, [this]() {
+      return !worker_running_ || paused_ ||
+             ready_queue_dequeue_position_.load() !=
+                 ready_queue_enqueue_position_.load();
+    });
+    waiting_worker_count_.fetch_sub(1, std::memory_order_relaxed);
   }
+}
 
-  if (paused_) {
-    Resume();
+void XmaDecoder::Shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(worker_mutex_);
+    worker_running_ = false;
+    paused_ = false;
   }
+  worker_cond_.notify_all();
 
-  if (worker_thread_) {
+  for (auto& worker_thread : worker_threads_) {
     // Wait for work thread.
-    xe::threading::Wait(worker_thread_->thread(), false);
-    worker_thread_.reset();
+    xe::threading::Wait(worker_thread->thread(), false);
   }
+  worker_threads_.clear();
 
   if (context_data_first_ptr_) {
     memory()->SystemHeapFree(context_data_first_ptr_);
@@ -305,6 +402,8 @@ void XmaDecoder::WriteRegister(uint32_t addr, uint32_t value) {
     // XMAEnableContext
 
     // The context ID is a bit in the range of the entire context array.
+    uint32_t register_index = r - XE_XMA_REG_CONTEXT_KICK_0;
+    uint32_t context_bits = value;
     uint32_t base_context_id = (r - XE_XMA_REG_CONTEXT_KICK_0) * 32;
     for (int i = 0; value && i < 32; ++i, value >>= 1) {
       if (value & 1) {
@@ -313,8 +412,8 @@ void XmaDecoder::WriteRegister(uint32_t addr, uint32_t value) {
         context.Enable();
       }
     }
-    // Signal the decoder thread to start processing.
-    work_event_->Set();
+    // Signal the decoder threads to start processing.
+    QueueContexts(register_index, context_bits);
   } else if (r >= XE_XMA_REG_CONTEXT_LOCK_0 && r <= XE_XMA_REG_CONTEXT_LOCK_9) {
     // Context lock command.
     // This requests a lock by flagging the context.
@@ -327,8 +426,6 @@ void XmaDecoder::WriteRegister(uint32_t addr, uint32_t value) {
         context.Disable();
       }
     }
-    // Signal the decoder thread to start processing.
-    work_event_->Set();
   } else if (r >= XE_XMA_REG_CONTEXT_CLEAR_0 &&
              r <= XE_XMA_REG_CONTEXT_CLEAR_9) {
     // Context clear command.
@@ -360,22 +457,63 @@ void XmaDecoder::WriteRegister(uint32_t addr, uint32_t value) {
   }
 }
 
+void XmaDecoder::LogTimingSummary() {
+  static const size_t kSlowestContextCount = 4;
+  AudioTimingHistogram::Summary total;
+  std::pair<uint32_t, AudioTimingHistogram::Summary>
+      slowest[kSlowestContextCount];
+  size_t slowest_count = 0;
+  for (uint32_t i = 0; i < kContextCount; ++i) {
+    AudioTimingHistogram::Summary summary =
+        contexts_[i].decode_timing().TakeSummary();
+    if (!summary.count) {
+      continue;
+    }
+    total.Add(summary);
+    // Keep the contexts with the largest maximum, sorted in descending order.
+    size_t position = slowest_count;
+    while (position && slowest[position - 1].second.max < summary.max) {
+      if (position < kSlowestContextCount) {
+        slowest[position] = slowest[position - 1];
+      }
+      --position;
+    }
+    if (position < kSlowestContextCount) {
+      slowest[position] = std::make_pair(i, summary);
+      slowest_count = std::min(slowest_count + 1, kSlowestContextCount);
+    }
+  }
+  if (!total.count) {
+    return;
+  }
+  XELOGI("XMA frame decoding: {}", total.Format("us"));
+  for (size_t i = 0; i < slowest_count; ++i) {
+    XELOGI("XMA frame decoding on context {}: {}", slowest[i].first,
+           slowest[i].second.Format("us"));
+  }
+}
+
 void XmaDecoder::Pause() {
   if (paused_) {
     return;
   }
+  std::unique_lock<std::mutex> lock(worker_mutex_);
   paused_ = true;
-
-  pause_fence_.Wait();
+  worker_cond_.notify_all();
+  worker_cond_.wait(lock, [this]() {
+    return paused_worker_count_ >= worker_threads_.size();
+  });
 }
 
 void XmaDecoder::Resume() {
   if (!paused_) {
     return;
   }
-  paused_ = false;
-
-  resume_fence_.Signal();
+  {
+    std::lock_guard<std::mutex> lock(worker_mutex_);
+    paused_ = false;
+  }
+  worker_cond_.notify_all();
 }
 
 }  // namespace apu
@@ -11,8 +11,10 @@
 #define XENIA_APU_XMA_DECODER_H_
 
 #include <atomic>
+#include <condition_variable>
 #include <mutex>
 #include <queue>
+#include <vector>
 
 #include "xenia/apu/xma_context.h"
 #include "xenia/apu/xma_register_file.h"
@@ -47,7 +49,11 @@ class XmaDecoder {
   uint32_t ReadRegister(uint32_t addr);
   void WriteRegister(uint32_t addr, uint32_t value);
 
-  bool is_paused() const { return paused_; }
+  // Logs the frame decoding time statistics of all contexts and of the slowest
+  // ones since the previous call.
+  void LogTimingSummary();
+
+  bool is_paused() const { return paused_.load(std::memory_order_relaxed); }
   void Pause();
   void Resume();
 
@@ -56,6 +62,13 @@ class XmaDecoder {
 
  private:
   void WorkerThreadMain();
+  // Queues the contexts (as a bit mask for a kick register) for decoding,
+  // except for those already in the queue, and wakes a worker if any of them
+  // is waiting.
+  void QueueContexts(uint32_t register_index, uint32_t context_bits);
+  // Takes the context that has been in the queue the longest, returns false if
+  // the queue is empty.
+  bool DequeueContext(uint32_t& context_id_out);
 
   static uint32_t MMIOReadRegisterThunk(void* ppc_context, XmaDecoder* as,
                                         uint32_t addr) {
@@ -71,17 +84,40 @@ class XmaDecoder {
   cpu::Processor* processor_ = nullptr;
 
   std::atomic<bool> worker_running_ = {false};
-  kernel::object_ref<kernel::XHostThread> worker_thread_;
-  std::unique_ptr<xe::threading::Event> work_event_ = nullptr;
-
-  bool paused_ = false;
-  xe::threading::Fence pause_fence_;   // Signaled when worker paused.
-  xe::threading::Fence resume_fence_;  // Signaled when resume requested.
+  std::vector<kernel::object_ref<kernel::XHostThread>> worker_threads_;
+  // Protects waiting for work and pausing, notified when contexts are queued
+  // while workers are waiting, and when paused_ or worker_running_ change.
+  std::mutex worker_mutex_;
+  std::condition_variable worker_cond_;
+  uint32_t paused_worker_count_ = 0;
+  // Workers waiting or about to wait for contexts to be queued, so kicks only
+  // need to take worker_mutex_ when some are idle.
+  std::atomic<uint32_t> waiting_worker_count_ = {0};
+
+  std::atomic<bool> paused_ = {false};
 
   XmaRegisterFile register_file_;
 
   static const uint32_t kContextCount = 320;
   XmaContext contexts_[kContextCount];
+
+  // Contexts kicked and not yet taken by a worker, in the order of the kicks,
+  // as a bounded lock-free multi-producer multi-consumer ring. A context is in
+  // the queue at most once (tracked by queued_contexts_, laid out like the kick
+  // registers), so it never overflows.
+  static const uint32_t kReadyQueueSize = 512;
+  static_assert(kReadyQueueSize >= kContextCount &&
+                !(kReadyQueueSize & (kReadyQueueSize - 1)));
+  struct ReadyQueueCell {
+    // Equal to the position when the cell is free for enqueueing at it,
+    // position + 1 when context_id has been written at it.
+    std::atomic<uint32_t> sequence;
+    uint32_t context_id;
+  };
+  ReadyQueueCell ready_queue_[kReadyQueueSize];
+  std::atomic<uint32_t> ready_queue_enqueue_position_ = {0};
+  std::atomic<uint32_t> ready_queue_dequeue_position_ = {0};
+  std::atomic<uint32_t> queued_contexts_[kContextCount / 32] = {};
   BitMap context_bitmap_;
 
   uint32_t context_data_first_ptr_ = 0;
@@ -11,11 +11,41 @@
 
 #include <cstring>
 #include <memory>
+#include <mutex>
 
 #include "xenia/base/assert.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/math.h"
+#include "xenia/base/memory.h"
+
+DEFINE_bool(arena_guard_pages, false,
+            "Debug: place an inaccessible page after every arena chunk and "
+            "scribble over arena memory when it's released, to catch "
+            "overruns and use after reset.",
+            "CPU");
 
 namespace xe {
 
+namespace {
+
+// Free chunks of the default size shared by all arenas.
+struct ChunkFreeList {
+  static constexpr size_t kMaxChunks = 16;
+
+  std::mutex mutex;
+  std::vector<void*> chunks;
+};
+
+ChunkFreeList& GetChunkFreeList() {
+  // Leaked so arenas destroyed during static destruction can still use it.
+  static ChunkFreeList* free_list = new ChunkFreeList;
+  return *free_list;
+}
+
+constexpr uint8_t kReleasedFill = 0xCD;
+
+}  // namespace
+
 Arena::Arena(size_t chunk_size)
     : chunk_size_(chunk_size), head_chunk_(nullptr), active_chunk_(nullptr) {}
 
@@ -24,82 +54,108 @@ Arena::~Arena() {
   Chunk* chunk = head_chunk_;
   while (chunk) {
     Chunk* next = chunk->next;
-    delete chunk;
+    Chunk::Release(chunk);
     chunk = next;
   }
   head_chunk_ = nullptr;
 }
 
-void Arena::Reset() {
-  active_chunk_ = head_chunk_;
-  if (active_chunk_) {
-    active_chunk_->offset = 0;
-  }
-}
+void Arena::Reset() { Restore(Marker{nullptr, 0}); }
 
 void Arena::DebugFill() {
   auto chunk = head_chunk_;
   while (chunk) {
-    std::memset(chunk->buffer, 0xCD, chunk->capacity);
+    std::memset(chunk->buffer, kReleasedFill, chunk->capacity);
     chunk = chunk->next;
   }
 }
 
-void* Arena::Alloc(size_t size) {
-  if (active_chunk_) {
-    if (active_chunk_->capacity - active_chunk_->offset < size + 4096) {
-      Chunk* next = active_chunk_->next;
-      if (!next) {
-        assert_true(size < chunk_size_, "need to support larger chunks");
-        next = new Chunk(chunk_size_);
-        active_chunk_->next = next;
+Arena::Marker Arena::Mark() const {
+  return Marker{active_chunk_, active_chunk_ ? active_chunk_->offset : 0};
+}
+
+void Arena::Restore(const Marker& marker) {
+  Chunk* chunk = marker.chunk ? static_cast<Chunk*>(marker.chunk) : head_chunk_;
+  if (!chunk) {
+    return;
+  }
+  if (cvars::arena_guard_pages && active_chunk_) {
+    // Everything from the marker to the current position.
+    Chunk* fill_chunk = chunk;
+    size_t fill_offset = marker.offset;
+    while (true) {
+      std::memset(fill_chunk->buffer + fill_offset, kReleasedFill,
+                  fill_chunk->offset - fill_offset);
+      if (fill_chunk == active_chunk_) {
+        break;
       }
-      next->offset = 0;
-      active_chunk_ = next;
+      fill_chunk = fill_chunk->next;
+      fill_offset = 0;
+    }
+  }
+  active_chunk_ = chunk;
+  active_chunk_->offset = marker.offset;
+  if (chunk == head_chunk_) {
+    active_chunk_->preceding_size = 0;
+  }
+}
+
+void* Arena::Alloc(size_t size) { return Alloc(size, 1); }
+
+void* Arena::Alloc(size_t size, size_t alignment) {
+  assert_true(xe::is_pow2(alignment));
+  size_t padding = 0;
+  if (active_chunk_) {
+    padding = (0 - uintptr_t(active_chunk_->buffer + active_chunk_->offset)) &
+              (alignment - 1);
+    if (active_chunk_->capacity - active_chunk_->offset <
+        padding + size + 4096) {
+      active_chunk_ = NextChunk(size);
+      padding = (0 - uintptr_t(active_chunk_->buffer)) & (alignment - 1);
     }
   } else {
-    head_chunk_ = active_chunk_ = new Chunk(chunk_size_);
+    head_chunk_ = active_chunk_ = Chunk::Acquire(chunk_size_);
+    active_chunk_->offset = 0;
+    active_chunk_->preceding_size = 0;
+    padding = (0 - uintptr_t(active_chunk_->buffer)) & (alignment - 1);
   }
 
-  uint8_t* p = active_chunk_->buffer + active_chunk_->offset;
-  active_chunk_->offset += size;
+  uint8_t* p = active_chunk_->buffer + active_chunk_->offset + padding;
+  active_chunk_->offset += padding + size;
   return p;
 }
 
+Arena::Chunk* Arena::NextChunk(size_t size) {
+  Chunk* next = active_chunk_->next;
+  if (!next) {
+    assert_true(size < chunk_size_, "need to support larger chunks");
+    next = Chunk::Acquire(chunk_size_);
+    active_chunk_->next = next;
+  }
+  next->offset = 0;
+  next->preceding_size = active_chunk_->preceding_size + active_chunk_->offset;
+  return next;
+}
+
 void Arena::Rewind(size_t size) { active_chunk_->offset -= size; }
 
 size_t Arena::CalculateSize() {
-  size_t total_length = 0;
-  Chunk* chunk = head_chunk_;
-  while (chunk) {
-    total_length += chunk->offset;
-    if (chunk == active_chunk_) {
-      break;
-    }
-    chunk = chunk->next;
+  if (!active_chunk_) {
+    return 0;
   }
-  return total_length;
+  return active_chunk_->preceding_size + active_chunk_->offset;
 }
 
 void* Arena::CloneContents() {
   size_t total_length = CalculateSize();
   auto result = reinterpret_cast<uint8_t*>(malloc(total_length));
-  auto p = result;
-  Chunk* chunk = head_chunk_;
-  while (chunk) {
-    std::memcpy(p, chunk->buffer, chunk->offset);
-    p += chunk->offset;
-    if (chunk == active_chunk_) {
-      break;
-    }
-    chunk = chunk->next;
-  }
+  CloneContents(result, total_length);
   return result;
 }
 
 void Arena::CloneContents(void* buffer, size_t buffer_length) {
   uint8_t* p = reinterpret_cast<uint8_t*>(buffer);
-  Chunk* chunk = head_chunk_;
+  Chunk* chunk = active_chunk_ ? head_chunk_ : nullptr;
   while (chunk) {
     std::memcpy(p, chunk->buffer, chunk->offset);
     p += chunk->offset;
@@ -110,13 +166,72 @@ void Arena::CloneContents(void* buffer, size_t buffer_length) {
   }
 }
 
+Arena::Chunk* Arena::Chunk::Acquire(size_t chunk_size) {
+  if (chunk_size == kDefaultChunkSize) {
+    ChunkFreeList& free_list = GetChunkFreeList();
+    std::lock_guard<std::mutex> lock(free_list.mutex);
+    if (!free_list.chunks.empty()) {
+      auto chunk = static_cast<Chunk*>(free_list.chunks.back());
+      free_list.chunks.pop_back();
+      chunk->next = nullptr;
+      return chunk;
+    }
+  }
+  return new Chunk(chunk_size);
+}
+
+void Arena::Chunk::Release(Chunk* chunk) {
+  // Guarded and unguarded chunks are not mixed in case the option is changed
+  // while arenas are alive.
+  if (chunk->capacity == kDefaultChunkSize &&
+      chunk->guarded == cvars::arena_guard_pages) {
+    ChunkFreeList& free_list = GetChunkFreeList();
+    std::lock_guard<std::mutex> lock(free_list.mutex);
+    if (free_list.chunks.size() < ChunkFreeList::kMaxChunks) {
+      free_list.chunks.push_back(chunk);
+      return;
+    }
+  }
+  delete chunk;
+}
+
 Arena::Chunk::Chunk(size_t chunk_size)
-    : next(nullptr), capacity(chunk_size), buffer(0), offset(0) {
+    : next(nullptr),
+      capacity(chunk_size),
+      buffer(0),
+      offset(0),
+      preceding_size(0),
+      guarded(cvars::arena_guard_pages) {
+  if (guarded) {
+    // The end of the buffer is placed right before the guard page.
+    size_t page_size = memory::page_size();
+    size_t buffer_pages_size = xe::round_up(capacity, page_size);
+    auto base = reinterpret_cast<uint8_t*>(
+        memory::AllocFixed(nullptr, buffer_pages_size + page_size,
+                           memory::AllocationType::kReserveCommit,
+                           memory::PageAccess::kReadWrite));
+    if (base) {
+      memory::Protect(base + buffer_pages_size, page_size,
+                      memory::PageAccess::kNoAccess);
+      buffer = base + buffer_pages_size - capacity;
+      return;
+    }
+    guarded = false;
+  }
   buffer = reinterpret_cast<uint8_t*>(malloc(capacity));
 }
 
 Arena::Chunk::~Chunk() {
-  if (buffer) {
+  if (!buffer) {
+    return;
+  }
+  if (guarded) {
+    size_t page_size = memory::page_size();
+    size_t buffer_pages_size = xe::round_up(capacity, page_size);
+    memory::DeallocFixed(buffer + capacity - buffer_pages_size,
+                         buffer_pages_size + page_size,
+                         memory::DeallocationType::kRelease);
+  } else {
     free(buffer);
   }
 }
@@ -18,19 +18,52 @@ namespace xe {
 
 class Arena {
  public:
-  explicit Arena(size_t chunk_size = 4 * 1024 * 1024);
+  // Chunks of this size are recycled through a global free list when arenas
+  // are destroyed, so translators created and destroyed repeatedly don't go
+  // back to the heap for their memory.
+  static constexpr size_t kDefaultChunkSize = 4 * 1024 * 1024;
+
+  // Position in the arena that can be returned to, releasing everything
+  // allocated after it.
+  struct Marker {
+    void* chunk;
+    size_t offset;
+  };
+
+  // Restores the position of the arena on destruction.
+  class Scope {
+   public:
+    explicit Scope(Arena* arena) : arena_(arena), marker_(arena->Mark()) {}
+    ~Scope() { arena_->Restore(marker_); }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+   private:
+    Arena* arena_;
+    Marker marker_;
+  };
+
+  explicit Arena(size_t chunk_size = kDefaultChunkSize);
   ~Arena();
 
   void Reset();
   void DebugFill();
 
+  Marker Mark() const;
+  void Restore(const Marker& marker);
+
   void* Alloc(size_t size);
+  // alignment must be a power of two.
+  void* Alloc(size_t size, size_t alignment);
   template <typename T>
   T* Alloc() {
-    return reinterpret_cast<T*>(Alloc(sizeof(T)));
+    return reinterpret_cast<T*>(Alloc(sizeof(T), alignof(T)));
   }
   void Rewind(size_t size);
 
+  // Bytes allocated since the last Reset.
+  size_t CalculateSize();
+
   void* CloneContents();
   template <typename T>
   void CloneContents(std::vector<T>* buffer) {
@@ -41,17 +74,28 @@ class Arena {
  private:
   class Chunk {
    public:
-    explicit Chunk(size_t chunk_size);
-    ~Chunk();
+    // Takes a chunk from the global free list if possible.
+    static Chunk* Acquire(size_t chunk_size);
+    // Puts the chunk to the global free list or deletes it.
+    static void Release(Chunk* chunk);
 
     Chunk* next;
 
     size_t capacity;
     uint8_t* buffer;
     size_t offset;
+    // Bytes allocated in the chunks before this one, valid while it's active.
+    size_t preceding_size;
+
+   private:
+    explicit Chunk(size_t chunk_size);
+    ~Chunk();
+
+    // Whether the buffer is followed by an inaccessible page.
+    bool guarded;
   };
 
-  size_t CalculateSize();
+  Chunk* NextChunk(size_t size);
   void CloneContents(void* buffer, size_t buffer_length);
 
   size_t chunk_size_;
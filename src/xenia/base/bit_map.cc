@@ -9,6 +9,8 @@
 
 #include "xenia/base/bit_map.h"
 
+#include <cstring>
+
 #include "xenia/base/assert.h"
 #include "xenia/base/atomic.h"
 #include "xenia/base/math.h"
@@ -23,46 +25,95 @@ BitMap::BitMap(uint64_t* data, size_t size_bits) {
   assert_true(size_bits % kDataSizeBits == 0);
 
   data_.resize(size_bits / kDataSizeBits);
-  std::memcpy(data_.data(), data, size_bits / kDataSizeBits);
+  std::memcpy(data_.data(), data, size_bits / 8);
+  UpdateSummary();
+}
+
+namespace {
+
+// Bit of entry index (or of the word index in the summary) in its word.
+inline uint64_t EntryBit(size_t index) {
+  return 1ull << (63 - index % 64);
+}
+
+inline void AtomicAnd(volatile uint64_t* value, uint64_t mask) {
+  uint64_t old_value;
+  do {
+    old_value = *value;
+  } while (!atomic_cas(old_value, old_value & mask, value));
+}
+
+inline void AtomicOr(volatile uint64_t* value, uint64_t mask) {
+  uint64_t old_value;
+  do {
+    old_value = *value;
+  } while (!atomic_cas(old_value, old_value | mask, value));
 }
 
+}  // namespace
+
 size_t BitMap::Acquire() {
+  for (size_t s = 0; s < summary_.size(); s++) {
+    uint64_t summary;
+    while ((summary = summary_[s]) != 0) {
+      size_t index = AcquireInWord(s * kDataSizeBits + lzcnt(summary));
+      if (index != size_t(-1)) {
+        return index;
+      }
+    }
+  }
+
+  // The summary may briefly lag behind concurrent releases, make sure the map
+  // is actually full.
   for (size_t i = 0; i < data_.size(); i++) {
-    uint64_t entry = 0;
-    uint64_t new_entry = 0;
-    int64_t acquired_idx = -1;
-
-    do {
-      entry = data_[i];
-      uint8_t index = lzcnt(entry);
-      if (index == kDataSizeBits) {
-        // None free.
-        acquired_idx = -1;
-        break;
+    if (data_[i]) {
+      size_t index = AcquireInWord(i);
+      if (index != size_t(-1)) {
+        return index;
       }
+    }
+  }
 
-      // Entry has a free bit. Acquire it.
-      uint64_t bit = 1ull << (kDataSizeBits - index - 1);
-      new_entry = entry & ~bit;
-      assert_not_zero(entry & bit);
+  return -1;
+}
 
-      acquired_idx = index;
-    } while (!atomic_cas(entry, new_entry, &data_[i]));
+size_t BitMap::AcquireInWord(size_t data_index) {
+  uint64_t entry = 0;
+  uint64_t new_entry = 0;
+  int64_t acquired_idx = -1;
 
-    if (acquired_idx != -1) {
-      // Acquired.
-      return (i * kDataSizeBits) + acquired_idx;
+  do {
+    entry = data_[data_index];
+    uint8_t index = lzcnt(entry);
+    if (index == kDataSizeBits) {
+      // None free.
+      acquired_idx = -1;
+      break;
     }
-  }
 
-  return -1;
+    // Entry has a free bit. Acquire it.
+    uint64_t bit = EntryBit(index);
+    new_entry = entry & ~bit;
+    assert_not_zero(entry & bit);
+
+    acquired_idx = index;
+  } while (!atomic_cas(entry, new_entry, &data_[data_index]));
+
+  if (acquired_idx == -1 || !new_entry) {
+    // The word is full now, or was already full with a stale summary.
+    UpdateSummary(data_index);
+  }
+  if (acquired_idx == -1) {
+    return -1;
+  }
+  return (data_index * kDataSizeBits) + acquired_idx;
 }
 
 void BitMap::Release(size_t index) {
   auto slot = index / kDataSizeBits;
   index -= slot * kDataSizeBits;
 
-  uint64_t bit = 1ull << (kDataSizeBits - index - 1);
+  uint64_t bit = EntryBit(index);
 
   uint64_t entry = 0;
   uint64_t new_entry = 0;
@@ -72,6 +123,10 @@ void BitMap::Release(size_t index) {
 
     new_entry = entry | bit;
   } while (!atomic_cas(entry, new_entry, &data_[slot]));
+
+  if (!entry) {
+    AtomicOr(&summary_[slot / kDataSizeBits], EntryBit(slot));
+  }
 }
 
 void BitMap::Resize(size_t new_size_bits) {
@@ -85,12 +140,35 @@ void BitMap::Resize(size_t new_size_bits) {
       data_[i] = -1;
     }
   }
+  UpdateSummary();
 }
 
 void BitMap::Reset() {
   for (size_t i = 0; i < data_.size(); i++) {
     data_[i] = -1;
   }
+  UpdateSummary();
+}
+
+void BitMap::UpdateSummary() {
+  summary_.clear();
+  summary_.resize((data_.size() + kDataSizeBits - 1) / kDataSizeBits);
+  for (size_t i = 0; i < data_.size(); i++) {
+    if (data_[i]) {
+      summary_[i / kDataSizeBits] |= EntryBit(i);
+    }
+  }
+}
+
+void BitMap::UpdateSummary(size_t data_index) {
+  volatile uint64_t* summary = &summary_[data_index / kDataSizeBits];
+  uint64_t bit = EntryBit(data_index);
+  AtomicAnd(summary, ~bit);
+  // An entry may have been released after the word was seen full but before
+  // the bit was cleared, in which case Release may have set the bit already.
+  if (data_[data_index]) {
+    AtomicOr(summary, bit);
+  }
 }
 
 }  // namespace xe
\ No newline at end of file
@@ -17,6 +17,9 @@
 namespace xe {
 
 // Bit Map: Efficient lookup of free/used entries.
+// A summary level with one bit per 64-bit word of entries, set if the word may
+// have free entries, lets Acquire skip full words, so acquisition doesn't slow
+// down as the map fills up.
 class BitMap {
  public:
   BitMap();
@@ -43,12 +46,25 @@ class BitMap {
   void Reset();
 
   const std::vector<uint64_t> data() const { return data_; }
+  // UpdateSummary must be called after modifying the data.
   std::vector<uint64_t>& data() { return data_; }
 
+  // Rebuilds the summary from the data.
+  void UpdateSummary();
+
  private:
   const static size_t kDataSize = 8;
   const static size_t kDataSizeBits = kDataSize * 8;
+
+  // (threadsafe) Acquires an entry in one word, returns -1 if it's full.
+  size_t AcquireInWord(size_t data_index);
+  // (threadsafe) Updates the summary bit of a word of entries after it has
+  // become full or got a free entry.
+  void UpdateSummary(size_t data_index);
+
   std::vector<uint64_t> data_;
+  // Bits ordered like the entries in the data words.
+  std::vector<uint64_t> summary_;
 };
 
 }  // namespace xe
@@ -0,0 +1,136 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/chrome_trace_writer.h"
+
+#include <cstdio>
+
+#include "xenia/base/filesystem.h"
+
+namespace xe {
+
+ChromeTraceWriter::ChromeTraceWriter() {
+  json_.Append("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+}
+
+void ChromeTraceWriter::AddThreadName(uint32_t thread_id,
+                                      const std::string_view name) {
+  BeginEvent();
+  json_.AppendFormat(
+      "{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":{},"
+      "\"args\":{{\"name\":",
+      thread_id);
+  AppendString(name);
+  json_.Append("}}");
+}
+
+void ChromeTraceWriter::AddComplete(const std::string_view name,
+                                    const std::string_view category,
+                                    uint32_t thread_id, double timestamp_us,
+                                    double duration_us,
+                                    const std::string_view detail) {
+  BeginEvent();
+  json_.Append("{\"name\":");
+  AppendString(name);
+  json_.Append(",\"cat\":");
+  AppendString(category);
+  json_.AppendFormat(
+      ",\"ph\":\"X\",\"pid\":0,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}",
+      thread_id, timestamp_us, duration_us);
+  if (!detail.empty()) {
+    json_.Append(",\"args\":{\"detail\":");
+    AppendString(detail);
+    json_.Append('}');
+  }
+  json_.Append('}');
+}
+
+void ChromeTraceWriter::AddBegin(const std::string_view name,
+                                 const std::string_view category,
+                                 uint32_t thread_id, double timestamp_us) {
+  BeginEvent();
+  json_.Append("{\"name\":");
+  AppendString(name);
+  json_.Append(",\"cat\":");
+  AppendString(category);
+  json_.AppendFormat(",\"ph\":\"B\",\"pid\":0,\"tid\":{},\"ts\":{:.3f}}}",
+                     thread_id, timestamp_us);
+}
+
+void ChromeTraceWriter::AddEnd(uint32_t thread_id, double timestamp_us) {
+  BeginEvent();
+  json_.AppendFormat("{{\"ph\":\"E\",\"pid\":0,\"tid\":{},\"ts\":{:.3f}}}",
+                     thread_id, timestamp_us);
+}
+
+void ChromeTraceWriter::AddInstant(const std::string_view name,
+                                   const std::string_view category,
+                                   uint32_t thread_id, double timestamp_us) {
+  BeginEvent();
+  json_.Append("{\"name\":");
+  AppendString(name);
+  json_.Append(",\"cat\":");
+  AppendString(category);
+  json_.AppendFormat(
+      ",\"ph\":\"i\",\"s\":\"g\",\"pid\":0,\"tid\":{},\"ts\":{:.3f}}}",
+      thread_id, timestamp_us);
+}
+
+void ChromeTraceWriter::AddCounter(const std::string_view name,
+                                   double timestamp_us, int64_t value) {
+  BeginEvent();
+  json_.Append("{\"name\":");
+  AppendString(name);
+  json_.AppendFormat(
+      ",\"ph\":\"C\",\"pid\":0,\"ts\":{:.3f},\"args\":{{\"value\":{}}}}}",
+      timestamp_us, value);
+}
+
+bool ChromeTraceWriter::WriteToFile(const std::filesystem::path& path) {
+  json_.Append("\n]}\n");
+  FILE* file = filesystem::OpenFile(path, "wb");
+  if (!file) {
+    return false;
+  }
+  std::string_view json = json_.to_string_view();
+  bool written = std::fwrite(json.data(), 1, json.size(), file) == json.size();
+  if (std::fclose(file)) {
+    written = false;
+  }
+  return written;
+}
+
+void ChromeTraceWriter::BeginEvent() {
+  json_.Append(event_count_ ? ",\n" : "\n");
+  ++event_count_;
+}
+
+void ChromeTraceWriter::AppendString(const std::string_view str) {
+  json_.Append('"');
+  for (char c : str) {
+    switch (c) {
+      case '"':
+        json_.Append("\\\"");
+        break;
+      case '\\':
+        json_.Append("\\\\");
+        break;
+      default:
+        if (uint8_t(c) < 0x20) {
+          json_.AppendFormat("\\u{:04x}", uint8_t(c));
+        } else {
+          json_.Append(c);
+        }
+        break;
+    }
+  }
+  json_.Append('"');
+}
+
+}  // namespace xe
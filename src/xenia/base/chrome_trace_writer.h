@@ -0,0 +1,62 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BASE_CHROME_TRACE_WRITER_H_
+#define XENIA_BASE_CHROME_TRACE_WRITER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+
+#include "xenia/base/string_buffer.h"
+
+namespace xe {
+
+// Builds a JSON file in the Chrome trace event format, which can be opened in
+// chrome://tracing or Perfetto. Timestamps are in microseconds, and all events
+// belong to a single process.
+class ChromeTraceWriter {
+ public:
+  ChromeTraceWriter();
+
+  size_t event_count() const { return event_count_; }
+
+  void AddThreadName(uint32_t thread_id, const std::string_view name);
+  // A phase with a known duration. The detail is added to the arguments if not
+  // empty.
+  void AddComplete(const std::string_view name, const std::string_view category,
+                   uint32_t thread_id, double timestamp_us, double duration_us,
+                   const std::string_view detail = std::string_view());
+  // The beginning and the end of a phase, which must be nested properly on
+  // each thread.
+  void AddBegin(const std::string_view name, const std::string_view category,
+                uint32_t thread_id, double timestamp_us);
+  void AddEnd(uint32_t thread_id, double timestamp_us);
+  // A point in time affecting all threads.
+  void AddInstant(const std::string_view name, const std::string_view category,
+                  uint32_t thread_id, double timestamp_us);
+  void AddCounter(const std::string_view name, double timestamp_us,
+                  int64_t value);
+
+  // Finishes the JSON and writes it to the file, replacing it. The writer must
+  // not be used afterwards.
+  bool WriteToFile(const std::filesystem::path& path);
+
+ private:
+  void BeginEvent();
+  void AppendString(const std::string_view str);
+
+  StringBuffer json_;
+  size_t event_count_ = 0;
+};
+
+}  // namespace xe
+
+#endif  // XENIA_BASE_CHROME_TRACE_WRITER_H_
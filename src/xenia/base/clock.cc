@@ -10,11 +10,13 @@
 #include "xenia/base/clock.h"
 
 #include <algorithm>
+#include <atomic>
 #include <limits>
 #include <mutex>
 
 #include "xenia/base/assert.h"
 #include "xenia/base/math.h"
+#include "xenia/base/platform.h"
 
 DEFINE_bool(clock_no_scaling, false,
             "Disable scaling code. Time management and locking is bypassed. "
@@ -24,6 +26,10 @@ DEFINE_bool(clock_source_raw, false,
             "Use the RDTSC instruction as the time source. "
             "Host CPU must support invariant TSC.",
             "CPU");
+DEFINE_bool(clock_inline_tsc, true,
+            "Derive the guest clock from the RDTSC instruction if the host CPU "
+            "has an invariant TSC, so JIT code can read it without calls.",
+            "CPU");
 
 namespace xe {
 
@@ -45,6 +51,51 @@ uint64_t last_host_tick_count_ = Clock::QueryHostTickCount();
 // Mutex to ensure last_host_tick_count_ and last_guest_tick_count_ are in sync
 std::mutex tick_mutex_;
 
+#if XE_ARCH_AMD64
+// Time stamp counter frequency, 0 if the guest clock is not derived from it.
+uint64_t guest_tick_mapping_tsc_frequency_ = 0;
+// The mapping is published by replacing the pointer, alternating between two
+// storage locations, so readers never see a partially written mapping unless
+// the ratio is changed twice while they're reading.
+Clock::GuestTickMapping guest_tick_mappings_[2];
+std::atomic<const Clock::GuestTickMapping*> guest_tick_mapping_{nullptr};
+static_assert(sizeof(guest_tick_mapping_) == sizeof(void*) &&
+                  decltype(guest_tick_mapping_)::is_always_lock_free,
+              "The mapping pointer must be readable by JIT code as is.");
+std::once_flag guest_tick_mapping_once_;
+
+// Must be called with tick_mutex_ locked. guest_tick_count is the current
+// guest time, from which the guest clock continues with the current ratio.
+void PublishGuestTickMapping(uint64_t guest_tick_count, uint64_t tsc) {
+  const Clock::GuestTickMapping* current =
+      guest_tick_mapping_.load(std::memory_order_relaxed);
+  Clock::GuestTickMapping* next = current == &guest_tick_mappings_[0]
+                                      ? &guest_tick_mappings_[1]
+                                      : &guest_tick_mappings_[0];
+  double ratio = double(guest_tick_ratio_.first) /
+                 double(guest_tick_ratio_.second) *
+                 double(Clock::QueryHostTickFrequency()) /
+                 double(guest_tick_mapping_tsc_frequency_);
+  next->multiplier = uint64_t(ratio * 4294967296.0);
+  next->offset = 0;
+  next->offset = guest_tick_count - Clock::MapGuestTickCount(*next, tsc);
+  guest_tick_mapping_.store(next, std::memory_order_release);
+}
+#endif  // XE_ARCH_AMD64
+
+// Must be called with tick_mutex_ locked.
+uint64_t AdvanceGuestClock(uint64_t host_tick_count) {
+  // Translate host tick count to guest tick count.
+  uint64_t host_tick_delta = host_tick_count > last_host_tick_count_
+                                 ? host_tick_count - last_host_tick_count_
+                                 : 0;
+  last_host_tick_count_ = host_tick_count;
+  uint64_t guest_tick_delta =
+      host_tick_delta * guest_tick_ratio_.first / guest_tick_ratio_.second;
+  last_guest_tick_count_ += guest_tick_delta;
+  return last_guest_tick_count_;
+}
+
 void RecomputeGuestTickScalar() {
   // Create a rational number with numerator (first) and denominator (second)
   auto frac =
@@ -62,12 +113,29 @@ void RecomputeGuestTickScalar() {
   reduce_fraction(frac);
 
   std::lock_guard<std::mutex> lock(tick_mutex_);
+#if XE_ARCH_AMD64
+  if (const Clock::GuestTickMapping* mapping =
+          guest_tick_mapping_.load(std::memory_order_relaxed)) {
+    uint64_t tsc = Clock::host_tick_count_raw();
+    uint64_t guest_tick_count = Clock::MapGuestTickCount(*mapping, tsc);
+    guest_tick_ratio_ = frac;
+    PublishGuestTickMapping(guest_tick_count, tsc);
+    return;
+  }
+#endif  // XE_ARCH_AMD64
   guest_tick_ratio_ = frac;
 }
 
 // Update the guest timer for all threads.
 // Return a copy of the value so locking is reduced.
 uint64_t UpdateGuestClock() {
+#if XE_ARCH_AMD64
+  if (const Clock::GuestTickMapping* mapping =
+          guest_tick_mapping_.load(std::memory_order_acquire)) {
+    return Clock::MapGuestTickCount(*mapping, Clock::host_tick_count_raw());
+  }
+#endif  // XE_ARCH_AMD64
+
   uint64_t host_tick_count = Clock::QueryHostTickCount();
 
   if (cvars::clock_no_scaling) {
@@ -77,15 +145,7 @@ uint64_t UpdateGuestClock() {
 
   std::unique_lock<std::mutex> lock(tick_mutex_, std::defer_lock);
   if (lock.try_lock()) {
-    // Translate host tick count to guest tick count.
-    uint64_t host_tick_delta = host_tick_count > last_host_tick_count_
-                                   ? host_tick_count - last_host_tick_count_
-                                   : 0;
-    last_host_tick_count_ = host_tick_count;
-    uint64_t guest_tick_delta =
-        host_tick_delta * guest_tick_ratio_.first / guest_tick_ratio_.second;
-    last_guest_tick_count_ += guest_tick_delta;
-    return last_guest_tick_count_;
+    return AdvanceGuestClock(host_tick_count);
   } else {
     // Wait until another thread has finished updating the clock.
     lock.lock();
@@ -152,6 +212,39 @@ void Clock::set_guest_system_time_base(uint64_t time_base) {
   guest_system_time_base_ = time_base;
 }
 
+const Clock::GuestTickMapping* const* Clock::guest_tick_mapping() {
+#if XE_ARCH_AMD64
+  if (!guest_tick_mapping_tsc_frequency_) {
+    return nullptr;
+  }
+  return reinterpret_cast<const GuestTickMapping* const*>(&guest_tick_mapping_);
+#else
+  return nullptr;
+#endif  // XE_ARCH_AMD64
+}
+
+void Clock::InitializeGuestTickMapping() {
+#if XE_ARCH_AMD64
+  if (!cvars::clock_inline_tsc) {
+    return;
+  }
+  std::call_once(guest_tick_mapping_once_, []() {
+    uint64_t tsc_frequency = host_tick_frequency_invariant_tsc();
+    if (!tsc_frequency) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(tick_mutex_);
+    uint64_t host_tick_count = QueryHostTickCount();
+    uint64_t guest_tick_count =
+        cvars::clock_no_scaling ? host_tick_count * guest_tick_ratio_.first /
+                                      guest_tick_ratio_.second
+                                : AdvanceGuestClock(host_tick_count);
+    guest_tick_mapping_tsc_frequency_ = tsc_frequency;
+    PublishGuestTickMapping(guest_tick_count, host_tick_count_raw());
+  });
+#endif  // XE_ARCH_AMD64
+}
+
 uint64_t Clock::QueryGuestTickCount() {
   auto guest_tick_count = UpdateGuestClock();
   return guest_tick_count;
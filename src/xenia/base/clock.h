@@ -16,6 +16,7 @@
 
 DECLARE_bool(clock_no_scaling);
 DECLARE_bool(clock_source_raw);
+DECLARE_bool(clock_inline_tsc);
 
 namespace xe {
 
@@ -28,6 +29,10 @@ class Clock {
   // Host tick count. Generally QueryHostTickCount() should be used.
   static uint64_t host_tick_count_platform();
   static uint64_t host_tick_count_raw();
+  // Frequency of the host time stamp counter if it's invariant, measured
+  // against the platform time source when the CPU doesn't report it, or 0 if
+  // it can't be used as a time source.
+  static uint64_t host_tick_frequency_invariant_tsc();
 
   // Queries the host tick frequency.
   static uint64_t QueryHostTickFrequency();
@@ -55,6 +60,32 @@ class Clock {
   // By default this is the current system time.
   static void set_guest_system_time_base(uint64_t time_base);
 
+  // Linear mapping from the host time stamp counter to the guest tick count,
+  // guest ticks = ((tsc * multiplier) >> 32) + offset, modulo 2^64.
+  struct GuestTickMapping {
+    uint64_t multiplier;
+    uint64_t offset;
+  };
+  // Returns the location of the pointer to the current mapping, for code that
+  // reads the guest clock without calling QueryGuestTickCount, or nullptr if
+  // the guest clock isn't derived from the time stamp counter. The pointer is
+  // replaced, never the mapping it points to, when the tick ratio changes.
+  // Valid only after InitializeGuestTickMapping.
+  static const GuestTickMapping* const* guest_tick_mapping();
+  // Switches the guest clock to the time stamp counter if enabled and
+  // supported. Must be called once the guest tick frequency is set, before any
+  // code reading the mapping is compiled or loaded from storage.
+  static void InitializeGuestTickMapping();
+  static uint64_t MapGuestTickCount(const GuestTickMapping& mapping,
+                                    uint64_t tsc) {
+    // The 64-bit middle of the 128-bit product.
+    uint64_t tsc_hi = tsc >> 32, tsc_lo = uint32_t(tsc);
+    uint64_t mul_hi = mapping.multiplier >> 32,
+             mul_lo = uint32_t(mapping.multiplier);
+    return ((tsc_hi * mul_hi) << 32) + tsc_hi * mul_lo + tsc_lo * mul_hi +
+           ((tsc_lo * mul_lo) >> 32) + mapping.offset;
+  }
+
   // Queries the current guest tick count, accounting for frequency adjustment
   // and scaling.
   static uint64_t QueryGuestTickCount();
@@ -14,18 +14,14 @@
 
 namespace xe {
 
-uint64_t Clock::host_tick_frequency_platform() {
-  timespec res;
-  clock_getres(CLOCK_MONOTONIC_RAW, &res);
-
-  return uint64_t(res.tv_sec) + uint64_t(res.tv_nsec) * 1000000000ull;
-}
+// Host ticks are nanoseconds.
+uint64_t Clock::host_tick_frequency_platform() { return 1000000000ull; }
 
 uint64_t Clock::host_tick_count_platform() {
   timespec res;
   clock_gettime(CLOCK_MONOTONIC_RAW, &res);
 
-  return uint64_t(res.tv_sec) + uint64_t(res.tv_nsec) * 1000000000ull;
+  return uint64_t(res.tv_sec) * 1000000000ull + uint64_t(res.tv_nsec);
 }
 
 uint64_t Clock::QueryHostSystemTime() {
@@ -98,6 +98,43 @@ uint64_t Clock::host_tick_frequency_raw() {
 
 uint64_t Clock::host_tick_count_raw() { return xe_cpu_rdtsc(); }
 
+uint64_t Clock::host_tick_frequency_invariant_tsc() {
+  uint32_t eax, ebx, ecx, edx;
+
+  xe_cpu_cpuid(0x0, eax, ebx, ecx, edx);
+  auto max_cpuid = eax;
+  xe_cpu_cpuid(0x80000000, eax, ebx, ecx, edx);
+  if (eax < 0x80000007) {
+    return 0;
+  }
+  xe_cpu_cpuid(0x80000007, eax, ebx, ecx, edx);
+  if (!(edx & (1 << 8))) {
+    return 0;
+  }
+
+  if (max_cpuid >= 0x15) {
+    xe_cpu_cpuid(0x15, eax, ebx, ecx, edx);
+    // Virtual machines may report nonsense there.
+    uint64_t tsc_frequency = eax ? uint64_t(ecx) * ebx / eax : 0;
+    if (tsc_frequency >= 100000000) {
+      return tsc_frequency;
+    }
+  }
+
+  // Measure against the platform time source for 20 ms, which is precise to a
+  // few ppm with common platform timer frequencies.
+  uint64_t platform_frequency = host_tick_frequency_platform();
+  uint64_t platform_start = host_tick_count_platform();
+  uint64_t tsc_start = xe_cpu_rdtsc();
+  uint64_t platform_end, tsc_end;
+  do {
+    platform_end = host_tick_count_platform();
+    tsc_end = xe_cpu_rdtsc();
+  } while (platform_end - platform_start < platform_frequency / 50);
+  return uint64_t(double(tsc_end - tsc_start) * double(platform_frequency) /
+                  double(platform_end - platform_start));
+}
+
 }  // namespace xe
 
 #endif
@@ -80,6 +80,25 @@ void ParseLaunchArguments(int& argc, char**& argv,
     std::cout << e.what() << std::endl;
     PrintHelpAndExit();
   }
+
+  UpdateSnapshots();
+}
+
+static std::vector<void (*)()>& GetSnapshotUpdaters() {
+  // Leaked as updaters are added during static initialization.
+  static auto updaters = new std::vector<void (*)()>;
+  return *updaters;
+}
+
+void AddSnapshotUpdater(void (*updater)()) {
+  GetSnapshotUpdaters().push_back(updater);
+  updater();
+}
+
+void UpdateSnapshots() {
+  for (auto updater : GetSnapshotUpdaters()) {
+    updater();
+  }
 }
 
 namespace toml {
@@ -255,6 +255,15 @@ inline void AddConfigVar(IConfigVar* cv) {
   if (!ConfigVars) ConfigVars = new std::map<std::string, IConfigVar*>();
   ConfigVars->insert(std::pair<std::string, IConfigVar*>(cv->name(), cv));
 }
+// Snapshots are copies of frequently read cvars, or of conditions derived from
+// them, packed together so hot paths test one structure. The updater is called
+// when it's added and whenever cvars are loaded from the launch arguments or
+// the config files.
+void AddSnapshotUpdater(void (*updater)());
+// Must be called after changing cvars other than through ParseLaunchArguments
+// or the config loading functions.
+void UpdateSnapshots();
+
 inline void AddCommandVar(ICommandVar* cv) {
   if (!CmdVars) CmdVars = new std::map<std::string, ICommandVar*>();
   CmdVars->insert(std::pair<std::string, ICommandVar*>(cv->name(), cv));
@@ -24,5 +24,12 @@ bool CreateParentFolder(const std::filesystem::path& path) {
   return true;
 }
 
+std::unique_ptr<FileLock> FileLock::TryAcquireForStorage(
+    const std::filesystem::path& storage_file_path) {
+  auto lock_path = storage_file_path;
+  lock_path += ".lock";
+  return TryAcquire(lock_path);
+}
+
 }  // namespace filesystem
 }  // namespace xe
@@ -11,6 +11,7 @@
 #define XENIA_BASE_FILESYSTEM_H_
 
 #include <filesystem>
+#include <functional>
 #include <iterator>
 #include <memory>
 #include <string>
@@ -122,6 +123,50 @@ struct FileInfo {
 bool GetInfo(const std::filesystem::path& path, FileInfo* out_info);
 std::vector<FileInfo> ListFiles(const std::filesystem::path& path);
 
+// Exclusive advisory lock held through a lock file, for choosing one of the
+// processes sharing a cache (multiple emulator instances with the same storage
+// root) to write to it while the others only read it. Released when the
+// FileLock is destroyed or the process exits.
+class FileLock {
+ public:
+  // Creates the lock file if needed. Returns nullptr if the lock is already
+  // held, by another process or by another FileLock in this one.
+  static std::unique_ptr<FileLock> TryAcquire(
+      const std::filesystem::path& path);
+
+  // Takes the lock of a storage file, through a lock file next to it.
+  // Multiple instances of the emulator may run the title with the same
+  // storage. Only the first one writes to it, while the others only use what
+  // it contained when they started, so the file is to be opened read-only if
+  // this returns nullptr.
+  static std::unique_ptr<FileLock> TryAcquireForStorage(
+      const std::filesystem::path& storage_file_path);
+
+  virtual ~FileLock() = default;
+
+ protected:
+  FileLock() = default;
+};
+
+// Watches a directory tree for changes made by any process, calling back on a
+// thread of the watcher with the path of every file or directory created,
+// removed, renamed or modified in it. An empty path means that events were
+// lost and anything in the tree may have changed.
+class DirectoryWatcher {
+ public:
+  using ChangeCallback = std::function<void(const std::filesystem::path&)>;
+
+  // Returns nullptr if the host can't watch the directory.
+  static std::unique_ptr<DirectoryWatcher> Create(
+      const std::filesystem::path& root_path, ChangeCallback callback);
+
+  // Stops watching, callbacks are not called after this returns.
+  virtual ~DirectoryWatcher() = default;
+
+ protected:
+  DirectoryWatcher() = default;
+};
+
 }  // namespace filesystem
 }  // namespace xe
 
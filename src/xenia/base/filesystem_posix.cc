@@ -11,19 +11,24 @@
 #include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/string.h"
+#include "xenia/base/threading.h"
 
 #include <assert.h>
 #include <dirent.h>
 #include <fcntl.h>
 #include <ftw.h>
 #include <libgen.h>
+#include <poll.h>
 #include <pwd.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/file.h>
+#include <sys/inotify.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <iostream>
+#include <unordered_map>
 
 namespace xe {
 
@@ -192,14 +197,45 @@ std::unique_ptr<FileHandle> FileHandle::OpenExisting(
   return std::make_unique<PosixFileHandle>(path, handle);
 }
 
+class PosixFileLock : public FileLock {
+ public:
+  explicit PosixFileLock(int handle) : handle_(handle) {}
+  ~PosixFileLock() override {
+    // Closing the only descriptor of the open file releases the lock.
+    close(handle_);
+  }
+
+ private:
+  int handle_;
+};
+
+std::unique_ptr<FileLock> FileLock::TryAcquire(
+    const std::filesystem::path& path) {
+  int handle = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0664);
+  if (handle == -1) {
+    return nullptr;
+  }
+  // flock locks belong to the open file description, so a second lock taken
+  // through a different open() in the same process fails too.
+  if (flock(handle, LOCK_EX | LOCK_NB) == -1) {
+    close(handle);
+    return nullptr;
+  }
+  return std::make_unique<PosixFileLock>(handle);
+}
+
 bool GetInfo(const std::filesystem::path& path, FileInfo* out_info) {
   struct stat st;
   if (stat(path.c_str(), &st) == 0) {
     if (S_ISDIR(st.st_mode)) {
       out_info->type = FileInfo::Type::kDirectory;
+      out_info->total_size = 0;
     } else {
       out_info->type = FileInfo::Type::kFile;
+      out_info->total_size = st.st_size;
     }
+    out_info->name = path.filename();
+    out_info->path = path.parent_path();
     out_info->create_timestamp = convertUnixtimeToWinFiletime(st.st_ctime);
     out_info->access_timestamp = convertUnixtimeToWinFiletime(st.st_atime);
     out_info->write_timestamp = convertUnixtimeToWinFiletime(st.st_mtime);
@@ -238,5 +274,123 @@ std::vector<FileInfo> ListFiles(const std::filesystem::path& path) {
   return result;
 }
 
+class PosixDirectoryWatcher : public DirectoryWatcher {
+ public:
+  explicit PosixDirectoryWatcher(ChangeCallback callback)
+      : callback_(std::move(callback)) {}
+
+  ~PosixDirectoryWatcher() override {
+    if (thread_) {
+      char stop = 0;
+      write(stop_pipe_[1], &stop, sizeof(stop));
+      xe::threading::Wait(thread_.get(), false);
+    }
+    for (int fd : {inotify_fd_, stop_pipe_[0], stop_pipe_[1]}) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  }
+
+  bool Initialize(const std::filesystem::path& root_path) {
+    inotify_fd_ = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (inotify_fd_ < 0 || pipe(stop_pipe_) != 0) {
+      return false;
+    }
+    // inotify watches are not recursive, every directory needs its own.
+    if (!AddWatches(root_path)) {
+      return false;
+    }
+    thread_ = xe::threading::Thread::Create({}, [this]() { ThreadMain(); });
+    if (!thread_) {
+      return false;
+    }
+    thread_->set_name("Directory Watcher");
+    return true;
+  }
+
+ private:
+  static constexpr uint32_t kWatchMask = IN_ATTRIB | IN_CLOSE_WRITE |
+                                         IN_CREATE | IN_DELETE | IN_MODIFY |
+                                         IN_MOVED_FROM | IN_MOVED_TO;
+
+  bool AddWatches(const std::filesystem::path& path) {
+    int wd = inotify_add_watch(inotify_fd_, path.c_str(), kWatchMask);
+    if (wd < 0) {
+      return false;
+    }
+    watch_paths_[wd] = path;
+    std::error_code error;
+    for (const auto& entry :
+         std::filesystem::directory_iterator(path, error)) {
+      if (entry.is_directory() && !entry.is_symlink()) {
+        AddWatches(entry.path());
+      }
+    }
+    return true;
+  }
+
+  void ThreadMain() {
+    alignas(inotify_event) char buffer[4096];
+    pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {stop_pipe_[0], POLLIN, 0}};
+    while (true) {
+      if (poll(fds, 2, -1) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return;
+      }
+      if (fds[1].revents) {
+        return;
+      }
+      ssize_t length;
+      while ((length = read(inotify_fd_, buffer, sizeof(buffer))) > 0) {
+        for (char* p = buffer; p < buffer + length;) {
+          auto event = reinterpret_cast<const inotify_event*>(p);
+          p += sizeof(inotify_event) + event->len;
+          if (event->mask & IN_Q_OVERFLOW) {
+            callback_({});
+            continue;
+          }
+          auto it = watch_paths_.find(event->wd);
+          if (it == watch_paths_.end()) {
+            continue;
+          }
+          if (event->mask & IN_IGNORED) {
+            // The directory was removed.
+            watch_paths_.erase(it);
+            continue;
+          }
+          std::filesystem::path path = it->second;
+          if (event->len) {
+            path /= event->name;
+          }
+          if ((event->mask & IN_ISDIR) &&
+              (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+            AddWatches(path);
+          }
+          callback_(path);
+        }
+      }
+    }
+  }
+
+  ChangeCallback callback_;
+  int inotify_fd_ = -1;
+  int stop_pipe_[2] = {-1, -1};
+  // Only accessed by the watcher thread after initialization.
+  std::unordered_map<int, std::filesystem::path> watch_paths_;
+  std::unique_ptr<xe::threading::Thread> thread_;
+};
+
+std::unique_ptr<DirectoryWatcher> DirectoryWatcher::Create(
+    const std::filesystem::path& root_path, ChangeCallback callback) {
+  auto watcher = std::make_unique<PosixDirectoryWatcher>(std::move(callback));
+  if (!watcher->Initialize(root_path)) {
+    return nullptr;
+  }
+  return std::move(watcher);
+}
+
 }  // namespace filesystem
 }  // namespace xe
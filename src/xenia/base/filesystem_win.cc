@@ -18,6 +18,7 @@
 #include "xenia/base/logging.h"
 #include "xenia/base/platform_win.h"
 #include "xenia/base/string.h"
+#include "xenia/base/threading.h"
 
 namespace xe {
 
@@ -203,6 +204,36 @@ std::unique_ptr<FileHandle> FileHandle::OpenExisting(
   return std::make_unique<Win32FileHandle>(path, handle);
 }
 
+class Win32FileLock : public FileLock {
+ public:
+  explicit Win32FileLock(HANDLE handle) : handle_(handle) {}
+  ~Win32FileLock() override {
+    // Closing the handle releases the lock.
+    CloseHandle(handle_);
+  }
+
+ private:
+  HANDLE handle_;
+};
+
+std::unique_ptr<FileLock> FileLock::TryAcquire(
+    const std::filesystem::path& path) {
+  HANDLE handle = CreateFileW(
+      path.c_str(), GENERIC_READ | GENERIC_WRITE,
+      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+      OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (handle == INVALID_HANDLE_VALUE) {
+    return nullptr;
+  }
+  OVERLAPPED overlapped = {};
+  if (!LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY,
+                  0, 1, 0, &overlapped)) {
+    CloseHandle(handle);
+    return nullptr;
+  }
+  return std::make_unique<Win32FileLock>(handle);
+}
+
 #define COMBINE_TIME(t) (((uint64_t)t.dwHighDateTime << 32) | t.dwLowDateTime)
 
 bool GetInfo(const std::filesystem::path& path, FileInfo* out_info) {
@@ -261,5 +292,113 @@ std::vector<FileInfo> ListFiles(const std::filesystem::path& path) {
   return result;
 }
 
+class Win32DirectoryWatcher : public DirectoryWatcher {
+ public:
+  Win32DirectoryWatcher(const std::filesystem::path& root_path,
+                        ChangeCallback callback)
+      : root_path_(root_path), callback_(std::move(callback)) {}
+
+  ~Win32DirectoryWatcher() override {
+    if (thread_) {
+      SetEvent(stop_event_);
+      xe::threading::Wait(thread_.get(), false);
+    }
+    for (HANDLE handle : {stop_event_, overlapped_.hEvent}) {
+      if (handle) {
+        CloseHandle(handle);
+      }
+    }
+    if (directory_ != INVALID_HANDLE_VALUE) {
+      CloseHandle(directory_);
+    }
+  }
+
+  bool Initialize() {
+    directory_ = CreateFileW(
+        root_path_.c_str(), FILE_LIST_DIRECTORY,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+        nullptr);
+    if (directory_ == INVALID_HANDLE_VALUE) {
+      return false;
+    }
+    stop_event_ = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    overlapped_.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    if (!stop_event_ || !overlapped_.hEvent) {
+      return false;
+    }
+    thread_ = xe::threading::Thread::Create({}, [this]() { ThreadMain(); });
+    if (!thread_) {
+      return false;
+    }
+    thread_->set_name("Directory Watcher");
+    return true;
+  }
+
+ private:
+  void ThreadMain() {
+    while (true) {
+      ResetEvent(overlapped_.hEvent);
+      if (!ReadDirectoryChangesW(
+              directory_, buffer_, sizeof(buffer_), TRUE,
+              FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME |
+                  FILE_NOTIFY_CHANGE_ATTRIBUTES | FILE_NOTIFY_CHANGE_SIZE |
+                  FILE_NOTIFY_CHANGE_LAST_WRITE,
+              nullptr, &overlapped_, nullptr)) {
+        XELOGE("ReadDirectoryChangesW failed for {}",
+               xe::path_to_utf8(root_path_));
+        return;
+      }
+      HANDLE wait_handles[] = {stop_event_, overlapped_.hEvent};
+      DWORD bytes_returned;
+      if (WaitForMultipleObjects(2, wait_handles, FALSE, INFINITE) !=
+          WAIT_OBJECT_0 + 1) {
+        CancelIoEx(directory_, &overlapped_);
+        GetOverlappedResult(directory_, &overlapped_, &bytes_returned, TRUE);
+        return;
+      }
+      if (!GetOverlappedResult(directory_, &overlapped_, &bytes_returned,
+                               FALSE)) {
+        return;
+      }
+      if (!bytes_returned) {
+        // The buffer overflowed.
+        callback_({});
+        continue;
+      }
+      auto buffer = reinterpret_cast<const uint8_t*>(buffer_);
+      while (true) {
+        auto info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(buffer);
+        callback_(root_path_ /
+                  std::wstring_view(info->FileName,
+                                    info->FileNameLength / sizeof(WCHAR)));
+        if (!info->NextEntryOffset) {
+          break;
+        }
+        buffer += info->NextEntryOffset;
+      }
+    }
+  }
+
+  std::filesystem::path root_path_;
+  ChangeCallback callback_;
+  HANDLE directory_ = INVALID_HANDLE_VALUE;
+  HANDLE stop_event_ = nullptr;
+  OVERLAPPED overlapped_ = {};
+  // ReadDirectoryChangesW requires DWORD alignment.
+  DWORD buffer_[16384];
+  std::unique_ptr<xe::threading::Thread> thread_;
+};
+
+std::unique_ptr<DirectoryWatcher> DirectoryWatcher::Create(
+    const std::filesystem::path& root_path, ChangeCallback callback) {
+  auto watcher =
+      std::make_unique<Win32DirectoryWatcher>(root_path, std::move(callback));
+  if (!watcher->Initialize()) {
+    return nullptr;
+  }
+  return std::move(watcher);
+}
+
 }  // namespace filesystem
 }  // namespace xe
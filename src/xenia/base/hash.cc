@@ -0,0 +1,58 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/hash.h"
+
+#include <algorithm>
+
+namespace xe {
+namespace hash {
+
+// Seed of the second lane of the 128-bit hashes, the 64-bit golden ratio.
+constexpr uint64_t kHash128HighSeed = 0x9E3779B97F4A7C15ull;
+// Both lanes are fed with the same chunk before moving to the next one, so
+// the second lane reads the data from the L1 cache rather than from the
+// memory.
+constexpr size_t kHash128ChunkSize = 4096;
+
+uint64_t Hash64(const void* data, size_t size, uint64_t seed) {
+  return XXH64(data, size, seed);
+}
+
+Hash128 ContentHash128(const void* data, size_t size) {
+  if (size <= kHash128ChunkSize) {
+    return {XXH64(data, size, 0), XXH64(data, size, kHash128HighSeed)};
+  }
+  StreamingHash128 hash;
+  hash.Update(data, size);
+  return hash.Digest();
+}
+
+void StreamingHash128::Reset() {
+  XXH64_reset(&low_state_, 0);
+  XXH64_reset(&high_state_, kHash128HighSeed);
+}
+
+void StreamingHash128::Update(const void* data, size_t size) {
+  auto bytes = static_cast<const uint8_t*>(data);
+  while (size) {
+    size_t chunk_size = std::min(size, kHash128ChunkSize);
+    XXH64_update(&low_state_, bytes, chunk_size);
+    XXH64_update(&high_state_, bytes, chunk_size);
+    bytes += chunk_size;
+    size -= chunk_size;
+  }
+}
+
+Hash128 StreamingHash128::Digest() const {
+  return {XXH64_digest(&low_state_), XXH64_digest(&high_state_)};
+}
+
+}  // namespace hash
+}  // namespace xe
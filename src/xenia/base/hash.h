@@ -11,10 +11,72 @@
 #define XENIA_BASE_HASH_H_
 
 #include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "third_party/xxhash/xxhash.h"
 
 namespace xe {
 namespace hash {
 
+// Hashing of cache keys and of guest and host data. The 64-bit hashes are
+// XXH64, so they match the hashes already stored in the existing caches.
+uint64_t Hash64(const void* data, size_t size, uint64_t seed = 0);
+
+// For fixed-size keys, which must have no uninitialized padding.
+template <typename T>
+uint64_t HashKey(const T& key, uint64_t seed = 0) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  return Hash64(&key, sizeof(key), seed);
+}
+
+// For content addressing, where a collision would result in wrong data being
+// used rather than just a slower lookup. low is the Hash64 of the data.
+struct Hash128 {
+  uint64_t low;
+  uint64_t high;
+
+  bool operator==(const Hash128& other) const {
+    return low == other.low && high == other.high;
+  }
+  bool operator!=(const Hash128& other) const { return !(*this == other); }
+};
+
+Hash128 ContentHash128(const void* data, size_t size);
+
+// For hashing keys built from multiple parts.
+class StreamingHash64 {
+ public:
+  explicit StreamingHash64(uint64_t seed = 0) { Reset(seed); }
+
+  void Reset(uint64_t seed = 0) { XXH64_reset(&state_, seed); }
+  void Update(const void* data, size_t size) {
+    XXH64_update(&state_, data, size);
+  }
+  template <typename T>
+  void UpdateKey(const T& key) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    Update(&key, sizeof(key));
+  }
+  uint64_t Digest() const { return XXH64_digest(&state_); }
+
+ private:
+  XXH64_state_t state_;
+};
+
+class StreamingHash128 {
+ public:
+  StreamingHash128() { Reset(); }
+
+  void Reset();
+  void Update(const void* data, size_t size);
+  Hash128 Digest() const;
+
+ private:
+  XXH64_state_t low_state_;
+  XXH64_state_t high_state_;
+};
+
 // For use in unordered_sets and unordered_maps (primarily multisets and
 // multimaps, with manual collision resolution), where the hash is calculated
 // externally (for instance, as XXH64), possibly requiring context data rather
@@ -24,6 +86,12 @@ struct IdentityHasher {
   size_t operator()(const Key& key) const { return static_cast<size_t>(key); }
 };
 
+struct Hash128Hasher {
+  size_t operator()(const Hash128& hash) const {
+    return static_cast<size_t>(hash.low);
+  }
+};
+
 }  // namespace hash
 }  // namespace xe
 
@@ -0,0 +1,244 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/input_latency.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/base/profiling.h"
+#include "xenia/base/string_buffer.h"
+
+DEFINE_bool(input_latency_instrumentation, false,
+            "Measure the latency from controller input changes to the "
+            "presentation of the guest frames reacting to them, publishing "
+            "histograms to the profiler counters and summaries to the log.",
+            "General");
+
+namespace xe {
+namespace input_latency {
+
+namespace {
+
+// Upper bounds of the histogram buckets, the last one is unbounded.
+constexpr uint32_t kBucketBoundsMs[] = {8, 16, 24, 33, 50, 66, 100, 150, 250};
+constexpr size_t kBucketCount = xe::countof(kBucketBoundsMs) + 1;
+
+constexpr uint64_t kSummaryIntervalMs = 10000;
+
+enum class Stage {
+  // From the input change to the guest swap.
+  kInputToSwap,
+  // From the guest swap to queueing the presentation.
+  kSwapToPresent,
+  kInputToPresent,
+
+  kCount,
+};
+constexpr const char* kStageNames[] = {
+    "input_to_swap",
+    "swap_to_present",
+    "input_to_present",
+};
+static_assert(xe::countof(kStageNames) == size_t(Stage::kCount));
+
+struct Histogram {
+  uint64_t bucket_counts[kBucketCount] = {};
+  uint64_t count = 0;
+  uint64_t sum_us = 0;
+  uint64_t min_us = UINT64_MAX;
+  uint64_t max_us = 0;
+#if XE_OPTION_PROFILING
+  MicroProfileToken bucket_tokens[kBucketCount];
+  MicroProfileToken last_token;
+#endif  // XE_OPTION_PROFILING
+};
+
+class Tracker {
+ public:
+  Tracker() {
+#if XE_OPTION_PROFILING
+    for (size_t i = 0; i < size_t(Stage::kCount); ++i) {
+      Histogram& histogram = histograms_[i];
+      for (size_t j = 0; j < kBucketCount; ++j) {
+        histogram.bucket_tokens[j] = MicroProfileGetCounterToken(
+            fmt::format("input_latency/{}/{}", kStageNames[i],
+                        GetBucketName(j))
+                .c_str());
+      }
+      histogram.last_token = MicroProfileGetCounterToken(
+          fmt::format("input_latency/{}/last_us", kStageNames[i]).c_str());
+    }
+#endif  // XE_OPTION_PROFILING
+  }
+
+  void RecordInputChange() {
+    uint64_t ticks = Clock::QueryHostTickCount();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!pending_input_ticks_) {
+      pending_input_ticks_ = ticks;
+    }
+  }
+
+  void RecordGuestSwap() {
+    uint64_t ticks = Clock::QueryHostTickCount();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!pending_input_ticks_) {
+      return;
+    }
+    // If the previous swapped frame hasn't been taken, it was skipped, and
+    // this one carries its input instead.
+    if (!swapped_input_ticks_) {
+      swapped_input_ticks_ = pending_input_ticks_;
+      swapped_ticks_ = ticks;
+      AddSample(Stage::kInputToSwap, ticks - pending_input_ticks_);
+    }
+    pending_input_ticks_ = 0;
+  }
+
+  void RecordFrameTaken() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!swapped_input_ticks_) {
+      return;
+    }
+    if (!taken_input_ticks_) {
+      taken_input_ticks_ = swapped_input_ticks_;
+      taken_swap_ticks_ = swapped_ticks_;
+    }
+    swapped_input_ticks_ = 0;
+    swapped_ticks_ = 0;
+  }
+
+  void RecordPresent() {
+    uint64_t ticks = Clock::QueryHostTickCount();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (taken_input_ticks_) {
+      AddSample(Stage::kSwapToPresent, ticks - taken_swap_ticks_);
+      AddSample(Stage::kInputToPresent, ticks - taken_input_ticks_);
+      taken_input_ticks_ = 0;
+      taken_swap_ticks_ = 0;
+    }
+    uint64_t now_ms = Clock::QueryHostUptimeMillis();
+    if (!last_summary_ms_) {
+      last_summary_ms_ = now_ms;
+    } else if (now_ms - last_summary_ms_ >= kSummaryIntervalMs) {
+      last_summary_ms_ = now_ms;
+      LogSummary();
+    }
+  }
+
+ private:
+  static std::string GetBucketName(size_t bucket) {
+    if (bucket < xe::countof(kBucketBoundsMs)) {
+      return fmt::format("under_{}ms", kBucketBoundsMs[bucket]);
+    }
+    return fmt::format("{}ms_or_more", kBucketBoundsMs[bucket - 1]);
+  }
+
+  void AddSample(Stage stage, uint64_t ticks) {
+    uint64_t us = ticks * 1000000 / Clock::QueryHostTickFrequency();
+    size_t bucket = 0;
+    while (bucket < xe::countof(kBucketBoundsMs) &&
+           us >= uint64_t(kBucketBoundsMs[bucket]) * 1000) {
+      ++bucket;
+    }
+    Histogram& histogram = histograms_[size_t(stage)];
+    ++histogram.bucket_counts[bucket];
+    ++histogram.count;
+    histogram.sum_us += us;
+    histogram.min_us = std::min(histogram.min_us, us);
+    histogram.max_us = std::max(histogram.max_us, us);
+#if XE_OPTION_PROFILING
+    MicroProfileCounterSet(histogram.bucket_tokens[bucket],
+                           int64_t(histogram.bucket_counts[bucket]));
+    MicroProfileCounterSet(histogram.last_token, int64_t(us));
+#endif  // XE_OPTION_PROFILING
+  }
+
+  void LogSummary() const {
+    StringBuffer summary;
+    summary.Append("Input latency since the start:");
+    for (size_t i = 0; i < size_t(Stage::kCount); ++i) {
+      const Histogram& histogram = histograms_[i];
+      summary.AppendFormat("\n  {}: ", kStageNames[i]);
+      if (!histogram.count) {
+        summary.Append("no samples");
+        continue;
+      }
+      summary.AppendFormat(
+          "{} samples, average {:.1f} ms, min {:.1f} ms, max {:.1f} ms",
+          histogram.count,
+          double(histogram.sum_us) / double(histogram.count) / 1000.0,
+          double(histogram.min_us) / 1000.0,
+          double(histogram.max_us) / 1000.0);
+      for (size_t j = 0; j < kBucketCount; ++j) {
+        if (histogram.bucket_counts[j]) {
+          summary.AppendFormat("\n    {}: {}", GetBucketName(j),
+                               histogram.bucket_counts[j]);
+        }
+      }
+    }
+    XELOGI("{}", summary.to_string_view());
+  }
+
+  std::mutex mutex_;
+  // Host ticks of the earliest input change not attributed to a frame yet.
+  uint64_t pending_input_ticks_ = 0;
+  // Input and swap ticks of the latest frame not taken for presentation yet.
+  uint64_t swapped_input_ticks_ = 0;
+  uint64_t swapped_ticks_ = 0;
+  // Input and swap ticks of the frame taken but not presented yet.
+  uint64_t taken_input_ticks_ = 0;
+  uint64_t taken_swap_ticks_ = 0;
+  uint64_t last_summary_ms_ = 0;
+  Histogram histograms_[size_t(Stage::kCount)];
+};
+
+Tracker& GetTracker() {
+  static Tracker tracker;
+  return tracker;
+}
+
+}  // namespace
+
+bool IsEnabled() { return cvars::input_latency_instrumentation; }
+
+void RecordInputChange() {
+  if (IsEnabled()) {
+    GetTracker().RecordInputChange();
+  }
+}
+
+void RecordGuestSwap() {
+  if (IsEnabled()) {
+    GetTracker().RecordGuestSwap();
+  }
+}
+
+void RecordFrameTaken() {
+  if (IsEnabled()) {
+    GetTracker().RecordFrameTaken();
+  }
+}
+
+void RecordPresent() {
+  if (IsEnabled()) {
+    GetTracker().RecordPresent();
+  }
+}
+
+}  // namespace input_latency
+}  // namespace xe
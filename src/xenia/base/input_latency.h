@@ -0,0 +1,38 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BASE_INPUT_LATENCY_H_
+#define XENIA_BASE_INPUT_LATENCY_H_
+
+namespace xe {
+namespace input_latency {
+
+// Instrumentation of the latency from a change of the host input to the
+// presentation of the first guest frame that could have reacted to it, enabled
+// with the input_latency_instrumentation cvar. The earliest input change not
+// attributed to a frame yet is carried through the stages below. The latencies
+// are published as histograms in the profiler counters and summarized in the
+// log periodically.
+
+bool IsEnabled();
+
+// The input system has seen the controller state change.
+void RecordInputChange();
+// The guest has issued a swap of a frame, which could have reacted to the
+// input changes recorded before.
+void RecordGuestSwap();
+// The host has taken the latest guest frame for presentation.
+void RecordFrameTaken();
+// The host has queued the presentation, so the frame taken last will be shown.
+void RecordPresent();
+
+}  // namespace input_latency
+}  // namespace xe
+
+#endif  // XENIA_BASE_INPUT_LATENCY_H_
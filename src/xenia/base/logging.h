@@ -10,9 +10,15 @@
 #ifndef XENIA_BASE_LOGGING_H_
 #define XENIA_BASE_LOGGING_H_
 
+#include <algorithm>
 #include <cstdarg>
 #include <cstdint>
+#include <cstring>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/string.h"
@@ -47,6 +53,141 @@ std::pair<char*, size_t> GetThreadBuffer();
 
 void AppendLogLine(LogLevel log_level, const char prefix_char, size_t written);
 
+// Deferred formatting (the log_deferred_format cvar): instead of the text, the
+// thread buffer receives a DeferredLogHeader followed by the arguments, and the
+// writer thread formats the line by calling the formatter from the header.
+// Only arguments that can be copied as plain values or as string contents are
+// supported, lines with other arguments are formatted immediately.
+bool ShouldDeferFormat();
+void AppendDeferredLogLine(LogLevel log_level, const char prefix_char,
+                           size_t written);
+
+template <typename T>
+constexpr bool IsDeferredLogString() {
+  using U = std::decay_t<T>;
+  return std::is_same_v<U, std::string> ||
+         std::is_same_v<U, std::string_view> ||
+         std::is_same_v<U, const char*> || std::is_same_v<U, char*>;
+}
+template <typename T>
+constexpr bool IsDeferredLogValue() {
+  using U = std::decay_t<T>;
+  return std::is_arithmetic_v<U> || std::is_enum_v<U> ||
+         std::is_same_v<U, const void*> || std::is_same_v<U, void*>;
+}
+template <typename T>
+constexpr bool IsDeferredLogArg() {
+  return IsDeferredLogString<T>() || IsDeferredLogValue<T>();
+}
+// Strings are decoded as views of the copy in the line data.
+template <typename T>
+using DeferredLogArgType =
+    std::conditional_t<IsDeferredLogString<T>(), std::string_view,
+                       std::decay_t<T>>;
+
+// Formats into the output buffer, returning the length of the text, which may
+// be larger than the buffer if it was truncated.
+using DeferredLogFormatter = size_t (*)(const char* format,
+                                        const uint8_t* args_data, char* out,
+                                        size_t out_size);
+
+struct DeferredLogHeader {
+  DeferredLogFormatter formatter;
+  // Must stay valid until the line is written, thus must be a literal.
+  const char* format;
+};
+
+class DeferredLogArgWriter {
+ public:
+  DeferredLogArgWriter(char* data, size_t size) : data_(data), size_(size) {}
+  size_t offset() const { return offset_; }
+
+  template <typename T>
+  void Put(const T& value) {
+    if constexpr (IsDeferredLogString<T>()) {
+      std::string_view str;
+      if constexpr (std::is_pointer_v<std::decay_t<T>>) {
+        if (value) {
+          str = value;
+        }
+      } else {
+        str = value;
+      }
+      // Truncate the string rather than dropping the line if it doesn't fit.
+      uint32_t length = uint32_t(std::min(
+          str.size(), size_ - std::min(size_, offset_ + sizeof(uint32_t))));
+      PutBytes(&length, sizeof(length));
+      PutBytes(str.data(), length);
+    } else {
+      std::decay_t<T> copy = value;
+      PutBytes(&copy, sizeof(copy));
+    }
+  }
+
+ private:
+  void PutBytes(const void* bytes, size_t length) {
+    length = std::min(length, size_ - offset_);
+    std::memcpy(data_ + offset_, bytes, length);
+    offset_ += length;
+  }
+
+  char* data_;
+  size_t size_;
+  size_t offset_ = 0;
+};
+
+class DeferredLogArgReader {
+ public:
+  explicit DeferredLogArgReader(const uint8_t* data) : data_(data) {}
+
+  template <typename T>
+  DeferredLogArgType<T> Get() {
+    if constexpr (IsDeferredLogString<T>()) {
+      uint32_t length;
+      std::memcpy(&length, data_, sizeof(length));
+      auto str = std::string_view(
+          reinterpret_cast<const char*>(data_ + sizeof(length)), length);
+      data_ += sizeof(length) + length;
+      return str;
+    } else {
+      std::decay_t<T> value;
+      std::memcpy(&value, data_, sizeof(value));
+      data_ += sizeof(value);
+      return value;
+    }
+  }
+
+ private:
+  const uint8_t* data_;
+};
+
+template <typename... Args>
+size_t FormatDeferredLogLine(const char* format, const uint8_t* args_data,
+                             char* out, size_t out_size) {
+  DeferredLogArgReader reader(args_data);
+  // Braced initialization to decode the arguments in order.
+  std::tuple<DeferredLogArgType<Args>...> args{reader.Get<Args>()...};
+  return std::apply(
+      [&](const auto&... decoded_args) {
+        return fmt::format_to_n(out, out_size, format, decoded_args...).size;
+      },
+      args);
+}
+
+// Returns the size of the line data written to the buffer.
+template <typename... Args>
+size_t EncodeDeferredLogLine(char* buffer, size_t buffer_size,
+                             const char* format, const Args&... args) {
+  DeferredLogHeader header;
+  header.formatter = FormatDeferredLogLine<Args...>;
+  header.format = format;
+  std::memcpy(buffer, &header, sizeof(header));
+  DeferredLogArgWriter writer(buffer + sizeof(header),
+                              buffer_size - sizeof(header));
+  (writer.Put(args), ...);
+  return sizeof(header) + writer.offset();
+}
+
 }  // namespace internal
 
 // Appends a line to the log with {fmt}-style formatting.
@@ -57,6 +198,14 @@ void AppendLogLineFormat(LogLevel log_level, const char prefix_char,
     return;
   }
   auto target = internal::GetThreadBuffer();
+  if constexpr ((internal::IsDeferredLogArg<Args>() && ...)) {
+    if (internal::ShouldDeferFormat()) {
+      size_t written = internal::EncodeDeferredLogLine(
+          target.first, target.second, format, args...);
+      internal::AppendDeferredLogLine(log_level, prefix_char, written);
+      return;
+    }
+  }
   auto result = fmt::format_to_n(target.first, target.second, format, args...);
   internal::AppendLogLine(log_level, prefix_char, result.size);
 }
@@ -8,13 +8,34 @@
  */
 
 #include "xenia/base/memory.h"
+#include "xenia/base/math.h"
 #include "xenia/base/platform.h"
 
 #include <algorithm>
+#include <atomic>
+
+#if XE_ARCH_AMD64 && !XE_COMPILER_MSVC
+#include <cpuid.h>
+#endif  // XE_ARCH_AMD64 && !XE_COMPILER_MSVC
 
 namespace xe {
 
-// TODO(benvanik): fancy AVX versions.
+namespace memory {
+
+namespace {
+std::atomic<int32_t> preferred_numa_node_{-1};
+}  // namespace
+
+void set_preferred_numa_node(int32_t node) {
+  preferred_numa_node_.store(node, std::memory_order_relaxed);
+}
+
+int32_t preferred_numa_node() {
+  return preferred_numa_node_.load(std::memory_order_relaxed);
+}
+
+}  // namespace memory
+
 // https://github.com/gnuradio/volk/blob/master/kernels/volk/volk_16u_byteswap.h
 // https://github.com/gnuradio/volk/blob/master/kernels/volk/volk_32u_byteswap.h
 // https://github.com/gnuradio/volk/blob/master/kernels/volk/volk_64u_byteswap.h
@@ -28,10 +49,200 @@ void copy_128_aligned(void* dest, const void* src, size_t count) {
 }
 
 #if XE_ARCH_AMD64
+#if XE_COMPILER_MSVC
+#define XE_TARGET_AVX2
+#define XE_TARGET_AVX512
+#define XE_TARGET_XSAVE
+#else
+#define XE_TARGET_AVX2 __attribute__((target("avx2")))
+#define XE_TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#define XE_TARGET_XSAVE __attribute__((target("xsave")))
+#endif  // XE_COMPILER_MSVC
+
+namespace {
+
+// Copies of at least this many bytes are done with non-temporal stores.
+constexpr size_t kCopyAndSwapNonTemporalSize = 1024 * 1024;
+
+// pshufb control reversing the bytes of every element, for vectors of up to
+// 512 bits.
+template <typename T>
+struct CopyAndSwapShuffleMask {
+  constexpr CopyAndSwapShuffleMask() : bytes() {
+    for (size_t i = 0; i < sizeof(bytes); ++i) {
+      // Indices are relative to each 128-bit lane.
+      size_t lane_byte = i & 15;
+      size_t element_byte = lane_byte % sizeof(T);
+      bytes[i] = uint8_t(lane_byte - element_byte + sizeof(T) - 1 -
+                         element_byte);
+    }
+  }
+  alignas(64) uint8_t bytes[64];
+};
+template <typename T>
+constexpr CopyAndSwapShuffleMask<T> kCopyAndSwapShuffleMask;
+
+template <typename T>
+void copy_and_swap_scalar(uint8_t* dest, const uint8_t* src, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    T value;
+    std::memcpy(&value, src + i * sizeof(T), sizeof(T));
+    value = byte_swap(value);
+    std::memcpy(dest + i * sizeof(T), &value, sizeof(T));
+  }
+}
+
+// Stores are aligned for non-temporal copies, loads never are, but on the
+// CPUs supporting AVX2 unaligned loads of aligned data are as fast as aligned
+// ones.
+template <typename T>
+XE_TARGET_AVX2 void copy_and_swap_avx2(void* dest_ptr, const void* src_ptr,
+                                       size_t count) {
+  auto dest = reinterpret_cast<uint8_t*>(dest_ptr);
+  auto src = reinterpret_cast<const uint8_t*>(src_ptr);
+  size_t size = count * sizeof(T);
+  __m256i shufmask = _mm256_load_si256(
+      reinterpret_cast<const __m256i*>(kCopyAndSwapShuffleMask<T>.bytes));
+  size_t i = 0;
+  if (size >= kCopyAndSwapNonTemporalSize &&
+      !(reinterpret_cast<uintptr_t>(dest) & (sizeof(T) - 1))) {
+    i = (32 - (reinterpret_cast<uintptr_t>(dest) & 31)) & 31;
+    copy_and_swap_scalar<T>(dest, src, i / sizeof(T));
+    for (; i + 32 <= size; i += 32) {
+      __m256i input =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+      __m256i output = _mm256_shuffle_epi8(input, shufmask);
+      _mm256_stream_si256(reinterpret_cast<__m256i*>(dest + i), output);
+    }
+    _mm_sfence();
+  } else {
+    for (; i + 32 <= size; i += 32) {
+      __m256i input =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+      __m256i output = _mm256_shuffle_epi8(input, shufmask);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), output);
+    }
+  }
+  copy_and_swap_scalar<T>(dest + i, src + i, (size - i) / sizeof(T));
+}
+
+template <typename T>
+XE_TARGET_AVX512 void copy_and_swap_avx512(void* dest_ptr,
+                                           const void* src_ptr, size_t count) {
+  auto dest = reinterpret_cast<uint8_t*>(dest_ptr);
+  auto src = reinterpret_cast<const uint8_t*>(src_ptr);
+  size_t size = count * sizeof(T);
+  __m512i shufmask = _mm512_load_si512(kCopyAndSwapShuffleMask<T>.bytes);
+  size_t i = 0;
+  if (size >= kCopyAndSwapNonTemporalSize &&
+      !(reinterpret_cast<uintptr_t>(dest) & (sizeof(T) - 1))) {
+    i = (64 - (reinterpret_cast<uintptr_t>(dest) & 63)) & 63;
+    copy_and_swap_scalar<T>(dest, src, i / sizeof(T));
+    for (; i + 64 <= size; i += 64) {
+      __m512i input = _mm512_loadu_si512(src + i);
+      __m512i output = _mm512_shuffle_epi8(input, shufmask);
+      _mm512_stream_si512(reinterpret_cast<__m512i*>(dest + i), output);
+    }
+    _mm_sfence();
+  } else {
+    for (; i + 64 <= size; i += 64) {
+      __m512i input = _mm512_loadu_si512(src + i);
+      __m512i output = _mm512_shuffle_epi8(input, shufmask);
+      _mm512_storeu_si512(dest + i, output);
+    }
+  }
+  copy_and_swap_scalar<T>(dest + i, src + i, (size - i) / sizeof(T));
+}
+
+XE_TARGET_XSAVE uint64_t get_xcr0() { return _xgetbv(0); }
+
+CopyAndSwapExtension get_supported_copy_and_swap_extension() {
+  int registers[4];
+#if XE_COMPILER_MSVC
+  __cpuid(registers, 0);
+#else
+  __cpuid(0, registers[0], registers[1], registers[2], registers[3]);
+#endif  // XE_COMPILER_MSVC
+  if (registers[0] < 7) {
+    return CopyAndSwapExtension::kBaseline;
+  }
+#if XE_COMPILER_MSVC
+  __cpuid(registers, 1);
+#else
+  __cpuid(1, registers[0], registers[1], registers[2], registers[3]);
+#endif  // XE_COMPILER_MSVC
+  // The OS must save the YMM registers (and the ZMM ones for AVX-512).
+  if (!(registers[2] & (1 << 27)) || (get_xcr0() & 0x6) != 0x6) {
+    return CopyAndSwapExtension::kBaseline;
+  }
+  uint64_t xcr0 = get_xcr0();
+#if XE_COMPILER_MSVC
+  __cpuidex(registers, 7, 0);
+#else
+  __cpuid_count(7, 0, registers[0], registers[1], registers[2], registers[3]);
+#endif  // XE_COMPILER_MSVC
+  uint32_t features = uint32_t(registers[1]);
+  // AVX512F and AVX512BW.
+  if ((features & (1u << 16)) && (features & (1u << 30)) &&
+      (xcr0 & 0xE0) == 0xE0) {
+    return CopyAndSwapExtension::kAVX512;
+  }
+  if (features & (1u << 5)) {
+    return CopyAndSwapExtension::kAVX2;
+  }
+  return CopyAndSwapExtension::kBaseline;
+}
+
+struct CopyAndSwapFunctions {
+  void (*copy_and_swap_16)(void* dest, const void* src, size_t count);
+  void (*copy_and_swap_32)(void* dest, const void* src, size_t count);
+  void (*copy_and_swap_64)(void* dest, const void* src, size_t count);
+};
+// Null (and the SSSE3 routines used) until chosen during static
+// initialization.
+CopyAndSwapFunctions copy_and_swap_functions_;
+CopyAndSwapExtension copy_and_swap_extension_ = CopyAndSwapExtension::kBaseline;
+
+struct CopyAndSwapInitializer {
+  CopyAndSwapInitializer() {
+    set_copy_and_swap_extension(CopyAndSwapExtension::kAVX512);
+  }
+} copy_and_swap_initializer_;
+
+}  // namespace
+
+CopyAndSwapExtension copy_and_swap_extension() {
+  return copy_and_swap_extension_;
+}
+
+void set_copy_and_swap_extension(CopyAndSwapExtension extension) {
+  static const CopyAndSwapExtension supported_extension =
+      get_supported_copy_and_swap_extension();
+  copy_and_swap_extension_ = std::min(extension, supported_extension);
+  switch (copy_and_swap_extension_) {
+    case CopyAndSwapExtension::kAVX512:
+      copy_and_swap_functions_ = {copy_and_swap_avx512<uint16_t>,
+                                  copy_and_swap_avx512<uint32_t>,
+                                  copy_and_swap_avx512<uint64_t>};
+      break;
+    case CopyAndSwapExtension::kAVX2:
+      copy_and_swap_functions_ = {copy_and_swap_avx2<uint16_t>,
+                                  copy_and_swap_avx2<uint32_t>,
+                                  copy_and_swap_avx2<uint64_t>};
+      break;
+    default:
+      copy_and_swap_functions_ = {};
+      break;
+  }
+}
+
 void copy_and_swap_16_aligned(void* dest_ptr, const void* src_ptr,
                               size_t count) {
   assert_zero(reinterpret_cast<uintptr_t>(dest_ptr) & 0xF);
   assert_zero(reinterpret_cast<uintptr_t>(src_ptr) & 0xF);
+  if (copy_and_swap_functions_.copy_and_swap_16) {
+    return copy_and_swap_functions_.copy_and_swap_16(dest_ptr, src_ptr, count);
+  }
 
   auto dest = reinterpret_cast<uint16_t*>(dest_ptr);
   auto src = reinterpret_cast<const uint16_t*>(src_ptr);
@@ -52,6 +263,9 @@ void copy_and_swap_16_aligned(void* dest_ptr, const void* src_ptr,
 
 void copy_and_swap_16_unaligned(void* dest_ptr, const void* src_ptr,
                                 size_t count) {
+  if (copy_and_swap_functions_.copy_and_swap_16) {
+    return copy_and_swap_functions_.copy_and_swap_16(dest_ptr, src_ptr, count);
+  }
   auto dest = reinterpret_cast<uint16_t*>(dest_ptr);
   auto src = reinterpret_cast<const uint16_t*>(src_ptr);
   __m128i shufmask =
@@ -73,6 +287,9 @@ void copy_and_swap_32_aligned(void* dest_ptr, const void* src_ptr,
                               size_t count) {
   assert_zero(reinterpret_cast<uintptr_t>(dest_ptr) & 0xF);
   assert_zero(reinterpret_cast<uintptr_t>(src_ptr) & 0xF);
+  if (copy_and_swap_functions_.copy_and_swap_32) {
+    return copy_and_swap_functions_.copy_and_swap_32(dest_ptr, src_ptr, count);
+  }
 
   auto dest = reinterpret_cast<uint32_t*>(dest_ptr);
   auto src = reinterpret_cast<const uint32_t*>(src_ptr);
@@ -93,6 +310,9 @@ void copy_and_swap_32_aligned(void* dest_ptr, const void* src_ptr,
 
 void copy_and_swap_32_unaligned(void* dest_ptr, const void* src_ptr,
                                 size_t count) {
+  if (copy_and_swap_functions_.copy_and_swap_32) {
+    return copy_and_swap_functions_.copy_and_swap_32(dest_ptr, src_ptr, count);
+  }
   auto dest = reinterpret_cast<uint32_t*>(dest_ptr);
   auto src = reinterpret_cast<const uint32_t*>(src_ptr);
   __m128i shufmask =
@@ -114,6 +334,9 @@ void copy_and_swap_64_aligned(void* dest_ptr, const void* src_ptr,
                               size_t count) {
   assert_zero(reinterpret_cast<uintptr_t>(dest_ptr) & 0xF);
   assert_zero(reinterpret_cast<uintptr_t>(src_ptr) & 0xF);
+  if (copy_and_swap_functions_.copy_and_swap_64) {
+    return copy_and_swap_functions_.copy_and_swap_64(dest_ptr, src_ptr, count);
+  }
 
   auto dest = reinterpret_cast<uint64_t*>(dest_ptr);
   auto src = reinterpret_cast<const uint64_t*>(src_ptr);
@@ -134,6 +357,9 @@ void copy_and_swap_64_aligned(void* dest_ptr, const void* src_ptr,
 
 void copy_and_swap_64_unaligned(void* dest_ptr, const void* src_ptr,
                                 size_t count) {
+  if (copy_and_swap_functions_.copy_and_swap_64) {
+    return copy_and_swap_functions_.copy_and_swap_64(dest_ptr, src_ptr, count);
+  }
   auto dest = reinterpret_cast<uint64_t*>(dest_ptr);
   auto src = reinterpret_cast<const uint64_t*>(src_ptr);
   __m128i shufmask =
@@ -235,6 +461,133 @@ void copy_and_swap_16_in_32_unaligned(void* dest_ptr, const void* src_ptr,
     dest[i] = (src[i] >> 16) | (src[i] << 16);
   }
 }
+
+CopyAndSwapExtension copy_and_swap_extension() {
+  return CopyAndSwapExtension::kBaseline;
+}
+
+void set_copy_and_swap_extension(CopyAndSwapExtension extension) {}
 #endif
 
+size_t find_first_difference(const void* a_ptr, const void* b_ptr,
+                             size_t size) {
+  auto a = reinterpret_cast<const uint8_t*>(a_ptr);
+  auto b = reinterpret_cast<const uint8_t*>(b_ptr);
+  size_t i = 0;
+#if XE_ARCH_AMD64
+  // Check 64 bytes at once and locate the difference in 16-byte steps.
+  for (; i + 64 <= size; i += 64) {
+    __m128i eq = _mm_set1_epi8(-1);
+    for (size_t j = 0; j < 64; j += 16) {
+      __m128i va =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(&a[i + j]));
+      __m128i vb =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(&b[i + j]));
+      eq = _mm_and_si128(eq, _mm_cmpeq_epi8(va, vb));
+    }
+    if (_mm_movemask_epi8(eq) != 0xFFFF) {
+      break;
+    }
+  }
+  for (; i + 16 <= size; i += 16) {
+    __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&a[i]));
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&b[i]));
+    uint32_t mask = uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)));
+    if (mask != 0xFFFF) {
+      return i + xe::tzcnt(~mask);
+    }
+  }
+#else
+  for (; i + 8 <= size; i += 8) {
+    uint64_t va, vb;
+    std::memcpy(&va, &a[i], sizeof(va));
+    std::memcpy(&vb, &b[i], sizeof(vb));
+    if (va != vb) {
+      break;
+    }
+  }
+#endif  // XE_ARCH_AMD64
+  for (; i < size && a[i] == b[i]; ++i) {
+  }
+  return i;
+}
+
+size_t count_leading_equal_32(const void* ptr, uint32_t value, size_t count) {
+  auto src = reinterpret_cast<const uint32_t*>(ptr);
+  size_t i = 0;
+#if XE_ARCH_AMD64
+  __m128i pattern = _mm_set1_epi32(int32_t(value));
+  for (; i + 16 <= count; i += 16) {
+    __m128i eq = _mm_set1_epi8(-1);
+    for (size_t j = 0; j < 16; j += 4) {
+      __m128i v =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i + j]));
+      eq = _mm_and_si128(eq, _mm_cmpeq_epi32(v, pattern));
+    }
+    if (_mm_movemask_epi8(eq) != 0xFFFF) {
+      break;
+    }
+  }
+  for (; i + 4 <= count; i += 4) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i]));
+    uint32_t mask = uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi32(v, pattern)));
+    if (mask != 0xFFFF) {
+      return i + xe::tzcnt(~mask) / 4;
+    }
+  }
+#endif  // XE_ARCH_AMD64
+  for (; i < count && src[i] == value; ++i) {
+  }
+  return i;
+}
+
+void fill_32(void* dest_ptr, uint32_t value, size_t count) {
+  auto dest = reinterpret_cast<uint32_t*>(dest_ptr);
+  size_t i = 0;
+#if XE_ARCH_AMD64
+  __m128i pattern = _mm_set1_epi32(int32_t(value));
+  for (; i + 16 <= count; i += 16) {
+    auto p = reinterpret_cast<__m128i*>(&dest[i]);
+    _mm_storeu_si128(p, pattern);
+    _mm_storeu_si128(p + 1, pattern);
+    _mm_storeu_si128(p + 2, pattern);
+    _mm_storeu_si128(p + 3, pattern);
+  }
+  for (; i + 4 <= count; i += 4) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&dest[i]), pattern);
+  }
+#endif  // XE_ARCH_AMD64
+  for (; i < count; ++i) {
+    dest[i] = value;
+  }
+}
+
+size_t find_zero_16(const uint16_t* ptr, size_t max_count) {
+  size_t i = 0;
+#if XE_ARCH_AMD64
+  // Only whole aligned vectors are loaded, so nothing past the 16 bytes
+  // containing the terminator is read. Unaligned elements would straddle the
+  // vectors, so they're scanned one by one.
+  if (!(reinterpret_cast<uintptr_t>(ptr) & 1)) {
+    for (; i < max_count && (reinterpret_cast<uintptr_t>(&ptr[i]) & 15);
+         ++i) {
+      if (!ptr[i]) {
+        return i;
+      }
+    }
+    __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= max_count; i += 8) {
+      __m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(&ptr[i]));
+      uint32_t mask = uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi16(v, zero)));
+      if (mask) {
+        return i + xe::tzcnt(mask) / 2;
+      }
+    }
+  }
+#endif  // XE_ARCH_AMD64
+  for (; i < max_count && ptr[i]; ++i) {
+  }
+  return i;
+}
+
 }  // namespace xe
@@ -15,6 +15,8 @@
 #include <filesystem>
 #include <functional>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_order.h"
@@ -30,6 +32,22 @@ size_t page_size();
 // This is likely 64KiB.
 size_t allocation_granularity();
 
+// Returns the size of large pages (likely 2MiB) if memory can be allocated
+// with AllocationType::kReserveCommitLargePages, or 0 if the system doesn't
+// support them or the process lacks the privilege to use them.
+size_t large_page_size();
+
+// Returns the number of NUMA nodes of the host system, 1 if it's not a NUMA
+// system or the topology can't be obtained.
+uint32_t numa_node_count();
+
+// Makes AllocFixed, CreateFileMappingHandle and MapFileView called from now on
+// prefer taking the physical memory from the NUMA node, falling back to other
+// nodes when it runs out. -1 (the default) leaves the choice to the system,
+// which usually takes the node of the thread first touching a page.
+void set_preferred_numa_node(int32_t node);
+int32_t preferred_numa_node();
+
 enum class PageAccess {
   kNoAccess = 0,
   kReadOnly = 1 << 0,
@@ -41,6 +59,9 @@ enum class AllocationType {
   kReserve = 1 << 0,
   kCommit = 1 << 1,
   kReserveCommit = kReserve | kCommit,
+  // Both base_address and length must be multiples of large_page_size().
+  // Fails rather than falling back to normal pages.
+  kReserveCommitLargePages = kReserveCommit | 1 << 2,
 };
 
 enum class DeallocationType {
@@ -65,6 +86,16 @@ bool DeallocFixed(void* base_address, size_t length,
 bool Protect(void* base_address, size_t length, PageAccess access,
              PageAccess* out_old_access = nullptr);
 
+// Hints the system to back the given range with large pages where possible,
+// falling back to normal pages transparently, and splitting large pages when
+// parts of them get different protection. Returns false if not supported.
+bool AdviseLargePages(void* base_address, size_t length);
+
+// Hints the system to start reading the pages of a mapped file in the given
+// range from storage asynchronously, as they will be accessed soon. Returns
+// false if not supported.
+bool AdvisePrefetch(const void* base_address, size_t length);
+
 // Queries a region of pages to get the access rights. This will modify the
 // length parameter to the length of pages with the same consecutive access
 // rights. The length will start from the first byte of the first page of
@@ -106,6 +137,30 @@ void* MapFileView(FileMappingHandle handle, void* base_address, size_t length,
                   PageAccess access, size_t file_offset);
 bool UnmapFileView(FileMappingHandle handle, void* base_address, size_t length);
 
+// Tracking of writes to pages by the OS, without access violations, polled by
+// the caller.
+//
+// Implemented with asynchronous userfaultfd write protection and PAGEMAP_SCAN
+// on Linux 6.7 and newer. GetWriteWatch on Windows only works with memory
+// allocated with MEM_WRITE_WATCH, not with views of file mappings, so creation
+// always fails there.
+typedef void* WriteWatchHandle;
+
+// Returns nullptr if write watches are not supported by the system.
+WriteWatchHandle CreateWriteWatch();
+void CloseWriteWatch(WriteWatchHandle handle);
+// Starts tracking writes to the pages of the range, forgetting the earlier
+// ones. The range must be mapped, and may be reset again after being remapped.
+bool ResetWriteWatch(WriteWatchHandle handle, void* base_address,
+                     size_t length);
+// Appends the (address, length) ranges of pages written to since they were
+// reset and resets them atomically, so a write racing with the call is
+// reported either by it or the next one. Fails if some pages in the range are
+// not tracked.
+bool GetAndResetWriteWatch(WriteWatchHandle handle, void* base_address,
+                           size_t length,
+                           std::vector<std::pair<void*, size_t>>& ranges_out);
+
 inline size_t hash_combine(size_t seed) { return seed; }
 
 template <typename T, typename... Ts>
@@ -125,6 +180,20 @@ inline void* low_address(void* address) {
 
 void copy_128_aligned(void* dest, const void* src, size_t count);
 
+// Widest vector instructions the copy_and_swap functions use, chosen at
+// runtime from what the CPU supports. Large copies (beyond the size of most
+// L2 caches) with AVX2 or AVX-512 use non-temporal stores, so they don't
+// evict data from the caches.
+enum class CopyAndSwapExtension {
+  kBaseline,
+  kAVX2,
+  kAVX512,
+};
+CopyAndSwapExtension copy_and_swap_extension();
+// Limits the instructions used to the given extension, or to the best one
+// supported if that's lower, for testing and benchmarking. Not thread-safe.
+void set_copy_and_swap_extension(CopyAndSwapExtension extension);
+
 void copy_and_swap_16_aligned(void* dest, const void* src, size_t count);
 void copy_and_swap_16_unaligned(void* dest, const void* src, size_t count);
 void copy_and_swap_32_aligned(void* dest, const void* src, size_t count);
@@ -135,6 +204,19 @@ void copy_and_swap_16_in_32_aligned(void* dest, const void* src, size_t count);
 void copy_and_swap_16_in_32_unaligned(void* dest, const void* src,
                                       size_t count);
 
+// Returns the number of leading bytes that are equal in both buffers, or size
+// if they're identical.
+size_t find_first_difference(const void* a, const void* b, size_t size);
+// Returns the number of leading 32-bit elements equal to value, which is
+// compared as stored in memory (byte swap it first for guest data).
+size_t count_leading_equal_32(const void* ptr, uint32_t value, size_t count);
+// Stores the 32-bit value count times, ptr only needs to be 4-byte aligned.
+void fill_32(void* dest, uint32_t value, size_t count);
+// Returns the index of the first zero 16-bit element, or max_count if there's
+// none before it. May read past the terminator, but never across a 16-byte
+// boundary, so it won't touch a page the string doesn't extend into.
+size_t find_zero_16(const uint16_t* ptr, size_t max_count);
+
 template <typename T>
 void copy_and_swap(T* dest, const T* src, size_t count) {
   bool is_aligned = reinterpret_cast<uintptr_t>(dest) % 32 == 0 &&
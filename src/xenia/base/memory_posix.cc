@@ -11,8 +11,22 @@
 #include "xenia/base/string.h"
 
 #include <fcntl.h>
+#include <linux/fs.h>
+#include <linux/mempolicy.h>
+#include <linux/userfaultfd.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
 #include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+
+// Asynchronous write protection and PAGEMAP_SCAN appeared in Linux 6.7.
+#if defined(PAGEMAP_SCAN) && defined(UFFD_FEATURE_WP_ASYNC)
+#define XE_MEMORY_WRITE_WATCH 1
+#else
+#define XE_MEMORY_WRITE_WATCH 0
+#endif
 
 namespace xe {
 namespace memory {
@@ -20,6 +34,67 @@ namespace memory {
 size_t page_size() { return getpagesize(); }
 size_t allocation_granularity() { return page_size(); }
 
+size_t large_page_size() {
+  // MAP_HUGETLB needs huge pages to have been reserved by the administrator
+  // (vm.nr_hugepages), so only report them if some are.
+  static size_t value = [] {
+    FILE* file = std::fopen("/proc/meminfo", "r");
+    if (!file) {
+      return size_t(0);
+    }
+    size_t total_count = 0;
+    size_t size_kb = 0;
+    char line[128];
+    while (std::fgets(line, sizeof(line), file)) {
+      std::sscanf(line, "HugePages_Total: %zu", &total_count);
+      std::sscanf(line, "Hugepagesize: %zu kB", &size_kb);
+    }
+    std::fclose(file);
+    return total_count ? size_kb * 1024 : size_t(0);
+  }();
+  return value;
+}
+
+uint32_t numa_node_count() {
+  // A CPU list style range such as "0-1".
+  static uint32_t value = [] {
+    FILE* file = std::fopen("/sys/devices/system/node/possible", "r");
+    if (!file) {
+      return uint32_t(1);
+    }
+    uint32_t count = 1;
+    unsigned int node;
+    while (std::fscanf(file, "%u", &node) == 1) {
+      count = std::max(count, uint32_t(node + 1));
+      int separator = std::fgetc(file);
+      if (separator != ',' && separator != '-') {
+        break;
+      }
+    }
+    std::fclose(file);
+    return count;
+  }();
+  return value;
+}
+
+namespace {
+
+// Sets the memory policy of the mapping so its pages are taken from the
+// preferred node when they're first touched. Done directly through the system
+// call as libnuma may be not installed.
+void ApplyPreferredNumaNode(void* base_address, size_t length) {
+  int32_t numa_node = preferred_numa_node();
+  if (numa_node < 0 || numa_node >= 64) {
+    return;
+  }
+  unsigned long node_mask = 1ul << numa_node;
+  // The kernel takes the number of bits of the mask plus one.
+  syscall(SYS_mbind, base_address, length, MPOL_PREFERRED, &node_mask,
+          sizeof(node_mask) * 8 + 1, 0);
+}
+
+}  // namespace
+
 uint32_t ToPosixProtectFlags(PageAccess access) {
   switch (access) {
     case PageAccess::kNoAccess:
@@ -40,7 +115,26 @@ void* AllocFixed(void* base_address, size_t length,
                  AllocationType allocation_type, PageAccess access) {
   // mmap does not support reserve / commit, so ignore allocation_type.
   uint32_t prot = ToPosixProtectFlags(access);
-  return mmap(base_address, length, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (allocation_type == AllocationType::kReserveCommitLargePages) {
+    void* result = mmap(base_address, length, prot,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (result == MAP_FAILED) {
+      return nullptr;
+    }
+    if (base_address && result != base_address) {
+      munmap(result, length);
+      return nullptr;
+    }
+    ApplyPreferredNumaNode(result, length);
+    return result;
+  }
+  void* result =
+      mmap(base_address, length, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (result == MAP_FAILED) {
+    return result;
+  }
+  ApplyPreferredNumaNode(result, length);
+  return result;
 }
 
 bool DeallocFixed(void* base_address, size_t length,
@@ -57,6 +151,20 @@ bool Protect(void* base_address, size_t length, PageAccess access,
   return mprotect(base_address, length, prot) == 0;
 }
 
+bool AdviseLargePages(void* base_address, size_t length) {
+  // Transparent huge pages, which don't need to be reserved by the
+  // administrator unlike MAP_HUGETLB.
+  return madvise(base_address, length, MADV_HUGEPAGE) == 0;
+}
+
+bool AdvisePrefetch(const void* base_address, size_t length) {
+  // madvise needs a page-aligned address.
+  uintptr_t start = reinterpret_cast<uintptr_t>(base_address);
+  uintptr_t aligned_start = start & ~uintptr_t(page_size() - 1);
+  return madvise(reinterpret_cast<void*>(aligned_start),
+                 length + (start - aligned_start), MADV_WILLNEED) == 0;
+}
+
 bool QueryProtect(void* base_address, size_t& length, PageAccess& access_out) {
   return false;
 }
@@ -97,8 +205,14 @@ void CloseFileMappingHandle(FileMappingHandle handle) {
 void* MapFileView(FileMappingHandle handle, void* base_address, size_t length,
                   PageAccess access, size_t file_offset) {
   uint32_t prot = ToPosixProtectFlags(access);
-  return mmap64(base_address, length, prot, MAP_PRIVATE | MAP_ANONYMOUS,
-                reinterpret_cast<intptr_t>(handle), file_offset);
+  void* result =
+      mmap64(base_address, length, prot, MAP_PRIVATE | MAP_ANONYMOUS,
+             reinterpret_cast<intptr_t>(handle), file_offset);
+  if (result == MAP_FAILED) {
+    return result;
+  }
+  ApplyPreferredNumaNode(result, length);
+  return result;
 }
 
 bool UnmapFileView(FileMappingHandle handle, void* base_address,
@@ -106,5 +220,109 @@ bool UnmapFileView(FileMappingHandle handle, void* base_address,
   return munmap(base_address, length) == 0;
 }
 
+namespace {
+struct WriteWatch {
+  int userfault_fd;
+  int pagemap_fd;
+};
+}  // namespace
+
+WriteWatchHandle CreateWriteWatch() {
+#if XE_MEMORY_WRITE_WATCH
+  int userfault_fd = int(syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK));
+  if (userfault_fd < 0) {
+    return nullptr;
+  }
+  // Writes to protected pages are resolved by the kernel itself, only marking
+  // the pages as written, so nobody needs to read the userfaultfd.
+  uffdio_api api = {};
+  api.api = UFFD_API;
+  api.features = UFFD_FEATURE_WP_ASYNC | UFFD_FEATURE_WP_UNPOPULATED;
+  if (ioctl(userfault_fd, UFFDIO_API, &api) < 0) {
+    close(userfault_fd);
+    return nullptr;
+  }
+  int pagemap_fd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+  if (pagemap_fd < 0) {
+    close(userfault_fd);
+    return nullptr;
+  }
+  return new WriteWatch{userfault_fd, pagemap_fd};
+#else
+  return nullptr;
+#endif  // XE_MEMORY_WRITE_WATCH
+}
+
+void CloseWriteWatch(WriteWatchHandle handle) {
+  auto write_watch = reinterpret_cast<WriteWatch*>(handle);
+  if (!write_watch) {
+    return;
+  }
+  close(write_watch->pagemap_fd);
+  close(write_watch->userfault_fd);
+  delete write_watch;
+}
+
+bool ResetWriteWatch(WriteWatchHandle handle, void* base_address,
+                     size_t length) {
+#if XE_MEMORY_WRITE_WATCH
+  auto write_watch = reinterpret_cast<WriteWatch*>(handle);
+  // Registering an already registered range is a no-op, but the range may
+  // have been remapped since.
+  uffdio_register register_arg = {};
+  register_arg.range.start = reinterpret_cast<uintptr_t>(base_address);
+  register_arg.range.len = length;
+  register_arg.mode = UFFDIO_REGISTER_MODE_WP;
+  if (ioctl(write_watch->userfault_fd, UFFDIO_REGISTER, &register_arg) < 0) {
+    return false;
+  }
+  uffdio_writeprotect protect_arg = {};
+  protect_arg.range = register_arg.range;
+  protect_arg.mode = UFFDIO_WRITEPROTECT_MODE_WP;
+  return ioctl(write_watch->userfault_fd, UFFDIO_WRITEPROTECT, &protect_arg) ==
+         0;
+#else
+  return false;
+#endif  // XE_MEMORY_WRITE_WATCH
+}
+
+bool GetAndResetWriteWatch(WriteWatchHandle handle, void* base_address,
+                           size_t length,
+                           std::vector<std::pair<void*, size_t>>& ranges_out) {
+#if XE_MEMORY_WRITE_WATCH
+  auto write_watch = reinterpret_cast<WriteWatch*>(handle);
+  page_region regions[64];
+  pm_scan_arg scan_arg = {};
+  scan_arg.size = sizeof(scan_arg);
+  // Protects the written pages again while reporting them, and fails if any
+  // page is not protected asynchronously.
+  scan_arg.flags = PM_SCAN_WP_MATCHING | PM_SCAN_CHECK_WPASYNC;
+  scan_arg.start = reinterpret_cast<uintptr_t>(base_address);
+  scan_arg.end = scan_arg.start + length;
+  scan_arg.vec = reinterpret_cast<uintptr_t>(regions);
+  scan_arg.vec_len = sizeof(regions) / sizeof(regions[0]);
+  scan_arg.category_mask = PAGE_IS_WRITTEN;
+  scan_arg.return_mask = PAGE_IS_WRITTEN;
+  while (scan_arg.start < scan_arg.end) {
+    int region_count = ioctl(write_watch->pagemap_fd, PAGEMAP_SCAN, &scan_arg);
+    if (region_count < 0) {
+      return false;
+    }
+    for (int i = 0; i < region_count; ++i) {
+      ranges_out.emplace_back(reinterpret_cast<void*>(regions[i].start),
+                              size_t(regions[i].end - regions[i].start));
+    }
+    // The scan stops early when the region array is full.
+    if (scan_arg.walk_end <= scan_arg.start) {
+      break;
+    }
+    scan_arg.start = scan_arg.walk_end;
+  }
+  return true;
+#else
+  return false;
+#endif  // XE_MEMORY_WRITE_WATCH
+}
+
 }  // namespace memory
 }  // namespace xe
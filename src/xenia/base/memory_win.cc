@@ -34,6 +34,39 @@ size_t allocation_granularity() {
   return value;
 }
 
+size_t large_page_size() {
+  // Large pages are never paged out, so allocating them needs the "Lock pages
+  // in memory" user right, which has to be enabled in the process token.
+  static size_t value = [] {
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(),
+                          TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+      return size_t(0);
+    }
+    TOKEN_PRIVILEGES privileges;
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    bool enabled =
+        LookupPrivilegeValueW(nullptr, SE_LOCK_MEMORY_NAME,
+                              &privileges.Privileges[0].Luid) &&
+        AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr,
+                              nullptr) &&
+        GetLastError() == ERROR_SUCCESS;
+    CloseHandle(token);
+    return enabled ? size_t(GetLargePageMinimum()) : size_t(0);
+  }();
+  return value;
+}
+
+uint32_t numa_node_count() {
+  static uint32_t value = [] {
+    ULONG highest_node;
+    return GetNumaHighestNodeNumber(&highest_node) ? uint32_t(highest_node + 1)
+                                                   : uint32_t(1);
+  }();
+  return value;
+}
+
 DWORD ToWin32ProtectFlags(PageAccess access) {
   switch (access) {
     case PageAccess::kNoAccess:
@@ -83,11 +116,19 @@ void* AllocFixed(void* base_address, size_t length,
     case AllocationType::kReserveCommit:
       alloc_type = MEM_RESERVE | MEM_COMMIT;
       break;
+    case AllocationType::kReserveCommitLargePages:
+      alloc_type = MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES;
+      break;
     default:
       assert_unhandled_case(allocation_type);
       break;
   }
   DWORD protect = ToWin32ProtectFlags(access);
+  int32_t numa_node = preferred_numa_node();
+  if (numa_node >= 0) {
+    return VirtualAllocExNuma(GetCurrentProcess(), base_address, length,
+                              alloc_type, protect, DWORD(numa_node));
+  }
   return VirtualAlloc(base_address, length, alloc_type, protect);
 }
 
@@ -126,6 +167,20 @@ bool Protect(void* base_address, size_t length, PageAccess access,
   return true;
 }
 
+bool AdviseLargePages(void* base_address, size_t length) {
+  // Large pages must be committed with SEC_LARGE_PAGES when creating the file
+  // mapping, and can't be protected at a smaller granularity afterwards, so
+  // they can't be used for memory that may be watched for writes.
+  return false;
+}
+
+bool AdvisePrefetch(const void* base_address, size_t length) {
+  WIN32_MEMORY_RANGE_ENTRY range;
+  range.VirtualAddress = const_cast<void*>(base_address);
+  range.NumberOfBytes = length;
+  return PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0) != FALSE;
+}
+
 bool QueryProtect(void* base_address, size_t& length, PageAccess& access_out) {
   access_out = PageAccess::kNoAccess;
 
@@ -147,6 +202,13 @@ FileMappingHandle CreateFileMappingHandle(const std::filesystem::path& path,
                                           bool commit) {
   DWORD protect =
       ToWin32ProtectFlags(access) | (commit ? SEC_COMMIT : SEC_RESERVE);
+  int32_t numa_node = preferred_numa_node();
+  if (numa_node >= 0) {
+    return CreateFileMappingNumaW(INVALID_HANDLE_VALUE, NULL, protect,
+                                  static_cast<DWORD>(length >> 32),
+                                  static_cast<DWORD>(length), path.c_str(),
+                                  DWORD(numa_node));
+  }
   return CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, protect,
                             static_cast<DWORD>(length >> 32),
                             static_cast<DWORD>(length), path.c_str());
@@ -174,6 +236,12 @@ void* MapFileView(FileMappingHandle handle, void* base_address, size_t length,
       assert_unhandled_case(access);
       return nullptr;
   }
+  int32_t numa_node = preferred_numa_node();
+  if (numa_node >= 0) {
+    return MapViewOfFileExNuma(handle, file_access, target_address_high,
+                               target_address_low, length, base_address,
+                               DWORD(numa_node));
+  }
   return MapViewOfFileEx(handle, file_access, target_address_high,
                          target_address_low, length, base_address);
 }
@@ -183,5 +251,20 @@ bool UnmapFileView(FileMappingHandle handle, void* base_address,
   return UnmapViewOfFile(base_address) ? true : false;
 }
 
+WriteWatchHandle CreateWriteWatch() { return nullptr; }
+
+void CloseWriteWatch(WriteWatchHandle handle) { assert_null(handle); }
+
+bool ResetWriteWatch(WriteWatchHandle handle, void* base_address,
+                     size_t length) {
+  return false;
+}
+
+bool GetAndResetWriteWatch(WriteWatchHandle handle, void* base_address,
+                           size_t length,
+                           std::vector<std::pair<void*, size_t>>& ranges_out) {
+  return false;
+}
+
 }  // namespace memory
 }  // namespace xe
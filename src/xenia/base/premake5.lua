@@ -7,6 +7,7 @@ project("xenia-base")
   language("C++")
   links({
     "fmt",
+    "xxhash",
   })
   defines({
   })
@@ -17,3 +18,4 @@ project("xenia-base")
   })
 
 include("testing")
+include("testing/bench")
@@ -7,6 +7,8 @@
  ******************************************************************************
  */
 
+#include <algorithm>
+#include <atomic>
 #include <string>
 
 // NOTE: this must be included before microprofile as macro expansion needs
@@ -28,10 +30,16 @@
 #include "third_party/microprofile/microprofile.h"
 
 #include "xenia/base/assert.h"
+#include "xenia/base/chrome_trace_writer.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/profiling.h"
 #include "xenia/ui/window.h"
 
+#if XE_PLATFORM_WIN32
+#include "xenia/base/platform_win.h"
+#endif  // XE_PLATFORM_WIN32
+
 #if XE_OPTION_PROFILING
 #include "third_party/microprofile/microprofileui.h"
 #endif  // XE_OPTION_PROFILING
@@ -42,6 +50,18 @@
 #endif  // XE_OPTION_PROFILING_UI
 
 DEFINE_bool(show_profiler, false, "Show profiling UI by default.", "UI");
+DEFINE_path(
+    profiler_trace_path, "",
+    "File to export the profiler scopes, counters and thread names of the "
+    "last frames to as a Chrome trace (viewable in chrome://tracing or "
+    "Perfetto). If set, the profiler records even when not displayed, and "
+    "exports on request (from the menu or with Ctrl+Break in the console) and "
+    "on shutdown. Exports after the first get a number added to the name.",
+    "General");
+DEFINE_int32(profiler_trace_frames, 256,
+             "Number of the last frames to include in profiler trace exports, "
+             "up to 500.",
+             "General");
 
 namespace xe {
 
@@ -52,6 +72,130 @@ std::unique_ptr<ui::MicroprofileDrawer> Profiler::drawer_ = nullptr;
 
 #if XE_OPTION_PROFILING
 
+namespace {
+
+std::atomic<bool> trace_export_requested{false};
+uint32_t trace_export_count = 0;
+
+#if XE_PLATFORM_WIN32
+BOOL WINAPI TraceExportConsoleCtrlHandler(DWORD ctrl_type) {
+  if (ctrl_type == CTRL_BREAK_EVENT) {
+    Profiler::RequestTraceExport();
+    return TRUE;
+  }
+  return FALSE;
+}
+#endif  // XE_PLATFORM_WIN32
+
+// Converts the frames still in the microprofile history and the thread logs
+// referenced by them, which is what the live view shows too. Must be called
+// on the thread flipping the frames.
+void ExportTrace() {
+  std::lock_guard<std::recursive_mutex> lock(MicroProfileMutex());
+  MicroProfile& profile = g_MicroProfile;
+  // Leave some frames that may be being overwritten, like microprofile does.
+  constexpr uint32_t kMaxFrameCount =
+      MICROPROFILE_MAX_FRAME_HISTORY - MICROPROFILE_GPU_FRAME_DELAY - 3;
+  uint32_t frame_count =
+      std::min(kMaxFrameCount, uint32_t(std::max(cvars::profiler_trace_frames,
+                                                 int32_t(1))));
+  // The current frame lags behind the last put one by the GPU frame delay.
+  constexpr uint64_t kFrameDelay = MICROPROFILE_GPU_FRAME_DELAY + 1;
+  if (profile.nFramePutIndex <= kFrameDelay) {
+    frame_count = 0;
+  } else {
+    frame_count = uint32_t(std::min(uint64_t(frame_count),
+                                    profile.nFramePutIndex - kFrameDelay));
+  }
+  if (!frame_count) {
+    XELOGW("No profiler frames to export to a trace yet");
+    return;
+  }
+  uint32_t first_frame =
+      (profile.nFrameCurrent + MICROPROFILE_MAX_FRAME_HISTORY - frame_count) %
+      MICROPROFILE_MAX_FRAME_HISTORY;
+  uint32_t last_frame = profile.nFrameCurrent;
+  int64_t tick_start = profile.Frames[first_frame].nFrameStartCpu;
+  double us_per_tick = 1000000.0 / double(MicroProfileTicksPerSecondCpu());
+
+  ChromeTraceWriter writer;
+  for (uint32_t i = 0; i < frame_count; ++i) {
+    uint32_t frame = (first_frame + i) % MICROPROFILE_MAX_FRAME_HISTORY;
+    int64_t frame_ticks = profile.Frames[frame].nFrameStartCpu - tick_start;
+    writer.AddInstant("Flip", "frame", 0, double(frame_ticks) * us_per_tick);
+  }
+  for (uint32_t i = 0; i < profile.nNumLogs; ++i) {
+    MicroProfileThreadLog* log = profile.Pool[i];
+    if (!log || log->nGpu || !log->Log) {
+      continue;
+    }
+    writer.AddThreadName(i, log->ThreadName);
+    uint32_t depth = 0;
+    uint32_t log_end = profile.Frames[last_frame].nLogStart[i];
+    for (uint32_t j = profile.Frames[first_frame].nLogStart[i]; j != log_end;
+         j = (j + 1) % MICROPROFILE_BUFFER_SIZE) {
+      MicroProfileLogEntry entry = log->Log[j];
+      uint64_t type = MicroProfileLogType(entry);
+      if (type != MP_LOG_ENTER && type != MP_LOG_LEAVE) {
+        continue;
+      }
+      double timestamp_us =
+          double(MicroProfileLogTickDifference(tick_start, entry)) *
+          us_per_tick;
+      if (type == MP_LOG_ENTER) {
+        const MicroProfileTimerInfo& timer =
+            profile.TimerInfo[MicroProfileLogTimerIndex(entry)];
+        writer.AddBegin(timer.pName,
+                        profile.GroupInfo[timer.nGroupIndex].pName, i,
+                        timestamp_us);
+        ++depth;
+      } else if (depth) {
+        // Not leaving a scope entered before the first exported frame.
+        writer.AddEnd(i, timestamp_us);
+        --depth;
+      }
+    }
+  }
+  // Counters have no history, so only their current values are exported.
+  int64_t end_ticks = profile.Frames[last_frame].nFrameStartCpu - tick_start;
+  double end_us = double(end_ticks) * us_per_tick;
+  for (uint32_t i = 0; i < profile.nNumCounters; ++i) {
+    const MicroProfileCounterInfo& counter = profile.CounterInfo[i];
+    if (!(counter.nFlags & MICROPROFILE_COUNTER_FLAG_LEAF)) {
+      continue;
+    }
+    std::string name(counter.pName, counter.nNameLen);
+    for (int parent = counter.nParent; parent >= 0;
+         parent = profile.CounterInfo[parent].nParent) {
+      const MicroProfileCounterInfo& parent_counter =
+          profile.CounterInfo[parent];
+      name = std::string(parent_counter.pName, parent_counter.nNameLen) + "/" +
+             name;
+    }
+    writer.AddCounter(name, end_us,
+                      profile.Counters[i].load(std::memory_order_relaxed));
+  }
+
+  std::filesystem::path path = cvars::profiler_trace_path;
+  if (trace_export_count) {
+    std::filesystem::path extension = path.extension();
+    path.replace_extension();
+    path += fmt::format(".{}", trace_export_count);
+    path += extension;
+  }
+  ++trace_export_count;
+  size_t event_count = writer.event_count();
+  if (writer.WriteToFile(path)) {
+    XELOGI("Exported {} frames with {} profiler events to {}", frame_count,
+           event_count, xe::path_to_utf8(path));
+  } else {
+    XELOGE("Failed to export the profiler trace to {}",
+           xe::path_to_utf8(path));
+  }
+}
+
+}  // namespace
+
 bool Profiler::is_enabled() { return true; }
 
 bool Profiler::is_visible() { return is_enabled() && MicroProfileIsDrawing(); }
@@ -84,6 +228,14 @@ void Profiler::Initialize() {
   MicroProfileSetEnableAllGroups(true);
   MicroProfileSetForceMetaCounters(false);
 #endif  // XE_OPTION_PROFILING_UI
+
+  if (!cvars::profiler_trace_path.empty()) {
+    // Headless capture - keep recording while the profiler isn't displayed.
+    MicroProfileSetForceEnable(true);
+#if XE_PLATFORM_WIN32
+    SetConsoleCtrlHandler(TraceExportConsoleCtrlHandler, TRUE);
+#endif  // XE_PLATFORM_WIN32
+  }
 }
 
 void Profiler::Dump() {
@@ -94,7 +246,19 @@ void Profiler::Dump() {
   // MicroProfileDumpHtmlToFile();
 }
 
+void Profiler::RequestTraceExport() {
+  if (!cvars::profiler_trace_path.empty()) {
+    trace_export_requested.store(true, std::memory_order_relaxed);
+  }
+}
+
 void Profiler::Shutdown() {
+  if (!cvars::profiler_trace_path.empty()) {
+#if XE_PLATFORM_WIN32
+    SetConsoleCtrlHandler(TraceExportConsoleCtrlHandler, FALSE);
+#endif  // XE_PLATFORM_WIN32
+    ExportTrace();
+  }
   drawer_.reset();
   window_ = nullptr;
   MicroProfileShutdown();
@@ -245,7 +409,13 @@ void Profiler::Present() {
 #endif  // XE_OPTION_PROFILING_UI
 }
 
-void Profiler::Flip() { MicroProfileFlip(); }
+void Profiler::Flip() {
+  if (trace_export_requested.load(std::memory_order_relaxed) &&
+      trace_export_requested.exchange(false, std::memory_order_relaxed)) {
+    ExportTrace();
+  }
+  MicroProfileFlip();
+}
 
 #else
 
@@ -253,6 +423,7 @@ bool Profiler::is_enabled() { return false; }
 bool Profiler::is_visible() { return false; }
 void Profiler::Initialize() {}
 void Profiler::Dump() {}
+void Profiler::RequestTraceExport() {}
 void Profiler::Shutdown() {}
 uint32_t Profiler::GetColor(const char* str) { return 0; }
 void Profiler::ThreadEnter(const char* name) {}
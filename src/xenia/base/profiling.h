@@ -159,6 +159,10 @@ class Profiler {
   static void Initialize();
   // Dumps data to stdout.
   static void Dump();
+  // Requests the scopes, counters and thread names of the last frames to be
+  // exported to the profiler_trace_path file as a Chrome trace, which is done
+  // on the next Flip. Safe to call from any thread.
+  static void RequestTraceExport();
   // Cleans up profiling, releasing all memory.
   static void Shutdown();
 
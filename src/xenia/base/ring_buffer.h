@@ -10,13 +10,16 @@
 #ifndef XENIA_BASE_RING_BUFFER_H_
 #define XENIA_BASE_RING_BUFFER_H_
 
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <string>
 #include <type_traits>
 #include <vector>
 
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_order.h"
+#include "xenia/base/memory.h"
 
 namespace xe {
 
@@ -95,6 +98,41 @@ class RingBuffer {
     return imm;
   }
 
+  // Reads up to count values, swapping each whole contiguous part of the range
+  // at once. Returns the number of values read.
+  template <typename T>
+  size_t ReadAndSwap(T* buffer, size_t count) {
+    static_assert(std::is_fundamental<T>::value && sizeof(T) > 1,
+                  "Bulk swapped read only supports basic types!");
+
+    ReadRange range = BeginRead(std::min(read_count(), count * sizeof(T)) /
+                                sizeof(T) * sizeof(T));
+    size_t first_count = range.first_length / sizeof(T);
+    xe::copy_and_swap(buffer, reinterpret_cast<const T*>(range.first),
+                      first_count);
+    if (range.second_length) {
+      const uint8_t* second = range.second;
+      size_t second_length = range.second_length;
+      size_t split_length = range.first_length % sizeof(T);
+      if (split_length) {
+        // A value split by the end of the buffer.
+        T imm;
+        std::memcpy(&imm, range.first + first_count * sizeof(T),
+                    split_length);
+        std::memcpy(reinterpret_cast<uint8_t*>(&imm) + split_length, second,
+                    sizeof(T) - split_length);
+        buffer[first_count++] = xe::byte_swap(imm);
+        second += sizeof(T) - split_length;
+        second_length -= sizeof(T) - split_length;
+      }
+      xe::copy_and_swap(buffer + first_count,
+                        reinterpret_cast<const T*>(second),
+                        second_length / sizeof(T));
+    }
+    EndRead(range);
+    return (range.first_length + range.second_length) / sizeof(T);
+  }
+
   size_t Write(const uint8_t* buffer, size_t count);
   template <typename T>
   size_t Write(const T* buffer, size_t count) {
@@ -0,0 +1,192 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/startup_timeline.h"
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/base/chrome_trace_writer.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/threading.h"
+
+DEFINE_path(startup_timeline_path, "",
+            "Record the times and threads of the startup phases until the "
+            "first guest frame is presented, and write them to this file as a "
+            "Chrome trace (viewable in chrome://tracing or Perfetto).",
+            "General");
+
+namespace xe {
+namespace startup_timeline {
+
+namespace {
+
+// Bounds the memory usage if a title takes very long to show anything while
+// resolving many functions.
+constexpr size_t kMaxEvents = 65536;
+
+std::atomic<bool> finished{false};
+
+class Recorder {
+ public:
+  Recorder() : origin_ticks_(Clock::QueryHostTickCount()) {}
+
+  void AddEvent(const char* name, std::string detail, uint64_t begin_ticks,
+                uint64_t end_ticks, bool instant) {
+    uint32_t thread_id = threading::current_thread_id();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (finished.load(std::memory_order_relaxed) ||
+        events_.size() >= kMaxEvents) {
+      return;
+    }
+    if (thread_names_.find(thread_id) == thread_names_.end()) {
+      thread_names_.emplace(thread_id,
+                            threading::Thread::GetCurrentThread()->name());
+    }
+    Event& event = events_.emplace_back();
+    event.name = name;
+    event.detail = std::move(detail);
+    event.begin_ticks = begin_ticks;
+    event.end_ticks = end_ticks;
+    event.thread_id = thread_id;
+    event.instant = instant;
+  }
+
+  void RecordGuestSwap() {
+    if (guest_swapped_.exchange(true, std::memory_order_relaxed)) {
+      return;
+    }
+    uint64_t ticks = Clock::QueryHostTickCount();
+    AddEvent("First guest swap", std::string(), ticks, ticks, true);
+  }
+
+  void RecordPresent() {
+    if (!guest_swapped_.load(std::memory_order_relaxed)) {
+      return;
+    }
+    uint64_t ticks = Clock::QueryHostTickCount();
+    AddEvent("First guest frame presented", std::string(), ticks, ticks, true);
+    Finish();
+  }
+
+  void Finish() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (finished.exchange(true, std::memory_order_relaxed)) {
+      return;
+    }
+    Write();
+  }
+
+ private:
+  struct Event {
+    const char* name;
+    std::string detail;
+    uint64_t begin_ticks;
+    uint64_t end_ticks;
+    uint32_t thread_id;
+    bool instant;
+  };
+
+  double TicksToUs(uint64_t ticks) const {
+    return double(ticks - origin_ticks_) * 1000000.0 /
+           double(Clock::QueryHostTickFrequency());
+  }
+
+  void Write() const {
+    ChromeTraceWriter writer;
+    for (const auto& it : thread_names_) {
+      if (!it.second.empty()) {
+        writer.AddThreadName(it.first, it.second);
+      }
+    }
+    for (const Event& event : events_) {
+      double begin_us = TicksToUs(event.begin_ticks);
+      if (event.instant) {
+        writer.AddInstant(event.name, "startup", event.thread_id, begin_us);
+      } else {
+        writer.AddComplete(event.name, "startup", event.thread_id, begin_us,
+                           TicksToUs(event.end_ticks) - begin_us,
+                           event.detail);
+      }
+    }
+    if (writer.WriteToFile(cvars::startup_timeline_path)) {
+      XELOGI("Wrote the startup timeline with {} events to {}",
+             events_.size(), xe::path_to_utf8(cvars::startup_timeline_path));
+    } else {
+      XELOGE("Failed to write the startup timeline to {}",
+             xe::path_to_utf8(cvars::startup_timeline_path));
+    }
+  }
+
+  uint64_t origin_ticks_;
+  std::atomic<bool> guest_swapped_{false};
+  std::mutex mutex_;
+  std::vector<Event> events_;
+  std::unordered_map<uint32_t, std::string> thread_names_;
+};
+
+Recorder& GetRecorder() {
+  static Recorder recorder;
+  return recorder;
+}
+
+}  // namespace
+
+bool IsEnabled() {
+  return !cvars::startup_timeline_path.empty() &&
+         !finished.load(std::memory_order_relaxed);
+}
+
+ScopedPhase::ScopedPhase(const char* name) : name_(name) {
+  if (IsEnabled()) {
+    // Make sure the origin is before the beginning of the first phase.
+    GetRecorder();
+    begin_ticks_ = Clock::QueryHostTickCount();
+  }
+}
+
+ScopedPhase::~ScopedPhase() {
+  if (begin_ticks_ && IsEnabled()) {
+    GetRecorder().AddEvent(name_, std::move(detail_), begin_ticks_,
+                           Clock::QueryHostTickCount(), false);
+  }
+}
+
+void RecordInstant(const char* name) {
+  if (IsEnabled()) {
+    uint64_t ticks = Clock::QueryHostTickCount();
+    GetRecorder().AddEvent(name, std::string(), ticks, ticks, true);
+  }
+}
+
+void RecordGuestSwap() {
+  if (IsEnabled()) {
+    GetRecorder().RecordGuestSwap();
+  }
+}
+
+void RecordPresent() {
+  if (IsEnabled()) {
+    GetRecorder().RecordPresent();
+  }
+}
+
+void Finish() {
+  if (IsEnabled()) {
+    GetRecorder().Finish();
+  }
+}
+
+}  // namespace startup_timeline
+}  // namespace xe
@@ -0,0 +1,66 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BASE_STARTUP_TIMELINE_H_
+#define XENIA_BASE_STARTUP_TIMELINE_H_
+
+#include <cstdint>
+#include <string>
+#include <utility>
+
+namespace xe {
+namespace startup_timeline {
+
+// Recorder of the begin and end times and threads of the phases of the
+// emulator startup, enabled with the startup_timeline_path cvar. Recording
+// stops when the first guest frame is presented, and the timeline is written
+// to the file in the Chrome trace event format, which can be opened in
+// chrome://tracing or Perfetto.
+
+// Whether the phases are still being recorded.
+bool IsEnabled();
+
+// Records the time between the construction and the destruction as a phase on
+// the current thread. The name must be a string literal.
+class ScopedPhase {
+ public:
+  explicit ScopedPhase(const char* name);
+  ~ScopedPhase();
+  ScopedPhase(const ScopedPhase&) = delete;
+  ScopedPhase& operator=(const ScopedPhase&) = delete;
+
+  bool active() const { return begin_ticks_ != 0; }
+  // Additional information about the phase, such as the path of the module
+  // being loaded. Should only be built if active().
+  void set_detail(std::string detail) { detail_ = std::move(detail); }
+
+ private:
+  const char* name_;
+  uint64_t begin_ticks_ = 0;
+  std::string detail_;
+};
+
+// Records a point in time on the current thread. The name must be a string
+// literal.
+void RecordInstant(const char* name);
+
+// The guest has issued a swap of a frame.
+void RecordGuestSwap();
+// The host has queued a presentation. Writes the timeline if a guest frame has
+// been swapped before.
+void RecordPresent();
+
+// Writes what has been recorded if the timeline hasn't been written yet, for
+// instance, if the emulator is shutting down before showing any guest frame.
+void Finish();
+
+}  // namespace startup_timeline
+}  // namespace xe
+
+#endif  // XENIA_BASE_STARTUP_TIMELINE_H_
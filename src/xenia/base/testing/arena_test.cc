@@ -0,0 +1,76 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <cstdint>
+#include <vector>
+
+#include "xenia/base/arena.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::base::test {
+
+TEST_CASE("Arena aligned allocation", "[arena]") {
+  Arena arena;
+  auto base = reinterpret_cast<uintptr_t>(arena.Alloc(3));
+  auto p = reinterpret_cast<uintptr_t>(arena.Alloc(16, 64));
+  REQUIRE((p & 63) == 0);
+  REQUIRE(p >= base + 3);
+  REQUIRE(arena.CalculateSize() == p - base + 16);
+  auto q = reinterpret_cast<uintptr_t>(arena.Alloc<uint64_t>());
+  REQUIRE((q & 7) == 0);
+}
+
+TEST_CASE("Arena markers", "[arena]") {
+  Arena arena(64 * 1024);
+  arena.Alloc(100);
+  Arena::Marker marker = arena.Mark();
+  void* first = arena.Alloc(32);
+  {
+    Arena::Scope scope(&arena);
+    // Spill into further chunks.
+    for (int i = 0; i < 8; ++i) {
+      arena.Alloc(32 * 1024);
+    }
+    REQUIRE(arena.CalculateSize() == 100 + 32 + 8 * 32 * 1024);
+  }
+  REQUIRE(arena.CalculateSize() == 100 + 32);
+  arena.Restore(marker);
+  REQUIRE(arena.CalculateSize() == 100);
+  REQUIRE(arena.Alloc(32) == first);
+  arena.Reset();
+  REQUIRE(arena.CalculateSize() == 0);
+}
+
+TEST_CASE("Arena clone across chunks", "[arena]") {
+  Arena arena(64 * 1024);
+  for (uint32_t i = 0; i < 32 * 1024; ++i) {
+    *arena.Alloc<uint32_t>() = i;
+  }
+  std::vector<uint32_t> contents;
+  arena.CloneContents(&contents);
+  REQUIRE(contents.size() == 32 * 1024);
+  bool matches = true;
+  for (uint32_t i = 0; i < 32 * 1024; ++i) {
+    matches &= contents[i] == i;
+  }
+  REQUIRE(matches);
+}
+
+TEST_CASE("Arena chunk recycling", "[arena]") {
+  void* chunk_memory;
+  {
+    Arena arena;
+    chunk_memory = arena.Alloc(1);
+  }
+  Arena arena;
+  REQUIRE(arena.Alloc(1) == chunk_memory);
+}
+
+}  // namespace xe::base::test
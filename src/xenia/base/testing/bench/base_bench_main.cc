@@ -0,0 +1,447 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "xenia/base/arena.h"
+#include "xenia/base/bit_map.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/hash.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/main.h"
+#include "xenia/base/math.h"
+#include "xenia/base/memory.h"
+#include "xenia/base/ring_buffer.h"
+#include "xenia/base/string.h"
+#include "xenia/base/type_pool.h"
+#include "xenia/base/utf8.h"
+
+DEFINE_transient_string(bench_filter, "",
+                        "Only runs the benchmarks whose name contains this "
+                        "string.",
+                        "General");
+DEFINE_string(bench_extensions, "avx512,avx2,baseline",
+              "Comma separated copy_and_swap instruction set extensions to "
+              "compare. Extensions the host does not support are skipped.",
+              "Other");
+DEFINE_int32(bench_repeat, 5,
+             "Timed runs per benchmark. The fastest one is reported.", "Other");
+DEFINE_int32(bench_bytes, 64 * 1024 * 1024,
+             "Approximate number of bytes processed by every timed run of "
+             "the size-based benchmarks.",
+             "Other");
+
+namespace xe {
+namespace base {
+namespace bench {
+
+// Sizes from a few cache lines up to beyond most L2 caches, where the large
+// copy_and_swap paths switch to non-temporal stores.
+const size_t kSizes[] = {64, 4 * 1024, 256 * 1024, 16 * 1024 * 1024};
+
+// Keeps the compiler from discarding the results being benchmarked.
+std::atomic<uint64_t> sink;
+
+struct Benchmark {
+  std::string name;
+  // Bytes processed by one operation, for the throughput, or 0.
+  size_t bytes_per_op;
+  uint64_t ops_per_run;
+  // Runs the given number of operations.
+  std::function<void(uint64_t op_count)> run;
+};
+
+class BenchRegistry {
+ public:
+  void Add(std::string name, size_t bytes_per_op, uint64_t ops_per_run,
+           std::function<void(uint64_t op_count)> run) {
+    benchmarks_.push_back(
+        {std::move(name), bytes_per_op, ops_per_run, std::move(run)});
+  }
+  // Adds a benchmark processing size bytes per operation, with the number of
+  // operations per run derived from bench_bytes.
+  void AddSized(std::string name, size_t size,
+                std::function<void(uint64_t op_count)> run) {
+    uint64_t ops = std::max(uint64_t(std::max(cvars::bench_bytes, 1)) / size,
+                            uint64_t(1));
+    Add(std::move(name), size, ops, std::move(run));
+  }
+
+  void Run() {
+    double ns_per_tick = 1000000000.0 / double(Clock::QueryHostTickFrequency());
+    for (const auto& benchmark : benchmarks_) {
+      if (!cvars::bench_filter.empty() &&
+          benchmark.name.find(cvars::bench_filter) == std::string::npos) {
+        continue;
+      }
+      // Warm up, with the caches and the lazily allocated memory.
+      benchmark.run(std::min(benchmark.ops_per_run, uint64_t(16)));
+      uint64_t best = std::numeric_limits<uint64_t>::max();
+      for (int32_t i = 0; i < std::max(cvars::bench_repeat, 1); ++i) {
+        uint64_t start = Clock::QueryHostTickCount();
+        benchmark.run(benchmark.ops_per_run);
+        best = std::min(best, Clock::QueryHostTickCount() - start);
+      }
+      double ns_per_op =
+          double(best) * ns_per_tick / double(benchmark.ops_per_run);
+      if (benchmark.bytes_per_op) {
+        XELOGI("  {:<48} {:12.3f} ns/op {:8.2f} GB/s", benchmark.name,
+               ns_per_op, double(benchmark.bytes_per_op) / ns_per_op);
+      } else {
+        XELOGI("  {:<48} {:12.3f} ns/op", benchmark.name, ns_per_op);
+      }
+    }
+  }
+
+ private:
+  std::vector<Benchmark> benchmarks_;
+};
+
+std::string SizeName(size_t size) {
+  if (size >= 1024 * 1024) {
+    return std::to_string(size / (1024 * 1024)) + "M";
+  }
+  if (size >= 1024) {
+    return std::to_string(size / 1024) + "K";
+  }
+  return std::to_string(size);
+}
+
+// Buffers shared by the memory benchmarks, with room for an unaligned offset.
+std::vector<uint8_t>& SourceBuffer() {
+  static std::vector<uint8_t> buffer(kSizes[xe::countof(kSizes) - 1] + 64, 1);
+  return buffer;
+}
+std::vector<uint8_t>& DestBuffer() {
+  static std::vector<uint8_t> buffer(kSizes[xe::countof(kSizes) - 1] + 64);
+  return buffer;
+}
+uint8_t* AlignedPtr(std::vector<uint8_t>& buffer) {
+  return reinterpret_cast<uint8_t*>(
+      xe::round_up(reinterpret_cast<uintptr_t>(buffer.data()), 64));
+}
+
+void AddCopyBenchmarks(BenchRegistry& registry) {
+  struct CopyFunction {
+    const char* name;
+    void (*copy)(void* dest, const void* src, size_t count);
+    size_t element_size;
+    bool aligned;
+  };
+  static const CopyFunction kCopyFunctions[] = {
+      {"copy_and_swap_16_aligned", copy_and_swap_16_aligned, 2, true},
+      {"copy_and_swap_16_unaligned", copy_and_swap_16_unaligned, 2, false},
+      {"copy_and_swap_32_aligned", copy_and_swap_32_aligned, 4, true},
+      {"copy_and_swap_32_unaligned", copy_and_swap_32_unaligned, 4, false},
+      {"copy_and_swap_64_aligned", copy_and_swap_64_aligned, 8, true},
+      {"copy_and_swap_64_unaligned", copy_and_swap_64_unaligned, 8, false},
+      {"copy_and_swap_16_in_32_aligned", copy_and_swap_16_in_32_aligned, 4,
+       true},
+      {"copy_and_swap_16_in_32_unaligned",
+       copy_and_swap_16_in_32_unaligned, 4, false},
+  };
+  struct Extension {
+    const char* name;
+    CopyAndSwapExtension extension;
+  };
+  static const Extension kExtensions[] = {
+      {"avx512", CopyAndSwapExtension::kAVX512},
+      {"avx2", CopyAndSwapExtension::kAVX2},
+      {"baseline", CopyAndSwapExtension::kBaseline},
+  };
+
+  for (size_t size : kSizes) {
+    registry.AddSized(
+        "copy_128_aligned/" + SizeName(size), size, [size](uint64_t ops) {
+          for (uint64_t i = 0; i < ops; ++i) {
+            copy_128_aligned(AlignedPtr(DestBuffer()),
+                             AlignedPtr(SourceBuffer()), size / 16);
+          }
+        });
+  }
+
+  CopyAndSwapExtension best_extension = copy_and_swap_extension();
+  for (const auto& extension : kExtensions) {
+    if (("," + cvars::bench_extensions + ",")
+                .find("," + std::string(extension.name) + ",") ==
+            std::string::npos ||
+        extension.extension > best_extension) {
+      continue;
+    }
+    for (const auto& function : kCopyFunctions) {
+      for (size_t size : kSizes) {
+        registry.AddSized(
+            std::string(function.name) + "/" + extension.name + "/" +
+                SizeName(size),
+            size, [&function, &extension, size](uint64_t ops) {
+              set_copy_and_swap_extension(extension.extension);
+              // Misaligned by one element in the unaligned variants.
+              size_t offset = function.aligned ? 0 : function.element_size;
+              for (uint64_t i = 0; i < ops; ++i) {
+                function.copy(AlignedPtr(DestBuffer()) + offset,
+                              AlignedPtr(SourceBuffer()) + offset,
+                              size / function.element_size);
+              }
+            });
+      }
+    }
+  }
+}
+
+void AddCompareBenchmarks(BenchRegistry& registry) {
+  // Equal to the source buffer, so the whole size is compared.
+  static std::vector<uint8_t> equal_buffer = SourceBuffer();
+  for (size_t size : kSizes) {
+    registry.AddSized("find_first_difference/" + SizeName(size), size,
+                      [size](uint64_t ops) {
+                        uint64_t sum = 0;
+                        for (uint64_t i = 0; i < ops; ++i) {
+                          sum += find_first_difference(
+                              equal_buffer.data(), SourceBuffer().data(),
+                              size);
+                        }
+                        sink += sum;
+                      });
+    registry.AddSized("count_leading_equal_32/" + SizeName(size), size,
+                      [size](uint64_t ops) {
+                        uint64_t sum = 0;
+                        for (uint64_t i = 0; i < ops; ++i) {
+                          sum += count_leading_equal_32(
+                              SourceBuffer().data(), 0x01010101, size / 4);
+                        }
+                        sink += sum;
+                      });
+    registry.AddSized("fill_32/" + SizeName(size), size, [size](uint64_t ops) {
+      for (uint64_t i = 0; i < ops; ++i) {
+        fill_32(AlignedPtr(DestBuffer()), 0x01010101, size / 4);
+      }
+    });
+  }
+}
+
+void AddRingBufferBenchmarks(BenchRegistry& registry) {
+  constexpr size_t kCapacity = 1024 * 1024;
+  static std::vector<uint8_t> storage(kCapacity);
+  // Odd offsets keep the reads and writes wrapping around at varying points.
+  for (size_t size : {size_t(64), size_t(4 * 1024), size_t(256 * 1024)}) {
+    registry.AddSized(
+        "RingBuffer Write+Read/" + SizeName(size), size, [size](uint64_t ops) {
+          RingBuffer ring(storage.data(), kCapacity);
+          ring.set_write_offset(kCapacity - size / 2);
+          ring.set_read_offset(kCapacity - size / 2);
+          for (uint64_t i = 0; i < ops; ++i) {
+            ring.Write(SourceBuffer().data(), size);
+            ring.Read(DestBuffer().data(), size);
+          }
+        });
+    registry.AddSized("RingBuffer Write+ReadAndSwap<uint32_t>/" +
+                          SizeName(size),
+                      size, [size](uint64_t ops) {
+                        RingBuffer ring(storage.data(), kCapacity);
+                        ring.set_write_offset(kCapacity - size / 2);
+                        ring.set_read_offset(kCapacity - size / 2);
+                        auto dest =
+                            reinterpret_cast<uint32_t*>(DestBuffer().data());
+                        for (uint64_t i = 0; i < ops; ++i) {
+                          ring.Write(SourceBuffer().data(), size);
+                          ring.ReadAndSwap(dest, size / sizeof(uint32_t));
+                        }
+                      });
+  }
+}
+
+void AddBitMapBenchmarks(BenchRegistry& registry) {
+  for (size_t size : {size_t(2048), size_t(64 * 1024)}) {
+    // Everything but the last entry in use, the worst case for a linear scan.
+    registry.Add("BitMap Acquire+Release at full/" + SizeName(size), 0,
+                 1000000, [size](uint64_t ops) {
+                   BitMap bit_map(size);
+                   for (size_t i = 0; i < size - 1; ++i) {
+                     bit_map.Acquire();
+                   }
+                   for (uint64_t i = 0; i < ops; ++i) {
+                     bit_map.Release(bit_map.Acquire());
+                   }
+                 });
+  }
+  registry.Add("BitMap Acquire+Release contended/2K", 0, 1000000,
+               [](uint64_t ops) {
+                 BitMap bit_map(2048);
+                 for (size_t i = 0; i < 2048 - 8; ++i) {
+                   bit_map.Acquire();
+                 }
+                 std::vector<std::thread> threads;
+                 for (uint32_t i = 0; i < 4; ++i) {
+                   threads.emplace_back([&bit_map, ops]() {
+                     for (uint64_t j = 0; j < ops / 4; ++j) {
+                       bit_map.Release(bit_map.Acquire());
+                     }
+                   });
+                 }
+                 for (auto& thread : threads) {
+                   thread.join();
+                 }
+               });
+}
+
+void AddArenaBenchmarks(BenchRegistry& registry) {
+  // Roughly the size of HIR instructions and values.
+  registry.Add("Arena Alloc 48 bytes", 0, 10000000, [](uint64_t ops) {
+    Arena arena;
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < ops; ++i) {
+      if (!(i & 0xFFFF)) {
+        arena.Reset();
+      }
+      sum += reinterpret_cast<uintptr_t>(arena.Alloc(48, 8));
+    }
+    sink += sum;
+  });
+  registry.Add("Arena Mark+Alloc+Restore", 0, 10000000, [](uint64_t ops) {
+    Arena arena;
+    arena.Alloc(64);
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < ops; ++i) {
+      Arena::Scope scope(&arena);
+      sum += reinterpret_cast<uintptr_t>(arena.Alloc(256, 16));
+    }
+    sink += sum;
+  });
+  registry.Add("Arena create+destroy", 0, 100000, [](uint64_t ops) {
+    for (uint64_t i = 0; i < ops; ++i) {
+      Arena arena;
+      sink += reinterpret_cast<uintptr_t>(arena.Alloc(64));
+    }
+  });
+}
+
+struct PooledObject {
+  explicit PooledObject(int value) : value(value) {}
+  int value;
+  uint8_t payload[256];
+};
+
+void AddTypePoolBenchmarks(BenchRegistry& registry) {
+  registry.Add("TypePool Allocate+Release", 0, 10000000, [](uint64_t ops) {
+    TypePool<PooledObject, int> pool;
+    for (uint64_t i = 0; i < ops; ++i) {
+      PooledObject* object = pool.Allocate(1);
+      pool.Release(object);
+    }
+  });
+  registry.Add("TypePool Allocate+Release contended", 0, 10000000,
+               [](uint64_t ops) {
+                 TypePool<PooledObject, int> pool;
+                 std::vector<std::thread> threads;
+                 for (uint32_t i = 0; i < 4; ++i) {
+                   threads.emplace_back([&pool, ops]() {
+                     for (uint64_t j = 0; j < ops / 4; ++j) {
+                       pool.Release(pool.Allocate(1));
+                     }
+                   });
+                 }
+                 for (auto& thread : threads) {
+                   thread.join();
+                 }
+               });
+}
+
+void AddHashBenchmarks(BenchRegistry& registry) {
+  for (size_t size : {size_t(16), size_t(256), size_t(4 * 1024),
+                      size_t(256 * 1024)}) {
+    registry.AddSized(
+        "hash::Hash64/" + SizeName(size), size, [size](uint64_t ops) {
+          uint64_t sum = 0;
+          for (uint64_t i = 0; i < ops; ++i) {
+            sum += hash::Hash64(SourceBuffer().data(), size, i);
+          }
+          sink += sum;
+        });
+    registry.AddSized(
+        "hash::ContentHash128/" + SizeName(size), size, [size](uint64_t ops) {
+          uint64_t sum = 0;
+          for (uint64_t i = 0; i < ops; ++i) {
+            sum += hash::ContentHash128(SourceBuffer().data(), size).high;
+          }
+          sink += sum;
+        });
+    registry.AddSized(
+        "utf8::hash_fnv1a/" + SizeName(size), size, [size](uint64_t ops) {
+          std::string_view view(
+              reinterpret_cast<const char*>(SourceBuffer().data()), size);
+          uint64_t sum = 0;
+          for (uint64_t i = 0; i < ops; ++i) {
+            sum += utf8::hash_fnv1a(view);
+          }
+          sink += sum;
+        });
+  }
+}
+
+void AddUtf8Benchmarks(BenchRegistry& registry) {
+  // Paths are mostly ASCII, titles' strings often are not.
+  static const std::string kAscii = "game:\\media\\textures\\level01.xpr";
+  static const std::string kMixed = "\xE3\x82\xB2\xE3\x83\xBC\xE3\x83\xA0 save";
+  for (const auto& [name, text] :
+       {std::make_pair("ascii", &kAscii), std::make_pair("mixed", &kMixed)}) {
+    for (size_t repeat : {size_t(1), size_t(64)}) {
+      std::string source;
+      for (size_t i = 0; i < repeat; ++i) {
+        source += *text;
+      }
+      std::u16string source_utf16 = xe::to_utf16(source);
+      registry.AddSized(std::string("to_utf16/") + name + "/" +
+                            SizeName(source.size()),
+                        source.size(), [source](uint64_t ops) {
+                          for (uint64_t i = 0; i < ops; ++i) {
+                            sink += xe::to_utf16(source).size();
+                          }
+                        });
+      registry.AddSized(std::string("to_utf8/") + name + "/" +
+                            SizeName(source.size()),
+                        source.size(), [source_utf16](uint64_t ops) {
+                          for (uint64_t i = 0; i < ops; ++i) {
+                            sink += xe::to_utf8(source_utf16).size();
+                          }
+                        });
+    }
+  }
+}
+
+int main(const std::vector<std::string>& args) {
+  BenchRegistry registry;
+  AddCopyBenchmarks(registry);
+  AddCompareBenchmarks(registry);
+  AddRingBufferBenchmarks(registry);
+  AddBitMapBenchmarks(registry);
+  AddArenaBenchmarks(registry);
+  AddTypePoolBenchmarks(registry);
+  AddHashBenchmarks(registry);
+  AddUtf8Benchmarks(registry);
+
+  CopyAndSwapExtension extension = copy_and_swap_extension();
+  registry.Run();
+  set_copy_and_swap_extension(extension);
+  return 0;
+}
+
+}  // namespace bench
+}  // namespace base
+}  // namespace xe
+
+DEFINE_ENTRY_POINT("xenia-base-bench", xe::base::bench::main, "[filter]",
+                   "bench_filter");
@@ -0,0 +1,22 @@
+project_root = "../../../../.."
+include(project_root.."/tools/build")
+
+group("tests")
+project("xenia-base-bench")
+  uuid("b3d5e8a1-6c2f-4f9e-9a47-1e0d2c8b5f73")
+  kind("ConsoleApp")
+  language("C++")
+  links({
+    "fmt",
+    "xenia-base",
+    "xxhash",
+  })
+  files({
+    "base_bench_main.cc",
+    "../../main_"..platform_suffix..".cc",
+  })
+  filter("platforms:Windows")
+    debugdir(project_root)
+
+    -- xenia-base needs this
+    links({"xenia-ui"})
@@ -0,0 +1,80 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "xenia/base/bit_map.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::base::test {
+
+TEST_CASE("BitMap acquire and release", "[bit_map]") {
+  BitMap bit_map(64 * 128);
+  constexpr size_t kSize = 64 * 128;
+  for (size_t i = 0; i < kSize; ++i) {
+    REQUIRE(bit_map.Acquire() == i);
+  }
+  REQUIRE(bit_map.Acquire() == size_t(-1));
+  // Lowest free entries first.
+  bit_map.Release(5000);
+  bit_map.Release(70);
+  REQUIRE(bit_map.Acquire() == 70);
+  REQUIRE(bit_map.Acquire() == 5000);
+  REQUIRE(bit_map.Acquire() == size_t(-1));
+  bit_map.Reset();
+  REQUIRE(bit_map.Acquire() == 0);
+}
+
+TEST_CASE("BitMap restored data", "[bit_map]") {
+  BitMap bit_map(128);
+  std::vector<uint64_t>& data = bit_map.data();
+  data[0] = 0;
+  data[1] = 1;
+  bit_map.UpdateSummary();
+  REQUIRE(bit_map.Acquire() == 127);
+  REQUIRE(bit_map.Acquire() == size_t(-1));
+}
+
+TEST_CASE("BitMap contention", "[bit_map]") {
+  // Nearly full, so the threads fight over the few free entries left.
+  constexpr size_t kSize = 64 * 64;
+  constexpr uint32_t kThreadCount = 8;
+  constexpr uint32_t kIterationCount = 20000;
+  BitMap bit_map(kSize);
+  for (size_t i = 0; i < kSize - kThreadCount; ++i) {
+    bit_map.Acquire();
+  }
+  std::vector<std::atomic<bool>> owned(kSize);
+  std::atomic<bool> failed{false};
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < kThreadCount; ++i) {
+    threads.emplace_back([&]() {
+      for (uint32_t j = 0; j < kIterationCount; ++j) {
+        // Every thread releases what it acquires, so there's always a free
+        // entry for it.
+        size_t index = bit_map.Acquire();
+        if (index >= kSize || owned[index].exchange(true)) {
+          failed = true;
+          return;
+        }
+        owned[index] = false;
+        bit_map.Release(index);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  REQUIRE(!failed);
+}
+
+}  // namespace xe::base::test
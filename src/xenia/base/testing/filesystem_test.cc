@@ -0,0 +1,50 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <filesystem>
+#include <memory>
+
+#include "xenia/base/filesystem.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::base::test {
+
+TEST_CASE("FileLock is exclusive", "[filesystem]") {
+  std::filesystem::path path =
+      std::filesystem::temp_directory_path() / "xenia_file_lock_test.lock";
+  std::unique_ptr<filesystem::FileLock> lock =
+      filesystem::FileLock::TryAcquire(path);
+  REQUIRE(lock);
+  REQUIRE(std::filesystem::exists(path));
+  REQUIRE(!filesystem::FileLock::TryAcquire(path));
+  lock.reset();
+  lock = filesystem::FileLock::TryAcquire(path);
+  REQUIRE(lock);
+  lock.reset();
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("FileLock for storage uses a lock file next to it",
+          "[filesystem]") {
+  std::filesystem::path path =
+      std::filesystem::temp_directory_path() / "xenia_file_lock_test.bin";
+  std::filesystem::path lock_path = path;
+  lock_path += ".lock";
+  std::unique_ptr<filesystem::FileLock> lock =
+      filesystem::FileLock::TryAcquireForStorage(path);
+  REQUIRE(lock);
+  REQUIRE(std::filesystem::exists(lock_path));
+  REQUIRE(!std::filesystem::exists(path));
+  REQUIRE(!filesystem::FileLock::TryAcquire(lock_path));
+  lock.reset();
+  std::filesystem::remove(lock_path);
+}
+
+}  // namespace xe::base::test
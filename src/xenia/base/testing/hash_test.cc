@@ -0,0 +1,78 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <cstdint>
+#include <vector>
+
+#include "xenia/base/hash.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::base::test {
+
+std::vector<uint8_t> MakeHashTestData(size_t size) {
+  std::vector<uint8_t> data(size);
+  for (size_t i = 0; i < size; ++i) {
+    data[i] = uint8_t(i * 131 + (i >> 8));
+  }
+  return data;
+}
+
+TEST_CASE("Hash64 matches XXH64", "[hash]") {
+  std::vector<uint8_t> data = MakeHashTestData(1000);
+  REQUIRE(hash::Hash64(data.data(), data.size()) ==
+          XXH64(data.data(), data.size(), 0));
+  REQUIRE(hash::Hash64(data.data(), data.size(), 5) ==
+          XXH64(data.data(), data.size(), 5));
+  uint64_t key = 0x0123456789ABCDEFull;
+  REQUIRE(hash::HashKey(key) == XXH64(&key, sizeof(key), 0));
+}
+
+TEST_CASE("Streaming Hash64 matches one-shot", "[hash]") {
+  std::vector<uint8_t> data = MakeHashTestData(1000);
+  hash::StreamingHash64 hash;
+  hash.Update(data.data(), 3);
+  hash.Update(data.data() + 3, 500);
+  hash.Update(data.data() + 503, data.size() - 503);
+  REQUIRE(hash.Digest() == hash::Hash64(data.data(), data.size()));
+  hash.Reset();
+  hash.Update(data.data(), data.size());
+  REQUIRE(hash.Digest() == hash::Hash64(data.data(), data.size()));
+}
+
+TEST_CASE("Hash128 low half is Hash64", "[hash]") {
+  // Sizes around the chunk size of the two lanes.
+  for (size_t size : {size_t(0), size_t(17), size_t(4096), size_t(4097),
+                      size_t(20000)}) {
+    std::vector<uint8_t> data = MakeHashTestData(size);
+    hash::Hash128 hash = hash::ContentHash128(data.data(), size);
+    REQUIRE(hash.low == hash::Hash64(data.data(), size));
+    REQUIRE(hash.high != hash.low);
+  }
+}
+
+TEST_CASE("Streaming Hash128 matches one-shot", "[hash]") {
+  std::vector<uint8_t> data = MakeHashTestData(20000);
+  hash::StreamingHash128 hash;
+  hash.Update(data.data(), 1);
+  hash.Update(data.data() + 1, 9000);
+  hash.Update(data.data() + 9001, data.size() - 9001);
+  REQUIRE(hash.Digest() == hash::ContentHash128(data.data(), data.size()));
+}
+
+TEST_CASE("Hash128 depends on all the data", "[hash]") {
+  std::vector<uint8_t> data = MakeHashTestData(10000);
+  hash::Hash128 hash = hash::ContentHash128(data.data(), data.size());
+  data[9999] ^= 1;
+  hash::Hash128 changed_hash = hash::ContentHash128(data.data(), data.size());
+  REQUIRE(changed_hash.low != hash.low);
+  REQUIRE(changed_hash.high != hash.high);
+}
+
+}  // namespace xe::base::test
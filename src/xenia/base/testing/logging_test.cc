@@ -0,0 +1,96 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "xenia/base/logging.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::base::test {
+
+namespace {
+
+enum class TestEnum : uint8_t {
+  kValue = 3,
+};
+
+// Encodes the line like deferred logging does and formats it like the writer
+// thread.
+template <typename... Args>
+std::string FormatDeferred(char* buffer, size_t buffer_size,
+                           const char* format, const Args&... args) {
+  using namespace logging::internal;
+  size_t written =
+      EncodeDeferredLogLine(buffer, buffer_size, format, args...);
+  REQUIRE(written <= buffer_size);
+  DeferredLogHeader header;
+  std::memcpy(&header, buffer, sizeof(header));
+  REQUIRE(header.format == format);
+  char text[256];
+  size_t length = header.formatter(
+      header.format, reinterpret_cast<const uint8_t*>(buffer) + sizeof(header),
+      text, sizeof(text));
+  return std::string(text, std::min(length, sizeof(text)));
+}
+
+}  // namespace
+
+TEST_CASE("Deferred log arguments", "[logging]") {
+  using namespace logging::internal;
+  REQUIRE(IsDeferredLogArg<int>());
+  REQUIRE(IsDeferredLogArg<char[6]>());
+  REQUIRE(IsDeferredLogArg<std::string>());
+  REQUIRE(IsDeferredLogArg<TestEnum>());
+  REQUIRE(IsDeferredLogArg<const void*>());
+  REQUIRE(!IsDeferredLogArg<std::u16string>());
+  REQUIRE(!IsDeferredLogArg<const int*>());
+}
+
+TEST_CASE("Deferred log formatting", "[logging]") {
+  char buffer[1024];
+  REQUIRE(FormatDeferred(buffer, sizeof(buffer), "no arguments {{}}") ==
+          "no arguments {}");
+  REQUIRE(FormatDeferred(buffer, sizeof(buffer), "{:08X} {} {:.2f} {}",
+                         uint32_t(0x82000000), int64_t(-5), 1.5, true) ==
+          "82000000 -5 1.50 true");
+  std::string str = "string";
+  const char* c_str = "c string";
+  REQUIRE(FormatDeferred(buffer, sizeof(buffer), "{} {} {} {}", str,
+                         std::string_view(str).substr(1, 3), c_str,
+                         "literal") == "string tri c string literal");
+  // Strings are copied, the originals may be gone when the line is written.
+  {
+    std::string temporary = "temporary";
+    size_t written = logging::internal::EncodeDeferredLogLine(
+        buffer, sizeof(buffer), "{} {}", temporary, 7);
+    REQUIRE(written > temporary.size());
+    temporary.assign(temporary.size(), 'x');
+  }
+  logging::internal::DeferredLogHeader header;
+  std::memcpy(&header, buffer, sizeof(header));
+  char text[64];
+  size_t length = header.formatter(
+      header.format, reinterpret_cast<const uint8_t*>(buffer) + sizeof(header),
+      text, sizeof(text));
+  REQUIRE(std::string_view(text, length) == "temporary 7");
+}
+
+TEST_CASE("Deferred log truncation", "[logging]") {
+  // Long strings are truncated to the buffer rather than overflowing it.
+  char buffer[sizeof(logging::internal::DeferredLogHeader) + 12];
+  std::string long_str(100, 'a');
+  REQUIRE(FormatDeferred(buffer, sizeof(buffer), "{}", long_str) ==
+          std::string(8, 'a'));
+}
+
+}  // namespace xe::base::test
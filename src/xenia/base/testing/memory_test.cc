@@ -9,7 +9,11 @@
 
 #include "xenia/base/memory.h"
 
+#include <vector>
+
 #include "third_party/catch/include/catch.hpp"
+#include "xenia/base/byte_order.h"
+#include "xenia/base/math.h"
 
 namespace xe {
 namespace base {
@@ -414,6 +418,129 @@ TEST_CASE("copy_and_swap_16_in_32_unaligned", "Copy and Swap") {
   REQUIRE(true == true);
 }
 
+const CopyAndSwapExtension kCopyAndSwapExtensions[] = {
+    CopyAndSwapExtension::kBaseline,
+    CopyAndSwapExtension::kAVX2,
+    CopyAndSwapExtension::kAVX512,
+};
+
+template <typename T>
+void TestCopyAndSwapExtension(void (*copy_and_swap)(void*, const void*,
+                                                    size_t)) {
+  // Odd counts and offsets to cover the vector loop tails and the alignment
+  // prologue of the non-temporal path, which starts at 1 MB.
+  const size_t kCounts[] = {0, 1, 7, 33, 255, 4097, (2 << 20) / sizeof(T) + 5};
+  const size_t kOffsets[] = {0, sizeof(T), 1, 3};
+  size_t max_size = (2 << 20) + 8 * sizeof(T) + 16;
+  std::vector<uint8_t> src(max_size), dest(max_size);
+  for (size_t i = 0; i < max_size; ++i) {
+    src[i] = uint8_t(i * 7 + (i >> 8));
+  }
+  for (size_t count : kCounts) {
+    for (size_t dest_offset : kOffsets) {
+      for (size_t src_offset : kOffsets) {
+        std::fill(dest.begin(), dest.end(), uint8_t(0xCD));
+        copy_and_swap(dest.data() + dest_offset, src.data() + src_offset,
+                      count);
+        bool matches = true;
+        for (size_t i = 0; i < count && matches; ++i) {
+          T value;
+          std::memcpy(&value, src.data() + src_offset + i * sizeof(T),
+                      sizeof(T));
+          value = xe::byte_swap(value);
+          matches = !std::memcmp(dest.data() + dest_offset + i * sizeof(T),
+                                 &value, sizeof(T));
+        }
+        REQUIRE(matches);
+        // Nothing past the end may be written.
+        REQUIRE(dest[dest_offset + count * sizeof(T)] == 0xCD);
+      }
+    }
+  }
+}
+
+TEST_CASE("copy_and_swap_extensions", "Copy and Swap") {
+  CopyAndSwapExtension old_extension = copy_and_swap_extension();
+  for (CopyAndSwapExtension extension : kCopyAndSwapExtensions) {
+    set_copy_and_swap_extension(extension);
+    if (copy_and_swap_extension() != extension) {
+      // Not supported by this CPU.
+      continue;
+    }
+    TestCopyAndSwapExtension<uint16_t>(copy_and_swap_16_unaligned);
+    TestCopyAndSwapExtension<uint32_t>(copy_and_swap_32_unaligned);
+    TestCopyAndSwapExtension<uint64_t>(copy_and_swap_64_unaligned);
+  }
+  set_copy_and_swap_extension(old_extension);
+}
+
+TEST_CASE("find_first_difference", "Compare") {
+  std::vector<uint8_t> a(4096 + 3), b(4096 + 3);
+  for (size_t i = 0; i < a.size(); ++i) {
+    a[i] = b[i] = uint8_t(i * 13 + 5);
+  }
+  const size_t kSizes[] = {0, 1, 15, 16, 17, 63, 64, 65, 200, 4096 + 3};
+  for (size_t size : kSizes) {
+    REQUIRE(find_first_difference(a.data(), b.data(), size) == size);
+    for (size_t offset = 0; offset < size; offset += 7) {
+      b[offset] ^= 0x10;
+      REQUIRE(find_first_difference(a.data(), b.data(), size) == offset);
+      // Later differences don't matter.
+      if (offset + 1 < size) {
+        b[size - 1] ^= 0x01;
+        REQUIRE(find_first_difference(a.data(), b.data(), size) == offset);
+        b[size - 1] ^= 0x01;
+      }
+      b[offset] ^= 0x10;
+    }
+  }
+  // Unaligned buffers.
+  REQUIRE(find_first_difference(a.data() + 1, b.data() + 1, 4096) == 4096);
+}
+
+TEST_CASE("count_leading_equal_32", "Compare") {
+  const uint32_t kPattern = 0x12345678;
+  std::vector<uint32_t> data(1031, kPattern);
+  const size_t kCounts[] = {0, 1, 3, 4, 5, 16, 17, 100, 1031};
+  for (size_t count : kCounts) {
+    REQUIRE(count_leading_equal_32(data.data(), kPattern, count) == count);
+    for (size_t index = 0; index < count; index += 3) {
+      // A single differing byte is a mismatch.
+      data[index] ^= 0x100;
+      REQUIRE(count_leading_equal_32(data.data(), kPattern, count) == index);
+      data[index] ^= 0x100;
+    }
+  }
+  REQUIRE(count_leading_equal_32(data.data(), 0, data.size()) == 0);
+}
+
+TEST_CASE("fill_32", "Fill") {
+  const size_t kCounts[] = {0, 1, 3, 4, 15, 16, 17, 100, 1031};
+  for (size_t count : kCounts) {
+    std::vector<uint32_t> data(count + 2, 0xCDCDCDCD);
+    fill_32(data.data() + 1, 0xA1B2C3D4, count);
+    REQUIRE(data[0] == 0xCDCDCDCD);
+    for (size_t i = 0; i < count; ++i) {
+      REQUIRE(data[1 + i] == 0xA1B2C3D4);
+    }
+    REQUIRE(data[1 + count] == 0xCDCDCDCD);
+  }
+}
+
+TEST_CASE("find_zero_16", "Compare") {
+  std::vector<uint16_t> data(300, 0x4100);
+  for (size_t start = 0; start < 9; ++start) {
+    for (size_t length = 0; length < 100; ++length) {
+      data[start + length] = 0;
+      REQUIRE(find_zero_16(data.data() + start, 200) == length);
+      // The limit is respected even if the terminator is beyond it.
+      REQUIRE(find_zero_16(data.data() + start, length / 2) == length / 2);
+      data[start + length] = 0x4100;
+    }
+  }
+  REQUIRE(find_zero_16(data.data(), data.size()) == data.size());
+}
+
 }  // namespace test
 }  // namespace base
 }  // namespace xe
@@ -5,5 +5,6 @@ test_suite("xenia-base-tests", project_root, ".", {
   links = {
     "fmt",
     "xenia-base",
+    "xxhash",
   },
 })
@@ -0,0 +1,81 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <cstdint>
+
+#include "xenia/base/ring_buffer.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::base::test {
+
+namespace {
+
+// Fills the buffer with big-endian 32-bit values 0, 1, 2... starting at the
+// byte offset, wrapping around the end.
+void FillRing(RingBuffer& ring, size_t offset, uint32_t count) {
+  ring.set_read_offset(offset);
+  ring.set_write_offset(offset);
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t value = xe::byte_swap(i);
+    ring.Write(value);
+  }
+}
+
+}  // namespace
+
+TEST_CASE("RingBuffer bulk swapped read: contiguous", "[ring_buffer]") {
+  uint8_t storage[64];
+  RingBuffer ring(storage, sizeof(storage));
+  uint32_t values[15];
+  FillRing(ring, 4, 8);
+  REQUIRE(ring.ReadAndSwap(values, 8) == 8);
+  for (uint32_t i = 0; i < 8; ++i) {
+    REQUIRE(values[i] == i);
+  }
+  REQUIRE(ring.empty());
+}
+
+TEST_CASE("RingBuffer bulk swapped read: wrapping", "[ring_buffer]") {
+  uint8_t storage[64];
+  RingBuffer ring(storage, sizeof(storage));
+  uint32_t values[15];
+  FillRing(ring, 48, 10);
+  REQUIRE(ring.ReadAndSwap(values, 10) == 10);
+  for (uint32_t i = 0; i < 10; ++i) {
+    REQUIRE(values[i] == i);
+  }
+  REQUIRE(ring.read_offset() == 24);
+}
+
+TEST_CASE("RingBuffer bulk swapped read: split value", "[ring_buffer]") {
+  uint8_t storage[64];
+  RingBuffer ring(storage, sizeof(storage));
+  uint32_t values[15];
+  FillRing(ring, 50, 10);
+  REQUIRE(ring.ReadAndSwap(values, 10) == 10);
+  for (uint32_t i = 0; i < 10; ++i) {
+    REQUIRE(values[i] == i);
+  }
+  REQUIRE(ring.read_offset() == 26);
+}
+
+TEST_CASE("RingBuffer bulk swapped read: partial", "[ring_buffer]") {
+  uint8_t storage[64];
+  RingBuffer ring(storage, sizeof(storage));
+  uint32_t values[15];
+  FillRing(ring, 40, 3);
+  REQUIRE(ring.ReadAndSwap(values, 15) == 3);
+  for (uint32_t i = 0; i < 3; ++i) {
+    REQUIRE(values[i] == i);
+  }
+  REQUIRE(ring.empty());
+}
+
+}  // namespace xe::base::test
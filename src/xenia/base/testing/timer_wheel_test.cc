@@ -0,0 +1,150 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "xenia/base/timer_wheel.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::base::test {
+
+using xe::threading::TimerWheel;
+using namespace std::chrono_literals;
+
+namespace {
+
+// Generous, the host may be busy running other tests.
+constexpr std::chrono::milliseconds kTimeout = 5s;
+
+bool WaitForCount(const std::atomic<uint32_t>& count, uint32_t expected) {
+  auto deadline = TimerWheel::clock::now() + kTimeout;
+  while (count.load() < expected) {
+    if (TimerWheel::clock::now() >= deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(1ms);
+  }
+  return true;
+}
+
+// Periodic, so the timer is still scheduled while its callback is running.
+// The callback blocks until release is set.
+TimerWheel::TimerId ScheduleBlockingTimer(TimerWheel& wheel,
+                                          std::atomic<uint32_t>& count,
+                                          std::atomic<bool>& release) {
+  return wheel.Schedule(TimerWheel::clock::now(), 1ms, [&count, &release]() {
+    ++count;
+    while (!release.load()) {
+      std::this_thread::sleep_for(1ms);
+    }
+  });
+}
+
+}  // namespace
+
+TEST_CASE("TimerWheel fires timers cascaded from upper levels",
+          "[timer_wheel]") {
+  TimerWheel wheel;
+  // 100us ticks, 64 slots per level: the first timer is on level 0, the
+  // second one on level 1 and the third one on level 2.
+  const std::chrono::milliseconds due_times[] = {2ms, 30ms, 450ms};
+  TimerWheel::clock::time_point fire_times[3];
+  std::atomic<uint32_t> count{0};
+  auto start = TimerWheel::clock::now();
+  for (uint32_t i = 0; i < 3; ++i) {
+    wheel.Schedule(start + due_times[i], 0ns, [&, i]() {
+      fire_times[i] = TimerWheel::clock::now();
+      ++count;
+    });
+  }
+  REQUIRE(WaitForCount(count, 3));
+  for (uint32_t i = 0; i < 3; ++i) {
+    REQUIRE(fire_times[i] >= start + due_times[i]);
+  }
+  REQUIRE(fire_times[0] <= fire_times[1]);
+  REQUIRE(fire_times[1] <= fire_times[2]);
+}
+
+TEST_CASE("TimerWheel re-arms periodic timers", "[timer_wheel]") {
+  TimerWheel wheel;
+  std::atomic<uint32_t> count{0};
+  auto start = TimerWheel::clock::now();
+  TimerWheel::TimerId id =
+      wheel.Schedule(start + 1ms, 5ms, [&count]() { ++count; });
+  REQUIRE(WaitForCount(count, 4));
+  uint32_t fired_count = count.load();
+  auto elapsed = TimerWheel::clock::now() - start;
+  // Never called early, and periods missed are dropped, not made up for.
+  REQUIRE(elapsed >= 1ms + 3 * 5ms);
+  REQUIRE(fired_count <= 1 + elapsed / 5ms);
+  REQUIRE(wheel.Cancel(id));
+  uint32_t cancelled_count = count.load();
+  std::this_thread::sleep_for(20ms);
+  REQUIRE(count.load() == cancelled_count);
+  REQUIRE_FALSE(wheel.Cancel(id));
+}
+
+TEST_CASE("TimerWheel cancel waits for the running callback",
+          "[timer_wheel]") {
+  TimerWheel wheel;
+  std::atomic<uint32_t> count{0};
+  std::atomic<bool> release{false};
+  TimerWheel::TimerId id = ScheduleBlockingTimer(wheel, count, release);
+  REQUIRE(WaitForCount(count, 1));
+  std::atomic<bool> cancelled{false};
+  bool found = false;
+  std::thread cancel_thread([&]() {
+    found = wheel.Cancel(id);
+    cancelled = true;
+  });
+  std::this_thread::sleep_for(20ms);
+  REQUIRE_FALSE(cancelled.load());
+  release = true;
+  cancel_thread.join();
+  REQUIRE(found);
+  std::this_thread::sleep_for(20ms);
+  REQUIRE(count.load() == 1);
+}
+
+TEST_CASE("TimerWheel cancel without waiting for the running callback",
+          "[timer_wheel]") {
+  TimerWheel wheel;
+  std::atomic<uint32_t> count{0};
+  std::atomic<bool> release{false};
+  TimerWheel::TimerId id = ScheduleBlockingTimer(wheel, count, release);
+  REQUIRE(WaitForCount(count, 1));
+  // Returns with the callback still blocked.
+  REQUIRE(wheel.Cancel(id, false));
+  release = true;
+  std::this_thread::sleep_for(20ms);
+  REQUIRE(count.load() == 1);
+}
+
+TEST_CASE("TimerWheel parks timers beyond the top level", "[timer_wheel]") {
+  TimerWheel wheel;
+  std::atomic<uint32_t> far_count{0};
+  std::atomic<uint32_t> near_count{0};
+  auto start = TimerWheel::clock::now();
+  // Past the ~29.8 hours all levels span.
+  TimerWheel::TimerId far_id =
+      wheel.Schedule(start + 48h, 0ns, [&far_count]() { ++far_count; });
+  // A timer due before it isn't held up by the parked one.
+  wheel.Schedule(start + 10ms, 0ns, [&near_count]() { ++near_count; });
+  REQUIRE(WaitForCount(near_count, 1));
+  REQUIRE(TimerWheel::clock::now() - start < kTimeout);
+  std::this_thread::sleep_for(20ms);
+  REQUIRE(far_count.load() == 0);
+  // Still scheduled rather than dropped.
+  REQUIRE(wheel.Cancel(far_id));
+}
+
+}  // namespace xe::base::test
@@ -0,0 +1,97 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "xenia/base/type_pool.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::base::test {
+
+namespace {
+
+struct PooledObject {
+  explicit PooledObject(std::atomic<int>* live_count)
+      : live_count(live_count) {
+    live_count->fetch_add(1);
+  }
+  ~PooledObject() { live_count->fetch_sub(1); }
+
+  std::atomic<int>* live_count;
+  std::atomic<bool> in_use{false};
+  uint64_t value = 0;
+};
+
+}  // namespace
+
+TEST_CASE("TypePool reuse", "[type_pool]") {
+  std::atomic<int> live_count{0};
+  {
+    TypePool<PooledObject, std::atomic<int>*> pool;
+    PooledObject* a = pool.Allocate(&live_count);
+    PooledObject* b = pool.Allocate(&live_count);
+    REQUIRE(a != b);
+    REQUIRE(live_count == 2);
+    pool.Release(a);
+    pool.Release(b);
+    // Last released first.
+    REQUIRE(pool.Allocate(&live_count) == b);
+    REQUIRE(pool.Allocate(&live_count) == a);
+    REQUIRE(live_count == 2);
+    pool.Release(a);
+    pool.Reset();
+    REQUIRE(live_count == 1);
+    pool.Release(b);
+  }
+  REQUIRE(live_count == 0);
+}
+
+TEST_CASE("TypePool contention", "[type_pool]") {
+  constexpr uint32_t kThreadCount = 8;
+  constexpr uint32_t kIterationCount = 100000;
+  std::atomic<int> live_count{0};
+  std::atomic<bool> shared_object{false};
+  {
+    TypePool<PooledObject, std::atomic<int>*> pool;
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < kThreadCount; ++i) {
+      threads.emplace_back([&, i]() {
+        PooledObject* held[2];
+        for (uint32_t j = 0; j < kIterationCount; ++j) {
+          // Hold more than one object at a time so the stack changes order.
+          for (PooledObject*& object : held) {
+            object = pool.Allocate(&live_count);
+            if (object->in_use.exchange(true)) {
+              shared_object = true;
+            }
+            object->value = uint64_t(i) << 32 | j;
+          }
+          for (PooledObject* object : held) {
+            if (object->value != (uint64_t(i) << 32 | j)) {
+              shared_object = true;
+            }
+            object->in_use = false;
+            pool.Release(object);
+          }
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    REQUIRE(!shared_object);
+    REQUIRE(live_count <= int(kThreadCount * 2));
+  }
+  REQUIRE(live_count == 0);
+}
+
+}  // namespace xe::base::test
@@ -9,9 +9,354 @@
 
 #include "xenia/base/threading.h"
 
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/base/memory.h"
+#include "xenia/base/platform.h"
+#include "xenia/base/utf8.h"
+
+DEFINE_bool(thread_roles, true,
+            "Place emulator threads on host processors by what they are doing, "
+            "keeping the guest hardware threads and the GPU command processor "
+            "on separate performance cores and background work such as shader "
+            "compilation on the rest, when the host has enough cores.",
+            "CPU");
+DEFINE_string(thread_role_affinities, "",
+              "Overrides of the host logical processor masks (hexadecimal, 0 "
+              "for any processor) of thread roles, such as \"gpu=30,io=c0\". "
+              "Roles: guest0 to guest5 (guest hardware threads), gpu, shader, "
+              "audio, io.",
+              "CPU");
+DEFINE_bool(pin_guest_hardware_threads, false,
+            "Pin the host thread behind every guest thread to the host "
+            "logical processor of the guest hardware thread it's running on, "
+            "honoring the guest thread affinities. The two hardware threads "
+            "of a guest core are placed on one physical host core with "
+            "simultaneous multithreading, or share a host core if there are "
+            "too few of them. Requires thread_roles.",
+            "CPU");
+DEFINE_string(thread_role_priorities, "",
+              "Overrides of the priorities of thread roles, from -2 (lowest) "
+              "to 2 (highest), such as \"gpu=1,shader=-1\".",
+              "CPU");
+DEFINE_bool(numa_placement, true,
+            "On hosts with multiple NUMA nodes, keep the guest memory, the JIT "
+            "code cache and the threads accessing them the most (the guest "
+            "hardware threads and the GPU command processor) on the node of "
+            "the GPU, so they don't have to go through the interconnect.",
+            "CPU");
+DEFINE_int32(numa_node, -1,
+             "The NUMA node for numa_placement, or -1 for the node the GPU is "
+             "attached to if it can be obtained.",
+             "CPU");
+DEFINE_bool(high_resolution_sleep, true,
+            "Perform short sleeps of guest and emulator threads precisely "
+            "instead of rounding them up to the host scheduler tick.",
+            "CPU");
+DEFINE_int32(sleep_spin_threshold_us, 100,
+             "Sleeps shorter than this many microseconds are done by yielding "
+             "in a loop until the time has passed rather than waiting on a "
+             "timer. Requires high_resolution_sleep.",
+             "CPU");
+
 namespace xe {
 namespace threading {
 
+namespace {
+
+constexpr const char* kThreadRoleNames[] = {
+    "guest0", "guest1", "guest2", "guest3", "guest4",
+    "guest5", "gpu",    "shader", "audio",  "io",
+};
+static_assert(xe::countof(kThreadRoleNames) == size_t(ThreadRole::kCount));
+
+constexpr size_t kGuestHardwareThreadCount = 6;
+
+struct ThreadRoleConfig {
+  uint64_t affinity_masks[size_t(ThreadRole::kCount)] = {};
+  int32_t priorities[size_t(ThreadRole::kCount)] = {};
+};
+
+// Gives every guest hardware thread its own host logical processor, with the
+// hardware threads of one guest core on the logical processors of one host
+// core so they share the caches and wake each other up as cheaply as on the
+// Xenon. Returns the index of the first performance core left for other roles.
+size_t PinGuestHardwareThreads(const std::vector<uint64_t>& performance_cores,
+                               uint64_t* masks) {
+  constexpr size_t kGuestCoreCount = kGuestHardwareThreadCount / 2;
+  uint64_t* guest_masks = masks + size_t(ThreadRole::kGuestHardwareThread0);
+  bool smt = performance_cores.size() >= kGuestCoreCount;
+  for (size_t i = 0; smt && i < kGuestCoreCount; ++i) {
+    smt = xe::bit_count(performance_cores[i]) >= 2;
+  }
+  if (smt) {
+    for (size_t i = 0; i < kGuestHardwareThreadCount; ++i) {
+      uint64_t core_mask = performance_cores[i >> 1];
+      if (i & 1) {
+        // The second logical processor of the core.
+        core_mask &= core_mask - 1;
+      }
+      guest_masks[i] = core_mask & ~(core_mask - 1);
+    }
+    return kGuestCoreCount;
+  }
+  if (performance_cores.size() >= kGuestHardwareThreadCount) {
+    for (size_t i = 0; i < kGuestHardwareThreadCount; ++i) {
+      guest_masks[i] = performance_cores[i];
+    }
+    return kGuestHardwareThreadCount;
+  }
+  // Fewer host cores than guest hardware threads, keep the hardware threads of
+  // a guest core together at least.
+  for (size_t i = 0; i < kGuestHardwareThreadCount; ++i) {
+    guest_masks[i] = performance_cores[(i >> 1) % performance_cores.size()];
+  }
+  return performance_cores.size();
+}
+
+void SetCoreThreadRoleAffinities(const std::vector<ProcessorCore>& cores,
+                                 ThreadRoleConfig& config) {
+  if (cores.empty()) {
+    return;
+  }
+  uint32_t performance_class = 0;
+  for (const ProcessorCore& core : cores) {
+    performance_class = std::max(performance_class, core.efficiency_class);
+  }
+  std::vector<uint64_t> performance_cores;
+  uint64_t efficiency_mask = 0;
+  for (const ProcessorCore& core : cores) {
+    if (core.efficiency_class == performance_class) {
+      performance_cores.push_back(core.logical_processor_mask);
+    } else {
+      efficiency_mask |= core.logical_processor_mask;
+    }
+  }
+  uint64_t* masks = config.affinity_masks;
+  size_t first_spare_core;
+  if (cvars::pin_guest_hardware_threads) {
+    first_spare_core = PinGuestHardwareThreads(performance_cores, masks);
+  } else if (performance_cores.size() > kGuestHardwareThreadCount) {
+    // A core for every guest hardware thread and one for the command processor.
+    for (size_t i = 0; i < kGuestHardwareThreadCount; ++i) {
+      masks[size_t(ThreadRole::kGuestHardwareThread0) + i] =
+          performance_cores[i];
+    }
+    first_spare_core = kGuestHardwareThreadCount;
+  } else if (performance_cores.size() > kGuestHardwareThreadCount / 2) {
+    // Like on the Xenon, two hardware threads per core.
+    for (size_t i = 0; i < kGuestHardwareThreadCount; ++i) {
+      masks[size_t(ThreadRole::kGuestHardwareThread0) + i] =
+          performance_cores[i >> 1];
+    }
+    first_spare_core = kGuestHardwareThreadCount / 2;
+  } else {
+    // Too few cores to separate anything, only keep background work away from
+    // the performance cores of hybrid processors.
+    masks[size_t(ThreadRole::kShaderCompilation)] = efficiency_mask;
+    masks[size_t(ThreadRole::kIo)] = efficiency_mask;
+    return;
+  }
+  if (first_spare_core < performance_cores.size()) {
+    masks[size_t(ThreadRole::kGpuCommandProcessor)] =
+        performance_cores[first_spare_core];
+  }
+  uint64_t spare_mask = 0;
+  for (size_t i = first_spare_core + 1; i < performance_cores.size(); ++i) {
+    spare_mask |= performance_cores[i];
+  }
+  // Audio is latency-sensitive, but light, so it doesn't need a whole core -
+  // prefer the performance cores not taken by anything else, if left any.
+  masks[size_t(ThreadRole::kAudio)] = spare_mask ? spare_mask : efficiency_mask;
+  masks[size_t(ThreadRole::kShaderCompilation)] = spare_mask | efficiency_mask;
+  masks[size_t(ThreadRole::kIo)] = spare_mask | efficiency_mask;
+}
+
+void SetDefaultThreadRoleAffinities(ThreadRoleConfig& config) {
+  std::vector<ProcessorCore> cores = GetProcessorCores();
+  int32_t numa_node = GetEmulationNumaNode();
+  uint64_t node_mask = 0;
+  uint64_t other_nodes_mask = 0;
+  if (numa_node >= 0) {
+    std::vector<ProcessorCore> node_cores;
+    for (const ProcessorCore& core : cores) {
+      if (core.numa_node == uint32_t(numa_node)) {
+        node_cores.push_back(core);
+        node_mask |= core.logical_processor_mask;
+      } else {
+        other_nodes_mask |= core.logical_processor_mask;
+      }
+    }
+    // Nodes with memory, but without processors, can only be used for memory.
+    if (!node_cores.empty()) {
+      cores = std::move(node_cores);
+    }
+  }
+  SetCoreThreadRoleAffinities(cores, config);
+  if (!node_mask) {
+    return;
+  }
+  // The roles that may run anywhere on the node still access the guest memory,
+  // but shader compilation only works with host memory and may also use the
+  // processors of the other nodes.
+  for (size_t i = 0; i < size_t(ThreadRole::kCount); ++i) {
+    uint64_t& mask = config.affinity_masks[i];
+    if (!mask) {
+      mask = node_mask;
+    }
+    if (ThreadRole(i) == ThreadRole::kShaderCompilation) {
+      mask |= other_nodes_mask;
+    }
+  }
+}
+
+// Calls the function for every "role=value" entry in a comma-separated list.
+template <typename Function>
+void ParseThreadRoleOverrides(const std::string& list, const char* cvar_name,
+                              Function function) {
+  for (std::string_view entry : xe::utf8::split(list, ",", true)) {
+    size_t separator = entry.find('=');
+    std::string_view name = entry.substr(0, separator);
+    size_t role = 0;
+    while (role < size_t(ThreadRole::kCount) &&
+           name != kThreadRoleNames[role]) {
+      ++role;
+    }
+    if (separator == std::string_view::npos ||
+        role >= size_t(ThreadRole::kCount)) {
+      XELOGW("{}: ignoring invalid entry \"{}\"", cvar_name, entry);
+      continue;
+    }
+    function(role, std::string(entry.substr(separator + 1)));
+  }
+}
+
+ThreadRoleConfig CreateThreadRoleConfig() {
+  ThreadRoleConfig config;
+  if (!cvars::thread_roles) {
+    return config;
+  }
+  SetDefaultThreadRoleAffinities(config);
+#if XE_PLATFORM_WIN32
+  // On POSIX, setting a priority switches the thread to real-time scheduling,
+  // so only do that when explicitly requested.
+  config.priorities[size_t(ThreadRole::kGpuCommandProcessor)] =
+      ThreadPriority::kAboveNormal;
+  config.priorities[size_t(ThreadRole::kShaderCompilation)] =
+      ThreadPriority::kBelowNormal;
+  config.priorities[size_t(ThreadRole::kAudio)] = ThreadPriority::kAboveNormal;
+#endif
+  ParseThreadRoleOverrides(
+      cvars::thread_role_affinities, "thread_role_affinities",
+      [&config](size_t role, const std::string& value) {
+        config.affinity_masks[role] = std::strtoull(value.c_str(), nullptr, 16);
+      });
+  ParseThreadRoleOverrides(
+      cvars::thread_role_priorities, "thread_role_priorities",
+      [&config](size_t role, const std::string& value) {
+        int32_t priority = int32_t(std::strtol(value.c_str(), nullptr, 10));
+        config.priorities[role] =
+            std::min(std::max(priority, int32_t(ThreadPriority::kLowest)),
+                     int32_t(ThreadPriority::kHighest));
+      });
+  for (size_t i = 0; i < size_t(ThreadRole::kCount); ++i) {
+    XELOGI("Thread role {}: affinity mask {:X}, priority {}",
+           kThreadRoleNames[i], config.affinity_masks[i],
+           config.priorities[i]);
+  }
+  return config;
+}
+
+const ThreadRoleConfig& GetThreadRoleConfig() {
+  // Created on the first use, after the configuration has been loaded.
+  static const ThreadRoleConfig config = CreateThreadRoleConfig();
+  return config;
+}
+
+}  // namespace
+
+int32_t GetEmulationNumaNode() {
+  // Chosen on the first use, after the configuration has been loaded.
+  static const int32_t numa_node = [] {
+    uint32_t node_count = xe::memory::numa_node_count();
+    if (!cvars::numa_placement || node_count <= 1) {
+      return int32_t(-1);
+    }
+    int32_t node = cvars::numa_node;
+    if (node < 0) {
+      node = GetDisplayAdapterNumaNode();
+      if (node < 0) {
+        XELOGI(
+            "NUMA node of the GPU unknown, not placing the guest memory on a "
+            "specific node - set numa_node to choose it");
+        return int32_t(-1);
+      }
+    }
+    if (uint32_t(node) >= node_count) {
+      XELOGW("numa_node: node {} doesn't exist, the host has {} nodes", node,
+             node_count);
+      return int32_t(-1);
+    }
+    XELOGI("Placing the guest memory and the emulation threads on NUMA node {}",
+           node);
+    return node;
+  }();
+  return numa_node;
+}
+
+uint64_t GetThreadRoleAffinityMask(ThreadRole role) {
+  assert_true(role < ThreadRole::kCount);
+  return GetThreadRoleConfig().affinity_masks[size_t(role)];
+}
+
+int32_t GetThreadRolePriority(ThreadRole role) {
+  assert_true(role < ThreadRole::kCount);
+  return GetThreadRoleConfig().priorities[size_t(role)];
+}
+
+void ApplyThreadRole(Thread* thread, ThreadRole role) {
+  if (!thread) {
+    return;
+  }
+  uint64_t affinity_mask = GetThreadRoleAffinityMask(role);
+  if (affinity_mask) {
+    thread->set_affinity_mask(affinity_mask);
+  }
+  int32_t priority = GetThreadRolePriority(role);
+  if (priority != ThreadPriority::kNormal) {
+    thread->set_priority(priority);
+  }
+}
+
+uint64_t GetGuestThreadAffinityMask(uint32_t guest_mask) {
+  if (!cvars::thread_roles) {
+    // Guest hardware threads directly mapped to host logical processors.
+    return guest_mask;
+  }
+  if (!guest_mask) {
+    guest_mask = (uint32_t(1) << kGuestHardwareThreadCount) - 1;
+  }
+  uint64_t host_mask = 0;
+  for (size_t i = 0; i < kGuestHardwareThreadCount; ++i) {
+    if (!(guest_mask & (uint32_t(1) << i))) {
+      continue;
+    }
+    uint64_t role_mask = GetThreadRoleAffinityMask(
+        ThreadRole(size_t(ThreadRole::kGuestHardwareThread0) + i));
+    if (!role_mask) {
+      return 0;
+    }
+    host_mask |= role_mask;
+  }
+  return host_mask;
+}
+
 uint32_t logical_processor_count() {
   static uint32_t value = 0;
   if (!value) {
@@ -56,6 +56,31 @@ uint32_t logical_processor_count();
 // Must be called at startup before attempting to set thread affinity.
 void EnableAffinityConfiguration();
 
+// A physical processor core of the host system.
+struct ProcessorCore {
+  // Logical processors of the core (more than one with simultaneous
+  // multithreading).
+  uint64_t logical_processor_mask;
+  // Higher for the more performant cores of hybrid processors, the same for all
+  // cores otherwise.
+  uint32_t efficiency_class;
+  // 0 if the host is not a NUMA system.
+  uint32_t numa_node;
+};
+
+// Returns the physical cores of the first 64 logical processors of the host
+// system, or an empty vector if the topology can't be obtained.
+std::vector<ProcessorCore> GetProcessorCores();
+
+// Returns the NUMA node the primary display adapter is attached to, or -1 if
+// it can't be obtained.
+int32_t GetDisplayAdapterNumaNode();
+
+// Returns the NUMA node to place the guest memory and the threads accessing it
+// the most (the guest hardware threads and the GPU command processor) on, or
+// -1 if they shouldn't be placed on any specific node.
+int32_t GetEmulationNumaNode();
+
 // Gets a stable thread-specific ID, but may not be. Use for informative
 // purposes only.
 uint32_t current_thread_system_id();
@@ -78,7 +103,13 @@ void MaybeYield();
 // Memory barrier (request - may be ignored).
 void SyncMemory();
 
-// Sleeps the current thread for at least as long as the given duration.
+// Tells the processor the thread is spinning on a value in memory, without
+// leaving user space.
+void SpinPause();
+
+// Sleeps the current thread for at least as long as the given duration. A zero
+// duration only yields. With high_resolution_sleep, short durations are not
+// rounded up to the scheduler tick of the host.
 void Sleep(std::chrono::microseconds duration);
 template <typename Rep, typename Period>
 void Sleep(std::chrono::duration<Rep, Period> duration) {
@@ -174,6 +205,10 @@ WaitResult SignalAndWait(
     bool is_alertable,
     std::chrono::milliseconds timeout = std::chrono::milliseconds::max());
 
+// The maximum number of wait handles in a single WaitMultiple, WaitAll or
+// WaitAny call, matching the limit of WaitForMultipleObjects on Windows.
+constexpr size_t kMaxWaitHandles = 64;
+
 std::pair<WaitResult, size_t> WaitMultiple(
     WaitHandle* wait_handles[], size_t wait_handle_count, bool wait_all,
     bool is_alertable,
@@ -406,6 +441,39 @@ class Thread : public WaitHandle {
   std::string name_;
 };
 
+// What host threads are doing, for placing them on host processors so threads
+// doing latency-critical work don't compete for the same cores.
+enum class ThreadRole {
+  kGuestHardwareThread0,
+  kGuestHardwareThread1,
+  kGuestHardwareThread2,
+  kGuestHardwareThread3,
+  kGuestHardwareThread4,
+  kGuestHardwareThread5,
+  kGpuCommandProcessor,
+  kShaderCompilation,
+  kAudio,
+  kIo,
+
+  kCount,
+};
+
+// Returns the host logical processor mask for threads of the role, or 0 if they
+// may run on any processor.
+uint64_t GetThreadRoleAffinityMask(ThreadRole role);
+
+// Returns the priority for threads of the role as a ThreadPriority value.
+int32_t GetThreadRolePriority(ThreadRole role);
+
+// Sets the affinity and the priority of the thread for the role, leaving the
+// ones the role doesn't specify unchanged.
+void ApplyThreadRole(Thread* thread, ThreadRole role);
+
+// Returns the host logical processor mask for a guest thread that may run on
+// the guest hardware threads in guest_mask (on any of them if it's 0), or 0 if
+// the affinity of the thread shouldn't be set.
+uint64_t GetGuestThreadAffinityMask(uint32_t guest_mask);
+
 }  // namespace threading
 }  // namespace xe
 
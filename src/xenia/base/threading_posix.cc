@@ -10,15 +10,28 @@
 #include "xenia/base/threading.h"
 
 #include "xenia/base/assert.h"
+#include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/memory.h"
+#include "xenia/base/platform.h"
 
 #include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <utility>
 #include <sys/eventfd.h>
 #include <sys/syscall.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
+#include <cerrno>
+#include <chrono>
+
+DECLARE_bool(high_resolution_sleep);
+DECLARE_int32(sleep_spin_threshold_us);
 
 namespace xe {
 namespace threading {
@@ -26,6 +39,108 @@ namespace threading {
 // TODO(dougvj)
 void EnableAffinityConfiguration() {}
 
+#if XE_PLATFORM_LINUX
+namespace {
+
+// Returns whether the logical processor is in a sysfs CPU list such as
+// "0-3,8".
+bool IsInSysfsCpuList(const char* path, uint32_t processor) {
+  FILE* file = std::fopen(path, "r");
+  if (!file) {
+    return false;
+  }
+  bool found = false;
+  unsigned int first, last;
+  while (!found && std::fscanf(file, "%u", &first) == 1) {
+    last = first;
+    int separator = std::fgetc(file);
+    if (separator == '-') {
+      if (std::fscanf(file, "%u", &last) != 1) {
+        break;
+      }
+      separator = std::fgetc(file);
+    }
+    found = processor >= first && processor <= last;
+    if (separator != ',') {
+      break;
+    }
+  }
+  std::fclose(file);
+  return found;
+}
+
+// Reads a single integer from a sysfs file.
+bool ReadSysfsInt(const std::string& path, int& value_out) {
+  FILE* file = std::fopen(path.c_str(), "r");
+  if (!file) {
+    return false;
+  }
+  bool read = std::fscanf(file, "%d", &value_out) == 1;
+  std::fclose(file);
+  return read;
+}
+
+}  // namespace
+
+std::vector<ProcessorCore> GetProcessorCores() {
+  std::vector<ProcessorCore> cores;
+  // Physical package and core IDs.
+  std::vector<std::pair<int, int>> core_ids;
+  uint32_t processor_count = std::min(logical_processor_count(), uint32_t(64));
+  uint32_t numa_node_count = xe::memory::numa_node_count();
+  for (uint32_t i = 0; i < processor_count; ++i) {
+    std::string topology_path =
+        fmt::format("/sys/devices/system/cpu/cpu{}/topology/", i);
+    std::pair<int, int> core_id;
+    if (!ReadSysfsInt(topology_path + "physical_package_id", core_id.first) ||
+        !ReadSysfsInt(topology_path + "core_id", core_id.second)) {
+      return {};
+    }
+    auto core_it = std::find(core_ids.begin(), core_ids.end(), core_id);
+    if (core_it != core_ids.end()) {
+      cores[size_t(core_it - core_ids.begin())].logical_processor_mask |=
+          uint64_t(1) << i;
+      continue;
+    }
+    core_ids.push_back(core_id);
+    ProcessorCore& core = cores.emplace_back();
+    core.logical_processor_mask = uint64_t(1) << i;
+    // The efficiency cores of Intel hybrid processors are listed separately.
+    core.efficiency_class =
+        IsInSysfsCpuList("/sys/devices/system/cpu/cpu_atom/cpus", i) ? 0 : 1;
+    core.numa_node = 0;
+    for (uint32_t node = 1; node < numa_node_count; ++node) {
+      if (IsInSysfsCpuList(
+              fmt::format("/sys/devices/system/node/node{}/cpulist", node)
+                  .c_str(),
+              i)) {
+        core.numa_node = node;
+        break;
+      }
+    }
+  }
+  return cores;
+}
+
+int32_t GetDisplayAdapterNumaNode() {
+  // The first DRM card is the adapter the console and usually the desktop are
+  // on. The node is -1 for devices not attached to a specific node.
+  for (uint32_t i = 0; i < 8; ++i) {
+    int numa_node;
+    if (ReadSysfsInt(
+            fmt::format("/sys/class/drm/card{}/device/numa_node", i),
+            numa_node)) {
+      return numa_node;
+    }
+  }
+  return -1;
+}
+#else
+std::vector<ProcessorCore> GetProcessorCores() { return {}; }
+
+int32_t GetDisplayAdapterNumaNode() { return -1; }
+#endif  // XE_PLATFORM_LINUX
+
 // uint64_t ticks() { return mach_absolute_time(); }
 
 uint32_t current_thread_system_id() {
@@ -46,16 +161,43 @@ void MaybeYield() {
 
 void SyncMemory() { __sync_synchronize(); }
 
+void SpinPause() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
 void Sleep(std::chrono::microseconds duration) {
-  timespec rqtp = {time_t(duration.count() / 1000000),
-                   time_t(duration.count() % 1000)};
-  nanosleep(&rqtp, nullptr);
-  // TODO(benvanik): spin while rmtp >0?
+  if (duration.count() <= 0) {
+    MaybeYield();
+    return;
+  }
+  if (cvars::high_resolution_sleep &&
+      duration.count() < cvars::sleep_spin_threshold_us) {
+    auto end = std::chrono::steady_clock::now() + duration;
+    do {
+      MaybeYield();
+    } while (std::chrono::steady_clock::now() < end);
+    return;
+  }
+  // An absolute deadline so signals interrupting the sleep don't extend it.
+  timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  uint64_t deadline_ns = uint64_t(deadline.tv_nsec) +
+                         uint64_t(duration.count() % 1000000) * 1000;
+  deadline.tv_sec += time_t(duration.count() / 1000000 +
+                            deadline_ns / 1000000000);
+  deadline.tv_nsec = long(deadline_ns % 1000000000);
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline,
+                         nullptr) == EINTR) {
+  }
 }
 
 // TODO(dougvj) Not sure how to implement the equivalent of this on POSIX.
 SleepResult AlertableSleep(std::chrono::microseconds duration) {
-  sleep(duration.count() / 1000);
+  Sleep(duration);
   return SleepResult::kSuccess;
 }
 
@@ -370,9 +512,38 @@ class PosixThread : public PosixThreadHandle<Thread> {
 
   uint32_t system_id() const override { return 0; }
 
+#if XE_PLATFORM_LINUX
+  uint64_t affinity_mask() override {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if (pthread_getaffinity_np(handle_, sizeof(cpu_set), &cpu_set)) {
+      return 0;
+    }
+    uint64_t mask = 0;
+    for (uint32_t i = 0; i < 64; ++i) {
+      if (CPU_ISSET(i, &cpu_set)) {
+        mask |= uint64_t(1) << i;
+      }
+    }
+    return mask;
+  }
+  void set_affinity_mask(uint64_t mask) override {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (uint32_t i = 0; i < 64; ++i) {
+      if (mask & (uint64_t(1) << i)) {
+        CPU_SET(i, &cpu_set);
+      }
+    }
+    if (pthread_setaffinity_np(handle_, sizeof(cpu_set), &cpu_set)) {
+      XELOGW("Failed to set the affinity mask of a thread to {:X}", mask);
+    }
+  }
+#else
   // TODO(DrChat)
   uint64_t affinity_mask() override { return 0; }
   void set_affinity_mask(uint64_t mask) override { assert_always(); }
+#endif  // XE_PLATFORM_LINUX
 
   int priority() override {
     int policy;
@@ -8,10 +8,20 @@
  */
 
 #include "xenia/base/assert.h"
+#include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/math.h"
 #include "xenia/base/platform_win.h"
 #include "xenia/base/threading.h"
 
+DECLARE_bool(high_resolution_sleep);
+DECLARE_int32(sleep_spin_threshold_us);
+
+// Not in older Windows SDKs.
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
 typedef HANDLE (*SetThreadDescriptionFn)(HANDLE hThread,
                                          PCWSTR lpThreadDescription);
 
@@ -27,6 +37,59 @@ void EnableAffinityConfiguration() {
   SetProcessAffinityMask(process_handle, system_affinity_mask);
 }
 
+std::vector<ProcessorCore> GetProcessorCores() {
+  std::vector<ProcessorCore> cores;
+  DWORD length = 0;
+  if (GetLogicalProcessorInformationEx(RelationProcessorCore, nullptr,
+                                       &length) ||
+      GetLastError() != ERROR_INSUFFICIENT_BUFFER) {
+    return cores;
+  }
+  std::vector<uint8_t> buffer(length);
+  if (!GetLogicalProcessorInformationEx(
+          RelationProcessorCore,
+          reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(
+              buffer.data()),
+          &length)) {
+    return cores;
+  }
+  for (DWORD offset = 0; offset < length;) {
+    const auto& info =
+        *reinterpret_cast<const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(
+            buffer.data() + offset);
+    offset += info.Size;
+    if (info.Relationship != RelationProcessorCore) {
+      continue;
+    }
+    // Thread affinity masks only cover the processor group of the process.
+    for (WORD i = 0; i < info.Processor.GroupCount; ++i) {
+      const GROUP_AFFINITY& group_affinity = info.Processor.GroupMask[i];
+      if (group_affinity.Group || !group_affinity.Mask) {
+        continue;
+      }
+      ProcessorCore& core = cores.emplace_back();
+      core.logical_processor_mask = uint64_t(group_affinity.Mask);
+      core.efficiency_class = info.Processor.EfficiencyClass;
+      // All logical processors of a core are on the same node.
+      PROCESSOR_NUMBER processor_number = {};
+      processor_number.Number =
+          BYTE(xe::tzcnt(uint64_t(group_affinity.Mask)));
+      USHORT numa_node;
+      core.numa_node = GetNumaProcessorNodeEx(&processor_number, &numa_node)
+                           ? uint32_t(numa_node)
+                           : 0;
+    }
+  }
+  return cores;
+}
+
+int32_t GetDisplayAdapterNumaNode() {
+  // DXGI doesn't report where adapters are attached, and the device property
+  // for it needs the configuration manager, so the node has to be chosen
+  // explicitly.
+  return -1;
+}
+
 uint32_t current_thread_system_id() {
   return static_cast<uint32_t>(GetCurrentThreadId());
 }
@@ -80,17 +143,65 @@ void MaybeYield() {
 
 void SyncMemory() { MemoryBarrier(); }
 
-void Sleep(std::chrono::microseconds duration) {
-  if (duration.count() < 100) {
+void SpinPause() { YieldProcessor(); }
+
+// Returns the waitable timer of the current thread for high-resolution
+// sleeps, or nullptr if the OS doesn't support them (before Windows 10 1803).
+static HANDLE GetHighResolutionSleepTimer() {
+  struct SleepTimer {
+    ~SleepTimer() {
+      if (handle) {
+        CloseHandle(handle);
+      }
+    }
+    HANDLE handle = nullptr;
+    bool initialized = false;
+  };
+  thread_local SleepTimer timer;
+  if (!timer.initialized) {
+    timer.initialized = true;
+    timer.handle = CreateWaitableTimerExW(
+        nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+        TIMER_ALL_ACCESS);
+  }
+  return timer.handle;
+}
+
+// Returns the result of the wait like SleepEx.
+static DWORD HighResolutionSleep(std::chrono::microseconds duration,
+                                 bool alertable) {
+  if (cvars::high_resolution_sleep && duration.count() > 0) {
+    if (!alertable && duration.count() < cvars::sleep_spin_threshold_us) {
+      auto end = std::chrono::steady_clock::now() + duration;
+      do {
+        MaybeYield();
+      } while (std::chrono::steady_clock::now() < end);
+      return 0;
+    }
+    HANDLE timer = GetHighResolutionSleepTimer();
+    if (timer) {
+      // Negative for relative time, in 100ns units.
+      LARGE_INTEGER due_time;
+      due_time.QuadPart = -int64_t(duration.count()) * 10;
+      if (SetWaitableTimer(timer, &due_time, 0, nullptr, nullptr, FALSE)) {
+        return WaitForSingleObjectEx(timer, INFINITE, alertable ? TRUE : FALSE);
+      }
+    }
+  }
+  if (!alertable && duration.count() < 100) {
     MaybeYield();
-  } else {
-    ::Sleep(static_cast<DWORD>(duration.count() / 1000));
+    return 0;
   }
+  return SleepEx(static_cast<DWORD>(duration.count() / 1000),
+                 alertable ? TRUE : FALSE);
+}
+
+void Sleep(std::chrono::microseconds duration) {
+  HighResolutionSleep(duration, false);
 }
 
 SleepResult AlertableSleep(std::chrono::microseconds duration) {
-  if (SleepEx(static_cast<DWORD>(duration.count() / 1000), TRUE) ==
-      WAIT_IO_COMPLETION) {
+  if (HighResolutionSleep(duration, true) == WAIT_IO_COMPLETION) {
     return SleepResult::kAlerted;
   }
   return SleepResult::kSuccess;
@@ -208,18 +319,25 @@ std::pair<WaitResult, size_t> WaitMultiple(WaitHandle* wait_handles[],
                                            size_t wait_handle_count,
                                            bool wait_all, bool is_alertable,
                                            std::chrono::milliseconds timeout) {
-  std::vector<HANDLE> handles(wait_handle_count);
+  static_assert(kMaxWaitHandles == MAXIMUM_WAIT_OBJECTS,
+                "The wait handle limit must match WaitForMultipleObjects");
+  assert_true(wait_handle_count <= kMaxWaitHandles);
+  if (wait_handle_count > kMaxWaitHandles) {
+    return std::pair<WaitResult, size_t>(WaitResult::kFailed, 0);
+  }
+  // On the stack - this is called repeatedly while spinning on guest waits.
+  HANDLE handles[kMaxWaitHandles];
   for (size_t i = 0; i < wait_handle_count; ++i) {
     handles[i] = wait_handles[i]->native_handle();
   }
   DWORD result = WaitForMultipleObjectsEx(
-      DWORD(handles.size()), handles.data(), wait_all ? TRUE : FALSE,
+      DWORD(wait_handle_count), handles, wait_all ? TRUE : FALSE,
       DWORD(timeout.count()), is_alertable ? TRUE : FALSE);
-  if (result >= WAIT_OBJECT_0 && result < WAIT_OBJECT_0 + handles.size()) {
+  if (result >= WAIT_OBJECT_0 && result < WAIT_OBJECT_0 + wait_handle_count) {
     return std::pair<WaitResult, size_t>(WaitResult::kSuccess,
                                          result - WAIT_OBJECT_0);
   } else if (result >= WAIT_ABANDONED_0 &&
-             result < WAIT_ABANDONED_0 + handles.size()) {
+             result < WAIT_ABANDONED_0 + wait_handle_count) {
     return std::pair<WaitResult, size_t>(WaitResult::kAbandoned,
                                          result - WAIT_ABANDONED_0);
   }
@@ -0,0 +1,274 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/timer_wheel.h"
+
+#include <algorithm>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/math.h"
+#include "xenia/base/platform.h"
+
+namespace xe {
+namespace threading {
+
+// Timed waits on Windows end on a timer interrupt, which is 0.5ms apart at
+// best (the resolution requested at startup), so the last millisecond is spun.
+#if XE_PLATFORM_WIN32
+constexpr std::chrono::nanoseconds kSpinDuration = std::chrono::milliseconds(1);
+#else
+constexpr std::chrono::nanoseconds kSpinDuration =
+    std::chrono::microseconds(100);
+#endif  // XE_PLATFORM_WIN32
+
+TimerWheel& TimerWheel::Get() {
+  // Never destroyed, timers may be cancelled by objects destroyed at exit.
+  static TimerWheel* wheel = new TimerWheel();
+  return *wheel;
+}
+
+TimerWheel::TimerWheel() : epoch_(clock::now()) {}
+
+TimerWheel::~TimerWheel() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  shutting_down_ = true;
+  if (thread_) {
+    wake_cond_.notify_one();
+    callback_cond_.wait(lock, [this]() { return thread_exited_; });
+  }
+}
+
+uint64_t TimerWheel::GetTick(clock::time_point time) const {
+  if (time <= epoch_) {
+    return 0;
+  }
+  return uint64_t((time - epoch_) / kTickDuration);
+}
+
+TimerWheel::clock::time_point TimerWheel::GetTickTime(uint64_t tick) const {
+  return epoch_ + kTickDuration * tick;
+}
+
+TimerWheel::TimerId TimerWheel::Schedule(clock::time_point due_time,
+                                         std::chrono::nanoseconds period,
+                                         std::function<void()> callback) {
+  assert_true(period.count() >= 0);
+  auto timer = std::make_unique<Timer>();
+  timer->due_time = due_time;
+  timer->period = period;
+  timer->callback =
+      std::make_shared<std::function<void()>>(std::move(callback));
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  TimerId id = next_id_++;
+  timer->id = id;
+  Insert(timer.get());
+  timers_.emplace(id, std::move(timer));
+  if (!thread_) {
+    Thread::CreationParameters params;
+    params.stack_size = 256 * 1024;
+    params.initial_priority = ThreadPriority::kHighest;
+    thread_ = Thread::Create(params, [this]() { ThreadMain(); });
+    assert_not_null(thread_);
+    thread_->set_name("Timer Wheel");
+  } else if (due_time < thread_wake_time_) {
+    wake_cond_.notify_one();
+  }
+  return id;
+}
+
+bool TimerWheel::Cancel(TimerId id, bool wait_for_callback) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto it = timers_.find(id);
+  bool found = it != timers_.end();
+  if (found) {
+    if (it->second->level != kLevelNone) {
+      Remove(it->second.get());
+    }
+    timers_.erase(it);
+  }
+  if (wait_for_callback && std::this_thread::get_id() != thread_id_) {
+    callback_cond_.wait(lock, [this, id]() { return running_id_ != id; });
+  }
+  return found;
+}
+
+void TimerWheel::Insert(Timer* timer) {
+  uint64_t tick = current_tick_;
+  if (timer->due_time > epoch_) {
+    // Rounded up so the timer is never called early.
+    tick = std::max(tick, uint64_t((timer->due_time - epoch_ + kTickDuration -
+                                    std::chrono::nanoseconds(1)) /
+                                   kTickDuration));
+  }
+  // The lowest level where the timer is less than a full turn of the slots
+  // away. On levels above 0 this makes the slot always different from the
+  // current one.
+  uint32_t level = 0;
+  while (level + 1 < kLevelCount &&
+         (tick >> (kSlotBits * level)) -
+                 (current_tick_ >> (kSlotBits * level)) >=
+             kSlotCount) {
+    ++level;
+  }
+  uint32_t shift = kSlotBits * level;
+  uint64_t position = tick >> shift;
+  uint64_t current_position = current_tick_ >> shift;
+  if (position - current_position >= kSlotCount) {
+    // Too far even for the top level.
+    position = current_position + kSlotCount - 1;
+  }
+  uint32_t slot = uint32_t(position & kSlotMask);
+  timer->level = level;
+  timer->slot = slot;
+  std::list<Timer*>& slot_timers = slots_[level][slot];
+  timer->slot_it = slot_timers.insert(slot_timers.end(), timer);
+  occupied_slots_[level] |= uint64_t(1) << slot;
+}
+
+void TimerWheel::Remove(Timer* timer) {
+  std::list<Timer*>& slot_timers = slots_[timer->level][timer->slot];
+  slot_timers.erase(timer->slot_it);
+  if (slot_timers.empty()) {
+    occupied_slots_[timer->level] &= ~(uint64_t(1) << timer->slot);
+  }
+  timer->level = kLevelNone;
+}
+
+uint64_t TimerWheel::GetNextEventTick() const {
+  uint64_t next_tick = UINT64_MAX;
+  for (uint32_t level = 0; level < kLevelCount; ++level) {
+    uint64_t occupied = occupied_slots_[level];
+    if (!occupied) {
+      continue;
+    }
+    uint32_t shift = kSlotBits * level;
+    uint64_t current_position = current_tick_ >> shift;
+    // Rotate so that bit 0 is the current slot.
+    uint32_t current_slot = uint32_t(current_position & kSlotMask);
+    if (current_slot) {
+      occupied = (occupied >> current_slot) |
+                 (occupied << (kSlotCount - current_slot));
+    }
+    // On levels above 0, this is the start of the ticks of the slot, when it's
+    // cascaded. The current slot only has timers before its start has been
+    // processed.
+    uint64_t tick = (current_position + xe::tzcnt(occupied)) << shift;
+    next_tick = std::min(next_tick, std::max(tick, current_tick_));
+  }
+  return next_tick;
+}
+
+void TimerWheel::Advance(clock::time_point now,
+                         std::vector<TimerId>& fired_out) {
+  uint64_t now_tick = GetTick(now);
+  std::list<Timer*> slot_timers;
+  while (!timers_.empty()) {
+    uint64_t tick = GetNextEventTick();
+    if (tick > now_tick) {
+      break;
+    }
+    current_tick_ = tick;
+    // Move the timers of the slots starting at this tick down, from the top so
+    // that the timers cascaded to a slot also starting now are moved again.
+    for (uint32_t level = kLevelCount - 1; level; --level) {
+      uint32_t shift = kSlotBits * level;
+      if (tick & ((uint64_t(1) << shift) - 1)) {
+        continue;
+      }
+      uint32_t slot = uint32_t((tick >> shift) & kSlotMask);
+      if (!(occupied_slots_[level] & (uint64_t(1) << slot))) {
+        continue;
+      }
+      slot_timers.clear();
+      slot_timers.swap(slots_[level][slot]);
+      occupied_slots_[level] &= ~(uint64_t(1) << slot);
+      for (Timer* timer : slot_timers) {
+        Insert(timer);
+      }
+    }
+    uint32_t slot = uint32_t(tick & kSlotMask);
+    slot_timers.clear();
+    slot_timers.swap(slots_[0][slot]);
+    occupied_slots_[0] &= ~(uint64_t(1) << slot);
+    for (Timer* timer : slot_timers) {
+      fired_out.push_back(timer->id);
+      if (timer->period.count()) {
+        // Periods missed entirely are dropped rather than called back to back.
+        timer->due_time += timer->period;
+        if (timer->due_time <= now) {
+          timer->due_time +=
+              timer->period * ((now - timer->due_time) / timer->period + 1);
+        }
+        Insert(timer);
+      } else {
+        timer->level = kLevelNone;
+      }
+    }
+    current_tick_ = tick + 1;
+  }
+  // Nothing is due until after now_tick, skip the empty ticks.
+  current_tick_ = std::max(current_tick_, now_tick + 1);
+}
+
+void TimerWheel::ThreadMain() {
+  std::vector<TimerId> fired;
+  std::unique_lock<std::mutex> lock(mutex_);
+  thread_id_ = std::this_thread::get_id();
+  while (!shutting_down_) {
+    clock::time_point now = clock::now();
+    fired.clear();
+    Advance(now, fired);
+    for (TimerId id : fired) {
+      // Call back one at a time and only if still scheduled, Cancel() may have
+      // been called while the lock was released for the previous callback.
+      auto it = timers_.find(id);
+      if (it == timers_.end()) {
+        continue;
+      }
+      std::shared_ptr<std::function<void()>> callback = it->second->callback;
+      if (it->second->level == kLevelNone) {
+        timers_.erase(it);
+      }
+      running_id_ = id;
+      lock.unlock();
+      if (*callback) {
+        (*callback)();
+      }
+      lock.lock();
+      running_id_ = kInvalidTimerId;
+      callback_cond_.notify_all();
+    }
+    if (!fired.empty()) {
+      // Time may have passed in the callbacks.
+      continue;
+    }
+    if (timers_.empty()) {
+      thread_wake_time_ = clock::time_point::max();
+      wake_cond_.wait(lock);
+      continue;
+    }
+    clock::time_point wake_time = GetTickTime(GetNextEventTick());
+    thread_wake_time_ = wake_time;
+    if (wake_time - now > kSpinDuration) {
+      wake_cond_.wait_until(lock, wake_time - kSpinDuration);
+    } else {
+      lock.unlock();
+      while (clock::now() < wake_time) {
+        MaybeYield();
+      }
+      lock.lock();
+    }
+  }
+  thread_exited_ = true;
+  callback_cond_.notify_all();
+}
+
+}  // namespace threading
+}  // namespace xe
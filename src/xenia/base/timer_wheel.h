@@ -0,0 +1,123 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BASE_TIMER_WHEEL_H_
+#define XENIA_BASE_TIMER_WHEEL_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace threading {
+
+// Hierarchical timing wheel serviced by a single host thread. Scheduling and
+// cancelling are O(1), and the thread only wakes up for ticks that have timers
+// in them, so any number of armed timers costs one sleeping thread instead of
+// one host timer object each.
+// Timers fire at most one tick (100us) plus the host wake latency late. The
+// last stretch before a due time is spun instead of slept on hosts where
+// timed waits are coarser than that.
+// Callbacks are executed on the wheel thread and must be kept short.
+class TimerWheel {
+ public:
+  using clock = std::chrono::steady_clock;
+  using TimerId = uint64_t;
+  static constexpr TimerId kInvalidTimerId = 0;
+
+  // The process-wide wheel. The thread is started on first use.
+  static TimerWheel& Get();
+
+  TimerWheel();
+  // Drops all timers, waiting for the callback running at the moment.
+  ~TimerWheel();
+
+  // Calls callback at due_time, and then every period after it if the period
+  // is not zero. Returns an ID to pass to Cancel().
+  TimerId Schedule(clock::time_point due_time, std::chrono::nanoseconds period,
+                   std::function<void()> callback);
+
+  // Removes the timer. If its callback is running on the wheel thread at the
+  // moment and wait_for_callback is true, waits for it to return, so the
+  // callback will not be called or be running after Cancel() returns (unless
+  // called from the callback itself). Callers holding locks the callback may
+  // take must not wait, and the callback must keep alive what it accesses.
+  // Returns false if the timer was not scheduled anymore.
+  bool Cancel(TimerId id, bool wait_for_callback = true);
+
+ private:
+  // 64 slots per level so the occupied slots of a level fit in one bitmask.
+  static constexpr uint32_t kSlotBits = 6;
+  static constexpr uint32_t kSlotCount = 1 << kSlotBits;
+  static constexpr uint32_t kSlotMask = kSlotCount - 1;
+  // 5 levels of 100us ticks span ~29.8 hours, later timers are parked in the
+  // last slot of the top level and placed again when it's cascaded.
+  static constexpr uint32_t kLevelCount = 5;
+  // Level of timers that have fired and are not in any slot.
+  static constexpr uint32_t kLevelNone = kLevelCount;
+  static constexpr std::chrono::nanoseconds kTickDuration =
+      std::chrono::microseconds(100);
+
+  struct Timer {
+    TimerId id;
+    clock::time_point due_time;
+    std::chrono::nanoseconds period;
+    std::shared_ptr<std::function<void()>> callback;
+    uint32_t level;
+    uint32_t slot;
+    std::list<Timer*>::iterator slot_it;
+  };
+
+  uint64_t GetTick(clock::time_point time) const;
+  clock::time_point GetTickTime(uint64_t tick) const;
+
+  void Insert(Timer* timer);
+  void Remove(Timer* timer);
+  // Tick of the next slot that needs attention, either one to fire or one to
+  // cascade to the lower levels. UINT64_MAX if no timer is in a slot.
+  uint64_t GetNextEventTick() const;
+  // Processes all ticks up to and including the one of now, returning the
+  // timers due to be called in fired_out. One-shot timers stay in timers_
+  // without a slot until their callback is called, so they can still be
+  // cancelled.
+  void Advance(clock::time_point now, std::vector<TimerId>& fired_out);
+  void ThreadMain();
+
+  std::mutex mutex_;
+  std::condition_variable wake_cond_;
+  std::condition_variable callback_cond_;
+  clock::time_point epoch_;
+  // Next tick to be processed, all earlier ones have been.
+  uint64_t current_tick_ = 0;
+  TimerId next_id_ = 1;
+  TimerId running_id_ = kInvalidTimerId;
+  // When the thread will wake up next, max() while it waits for a timer.
+  clock::time_point thread_wake_time_ = clock::time_point::max();
+  bool shutting_down_ = false;
+  bool thread_exited_ = false;
+  std::unordered_map<TimerId, std::unique_ptr<Timer>> timers_;
+  std::list<Timer*> slots_[kLevelCount][kSlotCount];
+  uint64_t occupied_slots_[kLevelCount] = {};
+  std::unique_ptr<Thread> thread_;
+  std::thread::id thread_id_;
+};
+
+}  // namespace threading
+}  // namespace xe
+
+#endif  // XENIA_BASE_TIMER_WHEEL_H_
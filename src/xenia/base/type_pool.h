@@ -10,48 +10,86 @@
 #ifndef XENIA_BASE_TYPE_POOL_H_
 #define XENIA_BASE_TYPE_POOL_H_
 
-#include <mutex>
-#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <new>
 
 namespace xe {
 
+// Pool of reusable objects. Released objects are kept in a lock-free stack
+// linked through the objects' own entries, so neither Allocate nor Release
+// takes a lock or touches the heap unless a new object has to be constructed.
 template <class T, typename A>
 class TypePool {
  public:
   ~TypePool() { Reset(); }
 
+  // Destroys the released objects. Must not be called while other threads are
+  // using the pool.
   void Reset() {
-    std::lock_guard<std::mutex> guard(lock_);
-    for (auto it = list_.begin(); it != list_.end(); ++it) {
-      T* value = *it;
-      delete value;
+    Entry* entry = EntryFromHead(head_.exchange(0, std::memory_order_acquire));
+    while (entry) {
+      Entry* next = entry->next.load(std::memory_order_relaxed);
+      entry->value()->~T();
+      delete entry;
+      entry = next;
     }
-    list_.clear();
   }
 
   T* Allocate(A arg0) {
-    T* result = 0;
-    {
-      std::lock_guard<std::mutex> guard(lock_);
-      if (list_.size()) {
-        result = list_.back();
-        list_.pop_back();
+    uint64_t head = head_.load(std::memory_order_acquire);
+    while (Entry* entry = EntryFromHead(head)) {
+      // Entries are only freed by Reset, so reading next is safe even if the
+      // entry has been popped by another thread meanwhile - the counter in the
+      // head makes the exchange fail in this case.
+      Entry* next = entry->next.load(std::memory_order_relaxed);
+      if (head_.compare_exchange_weak(head, MakeHead(next, head),
+                                      std::memory_order_acquire,
+                                      std::memory_order_acquire)) {
+        return entry->value();
       }
     }
-    if (!result) {
-      result = new T(arg0);
-    }
-    return result;
+    Entry* entry = new Entry;
+    new (entry->storage) T(arg0);
+    return entry->value();
   }
 
   void Release(T* value) {
-    std::lock_guard<std::mutex> guard(lock_);
-    list_.push_back(value);
+    // The object is at the beginning of its entry.
+    Entry* entry = reinterpret_cast<Entry*>(value);
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    do {
+      entry->next.store(EntryFromHead(head), std::memory_order_relaxed);
+    } while (!head_.compare_exchange_weak(head, MakeHead(entry, head),
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed));
   }
 
  private:
-  std::mutex lock_;
-  std::vector<T*> list_;
+  struct Entry {
+    alignas(T) uint8_t storage[sizeof(T)];
+    std::atomic<Entry*> next{nullptr};
+
+    T* value() { return std::launder(reinterpret_cast<T*>(storage)); }
+  };
+
+  // The head contains the pointer to the top entry in the low 48 bits, which
+  // is enough for user space addresses on 64-bit hosts, and a counter
+  // incremented on every change in the high 16 bits, so a pop with a stale next
+  // pointer fails if the top entry has been popped and pushed back meanwhile.
+  static constexpr uint32_t kEntryPointerBits = 48;
+  static constexpr uint64_t kEntryPointerMask =
+      (uint64_t(1) << kEntryPointerBits) - 1;
+
+  static Entry* EntryFromHead(uint64_t head) {
+    return reinterpret_cast<Entry*>(uintptr_t(head & kEntryPointerMask));
+  }
+  static uint64_t MakeHead(Entry* entry, uint64_t old_head) {
+    return uint64_t(uintptr_t(entry)) |
+           (((old_head >> kEntryPointerBits) + 1) << kEntryPointerBits);
+  }
+
+  std::atomic<uint64_t> head_{0};
 };
 
 }  // namespace xe
@@ -0,0 +1,362 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cache_pack.h"
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "third_party/snappy/snappy.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/hash.h"
+#include "xenia/base/logging.h"
+
+namespace xe {
+namespace cache_pack {
+
+namespace {
+
+enum class Root : uint32_t {
+  kStorage,
+  kTextureCache,
+  kFileAccessTrace,
+
+  kCount,
+};
+
+struct PackHeader {
+  static constexpr uint32_t kMagic = 0x4B504358;  // 'XCPK'
+  // Must be changed whenever the layout of the pack changes. The formats of the
+  // caches inside it are versioned by the caches themselves.
+  static constexpr uint32_t kVersion = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t title_id;
+  uint32_t entry_count;
+};
+
+// Followed by the UTF-8 path of the file relative to its root, with forward
+// slashes, and then by the Snappy-compressed contents of the file.
+struct EntryHeader {
+  uint32_t root;
+  uint32_t name_length;
+  uint64_t size;
+  uint64_t compressed_size;
+  // xe::hash::Hash64 of the uncompressed contents.
+  uint64_t data_hash;
+};
+
+struct Entry {
+  Root root;
+  std::filesystem::path relative_path;
+};
+
+const std::filesystem::path& GetRootPath(const CacheRoots& roots, Root root) {
+  switch (root) {
+    case Root::kTextureCache:
+      return roots.texture_cache_root;
+    case Root::kFileAccessTrace:
+      return roots.file_access_trace_root;
+    default:
+      return roots.storage_root;
+  }
+}
+
+// Adds the regular files in the directory with names starting with the
+// prefix, excluding the temporary and lock files of the caches being written.
+void AddFiles(std::vector<Entry>& entries, Root root,
+              const std::filesystem::path& root_path,
+              const std::filesystem::path& relative_directory,
+              std::string_view name_prefix, bool recursive) {
+  std::filesystem::path directory = root_path / relative_directory;
+  std::error_code error_code;
+  if (!std::filesystem::is_directory(directory, error_code)) {
+    return;
+  }
+  auto add_file = [&](const std::filesystem::directory_entry& file) {
+    std::error_code file_error_code;
+    if (!file.is_regular_file(file_error_code)) {
+      return;
+    }
+    std::filesystem::path extension = file.path().extension();
+    if (extension == ".tmp" || extension == ".lock") {
+      return;
+    }
+    if (xe::path_to_utf8(file.path().filename()).compare(
+            0, name_prefix.size(), name_prefix) != 0) {
+      return;
+    }
+    entries.push_back({root, file.path().lexically_relative(root_path)});
+  };
+  if (recursive) {
+    for (const auto& file :
+         std::filesystem::recursive_directory_iterator(directory, error_code)) {
+      add_file(file);
+    }
+  } else {
+    for (const auto& file :
+         std::filesystem::directory_iterator(directory, error_code)) {
+      add_file(file);
+    }
+  }
+}
+
+bool ReadWholeFile(const std::filesystem::path& path,
+                   std::vector<uint8_t>& data_out) {
+  data_out.clear();
+  FILE* file = xe::filesystem::OpenFile(path, "rb");
+  if (!file) {
+    return false;
+  }
+  bool read = false;
+  if (xe::filesystem::Seek(file, 0, SEEK_END)) {
+    int64_t size = xe::filesystem::Tell(file);
+    if (size >= 0 && xe::filesystem::Seek(file, 0, SEEK_SET)) {
+      data_out.resize(size_t(size));
+      read = !size || fread(data_out.data(), data_out.size(), 1, file) == 1;
+    }
+  }
+  fclose(file);
+  return read;
+}
+
+// Root-relative paths from the pack must not point outside the root.
+bool IsSafeRelativePath(const std::filesystem::path& path) {
+  if (path.empty() || path.has_root_name() || path.has_root_directory()) {
+    return false;
+  }
+  for (const std::filesystem::path& component : path) {
+    if (component == "..") {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+std::filesystem::path GetFileAccessTraceFileName(
+    const std::filesystem::path& launch_path) {
+  // Keyed by the launched file rather than the title ID, which is only known
+  // after loading the module, with the name of its directory for extracted
+  // titles all launched from a default.xex.
+  std::filesystem::path file_name = launch_path.parent_path().filename();
+  file_name += "_";
+  file_name += launch_path.filename();
+  file_name += ".trace";
+  return file_name;
+}
+
+bool Export(const CacheRoots& roots, uint32_t title_id,
+            const std::filesystem::path& file_access_trace_file_name,
+            const std::filesystem::path& pack_path) {
+  std::vector<Entry> entries;
+  if (!roots.storage_root.empty()) {
+    std::string title_prefix = fmt::format("{:08X}.", title_id);
+    // The local shader storage (the driver pipeline cache) is specific to the
+    // host GPU and driver, and is not exported.
+    AddFiles(entries, Root::kStorage, roots.storage_root,
+             std::filesystem::path("shaders") / "shareable", title_prefix,
+             false);
+    AddFiles(entries, Root::kStorage, roots.storage_root,
+             std::filesystem::path("shaders") / "spirv", "", true);
+    // Specific to the host CPU and the build, but rejected on load if they
+    // don't match, and the fleet is usually uniform.
+    AddFiles(entries, Root::kStorage, roots.storage_root, "jit", title_prefix,
+             false);
+  }
+  if (!roots.texture_cache_root.empty()) {
+    AddFiles(entries, Root::kTextureCache, roots.texture_cache_root, "", "",
+             true);
+  }
+  if (!roots.file_access_trace_root.empty() &&
+      !file_access_trace_file_name.empty()) {
+    std::error_code error_code;
+    if (std::filesystem::is_regular_file(
+            roots.file_access_trace_root / file_access_trace_file_name,
+            error_code)) {
+      entries.push_back({Root::kFileAccessTrace, file_access_trace_file_name});
+    }
+  }
+
+  // Write to a temporary file first so a partial pack is never imported.
+  std::filesystem::path temp_path = pack_path;
+  temp_path += ".tmp";
+  FILE* file = xe::filesystem::OpenFile(temp_path, "wb");
+  if (!file) {
+    XELOGE("Failed to create the cache pack {}", xe::path_to_utf8(temp_path));
+    return false;
+  }
+  PackHeader pack_header;
+  pack_header.magic = PackHeader::kMagic;
+  pack_header.version = PackHeader::kVersion;
+  pack_header.title_id = title_id;
+  pack_header.entry_count = 0;
+  bool written = fwrite(&pack_header, sizeof(pack_header), 1, file) == 1;
+  std::vector<uint8_t> data;
+  std::string compressed;
+  uint64_t total_size = 0, total_compressed_size = 0;
+  for (const Entry& entry : entries) {
+    if (!written) {
+      break;
+    }
+    std::filesystem::path path =
+        GetRootPath(roots, entry.root) / entry.relative_path;
+    if (!ReadWholeFile(path, data)) {
+      XELOGW("Cache pack: Failed to read {}, skipping",
+             xe::path_to_utf8(path));
+      continue;
+    }
+    snappy::Compress(reinterpret_cast<const char*>(data.data()), data.size(),
+                     &compressed);
+    std::string name = entry.relative_path.generic_u8string();
+    EntryHeader entry_header;
+    entry_header.root = uint32_t(entry.root);
+    entry_header.name_length = uint32_t(name.size());
+    entry_header.size = data.size();
+    entry_header.compressed_size = compressed.size();
+    entry_header.data_hash = xe::hash::Hash64(data.data(), data.size());
+    written = fwrite(&entry_header, sizeof(entry_header), 1, file) == 1 &&
+              fwrite(name.data(), name.size(), 1, file) == 1 &&
+              (compressed.empty() ||
+               fwrite(compressed.data(), compressed.size(), 1, file) == 1);
+    ++pack_header.entry_count;
+    total_size += data.size();
+    total_compressed_size += compressed.size();
+  }
+  written = written && xe::filesystem::Seek(file, 0, SEEK_SET) &&
+            fwrite(&pack_header, sizeof(pack_header), 1, file) == 1;
+  written &= fclose(file) == 0;
+  std::error_code error_code;
+  if (written) {
+    std::filesystem::rename(temp_path, pack_path, error_code);
+  }
+  if (!written || error_code) {
+    std::filesystem::remove(temp_path, error_code);
+    XELOGE("Failed to write the cache pack {}", xe::path_to_utf8(pack_path));
+    return false;
+  }
+  XELOGI(
+      "Exported {} cache files of title {:08X} ({} bytes, {} compressed) to {}",
+      pack_header.entry_count, title_id, total_size, total_compressed_size,
+      xe::path_to_utf8(pack_path));
+  return true;
+}
+
+bool Import(const std::filesystem::path& pack_path, const CacheRoots& roots,
+            uint32_t* title_id_out) {
+  FILE* file = xe::filesystem::OpenFile(pack_path, "rb");
+  if (!file) {
+    XELOGE("Failed to open the cache pack {}", xe::path_to_utf8(pack_path));
+    return false;
+  }
+  PackHeader pack_header;
+  if (fread(&pack_header, sizeof(pack_header), 1, file) != 1 ||
+      pack_header.magic != PackHeader::kMagic ||
+      pack_header.version != PackHeader::kVersion) {
+    XELOGE("{} is not a cache pack of a supported version",
+           xe::path_to_utf8(pack_path));
+    fclose(file);
+    return false;
+  }
+  if (title_id_out) {
+    *title_id_out = pack_header.title_id;
+  }
+
+  bool valid = true;
+  uint32_t imported_count = 0;
+  std::string name;
+  std::vector<char> compressed;
+  std::string data;
+  for (uint32_t i = 0; i < pack_header.entry_count; ++i) {
+    EntryHeader entry_header;
+    if (fread(&entry_header, sizeof(entry_header), 1, file) != 1 ||
+        entry_header.root >= uint32_t(Root::kCount) ||
+        !entry_header.name_length || entry_header.name_length > 4096) {
+      valid = false;
+      break;
+    }
+    name.resize(entry_header.name_length);
+    if (fread(name.data(), name.size(), 1, file) != 1) {
+      valid = false;
+      break;
+    }
+    std::filesystem::path relative_path = xe::to_path(name);
+    if (!IsSafeRelativePath(relative_path)) {
+      valid = false;
+      break;
+    }
+
+    // Existing caches may be larger than the packed ones, and may be in use by
+    // a running emulator - only fill in the missing ones.
+    const std::filesystem::path& root_path =
+        GetRootPath(roots, Root(entry_header.root));
+    std::filesystem::path path = root_path / relative_path;
+    std::error_code error_code;
+    if (root_path.empty() || std::filesystem::exists(path, error_code)) {
+      if (!xe::filesystem::Seek(file, int64_t(entry_header.compressed_size),
+                                SEEK_CUR)) {
+        valid = false;
+        break;
+      }
+      continue;
+    }
+
+    compressed.resize(size_t(entry_header.compressed_size));
+    if (!compressed.empty() &&
+        fread(compressed.data(), compressed.size(), 1, file) != 1) {
+      valid = false;
+      break;
+    }
+    if (!snappy::Uncompress(compressed.data(), compressed.size(), &data) ||
+        data.size() != entry_header.size ||
+        xe::hash::Hash64(data.data(), data.size()) != entry_header.data_hash) {
+      XELOGE("Cache pack: {} is corrupted, skipping", name);
+      continue;
+    }
+
+    // Write to a temporary file first so the caches never see a partial file.
+    std::filesystem::path temp_path = path;
+    temp_path += ".tmp";
+    xe::filesystem::CreateParentFolder(path);
+    FILE* entry_file = xe::filesystem::OpenFile(temp_path, "wb");
+    bool written = false;
+    if (entry_file) {
+      written = data.empty() ||
+                fwrite(data.data(), data.size(), 1, entry_file) == 1;
+      written &= fclose(entry_file) == 0;
+    }
+    if (written) {
+      std::filesystem::rename(temp_path, path, error_code);
+    }
+    if (!written || error_code) {
+      std::filesystem::remove(temp_path, error_code);
+      XELOGE("Cache pack: Failed to write {}", xe::path_to_utf8(path));
+      continue;
+    }
+    ++imported_count;
+  }
+  fclose(file);
+
+  if (!valid) {
+    XELOGE("The cache pack {} is truncated or corrupted",
+           xe::path_to_utf8(pack_path));
+  }
+  XELOGI("Imported {} cache files of title {:08X} from {}", imported_count,
+         pack_header.title_id, xe::path_to_utf8(pack_path));
+  return valid;
+}
+
+}  // namespace cache_pack
+}  // namespace xe
@@ -0,0 +1,56 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CACHE_PACK_H_
+#define XENIA_CACHE_PACK_H_
+
+#include <cstdint>
+#include <filesystem>
+
+namespace xe {
+
+// A single versioned and compressed file bundling the persistent caches of a
+// title - shader and pipeline storage, stored guest code, converted textures
+// and the file access trace - for pre-seeding the caches on other machines, so
+// the first run of the title there doesn't stutter.
+namespace cache_pack {
+
+// Where the caches are on this machine. Caches with an empty root are not
+// exported or imported.
+struct CacheRoots {
+  // Shader, pipeline and guest code storage.
+  std::filesystem::path storage_root;
+  // Converted textures, content-addressed and shared between titles.
+  std::filesystem::path texture_cache_root;
+  // Traces of the file reads of titles.
+  std::filesystem::path file_access_trace_root;
+};
+
+// Name of the file access trace of the title launched from the path, in the
+// file access trace root.
+std::filesystem::path GetFileAccessTraceFileName(
+    const std::filesystem::path& launch_path);
+
+// Writes the caches of the title to a new pack. The file access trace is
+// included if a name is specified. Caches still being written by a running
+// emulator are included as they are at the moment of the export.
+bool Export(const CacheRoots& roots, uint32_t title_id,
+            const std::filesystem::path& file_access_trace_file_name,
+            const std::filesystem::path& pack_path);
+
+// Extracts the caches from the pack that don't exist on this machine yet,
+// keeping the existing ones, which may be in use. Optionally returns the title
+// ID the pack has been exported for.
+bool Import(const std::filesystem::path& pack_path, const CacheRoots& roots,
+            uint32_t* title_id_out = nullptr);
+
+}  // namespace cache_pack
+}  // namespace xe
+
+#endif  // XENIA_CACHE_PACK_H_
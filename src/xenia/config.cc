@@ -62,6 +62,7 @@ void ReadConfig(const std::filesystem::path& file_path) {
       config_var->LoadConfigValue(config->get_qualified(config_key));
     }
   }
+  cvar::UpdateSnapshots();
   XELOGI("Loaded config: {}", xe::path_to_utf8(file_path));
 }
 
@@ -74,6 +75,7 @@ void ReadGameConfig(const std::filesystem::path& file_path) {
       config_var->LoadGameConfigValue(config->get_qualified(config_key));
     }
   }
+  cvar::UpdateSnapshots();
   XELOGI("Loaded game config: {}", xe::path_to_utf8(file_path));
 }
 
@@ -41,6 +41,11 @@ class Assembler {
                         uint32_t debug_info_flags,
                         std::unique_ptr<FunctionDebugInfo> debug_info) = 0;
 
+  // Sets up the function with machine code stored by a previous run, if the
+  // backend has any for the current guest code. The function must already be
+  // scanned. Returns false if the function needs to be translated.
+  virtual bool AssembleFromStorage(GuestFunction* function) { return false; }
+
  protected:
   Backend* backend_;
 };
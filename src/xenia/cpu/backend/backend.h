@@ -10,6 +10,7 @@
 #ifndef XENIA_CPU_BACKEND_BACKEND_H_
 #define XENIA_CPU_BACKEND_BACKEND_H_
 
+#include <filesystem>
 #include <memory>
 
 #include "xenia/cpu/backend/machine_info.h"
@@ -49,6 +50,16 @@ class Backend {
   virtual void CommitExecutableRange(uint32_t guest_low,
                                      uint32_t guest_high) = 0;
 
+  // Makes calls to the function go through the resolver again, so that the
+  // processor gets a chance to replace the code before it's next entered.
+  // Code that's already running is left as is.
+  virtual void InvalidateGuestFunction(GuestFunction* function) {}
+
+  // Sets up persistent storage of generated code for the title, if the
+  // backend supports it.
+  virtual void InitializeCodeStorage(const std::filesystem::path& storage_root,
+                                     uint32_t title_id) {}
+
   virtual std::unique_ptr<Assembler> CreateAssembler() = 0;
 
   virtual std::unique_ptr<GuestFunction> CreateGuestFunction(
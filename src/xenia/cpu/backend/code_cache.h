@@ -33,6 +33,18 @@ class CodeCache {
 
   // Finds platform-specific function unwind info for the given host PC.
   virtual void* LookupUnwindInfo(uint64_t host_pc) = 0;
+  // Returns the address the unwind info for the host PC is relative to.
+  virtual uint64_t LookupUnwindImageBase(uint64_t host_pc) {
+    return base_address();
+  }
+
+  // Whether there is replaced code waiting to be reclaimed.
+  virtual bool HasRetiredCode() { return false; }
+  // Reclaims the space of replaced code. live_host_pcs must hold the
+  // instruction pointers and return addresses of every thread that may be
+  // running generated code, captured with all of them suspended.
+  virtual void ReclaimRetiredCode(const uint64_t* live_host_pcs,
+                                  size_t live_host_pc_count) {}
 };
 
 }  // namespace backend
@@ -75,31 +75,78 @@ bool X64Assembler::Assemble(GuestFunction* function, HIRBuilder* builder,
   xe::make_reset_scope(this);
 
   // Lower HIR -> x64.
+  // Generated separately from the function, which may be running code
+  // described by its current source map.
   void* machine_code = nullptr;
   size_t code_size = 0;
+  std::vector<SourceMapEntry> source_map;
   if (!emitter_->Emit(function, builder, debug_info_flags, debug_info.get(),
-                      &machine_code, &code_size, &function->source_map())) {
+                      &machine_code, &code_size, &source_map)) {
     return false;
   }
 
   // Stash generated machine code.
   if (debug_info_flags & DebugInfoFlags::kDebugInfoDisasmMachineCode) {
-    DumpMachineCode(machine_code, code_size, function->source_map(),
-                    &string_buffer_);
+    DumpMachineCode(machine_code, code_size, source_map, &string_buffer_);
     debug_info->set_machine_code_disasm(strdup(string_buffer_.buffer()));
     string_buffer_.Reset();
   }
 
   function->set_debug_info(std::move(debug_info));
-  static_cast<X64Function*>(function)->Setup(
-      reinterpret_cast<uint8_t*>(machine_code), code_size);
+  auto x64_function = static_cast<X64Function*>(function);
+  void* old_machine_code = x64_function->machine_code();
+  x64_function->Setup(reinterpret_cast<uint8_t*>(machine_code), code_size,
+                      std::move(source_map));
 
   // Install into indirection table.
   uint64_t host_address = reinterpret_cast<uint64_t>(machine_code);
   assert_true((host_address >> 32) == 0);
-  reinterpret_cast<X64CodeCache*>(backend_->code_cache())
-      ->AddIndirection(function->address(),
-                       static_cast<uint32_t>(host_address));
+  auto code_cache = static_cast<X64CodeCache*>(backend_->code_cache());
+  code_cache->AddIndirection(function->address(),
+                             static_cast<uint32_t>(host_address));
+
+  // Baseline tier code will be replaced, so calls keep using the indirection
+  // until this is the optimized recompilation.
+  if (!function->is_baseline_tier() || function->tier_up_started()) {
+    code_cache->LinkGuestFunction(function->address(), machine_code);
+  }
+
+  // Nothing branches to the code this replaced anymore, but threads may still
+  // be running it.
+  if (old_machine_code) {
+    code_cache->RetireCode(old_machine_code);
+  }
+
+  return true;
+}
+
+bool X64Assembler::AssembleFromStorage(GuestFunction* function) {
+  auto code_cache = static_cast<X64CodeCache*>(backend_->code_cache());
+  if (!code_cache->has_storage()) {
+    return false;
+  }
+
+  size_t code_size = 0;
+  std::vector<SourceMapEntry> source_map;
+  void* machine_code =
+      code_cache->PlaceStoredGuestCode(function, &code_size, &source_map);
+  if (!machine_code) {
+    return false;
+  }
+  auto x64_function = static_cast<X64Function*>(function);
+  void* old_machine_code = x64_function->machine_code();
+  x64_function->Setup(reinterpret_cast<uint8_t*>(machine_code), code_size,
+                      std::move(source_map));
+
+  // Install into indirection table.
+  uint64_t host_address = reinterpret_cast<uint64_t>(machine_code);
+  assert_true((host_address >> 32) == 0);
+  code_cache->AddIndirection(function->address(),
+                             static_cast<uint32_t>(host_address));
+  code_cache->LinkGuestFunction(function->address(), machine_code);
+  if (old_machine_code) {
+    code_cache->RetireCode(old_machine_code);
+  }
 
   return true;
 }
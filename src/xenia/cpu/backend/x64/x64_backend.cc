@@ -23,6 +23,7 @@
 #include "xenia/cpu/backend/x64/x64_sequences.h"
 #include "xenia/cpu/backend/x64/x64_stack_layout.h"
 #include "xenia/cpu/breakpoint.h"
+#include "xenia/cpu/ppc/ppc_context.h"
 #include "xenia/cpu/processor.h"
 #include "xenia/cpu/stack_walker.h"
 
@@ -30,6 +31,15 @@ DEFINE_bool(
     use_haswell_instructions, true,
     "Uses the AVX2/FMA/etc instructions on Haswell processors when available.",
     "CPU");
+DEFINE_bool(use_avx512_instructions, true,
+            "Uses the AVX-512 instructions on processors that support them. "
+            "Requires use_haswell_instructions.",
+            "CPU");
+DEFINE_bool(use_fma_for_vmx, true,
+            "Lowers the VMX vector multiply-add/subtract instructions to host "
+            "FMA3 when available. These round once like the guest, while the "
+            "fallback rounds after both the multiply and the add.",
+            "CPU");
 
 namespace xe {
 namespace cpu {
@@ -42,7 +52,9 @@ class X64ThunkEmitter : public X64Emitter {
   ~X64ThunkEmitter() override;
   HostToGuestThunk EmitHostToGuestThunk();
   GuestToHostThunk EmitGuestToHostThunk();
+  GuestToHostThunk EmitExternCallThunk();
   ResolveFunctionThunk EmitResolveFunctionThunk();
+  GuestCallThunk EmitGuestCallThunk();
 
  private:
   // The following four functions provide save/load functionality for registers.
@@ -54,6 +66,9 @@ class X64ThunkEmitter : public X64Emitter {
   void EmitLoadNonvolatileRegs();
 };
 
+// X64Emitter handles actually resolving functions.
+extern "C" uint64_t ResolveFunction(void* raw_context, uint32_t target_address);
+
 X64Backend::X64Backend() : Backend(), code_cache_(nullptr) {
   if (cs_open(CS_ARCH_X86, CS_MODE_64, &capstone_handle_) != CS_ERR_OK) {
     assert_always("Failed to initialize capstone");
@@ -115,7 +130,9 @@ bool X64Backend::Initialize(Processor* processor) {
   X64ThunkEmitter thunk_emitter(this, &allocator);
   host_to_guest_thunk_ = thunk_emitter.EmitHostToGuestThunk();
   guest_to_host_thunk_ = thunk_emitter.EmitGuestToHostThunk();
+  extern_call_thunk_ = thunk_emitter.EmitExternCallThunk();
   resolve_function_thunk_ = thunk_emitter.EmitResolveFunctionThunk();
+  emitter_feature_flags_ = thunk_emitter.feature_flags();
 
   // Set the code cache to use the ResolveFunction thunk for default
   // indirections.
@@ -123,6 +140,13 @@ bool X64Backend::Initialize(Processor* processor) {
   code_cache_->set_indirection_default(
       uint32_t(uint64_t(resolve_function_thunk_)));
 
+  // Guest call chaining relies on the indirection table for unlinked calls.
+  if (code_cache_->has_indirection_table()) {
+    guest_call_thunk_ = thunk_emitter.EmitGuestCallThunk();
+    code_cache_->set_guest_call_thunk(
+        reinterpret_cast<void*>(guest_call_thunk_));
+  }
+
   // Allocate some special indirections.
   code_cache_->CommitExecutableRange(0x9FFF0000, 0x9FFFFFFF);
 
@@ -140,6 +164,45 @@ void X64Backend::CommitExecutableRange(uint32_t guest_low,
   code_cache_->CommitExecutableRange(guest_low, guest_high);
 }
 
+void X64Backend::InvalidateGuestFunction(GuestFunction* function) {
+  // Direct call sites are reverted to the indirection table, which now leads
+  // to the resolver.
+  code_cache_->AddIndirection(function->address(),
+                              uint32_t(uint64_t(resolve_function_thunk_)));
+  code_cache_->UnlinkGuestFunction(function->address());
+}
+
+void X64Backend::InitializeCodeStorage(
+    const std::filesystem::path& storage_root, uint32_t title_id) {
+  // Everything stored code references outside of itself, other than rebased
+  // host image addresses, must be identical between runs. The distances
+  // between functions in different libraries catch relinked builds with the
+  // same version, and the context layout catches local changes to it.
+  const uint64_t fingerprint_data[] = {
+      emitter_feature_flags_,
+      machine_info_.supports_extended_load_store,
+      uint64_t(host_to_guest_thunk_),
+      uint64_t(guest_to_host_thunk_),
+      uint64_t(extern_call_thunk_),
+      uint64_t(resolve_function_thunk_),
+      uint64_t(emitter_data_),
+      uint64_t(&ResolveFunction) - uint64_t(&X64CodeCache::Create),
+      uint64_t(&xe::Clock::QueryHostTickCount) - uint64_t(&ResolveFunction),
+      // How OPCODE_LOAD_CLOCK reads the guest clock.
+      uint64_t(cvars::clock_inline_tsc) |
+          (uint64_t(xe::Clock::guest_tick_mapping() != nullptr) << 1),
+      offsetof(ppc::PPCContext, xer_ca) |
+          (offsetof(ppc::PPCContext, f) << 16) |
+          (offsetof(ppc::PPCContext, v) << 32) |
+          (uint64_t(sizeof(ppc::PPCContext)) << 48),
+  };
+  const char build_version[] = XE_BUILD_COMMIT " " XE_BUILD_DATE;
+  uint64_t host_fingerprint =
+      XXH64(fingerprint_data, sizeof(fingerprint_data),
+            XXH64(build_version, sizeof(build_version) - 1, 0));
+  code_cache_->InitializeStorage(storage_root, title_id, host_fingerprint);
+}
+
 std::unique_ptr<Assembler> X64Backend::CreateAssembler() {
   return std::make_unique<X64Assembler>(this);
 }
@@ -518,8 +581,76 @@ GuestToHostThunk X64ThunkEmitter::EmitGuestToHostThunk() {
   return (GuestToHostThunk)fn;
 }
 
-// X64Emitter handles actually resolving functions.
-extern "C" uint64_t ResolveFunction(void* raw_context, uint32_t target_address);
+GuestToHostThunk X64ThunkEmitter::EmitExternCallThunk() {
+  // rcx = target function
+  // rdx = arg0
+  // r8  = arg1
+  // r9  = arg2
+
+  struct _code_offsets {
+    size_t prolog;
+    size_t prolog_stack_alloc;
+    size_t body;
+    size_t epilog;
+    size_t tail;
+  } code_offsets = {};
+
+  const size_t stack_size = StackLayout::THUNK_STACK_SIZE;
+
+  code_offsets.prolog = getSize();
+
+  // rsp + 0 = return address
+  sub(rsp, stack_size);
+
+  code_offsets.prolog_stack_alloc = getSize();
+  code_offsets.body = getSize();
+
+  // Only called between instructions, where the volatile registers that
+  // sequences use as scratch hold nothing. Only the allocatable ones (and the
+  // context and membase, which are volatile on Linux) need to survive.
+#if XE_PLATFORM_LINUX
+  mov(qword[rsp + offsetof(StackLayout::Thunk, r[3])], rsi);
+  mov(qword[rsp + offsetof(StackLayout::Thunk, r[4])], rdi);
+#endif
+  mov(qword[rsp + offsetof(StackLayout::Thunk, r[7])], r10);
+  mov(qword[rsp + offsetof(StackLayout::Thunk, r[8])], r11);
+  vmovaps(qword[rsp + offsetof(StackLayout::Thunk, xmm[4])], xmm4);
+  vmovaps(qword[rsp + offsetof(StackLayout::Thunk, xmm[5])], xmm5);
+
+  mov(rax, rcx);              // function
+  mov(rcx, GetContextReg());  // context
+  call(rax);
+
+#if XE_PLATFORM_LINUX
+  mov(rsi, qword[rsp + offsetof(StackLayout::Thunk, r[3])]);
+  mov(rdi, qword[rsp + offsetof(StackLayout::Thunk, r[4])]);
+#endif
+  mov(r10, qword[rsp + offsetof(StackLayout::Thunk, r[7])]);
+  mov(r11, qword[rsp + offsetof(StackLayout::Thunk, r[8])]);
+  vmovaps(xmm4, qword[rsp + offsetof(StackLayout::Thunk, xmm[4])]);
+  vmovaps(xmm5, qword[rsp + offsetof(StackLayout::Thunk, xmm[5])]);
+
+  code_offsets.epilog = getSize();
+
+  add(rsp, stack_size);
+  ret();
+
+  code_offsets.tail = getSize();
+
+  assert_zero(code_offsets.prolog);
+  EmitFunctionInfo func_info = {};
+  func_info.code_size.total = getSize();
+  func_info.code_size.prolog = code_offsets.body - code_offsets.prolog;
+  func_info.code_size.body = code_offsets.epilog - code_offsets.body;
+  func_info.code_size.epilog = code_offsets.tail - code_offsets.epilog;
+  func_info.code_size.tail = getSize() - code_offsets.tail;
+  func_info.prolog_stack_alloc_offset =
+      code_offsets.prolog_stack_alloc - code_offsets.prolog;
+  func_info.stack_size = stack_size;
+
+  void* fn = Emplace(func_info);
+  return (GuestToHostThunk)fn;
+}
 
 ResolveFunctionThunk X64ThunkEmitter::EmitResolveFunctionThunk() {
   // ebx = target PPC address
@@ -575,6 +706,44 @@ ResolveFunctionThunk X64ThunkEmitter::EmitResolveFunctionThunk() {
   return (ResolveFunctionThunk)fn;
 }
 
+GuestCallThunk X64ThunkEmitter::EmitGuestCallThunk() {
+  // ebx = target PPC address
+  // rcx = guest return address
+  // Entered with a call or jmp from the guest call site, so this behaves like
+  // the call/jmp through the indirection table it stands in for.
+
+  struct _code_offsets {
+    size_t prolog;
+    size_t body;
+    size_t epilog;
+    size_t tail;
+  } code_offsets = {};
+
+  code_offsets.prolog = getSize();
+  code_offsets.body = getSize();
+
+  mov(eax, dword[ebx]);
+
+  code_offsets.epilog = getSize();
+
+  jmp(rax);
+
+  code_offsets.tail = getSize();
+
+  assert_zero(code_offsets.prolog);
+  EmitFunctionInfo func_info = {};
+  func_info.code_size.total = getSize();
+  func_info.code_size.prolog = code_offsets.body - code_offsets.prolog;
+  func_info.code_size.body = code_offsets.epilog - code_offsets.body;
+  func_info.code_size.epilog = code_offsets.tail - code_offsets.epilog;
+  func_info.code_size.tail = getSize() - code_offsets.tail;
+  func_info.prolog_stack_alloc_offset = 0;
+  func_info.stack_size = 0;
+
+  void* fn = Emplace(func_info);
+  return (GuestCallThunk)fn;
+}
+
 void X64ThunkEmitter::EmitSaveVolatileRegs() {
   // Save off volatile registers.
   // mov(qword[rsp + offsetof(StackLayout::Thunk, r[0])], rax);
@@ -16,6 +16,8 @@
 #include "xenia/cpu/backend/backend.h"
 
 DECLARE_bool(use_haswell_instructions);
+DECLARE_bool(use_avx512_instructions);
+DECLARE_bool(use_fma_for_vmx);
 
 namespace xe {
 class Exception;
@@ -32,6 +34,7 @@ class X64CodeCache;
 typedef void* (*HostToGuestThunk)(void* target, void* arg0, void* arg1);
 typedef void* (*GuestToHostThunk)(void* target, void* arg0, void* arg1);
 typedef void (*ResolveFunctionThunk)();
+typedef void (*GuestCallThunk)();
 
 class X64Backend : public Backend {
  public:
@@ -42,19 +45,30 @@ class X64Backend : public Backend {
 
   X64CodeCache* code_cache() const { return code_cache_.get(); }
   uintptr_t emitter_data() const { return emitter_data_; }
+  uint32_t emitter_feature_flags() const { return emitter_feature_flags_; }
 
   // Call a generated function, saving all stack parameters.
   HostToGuestThunk host_to_guest_thunk() const { return host_to_guest_thunk_; }
   // Function that guest code can call to transition into host code.
   GuestToHostThunk guest_to_host_thunk() const { return guest_to_host_thunk_; }
+  // Same as guest_to_host_thunk, but only usable between HIR instructions as
+  // it leaves the registers sequences use as scratch to the callee.
+  GuestToHostThunk extern_call_thunk() const { return extern_call_thunk_; }
   // Function that thunks to the ResolveFunction in X64Emitter.
   ResolveFunctionThunk resolve_function_thunk() const {
     return resolve_function_thunk_;
   }
+  // Function that guest call sites not linked to their callee branch to,
+  // calling through the indirection table. Null without an indirection table.
+  GuestCallThunk guest_call_thunk() const { return guest_call_thunk_; }
 
   bool Initialize(Processor* processor) override;
 
   void CommitExecutableRange(uint32_t guest_low, uint32_t guest_high) override;
+  void InvalidateGuestFunction(GuestFunction* function) override;
+
+  void InitializeCodeStorage(const std::filesystem::path& storage_root,
+                             uint32_t title_id) override;
 
   std::unique_ptr<Assembler> CreateAssembler() override;
 
@@ -76,10 +90,13 @@ class X64Backend : public Backend {
 
   std::unique_ptr<X64CodeCache> code_cache_;
   uintptr_t emitter_data_ = 0;
+  uint32_t emitter_feature_flags_ = 0;
 
   HostToGuestThunk host_to_guest_thunk_;
   GuestToHostThunk guest_to_host_thunk_;
+  GuestToHostThunk extern_call_thunk_;
   ResolveFunctionThunk resolve_function_thunk_;
+  GuestCallThunk guest_call_thunk_ = nullptr;
 };
 
 }  // namespace x64
@@ -9,6 +9,8 @@
 
 #include "xenia/cpu/backend/x64/x64_code_cache.h"
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdlib>
 #include <cstring>
 
@@ -18,22 +20,125 @@
 #endif
 
 #include "third_party/fmt/include/fmt/format.h"
+#include "third_party/xxhash/xxhash.h"
 #include "xenia/base/assert.h"
+#include "xenia/base/atomic.h"
 #include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/module.h"
+#include "xenia/memory.h"
+
+DEFINE_bool(store_guest_code, false,
+            "Store relocatable generated guest code on disk and reuse it on "
+            "later runs of the same title instead of translating it again "
+            "(experimental).",
+            "CPU");
+
+DEFINE_bool(code_cache_large_pages, true,
+            "Back generated code and the indirection table with large pages "
+            "to reduce TLB misses when the host allows it (needs the \"Lock "
+            "pages in memory\" right on Windows and reserved huge pages on "
+            "Linux).",
+            "CPU");
+DEFINE_bool(code_cache_hot_region, true,
+            "Place the code of functions optimized by tiered compilation, and "
+            "stored code that was, in a separate region of the code cache to "
+            "keep the hottest code together in the instruction cache and the "
+            "TLB.",
+            "CPU");
 
 namespace xe {
 namespace cpu {
 namespace backend {
 namespace x64 {
 
+namespace {
+
+// 'XEJT'.
+constexpr uint32_t kStorageMagic = 0x544A4558;
+// Increment whenever the storage layout or the translator/emitter output
+// changes in a way that makes previously generated code invalid.
+constexpr uint32_t kStorageVersion = 3;
+
+struct StorageFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t host_fingerprint;
+};
+
+// Followed by code_size bytes of machine code, relocation_count uint32_t
+// offsets of host image relocations, call_site_count GuestCallSite and
+// source_map_count SourceMapEntry.
+struct StoredFunctionHeader {
+  uint32_t guest_address;
+  uint32_t guest_end_address;
+  uint64_t module_hash;
+  uint64_t guest_code_hash;
+  uint32_t code_size;
+  uint32_t code_size_prolog;
+  uint32_t code_size_body;
+  uint32_t code_size_epilog;
+  uint32_t code_size_tail;
+  uint32_t prolog_stack_alloc_offset;
+  uint32_t stack_size;
+  uint32_t relocation_count;
+  uint32_t source_map_count;
+  uint32_t call_site_count;
+  uint32_t flags;
+  uint32_t padding;
+};
+
+// The code was hot when it was stored, and is placed in the hot region.
+constexpr uint32_t kStoredFunctionFlagHot = 1 << 0;
+
+// Same as the emitter limit - anything bigger is a corrupted record.
+constexpr uint32_t kMaxStoredCodeSize = 1 * 1024 * 1024;
+
+// Host image addresses are stored relative to this so that they survive the
+// image being relocated between runs.
+uint64_t GetHostImageAnchor() {
+  return reinterpret_cast<uint64_t>(&X64CodeCache::Create);
+}
+
+// Call sites are 4b aligned, so the rel32 can be swapped while other threads
+// are executing the code.
+void PatchCallSite(uint8_t* call_site, const void* target) {
+  auto rel32 = reinterpret_cast<volatile int32_t*>(call_site);
+  xe::atomic_exchange(
+      int32_t(reinterpret_cast<intptr_t>(target) -
+              reinterpret_cast<intptr_t>(call_site + sizeof(int32_t))),
+      rel32);
+}
+
+uint64_t HashModule(const Module* module) {
+  const std::string& name = module->name();
+  return XXH64(name.data(), name.size(), 0);
+}
+
+uint64_t HashGuestCode(GuestFunction* function) {
+  auto memory = function->module()->memory();
+  return XXH64(memory->TranslateVirtual(function->address()),
+               function->end_address() - function->address() + 4, 0);
+}
+
+}  // namespace
+
 X64CodeCache::X64CodeCache() = default;
 
 X64CodeCache::~X64CodeCache() {
+  ShutdownStorage();
+
+  if (large_page_size_) {
+    ReleaseLargePageRegion(indirection_table_base_, indirection_table_chunks_);
+    ReleaseLargePageRegion(generated_code_base_, generated_code_chunks_);
+    return;
+  }
+
   if (indirection_table_base_) {
     xe::memory::DeallocFixed(indirection_table_base_, 0,
                              xe::memory::DeallocationType::kRelease);
@@ -49,6 +154,41 @@ X64CodeCache::~X64CodeCache() {
 }
 
 bool X64CodeCache::Initialize() {
+  // Preallocate the function maps to a large, reasonable size, as they're
+  // searched without locking.
+  generated_code_map_.reserve(kMaximumFunctionCount);
+  hot_code_map_.reserve(kMaximumFunctionCount);
+
+  // Large pages can't be committed in reserved memory, so the code and the
+  // indirection table are reserved in chunks that are replaced on commit.
+  if (cvars::code_cache_large_pages) {
+    large_page_size_ = xe::memory::large_page_size();
+  }
+  if (large_page_size_) {
+    auto indirection_table_base =
+        reinterpret_cast<uint8_t*>(kIndirectionTableBase);
+    auto generated_code_base = reinterpret_cast<uint8_t*>(kGeneratedCodeBase);
+    if (ReserveLargePageRegion(indirection_table_base, kIndirectionTableSize,
+                               indirection_table_chunks_,
+                               xe::memory::PageAccess::kReadWrite)) {
+      if (ReserveLargePageRegion(generated_code_base, kGeneratedCodeSize,
+                                 generated_code_chunks_,
+                                 xe::memory::PageAccess::kExecuteReadWrite)) {
+        indirection_table_base_ = indirection_table_base;
+        generated_code_base_ = generated_code_base;
+        XELOGI("Using {} KB pages for generated code",
+               large_page_size_ / 1024);
+        return true;
+      }
+      ReleaseLargePageRegion(indirection_table_base,
+                             indirection_table_chunks_);
+    }
+    XELOGW(
+        "Unable to reserve the code cache for large pages, using normal "
+        "pages");
+    large_page_size_ = 0;
+  }
+
   indirection_table_base_ = reinterpret_cast<uint8_t*>(xe::memory::AllocFixed(
       reinterpret_cast<void*>(kIndirectionTableBase), kIndirectionTableSize,
       xe::memory::AllocationType::kReserve,
@@ -87,12 +227,113 @@ bool X64CodeCache::Initialize() {
     return false;
   }
 
-  // Preallocate the function map to a large, reasonable size.
-  generated_code_map_.reserve(kMaximumFunctionCount);
+  return true;
+}
 
+bool X64CodeCache::ReserveLargePageRegion(uint8_t* base, size_t size,
+                                          std::vector<bool>& committed_chunks,
+                                          xe::memory::PageAccess access) {
+  committed_chunks.clear();
+  size_t chunk_count = xe::round_up(size, large_page_size_) / large_page_size_;
+  for (size_t i = 0; i < chunk_count; ++i) {
+    uint8_t* chunk = base + i * large_page_size_;
+    void* result = xe::memory::AllocFixed(chunk, large_page_size_,
+                                          xe::memory::AllocationType::kReserve,
+                                          access);
+    if (result != chunk) {
+      if (result) {
+        xe::memory::DeallocFixed(result, large_page_size_,
+                                 xe::memory::DeallocationType::kRelease);
+      }
+      ReleaseLargePageRegion(base, committed_chunks);
+      return false;
+    }
+    committed_chunks.push_back(false);
+  }
   return true;
 }
 
+void X64CodeCache::ReleaseLargePageRegion(uint8_t* base,
+                                          std::vector<bool>& chunks) {
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    xe::memory::DeallocFixed(base + i * large_page_size_, large_page_size_,
+                             xe::memory::DeallocationType::kRelease);
+  }
+  chunks.clear();
+}
+
+void X64CodeCache::CommitRegion(uint8_t* base,
+                                std::vector<bool>& committed_chunks,
+                                size_t offset, size_t length,
+                                xe::memory::PageAccess access) {
+  if (!large_page_size_) {
+    xe::memory::AllocFixed(base + offset, length,
+                           xe::memory::AllocationType::kCommit, access);
+    return;
+  }
+  if (!length) {
+    return;
+  }
+  // Replacing a chunk isn't atomic, so commits can't race.
+  auto global_lock = global_critical_region_.Acquire();
+  size_t chunk_last = (offset + length - 1) / large_page_size_;
+  for (size_t i = offset / large_page_size_; i <= chunk_last; ++i) {
+    if (committed_chunks[i]) {
+      continue;
+    }
+    // The chunk is only reserved, so nothing is lost by releasing it.
+    uint8_t* chunk = base + i * large_page_size_;
+    xe::memory::DeallocFixed(chunk, large_page_size_,
+                             xe::memory::DeallocationType::kRelease);
+    if (!xe::memory::AllocFixed(
+            chunk, large_page_size_,
+            xe::memory::AllocationType::kReserveCommitLargePages, access)) {
+      // Physical memory may be too fragmented to find a large page.
+      if (xe::memory::AllocFixed(chunk, large_page_size_,
+                                 xe::memory::AllocationType::kReserveCommit,
+                                 access) != chunk) {
+        XELOGE("Unable to commit code cache memory at {}",
+               static_cast<void*>(chunk));
+        assert_always();
+      }
+    }
+    committed_chunks[i] = true;
+  }
+}
+
+void X64CodeCache::CommitGeneratedCode(std::atomic<size_t>& commit_mark,
+                                       size_t region_offset,
+                                       size_t high_mark) {
+  // If we are going above the high water mark of committed memory, commit
+  // some more. It's ok if multiple threads do this, as redundant commits
+  // aren't harmful.
+  size_t old_commit_mark, new_commit_mark;
+  do {
+    old_commit_mark = commit_mark;
+    if (high_mark <= old_commit_mark) break;
+
+    new_commit_mark = old_commit_mark + 16 * 1024 * 1024;
+    CommitRegion(generated_code_base_, generated_code_chunks_, region_offset,
+                 new_commit_mark - region_offset,
+                 xe::memory::PageAccess::kExecuteReadWrite);
+  } while (commit_mark.compare_exchange_weak(old_commit_mark,
+                                             new_commit_mark));
+}
+
+size_t X64CodeCache::FindCodeBlock(uint64_t code_offset) {
+  bool hot = code_offset >= kHotCodeOffset;
+  const auto& map = code_map(hot);
+  auto it = std::lower_bound(
+      map.begin(), map.end(), code_offset,
+      [](const std::pair<uint64_t, GuestFunction*>& block, uint64_t offset) {
+        return (block.first >> 32) < offset;
+      });
+  if (it == map.end() || (it->first >> 32) != code_offset) {
+    return SIZE_MAX;
+  }
+  return size_t(it - map.begin()) | (hot ? kHotCodeBlock : 0);
+}
+
 void X64CodeCache::set_indirection_default(uint32_t default_value) {
   indirection_default_value_ = default_value;
 }
@@ -103,9 +344,11 @@ void X64CodeCache::AddIndirection(uint32_t guest_address,
     return;
   }
 
-  uint32_t* indirection_slot = reinterpret_cast<uint32_t*>(
+  // This may be replacing the code of a function other threads are calling
+  // (tiered compilation), so swap the slot atomically.
+  auto indirection_slot = reinterpret_cast<volatile int32_t*>(
       indirection_table_base_ + (guest_address - kIndirectionTableBase));
-  *indirection_slot = host_address;
+  xe::atomic_exchange(int32_t(host_address), indirection_slot);
 }
 
 void X64CodeCache::CommitExecutableRange(uint32_t guest_low,
@@ -115,10 +358,9 @@ void X64CodeCache::CommitExecutableRange(uint32_t guest_low,
   }
 
   // Commit the memory.
-  xe::memory::AllocFixed(
-      indirection_table_base_ + (guest_low - kIndirectionTableBase),
-      guest_high - guest_low, xe::memory::AllocationType::kCommit,
-      xe::memory::PageAccess::kExecuteReadWrite);
+  CommitRegion(indirection_table_base_, indirection_table_chunks_,
+               guest_low - kIndirectionTableBase, guest_high - guest_low,
+               xe::memory::PageAccess::kExecuteReadWrite);
 
   // Fill memory with the default value.
   uint32_t* p = reinterpret_cast<uint32_t*>(indirection_table_base_);
@@ -127,16 +369,84 @@ void X64CodeCache::CommitExecutableRange(uint32_t guest_low,
   }
 }
 
+void X64CodeCache::LinkGuestFunction(uint32_t guest_address,
+                                     void* host_address) {
+  auto global_lock = global_critical_region_.Acquire();
+  auto& target = guest_call_targets_[guest_address];
+  target.host_address = reinterpret_cast<uint8_t*>(host_address);
+  for (uint8_t* call_site : target.call_sites) {
+    PatchCallSite(call_site, host_address);
+  }
+}
+
+void X64CodeCache::UnlinkGuestFunction(uint32_t guest_address) {
+  auto global_lock = global_critical_region_.Acquire();
+  auto it = guest_call_targets_.find(guest_address);
+  if (it == guest_call_targets_.end() || !it->second.host_address) {
+    return;
+  }
+  it->second.host_address = nullptr;
+  for (uint8_t* call_site : it->second.call_sites) {
+    PatchCallSite(call_site, guest_call_thunk_);
+  }
+}
+
+void X64CodeCache::FillInlineCache(const uint8_t* descriptor,
+                                   uint32_t guest_address) {
+  auto global_lock = global_critical_region_.Acquire();
+  InlineCacheDescriptor header;
+  std::memcpy(&header, descriptor, offsetof(InlineCacheDescriptor, slots));
+  auto miss_branch = const_cast<uint8_t*>(descriptor + header.miss_branch);
+  const uint8_t* generic_dispatch = descriptor + header.generic_dispatch;
+  // Garbage targets are left to the indirection table to deal with.
+  if (guest_address < kIndirectionTableBase ||
+      guest_address - kIndirectionTableBase >= kIndirectionTableSize) {
+    return;
+  }
+  for (uint32_t i = 0; i < header.slot_count; ++i) {
+    InlineCacheDescriptor::Slot slot;
+    std::memcpy(&slot,
+                descriptor + offsetof(InlineCacheDescriptor, slots) +
+                    sizeof(slot) * i,
+                sizeof(slot));
+    auto slot_address = reinterpret_cast<volatile uint32_t*>(
+        const_cast<uint8_t*>(descriptor + slot.guest_address));
+    if (*slot_address == guest_address) {
+      // Another thread missed with the same target first.
+      return;
+    }
+    if (*slot_address) {
+      continue;
+    }
+    // Link the branch before the slot can match.
+    uint8_t* branch = const_cast<uint8_t*>(descriptor + slot.branch);
+    auto& target = guest_call_targets_[guest_address];
+    PatchCallSite(branch, target.host_address ? target.host_address
+                                              : guest_call_thunk_);
+    target.call_sites.push_back(branch);
+    xe::atomic_exchange(int32_t(guest_address),
+                        reinterpret_cast<volatile int32_t*>(slot_address));
+    if (i + 1 < header.slot_count) {
+      return;
+    }
+    break;
+  }
+  // Every slot is taken, so don't keep missing into the handler.
+  PatchCallSite(miss_branch, generic_dispatch);
+}
+
 void* X64CodeCache::PlaceHostCode(uint32_t guest_address, void* machine_code,
                                   const EmitFunctionInfo& func_info) {
   // Same for now. We may use different pools or whatnot later on, like when
   // we only want to place guest code in a serialized cache on disk.
-  return PlaceGuestCode(guest_address, machine_code, func_info, nullptr);
+  return PlaceGuestCode(guest_address, machine_code, func_info, nullptr, {},
+                        false);
 }
 
-void* X64CodeCache::PlaceGuestCode(uint32_t guest_address, void* machine_code,
-                                   const EmitFunctionInfo& func_info,
-                                   GuestFunction* function_info) {
+void* X64CodeCache::PlaceGuestCode(
+    uint32_t guest_address, void* machine_code,
+    const EmitFunctionInfo& func_info, GuestFunction* function_info,
+    const std::vector<GuestCallSite>& call_sites, bool hot) {
   // Hold a lock while we bump the pointers up. This is important as the
   // unwind table requires entries AND code to be sorted in order.
   size_t low_mark;
@@ -146,55 +456,94 @@ void* X64CodeCache::PlaceGuestCode(uint32_t guest_address, void* machine_code,
   {
     auto global_lock = global_critical_region_.Acquire();
 
-    low_mark = generated_code_offset_;
+    // Guest code goes into the space of reclaimed code if any fits, reusing
+    // its map entry and unwind table slot so both stay sorted.
+    size_t code_size = xe::round_up(func_info.code_size.total, 16);
+    size_t unwind_size = xe::round_up(unwind_reservation_size(), 16);
+    hot = hot && function_info && cvars::code_cache_hot_region;
+    auto* free_blocks = hot ? &hot_free_code_blocks_ : &free_code_blocks_;
+    auto free_block = free_blocks->end();
+    if (function_info) {
+      free_block = free_blocks->lower_bound(code_size + unwind_size);
+    }
+    if (hot && free_block == free_blocks->end() &&
+        hot_code_offset_ + code_size + unwind_size > kGeneratedCodeSize) {
+      // The hot region is full.
+      hot = false;
+      free_blocks = &free_code_blocks_;
+      free_block = free_blocks->lower_bound(code_size + unwind_size);
+    }
+    uint8_t* tail_address;
+    uint8_t* end_address;
+    if (free_block != free_blocks->end()) {
+      size_t block_index = free_block->second;
+      free_blocks->erase(free_block);
+      auto& block = code_block(block_index);
+      code_address = generated_code_base_ + (block.first >> 32);
+      tail_address = code_address + code_size;
+      unwind_reservation = ReuseUnwindReservation(
+          tail_address, block_index & ~kHotCodeBlock, hot);
+      end_address = generated_code_base_ + uint32_t(block.first);
+      block.second = function_info;
+      low_mark = high_mark = 0;
+    } else {
+      size_t& code_offset = hot ? hot_code_offset_ : generated_code_offset_;
+      low_mark = code_offset;
 
-    // Reserve code.
-    // Always move the code to land on 16b alignment.
-    code_address = generated_code_base_ + generated_code_offset_;
-    generated_code_offset_ += xe::round_up(func_info.code_size.total, 16);
+      // Reserve code.
+      // Always move the code to land on 16b alignment.
+      code_address = generated_code_base_ + code_offset;
+      code_offset += code_size;
 
-    auto tail_address = generated_code_base_ + generated_code_offset_;
+      tail_address = generated_code_base_ + code_offset;
 
-    // Reserve unwind info.
-    // We go on the high size of the unwind info as we don't know how big we
-    // need it, and a few extra bytes of padding isn't the worst thing.
-    unwind_reservation =
-        RequestUnwindReservation(generated_code_base_ + generated_code_offset_);
-    generated_code_offset_ += xe::round_up(unwind_reservation.data_size, 16);
+      // Reserve unwind info.
+      // We go on the high size of the unwind info as we don't know how big we
+      // need it, and a few extra bytes of padding isn't the worst thing.
+      unwind_reservation =
+          RequestUnwindReservation(generated_code_base_ + code_offset, hot);
+      code_offset += xe::round_up(unwind_reservation.data_size, 16);
 
-    auto end_address = generated_code_base_ + generated_code_offset_;
+      end_address = generated_code_base_ + code_offset;
 
-    high_mark = generated_code_offset_;
+      high_mark = code_offset;
 
-    // Store in map. It is maintained in sorted order of host PC dependent on
-    // us also being append-only.
-    generated_code_map_.emplace_back(
-        (uint64_t(code_address - generated_code_base_) << 32) |
-            generated_code_offset_,
-        function_info);
+      // Store in map. It is maintained in sorted order of host PC dependent
+      // on us also being append-only.
+      code_map(hot).emplace_back(
+          (uint64_t(code_address - generated_code_base_) << 32) | code_offset,
+          function_info);
+    }
 
     // TODO(DrChat): The following code doesn't really need to be under the
     // global lock except for PlaceCode (but it depends on the previous code
     // already being ran)
 
-    // If we are going above the high water mark of committed memory, commit
-    // some more. It's ok if multiple threads do this, as redundant commits
-    // aren't harmful.
-    size_t old_commit_mark, new_commit_mark;
-    do {
-      old_commit_mark = generated_code_commit_mark_;
-      if (high_mark <= old_commit_mark) break;
-
-      new_commit_mark = old_commit_mark + 16 * 1024 * 1024;
-      xe::memory::AllocFixed(generated_code_base_, new_commit_mark,
-                             xe::memory::AllocationType::kCommit,
-                             xe::memory::PageAccess::kExecuteReadWrite);
-    } while (generated_code_commit_mark_.compare_exchange_weak(
-        old_commit_mark, new_commit_mark));
+    if (hot) {
+      CommitGeneratedCode(hot_code_commit_mark_, kHotCodeOffset, high_mark);
+    } else {
+      CommitGeneratedCode(generated_code_commit_mark_, 0, high_mark);
+    }
 
     // Copy code.
     std::memcpy(code_address, machine_code, func_info.code_size.total);
 
+    // Point guest calls at their callees if they're already linked, or the
+    // indirection otherwise, before the code can be reached.
+    for (const GuestCallSite& call_site : call_sites) {
+      uint8_t* call_site_address = code_address + call_site.code_offset;
+      if (!call_site.guest_address) {
+        // Unused inline cache slot, linked when it's filled.
+        PatchCallSite(call_site_address, guest_call_thunk_);
+        continue;
+      }
+      auto& target = guest_call_targets_[call_site.guest_address];
+      PatchCallSite(call_site_address, target.host_address
+                                           ? target.host_address
+                                           : guest_call_thunk_);
+      target.call_sites.push_back(call_site_address);
+    }
+
     // Fill unused slots with 0xCC
     std::memset(tail_address, 0xCC,
                 static_cast<size_t>(end_address - tail_address));
@@ -229,14 +578,306 @@ void* X64CodeCache::PlaceGuestCode(uint32_t guest_address, void* machine_code,
   // Note that we do support code that doesn't have an indirection fixup, so
   // ignore those when we see them.
   if (guest_address && indirection_table_base_) {
-    uint32_t* indirection_slot = reinterpret_cast<uint32_t*>(
+    auto indirection_slot = reinterpret_cast<volatile int32_t*>(
         indirection_table_base_ + (guest_address - kIndirectionTableBase));
-    *indirection_slot = uint32_t(reinterpret_cast<uint64_t>(code_address));
+    xe::atomic_exchange(int32_t(reinterpret_cast<uint64_t>(code_address)),
+                        indirection_slot);
   }
 
   return code_address;
 }
 
+void X64CodeCache::InitializeStorage(const std::filesystem::path& storage_root,
+                                     uint32_t title_id,
+                                     uint64_t host_fingerprint) {
+  ShutdownStorage();
+  if (!cvars::store_guest_code) {
+    return;
+  }
+
+  // Generated code is specific to the host and the build, so this doesn't go
+  // into any shareable location.
+  auto storage_dir = storage_root / "jit";
+  if (!std::filesystem::exists(storage_dir)) {
+    if (!std::filesystem::create_directories(storage_dir)) {
+      XELOGE(
+          "Failed to create the guest code storage directory, persistent "
+          "guest code storage will be disabled: {}",
+          xe::path_to_utf8(storage_dir));
+      return;
+    }
+  }
+  auto storage_file_path = storage_dir / fmt::format("{:08X}.xjit", title_id);
+  std::unique_ptr<xe::filesystem::FileLock> storage_lock =
+      xe::filesystem::FileLock::TryAcquireForStorage(storage_file_path);
+  bool read_only = !storage_lock;
+  FILE* file =
+      xe::filesystem::OpenFile(storage_file_path, read_only ? "rb" : "a+b");
+  if (!file) {
+    if (read_only) {
+      XELOGI(
+          "The guest code storage is being created by another process, "
+          "persistent guest code storage will be disabled: {}",
+          xe::path_to_utf8(storage_file_path));
+    } else {
+      XELOGE(
+          "Failed to open the guest code storage file for writing, persistent "
+          "guest code storage will be disabled: {}",
+          xe::path_to_utf8(storage_file_path));
+    }
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(storage_mutex_);
+  storage_index_.clear();
+  StorageFileHeader file_header;
+  if (fread(&file_header, sizeof(file_header), 1, file) &&
+      file_header.magic == kStorageMagic &&
+      file_header.version == kStorageVersion &&
+      file_header.host_fingerprint == host_fingerprint) {
+    // Index the functions stored by previous runs until the end of the file or
+    // until a corrupted record is found. Another process may be appending to
+    // the file, so only whole records within the current size are indexed.
+    int64_t file_size = -1;
+    if (xe::filesystem::Seek(file, 0, SEEK_END)) {
+      file_size = xe::filesystem::Tell(file);
+    }
+    xe::filesystem::Seek(file, sizeof(file_header), SEEK_SET);
+    int64_t valid_bytes = sizeof(file_header);
+    size_t function_count = 0;
+    StoredFunctionHeader function_header;
+    while (fread(&function_header, sizeof(function_header), 1, file)) {
+      if (!function_header.code_size ||
+          function_header.code_size > kMaxStoredCodeSize ||
+          function_header.relocation_count > function_header.code_size ||
+          function_header.source_map_count > function_header.code_size) {
+        break;
+      }
+      int64_t payload_size =
+          int64_t(function_header.code_size) +
+          int64_t(function_header.relocation_count) * sizeof(uint32_t) +
+          int64_t(function_header.source_map_count) * sizeof(SourceMapEntry);
+      if (valid_bytes + int64_t(sizeof(function_header)) + payload_size >
+              file_size ||
+          !xe::filesystem::Seek(file, payload_size, SEEK_CUR) ||
+          xe::filesystem::Tell(file) != valid_bytes +
+                                            int64_t(sizeof(function_header)) +
+                                            payload_size) {
+        break;
+      }
+      storage_index_[function_header.guest_address].push_back(
+          {function_header.guest_code_hash, valid_bytes});
+      valid_bytes += sizeof(function_header) + payload_size;
+      ++function_count;
+    }
+    // Seeking past the end succeeds, so make sure the last record is whole.
+    if (!xe::filesystem::Seek(file, 0, SEEK_END) ||
+        xe::filesystem::Tell(file) < valid_bytes) {
+      storage_index_.clear();
+      valid_bytes = sizeof(file_header);
+      function_count = 0;
+    }
+    if (!read_only) {
+      xe::filesystem::TruncateStdioFile(file, uint64_t(valid_bytes));
+    }
+    XELOGI("Indexed {} stored guest functions{}", function_count,
+           read_only ? " (read-only, shared with another process)" : "");
+  } else if (read_only) {
+    // Can't be initialized for this host without writing.
+    XELOGI(
+        "The guest code storage used by another process is for a different "
+        "host or build, persistent guest code storage will be disabled: {}",
+        xe::path_to_utf8(storage_file_path));
+    fclose(file);
+    return;
+  } else {
+    xe::filesystem::TruncateStdioFile(file, 0);
+    file_header.magic = kStorageMagic;
+    file_header.version = kStorageVersion;
+    file_header.host_fingerprint = host_fingerprint;
+    fwrite(&file_header, sizeof(file_header), 1, file);
+  }
+  storage_file_ = file;
+  storage_lock_ = std::move(storage_lock);
+}
+
+void X64CodeCache::ShutdownStorage() {
+  std::lock_guard<std::mutex> lock(storage_mutex_);
+  if (storage_file_) {
+    fclose(storage_file_);
+    storage_file_ = nullptr;
+  }
+  storage_lock_.reset();
+  storage_index_.clear();
+}
+
+void* X64CodeCache::PlaceStoredGuestCode(
+    GuestFunction* function, size_t* out_code_size,
+    std::vector<SourceMapEntry>* out_source_map) {
+  uint32_t guest_address = function->address();
+  uint64_t guest_code_hash = HashGuestCode(function);
+
+  StoredFunctionHeader header;
+  std::vector<uint8_t> code;
+  std::vector<uint32_t> relocations;
+  std::vector<GuestCallSite> call_sites;
+  std::vector<SourceMapEntry> source_map;
+  {
+    std::lock_guard<std::mutex> lock(storage_mutex_);
+    if (!storage_file_) {
+      return nullptr;
+    }
+    auto it = storage_index_.find(guest_address);
+    if (it == storage_index_.end()) {
+      return nullptr;
+    }
+    int64_t file_offset = -1;
+    for (const auto& location : it->second) {
+      if (location.guest_code_hash == guest_code_hash) {
+        file_offset = location.file_offset;
+      }
+    }
+    if (file_offset < 0 ||
+        !xe::filesystem::Seek(storage_file_, file_offset, SEEK_SET) ||
+        !fread(&header, sizeof(header), 1, storage_file_)) {
+      return nullptr;
+    }
+    if (header.guest_address != guest_address ||
+        header.guest_end_address != function->end_address() ||
+        header.module_hash != HashModule(function->module()) ||
+        header.guest_code_hash != guest_code_hash) {
+      return nullptr;
+    }
+    code.resize(header.code_size);
+    relocations.resize(header.relocation_count);
+    call_sites.resize(header.call_site_count);
+    source_map.resize(header.source_map_count);
+    if (!fread(code.data(), code.size(), 1, storage_file_) ||
+        (!relocations.empty() &&
+         !fread(relocations.data(), relocations.size() * sizeof(uint32_t), 1,
+                storage_file_)) ||
+        (!call_sites.empty() &&
+         !fread(call_sites.data(), call_sites.size() * sizeof(GuestCallSite),
+                1, storage_file_)) ||
+        (!source_map.empty() &&
+         !fread(source_map.data(), source_map.size() * sizeof(SourceMapEntry),
+                1, storage_file_))) {
+      return nullptr;
+    }
+  }
+
+  // Rebase references into the host image.
+  uint64_t host_image_anchor = GetHostImageAnchor();
+  for (uint32_t relocation : relocations) {
+    if (relocation + sizeof(uint64_t) > code.size()) {
+      return nullptr;
+    }
+    uint64_t value;
+    std::memcpy(&value, code.data() + relocation, sizeof(value));
+    value += host_image_anchor;
+    std::memcpy(code.data() + relocation, &value, sizeof(value));
+  }
+  // Call sites are linked again when placing.
+  for (const GuestCallSite& call_site : call_sites) {
+    if ((call_site.code_offset & 3) ||
+        call_site.code_offset + sizeof(int32_t) > code.size()) {
+      return nullptr;
+    }
+  }
+
+  EmitFunctionInfo func_info = {};
+  func_info.code_size.prolog = header.code_size_prolog;
+  func_info.code_size.body = header.code_size_body;
+  func_info.code_size.epilog = header.code_size_epilog;
+  func_info.code_size.tail = header.code_size_tail;
+  func_info.code_size.total = header.code_size;
+  func_info.prolog_stack_alloc_offset = header.prolog_stack_alloc_offset;
+  func_info.stack_size = header.stack_size;
+  bool hot = (header.flags & kStoredFunctionFlagHot) ||
+             function->tier_up_started();
+  void* code_address = PlaceGuestCode(guest_address, code.data(), func_info,
+                                      function, call_sites, hot);
+  *out_source_map = std::move(source_map);
+  *out_code_size = code.size();
+  return code_address;
+}
+
+void X64CodeCache::StoreGuestCode(
+    GuestFunction* function, const void* code_address,
+    const EmitFunctionInfo& func_info,
+    const std::vector<SourceMapEntry>& source_map,
+    const std::vector<uint32_t>& host_relocations,
+    const std::vector<GuestCallSite>& call_sites) {
+  if (!storage_file_ || !storage_lock_) {
+    return;
+  }
+
+  StoredFunctionHeader header = {};
+  header.guest_address = function->address();
+  header.guest_end_address = function->end_address();
+  header.module_hash = HashModule(function->module());
+  header.guest_code_hash = HashGuestCode(function);
+  header.code_size = uint32_t(func_info.code_size.total);
+  header.code_size_prolog = uint32_t(func_info.code_size.prolog);
+  header.code_size_body = uint32_t(func_info.code_size.body);
+  header.code_size_epilog = uint32_t(func_info.code_size.epilog);
+  header.code_size_tail = uint32_t(func_info.code_size.tail);
+  header.prolog_stack_alloc_offset =
+      uint32_t(func_info.prolog_stack_alloc_offset);
+  header.stack_size = uint32_t(func_info.stack_size);
+  header.relocation_count = uint32_t(host_relocations.size());
+  header.call_site_count = uint32_t(call_sites.size());
+  header.source_map_count = uint32_t(source_map.size());
+  // Tiered compilation only recompiles functions that have been entered many
+  // times.
+  if (function->tier_up_started()) {
+    header.flags |= kStoredFunctionFlagHot;
+  }
+
+  // Make host image references relative so they can be rebased on load.
+  std::vector<uint8_t> code(header.code_size);
+  std::memcpy(code.data(), code_address, code.size());
+  uint64_t host_image_anchor = GetHostImageAnchor();
+  for (uint32_t relocation : host_relocations) {
+    assert_true(relocation + sizeof(uint64_t) <= code.size());
+    uint64_t value;
+    std::memcpy(&value, code.data() + relocation, sizeof(value));
+    value -= host_image_anchor;
+    std::memcpy(code.data() + relocation, &value, sizeof(value));
+  }
+
+  std::lock_guard<std::mutex> lock(storage_mutex_);
+  if (!storage_file_) {
+    return;
+  }
+  auto& locations = storage_index_[header.guest_address];
+  for (const auto& location : locations) {
+    if (location.guest_code_hash == header.guest_code_hash) {
+      // Already stored, likely translated again with debug info.
+      return;
+    }
+  }
+  if (!xe::filesystem::Seek(storage_file_, 0, SEEK_END)) {
+    return;
+  }
+  int64_t file_offset = xe::filesystem::Tell(storage_file_);
+  fwrite(&header, sizeof(header), 1, storage_file_);
+  fwrite(code.data(), code.size(), 1, storage_file_);
+  if (!host_relocations.empty()) {
+    fwrite(host_relocations.data(), host_relocations.size() * sizeof(uint32_t),
+           1, storage_file_);
+  }
+  if (!call_sites.empty()) {
+    fwrite(call_sites.data(), call_sites.size() * sizeof(GuestCallSite), 1,
+           storage_file_);
+  }
+  if (!source_map.empty()) {
+    fwrite(source_map.data(), source_map.size() * sizeof(SourceMapEntry), 1,
+           storage_file_);
+  }
+  locations.push_back({header.guest_code_hash, file_offset});
+}
+
 uint32_t X64CodeCache::PlaceData(const void* data, size_t length) {
   // Hold a lock while we bump the pointers up.
   size_t high_mark;
@@ -252,20 +893,7 @@ uint32_t X64CodeCache::PlaceData(const void* data, size_t length) {
     high_mark = generated_code_offset_;
   }
 
-  // If we are going above the high water mark of committed memory, commit some
-  // more. It's ok if multiple threads do this, as redundant commits aren't
-  // harmful.
-  size_t old_commit_mark, new_commit_mark;
-  do {
-    old_commit_mark = generated_code_commit_mark_;
-    if (high_mark <= old_commit_mark) break;
-
-    new_commit_mark = old_commit_mark + 16 * 1024 * 1024;
-    xe::memory::AllocFixed(generated_code_base_, new_commit_mark,
-                           xe::memory::AllocationType::kCommit,
-                           xe::memory::PageAccess::kExecuteReadWrite);
-  } while (generated_code_commit_mark_.compare_exchange_weak(old_commit_mark,
-                                                             new_commit_mark));
+  CommitGeneratedCode(generated_code_commit_mark_, 0, high_mark);
 
   // Copy code.
   std::memcpy(data_address, data, length);
@@ -273,10 +901,93 @@ uint32_t X64CodeCache::PlaceData(const void* data, size_t length) {
   return uint32_t(uintptr_t(data_address));
 }
 
+void X64CodeCache::RetireCode(void* code_address) {
+  auto global_lock = global_critical_region_.Acquire();
+  size_t block_index = FindCodeBlock(uint64_t(
+      reinterpret_cast<uint8_t*>(code_address) - generated_code_base_));
+  if (block_index == SIZE_MAX || pinned_code_blocks_.count(block_index)) {
+    return;
+  }
+  retired_code_blocks_.push_back(block_index);
+}
+
+void X64CodeCache::PinCode(void* code_address) {
+  auto global_lock = global_critical_region_.Acquire();
+  size_t block_index = FindCodeBlock(uint64_t(
+      reinterpret_cast<uint8_t*>(code_address) - generated_code_base_));
+  if (block_index != SIZE_MAX) {
+    pinned_code_blocks_.insert(block_index);
+  }
+}
+
+bool X64CodeCache::HasRetiredCode() {
+  auto global_lock = global_critical_region_.Acquire();
+  return !retired_code_blocks_.empty() || !quarantined_code_blocks_.empty();
+}
+
+void X64CodeCache::ReclaimRetiredCode(const uint64_t* live_host_pcs,
+                                      size_t live_host_pc_count) {
+  auto global_lock = global_critical_region_.Acquire();
+
+  // Free quarantined blocks no thread is in. A thread that had loaded the
+  // address of retired code before the previous pass has entered it or given
+  // it up by now.
+  std::vector<uint64_t> freed_ranges;
+  for (size_t block_index : quarantined_code_blocks_) {
+    auto& block = code_block(block_index);
+    uint64_t block_start = kGeneratedCodeBase + (block.first >> 32);
+    uint64_t block_end = kGeneratedCodeBase + uint32_t(block.first);
+    bool is_live = pinned_code_blocks_.count(block_index) != 0;
+    for (size_t i = 0; i < live_host_pc_count && !is_live; ++i) {
+      is_live = live_host_pcs[i] >= block_start && live_host_pcs[i] < block_end;
+    }
+    if (is_live) {
+      // Retry on the next pass.
+      retired_code_blocks_.push_back(block_index);
+      continue;
+    }
+    if (block.second) {
+      block.second->ForgetRetiredMachineCode(generated_code_base_ +
+                                             (block.first >> 32));
+    }
+    block.second = nullptr;
+    ((block_index & kHotCodeBlock) ? hot_free_code_blocks_ : free_code_blocks_)
+        .emplace(block_end - block_start, block_index);
+    freed_ranges.push_back(block.first);
+    // Make stray branches into the space fault until it's reused.
+    std::memset(generated_code_base_ + (block.first >> 32), 0xCC,
+                size_t(block_end - block_start));
+  }
+  quarantined_code_blocks_.swap(retired_code_blocks_);
+  retired_code_blocks_.clear();
+
+  // Forget the call sites in freed code so they aren't patched when their
+  // callees are linked.
+  if (!freed_ranges.empty()) {
+    std::sort(freed_ranges.begin(), freed_ranges.end());
+    for (auto& it : guest_call_targets_) {
+      auto& call_sites = it.second.call_sites;
+      call_sites.erase(
+          std::remove_if(call_sites.begin(), call_sites.end(),
+                         [&](uint8_t* call_site) {
+                           uint64_t offset =
+                               uint64_t(call_site - generated_code_base_);
+                           auto range = std::upper_bound(
+                               freed_ranges.begin(), freed_ranges.end(),
+                               (offset << 32) | 0xFFFFFFFF);
+                           return range != freed_ranges.begin() &&
+                                  offset < uint32_t(*(range - 1));
+                         }),
+          call_sites.end());
+    }
+  }
+}
+
 GuestFunction* X64CodeCache::LookupFunction(uint64_t host_pc) {
   uint32_t key = uint32_t(host_pc - kGeneratedCodeBase);
+  const auto& map = code_map(key >= kHotCodeOffset);
   void* fn_entry = std::bsearch(
-      &key, generated_code_map_.data(), generated_code_map_.size() + 1,
+      &key, map.data(), map.size() + 1,
       sizeof(std::pair<uint32_t, Function*>),
       [](const void* key_ptr, const void* element_ptr) {
         auto key = *reinterpret_cast<const uint32_t*>(key_ptr);
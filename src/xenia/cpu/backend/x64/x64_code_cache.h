@@ -11,11 +11,18 @@
 #define XENIA_CPU_BACKEND_X64_X64_CODE_CACHE_H_
 
 #include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
+#include "xenia/base/filesystem.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/mutex.h"
 #include "xenia/cpu/backend/code_cache.h"
@@ -37,6 +44,34 @@ struct EmitFunctionInfo {
   size_t stack_size;
 };
 
+// A call or tail call to a guest function in generated code that can be linked
+// directly to the callee. code_offset is the 4b aligned offset of the rel32
+// operand of the call/jmp. guest_address is 0 for the branch of an unused
+// inline cache slot, which is pointed at the guest call thunk until filled.
+struct GuestCallSite {
+  uint32_t code_offset;
+  uint32_t guest_address;
+};
+
+// Describes a polymorphic inline cache at an indirect guest branch, emitted as
+// data in the cold code of the function. Offsets are relative to the
+// descriptor and point at 4b aligned operands in the inline code: the guest
+// address compared by each slot (0 while unused), the rel32 of the direct
+// branch taken on a match, and the rel32 of the branch taken when no slot
+// matches, which once all slots are filled is patched to branch to the generic
+// dispatch through the indirection table instead of the miss handler.
+struct InlineCacheDescriptor {
+  static constexpr uint32_t kMaxSlots = 4;
+  struct Slot {
+    int32_t guest_address;
+    int32_t branch;
+  };
+  uint32_t slot_count;
+  int32_t miss_branch;
+  int32_t generic_dispatch;
+  Slot slots[kMaxSlots];
+};
+
 class X64CodeCache : public CodeCache {
  public:
   ~X64CodeCache() override;
@@ -49,7 +84,29 @@ class X64CodeCache : public CodeCache {
   uint32_t base_address() const override { return kGeneratedCodeBase; }
   uint32_t total_size() const override { return kGeneratedCodeSize; }
 
-  // TODO(benvanik): ELF serialization/etc
+  // Opens (or creates) the persistent guest code storage for the title.
+  // host_fingerprint must change whenever anything the generated code depends
+  // on (thunk placement, constant data location, host features, build) does,
+  // which discards everything stored in the file. If another process already
+  // uses the same storage, it's opened read-only.
+  void InitializeStorage(const std::filesystem::path& storage_root,
+                         uint32_t title_id, uint64_t host_fingerprint);
+  void ShutdownStorage();
+  bool has_storage() const { return storage_file_ != nullptr; }
+
+  // Places guest code stored by a previous run if the guest instructions of
+  // the function still hash the same, rebasing host image relocations.
+  // Returns the placed code and fills its source map, or nullptr.
+  void* PlaceStoredGuestCode(GuestFunction* function, size_t* out_code_size,
+                             std::vector<SourceMapEntry>* out_source_map);
+  // Appends placed guest code to the storage. host_relocations are offsets of
+  // 64-bit immediates in the code holding addresses within the host image.
+  void StoreGuestCode(GuestFunction* function, const void* code_address,
+                      const EmitFunctionInfo& func_info,
+                      const std::vector<SourceMapEntry>& source_map,
+                      const std::vector<uint32_t>& host_relocations,
+                      const std::vector<GuestCallSite>& call_sites);
+
   // TODO(benvanik): keep track of code blocks
   // TODO(benvanik): padding/guards/etc
 
@@ -59,15 +116,45 @@ class X64CodeCache : public CodeCache {
 
   void CommitExecutableRange(uint32_t guest_low, uint32_t guest_high);
 
+  // Call sites not linked to their callee branch to this thunk, which
+  // dispatches through the indirection table with the guest address in ebx.
+  void set_guest_call_thunk(void* thunk) { guest_call_thunk_ = thunk; }
+  // Patches all existing and future call sites of the guest function to
+  // branch directly to host_address. Only for code that's never replaced.
+  void LinkGuestFunction(uint32_t guest_address, void* host_address);
+  // Reverts call sites of the guest function to going through the indirection
+  // table, for when its code is no longer valid.
+  void UnlinkGuestFunction(uint32_t guest_address);
+  // Fills a free slot of the inline cache of an indirect branch with the guest
+  // function, linking it like a call site, or stops missing into the handler
+  // if the branch has more targets than the cache has slots.
+  void FillInlineCache(const uint8_t* descriptor, uint32_t guest_address);
+
   void* PlaceHostCode(uint32_t guest_address, void* machine_code,
                       const EmitFunctionInfo& func_info);
+  // Hot code (functions recompiled by tiered compilation after having been
+  // entered many times) is placed in a separate region so the code running the
+  // most shares pages and cache lines instead of being scattered among code
+  // that has run once.
   void* PlaceGuestCode(uint32_t guest_address, void* machine_code,
                        const EmitFunctionInfo& func_info,
-                       GuestFunction* function_info);
+                       GuestFunction* function_info,
+                       const std::vector<GuestCallSite>& call_sites, bool hot);
   uint32_t PlaceData(const void* data, size_t length);
 
+  // Marks the code of a function that has been given new code as unused, to
+  // be reclaimed once no thread can be running it anymore.
+  void RetireCode(void* code_address);
+  // Keeps the code from ever being reclaimed, for when its address has been
+  // embedded in other code.
+  void PinCode(void* code_address);
+
   GuestFunction* LookupFunction(uint64_t host_pc) override;
 
+  bool HasRetiredCode() override;
+  void ReclaimRetiredCode(const uint64_t* live_host_pcs,
+                          size_t live_host_pc_count) override;
+
  protected:
   // All executable code falls within 0x80000000 to 0x9FFFFFFF, so we can
   // only map enough for lookups within that range.
@@ -78,6 +165,9 @@ class X64CodeCache : public CodeCache {
   // so 256MB should be more than enough.
   static const uint64_t kGeneratedCodeBase = 0xA0000000;
   static const uint64_t kGeneratedCodeSize = 0x0FFFFFFF;
+  // Offset of the hot code region at the end of the generated code, with
+  // everything else placed below it.
+  static const uint64_t kHotCodeOffset = 0x0E000000;
 
   // This is picked to be high enough to cover whatever we can reasonably
   // expect. If we hit issues with this it probably means some corner case
@@ -88,11 +178,54 @@ class X64CodeCache : public CodeCache {
     size_t data_size = 0;
     size_t table_slot = 0;
     uint8_t* entry_address = 0;
+    // Code in the hot region has its own table.
+    bool hot = false;
   };
 
+  // Code map entries and unwind table slots of the hot region are marked with
+  // this bit in the block indices.
+  static constexpr size_t kHotCodeBlock = size_t(1) << (sizeof(size_t) * 8 - 1);
+
   X64CodeCache();
 
-  virtual UnwindReservation RequestUnwindReservation(uint8_t* entry_address) {
+  // Reserves the region in chunks of large_page_size_, so that each can be
+  // replaced by a large page allocation when it's committed.
+  bool ReserveLargePageRegion(uint8_t* base, size_t size,
+                              std::vector<bool>& committed_chunks,
+                              xe::memory::PageAccess access);
+  void ReleaseLargePageRegion(uint8_t* base, std::vector<bool>& chunks);
+  // Commits the part of a code cache region, in whole chunks when using large
+  // pages. Redundant commits are ok.
+  void CommitRegion(uint8_t* base, std::vector<bool>& committed_chunks,
+                    size_t offset, size_t length,
+                    xe::memory::PageAccess access);
+  // Commits generated code up to high_mark in the region starting at
+  // region_offset, in steps, advancing its commit mark.
+  void CommitGeneratedCode(std::atomic<size_t>& commit_mark,
+                           size_t region_offset, size_t high_mark);
+
+  std::vector<std::pair<uint64_t, GuestFunction*>>& code_map(bool hot) {
+    return hot ? hot_code_map_ : generated_code_map_;
+  }
+  std::pair<uint64_t, GuestFunction*>& code_block(size_t block_index) {
+    return code_map((block_index & kHotCodeBlock) != 0)[block_index &
+                                                        ~kHotCodeBlock];
+  }
+  // Index of the block starting at the offset from generated_code_base_, with
+  // kHotCodeBlock for the hot region, or SIZE_MAX.
+  size_t FindCodeBlock(uint64_t code_offset);
+
+  virtual size_t unwind_reservation_size() const { return 0; }
+  virtual UnwindReservation RequestUnwindReservation(uint8_t* entry_address,
+                                                     bool hot) {
+    return UnwindReservation();
+  }
+  // Reuses the unwind table slot of reclaimed code for new code placed in its
+  // space, which keeps the table sorted. The slot is the index of the block in
+  // its code map.
+  virtual UnwindReservation ReuseUnwindReservation(uint8_t* entry_address,
+                                                   size_t table_slot,
+                                                   bool hot) {
     return UnwindReservation();
   }
   virtual void PlaceCode(uint32_t guest_address, void* machine_code,
@@ -106,6 +239,14 @@ class X64CodeCache : public CodeCache {
   // or counts of anything, to keep the tables consistent and ordered.
   xe::global_critical_region global_critical_region_;
 
+  // Size of the chunks the indirection table and the generated code are
+  // reserved in when they're backed by large pages, or 0 with normal pages.
+  size_t large_page_size_ = 0;
+  // Which chunks have been committed when using large pages, guarded by the
+  // global critical region.
+  std::vector<bool> indirection_table_chunks_;
+  std::vector<bool> generated_code_chunks_;
+
   // Value that the indirection table will be initialized with upon commit.
   uint32_t indirection_default_value_ = 0xFEEDF00D;
 
@@ -124,6 +265,49 @@ class X64CodeCache : public CodeCache {
   // This can be used to bsearch on host PC to find the guest function.
   // The key is [start address | end address].
   std::vector<std::pair<uint64_t, GuestFunction*>> generated_code_map_;
+
+  // The same for the hot region, which is filled from kHotCodeOffset
+  // separately. Guarded by the global critical region like the above.
+  size_t hot_code_offset_ = kHotCodeOffset;
+  std::atomic<size_t> hot_code_commit_mark_ = {kHotCodeOffset};
+  std::vector<std::pair<uint64_t, GuestFunction*>> hot_code_map_;
+
+  // Indices in generated_code_map_ of code blocks that are no longer used.
+  // Blocks are retired when replaced, quarantined by the next reclamation
+  // pass (a thread may still have been about to enter them) and freed by the
+  // one after that if no thread is running them. The unwind table slot of a
+  // block has the same index. Guarded by the global critical region.
+  std::vector<size_t> retired_code_blocks_;
+  std::vector<size_t> quarantined_code_blocks_;
+  std::unordered_set<size_t> pinned_code_blocks_;
+  // Freed blocks by size, reused for new guest code that fits, separately for
+  // the hot region.
+  std::multimap<size_t, size_t> free_code_blocks_;
+  std::multimap<size_t, size_t> hot_free_code_blocks_;
+
+  // Call sites branching to each guest function and the code they're linked
+  // to, if any. Guarded by the global critical region.
+  struct GuestCallTarget {
+    uint8_t* host_address = nullptr;
+    std::vector<uint8_t*> call_sites;
+  };
+  std::unordered_map<uint32_t, GuestCallTarget> guest_call_targets_;
+  void* guest_call_thunk_ = nullptr;
+
+  // Persistent storage of relocatable guest code, appended as functions are
+  // generated. Access to the file and the index is guarded by storage_mutex_.
+  struct StoredFunctionLocation {
+    uint64_t guest_code_hash;
+    int64_t file_offset;
+  };
+  std::mutex storage_mutex_;
+  FILE* storage_file_ = nullptr;
+  // Held by the process writing to the storage, others only read it.
+  std::unique_ptr<xe::filesystem::FileLock> storage_lock_;
+  // Guest address -> all stored versions of the function at that address
+  // (modules may be loaded at the same address with different code).
+  std::unordered_map<uint32_t, std::vector<StoredFunctionLocation>>
+      storage_index_;
 };
 
 }  // namespace x64
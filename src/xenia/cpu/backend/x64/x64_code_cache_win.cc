@@ -103,23 +103,45 @@ class Win32X64CodeCache : public X64CodeCache {
   bool Initialize() override;
 
   void* LookupUnwindInfo(uint64_t host_pc) override;
+  uint64_t LookupUnwindImageBase(uint64_t host_pc) override;
 
  private:
-  UnwindReservation RequestUnwindReservation(uint8_t* entry_address) override;
+  // The normal and the hot code regions have separate tables as entries can
+  // only be appended to a growable table in sorted order.
+  struct UnwindTable {
+    uint8_t* base = nullptr;
+    size_t size = 0;
+    // Growable function table system handle.
+    void* handle = nullptr;
+    // Actual unwind table entries, relative to base.
+    std::vector<RUNTIME_FUNCTION> entries;
+    // Current number of entries in the table.
+    std::atomic<uint32_t> count = {0};
+  };
+
+  UnwindTable& unwind_table(bool hot) { return unwind_tables_[hot ? 1 : 0]; }
+  UnwindTable& unwind_table_for(uint64_t host_pc) {
+    return unwind_table(host_pc - kGeneratedCodeBase >= kHotCodeOffset);
+  }
+
+  size_t unwind_reservation_size() const override {
+    return xe::round_up(kUnwindInfoSize, 16);
+  }
+  UnwindReservation RequestUnwindReservation(uint8_t* entry_address,
+                                             bool hot) override;
+  UnwindReservation ReuseUnwindReservation(uint8_t* entry_address,
+                                           size_t table_slot,
+                                           bool hot) override;
   void PlaceCode(uint32_t guest_address, void* machine_code,
                  const EmitFunctionInfo& func_info, void* code_address,
                  UnwindReservation unwind_reservation) override;
 
   void InitializeUnwindEntry(uint8_t* unwind_entry_address,
-                             size_t unwind_table_slot, void* code_address,
+                             UnwindTable& table, size_t unwind_table_slot,
+                             void* code_address,
                              const EmitFunctionInfo& func_info);
 
-  // Growable function table system handle.
-  void* unwind_table_handle_ = nullptr;
-  // Actual unwind table entries.
-  std::vector<RUNTIME_FUNCTION> unwind_table_;
-  // Current number of entries in the table.
-  std::atomic<uint32_t> unwind_table_count_ = {0};
+  UnwindTable unwind_tables_[2];
   // Does this version of Windows support growable funciton tables?
   bool supports_growable_table_ = false;
 
@@ -135,14 +157,16 @@ std::unique_ptr<X64CodeCache> X64CodeCache::Create() {
 Win32X64CodeCache::Win32X64CodeCache() = default;
 
 Win32X64CodeCache::~Win32X64CodeCache() {
-  if (supports_growable_table_) {
-    if (unwind_table_handle_) {
-      delete_growable_table_(unwind_table_handle_);
-    }
-  } else {
-    if (generated_code_base_) {
-      RtlDeleteFunctionTable(reinterpret_cast<PRUNTIME_FUNCTION>(
-          reinterpret_cast<DWORD64>(generated_code_base_) | 0x3));
+  for (UnwindTable& table : unwind_tables_) {
+    if (supports_growable_table_) {
+      if (table.handle) {
+        delete_growable_table_(table.handle);
+      }
+    } else {
+      if (table.base) {
+        RtlDeleteFunctionTable(reinterpret_cast<PRUNTIME_FUNCTION>(
+            reinterpret_cast<DWORD64>(table.base) | 0x3));
+      }
     }
   }
 }
@@ -154,7 +178,13 @@ bool Win32X64CodeCache::Initialize() {
 
   // Compute total number of unwind entries we should allocate.
   // We don't support reallocing right now, so this should be high.
-  unwind_table_.resize(kMaximumFunctionCount);
+  unwind_table(false).base = generated_code_base_;
+  unwind_table(false).size = kHotCodeOffset;
+  unwind_table(true).base = generated_code_base_ + kHotCodeOffset;
+  unwind_table(true).size = kGeneratedCodeSize - kHotCodeOffset;
+  for (UnwindTable& table : unwind_tables_) {
+    table.entries.resize(kMaximumFunctionCount);
+  }
 
   // Check if this version of Windows supports growable function tables.
   auto ntdll_handle = GetModuleHandleW(L"ntdll.dll");
@@ -173,31 +203,33 @@ bool Win32X64CodeCache::Initialize() {
   supports_growable_table_ =
       add_growable_table_ && delete_growable_table_ && grow_table_;
 
-  // Create table and register with the system. It's empty now, but we'll grow
-  // it as functions are added.
-  if (supports_growable_table_) {
-    if (add_growable_table_(&unwind_table_handle_, unwind_table_.data(),
-                            unwind_table_count_, DWORD(unwind_table_.size()),
-                            reinterpret_cast<ULONG_PTR>(generated_code_base_),
-                            reinterpret_cast<ULONG_PTR>(generated_code_base_ +
-                                                        kGeneratedCodeSize))) {
-      XELOGE("Unable to create unwind function table");
-      return false;
-    }
-  } else {
-    // Install a callback that the debugger will use to lookup unwind info on
-    // demand.
-    if (!RtlInstallFunctionTableCallback(
-            reinterpret_cast<DWORD64>(generated_code_base_) | 0x3,
-            reinterpret_cast<DWORD64>(generated_code_base_), kGeneratedCodeSize,
-            [](DWORD64 control_pc, PVOID context) {
-              auto code_cache = reinterpret_cast<Win32X64CodeCache*>(context);
-              return reinterpret_cast<PRUNTIME_FUNCTION>(
-                  code_cache->LookupUnwindInfo(control_pc));
-            },
-            this, nullptr)) {
-      XELOGE("Unable to install function table callback");
-      return false;
+  // Create tables and register with the system. They're empty now, but we'll
+  // grow them as functions are added.
+  for (UnwindTable& table : unwind_tables_) {
+    if (supports_growable_table_) {
+      if (add_growable_table_(
+              &table.handle, table.entries.data(), table.count,
+              DWORD(table.entries.size()),
+              reinterpret_cast<ULONG_PTR>(table.base),
+              reinterpret_cast<ULONG_PTR>(table.base + table.size))) {
+        XELOGE("Unable to create unwind function table");
+        return false;
+      }
+    } else {
+      // Install a callback that the debugger will use to lookup unwind info
+      // on demand.
+      if (!RtlInstallFunctionTableCallback(
+              reinterpret_cast<DWORD64>(table.base) | 0x3,
+              reinterpret_cast<DWORD64>(table.base), DWORD(table.size),
+              [](DWORD64 control_pc, PVOID context) {
+                auto code_cache = reinterpret_cast<Win32X64CodeCache*>(context);
+                return reinterpret_cast<PRUNTIME_FUNCTION>(
+                    code_cache->LookupUnwindInfo(control_pc));
+              },
+              this, nullptr)) {
+        XELOGE("Unable to install function table callback");
+        return false;
+      }
     }
   }
 
@@ -205,12 +237,27 @@ bool Win32X64CodeCache::Initialize() {
 }
 
 Win32X64CodeCache::UnwindReservation
-Win32X64CodeCache::RequestUnwindReservation(uint8_t* entry_address) {
-  assert_false(unwind_table_count_ >= kMaximumFunctionCount);
+Win32X64CodeCache::RequestUnwindReservation(uint8_t* entry_address,
+                                            bool hot) {
+  UnwindTable& table = unwind_table(hot);
+  assert_false(table.count >= kMaximumFunctionCount);
+  UnwindReservation unwind_reservation;
+  unwind_reservation.data_size = unwind_reservation_size();
+  unwind_reservation.table_slot = table.count++;
+  unwind_reservation.entry_address = entry_address;
+  unwind_reservation.hot = hot;
+  return unwind_reservation;
+}
+
+Win32X64CodeCache::UnwindReservation
+Win32X64CodeCache::ReuseUnwindReservation(uint8_t* entry_address,
+                                          size_t table_slot, bool hot) {
+  assert_true(table_slot < unwind_table(hot).count);
   UnwindReservation unwind_reservation;
-  unwind_reservation.data_size = xe::round_up(kUnwindInfoSize, 16);
-  unwind_reservation.table_slot = unwind_table_count_++;
+  unwind_reservation.data_size = unwind_reservation_size();
+  unwind_reservation.table_slot = table_slot;
   unwind_reservation.entry_address = entry_address;
+  unwind_reservation.hot = hot;
   return unwind_reservation;
 }
 
@@ -219,13 +266,14 @@ void Win32X64CodeCache::PlaceCode(uint32_t guest_address, void* machine_code,
                                   void* code_address,
                                   UnwindReservation unwind_reservation) {
   // Add unwind info.
-  InitializeUnwindEntry(unwind_reservation.entry_address,
+  UnwindTable& table = unwind_table(unwind_reservation.hot);
+  InitializeUnwindEntry(unwind_reservation.entry_address, table,
                         unwind_reservation.table_slot, code_address, func_info);
 
   if (supports_growable_table_) {
     // Notify that the unwind table has grown.
     // We do this outside of the lock, but with the latest total count.
-    grow_table_(unwind_table_handle_, unwind_table_count_);
+    grow_table_(table.handle, table.count);
   }
 
   // This isn't needed on x64 (probably), but is convention.
@@ -234,8 +282,8 @@ void Win32X64CodeCache::PlaceCode(uint32_t guest_address, void* machine_code,
 }
 
 void Win32X64CodeCache::InitializeUnwindEntry(
-    uint8_t* unwind_entry_address, size_t unwind_table_slot, void* code_address,
-    const EmitFunctionInfo& func_info) {
+    uint8_t* unwind_entry_address, UnwindTable& table, size_t unwind_table_slot,
+    void* code_address, const EmitFunctionInfo& func_info) {
   auto unwind_info = reinterpret_cast<UNWIND_INFO*>(unwind_entry_address);
   UNWIND_CODE* unwind_code = nullptr;
 
@@ -297,21 +345,21 @@ void Win32X64CodeCache::InitializeUnwindEntry(
   }
 
   // Add entry.
-  auto& fn_entry = unwind_table_[unwind_table_slot];
+  auto& fn_entry = table.entries[unwind_table_slot];
   fn_entry.BeginAddress =
-      (DWORD)(reinterpret_cast<uint8_t*>(code_address) - generated_code_base_);
+      (DWORD)(reinterpret_cast<uint8_t*>(code_address) - table.base);
   fn_entry.EndAddress =
       (DWORD)(fn_entry.BeginAddress + func_info.code_size.total);
-  fn_entry.UnwindData = (DWORD)(unwind_entry_address - generated_code_base_);
+  fn_entry.UnwindData = (DWORD)(unwind_entry_address - table.base);
 }
 
 void* Win32X64CodeCache::LookupUnwindInfo(uint64_t host_pc) {
+  UnwindTable& table = unwind_table_for(host_pc);
+  uintptr_t key = uintptr_t(host_pc - reinterpret_cast<uint64_t>(table.base));
   return std::bsearch(
-      &host_pc, unwind_table_.data(), unwind_table_count_,
-      sizeof(RUNTIME_FUNCTION),
+      &key, table.entries.data(), table.count, sizeof(RUNTIME_FUNCTION),
       [](const void* key_ptr, const void* element_ptr) {
-        auto key =
-            *reinterpret_cast<const uintptr_t*>(key_ptr) - kGeneratedCodeBase;
+        auto key = *reinterpret_cast<const uintptr_t*>(key_ptr);
         auto element = reinterpret_cast<const RUNTIME_FUNCTION*>(element_ptr);
         if (key < element->BeginAddress) {
           return -1;
@@ -323,6 +371,10 @@ void* Win32X64CodeCache::LookupUnwindInfo(uint64_t host_pc) {
       });
 }
 
+uint64_t Win32X64CodeCache::LookupUnwindImageBase(uint64_t host_pc) {
+  return reinterpret_cast<uint64_t>(unwind_table_for(host_pc).base);
+}
+
 }  // namespace x64
 }  // namespace backend
 }  // namespace cpu
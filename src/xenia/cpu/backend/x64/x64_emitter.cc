@@ -11,8 +11,12 @@
 
 #include <stddef.h>
 
+#include <algorithm>
 #include <climits>
 #include <cstring>
+#include <mutex>
+#include <unordered_set>
+#include <utility>
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/assert.h"
@@ -29,6 +33,7 @@
 #include "xenia/cpu/backend/x64/x64_sequences.h"
 #include "xenia/cpu/backend/x64/x64_stack_layout.h"
 #include "xenia/cpu/cpu_flags.h"
+#include "xenia/cpu/export_resolver.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/function_debug_info.h"
 #include "xenia/cpu/processor.h"
@@ -42,6 +47,28 @@ DEFINE_bool(ignore_undefined_externs, true,
 DEFINE_bool(emit_source_annotations, false,
             "Add extra movs and nops to make disassembly easier to read.",
             "CPU");
+DEFINE_bool(chain_guest_calls, true,
+            "Patch direct calls between guest functions to branch straight to "
+            "the generated code of the callee once it's available instead of "
+            "going through the indirection table.",
+            "CPU");
+DEFINE_int32(indirect_branch_inline_cache_size, 4,
+             "Number of targets (up to 4) of each indirect guest branch, such "
+             "as virtual calls, compared against at the branch to call their "
+             "generated code directly instead of dispatching through the "
+             "indirection table. 0 to disable.",
+             "CPU");
+DEFINE_bool(inline_high_frequency_exports, true,
+            "Call the handlers of kernel exports tagged as high frequency "
+            "straight from the call site instead of through the generated "
+            "code of their import thunk.",
+            "CPU");
+DEFINE_bool(inline_critical_sections, true,
+            "Enter and leave uncontended guest critical sections in the "
+            "generated code of RtlEnterCriticalSection and "
+            "RtlLeaveCriticalSection calls, only calling the kernel when "
+            "waiting or waking a waiter is needed.",
+            "CPU");
 
 namespace xe {
 namespace cpu {
@@ -80,6 +107,18 @@ X64Emitter::X64Emitter(X64Backend* backend, XbyakAllocator* allocator)
     feature_flags_ |= cpu_.has(Xbyak::util::Cpu::tF16C) ? kX64EmitF16C : 0;
     feature_flags_ |= cpu_.has(Xbyak::util::Cpu::tMOVBE) ? kX64EmitMovbe : 0;
   }
+  if (cvars::use_haswell_instructions && cvars::use_avx512_instructions) {
+    feature_flags_ |=
+        cpu_.has(Xbyak::util::Cpu::tAVX512F) ? kX64EmitAVX512F : 0;
+    feature_flags_ |=
+        cpu_.has(Xbyak::util::Cpu::tAVX512VL) ? kX64EmitAVX512VL : 0;
+    feature_flags_ |=
+        cpu_.has(Xbyak::util::Cpu::tAVX512BW) ? kX64EmitAVX512BW : 0;
+    feature_flags_ |=
+        cpu_.has(Xbyak::util::Cpu::tAVX512DQ) ? kX64EmitAVX512DQ : 0;
+    feature_flags_ |=
+        cpu_.has(Xbyak::util::Cpu::tAVX512_VBMI) ? kX64EmitAVX512VBMI : 0;
+  }
 
   if (!cpu_.has(Xbyak::util::Cpu::tAVX)) {
     xe::FatalError(
@@ -101,7 +140,16 @@ bool X64Emitter::Emit(GuestFunction* function, HIRBuilder* builder,
   debug_info_ = debug_info;
   debug_info_flags_ = debug_info_flags;
   trace_data_ = &function->trace_data();
+  tier_up_function_ = nullptr;
+  if (function->is_baseline_tier() && !function->tier_up_started()) {
+    tier_up_function_ = function;
+  }
   source_map_arena_.Reset();
+  current_guest_address_ = 0;
+  host_relocations_.clear();
+  code_relocatable_ = true;
+  guest_call_sites_.clear();
+  cold_code_.clear();
 
   // Fill the generator with code.
   EmitFunctionInfo func_info = {};
@@ -116,6 +164,16 @@ bool X64Emitter::Emit(GuestFunction* function, HIRBuilder* builder,
   // Stash source map.
   source_map_arena_.CloneContents(out_source_map);
 
+  // Persist the code for later runs if it doesn't depend on this process.
+  // Stored code is validated against the guest code of the function only, so
+  // code with other functions inlined isn't stored.
+  if (code_cache_->has_storage() && code_relocatable_ && !debug_info_flags_ &&
+      !(builder->attributes() & hir::FUNCTION_ATTRIB_HAS_INLINED_CALLS)) {
+    code_cache_->StoreGuestCode(function, *out_code_address, func_info,
+                                *out_source_map, host_relocations_,
+                                guest_call_sites_);
+  }
+
   return true;
 }
 
@@ -129,8 +187,11 @@ void* X64Emitter::Emplace(const EmitFunctionInfo& func_info,
   void* new_address;
   assert_true(func_info.code_size.total == size_);
   if (function) {
-    new_address = code_cache_->PlaceGuestCode(function->address(), top_,
-                                              func_info, function);
+    // Only functions entered enough times to be optimized by tiered
+    // compilation are known to be hot.
+    new_address = code_cache_->PlaceGuestCode(
+        function->address(), top_, func_info, function, guest_call_sites_,
+        function->tier_up_started());
   } else {
     new_address = code_cache_->PlaceHostCode(0, top_, func_info);
   }
@@ -141,6 +202,13 @@ void* X64Emitter::Emplace(const EmitFunctionInfo& func_info,
   return new_address;
 }
 
+uint64_t TierUpFunction(void* raw_context, uint64_t function_ptr) {
+  auto thread_state = *reinterpret_cast<ThreadState**>(raw_context);
+  thread_state->processor()->OptimizeFunction(
+      reinterpret_cast<GuestFunction*>(function_ptr));
+  return 0;
+}
+
 bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
   Xbyak::Label epilog_label;
   epilog_label_ = &epilog_label;
@@ -221,6 +289,22 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
     bts(qword[low_address(&trace_header->function_thread_use)], rax);
   }
 
+  // Baseline tier code requests the optimized tier once it has been entered
+  // enough times. Nothing but the context is live yet, and the thunk preserves
+  // that. The countdown is owned by the function, so this can't be stored.
+  if (tier_up_function_) {
+    MarkNotRelocatable();
+    mov(rax,
+        reinterpret_cast<uint64_t>(tier_up_function_->tier_up_countdown()));
+    sub(dword[rax], 1);
+    GuestFunction* tier_up_function = tier_up_function_;
+    ColdCode& tier_up = AddColdCode([this, tier_up_function]() {
+      CallNative(TierUpFunction, reinterpret_cast<uint64_t>(tier_up_function));
+    });
+    jz(tier_up.entry, CodeGenerator::T_NEAR);
+    L(tier_up.resume);
+  }
+
   // Load membase.
   mov(GetMembaseReg(),
       qword[GetContextReg() + offsetof(ppc::PPCContext, virtual_membase)]);
@@ -235,6 +319,9 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
       label = label->next;
     }
 
+    // Predecessors may have left any rounding mode.
+    InvalidateRoundingMode();
+
     // Process instructions.
     const Instr* instr = block->instr_head;
     while (instr) {
@@ -266,6 +353,16 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
 
   code_offsets.tail = getSize();
 
+  // Rarely taken paths, out of the way of the hot ones.
+  for (ColdCode& cold_code : cold_code_) {
+    L(cold_code.entry);
+    cold_code.emit();
+    if (cold_code.resumes) {
+      jmp(cold_code.resume, CodeGenerator::T_NEAR);
+    }
+  }
+  cold_code_.clear();
+
   if (cvars::emit_source_annotations) {
     nop();
     nop();
@@ -286,9 +383,16 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
   return true;
 }
 
+X64Emitter::ColdCode& X64Emitter::AddColdCode(std::function<void()> emit) {
+  ColdCode& cold_code = cold_code_.emplace_back();
+  cold_code.emit = std::move(emit);
+  return cold_code;
+}
+
 void X64Emitter::MarkSourceOffset(const Instr* i) {
   auto entry = source_map_arena_.Alloc<SourceMapEntry>();
   entry->guest_address = static_cast<uint32_t>(i->src1.offset);
+  current_guest_address_ = entry->guest_address;
   entry->hir_offset = uint32_t(i->block->ordinal << 16) | i->ordinal;
   entry->code_offset = static_cast<uint32_t>(getSize());
 
@@ -336,16 +440,49 @@ uint64_t TrapDebugPrint(void* raw_context, uint64_t address) {
   return 0;
 }
 
-uint64_t TrapDebugBreak(void* raw_context, uint64_t address) {
-  auto thread_state = *reinterpret_cast<ThreadState**>(raw_context);
-  XELOGE("tw/td forced trap hit! This should be a crash!");
+// Traps other than debug prints are reported only the first time each one is
+// hit, as titles may hit asserts or use traps as a signalling channel
+// thousands of times per second and logging every hit stalls them.
+static bool ReportTrapOnce(uint32_t guest_address) {
+  static std::mutex mutex;
+  static std::unordered_set<uint32_t> reported;
+  std::lock_guard<std::mutex> lock(mutex);
+  return reported.insert(guest_address).second;
+}
+
+// The argument is the trap type in the low 16 bits and the guest address above.
+uint64_t TrapDebugBreak(void* raw_context, uint64_t site) {
+  auto guest_address = uint32_t(site >> 16);
+  if (ReportTrapOnce(guest_address)) {
+    XELOGE("tw/td forced trap hit at {:08X}! This should be a crash!",
+           guest_address);
+  }
   if (cvars::break_on_debugbreak) {
     xe::debugging::Break();
   }
   return 0;
 }
 
-void X64Emitter::Trap(uint16_t trap_type) {
+uint64_t TrapConditional(void* raw_context, uint64_t site) {
+  auto guest_address = uint32_t(site >> 16);
+  if (ReportTrapOnce(guest_address)) {
+    XELOGE("tw/td trap hit at {:08X}, ignoring further hits there",
+           guest_address);
+  }
+  return 0;
+}
+
+uint64_t TrapUnknown(void* raw_context, uint64_t site) {
+  auto guest_address = uint32_t(site >> 16);
+  if (ReportTrapOnce(guest_address)) {
+    XELOGW("Unknown trap type {} hit at {:08X}", uint16_t(site),
+           guest_address);
+  }
+  return 0;
+}
+
+void X64Emitter::Trap(uint16_t trap_type, uint32_t guest_address) {
+  uint64_t site = (uint64_t(guest_address) << 16) | trap_type;
   switch (trap_type) {
     case 20:
     case 26:
@@ -353,17 +490,20 @@ void X64Emitter::Trap(uint16_t trap_type) {
       CallNative(TrapDebugPrint, 0);
       break;
     case 0:
+      // Conditional tw/td/twi/tdi, commonly asserts. Taking them would crash
+      // the title on the console, but they're often hit harmlessly here.
+      CallNative(TrapConditional, site);
+      break;
     case 22:
       // Always trap?
       // TODO(benvanik): post software interrupt to debugger.
-      CallNative(TrapDebugBreak, 0);
+      CallNative(TrapDebugBreak, site);
       break;
     case 25:
       // ?
       break;
     default:
-      XELOGW("Unknown trap type {}", trap_type);
-      db(0xCC);
+      CallNative(TrapUnknown, site);
       break;
   }
 }
@@ -394,11 +534,55 @@ extern "C" uint64_t ResolveFunction(void* raw_context,
 void X64Emitter::Call(const hir::Instr* instr, GuestFunction* function) {
   assert_not_null(function);
   auto fn = static_cast<X64Function*>(function);
+  // The callee may change the rounding mode.
+  InvalidateRoundingMode();
+  // Import thunks are only "sc 2; blr", so calling the handler here skips
+  // nothing but the thunk's own frame and a trip through the indirection
+  // table.
+  auto export_data = function->export_data();
+  if (cvars::inline_high_frequency_exports &&
+      function->behavior() == Function::Behavior::kExtern &&
+      function->extern_handler() && export_data &&
+      (export_data->tags & ExportTag::kHighFrequency)) {
+    CallExtern(instr, function);
+    if (instr->flags & hir::CALL_TAIL) {
+      jmp(epilog_label(), CodeGenerator::T_NEAR);
+    }
+    return;
+  }
+  if (cvars::chain_guest_calls && backend()->guest_call_thunk()) {
+    // Branch to the guest call thunk with the target in ebx, which dispatches
+    // through the indirection table, until the code cache links the callee.
+    // This also keeps stored code independent of where the callee is placed.
+    mov(ebx, function->address());
+    if (instr->flags & hir::CALL_TAIL) {
+      EmitTraceUserCallReturn();
+      mov(rcx, qword[rsp + StackLayout::GUEST_RET_ADDR]);
+      add(rsp, static_cast<uint32_t>(stack_size()));
+    } else {
+      mov(rcx, qword[rsp + StackLayout::GUEST_CALL_RET_ADDR]);
+    }
+    // The rel32 must be aligned to be patched while the code is running.
+    while ((getSize() + 1) & 3) {
+      nop();
+    }
+    db((instr->flags & hir::CALL_TAIL) ? 0xE9 : 0xE8);
+    guest_call_sites_.push_back({uint32_t(getSize()), function->address()});
+    dd(0);
+    return;
+  }
+
   // Resolve address to the function to call and store in rax.
-  if (fn->machine_code()) {
+  // Stored code can't refer to where other functions were placed this run.
+  // Baseline tier code is replaced when it gets hot, and code may be
+  // invalidated if its guest code is modified, so then it's only reachable
+  // through the indirection table.
+  if (fn->machine_code() && !fn->is_baseline_tier() &&
+      !code_cache_->has_storage() && !cvars::invalidate_modified_code) {
     // TODO(benvanik): is it worth it to do this? It removes the need for
     // a ResolveFunction call, but makes the table less useful.
     assert_zero(uint64_t(fn->machine_code()) & 0xFFFFFFFF00000000);
+    code_cache_->PinCode(fn->machine_code());
     mov(eax, uint32_t(uint64_t(fn->machine_code())));
   } else if (code_cache_->has_indirection_table()) {
     // Load the pointer to the indirection table maintained in X64CodeCache.
@@ -433,7 +617,13 @@ void X64Emitter::Call(const hir::Instr* instr, GuestFunction* function) {
 
 void X64Emitter::CallIndirect(const hir::Instr* instr,
                               const Xbyak::Reg64& reg) {
-  // Check if return.
+  InvalidateRoundingMode();
+  // Check if return. Every guest call is a host call, with the guest return
+  // address kept next to the host one in the frame of the callee (and passed
+  // on by tail calls), so the host stack itself is the shadow return stack: a
+  // blr to the address the frame was called for returns straight to the host
+  // code after the call. Mismatches (longjmp and such) are tail calls through
+  // the indirection table, so they don't grow the host stack either.
   if (instr->flags & hir::CALL_POSSIBLE_RETURN) {
     cmp(reg.cvt32(), dword[rsp + StackLayout::GUEST_RET_ADDR]);
     je(epilog_label(), CodeGenerator::T_NEAR);
@@ -442,16 +632,21 @@ void X64Emitter::CallIndirect(const hir::Instr* instr,
   // Load the pointer to the indirection table maintained in X64CodeCache.
   // The target dword will either contain the address of the generated code
   // or a thunk to ResolveAddress.
+  Xbyak::Label done;
   if (code_cache_->has_indirection_table()) {
     if (reg.cvt32() != ebx) {
       mov(ebx, reg.cvt32());
     }
+    if (cvars::chain_guest_calls && backend()->guest_call_thunk() &&
+        cvars::indirect_branch_inline_cache_size > 0) {
+      EmitIndirectBranchInlineCache(instr, done);
+    }
     mov(eax, dword[ebx]);
   } else {
     // Old-style resolve.
     // Not too important because indirection table is almost always available.
     mov(edx, reg.cvt32());
-    mov(rax, reinterpret_cast<uint64_t>(ResolveFunction));
+    MovHostImageAddress(rax, reinterpret_cast<void*>(ResolveFunction));
     mov(rcx, GetContextReg());
     call(rax);
   }
@@ -472,6 +667,90 @@ void X64Emitter::CallIndirect(const hir::Instr* instr,
 
     call(rax);
   }
+  L(done);
+}
+
+uint64_t FillIndirectBranchInlineCache(void* raw_context, uint64_t descriptor,
+                                       uint64_t target_address) {
+  auto thread_state = *reinterpret_cast<ThreadState**>(raw_context);
+  auto code_cache = static_cast<X64CodeCache*>(
+      thread_state->processor()->backend()->code_cache());
+  code_cache->FillInlineCache(reinterpret_cast<const uint8_t*>(descriptor),
+                              uint32_t(target_address));
+  return 0;
+}
+
+void X64Emitter::EmitIndirectBranchInlineCache(const hir::Instr* instr,
+                                               Xbyak::Label& done) {
+  // ebx = target PPC address
+  // Each slot compares against a guest address, 0 until the slot is filled by
+  // the miss handler, and branches like a direct guest call does, going
+  // through the guest call thunk until the code cache links the target. The
+  // operands are aligned so they can be patched while the code is running.
+  bool is_tail = (instr->flags & hir::CALL_TAIL) != 0;
+  InlineCacheDescriptor descriptor = {};
+  descriptor.slot_count =
+      std::min(uint32_t(cvars::indirect_branch_inline_cache_size),
+               InlineCacheDescriptor::kMaxSlots);
+  for (uint32_t i = 0; i < descriptor.slot_count; ++i) {
+    Xbyak::Label next_slot;
+    while ((getSize() + 2) & 3) {
+      nop();
+    }
+    // cmp ebx, imm32
+    db(0x81);
+    db(0xFB);
+    descriptor.slots[i].guest_address = int32_t(getSize());
+    dd(0);
+    jne(next_slot, CodeGenerator::T_NEAR);
+    if (is_tail) {
+      EmitTraceUserCallReturn();
+      mov(rcx, qword[rsp + StackLayout::GUEST_RET_ADDR]);
+      add(rsp, static_cast<uint32_t>(stack_size()));
+    } else {
+      mov(rcx, qword[rsp + StackLayout::GUEST_CALL_RET_ADDR]);
+    }
+    while ((getSize() + 1) & 3) {
+      nop();
+    }
+    db(is_tail ? 0xE9 : 0xE8);
+    descriptor.slots[i].branch = int32_t(getSize());
+    guest_call_sites_.push_back({uint32_t(getSize()), 0});
+    dd(0);
+    if (!is_tail) {
+      jmp(done, CodeGenerator::T_NEAR);
+    }
+    L(next_slot);
+  }
+
+  // Until all slots are taken, misses go to the handler filling them before
+  // taking the generic dispatch.
+  ColdCode& miss = AddColdCode(nullptr);
+  while ((getSize() + 1) & 3) {
+    nop();
+  }
+  jmp(miss.entry, CodeGenerator::T_NEAR);
+  descriptor.miss_branch = int32_t(getSize() - sizeof(int32_t));
+  descriptor.generic_dispatch = int32_t(getSize());
+  L(miss.resume);
+
+  ColdCode& data = AddColdCode([this, descriptor]() {
+    int32_t base = int32_t(getSize());
+    dd(descriptor.slot_count);
+    dd(uint32_t(descriptor.miss_branch - base));
+    dd(uint32_t(descriptor.generic_dispatch - base));
+    for (uint32_t i = 0; i < descriptor.slot_count; ++i) {
+      dd(uint32_t(descriptor.slots[i].guest_address - base));
+      dd(uint32_t(descriptor.slots[i].branch - base));
+    }
+  });
+  data.resumes = false;
+  // rbx is preserved by the call.
+  miss.emit = [this, &data]() {
+    lea(GetNativeParam(0), ptr[rip + data.entry]);
+    mov(GetNativeParam(1).cvt32(), ebx);
+    CallNativeSafe(reinterpret_cast<void*>(FillIndirectBranchInlineCache));
+  };
 }
 
 uint64_t UndefinedCallExtern(void* raw_context, uint64_t function_ptr) {
@@ -485,7 +764,107 @@ uint64_t UndefinedCallExtern(void* raw_context, uint64_t function_ptr) {
   }
   return 0;
 }
+void X64Emitter::EmitGuestToHostAddress(const Xbyak::Reg64& reg) {
+  if (xe::memory::allocation_granularity() > 0x1000) {
+    // Emulate the 4 KB physical address offset in 0xE0000000+ when can't do
+    // it via memory mapping.
+    xor_(eax, eax);
+    cmp(reg.cvt32(), 0xE0000000);
+    setae(al);
+    shl(eax, 12);
+    add(reg.cvt32(), eax);
+  }
+  add(reg, GetMembaseReg());
+}
+
+bool X64Emitter::EmitCriticalSectionFastPath(const Export* export_data,
+                                             Xbyak::Label& done) {
+  // Layout of X_RTL_CRITICAL_SECTION in xboxkrnl_rtl.cc. lock_count is
+  // accessed in host byte order by the kernel, the rest is big-endian.
+  const uint32_t kLockCountOffset = 0x10;
+  const uint32_t kRecursionCountOffset = 0x14;
+  const uint32_t kOwningThreadOffset = 0x18;
+  // KPCR::current_thread, with r13 pointing to the KPCR.
+  const uint32_t kPcrCurrentThreadOffset = 0x100;
+
+  bool is_enter = !std::strcmp(export_data->name, "RtlEnterCriticalSection");
+  if (!is_enter &&
+      std::strcmp(export_data->name, "RtlLeaveCriticalSection")) {
+    return false;
+  }
+
+  // Volatile registers are free here as the call would clobber them anyway.
+  Xbyak::Label slow_path;
+  mov(ecx, dword[GetContextReg() + offsetof(ppc::PPCContext, r) + 3 * 8]);
+  EmitGuestToHostAddress(rcx);
+  if (is_enter) {
+    // Both the KPCR and the critical section store the thread big-endian, so
+    // it can be compared and copied without swapping.
+    mov(edx, dword[GetContextReg() + offsetof(ppc::PPCContext, r) + 13 * 8]);
+    EmitGuestToHostAddress(rdx);
+    mov(edx, dword[rdx + kPcrCurrentThreadOffset]);
+    // Acquire if not locked (lock_count -1 to 0).
+    Xbyak::Label not_acquired;
+    mov(eax, -1);
+    xor_(r8d, r8d);
+    lock();
+    cmpxchg(dword[rcx + kLockCountOffset], r8d);
+    jne(not_acquired, CodeGenerator::T_NEAR);
+    mov(dword[rcx + kOwningThreadOffset], edx);
+    mov(dword[rcx + kRecursionCountOffset], xe::byte_swap(uint32_t(1)));
+    jmp(done, CodeGenerator::T_NEAR);
+    // Recursive acquisition by the owner.
+    L(not_acquired);
+    cmp(dword[rcx + kOwningThreadOffset], edx);
+    jne(slow_path, CodeGenerator::T_NEAR);
+    lock();
+    inc(dword[rcx + kLockCountOffset]);
+    mov(eax, dword[rcx + kRecursionCountOffset]);
+    bswap(eax);
+    inc(eax);
+    bswap(eax);
+    mov(dword[rcx + kRecursionCountOffset], eax);
+    jmp(done, CodeGenerator::T_NEAR);
+  } else {
+    mov(eax, dword[rcx + kRecursionCountOffset]);
+    bswap(eax);
+    cmp(eax, 1);
+    // Let the kernel assert if not owned.
+    jl(slow_path, CodeGenerator::T_NEAR);
+    Xbyak::Label last_release;
+    je(last_release, CodeGenerator::T_NEAR);
+    // Still owned after this, just drop the recursion.
+    dec(eax);
+    bswap(eax);
+    mov(dword[rcx + kRecursionCountOffset], eax);
+    lock();
+    dec(dword[rcx + kLockCountOffset]);
+    jmp(done, CodeGenerator::T_NEAR);
+    // Unlock if there are no waiters (lock_count 0 to -1), otherwise one of
+    // them must be woken up by the kernel.
+    L(last_release);
+    cmp(dword[rcx + kLockCountOffset], 0);
+    jne(slow_path, CodeGenerator::T_NEAR);
+    mov(edx, dword[rcx + kOwningThreadOffset]);
+    mov(dword[rcx + kOwningThreadOffset], 0);
+    mov(dword[rcx + kRecursionCountOffset], 0);
+    xor_(eax, eax);
+    mov(r8d, -1);
+    lock();
+    cmpxchg(dword[rcx + kLockCountOffset], r8d);
+    je(done, CodeGenerator::T_NEAR);
+    // A waiter came in the meantime - still locked, so restore the ownership
+    // for the kernel to release it.
+    mov(dword[rcx + kOwningThreadOffset], edx);
+    mov(dword[rcx + kRecursionCountOffset], xe::byte_swap(uint32_t(1)));
+  }
+  L(slow_path);
+  return true;
+}
+
 void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
+  // Kernel code may run guest code (APCs and such) that changes it.
+  InvalidateRoundingMode();
   bool undefined = true;
   if (function->behavior() == Function::Behavior::kBuiltin) {
     auto builtin_function = static_cast<const BuiltinFunction*>(function);
@@ -495,7 +874,9 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
       // rdx = arg0
       // r8  = arg1
       // r9  = arg2
-      auto thunk = backend()->guest_to_host_thunk();
+      // The arguments are host objects that only live in this process.
+      MarkNotRelocatable();
+      auto thunk = backend()->extern_call_thunk();
       mov(rax, reinterpret_cast<uint64_t>(thunk));
       mov(rcx, reinterpret_cast<uint64_t>(builtin_function->handler()));
       mov(rdx, reinterpret_cast<uint64_t>(builtin_function->arg0()));
@@ -507,20 +888,30 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
     auto extern_function = static_cast<const GuestFunction*>(function);
     if (extern_function->extern_handler()) {
       undefined = false;
+      Xbyak::Label done;
+      bool has_fast_path = cvars::inline_critical_sections &&
+                           extern_function->export_data() &&
+                           EmitCriticalSectionFastPath(
+                               extern_function->export_data(), done);
       // rcx = target function
       // rdx = arg0
       // r8  = arg1
       // r9  = arg2
-      auto thunk = backend()->guest_to_host_thunk();
+      auto thunk = backend()->extern_call_thunk();
       mov(rax, reinterpret_cast<uint64_t>(thunk));
-      mov(rcx, reinterpret_cast<uint64_t>(extern_function->extern_handler()));
+      MovHostImageAddress(
+          rcx, reinterpret_cast<void*>(extern_function->extern_handler()));
       mov(rdx,
           qword[GetContextReg() + offsetof(ppc::PPCContext, kernel_state)]);
       call(rax);
       // rax = host return
+      if (has_fast_path) {
+        L(done);
+      }
     }
   }
   if (undefined) {
+    MarkNotRelocatable();
     CallNative(UndefinedCallExtern, reinterpret_cast<uint64_t>(function));
   }
 }
@@ -548,16 +939,47 @@ void X64Emitter::CallNativeSafe(void* fn) {
   // r9  = arg2
   auto thunk = backend()->guest_to_host_thunk();
   mov(rax, reinterpret_cast<uint64_t>(thunk));
-  mov(rcx, reinterpret_cast<uint64_t>(fn));
+  MovHostImageAddress(rcx, fn);
   call(rax);
   // rax = host return
 }
 
+void X64Emitter::MovHostImageAddress(const Xbyak::Reg64& reg,
+                                     const void* address) {
+  // Always use the full movabs encoding so the immediate can be patched
+  // regardless of the value it's rebased to.
+  int idx = reg.getIdx();
+  db(0x48 | (idx >> 3));
+  db(0xB8 | (idx & 7));
+  host_relocations_.push_back(uint32_t(getSize()));
+  dq(reinterpret_cast<uint64_t>(address));
+}
+
 void X64Emitter::SetReturnAddress(uint64_t value) {
   mov(rax, value);
   mov(qword[rsp + StackLayout::GUEST_CALL_RET_ADDR], rax);
 }
 
+bool X64Emitter::ChangeRoundingMode(const hir::Value* fpscr) {
+  if (fpscr->IsConstant()) {
+    uint32_t mode = fpscr->constant.u32 & 0x7;
+    if (rounding_mode_known_ && !rounding_mode_value_ &&
+        rounding_mode_ == mode) {
+      return false;
+    }
+    rounding_mode_value_ = nullptr;
+    rounding_mode_ = mode;
+  } else {
+    // Values are only defined once, so the same value is the same mode.
+    if (rounding_mode_known_ && rounding_mode_value_ == fpscr) {
+      return false;
+    }
+    rounding_mode_value_ = fpscr;
+  }
+  rounding_mode_known_ = true;
+  return true;
+}
+
 Xbyak::Reg64 X64Emitter::GetNativeParam(uint32_t param) {
   if (param == 0)
     return rdx;
@@ -739,7 +1161,9 @@ static const vec128_t xmm_consts[] = {
     /* XMMIntMaxPD            */ vec128d(INT_MAX),
     /* XMMPosIntMinPS         */ vec128f((float)0x80000000u),
     /* XMMQNaN                */ vec128i(0x7FC00000u),
-    /* XMMOneDouble           */ vec128d(1.0)
+    /* XMMOneDouble           */ vec128d(1.0),
+    /* XMMShiftMaskI8         */ vec128b(0x07),
+    /* XMMShiftMaskI16        */ vec128s(0x000F)
 };
 
 // First location to try and place constants.
@@ -10,6 +10,8 @@
 #ifndef XENIA_CPU_BACKEND_X64_X64_EMITTER_H_
 #define XENIA_CPU_BACKEND_X64_X64_EMITTER_H_
 
+#include <functional>
+#include <list>
 #include <vector>
 
 #include "xenia/base/arena.h"
@@ -27,6 +29,7 @@
 
 namespace xe {
 namespace cpu {
+class Export;
 class Processor;
 }  // namespace cpu
 }  // namespace xe
@@ -114,7 +117,9 @@ enum XmmConst {
   XMMIntMaxPD,
   XMMPosIntMinPS,
   XMMQNaN,
-  XMMOneDouble
+  XMMOneDouble,
+  XMMShiftMaskI8,
+  XMMShiftMaskI16
 };
 
 // Unfortunately due to the design of xbyak we have to pass this to the ctor.
@@ -130,6 +135,17 @@ enum X64EmitterFeatureFlags {
   kX64EmitBMI2 = 1 << 4,
   kX64EmitF16C = 1 << 5,
   kX64EmitMovbe = 1 << 6,
+  kX64EmitAVX512F = 1 << 7,
+  kX64EmitAVX512VL = 1 << 8,
+  kX64EmitAVX512BW = 1 << 9,
+  kX64EmitAVX512DQ = 1 << 10,
+  kX64EmitAVX512VBMI = 1 << 11,
+
+  // Combined flags - the VL variants are required to use the 128/256-bit
+  // forms of the AVX-512 instructions on xmm/ymm registers.
+  kX64EmitAVX512Ortho = kX64EmitAVX512F | kX64EmitAVX512VL,
+  kX64EmitAVX512BWVL = kX64EmitAVX512BW | kX64EmitAVX512VL,
+  kX64EmitAVX512VBMIVL = kX64EmitAVX512VBMI | kX64EmitAVX512VL,
 };
 
 class X64Emitter : public Xbyak::CodeGenerator {
@@ -181,14 +197,44 @@ class X64Emitter : public Xbyak::CodeGenerator {
   Xbyak::Label& epilog_label() { return *epilog_label_; }
 
   void MarkSourceOffset(const hir::Instr* i);
+  // Guest address of the last source offset marked.
+  uint32_t current_guest_address() const { return current_guest_address_; }
+
+  // Code of a rarely taken path, emitted out of line after the epilog so it
+  // doesn't take up instruction cache lines between the hot instructions.
+  // Branch to entry and bind resume where the code should continue. Data
+  // referenced by the code can be placed there too, with resumes cleared.
+  struct ColdCode {
+    Xbyak::Label entry;
+    Xbyak::Label resume;
+    std::function<void()> emit;
+    bool resumes = true;
+  };
+  ColdCode& AddColdCode(std::function<void()> emit);
 
   void DebugBreak();
-  void Trap(uint16_t trap_type = 0);
+  // Calls the handler of a guest trap at guest_address rather than raising a
+  // host exception, so titles trapping often keep running.
+  void Trap(uint16_t trap_type, uint32_t guest_address);
   void UnimplementedInstr(const hir::Instr* i);
 
   void Call(const hir::Instr* instr, GuestFunction* function);
   void CallIndirect(const hir::Instr* instr, const Xbyak::Reg64& reg);
+  // Emits the slots of a polymorphic inline cache comparing the target guest
+  // address in ebx against the functions the branch went to before, falling
+  // through to the generic dispatch if none match. done is where non-tail
+  // calls continue after returning.
+  void EmitIndirectBranchInlineCache(const hir::Instr* instr,
+                                     Xbyak::Label& done);
   void CallExtern(const hir::Instr* instr, const Function* function);
+  // Emits the uncontended paths of critical section exports, jumping to done
+  // if they were taken, falling through to the call otherwise. Returns false
+  // if the export doesn't have a fast path.
+  bool EmitCriticalSectionFastPath(const Export* export_data,
+                                   Xbyak::Label& done);
+  // Converts a guest address in the lower 32 bits of the register to a host
+  // address, clobbering eax.
+  void EmitGuestToHostAddress(const Xbyak::Reg64& reg);
   void CallNative(void* fn);
   void CallNative(uint64_t (*fn)(void* raw_context));
   void CallNative(uint64_t (*fn)(void* raw_context, uint64_t arg0));
@@ -197,6 +243,21 @@ class X64Emitter : public Xbyak::CodeGenerator {
   void CallNativeSafe(void* fn);
   void SetReturnAddress(uint64_t value);
 
+  // Records that the MXCSR rounding mode is being set from the FPSCR value.
+  // Returns false if it's already set from the same value (or constant) in
+  // the current block, in which case the switch can be skipped.
+  bool ChangeRoundingMode(const hir::Value* fpscr);
+  // Forgets the rounding mode, at block entry and after anything that may
+  // have changed it.
+  void InvalidateRoundingMode() { rounding_mode_known_ = false; }
+
+  // Moves an address within the host image (helper function or static table)
+  // into the register, recording it so the code can be stored and rebased.
+  void MovHostImageAddress(const Xbyak::Reg64& reg, const void* address);
+  // Marks the function being emitted as referencing host data that can't be
+  // rebased (heap objects and such), so it won't be stored.
+  void MarkNotRelocatable() { code_relocatable_ = false; }
+
   Xbyak::Reg64 GetNativeParam(uint32_t param);
 
   Xbyak::Reg64 GetContextReg();
@@ -219,8 +280,9 @@ class X64Emitter : public Xbyak::CodeGenerator {
   Xbyak::Address StashConstantXmm(int index, double v);
   Xbyak::Address StashConstantXmm(int index, const vec128_t& v);
 
+  uint32_t feature_flags() const { return feature_flags_; }
   bool IsFeatureEnabled(uint32_t feature_flag) const {
-    return (feature_flags_ & feature_flag) != 0;
+    return (feature_flags_ & feature_flag) == feature_flag;
   }
 
   FunctionDebugInfo* debug_info() const { return debug_info_; }
@@ -249,10 +311,26 @@ class X64Emitter : public Xbyak::CodeGenerator {
   FunctionDebugInfo* debug_info_ = nullptr;
   uint32_t debug_info_flags_ = 0;
   FunctionTraceData* trace_data_ = nullptr;
+  // Function whose baseline tier is being emitted, if any.
+  GuestFunction* tier_up_function_ = nullptr;
   Arena source_map_arena_;
+  uint32_t current_guest_address_ = 0;
 
   size_t stack_size_ = 0;
 
+  bool rounding_mode_known_ = false;
+  // Value the rounding mode was set from, or null if it was a constant.
+  const hir::Value* rounding_mode_value_ = nullptr;
+  uint32_t rounding_mode_ = 0;
+
+  // Code offsets of 64-bit host image address immediates in the function.
+  std::vector<uint32_t> host_relocations_;
+  bool code_relocatable_ = true;
+  // Guest calls that the code cache links directly to their callees.
+  std::vector<GuestCallSite> guest_call_sites_;
+  // A list rather than a vector as labels can't be moved once referenced.
+  std::list<ColdCode> cold_code_;
+
   static const uint32_t gpr_reg_map_[GPR_COUNT];
   static const uint32_t xmm_reg_map_[XMM_COUNT];
 };
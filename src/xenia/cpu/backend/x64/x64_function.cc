@@ -25,9 +25,16 @@ X64Function::~X64Function() {
   // machine_code_ is freed by code cache.
 }
 
-void X64Function::Setup(uint8_t* machine_code, size_t machine_code_length) {
-  machine_code_ = machine_code;
+void X64Function::Setup(uint8_t* machine_code, size_t machine_code_length,
+                        std::vector<SourceMapEntry> source_map) {
+  std::lock_guard<std::mutex> lock(machine_code_lock_);
+  if (machine_code_) {
+    retired_machine_code_.push_back(
+        {machine_code_, machine_code_length_, std::move(source_map_)});
+  }
+  source_map_ = std::move(source_map);
   machine_code_length_ = machine_code_length;
+  machine_code_ = machine_code;
 }
 
 bool X64Function::CallImpl(ThreadState* thread_state, uint32_t return_address) {
@@ -10,6 +10,9 @@
 #ifndef XENIA_CPU_BACKEND_X64_X64_FUNCTION_H_
 #define XENIA_CPU_BACKEND_X64_X64_FUNCTION_H_
 
+#include <atomic>
+#include <vector>
+
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/thread_state.h"
 
@@ -26,13 +29,16 @@ class X64Function : public GuestFunction {
   uint8_t* machine_code() const override { return machine_code_; }
   size_t machine_code_length() const override { return machine_code_length_; }
 
-  void Setup(uint8_t* machine_code, size_t machine_code_length);
+  // Replaces the machine code and its source map, keeping the previous ones
+  // as retired while threads may still be running the code.
+  void Setup(uint8_t* machine_code, size_t machine_code_length,
+             std::vector<SourceMapEntry> source_map);
 
  protected:
   bool CallImpl(ThreadState* thread_state, uint32_t return_address) override;
 
  private:
-  uint8_t* machine_code_ = nullptr;
+  std::atomic<uint8_t*> machine_code_ = nullptr;
   size_t machine_code_length_ = 0;
 };
 
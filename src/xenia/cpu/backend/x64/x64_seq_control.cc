@@ -20,58 +20,131 @@ namespace backend {
 namespace x64 {
 
 volatile int anchor_control = 0;
+// x86 condition codes in encoding order, so flipping the lowest bit inverts
+// the condition.
+enum FlagsCondition {
+  kConditionB = 2,
+  kConditionAE = 3,
+  kConditionE = 4,
+  kConditionNE = 5,
+  kConditionBE = 6,
+  kConditionA = 7,
+  kConditionL = 12,
+  kConditionGE = 13,
+  kConditionLE = 14,
+  kConditionG = 15,
+};
+
+// Gets the condition the flags left by the sequence of the instruction satisfy
+// when its result is true.
+static bool GetFlagsCondition(const hir::Instr* instr, int* out_condition) {
+  auto src1 = instr->src1.value;
+  bool is_float = src1->type == hir::FLOAT32_TYPE ||
+                  src1->type == hir::FLOAT64_TYPE;
+  // Integer compares with a constant first operand compare the operands
+  // swapped. Float ones set the flags like unsigned compares.
+  bool swapped = !is_float && src1->IsConstant();
+  switch (instr->opcode->num) {
+    case OPCODE_IS_TRUE:
+      *out_condition = kConditionNE;
+      return true;
+    case OPCODE_IS_FALSE:
+      *out_condition = kConditionE;
+      return true;
+    case OPCODE_COMPARE_EQ:
+      *out_condition = kConditionE;
+      return true;
+    case OPCODE_COMPARE_NE:
+      *out_condition = kConditionNE;
+      return true;
+    case OPCODE_COMPARE_SLT:
+      *out_condition =
+          is_float ? kConditionB : (swapped ? kConditionG : kConditionL);
+      return true;
+    case OPCODE_COMPARE_SLE:
+      *out_condition =
+          is_float ? kConditionBE : (swapped ? kConditionGE : kConditionLE);
+      return true;
+    case OPCODE_COMPARE_SGT:
+      *out_condition =
+          is_float ? kConditionA : (swapped ? kConditionL : kConditionG);
+      return true;
+    case OPCODE_COMPARE_SGE:
+      *out_condition =
+          is_float ? kConditionAE : (swapped ? kConditionLE : kConditionGE);
+      return true;
+    case OPCODE_COMPARE_ULT:
+      *out_condition = swapped ? kConditionA : kConditionB;
+      return true;
+    case OPCODE_COMPARE_ULE:
+      *out_condition = swapped ? kConditionAE : kConditionBE;
+      return true;
+    case OPCODE_COMPARE_UGT:
+      *out_condition = swapped ? kConditionB : kConditionA;
+      return true;
+    case OPCODE_COMPARE_UGE:
+      *out_condition = swapped ? kConditionBE : kConditionAE;
+      return true;
+    default:
+      return false;
+  }
+}
+
+static void EmitConditionalJump(X64Emitter& e, int condition,
+                                const char* label) {
+  switch (condition) {
+    case kConditionB:
+      e.jb(label, e.T_NEAR);
+      break;
+    case kConditionAE:
+      e.jae(label, e.T_NEAR);
+      break;
+    case kConditionE:
+      e.je(label, e.T_NEAR);
+      break;
+    case kConditionNE:
+      e.jne(label, e.T_NEAR);
+      break;
+    case kConditionBE:
+      e.jbe(label, e.T_NEAR);
+      break;
+    case kConditionA:
+      e.ja(label, e.T_NEAR);
+      break;
+    case kConditionL:
+      e.jl(label, e.T_NEAR);
+      break;
+    case kConditionGE:
+      e.jge(label, e.T_NEAR);
+      break;
+    case kConditionLE:
+      e.jle(label, e.T_NEAR);
+      break;
+    case kConditionG:
+      e.jg(label, e.T_NEAR);
+      break;
+    default:
+      assert_unhandled_case(condition);
+      break;
+  }
+}
+
+// Branches on the flags of the instruction defining the condition if it's
+// right before the branch (ConditionSinkingPass moves compares there), or
+// tests the condition otherwise.
 template <typename T>
-static void EmitFusedBranch(X64Emitter& e, const T& i) {
-  bool valid = i.instr->prev && i.instr->prev->dest == i.src1.value;
-  auto opcode = valid ? i.instr->prev->opcode->num : -1;
-  if (valid) {
-    auto name = i.src2.value->name;
-    switch (opcode) {
-      case OPCODE_IS_TRUE:
-        e.jnz(name, e.T_NEAR);
-        break;
-      case OPCODE_IS_FALSE:
-        e.jz(name, e.T_NEAR);
-        break;
-      case OPCODE_COMPARE_EQ:
-        e.je(name, e.T_NEAR);
-        break;
-      case OPCODE_COMPARE_NE:
-        e.jne(name, e.T_NEAR);
-        break;
-      case OPCODE_COMPARE_SLT:
-        e.jl(name, e.T_NEAR);
-        break;
-      case OPCODE_COMPARE_SLE:
-        e.jle(name, e.T_NEAR);
-        break;
-      case OPCODE_COMPARE_SGT:
-        e.jg(name, e.T_NEAR);
-        break;
-      case OPCODE_COMPARE_SGE:
-        e.jge(name, e.T_NEAR);
-        break;
-      case OPCODE_COMPARE_ULT:
-        e.jb(name, e.T_NEAR);
-        break;
-      case OPCODE_COMPARE_ULE:
-        e.jbe(name, e.T_NEAR);
-        break;
-      case OPCODE_COMPARE_UGT:
-        e.ja(name, e.T_NEAR);
-        break;
-      case OPCODE_COMPARE_UGE:
-        e.jae(name, e.T_NEAR);
-        break;
-      default:
-        e.test(i.src1, i.src1);
-        e.jnz(name, e.T_NEAR);
-        break;
-    }
-  } else {
+static void EmitFusedBranch(X64Emitter& e, const T& i, bool on_true) {
+  auto prev = i.instr->prev;
+  int condition;
+  if (!prev || prev->dest != i.src1.value ||
+      !GetFlagsCondition(prev, &condition)) {
     e.test(i.src1, i.src1);
-    e.jnz(i.src2.value->name, e.T_NEAR);
+    condition = kConditionNE;
+  }
+  if (!on_true) {
+    condition ^= 1;
   }
+  EmitConditionalJump(e, condition, i.src2.value->name);
 }
 // ============================================================================
 // OPCODE_DEBUG_BREAK
@@ -159,7 +232,7 @@ EMITTER_OPCODE_TABLE(OPCODE_DEBUG_BREAK_TRUE, DEBUG_BREAK_TRUE_I8,
 // ============================================================================
 struct TRAP : Sequence<TRAP, I<OPCODE_TRAP, VoidOp>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    e.Trap(i.instr->flags);
+    e.Trap(i.instr->flags, e.current_guest_address());
   }
 };
 EMITTER_OPCODE_TABLE(OPCODE_TRAP, TRAP);
@@ -167,64 +240,57 @@ EMITTER_OPCODE_TABLE(OPCODE_TRAP, TRAP);
 // ============================================================================
 // OPCODE_TRAP_TRUE
 // ============================================================================
+// Traps are rarely taken, so they're emitted out of line. The zero flag must
+// be clear for the trap to be taken.
+static void EmitTrapIfTrue(X64Emitter& e, uint16_t trap_type) {
+  // The cold code is emitted after the function, so the address of the trap
+  // has to be taken now.
+  uint32_t guest_address = e.current_guest_address();
+  X64Emitter::ColdCode& trap = e.AddColdCode(
+      [&e, trap_type, guest_address]() { e.Trap(trap_type, guest_address); });
+  e.jnz(trap.entry, e.T_NEAR);
+  e.L(trap.resume);
+}
 struct TRAP_TRUE_I8
     : Sequence<TRAP_TRUE_I8, I<OPCODE_TRAP_TRUE, VoidOp, I8Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     e.test(i.src1, i.src1);
-    Xbyak::Label skip;
-    e.jz(skip);
-    e.Trap(i.instr->flags);
-    e.L(skip);
+    EmitTrapIfTrue(e, i.instr->flags);
   }
 };
 struct TRAP_TRUE_I16
     : Sequence<TRAP_TRUE_I16, I<OPCODE_TRAP_TRUE, VoidOp, I16Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     e.test(i.src1, i.src1);
-    Xbyak::Label skip;
-    e.jz(skip);
-    e.Trap(i.instr->flags);
-    e.L(skip);
+    EmitTrapIfTrue(e, i.instr->flags);
   }
 };
 struct TRAP_TRUE_I32
     : Sequence<TRAP_TRUE_I32, I<OPCODE_TRAP_TRUE, VoidOp, I32Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     e.test(i.src1, i.src1);
-    Xbyak::Label skip;
-    e.jz(skip);
-    e.Trap(i.instr->flags);
-    e.L(skip);
+    EmitTrapIfTrue(e, i.instr->flags);
   }
 };
 struct TRAP_TRUE_I64
     : Sequence<TRAP_TRUE_I64, I<OPCODE_TRAP_TRUE, VoidOp, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     e.test(i.src1, i.src1);
-    Xbyak::Label skip;
-    e.jz(skip);
-    e.Trap(i.instr->flags);
-    e.L(skip);
+    EmitTrapIfTrue(e, i.instr->flags);
   }
 };
 struct TRAP_TRUE_F32
     : Sequence<TRAP_TRUE_F32, I<OPCODE_TRAP_TRUE, VoidOp, F32Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     e.vptest(i.src1, i.src1);
-    Xbyak::Label skip;
-    e.jz(skip);
-    e.Trap(i.instr->flags);
-    e.L(skip);
+    EmitTrapIfTrue(e, i.instr->flags);
   }
 };
 struct TRAP_TRUE_F64
     : Sequence<TRAP_TRUE_F64, I<OPCODE_TRAP_TRUE, VoidOp, F64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     e.vptest(i.src1, i.src1);
-    Xbyak::Label skip;
-    e.jz(skip);
-    e.Trap(i.instr->flags);
-    e.L(skip);
+    EmitTrapIfTrue(e, i.instr->flags);
   }
 };
 EMITTER_OPCODE_TABLE(OPCODE_TRAP_TRUE, TRAP_TRUE_I8, TRAP_TRUE_I16,
@@ -502,25 +568,25 @@ EMITTER_OPCODE_TABLE(OPCODE_BRANCH, BRANCH);
 struct BRANCH_TRUE_I8
     : Sequence<BRANCH_TRUE_I8, I<OPCODE_BRANCH_TRUE, VoidOp, I8Op, LabelOp>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    EmitFusedBranch(e, i);
+    EmitFusedBranch(e, i, true);
   }
 };
 struct BRANCH_TRUE_I16
     : Sequence<BRANCH_TRUE_I16, I<OPCODE_BRANCH_TRUE, VoidOp, I16Op, LabelOp>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    EmitFusedBranch(e, i);
+    EmitFusedBranch(e, i, true);
   }
 };
 struct BRANCH_TRUE_I32
     : Sequence<BRANCH_TRUE_I32, I<OPCODE_BRANCH_TRUE, VoidOp, I32Op, LabelOp>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    EmitFusedBranch(e, i);
+    EmitFusedBranch(e, i, true);
   }
 };
 struct BRANCH_TRUE_I64
     : Sequence<BRANCH_TRUE_I64, I<OPCODE_BRANCH_TRUE, VoidOp, I64Op, LabelOp>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    EmitFusedBranch(e, i);
+    EmitFusedBranch(e, i, true);
   }
 };
 struct BRANCH_TRUE_F32
@@ -565,32 +631,28 @@ EMITTER_OPCODE_TABLE(OPCODE_BRANCH_TRUE, BRANCH_TRUE_I8, BRANCH_TRUE_I16,
 struct BRANCH_FALSE_I8
     : Sequence<BRANCH_FALSE_I8, I<OPCODE_BRANCH_FALSE, VoidOp, I8Op, LabelOp>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    e.test(i.src1, i.src1);
-    e.jz(i.src2.value->name, e.T_NEAR);
+    EmitFusedBranch(e, i, false);
   }
 };
 struct BRANCH_FALSE_I16
     : Sequence<BRANCH_FALSE_I16,
                I<OPCODE_BRANCH_FALSE, VoidOp, I16Op, LabelOp>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    e.test(i.src1, i.src1);
-    e.jz(i.src2.value->name, e.T_NEAR);
+    EmitFusedBranch(e, i, false);
   }
 };
 struct BRANCH_FALSE_I32
     : Sequence<BRANCH_FALSE_I32,
                I<OPCODE_BRANCH_FALSE, VoidOp, I32Op, LabelOp>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    e.test(i.src1, i.src1);
-    e.jz(i.src2.value->name, e.T_NEAR);
+    EmitFusedBranch(e, i, false);
   }
 };
 struct BRANCH_FALSE_I64
     : Sequence<BRANCH_FALSE_I64,
                I<OPCODE_BRANCH_FALSE, VoidOp, I64Op, LabelOp>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    e.test(i.src1, i.src1);
-    e.jz(i.src2.value->name, e.T_NEAR);
+    EmitFusedBranch(e, i, false);
   }
 };
 struct BRANCH_FALSE_F32
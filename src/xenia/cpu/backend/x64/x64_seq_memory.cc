@@ -15,6 +15,8 @@
 #include "xenia/base/memory.h"
 #include "xenia/cpu/backend/x64/x64_op.h"
 #include "xenia/cpu/backend/x64/x64_tracers.h"
+#include "xenia/cpu/mmio_handler.h"
+#include "xenia/cpu/ppc/ppc_context.h"
 
 namespace xe {
 namespace cpu {
@@ -103,6 +105,87 @@ RegExp ComputeMemoryAddress(X64Emitter& e, const T& guest) {
   }
 }
 
+// ============================================================================
+// Checked MMIO accesses
+// ============================================================================
+// 32-bit loads/stores marked with LOAD_STORE_CHECK_MMIO have trapped on MMIO
+// before. Addresses within the MMIO window go to the MMIO handler directly
+// rather than through the access violation, everything else is accessed
+// inline as usual.
+static uint64_t LoadCheckedMMIOI32(void* raw_context, uint64_t address) {
+  auto guest_address = static_cast<uint32_t>(address);
+  uint32_t value;
+  auto mmio_handler = MMIOHandler::global_handler();
+  if (mmio_handler && mmio_handler->CheckLoad(guest_address, &value)) {
+    return value;
+  }
+  auto context = reinterpret_cast<ppc::PPCContext*>(raw_context);
+  return xe::load_and_swap<uint32_t>(context->virtual_membase + guest_address);
+}
+
+static uint64_t StoreCheckedMMIOI32(void* raw_context, uint64_t address,
+                                    uint64_t value) {
+  auto guest_address = static_cast<uint32_t>(address);
+  auto mmio_handler = MMIOHandler::global_handler();
+  if (mmio_handler &&
+      mmio_handler->CheckStore(guest_address, static_cast<uint32_t>(value))) {
+    return 0;
+  }
+  auto context = reinterpret_cast<ppc::PPCContext*>(raw_context);
+  xe::store_and_swap<uint32_t>(context->virtual_membase + guest_address,
+                               static_cast<uint32_t>(value));
+  return 0;
+}
+
+// Expects the guest address (without offset) in rax, as left behind by
+// ComputeMemoryAddress(Offset). Jumps to not_mmio if it's outside the MMIO
+// window, otherwise leaves the full guest address in
+// GetNativeParam(0).
+static void EmitMMIOWindowCheck(X64Emitter& e, int32_t offset,
+                                Xbyak::Label& not_mmio) {
+  e.lea(e.GetNativeParam(0).cvt32(), e.ptr[e.rax + offset]);
+  e.lea(e.ecx, e.ptr[e.GetNativeParam(0) - int32_t(kMMIOWindowBase)]);
+  e.cmp(e.ecx, kMMIOWindowSize);
+  e.jae(not_mmio, CodeGenerator::T_NEAR);
+}
+
+template <typename T>
+static void EmitCheckedMMIOLoadI32(X64Emitter& e, uint32_t flags,
+                                   const T& dest, int32_t offset,
+                                   Xbyak::Label& not_mmio,
+                                   Xbyak::Label& done) {
+  EmitMMIOWindowCheck(e, offset, not_mmio);
+  e.CallNativeSafe(reinterpret_cast<void*>(LoadCheckedMMIOI32));
+  // The handler returns the value in guest byte order.
+  if (!(flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP)) {
+    e.bswap(e.eax);
+  }
+  e.mov(dest, e.eax);
+  e.jmp(done, CodeGenerator::T_NEAR);
+}
+
+template <typename T>
+static void EmitCheckedMMIOStoreI32(X64Emitter& e, uint32_t flags,
+                                    const T& value, int32_t offset,
+                                    Xbyak::Label& not_mmio,
+                                    Xbyak::Label& done) {
+  EmitMMIOWindowCheck(e, offset, not_mmio);
+  // The handler takes the value in guest byte order.
+  bool byte_swap = (flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) != 0;
+  if (value.is_constant) {
+    uint32_t constant = static_cast<uint32_t>(value.constant());
+    e.mov(e.GetNativeParam(1).cvt32(),
+          byte_swap ? constant : xe::byte_swap(constant));
+  } else {
+    e.mov(e.GetNativeParam(1).cvt32(), value);
+    if (!byte_swap) {
+      e.bswap(e.GetNativeParam(1).cvt32());
+    }
+  }
+  e.CallNativeSafe(reinterpret_cast<void*>(StoreCheckedMMIOI32));
+  e.jmp(done, CodeGenerator::T_NEAR);
+}
+
 // ============================================================================
 // OPCODE_ATOMIC_EXCHANGE
 // ============================================================================
@@ -556,6 +639,7 @@ struct LOAD_MMIO_I32
     // uint64_t (context, addr)
     auto mmio_range = reinterpret_cast<MMIORange*>(i.src1.value);
     auto read_address = uint32_t(i.src2.value);
+    e.MarkNotRelocatable();
     e.mov(e.GetNativeParam(0), uint64_t(mmio_range->callback_context));
     e.mov(e.GetNativeParam(1).cvt32(), read_address);
     e.CallNativeSafe(reinterpret_cast<void*>(mmio_range->read));
@@ -581,6 +665,7 @@ struct STORE_MMIO_I32
     // void (context, addr, value)
     auto mmio_range = reinterpret_cast<MMIORange*>(i.src1.value);
     auto write_address = uint32_t(i.src2.value);
+    e.MarkNotRelocatable();
     e.mov(e.GetNativeParam(0), uint64_t(mmio_range->callback_context));
     e.mov(e.GetNativeParam(1).cvt32(), write_address);
     if (i.src3.is_constant) {
@@ -635,6 +720,16 @@ struct LOAD_OFFSET_I32
     : Sequence<LOAD_OFFSET_I32, I<OPCODE_LOAD_OFFSET, I32Op, I64Op, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddressOffset(e, i.src1, i.src2);
+    Xbyak::Label not_mmio, done;
+    bool check_mmio =
+        (i.instr->flags & LoadStoreFlags::LOAD_STORE_CHECK_MMIO) &&
+        !i.src1.is_constant;
+    if (check_mmio) {
+      EmitCheckedMMIOLoadI32(e, i.instr->flags, i.dest,
+                             static_cast<int32_t>(i.src2.constant()), not_mmio,
+                             done);
+      e.L(not_mmio);
+    }
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
       if (e.IsFeatureEnabled(kX64EmitMovbe)) {
         e.movbe(i.dest, e.dword[addr]);
@@ -645,6 +740,9 @@ struct LOAD_OFFSET_I32
     } else {
       e.mov(i.dest, e.dword[addr]);
     }
+    if (check_mmio) {
+      e.L(done);
+    }
   }
 };
 
@@ -710,6 +808,16 @@ struct STORE_OFFSET_I32
                I<OPCODE_STORE_OFFSET, VoidOp, I64Op, I64Op, I32Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddressOffset(e, i.src1, i.src2);
+    Xbyak::Label not_mmio, done;
+    bool check_mmio =
+        (i.instr->flags & LoadStoreFlags::LOAD_STORE_CHECK_MMIO) &&
+        !i.src1.is_constant;
+    if (check_mmio) {
+      EmitCheckedMMIOStoreI32(e, i.instr->flags, i.src3,
+                              static_cast<int32_t>(i.src2.constant()),
+                              not_mmio, done);
+      e.L(not_mmio);
+    }
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
       assert_false(i.src3.is_constant);
       if (e.IsFeatureEnabled(kX64EmitMovbe)) {
@@ -724,6 +832,9 @@ struct STORE_OFFSET_I32
         e.mov(e.dword[addr], i.src3);
       }
     }
+    if (check_mmio) {
+      e.L(done);
+    }
   }
 };
 
@@ -788,6 +899,14 @@ struct LOAD_I16 : Sequence<LOAD_I16, I<OPCODE_LOAD, I16Op, I64Op>> {
 struct LOAD_I32 : Sequence<LOAD_I32, I<OPCODE_LOAD, I32Op, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddress(e, i.src1);
+    Xbyak::Label not_mmio, done;
+    bool check_mmio =
+        (i.instr->flags & LoadStoreFlags::LOAD_STORE_CHECK_MMIO) &&
+        !i.src1.is_constant;
+    if (check_mmio) {
+      EmitCheckedMMIOLoadI32(e, i.instr->flags, i.dest, 0, not_mmio, done);
+      e.L(not_mmio);
+    }
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
       if (e.IsFeatureEnabled(kX64EmitMovbe)) {
         e.movbe(i.dest, e.dword[addr]);
@@ -798,6 +917,9 @@ struct LOAD_I32 : Sequence<LOAD_I32, I<OPCODE_LOAD, I32Op, I64Op>> {
     } else {
       e.mov(i.dest, e.dword[addr]);
     }
+    if (check_mmio) {
+      e.L(done);
+    }
     if (IsTracingData()) {
       e.mov(e.GetNativeParam(1).cvt32(), i.dest);
       e.lea(e.GetNativeParam(0), e.ptr[addr]);
@@ -920,6 +1042,14 @@ struct STORE_I16 : Sequence<STORE_I16, I<OPCODE_STORE, VoidOp, I64Op, I16Op>> {
 struct STORE_I32 : Sequence<STORE_I32, I<OPCODE_STORE, VoidOp, I64Op, I32Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddress(e, i.src1);
+    Xbyak::Label not_mmio, done;
+    bool check_mmio =
+        (i.instr->flags & LoadStoreFlags::LOAD_STORE_CHECK_MMIO) &&
+        !i.src1.is_constant;
+    if (check_mmio) {
+      EmitCheckedMMIOStoreI32(e, i.instr->flags, i.src2, 0, not_mmio, done);
+      e.L(not_mmio);
+    }
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
       assert_false(i.src2.is_constant);
       if (e.IsFeatureEnabled(kX64EmitMovbe)) {
@@ -934,6 +1064,9 @@ struct STORE_I32 : Sequence<STORE_I32, I<OPCODE_STORE, VoidOp, I64Op, I32Op>> {
         e.mov(e.dword[addr], i.src2);
       }
     }
+    if (check_mmio) {
+      e.L(done);
+    }
     if (IsTracingData()) {
       addr = ComputeMemoryAddress(e, i.src1);
       e.mov(e.GetNativeParam(1).cvt32(), e.dword[addr]);
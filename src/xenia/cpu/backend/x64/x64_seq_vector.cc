@@ -667,6 +667,137 @@ struct VECTOR_SUB
 };
 EMITTER_OPCODE_TABLE(OPCODE_VECTOR_SUB, VECTOR_SUB);
 
+// ============================================================================
+// Variable 8/16-bit vector shifts
+// ============================================================================
+// x86 only has per-lane variable shifts for 16-bit lanes with AVX-512BW and
+// for 32-bit lanes with AVX2, so narrower lanes are widened, shifted and then
+// narrowed again. Counts are masked to the lane width like the guest does.
+enum VectorShiftKind {
+  kVectorShiftLeft,
+  kVectorShiftRightLogical,
+  kVectorShiftRightArithmetic,
+};
+
+static void EmitVariableShiftWords(X64Emitter& e, const Xmm& dest,
+                                   const Xmm& src, const Xmm& shamt,
+                                   VectorShiftKind kind) {
+  switch (kind) {
+    case kVectorShiftLeft:
+      e.vpsllvw(dest, src, shamt);
+      break;
+    case kVectorShiftRightLogical:
+      e.vpsrlvw(dest, src, shamt);
+      break;
+    case kVectorShiftRightArithmetic:
+      e.vpsravw(dest, src, shamt);
+      break;
+  }
+}
+
+static void EmitVariableShiftDwords(X64Emitter& e, const Xmm& dest,
+                                    const Xmm& src, const Xmm& shamt,
+                                    VectorShiftKind kind) {
+  switch (kind) {
+    case kVectorShiftLeft:
+      e.vpsllvd(dest, src, shamt);
+      break;
+    case kVectorShiftRightLogical:
+      e.vpsrlvd(dest, src, shamt);
+      break;
+    case kVectorShiftRightArithmetic:
+      e.vpsravd(dest, src, shamt);
+      break;
+  }
+}
+
+// Requires AVX2. src1 must already be in a register; xmm0-xmm3 are clobbered.
+static void EmitVariableShift(X64Emitter& e, const Xmm& dest, const Xmm& src1,
+                              const V128Op& src2, bool is_int8,
+                              VectorShiftKind kind) {
+  bool sign_extend = kind == kVectorShiftRightArithmetic;
+
+  // Masked shift counts in xmm3.
+  if (src2.is_constant) {
+    vec128_t masked = src2.constant();
+    if (is_int8) {
+      for (size_t n = 0; n < 16; ++n) {
+        masked.u8[n] &= 0x7;
+      }
+    } else {
+      for (size_t n = 0; n < 8; ++n) {
+        masked.u16[n] &= 0xF;
+      }
+    }
+    e.LoadConstantXmm(e.xmm3, masked);
+  } else {
+    e.vpand(e.xmm3, src2,
+            e.GetXmmConstPtr(is_int8 ? XMMShiftMaskI8 : XMMShiftMaskI16));
+  }
+
+  if (e.IsFeatureEnabled(kX64EmitAVX512BWVL)) {
+    if (!is_int8) {
+      EmitVariableShiftWords(e, dest, src1, e.xmm3, kind);
+      return;
+    }
+    // Widen to words, shift, then truncate back to bytes.
+    if (sign_extend) {
+      e.vpmovsxbw(e.ymm0, src1);
+    } else {
+      e.vpmovzxbw(e.ymm0, src1);
+    }
+    e.vpmovzxbw(e.ymm1, e.xmm3);
+    EmitVariableShiftWords(e, e.ymm0, e.ymm0, e.ymm1, kind);
+    e.vpmovwb(dest, e.ymm0);
+    e.vzeroupper();
+    return;
+  }
+
+  if (!is_int8) {
+    // Widen to dwords, shift, mask and pack back to words.
+    if (sign_extend) {
+      e.vpmovsxwd(e.ymm0, src1);
+    } else {
+      e.vpmovzxwd(e.ymm0, src1);
+    }
+    e.vpmovzxwd(e.ymm1, e.xmm3);
+    EmitVariableShiftDwords(e, e.ymm0, e.ymm0, e.ymm1, kind);
+    e.vbroadcasti128(e.ymm1, e.GetXmmConstPtr(XMMMaskEvenPI16));
+    e.vpand(e.ymm0, e.ymm0, e.ymm1);
+    e.vextracti128(e.xmm1, e.ymm0, 1);
+    e.vpackusdw(dest, e.xmm0, e.xmm1);
+    e.vzeroupper();
+    return;
+  }
+
+  // Bytes 0-7 in ymm0 and bytes 8-15 in ymm1, one per dword.
+  if (sign_extend) {
+    e.vpmovsxbd(e.ymm0, src1);
+  } else {
+    e.vpmovzxbd(e.ymm0, src1);
+  }
+  e.vpmovzxbd(e.ymm1, e.xmm3);
+  EmitVariableShiftDwords(e, e.ymm0, e.ymm0, e.ymm1, kind);
+  e.vpshufd(e.xmm2, src1, 0b11101110);
+  e.vpshufd(e.xmm3, e.xmm3, 0b11101110);
+  if (sign_extend) {
+    e.vpmovsxbd(e.ymm2, e.xmm2);
+  } else {
+    e.vpmovzxbd(e.ymm2, e.xmm2);
+  }
+  e.vpmovzxbd(e.ymm1, e.xmm3);
+  EmitVariableShiftDwords(e, e.ymm1, e.ymm2, e.ymm1, kind);
+  e.vbroadcasti128(e.ymm2, e.GetXmmConstPtr(XMMShiftByteMask));
+  e.vpand(e.ymm0, e.ymm0, e.ymm2);
+  e.vpand(e.ymm1, e.ymm1, e.ymm2);
+  // vpackusdw works per 128-bit lane, so restore the qword order after it.
+  e.vpackusdw(e.ymm0, e.ymm0, e.ymm1);
+  e.vpermq(e.ymm0, e.ymm0, 0b11011000);
+  e.vextracti128(e.xmm1, e.ymm0, 1);
+  e.vpackuswb(dest, e.xmm0, e.xmm1);
+  e.vzeroupper();
+}
+
 // ============================================================================
 // OPCODE_VECTOR_SHL
 // ============================================================================
@@ -707,7 +838,18 @@ struct VECTOR_SHL_V128
   }
 
   static void EmitInt8(X64Emitter& e, const EmitArgType& i) {
-    // TODO(benvanik): native version (with shift magic).
+    if (e.IsFeatureEnabled(kX64EmitAVX2)) {
+      Xmm src1;
+      if (i.src1.is_constant) {
+        src1 = e.xmm2;
+        e.LoadConstantXmm(src1, i.src1.constant());
+      } else {
+        src1 = i.src1;
+      }
+      EmitVariableShift(e, i.dest, src1, i.src2, true, kVectorShiftLeft);
+      return;
+    }
+
     if (i.src2.is_constant) {
       e.lea(e.GetNativeParam(1), e.StashConstantXmm(1, i.src2.constant()));
     } else {
@@ -743,6 +885,11 @@ struct VECTOR_SHL_V128
       }
     }
 
+    if (e.IsFeatureEnabled(kX64EmitAVX2)) {
+      EmitVariableShift(e, i.dest, src1, i.src2, false, kVectorShiftLeft);
+      return;
+    }
+
     // Shift 8 words in src1 by amount specified in src2.
     Xbyak::Label emu, end;
 
@@ -896,7 +1043,19 @@ struct VECTOR_SHR_V128
   }
 
   static void EmitInt8(X64Emitter& e, const EmitArgType& i) {
-    // TODO(benvanik): native version (with shift magic).
+    if (e.IsFeatureEnabled(kX64EmitAVX2)) {
+      Xmm src1;
+      if (i.src1.is_constant) {
+        src1 = e.xmm2;
+        e.LoadConstantXmm(src1, i.src1.constant());
+      } else {
+        src1 = i.src1;
+      }
+      EmitVariableShift(e, i.dest, src1, i.src2, true,
+                        kVectorShiftRightLogical);
+      return;
+    }
+
     if (i.src2.is_constant) {
       e.lea(e.GetNativeParam(1), e.StashConstantXmm(1, i.src2.constant()));
     } else {
@@ -924,6 +1083,12 @@ struct VECTOR_SHR_V128
       }
     }
 
+    if (e.IsFeatureEnabled(kX64EmitAVX2)) {
+      EmitVariableShift(e, i.dest, i.src1, i.src2, false,
+                        kVectorShiftRightLogical);
+      return;
+    }
+
     // Shift 8 words in src1 by amount specified in src2.
     Xbyak::Label emu, end;
 
@@ -1060,7 +1225,19 @@ struct VECTOR_SHA_V128
   }
 
   static void EmitInt8(X64Emitter& e, const EmitArgType& i) {
-    // TODO(benvanik): native version (with shift magic).
+    if (e.IsFeatureEnabled(kX64EmitAVX2)) {
+      Xmm src1;
+      if (i.src1.is_constant) {
+        src1 = e.xmm2;
+        e.LoadConstantXmm(src1, i.src1.constant());
+      } else {
+        src1 = i.src1;
+      }
+      EmitVariableShift(e, i.dest, src1, i.src2, true,
+                        kVectorShiftRightArithmetic);
+      return;
+    }
+
     if (i.src2.is_constant) {
       e.lea(e.GetNativeParam(1), e.StashConstantXmm(1, i.src2.constant()));
     } else {
@@ -1088,6 +1265,12 @@ struct VECTOR_SHA_V128
       }
     }
 
+    if (e.IsFeatureEnabled(kX64EmitAVX2)) {
+      EmitVariableShift(e, i.dest, i.src1, i.src2, false,
+                        kVectorShiftRightArithmetic);
+      return;
+    }
+
     // Shift 8 words in src1 by amount specified in src2.
     Xbyak::Label emu, end;
 
@@ -1206,7 +1389,7 @@ static __m128i EmulateVectorRotateLeft(void*, __m128i src1, __m128i src2) {
   return _mm_load_si128(reinterpret_cast<__m128i*>(value));
 }
 
-// TODO(benvanik): AVX512 has a native variable rotate (rolv).
+// TODO(benvanik): 8/16-bit rotates could be built from the variable shifts.
 struct VECTOR_ROTATE_LEFT_V128
     : Sequence<VECTOR_ROTATE_LEFT_V128,
                I<OPCODE_VECTOR_ROTATE_LEFT, V128Op, V128Op, V128Op>> {
@@ -1237,7 +1420,15 @@ struct VECTOR_ROTATE_LEFT_V128
         e.vmovaps(i.dest, e.xmm0);
         break;
       case INT32_TYPE: {
-        if (e.IsFeatureEnabled(kX64EmitAVX2)) {
+        if (e.IsFeatureEnabled(kX64EmitAVX512Ortho)) {
+          // vprolvd takes the counts modulo 32 itself.
+          if (i.src2.is_constant) {
+            e.LoadConstantXmm(e.xmm0, i.src2.constant());
+            e.vprolvd(i.dest, i.src1, e.xmm0);
+          } else {
+            e.vprolvd(i.dest, i.src1, i.src2);
+          }
+        } else if (e.IsFeatureEnabled(kX64EmitAVX2)) {
           Xmm temp = i.dest;
           if (i.dest == i.src1 || i.dest == i.src2) {
             temp = e.xmm2;
@@ -1476,7 +1667,7 @@ struct EXTRACT_I32
       e.mov(e.al, i.src2);
       e.and_(e.al, 0x03);
       e.shl(e.al, 4);
-      e.mov(e.rdx, reinterpret_cast<uint64_t>(extract_table_32));
+      e.MovHostImageAddress(e.rdx, extract_table_32);
       e.vmovaps(e.xmm0, e.ptr[e.rdx + e.rax]);
       e.vpshufb(e.xmm0, src1, e.xmm0);
       e.vpextrd(i.dest, e.xmm0, 0);
@@ -1666,6 +1857,29 @@ struct PERMUTE_V128
         e.vpcmpgtb(e.xmm0, e.xmm0, e.GetXmmConstPtr(XMMPermuteControl15));
         e.vpandn(i.dest, e.xmm0, i.dest);
       }
+    } else if (e.IsFeatureEnabled(kX64EmitAVX512VBMIVL)) {
+      // Two-table byte permute. vpermi2b only looks at the low 5 bits of
+      // each index, and bit 4 selects src3 just like the guest control.
+      if (i.src1.is_constant) {
+        e.LoadConstantXmm(e.xmm0, i.src1.constant());
+        e.vxorps(e.xmm0, e.xmm0, e.GetXmmConstPtr(XMMSwapWordMask));
+      } else {
+        e.vxorps(e.xmm0, i.src1, e.GetXmmConstPtr(XMMSwapWordMask));
+      }
+      Xmm src2 = e.xmm1;
+      if (i.src2.is_constant) {
+        e.LoadConstantXmm(src2, i.src2.constant());
+      } else {
+        src2 = i.src2;
+      }
+      Xmm src3 = e.xmm2;
+      if (i.src3.is_constant) {
+        e.LoadConstantXmm(src3, i.src3.constant());
+      } else {
+        src3 = i.src3;
+      }
+      e.vpermi2b(e.xmm0, src2, src3);
+      e.vmovdqa(i.dest, e.xmm0);
     } else {
       // General permute.
       // Control mask needs to be shuffled.
@@ -2021,54 +2235,33 @@ struct PACK : Sequence<PACK, I<OPCODE_PACK, V128Op, V128Op, V128Op>> {
     // Merge XZ and YW.
     e.vorps(i.dest, e.xmm0);
   }
-  static __m128i EmulatePack8_IN_16_UN_UN_SAT(void*, __m128i src1,
-                                              __m128i src2) {
-    alignas(16) uint16_t a[8];
-    alignas(16) uint16_t b[8];
-    alignas(16) uint8_t c[16];
-    _mm_store_si128(reinterpret_cast<__m128i*>(a), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(b), src2);
-    for (int i = 0; i < 8; ++i) {
-      c[i] = uint8_t(std::max(uint16_t(0), std::min(uint16_t(255), a[i])));
-      c[i + 8] = uint8_t(std::max(uint16_t(0), std::min(uint16_t(255), b[i])));
-    }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(c));
-  }
-  static __m128i EmulatePack8_IN_16_UN_UN(void*, __m128i src1, __m128i src2) {
-    alignas(16) uint8_t a[16];
-    alignas(16) uint8_t b[16];
-    alignas(16) uint8_t c[16];
-    _mm_store_si128(reinterpret_cast<__m128i*>(a), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(b), src2);
-    for (int i = 0; i < 8; ++i) {
-      c[i] = a[i * 2];
-      c[i + 8] = b[i * 2];
-    }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(c));
-  }
   static void Emit8_IN_16(X64Emitter& e, const EmitArgType& i, uint32_t flags) {
     // TODO(benvanik): handle src2 (or src1) being constant zero
     if (IsPackInUnsigned(flags)) {
       if (IsPackOutUnsigned(flags)) {
         if (IsPackOutSaturate(flags)) {
           // unsigned -> unsigned + saturate
+          // Clamp to 0xFF first - vpackuswb treats its inputs as signed.
+          Xmm src2 = i.src2.is_constant ? e.xmm1 : i.src2;
           if (i.src2.is_constant) {
-            e.lea(e.GetNativeParam(1),
-                  e.StashConstantXmm(1, i.src2.constant()));
-          } else {
-            e.lea(e.GetNativeParam(1), e.StashXmm(1, i.src2));
+            e.LoadConstantXmm(src2, i.src2.constant());
           }
-          e.lea(e.GetNativeParam(0), e.StashXmm(0, i.src1));
-          e.CallNativeSafe(
-              reinterpret_cast<void*>(EmulatePack8_IN_16_UN_UN_SAT));
-          e.vmovaps(i.dest, e.xmm0);
+          e.LoadConstantXmm(e.xmm2, vec128s(0x00FF));
+          e.vpminuw(e.xmm0, i.src1, e.xmm2);
+          e.vpminuw(e.xmm1, src2, e.xmm2);
+          e.vpackuswb(i.dest, e.xmm0, e.xmm1);
           e.vpshufb(i.dest, i.dest, e.GetXmmConstPtr(XMMByteOrderMask));
         } else {
           // unsigned -> unsigned
-          e.lea(e.GetNativeParam(1), e.StashXmm(1, i.src2));
-          e.lea(e.GetNativeParam(0), e.StashXmm(0, i.src1));
-          e.CallNativeSafe(reinterpret_cast<void*>(EmulatePack8_IN_16_UN_UN));
-          e.vmovaps(i.dest, e.xmm0);
+          // Truncate by keeping the low byte of each word.
+          Xmm src2 = i.src2.is_constant ? e.xmm1 : i.src2;
+          if (i.src2.is_constant) {
+            e.LoadConstantXmm(src2, i.src2.constant());
+          }
+          e.LoadConstantXmm(e.xmm2, vec128s(0x00FF));
+          e.vpand(e.xmm0, i.src1, e.xmm2);
+          e.vpand(e.xmm1, src2, e.xmm2);
+          e.vpackuswb(i.dest, e.xmm0, e.xmm1);
           e.vpshufb(i.dest, i.dest, e.GetXmmConstPtr(XMMByteOrderMask));
         }
       } else {
@@ -32,6 +32,7 @@
 #include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/threading.h"
+#include "xenia/cpu/backend/x64/x64_backend.h"
 #include "xenia/cpu/backend/x64/x64_emitter.h"
 #include "xenia/cpu/backend/x64/x64_op.h"
 #include "xenia/cpu/backend/x64/x64_tracers.h"
@@ -64,6 +65,7 @@ struct COMMENT : Sequence<COMMENT, I<OPCODE_COMMENT, VoidOp, OffsetOp>> {
       // TODO(benvanik): pass through.
       // TODO(benvanik): don't just leak this memory.
       auto str_copy = strdup(str);
+      e.MarkNotRelocatable();
       e.mov(e.rdx, reinterpret_cast<uint64_t>(str_copy));
       e.CallNative(reinterpret_cast<void*>(TraceString));
     }
@@ -435,6 +437,9 @@ struct LOAD_CLOCK : Sequence<LOAD_CLOCK, I<OPCODE_LOAD_CLOCK, I64Op>> {
     // here to cut extra function calls with CPU cache misses and stack frame
     // overhead.
     if (cvars::clock_no_scaling && cvars::clock_source_raw) {
+      // The ratio depends on the measured host frequency, so it's not valid
+      // in later runs.
+      e.MarkNotRelocatable();
       auto ratio = Clock::guest_tick_ratio();
       // The 360 CPU is an in-order CPU, AMD64 usually isn't. Without
       // mfence/lfence magic the rdtsc instruction can be executed sooner or
@@ -453,6 +458,19 @@ struct LOAD_CLOCK : Sequence<LOAD_CLOCK, I<OPCODE_LOAD_CLOCK, I64Op>> {
       e.mov(e.rcx, ratio.second);
       e.div(e.rcx);
       e.mov(i.dest, e.rax);
+    } else if (const Clock::GuestTickMapping* const* mapping =
+                   Clock::guest_tick_mapping()) {
+      // The same calculation as Clock::MapGuestTickCount, on the mapping
+      // currently published by the Clock class.
+      e.MovHostImageAddress(e.rcx, mapping);
+      e.mov(e.rcx, e.qword[e.rcx]);
+      e.rdtsc();
+      e.shl(e.rdx, 32);
+      e.or_(e.rax, e.rdx);
+      e.mul(e.qword[e.rcx + offsetof(Clock::GuestTickMapping, multiplier)]);
+      e.shrd(e.rax, e.rdx, 32);
+      e.add(e.rax, e.qword[e.rcx + offsetof(Clock::GuestTickMapping, offset)]);
+      e.mov(i.dest, e.rax);
     } else {
       e.CallNative(LoadClock);
       e.mov(i.dest, e.rax);
@@ -749,6 +767,23 @@ struct SELECT_V128_V128
       e.LoadConstantXmm(src3, i.src3.constant());
     }
 
+    if (e.IsFeatureEnabled(kX64EmitAVX512Ortho)) {
+      // Bitwise select in one instruction. The truth table depends on which
+      // operand the destination aliases:
+      //   0xAC = A ? C : B, 0xB8 = B ? C : A, 0xE2 = B ? A : C
+      if (i.dest == src1 || (i.dest != src2 && i.dest != src3)) {
+        if (i.dest != src1) {
+          e.vmovdqa(i.dest, src1);
+        }
+        e.vpternlogd(i.dest, src2, src3, 0xAC);
+      } else if (i.dest == src2) {
+        e.vpternlogd(i.dest, src1, src3, 0xB8);
+      } else {
+        e.vpternlogd(i.dest, src1, src2, 0xE2);
+      }
+      return;
+    }
+
     // src1 ? src2 : src3;
     e.vpandn(e.xmm3, src1, src2);
     e.vpand(i.dest, src1, src3);
@@ -2215,10 +2250,10 @@ struct MUL_ADD_V128
     : Sequence<MUL_ADD_V128,
                I<OPCODE_MUL_ADD, V128Op, V128Op, V128Op, V128Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    // TODO(benvanik): the vfmadd sequence produces slightly different results
-    // than vmul+vadd and it'd be nice to know why. Until we know, it's
-    // disabled so tests pass.
-    if (false && e.IsFeatureEnabled(kX64EmitFMA)) {
+    // FMA extension
+    // The fused form skips the rounding of the intermediate product, so its
+    // results can differ from vmul+vadd in the last bit.
+    if (cvars::use_fma_for_vmx && e.IsFeatureEnabled(kX64EmitFMA)) {
       EmitCommutativeBinaryXmmOp(e, i,
                                  [&i](X64Emitter& e, const Xmm& dest,
                                       const Xmm& src1, const Xmm& src2) {
@@ -2380,7 +2415,7 @@ struct MUL_SUB_V128
                I<OPCODE_MUL_SUB, V128Op, V128Op, V128Op, V128Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     // FMA extension
-    if (e.IsFeatureEnabled(kX64EmitFMA)) {
+    if (cvars::use_fma_for_vmx && e.IsFeatureEnabled(kX64EmitFMA)) {
       EmitCommutativeBinaryXmmOp(e, i,
                                  [&i](X64Emitter& e, const Xmm& dest,
                                       const Xmm& src1, const Xmm& src2) {
@@ -2935,6 +2970,11 @@ struct NOT_I64 : Sequence<NOT_I64, I<OPCODE_NOT, I64Op, I64Op>> {
 };
 struct NOT_V128 : Sequence<NOT_V128, I<OPCODE_NOT, V128Op, V128Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
+    if (e.IsFeatureEnabled(kX64EmitAVX512Ortho)) {
+      // dest = ~src, without loading the all-ones constant.
+      e.vpternlogd(i.dest, i.src1, i.src1, 0x55);
+      return;
+    }
     // dest = src ^ 0xFFFF...
     e.vpxor(i.dest, i.src1, e.GetXmmConstPtr(XMMFFFF /* FF... */));
   }
@@ -3335,9 +3375,13 @@ struct SET_ROUNDING_MODE_I32
     : Sequence<SET_ROUNDING_MODE_I32,
                I<OPCODE_SET_ROUNDING_MODE, VoidOp, I32Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
+    // vldmxcsr is serializing, so avoid reloading the mode it already has.
+    if (!e.ChangeRoundingMode(i.src1.value)) {
+      return;
+    }
     e.mov(e.rcx, i.src1);
     e.and_(e.rcx, 0x7);
-    e.mov(e.rax, uintptr_t(mxcsr_table));
+    e.MovHostImageAddress(e.rax, mxcsr_table);
     e.vldmxcsr(e.ptr[e.rax + e.rcx * 4]);
   }
 };
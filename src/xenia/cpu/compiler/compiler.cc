@@ -9,6 +9,7 @@
 
 #include "xenia/cpu/compiler/compiler.h"
 
+#include "xenia/base/clock.h"
 #include "xenia/base/profiling.h"
 #include "xenia/cpu/compiler/compiler_pass.h"
 
@@ -27,15 +28,32 @@ void Compiler::AddPass(std::unique_ptr<CompilerPass> pass) {
 
 void Compiler::Reset() {}
 
-bool Compiler::Compile(xe::cpu::hir::HIRBuilder* builder) {
+bool Compiler::Compile(xe::cpu::hir::HIRBuilder* builder,
+                       JitStats::Translation* stats) {
+  SCOPE_profile_cpu_f("cpu");
+
   // TODO(benvanik): sophisticated stuff. Run passes in parallel, run until they
   //                 stop changing things, etc.
   for (size_t i = 0; i < passes_.size(); ++i) {
     auto& pass = passes_[i];
     scratch_arena_.Reset();
+    if (!stats) {
+      if (!pass->Run(builder)) {
+        return false;
+      }
+      continue;
+    }
+    // Memory use is the HIR growth plus whatever scratch the pass needed.
+    size_t hir_size = builder->arena()->CalculateSize();
+    uint64_t start_ticks = Clock::QueryHostTickCount();
     if (!pass->Run(builder)) {
       return false;
     }
+    uint64_t ticks = Clock::QueryHostTickCount() - start_ticks;
+    size_t new_hir_size = builder->arena()->CalculateSize();
+    stats->AddPass(pass->name(), ticks,
+                   (new_hir_size > hir_size ? new_hir_size - hir_size : 0) +
+                       scratch_arena_.CalculateSize());
   }
 
   return true;
@@ -15,6 +15,7 @@
 
 #include "xenia/base/arena.h"
 #include "xenia/cpu/hir/hir_builder.h"
+#include "xenia/cpu/jit_stats.h"
 
 namespace xe {
 namespace cpu {
@@ -40,7 +41,9 @@ class Compiler {
 
   void Reset();
 
-  bool Compile(hir::HIRBuilder* builder);
+  // Per pass measurements are added to stats if given.
+  bool Compile(hir::HIRBuilder* builder,
+               JitStats::Translation* stats = nullptr);
 
  private:
   Processor* processor_;
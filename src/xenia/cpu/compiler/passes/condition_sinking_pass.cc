@@ -0,0 +1,70 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/passes/condition_sinking_pass.h"
+
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/compiler/compiler.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+
+ConditionSinkingPass::ConditionSinkingPass() : CompilerPass() {}
+
+ConditionSinkingPass::~ConditionSinkingPass() {}
+
+bool ConditionSinkingPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
+  // Compares only branched on are moved down to the branch:
+  //   v0 = compare_slt v1, v2
+  //   v3 = add v4, v5                   v3 = add v4, v5
+  //   store_context +256, v3      ->    store_context +256, v3
+  //   branch_true v0, label0            v0 = compare_slt v1, v2
+  //                                     branch_true v0, label0
+  // Values are SSA and compares have no side effects, so the operands are
+  // still the same at the branch.
+  auto block = builder->first_block();
+  while (block) {
+    for (Instr* i = block->instr_head; i; i = i->next) {
+      if (i->opcode != &OPCODE_BRANCH_TRUE_info &&
+          i->opcode != &OPCODE_BRANCH_FALSE_info) {
+        continue;
+      }
+      Value* cond = i->src1.value;
+      Instr* compare = cond->def;
+      if (!compare || compare->block != block || compare == i->prev ||
+          compare->opcode->num < OPCODE_COMPARE_EQ ||
+          compare->opcode->num > OPCODE_COMPARE_UGE) {
+        continue;
+      }
+      if (!cond->use_head || cond->use_head->next) {
+        continue;
+      }
+      compare->MoveBefore(i);
+    }
+    block = block->next;
+  }
+
+  return true;
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
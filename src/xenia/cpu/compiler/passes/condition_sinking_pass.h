@@ -0,0 +1,38 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_PASSES_CONDITION_SINKING_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_CONDITION_SINKING_PASS_H_
+
+#include "xenia/cpu/compiler/compiler_pass.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// Moves compares only consumed by a conditional branch right before it, so the
+// backend can branch on the flags set by the compare. Once context promotion
+// and dead store elimination have dropped the condition register stores that
+// nothing observes, this is what's left of most PPC compares.
+class ConditionSinkingPass : public CompilerPass {
+ public:
+  ConditionSinkingPass();
+  ~ConditionSinkingPass() override;
+
+  const char* name() const override { return "ConditionSinkingPass"; }
+  bool Run(hir::HIRBuilder* builder) override;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_CONDITION_SINKING_PASS_H_
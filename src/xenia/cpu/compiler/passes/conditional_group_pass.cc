@@ -47,6 +47,8 @@ bool ConditionalGroupPass::Initialize(Compiler* compiler) {
 }
 
 bool ConditionalGroupPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
   bool dirty;
   int loops = 0;
   do {
@@ -38,6 +38,8 @@ ConstantPropagationPass::ConstantPropagationPass()
 ConstantPropagationPass::~ConstantPropagationPass() {}
 
 bool ConstantPropagationPass::Run(HIRBuilder* builder, bool& result) {
+  SCOPE_profile_cpu_f("cpu");
+
   // Once ContextPromotion has run there will likely be a whole slew of
   // constants that can be pushed through the function.
   // Example:
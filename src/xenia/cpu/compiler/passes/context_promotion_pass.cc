@@ -51,6 +51,8 @@ bool ContextPromotionPass::Initialize(Compiler* compiler) {
 }
 
 bool ContextPromotionPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
   // Like mem2reg, but because context memory is unaliasable it's easier to
   // check and convert LoadContext/StoreContext into value operations.
   // Example of load->value promotion:
@@ -67,8 +69,30 @@ bool ContextPromotionPass::Run(HIRBuilder* builder) {
   // instead as it may be faster (at least on the block-level).
 
   // Promote loads to values.
-  // Process each block independently, for now.
+  // Blocks with a single predecessor (per the edges from
+  // ControlFlowAnalysisPass) start with the values known at the end of that
+  // predecessor, if it has already been processed:
+  //   block0:
+  //     v0 = load_context +100
+  //     branch_true v1, label0
+  //   block1 (only reached from block0):
+  //     v2 = load_context +100  <-- replace with v2 = v0
+  // Values carried from one block to another are kept in registers or
+  // locals by register allocation.
+  uint16_t block_count = 0;
   auto block = builder->first_block();
+  while (block) {
+    block->ordinal = block_count++;
+    block = block->next;
+  }
+  // Never shrunk, so the storage is reused by the next function.
+  if (exit_values_.size() < block_count) {
+    exit_values_.resize(block_count);
+  }
+  for (uint16_t n = 0; n < block_count; ++n) {
+    exit_values_[n].clear();
+  }
+  block = builder->first_block();
   while (block) {
     PromoteBlock(block);
     block = block->next;
@@ -88,19 +112,51 @@ bool ContextPromotionPass::Run(HIRBuilder* builder) {
   return true;
 }
 
+namespace {
+Block* GetSinglePredecessor(Block* block) {
+  auto edge = block->incoming_edge_head;
+  if (!edge) {
+    return nullptr;
+  }
+  Block* src = edge->src;
+  for (; edge; edge = edge->incoming_next) {
+    if (edge->src != src) {
+      return nullptr;
+    }
+  }
+  return src;
+}
+}  // namespace
+
 void ContextPromotionPass::PromoteBlock(Block* block) {
   auto& validity = context_validity_;
   validity.reset();
 
+  // Inherit what the predecessor knew. As it is processed first (the entry
+  // block has no predecessors) its definitions dominate this block.
+  auto predecessor = GetSinglePredecessor(block);
+  if (predecessor && predecessor != block &&
+      predecessor->ordinal < block->ordinal) {
+    for (auto& entry : exit_values_[predecessor->ordinal]) {
+      context_values_[entry.first] = entry.second;
+      validity.set(entry.first);
+    }
+  }
+
   Instr* i = block->instr_head;
   while (i) {
     auto next = i->next;
-    if (i->opcode->flags & OPCODE_FLAG_VOLATILE) {
+    if (i->opcode == &OPCODE_BRANCH_TRUE_info ||
+        i->opcode == &OPCODE_BRANCH_FALSE_info) {
+      // Doesn't touch the context; the rest of the block is the fallthrough
+      // path and sees the same values.
+    } else if (i->opcode->flags & OPCODE_FLAG_VOLATILE) {
       // Volatile instruction - requires all context values be flushed.
       validity.reset();
     } else if (i->opcode == &OPCODE_LOAD_CONTEXT_info) {
       size_t offset = i->src1.offset;
-      if (validity.test(static_cast<uint32_t>(offset))) {
+      if (validity.test(static_cast<uint32_t>(offset)) &&
+          context_values_[offset]->type == i->dest->type) {
         // Legit previous value, reuse.
         Value* previous_value = context_values_[offset];
         i->opcode = &hir::OPCODE_ASSIGN_info;
@@ -114,11 +170,34 @@ void ContextPromotionPass::PromoteBlock(Block* block) {
       size_t offset = i->src1.offset;
       Value* value = i->src2.value;
       // Store value into the table for later.
+      InvalidateOverlapping(static_cast<uint32_t>(offset),
+                            static_cast<uint32_t>(GetTypeSize(value->type)));
       context_values_[offset] = value;
       validity.set(static_cast<uint32_t>(offset));
     }
     i = next;
   }
+
+  // Stash what is known at the end of the block for its successors.
+  auto& exit_values = exit_values_[block->ordinal];
+  for (int offset = validity.find_first(); offset != -1;
+       offset = validity.find_next(offset)) {
+    exit_values.emplace_back(offset, context_values_[offset]);
+  }
+}
+
+void ContextPromotionPass::InvalidateOverlapping(uint32_t offset,
+                                                 uint32_t size) {
+  // Values are tracked by their first byte; drop any that overlap the new
+  // range so partial writes never forward stale data.
+  auto& validity = context_validity_;
+  uint32_t start = offset >= 15 ? offset - 15 : 0;
+  for (uint32_t n = start; n < offset + size; n++) {
+    if (validity.test(n) &&
+        n + GetTypeSize(context_values_[n]->type) > offset) {
+      validity.reset(n);
+    }
+  }
 }
 
 void ContextPromotionPass::RemoveDeadStoresBlock(Block* block) {
@@ -11,6 +11,7 @@
 #define XENIA_CPU_COMPILER_PASSES_CONTEXT_PROMOTION_PASS_H_
 
 #include <cmath>
+#include <utility>
 #include <vector>
 
 #include "xenia/base/platform.h"
@@ -38,15 +39,19 @@ class ContextPromotionPass : public CompilerPass {
 
   bool Initialize(Compiler* compiler) override;
 
+  const char* name() const override { return "ContextPromotionPass"; }
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
   void PromoteBlock(hir::Block* block);
+  void InvalidateOverlapping(uint32_t offset, uint32_t size);
   void RemoveDeadStoresBlock(hir::Block* block);
 
  private:
   std::vector<hir::Value*> context_values_;
   llvm::BitVector context_validity_;
+  // Context values known at the end of each block, by block ordinal.
+  std::vector<std::vector<std::pair<uint32_t, hir::Value*>>> exit_values_;
 };
 
 }  // namespace passes
@@ -30,6 +30,8 @@ ControlFlowAnalysisPass::ControlFlowAnalysisPass() : CompilerPass() {}
 ControlFlowAnalysisPass::~ControlFlowAnalysisPass() {}
 
 bool ControlFlowAnalysisPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
   // Reset edges for all blocks. Needed to be re-runnable.
   // Note that this wastes a bunch of arena memory, so we shouldn't
   // re-run too often.
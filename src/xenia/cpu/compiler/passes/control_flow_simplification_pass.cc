@@ -31,6 +31,8 @@ ControlFlowSimplificationPass::ControlFlowSimplificationPass()
 ControlFlowSimplificationPass::~ControlFlowSimplificationPass() {}
 
 bool ControlFlowSimplificationPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
   // Walk forwards and kill any unreachable blocks.
   // Do this before merging.
   auto block = builder->first_block();
@@ -16,17 +16,6 @@
 #include "xenia/cpu/compiler/compiler.h"
 #include "xenia/cpu/processor.h"
 
-#if XE_COMPILER_MSVC
-#pragma warning(push)
-#pragma warning(disable : 4244)
-#pragma warning(disable : 4267)
-#include <llvm/ADT/BitVector.h>
-#pragma warning(pop)
-#else
-#include <llvm/ADT/BitVector.h>
-#include <cmath>
-#endif  // XE_COMPILER_MSVC
-
 namespace xe {
 namespace cpu {
 namespace compiler {
@@ -36,6 +25,7 @@ namespace passes {
 using namespace xe::cpu::hir;
 
 using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Label;
 using xe::cpu::hir::OpcodeSignatureType;
 using xe::cpu::hir::Value;
 
@@ -44,10 +34,13 @@ DataFlowAnalysisPass::DataFlowAnalysisPass() : CompilerPass() {}
 DataFlowAnalysisPass::~DataFlowAnalysisPass() {}
 
 bool DataFlowAnalysisPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
   // Linearize blocks so that we can detect cycles and propagate dependencies.
   uint32_t block_count = LinearizeBlocks(builder);
 
-  // Analyze value flow and add locals as needed.
+  // Analyze value flow. Values are left in place; RegisterAllocationPass
+  // decides whether they stay in registers or are passed through locals.
   AnalyzeFlow(builder, block_count);
 
   return true;
@@ -67,41 +60,40 @@ uint32_t DataFlowAnalysisPass::LinearizeBlocks(HIRBuilder* builder) {
 
 void DataFlowAnalysisPass::AnalyzeFlow(HIRBuilder* builder,
                                        uint32_t block_count) {
-  uint32_t max_value_estimate =
-      builder->max_value_ordinal() + 1 + block_count * 4;
-
-  // Stash for value map. We may want to maintain this during building.
-  auto arena = builder->arena();
-  auto value_map = reinterpret_cast<Value**>(
-      arena->Alloc(sizeof(Value*) * max_value_estimate));
-
-  // Allocate incoming bitvectors for use by blocks. We don't need outgoing
-  // because they are only used during the block iteration.
-  // Mapped by block ordinal.
-  // TODO(benvanik): cache this list, grow as needed, etc.
-  auto incoming_bitvectors =
-      (llvm::BitVector**)arena->Alloc(sizeof(llvm::BitVector*) * block_count);
+  uint32_t max_value_estimate = builder->max_value_ordinal();
+
+  // Bitvectors are kept around (and reused) so that later passes can query
+  // block->incoming_values. They're never shrunk as their storage is reused
+  // by the next function.
+  if (live_in_.size() < block_count) {
+    live_in_.resize(block_count);
+    uses_.resize(block_count);
+    defs_.resize(block_count);
+  }
   for (auto n = 0u; n < block_count; n++) {
-    incoming_bitvectors[n] = new llvm::BitVector(max_value_estimate);
+    live_in_[n].clear();
+    live_in_[n].resize(max_value_estimate);
+    uses_[n].clear();
+    uses_[n].resize(max_value_estimate);
+    defs_[n].clear();
+    defs_[n].resize(max_value_estimate);
   }
 
-  // Walk blocks in reverse and calculate incoming/outgoing values.
-  auto block = builder->last_block();
+  // Gather values used before being defined in each block, and values
+  // defined in each block. As this is SSA any value defined in another block
+  // is necessarily upward exposed.
+  auto block = builder->first_block();
   while (block) {
-    // Allocate bitsets based on max value number.
-    block->incoming_values = incoming_bitvectors[block->ordinal];
-    auto& incoming_values = *block->incoming_values;
-
-    // Walk instructions and gather up incoming values.
+    auto& uses = uses_[block->ordinal];
+    auto& defs = defs_[block->ordinal];
     auto instr = block->instr_head;
     while (instr) {
       uint32_t signature = instr->opcode->signature;
-#define SET_INCOMING_VALUE(v)                   \
-  if (v->def && v->def->block != block) {       \
-    incoming_values.set(v->ordinal);            \
-  }                                             \
-  assert_true(v->ordinal < max_value_estimate); \
-  value_map[v->ordinal] = v;
+#define SET_INCOMING_VALUE(v)                     \
+  if (v->def && v->def->block != block) {         \
+    assert_true(v->ordinal < max_value_estimate); \
+    uses.set(v->ordinal);                         \
+  }
       if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V) {
         SET_INCOMING_VALUE(instr->src1.value);
       }
@@ -112,99 +104,67 @@ void DataFlowAnalysisPass::AnalyzeFlow(HIRBuilder* builder,
         SET_INCOMING_VALUE(instr->src3.value);
       }
 #undef SET_INCOMING_VALUE
-      instr = instr->next;
-    }
-
-    // Add all successor incoming values to our outgoing, as we need to
-    // pass them through.
-    llvm::BitVector outgoing_values(max_value_estimate);
-    auto outgoing_edge = block->outgoing_edge_head;
-    while (outgoing_edge) {
-      if (outgoing_edge->dest->ordinal > block->ordinal) {
-        outgoing_values |= *outgoing_edge->dest->incoming_values;
-      }
-      outgoing_edge = outgoing_edge->outgoing_next;
-    }
-    incoming_values |= outgoing_values;
-
-    // Add stores for all outgoing values.
-    auto outgoing_ordinal = outgoing_values.find_first();
-    while (outgoing_ordinal != -1) {
-      Value* src_value = value_map[outgoing_ordinal];
-      assert_not_null(src_value);
-      if (!src_value->local_slot) {
-        src_value->local_slot = builder->AllocLocal(src_value->type);
-      }
-      builder->StoreLocal(src_value->local_slot, src_value);
-
-      // If we are in the block the value was defined in:
-      if (src_value->def->block == block) {
-        // Move the store to right after the def, or as soon after
-        // as we can (respecting PAIRED flags).
-        auto def_next = src_value->def->next;
-        while (def_next && def_next->opcode->flags & OPCODE_FLAG_PAIRED_PREV) {
-          def_next = def_next->next;
-        }
-        assert_not_null(def_next);
-        builder->last_instr()->MoveBefore(def_next);
-
-        // We don't need it in the incoming list.
-        incoming_values.reset(outgoing_ordinal);
-      } else {
-        // Eh, just throw at the end, before the first branch.
-        auto tail = block->instr_tail;
-        while (tail && tail->opcode->flags & OPCODE_FLAG_BRANCH) {
-          tail = tail->prev;
-        }
-        assert_not_zero(tail);
-        builder->last_instr()->MoveBefore(tail->next);
+      if (GET_OPCODE_SIG_TYPE_DEST(signature) == OPCODE_SIG_TYPE_V) {
+        assert_true(instr->dest->ordinal < max_value_estimate);
+        defs.set(instr->dest->ordinal);
       }
-
-      outgoing_ordinal = outgoing_values.find_next(outgoing_ordinal);
+      instr = instr->next;
     }
+    block = block->next;
+  }
 
-    // Add loads for all incoming values and rename them in the block.
-    auto incoming_ordinal = incoming_values.find_first();
-    while (incoming_ordinal != -1) {
-      Value* src_value = value_map[incoming_ordinal];
-      assert_not_null(src_value);
-      if (!src_value->local_slot) {
-        src_value->local_slot = builder->AllocLocal(src_value->type);
+  // Iterate to a fixed point. Blocks are walked in reverse as most edges
+  // point forward, but back edges (loops) require additional passes.
+  // Successors are taken from the branch instructions themselves as the
+  // edge lists are not maintained by all passes, and they omit fallthrough.
+  auto& outgoing_values = outgoing_values_;
+  outgoing_values.clear();
+  outgoing_values.resize(max_value_estimate);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    block = builder->last_block();
+    while (block) {
+      outgoing_values.reset();
+      auto tail = block->instr_tail;
+      bool falls_through =
+          !tail || (tail->opcode != &OPCODE_BRANCH_info &&
+                    tail->opcode != &OPCODE_RETURN_info);
+      if (falls_through && block->next) {
+        outgoing_values |= live_in_[block->next->ordinal];
       }
-      Value* local_value = builder->LoadLocal(src_value->local_slot);
-      builder->last_instr()->MoveBefore(block->instr_head);
-
-      // Swap uses of original value with the local value.
-      instr = block->instr_head;
+      auto instr = block->instr_head;
       while (instr) {
-        uint32_t signature = instr->opcode->signature;
-        if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V) {
-          if (instr->src1.value == src_value) {
-            instr->set_src1(local_value);
-          }
-        }
-        if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V) {
-          if (instr->src2.value == src_value) {
-            instr->set_src2(local_value);
-          }
+        Label* label = nullptr;
+        if (instr->opcode == &OPCODE_BRANCH_info) {
+          label = instr->src1.label;
+        } else if (instr->opcode == &OPCODE_BRANCH_TRUE_info ||
+                   instr->opcode == &OPCODE_BRANCH_FALSE_info) {
+          label = instr->src2.label;
         }
-        if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V) {
-          if (instr->src3.value == src_value) {
-            instr->set_src3(local_value);
-          }
+        if (label && label->block) {
+          outgoing_values |= live_in_[label->block->ordinal];
         }
         instr = instr->next;
       }
 
-      incoming_ordinal = incoming_values.find_next(incoming_ordinal);
-    }
+      // incoming = uses | (outgoing - defs)
+      outgoing_values.reset(defs_[block->ordinal]);
+      outgoing_values |= uses_[block->ordinal];
+      auto& incoming_values = live_in_[block->ordinal];
+      if (outgoing_values != incoming_values) {
+        incoming_values = outgoing_values;
+        changed = true;
+      }
 
-    block = block->prev;
+      block = block->prev;
+    }
   }
 
-  // Cleanup bitvectors.
-  for (auto n = 0u; n < block_count; n++) {
-    delete incoming_bitvectors[n];
+  block = builder->first_block();
+  while (block) {
+    block->incoming_values = &live_in_[block->ordinal];
+    block = block->next;
   }
 }
 
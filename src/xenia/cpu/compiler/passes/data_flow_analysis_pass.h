@@ -10,23 +10,45 @@
 #ifndef XENIA_CPU_COMPILER_PASSES_DATA_FLOW_ANALYSIS_PASS_H_
 #define XENIA_CPU_COMPILER_PASSES_DATA_FLOW_ANALYSIS_PASS_H_
 
+#include <vector>
+
+#include "xenia/base/platform.h"
 #include "xenia/cpu/compiler/compiler_pass.h"
 
+#if XE_COMPILER_MSVC
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#pragma warning(disable : 4267)
+#include <llvm/ADT/BitVector.h>
+#pragma warning(pop)
+#else
+#include <llvm/ADT/BitVector.h>
+#endif  // XE_COMPILER_MSVC
+
 namespace xe {
 namespace cpu {
 namespace compiler {
 namespace passes {
 
+// Computes the set of values live on entry to each block and stores it in
+// Block::incoming_values, indexed by value ordinal. The sets stay valid until
+// the pass is run again and are consumed by RegisterAllocationPass.
 class DataFlowAnalysisPass : public CompilerPass {
  public:
   DataFlowAnalysisPass();
   ~DataFlowAnalysisPass() override;
 
+  const char* name() const override { return "DataFlowAnalysisPass"; }
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
   uint32_t LinearizeBlocks(hir::HIRBuilder* builder);
   void AnalyzeFlow(hir::HIRBuilder* builder, uint32_t block_count);
+
+  std::vector<llvm::BitVector> live_in_;
+  std::vector<llvm::BitVector> uses_;
+  std::vector<llvm::BitVector> defs_;
+  llvm::BitVector outgoing_values_;
 };
 
 }  // namespace passes
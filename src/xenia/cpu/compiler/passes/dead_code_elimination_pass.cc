@@ -28,6 +28,8 @@ DeadCodeEliminationPass::DeadCodeEliminationPass() : CompilerPass() {}
 DeadCodeEliminationPass::~DeadCodeEliminationPass() {}
 
 bool DeadCodeEliminationPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
   // ContextPromotion/DSE will likely leave around a lot of dead statements.
   // Code generated for comparison/testing produces many unused statements and
   // with proper use analysis it should be possible to remove most of them:
@@ -0,0 +1,178 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/passes/dead_store_elimination_pass.h"
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/compiler/compiler.h"
+#include "xenia/cpu/ppc/ppc_context.h"
+#include "xenia/cpu/processor.h"
+
+DECLARE_bool(debug);
+DECLARE_bool(store_all_context_values);
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+using xe::cpu::hir::Label;
+
+DeadStoreEliminationPass::DeadStoreEliminationPass() : CompilerPass() {}
+
+DeadStoreEliminationPass::~DeadStoreEliminationPass() {}
+
+bool DeadStoreEliminationPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
+  // Backwards liveness over context bytes:
+  //   store_context +100, v0  <-- removed, +100 is stored on every path
+  //   branch_true v1, label0      before it is loaded again
+  //   store_context +100, v2
+  //   branch label1
+  // label0:
+  //   store_context +100, v3
+  // label1:
+  //   return
+  // Anything that may observe the context (calls, returns, traps, barriers)
+  // makes every byte live, so stores are only dropped when provably dead.
+  if (cvars::debug || cvars::store_all_context_values) {
+    return true;
+  }
+
+  uint16_t block_count = 0;
+  auto block = builder->first_block();
+  while (block) {
+    block->ordinal = block_count++;
+    block = block->next;
+  }
+  if (!block_count) {
+    return true;
+  }
+
+  const uint32_t context_size = static_cast<uint32_t>(sizeof(ppc::PPCContext));
+  // Never shrunk, so the storage is reused by the next function.
+  if (live_in_.size() < block_count) {
+    live_in_.resize(block_count);
+  }
+  for (uint32_t n = 0; n < block_count; ++n) {
+    live_in_[n].clear();
+    live_in_[n].resize(context_size);
+  }
+
+  // Iterate until the per-block liveness settles. Blocks are walked in
+  // reverse as most edges point forward.
+  auto& live = live_;
+  live.clear();
+  live.resize(context_size);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    block = builder->last_block();
+    while (block) {
+      ComputeLiveOut(block, live);
+      ProcessBlock(block, live, false);
+      auto& live_in = live_in_[block->ordinal];
+      if (live != live_in) {
+        live_in = live;
+        changed = true;
+      }
+      block = block->prev;
+    }
+  }
+
+  block = builder->first_block();
+  while (block) {
+    ComputeLiveOut(block, live);
+    ProcessBlock(block, live, true);
+    block = block->next;
+  }
+
+  return true;
+}
+
+void DeadStoreEliminationPass::ComputeLiveOut(Block* block,
+                                              llvm::BitVector& live) {
+  // Fallthrough liveness. Explicit branches are merged in as they are
+  // encountered by ProcessBlock.
+  if (block->next) {
+    live = live_in_[block->next->ordinal];
+  } else {
+    live.set();
+  }
+}
+
+void DeadStoreEliminationPass::ProcessBlock(Block* block,
+                                            llvm::BitVector& live,
+                                            bool remove_dead) {
+  auto label_live_in = [this](Label* label) -> const llvm::BitVector* {
+    if (!label->block) {
+      return nullptr;
+    }
+    return &live_in_[label->block->ordinal];
+  };
+
+  Instr* i = block->instr_tail;
+  while (i) {
+    Instr* prev = i->prev;
+    const OpcodeInfo* info = i->opcode;
+    if (info == &OPCODE_BRANCH_info) {
+      // Unconditional - nothing after this is reachable.
+      auto target_live = label_live_in(i->src1.label);
+      if (target_live) {
+        live = *target_live;
+      } else {
+        live.set();
+      }
+    } else if (info == &OPCODE_BRANCH_TRUE_info ||
+               info == &OPCODE_BRANCH_FALSE_info) {
+      auto target_live = label_live_in(i->src2.label);
+      if (target_live) {
+        live |= *target_live;
+      } else {
+        live.set();
+      }
+    } else if (info->flags & (OPCODE_FLAG_VOLATILE | OPCODE_FLAG_BRANCH) ||
+               info == &OPCODE_CONTEXT_BARRIER_info) {
+      // Calls, returns, traps/etc may observe the entire context.
+      live.set();
+    } else if (info == &OPCODE_LOAD_CONTEXT_info) {
+      auto offset = static_cast<uint32_t>(i->src1.offset);
+      auto size = static_cast<uint32_t>(GetTypeSize(i->dest->type));
+      live.set(offset, offset + size);
+    } else if (info == &OPCODE_STORE_CONTEXT_info) {
+      auto offset = static_cast<uint32_t>(i->src1.offset);
+      auto size = static_cast<uint32_t>(GetTypeSize(i->src2.value->type));
+      bool is_live = false;
+      for (uint32_t n = offset; n < offset + size; n++) {
+        if (live.test(n)) {
+          is_live = true;
+          break;
+        }
+      }
+      if (!is_live && remove_dead) {
+        i->Remove();
+      }
+      live.reset(offset, offset + size);
+    }
+    i = prev;
+  }
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,443 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/passes/loop_invariant_code_motion_pass.h"
+
+#include <algorithm>
+#include <cstddef>
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/compiler/compiler.h"
+#include "xenia/cpu/ppc/ppc_context.h"
+#include "xenia/cpu/processor.h"
+
+DECLARE_bool(debug);
+
+DEFINE_bool(loop_invariant_code_motion, true,
+            "Move loads of guest registers and computations that don't change "
+            "between iterations of a loop out of it.",
+            "CPU");
+DEFINE_bool(loop_invariant_guest_memory_loads, false,
+            "Also move loads of guest memory out of loops if no store in the "
+            "loop can overwrite them. Reads of memory written by other "
+            "threads or devices, like spinning on a flag, can't be told apart "
+            "from others in the guest code, and would never see the new value.",
+            "CPU");
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+using xe::cpu::hir::Label;
+using xe::cpu::hir::Value;
+
+namespace {
+
+// Hoisted values are live for the whole loop, so hoisting too many would only
+// make register allocation spill them.
+const uint32_t kMaxHoistedInstrsPerLoop = 16;
+
+Label* GetBranchTarget(const Instr* i) {
+  if (i->opcode == &OPCODE_BRANCH_info) {
+    return i->src1.label;
+  }
+  if (i->opcode == &OPCODE_BRANCH_TRUE_info ||
+      i->opcode == &OPCODE_BRANCH_FALSE_info) {
+    return i->src2.label;
+  }
+  return nullptr;
+}
+
+bool FallsThrough(const Block* block) {
+  const Instr* tail = block->instr_tail;
+  return !tail || (tail->opcode != &OPCODE_BRANCH_info &&
+                   tail->opcode != &OPCODE_RETURN_info);
+}
+
+bool IsIntType(TypeName type) { return type <= INT64_TYPE; }
+
+// Side effect free computations that can't fault and don't depend on the
+// rounding mode.
+bool IsHoistableIntOpcode(const OpcodeInfo* opcode) {
+  switch (opcode->num) {
+    case OPCODE_ASSIGN:
+    case OPCODE_ZERO_EXTEND:
+    case OPCODE_SIGN_EXTEND:
+    case OPCODE_TRUNCATE:
+    case OPCODE_ADD:
+    case OPCODE_SUB:
+    case OPCODE_MUL:
+    case OPCODE_MUL_HI:
+    case OPCODE_NEG:
+    case OPCODE_AND:
+    case OPCODE_OR:
+    case OPCODE_XOR:
+    case OPCODE_NOT:
+    case OPCODE_SHL:
+    case OPCODE_SHR:
+    case OPCODE_SHA:
+    case OPCODE_ROTATE_LEFT:
+    case OPCODE_BYTE_SWAP:
+    case OPCODE_CNTLZ:
+      return true;
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+LoopInvariantCodeMotionPass::LoopInvariantCodeMotionPass() : CompilerPass() {}
+
+LoopInvariantCodeMotionPass::~LoopInvariantCodeMotionPass() {}
+
+bool LoopInvariantCodeMotionPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
+  // A loop is the range of blocks from the target of a backward branch to the
+  // block containing it:
+  //   block0:                          block0:
+  //     ...                              ...
+  //                                      v0 = load_context +344 (r13)
+  //                                      v1 = add v0, 0x100
+  //   label0:                     ->   label0:
+  //     v0 = load_context +344           ...
+  //     v1 = add v0, 0x100               v2 = load v1
+  //     v2 = load v1                     ...
+  //     ...                              branch_true v3, label0
+  //     branch_true v3, label0
+  // Nothing is moved out of loops with context or memory stores that may
+  // overwrite what's loaded, and loads aren't moved out of loops with calls
+  // or anything else observing or changing the state of the guest.
+  if (!cvars::loop_invariant_code_motion || cvars::debug) {
+    return true;
+  }
+
+  blocks_.clear();
+  auto block = builder->first_block();
+  while (block) {
+    block->ordinal = static_cast<uint16_t>(blocks_.size());
+    blocks_.push_back(block);
+    block = block->next;
+  }
+
+  loops_.clear();
+  for (Block* latch : blocks_) {
+    for (Instr* i = latch->instr_head; i; i = i->next) {
+      Label* target = GetBranchTarget(i);
+      if (!target || !target->block ||
+          target->block->ordinal > latch->ordinal) {
+        continue;
+      }
+      uint32_t header = target->block->ordinal;
+      auto it = std::find_if(
+          loops_.begin(), loops_.end(),
+          [header](const Loop& loop) { return loop.header == header; });
+      if (it != loops_.end()) {
+        it->latch = std::max(it->latch, uint32_t(latch->ordinal));
+      } else {
+        loops_.push_back({header, latch->ordinal});
+      }
+    }
+  }
+
+  // Inner loops first, so what's moved out of them can be moved further out
+  // of the loops containing them.
+  std::stable_sort(loops_.begin(), loops_.end(),
+                   [](const Loop& a, const Loop& b) {
+                     return a.latch - a.header < b.latch - b.header;
+                   });
+  for (const Loop& loop : loops_) {
+    HoistLoop(loop);
+  }
+
+  return true;
+}
+
+bool LoopInvariantCodeMotionPass::HoistLoop(const Loop& loop) {
+  bool always_entered;
+  if (!CheckLoopEntry(loop, &always_entered)) {
+    return false;
+  }
+  Block* preheader = blocks_[loop.header - 1];
+  if (!preheader->instr_tail) {
+    return false;
+  }
+  // Insert before the branches ending the block, which only read the values
+  // they're branching on.
+  Instr* insert_before = nullptr;
+  for (Instr* i = preheader->instr_tail; i && GetBranchTarget(i); i = i->prev) {
+    insert_before = i;
+  }
+
+  ScanLoopStores(loop);
+
+  uint32_t hoisted_count = 0;
+  for (uint32_t n = loop.header; n <= loop.latch; ++n) {
+    Block* block = blocks_[n];
+    // Instructions of the first block before any branch run whenever the loop
+    // is entered, so only they may be moved if they could fault.
+    bool in_header_prefix = n == loop.header;
+    Instr* i = block->instr_head;
+    while (i) {
+      Instr* next = i->next;
+      if (i->opcode->flags & OPCODE_FLAG_BRANCH) {
+        in_header_prefix = false;
+      } else if (CanHoist(loop, i, in_header_prefix, always_entered)) {
+        if (insert_before) {
+          i->MoveBefore(insert_before);
+        } else {
+          Instr* tail = preheader->instr_tail;
+          i->MoveBefore(tail);
+          tail->MoveBefore(i);
+        }
+        if (++hoisted_count >= kMaxHoistedInstrsPerLoop) {
+          return true;
+        }
+      }
+      i = next;
+    }
+  }
+  return hoisted_count != 0;
+}
+
+bool LoopInvariantCodeMotionPass::CheckLoopEntry(const Loop& loop,
+                                                 bool* out_always_entered) {
+  if (!loop.header) {
+    return false;
+  }
+  Block* header = blocks_[loop.header];
+  Block* preheader = blocks_[loop.header - 1];
+  bool entered = FallsThrough(preheader);
+  bool always_entered = true;
+  for (Block* block : blocks_) {
+    bool in_loop =
+        block->ordinal >= loop.header && block->ordinal <= loop.latch;
+    for (Instr* i = block->instr_head; i; i = i->next) {
+      Label* target = GetBranchTarget(i);
+      if (block == preheader &&
+          ((target && target->block != header) ||
+           i->opcode == &OPCODE_RETURN_TRUE_info)) {
+        always_entered = false;
+      }
+      if (in_loop || !target || !target->block) {
+        continue;
+      }
+      uint32_t target_ordinal = target->block->ordinal;
+      if (target_ordinal < loop.header || target_ordinal > loop.latch) {
+        continue;
+      }
+      if (target->block != header || block != preheader) {
+        return false;
+      }
+      entered = true;
+    }
+  }
+  *out_always_entered = always_entered;
+  return entered;
+}
+
+void LoopInvariantCodeMotionPass::ScanLoopStores(const Loop& loop) {
+  has_barrier_ = false;
+  has_unknown_store_ = false;
+  context_stores_.clear();
+  context_stores_.resize(sizeof(ppc::PPCContext));
+  memory_stores_.clear();
+  for (uint32_t n = loop.header; n <= loop.latch; ++n) {
+    for (Instr* i = blocks_[n]->instr_head; i; i = i->next) {
+      switch (i->opcode->num) {
+        case OPCODE_STORE_CONTEXT: {
+          auto offset = static_cast<uint32_t>(i->src1.offset);
+          auto size = static_cast<uint32_t>(GetTypeSize(i->src2.value->type));
+          context_stores_.set(offset, offset + size);
+        } break;
+        case OPCODE_STORE:
+          memory_stores_.push_back(GetMemoryAccess(
+              i->src1.value, nullptr,
+              static_cast<uint32_t>(GetTypeSize(i->src2.value->type))));
+          break;
+        case OPCODE_STORE_OFFSET:
+          memory_stores_.push_back(GetMemoryAccess(
+              i->src1.value, i->src2.value,
+              static_cast<uint32_t>(GetTypeSize(i->src3.value->type))));
+          break;
+        case OPCODE_MEMSET:
+        case OPCODE_CACHE_CONTROL:
+        case OPCODE_STORE_MMIO:
+          has_unknown_store_ = true;
+          break;
+        case OPCODE_CALL:
+        case OPCODE_CALL_TRUE:
+        case OPCODE_CALL_INDIRECT:
+        case OPCODE_CALL_INDIRECT_TRUE:
+        case OPCODE_CALL_EXTERN:
+        case OPCODE_CONTEXT_BARRIER:
+        case OPCODE_DEBUG_BREAK:
+        case OPCODE_DEBUG_BREAK_TRUE:
+        case OPCODE_TRAP:
+        case OPCODE_TRAP_TRUE:
+        case OPCODE_LOAD_MMIO:
+        case OPCODE_MEMORY_BARRIER:
+        case OPCODE_ATOMIC_EXCHANGE:
+        case OPCODE_ATOMIC_COMPARE_EXCHANGE:
+          has_barrier_ = true;
+          break;
+        default:
+          break;
+      }
+    }
+  }
+}
+
+bool LoopInvariantCodeMotionPass::IsInvariant(const Loop& loop,
+                                              Value* value) const {
+  if (value->IsConstant()) {
+    return true;
+  }
+  // Values are SSA, so anything defined outside the loop is the same in every
+  // iteration.
+  return value->def && (value->def->block->ordinal < loop.header ||
+                        value->def->block->ordinal > loop.latch);
+}
+
+bool LoopInvariantCodeMotionPass::CanHoist(const Loop& loop, Instr* i,
+                                           bool in_header_prefix,
+                                           bool always_entered) const {
+  if (!i->dest ||
+      (i->next && (i->next->opcode->flags & OPCODE_FLAG_PAIRED_PREV))) {
+    return false;
+  }
+  uint32_t signature = i->opcode->signature;
+  Value* srcs[] = {
+      GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V ? i->src1.value
+                                                              : nullptr,
+      GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V ? i->src2.value
+                                                              : nullptr,
+      GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V ? i->src3.value
+                                                              : nullptr,
+  };
+  for (Value* src : srcs) {
+    if (src && !IsInvariant(loop, src)) {
+      return false;
+    }
+  }
+
+  if (IsHoistableIntOpcode(i->opcode)) {
+    if (!IsIntType(i->dest->type)) {
+      return false;
+    }
+    for (Value* src : srcs) {
+      if (src && !IsIntType(src->type)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  if (has_barrier_) {
+    return false;
+  }
+  if (i->opcode == &OPCODE_LOAD_CONTEXT_info) {
+    auto offset = static_cast<uint32_t>(i->src1.offset);
+    auto size = static_cast<uint32_t>(GetTypeSize(i->dest->type));
+    for (uint32_t n = offset; n < offset + size; ++n) {
+      if (context_stores_.test(n)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  if (i->opcode == &OPCODE_LOAD_info || i->opcode == &OPCODE_LOAD_OFFSET_info) {
+    // Guest memory may be unmapped where the loop isn't entered or the load
+    // isn't reached.
+    if (!cvars::loop_invariant_guest_memory_loads || !in_header_prefix ||
+        !always_entered || has_unknown_store_) {
+      return false;
+    }
+    MemoryAccess load = GetMemoryAccess(
+        i->src1.value,
+        i->opcode == &OPCODE_LOAD_OFFSET_info ? i->src2.value : nullptr,
+        static_cast<uint32_t>(GetTypeSize(i->dest->type)));
+    for (const MemoryAccess& store : memory_stores_) {
+      if (!AreDistinct(load, store)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+LoopInvariantCodeMotionPass::MemoryAccess
+LoopInvariantCodeMotionPass::GetMemoryAccess(Value* address, Value* offset,
+                                             uint32_t size) const {
+  MemoryAccess access = {address, 0, size, true};
+  if (offset) {
+    if (offset->IsConstant()) {
+      access.offset = int64_t(offset->AsUint64());
+    } else {
+      access.offset_known = false;
+    }
+  }
+  // base + constant, as built for d(rA) operands.
+  while (access.base->def && access.base->def->opcode == &OPCODE_ADD_info &&
+         access.base->def->src2.value->IsConstant() &&
+         IsIntType(access.base->def->src2.value->type)) {
+    access.offset += int64_t(access.base->def->src2.value->AsUint64());
+    access.base = access.base->def->src1.value;
+  }
+  return access;
+}
+
+bool LoopInvariantCodeMotionPass::AreDistinct(const MemoryAccess& a,
+                                              const MemoryAccess& b) const {
+  if (a.base == b.base) {
+    if (!a.offset_known || !b.offset_known) {
+      return false;
+    }
+    // Guest addresses are 32-bit.
+    uint32_t a_start = uint32_t(a.offset);
+    uint32_t b_start = uint32_t(b.offset);
+    return uint32_t(b_start - a_start) >= a.size &&
+           uint32_t(a_start - b_start) >= b.size;
+  }
+  // The stack (r1) and the processor control region (r13) never overlap.
+  int32_t a_register = GetBaseRegister(a.base);
+  int32_t b_register = GetBaseRegister(b.base);
+  return (a_register == 1 && b_register == 13) ||
+         (a_register == 13 && b_register == 1);
+}
+
+int32_t LoopInvariantCodeMotionPass::GetBaseRegister(Value* value) const {
+  Instr* def = value->def;
+  if (!def || def->opcode != &OPCODE_LOAD_CONTEXT_info ||
+      value->type != INT64_TYPE) {
+    return -1;
+  }
+  auto offset = static_cast<size_t>(def->src1.offset);
+  if (offset < offsetof(ppc::PPCContext, r) ||
+      offset >= offsetof(ppc::PPCContext, r) + 32 * 8 ||
+      (offset - offsetof(ppc::PPCContext, r)) & 7) {
+    return -1;
+  }
+  return int32_t((offset - offsetof(ppc::PPCContext, r)) / 8);
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
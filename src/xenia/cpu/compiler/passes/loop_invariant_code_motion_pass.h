@@ -0,0 +1,92 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_PASSES_LOOP_INVARIANT_CODE_MOTION_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_LOOP_INVARIANT_CODE_MOTION_PASS_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "xenia/base/platform.h"
+#include "xenia/cpu/compiler/compiler_pass.h"
+
+#if XE_COMPILER_MSVC
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#pragma warning(disable : 4267)
+#include <llvm/ADT/BitVector.h>
+#pragma warning(pop)
+#else
+#include <llvm/ADT/BitVector.h>
+#endif  // XE_COMPILER_MSVC
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// Moves computations that produce the same value on every iteration of a loop
+// to the block entering the loop. Loops are found from backward branches, and
+// only those entered through their first block, preceded by the only block
+// entering them, are handled, which covers the loops of compiled code.
+class LoopInvariantCodeMotionPass : public CompilerPass {
+ public:
+  LoopInvariantCodeMotionPass();
+  ~LoopInvariantCodeMotionPass() override;
+
+  const char* name() const override { return "LoopInvariantCodeMotionPass"; }
+  bool Run(hir::HIRBuilder* builder) override;
+
+ private:
+  // A guest memory access as a base value plus a constant offset if the
+  // address could be split like that.
+  struct MemoryAccess {
+    hir::Value* base;
+    int64_t offset;
+    uint32_t size;
+    bool offset_known;
+  };
+
+  struct Loop {
+    uint32_t header;
+    uint32_t latch;
+  };
+
+  bool HoistLoop(const Loop& loop);
+  // Checks that nothing but the block before the header enters the loop and
+  // returns whether that block always enters it.
+  bool CheckLoopEntry(const Loop& loop, bool* out_always_entered);
+  void ScanLoopStores(const Loop& loop);
+  bool IsInvariant(const Loop& loop, hir::Value* value) const;
+  bool CanHoist(const Loop& loop, hir::Instr* instr, bool in_header_prefix,
+                bool always_entered) const;
+  MemoryAccess GetMemoryAccess(hir::Value* address, hir::Value* offset,
+                               uint32_t size) const;
+  // Whether the accesses can't overlap, either as they're relative to the same
+  // base or as they're relative to registers pointing to distinct regions.
+  bool AreDistinct(const MemoryAccess& a, const MemoryAccess& b) const;
+  // Gets the guest register the value was loaded from, or -1.
+  int32_t GetBaseRegister(hir::Value* value) const;
+
+  std::vector<hir::Block*> blocks_;
+  std::vector<Loop> loops_;
+
+  // Summary of the loop being processed.
+  bool has_barrier_;
+  bool has_unknown_store_;
+  llvm::BitVector context_stores_;
+  std::vector<MemoryAccess> memory_stores_;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_LOOP_INVARIANT_CODE_MOTION_PASS_H_
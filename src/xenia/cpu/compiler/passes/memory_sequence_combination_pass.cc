@@ -9,6 +9,8 @@
 
 #include "xenia/cpu/compiler/passes/memory_sequence_combination_pass.h"
 
+#include <algorithm>
+
 #include "xenia/base/profiling.h"
 
 namespace xe {
@@ -19,6 +21,7 @@ namespace passes {
 // TODO(benvanik): remove when enums redefined.
 using namespace xe::cpu::hir;
 
+using xe::cpu::hir::Block;
 using xe::cpu::hir::HIRBuilder;
 using xe::cpu::hir::Instr;
 using xe::cpu::hir::Value;
@@ -29,6 +32,8 @@ MemorySequenceCombinationPass::MemorySequenceCombinationPass()
 MemorySequenceCombinationPass::~MemorySequenceCombinationPass() = default;
 
 bool MemorySequenceCombinationPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
   // Run over all loads and stores and see if we can collapse sequences into the
   // fat opcodes. See the respective utility functions for examples.
   auto block = builder->first_block();
@@ -44,6 +49,7 @@ bool MemorySequenceCombinationPass::Run(HIRBuilder* builder) {
       }
       i = i->next;
     }
+    MergeConstantStores(builder, block);
     block = block->next;
   }
   return true;
@@ -150,6 +156,114 @@ void MemorySequenceCombinationPass::CombineStoreSequence(Instr* i) {
   // TODO(benvanik): extend/truncate.
 }
 
+void MemorySequenceCombinationPass::MergeConstantStores(HIRBuilder* builder,
+                                                        Block* block) {
+  // Adjacent constant stores to the same base, such as from structure
+  // initialization:
+  //   store_offset v0, 8, 1.i32
+  //   store_offset v0, 12, 2.i32
+  // become:
+  //   store_offset v0, 8, 0x0000000200000001.i64
+  // with the bytes of the constant in host order, as constants are stored
+  // already swapped. Nothing else may access memory between the stores.
+  store_run_.clear();
+  for (auto i = block->instr_head; i; i = i->next) {
+    if (i->opcode == &OPCODE_STORE_OFFSET_info && !i->flags &&
+        i->src2.value->IsConstant() && i->src3.value->IsConstant() &&
+        i->src3.value->type <= INT64_TYPE) {
+      if (!store_run_.empty() &&
+          store_run_.front().instr->src1.value != i->src1.value) {
+        MergeConstantStoreRun(builder);
+      }
+      store_run_.push_back({i, i->src2.value->constant.i64,
+                            uint32_t(GetTypeSize(i->src3.value->type)),
+                            i->src3.value->AsUint64()});
+    } else if (i->opcode->flags & (OPCODE_FLAG_MEMORY | OPCODE_FLAG_VOLATILE |
+                                   OPCODE_FLAG_BRANCH)) {
+      MergeConstantStoreRun(builder);
+    }
+  }
+  MergeConstantStoreRun(builder);
+}
+
+void MemorySequenceCombinationPass::MergeConstantStoreRun(
+    HIRBuilder* builder) {
+  if (store_run_.size() < 2) {
+    store_run_.clear();
+    return;
+  }
+  // The merged store replaces the last of its stores in program order.
+  for (size_t n = 0; n < store_run_.size(); ++n) {
+    store_run_[n].order = uint32_t(n);
+  }
+  std::sort(store_run_.begin(), store_run_.end(),
+            [](const ConstantStore& a, const ConstantStore& b) {
+              return a.offset < b.offset;
+            });
+  // Where a later store overwrites part of an earlier one only the order
+  // decides, so leave such runs alone.
+  for (size_t n = 1; n < store_run_.size(); ++n) {
+    if (store_run_[n - 1].offset + store_run_[n - 1].size >
+        store_run_[n].offset) {
+      store_run_.clear();
+      return;
+    }
+  }
+
+  // Merge into naturally aligned windows of the offsets, as the base usually
+  // is aligned, covered exactly by the stores.
+  size_t first = 0;
+  while (first < store_run_.size()) {
+    int64_t start = store_run_[first].offset;
+    size_t end_index = first;
+    for (uint32_t width = 8; width >= 2; width >>= 1) {
+      if (start & (width - 1)) {
+        continue;
+      }
+      size_t last = first;
+      int64_t end = start;
+      while (last < store_run_.size() && store_run_[last].offset == end &&
+             end < start + width) {
+        end += store_run_[last].size;
+        ++last;
+      }
+      if (end != start + width || last - first < 2) {
+        continue;
+      }
+      uint64_t value = 0;
+      const ConstantStore* kept = &store_run_[first];
+      for (size_t n = first; n < last; ++n) {
+        const ConstantStore& store = store_run_[n];
+        uint64_t mask = store.size == 8 ? ~uint64_t(0)
+                                        : (uint64_t(1) << (store.size * 8)) - 1;
+        value |= (store.value & mask) << ((store.offset - start) * 8);
+        if (store.order > kept->order) {
+          kept = &store;
+        }
+      }
+      for (size_t n = first; n < last; ++n) {
+        if (&store_run_[n] != kept) {
+          store_run_[n].instr->Remove();
+        }
+      }
+      Value* merged_value;
+      if (width == 8) {
+        merged_value = builder->LoadConstantUint64(value);
+      } else if (width == 4) {
+        merged_value = builder->LoadConstantUint32(uint32_t(value));
+      } else {
+        merged_value = builder->LoadConstantUint16(uint16_t(value));
+      }
+      kept->instr->set_src2(builder->LoadConstantInt64(start));
+      kept->instr->set_src3(merged_value);
+      end_index = last;
+      break;
+    }
+    first = end_index > first ? end_index : first + 1;
+  }
+  store_run_.clear();
+}
+
 }  // namespace passes
 }  // namespace compiler
 }  // namespace cpu
@@ -10,6 +10,8 @@
 #ifndef XENIA_CPU_COMPILER_PASSES_MEMORY_SEQUENCE_COMBINATION_PASS_H_
 #define XENIA_CPU_COMPILER_PASSES_MEMORY_SEQUENCE_COMBINATION_PASS_H_
 
+#include <vector>
+
 #include "xenia/cpu/compiler/compiler_pass.h"
 
 namespace xe {
@@ -22,12 +24,25 @@ class MemorySequenceCombinationPass : public CompilerPass {
   MemorySequenceCombinationPass();
   ~MemorySequenceCombinationPass() override;
 
+  const char* name() const override { return "MemorySequenceCombinationPass"; }
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
   void CombineMemorySequences(hir::HIRBuilder* builder);
   void CombineLoadSequence(hir::Instr* i);
   void CombineStoreSequence(hir::Instr* i);
+  void MergeConstantStores(hir::HIRBuilder* builder, hir::Block* block);
+  void MergeConstantStoreRun(hir::HIRBuilder* builder);
+
+  struct ConstantStore {
+    hir::Instr* instr;
+    int64_t offset;
+    uint32_t size;
+    uint64_t value;
+    uint32_t order;
+  };
+  // Constant stores to the same base since the last other memory access.
+  std::vector<ConstantStore> store_run_;
 };
 
 }  // namespace passes
@@ -16,6 +16,17 @@
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
+#include "xenia/cpu/cpu_flags.h"
+
+#if XE_COMPILER_MSVC
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#pragma warning(disable : 4267)
+#include <llvm/ADT/BitVector.h>
+#pragma warning(pop)
+#else
+#include <llvm/ADT/BitVector.h>
+#endif  // XE_COMPILER_MSVC
 
 namespace xe {
 namespace cpu {
@@ -35,6 +46,30 @@ using xe::cpu::hir::Value;
 
 #define ASSERT_NO_CYCLES 0
 
+// Registers of each set left to the per-block allocator in blocks where
+// global values are live. Enough for the sources and dest of any instruction.
+static const uint32_t kMinLocalRegisters = 4;
+
+namespace {
+bool ClobbersRegisters(const Instr* instr) {
+  // Guest calls and host calls do not preserve the allocatable registers.
+  switch (instr->opcode->num) {
+    case OPCODE_CALL:
+    case OPCODE_CALL_TRUE:
+    case OPCODE_CALL_INDIRECT:
+    case OPCODE_CALL_INDIRECT_TRUE:
+    case OPCODE_CALL_EXTERN:
+    case OPCODE_TRAP:
+    case OPCODE_TRAP_TRUE:
+    case OPCODE_DEBUG_BREAK:
+    case OPCODE_DEBUG_BREAK_TRUE:
+      return true;
+    default:
+      return false;
+  }
+}
+}  // namespace
+
 RegisterAllocationPass::RegisterAllocationPass(const MachineInfo* machine_info)
     : CompilerPass() {
   // Initialize register sets.
@@ -71,11 +106,16 @@ RegisterAllocationPass::~RegisterAllocationPass() {
 }
 
 bool RegisterAllocationPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
   // Simple per-block allocator that operates on SSA form.
-  // Registers do not move across blocks, though this could be
-  // optimized with some intra-block analysis (dominators/etc).
+  // Values used across blocks are handled up front: they either get a
+  // register for their entire live range (reserved in every block it
+  // covers) or are passed through a local. Everything else is allocated
+  // per block below.
   // Really, it'd just be nice to have someone who knew what they
   // were doing lower SSA and do this right.
+  AllocateGlobalValues(builder);
 
   uint16_t block_ordinal = 0;
   uint32_t instr_ordinal = 0;
@@ -85,7 +125,7 @@ bool RegisterAllocationPass::Run(HIRBuilder* builder) {
     block->ordinal = block_ordinal++;
 
     // Reset all state.
-    PrepareBlockState();
+    PrepareBlockState(block);
 
     // Renumber all instructions in the block. This is required so that
     // we can sort the usage pointers below.
@@ -125,9 +165,9 @@ bool RegisterAllocationPass::Run(HIRBuilder* builder) {
         }
       }
 
-      if (GET_OPCODE_SIG_TYPE_DEST(signature) == OPCODE_SIG_TYPE_V) {
-        // Must not have been set already.
-        assert_null(instr->dest->reg.set);
+      // Values live across blocks were assigned by AllocateGlobalValues.
+      if (GET_OPCODE_SIG_TYPE_DEST(signature) == OPCODE_SIG_TYPE_V &&
+          !instr->dest->reg.set) {
 
         // Sort the usage list. We depend on this in future uses of this
         // variable.
@@ -173,6 +213,258 @@ bool RegisterAllocationPass::Run(HIRBuilder* builder) {
   return true;
 }
 
+void RegisterAllocationPass::AllocateGlobalValues(HIRBuilder* builder) {
+  global_values_.clear();
+  pinned_registers_.clear();
+
+  // Gather values that escape the block they are defined in.
+  uint16_t block_count = 0;
+  auto block = builder->first_block();
+  while (block) {
+    block->ordinal = block_count++;
+    auto instr = block->instr_head;
+    while (instr) {
+      if (GET_OPCODE_SIG_TYPE_DEST(instr->opcode->signature) ==
+          OPCODE_SIG_TYPE_V) {
+        auto use = instr->dest->use_head;
+        while (use) {
+          if (use->instr->block != block) {
+            global_values_.push_back({instr->dest, block->ordinal,
+                                      block->ordinal});
+            break;
+          }
+          use = use->next;
+        }
+      }
+      instr = instr->next;
+    }
+    block = block->next;
+  }
+  if (global_values_.empty()) {
+    return;
+  }
+
+  // Liveness comes from DataFlowAnalysisPass. Without it everything goes
+  // through locals.
+  bool has_liveness = cvars::global_register_allocation &&
+                      builder->first_block()->incoming_values;
+  auto& block_has_call = block_has_call_;
+  block_has_call.assign(block_count, false);
+  if (has_liveness) {
+    block = builder->first_block();
+    while (block) {
+      for (auto instr = block->instr_head; instr; instr = instr->next) {
+        if (ClobbersRegisters(instr)) {
+          block_has_call[block->ordinal] = true;
+          break;
+        }
+      }
+      block = block->next;
+    }
+  }
+
+  auto& candidates = candidates_;
+  auto& spills = spills_;
+  candidates.clear();
+  spills.clear();
+  for (auto& global_value : global_values_) {
+    auto value = global_value.value;
+    bool keep_in_register = has_liveness;
+    if (keep_in_register) {
+      for (auto instr = value->def->next; instr; instr = instr->next) {
+        if (ClobbersRegisters(instr)) {
+          keep_in_register = false;
+          break;
+        }
+      }
+    }
+    if (keep_in_register) {
+      block = builder->first_block();
+      while (block) {
+        if (block->incoming_values->size() > value->ordinal &&
+            block->incoming_values->test(value->ordinal)) {
+          global_value.first_block =
+              std::min(global_value.first_block, block->ordinal);
+          global_value.last_block =
+              std::max(global_value.last_block, block->ordinal);
+          if (block_has_call[block->ordinal]) {
+            keep_in_register = false;
+            break;
+          }
+        }
+        block = block->next;
+      }
+    }
+    if (keep_in_register) {
+      // Sanity check the liveness we were given.
+      for (auto use = value->use_head; use; use = use->next) {
+        auto use_block = use->instr->block;
+        if (use_block != value->def->block &&
+            (use_block->incoming_values->size() <= value->ordinal ||
+             !use_block->incoming_values->test(value->ordinal))) {
+          keep_in_register = false;
+          break;
+        }
+      }
+    }
+    if (keep_in_register) {
+      candidates.push_back(&global_value);
+    } else {
+      spills.push_back(value);
+    }
+  }
+
+  // Linear scan over the block ranges. Ranges that touch the same block
+  // interfere, which keeps the per-block reservations exact.
+  std::stable_sort(candidates.begin(), candidates.end(),
+                   [](const GlobalValue* a, const GlobalValue* b) {
+                     return a->first_block < b->first_block;
+                   });
+  const size_t set_count = xe::countof(usage_sets_.all_sets);
+  auto& active = active_;
+  active.resize(set_count);
+  for (auto& set_active : active) {
+    set_active.clear();
+  }
+  for (auto candidate : candidates) {
+    auto usage_set = RegisterSetForValue(candidate->value);
+    auto& set_active = active[RegisterSetIndex(usage_set)];
+    std::bitset<32> available;
+    for (uint32_t n = 0; n < usage_set->count; n++) {
+      available.set(n);
+    }
+    for (auto it = set_active.begin(); it != set_active.end();) {
+      if ((*it)->last_block < candidate->first_block) {
+        it = set_active.erase(it);
+      } else {
+        available.reset((*it)->value->reg.index);
+        ++it;
+      }
+    }
+    uint32_t limit = usage_set->count > kMinLocalRegisters
+                         ? usage_set->count - kMinLocalRegisters
+                         : 0;
+    if (set_active.size() < limit) {
+      uint32_t index = 0;
+      xe::bit_scan_forward(static_cast<uint32_t>(available.to_ulong()),
+                           &index);
+      candidate->value->reg.set = usage_set->set;
+      candidate->value->reg.index = index;
+      set_active.push_back(candidate);
+      continue;
+    }
+    // Out of registers. Spill whichever range ends last.
+    auto furthest =
+        std::max_element(set_active.begin(), set_active.end(),
+                         [](const GlobalValue* a, const GlobalValue* b) {
+                           return a->last_block < b->last_block;
+                         });
+    if (furthest != set_active.end() &&
+        (*furthest)->last_block > candidate->last_block) {
+      auto victim = *furthest;
+      candidate->value->reg = victim->value->reg;
+      victim->value->reg.set = nullptr;
+      victim->value->reg.index = -1;
+      spills.push_back(victim->value);
+      *furthest = candidate;
+    } else {
+      spills.push_back(candidate->value);
+    }
+  }
+
+  // Reserve the assigned registers in every block of their range.
+  pinned_registers_.resize(block_count * set_count);
+  for (auto candidate : candidates) {
+    auto value = candidate->value;
+    if (!value->reg.set) {
+      continue;
+    }
+    size_t set_index = RegisterSetIndex(RegisterSetForValue(value));
+    for (uint32_t n = candidate->first_block; n <= candidate->last_block;
+         n++) {
+      pinned_registers_[n * set_count + set_index].set(value->reg.index);
+    }
+  }
+
+  for (auto value : spills) {
+    SpillGlobalValue(builder, value);
+  }
+}
+
+void RegisterAllocationPass::SpillGlobalValue(HIRBuilder* builder,
+                                              Value* value) {
+  // Store once right after the definition (respecting PAIRED flags) and
+  // reload at the top of every other block that uses the value. As this is
+  // SSA the definition dominates all uses, so the local is always valid.
+  auto def_block = value->def->block;
+  if (!value->local_slot) {
+    value->local_slot = builder->AllocLocal(value->type);
+  }
+  builder->StoreLocal(value->local_slot, value);
+  auto spill_store = builder->last_instr();
+  auto insert_after = value->def;
+  while (insert_after->next &&
+         insert_after->next->opcode->flags & OPCODE_FLAG_PAIRED_PREV) {
+    insert_after = insert_after->next;
+  }
+  if (insert_after->next) {
+    spill_store->MoveBefore(insert_after->next);
+  } else {
+    spill_store->MoveBefore(insert_after);
+    insert_after->MoveBefore(spill_store);
+  }
+
+  while (true) {
+    Block* use_block = nullptr;
+    for (auto use = value->use_head; use; use = use->next) {
+      if (use->instr->block != def_block) {
+        use_block = use->instr->block;
+        break;
+      }
+    }
+    if (!use_block) {
+      break;
+    }
+
+    auto local_value = builder->LoadLocal(value->local_slot);
+    builder->last_instr()->MoveBefore(use_block->instr_head);
+    local_value->local_slot = value->local_slot;
+
+    // Swap uses of original value with the local value.
+    auto instr = use_block->instr_head;
+    while (instr) {
+      uint32_t signature = instr->opcode->signature;
+      if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V) {
+        if (instr->src1.value == value) {
+          instr->set_src1(local_value);
+        }
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V) {
+        if (instr->src2.value == value) {
+          instr->set_src2(local_value);
+        }
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V) {
+        if (instr->src3.value == value) {
+          instr->set_src3(local_value);
+        }
+      }
+      instr = instr->next;
+    }
+  }
+}
+
+size_t RegisterAllocationPass::RegisterSetIndex(
+    const RegisterSetUsage* usage_set) const {
+  for (size_t i = 0; i < xe::countof(usage_sets_.all_sets); ++i) {
+    if (usage_sets_.all_sets[i] == usage_set) {
+      return i;
+    }
+  }
+  assert_always();
+  return 0;
+}
+
 void RegisterAllocationPass::DumpUsage(const char* name) {
 #if 0
   fprintf(stdout, "\n%s:\n", name);
@@ -195,12 +487,19 @@ void RegisterAllocationPass::DumpUsage(const char* name) {
 #endif
 }
 
-void RegisterAllocationPass::PrepareBlockState() {
-  for (size_t i = 0; i < xe::countof(usage_sets_.all_sets); ++i) {
+void RegisterAllocationPass::PrepareBlockState(Block* block) {
+  const size_t set_count = xe::countof(usage_sets_.all_sets);
+  size_t pinned_base = size_t(block->ordinal) * set_count;
+  for (size_t i = 0; i < set_count; ++i) {
     auto usage_set = usage_sets_.all_sets[i];
     if (usage_set) {
       usage_set->availability.set();
       usage_set->upcoming_uses.clear();
+      // Keep out of the way of values live across this block. Blocks added
+      // by spilling have no reservations.
+      if (pinned_base + i < pinned_registers_.size()) {
+        usage_set->availability &= ~pinned_registers_[pinned_base + i];
+      }
     }
   }
   DumpUsage("PrepareBlockState");
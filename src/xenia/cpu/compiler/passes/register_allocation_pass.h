@@ -28,6 +28,7 @@ class RegisterAllocationPass : public CompilerPass {
   explicit RegisterAllocationPass(const backend::MachineInfo* machine_info);
   ~RegisterAllocationPass() override;
 
+  const char* name() const override { return "RegisterAllocationPass"; }
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
@@ -51,8 +52,20 @@ class RegisterAllocationPass : public CompilerPass {
     std::vector<RegisterUsage> upcoming_uses;
   };
 
+  // A value used outside of the block that defines it. Live ranges are
+  // tracked at block granularity in linear block order.
+  struct GlobalValue {
+    hir::Value* value;
+    uint16_t first_block;
+    uint16_t last_block;
+  };
+
+  void AllocateGlobalValues(hir::HIRBuilder* builder);
+  void SpillGlobalValue(hir::HIRBuilder* builder, hir::Value* value);
+  size_t RegisterSetIndex(const RegisterSetUsage* usage_set) const;
+
   void DumpUsage(const char* name);
-  void PrepareBlockState();
+  void PrepareBlockState(hir::Block* block);
   void AdvanceUses(hir::Instr* instr);
   bool IsRegInUse(const hir::RegAssignment& reg);
   RegisterSetUsage* MarkRegUsed(const hir::RegAssignment& reg,
@@ -76,6 +89,16 @@ class RegisterAllocationPass : public CompilerPass {
     RegisterSetUsage* vec_set = nullptr;
     RegisterSetUsage* all_sets[3];
   } usage_sets_;
+
+  std::vector<GlobalValue> global_values_;
+  // Registers held by global values, indexed by
+  // block ordinal * countof(all_sets) + set index.
+  std::vector<std::bitset<32>> pinned_registers_;
+  // Scratch for AllocateGlobalValues, kept to reuse the storage.
+  std::vector<bool> block_has_call_;
+  std::vector<GlobalValue*> candidates_;
+  std::vector<hir::Value*> spills_;
+  std::vector<std::vector<GlobalValue*>> active_;
 };
 
 }  // namespace passes
@@ -1,5 +1,6 @@
 #include "repetitive_computation_merger_pass.h"
 #include <bitset>
+#include "xenia/base/profiling.h"
 #include "xenia/cpu/ppc/ppc_context.h"
 namespace xe {
 namespace cpu {
@@ -836,6 +837,8 @@ bool RepetitiveComputationMergerPass::RunPerBlock(hir::HIRBuilder* builder,
   return did_change;
 }
 bool RepetitiveComputationMergerPass::Run(hir::HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
   if (!did_atexit) {
    // atexit(dump_opts);
     did_atexit = true;
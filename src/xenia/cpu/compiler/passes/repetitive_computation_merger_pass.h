@@ -22,6 +22,9 @@ class RepetitiveComputationMergerPass : public CompilerPass {
   RepetitiveComputationMergerPass();
   ~RepetitiveComputationMergerPass() override;
 
+  const char* name() const override {
+    return "RepetitiveComputationMergerPass";
+  }
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
@@ -28,6 +28,8 @@ SimplificationPass::SimplificationPass() : ConditionalGroupSubpass() {}
 SimplificationPass::~SimplificationPass() {}
 
 bool SimplificationPass::Run(HIRBuilder* builder, bool& result) {
+  SCOPE_profile_cpu_f("cpu");
+
   result = false;
   result |= EliminateConversions(builder);
   result |= SimplifyAssignments(builder);
@@ -34,6 +34,8 @@ ValidationPass::ValidationPass() : CompilerPass() {}
 ValidationPass::~ValidationPass() {}
 
 bool ValidationPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
 #if 0
   StringBuffer str;
   builder->Dump(&str);
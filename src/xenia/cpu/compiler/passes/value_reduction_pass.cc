@@ -9,6 +9,8 @@
 
 #include "xenia/cpu/compiler/passes/value_reduction_pass.h"
 
+#include <algorithm>
+
 #include "xenia/base/platform.h"
 #include "xenia/base/profiling.h"
 #include "xenia/cpu/backend/backend.h"
@@ -45,7 +47,8 @@ ValueReductionPass::~ValueReductionPass() {}
 void ValueReductionPass::ComputeLastUse(Value* value) {
   // TODO(benvanik): compute during construction?
   // Note that this list isn't sorted (unfortunately), so we have to scan
-  // them all.
+  // them all. Only called for block-local values, so instruction ordinals
+  // are comparable.
   uint32_t max_ordinal = 0;
   Value::Use* last_use = nullptr;
   auto use = value->use_head;
@@ -59,12 +62,88 @@ void ValueReductionPass::ComputeLastUse(Value* value) {
   value->last_use = last_use ? last_use->instr : nullptr;
 }
 
+bool ValueReductionPass::IsBlockLocal(Value* value) {
+  if (!value->def) {
+    // Constants and the like have no defining block.
+    return false;
+  }
+  auto use = value->use_head;
+  while (use) {
+    if (use->instr->block != value->def->block) {
+      return false;
+    }
+    use = use->next;
+  }
+  return true;
+}
+
 bool ValueReductionPass::Run(HIRBuilder* builder) {
-  // Walk each block and reuse variable ordinals as much as possible.
+  SCOPE_profile_cpu_f("cpu");
 
-  llvm::BitVector ordinals(builder->max_value_ordinal());
+  // Walk each block and reuse variable ordinals as much as possible.
+  // Values that flow between blocks (and constants, which have no defining
+  // instruction) keep a unique ordinal so that passes keyed on ordinals,
+  // such as DataFlowAnalysisPass, still see distinct values. Block-local
+  // values are packed above those and reused once their last use is seen.
 
+  // Mark everything unassigned.
   auto block = builder->first_block();
+  while (block) {
+    auto instr = block->instr_head;
+    while (instr) {
+      uint32_t signature = instr->opcode->signature;
+      if (GET_OPCODE_SIG_TYPE_DEST(signature) == OPCODE_SIG_TYPE_V) {
+        instr->dest->ordinal = UINT32_MAX;
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V) {
+        instr->src1.value->ordinal = UINT32_MAX;
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V) {
+        instr->src2.value->ordinal = UINT32_MAX;
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V) {
+        instr->src3.value->ordinal = UINT32_MAX;
+      }
+      instr = instr->next;
+    }
+    block = block->next;
+  }
+
+  // Assign unique ordinals to all values that are not block-local.
+  uint32_t global_count = 0;
+  block = builder->first_block();
+  while (block) {
+    auto instr = block->instr_head;
+    while (instr) {
+      uint32_t signature = instr->opcode->signature;
+#define ASSIGN_GLOBAL_ORDINAL(v)                      \
+  if (v->ordinal == UINT32_MAX && !IsBlockLocal(v)) { \
+    v->ordinal = global_count++;                      \
+  }
+      if (GET_OPCODE_SIG_TYPE_DEST(signature) == OPCODE_SIG_TYPE_V) {
+        ASSIGN_GLOBAL_ORDINAL(instr->dest);
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V) {
+        ASSIGN_GLOBAL_ORDINAL(instr->src1.value);
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V) {
+        ASSIGN_GLOBAL_ORDINAL(instr->src2.value);
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V) {
+        ASSIGN_GLOBAL_ORDINAL(instr->src3.value);
+      }
+#undef ASSIGN_GLOBAL_ORDINAL
+      instr = instr->next;
+    }
+    block = block->next;
+  }
+
+  auto& ordinals = ordinals_;
+  ordinals.clear();
+  ordinals.resize(builder->max_value_ordinal());
+  uint32_t max_local_count = 0;
+
+  block = builder->first_block();
   while (block) {
     // Reset used ordinals.
     ordinals.reset();
@@ -84,51 +163,38 @@ bool ValueReductionPass::Run(HIRBuilder* builder) {
       auto src1_type = GET_OPCODE_SIG_TYPE_SRC1(info->signature);
       auto src2_type = GET_OPCODE_SIG_TYPE_SRC2(info->signature);
       auto src3_type = GET_OPCODE_SIG_TYPE_SRC3(info->signature);
+#define RELEASE_LOCAL_ORDINAL(v)                                \
+  if (v->ordinal >= global_count && v->ordinal != UINT32_MAX) { \
+    if (v->last_use == instr) {                                 \
+      /* Available. */                                          \
+      ordinals.reset(v->ordinal - global_count);                \
+    }                                                           \
+  }
       if (src1_type == OPCODE_SIG_TYPE_V) {
-        auto v = instr->src1.value;
-        if (!v->last_use) {
-          ComputeLastUse(v);
-        }
-        if (v->last_use == instr) {
-          // Available.
-          if (!instr->src1.value->IsConstant()) {
-            ordinals.reset(v->ordinal);
-          }
-        }
+        RELEASE_LOCAL_ORDINAL(instr->src1.value);
       }
       if (src2_type == OPCODE_SIG_TYPE_V) {
-        auto v = instr->src2.value;
-        if (!v->last_use) {
-          ComputeLastUse(v);
-        }
-        if (v->last_use == instr) {
-          // Available.
-          if (!instr->src2.value->IsConstant()) {
-            ordinals.reset(v->ordinal);
-          }
-        }
+        RELEASE_LOCAL_ORDINAL(instr->src2.value);
       }
       if (src3_type == OPCODE_SIG_TYPE_V) {
-        auto v = instr->src3.value;
-        if (!v->last_use) {
-          ComputeLastUse(v);
-        }
-        if (v->last_use == instr) {
-          // Available.
-          if (!instr->src3.value->IsConstant()) {
-            ordinals.reset(v->ordinal);
-          }
-        }
+        RELEASE_LOCAL_ORDINAL(instr->src3.value);
       }
-      if (dest_type == OPCODE_SIG_TYPE_V) {
+#undef RELEASE_LOCAL_ORDINAL
+      if (dest_type == OPCODE_SIG_TYPE_V &&
+          instr->dest->ordinal == UINT32_MAX) {
         // Dest values are processed last, as they may be able to reuse a
         // source value ordinal.
         auto v = instr->dest;
+        ComputeLastUse(v);
         // Find a lower ordinal.
         for (auto n = 0u; n < ordinals.size(); n++) {
           if (!ordinals.test(n)) {
-            ordinals.set(n);
-            v->ordinal = n;
+            v->ordinal = global_count + n;
+            max_local_count = std::max(max_local_count, n + 1);
+            // Values without uses are dead immediately.
+            if (v->last_use) {
+              ordinals.set(n);
+            }
             break;
           }
         }
@@ -140,6 +206,9 @@ bool ValueReductionPass::Run(HIRBuilder* builder) {
     block = block->next;
   }
 
+  // New values allocated by later passes must not collide.
+  builder->set_max_value_ordinal(global_count + max_local_count);
+
   return true;
 }
 
@@ -10,8 +10,19 @@
 #ifndef XENIA_CPU_COMPILER_PASSES_VALUE_REDUCTION_PASS_H_
 #define XENIA_CPU_COMPILER_PASSES_VALUE_REDUCTION_PASS_H_
 
+#include "xenia/base/platform.h"
 #include "xenia/cpu/compiler/compiler_pass.h"
 
+#if XE_COMPILER_MSVC
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#pragma warning(disable : 4267)
+#include <llvm/ADT/BitVector.h>
+#pragma warning(pop)
+#else
+#include <llvm/ADT/BitVector.h>
+#endif  // XE_COMPILER_MSVC
+
 namespace xe {
 namespace cpu {
 namespace compiler {
@@ -22,10 +33,14 @@ class ValueReductionPass : public CompilerPass {
   ValueReductionPass();
   ~ValueReductionPass() override;
 
+  const char* name() const override { return "ValueReductionPass"; }
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
   void ComputeLastUse(hir::Value* value);
+  bool IsBlockLocal(hir::Value* value);
+
+  llvm::BitVector ordinals_;
 };
 
 }  // namespace passes
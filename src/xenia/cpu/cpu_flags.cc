@@ -17,6 +17,12 @@ DEFINE_string(
     "database.",
     "CPU");
 
+DEFINE_bool(analyze_functions_on_load, false,
+            "Find the functions of modules when they're loaded, on all cores, "
+            "and queue them for speculative compilation instead of only "
+            "discovering each when it's first called.",
+            "CPU");
+
 DEFINE_bool(disassemble_functions, false,
             "Disassemble functions during generation.", "CPU");
 
@@ -38,6 +44,41 @@ DEFINE_bool(
 DEFINE_bool(validate_hir, false,
             "Perform validation checks on the HIR during compilation.", "CPU");
 
+DEFINE_bool(tiered_compilation, false,
+            "Compile functions with a minimal set of optimizations first and "
+            "recompile them with all optimizations once they have been called "
+            "tiered_compilation_threshold times. Reduces the time spent "
+            "compiling code that only runs a few times.",
+            "CPU");
+DEFINE_int32(tiered_compilation_threshold, 1000,
+             "Number of calls after which a function is optimized when using "
+             "tiered_compilation.",
+             "CPU");
+
+DEFINE_bool(global_register_allocation, true,
+            "Keep values that are used across blocks in host registers for "
+            "their entire live range instead of passing them through stack "
+            "locals.",
+            "CPU");
+
+DEFINE_bool(recognize_memory_idioms, true,
+            "Recognize the memcpy and memset implementations titles link "
+            "statically and service their larger calls on the host, once the "
+            "guest code has been seen to produce the same results.",
+            "CPU");
+
+DEFINE_bool(invalidate_modified_code, false,
+            "Watch writable guest pages that code was compiled from, and "
+            "compile the functions again when the pages are written to "
+            "(overlays, self-modifying code). Titles writing data next to "
+            "their code fault on every such write, which is slow.",
+            "CPU");
+
+DEFINE_bool(reclaim_generated_code, true,
+            "Reuse the space of generated code replaced by recompilation once "
+            "no thread is running it anymore.",
+            "CPU");
+
 // Breakpoints:
 DEFINE_uint64(break_on_instruction, 0,
               "int3 before the given guest address is executed.", "CPU");
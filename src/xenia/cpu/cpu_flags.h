@@ -14,6 +14,7 @@
 DECLARE_string(cpu);
 
 DECLARE_string(load_module_map);
+DECLARE_bool(analyze_functions_on_load);
 
 DECLARE_bool(disassemble_functions);
 
@@ -26,6 +27,17 @@ DECLARE_bool(disable_global_lock);
 
 DECLARE_bool(validate_hir);
 
+DECLARE_bool(tiered_compilation);
+DECLARE_int32(tiered_compilation_threshold);
+
+DECLARE_bool(global_register_allocation);
+
+DECLARE_bool(recognize_memory_idioms);
+
+DECLARE_bool(invalidate_modified_code);
+
+DECLARE_bool(reclaim_generated_code);
+
 DECLARE_uint64(break_on_instruction);
 DECLARE_int32(break_condition_gpr);
 DECLARE_uint64(break_condition_value);
@@ -9,79 +9,143 @@
 
 #include "xenia/cpu/entry_table.h"
 
+#include <algorithm>
+
 #include "xenia/base/profiling.h"
 #include "xenia/base/threading.h"
 
 namespace xe {
 namespace cpu {
 
-EntryTable::EntryTable() = default;
+EntryTable::EntryTable() : pages_(new std::atomic<Page*>[kPageCount]) {
+  for (uint32_t i = 0; i < kPageCount; ++i) {
+    pages_[i].store(nullptr, std::memory_order_relaxed);
+  }
+}
 
 EntryTable::~EntryTable() {
-  auto global_lock = global_critical_region_.Acquire();
-  for (auto it : map_) {
-    Entry* entry = it.second;
-    delete entry;
+  for (uint32_t i = 0; i < kPageCount; ++i) {
+    Page* page = pages_[i].load(std::memory_order_acquire);
+    if (!page) {
+      continue;
+    }
+    for (uint32_t j = 0; j < kSlotsPerPage; ++j) {
+      delete page->slots[j].load(std::memory_order_relaxed);
+    }
+    delete page;
+  }
+}
+
+std::atomic<Entry*>* EntryTable::GetSlot(uint32_t address, bool create) {
+  if (address & ((1u << kSlotShift) - 1)) {
+    // Functions can't start at unaligned addresses.
+    return nullptr;
+  }
+  auto& page_ptr = pages_[address >> kPageShift];
+  Page* page = page_ptr.load(std::memory_order_acquire);
+  if (!page) {
+    if (!create) {
+      return nullptr;
+    }
+    Page* new_page = new Page();
+    for (uint32_t i = 0; i < kSlotsPerPage; ++i) {
+      new_page->slots[i].store(nullptr, std::memory_order_relaxed);
+    }
+    if (page_ptr.compare_exchange_strong(page, new_page,
+                                         std::memory_order_acq_rel,
+                                         std::memory_order_acquire)) {
+      page = new_page;
+    } else {
+      // Another thread beat us to it - page now holds its allocation.
+      delete new_page;
+    }
   }
+  uint32_t slot_index = (address & ((1u << kPageShift) - 1)) >> kSlotShift;
+  return &page->slots[slot_index];
 }
 
 Entry* EntryTable::Get(uint32_t address) {
-  auto global_lock = global_critical_region_.Acquire();
-  const auto& it = map_.find(address);
-  Entry* entry = it != map_.end() ? it->second : nullptr;
+  auto slot = GetSlot(address, false);
+  if (!slot) {
+    return nullptr;
+  }
+  Entry* entry = slot->load(std::memory_order_acquire);
   if (entry) {
     // TODO(benvanik): wait if needed?
-    if (entry->status != Entry::STATUS_READY) {
+    if (entry->status.load(std::memory_order_acquire) !=
+        Entry::STATUS_READY) {
       entry = nullptr;
     }
   }
   return entry;
 }
 
+bool EntryTable::Contains(uint32_t address) {
+  auto slot = GetSlot(address, false);
+  return slot && slot->load(std::memory_order_acquire) != nullptr;
+}
+
 Entry::Status EntryTable::GetOrCreate(uint32_t address, Entry** out_entry) {
-  // TODO(benvanik): replace with a map with wait-free for find.
-  // https://github.com/facebook/folly/blob/master/folly/AtomicHashMap.h
+  auto slot = GetSlot(address, true);
+  if (!slot) {
+    *out_entry = nullptr;
+    return Entry::STATUS_FAILED;
+  }
 
-  auto global_lock = global_critical_region_.Acquire();
-  const auto& it = map_.find(address);
-  Entry* entry = it != map_.end() ? it->second : nullptr;
-  Entry::Status status;
-  if (entry) {
-    // If we aren't ready yet spin and wait.
-    if (entry->status == Entry::STATUS_COMPILING) {
-      // Still compiling, so spin.
-      do {
-        global_lock.unlock();
-        // TODO(benvanik): sleep for less time?
-        xe::threading::Sleep(std::chrono::microseconds(10));
-        global_lock.lock();
-      } while (entry->status == Entry::STATUS_COMPILING);
+  Entry* entry = slot->load(std::memory_order_acquire);
+  if (!entry) {
+    // Create and try to publish for initialization. Whoever wins the CAS owns
+    // compilation of the function; everyone else waits on it below.
+    auto new_entry = new Entry();
+    new_entry->address = address;
+    new_entry->end_address = 0;
+    new_entry->status.store(Entry::STATUS_COMPILING, std::memory_order_relaxed);
+    new_entry->function = nullptr;
+    if (slot->compare_exchange_strong(entry, new_entry,
+                                      std::memory_order_acq_rel,
+                                      std::memory_order_acquire)) {
+      *out_entry = new_entry;
+      return Entry::STATUS_NEW;
     }
-    status = entry->status;
-  } else {
-    // Create and return for initialization.
-    entry = new Entry();
-    entry->address = address;
-    entry->end_address = 0;
-    entry->status = Entry::STATUS_COMPILING;
-    entry->function = 0;
-    map_[address] = entry;
-    status = Entry::STATUS_NEW;
+    delete new_entry;
+  }
+
+  // If we aren't ready yet spin and wait.
+  Entry::Status status = entry->status.load(std::memory_order_acquire);
+  while (status == Entry::STATUS_COMPILING) {
+    // TODO(benvanik): sleep for less time?
+    xe::threading::Sleep(std::chrono::microseconds(10));
+    status = entry->status.load(std::memory_order_acquire);
   }
-  global_lock.unlock();
   *out_entry = entry;
   return status;
 }
 
+void EntryTable::MarkReady(Entry* entry, Function* function,
+                           uint32_t end_address) {
+  entry->function = function;
+  entry->end_address = end_address;
+  entry->status.store(Entry::STATUS_READY, std::memory_order_release);
+  std::lock_guard<std::mutex> lock(ready_entries_mutex_);
+  ready_entries_.emplace(entry->address, entry);
+  if (end_address > entry->address) {
+    max_ready_entry_span_ =
+        std::max(max_ready_entry_span_, end_address - entry->address);
+  }
+}
+
 std::vector<Function*> EntryTable::FindWithAddress(uint32_t address) {
-  auto global_lock = global_critical_region_.Acquire();
   std::vector<Function*> fns;
-  for (auto& it : map_) {
-    Entry* entry = it.second;
-    if (address >= entry->address && address <= entry->end_address) {
-      if (entry->status == Entry::STATUS_READY) {
-        fns.push_back(entry->function);
-      }
+  std::lock_guard<std::mutex> lock(ready_entries_mutex_);
+  auto it = ready_entries_.upper_bound(address);
+  while (it != ready_entries_.begin()) {
+    --it;
+    Entry* entry = it->second;
+    if (address - entry->address > max_ready_entry_span_) {
+      break;
+    }
+    if (address <= entry->end_address) {
+      fns.push_back(entry->function);
     }
   }
   return fns;
@@ -10,11 +10,13 @@
 #ifndef XENIA_CPU_ENTRY_TABLE_H_
 #define XENIA_CPU_ENTRY_TABLE_H_
 
-#include <unordered_map>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <vector>
 
-#include "xenia/base/mutex.h"
-
 namespace xe {
 namespace cpu {
 
@@ -30,24 +32,54 @@ typedef struct Entry_t {
 
   uint32_t address;
   uint32_t end_address;
-  Status status;
+  // Published last (release) so readers observing STATUS_READY also observe
+  // function and end_address.
+  std::atomic<Status> status;
   Function* function;
 } Entry;
 
+// Sparse two-level table mapping guest function addresses to entries.
+// The first level is indexed by the upper bits of the address and points at
+// lazily-allocated pages of entry slots. Lookups are lock-free and insertion
+// races are resolved with a compare-and-swap on the slot, so only the thread
+// that wins the slot is told to compile the function. Ready entries are also
+// indexed by address under a lock for the rarer lookups of functions
+// containing an address.
 class EntryTable {
  public:
   EntryTable();
   ~EntryTable();
 
   Entry* Get(uint32_t address);
+  // Returns true if an entry exists in any state, including compiling.
+  bool Contains(uint32_t address);
   Entry::Status GetOrCreate(uint32_t address, Entry** out_entry);
+  // Publishes the function of an entry GetOrCreate returned as new.
+  void MarkReady(Entry* entry, Function* function, uint32_t end_address);
 
   std::vector<Function*> FindWithAddress(uint32_t address);
 
  private:
-  xe::global_critical_region global_critical_region_;
-  // TODO(benvanik): replace with a better data structure.
-  std::unordered_map<uint32_t, Entry*> map_;
+  // Guest instructions are 4b aligned so the low 2 bits are never part of the
+  // key. Each page covers 64KB of guest address space.
+  static constexpr uint32_t kPageShift = 16;
+  static constexpr uint32_t kPageCount = 1u << (32 - kPageShift);
+  static constexpr uint32_t kSlotShift = 2;
+  static constexpr uint32_t kSlotsPerPage = 1u << (kPageShift - kSlotShift);
+
+  struct Page {
+    std::atomic<Entry*> slots[kSlotsPerPage];
+  };
+
+  std::atomic<Entry*>* GetSlot(uint32_t address, bool create);
+
+  std::unique_ptr<std::atomic<Page*>[]> pages_;
+
+  // Ready entries by start address. Lookups only need to visit the entries
+  // starting up to the largest span below the address.
+  std::mutex ready_entries_mutex_;
+  std::map<uint32_t, Entry*> ready_entries_;
+  uint32_t max_ready_entry_span_ = 0;
 };
 
 }  // namespace cpu
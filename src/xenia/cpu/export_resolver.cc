@@ -9,6 +9,9 @@
 
 #include "xenia/cpu/export_resolver.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "xenia/base/assert.h"
 #include "xenia/base/math.h"
 #include "xenia/base/string.h"
@@ -16,6 +19,12 @@
 namespace xe {
 namespace cpu {
 
+namespace {
+bool CompareExportNames(const Export* a, const Export* b) {
+  return std::strcmp(a->name, b->name) < 0;
+}
+}  // namespace
+
 ExportResolver::Table::Table(const std::string_view module_name,
                              const std::vector<Export*>* exports_by_ordinal)
     : exports_by_ordinal_(exports_by_ordinal) {
@@ -28,9 +37,8 @@ ExportResolver::Table::Table(const std::string_view module_name,
       exports_by_name_.push_back(export_entry);
     }
   }
-  std::sort(
-      exports_by_name_.begin(), exports_by_name_.end(),
-      [](Export* a, Export* b) { return std::strcmp(a->name, b->name) <= 0; });
+  std::sort(exports_by_name_.begin(), exports_by_name_.end(),
+            CompareExportNames);
 }
 
 ExportResolver::ExportResolver() = default;
@@ -42,31 +50,35 @@ void ExportResolver::RegisterTable(
     const std::vector<xe::cpu::Export*>* exports) {
   tables_.emplace_back(module_name, exports);
 
-  all_exports_by_name_.reserve(all_exports_by_name_.size() + exports->size());
-  for (size_t i = 0; i < exports->size(); ++i) {
-    auto export_entry = exports->at(i);
-    if (export_entry) {
-      all_exports_by_name_.push_back(export_entry);
-    }
-  }
-  std::sort(
-      all_exports_by_name_.begin(), all_exports_by_name_.end(),
-      [](Export* a, Export* b) { return std::strcmp(a->name, b->name) <= 0; });
+  // The names of the new table are already sorted, merge them instead of
+  // sorting everything again.
+  const std::vector<Export*>& table_exports_by_name =
+      tables_.back().exports_by_name();
+  size_t old_size = all_exports_by_name_.size();
+  all_exports_by_name_.insert(all_exports_by_name_.end(),
+                              table_exports_by_name.cbegin(),
+                              table_exports_by_name.cend());
+  std::inplace_merge(all_exports_by_name_.begin(),
+                     all_exports_by_name_.begin() + old_size,
+                     all_exports_by_name_.end(), CompareExportNames);
 }
 
-Export* ExportResolver::GetExportByOrdinal(const std::string_view module_name,
-                                           uint16_t ordinal) {
+const ExportResolver::Table* ExportResolver::GetTable(
+    const std::string_view module_name) const {
   for (const auto& table : tables_) {
     if (xe::utf8::starts_with_case(module_name, table.module_name())) {
-      if (ordinal >= table.exports_by_ordinal().size()) {
-        return nullptr;
-      }
-      return table.exports_by_ordinal().at(ordinal);
+      return &table;
     }
   }
   return nullptr;
 }
 
+Export* ExportResolver::GetExportByOrdinal(const std::string_view module_name,
+                                           uint16_t ordinal) {
+  const Table* table = GetTable(module_name);
+  return table ? table->GetExportByOrdinal(ordinal) : nullptr;
+}
+
 void ExportResolver::SetVariableMapping(const std::string_view module_name,
                                         uint16_t ordinal, uint32_t value) {
   auto export_entry = GetExportByOrdinal(module_name, ordinal);
@@ -128,6 +128,14 @@ class ExportResolver {
       return exports_by_name_;
     }
 
+    // Ordinals are dense, so the ordinal table is indexed directly.
+    Export* GetExportByOrdinal(uint16_t ordinal) const {
+      if (ordinal >= exports_by_ordinal_->size()) {
+        return nullptr;
+      }
+      return (*exports_by_ordinal_)[ordinal];
+    }
+
    private:
     std::string module_name_;
     const std::vector<Export*>* exports_by_ordinal_ = nullptr;
@@ -144,6 +152,11 @@ class ExportResolver {
     return all_exports_by_name_;
   }
 
+  // Finds the table of the module, so the exports of a library can be looked
+  // up without matching the module name for every import. Valid until the next
+  // RegisterTable.
+  const Table* GetTable(const std::string_view module_name) const;
+
   Export* GetExportByOrdinal(const std::string_view module_name,
                              uint16_t ordinal);
 
@@ -9,6 +9,8 @@
 
 #include "xenia/cpu/function.h"
 
+#include <algorithm>
+
 #include "xenia/base/logging.h"
 #include "xenia/cpu/symbol.h"
 #include "xenia/cpu/thread_state.h"
@@ -91,24 +93,31 @@ const SourceMapEntry* GuestFunction::LookupHIROffset(uint32_t offset) const {
 
 const SourceMapEntry* GuestFunction::LookupMachineCodeOffset(
     uint32_t offset) const {
+  return LookupMachineCodeOffset(source_map_, offset);
+}
+
+const SourceMapEntry* GuestFunction::LookupMachineCodeOffset(
+    const std::vector<SourceMapEntry>& source_map, uint32_t offset) {
   // TODO(benvanik): binary search? We know the list is sorted by code order.
-  for (int64_t i = source_map_.size() - 1; i >= 0; --i) {
-    const auto& entry = source_map_[i];
+  for (int64_t i = source_map.size() - 1; i >= 0; --i) {
+    const auto& entry = source_map[i];
     if (entry.code_offset <= offset) {
       return &entry;
     }
   }
-  return source_map_.empty() ? nullptr : &source_map_[0];
+  return source_map.empty() ? nullptr : &source_map[0];
 }
 
 uint32_t GuestFunction::MapGuestAddressToMachineCodeOffset(
     uint32_t guest_address) const {
+  std::lock_guard<std::mutex> lock(machine_code_lock_);
   auto entry = LookupGuestAddress(guest_address);
   return entry ? entry->code_offset : 0;
 }
 
 uintptr_t GuestFunction::MapGuestAddressToMachineCode(
     uint32_t guest_address) const {
+  std::lock_guard<std::mutex> lock(machine_code_lock_);
   auto entry = LookupGuestAddress(guest_address);
   return reinterpret_cast<uintptr_t>(machine_code()) +
          (entry ? entry->code_offset : 0);
@@ -116,11 +125,35 @@ uintptr_t GuestFunction::MapGuestAddressToMachineCode(
 
 uint32_t GuestFunction::MapMachineCodeToGuestAddress(
     uintptr_t host_address) const {
+  std::lock_guard<std::mutex> lock(machine_code_lock_);
+  // Offsets are relative to the code the address is in, which may have been
+  // replaced already.
+  for (const RetiredMachineCode& retired : retired_machine_code_) {
+    uintptr_t retired_address =
+        reinterpret_cast<uintptr_t>(retired.machine_code);
+    if (host_address >= retired_address &&
+        host_address - retired_address < retired.machine_code_length) {
+      auto entry = LookupMachineCodeOffset(
+          retired.source_map,
+          static_cast<uint32_t>(host_address - retired_address));
+      return entry ? entry->guest_address : address();
+    }
+  }
   auto entry = LookupMachineCodeOffset(static_cast<uint32_t>(
       host_address - reinterpret_cast<uintptr_t>(machine_code())));
   return entry ? entry->guest_address : address();
 }
 
+void GuestFunction::ForgetRetiredMachineCode(const uint8_t* machine_code) {
+  std::lock_guard<std::mutex> lock(machine_code_lock_);
+  retired_machine_code_.erase(
+      std::remove_if(retired_machine_code_.begin(), retired_machine_code_.end(),
+                     [machine_code](const RetiredMachineCode& retired) {
+                       return retired.machine_code == machine_code;
+                     }),
+      retired_machine_code_.end());
+}
+
 bool GuestFunction::Call(ThreadState* thread_state, uint32_t return_address) {
   // SCOPE_profile_cpu_f("cpu");
 
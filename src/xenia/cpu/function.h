@@ -10,7 +10,9 @@
 #ifndef XENIA_CPU_FUNCTION_H_
 #define XENIA_CPU_FUNCTION_H_
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include "xenia/cpu/function_debug_info.h"
@@ -116,31 +118,77 @@ class GuestFunction : public Function {
     debug_info_ = std::move(debug_info);
   }
   FunctionTraceData& trace_data() { return trace_data_; }
-  std::vector<SourceMapEntry>& source_map() { return source_map_; }
+  // Source map of the current machine code. Replaced when the function is
+  // recompiled, so only usable by the thread recompiling it.
+  const std::vector<SourceMapEntry>& source_map() const { return source_map_; }
 
   ExternHandler extern_handler() const { return extern_handler_; }
   Export* export_data() const { return export_data_; }
   void SetupExtern(ExternHandler handler, Export* export_data = nullptr);
 
+  // Whether the current machine code is the baseline tier, which counts its
+  // entries down in tier_up_countdown and gets replaced once it's hot.
+  bool is_baseline_tier() const { return baseline_tier_; }
+  void set_baseline_tier(bool value) { baseline_tier_ = value; }
+  int32_t* tier_up_countdown() { return &tier_up_countdown_; }
+  bool tier_up_started() const { return tier_up_started_; }
+  // Returns true for the first caller only.
+  bool BeginTierUp() { return !tier_up_started_.exchange(true); }
+
+  // Whether generated code of the function has trapped on MMIO accesses. The
+  // accesses are emitted as checked MMIO accesses when it's recompiled.
+  bool has_mmio_access_sites() const { return has_mmio_access_sites_; }
+  void set_has_mmio_access_sites() { has_mmio_access_sites_ = true; }
+
+  // Whether the guest code the machine code was generated from has been
+  // modified since. The function is compiled again when it's next resolved.
+  bool is_code_invalidated() const { return code_invalidated_; }
+  void set_code_invalidated(bool value) { code_invalidated_ = value; }
+
   const SourceMapEntry* LookupGuestAddress(uint32_t guest_address) const;
   const SourceMapEntry* LookupHIROffset(uint32_t offset) const;
   const SourceMapEntry* LookupMachineCodeOffset(uint32_t offset) const;
 
+  // Safe while the function is being recompiled. Host addresses in machine
+  // code replaced by a recompilation are mapped until the code is freed.
   uint32_t MapGuestAddressToMachineCodeOffset(uint32_t guest_address) const;
   uintptr_t MapGuestAddressToMachineCode(uint32_t guest_address) const;
   uint32_t MapMachineCodeToGuestAddress(uintptr_t host_address) const;
 
+  // Drops the source map of replaced machine code once the code is freed.
+  void ForgetRetiredMachineCode(const uint8_t* machine_code);
+
   bool Call(ThreadState* thread_state, uint32_t return_address) override;
 
  protected:
   virtual bool CallImpl(ThreadState* thread_state, uint32_t return_address) = 0;
 
+  static const SourceMapEntry* LookupMachineCodeOffset(
+      const std::vector<SourceMapEntry>& source_map, uint32_t offset);
+
+  // Machine code replaced by a recompilation, which threads may still be
+  // running, and exception handlers may need to map addresses in.
+  struct RetiredMachineCode {
+    const uint8_t* machine_code;
+    size_t machine_code_length;
+    std::vector<SourceMapEntry> source_map;
+  };
+
  protected:
   std::unique_ptr<FunctionDebugInfo> debug_info_;
   FunctionTraceData trace_data_;
+  // Guards the machine code, its source map and the retired machine code
+  // against recompilations on other threads.
+  mutable std::mutex machine_code_lock_;
   std::vector<SourceMapEntry> source_map_;
+  std::vector<RetiredMachineCode> retired_machine_code_;
   ExternHandler extern_handler_ = nullptr;
   Export* export_data_ = nullptr;
+  std::atomic<bool> baseline_tier_ = false;
+  std::atomic<bool> tier_up_started_ = false;
+  std::atomic<bool> has_mmio_access_sites_ = false;
+  std::atomic<bool> code_invalidated_ = false;
+  int32_t tier_up_countdown_ = 0;
 };
 
 }  // namespace cpu
@@ -28,6 +28,8 @@ namespace hir {
 
 enum FunctionAttributes {
   FUNCTION_ATTRIB_INLINE = (1 << 1),
+  // Contains code of other guest functions emitted in place of calls.
+  FUNCTION_ATTRIB_HAS_INLINED_CALLS = (1 << 2),
 };
 
 class HIRBuilder {
@@ -49,6 +51,7 @@ class HIRBuilder {
   std::vector<Value*>& locals() { return locals_; }
 
   uint32_t max_value_ordinal() const { return next_value_ordinal_; }
+  void set_max_value_ordinal(uint32_t value) { next_value_ordinal_ = value; }
 
   Block* first_block() const { return block_head_; }
   Block* last_block() const { return block_tail_; }
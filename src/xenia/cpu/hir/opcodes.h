@@ -37,6 +37,9 @@ enum RoundMode {
 
 enum LoadStoreFlags {
   LOAD_STORE_BYTE_SWAP = 1 << 0,
+  // The 32-bit access has been seen accessing MMIO, check for it instead of
+  // relying on the access trapping.
+  LOAD_STORE_CHECK_MMIO = 1 << 1,
 };
 
 enum CacheControlType {
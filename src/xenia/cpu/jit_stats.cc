@@ -0,0 +1,120 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/jit_stats.h"
+
+#include <algorithm>
+
+#include "xenia/base/clock.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+
+namespace xe {
+namespace cpu {
+
+namespace {
+
+const char* const kStageNames[] = {
+    "scan",
+    "emit hir",
+    "compile",
+    "assemble",
+};
+static_assert(xe::countof(kStageNames) == size_t(JitStats::Stage::kCount),
+              "Stage name count mismatch");
+
+}  // namespace
+
+void JitStats::Translation::Reset() {
+  for (auto& stage : stages) {
+    stage = Counter();
+  }
+  passes.clear();
+}
+
+void JitStats::Translation::AddPass(const char* name, uint64_t ticks,
+                                    uint64_t bytes) {
+  passes.emplace_back(name, Counter());
+  passes.back().second.Add(ticks, bytes);
+}
+
+JitStats::JitStats()
+    : tick_frequency_(std::max(Clock::QueryHostTickFrequency(), uint64_t(1))) {}
+
+void JitStats::AddTranslation(uint32_t guest_address,
+                              const Translation& translation) {
+  uint64_t ticks = 0;
+  for (const auto& stage : translation.stages) {
+    ticks += stage.ticks;
+  }
+
+  std::lock_guard<std::mutex> lock(lock_);
+  for (size_t i = 0; i < size_t(Stage::kCount); ++i) {
+    if (translation.stages[i].count) {
+      stages_[i].Add(translation.stages[i]);
+    }
+  }
+  for (const auto& pass : translation.passes) {
+    auto it = pass_indices_.find(pass.first);
+    if (it == pass_indices_.end()) {
+      it = pass_indices_.emplace(pass.first, passes_.size()).first;
+      passes_.emplace_back(pass.first, Counter());
+    }
+    passes_[it->second].second.Add(pass.second);
+  }
+  auto& function = functions_[guest_address];
+  ++function.translation_count;
+  function.ticks += ticks;
+  function.max_ticks = std::max(function.max_ticks, ticks);
+}
+
+void JitStats::Dump(size_t function_count) {
+  std::lock_guard<std::mutex> lock(lock_);
+  if (functions_.empty()) {
+    return;
+  }
+  auto to_ms = [this](uint64_t ticks) {
+    return double(ticks) * 1000.0 / double(tick_frequency_);
+  };
+  auto log_counter = [&to_ms](const char* prefix, const std::string& name,
+                              const Counter& counter) {
+    XELOGI("{}{:<32} {:8} runs {:10.2f} ms {:8.3f} ms/run {:12} bytes", prefix,
+           name, counter.count, to_ms(counter.ticks),
+           counter.count ? to_ms(counter.ticks) / counter.count : 0.0,
+           counter.bytes);
+  };
+
+  XELOGI("JIT statistics for {} guest functions:", functions_.size());
+  for (size_t i = 0; i < size_t(Stage::kCount); ++i) {
+    log_counter("  ", kStageNames[i], stages_[i]);
+    if (Stage(i) == Stage::kCompile) {
+      for (const auto& pass : passes_) {
+        log_counter("    ", pass.first, pass.second);
+      }
+    }
+  }
+
+  std::vector<std::pair<uint32_t, FunctionCounters>> functions(
+      functions_.begin(), functions_.end());
+  function_count = std::min(function_count, functions.size());
+  std::partial_sort(functions.begin(), functions.begin() + function_count,
+                    functions.end(), [](const auto& a, const auto& b) {
+                      return a.second.ticks > b.second.ticks;
+                    });
+  XELOGI("Slowest guest functions to translate:");
+  for (size_t i = 0; i < function_count; ++i) {
+    const auto& function = functions[i].second;
+    XELOGI("  {:08X} {:4} translations {:10.2f} ms {:8.3f} ms max",
+           functions[i].first, function.translation_count,
+           to_ms(function.ticks), to_ms(function.max_ticks));
+  }
+}
+
+}  // namespace cpu
+}  // namespace xe
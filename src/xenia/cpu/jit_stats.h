@@ -0,0 +1,93 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_JIT_STATS_H_
+#define XENIA_CPU_JIT_STATS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace xe {
+namespace cpu {
+
+// Wall time and memory use of each stage of the guest code translator,
+// aggregated over all translations and per guest function.
+class JitStats {
+ public:
+  enum class Stage {
+    kScan,
+    kEmitHir,
+    kCompile,
+    kAssemble,
+    kCount,
+  };
+
+  struct Counter {
+    uint64_t count = 0;
+    uint64_t ticks = 0;
+    // HIR arena growth for the frontend and the passes, code size for the
+    // assembler.
+    uint64_t bytes = 0;
+
+    void Add(uint64_t add_ticks, uint64_t add_bytes) {
+      ++count;
+      ticks += add_ticks;
+      bytes += add_bytes;
+    }
+    void Add(const Counter& other) {
+      count += other.count;
+      ticks += other.ticks;
+      bytes += other.bytes;
+    }
+  };
+
+  // Measurements of a single translation, filled in by the translator and
+  // the compiler without any locking and handed over by AddTranslation.
+  struct Translation {
+    Counter stages[size_t(Stage::kCount)];
+    std::vector<std::pair<const char*, Counter>> passes;
+
+    void Reset();
+    void AddPass(const char* name, uint64_t ticks, uint64_t bytes);
+  };
+
+  JitStats();
+
+  void AddTranslation(uint32_t guest_address, const Translation& translation);
+
+  // Logs the totals of every stage and pass, and the guest functions that
+  // took longest to translate.
+  void Dump(size_t function_count);
+
+ private:
+  struct FunctionCounters {
+    uint64_t translation_count = 0;
+    uint64_t ticks = 0;
+    uint64_t max_ticks = 0;
+  };
+
+  std::mutex lock_;
+  uint64_t tick_frequency_;
+  Counter stages_[size_t(Stage::kCount)];
+  // Passes appear in the order they first ran.
+  std::vector<std::pair<std::string, Counter>> passes_;
+  std::map<std::string, size_t> pass_indices_;
+  std::unordered_map<uint32_t, FunctionCounters> functions_;
+};
+
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_JIT_STATS_H_
@@ -26,6 +26,8 @@ typedef struct mspack_memory_file_t {
   void* buffer;
   off_t buffer_size;
   off_t offset;
+  // If not null, reads are forwarded to it instead of the buffer.
+  const std::function<int(void*, int)>* read_callback;
 } mspack_memory_file;
 
 mspack_memory_file* mspack_memory_open(mspack_system* sys, void* buffer,
@@ -52,6 +54,9 @@ void mspack_memory_close(mspack_memory_file* file) {
 
 int mspack_memory_read(mspack_file* file, void* buffer, int chars) {
   auto memfile = (mspack_memory_file*)file;
+  if (memfile->read_callback) {
+    return (*memfile->read_callback)(buffer, chars);
+  }
   const off_t remaining = memfile->buffer_size - memfile->offset;
   const off_t total = std::min(static_cast<off_t>(chars), remaining);
   std::memcpy(buffer, (uint8_t*)memfile->buffer + memfile->offset, total);
@@ -145,6 +150,43 @@ int lzx_decompress(const void* lzx_data, size_t lzx_len, void* dest,
   return result_code;
 }
 
+int lzx_decompress_stream(
+    const std::function<int(void* buffer, int length)>& read, void* dest,
+    size_t dest_len, uint32_t window_size) {
+  int result_code = 1;
+
+  uint32_t window_bits;
+  if (!xe::bit_scan_forward(window_size, &window_bits)) {
+    return result_code;
+  }
+
+  mspack_system* sys = mspack_memory_sys_create();
+  mspack_memory_file* lzxsrc = mspack_memory_open(sys, nullptr, 0);
+  mspack_memory_file* lzxdst = mspack_memory_open(sys, dest, dest_len);
+  if (lzxsrc && lzxdst) {
+    lzxsrc->read_callback = &read;
+    lzxd_stream* lzxd =
+        lzxd_init(sys, (mspack_file*)lzxsrc, (mspack_file*)lzxdst, window_bits,
+                  0, 0x8000, (off_t)dest_len, 0);
+    if (lzxd) {
+      result_code = lzxd_decompress(lzxd, (off_t)dest_len);
+      lzxd_free(lzxd);
+    }
+  }
+
+  if (lzxsrc) {
+    mspack_memory_close(lzxsrc);
+  }
+  if (lzxdst) {
+    mspack_memory_close(lzxdst);
+  }
+  if (sys) {
+    mspack_memory_sys_destroy(sys);
+  }
+
+  return result_code;
+}
+
 int lzxdelta_apply_patch(xe::xex2_delta_patch* patch, size_t patch_len,
                          uint32_t window_size, void* dest) {
   void* patch_end = (char*)patch + patch_len;
@@ -10,6 +10,7 @@
 #ifndef XENIA_CPU_LZX_H_
 #define XENIA_CPU_LZX_H_
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -23,6 +24,13 @@ int lzx_decompress(const void* lzx_data, size_t lzx_len, void* dest,
                    size_t dest_len, uint32_t window_size, void* window_data,
                    size_t window_data_len);
 
+// Decompresses data pulled from read as the decoder needs it. read fills up to
+// length bytes of the buffer and returns how many it has placed there, which
+// may be less than requested, 0 at the end of the data or -1 on failure.
+int lzx_decompress_stream(
+    const std::function<int(void* buffer, int length)>& read, void* dest,
+    size_t dest_len, uint32_t window_size);
+
 int lzxdelta_apply_patch(xe::xex2_delta_patch* patch, size_t patch_len,
                          uint32_t window_size, void* dest);
 
@@ -60,7 +60,9 @@ MMIOHandler::MMIOHandler(uint8_t* virtual_membase, uint8_t* physical_membase,
       host_to_guest_virtual_(host_to_guest_virtual),
       host_to_guest_virtual_context_(host_to_guest_virtual_context),
       access_violation_callback_(access_violation_callback),
-      access_violation_callback_context_(access_violation_callback_context) {}
+      access_violation_callback_context_(access_violation_callback_context) {
+  page_ranges_.resize(kMMIOPageCount);
+}
 
 MMIOHandler::~MMIOHandler() {
   ExceptionHandler::Uninstall(ExceptionCallbackThunk, this);
@@ -73,6 +75,11 @@ bool MMIOHandler::RegisterRange(uint32_t virtual_address, uint32_t mask,
                                 uint32_t size, void* context,
                                 MMIOReadCallback read_callback,
                                 MMIOWriteCallback write_callback) {
+  assert_true(virtual_address >= kMMIOWindowBase &&
+              virtual_address - kMMIOWindowBase + size <= kMMIOWindowSize);
+  if (mapped_ranges_.size() >= kMMIOPageNeedsScan - 1) {
+    return false;
+  }
   mapped_ranges_.push_back({
       virtual_address,
       mask,
@@ -81,10 +88,40 @@ bool MMIOHandler::RegisterRange(uint32_t virtual_address, uint32_t mask,
       read_callback,
       write_callback,
   });
+
+  // Fill the pages this range covers that aren't taken by an earlier range,
+  // matching the order of ScanRanges.
+  auto entry = static_cast<uint16_t>(mapped_ranges_.size());
+  const uint32_t page_mask = ~((uint32_t(1) << kMMIOPageShift) - 1);
+  for (uint32_t i = 0; i < kMMIOPageCount; ++i) {
+    uint32_t page_address = kMMIOWindowBase + (i << kMMIOPageShift);
+    if ((page_address & mask & page_mask) !=
+        (virtual_address & mask & page_mask)) {
+      continue;
+    }
+    if (mask & ~page_mask) {
+      // Only part of the page may belong to the range.
+      page_ranges_[i] = kMMIOPageNeedsScan;
+    } else if (!page_ranges_[i]) {
+      page_ranges_[i] = entry;
+    }
+  }
   return true;
 }
 
 MMIORange* MMIOHandler::LookupRange(uint32_t virtual_address) {
+  uint32_t window_offset = virtual_address - kMMIOWindowBase;
+  if (window_offset >= kMMIOWindowSize) {
+    return nullptr;
+  }
+  uint16_t entry = page_ranges_[window_offset >> kMMIOPageShift];
+  if (entry == kMMIOPageNeedsScan) {
+    return ScanRanges(virtual_address);
+  }
+  return entry ? &mapped_ranges_[entry - 1] : nullptr;
+}
+
+MMIORange* MMIOHandler::ScanRanges(uint32_t virtual_address) {
   for (auto& range : mapped_ranges_) {
     if ((virtual_address & range.mask) == range.address) {
       return &range;
@@ -93,25 +130,30 @@ MMIORange* MMIOHandler::LookupRange(uint32_t virtual_address) {
   return nullptr;
 }
 
+void MMIOHandler::SetAccessSiteCallback(AccessSiteCallback callback,
+                                        void* context) {
+  auto lock = global_critical_region_.Acquire();
+  access_site_callback_ = callback;
+  access_site_callback_context_ = context;
+}
+
 bool MMIOHandler::CheckLoad(uint32_t virtual_address, uint32_t* out_value) {
-  for (const auto& range : mapped_ranges_) {
-    if ((virtual_address & range.mask) == range.address) {
-      *out_value = static_cast<uint32_t>(
-          range.read(nullptr, range.callback_context, virtual_address));
-      return true;
-    }
+  const MMIORange* range = LookupRange(virtual_address);
+  if (!range) {
+    return false;
   }
-  return false;
+  *out_value = static_cast<uint32_t>(
+      range->read(nullptr, range->callback_context, virtual_address));
+  return true;
 }
 
 bool MMIOHandler::CheckStore(uint32_t virtual_address, uint32_t value) {
-  for (const auto& range : mapped_ranges_) {
-    if ((virtual_address & range.mask) == range.address) {
-      range.write(nullptr, range.callback_context, virtual_address, value);
-      return true;
-    }
+  const MMIORange* range = LookupRange(virtual_address);
+  if (!range) {
+    return false;
   }
-  return false;
+  range->write(nullptr, range->callback_context, virtual_address, value);
+  return true;
 }
 
 struct DecodedMov {
@@ -297,19 +339,12 @@ bool MMIOHandler::ExceptionCallback(Exception* ex) {
   }
   void* fault_host_address = reinterpret_cast<void*>(ex->fault_address());
 
-  // Access violations are pretty rare, so we can do a linear search here.
   // Only check if in the virtual range, as we only support virtual ranges.
   const MMIORange* range = nullptr;
   if (ex->fault_address() < uint64_t(physical_membase_)) {
     uint32_t fault_virtual_address = host_to_guest_virtual_(
         host_to_guest_virtual_context_, fault_host_address);
-    for (const auto& test_range : mapped_ranges_) {
-      if ((fault_virtual_address & test_range.mask) == test_range.address) {
-        // Address is within the range of this mapping.
-        range = &test_range;
-        break;
-      }
-    }
+    range = LookupRange(fault_virtual_address);
   }
   if (!range) {
     // Recheck if the pages are still protected (race condition - another thread
@@ -372,6 +407,12 @@ bool MMIOHandler::ExceptionCallback(Exception* ex) {
                  static_cast<uint32_t>(ex->fault_address()), value);
   }
 
+  // Let the owner of the code avoid the fault for this access next time.
+  if (access_site_callback_) {
+    access_site_callback_(access_site_callback_context_,
+                          reinterpret_cast<void*>(rip));
+  }
+
   // Advance RIP to the next instruction so that we resume properly.
   ex->set_resume_pc(rip + mov.length);
 
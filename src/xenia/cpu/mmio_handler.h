@@ -29,6 +29,11 @@ typedef uint32_t (*MMIOReadCallback)(void* ppc_context, void* callback_context,
 typedef void (*MMIOWriteCallback)(void* ppc_context, void* callback_context,
                                   uint32_t addr, uint32_t value);
 
+// All MMIO ranges are mapped within this window of the guest virtual address
+// space, so generated code can tell possible MMIO accesses apart cheaply.
+constexpr uint32_t kMMIOWindowBase = 0x7F000000;
+constexpr uint32_t kMMIOWindowSize = 0x01000000;
+
 struct MMIORange {
   uint32_t address;
   uint32_t mask;
@@ -48,6 +53,9 @@ class MMIOHandler {
   typedef bool (*AccessViolationCallback)(
       std::unique_lock<std::recursive_mutex> global_lock_locked_once,
       void* context, void* host_address, bool is_write);
+  // Called after an access from host code at host_pc trapped and has been
+  // serviced, so that the code can be changed to not fault the next time.
+  typedef void (*AccessSiteCallback)(void* context, void* host_pc);
 
   // access_violation_callback is called with global_critical_region locked once
   // on the thread, so if multiple threads trigger an access violation in the
@@ -65,6 +73,8 @@ class MMIOHandler {
                      MMIOWriteCallback write_callback);
   MMIORange* LookupRange(uint32_t virtual_address);
 
+  void SetAccessSiteCallback(AccessSiteCallback callback, void* context);
+
   bool CheckLoad(uint32_t virtual_address, uint32_t* out_value);
   bool CheckStore(uint32_t virtual_address, uint32_t value);
 
@@ -78,11 +88,23 @@ class MMIOHandler {
   static bool ExceptionCallbackThunk(Exception* ex, void* data);
   bool ExceptionCallback(Exception* ex);
 
+  // Granularity of the range lookup table.
+  static constexpr uint32_t kMMIOPageShift = 12;
+  static constexpr uint32_t kMMIOPageCount = kMMIOWindowSize >> kMMIOPageShift;
+  // Page table entry for pages touched by ranges with masks finer than a page,
+  // which have to be resolved by checking all the ranges.
+  static constexpr uint16_t kMMIOPageNeedsScan = 0xFFFF;
+
+  MMIORange* ScanRanges(uint32_t virtual_address);
+
   uint8_t* virtual_membase_;
   uint8_t* physical_membase_;
   uint8_t* memory_end_;
 
   std::vector<MMIORange> mapped_ranges_;
+  // Index + 1 in mapped_ranges_ of the range for each page of the MMIO window,
+  // 0 for pages not mapped to any range.
+  std::vector<uint16_t> page_ranges_;
 
   HostToGuestVirtual host_to_guest_virtual_;
   const void* host_to_guest_virtual_context_;
@@ -90,6 +112,9 @@ class MMIOHandler {
   AccessViolationCallback access_violation_callback_;
   void* access_violation_callback_context_;
 
+  AccessSiteCallback access_site_callback_ = nullptr;
+  void* access_site_callback_context_ = nullptr;
+
   static MMIOHandler* global_handler_;
 
   xe::global_critical_region global_critical_region_;
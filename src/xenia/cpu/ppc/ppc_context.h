@@ -10,6 +10,7 @@
 #ifndef XENIA_CPU_PPC_PPC_CONTEXT_H_
 #define XENIA_CPU_PPC_PPC_CONTEXT_H_
 
+#include <cstddef>
 #include <cstdint>
 #include <mutex>
 #include <string>
@@ -253,18 +254,19 @@ typedef struct PPCContext_s {
   // TODO(benvanik): this is getting nasty. Must be here.
   uint8_t* virtual_membase;  // 0x8
 
-  // Most frequently used registers first.
-  uint64_t lr;      // 0x10 Link register
-  uint64_t ctr;     // 0x18 Count register
-  uint64_t r[32];   // 0x20 General purpose registers
-  double f[32];     // 0x120 Floating-point registers
-  vec128_t v[128];  // 0x220 VMX128 vector registers
+  // Most frequently used registers first, with the condition registers right
+  // after the general purpose registers so that the state nearly all code
+  // touches is in the first few cache lines. The large floating-point and
+  // vector register files follow.
+  uint64_t lr;     // 0x10 Link register
+  uint64_t ctr;    // 0x18 Count register
+  uint64_t r[32];  // 0x20 General purpose registers
 
   // XER register:
   // Split to make it easier to do individual updates.
-  uint8_t xer_ca;  // 0xA20
-  uint8_t xer_ov;  // 0xA21
-  uint8_t xer_so;  // 0xA22
+  uint8_t xer_ca;  // 0x120
+  uint8_t xer_ov;  // 0x121
+  uint8_t xer_so;  // 0x122
 
   // Condition registers:
   // These are split to make it easier to do DCE on unused stores.
@@ -279,7 +281,7 @@ typedef struct PPCContext_s {
                        // successfully
       uint8_t cr0_so;  // Summary Overflow (SO) - copy of XER[SO]
     };
-  } cr0;  // 0xA24
+  } cr0;  // 0x124
   union {
     uint32_t value;
     struct {
@@ -393,9 +395,9 @@ typedef struct PPCContext_s {
       uint32_t
           fx : 1;  // FP exception summary                             -- sticky
     } bits;
-  } fpscr;  // Floating-point status and control register
+  } fpscr;  // 0x144 Floating-point status and control register
 
-  uint8_t vscr_sat;
+  uint8_t vscr_sat;  // 0x148
 
   // uint32_t get_fprf() {
   //   return fpscr.value & 0x000F8000;
@@ -404,6 +406,11 @@ typedef struct PPCContext_s {
   //   fpscr.value = (fpscr.value & ~0x000F8000) | v;
   // }
 
+  double f[32];     // 0x150 Floating-point registers
+  vec128_t v[128];  // 0x250 VMX128 vector registers
+
+  // Rarely used state from here on.
+
   // Thread ID assigned to this context.
   uint32_t thread_id;
 
@@ -425,6 +432,10 @@ typedef struct PPCContext_s {
 
   // Value of last reserved load
   uint64_t reserved_val;
+  // 128 byte line reserved by the last reserved load, with the low bit set, or
+  // 0 once the reservation has been used by a conditional store.
+  uint32_t reserved_line;
+  uint8_t reserved_padding[52];
 
   static std::string GetRegisterName(PPCRegister reg);
   std::string GetStringFromValue(PPCRegister reg) const;
@@ -436,6 +447,7 @@ typedef struct PPCContext_s {
 } PPCContext;
 #pragma pack(pop)
 static_assert(sizeof(PPCContext) % 64 == 0, "64b padded");
+static_assert(offsetof(PPCContext, v) % 16 == 0, "vector registers aligned");
 
 }  // namespace ppc
 }  // namespace cpu
@@ -1145,8 +1145,8 @@ int InstrEmit_vmulfp128(PPCHIRBuilder& f, const InstrData& i) {
 int InstrEmit_vnmsubfp_(PPCHIRBuilder& f, uint32_t vd, uint32_t va, uint32_t vb,
                         uint32_t vc) {
   // (VD) <- -(((VA) * (VC)) - (VB))
-  // NOTE: only one rounding should take place, but that's hard...
-  // This really needs VFNMSUB132PS/VFNMSUB213PS/VFNMSUB231PS but that's AVX.
+  // NOTE: only one rounding should take place. The x64 backend lowers MulSub
+  // to FMA3 when the host has it, otherwise the product is rounded as well.
   Value* v = f.Neg(f.MulSub(f.LoadVR(va), f.LoadVR(vc), f.LoadVR(vb)));
   f.StoreVR(vd, v);
   return 0;
@@ -81,7 +81,7 @@ int InstrEmit_branch(PPCHIRBuilder& f, const char* src, uint64_t cia,
           cond = f.IsFalse(cond);
         }
         f.CallTrue(cond, function, call_flags);
-      } else {
+      } else if (!lk || !f.EmitInlineCall(function)) {
         f.Call(function, call_flags);
       }
     }
@@ -337,6 +337,39 @@ int InstrEmit_bclrx(PPCHIRBuilder& f, const InstrData& i) {
     expect_true = !not_cond_ok;
   }
 
+  // Returning from a function inlined into the caller continues after the
+  // call in the caller.
+  if (!i.XL.LK && f.inline_return_label()) {
+    if (!ok) {
+      f.Branch(f.inline_return_label());
+    } else if (expect_true) {
+      f.BranchTrue(ok, f.inline_return_label());
+    } else {
+      f.BranchFalse(ok, f.inline_return_label());
+    }
+    return 0;
+  }
+
+  // Only returns that are taken may check the results of a memory idiom.
+  if (!i.XL.LK && f.has_memory_idiom()) {
+    Label* not_taken = nullptr;
+    if (ok) {
+      not_taken = f.NewLabel();
+      if (expect_true) {
+        f.BranchFalse(ok, not_taken);
+      } else {
+        f.BranchTrue(ok, not_taken);
+      }
+    }
+    f.EmitMemoryIdiomReturn();
+    InstrEmit_branch(f, "bclrx", i.address, f.LoadLR(), false, nullptr, true,
+                     true);
+    if (not_taken) {
+      f.MarkLabel(not_taken);
+    }
+    return 0;
+  }
+
   return InstrEmit_branch(f, "bclrx", i.address, f.LoadLR(), i.XL.LK, ok,
                           expect_true, true);
 }
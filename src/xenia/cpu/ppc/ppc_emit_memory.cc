@@ -759,16 +759,11 @@ int InstrEmit_ldarx(PPCHIRBuilder& f, const InstrData& i) {
   // RESERVE_ADDR <- real_addr(EA)
   // RT <- MEM(EA, 8)
 
-  // NOTE: we assume we are within a global lock.
-  // We could assert here that the block (or its parent) has taken a global lock
-  // already, but I haven't see anything but interrupt callbacks (which are
-  // always under a global lock) do that yet.
-  // We issue a memory barrier here to make sure that we get good values.
-  f.MemoryBarrier();
-
+  // No barrier is needed, as x64 doesn't reorder loads with other loads and
+  // guest code orders earlier stores with sync if it needs to.
   Value* ea = CalculateEA_0(f, i.X.RA, i.X.RB);
   Value* rt = f.ByteSwap(f.Load(ea, INT64_TYPE));
-  f.StoreReserved(rt);
+  f.StoreReserved(ea, rt);
   f.StoreGPR(i.X.RT, rt);
   return 0;
 }
@@ -784,16 +779,11 @@ int InstrEmit_lwarx(PPCHIRBuilder& f, const InstrData& i) {
   // RESERVE_ADDR <- real_addr(EA)
   // RT <- i32.0 || MEM(EA, 4)
 
-  // NOTE: we assume we are within a global lock.
-  // We could assert here that the block (or its parent) has taken a global lock
-  // already, but I haven't see anything but interrupt callbacks (which are
-  // always under a global lock) do that yet.
-  // We issue a memory barrier here to make sure that we get good values.
-  f.MemoryBarrier();
-
+  // No barrier is needed, as x64 doesn't reorder loads with other loads and
+  // guest code orders earlier stores with sync if it needs to.
   Value* ea = CalculateEA_0(f, i.X.RA, i.X.RB);
   Value* rt = f.ZeroExtend(f.ByteSwap(f.Load(ea, INT32_TYPE)), INT64_TYPE);
-  f.StoreReserved(rt);
+  f.StoreReserved(ea, rt);
   f.StoreGPR(i.X.RT, rt);
   return 0;
 }
@@ -809,24 +799,22 @@ int InstrEmit_stdcx(PPCHIRBuilder& f, const InstrData& i) {
   // n <- 1 if store performed
   // CR0[LT GT EQ SO] = 0b00 || n || XER[SO]
 
-  // NOTE: we assume we are within a global lock.
-  // As we have been exclusively executing this entire time, we assume that no
-  // one else could have possibly touched the memory and must always succeed.
-  // We use atomic compare exchange here to support reserved load/store without
-  // being under the global lock (flag disable_global_lock - see mtmsr/mtmsrd).
-  // This will always succeed if under the global lock, however.
+  // The store is only attempted if this thread still holds the reservation
+  // of the line. Other threads may have written to the memory since the
+  // reserved load, which the atomic compare exchange detects if they changed
+  // the value. The locked instruction also orders memory like a barrier.
 
   Value* ea = CalculateEA_0(f, i.X.RA, i.X.RB);
   Value* rt = f.ByteSwap(f.LoadGPR(i.X.RT));
   Value* res = f.ByteSwap(f.LoadReserved());
-  Value* v = f.AtomicCompareExchange(ea, res, rt);
-  f.StoreContext(offsetof(PPCContext, cr0.cr0_eq), v);
+  auto done = f.NewLabel();
+  f.StoreContext(offsetof(PPCContext, cr0.cr0_eq), f.LoadZeroInt8());
   f.StoreContext(offsetof(PPCContext, cr0.cr0_lt), f.LoadZeroInt8());
   f.StoreContext(offsetof(PPCContext, cr0.cr0_gt), f.LoadZeroInt8());
-
-  // Issue memory barrier for when we go out of lock and want others to see our
-  // updates.
-  f.MemoryBarrier();
+  f.BranchFalse(f.ClaimReservation(ea), done);
+  Value* v = f.AtomicCompareExchange(ea, res, rt);
+  f.StoreContext(offsetof(PPCContext, cr0.cr0_eq), v);
+  f.MarkLabel(done);
 
   return 0;
 }
@@ -842,24 +830,22 @@ int InstrEmit_stwcx(PPCHIRBuilder& f, const InstrData& i) {
   // n <- 1 if store performed
   // CR0[LT GT EQ SO] = 0b00 || n || XER[SO]
 
-  // NOTE: we assume we are within a global lock.
-  // As we have been exclusively executing this entire time, we assume that no
-  // one else could have possibly touched the memory and must always succeed.
-  // We use atomic compare exchange here to support reserved load/store without
-  // being under the global lock (flag disable_global_lock - see mtmsr/mtmsrd).
-  // This will always succeed if under the global lock, however.
+  // The store is only attempted if this thread still holds the reservation
+  // of the line. Other threads may have written to the memory since the
+  // reserved load, which the atomic compare exchange detects if they changed
+  // the value. The locked instruction also orders memory like a barrier.
 
   Value* ea = CalculateEA_0(f, i.X.RA, i.X.RB);
   Value* rt = f.ByteSwap(f.Truncate(f.LoadGPR(i.X.RT), INT32_TYPE));
   Value* res = f.ByteSwap(f.Truncate(f.LoadReserved(), INT32_TYPE));
-  Value* v = f.AtomicCompareExchange(ea, res, rt);
-  f.StoreContext(offsetof(PPCContext, cr0.cr0_eq), v);
+  auto done = f.NewLabel();
+  f.StoreContext(offsetof(PPCContext, cr0.cr0_eq), f.LoadZeroInt8());
   f.StoreContext(offsetof(PPCContext, cr0.cr0_lt), f.LoadZeroInt8());
   f.StoreContext(offsetof(PPCContext, cr0.cr0_gt), f.LoadZeroInt8());
-
-  // Issue memory barrier for when we go out of lock and want others to see our
-  // updates.
-  f.MemoryBarrier();
+  f.BranchFalse(f.ClaimReservation(ea), done);
+  Value* v = f.AtomicCompareExchange(ea, res, rt);
+  f.StoreContext(offsetof(PPCContext, cr0.cr0_eq), v);
+  f.MarkLabel(done);
 
   return 0;
 }
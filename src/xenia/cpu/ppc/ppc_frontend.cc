@@ -9,7 +9,12 @@
 
 #include "xenia/cpu/ppc/ppc_frontend.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
 #include "xenia/base/atomic.h"
+#include "xenia/base/logging.h"
 #include "xenia/cpu/ppc/ppc_context.h"
 #include "xenia/cpu/ppc/ppc_emit.h"
 #include "xenia/cpu/ppc/ppc_opcode_info.h"
@@ -84,6 +89,131 @@ void LeaveGlobalLock(PPCContext* ppc_context, void* arg0, void* arg1) {
   global_mutex->unlock();
 }
 
+// Calls of a memory idiom with sizes up to this are checked against the
+// expected results, until enough matched for the host to take over.
+constexpr uint32_t kMemoryIdiomMaxValidationSize = 4096;
+constexpr uint32_t kMemoryIdiomValidationCalls = 8;
+// Bytes around the destination, within its pages, that must stay unchanged.
+constexpr uint32_t kMemoryIdiomGuardSize = 128;
+
+struct MemoryIdiomState {
+  MemoryIdiomBuiltins builtins;
+  Memory* memory;
+  uint32_t guest_address;
+  MemoryIdiom idiom;
+  std::atomic<uint32_t> validated_calls = {0};
+  std::atomic<bool> rejected = {false};
+};
+
+// The call of a memory idiom this thread is checking the guest code of.
+struct MemoryIdiomValidation {
+  uint32_t dst;
+  uint32_t size;
+  uint32_t guard_before;
+  uint32_t guard_after;
+  uint8_t expected[kMemoryIdiomMaxValidationSize];
+  uint8_t guards[kMemoryIdiomGuardSize * 2];
+};
+thread_local MemoryIdiomValidation memory_idiom_validation_;
+
+const char* GetMemoryIdiomName(MemoryIdiom idiom) {
+  return idiom == MemoryIdiom::kCopy ? "memcpy" : "memset";
+}
+
+// Whether the guest range is within a single heap, which the host can access
+// directly. MMIO is in none.
+bool IsMemoryIdiomRange(Memory* memory, uint32_t address, uint32_t size) {
+  uint32_t last_address = address + size - 1;
+  if (last_address < address) {
+    return false;
+  }
+  const BaseHeap* heap = memory->LookupHeap(address);
+  return heap && heap == memory->LookupHeap(last_address);
+}
+
+// Services a call of a memory idiom, or prepares checking the guest code.
+void DispatchMemoryIdiom(PPCContext* ppc_context, void* arg0, void* arg1) {
+  auto state = reinterpret_cast<MemoryIdiomState*>(arg0);
+  ppc_context->scratch = 0;
+  if ((ppc_context->r[5] >> 32) ||
+      state->rejected.load(std::memory_order_relaxed)) {
+    return;
+  }
+  Memory* memory = state->memory;
+  uint32_t dst = uint32_t(ppc_context->r[3]);
+  uint32_t src = uint32_t(ppc_context->r[4]);
+  uint32_t size = uint32_t(ppc_context->r[5]);
+  bool copy = state->idiom == MemoryIdiom::kCopy;
+  // memmove semantics aren't what every memcpy implements.
+  if (!IsMemoryIdiomRange(memory, dst, size) ||
+      (copy && (!IsMemoryIdiomRange(memory, src, size) ||
+                (src < dst + size && dst < src + size)))) {
+    return;
+  }
+  // Host writes to guest memory trigger watches and code invalidation like
+  // guest stores do, and bytes are the same in either byte order.
+  uint8_t* host_dst = memory->TranslateVirtual(dst);
+  if (state->validated_calls.load(std::memory_order_acquire) >=
+      kMemoryIdiomValidationCalls) {
+    if (copy) {
+      std::memcpy(host_dst, memory->TranslateVirtual(src), size);
+    } else {
+      std::memset(host_dst, uint8_t(src), size);
+    }
+    ppc_context->scratch = 1;
+    return;
+  }
+  if (size > kMemoryIdiomMaxValidationSize) {
+    return;
+  }
+  auto& validation = memory_idiom_validation_;
+  validation.dst = dst;
+  validation.size = size;
+  if (copy) {
+    std::memcpy(validation.expected, memory->TranslateVirtual(src), size);
+  } else {
+    std::memset(validation.expected, uint8_t(src), size);
+  }
+  // Pages are at least 4 KB, so the guards are in pages the call accesses.
+  uint32_t end = dst + size;
+  validation.guard_before = std::min(dst & 0xFFF, kMemoryIdiomGuardSize);
+  validation.guard_after =
+      std::min(0xFFF - ((end - 1) & 0xFFF), kMemoryIdiomGuardSize);
+  std::memcpy(validation.guards, host_dst - validation.guard_before,
+              validation.guard_before);
+  std::memcpy(validation.guards + validation.guard_before, host_dst + size,
+              validation.guard_after);
+  ppc_context->scratch = 2;
+}
+
+// Checks what the guest code of a memory idiom did in the call being checked.
+void ValidateMemoryIdiom(PPCContext* ppc_context, void* arg0, void* arg1) {
+  auto state = reinterpret_cast<MemoryIdiomState*>(arg0);
+  ppc_context->scratch = 0;
+  const auto& validation = memory_idiom_validation_;
+  const uint8_t* host_dst = state->memory->TranslateVirtual(validation.dst);
+  bool matches =
+      uint32_t(ppc_context->r[3]) == validation.dst &&
+      !std::memcmp(host_dst, validation.expected, validation.size) &&
+      !std::memcmp(host_dst - validation.guard_before, validation.guards,
+                   validation.guard_before) &&
+      !std::memcmp(host_dst + validation.size,
+                   validation.guards + validation.guard_before,
+                   validation.guard_after);
+  if (!matches) {
+    if (!state->rejected.exchange(true)) {
+      XELOGW("Function {:08X} isn't {}, leaving it to the guest code",
+             state->guest_address, GetMemoryIdiomName(state->idiom));
+    }
+    return;
+  }
+  if (state->validated_calls.fetch_add(1, std::memory_order_acq_rel) + 1 ==
+      kMemoryIdiomValidationCalls) {
+    XELOGI("Servicing calls of {:08X} as {} on the host", state->guest_address,
+           GetMemoryIdiomName(state->idiom));
+  }
+}
+
 bool PPCFrontend::Initialize() {
   void* arg0 = reinterpret_cast<void*>(&xe::global_critical_region::mutex());
   void* arg1 = reinterpret_cast<void*>(&builtins_.global_lock_count);
@@ -105,6 +235,29 @@ bool PPCFrontend::DeclareFunction(GuestFunction* function) {
   return true;
 }
 
+const MemoryIdiomBuiltins* PPCFrontend::DefineMemoryIdiom(
+    GuestFunction* function, MemoryIdiom idiom) {
+  std::lock_guard<std::mutex> lock(memory_idioms_mutex_);
+  auto& state = memory_idioms_[function->address()];
+  if (state) {
+    // Builtins are never freed, so retranslations share the first ones and
+    // what they have found out about the function. Code rewritten into the
+    // other idiom is left to the guest.
+    return state->idiom == idiom ? &state->builtins : nullptr;
+  }
+  state = std::make_unique<MemoryIdiomState>();
+  state->memory = memory();
+  state->guest_address = function->address();
+  state->idiom = idiom;
+  std::string name =
+      fmt::format("{}_{:08X}", GetMemoryIdiomName(idiom), function->address());
+  state->builtins.dispatch = processor_->DefineBuiltin(
+      name + "_Dispatch", DispatchMemoryIdiom, state.get(), nullptr);
+  state->builtins.validate = processor_->DefineBuiltin(
+      name + "_Validate", ValidateMemoryIdiom, state.get(), nullptr);
+  return &state->builtins;
+}
+
 bool PPCFrontend::DefineFunction(GuestFunction* function,
                                  uint32_t debug_info_flags) {
   auto translator = translator_pool_.Allocate(this);
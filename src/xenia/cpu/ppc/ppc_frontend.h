@@ -11,9 +11,12 @@
 #define XENIA_CPU_PPC_PPC_FRONTEND_H_
 
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 
 #include "xenia/base/type_pool.h"
 #include "xenia/cpu/function.h"
+#include "xenia/cpu/ppc/ppc_scanner.h"
 #include "xenia/memory.h"
 
 namespace xe {
@@ -27,6 +30,7 @@ namespace cpu {
 namespace ppc {
 
 class PPCTranslator;
+struct MemoryIdiomState;
 
 struct PPCBuiltins {
   int32_t global_lock_count;
@@ -35,6 +39,19 @@ struct PPCBuiltins {
   Function* leave_global_lock;
 };
 
+// Builtins servicing the calls of a function recognized as a memory idiom,
+// with their own record of how the calls of that translation went.
+struct MemoryIdiomBuiltins {
+  // Smaller calls are left to the guest code.
+  static constexpr uint32_t kMinHostSize = 256;
+
+  // Does what the call would to memory and sets scratch to 1, or sets it to 2
+  // if the guest code is to run and have its results checked, or to 0.
+  Function* dispatch;
+  // Checks the results of the guest code where it returns, if scratch is 2.
+  Function* validate;
+};
+
 class PPCFrontend {
  public:
   explicit PPCFrontend(Processor* processor);
@@ -49,10 +66,20 @@ class PPCFrontend {
   bool DeclareFunction(GuestFunction* function);
   bool DefineFunction(GuestFunction* function, uint32_t debug_info_flags);
 
+  // Returns the builtins for a function recognized as the memory idiom,
+  // creating them the first time the function is translated. The host only
+  // takes over its calls after the guest code has produced the expected
+  // results for a number of them, across all translations of the function.
+  const MemoryIdiomBuiltins* DefineMemoryIdiom(GuestFunction* function,
+                                               MemoryIdiom idiom);
+
  private:
   Processor* processor_;
   PPCBuiltins builtins_ = {0};
   TypePool<PPCTranslator, PPCFrontend*> translator_pool_;
+  std::mutex memory_idioms_mutex_;
+  std::unordered_map<uint32_t, std::unique_ptr<MemoryIdiomState>>
+      memory_idioms_;
 };
 
 }  // namespace ppc
@@ -10,6 +10,7 @@
 #include "xenia/cpu/ppc/ppc_hir_builder.h"
 
 #include <stddef.h>
+#include <algorithm>
 #include <cstring>
 
 #include "third_party/fmt/include/fmt/format.h"
@@ -32,6 +33,11 @@ DEFINE_bool(
     "Break to the host debugger (or crash if no debugger attached) if an "
     "unimplemented PowerPC instruction is encountered.",
     "CPU");
+DEFINE_int32(inline_leaf_function_size, 16,
+             "Maximum number of instructions of guest leaf functions (no "
+             "calls, no indirect branches) that are emitted directly into "
+             "their callers, 0 to disable inlining.",
+             "CPU");
 
 namespace xe {
 namespace cpu {
@@ -44,6 +50,9 @@ using xe::cpu::hir::Label;
 using xe::cpu::hir::TypeName;
 using xe::cpu::hir::Value;
 
+// Total number of inlined instructions per function, to bound code growth.
+constexpr uint32_t kInlineInstructionBudget = 256;
+
 // The number of times each opcode has been translated.
 // Accumulated across the entire run.
 uint32_t opcode_translation_counts[static_cast<int>(PPCOpcode::kInvalid)] = {0};
@@ -65,7 +74,10 @@ void DumpAllOpcodeCounts() {
 }
 
 PPCHIRBuilder::PPCHIRBuilder(PPCFrontend* frontend)
-    : HIRBuilder(), frontend_(frontend), comment_buffer_(4096) {}
+    : HIRBuilder(),
+      frontend_(frontend),
+      scanner_(frontend),
+      comment_buffer_(4096) {}
 
 PPCHIRBuilder::~PPCHIRBuilder() = default;
 
@@ -78,15 +90,18 @@ void PPCHIRBuilder::Reset() {
   instr_offset_list_ = NULL;
   label_list_ = NULL;
   with_debug_info_ = false;
+  inline_return_label_ = nullptr;
+  inline_instruction_budget_ = 0;
+  memory_idiom_ = nullptr;
   HIRBuilder::Reset();
 }
 
-bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags) {
+bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags,
+                         const MemoryIdiomBuiltins* memory_idiom) {
   SCOPE_profile_cpu_f("cpu");
 
-  Memory* memory = frontend_->memory();
-
   function_ = function;
+  memory_idiom_ = memory_idiom;
   start_address_ = function_->address();
   instr_count_ = (function_->end_address() - function_->address()) / 4 + 1;
 
@@ -112,8 +127,23 @@ bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags) {
   // Always mark entry with label.
   label_list_[0] = NewLabel();
 
-  uint32_t start_address = function_->address();
-  uint32_t end_address = function_->end_address();
+  inline_instruction_budget_ = kInlineInstructionBudget;
+  if (memory_idiom_) {
+    EmitMemoryIdiomDispatch();
+  }
+  EmitInstructions(function_->address(), function_->end_address());
+
+  if (false) {
+    DumpAllOpcodeCounts();
+  }
+
+  return Finalize();
+}
+
+void PPCHIRBuilder::EmitInstructions(uint32_t start_address,
+                                     uint32_t end_address) {
+  Memory* memory = frontend_->memory();
+
   for (uint32_t address = start_address, offset = 0; address <= end_address;
        address += 4, offset++) {
     trace_info_.dest_count = 0;
@@ -185,13 +215,101 @@ bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags) {
         DebugBreak();
       }
     }
+
+    if (frontend_->processor()->IsMMIOAccessSite(address)) {
+      MarkMMIOAccesses(first_instr);
+    }
   }
+}
 
-  if (false) {
-    DumpAllOpcodeCounts();
+void PPCHIRBuilder::MarkMMIOAccesses(Instr* first_instr) {
+  // Everything after first_instr was emitted for the current guest
+  // instruction, which may have started new blocks.
+  Block* block = first_instr->block;
+  Instr* i = first_instr->next;
+  while (block) {
+    for (; i; i = i->next) {
+      bool is_load = i->opcode == &OPCODE_LOAD_info ||
+                     i->opcode == &OPCODE_LOAD_OFFSET_info;
+      if (is_load && i->dest->type == INT32_TYPE) {
+        i->flags |= LoadStoreFlags::LOAD_STORE_CHECK_MMIO;
+      } else if (i->opcode == &OPCODE_STORE_info &&
+                 i->src2.value->type == INT32_TYPE) {
+        i->flags |= LoadStoreFlags::LOAD_STORE_CHECK_MMIO;
+      } else if (i->opcode == &OPCODE_STORE_OFFSET_info &&
+                 i->src3.value->type == INT32_TYPE) {
+        i->flags |= LoadStoreFlags::LOAD_STORE_CHECK_MMIO;
+      }
+    }
+    block = block->next;
+    i = block ? block->instr_head : nullptr;
   }
+}
 
-  return Finalize();
+void PPCHIRBuilder::EmitMemoryIdiomDispatch() {
+  // Small calls are over before the host would be done being called, and go
+  // straight to the guest code with nothing to check.
+  size_t scratch_offset = offsetof(PPCContext, scratch);
+  StoreContext(scratch_offset, LoadZeroInt64());
+  Value* min_size = LoadConstantUint64(MemoryIdiomBuiltins::kMinHostSize);
+  BranchTrue(CompareULT(LoadGPR(5), min_size), label_list_[0]);
+  CallExtern(memory_idiom_->dispatch);
+  ReturnTrue(CompareEQ(LoadContext(scratch_offset, INT64_TYPE),
+                       LoadConstantUint64(1)));
+}
+
+void PPCHIRBuilder::EmitMemoryIdiomReturn() {
+  Label* done = NewLabel();
+  BranchFalse(CompareEQ(LoadContext(offsetof(PPCContext, scratch), INT64_TYPE),
+                        LoadConstantUint64(2)),
+              done);
+  CallExtern(memory_idiom_->validate);
+  MarkLabel(done);
+}
+
+bool PPCHIRBuilder::EmitInlineCall(Function* function) {
+  if (cvars::inline_leaf_function_size <= 0 || with_debug_info_ ||
+      inline_return_label_ || function == function_ || !function->is_guest() ||
+      function->behavior() != Function::Behavior::kDefault) {
+    return false;
+  }
+  uint32_t max_instruction_count = std::min(
+      uint32_t(cvars::inline_leaf_function_size), inline_instruction_budget_);
+  uint32_t start_address = function->address();
+  uint32_t end_address;
+  if (!scanner_.IsInlineCandidate(start_address, max_instruction_count,
+                                  &end_address)) {
+    return false;
+  }
+
+  // Emit the callee in place, with labels for its own address range. LR was
+  // set by the call as usual, and returns branch back here instead.
+  uint64_t caller_start_address = start_address_;
+  uint64_t caller_instr_count = instr_count_;
+  Instr** caller_instr_offset_list = instr_offset_list_;
+  Label** caller_label_list = label_list_;
+
+  start_address_ = start_address;
+  instr_count_ = (end_address - start_address) / 4 + 1;
+  inline_instruction_budget_ -= uint32_t(instr_count_);
+  size_t list_size = instr_count_ * sizeof(void*);
+  instr_offset_list_ = (Instr**)arena_->Alloc(list_size);
+  label_list_ = (Label**)arena_->Alloc(list_size);
+  std::memset(instr_offset_list_, 0, list_size);
+  std::memset(label_list_, 0, list_size);
+  inline_return_label_ = NewLabel();
+
+  EmitInstructions(start_address, end_address);
+  MarkLabel(inline_return_label_);
+
+  inline_return_label_ = nullptr;
+  start_address_ = caller_start_address;
+  instr_count_ = caller_instr_count;
+  instr_offset_list_ = caller_instr_offset_list;
+  label_list_ = caller_label_list;
+
+  set_attributes(attributes() | FUNCTION_ATTRIB_HAS_INLINED_CALLS);
+  return true;
 }
 
 void PPCHIRBuilder::MaybeBreakOnInstruction(uint32_t address) {
@@ -558,8 +676,16 @@ void PPCHIRBuilder::StoreVR(uint32_t reg, Value* value) {
   trace_reg.value = value;
 }
 
-void PPCHIRBuilder::StoreReserved(Value* val) {
+Value* PPCHIRBuilder::GetReservedLine(Value* address) {
+  // The Xenon reserves whole 128 byte cache lines.
+  Value* line =
+      And(Truncate(address, INT32_TYPE), LoadConstantUint32(~uint32_t(127)));
+  return Or(line, LoadConstantUint32(1));
+}
+
+void PPCHIRBuilder::StoreReserved(Value* address, Value* val) {
   assert_true(val->type == INT64_TYPE);
+  StoreContext(offsetof(PPCContext, reserved_line), GetReservedLine(address));
   StoreContext(offsetof(PPCContext, reserved_val), val);
 }
 
@@ -567,6 +693,13 @@ Value* PPCHIRBuilder::LoadReserved() {
   return LoadContext(offsetof(PPCContext, reserved_val), INT64_TYPE);
 }
 
+Value* PPCHIRBuilder::ClaimReservation(Value* address) {
+  Value* reserved_line =
+      LoadContext(offsetof(PPCContext, reserved_line), INT32_TYPE);
+  StoreContext(offsetof(PPCContext, reserved_line), LoadZeroInt32());
+  return CompareEQ(reserved_line, GetReservedLine(address));
+}
+
 }  // namespace ppc
 }  // namespace cpu
 }  // namespace xe
@@ -13,11 +13,13 @@
 #include "xenia/base/string_buffer.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/hir/hir_builder.h"
+#include "xenia/cpu/ppc/ppc_scanner.h"
 
 namespace xe {
 namespace cpu {
 namespace ppc {
 
+struct MemoryIdiomBuiltins;
 struct PPCBuiltins;
 class PPCFrontend;
 
@@ -38,12 +40,25 @@ class PPCHIRBuilder : public hir::HIRBuilder {
     // Emit comment nodes.
     EMIT_DEBUG_COMMENTS = 1 << 0,
   };
-  bool Emit(GuestFunction* function, uint32_t flags);
+  // Calls of a function recognized as a memory idiom first go to its
+  // builtins, which service them or have the guest code checked.
+  bool Emit(GuestFunction* function, uint32_t flags,
+            const MemoryIdiomBuiltins* memory_idiom = nullptr);
 
   GuestFunction* function() const { return function_; }
   Function* LookupFunction(uint32_t address);
   Label* LookupLabel(uint32_t address);
 
+  // Emits a call to a small leaf function by emitting its instructions in
+  // place, if it's suitable. Returns false if a call needs to be emitted.
+  bool EmitInlineCall(Function* function);
+  // Label that returns (blr) branch to while emitting an inlined function.
+  Label* inline_return_label() const { return inline_return_label_; }
+  // Whether the function is emitted as a memory idiom, so that each return
+  // needs EmitMemoryIdiomReturn to check the results of the guest code first.
+  bool has_memory_idiom() const { return memory_idiom_ != nullptr; }
+  void EmitMemoryIdiomReturn();
+
   Value* LoadLR();
   void StoreLR(Value* value);
   Value* LoadCTR();
@@ -78,14 +93,24 @@ class PPCHIRBuilder : public hir::HIRBuilder {
   Value* LoadVR(uint32_t reg);
   void StoreVR(uint32_t reg, Value* value);
 
-  void StoreReserved(Value* val);
+  // Reserves the line of the address for a conditional store of the value.
+  void StoreReserved(Value* address, Value* val);
   Value* LoadReserved();
+  // Whether the address is in the line reserved by this thread. The
+  // reservation is lost, as it is by any conditional store.
+  Value* ClaimReservation(Value* address);
 
  private:
+  void EmitInstructions(uint32_t start_address, uint32_t end_address);
+  void EmitMemoryIdiomDispatch();
+  Value* GetReservedLine(Value* address);
   void MaybeBreakOnInstruction(uint32_t address);
+  // Flags the 32-bit loads/stores emitted after first_instr to check for MMIO.
+  void MarkMMIOAccesses(Instr* first_instr);
   void AnnotateLabel(uint32_t address, Label* label);
 
   PPCFrontend* frontend_;
+  PPCScanner scanner_;
 
   // Reset whenever needed:
   StringBuffer comment_buffer_;
@@ -97,6 +122,9 @@ class PPCHIRBuilder : public hir::HIRBuilder {
   uint64_t instr_count_;
   Instr** instr_offset_list_;
   Label** label_list_;
+  Label* inline_return_label_ = nullptr;
+  uint32_t inline_instruction_budget_ = 0;
+  const MemoryIdiomBuiltins* memory_idiom_ = nullptr;
 
   // Reset each instruction.
   struct {
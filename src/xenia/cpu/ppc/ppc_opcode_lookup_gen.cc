@@ -11,540 +11,599 @@ namespace xe {
 namespace cpu {
 namespace ppc {
 
-constexpr uint32_t ExtractBits(uint32_t v, uint32_t a, uint32_t b) {
-  return (v >> (32 - 1 - b)) & ((1 << (b - a + 1)) - 1);
+namespace {
+
+struct DecodeEntry {
+  uint32_t mask;
+  uint32_t value;
+  PPCOpcode opcode;
+};
+
+// Where the table of a primary opcode starts and how it's indexed.
+struct PrimaryDecode {
+  uint16_t offset;
+  uint8_t shift;
+  uint16_t mask;
+};
+
+constexpr PrimaryDecode kPrimaryDecodes[64] = {
+  {0, 0, 0x0},  // 0
+  {1, 0, 0x0},  // 1
+  {2, 0, 0x0},  // 2
+  {3, 0, 0x0},  // 3
+  {4, 0, 0x7FF},  // 4
+  {2052, 4, 0x3F},  // 5
+  {2116, 4, 0x7F},  // 6
+  {2244, 0, 0x0},  // 7
+  {2245, 0, 0x0},  // 8
+  {2246, 0, 0x0},  // 9
+  {2247, 0, 0x0},  // 10
+  {2248, 0, 0x0},  // 11
+  {2249, 0, 0x0},  // 12
+  {2250, 0, 0x0},  // 13
+  {2251, 0, 0x0},  // 14
+  {2252, 0, 0x0},  // 15
+  {2253, 0, 0x0},  // 16
+  {2254, 0, 0x0},  // 17
+  {2255, 0, 0x0},  // 18
+  {2256, 1, 0x3FF},  // 19
+  {3280, 0, 0x0},  // 20
+  {3281, 0, 0x0},  // 21
+  {3282, 0, 0x0},  // 22
+  {3283, 0, 0x0},  // 23
+  {3284, 0, 0x0},  // 24
+  {3285, 0, 0x0},  // 25
+  {3286, 0, 0x0},  // 26
+  {3287, 0, 0x0},  // 27
+  {3288, 0, 0x0},  // 28
+  {3289, 0, 0x0},  // 29
+  {3290, 1, 0xF},  // 30
+  {3306, 1, 0x3FF},  // 31
+  {4330, 0, 0x0},  // 32
+  {4331, 0, 0x0},  // 33
+  {4332, 0, 0x0},  // 34
+  {4333, 0, 0x0},  // 35
+  {4334, 0, 0x0},  // 36
+  {4335, 0, 0x0},  // 37
+  {4336, 0, 0x0},  // 38
+  {4337, 0, 0x0},  // 39
+  {4338, 0, 0x0},  // 40
+  {4339, 0, 0x0},  // 41
+  {4340, 0, 0x0},  // 42
+  {4341, 0, 0x0},  // 43
+  {4342, 0, 0x0},  // 44
+  {4343, 0, 0x0},  // 45
+  {4344, 0, 0x0},  // 46
+  {4345, 0, 0x0},  // 47
+  {4346, 0, 0x0},  // 48
+  {4347, 0, 0x0},  // 49
+  {4348, 0, 0x0},  // 50
+  {4349, 0, 0x0},  // 51
+  {4350, 0, 0x0},  // 52
+  {4351, 0, 0x0},  // 53
+  {4352, 0, 0x0},  // 54
+  {4353, 0, 0x0},  // 55
+  {4354, 0, 0x0},  // 56
+  {4355, 0, 0x0},  // 57
+  {4356, 0, 0x3},  // 58
+  {4360, 1, 0x1F},  // 59
+  {4392, 0, 0x0},  // 60
+  {4393, 0, 0x0},  // 61
+  {4394, 0, 0x3},  // 62
+  {4398, 1, 0x3FF},  // 63
+};
+
+constexpr uint32_t kDecodeTableSize = 5422;
+
+// Extended opcodes in bits 21-31, in the order they are tried in.
+constexpr DecodeEntry kDecodeEntries[] = {
+  {0xFC000000, 0x08000000, PPCOpcode::tdi},
+  {0xFC000000, 0x0C000000, PPCOpcode::twi},
+  {0xFC0007F3, 0x10000003, PPCOpcode::lvsl128},
+  {0xFC0007F3, 0x10000043, PPCOpcode::lvsr128},
+  {0xFC0007F3, 0x10000083, PPCOpcode::lvewx128},
+  {0xFC0007F3, 0x100000C3, PPCOpcode::lvx128},
+  {0xFC0007F3, 0x10000183, PPCOpcode::stvewx128},
+  {0xFC0007F3, 0x100001C3, PPCOpcode::stvx128},
+  {0xFC0007F3, 0x100002C3, PPCOpcode::lvxl128},
+  {0xFC0007F3, 0x100003C3, PPCOpcode::stvxl128},
+  {0xFC0007F3, 0x10000403, PPCOpcode::lvlx128},
+  {0xFC0007F3, 0x10000443, PPCOpcode::lvrx128},
+  {0xFC0007F3, 0x10000503, PPCOpcode::stvlx128},
+  {0xFC0007F3, 0x10000543, PPCOpcode::stvrx128},
+  {0xFC0007F3, 0x10000603, PPCOpcode::lvlxl128},
+  {0xFC0007F3, 0x10000643, PPCOpcode::lvrxl128},
+  {0xFC0007F3, 0x10000703, PPCOpcode::stvlxl128},
+  {0xFC0007F3, 0x10000743, PPCOpcode::stvrxl128},
+  {0xFC0007FF, 0x10000000, PPCOpcode::vaddubm},
+  {0xFC0007FF, 0x10000002, PPCOpcode::vmaxub},
+  {0xFC0007FF, 0x10000004, PPCOpcode::vrlb},
+  {0xFC0007FF, 0x10000008, PPCOpcode::vmuloub},
+  {0xFC0007FF, 0x1000000A, PPCOpcode::vaddfp},
+  {0xFC0007FF, 0x1000000C, PPCOpcode::vmrghb},
+  {0xFC0007FF, 0x1000000E, PPCOpcode::vpkuhum},
+  {0xFC0007FF, 0x10000040, PPCOpcode::vadduhm},
+  {0xFC0007FF, 0x10000042, PPCOpcode::vmaxuh},
+  {0xFC0007FF, 0x10000044, PPCOpcode::vrlh},
+  {0xFC0007FF, 0x10000048, PPCOpcode::vmulouh},
+  {0xFC0007FF, 0x1000004A, PPCOpcode::vsubfp},
+  {0xFC0007FF, 0x1000004C, PPCOpcode::vmrghh},
+  {0xFC0007FF, 0x1000004E, PPCOpcode::vpkuwum},
+  {0xFC0007FF, 0x10000080, PPCOpcode::vadduwm},
+  {0xFC0007FF, 0x10000082, PPCOpcode::vmaxuw},
+  {0xFC0007FF, 0x10000084, PPCOpcode::vrlw},
+  {0xFC0007FF, 0x1000008C, PPCOpcode::vmrghw},
+  {0xFC0007FF, 0x1000008E, PPCOpcode::vpkuhus},
+  {0xFC0007FF, 0x100000CE, PPCOpcode::vpkuwus},
+  {0xFC0007FF, 0x10000102, PPCOpcode::vmaxsb},
+  {0xFC0007FF, 0x10000104, PPCOpcode::vslb},
+  {0xFC0007FF, 0x10000108, PPCOpcode::vmulosb},
+  {0xFC0007FF, 0x1000010A, PPCOpcode::vrefp},
+  {0xFC0007FF, 0x1000010C, PPCOpcode::vmrglb},
+  {0xFC0007FF, 0x1000010E, PPCOpcode::vpkshus},
+  {0xFC0007FF, 0x10000142, PPCOpcode::vmaxsh},
+  {0xFC0007FF, 0x10000144, PPCOpcode::vslh},
+  {0xFC0007FF, 0x10000148, PPCOpcode::vmulosh},
+  {0xFC0007FF, 0x1000014A, PPCOpcode::vrsqrtefp},
+  {0xFC0007FF, 0x1000014C, PPCOpcode::vmrglh},
+  {0xFC0007FF, 0x1000014E, PPCOpcode::vpkswus},
+  {0xFC0007FF, 0x10000180, PPCOpcode::vaddcuw},
+  {0xFC0007FF, 0x10000182, PPCOpcode::vmaxsw},
+  {0xFC0007FF, 0x10000184, PPCOpcode::vslw},
+  {0xFC0007FF, 0x1000018A, PPCOpcode::vexptefp},
+  {0xFC0007FF, 0x1000018C, PPCOpcode::vmrglw},
+  {0xFC0007FF, 0x1000018E, PPCOpcode::vpkshss},
+  {0xFC0007FF, 0x100001C4, PPCOpcode::vsl},
+  {0xFC0007FF, 0x100001CA, PPCOpcode::vlogefp},
+  {0xFC0007FF, 0x100001CE, PPCOpcode::vpkswss},
+  {0xFC0007FF, 0x10000200, PPCOpcode::vaddubs},
+  {0xFC0007FF, 0x10000202, PPCOpcode::vminub},
+  {0xFC0007FF, 0x10000204, PPCOpcode::vsrb},
+  {0xFC0007FF, 0x10000208, PPCOpcode::vmuleub},
+  {0xFC0007FF, 0x1000020A, PPCOpcode::vrfin},
+  {0xFC0007FF, 0x1000020C, PPCOpcode::vspltb},
+  {0xFC0007FF, 0x1000020E, PPCOpcode::vupkhsb},
+  {0xFC0007FF, 0x10000240, PPCOpcode::vadduhs},
+  {0xFC0007FF, 0x10000242, PPCOpcode::vminuh},
+  {0xFC0007FF, 0x10000244, PPCOpcode::vsrh},
+  {0xFC0007FF, 0x10000248, PPCOpcode::vmuleuh},
+  {0xFC0007FF, 0x1000024A, PPCOpcode::vrfiz},
+  {0xFC0007FF, 0x1000024C, PPCOpcode::vsplth},
+  {0xFC0007FF, 0x1000024E, PPCOpcode::vupkhsh},
+  {0xFC0007FF, 0x10000280, PPCOpcode::vadduws},
+  {0xFC0007FF, 0x10000282, PPCOpcode::vminuw},
+  {0xFC0007FF, 0x10000284, PPCOpcode::vsrw},
+  {0xFC0007FF, 0x1000028A, PPCOpcode::vrfip},
+  {0xFC0007FF, 0x1000028C, PPCOpcode::vspltw},
+  {0xFC0007FF, 0x1000028E, PPCOpcode::vupklsb},
+  {0xFC0007FF, 0x100002C4, PPCOpcode::vsr},
+  {0xFC0007FF, 0x100002CA, PPCOpcode::vrfim},
+  {0xFC0007FF, 0x100002CE, PPCOpcode::vupklsh},
+  {0xFC0007FF, 0x10000300, PPCOpcode::vaddsbs},
+  {0xFC0007FF, 0x10000302, PPCOpcode::vminsb},
+  {0xFC0007FF, 0x10000304, PPCOpcode::vsrab},
+  {0xFC0007FF, 0x10000308, PPCOpcode::vmulesb},
+  {0xFC0007FF, 0x1000030A, PPCOpcode::vcfux},
+  {0xFC0007FF, 0x1000030C, PPCOpcode::vspltisb},
+  {0xFC0007FF, 0x1000030E, PPCOpcode::vpkpx},
+  {0xFC0007FF, 0x10000340, PPCOpcode::vaddshs},
+  {0xFC0007FF, 0x10000342, PPCOpcode::vminsh},
+  {0xFC0007FF, 0x10000344, PPCOpcode::vsrah},
+  {0xFC0007FF, 0x10000348, PPCOpcode::vmulesh},
+  {0xFC0007FF, 0x1000034A, PPCOpcode::vcfsx},
+  {0xFC0007FF, 0x1000034C, PPCOpcode::vspltish},
+  {0xFC0007FF, 0x1000034E, PPCOpcode::vupkhpx},
+  {0xFC0007FF, 0x10000380, PPCOpcode::vaddsws},
+  {0xFC0007FF, 0x10000382, PPCOpcode::vminsw},
+  {0xFC0007FF, 0x10000384, PPCOpcode::vsraw},
+  {0xFC0007FF, 0x1000038A, PPCOpcode::vctuxs},
+  {0xFC0007FF, 0x1000038C, PPCOpcode::vspltisw},
+  {0xFC0007FF, 0x100003CA, PPCOpcode::vctsxs},
+  {0xFC0007FF, 0x100003CE, PPCOpcode::vupklpx},
+  {0xFC0007FF, 0x10000400, PPCOpcode::vsububm},
+  {0xFC0007FF, 0x10000402, PPCOpcode::vavgub},
+  {0xFC0007FF, 0x10000404, PPCOpcode::vand},
+  {0xFC0007FF, 0x1000040A, PPCOpcode::vmaxfp},
+  {0xFC0007FF, 0x1000040C, PPCOpcode::vslo},
+  {0xFC0007FF, 0x10000440, PPCOpcode::vsubuhm},
+  {0xFC0007FF, 0x10000442, PPCOpcode::vavguh},
+  {0xFC0007FF, 0x10000444, PPCOpcode::vandc},
+  {0xFC0007FF, 0x1000044A, PPCOpcode::vminfp},
+  {0xFC0007FF, 0x1000044C, PPCOpcode::vsro},
+  {0xFC0007FF, 0x10000480, PPCOpcode::vsubuwm},
+  {0xFC0007FF, 0x10000482, PPCOpcode::vavguw},
+  {0xFC0007FF, 0x10000484, PPCOpcode::vor},
+  {0xFC0007FF, 0x100004C4, PPCOpcode::vxor},
+  {0xFC0007FF, 0x10000502, PPCOpcode::vavgsb},
+  {0xFC0007FF, 0x10000504, PPCOpcode::vnor},
+  {0xFC0007FF, 0x10000542, PPCOpcode::vavgsh},
+  {0xFC0007FF, 0x10000580, PPCOpcode::vsubcuw},
+  {0xFC0007FF, 0x10000582, PPCOpcode::vavgsw},
+  {0xFC0007FF, 0x10000600, PPCOpcode::vsububs},
+  {0xFC0007FF, 0x10000604, PPCOpcode::mfvscr},
+  {0xFC0007FF, 0x10000608, PPCOpcode::vsum4ubs},
+  {0xFC0007FF, 0x10000640, PPCOpcode::vsubuhs},
+  {0xFC0007FF, 0x10000644, PPCOpcode::mtvscr},
+  {0xFC0007FF, 0x10000648, PPCOpcode::vsum4shs},
+  {0xFC0007FF, 0x10000680, PPCOpcode::vsubuws},
+  {0xFC0007FF, 0x10000688, PPCOpcode::vsum2sws},
+  {0xFC0007FF, 0x10000700, PPCOpcode::vsubsbs},
+  {0xFC0007FF, 0x10000708, PPCOpcode::vsum4sbs},
+  {0xFC0007FF, 0x10000740, PPCOpcode::vsubshs},
+  {0xFC0007FF, 0x10000780, PPCOpcode::vsubsws},
+  {0xFC0007FF, 0x10000788, PPCOpcode::vsumsws},
+  {0xFC0003FF, 0x10000006, PPCOpcode::vcmpequb},
+  {0xFC0003FF, 0x10000046, PPCOpcode::vcmpequh},
+  {0xFC0003FF, 0x10000086, PPCOpcode::vcmpequw},
+  {0xFC0003FF, 0x100000C6, PPCOpcode::vcmpeqfp},
+  {0xFC0003FF, 0x100001C6, PPCOpcode::vcmpgefp},
+  {0xFC0003FF, 0x10000206, PPCOpcode::vcmpgtub},
+  {0xFC0003FF, 0x10000246, PPCOpcode::vcmpgtuh},
+  {0xFC0003FF, 0x10000286, PPCOpcode::vcmpgtuw},
+  {0xFC0003FF, 0x100002C6, PPCOpcode::vcmpgtfp},
+  {0xFC0003FF, 0x10000306, PPCOpcode::vcmpgtsb},
+  {0xFC0003FF, 0x10000346, PPCOpcode::vcmpgtsh},
+  {0xFC0003FF, 0x10000386, PPCOpcode::vcmpgtsw},
+  {0xFC0003FF, 0x100003C6, PPCOpcode::vcmpbfp},
+  {0xFC00003F, 0x10000020, PPCOpcode::vmhaddshs},
+  {0xFC00003F, 0x10000021, PPCOpcode::vmhraddshs},
+  {0xFC00003F, 0x10000022, PPCOpcode::vmladduhm},
+  {0xFC00003F, 0x10000024, PPCOpcode::vmsumubm},
+  {0xFC00003F, 0x10000025, PPCOpcode::vmsummbm},
+  {0xFC00003F, 0x10000026, PPCOpcode::vmsumuhm},
+  {0xFC00003F, 0x10000027, PPCOpcode::vmsumuhs},
+  {0xFC00003F, 0x10000028, PPCOpcode::vmsumshm},
+  {0xFC00003F, 0x10000029, PPCOpcode::vmsumshs},
+  {0xFC00003F, 0x1000002A, PPCOpcode::vsel},
+  {0xFC00003F, 0x1000002B, PPCOpcode::vperm},
+  {0xFC00003F, 0x1000002C, PPCOpcode::vsldoi},
+  {0xFC00003F, 0x1000002E, PPCOpcode::vmaddfp},
+  {0xFC00003F, 0x1000002F, PPCOpcode::vnmsubfp},
+  {0xFC000010, 0x10000010, PPCOpcode::vsldoi128},
+  {0xFC000210, 0x14000000, PPCOpcode::vperm128},
+  {0xFC0003D0, 0x14000010, PPCOpcode::vaddfp128},
+  {0xFC0003D0, 0x14000050, PPCOpcode::vsubfp128},
+  {0xFC0003D0, 0x14000090, PPCOpcode::vmulfp128},
+  {0xFC0003D0, 0x140000D0, PPCOpcode::vmaddfp128},
+  {0xFC0003D0, 0x14000110, PPCOpcode::vmaddcfp128},
+  {0xFC0003D0, 0x14000150, PPCOpcode::vnmsubfp128},
+  {0xFC0003D0, 0x14000190, PPCOpcode::vmsum3fp128},
+  {0xFC0003D0, 0x140001D0, PPCOpcode::vmsum4fp128},
+  {0xFC0003D0, 0x14000200, PPCOpcode::vpkshss128},
+  {0xFC0003D0, 0x14000210, PPCOpcode::vand128},
+  {0xFC0003D0, 0x14000240, PPCOpcode::vpkshus128},
+  {0xFC0003D0, 0x14000250, PPCOpcode::vandc128},
+  {0xFC0003D0, 0x14000280, PPCOpcode::vpkswss128},
+  {0xFC0003D0, 0x14000290, PPCOpcode::vnor128},
+  {0xFC0003D0, 0x140002C0, PPCOpcode::vpkswus128},
+  {0xFC0003D0, 0x140002D0, PPCOpcode::vor128},
+  {0xFC0003D0, 0x14000300, PPCOpcode::vpkuhum128},
+  {0xFC0003D0, 0x14000310, PPCOpcode::vxor128},
+  {0xFC0003D0, 0x14000340, PPCOpcode::vpkuhus128},
+  {0xFC0003D0, 0x14000350, PPCOpcode::vsel128},
+  {0xFC0003D0, 0x14000380, PPCOpcode::vpkuwum128},
+  {0xFC0003D0, 0x14000390, PPCOpcode::vslo128},
+  {0xFC0003D0, 0x140003C0, PPCOpcode::vpkuwus128},
+  {0xFC0003D0, 0x140003D0, PPCOpcode::vsro128},
+  {0xFC000630, 0x18000210, PPCOpcode::vpermwi128},
+  {0xFC000730, 0x18000610, PPCOpcode::vpkd3d128},
+  {0xFC000730, 0x18000710, PPCOpcode::vrlimi128},
+  {0xFC0007F0, 0x18000230, PPCOpcode::vcfpsxws128},
+  {0xFC0007F0, 0x18000270, PPCOpcode::vcfpuxws128},
+  {0xFC0007F0, 0x180002B0, PPCOpcode::vcsxwfp128},
+  {0xFC0007F0, 0x180002F0, PPCOpcode::vcuxwfp128},
+  {0xFC0007F0, 0x18000330, PPCOpcode::vrfim128},
+  {0xFC0007F0, 0x18000370, PPCOpcode::vrfin128},
+  {0xFC0007F0, 0x180003B0, PPCOpcode::vrfip128},
+  {0xFC0007F0, 0x180003F0, PPCOpcode::vrfiz128},
+  {0xFC0007F0, 0x18000630, PPCOpcode::vrefp128},
+  {0xFC0007F0, 0x18000670, PPCOpcode::vrsqrtefp128},
+  {0xFC0007F0, 0x180006B0, PPCOpcode::vexptefp128},
+  {0xFC0007F0, 0x180006F0, PPCOpcode::vlogefp128},
+  {0xFC0007F0, 0x18000730, PPCOpcode::vspltw128},
+  {0xFC0007F0, 0x18000770, PPCOpcode::vspltisw128},
+  {0xFC0007F0, 0x180007F0, PPCOpcode::vupkd3d128},
+  {0xFC000390, 0x18000000, PPCOpcode::vcmpeqfp128},
+  {0xFC000390, 0x18000080, PPCOpcode::vcmpgefp128},
+  {0xFC000390, 0x18000100, PPCOpcode::vcmpgtfp128},
+  {0xFC000390, 0x18000180, PPCOpcode::vcmpbfp128},
+  {0xFC000390, 0x18000200, PPCOpcode::vcmpequw128},
+  {0xFC0003D0, 0x18000050, PPCOpcode::vrlw128},
+  {0xFC0003D0, 0x180000D0, PPCOpcode::vslw128},
+  {0xFC0003D0, 0x18000150, PPCOpcode::vsraw128},
+  {0xFC0003D0, 0x180001D0, PPCOpcode::vsrw128},
+  {0xFC0003D0, 0x18000280, PPCOpcode::vmaxfp128},
+  {0xFC0003D0, 0x180002C0, PPCOpcode::vminfp128},
+  {0xFC0003D0, 0x18000300, PPCOpcode::vmrghw128},
+  {0xFC0003D0, 0x18000340, PPCOpcode::vmrglw128},
+  {0xFC0003D0, 0x18000380, PPCOpcode::vupkhsb128},
+  {0xFC0003D0, 0x180003C0, PPCOpcode::vupklsb128},
+  {0xFC000000, 0x1C000000, PPCOpcode::mulli},
+  {0xFC000000, 0x20000000, PPCOpcode::subficx},
+  {0xFC000000, 0x28000000, PPCOpcode::cmpli},
+  {0xFC000000, 0x2C000000, PPCOpcode::cmpi},
+  {0xFC000000, 0x30000000, PPCOpcode::addic},
+  {0xFC000000, 0x34000000, PPCOpcode::addicx},
+  {0xFC000000, 0x38000000, PPCOpcode::addi},
+  {0xFC000000, 0x3C000000, PPCOpcode::addis},
+  {0xFC000000, 0x40000000, PPCOpcode::bcx},
+  {0xFC000000, 0x44000000, PPCOpcode::sc},
+  {0xFC000000, 0x48000000, PPCOpcode::bx},
+  {0xFC0007FE, 0x4C000000, PPCOpcode::mcrf},
+  {0xFC0007FE, 0x4C000020, PPCOpcode::bclrx},
+  {0xFC0007FE, 0x4C000042, PPCOpcode::crnor},
+  {0xFC0007FE, 0x4C000102, PPCOpcode::crandc},
+  {0xFC0007FE, 0x4C00012C, PPCOpcode::isync},
+  {0xFC0007FE, 0x4C000182, PPCOpcode::crxor},
+  {0xFC0007FE, 0x4C0001C2, PPCOpcode::crnand},
+  {0xFC0007FE, 0x4C000202, PPCOpcode::crand},
+  {0xFC0007FE, 0x4C000242, PPCOpcode::creqv},
+  {0xFC0007FE, 0x4C000342, PPCOpcode::crorc},
+  {0xFC0007FE, 0x4C000382, PPCOpcode::cror},
+  {0xFC0007FE, 0x4C000420, PPCOpcode::bcctrx},
+  {0xFC000000, 0x50000000, PPCOpcode::rlwimix},
+  {0xFC000000, 0x54000000, PPCOpcode::rlwinmx},
+  {0xFC000000, 0x5C000000, PPCOpcode::rlwnmx},
+  {0xFC000000, 0x60000000, PPCOpcode::ori},
+  {0xFC000000, 0x64000000, PPCOpcode::oris},
+  {0xFC000000, 0x68000000, PPCOpcode::xori},
+  {0xFC000000, 0x6C000000, PPCOpcode::xoris},
+  {0xFC000000, 0x70000000, PPCOpcode::andix},
+  {0xFC000000, 0x74000000, PPCOpcode::andisx},
+  {0xFC00001C, 0x78000000, PPCOpcode::rldiclx},
+  {0xFC00001C, 0x78000004, PPCOpcode::rldicrx},
+  {0xFC00001C, 0x78000008, PPCOpcode::rldicx},
+  {0xFC00001C, 0x7800000C, PPCOpcode::rldimix},
+  {0xFC00001E, 0x78000010, PPCOpcode::rldclx},
+  {0xFC00001E, 0x78000012, PPCOpcode::rldcrx},
+  {0xFC0007FC, 0x7C000674, PPCOpcode::sradix},
+  {0xFC0007FE, 0x7C000000, PPCOpcode::cmp},
+  {0xFC0007FE, 0x7C000008, PPCOpcode::tw},
+  {0xFC0007FE, 0x7C00000C, PPCOpcode::lvsl},
+  {0xFC0007FE, 0x7C00000E, PPCOpcode::lvebx},
+  {0xFC0007FE, 0x7C000026, PPCOpcode::mfcr},
+  {0xFC0007FE, 0x7C000028, PPCOpcode::lwarx},
+  {0xFC0007FE, 0x7C00002A, PPCOpcode::ldx},
+  {0xFC0007FE, 0x7C00002E, PPCOpcode::lwzx},
+  {0xFC0007FE, 0x7C000030, PPCOpcode::slwx},
+  {0xFC0007FE, 0x7C000034, PPCOpcode::cntlzwx},
+  {0xFC0007FE, 0x7C000036, PPCOpcode::sldx},
+  {0xFC0007FE, 0x7C000038, PPCOpcode::andx},
+  {0xFC0007FE, 0x7C000040, PPCOpcode::cmpl},
+  {0xFC0007FE, 0x7C00004C, PPCOpcode::lvsr},
+  {0xFC0007FE, 0x7C00004E, PPCOpcode::lvehx},
+  {0xFC0007FE, 0x7C00006A, PPCOpcode::ldux},
+  {0xFC0007FE, 0x7C00006C, PPCOpcode::dcbst},
+  {0xFC0007FE, 0x7C00006E, PPCOpcode::lwzux},
+  {0xFC0007FE, 0x7C000074, PPCOpcode::cntlzdx},
+  {0xFC0007FE, 0x7C000078, PPCOpcode::andcx},
+  {0xFC0007FE, 0x7C000088, PPCOpcode::td},
+  {0xFC0007FE, 0x7C00008E, PPCOpcode::lvewx},
+  {0xFC0007FE, 0x7C0000A6, PPCOpcode::mfmsr},
+  {0xFC0007FE, 0x7C0000A8, PPCOpcode::ldarx},
+  {0xFC0007FE, 0x7C0000AC, PPCOpcode::dcbf},
+  {0xFC0007FE, 0x7C0000AE, PPCOpcode::lbzx},
+  {0xFC0007FE, 0x7C0000CE, PPCOpcode::lvx},
+  {0xFC0007FE, 0x7C0000EE, PPCOpcode::lbzux},
+  {0xFC0007FE, 0x7C0000F8, PPCOpcode::norx},
+  {0xFC0007FE, 0x7C00010E, PPCOpcode::stvebx},
+  {0xFC0007FE, 0x7C000120, PPCOpcode::mtcrf},
+  {0xFC0007FE, 0x7C000124, PPCOpcode::mtmsr},
+  {0xFC0007FE, 0x7C00012A, PPCOpcode::stdx},
+  {0xFC0007FE, 0x7C00012C, PPCOpcode::stwcx},
+  {0xFC0007FE, 0x7C00012E, PPCOpcode::stwx},
+  {0xFC0007FE, 0x7C00014E, PPCOpcode::stvehx},
+  {0xFC0007FE, 0x7C000164, PPCOpcode::mtmsrd},
+  {0xFC0007FE, 0x7C00016A, PPCOpcode::stdux},
+  {0xFC0007FE, 0x7C00016E, PPCOpcode::stwux},
+  {0xFC0007FE, 0x7C00018E, PPCOpcode::stvewx},
+  {0xFC0007FE, 0x7C0001AC, PPCOpcode::stdcx},
+  {0xFC0007FE, 0x7C0001AE, PPCOpcode::stbx},
+  {0xFC0007FE, 0x7C0001CE, PPCOpcode::stvx},
+  {0xFC0007FE, 0x7C0001EC, PPCOpcode::dcbtst},
+  {0xFC0007FE, 0x7C0001EE, PPCOpcode::stbux},
+  {0xFC0007FE, 0x7C00022C, PPCOpcode::dcbt},
+  {0xFC0007FE, 0x7C00022E, PPCOpcode::lhzx},
+  {0xFC0007FE, 0x7C000238, PPCOpcode::eqvx},
+  {0xFC0007FE, 0x7C00026E, PPCOpcode::lhzux},
+  {0xFC0007FE, 0x7C000278, PPCOpcode::xorx},
+  {0xFC0007FE, 0x7C0002A6, PPCOpcode::mfspr},
+  {0xFC0007FE, 0x7C0002AA, PPCOpcode::lwax},
+  {0xFC0007FE, 0x7C0002AE, PPCOpcode::lhax},
+  {0xFC0007FE, 0x7C0002CE, PPCOpcode::lvxl},
+  {0xFC0007FE, 0x7C0002E6, PPCOpcode::mftb},
+  {0xFC0007FE, 0x7C0002EA, PPCOpcode::lwaux},
+  {0xFC0007FE, 0x7C0002EE, PPCOpcode::lhaux},
+  {0xFC0007FE, 0x7C00032E, PPCOpcode::sthx},
+  {0xFC0007FE, 0x7C000338, PPCOpcode::orcx},
+  {0xFC0007FE, 0x7C00036E, PPCOpcode::sthux},
+  {0xFC0007FE, 0x7C000378, PPCOpcode::orx},
+  {0xFC0007FE, 0x7C0003A6, PPCOpcode::mtspr},
+  {0xFC0007FE, 0x7C0003AC, PPCOpcode::dcbi},
+  {0xFC0007FE, 0x7C0003B8, PPCOpcode::nandx},
+  {0xFC0007FE, 0x7C0003CE, PPCOpcode::stvxl},
+  {0xFC0007FE, 0x7C000400, PPCOpcode::mcrxr},
+  {0xFC0007FE, 0x7C00040E, PPCOpcode::lvlx},
+  {0xFC0007FE, 0x7C000428, PPCOpcode::ldbrx},
+  {0xFC0007FE, 0x7C00042A, PPCOpcode::lswx},
+  {0xFC0007FE, 0x7C00042C, PPCOpcode::lwbrx},
+  {0xFC0007FE, 0x7C00042E, PPCOpcode::lfsx},
+  {0xFC0007FE, 0x7C000430, PPCOpcode::srwx},
+  {0xFC0007FE, 0x7C000436, PPCOpcode::srdx},
+  {0xFC0007FE, 0x7C00044E, PPCOpcode::lvrx},
+  {0xFC0007FE, 0x7C00046E, PPCOpcode::lfsux},
+  {0xFC0007FE, 0x7C0004AA, PPCOpcode::lswi},
+  {0xFC0007FE, 0x7C0004AC, PPCOpcode::sync},
+  {0xFC0007FE, 0x7C0004AE, PPCOpcode::lfdx},
+  {0xFC0007FE, 0x7C0004EE, PPCOpcode::lfdux},
+  {0xFC0007FE, 0x7C00050E, PPCOpcode::stvlx},
+  {0xFC0007FE, 0x7C000528, PPCOpcode::stdbrx},
+  {0xFC0007FE, 0x7C00052A, PPCOpcode::stswx},
+  {0xFC0007FE, 0x7C00052C, PPCOpcode::stwbrx},
+  {0xFC0007FE, 0x7C00052E, PPCOpcode::stfsx},
+  {0xFC0007FE, 0x7C00054E, PPCOpcode::stvrx},
+  {0xFC0007FE, 0x7C00056E, PPCOpcode::stfsux},
+  {0xFC0007FE, 0x7C0005AA, PPCOpcode::stswi},
+  {0xFC0007FE, 0x7C0005AE, PPCOpcode::stfdx},
+  {0xFC0007FE, 0x7C0005EE, PPCOpcode::stfdux},
+  {0xFC0007FE, 0x7C00060E, PPCOpcode::lvlxl},
+  {0xFC0007FE, 0x7C00062C, PPCOpcode::lhbrx},
+  {0xFC0007FE, 0x7C000630, PPCOpcode::srawx},
+  {0xFC0007FE, 0x7C000634, PPCOpcode::sradx},
+  {0xFC0007FE, 0x7C00064E, PPCOpcode::lvrxl},
+  {0xFC0007FE, 0x7C000670, PPCOpcode::srawix},
+  {0xFC0007FE, 0x7C0006AC, PPCOpcode::eieio},
+  {0xFC0007FE, 0x7C00070E, PPCOpcode::stvlxl},
+  {0xFC0007FE, 0x7C00072C, PPCOpcode::sthbrx},
+  {0xFC0007FE, 0x7C000734, PPCOpcode::extshx},
+  {0xFC0007FE, 0x7C00074E, PPCOpcode::stvrxl},
+  {0xFC0007FE, 0x7C000774, PPCOpcode::extsbx},
+  {0xFC0007FE, 0x7C0007AC, PPCOpcode::icbi},
+  {0xFC0007FE, 0x7C0007AE, PPCOpcode::stfiwx},
+  {0xFC0007FE, 0x7C0007B4, PPCOpcode::extswx},
+  {0xFC0003FE, 0x7C000010, PPCOpcode::subfcx},
+  {0xFC0003FE, 0x7C000012, PPCOpcode::mulhdux},
+  {0xFC0003FE, 0x7C000014, PPCOpcode::addcx},
+  {0xFC0003FE, 0x7C000016, PPCOpcode::mulhwux},
+  {0xFC0003FE, 0x7C000050, PPCOpcode::subfx},
+  {0xFC0003FE, 0x7C000092, PPCOpcode::mulhdx},
+  {0xFC0003FE, 0x7C000096, PPCOpcode::mulhwx},
+  {0xFC0003FE, 0x7C0000D0, PPCOpcode::negx},
+  {0xFC0003FE, 0x7C000110, PPCOpcode::subfex},
+  {0xFC0003FE, 0x7C000114, PPCOpcode::addex},
+  {0xFC0003FE, 0x7C000190, PPCOpcode::subfzex},
+  {0xFC0003FE, 0x7C000194, PPCOpcode::addzex},
+  {0xFC0003FE, 0x7C0001D0, PPCOpcode::subfmex},
+  {0xFC0003FE, 0x7C0001D2, PPCOpcode::mulldx},
+  {0xFC0003FE, 0x7C0001D4, PPCOpcode::addmex},
+  {0xFC0003FE, 0x7C0001D6, PPCOpcode::mullwx},
+  {0xFC0003FE, 0x7C000214, PPCOpcode::addx},
+  {0xFC0003FE, 0x7C000392, PPCOpcode::divdux},
+  {0xFC0003FE, 0x7C000396, PPCOpcode::divwux},
+  {0xFC0003FE, 0x7C0003D2, PPCOpcode::divdx},
+  {0xFC0003FE, 0x7C0003D6, PPCOpcode::divwx},
+  {0xFC000000, 0x80000000, PPCOpcode::lwz},
+  {0xFC000000, 0x84000000, PPCOpcode::lwzu},
+  {0xFC000000, 0x88000000, PPCOpcode::lbz},
+  {0xFC000000, 0x8C000000, PPCOpcode::lbzu},
+  {0xFC000000, 0x90000000, PPCOpcode::stw},
+  {0xFC000000, 0x94000000, PPCOpcode::stwu},
+  {0xFC000000, 0x98000000, PPCOpcode::stb},
+  {0xFC000000, 0x9C000000, PPCOpcode::stbu},
+  {0xFC000000, 0xA0000000, PPCOpcode::lhz},
+  {0xFC000000, 0xA4000000, PPCOpcode::lhzu},
+  {0xFC000000, 0xA8000000, PPCOpcode::lha},
+  {0xFC000000, 0xAC000000, PPCOpcode::lhau},
+  {0xFC000000, 0xB0000000, PPCOpcode::sth},
+  {0xFC000000, 0xB4000000, PPCOpcode::sthu},
+  {0xFC000000, 0xB8000000, PPCOpcode::lmw},
+  {0xFC000000, 0xBC000000, PPCOpcode::stmw},
+  {0xFC000000, 0xC0000000, PPCOpcode::lfs},
+  {0xFC000000, 0xC4000000, PPCOpcode::lfsu},
+  {0xFC000000, 0xC8000000, PPCOpcode::lfd},
+  {0xFC000000, 0xCC000000, PPCOpcode::lfdu},
+  {0xFC000000, 0xD0000000, PPCOpcode::stfs},
+  {0xFC000000, 0xD4000000, PPCOpcode::stfsu},
+  {0xFC000000, 0xD8000000, PPCOpcode::stfd},
+  {0xFC000000, 0xDC000000, PPCOpcode::stfdu},
+  {0xFC000003, 0xE8000000, PPCOpcode::ld},
+  {0xFC000003, 0xE8000001, PPCOpcode::ldu},
+  {0xFC000003, 0xE8000002, PPCOpcode::lwa},
+  {0xFC00003E, 0xEC000024, PPCOpcode::fdivsx},
+  {0xFC00003E, 0xEC000028, PPCOpcode::fsubsx},
+  {0xFC00003E, 0xEC00002A, PPCOpcode::faddsx},
+  {0xFC00003E, 0xEC00002C, PPCOpcode::fsqrtsx},
+  {0xFC00003E, 0xEC000030, PPCOpcode::fresx},
+  {0xFC00003E, 0xEC000032, PPCOpcode::fmulsx},
+  {0xFC00003E, 0xEC000038, PPCOpcode::fmsubsx},
+  {0xFC00003E, 0xEC00003A, PPCOpcode::fmaddsx},
+  {0xFC00003E, 0xEC00003C, PPCOpcode::fnmsubsx},
+  {0xFC00003E, 0xEC00003E, PPCOpcode::fnmaddsx},
+  {0xFC000003, 0xF8000000, PPCOpcode::std},
+  {0xFC000003, 0xF8000001, PPCOpcode::stdu},
+  {0xFC0007FE, 0xFC000000, PPCOpcode::fcmpu},
+  {0xFC0007FE, 0xFC000018, PPCOpcode::frspx},
+  {0xFC0007FE, 0xFC00001C, PPCOpcode::fctiwx},
+  {0xFC0007FE, 0xFC00001E, PPCOpcode::fctiwzx},
+  {0xFC0007FE, 0xFC000040, PPCOpcode::fcmpo},
+  {0xFC0007FE, 0xFC00004C, PPCOpcode::mtfsb1x},
+  {0xFC0007FE, 0xFC000050, PPCOpcode::fnegx},
+  {0xFC0007FE, 0xFC000080, PPCOpcode::mcrfs},
+  {0xFC0007FE, 0xFC00008C, PPCOpcode::mtfsb0x},
+  {0xFC0007FE, 0xFC000090, PPCOpcode::fmrx},
+  {0xFC0007FE, 0xFC00010C, PPCOpcode::mtfsfix},
+  {0xFC0007FE, 0xFC000110, PPCOpcode::fnabsx},
+  {0xFC0007FE, 0xFC000210, PPCOpcode::fabsx},
+  {0xFC0007FE, 0xFC00048E, PPCOpcode::mffsx},
+  {0xFC0007FE, 0xFC00058E, PPCOpcode::mtfsfx},
+  {0xFC0007FE, 0xFC00065C, PPCOpcode::fctidx},
+  {0xFC0007FE, 0xFC00065E, PPCOpcode::fctidzx},
+  {0xFC0007FE, 0xFC00069C, PPCOpcode::fcfidx},
+  {0xFC00003E, 0xFC000024, PPCOpcode::fdivx},
+  {0xFC00003E, 0xFC000028, PPCOpcode::fsubx},
+  {0xFC00003E, 0xFC00002A, PPCOpcode::faddx},
+  {0xFC00003E, 0xFC00002C, PPCOpcode::fsqrtx},
+  {0xFC00003E, 0xFC00002E, PPCOpcode::fselx},
+  {0xFC00003E, 0xFC000032, PPCOpcode::fmulx},
+  {0xFC00003E, 0xFC000034, PPCOpcode::frsqrtex},
+  {0xFC00003E, 0xFC000038, PPCOpcode::fmsubx},
+  {0xFC00003E, 0xFC00003A, PPCOpcode::fmaddx},
+  {0xFC00003E, 0xFC00003C, PPCOpcode::fnmsubx},
+  {0xFC00003E, 0xFC00003E, PPCOpcode::fnmaddx},
+};
+
+// Extended opcodes that also use other bits, tried when the table misses.
+constexpr DecodeEntry kWideDecodeEntries[] = {
+  {0xFFE007FE, 0x7C0007EC, PPCOpcode::dcbz},
+  {0xFFE007FE, 0x7C2007EC, PPCOpcode::dcbz128},
+};
+
+struct DecodeTable {
+  // PPCOpcode + 1, 0 if there is no match in kDecodeEntries.
+  uint16_t opcodes[kDecodeTableSize];
+};
+
+constexpr DecodeTable BuildDecodeTable() {
+  DecodeTable table = {};
+  for (const auto& entry : kDecodeEntries) {
+    const auto& primary = kPrimaryDecodes[entry.value >> 26];
+    uint32_t fixed_bits = entry.mask & (uint32_t(primary.mask) << primary.shift);
+    uint32_t free_bits = (uint32_t(primary.mask) << primary.shift) & ~fixed_bits;
+    // Fill in every encoding that only differs in bits the entry ignores.
+    uint32_t bits = free_bits;
+    while (true) {
+      uint32_t index = ((entry.value & fixed_bits) | bits) >> primary.shift;
+      auto& slot = table.opcodes[primary.offset + index];
+      if (!slot) {
+        slot = uint16_t(uint32_t(entry.opcode) + 1);
+      }
+      if (!bits) {
+        break;
+      }
+      bits = (bits - 1) & free_bits;
+    }
+  }
+  return table;
 }
 
-#define PPC_DECODER_MISS assert_always(); return PPCOpcode::kInvalid
-#define PPC_DECODER_HIT(name) return PPCOpcode::name;
+constexpr DecodeTable kDecodeTable = BuildDecodeTable();
+
+}  // namespace
 
 PPCOpcode LookupOpcode(uint32_t code) {
-  switch (ExtractBits(code, 0, 5)) {
-  case 2: PPC_DECODER_HIT(tdi);
-  case 3: PPC_DECODER_HIT(twi);
-  case 4:
-    switch ((ExtractBits(code, 21, 27) << 4)|(ExtractBits(code, 30, 31) << 0)) {
-      case 0b00000000011: PPC_DECODER_HIT(lvsl128);
-      case 0b00001000011: PPC_DECODER_HIT(lvsr128);
-      case 0b00010000011: PPC_DECODER_HIT(lvewx128);
-      case 0b00011000011: PPC_DECODER_HIT(lvx128);
-      case 0b00110000011: PPC_DECODER_HIT(stvewx128);
-      case 0b00111000011: PPC_DECODER_HIT(stvx128);
-      case 0b01011000011: PPC_DECODER_HIT(lvxl128);
-      case 0b01111000011: PPC_DECODER_HIT(stvxl128);
-      case 0b10000000011: PPC_DECODER_HIT(lvlx128);
-      case 0b10001000011: PPC_DECODER_HIT(lvrx128);
-      case 0b10100000011: PPC_DECODER_HIT(stvlx128);
-      case 0b10101000011: PPC_DECODER_HIT(stvrx128);
-      case 0b11000000011: PPC_DECODER_HIT(lvlxl128);
-      case 0b11001000011: PPC_DECODER_HIT(lvrxl128);
-      case 0b11100000011: PPC_DECODER_HIT(stvlxl128);
-      case 0b11101000011: PPC_DECODER_HIT(stvrxl128);
-    }
-    switch ((ExtractBits(code, 21, 31) << 0)) {
-      case 0b00000000000: PPC_DECODER_HIT(vaddubm);
-      case 0b00000000010: PPC_DECODER_HIT(vmaxub);
-      case 0b00000000100: PPC_DECODER_HIT(vrlb);
-      case 0b00000001000: PPC_DECODER_HIT(vmuloub);
-      case 0b00000001010: PPC_DECODER_HIT(vaddfp);
-      case 0b00000001100: PPC_DECODER_HIT(vmrghb);
-      case 0b00000001110: PPC_DECODER_HIT(vpkuhum);
-      case 0b00001000000: PPC_DECODER_HIT(vadduhm);
-      case 0b00001000010: PPC_DECODER_HIT(vmaxuh);
-      case 0b00001000100: PPC_DECODER_HIT(vrlh);
-      case 0b00001001000: PPC_DECODER_HIT(vmulouh);
-      case 0b00001001010: PPC_DECODER_HIT(vsubfp);
-      case 0b00001001100: PPC_DECODER_HIT(vmrghh);
-      case 0b00001001110: PPC_DECODER_HIT(vpkuwum);
-      case 0b00010000000: PPC_DECODER_HIT(vadduwm);
-      case 0b00010000010: PPC_DECODER_HIT(vmaxuw);
-      case 0b00010000100: PPC_DECODER_HIT(vrlw);
-      case 0b00010001100: PPC_DECODER_HIT(vmrghw);
-      case 0b00010001110: PPC_DECODER_HIT(vpkuhus);
-      case 0b00011001110: PPC_DECODER_HIT(vpkuwus);
-      case 0b00100000010: PPC_DECODER_HIT(vmaxsb);
-      case 0b00100000100: PPC_DECODER_HIT(vslb);
-      case 0b00100001000: PPC_DECODER_HIT(vmulosb);
-      case 0b00100001010: PPC_DECODER_HIT(vrefp);
-      case 0b00100001100: PPC_DECODER_HIT(vmrglb);
-      case 0b00100001110: PPC_DECODER_HIT(vpkshus);
-      case 0b00101000010: PPC_DECODER_HIT(vmaxsh);
-      case 0b00101000100: PPC_DECODER_HIT(vslh);
-      case 0b00101001000: PPC_DECODER_HIT(vmulosh);
-      case 0b00101001010: PPC_DECODER_HIT(vrsqrtefp);
-      case 0b00101001100: PPC_DECODER_HIT(vmrglh);
-      case 0b00101001110: PPC_DECODER_HIT(vpkswus);
-      case 0b00110000000: PPC_DECODER_HIT(vaddcuw);
-      case 0b00110000010: PPC_DECODER_HIT(vmaxsw);
-      case 0b00110000100: PPC_DECODER_HIT(vslw);
-      case 0b00110001010: PPC_DECODER_HIT(vexptefp);
-      case 0b00110001100: PPC_DECODER_HIT(vmrglw);
-      case 0b00110001110: PPC_DECODER_HIT(vpkshss);
-      case 0b00111000100: PPC_DECODER_HIT(vsl);
-      case 0b00111001010: PPC_DECODER_HIT(vlogefp);
-      case 0b00111001110: PPC_DECODER_HIT(vpkswss);
-      case 0b01000000000: PPC_DECODER_HIT(vaddubs);
-      case 0b01000000010: PPC_DECODER_HIT(vminub);
-      case 0b01000000100: PPC_DECODER_HIT(vsrb);
-      case 0b01000001000: PPC_DECODER_HIT(vmuleub);
-      case 0b01000001010: PPC_DECODER_HIT(vrfin);
-      case 0b01000001100: PPC_DECODER_HIT(vspltb);
-      case 0b01000001110: PPC_DECODER_HIT(vupkhsb);
-      case 0b01001000000: PPC_DECODER_HIT(vadduhs);
-      case 0b01001000010: PPC_DECODER_HIT(vminuh);
-      case 0b01001000100: PPC_DECODER_HIT(vsrh);
-      case 0b01001001000: PPC_DECODER_HIT(vmuleuh);
-      case 0b01001001010: PPC_DECODER_HIT(vrfiz);
-      case 0b01001001100: PPC_DECODER_HIT(vsplth);
-      case 0b01001001110: PPC_DECODER_HIT(vupkhsh);
-      case 0b01010000000: PPC_DECODER_HIT(vadduws);
-      case 0b01010000010: PPC_DECODER_HIT(vminuw);
-      case 0b01010000100: PPC_DECODER_HIT(vsrw);
-      case 0b01010001010: PPC_DECODER_HIT(vrfip);
-      case 0b01010001100: PPC_DECODER_HIT(vspltw);
-      case 0b01010001110: PPC_DECODER_HIT(vupklsb);
-      case 0b01011000100: PPC_DECODER_HIT(vsr);
-      case 0b01011001010: PPC_DECODER_HIT(vrfim);
-      case 0b01011001110: PPC_DECODER_HIT(vupklsh);
-      case 0b01100000000: PPC_DECODER_HIT(vaddsbs);
-      case 0b01100000010: PPC_DECODER_HIT(vminsb);
-      case 0b01100000100: PPC_DECODER_HIT(vsrab);
-      case 0b01100001000: PPC_DECODER_HIT(vmulesb);
-      case 0b01100001010: PPC_DECODER_HIT(vcfux);
-      case 0b01100001100: PPC_DECODER_HIT(vspltisb);
-      case 0b01100001110: PPC_DECODER_HIT(vpkpx);
-      case 0b01101000000: PPC_DECODER_HIT(vaddshs);
-      case 0b01101000010: PPC_DECODER_HIT(vminsh);
-      case 0b01101000100: PPC_DECODER_HIT(vsrah);
-      case 0b01101001000: PPC_DECODER_HIT(vmulesh);
-      case 0b01101001010: PPC_DECODER_HIT(vcfsx);
-      case 0b01101001100: PPC_DECODER_HIT(vspltish);
-      case 0b01101001110: PPC_DECODER_HIT(vupkhpx);
-      case 0b01110000000: PPC_DECODER_HIT(vaddsws);
-      case 0b01110000010: PPC_DECODER_HIT(vminsw);
-      case 0b01110000100: PPC_DECODER_HIT(vsraw);
-      case 0b01110001010: PPC_DECODER_HIT(vctuxs);
-      case 0b01110001100: PPC_DECODER_HIT(vspltisw);
-      case 0b01111001010: PPC_DECODER_HIT(vctsxs);
-      case 0b01111001110: PPC_DECODER_HIT(vupklpx);
-      case 0b10000000000: PPC_DECODER_HIT(vsububm);
-      case 0b10000000010: PPC_DECODER_HIT(vavgub);
-      case 0b10000000100: PPC_DECODER_HIT(vand);
-      case 0b10000001010: PPC_DECODER_HIT(vmaxfp);
-      case 0b10000001100: PPC_DECODER_HIT(vslo);
-      case 0b10001000000: PPC_DECODER_HIT(vsubuhm);
-      case 0b10001000010: PPC_DECODER_HIT(vavguh);
-      case 0b10001000100: PPC_DECODER_HIT(vandc);
-      case 0b10001001010: PPC_DECODER_HIT(vminfp);
-      case 0b10001001100: PPC_DECODER_HIT(vsro);
-      case 0b10010000000: PPC_DECODER_HIT(vsubuwm);
-      case 0b10010000010: PPC_DECODER_HIT(vavguw);
-      case 0b10010000100: PPC_DECODER_HIT(vor);
-      case 0b10011000100: PPC_DECODER_HIT(vxor);
-      case 0b10100000010: PPC_DECODER_HIT(vavgsb);
-      case 0b10100000100: PPC_DECODER_HIT(vnor);
-      case 0b10101000010: PPC_DECODER_HIT(vavgsh);
-      case 0b10110000000: PPC_DECODER_HIT(vsubcuw);
-      case 0b10110000010: PPC_DECODER_HIT(vavgsw);
-      case 0b11000000000: PPC_DECODER_HIT(vsububs);
-      case 0b11000000100: PPC_DECODER_HIT(mfvscr);
-      case 0b11000001000: PPC_DECODER_HIT(vsum4ubs);
-      case 0b11001000000: PPC_DECODER_HIT(vsubuhs);
-      case 0b11001000100: PPC_DECODER_HIT(mtvscr);
-      case 0b11001001000: PPC_DECODER_HIT(vsum4shs);
-      case 0b11010000000: PPC_DECODER_HIT(vsubuws);
-      case 0b11010001000: PPC_DECODER_HIT(vsum2sws);
-      case 0b11100000000: PPC_DECODER_HIT(vsubsbs);
-      case 0b11100001000: PPC_DECODER_HIT(vsum4sbs);
-      case 0b11101000000: PPC_DECODER_HIT(vsubshs);
-      case 0b11110000000: PPC_DECODER_HIT(vsubsws);
-      case 0b11110001000: PPC_DECODER_HIT(vsumsws);
-    }
-    switch ((ExtractBits(code, 22, 31) << 0)) {
-      case 0b0000000110: PPC_DECODER_HIT(vcmpequb);
-      case 0b0001000110: PPC_DECODER_HIT(vcmpequh);
-      case 0b0010000110: PPC_DECODER_HIT(vcmpequw);
-      case 0b0011000110: PPC_DECODER_HIT(vcmpeqfp);
-      case 0b0111000110: PPC_DECODER_HIT(vcmpgefp);
-      case 0b1000000110: PPC_DECODER_HIT(vcmpgtub);
-      case 0b1001000110: PPC_DECODER_HIT(vcmpgtuh);
-      case 0b1010000110: PPC_DECODER_HIT(vcmpgtuw);
-      case 0b1011000110: PPC_DECODER_HIT(vcmpgtfp);
-      case 0b1100000110: PPC_DECODER_HIT(vcmpgtsb);
-      case 0b1101000110: PPC_DECODER_HIT(vcmpgtsh);
-      case 0b1110000110: PPC_DECODER_HIT(vcmpgtsw);
-      case 0b1111000110: PPC_DECODER_HIT(vcmpbfp);
-    }
-    switch ((ExtractBits(code, 26, 31) << 0)) {
-      case 0b100000: PPC_DECODER_HIT(vmhaddshs);
-      case 0b100001: PPC_DECODER_HIT(vmhraddshs);
-      case 0b100010: PPC_DECODER_HIT(vmladduhm);
-      case 0b100100: PPC_DECODER_HIT(vmsumubm);
-      case 0b100101: PPC_DECODER_HIT(vmsummbm);
-      case 0b100110: PPC_DECODER_HIT(vmsumuhm);
-      case 0b100111: PPC_DECODER_HIT(vmsumuhs);
-      case 0b101000: PPC_DECODER_HIT(vmsumshm);
-      case 0b101001: PPC_DECODER_HIT(vmsumshs);
-      case 0b101010: PPC_DECODER_HIT(vsel);
-      case 0b101011: PPC_DECODER_HIT(vperm);
-      case 0b101100: PPC_DECODER_HIT(vsldoi);
-      case 0b101110: PPC_DECODER_HIT(vmaddfp);
-      case 0b101111: PPC_DECODER_HIT(vnmsubfp);
-    }
-    switch ((ExtractBits(code, 27, 27) << 0)) {
-      case 0b1: PPC_DECODER_HIT(vsldoi128);
-    }
-    PPC_DECODER_MISS;
-  case 5:
-    switch ((ExtractBits(code, 22, 22) << 5)|(ExtractBits(code, 27, 27) << 0)) {
-      case 0b000000: PPC_DECODER_HIT(vperm128);
-    }
-    switch ((ExtractBits(code, 22, 25) << 2)|(ExtractBits(code, 27, 27) << 0)) {
-      case 0b000001: PPC_DECODER_HIT(vaddfp128);
-      case 0b000101: PPC_DECODER_HIT(vsubfp128);
-      case 0b001001: PPC_DECODER_HIT(vmulfp128);
-      case 0b001101: PPC_DECODER_HIT(vmaddfp128);
-      case 0b010001: PPC_DECODER_HIT(vmaddcfp128);
-      case 0b010101: PPC_DECODER_HIT(vnmsubfp128);
-      case 0b011001: PPC_DECODER_HIT(vmsum3fp128);
-      case 0b011101: PPC_DECODER_HIT(vmsum4fp128);
-      case 0b100000: PPC_DECODER_HIT(vpkshss128);
-      case 0b100001: PPC_DECODER_HIT(vand128);
-      case 0b100100: PPC_DECODER_HIT(vpkshus128);
-      case 0b100101: PPC_DECODER_HIT(vandc128);
-      case 0b101000: PPC_DECODER_HIT(vpkswss128);
-      case 0b101001: PPC_DECODER_HIT(vnor128);
-      case 0b101100: PPC_DECODER_HIT(vpkswus128);
-      case 0b101101: PPC_DECODER_HIT(vor128);
-      case 0b110000: PPC_DECODER_HIT(vpkuhum128);
-      case 0b110001: PPC_DECODER_HIT(vxor128);
-      case 0b110100: PPC_DECODER_HIT(vpkuhus128);
-      case 0b110101: PPC_DECODER_HIT(vsel128);
-      case 0b111000: PPC_DECODER_HIT(vpkuwum128);
-      case 0b111001: PPC_DECODER_HIT(vslo128);
-      case 0b111100: PPC_DECODER_HIT(vpkuwus128);
-      case 0b111101: PPC_DECODER_HIT(vsro128);
-    }
-    PPC_DECODER_MISS;
-  case 6:
-    switch ((ExtractBits(code, 21, 22) << 5)|(ExtractBits(code, 26, 27) << 0)) {
-      case 0b0100001: PPC_DECODER_HIT(vpermwi128);
-    }
-    switch ((ExtractBits(code, 21, 23) << 4)|(ExtractBits(code, 26, 27) << 0)) {
-      case 0b1100001: PPC_DECODER_HIT(vpkd3d128);
-      case 0b1110001: PPC_DECODER_HIT(vrlimi128);
-    }
-    switch ((ExtractBits(code, 21, 27) << 0)) {
-      case 0b0100011: PPC_DECODER_HIT(vcfpsxws128);
-      case 0b0100111: PPC_DECODER_HIT(vcfpuxws128);
-      case 0b0101011: PPC_DECODER_HIT(vcsxwfp128);
-      case 0b0101111: PPC_DECODER_HIT(vcuxwfp128);
-      case 0b0110011: PPC_DECODER_HIT(vrfim128);
-      case 0b0110111: PPC_DECODER_HIT(vrfin128);
-      case 0b0111011: PPC_DECODER_HIT(vrfip128);
-      case 0b0111111: PPC_DECODER_HIT(vrfiz128);
-      case 0b1100011: PPC_DECODER_HIT(vrefp128);
-      case 0b1100111: PPC_DECODER_HIT(vrsqrtefp128);
-      case 0b1101011: PPC_DECODER_HIT(vexptefp128);
-      case 0b1101111: PPC_DECODER_HIT(vlogefp128);
-      case 0b1110011: PPC_DECODER_HIT(vspltw128);
-      case 0b1110111: PPC_DECODER_HIT(vspltisw128);
-      case 0b1111111: PPC_DECODER_HIT(vupkd3d128);
-    }
-    switch ((ExtractBits(code, 22, 24) << 3)|(ExtractBits(code, 27, 27) << 0)) {
-      case 0b000000: PPC_DECODER_HIT(vcmpeqfp128);
-      case 0b001000: PPC_DECODER_HIT(vcmpgefp128);
-      case 0b010000: PPC_DECODER_HIT(vcmpgtfp128);
-      case 0b011000: PPC_DECODER_HIT(vcmpbfp128);
-      case 0b100000: PPC_DECODER_HIT(vcmpequw128);
-    }
-    switch ((ExtractBits(code, 22, 25) << 2)|(ExtractBits(code, 27, 27) << 0)) {
-      case 0b000101: PPC_DECODER_HIT(vrlw128);
-      case 0b001101: PPC_DECODER_HIT(vslw128);
-      case 0b010101: PPC_DECODER_HIT(vsraw128);
-      case 0b011101: PPC_DECODER_HIT(vsrw128);
-      case 0b101000: PPC_DECODER_HIT(vmaxfp128);
-      case 0b101100: PPC_DECODER_HIT(vminfp128);
-      case 0b110000: PPC_DECODER_HIT(vmrghw128);
-      case 0b110100: PPC_DECODER_HIT(vmrglw128);
-      case 0b111000: PPC_DECODER_HIT(vupkhsb128);
-      case 0b111100: PPC_DECODER_HIT(vupklsb128);
-    }
-    PPC_DECODER_MISS;
-  case 7: PPC_DECODER_HIT(mulli);
-  case 8: PPC_DECODER_HIT(subficx);
-  case 10: PPC_DECODER_HIT(cmpli);
-  case 11: PPC_DECODER_HIT(cmpi);
-  case 12: PPC_DECODER_HIT(addic);
-  case 13: PPC_DECODER_HIT(addicx);
-  case 14: PPC_DECODER_HIT(addi);
-  case 15: PPC_DECODER_HIT(addis);
-  case 16: PPC_DECODER_HIT(bcx);
-  case 17: PPC_DECODER_HIT(sc);
-  case 18: PPC_DECODER_HIT(bx);
-  case 19:
-    switch ((ExtractBits(code, 21, 30) << 0)) {
-      case 0b0000000000: PPC_DECODER_HIT(mcrf);
-      case 0b0000010000: PPC_DECODER_HIT(bclrx);
-      case 0b0000100001: PPC_DECODER_HIT(crnor);
-      case 0b0010000001: PPC_DECODER_HIT(crandc);
-      case 0b0010010110: PPC_DECODER_HIT(isync);
-      case 0b0011000001: PPC_DECODER_HIT(crxor);
-      case 0b0011100001: PPC_DECODER_HIT(crnand);
-      case 0b0100000001: PPC_DECODER_HIT(crand);
-      case 0b0100100001: PPC_DECODER_HIT(creqv);
-      case 0b0110100001: PPC_DECODER_HIT(crorc);
-      case 0b0111000001: PPC_DECODER_HIT(cror);
-      case 0b1000010000: PPC_DECODER_HIT(bcctrx);
-    }
-    PPC_DECODER_MISS;
-  case 20: PPC_DECODER_HIT(rlwimix);
-  case 21: PPC_DECODER_HIT(rlwinmx);
-  case 23: PPC_DECODER_HIT(rlwnmx);
-  case 24: PPC_DECODER_HIT(ori);
-  case 25: PPC_DECODER_HIT(oris);
-  case 26: PPC_DECODER_HIT(xori);
-  case 27: PPC_DECODER_HIT(xoris);
-  case 28: PPC_DECODER_HIT(andix);
-  case 29: PPC_DECODER_HIT(andisx);
-  case 30:
-    switch ((ExtractBits(code, 27, 29) << 0)) {
-      case 0b000: PPC_DECODER_HIT(rldiclx);
-      case 0b001: PPC_DECODER_HIT(rldicrx);
-      case 0b010: PPC_DECODER_HIT(rldicx);
-      case 0b011: PPC_DECODER_HIT(rldimix);
-    }
-    switch ((ExtractBits(code, 27, 30) << 0)) {
-      case 0b1000: PPC_DECODER_HIT(rldclx);
-      case 0b1001: PPC_DECODER_HIT(rldcrx);
-    }
-    PPC_DECODER_MISS;
-  case 31:
-    switch ((ExtractBits(code, 21, 29) << 0)) {
-      case 0b110011101: PPC_DECODER_HIT(sradix);
-    }
-    switch ((ExtractBits(code, 21, 30) << 0)) {
-      case 0b0000000000: PPC_DECODER_HIT(cmp);
-      case 0b0000000100: PPC_DECODER_HIT(tw);
-      case 0b0000000110: PPC_DECODER_HIT(lvsl);
-      case 0b0000000111: PPC_DECODER_HIT(lvebx);
-      case 0b0000010011: PPC_DECODER_HIT(mfcr);
-      case 0b0000010100: PPC_DECODER_HIT(lwarx);
-      case 0b0000010101: PPC_DECODER_HIT(ldx);
-      case 0b0000010111: PPC_DECODER_HIT(lwzx);
-      case 0b0000011000: PPC_DECODER_HIT(slwx);
-      case 0b0000011010: PPC_DECODER_HIT(cntlzwx);
-      case 0b0000011011: PPC_DECODER_HIT(sldx);
-      case 0b0000011100: PPC_DECODER_HIT(andx);
-      case 0b0000100000: PPC_DECODER_HIT(cmpl);
-      case 0b0000100110: PPC_DECODER_HIT(lvsr);
-      case 0b0000100111: PPC_DECODER_HIT(lvehx);
-      case 0b0000110101: PPC_DECODER_HIT(ldux);
-      case 0b0000110110: PPC_DECODER_HIT(dcbst);
-      case 0b0000110111: PPC_DECODER_HIT(lwzux);
-      case 0b0000111010: PPC_DECODER_HIT(cntlzdx);
-      case 0b0000111100: PPC_DECODER_HIT(andcx);
-      case 0b0001000100: PPC_DECODER_HIT(td);
-      case 0b0001000111: PPC_DECODER_HIT(lvewx);
-      case 0b0001010011: PPC_DECODER_HIT(mfmsr);
-      case 0b0001010100: PPC_DECODER_HIT(ldarx);
-      case 0b0001010110: PPC_DECODER_HIT(dcbf);
-      case 0b0001010111: PPC_DECODER_HIT(lbzx);
-      case 0b0001100111: PPC_DECODER_HIT(lvx);
-      case 0b0001110111: PPC_DECODER_HIT(lbzux);
-      case 0b0001111100: PPC_DECODER_HIT(norx);
-      case 0b0010000111: PPC_DECODER_HIT(stvebx);
-      case 0b0010010000: PPC_DECODER_HIT(mtcrf);
-      case 0b0010010010: PPC_DECODER_HIT(mtmsr);
-      case 0b0010010101: PPC_DECODER_HIT(stdx);
-      case 0b0010010110: PPC_DECODER_HIT(stwcx);
-      case 0b0010010111: PPC_DECODER_HIT(stwx);
-      case 0b0010100111: PPC_DECODER_HIT(stvehx);
-      case 0b0010110010: PPC_DECODER_HIT(mtmsrd);
-      case 0b0010110101: PPC_DECODER_HIT(stdux);
-      case 0b0010110111: PPC_DECODER_HIT(stwux);
-      case 0b0011000111: PPC_DECODER_HIT(stvewx);
-      case 0b0011010110: PPC_DECODER_HIT(stdcx);
-      case 0b0011010111: PPC_DECODER_HIT(stbx);
-      case 0b0011100111: PPC_DECODER_HIT(stvx);
-      case 0b0011110110: PPC_DECODER_HIT(dcbtst);
-      case 0b0011110111: PPC_DECODER_HIT(stbux);
-      case 0b0100010110: PPC_DECODER_HIT(dcbt);
-      case 0b0100010111: PPC_DECODER_HIT(lhzx);
-      case 0b0100011100: PPC_DECODER_HIT(eqvx);
-      case 0b0100110111: PPC_DECODER_HIT(lhzux);
-      case 0b0100111100: PPC_DECODER_HIT(xorx);
-      case 0b0101010011: PPC_DECODER_HIT(mfspr);
-      case 0b0101010101: PPC_DECODER_HIT(lwax);
-      case 0b0101010111: PPC_DECODER_HIT(lhax);
-      case 0b0101100111: PPC_DECODER_HIT(lvxl);
-      case 0b0101110011: PPC_DECODER_HIT(mftb);
-      case 0b0101110101: PPC_DECODER_HIT(lwaux);
-      case 0b0101110111: PPC_DECODER_HIT(lhaux);
-      case 0b0110010111: PPC_DECODER_HIT(sthx);
-      case 0b0110011100: PPC_DECODER_HIT(orcx);
-      case 0b0110110111: PPC_DECODER_HIT(sthux);
-      case 0b0110111100: PPC_DECODER_HIT(orx);
-      case 0b0111010011: PPC_DECODER_HIT(mtspr);
-      case 0b0111010110: PPC_DECODER_HIT(dcbi);
-      case 0b0111011100: PPC_DECODER_HIT(nandx);
-      case 0b0111100111: PPC_DECODER_HIT(stvxl);
-      case 0b1000000000: PPC_DECODER_HIT(mcrxr);
-      case 0b1000000111: PPC_DECODER_HIT(lvlx);
-      case 0b1000010100: PPC_DECODER_HIT(ldbrx);
-      case 0b1000010101: PPC_DECODER_HIT(lswx);
-      case 0b1000010110: PPC_DECODER_HIT(lwbrx);
-      case 0b1000010111: PPC_DECODER_HIT(lfsx);
-      case 0b1000011000: PPC_DECODER_HIT(srwx);
-      case 0b1000011011: PPC_DECODER_HIT(srdx);
-      case 0b1000100111: PPC_DECODER_HIT(lvrx);
-      case 0b1000110111: PPC_DECODER_HIT(lfsux);
-      case 0b1001010101: PPC_DECODER_HIT(lswi);
-      case 0b1001010110: PPC_DECODER_HIT(sync);
-      case 0b1001010111: PPC_DECODER_HIT(lfdx);
-      case 0b1001110111: PPC_DECODER_HIT(lfdux);
-      case 0b1010000111: PPC_DECODER_HIT(stvlx);
-      case 0b1010010100: PPC_DECODER_HIT(stdbrx);
-      case 0b1010010101: PPC_DECODER_HIT(stswx);
-      case 0b1010010110: PPC_DECODER_HIT(stwbrx);
-      case 0b1010010111: PPC_DECODER_HIT(stfsx);
-      case 0b1010100111: PPC_DECODER_HIT(stvrx);
-      case 0b1010110111: PPC_DECODER_HIT(stfsux);
-      case 0b1011010101: PPC_DECODER_HIT(stswi);
-      case 0b1011010111: PPC_DECODER_HIT(stfdx);
-      case 0b1011110111: PPC_DECODER_HIT(stfdux);
-      case 0b1100000111: PPC_DECODER_HIT(lvlxl);
-      case 0b1100010110: PPC_DECODER_HIT(lhbrx);
-      case 0b1100011000: PPC_DECODER_HIT(srawx);
-      case 0b1100011010: PPC_DECODER_HIT(sradx);
-      case 0b1100100111: PPC_DECODER_HIT(lvrxl);
-      case 0b1100111000: PPC_DECODER_HIT(srawix);
-      case 0b1101010110: PPC_DECODER_HIT(eieio);
-      case 0b1110000111: PPC_DECODER_HIT(stvlxl);
-      case 0b1110010110: PPC_DECODER_HIT(sthbrx);
-      case 0b1110011010: PPC_DECODER_HIT(extshx);
-      case 0b1110100111: PPC_DECODER_HIT(stvrxl);
-      case 0b1110111010: PPC_DECODER_HIT(extsbx);
-      case 0b1111010110: PPC_DECODER_HIT(icbi);
-      case 0b1111010111: PPC_DECODER_HIT(stfiwx);
-      case 0b1111011010: PPC_DECODER_HIT(extswx);
-    }
-    switch ((ExtractBits(code, 22, 30) << 0)) {
-      case 0b000001000: PPC_DECODER_HIT(subfcx);
-      case 0b000001001: PPC_DECODER_HIT(mulhdux);
-      case 0b000001010: PPC_DECODER_HIT(addcx);
-      case 0b000001011: PPC_DECODER_HIT(mulhwux);
-      case 0b000101000: PPC_DECODER_HIT(subfx);
-      case 0b001001001: PPC_DECODER_HIT(mulhdx);
-      case 0b001001011: PPC_DECODER_HIT(mulhwx);
-      case 0b001101000: PPC_DECODER_HIT(negx);
-      case 0b010001000: PPC_DECODER_HIT(subfex);
-      case 0b010001010: PPC_DECODER_HIT(addex);
-      case 0b011001000: PPC_DECODER_HIT(subfzex);
-      case 0b011001010: PPC_DECODER_HIT(addzex);
-      case 0b011101000: PPC_DECODER_HIT(subfmex);
-      case 0b011101001: PPC_DECODER_HIT(mulldx);
-      case 0b011101010: PPC_DECODER_HIT(addmex);
-      case 0b011101011: PPC_DECODER_HIT(mullwx);
-      case 0b100001010: PPC_DECODER_HIT(addx);
-      case 0b111001001: PPC_DECODER_HIT(divdux);
-      case 0b111001011: PPC_DECODER_HIT(divwux);
-      case 0b111101001: PPC_DECODER_HIT(divdx);
-      case 0b111101011: PPC_DECODER_HIT(divwx);
-    }
-    switch ((ExtractBits(code, 6, 10) << 20)|(ExtractBits(code, 21, 30) << 0)) {
-      case 0b0000000000000001111110110: PPC_DECODER_HIT(dcbz);
-      case 0b0000100000000001111110110: PPC_DECODER_HIT(dcbz128);
-    }
-    PPC_DECODER_MISS;
-  case 32: PPC_DECODER_HIT(lwz);
-  case 33: PPC_DECODER_HIT(lwzu);
-  case 34: PPC_DECODER_HIT(lbz);
-  case 35: PPC_DECODER_HIT(lbzu);
-  case 36: PPC_DECODER_HIT(stw);
-  case 37: PPC_DECODER_HIT(stwu);
-  case 38: PPC_DECODER_HIT(stb);
-  case 39: PPC_DECODER_HIT(stbu);
-  case 40: PPC_DECODER_HIT(lhz);
-  case 41: PPC_DECODER_HIT(lhzu);
-  case 42: PPC_DECODER_HIT(lha);
-  case 43: PPC_DECODER_HIT(lhau);
-  case 44: PPC_DECODER_HIT(sth);
-  case 45: PPC_DECODER_HIT(sthu);
-  case 46: PPC_DECODER_HIT(lmw);
-  case 47: PPC_DECODER_HIT(stmw);
-  case 48: PPC_DECODER_HIT(lfs);
-  case 49: PPC_DECODER_HIT(lfsu);
-  case 50: PPC_DECODER_HIT(lfd);
-  case 51: PPC_DECODER_HIT(lfdu);
-  case 52: PPC_DECODER_HIT(stfs);
-  case 53: PPC_DECODER_HIT(stfsu);
-  case 54: PPC_DECODER_HIT(stfd);
-  case 55: PPC_DECODER_HIT(stfdu);
-  case 58:
-    switch ((ExtractBits(code, 30, 31) << 0)) {
-      case 0b00: PPC_DECODER_HIT(ld);
-      case 0b01: PPC_DECODER_HIT(ldu);
-      case 0b10: PPC_DECODER_HIT(lwa);
-    }
-    PPC_DECODER_MISS;
-  case 59:
-    switch ((ExtractBits(code, 26, 30) << 0)) {
-      case 0b10010: PPC_DECODER_HIT(fdivsx);
-      case 0b10100: PPC_DECODER_HIT(fsubsx);
-      case 0b10101: PPC_DECODER_HIT(faddsx);
-      case 0b10110: PPC_DECODER_HIT(fsqrtsx);
-      case 0b11000: PPC_DECODER_HIT(fresx);
-      case 0b11001: PPC_DECODER_HIT(fmulsx);
-      case 0b11100: PPC_DECODER_HIT(fmsubsx);
-      case 0b11101: PPC_DECODER_HIT(fmaddsx);
-      case 0b11110: PPC_DECODER_HIT(fnmsubsx);
-      case 0b11111: PPC_DECODER_HIT(fnmaddsx);
-    }
-    PPC_DECODER_MISS;
-  case 62:
-    switch ((ExtractBits(code, 30, 31) << 0)) {
-      case 0b00: PPC_DECODER_HIT(std);
-      case 0b01: PPC_DECODER_HIT(stdu);
-    }
-    PPC_DECODER_MISS;
-  case 63:
-    switch ((ExtractBits(code, 21, 30) << 0)) {
-      case 0b0000000000: PPC_DECODER_HIT(fcmpu);
-      case 0b0000001100: PPC_DECODER_HIT(frspx);
-      case 0b0000001110: PPC_DECODER_HIT(fctiwx);
-      case 0b0000001111: PPC_DECODER_HIT(fctiwzx);
-      case 0b0000100000: PPC_DECODER_HIT(fcmpo);
-      case 0b0000100110: PPC_DECODER_HIT(mtfsb1x);
-      case 0b0000101000: PPC_DECODER_HIT(fnegx);
-      case 0b0001000000: PPC_DECODER_HIT(mcrfs);
-      case 0b0001000110: PPC_DECODER_HIT(mtfsb0x);
-      case 0b0001001000: PPC_DECODER_HIT(fmrx);
-      case 0b0010000110: PPC_DECODER_HIT(mtfsfix);
-      case 0b0010001000: PPC_DECODER_HIT(fnabsx);
-      case 0b0100001000: PPC_DECODER_HIT(fabsx);
-      case 0b1001000111: PPC_DECODER_HIT(mffsx);
-      case 0b1011000111: PPC_DECODER_HIT(mtfsfx);
-      case 0b1100101110: PPC_DECODER_HIT(fctidx);
-      case 0b1100101111: PPC_DECODER_HIT(fctidzx);
-      case 0b1101001110: PPC_DECODER_HIT(fcfidx);
-    }
-    switch ((ExtractBits(code, 26, 30) << 0)) {
-      case 0b10010: PPC_DECODER_HIT(fdivx);
-      case 0b10100: PPC_DECODER_HIT(fsubx);
-      case 0b10101: PPC_DECODER_HIT(faddx);
-      case 0b10110: PPC_DECODER_HIT(fsqrtx);
-      case 0b10111: PPC_DECODER_HIT(fselx);
-      case 0b11001: PPC_DECODER_HIT(fmulx);
-      case 0b11010: PPC_DECODER_HIT(frsqrtex);
-      case 0b11100: PPC_DECODER_HIT(fmsubx);
-      case 0b11101: PPC_DECODER_HIT(fmaddx);
-      case 0b11110: PPC_DECODER_HIT(fnmsubx);
-      case 0b11111: PPC_DECODER_HIT(fnmaddx);
+  const auto& primary = kPrimaryDecodes[code >> 26];
+  uint16_t opcode =
+      kDecodeTable.opcodes[primary.offset + ((code >> primary.shift) & primary.mask)];
+  if (opcode) {
+    return PPCOpcode(opcode - 1);
+  }
+  for (const auto& entry : kWideDecodeEntries) {
+    if ((code & entry.mask) == entry.value) {
+      return entry.opcode;
     }
-    PPC_DECODER_MISS;
-  default: PPC_DECODER_MISS;
   }
+  assert_always();
+  return PPCOpcode::kInvalid;
 }
 
 }  // namespace ppc
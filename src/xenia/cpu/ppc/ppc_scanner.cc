@@ -42,6 +42,8 @@ bool PPCScanner::IsRestGprLr(uint32_t address) {
 }
 
 bool PPCScanner::Scan(GuestFunction* function, FunctionDebugInfo* debug_info) {
+  SCOPE_profile_cpu_f("cpu");
+
   // This is a simple basic block analyizer. It walks the start address to the
   // end address looking for branches. Each span of instructions between
   // branches is considered a basic block. When the last blr (that has no
@@ -53,6 +55,8 @@ bool PPCScanner::Scan(GuestFunction* function, FunctionDebugInfo* debug_info) {
 
   LOGPPC("Analyzing function {:08X}...", function->address());
 
+  call_targets_.clear();
+
   // For debug info, only if needed.
   uint32_t address_reference_count = 0;
   uint32_t instruction_result_count = 0;
@@ -140,8 +144,7 @@ bool PPCScanner::Scan(GuestFunction* function, FunctionDebugInfo* debug_info) {
       uint32_t target = d.I.ADDR();
       if (d.I.LK()) {
         LOGPPC("bl {:08X} -> {:08X}", address, target);
-        // Queue call target if needed.
-        // GetOrInsertFunction(target);
+        call_targets_.push_back(target);
       } else {
         LOGPPC("b {:08X} -> {:08X}", address, target);
 
@@ -208,6 +211,9 @@ bool PPCScanner::Scan(GuestFunction* function, FunctionDebugInfo* debug_info) {
           //     we are running over tail-call functions here that branch to
           //     somewhere else.
           // GetOrInsertFunction(target);
+        } else if (ends_fn && (target < start_address || target > address)) {
+          // Tail call into another function.
+          call_targets_.push_back(target);
         }
       }
       ends_block = true;
@@ -217,10 +223,9 @@ bool PPCScanner::Scan(GuestFunction* function, FunctionDebugInfo* debug_info) {
       if (d.B.LK()) {
         LOGPPC("bcl {:08X} -> {:08X}", address, target);
 
-        // Queue call target if needed.
         // TODO(benvanik): see if this is correct - not sure anyone makes
         //     function calls with bcl.
-        // GetOrInsertFunction(target);
+        call_targets_.push_back(target);
       } else {
         LOGPPC("bc {:08X} -> {:08X}", address, target);
 
@@ -292,6 +297,542 @@ bool PPCScanner::Scan(GuestFunction* function, FunctionDebugInfo* debug_info) {
   return true;
 }
 
+bool PPCScanner::IsInlineCandidate(uint32_t address,
+                                   uint32_t max_instruction_count,
+                                   uint32_t* out_end_address) {
+  Memory* memory = frontend_->memory();
+
+  uint32_t start_address = address;
+  uint32_t furthest_target = start_address;
+  for (uint32_t i = 0; i < max_instruction_count; ++i, address += 4) {
+    uint32_t code =
+        xe::load_and_swap<uint32_t>(memory->TranslateVirtual(address));
+    auto opcode = LookupOpcode(code);
+
+    PPCDecodeData d;
+    d.address = address;
+    d.code = code;
+
+    if (!code || opcode == PPCOpcode::kInvalid) {
+      return false;
+    }
+    if (code == 0x4E800020) {
+      // blr - the end unless something branches over it.
+      if (furthest_target <= address) {
+        *out_end_address = address;
+        return true;
+      }
+      continue;
+    }
+
+    uint32_t target;
+    switch (opcode) {
+      case PPCOpcode::bx:
+        if (d.I.LK()) {
+          return false;
+        }
+        target = d.I.ADDR();
+        break;
+      case PPCOpcode::bcx:
+        if (d.B.LK()) {
+          return false;
+        }
+        target = d.B.ADDR();
+        break;
+      case PPCOpcode::bclrx:
+        // Conditional return.
+        if (d.XL.LK()) {
+          return false;
+        }
+        continue;
+      case PPCOpcode::mtspr:
+        // The return address must stay what the caller set.
+        if ((((d.XFX.SPR() & 0x1F) << 5) | ((d.XFX.SPR() >> 5) & 0x1F)) ==
+            8) {
+          return false;
+        }
+        continue;
+      case PPCOpcode::bcctrx:
+      case PPCOpcode::sc:
+        return false;
+      default:
+        continue;
+    }
+    // Branches must stay within the function. The end is only known at the
+    // final blr, which can't be before furthest_target.
+    if (target < start_address) {
+      return false;
+    }
+    furthest_target = std::max(furthest_target, target);
+  }
+  return false;
+}
+
+namespace {
+
+// The register use of an instruction of a memory idiom candidate.
+struct IdiomInstr {
+  enum class Access {
+    kNone,
+    kLoad,
+    kStore,
+  };
+
+  // GPRs read as a bit mask.
+  uint32_t reads = 0;
+  // GPR written with a value that isn't an address, or -1.
+  int32_t value_dest = -1;
+  // GPR written with address_a + address_b plus a constant, or -1.
+  int32_t address_dest = -1;
+  // Operands of the address computed for address_dest and the memory access,
+  // -1 when not used. address_b is subtracted instead if negated.
+  int32_t address_a = -1;
+  int32_t address_b = -1;
+  bool address_b_negated = false;
+  Access access = Access::kNone;
+  // Cache block instructions and VMX accesses.
+  bool streaming = false;
+  // Loop branches back to the same or an earlier instruction.
+  bool loops = false;
+};
+
+constexpr uint32_t GprBit(int32_t reg) { return reg >= 0 ? 1u << reg : 0; }
+
+// Decodes the instruction for FindMemoryIdiom, returning false if it isn't
+// one these routines consist of.
+bool DecodeIdiomInstr(const PPCDecodeData& d, PPCOpcode opcode,
+                      uint32_t start_address, uint32_t end_address,
+                      IdiomInstr* out) {
+  // The register fields are in the same place in every format that has them.
+  int32_t rt = int32_t(d.X.RT());
+  int32_t ra = int32_t(d.X.RA());
+  int32_t rb = int32_t(d.X.RB());
+  int32_t ra0 = ra ? ra : -1;
+  auto access = [&](IdiomInstr::Access kind, bool indexed, bool update) {
+    out->access = kind;
+    out->address_a = ra0;
+    out->address_b = indexed ? rb : -1;
+    out->reads |= GprBit(out->address_a) | GprBit(out->address_b);
+    if (update) {
+      if (!ra || ra == rt) {
+        return false;
+      }
+      out->address_dest = ra;
+    }
+    return true;
+  };
+  auto load_gpr = [&](bool indexed, bool update) {
+    out->value_dest = rt;
+    return access(IdiomInstr::Access::kLoad, indexed, update);
+  };
+  auto store_gpr = [&](bool indexed, bool update) {
+    out->reads |= GprBit(rt);
+    return access(IdiomInstr::Access::kStore, indexed, update);
+  };
+  auto vector_access = [&](IdiomInstr::Access kind) {
+    out->streaming = true;
+    return access(kind, true, false);
+  };
+  auto branch = [&](uint32_t target) {
+    if (target < start_address || target > end_address) {
+      return false;
+    }
+    out->loops = target <= d.address;
+    return true;
+  };
+
+  switch (opcode) {
+    case PPCOpcode::lbz:
+    case PPCOpcode::lhz:
+    case PPCOpcode::lha:
+    case PPCOpcode::lwz:
+    case PPCOpcode::lwa:
+    case PPCOpcode::ld:
+      return load_gpr(false, false);
+    case PPCOpcode::lbzu:
+    case PPCOpcode::lhzu:
+    case PPCOpcode::lhau:
+    case PPCOpcode::lwzu:
+    case PPCOpcode::ldu:
+      return load_gpr(false, true);
+    case PPCOpcode::lbzx:
+    case PPCOpcode::lhzx:
+    case PPCOpcode::lhax:
+    case PPCOpcode::lwzx:
+    case PPCOpcode::lwax:
+    case PPCOpcode::ldx:
+      return load_gpr(true, false);
+    case PPCOpcode::lbzux:
+    case PPCOpcode::lhzux:
+    case PPCOpcode::lhaux:
+    case PPCOpcode::lwzux:
+    case PPCOpcode::lwaux:
+    case PPCOpcode::ldux:
+      return load_gpr(true, true);
+    // Single precision accesses convert, so only doubles copy exactly.
+    case PPCOpcode::lfd:
+      return access(IdiomInstr::Access::kLoad, false, false);
+    case PPCOpcode::lfdu:
+      return access(IdiomInstr::Access::kLoad, false, true);
+    case PPCOpcode::lfdx:
+      return access(IdiomInstr::Access::kLoad, true, false);
+    case PPCOpcode::lfdux:
+      return access(IdiomInstr::Access::kLoad, true, true);
+    case PPCOpcode::lvx:
+    case PPCOpcode::lvxl:
+    case PPCOpcode::lvlx:
+    case PPCOpcode::lvlxl:
+    case PPCOpcode::lvrx:
+    case PPCOpcode::lvrxl:
+    case PPCOpcode::lvebx:
+    case PPCOpcode::lvehx:
+    case PPCOpcode::lvewx:
+    case PPCOpcode::lvx128:
+    case PPCOpcode::lvxl128:
+    case PPCOpcode::lvlx128:
+    case PPCOpcode::lvlxl128:
+    case PPCOpcode::lvrx128:
+    case PPCOpcode::lvrxl128:
+    case PPCOpcode::lvewx128:
+      return vector_access(IdiomInstr::Access::kLoad);
+    case PPCOpcode::stb:
+    case PPCOpcode::sth:
+    case PPCOpcode::stw:
+    case PPCOpcode::std:
+      return store_gpr(false, false);
+    case PPCOpcode::stbu:
+    case PPCOpcode::sthu:
+    case PPCOpcode::stwu:
+    case PPCOpcode::stdu:
+      return store_gpr(false, true);
+    case PPCOpcode::stbx:
+    case PPCOpcode::sthx:
+    case PPCOpcode::stwx:
+    case PPCOpcode::stdx:
+      return store_gpr(true, false);
+    case PPCOpcode::stbux:
+    case PPCOpcode::sthux:
+    case PPCOpcode::stwux:
+    case PPCOpcode::stdux:
+      return store_gpr(true, true);
+    case PPCOpcode::stfd:
+      return access(IdiomInstr::Access::kStore, false, false);
+    case PPCOpcode::stfdu:
+      return access(IdiomInstr::Access::kStore, false, true);
+    case PPCOpcode::stfdx:
+      return access(IdiomInstr::Access::kStore, true, false);
+    case PPCOpcode::stfdux:
+      return access(IdiomInstr::Access::kStore, true, true);
+    case PPCOpcode::stvx:
+    case PPCOpcode::stvxl:
+    case PPCOpcode::stvlx:
+    case PPCOpcode::stvlxl:
+    case PPCOpcode::stvrx:
+    case PPCOpcode::stvrxl:
+    case PPCOpcode::stvebx:
+    case PPCOpcode::stvehx:
+    case PPCOpcode::stvewx:
+    case PPCOpcode::stvx128:
+    case PPCOpcode::stvxl128:
+    case PPCOpcode::stvlx128:
+    case PPCOpcode::stvlxl128:
+    case PPCOpcode::stvrx128:
+    case PPCOpcode::stvrxl128:
+    case PPCOpcode::stvewx128:
+    case PPCOpcode::dcbz:
+    case PPCOpcode::dcbz128:
+      return vector_access(IdiomInstr::Access::kStore);
+    case PPCOpcode::dcbt:
+    case PPCOpcode::dcbtst:
+      // Only a hint, wherever it points.
+      out->streaming = true;
+      out->reads |= GprBit(ra0) | GprBit(rb);
+      return true;
+    case PPCOpcode::lvsl:
+    case PPCOpcode::lvsr:
+    case PPCOpcode::lvsl128:
+    case PPCOpcode::lvsr128:
+      out->reads |= GprBit(ra0) | GprBit(rb);
+      return true;
+
+    case PPCOpcode::addi:
+    case PPCOpcode::addis:
+      if (!ra) {
+        out->value_dest = rt;
+        return true;
+      }
+      [[fallthrough]];
+    case PPCOpcode::addic:
+    case PPCOpcode::addicx:
+      out->address_dest = rt;
+      out->address_a = ra;
+      out->reads |= GprBit(ra);
+      return true;
+    case PPCOpcode::addx:
+    case PPCOpcode::addcx:
+      out->address_dest = rt;
+      out->address_a = ra;
+      out->address_b = rb;
+      out->reads |= GprBit(ra) | GprBit(rb);
+      return true;
+    case PPCOpcode::subfx:
+    case PPCOpcode::subfcx:
+      // rt = rb - ra.
+      out->address_dest = rt;
+      out->address_a = rb;
+      out->address_b = ra;
+      out->address_b_negated = true;
+      out->reads |= GprBit(ra) | GprBit(rb);
+      return true;
+    case PPCOpcode::orx:
+      out->reads |= GprBit(rt) | GprBit(rb);
+      if (rt == rb) {
+        // mr ra, rs.
+        out->address_dest = ra;
+        out->address_a = rt;
+      } else {
+        out->value_dest = ra;
+      }
+      return true;
+    case PPCOpcode::cmp:
+    case PPCOpcode::cmpl:
+      out->reads |= GprBit(ra) | GprBit(rb);
+      return true;
+    case PPCOpcode::cmpi:
+    case PPCOpcode::cmpli:
+      out->reads |= GprBit(ra);
+      return true;
+    case PPCOpcode::mulli:
+    case PPCOpcode::subficx:
+    case PPCOpcode::negx:
+    case PPCOpcode::addmex:
+    case PPCOpcode::addzex:
+    case PPCOpcode::subfmex:
+    case PPCOpcode::subfzex:
+      out->value_dest = rt;
+      out->reads |= GprBit(ra);
+      return true;
+    case PPCOpcode::addex:
+    case PPCOpcode::subfex:
+    case PPCOpcode::mullwx:
+    case PPCOpcode::mulldx:
+    case PPCOpcode::mulhwx:
+    case PPCOpcode::mulhwux:
+    case PPCOpcode::mulhdx:
+    case PPCOpcode::mulhdux:
+    case PPCOpcode::divwx:
+    case PPCOpcode::divwux:
+    case PPCOpcode::divdx:
+    case PPCOpcode::divdux:
+      out->value_dest = rt;
+      out->reads |= GprBit(ra) | GprBit(rb);
+      return true;
+    case PPCOpcode::andix:
+    case PPCOpcode::andisx:
+    case PPCOpcode::ori:
+    case PPCOpcode::oris:
+    case PPCOpcode::xori:
+    case PPCOpcode::xoris:
+    case PPCOpcode::rlwinmx:
+    case PPCOpcode::rldiclx:
+    case PPCOpcode::rldicrx:
+    case PPCOpcode::rldicx:
+    case PPCOpcode::sradix:
+    case PPCOpcode::srawix:
+    case PPCOpcode::cntlzwx:
+    case PPCOpcode::cntlzdx:
+    case PPCOpcode::extsbx:
+    case PPCOpcode::extshx:
+    case PPCOpcode::extswx:
+      out->value_dest = ra;
+      out->reads |= GprBit(rt);
+      return true;
+    case PPCOpcode::rlwimix:
+    case PPCOpcode::rldimix:
+      out->value_dest = ra;
+      out->reads |= GprBit(rt) | GprBit(ra);
+      return true;
+    case PPCOpcode::andx:
+    case PPCOpcode::andcx:
+    case PPCOpcode::orcx:
+    case PPCOpcode::xorx:
+    case PPCOpcode::norx:
+    case PPCOpcode::nandx:
+    case PPCOpcode::eqvx:
+    case PPCOpcode::slwx:
+    case PPCOpcode::srwx:
+    case PPCOpcode::srawx:
+    case PPCOpcode::sldx:
+    case PPCOpcode::srdx:
+    case PPCOpcode::sradx:
+    case PPCOpcode::rlwnmx:
+    case PPCOpcode::rldclx:
+    case PPCOpcode::rldcrx:
+      out->value_dest = ra;
+      out->reads |= GprBit(rt) | GprBit(rb);
+      return true;
+
+    case PPCOpcode::mtspr:
+      // Only the loop counter.
+      if ((((d.XFX.SPR() & 0x1F) << 5) | ((d.XFX.SPR() >> 5) & 0x1F)) != 9) {
+        return false;
+      }
+      out->reads |= GprBit(rt);
+      return true;
+    case PPCOpcode::crand:
+    case PPCOpcode::crandc:
+    case PPCOpcode::creqv:
+    case PPCOpcode::crnand:
+    case PPCOpcode::crnor:
+    case PPCOpcode::cror:
+    case PPCOpcode::crorc:
+    case PPCOpcode::crxor:
+    case PPCOpcode::mcrf:
+      return true;
+    case PPCOpcode::bx:
+      return !d.I.LK() && !d.I.AA() && branch(d.I.ADDR());
+    case PPCOpcode::bcx:
+      return !d.B.LK() && !d.B.AA() && branch(d.B.ADDR());
+    case PPCOpcode::bclrx:
+      return !d.XL.LK();
+
+    default:
+      // Floating-point and VMX operations only use their own registers.
+      switch (GetOpcodeInfo(opcode).group) {
+        case PPCOpcodeGroup::kF:
+        case PPCOpcodeGroup::kV:
+          return true;
+        default:
+          return false;
+      }
+  }
+}
+
+// Whether the address is one of the pointers plus a value not derived from
+// the arguments.
+bool IsDerivedAddress(const IdiomInstr& instr, uint32_t pointers,
+                      uint32_t tainted) {
+  bool a_pointer = pointers & GprBit(instr.address_a);
+  bool b_pointer = pointers & GprBit(instr.address_b);
+  bool a_offset = !(tainted & GprBit(instr.address_a));
+  bool b_offset = !(tainted & GprBit(instr.address_b));
+  return (a_pointer && b_offset) ||
+         (!instr.address_b_negated && b_pointer && a_offset);
+}
+
+// Finds the registers that only ever hold the pointer argument in seed plus
+// offsets not derived from the arguments.
+uint32_t FindDerivedPointers(const std::vector<IdiomInstr>& instrs,
+                             int32_t seed, uint32_t tainted) {
+  // Start with everything an address is computed from the seed through and
+  // remove registers also written with anything else until none are left.
+  uint32_t pointers = GprBit(seed);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (const auto& instr : instrs) {
+      uint32_t operands = GprBit(instr.address_a);
+      if (!instr.address_b_negated) {
+        operands |= GprBit(instr.address_b);
+      }
+      if (instr.address_dest >= 0 && (pointers & operands) &&
+          !(pointers & GprBit(instr.address_dest))) {
+        pointers |= GprBit(instr.address_dest);
+        changed = true;
+      }
+    }
+  }
+  for (const auto& instr : instrs) {
+    pointers &= ~GprBit(instr.value_dest);
+  }
+  changed = true;
+  while (changed) {
+    changed = false;
+    for (const auto& instr : instrs) {
+      if ((pointers & GprBit(instr.address_dest)) &&
+          !IsDerivedAddress(instr, pointers, tainted)) {
+        pointers &= ~GprBit(instr.address_dest);
+        changed = true;
+      }
+    }
+  }
+  return pointers;
+}
+
+}  // namespace
+
+MemoryIdiom PPCScanner::FindMemoryIdiom(GuestFunction* function) {
+  Memory* memory = frontend_->memory();
+
+  uint32_t start_address = function->address();
+  uint32_t end_address = function->end_address();
+  std::vector<IdiomInstr> instrs;
+  instrs.reserve((end_address - start_address) / 4 + 1);
+  uint32_t reads = 0;
+  uint32_t writes = 0;
+  bool loops = false;
+  bool streaming = false;
+  bool loads = false;
+  bool stores = false;
+  for (uint32_t address = start_address; address <= end_address;
+       address += 4) {
+    PPCDecodeData d;
+    d.address = address;
+    d.code = xe::load_and_swap<uint32_t>(memory->TranslateVirtual(address));
+    IdiomInstr instr;
+    if (!DecodeIdiomInstr(d, LookupOpcode(d.code), start_address, end_address,
+                          &instr)) {
+      return MemoryIdiom::kNone;
+    }
+    reads |= instr.reads;
+    writes |= GprBit(instr.value_dest) | GprBit(instr.address_dest);
+    loops |= instr.loops;
+    streaming |= instr.streaming;
+    loads |= instr.access == IdiomInstr::Access::kLoad;
+    stores |= instr.access == IdiomInstr::Access::kStore;
+    instrs.push_back(instr);
+  }
+
+  // Without a stack frame, nothing but the volatile registers other than the
+  // returned destination can be changed.
+  constexpr uint32_t kWritableGprs = 0x00001FF1;
+  if ((writes & ~kWritableGprs) || !loops || !streaming || !stores ||
+      !(reads & GprBit(4)) || !(reads & GprBit(5))) {
+    return MemoryIdiom::kNone;
+  }
+
+  // Values computed from the pointers (or from the fill value) can't be used
+  // as offsets, so every access stays relative to its pointer.
+  uint32_t tainted = GprBit(3) | GprBit(4);
+  bool changed = true;
+  while (changed) {
+    uint32_t new_tainted = tainted;
+    for (const auto& instr : instrs) {
+      if (instr.access == IdiomInstr::Access::kLoad ||
+          (instr.reads & tainted)) {
+        new_tainted |=
+            GprBit(instr.value_dest) | GprBit(instr.address_dest);
+      }
+    }
+    changed = new_tainted != tainted;
+    tainted = new_tainted;
+  }
+  uint32_t dst_pointers = FindDerivedPointers(instrs, 3, tainted);
+  uint32_t src_pointers =
+      loads ? FindDerivedPointers(instrs, 4, tainted) : 0;
+  for (const auto& instr : instrs) {
+    if (instr.access == IdiomInstr::Access::kStore &&
+        !IsDerivedAddress(instr, dst_pointers, tainted)) {
+      return MemoryIdiom::kNone;
+    }
+    if (instr.access == IdiomInstr::Access::kLoad &&
+        !IsDerivedAddress(instr, src_pointers, tainted)) {
+      return MemoryIdiom::kNone;
+    }
+  }
+  return loads ? MemoryIdiom::kCopy : MemoryIdiom::kFill;
+}
+
 std::vector<BlockInfo> PPCScanner::FindBlocks(GuestFunction* function) {
   Memory* memory = frontend_->memory();
 
@@ -26,6 +26,16 @@ struct BlockInfo {
   uint32_t end_address;
 };
 
+// C library memory routines that titles link statically and that calls can be
+// serviced by the host for.
+enum class MemoryIdiom {
+  kNone,
+  // memcpy(r3 = dst, r4 = src, r5 = size), returning dst.
+  kCopy,
+  // memset(r3 = dst, r4 = value, r5 = size), returning dst.
+  kFill,
+};
+
 class PPCScanner {
  public:
   explicit PPCScanner(PPCFrontend* frontend);
@@ -35,10 +45,29 @@ class PPCScanner {
 
   std::vector<BlockInfo> FindBlocks(GuestFunction* function);
 
+  // Checks whether the function at the address is a leaf that can be emitted
+  // into its callers: at most max_instruction_count instructions, returning
+  // only with blr variants, no calls or other branches leaving it and no LR
+  // writes. Outputs the address of the final blr.
+  bool IsInlineCandidate(uint32_t address, uint32_t max_instruction_count,
+                         uint32_t* out_end_address);
+
+  // Fingerprints the function by its instructions as a memcpy or memset
+  // implementation: a leaf without a stack frame that loops over memory with
+  // cache block or VMX instructions, leaves r3 unchanged, stores only through
+  // pointers derived from r3 and loads only through pointers derived from r4.
+  // A match only means the function may be one, so the results of its calls
+  // still have to be checked before the host takes them over.
+  MemoryIdiom FindMemoryIdiom(GuestFunction* function);
+
+  // Direct call and tail call targets found during the last Scan.
+  const std::vector<uint32_t>& call_targets() const { return call_targets_; }
+
  private:
   bool IsRestGprLr(uint32_t address);
 
   PPCFrontend* frontend_ = nullptr;
+  std::vector<uint32_t> call_targets_;
 };
 
 }  // namespace ppc
@@ -9,8 +9,11 @@
 
 #include "xenia/cpu/ppc/ppc_translator.h"
 
+#include <algorithm>
+
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/reset_scope.h"
@@ -30,6 +33,34 @@ using xe::cpu::backend::Backend;
 using xe::cpu::compiler::Compiler;
 namespace passes = xe::cpu::compiler::passes;
 
+namespace {
+
+// Adds the time until it goes out of scope to a stage of the translation,
+// when statistics are being collected.
+class StageTimer {
+ public:
+  StageTimer(JitStats::Translation* stats, JitStats::Stage stage)
+      : stats_(stats),
+        stage_(stage),
+        start_ticks_(stats ? Clock::QueryHostTickCount() : 0) {}
+  ~StageTimer() {
+    if (stats_) {
+      stats_->stages[size_t(stage_)].Add(
+          Clock::QueryHostTickCount() - start_ticks_, bytes_);
+    }
+  }
+
+  void set_bytes(uint64_t bytes) { bytes_ = bytes; }
+
+ private:
+  JitStats::Translation* stats_;
+  JitStats::Stage stage_;
+  uint64_t start_ticks_;
+  uint64_t bytes_ = 0;
+};
+
+}  // namespace
+
 PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
   Backend* backend = frontend->processor()->backend();
 
@@ -71,20 +102,35 @@ PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
   }
   compiler_->AddPass(std::make_unique<passes::SimplificationPass>());
   if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
-  // compiler_->AddPass(std::make_unique<passes::DeadStoreEliminationPass>());
-  // if (validate)
-  // compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  compiler_->AddPass(std::make_unique<passes::DeadStoreEliminationPass>());
+  if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
   compiler_->AddPass(std::make_unique<passes::DeadCodeEliminationPass>());
   if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
 
-  //// Removes all unneeded variables. Try not to add new ones after this.
-  // compiler_->AddPass(new passes::ValueReductionPass());
-  // if (validate) compiler_->AddPass(new passes::ValidationPass());
+  // Removes all unneeded variables. Try not to add new ones after this.
+  compiler_->AddPass(std::make_unique<passes::ValueReductionPass>());
+  if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
 
   //RepetitiveComputationMergerPass ala Chrispy
   compiler_->AddPass(std::make_unique<passes::RepetitiveComputationMergerPass>());
   if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
 
+  // Loops are where most time is spent, so keep them free of what doesn't
+  // change between iterations.
+  compiler_->AddPass(std::make_unique<passes::LoopInvariantCodeMotionPass>());
+  if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+
+  // Lets the backend branch on the flags of compares, which often only remain
+  // for branches once unobserved condition register stores are gone.
+  compiler_->AddPass(std::make_unique<passes::ConditionSinkingPass>());
+  if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+
+  // Liveness of values across blocks, used by register allocation to keep
+  // them in registers.
+  if (cvars::global_register_allocation) {
+    compiler_->AddPass(std::make_unique<passes::DataFlowAnalysisPass>());
+  }
+
   // Register allocation for the target backend.
   // Will modify the HIR to add loads/stores.
   // This should be the last pass before finalization, as after this all
@@ -95,6 +141,27 @@ PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
 
   // Must come last. The HIR is not really HIR after this.
   compiler_->AddPass(std::make_unique<passes::FinalizationPass>());
+
+  // Baseline tier for tiered compilation, only doing what the backend needs.
+  // Constant propagation is required as sequences don't accept instructions
+  // with only constant operands.
+  baseline_compiler_.reset(new Compiler(frontend->processor()));
+  if (validate) {
+    baseline_compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  }
+  baseline_compiler_->AddPass(
+      std::make_unique<passes::ConstantPropagationPass>());
+  baseline_compiler_->AddPass(
+      std::make_unique<passes::DeadCodeEliminationPass>());
+  if (validate) {
+    baseline_compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  }
+  baseline_compiler_->AddPass(std::make_unique<passes::RegisterAllocationPass>(
+      backend->machine_info()));
+  if (validate) {
+    baseline_compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  }
+  baseline_compiler_->AddPass(std::make_unique<passes::FinalizationPass>());
 }
 
 PPCTranslator::~PPCTranslator() = default;
@@ -103,9 +170,26 @@ bool PPCTranslator::Translate(GuestFunction* function,
                               uint32_t debug_info_flags) {
   SCOPE_profile_cpu_f("cpu");
 
+  JitStats* jit_stats = frontend_->processor()->jit_stats();
+  if (!jit_stats) {
+    return TranslateFunction(function, debug_info_flags, nullptr);
+  }
+  jit_stats_translation_.Reset();
+  if (!TranslateFunction(function, debug_info_flags,
+                         &jit_stats_translation_)) {
+    return false;
+  }
+  jit_stats->AddTranslation(function->address(), jit_stats_translation_);
+  return true;
+}
+
+bool PPCTranslator::TranslateFunction(GuestFunction* function,
+                                      uint32_t debug_info_flags,
+                                      JitStats::Translation* stats) {
   // Reset() all caching when we leave.
   xe::make_reset_scope(builder_);
   xe::make_reset_scope(compiler_);
+  xe::make_reset_scope(baseline_compiler_);
   xe::make_reset_scope(assembler_);
   xe::make_reset_scope(&string_buffer_);
 
@@ -131,10 +215,46 @@ bool PPCTranslator::Translate(GuestFunction* function,
   }
 
   // Scan the function to find its extents and gather debug data.
-  if (!scanner_->Scan(function, debug_info.get())) {
-    return false;
+  {
+    StageTimer timer(stats, JitStats::Stage::kScan);
+    if (!scanner_->Scan(function, debug_info.get())) {
+      return false;
+    }
+  }
+
+  // Let the background threads get started on whatever this will call.
+  for (uint32_t target : scanner_->call_targets()) {
+    frontend_->processor()->QueueSpeculativeCompile(target);
+  }
+
+  // Calls of memcpy and memset implementations go to the host when it can
+  // service them. The builtins this needs only exist in this process.
+  const MemoryIdiomBuiltins* memory_idiom = nullptr;
+  if (cvars::recognize_memory_idioms && !debug_info_flags) {
+    MemoryIdiom idiom = scanner_->FindMemoryIdiom(function);
+    if (idiom != MemoryIdiom::kNone) {
+      memory_idiom = frontend_->DefineMemoryIdiom(function, idiom);
+    }
   }
 
+  // Reuse code generated by a previous run if the guest code is unchanged.
+  // Debug info and tracing can't be recovered from stored code, and neither
+  // can the MMIO access sites found in this run.
+  if (!debug_info_flags && !function->has_mmio_access_sites() &&
+      !memory_idiom) {
+    StageTimer timer(stats, JitStats::Stage::kAssemble);
+    if (assembler_->AssembleFromStorage(function)) {
+      timer.set_bytes(function->machine_code_length());
+      function->set_baseline_tier(false);
+      return true;
+    }
+  }
+
+  // Start with the baseline tier unless this is the recompilation of a hot
+  // function, or the full pipeline is needed for debugging.
+  bool baseline = cvars::tiered_compilation && !debug_info_flags &&
+                  !function->tier_up_started();
+
   // Setup trace data, if needed.
   if (debug_info_flags & DebugInfoFlags::kDebugInfoTraceFunctions) {
     // Base trace data.
@@ -168,8 +288,12 @@ bool PPCTranslator::Translate(GuestFunction* function,
   if (debug_info) {
     emit_flags |= PPCHIRBuilder::EMIT_DEBUG_COMMENTS;
   }
-  if (!builder_->Emit(function, emit_flags)) {
-    return false;
+  {
+    StageTimer timer(stats, JitStats::Stage::kEmitHir);
+    if (!builder_->Emit(function, emit_flags, memory_idiom)) {
+      return false;
+    }
+    timer.set_bytes(builder_->arena()->CalculateSize());
   }
 
   // Stash raw HIR.
@@ -180,8 +304,17 @@ bool PPCTranslator::Translate(GuestFunction* function,
   }
 
   // Compile/optimize/etc.
-  if (!compiler_->Compile(builder_.get())) {
-    return false;
+  Compiler* compiler = baseline ? baseline_compiler_.get() : compiler_.get();
+  {
+    StageTimer timer(stats, JitStats::Stage::kCompile);
+    size_t hir_size = stats ? builder_->arena()->CalculateSize() : 0;
+    if (!compiler->Compile(builder_.get(), stats)) {
+      return false;
+    }
+    if (stats) {
+      size_t new_hir_size = builder_->arena()->CalculateSize();
+      timer.set_bytes(new_hir_size > hir_size ? new_hir_size - hir_size : 0);
+    }
   }
 
   // Stash optimized HIR.
@@ -192,9 +325,23 @@ bool PPCTranslator::Translate(GuestFunction* function,
   }
 
   // Assemble to backend machine code.
-  if (!assembler_->Assemble(function, builder_.get(), debug_info_flags,
-                            std::move(debug_info))) {
-    return false;
+  // The baseline tier must be marked before the code becomes reachable so
+  // that callers never link directly to code that will be replaced.
+  if (baseline) {
+    function->set_baseline_tier(true);
+    *function->tier_up_countdown() =
+        std::max(cvars::tiered_compilation_threshold, int32_t(1));
+  }
+  {
+    StageTimer timer(stats, JitStats::Stage::kAssemble);
+    if (!assembler_->Assemble(function, builder_.get(), debug_info_flags,
+                              std::move(debug_info))) {
+      return false;
+    }
+    timer.set_bytes(function->machine_code_length());
+  }
+  if (!baseline) {
+    function->set_baseline_tier(false);
   }
 
   return true;
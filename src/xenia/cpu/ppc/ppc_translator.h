@@ -16,6 +16,7 @@
 #include "xenia/cpu/backend/assembler.h"
 #include "xenia/cpu/compiler/compiler.h"
 #include "xenia/cpu/function.h"
+#include "xenia/cpu/jit_stats.h"
 
 namespace xe {
 namespace cpu {
@@ -33,15 +34,20 @@ class PPCTranslator {
   bool Translate(GuestFunction* function, uint32_t debug_info_flags);
 
  private:
+  bool TranslateFunction(GuestFunction* function, uint32_t debug_info_flags,
+                         JitStats::Translation* stats);
   void DumpSource(GuestFunction* function, StringBuffer* string_buffer);
 
   PPCFrontend* frontend_;
   std::unique_ptr<PPCScanner> scanner_;
   std::unique_ptr<PPCHIRBuilder> builder_;
   std::unique_ptr<compiler::Compiler> compiler_;
+  std::unique_ptr<compiler::Compiler> baseline_compiler_;
   std::unique_ptr<backend::Assembler> assembler_;
 
   StringBuffer string_buffer_;
+  // Reused by every translation while --dump_jit_stats is enabled.
+  JitStats::Translation jit_stats_translation_;
 };
 
 }  // namespace ppc
@@ -1,11 +1,12 @@
 test_vmaddfp_1:
-  #_ REGISTER_IN v4 [3f800000, 3fc00000, 3f8ccccd, 3ff33333]
-  # 1.0, 1.5, 1.1, 1.9
+  #_ REGISTER_IN v4 [3f800000, 3fc00000, 3f99999a, 3ff33333]
+  # 1.0, 1.5, 1.2, 1.9
   vmaddfp v3, v4, v4, v4
   blr
-  #_ REGISTER_OUT v3 [40000000, 40700000, 4013d70a, 40b051eb]
-  #_ REGISTER_OUT v4 [3f800000, 3fc00000, 3f8ccccd, 3ff33333]
-  # 2.0, 3.75, 2.31, 5.51
+  #_ REGISTER_OUT v3 [40000000, 40700000, 4028f5c3, 40b051eb]
+  #_ REGISTER_OUT v4 [3f800000, 3fc00000, 3f99999a, 3ff33333]
+  # 2.0, 3.75, 2.64, 5.51
+  # Same result whether the product is rounded before the add or not.
   # 40b051eb is actually 5.50999975, not 5.51?
   # 40b051ec is 5.51
 
@@ -36,4 +37,14 @@ test_vmaddfp_3:
   #_ REGISTER_OUT v4 [40a00000, 40a00000, 3f800000, 3f800000]
   #_ REGISTER_OUT v5 [40a00000, 40a00000, 3f800000, 3f800000]
   #_ REGISTER_OUT v6 [3f800000, 3f800000, 3f800000, 3f800000]
-  
\ No newline at end of file
+  
+
+test_vmaddfp_4:
+  #_ HOST_REQUIRES fma_for_vmx
+  #_ REGISTER_IN v4 [3f8ccccd, 3f8ccccd, 3f8ccccd, 3f8ccccd]
+  # 1.1, 1.1, 1.1, 1.1
+  vmaddfp v3, v4, v4, v4
+  blr
+  # 2.31, not rounding the product before the add (4013d70a if it is).
+  #_ REGISTER_OUT v3 [4013d70b, 4013d70b, 4013d70b, 4013d70b]
+  #_ REGISTER_OUT v4 [3f8ccccd, 3f8ccccd, 3f8ccccd, 3f8ccccd]
@@ -14,6 +14,7 @@
 #include "xenia/base/platform.h"
 #include "xenia/base/string_buffer.h"
 #include "xenia/cpu/backend/x64/x64_backend.h"
+#include "xenia/cpu/backend/x64/x64_emitter.h"
 #include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/ppc/ppc_context.h"
 #include "xenia/cpu/ppc/ppc_frontend.h"
@@ -240,6 +241,31 @@ class TestRunner {
     return true;
   }
 
+  // Whether the host has everything the HOST_REQUIRES annotations of the test
+  // name, for tests of results that differ between code generation paths.
+  bool IsSupportedByHost(const TestCase& test_case) {
+    for (auto& it : test_case.annotations) {
+      if (it.first != "HOST_REQUIRES") {
+        continue;
+      }
+      if (it.second == "fma_for_vmx") {
+#if defined(XENIA_HAS_X64_BACKEND) && XENIA_HAS_X64_BACKEND
+        auto backend = static_cast<xe::cpu::backend::x64::X64Backend*>(
+            processor_->backend());
+        if (cvars::use_fma_for_vmx &&
+            (backend->emitter_feature_flags() &
+             xe::cpu::backend::x64::kX64EmitFMA)) {
+          continue;
+        }
+#endif  // XENIA_HAS_X64_BACKEND
+        return false;
+      }
+      XELOGE("Unknown host requirement {}", it.second);
+      return false;
+    }
+    return true;
+  }
+
   bool Run(TestCase& test_case) {
     // Setup test state from annotations.
     if (!SetupTestState(test_case)) {
@@ -390,7 +416,7 @@ int filter(unsigned int code) {
 
 void ProtectedRunTest(TestSuite& test_suite, TestRunner& runner,
                       TestCase& test_case, int& failed_count,
-                      int& passed_count) {
+                      int& passed_count, int& skipped_count) {
 #if XE_COMPILER_MSVC
   __try {
 #endif  // XE_COMPILER_MSVC
@@ -399,7 +425,10 @@ void ProtectedRunTest(TestSuite& test_suite, TestRunner& runner,
       XELOGE("    TEST FAILED SETUP");
       ++failed_count;
     }
-    if (runner.Run(test_case)) {
+    if (!runner.IsSupportedByHost(test_case)) {
+      XELOGI("    TEST SKIPPED (NOT SUPPORTED BY THE HOST)");
+      ++skipped_count;
+    } else if (runner.Run(test_case)) {
       ++passed_count;
     } else {
       XELOGE("    TEST FAILED");
@@ -418,6 +447,7 @@ bool RunTests(const std::string_view test_name) {
   int result_code = 1;
   int failed_count = 0;
   int passed_count = 0;
+  int skipped_count = 0;
 
   XELOGI("Haswell instruction usage {}.",
          cvars::use_haswell_instructions ? "enabled" : "disabled");
@@ -460,16 +490,17 @@ bool RunTests(const std::string_view test_name) {
     for (auto& test_case : test_suite.test_cases()) {
       XELOGI("  - {}", test_case.name);
       ProtectedRunTest(test_suite, runner, test_case, failed_count,
-                       passed_count);
+                       passed_count, skipped_count);
     }
 
     XELOGI("");
   }
 
   XELOGI("");
-  XELOGI("Total tests: {}", failed_count + passed_count);
+  XELOGI("Total tests: {}", failed_count + passed_count + skipped_count);
   XELOGI("Passed: {}", passed_count);
   XELOGI("Failed: {}", failed_count);
+  XELOGI("Skipped: {}", skipped_count);
 
   return failed_count ? false : true;
 }
@@ -9,6 +9,7 @@ project("xenia-cpu")
   links({
     "xenia-base",
     "mspack",
+    "xxhash",
   })
   includedirs({
     project_root.."/third_party/llvm/include",
@@ -21,4 +22,5 @@ project("xenia-cpu")
   local_platform_files("ppc")
 
 include("testing")
+include("testing/bench")
 include("ppc/testing")
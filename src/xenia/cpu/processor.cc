@@ -13,19 +13,23 @@
 #include "xenia/base/atomic.h"
 #include "xenia/base/byte_order.h"
 #include "xenia/base/byte_stream.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/debugging.h"
 #include "xenia/base/exception_handler.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/profiling.h"
+#include "xenia/base/startup_timeline.h"
 #include "xenia/base/threading.h"
+#include "xenia/cpu/backend/code_cache.h"
 #include "xenia/cpu/breakpoint.h"
 #include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/export_resolver.h"
 #include "xenia/cpu/module.h"
 #include "xenia/cpu/ppc/ppc_decode_data.h"
 #include "xenia/cpu/ppc/ppc_frontend.h"
+#include "xenia/cpu/sampling_profiler.h"
 #include "xenia/cpu/stack_walker.h"
 #include "xenia/cpu/thread.h"
 #include "xenia/cpu/thread_state.h"
@@ -46,6 +50,27 @@ DEFINE_path(trace_function_data_path, "", "File to write trace data to.",
             "CPU");
 DEFINE_bool(break_on_start, false, "Break into the debugger on startup.",
             "CPU");
+DEFINE_path(guest_profile_path, "",
+            "File to write sampled guest call stacks to on exit, in the folded "
+            "format used by flamegraph tools. Enables the guest sampling "
+            "profiler.",
+            "CPU");
+DEFINE_int32(guest_profile_interval_ms, 1,
+             "Interval between guest sampling profiler samples, in "
+             "milliseconds.",
+             "CPU");
+DEFINE_bool(dump_jit_stats, false,
+            "Measure the time and memory spent in each stage and pass of the "
+            "guest code translator, and log them on exit.",
+            "CPU");
+DEFINE_int32(
+    speculative_compile_threads, -1,
+    "Number of threads compiling guest functions ahead of their first call "
+    "(direct call targets of just compiled code). -1 to calculate "
+    "automatically (25% of logical CPU cores), a positive number to specify "
+    "the number of threads explicitly (up to the number of logical CPU cores), "
+    "0 to only compile functions on the guest threads calling them.",
+    "CPU");
 
 namespace xe {
 namespace kernel {
@@ -82,6 +107,40 @@ Processor::Processor(xe::Memory* memory, ExportResolver* export_resolver)
     : memory_(memory), export_resolver_(export_resolver) {}
 
 Processor::~Processor() {
+  if (memory_ && memory_->mmio_handler()) {
+    memory_->mmio_handler()->SetAccessSiteCallback(nullptr, nullptr);
+  }
+  if (memory_ && cvars::invalidate_modified_code) {
+    memory_->SetCodeModificationCallback(nullptr, nullptr);
+  }
+
+  // Sampled functions are owned by the modules.
+  if (sampling_profiler_) {
+    sampling_profiler_->Stop();
+    sampling_profiler_->WriteFoldedStacks(cvars::guest_profile_path);
+    sampling_profiler_->DumpHotFunctions(20);
+    sampling_profiler_.reset();
+  }
+
+  // Stop compiling before anything the compiler depends on goes away.
+  if (!speculative_compile_threads_.empty()) {
+    {
+      std::lock_guard<std::mutex> lock(speculative_compile_lock_);
+      speculative_compile_shutdown_ = true;
+      speculative_compile_queue_.clear();
+      tier_up_queue_.clear();
+    }
+    speculative_compile_cond_.notify_all();
+    for (auto& thread : speculative_compile_threads_) {
+      xe::threading::Wait(thread.get(), false);
+    }
+    speculative_compile_threads_.clear();
+  }
+
+  if (jit_stats_) {
+    jit_stats_->Dump(20);
+  }
+
   {
     auto global_lock = global_critical_region_.Acquire();
     modules_.clear();
@@ -127,6 +186,39 @@ bool Processor::Setup(std::unique_ptr<backend::Backend> backend) {
   backend_ = std::move(backend);
   frontend_ = std::move(frontend);
 
+  // Generated code that traps on MMIO gets recompiled to call the handler
+  // directly instead.
+  if (memory_->mmio_handler()) {
+    memory_->mmio_handler()->SetAccessSiteCallback(MMIOAccessSiteThunk, this);
+  }
+
+  // Code compiled from guest memory that's written to later is replaced.
+  if (cvars::invalidate_modified_code) {
+    memory_->SetCodeModificationCallback(CodeModificationThunk, this);
+  }
+
+  if (cvars::dump_jit_stats) {
+    jit_stats_ = std::make_unique<JitStats>();
+  }
+
+  if (cvars::speculative_compile_threads != 0) {
+    uint32_t logical_processor_count =
+        std::max(xe::threading::logical_processor_count(), uint32_t(1));
+    uint32_t thread_count;
+    if (cvars::speculative_compile_threads < 0) {
+      thread_count = std::max(logical_processor_count / 4, uint32_t(1));
+    } else {
+      thread_count = std::min(uint32_t(cvars::speculative_compile_threads),
+                              logical_processor_count);
+    }
+    for (uint32_t i = 0; i < thread_count; ++i) {
+      auto thread = xe::threading::Thread::Create(
+          {}, [this]() { SpeculativeCompileThread(); });
+      thread->set_name("CPU Speculative Compile");
+      speculative_compile_threads_.push_back(std::move(thread));
+    }
+  }
+
   // Stack walker is used when profiling, debugging, and dumping.
   // Note that creation may fail, in which case we'll have to disable those
   // features.
@@ -139,6 +231,15 @@ bool Processor::Setup(std::unique_ptr<backend::Backend> backend) {
     }
   }
 
+  if (!cvars::guest_profile_path.empty()) {
+    sampling_profiler_ = std::make_unique<SamplingProfiler>(this);
+    if (!sampling_profiler_->Start(
+            uint32_t(std::max(cvars::guest_profile_interval_ms, 1)))) {
+      XELOGW("Unable to start the guest sampling profiler");
+      sampling_profiler_.reset();
+    }
+  }
+
   // Open the trace data path, if requested.
   functions_trace_path_ = cvars::trace_function_data_path;
   if (!functions_trace_path_.empty()) {
@@ -179,7 +280,8 @@ Module* Processor::GetModule(const std::string_view name) {
 
 std::vector<Module*> Processor::GetModules() {
   auto global_lock = global_critical_region_.Acquire();
-  std::vector<Module*> clone(modules_.size());
+  std::vector<Module*> clone;
+  clone.reserve(modules_.size());
   for (const auto& module : modules_) {
     clone.push_back(module.get());
   }
@@ -221,6 +323,10 @@ Function* Processor::ResolveFunction(uint32_t address) {
   Entry::Status status = entry_table_.GetOrCreate(address, &entry);
   if (status == Entry::STATUS_NEW) {
     // Needs to be generated. We have the 'lock' on it and must do so now.
+    startup_timeline::ScopedPhase startup_phase("Processor::ResolveFunction");
+    if (startup_phase.active()) {
+      startup_phase.set_detail(fmt::format("{:08X}", address));
+    }
 
     // Grab symbol declaration.
     auto function = LookupFunction(address);
@@ -233,19 +339,321 @@ Function* Processor::ResolveFunction(uint32_t address) {
       entry->status = Entry::STATUS_FAILED;
       return nullptr;
     }
-    entry->function = function;
-    entry->end_address = function->end_address();
-    status = entry->status = Entry::STATUS_READY;
+    entry_table_.MarkReady(entry, function, function->end_address());
+    status = Entry::STATUS_READY;
   }
   if (status == Entry::STATUS_READY) {
-    // Ready to use.
-    return entry->function;
+    // Ready to use, unless the guest code has been modified since.
+    auto function = entry->function;
+    if (function->is_guest() &&
+        static_cast<GuestFunction*>(function)->is_code_invalidated()) {
+      RecompileModified(static_cast<GuestFunction*>(function));
+    }
+    return function;
   } else {
     // Failed or bad state.
     return nullptr;
   }
 }
 
+void Processor::QueueSpeculativeCompile(uint32_t address) {
+  if (speculative_compile_threads_.empty() ||
+      entry_table_.Contains(address)) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(speculative_compile_lock_);
+    // Nothing is lost if the threads fall behind, so don't let the queue grow
+    // unbounded while they are busy walking the call graph.
+    if (speculative_compile_shutdown_ ||
+        speculative_compile_queue_.size() >= 4096) {
+      return;
+    }
+    speculative_compile_queue_.push_back(address);
+  }
+  speculative_compile_cond_.notify_one();
+}
+
+void Processor::OptimizeFunction(GuestFunction* function) {
+  if (!function->BeginTierUp()) {
+    return;
+  }
+  if (!speculative_compile_threads_.empty()) {
+    QueueRecompile(function);
+    return;
+  }
+  RecompileOptimized(function);
+}
+
+bool Processor::IsMMIOAccessSite(uint32_t guest_address) {
+  if (!has_mmio_access_sites_) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mmio_access_sites_lock_);
+  return mmio_access_sites_.count(guest_address) != 0;
+}
+
+void Processor::MMIOAccessSiteThunk(void* context, void* host_pc) {
+  reinterpret_cast<Processor*>(context)->OnMMIOAccessSite(host_pc);
+}
+
+void Processor::OnMMIOAccessSite(void* host_pc) {
+  // Only generated guest code can be recompiled to avoid the trap.
+  auto host_address = reinterpret_cast<uintptr_t>(host_pc);
+  GuestFunction* function =
+      backend_->code_cache()->LookupFunction(uint64_t(host_address));
+  if (!function) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mmio_access_sites_lock_);
+    if (!mmio_access_host_sites_.insert(host_address).second) {
+      // Code from before the recompilation may still be running.
+      return;
+    }
+    mmio_access_sites_.insert(
+        function->MapMachineCodeToGuestAddress(host_address));
+    has_mmio_access_sites_ = true;
+  }
+  function->set_has_mmio_access_sites();
+
+  // This is called from the exception handler, so the function can only be
+  // recompiled in the background. Without the compilation threads the site is
+  // still used by anything compiled later.
+  if (!speculative_compile_threads_.empty()) {
+    QueueRecompile(function);
+  }
+}
+
+void Processor::QueueRecompile(GuestFunction* function) {
+  {
+    std::lock_guard<std::mutex> lock(speculative_compile_lock_);
+    if (speculative_compile_shutdown_) {
+      return;
+    }
+    tier_up_queue_.push_back(function);
+  }
+  speculative_compile_cond_.notify_one();
+}
+
+void Processor::RecompileOptimized(GuestFunction* function) {
+  SCOPE_profile_cpu_f("cpu");
+  std::lock_guard<std::mutex> lock(recompile_lock_);
+  // The translator picks the full pipeline if the tier up has started. On
+  // failure the previous code simply stays in use. The function stays live
+  // meanwhile: the new code and source map are generated on their own and
+  // swapped in together, with the baseline ones retired, not freed.
+  if (!frontend_->DefineFunction(function, debug_info_flags_)) {
+    XELOGW("Failed to recompile function {:08X}", function->address());
+    return;
+  }
+  functions_compiled_.fetch_add(1, std::memory_order_relaxed);
+  WatchFunctionCode(function, true);
+  ReclaimRetiredCode();
+}
+
+void Processor::ReclaimRetiredCode() {
+  auto code_cache = backend_->code_cache();
+  if (!cvars::reclaim_generated_code || cvars::debug || !stack_walker_ ||
+      !code_cache->HasRetiredCode()) {
+    return;
+  }
+  auto global_lock = global_critical_region_.Acquire();
+
+  // Walking every stack isn't free, and the code cache relies on passes being
+  // far enough apart for threads that were about to enter retired code to have
+  // done so.
+  uint64_t now = Clock::QueryHostUptimeMillis();
+  if (now - last_code_reclaim_time_ < kCodeReclaimIntervalMs) {
+    return;
+  }
+  last_code_reclaim_time_ = now;
+
+  // Threads are suspended one at a time. Once resumed, a thread can't get a
+  // new reference to code that was retired before the pass. A suspended
+  // thread may be holding the heap lock or any other, so only its stack is
+  // copied while it's suspended, and the copy is walked after it's resumed.
+  auto thread_infos = QueryThreadDebugInfos();
+  code_reclaim_host_pcs_.resize((thread_infos.size() + 1) *
+                                kMaxCodeReclaimFrames);
+  code_reclaim_stack_copy_.resize(kCodeReclaimStackCopySize);
+  uint64_t* host_pcs = code_reclaim_host_pcs_.data();
+  size_t host_pc_count = stack_walker_->CaptureStackTrace(
+      host_pcs, 0, kMaxCodeReclaimFrames);
+  if (host_pc_count >= kMaxCodeReclaimFrames) {
+    return;
+  }
+  StackWalker::StackCopy stack_copy;
+  stack_copy.buffer = code_reclaim_stack_copy_.data();
+  stack_copy.buffer_size = code_reclaim_stack_copy_.size();
+  auto current_thread = Thread::IsInThread() ? Thread::GetCurrentThread()
+                                             : nullptr;
+  for (auto thread_info : thread_infos) {
+    auto thread = thread_info->thread;
+    if (!thread || thread == current_thread ||
+        thread_info->state == ThreadDebugInfo::State::kExited ||
+        thread_info->state == ThreadDebugInfo::State::kZombie) {
+      continue;
+    }
+    if (!thread->thread()->Suspend(nullptr)) {
+      // Can't tell what it's running.
+      return;
+    }
+    bool copied = stack_walker_->CopyThreadStack(
+        thread->thread()->native_handle(), &stack_copy);
+    thread->thread()->Resume();
+    if (!copied) {
+      XELOGD("Can't copy the stack of thread {:08X}, not reclaiming code",
+             thread_info->thread_id);
+      return;
+    }
+    size_t count = stack_walker_->CaptureStackTrace(
+        &stack_copy, host_pcs + host_pc_count, kMaxCodeReclaimFrames);
+    if (!count || count >= kMaxCodeReclaimFrames) {
+      // The outer frames may be in retired code.
+      return;
+    }
+    host_pc_count += count;
+  }
+  code_cache->ReclaimRetiredCode(host_pcs, host_pc_count);
+}
+
+void Processor::CodeModificationThunk(void* context, uint32_t virtual_address,
+                                      uint32_t length) {
+  reinterpret_cast<Processor*>(context)->OnCodeModified(virtual_address,
+                                                        length);
+}
+
+void Processor::OnCodeModified(uint32_t virtual_address, uint32_t length) {
+  // Called with the global lock held, often from the exception handler, so
+  // only the calls are redirected here and the compilation is left to the
+  // next time the function is resolved.
+  auto global_lock = global_critical_region_.Acquire();
+  uint32_t page_first = virtual_address >> kCodePageShift;
+  uint32_t page_last = (virtual_address + length - 1) >> kCodePageShift;
+  for (uint32_t page = page_first; page <= page_last; ++page) {
+    auto it = code_page_functions_.find(page);
+    if (it == code_page_functions_.end()) {
+      continue;
+    }
+    for (GuestFunction* function : it->second) {
+      if (!function->is_code_invalidated()) {
+        function->set_code_invalidated(true);
+        backend_->InvalidateGuestFunction(function);
+      }
+    }
+  }
+}
+
+void Processor::WatchFunctionCode(GuestFunction* function,
+                                  bool include_inlined_code) {
+  if (!cvars::invalidate_modified_code) {
+    return;
+  }
+  auto global_lock = global_critical_region_.Acquire();
+  auto watch_range = [this, function](uint32_t address, uint32_t length) {
+    uint32_t page_first = address >> kCodePageShift;
+    uint32_t page_last = (address + length - 1) >> kCodePageShift;
+    for (uint32_t page = page_first; page <= page_last; ++page) {
+      auto& functions = code_page_functions_[page];
+      if (std::find(functions.begin(), functions.end(), function) ==
+          functions.end()) {
+        functions.push_back(function);
+      }
+    }
+    memory_->WatchCodeRange(address, length);
+  };
+  watch_range(function->address(),
+              function->has_end_address()
+                  ? function->end_address() - function->address()
+                  : 4);
+  if (include_inlined_code) {
+    // Leaf functions inlined from elsewhere show up in the source map.
+    for (const auto& entry : function->source_map()) {
+      if (!function->ContainsAddress(entry.guest_address)) {
+        watch_range(entry.guest_address, 4);
+      }
+    }
+  }
+}
+
+void Processor::RecompileModified(GuestFunction* function) {
+  // Never wait for other recompilations, as the caller may be holding the
+  // global lock they need. The (stale) code still works until the next call.
+  std::unique_lock<std::mutex> lock(recompile_lock_, std::try_to_lock);
+  if (!lock.owns_lock() || !function->is_code_invalidated()) {
+    return;
+  }
+  // Writes from here on invalidate the new code again.
+  WatchFunctionCode(function, false);
+  function->set_code_invalidated(false);
+  if (!frontend_->DefineFunction(function, debug_info_flags_)) {
+    XELOGE("Failed to recompile modified function {:08X}",
+           function->address());
+    return;
+  }
+  functions_compiled_.fetch_add(1, std::memory_order_relaxed);
+  WatchFunctionCode(function, true);
+  if (function->is_code_invalidated()) {
+    // Modified again while compiling, after the new code was installed.
+    backend_->InvalidateGuestFunction(function);
+  }
+  ReclaimRetiredCode();
+}
+
+void Processor::SpeculativeCompileThread() {
+  while (true) {
+    uint32_t address;
+    GuestFunction* tier_up_function = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(speculative_compile_lock_);
+      speculative_compile_cond_.wait(lock, [this]() {
+        return speculative_compile_shutdown_ || !tier_up_queue_.empty() ||
+               !speculative_compile_queue_.empty();
+      });
+      if (speculative_compile_shutdown_) {
+        return;
+      }
+      if (!tier_up_queue_.empty()) {
+        tier_up_function = tier_up_queue_.front();
+        tier_up_queue_.pop_front();
+      } else {
+        address = speculative_compile_queue_.front();
+        speculative_compile_queue_.pop_front();
+      }
+    }
+
+    if (tier_up_function) {
+      RecompileOptimized(tier_up_function);
+      continue;
+    }
+
+    if (entry_table_.Contains(address)) {
+      // Already resolved or being compiled by someone else.
+      continue;
+    }
+
+    // Resolving an address outside of the loaded code would permanently mark
+    // it as failed, so leave anything unusual to the guest.
+    bool is_guest_code = false;
+    {
+      auto global_lock = global_critical_region_.Acquire();
+      for (const auto& module : modules_) {
+        if (module->is_executable() && module->ContainsAddress(address)) {
+          is_guest_code = true;
+          break;
+        }
+      }
+    }
+    if (!is_guest_code) {
+      continue;
+    }
+
+    SCOPE_profile_cpu_i("cpu", "SpeculativeCompile");
+    ResolveFunction(address);
+  }
+}
+
 Function* Processor::LookupFunction(uint32_t address) {
   // TODO(benvanik): fast reject invalid addresses/log errors.
 
@@ -295,11 +703,14 @@ bool Processor::DemandFunction(Function* function) {
   if (symbol_status == Symbol::Status::kNew) {
     // Symbol is undefined, so define now.
     assert_true(function->is_guest());
-    if (!frontend_->DefineFunction(static_cast<GuestFunction*>(function),
-                                   debug_info_flags_)) {
+    auto guest_function = static_cast<GuestFunction*>(function);
+    WatchFunctionCode(guest_function, false);
+    if (!frontend_->DefineFunction(guest_function, debug_info_flags_)) {
       function->set_status(Symbol::Status::kFailed);
       return false;
     }
+    functions_compiled_.fetch_add(1, std::memory_order_relaxed);
+    WatchFunctionCode(guest_function, true);
 
     // Before we give the symbol back to the rest, let the debugger know.
     OnFunctionDefined(function);
@@ -453,6 +864,7 @@ bool Processor::Restore(ByteStream* stream) {
   for (uint32_t thread_id : to_delete) {
     thread_debug_infos_.erase(thread_id);
   }
+  thread_debug_infos_version_.fetch_add(1, std::memory_order_release);
 
   return true;
 }
@@ -487,6 +899,7 @@ void Processor::OnThreadCreated(uint32_t thread_handle,
   thread_info->state = ThreadDebugInfo::State::kAlive;
   thread_info->suspended = false;
   thread_debug_infos_.emplace(thread_info->thread_id, std::move(thread_info));
+  thread_debug_infos_version_.fetch_add(1, std::memory_order_release);
 }
 
 void Processor::OnThreadExit(uint32_t thread_id) {
@@ -495,6 +908,7 @@ void Processor::OnThreadExit(uint32_t thread_id) {
   assert_true(it != thread_debug_infos_.end());
   auto thread_info = it->second.get();
   thread_info->state = ThreadDebugInfo::State::kExited;
+  thread_debug_infos_version_.fetch_add(1, std::memory_order_release);
 }
 
 void Processor::OnThreadDestroyed(uint32_t thread_id) {
@@ -504,6 +918,7 @@ void Processor::OnThreadDestroyed(uint32_t thread_id) {
   auto thread_info = it->second.get();
   thread_info->state = ThreadDebugInfo::State::kZombie;
   thread_info->thread = nullptr;
+  thread_debug_infos_version_.fetch_add(1, std::memory_order_release);
 }
 
 void Processor::OnThreadEnteringWait(uint32_t thread_id) {
@@ -512,6 +927,7 @@ void Processor::OnThreadEnteringWait(uint32_t thread_id) {
   assert_true(it != thread_debug_infos_.end());
   auto thread_info = it->second.get();
   thread_info->state = ThreadDebugInfo::State::kWaiting;
+  thread_debug_infos_version_.fetch_add(1, std::memory_order_release);
 }
 
 void Processor::OnThreadLeavingWait(uint32_t thread_id) {
@@ -521,6 +937,7 @@ void Processor::OnThreadLeavingWait(uint32_t thread_id) {
   auto thread_info = it->second.get();
   if (thread_info->state == ThreadDebugInfo::State::kWaiting) {
     thread_info->state = ThreadDebugInfo::State::kAlive;
+    thread_debug_infos_version_.fetch_add(1, std::memory_order_release);
   }
 }
 
@@ -661,6 +1078,7 @@ bool Processor::OnThreadBreakpointHit(Exception* ex) {
   // it wants to do).
   execution_state_ = ExecutionState::kPaused;
   thread_info->suspended = true;
+  thread_debug_infos_version_.fetch_add(1, std::memory_order_release);
 
   // Must unlock, or we will deadlock.
   global_lock.unlock();
@@ -756,6 +1174,7 @@ bool Processor::SuspendAllThreads() {
     bool did_suspend = thread->thread()->Suspend(nullptr);
     assert_true(did_suspend);
     thread_info->suspended = true;
+    thread_debug_infos_version_.fetch_add(1, std::memory_order_release);
   }
   return true;
 }
@@ -771,6 +1190,7 @@ bool Processor::ResumeThread(uint32_t thread_id) {
   assert_false(thread_info->state == ThreadDebugInfo::State::kExited ||
                thread_info->state == ThreadDebugInfo::State::kZombie);
   thread_info->suspended = false;
+  thread_debug_infos_version_.fetch_add(1, std::memory_order_release);
   auto thread = thread_info->thread;
   return thread->thread()->Resume();
 }
@@ -797,6 +1217,7 @@ bool Processor::ResumeAllThreads() {
       continue;
     }
     thread_info->suspended = false;
+    thread_debug_infos_version_.fetch_add(1, std::memory_order_release);
     bool did_resume = thread->thread()->Resume();
     assert_true(did_resume);
   }
@@ -857,6 +1278,7 @@ void Processor::UpdateThreadExecutionStates(uint32_t override_thread_id,
       }
     }
   }
+  thread_debug_infos_version_.fetch_add(1, std::memory_order_release);
 }
 
 void Processor::SuspendAllBreakpoints() {
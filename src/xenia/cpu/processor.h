@@ -10,19 +10,27 @@
 #ifndef XENIA_CPU_PROCESSOR_H_
 #define XENIA_CPU_PROCESSOR_H_
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "xenia/base/cvar.h"
 #include "xenia/base/mapped_memory.h"
 #include "xenia/base/mutex.h"
+#include "xenia/base/threading.h"
 #include "xenia/cpu/backend/backend.h"
 #include "xenia/cpu/debug_listener.h"
 #include "xenia/cpu/entry_table.h"
 #include "xenia/cpu/export_resolver.h"
 #include "xenia/cpu/function.h"
+#include "xenia/cpu/jit_stats.h"
 #include "xenia/cpu/module.h"
 #include "xenia/cpu/ppc/ppc_frontend.h"
 #include "xenia/cpu/thread_debug_info.h"
@@ -35,6 +43,7 @@ namespace xe {
 namespace cpu {
 
 class Breakpoint;
+class SamplingProfiler;
 class StackWalker;
 class XexModule;
 
@@ -66,6 +75,11 @@ class Processor {
 
   Memory* memory() const { return memory_; }
   StackWalker* stack_walker() const { return stack_walker_.get(); }
+  SamplingProfiler* sampling_profiler() const {
+    return sampling_profiler_.get();
+  }
+  // Null unless --dump_jit_stats is set.
+  JitStats* jit_stats() const { return jit_stats_.get(); }
   ppc::PPCFrontend* frontend() const { return frontend_.get(); }
   backend::Backend* backend() const { return backend_.get(); }
   ExportResolver* export_resolver() const { return export_resolver_; }
@@ -113,6 +127,22 @@ class Processor {
   Function* LookupFunction(uint32_t address);
   Function* LookupFunction(Module* module, uint32_t address);
   Function* ResolveFunction(uint32_t address);
+  // Queues the function at the address to be compiled ahead of its first call
+  // by the speculative compilation threads, if they are enabled. Guest threads
+  // calling the function while it's being compiled wait for it as usual.
+  void QueueSpeculativeCompile(uint32_t address);
+  // Recompiles a hot baseline tier function with all optimizations, on the
+  // speculative compilation threads if available. The baseline code keeps
+  // being used until the optimized code replaces it.
+  void OptimizeFunction(GuestFunction* function);
+  // Whether the guest load/store at the address has been seen accessing MMIO
+  // from generated code.
+  bool IsMMIOAccessSite(uint32_t guest_address);
+
+  // Number of guest functions compiled so far, including recompilations.
+  uint64_t functions_compiled() const {
+    return functions_compiled_.load(std::memory_order_relaxed);
+  }
 
   bool Execute(ThreadState* thread_state, uint32_t address);
   bool ExecuteRaw(ThreadState* thread_state, uint32_t address);
@@ -131,6 +161,11 @@ class Processor {
   // This is the preferred way to sample thread state vs. attempting to ask
   // the kernel.
   std::vector<ThreadDebugInfo*> QueryThreadDebugInfos();
+  // Changes whenever a thread is added or any thread debug info is modified,
+  // so debugger snapshots can be rebuilt only when needed.
+  uint64_t thread_debug_infos_version() const {
+    return thread_debug_infos_version_.load(std::memory_order_acquire);
+  }
 
   // Returns the debugger info for the given thread.
   ThreadDebugInfo* QueryThreadDebugInfo(uint32_t thread_id);
@@ -222,6 +257,17 @@ class Processor {
 
   void OnFunctionDefined(Function* function);
 
+  static void MMIOAccessSiteThunk(void* context, void* host_pc);
+  void OnMMIOAccessSite(void* host_pc);
+
+  static void CodeModificationThunk(void* context, uint32_t virtual_address,
+                                    uint32_t length);
+  void OnCodeModified(uint32_t virtual_address, uint32_t length);
+  // Watches the guest code of the function for modification. The code inlined
+  // into it is only known once it has been compiled.
+  void WatchFunctionCode(GuestFunction* function, bool include_inlined_code);
+  void RecompileModified(GuestFunction* function);
+
   static bool ExceptionCallbackThunk(Exception* ex, void* data);
   bool ExceptionCallback(Exception* ex);
   void OnStepCompleted(ThreadDebugInfo* thread_info);
@@ -235,8 +281,19 @@ class Processor {
 
   bool DemandFunction(Function* function);
 
+  void SpeculativeCompileThread();
+  void QueueRecompile(GuestFunction* function);
+  void RecompileOptimized(GuestFunction* function);
+  // Lets the code cache reuse the space of code replaced by recompilation
+  // that no thread is running anymore. Throttled, as every stack is walked.
+  void ReclaimRetiredCode();
+
   Memory* memory_ = nullptr;
   std::unique_ptr<StackWalker> stack_walker_;
+  // Only created when --guest_profile_path is set.
+  std::unique_ptr<SamplingProfiler> sampling_profiler_;
+  // Only created when --dump_jit_stats is set.
+  std::unique_ptr<JitStats> jit_stats_;
 
   std::function<DebugListener*(Processor*)> debug_listener_handler_;
   DebugListener* debug_listener_ = nullptr;
@@ -252,6 +309,45 @@ class Processor {
   ExportResolver* export_resolver_ = nullptr;
 
   EntryTable entry_table_;
+
+  // Addresses waiting to be compiled by the speculative compilation threads,
+  // guarded by speculative_compile_lock_.
+  std::mutex speculative_compile_lock_;
+  std::condition_variable speculative_compile_cond_;
+  std::deque<uint32_t> speculative_compile_queue_;
+  // Hot functions to optimize and functions with new MMIO access sites, taking
+  // priority over speculative compilation.
+  std::deque<GuestFunction*> tier_up_queue_;
+  bool speculative_compile_shutdown_ = false;
+  std::vector<std::unique_ptr<xe::threading::Thread>>
+      speculative_compile_threads_;
+  // Recompilations of the same function must not overlap.
+  std::mutex recompile_lock_;
+
+  // Reclamation passes of replaced code, guarded by the global critical
+  // region. The buffers are kept to not allocate with threads suspended.
+  static constexpr uint64_t kCodeReclaimIntervalMs = 1000;
+  static constexpr size_t kMaxCodeReclaimFrames = 512;
+  static constexpr size_t kCodeReclaimStackCopySize = 1024 * 1024;
+  uint64_t last_code_reclaim_time_ = 0;
+  std::vector<uint64_t> code_reclaim_host_pcs_;
+  std::vector<uint8_t> code_reclaim_stack_copy_;
+
+  // Functions with code compiled from each 4 KB guest page watched for
+  // modification, guarded by the global critical region.
+  static constexpr uint32_t kCodePageShift = 12;
+  std::unordered_map<uint32_t, std::vector<GuestFunction*>>
+      code_page_functions_;
+
+  // Guest addresses of loads/stores that trapped on MMIO ranges, and the host
+  // code addresses that trapped, guarded by mmio_access_sites_lock_.
+  std::mutex mmio_access_sites_lock_;
+  std::unordered_set<uint32_t> mmio_access_sites_;
+  std::unordered_set<uintptr_t> mmio_access_host_sites_;
+  std::atomic<bool> has_mmio_access_sites_ = false;
+
+  std::atomic<uint64_t> functions_compiled_{0};
+
   xe::global_critical_region global_critical_region_;
   ExecutionState execution_state_ = ExecutionState::kPaused;
   std::vector<std::unique_ptr<Module>> modules_;
@@ -261,6 +357,8 @@ class Processor {
   // Maps thread ID to state. Updated on thread create, and threads are never
   // removed. Must be guarded with the global lock.
   std::map<uint32_t, std::unique_ptr<ThreadDebugInfo>> thread_debug_infos_;
+  // Incremented with the global lock held after modifying the infos.
+  std::atomic<uint64_t> thread_debug_infos_version_{0};
 
   // TODO(benvanik): cleanup/change structures.
   std::vector<Breakpoint*> breakpoints_;
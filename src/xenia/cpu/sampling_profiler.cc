@@ -0,0 +1,197 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/sampling_profiler.h"
+
+#include <algorithm>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/mutex.h"
+#include "xenia/cpu/function.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/cpu/stack_walker.h"
+#include "xenia/cpu/thread.h"
+#include "xenia/cpu/thread_debug_info.h"
+
+namespace xe {
+namespace cpu {
+
+namespace {
+
+// Deeper guest stacks are truncated to their innermost frames.
+constexpr size_t kMaxSampledFrames = 64;
+
+std::string GetFunctionName(const Function* function) {
+  if (!function->name().empty()) {
+    return function->name();
+  }
+  return fmt::format("sub_{:08X}", function->address());
+}
+
+}  // namespace
+
+SamplingProfiler::SamplingProfiler(Processor* processor)
+    : processor_(processor) {}
+
+SamplingProfiler::~SamplingProfiler() { Stop(); }
+
+bool SamplingProfiler::Start(uint32_t interval_ms) {
+  if (thread_) {
+    return true;
+  }
+  if (!processor_->stack_walker()) {
+    XELOGW("Guest sampling profiler requires a stack walker");
+    return false;
+  }
+  shutdown_event_ = xe::threading::Event::CreateManualResetEvent(false);
+  interval_ms = std::max(interval_ms, uint32_t(1));
+  thread_ = xe::threading::Thread::Create(
+      {}, [this, interval_ms]() { SampleThread(interval_ms); });
+  if (!thread_) {
+    shutdown_event_.reset();
+    return false;
+  }
+  thread_->set_name("CPU Sampling Profiler");
+  return true;
+}
+
+void SamplingProfiler::Stop() {
+  if (!thread_) {
+    return;
+  }
+  shutdown_event_->Set();
+  xe::threading::Wait(thread_.get(), false);
+  thread_.reset();
+  shutdown_event_.reset();
+}
+
+void SamplingProfiler::SampleThread(uint32_t interval_ms) {
+  while (xe::threading::Wait(shutdown_event_.get(), false,
+                             std::chrono::milliseconds(interval_ms)) ==
+         xe::threading::WaitResult::kTimeout) {
+    SampleAllThreads();
+  }
+}
+
+void SamplingProfiler::SampleAllThreads() {
+  struct ThreadSample {
+    std::string thread_name;
+    size_t frame_count;
+    uint64_t frame_host_pcs[kMaxSampledFrames];
+  };
+  std::vector<ThreadSample> thread_samples;
+
+  // Threads are only suspended for as long as it takes to walk their stacks.
+  // Nothing may allocate while a thread is suspended, as it may be holding the
+  // heap lock.
+  auto stack_walker = processor_->stack_walker();
+  {
+    auto global_lock = global_critical_region::AcquireDirect();
+    auto thread_infos = processor_->QueryThreadDebugInfos();
+    thread_samples.resize(thread_infos.size());
+    size_t sample_count = 0;
+    for (auto thread_info : thread_infos) {
+      auto thread = thread_info->thread;
+      if (!thread || thread_info->suspended ||
+          thread_info->state != ThreadDebugInfo::State::kAlive ||
+          !thread->can_debugger_suspend()) {
+        // Dead, waiting, stopped by the debugger or a host thread.
+        continue;
+      }
+      if (!thread->thread()->Suspend(nullptr)) {
+        continue;
+      }
+      auto& sample = thread_samples[sample_count];
+      sample.frame_count = stack_walker->CaptureStackTrace(
+          thread->thread()->native_handle(), sample.frame_host_pcs, 0,
+          kMaxSampledFrames, nullptr, nullptr);
+      thread->thread()->Resume();
+      if (sample.frame_count) {
+        sample.thread_name = thread->thread_name();
+        ++sample_count;
+      }
+    }
+    thread_samples.resize(sample_count);
+  }
+
+  StackFrame frames[kMaxSampledFrames];
+  for (auto& sample : thread_samples) {
+    stack_walker->ResolveStack(sample.frame_host_pcs, frames,
+                               sample.frame_count);
+    StackKey key;
+    key.first = std::move(sample.thread_name);
+    // Frames are captured innermost first. Host frames (kernel exports and
+    // the like) are attributed to the guest function calling them.
+    for (size_t i = sample.frame_count; i-- > 0;) {
+      const auto& frame = frames[i];
+      if (frame.type == StackFrame::Type::kGuest &&
+          frame.guest_symbol.function) {
+        key.second.push_back(frame.guest_symbol.function);
+      }
+    }
+    if (key.second.empty()) {
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(samples_lock_);
+    ++function_samples_[key.second.back()];
+    ++stack_samples_[std::move(key)];
+    ++sample_count_;
+  }
+}
+
+bool SamplingProfiler::WriteFoldedStacks(const std::filesystem::path& path) {
+  FILE* file = xe::filesystem::OpenFile(path, "wb");
+  if (!file) {
+    XELOGE("Unable to open guest profile file {}", xe::path_to_utf8(path));
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(samples_lock_);
+  std::string line;
+  for (const auto& it : stack_samples_) {
+    line = it.first.first.empty() ? "(unnamed thread)" : it.first.first;
+    for (auto function : it.first.second) {
+      line += ';';
+      line += GetFunctionName(function);
+    }
+    line += fmt::format(" {}\n", it.second);
+    std::fwrite(line.data(), 1, line.size(), file);
+  }
+  std::fclose(file);
+  XELOGI("Wrote {} guest profile samples to {}", sample_count_,
+         xe::path_to_utf8(path));
+  return true;
+}
+
+void SamplingProfiler::DumpHotFunctions(size_t count) {
+  std::vector<std::pair<Function*, uint64_t>> functions;
+  uint64_t sample_count;
+  {
+    std::lock_guard<std::mutex> lock(samples_lock_);
+    functions.assign(function_samples_.begin(), function_samples_.end());
+    sample_count = sample_count_;
+  }
+  if (!sample_count) {
+    return;
+  }
+  count = std::min(count, functions.size());
+  std::partial_sort(
+      functions.begin(), functions.begin() + count, functions.end(),
+      [](const auto& a, const auto& b) { return a.second > b.second; });
+  XELOGI("Hottest guest functions ({} samples):", sample_count);
+  for (size_t i = 0; i < count; ++i) {
+    XELOGI("  {:6.2f}% {:08X} {}",
+           100.0 * functions[i].second / sample_count,
+           functions[i].first->address(), GetFunctionName(functions[i].first));
+  }
+}
+
+}  // namespace cpu
+}  // namespace xe
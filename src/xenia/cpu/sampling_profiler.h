@@ -0,0 +1,73 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_SAMPLING_PROFILER_H_
+#define XENIA_CPU_SAMPLING_PROFILER_H_
+
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace cpu {
+
+class Function;
+class Processor;
+
+// Periodically suspends every guest thread and records the guest functions
+// on its stack. Much cheaper than --trace_functions, as generated code is left
+// untouched.
+//
+// Samples are aggregated per thread and call stack and written out in the
+// folded stack format understood by flamegraph.pl and speedscope.
+class SamplingProfiler {
+ public:
+  explicit SamplingProfiler(Processor* processor);
+  ~SamplingProfiler();
+
+  bool is_running() const { return thread_ != nullptr; }
+
+  bool Start(uint32_t interval_ms);
+  void Stop();
+
+  // Writes the folded stacks collected so far, one
+  // "thread;outer;...;inner count" line per unique stack.
+  bool WriteFoldedStacks(const std::filesystem::path& path);
+  // Logs the functions with the most samples where they were executing.
+  void DumpHotFunctions(size_t count);
+
+ private:
+  // Call stack of guest functions, outermost first.
+  typedef std::pair<std::string, std::vector<Function*>> StackKey;
+
+  void SampleThread(uint32_t interval_ms);
+  void SampleAllThreads();
+
+  Processor* processor_;
+
+  std::unique_ptr<xe::threading::Thread> thread_;
+  std::unique_ptr<xe::threading::Event> shutdown_event_;
+
+  std::mutex samples_lock_;
+  std::map<StackKey, uint64_t> stack_samples_;
+  std::unordered_map<Function*, uint64_t> function_samples_;
+  uint64_t sample_count_ = 0;
+};
+
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_SAMPLING_PROFILER_H_
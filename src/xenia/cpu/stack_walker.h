@@ -87,6 +87,31 @@ class StackWalker {
                                    X64Context* out_host_context,
                                    uint64_t* out_stack_hash = nullptr) = 0;
 
+  // Registers and the used part of the stack of a thread, to be walked once
+  // the thread is running again.
+  struct StackCopy {
+    X64Context host_context;
+    // Where the copied bytes are in the thread's stack.
+    uint64_t stack_address;
+    size_t stack_size;
+    // Provided by the caller.
+    uint8_t* buffer;
+    size_t buffer_size;
+  };
+
+  // Copies the state of the given thread, referenced by native thread handle,
+  // into copy->buffer. The thread must be suspended. This doesn't allocate,
+  // take locks or log, as the thread may hold the locks these need.
+  // Returns false if the state couldn't be read or doesn't fit the buffer.
+  virtual bool CopyThreadStack(void* thread_handle, StackCopy* copy) = 0;
+
+  // Captures up to the given number of stack frames from a stack copied with
+  // CopyThreadStack. The copy is modified while walking it.
+  // Returns the number of frames captured, or 0 if the walk didn't reach the
+  // outermost frame.
+  virtual size_t CaptureStackTrace(StackCopy* copy, uint64_t* frame_host_pcs,
+                                   size_t frame_count) = 0;
+
   // Resolves symbol information for the given stack frames.
   // Each frame provided must have host_pc set, and all other fields will be
   // populated.
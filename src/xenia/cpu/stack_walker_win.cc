@@ -217,6 +217,98 @@ class Win32StackWalker : public StackWalker {
     return frame_index - frame_offset;
   }
 
+  bool CopyThreadStack(void* thread_handle, StackCopy* copy) override {
+    CONTEXT thread_context;
+    thread_context.ContextFlags = CONTEXT_FULL;
+    if (!GetThreadContext(thread_handle, &thread_context)) {
+      return false;
+    }
+    // The committed part of the stack above the stack pointer runs to the
+    // stack base.
+    MEMORY_BASIC_INFORMATION stack_info;
+    if (!VirtualQuery(reinterpret_cast<LPCVOID>(thread_context.Rsp),
+                      &stack_info, sizeof(stack_info))) {
+      return false;
+    }
+    uint64_t stack_end = reinterpret_cast<uint64_t>(stack_info.BaseAddress) +
+                         stack_info.RegionSize;
+    size_t stack_size = size_t(stack_end - thread_context.Rsp);
+    if (stack_size > copy->buffer_size) {
+      return false;
+    }
+    copy->host_context.rip = thread_context.Rip;
+    copy->host_context.eflags = thread_context.EFlags;
+    std::memcpy(copy->host_context.int_registers, &thread_context.Rax,
+                sizeof(copy->host_context.int_registers));
+    copy->stack_address = thread_context.Rsp;
+    copy->stack_size = stack_size;
+    std::memcpy(copy->buffer, reinterpret_cast<const void*>(thread_context.Rsp),
+                stack_size);
+    return true;
+  }
+
+  size_t CaptureStackTrace(StackCopy* copy, uint64_t* frame_host_pcs,
+                           size_t frame_count) override {
+    // Pointers into the stack, like saved frame pointers, are redirected to
+    // the copy so that the unwinder only reads the copy.
+    uint64_t stack_begin = copy->stack_address;
+    uint64_t stack_end = stack_begin + copy->stack_size;
+    uint64_t buffer_begin = reinterpret_cast<uint64_t>(copy->buffer);
+    uint64_t buffer_end = buffer_begin + copy->stack_size;
+    auto relocate = [&](uint64_t& value) {
+      if (value >= stack_begin && value < stack_end) {
+        value = value - stack_begin + buffer_begin;
+      }
+    };
+    auto words = reinterpret_cast<uint64_t*>(copy->buffer);
+    for (size_t i = 0; i < copy->stack_size / sizeof(uint64_t); ++i) {
+      relocate(words[i]);
+    }
+    CONTEXT thread_context = {0};
+    thread_context.ContextFlags = CONTEXT_FULL;
+    thread_context.Rip = copy->host_context.rip;
+    thread_context.EFlags = copy->host_context.eflags;
+    std::memcpy(&thread_context.Rax, copy->host_context.int_registers,
+                sizeof(copy->host_context.int_registers));
+    for (DWORD64* reg = &thread_context.Rax; reg <= &thread_context.R15;
+         ++reg) {
+      relocate(*reg);
+    }
+
+    size_t frame_index = 0;
+    while (frame_index < frame_count) {
+      frame_host_pcs[frame_index++] = thread_context.Rip;
+      DWORD64 image_base = 0;
+      PRUNTIME_FUNCTION function =
+          RtlLookupFunctionEntry(thread_context.Rip, &image_base, nullptr);
+      if (function) {
+        PVOID handler_data;
+        DWORD64 establisher_frame;
+        RtlVirtualUnwind(UNW_FLAG_NHANDLER, image_base, thread_context.Rip,
+                         function, &thread_context, &handler_data,
+                         &establisher_frame, nullptr);
+      } else {
+        // Leaf functions have no unwind info and leave the stack alone.
+        if (thread_context.Rsp < buffer_begin ||
+            thread_context.Rsp + sizeof(uint64_t) > buffer_end) {
+          return 0;
+        }
+        thread_context.Rip =
+            *reinterpret_cast<const DWORD64*>(thread_context.Rsp);
+        thread_context.Rsp += sizeof(uint64_t);
+      }
+      if (!thread_context.Rip) {
+        // Returned from the outermost frame.
+        return frame_index;
+      }
+      if (thread_context.Rsp < buffer_begin ||
+          thread_context.Rsp > buffer_end) {
+        return 0;
+      }
+    }
+    return frame_index;
+  }
+
   bool ResolveStack(uint64_t* frame_host_pcs, StackFrame* frames,
                     size_t frame_count) override {
     // TODO(benvanik): collect symbols to resolve with dbghelp and resolve
@@ -286,9 +378,9 @@ class Win32StackWalker : public StackWalker {
   static DWORD64 WINAPI XSymGetModuleBase64(_In_ HANDLE hProcess,
                                             _In_ DWORD64 dwAddr) {
     if (dwAddr >= code_cache_min_ && dwAddr < code_cache_max_) {
-      // In our generated range all addresses are relative to the code cache
-      // base.
-      return code_cache_min_;
+      // In our generated range addresses are relative to the base of the code
+      // cache region they're in.
+      return code_cache_->LookupUnwindImageBase(dwAddr);
     }
     // Normal module base lookup.
     return sym_get_module_base_64_(hProcess, dwAddr);
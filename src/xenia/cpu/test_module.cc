@@ -14,6 +14,7 @@
 #include "xenia/base/reset_scope.h"
 #include "xenia/base/string.h"
 #include "xenia/cpu/compiler/compiler_passes.h"
+#include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/processor.h"
 
 namespace xe {
@@ -47,12 +48,25 @@ TestModule::TestModule(Processor* processor, const std::string_view name,
   compiler_->AddPass(std::make_unique<passes::ContextPromotionPass>());
   compiler_->AddPass(std::make_unique<passes::SimplificationPass>());
   compiler_->AddPass(std::make_unique<passes::ConstantPropagationPass>());
+  if (processor->backend()->machine_info()->supports_extended_load_store) {
+    compiler_->AddPass(
+        std::make_unique<passes::MemorySequenceCombinationPass>());
+  }
   compiler_->AddPass(std::make_unique<passes::SimplificationPass>());
-  // compiler_->AddPass(std::make_unique<passes::DeadStoreEliminationPass>());
+  compiler_->AddPass(std::make_unique<passes::DeadStoreEliminationPass>());
   compiler_->AddPass(std::make_unique<passes::DeadCodeEliminationPass>());
 
-  //// Removes all unneeded variables. Try not to add new ones after this.
-  // compiler_->AddPass(new passes::ValueReductionPass());
+  // Removes all unneeded variables. Try not to add new ones after this.
+  compiler_->AddPass(std::make_unique<passes::ValueReductionPass>());
+
+  compiler_->AddPass(std::make_unique<passes::LoopInvariantCodeMotionPass>());
+  compiler_->AddPass(std::make_unique<passes::ConditionSinkingPass>());
+
+  // Liveness of values across blocks, used by register allocation to keep
+  // them in registers.
+  if (cvars::global_register_allocation) {
+    compiler_->AddPass(std::make_unique<passes::DataFlowAnalysisPass>());
+  }
 
   // Register allocation for the target backend.
   // Will modify the HIR to add loads/stores.
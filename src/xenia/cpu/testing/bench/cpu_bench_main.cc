@@ -0,0 +1,328 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/main.h"
+#include "xenia/base/math.h"
+#include "xenia/base/memory.h"
+#include "xenia/cpu/backend/x64/x64_backend.h"
+#include "xenia/cpu/backend/x64/x64_emitter.h"
+#include "xenia/cpu/ppc/ppc_context.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/cpu/raw_module.h"
+#include "xenia/cpu/thread_state.h"
+
+DEFINE_transient_string(bench_filter, "",
+                        "Only runs the benchmarks whose HIR opcode or "
+                        "mnemonic contains this string.",
+                        "General");
+DEFINE_string(bench_variants, "avx512,avx2,sse",
+              "Comma separated host instruction set variants to compare. "
+              "Variants the host does not support are skipped.",
+              "Other");
+DEFINE_int32(bench_iterations, 100000,
+             "Guest loop iterations per timed call. Every iteration executes "
+             "the benchmarked instruction 32 times.",
+             "Other");
+DEFINE_int32(bench_repeat, 5,
+             "Timed calls per benchmark. The fastest one is reported.",
+             "Other");
+
+namespace xe {
+namespace cpu {
+namespace bench {
+
+using xe::cpu::backend::x64::X64Backend;
+using xe::cpu::ppc::PPCContext;
+
+constexpr uint32_t kCodeAddress = 0x80000000;
+constexpr uint32_t kCodeSize = 0x10000;
+constexpr uint32_t kDataAddress = 0x10001000;
+constexpr uint32_t kDataSize = 0xF000;
+
+// Copies of the benchmarked instruction per guest loop iteration. Each copy
+// depends on the previous one so that the compiler can't fold them away,
+// making the reported time the latency of the sequence rather than its
+// throughput.
+constexpr uint32_t kUnroll = 32;
+
+// Instruction field encoders, applied to the base opcodes from
+// tools/ppc-instructions.xml.
+constexpr uint32_t FormDAB(uint32_t opcode, uint32_t d, uint32_t a,
+                           uint32_t b) {
+  return opcode | (d << 21) | (a << 16) | (b << 11);
+}
+constexpr uint32_t FormDABC(uint32_t opcode, uint32_t d, uint32_t a,
+                            uint32_t b, uint32_t c) {
+  return FormDAB(opcode, d, a, b) | (c << 6);
+}
+constexpr uint32_t FormDImm(uint32_t opcode, uint32_t d, uint32_t a,
+                            int16_t imm) {
+  return opcode | (d << 21) | (a << 16) | uint16_t(imm);
+}
+constexpr uint32_t FormM(uint32_t opcode, uint32_t s, uint32_t a, uint32_t sh,
+                         uint32_t mb, uint32_t me) {
+  return opcode | (s << 21) | (a << 16) | (sh << 11) | (mb << 6) | (me << 1);
+}
+
+constexpr uint32_t kBdnzOpcode = 0x42000000;  // bc 16, 0, target
+constexpr uint32_t kBlrOpcode = 0x4E800020;
+
+struct Benchmark {
+  // The HIR opcode the instruction mostly lowers to.
+  const char* opcode;
+  const char* mnemonic;
+  uint32_t code;
+  void (*setup)(PPCContext* ctx, uint8_t* data);
+};
+
+void SetupGPRs(PPCContext* ctx, uint8_t* data) {
+  ctx->r[3] = 0x7FFFFFFF;
+  ctx->r[4] = 1;
+}
+
+void SetupFPRs(PPCContext* ctx, uint8_t* data) {
+  ctx->f[1] = 1.0;
+  ctx->f[2] = 0.0;
+  ctx->f[3] = 1.0;
+}
+
+void SetupVRs(PPCContext* ctx, uint8_t* data) {
+  ctx->v[3] = vec128f(1.0f);
+  ctx->v[4] = vec128i(1);
+  ctx->v[5] = vec128i(0x00010203, 0x04050607, 0x08090A0B, 0x0C0D0E0F);
+}
+
+void SetupMemory(PPCContext* ctx, uint8_t* data) {
+  // The first word points at itself for the dependent load chain.
+  xe::store_and_swap<uint32_t>(data, kDataAddress);
+  xe::store_and_swap<uint32_t>(data + 16, 0);
+  ctx->r[3] = kDataAddress;
+  ctx->r[5] = kDataAddress + 16;
+  ctx->r[6] = 0;
+}
+
+const Benchmark kBenchmarks[] = {
+    {"ADD", "add", FormDAB(0x7C000214, 3, 3, 4), SetupGPRs},
+    {"MUL", "mullw", FormDAB(0x7C0001D6, 3, 3, 4), SetupGPRs},
+    {"DIV", "divw", FormDAB(0x7C0003D6, 3, 3, 4), SetupGPRs},
+    {"ROTATE_LEFT", "rlwinm", FormM(0x54000000, 3, 3, 1, 0, 31), SetupGPRs},
+    {"SHL", "slw", FormDAB(0x7C000030, 3, 3, 4), SetupGPRs},
+    {"CNTLZ", "cntlzw", FormDAB(0x7C000034, 3, 3, 0), SetupGPRs},
+    {"ADD", "fadd", FormDAB(0xFC00002A, 1, 1, 2), SetupFPRs},
+    {"MUL_ADD", "fmadd", FormDABC(0xFC00003A, 1, 1, 2, 3), SetupFPRs},
+    {"DIV", "fdiv", FormDAB(0xFC000024, 1, 1, 3), SetupFPRs},
+    {"SQRT", "fsqrt", FormDAB(0xFC00002C, 1, 0, 1), SetupFPRs},
+    {"ADD", "vaddfp", FormDAB(0x1000000A, 3, 3, 4), SetupVRs},
+    {"MUL_ADD", "vmaddfp", FormDABC(0x1000002E, 3, 3, 4, 3), SetupVRs},
+    {"RECIP", "vrefp", FormDAB(0x1000010A, 3, 0, 3), SetupVRs},
+    {"RSQRT", "vrsqrtefp", FormDAB(0x1000014A, 3, 0, 3), SetupVRs},
+    {"VECTOR_COMPARE_EQ", "vcmpeqfp", FormDAB(0x100000C6, 3, 3, 4),
+     SetupVRs},
+    {"VECTOR_ADD", "vaddubm", FormDAB(0x10000000, 3, 3, 4), SetupVRs},
+    {"VECTOR_MAX", "vmaxsw", FormDAB(0x10000182, 3, 3, 4), SetupVRs},
+    {"VECTOR_SHL", "vslw", FormDAB(0x10000184, 3, 3, 4), SetupVRs},
+    {"PERMUTE", "vperm", FormDABC(0x1000002B, 3, 3, 4, 5), SetupVRs},
+    {"LOAD", "lwz", FormDImm(0x80000000, 3, 3, 0), SetupMemory},
+    {"STORE", "stw", FormDImm(0x90000000, 3, 5, 0), SetupMemory},
+    {"LOAD", "lvx", FormDAB(0x7C0000CE, 3, 6, 5), SetupMemory},
+    {"STORE", "stvx", FormDAB(0x7C0001CE, 3, 6, 5), SetupMemory},
+};
+
+struct Variant {
+  const char* name;
+  bool use_haswell_instructions;
+  bool use_avx512_instructions;
+  // Emitter features the host must have for the variant to be meaningful.
+  uint32_t required_features;
+};
+
+const Variant kVariants[] = {
+    {"avx512", true, true, backend::x64::kX64EmitAVX512Ortho},
+    {"avx2", true, false, backend::x64::kX64EmitAVX2},
+    {"sse", false, false, 0},
+};
+
+class BenchRunner {
+ public:
+  BenchRunner() {
+    memory_.reset(new Memory());
+    memory_->Initialize();
+  }
+
+  ~BenchRunner() {
+    thread_state_.reset();
+    processor_.reset();
+    memory_.reset();
+  }
+
+  // Emitter features are latched when the backend is created, so every
+  // variant gets a fresh processor.
+  bool Setup(const Variant& variant) {
+    thread_state_.reset();
+    processor_.reset();
+    memory_->Reset();
+
+    cvars::use_haswell_instructions = variant.use_haswell_instructions;
+    cvars::use_avx512_instructions = variant.use_avx512_instructions;
+    auto backend = std::make_unique<X64Backend>();
+    auto backend_ptr = backend.get();
+    processor_.reset(new Processor(memory_.get(), nullptr));
+    if (!processor_->Setup(std::move(backend))) {
+      XELOGE("Unable to set up the processor");
+      return false;
+    }
+    if ((backend_ptr->emitter_feature_flags() & variant.required_features) !=
+        variant.required_features) {
+      XELOGI("Skipping the {} variant, not supported by the host",
+             variant.name);
+      return false;
+    }
+
+    auto code_heap = memory_->LookupHeap(kCodeAddress);
+    auto data_heap = memory_->LookupHeap(kDataAddress);
+    if (!code_heap->AllocFixed(
+            kCodeAddress, kCodeSize, 0,
+            kMemoryAllocationReserve | kMemoryAllocationCommit,
+            kMemoryProtectRead | kMemoryProtectWrite) ||
+        !data_heap->AllocFixed(
+            kDataAddress, kDataSize, 0,
+            kMemoryAllocationReserve | kMemoryAllocationCommit,
+            kMemoryProtectRead | kMemoryProtectWrite)) {
+      XELOGE("Unable to allocate guest memory");
+      return false;
+    }
+
+    // One function per benchmark, plus an empty loop for the baseline.
+    uint8_t* p = memory_->TranslateVirtual(kCodeAddress);
+    benchmark_addresses_.clear();
+    baseline_address_ = kCodeAddress;
+    p = WriteLoop(p, 0, 0);
+    for (const auto& benchmark : kBenchmarks) {
+      benchmark_addresses_.push_back(
+          kCodeAddress +
+          uint32_t(p - memory_->TranslateVirtual(kCodeAddress)));
+      p = WriteLoop(p, benchmark.code, kUnroll);
+    }
+
+    auto module = std::make_unique<RawModule>(processor_.get());
+    module->SetAddressRange(kCodeAddress, kCodeSize);
+    processor_->AddModule(std::move(module));
+    processor_->backend()->CommitExecutableRange(kCodeAddress,
+                                                 kCodeAddress + kCodeSize);
+
+    uint32_t stack_size = 64 * 1024;
+    uint32_t stack_address = kCodeAddress - stack_size;
+    uint32_t pcr_address = stack_address - 0x1000;
+    thread_state_.reset(
+        new ThreadState(processor_.get(), 0x100, stack_address, pcr_address));
+    return true;
+  }
+
+  // Returns the host ticks of the fastest call, or 0 on failure.
+  uint64_t Time(uint32_t address,
+                void (*setup)(PPCContext* ctx, uint8_t* data)) {
+    // Resolving JITs the function, keeping translation out of the timing.
+    auto fn = processor_->ResolveFunction(address);
+    if (!fn) {
+      XELOGE("Unable to translate the function at {:08X}", address);
+      return 0;
+    }
+    auto ctx = thread_state_->context();
+    uint64_t best = std::numeric_limits<uint64_t>::max();
+    for (int32_t i = 0; i < std::max(cvars::bench_repeat, 1); ++i) {
+      if (setup) {
+        setup(ctx, memory_->TranslateVirtual(kDataAddress));
+      }
+      ctx->ctr = uint32_t(std::max(cvars::bench_iterations, 1));
+      ctx->lr = 0xBCBCBCBC;
+      uint64_t start = Clock::QueryHostTickCount();
+      fn->Call(thread_state_.get(), uint32_t(ctx->lr));
+      best = std::min(best, Clock::QueryHostTickCount() - start);
+    }
+    return best;
+  }
+
+  void Run(const Variant& variant) {
+    double ns_per_tick = 1000000000.0 / double(Clock::QueryHostTickFrequency());
+    double op_count = double(std::max(cvars::bench_iterations, 1)) * kUnroll;
+    uint64_t baseline = Time(baseline_address_, nullptr);
+
+    XELOGI("{} variant:", variant.name);
+    for (size_t i = 0; i < xe::countof(kBenchmarks); ++i) {
+      const auto& benchmark = kBenchmarks[i];
+      if (!cvars::bench_filter.empty() &&
+          !std::strstr(benchmark.opcode, cvars::bench_filter.c_str()) &&
+          !std::strstr(benchmark.mnemonic, cvars::bench_filter.c_str())) {
+        continue;
+      }
+      uint64_t ticks = Time(benchmark_addresses_[i], benchmark.setup);
+      if (!ticks) {
+        continue;
+      }
+      // The loop overhead is measured separately and subtracted.
+      ticks -= std::min(ticks, baseline);
+      XELOGI("  {:<20} {:<10} {:8.3f} ns/op", benchmark.opcode,
+             benchmark.mnemonic, double(ticks) * ns_per_tick / op_count);
+    }
+  }
+
+ private:
+  // Writes "loop: code x count; bdnz loop; blr".
+  static uint8_t* WriteLoop(uint8_t* p, uint32_t code, uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i) {
+      xe::store_and_swap<uint32_t>(p, code);
+      p += 4;
+    }
+    int32_t displacement = -int32_t(count * 4);
+    xe::store_and_swap<uint32_t>(p, kBdnzOpcode | (displacement & 0xFFFC));
+    xe::store_and_swap<uint32_t>(p + 4, kBlrOpcode);
+    return p + 8;
+  }
+
+  std::unique_ptr<Memory> memory_;
+  std::unique_ptr<Processor> processor_;
+  std::unique_ptr<ThreadState> thread_state_;
+  uint32_t baseline_address_ = 0;
+  std::vector<uint32_t> benchmark_addresses_;
+};
+
+int main(const std::vector<std::string>& args) {
+  BenchRunner runner;
+  bool any_run = false;
+  for (const auto& variant : kVariants) {
+    if (("," + cvars::bench_variants + ",")
+            .find("," + std::string(variant.name) + ",") ==
+        std::string::npos) {
+      continue;
+    }
+    if (!runner.Setup(variant)) {
+      continue;
+    }
+    runner.Run(variant);
+    any_run = true;
+  }
+  return any_run ? 0 : 1;
+}
+
+}  // namespace bench
+}  // namespace cpu
+}  // namespace xe
+
+DEFINE_ENTRY_POINT("xenia-cpu-bench", xe::cpu::bench::main, "[filter]",
+                   "bench_filter");
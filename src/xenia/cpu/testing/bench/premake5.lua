@@ -0,0 +1,26 @@
+project_root = "../../../../.."
+include(project_root.."/tools/build")
+
+group("tests")
+project("xenia-cpu-bench")
+  uuid("6f1c9a52-3b7e-4d0a-8e21-5c4b7d93a0f6")
+  kind("ConsoleApp")
+  language("C++")
+  links({
+    "capstone", -- cpu-backend-x64
+    "fmt",
+    "mspack",
+    "xenia-core",
+    "xenia-cpu-backend-x64",
+    "xenia-cpu",
+    "xenia-base",
+  })
+  files({
+    "cpu_bench_main.cc",
+    "../../../base/main_"..platform_suffix..".cc",
+  })
+  filter("platforms:Windows")
+    debugdir(project_root)
+
+    -- xenia-base needs this
+    links({"xenia-ui"})
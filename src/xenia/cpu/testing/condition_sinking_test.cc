@@ -0,0 +1,95 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/testing/util.h"
+
+using namespace xe::cpu::hir;
+using namespace xe::cpu;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+TEST_CASE("CONDITION_SINKING_BRANCH", "[pass]") {
+  TestFunction test([](HIRBuilder& b) {
+    // The compare is moved past the add, which changes the host flags.
+    auto taken = b.NewLabel();
+    auto done = b.NewLabel();
+    auto cond = b.CompareSLT(LoadGPR(b, 4), LoadGPR(b, 5));
+    StoreGPR(b, 6, b.Add(LoadGPR(b, 7), LoadGPR(b, 8)));
+    b.BranchTrue(cond, taken);
+    StoreGPR(b, 3, b.LoadConstantUint64(1));
+    b.Branch(done);
+    b.MarkLabel(taken);
+    StoreGPR(b, 3, b.LoadConstantUint64(2));
+    b.MarkLabel(done);
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[4] = uint64_t(-1);
+        ctx->r[5] = 1;
+        ctx->r[7] = uint64_t(-2);
+        ctx->r[8] = 2;
+      },
+      [](PPCContext* ctx) {
+        REQUIRE(ctx->r[3] == 2);
+        REQUIRE(ctx->r[6] == 0);
+      });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[4] = 1;
+        ctx->r[5] = uint64_t(-1);
+        ctx->r[7] = 3;
+        ctx->r[8] = 4;
+      },
+      [](PPCContext* ctx) {
+        REQUIRE(ctx->r[3] == 1);
+        REQUIRE(ctx->r[6] == 7);
+      });
+}
+
+TEST_CASE("CONDITION_SINKING_USED_AFTER_BRANCH", "[pass]") {
+  TestFunction test([](HIRBuilder& b) {
+    // The compare result is also stored on both paths, so it stays where it
+    // is.
+    auto taken = b.NewLabel();
+    auto done = b.NewLabel();
+    auto cond = b.CompareEQ(LoadGPR(b, 4), LoadGPR(b, 5));
+    StoreGPR(b, 6, b.Add(LoadGPR(b, 7), LoadGPR(b, 8)));
+    b.BranchTrue(cond, taken);
+    StoreGPR(b, 3, b.ZeroExtend(cond, INT64_TYPE));
+    b.Branch(done);
+    b.MarkLabel(taken);
+    StoreGPR(b, 3, b.Add(b.ZeroExtend(cond, INT64_TYPE),
+                         b.LoadConstantUint64(10)));
+    b.MarkLabel(done);
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[4] = 5;
+        ctx->r[5] = 5;
+        ctx->r[7] = 1;
+        ctx->r[8] = 2;
+      },
+      [](PPCContext* ctx) {
+        REQUIRE(ctx->r[3] == 11);
+        REQUIRE(ctx->r[6] == 3);
+      });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[4] = 5;
+        ctx->r[5] = 6;
+        ctx->r[7] = 1;
+        ctx->r[8] = 2;
+      },
+      [](PPCContext* ctx) {
+        REQUIRE(ctx->r[3] == 0);
+        REQUIRE(ctx->r[6] == 3);
+      });
+}
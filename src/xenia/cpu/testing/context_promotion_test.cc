@@ -0,0 +1,54 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2013 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/testing/util.h"
+
+using namespace xe::cpu::hir;
+using namespace xe::cpu;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+TEST_CASE("CONTEXT_PROMOTION_ACROSS_BLOCKS", "[pass]") {
+  TestFunction test([](HIRBuilder& b) {
+    // r3 is reloaded in both successors and in the join block.
+    auto other = b.NewLabel();
+    auto done = b.NewLabel();
+    StoreGPR(b, 3, b.Add(LoadGPR(b, 4), LoadGPR(b, 5)));
+    b.BranchTrue(LoadGPR(b, 6), other);
+    StoreGPR(b, 7, b.Add(LoadGPR(b, 3), b.LoadConstantUint64(1)));
+    b.Branch(done);
+    b.MarkLabel(other);
+    StoreGPR(b, 7, b.Sub(LoadGPR(b, 3), b.LoadConstantUint64(1)));
+    b.MarkLabel(done);
+    StoreGPR(b, 8, LoadGPR(b, 3));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[4] = 10;
+        ctx->r[5] = 20;
+        ctx->r[6] = 0;
+      },
+      [](PPCContext* ctx) {
+        REQUIRE(ctx->r[3] == 30);
+        REQUIRE(ctx->r[7] == 31);
+        REQUIRE(ctx->r[8] == 30);
+      });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[4] = 10;
+        ctx->r[5] = 20;
+        ctx->r[6] = 1;
+      },
+      [](PPCContext* ctx) {
+        REQUIRE(ctx->r[3] == 30);
+        REQUIRE(ctx->r[7] == 29);
+        REQUIRE(ctx->r[8] == 30);
+      });
+}
@@ -0,0 +1,73 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/testing/util.h"
+
+using namespace xe::cpu::hir;
+using namespace xe::cpu;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+TEST_CASE("DEAD_STORE_LIVE_ACROSS_BRANCH", "[pass]") {
+  TestFunction test([](HIRBuilder& b) {
+    // The first store is only overwritten on one path and must be kept.
+    auto skip = b.NewLabel();
+    StoreGPR(b, 3, b.LoadConstantUint64(1));
+    b.BranchTrue(LoadGPR(b, 4), skip);
+    StoreGPR(b, 3, b.LoadConstantUint64(2));
+    b.MarkLabel(skip);
+    b.Return();
+  });
+  test.Run([](PPCContext* ctx) { ctx->r[4] = 1; },
+           [](PPCContext* ctx) {
+             auto result = ctx->r[3];
+             REQUIRE(result == 1);
+           });
+  test.Run([](PPCContext* ctx) { ctx->r[4] = 0; },
+           [](PPCContext* ctx) {
+             auto result = ctx->r[3];
+             REQUIRE(result == 2);
+           });
+}
+
+TEST_CASE("DEAD_STORE_OVERWRITTEN_ON_ALL_PATHS", "[pass]") {
+  TestFunction test([](HIRBuilder& b) {
+    // The first store is dead on both paths.
+    auto other = b.NewLabel();
+    auto done = b.NewLabel();
+    StoreGPR(b, 3, b.LoadConstantUint64(1));
+    b.BranchTrue(LoadGPR(b, 4), other);
+    StoreGPR(b, 3, LoadGPR(b, 5));
+    b.Branch(done);
+    b.MarkLabel(other);
+    StoreGPR(b, 3, LoadGPR(b, 6));
+    b.MarkLabel(done);
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[4] = 0;
+        ctx->r[5] = 5;
+        ctx->r[6] = 6;
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->r[3];
+        REQUIRE(result == 5);
+      });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[4] = 1;
+        ctx->r[5] = 5;
+        ctx->r[6] = 6;
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->r[3];
+        REQUIRE(result == 6);
+      });
+}
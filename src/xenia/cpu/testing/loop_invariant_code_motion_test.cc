@@ -0,0 +1,180 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/cvar.h"
+#include "xenia/cpu/testing/util.h"
+
+DECLARE_bool(loop_invariant_guest_memory_loads);
+
+using namespace xe::cpu::hir;
+using namespace xe::cpu;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+namespace {
+
+constexpr uint32_t kDataAddress = TestFunction::kDataAddress;
+
+// Counts r3 down to 0, branching back to loop while it isn't.
+void EndLoop(HIRBuilder& b, Label* loop) {
+  StoreGPR(b, 3, b.Sub(LoadGPR(b, 3), b.LoadConstantUint64(1)));
+  b.BranchTrue(LoadGPR(b, 3), loop);
+}
+
+// Memory loads are only moved out of loops with this enabled.
+class GuestMemoryLoadsScope {
+ public:
+  GuestMemoryLoadsScope()
+      : previous_(cvars::loop_invariant_guest_memory_loads) {
+    cvars::loop_invariant_guest_memory_loads = true;
+  }
+  ~GuestMemoryLoadsScope() {
+    cvars::loop_invariant_guest_memory_loads = previous_;
+  }
+
+ private:
+  bool previous_;
+};
+
+}  // namespace
+
+TEST_CASE("LOOP_INVARIANT_HOISTED", "[pass]") {
+  TestFunction test([](HIRBuilder& b) {
+    // r4 + r5 is the same in every iteration.
+    auto loop = b.NewLabel();
+    StoreGPR(b, 6, b.LoadConstantUint64(0));
+    b.MarkLabel(loop);
+    StoreGPR(b, 6, b.Add(LoadGPR(b, 6), b.Add(LoadGPR(b, 4), LoadGPR(b, 5))));
+    EndLoop(b, loop);
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[3] = 4;
+        ctx->r[4] = 2;
+        ctx->r[5] = 3;
+      },
+      [](PPCContext* ctx) {
+        REQUIRE(ctx->r[3] == 0);
+        REQUIRE(ctx->r[6] == 20);
+      });
+}
+
+TEST_CASE("LOOP_INVARIANT_CONTEXT_STORE_ALIASES", "[pass]") {
+  TestFunction test([](HIRBuilder& b) {
+    // r4 is loaded before being stored in the same iteration.
+    auto loop = b.NewLabel();
+    StoreGPR(b, 6, b.LoadConstantUint64(0));
+    b.MarkLabel(loop);
+    StoreGPR(b, 6, b.Add(LoadGPR(b, 6), LoadGPR(b, 4)));
+    StoreGPR(b, 4, b.Add(LoadGPR(b, 4), b.LoadConstantUint64(1)));
+    EndLoop(b, loop);
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[3] = 3;
+        ctx->r[4] = 1;
+      },
+      [](PPCContext* ctx) {
+        REQUIRE(ctx->r[4] == 4);
+        REQUIRE(ctx->r[6] == 6);
+      });
+}
+
+TEST_CASE("LOOP_INVARIANT_MEMORY_STORE_ALIASES", "[pass]") {
+  GuestMemoryLoadsScope memory_loads;
+  TestFunction test([](HIRBuilder& b) {
+    // The load at r4 + 8 reads what the previous iteration stored through
+    // another base register.
+    auto loop = b.NewLabel();
+    StoreGPR(b, 6, b.LoadConstantUint64(0));
+    b.MarkLabel(loop);
+    auto value =
+        b.Load(b.Add(LoadGPR(b, 4), b.LoadConstantUint64(8)), INT64_TYPE);
+    StoreGPR(b, 6, b.Add(LoadGPR(b, 6), value));
+    b.Store(LoadGPR(b, 5), b.Add(value, b.LoadConstantUint64(1)));
+    EndLoop(b, loop);
+    b.Return();
+  });
+  auto data = reinterpret_cast<uint64_t*>(test.AllocData());
+  data[1] = 1;
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[3] = 3;
+        ctx->r[4] = kDataAddress;
+        ctx->r[5] = kDataAddress + 8;
+      },
+      [data](PPCContext* ctx) {
+        REQUIRE(ctx->r[6] == 6);
+        REQUIRE(data[1] == 4);
+      });
+}
+
+TEST_CASE("LOOP_INVARIANT_NESTED", "[pass]") {
+  TestFunction test([](HIRBuilder& b) {
+    // r4 * r5 doesn't change in either loop, r8 only in the outer one.
+    auto outer = b.NewLabel();
+    auto inner = b.NewLabel();
+    StoreGPR(b, 6, b.LoadConstantUint64(0));
+    b.MarkLabel(outer);
+    StoreGPR(b, 7, LoadGPR(b, 8));
+    b.MarkLabel(inner);
+    StoreGPR(b, 6, b.Add(LoadGPR(b, 6), b.Mul(LoadGPR(b, 4), LoadGPR(b, 5))));
+    StoreGPR(b, 7, b.Sub(LoadGPR(b, 7), b.LoadConstantUint64(1)));
+    b.BranchTrue(LoadGPR(b, 7), inner);
+    StoreGPR(b, 8, b.Add(LoadGPR(b, 8), b.LoadConstantUint64(1)));
+    EndLoop(b, outer);
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[3] = 3;
+        ctx->r[4] = 2;
+        ctx->r[5] = 5;
+        ctx->r[8] = 2;
+      },
+      [](PPCContext* ctx) {
+        // 2 + 3 + 4 inner iterations.
+        REQUIRE(ctx->r[6] == 90);
+        REQUIRE(ctx->r[7] == 0);
+        REQUIRE(ctx->r[8] == 5);
+      });
+}
+
+TEST_CASE("LOOP_INVARIANT_NOT_ALWAYS_ENTERED", "[pass]") {
+  GuestMemoryLoadsScope memory_loads;
+  TestFunction test([](HIRBuilder& b) {
+    // r4 is only a valid address when the loop runs, so the load in it must
+    // not be moved to where it would run either way.
+    auto loop = b.NewLabel();
+    auto done = b.NewLabel();
+    StoreGPR(b, 6, b.LoadConstantUint64(0));
+    b.BranchFalse(LoadGPR(b, 3), done);
+    b.MarkLabel(loop);
+    StoreGPR(b, 6, b.Add(LoadGPR(b, 6), b.Load(LoadGPR(b, 4), INT64_TYPE)));
+    EndLoop(b, loop);
+    b.MarkLabel(done);
+    b.Return();
+  });
+  auto data = reinterpret_cast<uint64_t*>(test.AllocData());
+  data[0] = 5;
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[3] = 0;
+        ctx->r[4] = 0;
+      },
+      [](PPCContext* ctx) { REQUIRE(ctx->r[6] == 0); });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[3] = 2;
+        ctx->r[4] = kDataAddress;
+      },
+      [](PPCContext* ctx) { REQUIRE(ctx->r[6] == 10); });
+}
@@ -0,0 +1,132 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <cstring>
+
+#include "xenia/cpu/testing/util.h"
+
+using namespace xe::cpu::hir;
+using namespace xe::cpu;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+namespace {
+
+void StoreConstant(HIRBuilder& b, int64_t offset, Value* value) {
+  b.StoreOffset(LoadGPR(b, 4), b.LoadConstantInt64(offset), value);
+}
+
+// Runs the function with r4 pointing at zeroed memory, and checks the bytes
+// at the start of it.
+template <size_t N>
+void RunAndCheckBytes(TestFunction& test, const uint8_t (&expected)[N]) {
+  uint8_t* data = test.AllocData();
+  test.Run(
+      [data](PPCContext* ctx) {
+        std::memset(data, 0, 16);
+        ctx->r[4] = TestFunction::kDataAddress;
+      },
+      [data, &expected](PPCContext* ctx) {
+        REQUIRE(std::memcmp(data, expected, N) == 0);
+      });
+}
+
+}  // namespace
+
+TEST_CASE("MERGE_CONSTANT_STORES_16", "[pass]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreConstant(b, 3, b.LoadConstantUint8(0x44));
+    StoreConstant(b, 2, b.LoadConstantUint8(0x33));
+    b.Return();
+  });
+  const uint8_t expected[] = {0x00, 0x00, 0x33, 0x44, 0x00};
+  RunAndCheckBytes(test, expected);
+}
+
+TEST_CASE("MERGE_CONSTANT_STORES_32", "[pass]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreConstant(b, 4, b.LoadConstantUint8(0x11));
+    StoreConstant(b, 5, b.LoadConstantUint8(0x22));
+    StoreConstant(b, 6, b.LoadConstantUint16(0x4433));
+    b.Return();
+  });
+  const uint8_t expected[] = {0x00, 0x00, 0x00, 0x00, 0x11,
+                              0x22, 0x33, 0x44, 0x00};
+  RunAndCheckBytes(test, expected);
+}
+
+TEST_CASE("MERGE_CONSTANT_STORES_64", "[pass]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreConstant(b, 8, b.LoadConstantUint32(0x44332211));
+    StoreConstant(b, 12, b.LoadConstantUint32(0x88776655));
+    b.Return();
+  });
+  const uint8_t expected[] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                              0x00, 0x00, 0x11, 0x22, 0x33, 0x44,
+                              0x55, 0x66, 0x77, 0x88};
+  RunAndCheckBytes(test, expected);
+}
+
+TEST_CASE("MERGE_CONSTANT_STORES_OVERLAPPING", "[pass]") {
+  TestFunction test([](HIRBuilder& b) {
+    // The second store overwrites half of the first one.
+    StoreConstant(b, 0, b.LoadConstantUint32(0x11111111));
+    StoreConstant(b, 2, b.LoadConstantUint16(0x2222));
+    StoreConstant(b, 4, b.LoadConstantUint32(0x33333333));
+    b.Return();
+  });
+  const uint8_t expected[] = {0x11, 0x11, 0x22, 0x22, 0x33,
+                              0x33, 0x33, 0x33, 0x00};
+  RunAndCheckBytes(test, expected);
+}
+
+TEST_CASE("MERGE_CONSTANT_STORES_BROKEN_BY_LOAD", "[pass]") {
+  TestFunction test([](HIRBuilder& b) {
+    // The load must see the first store and not the second one.
+    StoreConstant(b, 0, b.LoadConstantUint32(0x11111111));
+    StoreGPR(b, 5,
+             b.LoadOffset(LoadGPR(b, 4), b.LoadConstantInt64(0), INT64_TYPE));
+    StoreConstant(b, 4, b.LoadConstantUint32(0x22222222));
+    b.Return();
+  });
+  uint8_t* data = test.AllocData();
+  test.Run(
+      [data](PPCContext* ctx) {
+        std::memset(data, 0, 16);
+        ctx->r[4] = TestFunction::kDataAddress;
+      },
+      [data](PPCContext* ctx) {
+        REQUIRE(ctx->r[5] == 0x0000000011111111ull);
+        REQUIRE(data[4] == 0x22);
+      });
+}
+
+TEST_CASE("MERGE_CONSTANT_STORES_BROKEN_BY_STORE", "[pass]") {
+  TestFunction test([](HIRBuilder& b) {
+    // The store of r5 overwrites the first constant store, and must not be
+    // overwritten by a merged one.
+    StoreConstant(b, 4, b.LoadConstantUint32(0x22222222));
+    b.StoreOffset(LoadGPR(b, 4), b.LoadConstantInt64(4),
+                  b.Truncate(LoadGPR(b, 5), INT32_TYPE));
+    StoreConstant(b, 0, b.LoadConstantUint32(0x11111111));
+    b.Return();
+  });
+  uint8_t* data = test.AllocData();
+  test.Run(
+      [data](PPCContext* ctx) {
+        std::memset(data, 0, 16);
+        ctx->r[4] = TestFunction::kDataAddress;
+        ctx->r[5] = 0x33333333;
+      },
+      [data](PPCContext* ctx) {
+        const uint8_t expected[] = {0x11, 0x11, 0x11, 0x11,
+                                    0x33, 0x33, 0x33, 0x33};
+        REQUIRE(std::memcmp(data, expected, sizeof(expected)) == 0);
+      });
+}
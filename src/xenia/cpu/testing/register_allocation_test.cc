@@ -0,0 +1,71 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/testing/util.h"
+
+using namespace xe::cpu::hir;
+using namespace xe::cpu;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+TEST_CASE("GLOBAL_VALUE_ACROSS_BRANCH", "[pass]") {
+  TestFunction test([](HIRBuilder& b) {
+    auto skip = b.NewLabel();
+    auto v = LoadGPR(b, 4);
+    b.BranchTrue(LoadGPR(b, 5), skip);
+    StoreGPR(b, 3, b.LoadConstantUint64(0));
+    b.MarkLabel(skip);
+    StoreGPR(b, 6, b.Add(v, LoadGPR(b, 3)));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[3] = 10;
+        ctx->r[4] = 5;
+        ctx->r[5] = 1;
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->r[6];
+        REQUIRE(result == 15);
+      });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[3] = 10;
+        ctx->r[4] = 5;
+        ctx->r[5] = 0;
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->r[6];
+        REQUIRE(result == 5);
+      });
+}
+
+TEST_CASE("GLOBAL_VALUE_LIVE_ACROSS_LOOP", "[pass]") {
+  TestFunction test([](HIRBuilder& b) {
+    // v is defined before the loop and must survive the back edge.
+    auto loop = b.NewLabel();
+    auto v = LoadGPR(b, 4);
+    b.MarkLabel(loop);
+    StoreGPR(b, 3, b.Add(LoadGPR(b, 3), v));
+    auto count = b.Sub(LoadGPR(b, 5), b.LoadConstantUint64(1));
+    StoreGPR(b, 5, count);
+    b.BranchTrue(count, loop);
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[3] = 1;
+        ctx->r[4] = 3;
+        ctx->r[5] = 4;
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->r[3];
+        REQUIRE(result == 13);
+      });
+}
@@ -85,6 +85,17 @@ class TestFunction {
     }
   }
 
+  // Commits a page of guest memory at kDataAddress for the function to access,
+  // returning where it is on the host.
+  static constexpr uint32_t kDataAddress = 0x40000000;
+  uint8_t* AllocData() {
+    memory->LookupHeap(kDataAddress)
+        ->AllocFixed(kDataAddress, 0x10000, 0x10000,
+                     kMemoryAllocationReserve | kMemoryAllocationCommit,
+                     kMemoryProtectRead | kMemoryProtectWrite);
+    return memory->TranslateVirtual(kDataAddress);
+  }
+
   uint32_t memory_size;
   std::unique_ptr<Memory> memory;
   std::vector<std::unique_ptr<Processor>> processors;
@@ -10,16 +10,27 @@
 #include "xenia/cpu/xex_module.h"
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include "third_party/fmt/include/fmt/format.h"
+#include "third_party/xxhash/xxhash.h"
 
 #include "xenia/base/byte_order.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
+#include "xenia/base/startup_timeline.h"
+#include "xenia/base/threading.h"
 #include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/export_resolver.h"
 #include "xenia/cpu/lzx.h"
+#include "xenia/cpu/ppc/ppc_decode_data.h"
+#include "xenia/cpu/ppc/ppc_opcode_info.h"
 #include "xenia/cpu/processor.h"
 #include "xenia/kernel/kernel_state.h"
 #include "xenia/kernel/xmodule.h"
@@ -36,12 +47,13 @@ static const uint8_t xe_xex2_devkit_key[16] = {
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
 
-void aes_decrypt_buffer(const uint8_t* session_key, const uint8_t* input_buffer,
-                        const size_t input_size, uint8_t* output_buffer,
-                        const size_t output_size) {
-  uint32_t rk[4 * (MAXNR + 1)];
-  uint8_t ivec[16] = {0};
-  int32_t Nr = rijndaelKeySetupDec(rk, session_key, 128);
+// Decrypts AES-CBC data, with ivec holding the previous ciphertext block on
+// entry and updated to the last ciphertext block of the input on return, so
+// that the decryption of a buffer can be split into parts.
+static void aes_decrypt_cbc(const uint32_t* rk, int32_t Nr,
+                            const uint8_t* input_buffer,
+                            const size_t input_size, uint8_t* output_buffer,
+                            uint8_t* ivec) {
   const uint8_t* ct = input_buffer;
   uint8_t* pt = output_buffer;
   for (size_t n = 0; n < input_size; n += 16, ct += 16, pt += 16) {
@@ -56,6 +68,74 @@ void aes_decrypt_buffer(const uint8_t* session_key, const uint8_t* input_buffer,
   }
 }
 
+// Header of the files of the XEX image cache, followed by the image.
+struct ImageCacheHeader {
+  static constexpr uint32_t kMagic = 0x434D4958;  // 'XIMC'
+  static constexpr uint32_t kVersion = 1;
+  static constexpr uint32_t kFlagDevKit = 1 << 0;
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t flags;
+  uint32_t base_address;
+  uint32_t image_size;
+  uint32_t reserved;
+};
+
+void aes_decrypt_buffer(const uint8_t* session_key, const uint8_t* input_buffer,
+                        const size_t input_size, uint8_t* output_buffer,
+                        const size_t output_size) {
+  uint32_t rk[4 * (MAXNR + 1)];
+  int32_t Nr = rijndaelKeySetupDec(rk, session_key, 128);
+
+  // Unlike encryption, CBC decryption of a block only needs the ciphertext of
+  // the previous one, so large buffers are split into parts decrypted in
+  // parallel, each starting with the last ciphertext block before it as IV.
+  const size_t kMinPartSize = 2 * 1024 * 1024;
+  size_t part_count = std::min(
+      size_t(std::max(xe::threading::logical_processor_count(), uint32_t(1))),
+      std::max(input_size / kMinPartSize, size_t(1)));
+  size_t part_size = xe::round_up(input_size / part_count, size_t(16));
+
+  // Parts not taken by other threads, from this offset to the end, are
+  // decrypted on this thread after the first part.
+  size_t remaining_offset = input_size;
+  std::vector<std::unique_ptr<xe::threading::Thread>> threads;
+  for (size_t i = 1; i < part_count; ++i) {
+    size_t part_offset = part_size * i;
+    if (part_offset >= input_size) {
+      break;
+    }
+    size_t part_length = std::min(part_size, input_size - part_offset);
+    xe::threading::Thread::CreationParameters params;
+    auto thread = xe::threading::Thread::Create(params, [=, &rk]() {
+      uint8_t ivec[16];
+      std::memcpy(ivec, input_buffer + part_offset - 16, 16);
+      aes_decrypt_cbc(rk, Nr, input_buffer + part_offset, part_length,
+                      output_buffer + part_offset, ivec);
+    });
+    if (!thread) {
+      remaining_offset = part_offset;
+      break;
+    }
+    thread->set_name("XEX Decryption");
+    threads.push_back(std::move(thread));
+  }
+
+  uint8_t ivec[16] = {0};
+  aes_decrypt_cbc(rk, Nr, input_buffer, std::min(part_size, input_size),
+                  output_buffer, ivec);
+  if (remaining_offset < input_size) {
+    std::memcpy(ivec, input_buffer + remaining_offset - 16, 16);
+    aes_decrypt_cbc(rk, Nr, input_buffer + remaining_offset,
+                    input_size - remaining_offset,
+                    output_buffer + remaining_offset, ivec);
+  }
+  for (auto& thread : threads) {
+    xe::threading::Wait(thread.get(), false);
+  }
+}
+
 namespace xe {
 namespace cpu {
 
@@ -198,6 +278,76 @@ uint32_t XexModule::GetProcAddress(const std::string_view name) const {
   return 0;
 }
 
+std::filesystem::path XexModule::GetImageCachePath(uint64_t patch_hash) const {
+  if (patch_hash) {
+    return image_cache_dir_ /
+           fmt::format("{:016X}_{:016X}.ximg", file_hash_, patch_hash);
+  }
+  return image_cache_dir_ / fmt::format("{:016X}.ximg", file_hash_);
+}
+
+std::unique_ptr<MappedMemory> XexModule::OpenCachedImage(
+    uint64_t patch_hash, uint32_t image_size) const {
+  if (image_cache_dir_.empty()) {
+    return nullptr;
+  }
+  auto mapping = MappedMemory::Open(GetImageCachePath(patch_hash),
+                                    MappedMemory::Mode::kRead);
+  if (!mapping || mapping->size() < sizeof(ImageCacheHeader)) {
+    return nullptr;
+  }
+  auto header = reinterpret_cast<const ImageCacheHeader*>(mapping->data());
+  if (header->magic != ImageCacheHeader::kMagic ||
+      header->version != ImageCacheHeader::kVersion ||
+      header->base_address != base_address_ ||
+      (image_size && header->image_size != image_size) ||
+      mapping->size() != sizeof(ImageCacheHeader) + header->image_size) {
+    XELOGW("Ignoring the invalid cached XEX image {}",
+           xe::path_to_utf8(GetImageCachePath(patch_hash)));
+    return nullptr;
+  }
+  return mapping;
+}
+
+void XexModule::StoreCachedImage(uint64_t patch_hash,
+                                 uint32_t image_size) const {
+  if (image_cache_dir_.empty()) {
+    return;
+  }
+  std::error_code error_code;
+  std::filesystem::create_directories(image_cache_dir_, error_code);
+  auto path = GetImageCachePath(patch_hash);
+  // Written under a different name and renamed when complete, so a cached
+  // image is never seen partially written.
+  auto temp_path = path;
+  temp_path += ".tmp";
+  FILE* file = xe::filesystem::OpenFile(temp_path, "wb");
+  if (!file) {
+    XELOGW("Failed to create the cached XEX image {}",
+           xe::path_to_utf8(temp_path));
+    return;
+  }
+  ImageCacheHeader header = {};
+  header.magic = ImageCacheHeader::kMagic;
+  header.version = ImageCacheHeader::kVersion;
+  header.flags = is_dev_kit_ ? ImageCacheHeader::kFlagDevKit : 0;
+  header.base_address = base_address_;
+  header.image_size = image_size;
+  bool written =
+      fwrite(&header, sizeof(header), 1, file) == 1 &&
+      fwrite(memory()->TranslateVirtual(base_address_), 1, image_size, file) ==
+          image_size;
+  written = !fclose(file) && written;
+  if (written) {
+    std::filesystem::rename(temp_path, path, error_code);
+    written = !error_code;
+  }
+  if (!written) {
+    XELOGW("Failed to write the cached XEX image {}", xe::path_to_utf8(path));
+    std::filesystem::remove(temp_path, error_code);
+  }
+}
+
 int XexModule::ApplyPatch(XexModule* module) {
   if (!is_patch()) {
     // This isn't a XEX2 patch.
@@ -352,84 +502,96 @@ int XexModule::ApplyPatch(XexModule* module) {
     return 7;
   }
 
-  // Decrypt (if needed).
-  bool free_input = false;
-  const uint8_t* patch_buffer = xexp_data_mem_.data();
-  const size_t patch_length = xexp_data_mem_.size();
+  uint8_t* base_exe = memory()->TranslateVirtual(module->base_address_);
 
-  const uint8_t* input_buffer = patch_buffer;
+  auto cached_image = module->OpenCachedImage(file_hash_, new_image_size);
+  if (cached_image) {
+    std::memcpy(base_exe, cached_image->data() + sizeof(ImageCacheHeader),
+                new_image_size);
+    XELOGI("Loaded the patched XEX image from the cache");
+  } else {
+    // Decrypt (if needed).
+    bool free_input = false;
+    const uint8_t* patch_buffer = xexp_data_mem_.data();
+    const size_t patch_length = xexp_data_mem_.size();
 
-  switch (file_format_header->encryption_type) {
-    case XEX_ENCRYPTION_NONE:
-      // No-op.
-      break;
-    case XEX_ENCRYPTION_NORMAL:
-      // TODO: a way to do without a copy/alloc?
-      free_input = true;
-      input_buffer = (const uint8_t*)calloc(1, patch_length);
-      aes_decrypt_buffer(session_key_, patch_buffer, patch_length,
-                         (uint8_t*)input_buffer, patch_length);
-      break;
-    default:
-      assert_always();
-      return 8;
-  }
+    const uint8_t* input_buffer = patch_buffer;
 
-  const xex2_compressed_block_info* cur_block =
-      &file_format_header->compression_info.normal.first_block;
+    switch (file_format_header->encryption_type) {
+      case XEX_ENCRYPTION_NONE:
+        // No-op.
+        break;
+      case XEX_ENCRYPTION_NORMAL:
+        // TODO: a way to do without a copy/alloc?
+        free_input = true;
+        input_buffer = (const uint8_t*)calloc(1, patch_length);
+        aes_decrypt_buffer(session_key_, patch_buffer, patch_length,
+                           (uint8_t*)input_buffer, patch_length);
+        break;
+      default:
+        assert_always();
+        return 8;
+    }
 
-  const uint8_t* p = input_buffer;
-  uint8_t* base_exe = memory()->TranslateVirtual(module->base_address_);
+    const xex2_compressed_block_info* cur_block =
+        &file_format_header->compression_info.normal.first_block;
 
-  // If image_source_offset is set, copy [source_offset:source_size] to
-  // target_offset
-  if (patch_header->delta_image_source_offset) {
-    memcpy(base_exe + patch_header->delta_image_target_offset,
-           base_exe + patch_header->delta_image_source_offset,
-           patch_header->delta_image_source_size);
-  }
+    const uint8_t* p = input_buffer;
 
-  // TODO: should we use new_image_size here instead?
-  uint32_t image_target_size = patch_header->delta_image_target_offset +
-                               patch_header->delta_image_source_size;
+    // If image_source_offset is set, copy [source_offset:source_size] to
+    // target_offset
+    if (patch_header->delta_image_source_offset) {
+      memcpy(base_exe + patch_header->delta_image_target_offset,
+             base_exe + patch_header->delta_image_source_offset,
+             patch_header->delta_image_source_size);
+    }
 
-  // If new size is smaller than original, null out the difference
-  if (image_target_size < original_image_size) {
-    memset(base_exe + image_target_size, 0,
-           original_image_size - image_target_size);
-  }
+    // TODO: should we use new_image_size here instead?
+    uint32_t image_target_size = patch_header->delta_image_target_offset +
+                                 patch_header->delta_image_source_size;
 
-  // Now loop through each block and apply the delta patches inside
-  while (cur_block->block_size) {
-    const auto* next_block = (const xex2_compressed_block_info*)p;
+    // If new size is smaller than original, null out the difference
+    if (image_target_size < original_image_size) {
+      memset(base_exe + image_target_size, 0,
+             original_image_size - image_target_size);
+    }
 
-    // Compare block hash, if no match we probably used wrong decrypt key
-    s.reset();
-    s.processBytes(p, cur_block->block_size);
-    s.finalize(digest);
+    // Now loop through each block and apply the delta patches inside
+    while (cur_block->block_size) {
+      const auto* next_block = (const xex2_compressed_block_info*)p;
 
-    if (memcmp(digest, cur_block->block_hash, 0x14) != 0) {
-      result_code = 9;
-      XELOGE("XEX patch block hash doesn't match hash inside block info!");
-      break;
-    }
+      // Compare block hash, if no match we probably used wrong decrypt key
+      s.reset();
+      s.processBytes(p, cur_block->block_size);
+      s.finalize(digest);
+
+      if (memcmp(digest, cur_block->block_hash, 0x14) != 0) {
+        result_code = 9;
+        XELOGE("XEX patch block hash doesn't match hash inside block info!");
+        break;
+      }
 
-    // skip block info
-    p += 20;
-    p += 4;
+      // skip block info
+      p += 20;
+      p += 4;
 
-    uint32_t block_data_size = cur_block->block_size - 20 - 4;
+      uint32_t block_data_size = cur_block->block_size - 20 - 4;
 
-    // Apply delta patch
-    result_code = lzxdelta_apply_patch(
-        (xex2_delta_patch*)p, block_data_size,
-        file_format_header->compression_info.normal.window_size, base_exe);
-    if (result_code) {
-      break;
+      // Apply delta patch
+      result_code = lzxdelta_apply_patch(
+          (xex2_delta_patch*)p, block_data_size,
+          file_format_header->compression_info.normal.window_size, base_exe);
+      if (result_code) {
+        break;
+      }
+
+      p += block_data_size;
+      cur_block = next_block;
     }
 
-    p += block_data_size;
-    cur_block = next_block;
+    if (free_input) {
+      free((void*)input_buffer);
+    }
   }
 
   if (!result_code) {
@@ -449,6 +611,10 @@ int XexModule::ApplyPatch(XexModule* module) {
       }
     }
 
+    if (!cached_image) {
+      module->StoreCachedImage(file_hash_, new_image_size);
+    }
+
     auto& source_ver = patch_header->source_version;
     auto& target_ver = patch_header->target_version;
 
@@ -462,9 +628,6 @@ int XexModule::ApplyPatch(XexModule* module) {
     XELOGE("XEX patch application failed, error code {}", result_code);
   }
 
-  if (free_input) {
-    free((void*)input_buffer);
-  }
   return result_code;
 }
 
@@ -664,77 +827,149 @@ int XexModule::ReadImageCompressed(const void* xex_addr, size_t xex_length) {
   //   20b hash of entire next block (including size/hash)
   //    Nb block uint8_ts
   // - decompress block contents
+  // Decryption and de-blocking are done on a separate thread in order, block
+  // by block, and the LZX decoder is fed with the de-blocked data as soon as
+  // it's available, so all the steps overlap instead of each one going
+  // through the whole image before the next starts.
 
-  uint8_t* compress_buffer = NULL;
-  const uint8_t* p = NULL;
-  uint8_t* d = NULL;
-  sha1::SHA1 s;
-
-  // Decrypt (if needed).
-  bool free_input = false;
-  const uint8_t* input_buffer = exe_buffer;
-  size_t input_size = exe_length;
-
+  bool encrypted;
   switch (opt_file_format_info()->encryption_type) {
     case XEX_ENCRYPTION_NONE:
-      // No-op.
+      encrypted = false;
       break;
     case XEX_ENCRYPTION_NORMAL:
-      // TODO: a way to do without a copy/alloc?
-      free_input = true;
-      input_buffer = (const uint8_t*)calloc(1, exe_length);
-      aes_decrypt_buffer(session_key_, exe_buffer, exe_length,
-                         (uint8_t*)input_buffer, exe_length);
+      encrypted = true;
       break;
     default:
       assert_always();
       return 1;
   }
 
-  const auto* compression_info = &opt_file_format_info()->compression_info;
-  const xex2_compressed_block_info* cur_block =
-      &compression_info->normal.first_block;
+  // TODO: a way to do without a copy/alloc?
+  std::vector<uint8_t> decrypt_buffer(encrypted ? exe_length : 0);
+  const uint8_t* input_buffer = encrypted ? decrypt_buffer.data() : exe_buffer;
+  // Only whole AES blocks can be decrypted.
+  const size_t input_size = encrypted ? exe_length & ~size_t(15) : exe_length;
 
-  compress_buffer = (uint8_t*)calloc(1, exe_length);
+  const auto* compression_info = &opt_file_format_info()->compression_info;
+  std::vector<uint8_t> compress_buffer(exe_length);
+
+  std::mutex deblock_mutex;
+  std::condition_variable deblock_cond;
+  // Length of the data at the beginning of compress_buffer that has been
+  // verified and can be decompressed.
+  size_t deblocked_length = 0;
+  bool deblock_done = false;
+  int deblock_result = 0;
+  std::atomic<bool> deblock_cancelled(false);
+
+  auto deblock = [&]() {
+    uint32_t rk[4 * (MAXNR + 1)];
+    uint8_t ivec[16] = {0};
+    int32_t Nr = encrypted ? rijndaelKeySetupDec(rk, session_key_, 128) : 0;
+    // Decrypting ahead by more than the next block keeps the number of
+    // wakeups of the decoder low with small blocks.
+    const size_t kDecryptStep = 256 * 1024;
+    size_t decrypted_length = encrypted ? 0 : input_size;
+
+    const xex2_compressed_block_info* cur_block =
+        &compression_info->normal.first_block;
+    size_t block_offset = 0;
+    uint8_t* d = compress_buffer.data();
+    int result_code = 0;
+    sha1::SHA1 s;
+    uint8_t block_calced_digest[0x14];
+    while (cur_block->block_size && !deblock_cancelled) {
+      const size_t block_size = cur_block->block_size;
+      if (block_size < 4 + 20 || block_size > input_size - block_offset) {
+        result_code = 2;
+        break;
+      }
+      const size_t block_end = block_offset + block_size;
+      if (decrypted_length < block_end) {
+        size_t decrypt_end = std::min(
+            xe::round_up(std::max(block_end, decrypted_length + kDecryptStep),
+                         size_t(16)),
+            input_size);
+        aes_decrypt_cbc(rk, Nr, exe_buffer + decrypted_length,
+                        decrypt_end - decrypted_length,
+                        decrypt_buffer.data() + decrypted_length, ivec);
+        decrypted_length = decrypt_end;
+      }
 
-  p = input_buffer;
-  d = compress_buffer;
+      const uint8_t* p = input_buffer + block_offset;
+      const uint8_t* pend = input_buffer + block_end;
+      const auto* next_block = (const xex2_compressed_block_info*)p;
 
-  // De-block.
-  int result_code = 0;
+      // Compare block hash, if no match we probably used wrong decrypt key
+      s.reset();
+      s.processBytes(p, block_size);
+      s.finalize(block_calced_digest);
+      if (memcmp(block_calced_digest, cur_block->block_hash, 0x14) != 0) {
+        result_code = 2;
+        break;
+      }
 
-  uint8_t block_calced_digest[0x14];
-  while (cur_block->block_size) {
-    const uint8_t* pnext = p + cur_block->block_size;
-    const auto* next_block = (const xex2_compressed_block_info*)p;
-
-    // Compare block hash, if no match we probably used wrong decrypt key
-    s.reset();
-    s.processBytes(p, cur_block->block_size);
-    s.finalize(block_calced_digest);
-    if (memcmp(block_calced_digest, cur_block->block_hash, 0x14) != 0) {
-      result_code = 2;
-      break;
-    }
+      // skip block info
+      p += 4;
+      p += 20;
 
-    // skip block info
-    p += 4;
-    p += 20;
+      while (pend - p >= 2) {
+        const size_t chunk_size = (p[0] << 8) | p[1];
+        p += 2;
+        if (!chunk_size) {
+          break;
+        }
+        if (chunk_size > size_t(pend - p)) {
+          result_code = 2;
+          break;
+        }
 
-    while (true) {
-      const size_t chunk_size = (p[0] << 8) | p[1];
-      p += 2;
-      if (!chunk_size) {
+        memcpy(d, p, chunk_size);
+        p += chunk_size;
+        d += chunk_size;
+      }
+      if (result_code) {
         break;
       }
 
-      memcpy(d, p, chunk_size);
-      p += chunk_size;
-      d += chunk_size;
+      {
+        std::lock_guard<std::mutex> lock(deblock_mutex);
+        deblocked_length = d - compress_buffer.data();
+      }
+      deblock_cond.notify_one();
+
+      block_offset = block_end;
+      cur_block = next_block;
     }
 
-    p = pnext;
-    cur_block = next_block;
+    {
+      std::lock_guard<std::mutex> lock(deblock_mutex);
+      deblock_done = true;
+      deblock_result = result_code;
+    }
+    deblock_cond.notify_one();
+  };
+
+  xe::threading::Thread::CreationParameters deblock_thread_params;
+  auto deblock_thread =
+      xe::threading::Thread::Create(deblock_thread_params, deblock);
+  if (deblock_thread) {
+    deblock_thread->set_name("XEX De-blocking");
+  } else {
+    deblock();
+  }
+
+  // Wait for the first block so nothing is allocated if the hash already
+  // doesn't match because the key is wrong.
+  int result_code = 0;
+  {
+    std::unique_lock<std::mutex> lock(deblock_mutex);
+    deblock_cond.wait(lock,
+                      [&]() { return deblocked_length || deblock_done; });
+    if (deblock_done) {
+      result_code = deblock_result;
+    }
   }
 
   if (!result_code) {
@@ -754,9 +989,28 @@ int XexModule::ReadImageCompressed(const void* xex_addr, size_t xex_length) {
       std::memset(buffer, 0, uncompressed_size);
 
       // Decompress into XEX base
-      result_code = lzx_decompress(
-          compress_buffer, d - compress_buffer, buffer, uncompressed_size,
-          compression_info->normal.window_size, nullptr, 0);
+      size_t read_offset = 0;
+      auto read = [&](void* read_buffer, int read_length) -> int {
+        size_t read_end;
+        {
+          std::unique_lock<std::mutex> lock(deblock_mutex);
+          deblock_cond.wait(lock, [&]() {
+            return deblocked_length > read_offset || deblock_done;
+          });
+          if (deblock_result) {
+            return -1;
+          }
+          read_end = deblocked_length;
+        }
+        // The de-blocking thread only writes past deblocked_length.
+        size_t count = std::min(size_t(read_length), read_end - read_offset);
+        std::memcpy(read_buffer, compress_buffer.data() + read_offset, count);
+        read_offset += count;
+        return int(count);
+      };
+      result_code =
+          lzx_decompress_stream(read, buffer, uncompressed_size,
+                                compression_info->normal.window_size);
     } else {
       XELOGE("Unable to allocate XEX memory at {:08X}-{:08X}.", base_address_,
              uncompressed_size);
@@ -764,11 +1018,12 @@ int XexModule::ReadImageCompressed(const void* xex_addr, size_t xex_length) {
     }
   }
 
-  if (compress_buffer) {
-    free((void*)compress_buffer);
+  deblock_cancelled = true;
+  if (deblock_thread) {
+    xe::threading::Wait(deblock_thread.get(), false);
   }
-  if (free_input) {
-    free((void*)input_buffer);
+  if (deblock_result) {
+    result_code = deblock_result;
   }
   return result_code;
 }
@@ -866,6 +1121,10 @@ int XexModule::ReadPEHeaders() {
 
 bool XexModule::Load(const std::string_view name, const std::string_view path,
                      const void* xex_addr, size_t xex_length) {
+  startup_timeline::ScopedPhase startup_phase("XexModule::Load");
+  if (startup_phase.active()) {
+    startup_phase.set_detail(std::string(path));
+  }
   auto src_header = reinterpret_cast<const xex2_header*>(xex_addr);
 
   if (src_header->magic == 'XEX1') {
@@ -926,6 +1185,38 @@ bool XexModule::Load(const std::string_view name, const std::string_view path,
 
   uint8_t* data = memory()->TranslateVirtual(base_address_);
 
+  if (!image_cache_dir_.empty()) {
+    file_hash_ = XXH64(xex_addr, xex_length, 0);
+  }
+
+  // Patches only keep their data for ApplyPatch(), they have no image.
+  auto cached_image =
+      is_patch() ? nullptr : OpenCachedImage(0, /* image_size */ 0);
+  if (cached_image) {
+    auto cached_header =
+        reinterpret_cast<const ImageCacheHeader*>(cached_image->data());
+    if (!memory()
+             ->LookupHeap(base_address_)
+             ->AllocFixed(
+                 base_address_, cached_header->image_size, 4096,
+                 xe::kMemoryAllocationReserve | xe::kMemoryAllocationCommit,
+                 xe::kMemoryProtectRead | xe::kMemoryProtectWrite)) {
+      XELOGE("Unable to allocate XEX memory at {:08X}-{:08X}.", base_address_,
+             cached_header->image_size);
+      return false;
+    }
+    std::memcpy(data, cached_image->data() + sizeof(ImageCacheHeader),
+                cached_header->image_size);
+    is_dev_kit_ = (cached_header->flags & ImageCacheHeader::kFlagDevKit) != 0;
+    // Still needed to verify patches.
+    aes_decrypt_buffer(
+        is_dev_kit_ ? xe_xex2_devkit_key : xe_xex2_retail_key,
+        reinterpret_cast<const uint8_t*>(xex_security_info()->aes_key), 16,
+        session_key_, 16);
+    XELOGI("Loaded the XEX image from the cache");
+    return true;
+  }
+
   // Load in the XEX basefile
   // We'll try using both XEX2 keys to see if any give a valid PE
   int result_code = ReadImage(xex_addr, xex_length, false);
@@ -941,6 +1232,14 @@ bool XexModule::Load(const std::string_view name, const std::string_view path,
     }
   }
 
+  if (!is_patch()) {
+    uint32_t allocated_size;
+    if (memory()->LookupHeap(base_address_)->QuerySize(base_address_,
+                                                       &allocated_size)) {
+      StoreCachedImage(0, allocated_size);
+    }
+  }
+
   // Note: caller will have to call LoadContinue once it's determined whether a
   // patch file exists or not!
   return true;
@@ -953,6 +1252,10 @@ bool XexModule::LoadContinue() {
   if (finished_load_) {
     return true;
   }
+  startup_timeline::ScopedPhase startup_phase("XexModule::LoadContinue");
+  if (startup_phase.active()) {
+    startup_phase.set_detail(path_);
+  }
 
   finished_load_ = true;
 
@@ -1045,6 +1348,10 @@ bool XexModule::LoadContinue() {
     }
   }
 
+  if (cvars::analyze_functions_on_load) {
+    AnalyzeFunctions();
+  }
+
   // Setup memory protection.
   for (uint32_t i = 0, page = 0; i < sec_header->page_descriptor_count; i++) {
     // Byteswap the bitfield manually.
@@ -1089,9 +1396,11 @@ bool XexModule::Unload() {
 
 bool XexModule::SetupLibraryImports(const std::string_view name,
                                     const xex2_import_library* library) {
-  ExportResolver* kernel_resolver = nullptr;
-  if (kernel_state_->IsKernelModule(name)) {
-    kernel_resolver = processor_->export_resolver();
+  // Find the exports of the library once rather than for every import.
+  bool is_kernel_library = kernel_state_->IsKernelModule(name);
+  const ExportResolver::Table* kernel_table = nullptr;
+  if (is_kernel_library) {
+    kernel_table = processor_->export_resolver()->GetTable(name);
   }
 
   auto user_module = kernel_state_->GetModule(name);
@@ -1120,8 +1429,10 @@ bool XexModule::SetupLibraryImports(const std::string_view name,
     Export* kernel_export = nullptr;
     uint32_t user_export_addr = 0;
 
-    if (kernel_resolver) {
-      kernel_export = kernel_resolver->GetExportByOrdinal(name, ordinal);
+    if (is_kernel_library) {
+      if (kernel_table) {
+        kernel_export = kernel_table->GetExportByOrdinal(ordinal);
+      }
     } else if (user_module) {
       user_export_addr = user_module->GetProcAddressByOrdinal(ordinal);
     }
@@ -1275,6 +1586,104 @@ std::unique_ptr<Function> XexModule::CreateFunction(uint32_t address) {
       processor_->backend()->CreateGuestFunction(this, address));
 }
 
+void XexModule::AnalyzeFunctions() {
+  // Most functions have exact extents in the exception data. The length is in
+  // instructions.
+  std::vector<std::pair<uint32_t, uint32_t>> extents;
+  auto pdata = GetPESection(".pdata");
+  if (pdata) {
+    auto entries =
+        memory()->TranslateVirtual<const xe::be<uint32_t>*>(pdata->address);
+    for (uint32_t i = 0; i + 1 < pdata->size / 4; i += 2) {
+      uint32_t start_address = entries[i];
+      uint32_t length = (uint32_t(entries[i + 1]) >> 8) & 0x3FFFFF;
+      if (start_address >= low_address_ && start_address < high_address_ &&
+          length) {
+        extents.emplace_back(start_address, start_address + (length - 1) * 4);
+      }
+    }
+  }
+
+  // Functions without exception data are found by being called. The code is
+  // split into chunks that threads take in turn, each collecting the call
+  // targets on its own.
+  constexpr uint32_t kChunkSize = 256 * 1024;
+  uint32_t chunk_count =
+      xe::round_up(high_address_ - low_address_, kChunkSize) / kChunkSize;
+  uint32_t thread_count =
+      std::min(std::max(xe::threading::logical_processor_count(), uint32_t(1)),
+               chunk_count);
+  std::atomic<uint32_t> next_chunk = {0};
+  std::vector<std::vector<uint32_t>> thread_call_targets(thread_count);
+  auto scan_chunks = [&](std::vector<uint32_t>& call_targets) {
+    uint32_t chunk;
+    while ((chunk = next_chunk++) < chunk_count) {
+      uint32_t start_address = low_address_ + chunk * kChunkSize;
+      uint32_t end_address =
+          std::min(start_address + kChunkSize, high_address_);
+      for (uint32_t address = start_address; address < end_address;
+           address += 4) {
+        ppc::PPCDecodeData d;
+        d.address = address;
+        d.code = xe::load_and_swap<uint32_t>(
+            memory()->TranslateVirtual(address));
+        if (ppc::LookupOpcode(d.code) != ppc::PPCOpcode::bx || !d.I.LK()) {
+          continue;
+        }
+        uint32_t target = d.I.ADDR();
+        if (target >= low_address_ && target < high_address_) {
+          call_targets.push_back(target);
+        }
+      }
+    }
+  };
+  std::vector<std::unique_ptr<xe::threading::Thread>> threads;
+  for (uint32_t i = 1; i < thread_count; ++i) {
+    auto& call_targets = thread_call_targets[i];
+    threads.push_back(xe::threading::Thread::Create(
+        {}, [&scan_chunks, &call_targets]() { scan_chunks(call_targets); }));
+  }
+  if (thread_count) {
+    scan_chunks(thread_call_targets[0]);
+  }
+  for (auto& thread : threads) {
+    xe::threading::Wait(thread.get(), false);
+  }
+
+  std::vector<uint32_t> addresses;
+  for (const auto& extent : extents) {
+    addresses.push_back(extent.first);
+  }
+  for (const auto& call_targets : thread_call_targets) {
+    addresses.insert(addresses.end(), call_targets.begin(),
+                     call_targets.end());
+  }
+  std::sort(addresses.begin(), addresses.end());
+  addresses.erase(std::unique(addresses.begin(), addresses.end()),
+                  addresses.end());
+  std::sort(extents.begin(), extents.end());
+
+  // Functions already declared (imports, __savegprlr_* and the like, the
+  // module map) are left alone.
+  size_t declared_count = 0;
+  for (uint32_t address : addresses) {
+    Function* function;
+    if (DeclareFunction(address, &function) != Symbol::Status::kNew) {
+      continue;
+    }
+    auto extent = std::lower_bound(
+        extents.begin(), extents.end(), std::make_pair(address, uint32_t(0)));
+    if (extent != extents.end() && extent->first == address) {
+      function->set_end_address(extent->second);
+    }
+    function->set_status(Symbol::Status::kDeclared);
+    processor_->QueueSpeculativeCompile(address);
+    ++declared_count;
+  }
+  XELOGI("Found {} functions in {} ({} from exception data)", declared_count,
+         name(), extents.size());
+}
+
 bool XexModule::FindSaveRest() {
   // Special stack save/restore functions.
   // http://research.microsoft.com/en-us/um/redmond/projects/invisible/src/crt/md/ppc/xxx.s.htm
@@ -1441,42 +1850,57 @@ bool XexModule::FindSaveRest() {
   // TODO(benvanik): these are almost always sequential, if present.
   //     It'd be smarter to search around the other ones to prevent
   //     3 full module scans.
-  uint32_t gplr_start = 0;
-  uint32_t fpr_start = 0;
-  uint32_t vmx_start = 0;
-
+  // The scans only read the code, which isn't modified anymore at this point,
+  // so they're done in parallel.
   auto page_size = base_address_ <= 0x90000000 ? 64 * 1024 : 4 * 1024;
   auto sec_header = xex_security_info();
-  for (uint32_t i = 0, page = 0; i < sec_header->page_descriptor_count; i++) {
-    // Byteswap the bitfield manually.
-    xex2_page_descriptor desc;
-    desc.value = xe::byte_swap(sec_header->page_descriptors[i].value);
-
-    const auto start_address = base_address_ + (page * page_size);
-    const auto end_address = start_address + (desc.page_count * page_size);
-
-    if (desc.info == XEX_SECTION_CODE) {
-      if (!gplr_start) {
-        gplr_start = memory_->SearchAligned(start_address, end_address,
-                                            gprlr_code_values,
-                                            xe::countof(gprlr_code_values));
-      }
-      if (!fpr_start) {
-        fpr_start =
-            memory_->SearchAligned(start_address, end_address, fpr_code_values,
-                                   xe::countof(fpr_code_values));
-      }
-      if (!vmx_start) {
-        vmx_start =
-            memory_->SearchAligned(start_address, end_address, vmx_code_values,
-                                   xe::countof(vmx_code_values));
-      }
-      if (gplr_start && fpr_start && vmx_start) {
-        break;
+  auto search_code = [this, page_size, sec_header](const uint32_t* values,
+                                                   size_t value_count) {
+    for (uint32_t i = 0, page = 0; i < sec_header->page_descriptor_count;
+         i++) {
+      // Byteswap the bitfield manually.
+      xex2_page_descriptor desc;
+      desc.value = xe::byte_swap(sec_header->page_descriptors[i].value);
+
+      const auto start_address = base_address_ + (page * page_size);
+      const auto end_address = start_address + (desc.page_count * page_size);
+
+      if (desc.info == XEX_SECTION_CODE) {
+        uint32_t found_address = memory_->SearchAligned(
+            start_address, end_address, values, value_count);
+        if (found_address) {
+          return found_address;
+        }
       }
+
+      page += desc.page_count;
     }
+    return uint32_t(0);
+  };
 
-    page += desc.page_count;
+  uint32_t gplr_start = 0;
+  uint32_t fpr_start = 0;
+  uint32_t vmx_start = 0;
+
+  xe::threading::Thread::CreationParameters search_thread_params;
+  auto fpr_thread = xe::threading::Thread::Create(
+      search_thread_params, [&search_code, &fpr_start]() {
+        fpr_start = search_code(fpr_code_values, xe::countof(fpr_code_values));
+      });
+  auto vmx_thread = xe::threading::Thread::Create(
+      search_thread_params, [&search_code, &vmx_start]() {
+        vmx_start = search_code(vmx_code_values, xe::countof(vmx_code_values));
+      });
+  gplr_start = search_code(gprlr_code_values, xe::countof(gprlr_code_values));
+  if (fpr_thread) {
+    xe::threading::Wait(fpr_thread.get(), false);
+  } else {
+    fpr_start = search_code(fpr_code_values, xe::countof(fpr_code_values));
+  }
+  if (vmx_thread) {
+    xe::threading::Wait(vmx_thread.get(), false);
+  } else {
+    vmx_start = search_code(vmx_code_values, xe::countof(vmx_code_values));
   }
 
   // Add function stubs.
@@ -10,9 +10,12 @@
 #ifndef XENIA_CPU_XEX_MODULE_H_
 #define XENIA_CPU_XEX_MODULE_H_
 
+#include <filesystem>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "xenia/base/mapped_memory.h"
 #include "xenia/cpu/module.h"
 #include "xenia/kernel/util/xex2_info.h"
 
@@ -134,6 +137,14 @@ class XexModule : public xe::cpu::Module {
   uint32_t GetProcAddress(uint16_t ordinal) const;
   uint32_t GetProcAddress(const std::string_view name) const;
 
+  // Directory where the loaded images are cached, keyed by the hashes of the
+  // XEX file and of the patch applied to it, so that loading the same files
+  // again skips decryption, decompression and patching. Must be set before
+  // Load(), empty to disable the cache.
+  void set_image_cache_dir(const std::filesystem::path& image_cache_dir) {
+    image_cache_dir_ = image_cache_dir;
+  }
+
   int ApplyPatch(XexModule* module);
   bool Load(const std::string_view name, const std::string_view path,
             const void* xex_addr, size_t xex_length);
@@ -175,11 +186,23 @@ class XexModule : public xe::cpu::Module {
   int ReadImageBasicCompressed(const void* xex_addr, size_t xex_length);
   int ReadImageCompressed(const void* xex_addr, size_t xex_length);
 
+  // The file of the image with the patch of the given hash applied, or of the
+  // unpatched image if patch_hash is 0.
+  std::filesystem::path GetImageCachePath(uint64_t patch_hash) const;
+  // Maps the cached image, returning nullptr if it's not cached or if the size
+  // doesn't match image_size (unless it's 0).
+  std::unique_ptr<MappedMemory> OpenCachedImage(uint64_t patch_hash,
+                                                uint32_t image_size) const;
+  void StoreCachedImage(uint64_t patch_hash, uint32_t image_size) const;
+
   int ReadPEHeaders();
 
   bool SetupLibraryImports(const std::string_view name,
                            const xex2_import_library* library);
   bool FindSaveRest();
+  // Declares the functions found in the exception data and the targets of
+  // direct calls in the code, with --analyze_functions_on_load.
+  void AnalyzeFunctions();
 
   Processor* processor_ = nullptr;
   kernel::KernelState* kernel_state_ = nullptr;
@@ -192,6 +215,10 @@ class XexModule : public xe::cpu::Module {
       import_libs_;  // pre-loaded import libraries for ease of use
   std::vector<PESection> pe_sections_;
 
+  std::filesystem::path image_cache_dir_;
+  // Hash of the whole XEX file.
+  uint64_t file_hash_ = 0;
+
   uint8_t session_key_[0x10];
   bool is_dev_kit_ = false;
 
@@ -277,22 +277,14 @@ void DebugWindow::DrawToolbar() {
   // global operations.
   // TODO(benvanik): use a popup + custom rendering to get richer view.
   int current_thread_index = 0;
-  StringBuffer thread_combo;
-  int i = 0;
-  for (auto thread_info : cache_.thread_debug_infos) {
-    if (thread_info == state_.thread_info) {
-      current_thread_index = i;
-    }
-    if (thread_info->state != cpu::ThreadDebugInfo::State::kZombie) {
-      thread_combo.Append(thread_info->thread->thread_name());
-    } else {
-      thread_combo.Append("(zombie)");
+  for (size_t i = 0; i < cache_.thread_debug_infos.size(); ++i) {
+    if (cache_.thread_debug_infos[i] == state_.thread_info) {
+      current_thread_index = int(i);
+      break;
     }
-    thread_combo.Append('\0');
-    ++i;
   }
   if (ImGui::Combo("##thread_combo", &current_thread_index,
-                   thread_combo.buffer(), 10)) {
+                   cache_.thread_combo.c_str(), 10)) {
     // Thread changed.
     SelectThreadStackFrame(cache_.thread_debug_infos[current_thread_index], 0,
                            true);
@@ -300,11 +292,28 @@ void DebugWindow::DrawToolbar() {
 }
 
 void DebugWindow::DrawFunctionsPane() {
-  ImGui::Text("<functions>");
   // bar: analyze (?), goto current
   // combo with module (+ emulator itself?)
-  // list with all functions known
   // filter box + search button -> search dialog
+  ImGui::BeginChild("##functions_listing");
+  // There may be tens of thousands of functions, only submit the visible ones.
+  ImGuiListClipper clipper;
+  clipper.Begin(int(cache_.functions.size()),
+                ImGui::GetTextLineHeightWithSpacing());
+  while (clipper.Step()) {
+    for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i) {
+      auto function = cache_.functions[i];
+      ImGui::PushID(function);
+      char label[256];
+      std::snprintf(label, xe::countof(label), "%.8X %s", function->address(),
+                    function->name().c_str());
+      if (ImGui::Selectable(label, function == state_.function)) {
+        NavigateToFunction(function);
+      }
+      ImGui::PopID();
+    }
+  }
+  ImGui::EndChild();
 }
 
 void DebugWindow::DrawSourcePane() {
@@ -445,8 +454,107 @@ void DebugWindow::DrawGuestFunctionSource() {
   //     click code address to jump to code
   //     click memory address to jump to memory browser
   //     if historical data for memory/etc present, show combo boxes
-  auto memory = emulator_->memory();
+  UpdateSourceCache();
+  const auto& lines = source_cache_.lines;
+
+  uint32_t guest_pc = 0;
+  uint64_t host_pc = 0;
+  if (state_.thread_info) {
+    auto& frame = state_.thread_info->frames[state_.thread_stack_frame_index];
+    guest_pc = frame.guest_pc;
+    host_pc = frame.host_pc;
+  }
+  auto is_current_line = [&](const SourceLine& line) {
+    if (!state_.thread_info) {
+      return false;
+    }
+    return line.address_type == Breakpoint::AddressType::kGuest
+               ? line.address == guest_pc
+               : line.address == host_pc;
+  };
+
+  // Every line is a gutter button followed by text, and item spacing is
+  // disabled for the whole window, so all lines are the same height and only
+  // the visible ones need to be submitted.
+  float line_height = ImGui::GetFrameHeightWithSpacing();
+
+  if (state_.has_changed_pc) {
+    // Center the current instruction, preferring the x64 line if shown.
+    // TODO(benvanik): not so annoying scroll.
+    size_t scroll_line = lines.size();
+    for (size_t i = 0; i < lines.size(); ++i) {
+      if (!is_current_line(lines[i])) {
+        continue;
+      }
+      if (lines[i].address_type == Breakpoint::AddressType::kHost) {
+        scroll_line = i;
+        break;
+      }
+      if (scroll_line == lines.size()) {
+        scroll_line = i;
+      }
+    }
+    if (scroll_line < lines.size()) {
+      ImGui::SetScrollY(std::max(scroll_line * line_height -
+                                     ImGui::GetWindowHeight() * 0.5f,
+                                 0.0f));
+      state_.has_changed_pc = false;
+    }
+  }
+
+  ImGuiListClipper clipper;
+  clipper.Begin(int(lines.size()), line_height);
+  while (clipper.Step()) {
+    for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i) {
+      const SourceLine& line = lines[i];
+      ImGui::PushID(i);
+
+      bool is_host = line.address_type == Breakpoint::AddressType::kHost;
+      if (is_host) {
+        ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 1.0f, 1.0f, 0.5f));
+      }
+      // TODO(benvanik): check other threads?
+      bool is_current_instr = is_current_line(line);
+      if (is_current_instr) {
+        ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.0f, 1.0f, 0.0f, 1.0f));
+      }
+
+      bool has_bp =
+          LookupBreakpointAtAddress(line.address_type, line.address) != nullptr;
+      DrawBreakpointGutterButton(has_bp, line.address_type, line.address);
+      ImGui::SameLine();
+
+      ImGui::Text(is_host ? "    %c " : " %c ", is_current_instr ? '>' : ' ');
+      ImGui::SameLine();
+      ImGui::TextUnformatted(line.text.c_str(),
+                             line.text.c_str() + line.text.size());
+
+      if (is_current_instr) {
+        ImGui::PopStyleColor();
+      }
+      if (is_host) {
+        ImGui::PopStyleColor();
+      }
+
+      ImGui::PopID();
+    }
+  }
+}
+
+void DebugWindow::UpdateSourceCache() {
   auto function = static_cast<cpu::GuestFunction*>(state_.function);
+  if (source_cache_.function == function &&
+      source_cache_.machine_code == function->machine_code() &&
+      source_cache_.display_mode == state_.source_display_mode) {
+    return;
+  }
+  source_cache_.function = function;
+  source_cache_.machine_code = function->machine_code();
+  source_cache_.display_mode = state_.source_display_mode;
+  auto& lines = source_cache_.lines;
+  lines.clear();
+
+  auto memory = emulator_->memory();
   auto& source_map = function->source_map();
   uint32_t source_map_index = 0;
 
@@ -466,11 +574,10 @@ void DebugWindow::DrawGuestFunctionSource() {
       draw_x64 = true;
       break;
   }
-
-  auto guest_pc =
-      state_.thread_info
-          ? state_.thread_info->frames[state_.thread_stack_frame_index].guest_pc
-          : 0;
+  if (source_map.empty()) {
+    // Not compiled yet, nothing to interleave with.
+    draw_x64 = false;
+  }
 
   if (draw_hir) {
     // TODO(benvanik): get HIR and draw preamble.
@@ -480,43 +587,21 @@ void DebugWindow::DrawGuestFunctionSource() {
   }
   if (draw_x64) {
     // x64 preamble.
-    DrawMachineCodeSource(function->machine_code(), source_map[0].code_offset);
+    AppendMachineCodeSource(function->machine_code(),
+                            source_map[0].code_offset);
   }
 
   StringBuffer str;
   for (uint32_t address = function->address();
        address <= function->end_address(); address += 4) {
-    ImGui::PushID(address);
-
-    // TODO(benvanik): check other threads?
-    bool is_current_instr = address == guest_pc;
-    if (is_current_instr) {
-      ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.0f, 1.0f, 0.0f, 1.0f));
-      if (!draw_x64) {
-        ScrollToSourceIfPcChanged();
-      }
-    }
-
-    bool has_guest_bp =
-        LookupBreakpointAtAddress(Breakpoint::AddressType::kGuest, address) !=
-        nullptr;
-    DrawBreakpointGutterButton(has_guest_bp, Breakpoint::AddressType::kGuest,
-                               address);
-    ImGui::SameLine();
-
-    ImGui::Text(" %c ", is_current_instr ? '>' : ' ');
-    ImGui::SameLine();
-
     uint32_t code =
         xe::load_and_swap<uint32_t>(memory->TranslateVirtual(address));
     cpu::ppc::DisasmPPC(address, code, &str);
-    ImGui::Text("%.8X %.8X   %s", address, code, str.buffer());
+    lines.push_back({Breakpoint::AddressType::kGuest, address,
+                     fmt::format("{:08X} {:08X}   {}", address, code,
+                                 str.to_string_view())});
     str.Reset();
 
-    if (is_current_instr) {
-      ImGui::PopStyleColor();
-    }
-
     while (source_map_index < source_map.size() &&
            source_map[source_map_index].guest_address != address) {
       ++source_map_index;
@@ -536,55 +621,25 @@ void DebugWindow::DrawGuestFunctionSource() {
                  ? function->machine_code_length()
                  : source_map[source_map_index + 1].code_offset) -
             source_map[source_map_index].code_offset;
-        DrawMachineCodeSource(machine_code_start, machine_code_length);
+        AppendMachineCodeSource(machine_code_start, machine_code_length);
       }
     }
-
-    ImGui::PopID();
   }
 }
 
-void DebugWindow::DrawMachineCodeSource(const uint8_t* machine_code_ptr,
-                                        size_t length) {
-  auto host_pc =
-      state_.thread_info
-          ? state_.thread_info->frames[state_.thread_stack_frame_index].host_pc
-          : 0;
-
-  ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 1.0f, 1.0f, 0.5f));
-  auto machine_code_start_ptr = machine_code_ptr;
+void DebugWindow::AppendMachineCodeSource(const uint8_t* machine_code_ptr,
+                                          size_t length) {
   size_t remaining_machine_code_size = length;
   uint64_t host_address = uint64_t(machine_code_ptr);
   cs_insn insn = {0};
   while (remaining_machine_code_size &&
          cs_disasm_iter(capstone_handle_, &machine_code_ptr,
                         &remaining_machine_code_size, &host_address, &insn)) {
-    ImGui::PushID(reinterpret_cast<void*>(insn.address));
-
-    bool is_current_instr = state_.thread_info && insn.address == host_pc;
-    if (is_current_instr) {
-      ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.0f, 1.0f, 0.0f, 1.0f));
-      ScrollToSourceIfPcChanged();
-    }
-
-    bool has_host_bp = LookupBreakpointAtAddress(Breakpoint::AddressType::kHost,
-                                                 insn.address) != nullptr;
-    DrawBreakpointGutterButton(has_host_bp, Breakpoint::AddressType::kHost,
-                               insn.address);
-    ImGui::SameLine();
-
-    ImGui::Text("    %c ", is_current_instr ? '>' : ' ');
-    ImGui::SameLine();
-    ImGui::Text(" %.8X        %-10s %s", uint32_t(insn.address), insn.mnemonic,
-                insn.op_str);
-
-    if (is_current_instr) {
-      ImGui::PopStyleColor();
-    }
-
-    ImGui::PopID();
+    source_cache_.lines.push_back(
+        {Breakpoint::AddressType::kHost, insn.address,
+         fmt::format(" {:08X}        {:<10} {}", uint32_t(insn.address),
+                     insn.mnemonic, insn.op_str)});
   }
-  ImGui::PopStyleColor();
 }
 
 void DebugWindow::DrawBreakpointGutterButton(
@@ -618,14 +673,6 @@ void DebugWindow::DrawBreakpointGutterButton(
   }
 }
 
-void DebugWindow::ScrollToSourceIfPcChanged() {
-  if (state_.has_changed_pc) {
-    // TODO(benvanik): not so annoying scroll.
-    ImGui::SetScrollHereY(0.5f);
-    state_.has_changed_pc = false;
-  }
-}
-
 bool DebugWindow::DrawRegisterTextBox(int id, uint32_t* value) {
   char buffer[256] = {0};
   ImGuiInputTextFlags input_flags =
@@ -997,9 +1044,8 @@ void DebugWindow::DrawThreadsPane() {
   for (size_t i = 0; i < cache_.thread_debug_infos.size(); ++i) {
     auto thread_info = cache_.thread_debug_infos[i];
     bool is_current_thread = thread_info == state_.thread_info;
-    auto thread =
-        emulator_->kernel_state()->GetThreadByID(thread_info->thread_id);
-    if (!thread) {
+    const std::string& thread_label = cache_.thread_labels[i];
+    if (thread_label.empty()) {
       // TODO(benvanik): better display of zombie thread states.
       continue;
     }
@@ -1017,26 +1063,8 @@ void DebugWindow::DrawThreadsPane() {
     if (is_current_thread) {
       ImGui::SetNextItemOpen(true, ImGuiCond_Always);
     }
-    const char* state_label = "?";
-    if (thread->can_debugger_suspend()) {
-      if (thread->is_running()) {
-        if (thread->suspend_count() > 1) {
-          state_label = "SUSPEND";
-        } else {
-          state_label = "RUNNING";
-        }
-      } else {
-        state_label = "ZOMBIE";
-      }
-    }
-    char thread_label[256];
-    std::snprintf(thread_label, xe::countof(thread_label),
-                  "%-5s %-7s id=%.4X hnd=%.4X   %s",
-                  thread->is_guest_thread() ? "guest" : "host", state_label,
-                  thread->thread_id(), thread->handle(),
-                  thread->name().c_str());
     if (ImGui::CollapsingHeader(
-            thread_label,
+            thread_label.c_str(),
             is_current_thread ? ImGuiTreeNodeFlags_DefaultOpen : 0)) {
       //   |     (log button) detail of kernel call categories
       // log button toggles only logging that thread
@@ -1456,7 +1484,67 @@ void DebugWindow::UpdateCache() {
   cache_.modules =
       object_table->GetObjectsByType<XModule>(XObject::Type::kTypeModule);
 
-  cache_.thread_debug_infos = processor_->QueryThreadDebugInfos();
+  // Only rebuild the thread data if any thread has changed since the last
+  // update, looking up the thread objects is expensive with many threads.
+  uint64_t thread_debug_infos_version =
+      processor_->thread_debug_infos_version();
+  if (thread_debug_infos_version != cache_.thread_debug_infos_version) {
+    cache_.thread_debug_infos_version = thread_debug_infos_version;
+    cache_.thread_debug_infos = processor_->QueryThreadDebugInfos();
+    cache_.thread_labels.clear();
+    cache_.thread_labels.reserve(cache_.thread_debug_infos.size());
+    cache_.thread_combo.clear();
+    for (auto thread_info : cache_.thread_debug_infos) {
+      if (thread_info->state != cpu::ThreadDebugInfo::State::kZombie) {
+        cache_.thread_combo.append(thread_info->thread->thread_name());
+      } else {
+        cache_.thread_combo.append("(zombie)");
+      }
+      cache_.thread_combo.push_back('\0');
+
+      auto thread = kernel_state->GetThreadByID(thread_info->thread_id);
+      if (!thread) {
+        cache_.thread_labels.emplace_back();
+        continue;
+      }
+      const char* state_label = "?";
+      if (thread->can_debugger_suspend()) {
+        if (thread->is_running()) {
+          if (thread->suspend_count() > 1) {
+            state_label = "SUSPEND";
+          } else {
+            state_label = "RUNNING";
+          }
+        } else {
+          state_label = "ZOMBIE";
+        }
+      }
+      cache_.thread_labels.push_back(fmt::format(
+          "{:<5} {:<7} id={:04X} hnd={:04X}   {}",
+          thread->is_guest_thread() ? "guest" : "host", state_label,
+          thread->thread_id(), thread->handle(), thread->name()));
+    }
+  }
+
+  // Rebuild the function listing only if new functions have been declared.
+  auto cpu_modules = processor_->GetModules();
+  size_t function_symbol_count = 0;
+  for (auto cpu_module : cpu_modules) {
+    function_symbol_count += cpu_module->QuerySymbolCount();
+  }
+  if (function_symbol_count != cache_.function_symbol_count) {
+    cache_.function_symbol_count = function_symbol_count;
+    cache_.functions.clear();
+    for (auto cpu_module : cpu_modules) {
+      cpu_module->ForEachFunction([this](cpu::Function* function) {
+        cache_.functions.push_back(function);
+      });
+    }
+    std::sort(cache_.functions.begin(), cache_.functions.end(),
+              [](const cpu::Function* a, const cpu::Function* b) {
+                return a->address() < b->address();
+              });
+  }
 
   SelectThreadStackFrame(state_.thread_info, state_.thread_stack_frame_index,
                          false);
@@ -11,6 +11,7 @@
 #define XENIA_DEBUG_UI_DEBUG_WINDOW_H_
 
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "xenia/base/x64_context.h"
@@ -56,11 +57,11 @@ class DebugWindow : public cpu::DebugListener {
   void DrawFunctionsPane();
   void DrawSourcePane();
   void DrawGuestFunctionSource();
-  void DrawMachineCodeSource(const uint8_t* ptr, size_t length);
+  void UpdateSourceCache();
+  void AppendMachineCodeSource(const uint8_t* ptr, size_t length);
   void DrawBreakpointGutterButton(bool has_breakpoint,
                                   cpu::Breakpoint::AddressType address_type,
                                   uint64_t address);
-  void ScrollToSourceIfPcChanged();
   void DrawRegistersPane();
   bool DrawRegisterTextBox(int id, uint32_t* value);
   bool DrawRegisterTextBox(int id, uint64_t* value);
@@ -101,8 +102,34 @@ class DebugWindow : public cpu::DebugListener {
     bool is_running = false;
     std::vector<kernel::object_ref<kernel::XModule>> modules;
     std::vector<cpu::ThreadDebugInfo*> thread_debug_infos;
+    // Processor::thread_debug_infos_version() the thread data below was built
+    // for, rebuilt only when the processor reports a change.
+    uint64_t thread_debug_infos_version = ~uint64_t(0);
+    // Parallel to thread_debug_infos, empty if the thread object is gone.
+    std::vector<std::string> thread_labels;
+    // Null-separated thread names for the toolbar combo.
+    std::string thread_combo;
+    // All functions of all modules sorted by address, rebuilt when any module
+    // declares new symbols.
+    size_t function_symbol_count = 0;
+    std::vector<cpu::Function*> functions;
   } cache_;
 
+  // Disassembly of the function in the source pane, rebuilt only when the
+  // function, its machine code or the display mode changes, so that large
+  // functions aren't disassembled again on every frame.
+  struct SourceLine {
+    cpu::Breakpoint::AddressType address_type;
+    uint64_t address;
+    std::string text;
+  };
+  struct {
+    cpu::Function* function = nullptr;
+    const uint8_t* machine_code = nullptr;
+    int display_mode = -1;
+    std::vector<SourceLine> lines;
+  } source_cache_;
+
   enum class RegisterGroup {
     kGuestGeneral,
     kGuestFloat,
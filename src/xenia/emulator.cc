@@ -24,7 +24,9 @@
 #include "xenia/base/logging.h"
 #include "xenia/base/mapped_memory.h"
 #include "xenia/base/profiling.h"
+#include "xenia/base/startup_timeline.h"
 #include "xenia/base/string.h"
+#include "xenia/cache_pack.h"
 #include "xenia/cpu/backend/code_cache.h"
 #include "xenia/cpu/backend/x64/x64_backend.h"
 #include "xenia/cpu/cpu_flags.h"
@@ -42,6 +44,7 @@
 #include "xenia/memory.h"
 #include "xenia/ui/file_picker.h"
 #include "xenia/ui/imgui_dialog.h"
+#include "xenia/vfs/devices/compressed_disc_image_device.h"
 #include "xenia/vfs/devices/disc_image_device.h"
 #include "xenia/vfs/devices/host_path_device.h"
 #include "xenia/vfs/devices/null_device.h"
@@ -57,6 +60,16 @@ DEFINE_string(
     "or the module specified by the game. Leave blank to launch the default "
     "module.",
     "General");
+DEFINE_path(file_access_trace_path, "",
+            "Directory for traces of the file reads of titles. The first boot "
+            "of a title records its trace, and later boots read the same data "
+            "in the background ahead of the title to speed up loading.",
+            "Storage");
+DEFINE_path(import_cache_pack, "",
+            "Cache pack written by xenia-cache-pack to pre-seed the caches of "
+            "the title with when launching it. Only the caches that don't "
+            "exist yet are extracted from the pack.",
+            "Storage");
 
 namespace xe {
 
@@ -82,9 +95,17 @@ Emulator::Emulator(const std::filesystem::path& command_line,
       title_id_(0),
       paused_(false),
       restoring_(false),
-      restore_fence_() {}
+      restore_fence_(),
+      checkpoint_index_(0),
+      checkpoint_memory_offset_(0) {}
 
 Emulator::~Emulator() {
+  WaitForCheckpoint();
+  WaitForLazyRestore();
+
+  // In case no guest frame has been presented.
+  startup_timeline::Finish();
+
   // Note that we delete things in the reverse order they were initialized.
 
   // Give the systems time to shutdown before we delete them.
@@ -117,6 +138,7 @@ X_STATUS Emulator::Setup(
         graphics_system_factory,
     std::function<std::vector<std::unique_ptr<hid::InputDriver>>(ui::Window*)>
         input_driver_factory) {
+  startup_timeline::ScopedPhase startup_phase("Emulator::Setup");
   X_STATUS result = X_STATUS_UNSUCCESSFUL;
 
   display_window_ = display_window;
@@ -128,6 +150,8 @@ X_STATUS Emulator::Setup(
   Clock::set_guest_system_time_base(Clock::QueryHostSystemTime());
   // This can be adjusted dynamically, as well.
   Clock::set_guest_time_scalar(cvars::time_scalar);
+  // Before the CPU, so code loaded from storage finds the mapping it reads.
+  Clock::InitializeGuestTickMapping();
 
   // Before we can set thread affinity we must enable the process to use all
   // logical processors.
@@ -135,8 +159,11 @@ X_STATUS Emulator::Setup(
 
   // Create memory system first, as it is required for other systems.
   memory_ = std::make_unique<Memory>();
-  if (!memory_->Initialize()) {
-    return false;
+  {
+    startup_timeline::ScopedPhase memory_phase("Memory::Initialize");
+    if (!memory_->Initialize()) {
+      return false;
+    }
   }
 
   // Shared export resolver used to attach and query for HLE exports.
@@ -161,8 +188,11 @@ X_STATUS Emulator::Setup(
   // Initialize the CPU.
   processor_ = std::make_unique<xe::cpu::Processor>(memory_.get(),
                                                     export_resolver_.get());
-  if (!processor_->Setup(std::move(backend))) {
-    return X_STATUS_UNSUCCESSFUL;
+  {
+    startup_timeline::ScopedPhase processor_phase("Processor::Setup");
+    if (!processor_->Setup(std::move(backend))) {
+      return X_STATUS_UNSUCCESSFUL;
+    }
   }
 
   // Initialize the APU.
@@ -203,8 +233,11 @@ X_STATUS Emulator::Setup(
   kernel_state_ = std::make_unique<xe::kernel::KernelState>(this);
 
   // Setup the core components.
-  result = graphics_system_->Setup(processor_.get(), kernel_state_.get(),
-                                   display_window_);
+  {
+    startup_timeline::ScopedPhase graphics_phase("GraphicsSystem::Setup");
+    result = graphics_system_->Setup(processor_.get(), kernel_state_.get(),
+                                     display_window_);
+  }
   if (result) {
     return result;
   }
@@ -216,13 +249,16 @@ X_STATUS Emulator::Setup(
     }
   }
 
+  {
+    startup_timeline::ScopedPhase kernel_phase("Kernel module init");
 #define LOAD_KERNEL_MODULE(t) \
   static_cast<void>(kernel_state_->LoadKernelModule<kernel::t>())
-  // HLE kernel modules.
-  LOAD_KERNEL_MODULE(xboxkrnl::XboxkrnlModule);
-  LOAD_KERNEL_MODULE(xam::XamModule);
-  LOAD_KERNEL_MODULE(xbdm::XbdmModule);
+    // HLE kernel modules.
+    LOAD_KERNEL_MODULE(xboxkrnl::XboxkrnlModule);
+    LOAD_KERNEL_MODULE(xam::XamModule);
+    LOAD_KERNEL_MODULE(xbdm::XbdmModule);
 #undef LOAD_KERNEL_MODULE
+  }
 
   // Initialize emulator fallback exception handling last.
   ExceptionHandler::Install(Emulator::ExceptionCallbackThunk, this);
@@ -290,6 +326,7 @@ X_STATUS Emulator::LaunchXexFile(const std::filesystem::path& path,
   // Register the local directory in the virtual filesystem.
   auto parent_path = path.parent_path();
   for (auto mount_path : mount_paths) {
+    startup_timeline::ScopedPhase mount_phase("VFS mount");
     auto device = std::make_unique<vfs::HostPathDevice>(mount_path, parent_path, true);
     if (!device->Initialize()) {
       XELOGE("Unable to scan host path");
@@ -321,14 +358,24 @@ X_STATUS Emulator::LaunchDiscImage(const std::filesystem::path& path,
     mount_path = "\\Device\\LauncherData";
   }
   // Register the disc image in the virtual filesystem.
-  auto device = std::make_unique<vfs::DiscImageDevice>(mount_path, path);
-  if (!device->Initialize()) {
-    xe::FatalError("Unable to mount disc image; file not found or corrupt.");
-    return X_STATUS_NO_SUCH_FILE;
-  }
-  if (!file_system_->RegisterDevice(std::move(device))) {
-    xe::FatalError("Unable to register disc image.");
-    return X_STATUS_NO_SUCH_FILE;
+  {
+    startup_timeline::ScopedPhase mount_phase("VFS mount");
+    std::unique_ptr<vfs::Device> device;
+    auto extension = xe::utf8::lower_ascii(xe::path_to_utf8(path.extension()));
+    if (extension == ".xcdi") {
+      device =
+          std::make_unique<vfs::CompressedDiscImageDevice>(mount_path, path);
+    } else {
+      device = std::make_unique<vfs::DiscImageDevice>(mount_path, path);
+    }
+    if (!device->Initialize()) {
+      xe::FatalError("Unable to mount disc image; file not found or corrupt.");
+      return X_STATUS_NO_SUCH_FILE;
+    }
+    if (!file_system_->RegisterDevice(std::move(device))) {
+      xe::FatalError("Unable to register disc image.");
+      return X_STATUS_NO_SUCH_FILE;
+    }
   }
 
   file_system_->UnregisterSymbolicLink("d:");
@@ -354,15 +401,18 @@ X_STATUS Emulator::LaunchStfsContainer(const std::filesystem::path& path,
     mount_path = "\\Device\\LauncherData";
   }
   // Register the container in the virtual filesystem.
-  auto device = std::make_unique<vfs::StfsContainerDevice>(mount_path, path);
-  if (!device->Initialize()) {
-    xe::FatalError(
-        "Unable to mount STFS container; file not found or corrupt.");
-    return X_STATUS_NO_SUCH_FILE;
-  }
-  if (!file_system_->RegisterDevice(std::move(device))) {
-    xe::FatalError("Unable to register STFS container.");
-    return X_STATUS_NO_SUCH_FILE;
+  {
+    startup_timeline::ScopedPhase mount_phase("VFS mount");
+    auto device = std::make_unique<vfs::StfsContainerDevice>(mount_path, path);
+    if (!device->Initialize()) {
+      xe::FatalError(
+          "Unable to mount STFS container; file not found or corrupt.");
+      return X_STATUS_NO_SUCH_FILE;
+    }
+    if (!file_system_->RegisterDevice(std::move(device))) {
+      xe::FatalError("Unable to register STFS container.");
+      return X_STATUS_NO_SUCH_FILE;
+    }
   }
 
   file_system_->RegisterSymbolicLink("game:", mount_path);
@@ -434,6 +484,7 @@ void Emulator::Resume() {
 }
 
 bool Emulator::SaveToFile(const std::filesystem::path& path) {
+  WaitForLazyRestore();
   Pause();
 
   filesystem::CreateFile(path);
@@ -462,6 +513,7 @@ bool Emulator::SaveToFile(const std::filesystem::path& path) {
 }
 
 bool Emulator::RestoreFromFile(const std::filesystem::path& path) {
+  WaitForLazyRestore();
   // Restore the emulator state from a file
   auto map = MappedMemory::Open(path, MappedMemory::Mode::kReadWrite);
   if (!map) {
@@ -526,6 +578,347 @@ bool Emulator::RestoreFromFile(const std::filesystem::path& path) {
   return true;
 }
 
+bool Emulator::SaveCheckpointToFile(const std::filesystem::path& path) {
+  // Only one checkpoint can be written at a time, and the memory must be
+  // captured after the previous one.
+  WaitForCheckpoint();
+  WaitForLazyRestore();
+
+  Pause();
+
+  filesystem::CreateFile(path);
+  checkpoint_map_ = MappedMemory::Open(path, MappedMemory::Mode::kReadWrite, 0,
+                                       1024ull * 1024ull * 1024ull * 2ull);
+  if (!checkpoint_map_) {
+    Resume();
+    return false;
+  }
+
+  ByteStream stream(checkpoint_map_->data(), checkpoint_map_->size());
+  stream.Write('XCHK');
+  stream.Write(title_id_);
+  stream.Write(checkpoint_index_);
+  // Offset of the memory, so it can be found in the checkpoints preceding the
+  // restored one without reading the rest of their state.
+  size_t memory_offset_offset = stream.offset();
+  stream.Write(uint64_t(0));
+
+  processor_->Save(&stream);
+  graphics_system_->Save(&stream);
+  audio_system_->Save(&stream);
+  kernel_state_->Save(&stream);
+  checkpoint_memory_offset_ = stream.offset();
+  stream.set_offset(memory_offset_offset);
+  stream.Write(uint64_t(checkpoint_memory_offset_));
+
+  if (!checkpoint_index_) {
+    memory_->ResetCheckpoints();
+  }
+  checkpoint_memory_ = std::make_unique<MemoryCheckpoint>();
+  memory_->CaptureCheckpoint(checkpoint_memory_.get());
+  ++checkpoint_index_;
+
+  Resume();
+
+  checkpoint_thread_ =
+      threading::Thread::Create({}, [this]() { WriteCheckpoint(); });
+  if (!checkpoint_thread_) {
+    WriteCheckpoint();
+  } else {
+    checkpoint_thread_->set_name("Checkpoint Writer");
+  }
+  return true;
+}
+
+void Emulator::WriteCheckpoint() {
+  ByteStream stream(checkpoint_map_->data(), checkpoint_map_->size(),
+                    checkpoint_memory_offset_);
+  checkpoint_memory_->Write(&stream);
+  checkpoint_map_->Close(stream.offset());
+  checkpoint_map_.reset();
+  checkpoint_memory_.reset();
+}
+
+void Emulator::WaitForCheckpoint() {
+  if (!checkpoint_thread_) {
+    return;
+  }
+  threading::Wait(checkpoint_thread_.get(), false);
+  checkpoint_thread_.reset();
+}
+
+bool Emulator::RestoreFromCheckpoints(
+    const std::vector<std::filesystem::path>& paths) {
+  WaitForCheckpoint();
+  WaitForLazyRestore();
+  if (paths.empty()) {
+    return false;
+  }
+
+  std::vector<std::unique_ptr<MappedMemory>> maps;
+  std::vector<size_t> memory_offsets;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    auto map = MappedMemory::Open(paths[i], MappedMemory::Mode::kRead);
+    if (!map) {
+      return false;
+    }
+    ByteStream stream(map->data(), map->size());
+    if (stream.Read<uint32_t>() != 'XCHK' ||
+        stream.Read<uint32_t>() != title_id_ ||
+        stream.Read<uint32_t>() != i) {
+      XELOGE("{} is not checkpoint {} of the running title",
+             xe::path_to_utf8(paths[i]), i);
+      return false;
+    }
+    memory_offsets.push_back(size_t(stream.Read<uint64_t>()));
+    maps.push_back(std::move(map));
+  }
+
+  restoring_ = true;
+
+  // Terminate any loaded titles.
+  Pause();
+  kernel_state_->TerminateTitle();
+
+  auto lock = global_critical_region::AcquireDirect();
+
+  // Everything other than the memory is taken from the last checkpoint.
+  ByteStream stream(maps.back()->data(), maps.back()->size(),
+                    sizeof(uint32_t) * 3 + sizeof(uint64_t));
+  if (!processor_->Restore(&stream)) {
+    XELOGE("Could not restore processor!");
+    return false;
+  }
+  if (!graphics_system_->Restore(&stream)) {
+    XELOGE("Could not restore graphics system!");
+    return false;
+  }
+  if (!audio_system_->Restore(&stream)) {
+    XELOGE("Could not restore audio system!");
+    return false;
+  }
+  if (!kernel_state_->Restore(&stream)) {
+    XELOGE("Could not restore kernel state!");
+    return false;
+  }
+  for (size_t i = 0; i < maps.size(); ++i) {
+    ByteStream memory_stream(maps[i]->data(), maps[i]->size(),
+                             memory_offsets[i]);
+    if (!memory_->RestoreCheckpoint(&memory_stream)) {
+      XELOGE("Could not restore memory from checkpoint {}!", i);
+      return false;
+    }
+  }
+  checkpoint_index_ = uint32_t(maps.size());
+
+  // Update the main thread.
+  auto threads =
+      kernel_state_->object_table()->GetObjectsByType<kernel::XThread>();
+  for (auto thread : threads) {
+    if (thread->main_thread()) {
+      main_thread_ = thread;
+      break;
+    }
+  }
+
+  Resume();
+
+  restore_fence_.Signal();
+  restoring_ = false;
+
+  return true;
+}
+
+namespace {
+
+constexpr uint32_t kStreamingSaveStateVersion = 1;
+
+// Entry of the chunk table following the header of streaming save states.
+struct StreamingSaveStateChunk {
+  uint32_t tag;
+  uint32_t reserved;
+  uint64_t offset;
+  uint64_t size;
+};
+
+enum : uint32_t {
+  // Processor, graphics, audio and kernel state.
+  kStreamingSaveStateChunkState = 'STAT',
+  kStreamingSaveStateChunkMemory = 'MEMO',
+};
+
+// Restores a few lazily restored pages at once, not to hold the global lock
+// for long.
+constexpr uint32_t kLazyRestoreBatchPageCount = 64;
+
+}  // namespace
+
+bool Emulator::SaveStreamingToFile(const std::filesystem::path& path) {
+  WaitForCheckpoint();
+  WaitForLazyRestore();
+  Pause();
+
+  filesystem::CreateFile(path);
+  // Large enough for all committed memory, uncompressed.
+  auto map = MappedMemory::Open(path, MappedMemory::Mode::kReadWrite, 0,
+                                1024ull * 1024ull * 1024ull * 4ull);
+  if (!map) {
+    Resume();
+    return false;
+  }
+
+  ByteStream stream(map->data(), map->size());
+  StreamingSaveStateChunk chunks[2] = {};
+  stream.Write('XSTR');
+  stream.Write(kStreamingSaveStateVersion);
+  stream.Write(title_id_);
+  stream.Write(uint32_t(xe::countof(chunks)));
+  size_t chunk_table_offset = stream.offset();
+  stream.Advance(sizeof(chunks));
+
+  chunks[0].tag = kStreamingSaveStateChunkState;
+  chunks[0].offset = stream.offset();
+  processor_->Save(&stream);
+  graphics_system_->Save(&stream);
+  audio_system_->Save(&stream);
+  kernel_state_->Save(&stream);
+  chunks[0].size = stream.offset() - chunks[0].offset;
+
+  chunks[1].tag = kStreamingSaveStateChunkMemory;
+  chunks[1].offset = stream.offset();
+  bool saved = memory_->SaveStreaming(&stream);
+  chunks[1].size = stream.offset() - chunks[1].offset;
+
+  size_t size = stream.offset();
+  stream.set_offset(chunk_table_offset);
+  stream.Write(chunks, sizeof(chunks));
+  map->Close(size);
+
+  Resume();
+  return saved;
+}
+
+bool Emulator::RestoreStreamingFromFile(const std::filesystem::path& path) {
+  WaitForCheckpoint();
+  WaitForLazyRestore();
+
+  auto map = MappedMemory::Open(path, MappedMemory::Mode::kRead);
+  if (!map) {
+    return false;
+  }
+  ByteStream header_stream(map->data(), map->size());
+  if (map->size() < sizeof(uint32_t) * 4 ||
+      header_stream.Read<uint32_t>() != 'XSTR' ||
+      header_stream.Read<uint32_t>() != kStreamingSaveStateVersion) {
+    XELOGE("{} is not a streaming save state", xe::path_to_utf8(path));
+    return false;
+  }
+  if (header_stream.Read<uint32_t>() != title_id_) {
+    // Swapping between titles is unsupported at the moment.
+    XELOGE("{} is a save state of another title", xe::path_to_utf8(path));
+    return false;
+  }
+  uint32_t chunk_count = header_stream.Read<uint32_t>();
+  if (chunk_count > (map->size() - header_stream.offset()) /
+                        sizeof(StreamingSaveStateChunk)) {
+    return false;
+  }
+  const StreamingSaveStateChunk* state_chunk = nullptr;
+  const StreamingSaveStateChunk* memory_chunk = nullptr;
+  auto chunks = reinterpret_cast<const StreamingSaveStateChunk*>(
+      map->data() + header_stream.offset());
+  for (uint32_t i = 0; i < chunk_count; ++i) {
+    const StreamingSaveStateChunk& chunk = chunks[i];
+    if (chunk.offset > map->size() || chunk.size > map->size() - chunk.offset) {
+      return false;
+    }
+    // Unknown chunks are skipped.
+    if (chunk.tag == kStreamingSaveStateChunkState) {
+      state_chunk = &chunk;
+    } else if (chunk.tag == kStreamingSaveStateChunkMemory) {
+      memory_chunk = &chunk;
+    }
+  }
+  if (!state_chunk || !memory_chunk) {
+    XELOGE("{} is missing required chunks", xe::path_to_utf8(path));
+    return false;
+  }
+  size_t memory_offset = size_t(memory_chunk->offset);
+
+  restoring_ = true;
+
+  // Terminate any loaded titles.
+  Pause();
+  kernel_state_->TerminateTitle();
+
+  auto lock = global_critical_region::AcquireDirect();
+
+  size_t state_offset = size_t(state_chunk->offset);
+  ByteStream stream(map->data(), state_offset + size_t(state_chunk->size),
+                    state_offset);
+  if (!processor_->Restore(&stream)) {
+    XELOGE("Could not restore processor!");
+    return false;
+  }
+  if (!graphics_system_->Restore(&stream)) {
+    XELOGE("Could not restore graphics system!");
+    return false;
+  }
+  if (!audio_system_->Restore(&stream)) {
+    XELOGE("Could not restore audio system!");
+    return false;
+  }
+  if (!kernel_state_->Restore(&stream)) {
+    XELOGE("Could not restore kernel state!");
+    return false;
+  }
+  // The memory takes over the mapped file if it restores lazily.
+  if (!memory_->RestoreStreaming(std::move(map), memory_offset)) {
+    XELOGE("Could not restore memory!");
+    return false;
+  }
+
+  // Update the main thread.
+  auto threads =
+      kernel_state_->object_table()->GetObjectsByType<kernel::XThread>();
+  for (auto thread : threads) {
+    if (thread->main_thread()) {
+      main_thread_ = thread;
+      break;
+    }
+  }
+
+  Resume();
+
+  // Pages are restored on first access, but some may be accessed by the host
+  // in ways that don't fault, such as by system calls, so restore the rest
+  // soon in the background too.
+  lazy_restore_thread_ = threading::Thread::Create({}, [this]() {
+    while (memory_->RestoreLazyPages(kLazyRestoreBatchPageCount)) {
+      threading::MaybeYield();
+    }
+  });
+  if (!lazy_restore_thread_) {
+    while (memory_->RestoreLazyPages(UINT32_MAX)) {
+    }
+  } else {
+    lazy_restore_thread_->set_name("Lazy Restore");
+  }
+
+  restore_fence_.Signal();
+  restoring_ = false;
+
+  return true;
+}
+
+void Emulator::WaitForLazyRestore() {
+  if (!lazy_restore_thread_) {
+    return;
+  }
+  threading::Wait(lazy_restore_thread_.get(), false);
+  lazy_restore_thread_.reset();
+}
+
 bool Emulator::TitleRequested() {
   auto xam = kernel_state()->GetKernelModule<kernel::xam::XamModule>("xam.xex");
   return xam->loader_data().launch_data_present;
@@ -551,8 +944,8 @@ const std::filesystem::path Emulator::GetNewDiscPath(
   file_picker->set_title(!window_message.empty() ? window_message
                                                  : "Select Content Package");
   file_picker->set_extensions({
-      {"Supported Files", "*.iso;*.xex;*.xcp;*.*"},
-      {"Disc Image (*.iso)", "*.iso"},
+      {"Supported Files", "*.iso;*.xcdi;*.xex;*.xcp;*.*"},
+      {"Disc Image (*.iso, *.xcdi)", "*.iso;*.xcdi"},
       {"Xbox Executable (*.xex)", "*.xex"},
       {"All Files (*.*)", "*.*"},
   });
@@ -713,16 +1106,43 @@ X_STATUS Emulator::CompleteLaunch(const std::filesystem::path& path,
     }
   }
 
+  if (!cvars::import_cache_pack.empty()) {
+    // Before any cache is opened, including the file access trace of this
+    // launch.
+    startup_timeline::ScopedPhase import_phase("Import cache pack");
+    cache_pack::CacheRoots cache_roots;
+    cache_roots.storage_root = storage_root_;
+    cache_roots.texture_cache_root =
+        graphics_system_->texture_disk_cache_root();
+    cache_roots.file_access_trace_root = cvars::file_access_trace_path;
+    cache_pack::Import(cvars::import_cache_pack, cache_roots);
+  }
+
+  if (!cvars::file_access_trace_path.empty()) {
+    // Before any file of the title is read.
+    file_system_->StartAccessTrace(
+        cvars::file_access_trace_path /
+        cache_pack::GetFileAccessTraceFileName(path));
+  }
+
   // Reset state.
   title_id_ = 0;
   game_title_ = "";
+  checkpoint_index_ = 0;
   display_window_->SetIcon(nullptr, 0);
 
   // Allow xam to request module loads.
   auto xam = kernel_state()->GetKernelModule<kernel::xam::XamModule>("xam.xex");
 
   XELOGI("Launching module {}", module_path);
-  auto module = kernel_state_->LoadUserModule(module_path);
+  kernel::object_ref<kernel::UserModule> module;
+  {
+    startup_timeline::ScopedPhase load_phase("Load user module");
+    if (load_phase.active()) {
+      load_phase.set_detail(std::string(module_path));
+    }
+    module = kernel_state_->LoadUserModule(module_path);
+  }
   if (!module) {
     XELOGE("Failed to load user module {}", xe::path_to_utf8(path));
     return X_STATUS_NOT_FOUND;
@@ -765,9 +1185,22 @@ X_STATUS Emulator::CompleteLaunch(const std::filesystem::path& path,
   // playing before the video can be seen if doing this in parallel with the
   // main thread.
   on_shader_storage_initialization(true);
-  graphics_system_->InitializeShaderStorage(storage_root_, title_id_, true);
+  {
+    startup_timeline::ScopedPhase shader_storage_phase(
+        "GraphicsSystem::InitializeShaderStorage");
+    graphics_system_->InitializeShaderStorage(storage_root_, title_id_, true);
+  }
   on_shader_storage_initialization(false);
 
+  // Guest code is translated lazily, so this only has to be ready before any
+  // of the title code runs.
+  {
+    startup_timeline::ScopedPhase code_storage_phase(
+        "Backend::InitializeCodeStorage");
+    processor_->backend()->InitializeCodeStorage(storage_root_, title_id_);
+  }
+
+  startup_timeline::RecordInstant("Launch main thread");
   auto main_thread = kernel_state_->LaunchModule(module);
   if (!main_thread) {
     return X_STATUS_UNSUCCESSFUL;
@@ -12,6 +12,7 @@
 
 #include <functional>
 #include <string>
+#include <vector>
 
 #include "xenia/base/delegate.h"
 #include "xenia/base/exception_handler.h"
@@ -21,6 +22,7 @@
 #include "xenia/xbox.h"
 
 namespace xe {
+class MappedMemory;
 namespace apu {
 class AudioSystem;
 }  // namespace apu
@@ -145,6 +147,22 @@ class Emulator {
   bool SaveToFile(const std::filesystem::path& path);
   bool RestoreFromFile(const std::filesystem::path& path);
 
+  // Incremental save states. Checkpoints contain the same state as full save
+  // states, except for only the memory modified since the previous checkpoint
+  // of the title, and the memory is compressed and written after the emulator
+  // has been resumed. A state is restored from all checkpoints up to it from
+  // the first one of the title, in the order they were saved.
+  uint32_t checkpoint_index() const { return checkpoint_index_; }
+  bool SaveCheckpointToFile(const std::filesystem::path& path);
+  bool RestoreFromCheckpoints(const std::vector<std::filesystem::path>& paths);
+
+  // Streaming save states, an indexed container of chunks with the memory
+  // stored uncompressed, so it can be restored lazily from the mapped file:
+  // the title resumes right away, and the memory is restored as it's accessed
+  // and in the background.
+  bool SaveStreamingToFile(const std::filesystem::path& path);
+  bool RestoreStreamingFromFile(const std::filesystem::path& path);
+
   // The game can request another title to be loaded.
   bool TitleRequested();
   void LaunchNextTitle();
@@ -167,6 +185,10 @@ class Emulator {
   X_STATUS CompleteLaunch(const std::filesystem::path& path,
                           const std::string_view module_path);
 
+  void WriteCheckpoint();
+  void WaitForCheckpoint();
+  void WaitForLazyRestore();
+
   std::filesystem::path command_line_;
   std::filesystem::path storage_root_;
   std::filesystem::path content_root_;
@@ -192,6 +214,16 @@ class Emulator {
   bool paused_;
   bool restoring_;
   threading::Fence restore_fence_;  // Fired on restore finish.
+
+  uint32_t checkpoint_index_;
+  // The checkpoint being written by checkpoint_thread_.
+  std::unique_ptr<MappedMemory> checkpoint_map_;
+  size_t checkpoint_memory_offset_;
+  std::unique_ptr<MemoryCheckpoint> checkpoint_memory_;
+  std::unique_ptr<threading::Thread> checkpoint_thread_;
+
+  // Restores the memory of a streaming save state not accessed yet.
+  std::unique_ptr<threading::Thread> lazy_restore_thread_;
 };
 
 }  // namespace xe
@@ -0,0 +1,107 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_BENCHMARK_COUNTERS_H_
+#define XENIA_GPU_BENCHMARK_COUNTERS_H_
+
+#include <atomic>
+#include <cstdint>
+
+#include "xenia/base/clock.h"
+
+namespace xe {
+namespace gpu {
+
+// Counters of the work done by the command processor and the backend, for
+// measuring the performance of trace playback and for the performance HUD,
+// which samples them once per frame. The counts may be incremented from any
+// thread, the CPU time is only collected on the command processor thread while
+// timing_enabled is true.
+struct BenchmarkCounters {
+  bool timing_enabled = false;
+
+  // Host ticks spent in the command processor phases. Draws include resolves,
+  // and packets include everything.
+  uint64_t packet_ticks = 0;
+  uint64_t draw_ticks = 0;
+  uint64_t resolve_ticks = 0;
+  uint64_t swap_ticks = 0;
+  std::atomic<uint64_t> draw_count{0};
+  std::atomic<uint64_t> resolve_count{0};
+  std::atomic<uint64_t> swap_count{0};
+  // Host ticks the command processor thread has spent waiting for commands,
+  // collected regardless of timing_enabled.
+  std::atomic<uint64_t> idle_ticks{0};
+
+  std::atomic<uint64_t> pipeline_creations{0};
+  std::atomic<uint64_t> texture_uploads{0};
+  std::atomic<uint64_t> texture_upload_bytes{0};
+
+  // Pipelines queued for asynchronous creation and not created yet. Not a
+  // count of work done, so not reset.
+  std::atomic<uint32_t> pending_pipeline_creations{0};
+
+  void Reset() {
+    packet_ticks = 0;
+    draw_ticks = 0;
+    resolve_ticks = 0;
+    swap_ticks = 0;
+    draw_count.store(0, std::memory_order_relaxed);
+    resolve_count.store(0, std::memory_order_relaxed);
+    swap_count.store(0, std::memory_order_relaxed);
+    idle_ticks.store(0, std::memory_order_relaxed);
+    pipeline_creations.store(0, std::memory_order_relaxed);
+    texture_uploads.store(0, std::memory_order_relaxed);
+    texture_upload_bytes.store(0, std::memory_order_relaxed);
+  }
+
+  void CountDraw() { draw_count.fetch_add(1, std::memory_order_relaxed); }
+  void CountResolve() {
+    resolve_count.fetch_add(1, std::memory_order_relaxed);
+  }
+  void CountSwap() { swap_count.fetch_add(1, std::memory_order_relaxed); }
+  void CountIdleTicks(uint64_t ticks) {
+    idle_ticks.fetch_add(ticks, std::memory_order_relaxed);
+  }
+  void CountPipelineCreationsQueued(uint32_t count = 1) {
+    pending_pipeline_creations.fetch_add(count, std::memory_order_relaxed);
+  }
+  void CountPipelineCreationsDone(uint32_t count = 1) {
+    pending_pipeline_creations.fetch_sub(count, std::memory_order_relaxed);
+  }
+  void CountPipelineCreation() {
+    pipeline_creations.fetch_add(1, std::memory_order_relaxed);
+  }
+  void CountTextureUpload(uint64_t bytes) {
+    texture_uploads.fetch_add(1, std::memory_order_relaxed);
+    texture_upload_bytes.fetch_add(bytes, std::memory_order_relaxed);
+  }
+};
+
+// Adds the host ticks spent in the scope to the counter if timing is enabled.
+class BenchmarkTimingScope {
+ public:
+  BenchmarkTimingScope(const BenchmarkCounters& counters, uint64_t& ticks)
+      : ticks_(counters.timing_enabled ? &ticks : nullptr),
+        start_(ticks_ ? Clock::QueryHostTickCount() : 0) {}
+  ~BenchmarkTimingScope() {
+    if (ticks_) {
+      *ticks_ += Clock::QueryHostTickCount() - start_;
+    }
+  }
+
+ private:
+  uint64_t* ticks_;
+  uint64_t start_;
+};
+
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_BENCHMARK_COUNTERS_H_
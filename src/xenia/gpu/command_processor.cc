@@ -15,17 +15,24 @@
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/byte_stream.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/input_latency.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
+#include "xenia/base/memory.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/ring_buffer.h"
+#include "xenia/base/startup_timeline.h"
+#include "xenia/base/threading.h"
 #include "xenia/gpu/gpu_flags.h"
 #include "xenia/gpu/graphics_system.h"
 #include "xenia/gpu/sampler_info.h"
 #include "xenia/gpu/texture_info.h"
 #include "xenia/gpu/xenos.h"
+#include "xenia/kernel/kernel_flags.h"
 #include "xenia/kernel/kernel_state.h"
 #include "xenia/kernel/user_module.h"
+#include "xenia/memory_heatmap.h"
 
 namespace xe {
 namespace gpu {
@@ -49,17 +56,12 @@ bool CommandProcessor::Initialize(
     std::unique_ptr<xe::ui::GraphicsContext> context) {
   context_ = std::move(context);
 
-  // Initialize the gamma ramps to their default (linear) values - taken from
-  // what games set when starting.
+  // Initialize the gamma ramps to their default (linear) values.
   for (uint32_t i = 0; i < 256; ++i) {
-    uint32_t value = i * 1023 / 255;
-    gamma_ramp_.normal[i].value = value | (value << 10) | (value << 20);
+    gamma_ramp_.normal[i].value = GammaRamp::GetLinearNormalValue(i);
   }
   for (uint32_t i = 0; i < 128; ++i) {
-    uint32_t value = (i * 65535 / 127) & ~63;
-    if (i < 127) {
-      value |= 0x200 << 16;
-    }
+    uint32_t value = GammaRamp::GetLinearPWLValue(i);
     for (uint32_t j = 0; j < 3; ++j) {
       gamma_ramp_.pwl[i].values[j].value = value;
     }
@@ -68,6 +70,15 @@ bool CommandProcessor::Initialize(
   dirty_gamma_ramp_pwl_ = true;
 
   worker_running_ = true;
+  if (cvars::gpu_parser_thread) {
+    parsed_commands_ =
+        std::make_unique<ParsedCommand[]>(kParsedCommandQueueSize);
+    parser_event_ = xe::threading::Event::CreateAutoResetEvent(false);
+    parsed_commands_event_ = xe::threading::Event::CreateAutoResetEvent(false);
+    parser_thread_ = xe::threading::Thread::Create(
+        {}, [this]() { ParserThreadMain(); });
+    parser_thread_->set_name("GraphicsSystem Command Parser");
+  }
   worker_thread_ = kernel::object_ref<kernel::XHostThread>(
       new kernel::XHostThread(kernel_state_, 128 * 1024, 0, [this]() {
         WorkerThreadMain();
@@ -75,6 +86,9 @@ bool CommandProcessor::Initialize(
       }));
   worker_thread_->set_name("GraphicsSystem Command Processor");
   worker_thread_->Create();
+  xe::threading::ApplyThreadRole(
+      worker_thread_->thread(),
+      xe::threading::ThreadRole::kGpuCommandProcessor);
 
   return true;
 }
@@ -84,8 +98,23 @@ void CommandProcessor::Shutdown() {
 
   worker_running_ = false;
   write_ptr_index_event_->Set();
+  if (parser_thread_) {
+    {
+      std::lock_guard<std::mutex> lock(parser_mutex_);
+    }
+    parser_cv_.notify_all();
+    parser_event_->Set();
+    parsed_commands_event_->Set();
+    xe::threading::Wait(parser_thread_.get(), false);
+    parser_thread_.reset();
+  }
   worker_thread_->Wait(0, 0, 0, nullptr);
   worker_thread_.reset();
+
+  if (cvars::headless && cvars::headless_unthrottled) {
+    XELOGI("Headless: {} guest swaps, {} presented", headless_swap_count_,
+           headless_presented_swap_count_);
+  }
 }
 
 void CommandProcessor::InitializeShaderStorage(
@@ -148,6 +177,12 @@ void CommandProcessor::WorkerThreadMain() {
     return;
   }
 
+  if (parser_thread_) {
+    ExecuteParsedCommands();
+    ShutdownContext();
+    return;
+  }
+
   while (worker_running_) {
     while (!pending_fns_.empty()) {
       auto fn = std::move(pending_fns_.front());
@@ -162,6 +197,7 @@ void CommandProcessor::WorkerThreadMain() {
       // We spin here waiting for new ones, as the overhead of waiting on our
       // event is too high.
       PrepareForWait();
+      uint64_t idle_ticks = Clock::QueryHostTickCount();
       uint32_t loop_count = 0;
       do {
         // If we spin around too much, revert to a "low-power" state.
@@ -173,6 +209,10 @@ void CommandProcessor::WorkerThreadMain() {
 
         xe::threading::MaybeYield();
         loop_count++;
+        // Counted while waiting, so a long stall is visible while it lasts.
+        uint64_t now_ticks = Clock::QueryHostTickCount();
+        benchmark_counters_.CountIdleTicks(now_ticks - idle_ticks);
+        idle_ticks = now_ticks;
         write_ptr_index = write_ptr_index_.load();
       } while (worker_running_ && pending_fns_.empty() &&
                (write_ptr_index == 0xBAADF00D ||
@@ -185,14 +225,7 @@ void CommandProcessor::WorkerThreadMain() {
     assert_true(read_ptr_index_ != write_ptr_index);
 
     // Execute. Note that we handle wraparound transparently.
-    read_ptr_index_ = ExecutePrimaryBuffer(read_ptr_index_, write_ptr_index);
-
-    // TODO(benvanik): use reader->Read_update_freq_ and only issue after moving
-    //     that many indices.
-    if (read_ptr_writeback_ptr_) {
-      xe::store_and_swap<uint32_t>(
-          memory_->TranslatePhysical(read_ptr_writeback_ptr_), read_ptr_index_);
-    }
+    UpdateReadPointer(ExecutePrimaryBuffer(read_ptr_index_, write_ptr_index));
 
     // FIXME: We're supposed to process the WAIT_UNTIL register at this point,
     // but no games seem to actually use it.
@@ -201,12 +234,386 @@ void CommandProcessor::WorkerThreadMain() {
   ShutdownContext();
 }
 
+void CommandProcessor::ExecuteParsedCommands() {
+  // Pending functions are called only between primary buffers, like when
+  // executing the ring buffer directly, so pausing doesn't split them.
+  bool in_primary_buffer = false;
+  while (worker_running_) {
+    if (!in_primary_buffer) {
+      while (!pending_fns_.empty()) {
+        auto fn = std::move(pending_fns_.front());
+        pending_fns_.pop();
+        fn();
+      }
+    }
+
+    size_t read_index = parsed_commands_read_.load(std::memory_order_relaxed);
+    if (read_index == parsed_commands_write_.load(std::memory_order_acquire)) {
+      SCOPE_profile_cpu_i("gpu", "xe::gpu::CommandProcessor::Stall");
+      // Inside a primary buffer, the parser thread is likely to push more
+      // commands very soon, so only prepare for waiting if it takes long.
+      bool prepared_for_wait = false;
+      if (!in_primary_buffer) {
+        PrepareForWait();
+        prepared_for_wait = true;
+      }
+      uint64_t idle_ticks = Clock::QueryHostTickCount();
+      uint32_t loop_count = 0;
+      do {
+        if (loop_count > 500) {
+          if (!prepared_for_wait) {
+            PrepareForWait();
+            prepared_for_wait = true;
+          }
+          parsed_commands_waiting_.store(true, std::memory_order_relaxed);
+          if (read_index ==
+              parsed_commands_write_.load(std::memory_order_acquire)) {
+            xe::threading::Wait(parsed_commands_event_.get(), true,
+                                std::chrono::milliseconds(5));
+          }
+          parsed_commands_waiting_.store(false, std::memory_order_relaxed);
+        }
+        xe::threading::MaybeYield();
+        loop_count++;
+        uint64_t now_ticks = Clock::QueryHostTickCount();
+        benchmark_counters_.CountIdleTicks(now_ticks - idle_ticks);
+        idle_ticks = now_ticks;
+      } while (worker_running_ &&
+               (in_primary_buffer || pending_fns_.empty()) &&
+               read_index ==
+                   parsed_commands_write_.load(std::memory_order_acquire));
+      if (prepared_for_wait) {
+        ReturnFromWait();
+      }
+      continue;
+    }
+
+    const ParsedCommand& command =
+        parsed_commands_[read_index & (kParsedCommandQueueSize - 1)];
+    if (command.type == ParsedCommandType::kPrimaryBufferStart) {
+      in_primary_buffer = true;
+    } else if (command.type == ParsedCommandType::kPrimaryBufferEnd) {
+      in_primary_buffer = false;
+    }
+    ExecuteParsedCommand(command);
+    parsed_commands_read_.store(read_index + 1, std::memory_order_release);
+    if (parser_waiting_.load(std::memory_order_relaxed)) {
+      parser_event_->Set();
+    }
+  }
+}
+
+void CommandProcessor::ExecuteParsedCommand(const ParsedCommand& command) {
+  RingBuffer reader(command.buffer, command.buffer_size);
+  if (command.buffer) {
+    reader.set_read_offset(command.offset);
+  }
+  switch (command.type) {
+    case ParsedCommandType::kPrimaryBufferStart:
+      BeginPrimaryBuffer(command.value, command.count);
+      break;
+    case ParsedCommandType::kPrimaryBufferEnd:
+      EndPrimaryBuffer();
+      UpdateReadPointer(command.count);
+      break;
+    case ParsedCommandType::kIndirectBufferStart:
+      trace_writer_.WritePacketStart(uint32_t(reader.read_ptr() - 4), 2);
+      trace_writer_.WriteIndirectBufferStart(command.value,
+                                             command.count * sizeof(uint32_t));
+      break;
+    case ParsedCommandType::kIndirectBufferEnd:
+      trace_writer_.WriteIndirectBufferEnd();
+      trace_writer_.WritePacketEnd();
+      break;
+    case ParsedCommandType::kPacket: {
+      reader.set_write_offset(command.offset +
+                              command.count * sizeof(uint32_t));
+      bool result = false;
+      switch (command.value >> 30) {
+        case 0x00:
+          result = ExecutePacketType0(&reader, command.value);
+          break;
+        case 0x01:
+          result = ExecutePacketType1(&reader, command.value);
+          break;
+        case 0x02:
+          result = ExecutePacketType2(&reader, command.value);
+          break;
+        case 0x03:
+          result = ExecutePacketType3(&reader, command.value);
+          break;
+      }
+      if (!result && worker_running_) {
+        XELOGE("**** Failed to execute a parsed packet {:08X}.",
+               command.value);
+        assert_always();
+      }
+    } break;
+    case ParsedCommandType::kPacketSkipped:
+      trace_writer_.WritePacketStart(uint32_t(reader.read_ptr() - 4),
+                                     command.count);
+      trace_writer_.WritePacketEnd();
+      break;
+  }
+}
+
+void CommandProcessor::ParserThreadMain() {
+  uint32_t loop_count = 0;
+  while (worker_running_) {
+    {
+      std::unique_lock<std::mutex> lock(parser_mutex_);
+      parser_cv_.wait(lock,
+                      [this]() { return !parser_paused_ || !worker_running_; });
+      uint32_t write_ptr_index = write_ptr_index_.load();
+      if (worker_running_ && write_ptr_index != 0xBAADF00D &&
+          parse_read_ptr_index_ != write_ptr_index) {
+        ParsePrimaryBuffer(parse_read_ptr_index_, write_ptr_index);
+        parse_read_ptr_index_ = write_ptr_index;
+        loop_count = 0;
+        continue;
+      }
+    }
+    // Spin waiting for new commands, like the worker thread does when
+    // executing the ring buffer directly.
+    if (loop_count > 500) {
+      xe::threading::Wait(write_ptr_index_event_.get(), true,
+                          std::chrono::milliseconds(5));
+    }
+    xe::threading::MaybeYield();
+    loop_count++;
+  }
+}
+
+void CommandProcessor::ParsePrimaryBuffer(uint32_t read_index,
+                                          uint32_t write_index) {
+  SCOPE_profile_cpu_f("gpu");
+
+  if (!PushParsedCommand(ParsedCommandType::kPrimaryBufferStart, read_index,
+                         nullptr, write_index)) {
+    return;
+  }
+  RingBuffer reader(memory_->TranslatePhysical(primary_buffer_ptr_),
+                    primary_buffer_size_);
+  reader.set_read_offset(read_index * sizeof(uint32_t));
+  reader.set_write_offset(write_index * sizeof(uint32_t));
+  do {
+    if (!ParsePacket(&reader)) {
+      XELOGE("**** PRIMARY RINGBUFFER: Failed to parse packet.");
+      assert_always();
+      break;
+    }
+  } while (reader.read_count());
+  PushParsedCommand(ParsedCommandType::kPrimaryBufferEnd, 0, nullptr,
+                    write_index);
+}
+
+void CommandProcessor::ParseIndirectBuffer(uint32_t ptr, uint32_t count) {
+  RingBuffer reader(memory_->TranslatePhysical(ptr), count * sizeof(uint32_t));
+  reader.set_write_offset(count * sizeof(uint32_t));
+  do {
+    if (!ParsePacket(&reader)) {
+      XELOGE("**** INDIRECT RINGBUFFER: Failed to parse packet.");
+      assert_always();
+      break;
+    }
+  } while (reader.read_count());
+}
+
+bool CommandProcessor::ParsePacket(RingBuffer* reader) {
+  const uint32_t packet = reader->ReadAndSwap<uint32_t>();
+  if (packet == 0) {
+    return PushParsedCommand(ParsedCommandType::kPacketSkipped, packet, reader,
+                             1);
+  }
+  uint32_t count;
+  switch (packet >> 30) {
+    case 0x01:
+      count = 2;
+      break;
+    case 0x02:
+      count = 0;
+      break;
+    default:
+      count = ((packet >> 16) & 0x3FFF) + 1;
+      break;
+  }
+  if (reader->read_count() < count * sizeof(uint32_t)) {
+    XELOGE("ParsePacket overflow (read count {:08X}, packet count {:08X})",
+           reader->read_count(), count * sizeof(uint32_t));
+    return false;
+  }
+  if ((packet >> 30) == 0x03) {
+    return ParsePacketType3(reader, packet, count);
+  }
+  if (!PushParsedCommand(ParsedCommandType::kPacket, packet, reader, count)) {
+    return false;
+  }
+  reader->AdvanceRead(count * sizeof(uint32_t));
+  return true;
+}
+
+bool CommandProcessor::ParsePacketType3(RingBuffer* reader, uint32_t packet,
+                                        uint32_t count) {
+  uint32_t opcode = (packet >> 8) & 0x7F;
+  // For reading the data without moving the packet reader.
+  RingBuffer data_reader = *reader;
+
+  if (packet & 1) {
+    bool any_pass = (parse_bin_select_ & parse_bin_mask_) != 0;
+    if (!any_pass || opcode == PM4_XE_SWAP) {
+      if (!PushParsedCommand(ParsedCommandType::kPacketSkipped, packet,
+                             reader, 1 + count)) {
+        return false;
+      }
+      reader->AdvanceRead(count * sizeof(uint32_t));
+      return true;
+    }
+    // The predicate has been checked already.
+    packet &= ~uint32_t(1);
+  }
+
+  switch (opcode) {
+    case PM4_INDIRECT_BUFFER:
+    case PM4_INDIRECT_BUFFER_PFD: {
+      uint32_t list_ptr =
+          GpuToCpu(CpuToGpu(data_reader.ReadAndSwap<uint32_t>()));
+      uint32_t list_length = data_reader.ReadAndSwap<uint32_t>();
+      assert_zero(list_length & ~0xFFFFF);
+      list_length &= 0xFFFFF;
+      if (!PushParsedCommand(ParsedCommandType::kIndirectBufferStart,
+                             list_ptr, reader, list_length)) {
+        return false;
+      }
+      reader->AdvanceRead(count * sizeof(uint32_t));
+      if (parse_sync_pending_) {
+        AwaitParsedCommandsExecution();
+      }
+      ParseIndirectBuffer(list_ptr, list_length);
+      return PushParsedCommand(ParsedCommandType::kIndirectBufferEnd, 0,
+                               nullptr, 0);
+    }
+    case PM4_WAIT_REG_MEM:
+    case PM4_INTERRUPT:
+    case PM4_REG_TO_MEM:
+    case PM4_MEM_WRITE:
+    case PM4_COND_WRITE:
+      parse_sync_pending_ = true;
+      break;
+    case PM4_SET_BIN_MASK_LO:
+      parse_bin_mask_ = (parse_bin_mask_ & 0xFFFFFFFF00000000ull) |
+                        data_reader.ReadAndSwap<uint32_t>();
+      break;
+    case PM4_SET_BIN_MASK_HI:
+      parse_bin_mask_ =
+          (parse_bin_mask_ & 0xFFFFFFFFull) |
+          (uint64_t(data_reader.ReadAndSwap<uint32_t>()) << 32);
+      break;
+    case PM4_SET_BIN_SELECT_LO:
+      parse_bin_select_ = (parse_bin_select_ & 0xFFFFFFFF00000000ull) |
+                          data_reader.ReadAndSwap<uint32_t>();
+      break;
+    case PM4_SET_BIN_SELECT_HI:
+      parse_bin_select_ =
+          (parse_bin_select_ & 0xFFFFFFFFull) |
+          (uint64_t(data_reader.ReadAndSwap<uint32_t>()) << 32);
+      break;
+    case PM4_SET_BIN_MASK: {
+      uint64_t val_hi = data_reader.ReadAndSwap<uint32_t>();
+      uint64_t val_lo = data_reader.ReadAndSwap<uint32_t>();
+      parse_bin_mask_ = (val_hi << 32) | val_lo;
+    } break;
+    case PM4_SET_BIN_SELECT: {
+      uint64_t val_hi = data_reader.ReadAndSwap<uint32_t>();
+      uint64_t val_lo = data_reader.ReadAndSwap<uint32_t>();
+      parse_bin_select_ = (val_hi << 32) | val_lo;
+    } break;
+  }
+
+  // The bin packets are executed too, to keep the state of the worker thread
+  // consistent.
+  if (!PushParsedCommand(ParsedCommandType::kPacket, packet, reader, count)) {
+    return false;
+  }
+  reader->AdvanceRead(count * sizeof(uint32_t));
+  return true;
+}
+
+bool CommandProcessor::PushParsedCommand(ParsedCommandType type,
+                                         uint32_t value,
+                                         const RingBuffer* reader,
+                                         uint32_t count) {
+  size_t write_index = parsed_commands_write_.load(std::memory_order_relaxed);
+  if (write_index - parsed_commands_read_.load(std::memory_order_acquire) >=
+      kParsedCommandQueueSize) {
+    uint32_t loop_count = 0;
+    do {
+      if (!worker_running_) {
+        return false;
+      }
+      if (loop_count > 500) {
+        parser_waiting_.store(true, std::memory_order_relaxed);
+        xe::threading::Wait(parser_event_.get(), true,
+                            std::chrono::milliseconds(1));
+        parser_waiting_.store(false, std::memory_order_relaxed);
+      }
+      xe::threading::MaybeYield();
+      loop_count++;
+    } while (write_index -
+                 parsed_commands_read_.load(std::memory_order_acquire) >=
+             kParsedCommandQueueSize);
+  }
+  ParsedCommand& command =
+      parsed_commands_[write_index & (kParsedCommandQueueSize - 1)];
+  command.type = type;
+  command.value = value;
+  if (reader) {
+    command.buffer = reader->buffer();
+    command.buffer_size = uint32_t(reader->capacity());
+    command.offset = uint32_t(reader->read_offset());
+  } else {
+    command.buffer = nullptr;
+    command.buffer_size = 0;
+    command.offset = 0;
+  }
+  command.count = count;
+  parsed_commands_write_.store(write_index + 1, std::memory_order_release);
+  if (parsed_commands_waiting_.load(std::memory_order_relaxed)) {
+    parsed_commands_event_->Set();
+  }
+  return true;
+}
+
+void CommandProcessor::AwaitParsedCommandsExecution() {
+  SCOPE_profile_cpu_f("gpu");
+  parse_sync_pending_ = false;
+  size_t write_index = parsed_commands_write_.load(std::memory_order_relaxed);
+  uint32_t loop_count = 0;
+  while (worker_running_ &&
+         parsed_commands_read_.load(std::memory_order_acquire) != write_index) {
+    if (loop_count > 500) {
+      parser_waiting_.store(true, std::memory_order_relaxed);
+      xe::threading::Wait(parser_event_.get(), true,
+                          std::chrono::milliseconds(1));
+      parser_waiting_.store(false, std::memory_order_relaxed);
+    }
+    xe::threading::MaybeYield();
+    loop_count++;
+  }
+}
+
 void CommandProcessor::Pause() {
   if (paused_) {
     return;
   }
   paused_ = true;
 
+  if (parser_thread_) {
+    // Let the parser thread finish the current part of the ring buffer and
+    // stop, so the parsed commands can be dropped if the state is restored.
+    std::lock_guard<std::mutex> lock(parser_mutex_);
+    parser_paused_ = true;
+  }
+
   threading::Fence fence;
   CallInThread([&fence]() {
     fence.Signal();
@@ -226,6 +633,71 @@ void CommandProcessor::Resume() {
   paused_ = false;
 
   worker_thread_->thread()->Resume();
+
+  if (parser_thread_) {
+    {
+      std::lock_guard<std::mutex> lock(parser_mutex_);
+      parser_paused_ = false;
+    }
+    parser_cv_.notify_all();
+  }
+}
+
+void CommandProcessor::SaveTracePlaybackState(
+    TracePlaybackState& state) const {
+  std::memcpy(state.registers.values, register_file_->values,
+              sizeof(state.registers.values));
+  state.active_vertex_shader = active_vertex_shader_;
+  state.active_pixel_shader = active_pixel_shader_;
+  state.bin_select = bin_select_;
+  state.bin_mask = bin_mask_;
+  state.gamma_ramp = gamma_ramp_;
+  state.gamma_ramp_rw_subindex = gamma_ramp_rw_subindex_;
+}
+
+void CommandProcessor::RestoreTracePlaybackState(
+    const TracePlaybackState& state) {
+  // Only the changed registers need to be written. Constants and registers
+  // with write side effects (such as memory writeback or gamma ramp index
+  // increment) are stored directly, others go through WriteRegister so the
+  // implementation can invalidate the state derived from them.
+  const uint32_t constants_ranges[][2] = {
+      {XE_GPU_REG_SHADER_CONSTANT_000_X, XE_GPU_REG_SHADER_CONSTANT_511_W},
+      {XE_GPU_REG_SHADER_CONSTANT_BOOL_000_031,
+       XE_GPU_REG_SHADER_CONSTANT_LOOP_31},
+  };
+  for (uint32_t i = 0; i < RegisterFile::kRegisterCount; ++i) {
+    uint32_t value = state.registers.values[i].u32;
+    if (register_file_->values[i].u32 == value) {
+      continue;
+    }
+    bool store_directly =
+        i == XE_GPU_REG_COHER_STATUS_HOST ||
+        (i >= XE_GPU_REG_SCRATCH_REG0 && i <= XE_GPU_REG_SCRATCH_REG7) ||
+        i == XE_GPU_REG_DC_LUT_PWL_DATA || i == XE_GPU_REG_DC_LUT_30_COLOR ||
+        i == XE_GPU_REG_DC_LUT_RW_MODE;
+    for (const auto& range : constants_ranges) {
+      store_directly |= i >= range[0] && i <= range[1];
+    }
+    if (store_directly) {
+      register_groups_dirty_ |= register_groups_[i];
+      register_file_->values[i].u32 = value;
+    } else {
+      WriteRegister(i, value);
+    }
+  }
+  for (const auto& range : constants_ranges) {
+    OnShaderConstantsChanged(range[0], range[1]);
+  }
+
+  active_vertex_shader_ = state.active_vertex_shader;
+  active_pixel_shader_ = state.active_pixel_shader;
+  bin_select_ = state.bin_select;
+  bin_mask_ = state.bin_mask;
+  gamma_ramp_ = state.gamma_ramp;
+  gamma_ramp_rw_subindex_ = state.gamma_ramp_rw_subindex;
+  dirty_gamma_ramp_normal_ = true;
+  dirty_gamma_ramp_pwl_ = true;
 }
 
 bool CommandProcessor::Save(ByteStream* stream) {
@@ -251,6 +723,14 @@ bool CommandProcessor::Restore(ByteStream* stream) {
   read_ptr_writeback_ptr_ = stream->Read<uint32_t>();
   write_ptr_index_.store(stream->Read<uint32_t>());
 
+  if (parser_thread_) {
+    // Both threads are paused - drop the commands parsed from the old ring
+    // buffer contents.
+    std::lock_guard<std::mutex> lock(parser_mutex_);
+    parsed_commands_read_.store(parsed_commands_write_.load());
+    parse_read_ptr_index_ = read_ptr_index_;
+  }
+
   return true;
 }
 
@@ -260,6 +740,10 @@ void CommandProcessor::ShutdownContext() { context_.reset(); }
 
 void CommandProcessor::InitializeRingBuffer(uint32_t ptr, uint32_t log2_size) {
   read_ptr_index_ = 0;
+  if (parser_thread_) {
+    std::lock_guard<std::mutex> lock(parser_mutex_);
+    parse_read_ptr_index_ = 0;
+  }
   primary_buffer_ptr_ = ptr;
   primary_buffer_size_ = 1 << log2_size;
 
@@ -291,6 +775,9 @@ void CommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
     return;
   }
 
+  if (regs->values[index].u32 != value) {
+    register_groups_dirty_ |= register_groups_[index];
+  }
   regs->values[index].u32 = value;
   if (!regs->GetRegisterInfo(index)) {
     XELOGW("GPU: Write to unknown register ({:04X} = {:08X})", index, value);
@@ -315,6 +802,81 @@ void CommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
   }
 }
 
+void CommandProcessor::WriteRegistersFromMem(uint32_t start_index,
+                                             const uint32_t* source,
+                                             uint32_t count) {
+  if (!count) {
+    return;
+  }
+  uint32_t last_index = start_index + count - 1;
+  bool bulk = (start_index >= XE_GPU_REG_SHADER_CONSTANT_000_X &&
+               last_index <= XE_GPU_REG_SHADER_CONSTANT_511_W) ||
+              (start_index >= XE_GPU_REG_SHADER_CONSTANT_BOOL_000_031 &&
+               last_index <= XE_GPU_REG_SHADER_CONSTANT_LOOP_31);
+  if (!bulk) {
+    for (uint32_t i = 0; i < count; ++i) {
+      WriteRegister(start_index + i, xe::load_and_swap<uint32_t>(source + i));
+    }
+    return;
+  }
+
+  // Constants don't need any special handling in WriteRegister, and are
+  // usually rewritten with mostly the same values - only store and report the
+  // range that has been changed.
+  uint32_t swapped[XE_GPU_REG_SHADER_CONSTANT_511_W -
+                   XE_GPU_REG_SHADER_CONSTANT_000_X + 1];
+  assert_true(count <= xe::countof(swapped));
+  xe::copy_and_swap_32_unaligned(swapped, source, count);
+  uint32_t* dest = &register_file_->values[start_index].u32;
+  uint32_t first_changed = 0;
+  while (first_changed < count &&
+         dest[first_changed] == swapped[first_changed]) {
+    ++first_changed;
+  }
+  if (first_changed >= count) {
+    return;
+  }
+  uint32_t last_changed = count - 1;
+  while (dest[last_changed] == swapped[last_changed]) {
+    --last_changed;
+  }
+  std::memcpy(dest + first_changed, swapped + first_changed,
+              sizeof(uint32_t) * (last_changed - first_changed + 1));
+  uint32_t groups = 0;
+  for (uint32_t i = first_changed; i <= last_changed; ++i) {
+    groups |= register_groups_[start_index + i];
+  }
+  register_groups_dirty_ |= groups;
+  OnShaderConstantsChanged(start_index + first_changed,
+                           start_index + last_changed);
+}
+
+void CommandProcessor::WriteRegistersFromRing(uint32_t start_index,
+                                              RingBuffer* reader,
+                                              uint32_t count) {
+  RingBuffer::ReadRange range = reader->BeginRead(count * sizeof(uint32_t));
+  uint32_t first_count = uint32_t(range.first_length / sizeof(uint32_t));
+  WriteRegistersFromMem(start_index,
+                        reinterpret_cast<const uint32_t*>(range.first),
+                        first_count);
+  if (range.second) {
+    WriteRegistersFromMem(start_index + first_count,
+                          reinterpret_cast<const uint32_t*>(range.second),
+                          uint32_t(range.second_length / sizeof(uint32_t)));
+  }
+  reader->EndRead(range);
+}
+
+void CommandProcessor::AddRegistersToGroup(uint32_t group, uint32_t first,
+                                           uint32_t last) {
+  assert_true(group < kMaxRegisterGroups);
+  assert_true(first <= last && last < RegisterFile::kRegisterCount);
+  for (uint32_t i = first; i <= last; ++i) {
+    register_groups_[i] |= uint8_t(1) << group;
+  }
+  register_groups_dirty_ |= uint32_t(1) << group;
+}
+
 void CommandProcessor::UpdateGammaRampValue(GammaRampType type,
                                             uint32_t value) {
   RegisterFile* regs = register_file_;
@@ -397,12 +959,34 @@ void CommandProcessor::IssueSwap(uint32_t frontbuffer_ptr,
   if (!swap_request_handler_) {
     return;
   }
+  benchmark_counters_.CountSwap();
+
+  bool unthrottled = cvars::headless && cvars::headless_unthrottled;
+  if (unthrottled) {
+    // Only count the swap, skipping the copy to the swap texture too, unless
+    // it's one of the frames still presented to see the progress.
+    ++headless_swap_count_;
+    if (cvars::headless_present_interval <= 0 ||
+        headless_swap_count_ % uint32_t(cvars::headless_present_interval)) {
+      MemoryHeatmap* memory_heatmap = memory_->heatmap();
+      if (memory_heatmap) {
+        memory_heatmap->EndFrame();
+      }
+      input_latency::RecordGuestSwap();
+      startup_timeline::RecordGuestSwap();
+      return;
+    }
+    ++headless_presented_swap_count_;
+  }
 
   // If there was a swap pending we drop it on the floor.
   // This prevents the display from pulling the backbuffer out from under us.
   // If we skip a lot then we may need to buffer more, but as the display
   // thread should be fairly idle that shouldn't happen.
-  if (!cvars::vsync) {
+  if (unthrottled) {
+    std::lock_guard<std::mutex> lock(swap_state_.mutex);
+    swap_state_.pending = false;
+  } else if (!cvars::vsync) {
     std::lock_guard<std::mutex> lock(swap_state_.mutex);
     if (swap_state_.pending) {
       swap_state_.pending = false;
@@ -422,13 +1006,24 @@ void CommandProcessor::IssueSwap(uint32_t frontbuffer_ptr,
     }
   }
 
-  PerformSwap(frontbuffer_ptr, frontbuffer_width, frontbuffer_height);
+  {
+    BenchmarkTimingScope benchmark_timing_scope(
+        benchmark_counters_, benchmark_counters_.swap_ticks);
+    PerformSwap(frontbuffer_ptr, frontbuffer_width, frontbuffer_height);
+  }
+
+  MemoryHeatmap* memory_heatmap = memory_->heatmap();
+  if (memory_heatmap) {
+    memory_heatmap->EndFrame();
+  }
 
   {
     // Set pending so that the display will swap the next time it can.
     std::lock_guard<std::mutex> lock(swap_state_.mutex);
     swap_state_.pending = true;
   }
+  input_latency::RecordGuestSwap();
+  startup_timeline::RecordGuestSwap();
 
   // Notify the display a swap is pending so that our changes are picked up.
   // It does the actual front/back buffer swap.
@@ -439,6 +1034,29 @@ uint32_t CommandProcessor::ExecutePrimaryBuffer(uint32_t read_index,
                                                 uint32_t write_index) {
   SCOPE_profile_cpu_f("gpu");
 
+  BeginPrimaryBuffer(read_index, write_index);
+
+  // Execute commands!
+  RingBuffer reader(memory_->TranslatePhysical(primary_buffer_ptr_),
+                    primary_buffer_size_);
+  reader.set_read_offset(read_index * sizeof(uint32_t));
+  reader.set_write_offset(write_index * sizeof(uint32_t));
+  do {
+    if (!ExecutePacket(&reader)) {
+      // This probably should be fatal - but we're going to continue anyways.
+      XELOGE("**** PRIMARY RINGBUFFER: Failed to execute packet.");
+      assert_always();
+      break;
+    }
+  } while (reader.read_count());
+
+  EndPrimaryBuffer();
+
+  return write_index;
+}
+
+void CommandProcessor::BeginPrimaryBuffer(uint32_t read_index,
+                                          uint32_t write_index) {
   // If we have a pending trace stream open it now. That way we ensure we get
   // all commands.
   if (!trace_writer_.is_open() && trace_state_ == TraceState::kStreaming) {
@@ -458,26 +1076,23 @@ uint32_t CommandProcessor::ExecutePrimaryBuffer(uint32_t read_index,
   end_ptr = (primary_buffer_ptr_ & ~0x1FFFFFFF) | (end_ptr & 0x1FFFFFFF);
 
   trace_writer_.WritePrimaryBufferStart(start_ptr, write_index - read_index);
+}
 
-  // Execute commands!
-  RingBuffer reader(memory_->TranslatePhysical(primary_buffer_ptr_),
-                    primary_buffer_size_);
-  reader.set_read_offset(read_index * sizeof(uint32_t));
-  reader.set_write_offset(write_index * sizeof(uint32_t));
-  do {
-    if (!ExecutePacket(&reader)) {
-      // This probably should be fatal - but we're going to continue anyways.
-      XELOGE("**** PRIMARY RINGBUFFER: Failed to execute packet.");
-      assert_always();
-      break;
-    }
-  } while (reader.read_count());
-
+void CommandProcessor::EndPrimaryBuffer() {
   OnPrimaryBufferEnd();
 
   trace_writer_.WritePrimaryBufferEnd();
+}
 
-  return write_index;
+void CommandProcessor::UpdateReadPointer(uint32_t read_ptr_index) {
+  read_ptr_index_ = read_ptr_index;
+
+  // TODO(benvanik): use reader->Read_update_freq_ and only issue after moving
+  //     that many indices.
+  if (read_ptr_writeback_ptr_) {
+    xe::store_and_swap<uint32_t>(
+        memory_->TranslatePhysical(read_ptr_writeback_ptr_), read_ptr_index_);
+  }
 }
 
 void CommandProcessor::ExecuteIndirectBuffer(uint32_t ptr, uint32_t count) {
@@ -501,6 +1116,8 @@ void CommandProcessor::ExecuteIndirectBuffer(uint32_t ptr, uint32_t count) {
 }
 
 void CommandProcessor::ExecutePacket(uint32_t ptr, uint32_t count) {
+  BenchmarkTimingScope benchmark_timing_scope(benchmark_counters_,
+                                              benchmark_counters_.packet_ticks);
   // Execute commands!
   RingBuffer reader(memory_->TranslatePhysical(ptr), count * sizeof(uint32_t));
   reader.set_write_offset(count * sizeof(uint32_t));
@@ -554,10 +1171,12 @@ bool CommandProcessor::ExecutePacketType0(RingBuffer* reader, uint32_t packet) {
 
   uint32_t base_index = (packet & 0x7FFF);
   uint32_t write_one_reg = (packet >> 15) & 0x1;
-  for (uint32_t m = 0; m < count; m++) {
-    uint32_t reg_data = reader->ReadAndSwap<uint32_t>();
-    uint32_t target_index = write_one_reg ? base_index : base_index + m;
-    WriteRegister(target_index, reg_data);
+  if (write_one_reg) {
+    for (uint32_t m = 0; m < count; m++) {
+      WriteRegister(base_index, reader->ReadAndSwap<uint32_t>());
+    }
+  } else {
+    WriteRegistersFromRing(base_index, reader, count);
   }
 
   trace_writer_.WritePacketEnd();
@@ -778,10 +1397,8 @@ bool CommandProcessor::ExecutePacketType3_ME_INIT(RingBuffer* reader,
                                                   uint32_t packet,
                                                   uint32_t count) {
   // initialize CP's micro-engine
-  me_bin_.clear();
-  for (uint32_t i = 0; i < count; i++) {
-    me_bin_.push_back(reader->ReadAndSwap<uint32_t>());
-  }
+  me_bin_.resize(count);
+  me_bin_.resize(reader->ReadAndSwap(me_bin_.data(), count));
 
   return true;
 }
@@ -987,15 +1604,20 @@ bool CommandProcessor::ExecutePacketType3_MEM_WRITE(RingBuffer* reader,
                                                     uint32_t packet,
                                                     uint32_t count) {
   uint32_t write_addr = reader->ReadAndSwap<uint32_t>();
-  for (uint32_t i = 0; i < count - 1; i++) {
-    uint32_t write_data = reader->ReadAndSwap<uint32_t>();
-
-    auto endianness = static_cast<xenos::Endian>(write_addr & 0x3);
-    auto addr = write_addr & ~0x3;
-    write_data = GpuSwap(write_data, endianness);
-    xe::store(memory_->TranslatePhysical(addr), write_data);
-    trace_writer_.WriteMemoryWrite(CpuToGpu(addr), 4);
-    write_addr += 4;
+  auto endianness = static_cast<xenos::Endian>(write_addr & 0x3);
+  uint32_t write_data[64];
+  for (uint32_t i = 0; i < count - 1;) {
+    uint32_t batch_count =
+        std::min(count - 1 - i, uint32_t(xe::countof(write_data)));
+    reader->ReadAndSwap(write_data, batch_count);
+    for (uint32_t j = 0; j < batch_count; ++j) {
+      auto addr = write_addr & ~0x3;
+      xe::store(memory_->TranslatePhysical(addr),
+                GpuSwap(write_data[j], endianness));
+      trace_writer_.WriteMemoryWrite(CpuToGpu(addr), 4);
+      write_addr += 4;
+    }
+    i += batch_count;
   }
 
   return true;
@@ -1150,16 +1772,21 @@ bool CommandProcessor::ExecutePacketType3_EVENT_WRITE_ZPD(RingBuffer* reader,
 
   // Occlusion queries:
   // This command is send on query begin and end.
+  uint32_t sample_counts_address =
+      register_file_->values[XE_GPU_REG_RB_SAMPLE_COUNT_ADDR].u32;
+  auto* pSampleCounts =
+      memory_->TranslatePhysical<xe_gpu_depth_sample_counts*>(
+          sample_counts_address);
+  // 0xFFFFFEED is written to this two locations by D3D only on D3DISSUE_END
+  // and used to detect a finished query.
+  bool isEnd = pSampleCounts->ZPass_A == xe::byte_swap(0xFFFFFEED) &&
+               pSampleCounts->ZPass_B == xe::byte_swap(0xFFFFFEED);
+  if (IssueOcclusionQueryEvent(sample_counts_address, isEnd)) {
+    return true;
+  }
   // As a workaround report some fixed amount of passed samples.
   auto fake_sample_count = cvars::query_occlusion_fake_sample_count;
   if (fake_sample_count >= 0) {
-    auto* pSampleCounts =
-        memory_->TranslatePhysical<xe_gpu_depth_sample_counts*>(
-            register_file_->values[XE_GPU_REG_RB_SAMPLE_COUNT_ADDR].u32);
-    // 0xFFFFFEED is written to this two locations by D3D only on D3DISSUE_END
-    // and used to detect a finished query.
-    bool isEnd = pSampleCounts->ZPass_A == xe::byte_swap(0xFFFFFEED) &&
-                 pSampleCounts->ZPass_B == xe::byte_swap(0xFFFFFEED);
     std::memset(pSampleCounts, 0, sizeof(xe_gpu_depth_sample_counts));
     if (isEnd) {
       pSampleCounts->ZPass_A = fake_sample_count;
@@ -1215,11 +1842,17 @@ bool CommandProcessor::ExecutePacketType3_DRAW_INDX(RingBuffer* reader,
     } break;
   }
 
-  bool success =
-      IssueDraw(vgt_draw_initiator.prim_type, vgt_draw_initiator.num_indices,
-                is_indexed ? &index_buffer_info : nullptr,
-                xenos::IsMajorModeExplicit(vgt_draw_initiator.major_mode,
-                                           vgt_draw_initiator.prim_type));
+  bool success;
+  {
+    BenchmarkTimingScope benchmark_timing_scope(
+        benchmark_counters_, benchmark_counters_.draw_ticks);
+    benchmark_counters_.CountDraw();
+    success =
+        IssueDraw(vgt_draw_initiator.prim_type, vgt_draw_initiator.num_indices,
+                  is_indexed ? &index_buffer_info : nullptr,
+                  xenos::IsMajorModeExplicit(vgt_draw_initiator.major_mode,
+                                             vgt_draw_initiator.prim_type));
+  }
   if (!success) {
     XELOGE("PM4_DRAW_INDX({}, {}, {}): Failed in backend",
            vgt_draw_initiator.num_indices,
@@ -1248,10 +1881,16 @@ bool CommandProcessor::ExecutePacketType3_DRAW_INDX_2(RingBuffer* reader,
   // TODO(Triang3l): VGT_IMMED_DATA.
   reader->AdvanceRead((count - 1) * sizeof(uint32_t));
 
-  bool success = IssueDraw(
-      vgt_draw_initiator.prim_type, vgt_draw_initiator.num_indices, nullptr,
-      xenos::IsMajorModeExplicit(vgt_draw_initiator.major_mode,
-                                 vgt_draw_initiator.prim_type));
+  bool success;
+  {
+    BenchmarkTimingScope benchmark_timing_scope(
+        benchmark_counters_, benchmark_counters_.draw_ticks);
+    benchmark_counters_.CountDraw();
+    success = IssueDraw(
+        vgt_draw_initiator.prim_type, vgt_draw_initiator.num_indices, nullptr,
+        xenos::IsMajorModeExplicit(vgt_draw_initiator.major_mode,
+                                   vgt_draw_initiator.prim_type));
+  }
   if (!success) {
     XELOGE("PM4_DRAW_INDX_IMM({}, {}): Failed in backend",
            vgt_draw_initiator.num_indices,
@@ -1291,10 +1930,7 @@ bool CommandProcessor::ExecutePacketType3_SET_CONSTANT(RingBuffer* reader,
       reader->AdvanceRead((count - 1) * sizeof(uint32_t));
       return true;
   }
-  for (uint32_t n = 0; n < count - 1; n++, index++) {
-    uint32_t data = reader->ReadAndSwap<uint32_t>();
-    WriteRegister(index, data);
-  }
+  WriteRegistersFromRing(index, reader, count - 1);
   return true;
 }
 
@@ -1303,10 +1939,7 @@ bool CommandProcessor::ExecutePacketType3_SET_CONSTANT2(RingBuffer* reader,
                                                         uint32_t count) {
   uint32_t offset_type = reader->ReadAndSwap<uint32_t>();
   uint32_t index = offset_type & 0xFFFF;
-  for (uint32_t n = 0; n < count - 1; n++, index++) {
-    uint32_t data = reader->ReadAndSwap<uint32_t>();
-    WriteRegister(index, data);
-  }
+  WriteRegistersFromRing(index, reader, count - 1);
   return true;
 }
 
@@ -1342,11 +1975,10 @@ bool CommandProcessor::ExecutePacketType3_LOAD_ALU_CONSTANT(RingBuffer* reader,
       return true;
   }
   trace_writer_.WriteMemoryRead(CpuToGpu(address), size_dwords * 4);
-  for (uint32_t n = 0; n < size_dwords; n++, index++) {
-    uint32_t data = xe::load_and_swap<uint32_t>(
-        memory_->TranslatePhysical(address + n * 4));
-    WriteRegister(index, data);
-  }
+  WriteRegistersFromMem(
+      index,
+      reinterpret_cast<const uint32_t*>(memory_->TranslatePhysical(address)),
+      size_dwords);
   return true;
 }
 
@@ -1354,10 +1986,7 @@ bool CommandProcessor::ExecutePacketType3_SET_SHADER_CONSTANTS(
     RingBuffer* reader, uint32_t packet, uint32_t count) {
   uint32_t offset_type = reader->ReadAndSwap<uint32_t>();
   uint32_t index = offset_type & 0xFFFF;
-  for (uint32_t n = 0; n < count - 1; n++, index++) {
-    uint32_t data = reader->ReadAndSwap<uint32_t>();
-    WriteRegister(index, data);
-  }
+  WriteRegistersFromRing(index, reader, count - 1);
   return true;
 }
 
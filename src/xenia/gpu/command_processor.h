@@ -11,6 +11,8 @@
 #define XENIA_GPU_COMMAND_PROCESSOR_H_
 
 #include <atomic>
+#include <condition_variable>
+#include <cstddef>
 #include <cstring>
 #include <functional>
 #include <memory>
@@ -21,6 +23,7 @@
 
 #include "xenia/base/ring_buffer.h"
 #include "xenia/base/threading.h"
+#include "xenia/gpu/benchmark_counters.h"
 #include "xenia/gpu/register_file.h"
 #include "xenia/gpu/trace_writer.h"
 #include "xenia/gpu/xenos.h"
@@ -58,6 +61,17 @@ enum class SwapMode {
   kIgnored,
 };
 
+// Kinds of GPU work measured by the optional GPU timing instrumentation.
+enum class GpuTimingCategory : uint32_t {
+  kDraw,
+  kResolve,
+  kEdramStore,
+  kEdramLoad,
+  kTextureLoad,
+
+  kCount,
+};
+
 enum class GammaRampType {
   kUnknown = 0,
   kNormal,
@@ -98,6 +112,20 @@ struct GammaRamp {
     };
   };
 
+  // Entries of the linear ramps, the defaults - taken from what games set
+  // when starting. For PWL, the same value is used for all components.
+  static uint32_t GetLinearNormalValue(uint32_t index) {
+    uint32_t value = index * 1023 / 255;
+    return value | (value << 10) | (value << 20);
+  }
+  static uint32_t GetLinearPWLValue(uint32_t index) {
+    uint32_t value = (index * 65535 / 127) & ~63;
+    if (index < 127) {
+      value |= 0x200 << 16;
+    }
+    return value;
+  }
+
   NormalEntry normal[256];
   PWLEntry pwl[128];
 };
@@ -145,6 +173,31 @@ class CommandProcessor {
 
   virtual void RestoreEdramSnapshot(const void* snapshot) = 0;
 
+  // Command processor state at a point of trace playback, for resuming the
+  // playback from there. Memory and EDRAM contents are not included.
+  struct TracePlaybackState {
+    RegisterFile registers;
+    // Only valid until the caches are cleared.
+    Shader* active_vertex_shader;
+    Shader* active_pixel_shader;
+    uint64_t bin_select;
+    uint64_t bin_mask;
+    GammaRamp gamma_ramp;
+    int gamma_ramp_rw_subindex;
+  };
+  // Must be called on the command processor thread.
+  void SaveTracePlaybackState(TracePlaybackState& state) const;
+  void RestoreTracePlaybackState(const TracePlaybackState& state);
+
+  // If GPU timing is enabled, writes the GPU time spent on every category of
+  // work (GpuTimingCategory::kCount values) in the latest frame for which all
+  // the timing data is available, in microseconds, and returns true.
+  virtual bool GetGpuFrameTiming(double* microseconds_out) const {
+    return false;
+  }
+
+  BenchmarkCounters& benchmark_counters() { return benchmark_counters_; }
+
   void InitializeRingBuffer(uint32_t ptr, uint32_t page_count);
   void EnableReadPointerWriteBack(uint32_t ptr, uint32_t block_size);
 
@@ -168,11 +221,85 @@ class CommandProcessor {
     size_t length = 0;
   };
 
+  // With gpu_parser_thread, the ring buffer is parsed on a separate thread -
+  // the packets are validated, predicates are evaluated and indirect buffers
+  // are expanded there, and the worker thread only executes the resulting
+  // commands, which reference the packet data in guest memory.
+  enum class ParsedCommandType : uint32_t {
+    // Value is the read index, count is the write index.
+    kPrimaryBufferStart,
+    // Count is the write index, to become the read index.
+    kPrimaryBufferEnd,
+    // Value is the physical address of the buffer, count is its length in
+    // dwords, offset is after the INDIRECT_BUFFER packet header.
+    kIndirectBufferStart,
+    kIndirectBufferEnd,
+    // Value is the packet header, count is the data length in dwords, offset
+    // is after the header.
+    kPacket,
+    // Null or predicated out packet, only written to the trace. Count is the
+    // length in dwords including the header, offset is after the header.
+    kPacketSkipped,
+  };
+  struct ParsedCommand {
+    ParsedCommandType type;
+    uint32_t value;
+    uint8_t* buffer;
+    uint32_t buffer_size;
+    uint32_t offset;
+    uint32_t count;
+  };
+  // Power of two.
+  static constexpr size_t kParsedCommandQueueSize = 8192;
+
   void WorkerThreadMain();
+  void ExecuteParsedCommands();
+  void ExecuteParsedCommand(const ParsedCommand& command);
+  void ParserThreadMain();
+  void ParsePrimaryBuffer(uint32_t start_index, uint32_t end_index);
+  void ParseIndirectBuffer(uint32_t ptr, uint32_t length);
+  bool ParsePacket(RingBuffer* reader);
+  bool ParsePacketType3(RingBuffer* reader, uint32_t packet, uint32_t count);
+  // Returns false if the worker thread has been stopped.
+  bool PushParsedCommand(ParsedCommandType type, uint32_t value,
+                         const RingBuffer* reader, uint32_t count);
+  // Waits until the worker thread has executed all the pushed commands.
+  void AwaitParsedCommandsExecution();
   virtual bool SetupContext() = 0;
   virtual void ShutdownContext() = 0;
 
   virtual void WriteRegister(uint32_t index, uint32_t value);
+  // Write count registers starting from start_index from big-endian data.
+  // Ranges fully within the float constants or within the bool and loop
+  // constants are copied in bulk, with OnShaderConstantsChanged called once for
+  // the part that has actually been changed, other registers are written via
+  // WriteRegister.
+  void WriteRegistersFromMem(uint32_t start_index, const uint32_t* source,
+                             uint32_t count);
+  void WriteRegistersFromRing(uint32_t start_index, RingBuffer* reader,
+                              uint32_t count);
+  // Called after a bulk write that has modified the registers between
+  // first_index and last_index (not necessarily every one of them), which are
+  // all float constants or all bool and loop constants.
+  virtual void OnShaderConstantsChanged(uint32_t first_index,
+                                        uint32_t last_index) {}
+
+  // Registers can be put into groups (defined by the implementations), and
+  // WriteRegister marks the groups containing a register as dirty when its
+  // value is changed, so state derived from the registers can be recalculated
+  // only when it may be different.
+  static constexpr uint32_t kMaxRegisterGroups = 8;
+  void AddRegistersToGroup(uint32_t group, uint32_t first, uint32_t last);
+  // Returns whether any of the groups have been modified since they were last
+  // consumed, and resets them to not modified.
+  bool ConsumeRegisterGroupsDirty(uint32_t group_mask) {
+    bool dirty = (register_groups_dirty_ & group_mask) != 0;
+    register_groups_dirty_ &= ~group_mask;
+    return dirty;
+  }
+  void MarkRegisterGroupsDirty(uint32_t group_mask = UINT32_MAX) {
+    register_groups_dirty_ |= group_mask;
+  }
 
   void UpdateGammaRampValue(GammaRampType type, uint32_t value);
 
@@ -184,7 +311,10 @@ class CommandProcessor {
                            uint32_t frontbuffer_height) = 0;
 
   uint32_t ExecutePrimaryBuffer(uint32_t start_index, uint32_t end_index);
+  void BeginPrimaryBuffer(uint32_t start_index, uint32_t end_index);
+  void EndPrimaryBuffer();
   virtual void OnPrimaryBufferEnd() {}
+  void UpdateReadPointer(uint32_t read_ptr_index);
   void ExecuteIndirectBuffer(uint32_t ptr, uint32_t length);
   bool ExecutePacket(RingBuffer* reader);
   bool ExecutePacketType0(RingBuffer* reader, uint32_t packet);
@@ -250,6 +380,14 @@ class CommandProcessor {
                          IndexBufferInfo* index_buffer_info,
                          bool major_mode_explicit) = 0;
   virtual bool IssueCopy() = 0;
+  // Called for EVENT_WRITE_ZPD, sent by the guest when an occlusion query is
+  // begun and ended, with RB_SAMPLE_COUNT_ADDR. Returns true if the sample
+  // counts will be provided by the implementation, false to write the fake
+  // sample count.
+  virtual bool IssueOcclusionQueryEvent(uint32_t sample_counts_address,
+                                        bool is_end) {
+    return false;
+  }
 
   virtual void InitializeTrace() = 0;
   virtual void FinalizeTrace() = 0;
@@ -260,6 +398,7 @@ class CommandProcessor {
   RegisterFile* register_file_ = nullptr;
 
   TraceWriter trace_writer_;
+  BenchmarkCounters benchmark_counters_;
   enum class TraceState {
     kDisabled,
     kStreaming,
@@ -276,6 +415,9 @@ class CommandProcessor {
   SwapMode swap_mode_ = SwapMode::kNormal;
   SwapState swap_state_;
   std::function<void()> swap_request_handler_;
+  // With headless_unthrottled, the guest swaps issued and those presented.
+  uint64_t headless_swap_count_ = 0;
+  uint64_t headless_presented_swap_count_ = 0;
   std::queue<std::function<void()>> pending_fns_;
 
   // MicroEngine binary from PM4_ME_INIT
@@ -296,6 +438,33 @@ class CommandProcessor {
   uint64_t bin_select_ = 0xFFFFFFFFull;
   uint64_t bin_mask_ = 0xFFFFFFFFull;
 
+  // Bits of the groups each register is in.
+  uint8_t register_groups_[RegisterFile::kRegisterCount] = {};
+  uint32_t register_groups_dirty_ = UINT32_MAX;
+
+  std::unique_ptr<xe::threading::Thread> parser_thread_;
+  // Held by the parser thread while parsing a part of the ring buffer.
+  std::mutex parser_mutex_;
+  std::condition_variable parser_cv_;
+  bool parser_paused_ = false;
+  // Protected by parser_mutex_.
+  uint32_t parse_read_ptr_index_ = 0;
+  // Parser thread state.
+  uint64_t parse_bin_select_ = 0xFFFFFFFFull;
+  uint64_t parse_bin_mask_ = 0xFFFFFFFFull;
+  // Whether packets that wait for guest memory or write it have been parsed
+  // since the worker thread last caught up with the parser thread - indirect
+  // buffers may be filled by the CPU or the GPU only after such packets.
+  bool parse_sync_pending_ = false;
+  std::unique_ptr<ParsedCommand[]> parsed_commands_;
+  // Single producer (parser thread), single consumer (worker thread).
+  std::atomic<size_t> parsed_commands_write_ = 0;
+  std::atomic<size_t> parsed_commands_read_ = 0;
+  std::atomic<bool> parser_waiting_ = false;
+  std::atomic<bool> parsed_commands_waiting_ = false;
+  std::unique_ptr<xe::threading::Event> parser_event_;
+  std::unique_ptr<xe::threading::Event> parsed_commands_event_;
+
   Shader* active_vertex_shader_ = nullptr;
   Shader* active_pixel_shader_ = nullptr;
 
@@ -29,6 +29,13 @@ DEFINE_bool(d3d12_bindless, true,
             "Use bindless resources where available - may improve performance, "
             "but may make debugging more complicated.",
             "D3D12");
+DEFINE_int32(
+    d3d12_command_list_recording_threads, 0,
+    "Number of threads recording parts of large submissions into separate "
+    "command lists in parallel with the command processor thread (up to the "
+    "number of logical CPU cores), 0 to record whole submissions on the "
+    "command processor thread.",
+    "D3D12");
 DEFINE_bool(d3d12_edram_rov, true,
             "Use rasterizer-ordered views for render target emulation where "
             "available.",
@@ -36,21 +43,36 @@ DEFINE_bool(d3d12_edram_rov, true,
 DEFINE_bool(d3d12_readback_memexport, false,
             "Read data written by memory export in shaders on the CPU. This "
             "may be needed in some games (but many only access exported data "
-            "on the GPU, and this flag isn't needed to handle such behavior), "
-            "but causes mid-frame synchronization, so it has a huge "
-            "performance impact.",
+            "on the GPU, and this flag isn't needed to handle such behavior). "
+            "The data is copied back asynchronously and written to the guest "
+            "memory when the CPU accesses it, but this still requires ending "
+            "the submission after every memory export draw.",
             "D3D12");
 DEFINE_bool(d3d12_readback_resolve, false,
             "Read render-to-texture results on the CPU. This may be needed in "
-            "some games, for instance, for screenshots in saved games, but "
-            "causes mid-frame synchronization, so it has a huge performance "
-            "impact.",
+            "some games, for instance, for screenshots in saved games. The "
+            "data is copied back asynchronously and written to the guest "
+            "memory when the CPU accesses it, but this still requires ending "
+            "the submission after every resolve.",
             "D3D12");
 DEFINE_bool(d3d12_ssaa_custom_sample_positions, false,
             "Enable custom SSAA sample positions for the RTV/DSV rendering "
             "path where available instead of centers (experimental, not very "
             "high-quality).",
             "D3D12");
+DEFINE_bool(d3d12_gpu_timing, false,
+            "Measure the GPU time spent on draws, resolves, EDRAM stores and "
+            "loads, and texture loads with timestamp queries, and report the "
+            "totals for every frame as profiler counters and in the trace "
+            "viewer.",
+            "D3D12");
+DEFINE_bool(d3d12_occlusion_queries, true,
+            "Count the samples passing the depth / stencil test for guest "
+            "occlusion queries with host queries instead of reporting "
+            "--query_occlusion_fake_sample_count. Only used with the RTV/DSV "
+            "rendering path since the depth test is done in the pixel shader "
+            "with ROV.",
+            "D3D12");
 DEFINE_bool(d3d12_submit_on_primary_buffer_end, true,
             "Submit the command list when a PM4 primary buffer ends if it's "
             "possible to submit immediately to try to reduce frame latency.",
@@ -90,7 +112,11 @@ void D3D12CommandProcessor::RequestFrameTrace(
 void D3D12CommandProcessor::TracePlaybackWroteMemory(uint32_t base_ptr,
                                                      uint32_t length) {
   shared_memory_->MemoryInvalidationCallback(base_ptr, length, true);
-  primitive_converter_->MemoryInvalidationCallback(base_ptr, length, true);
+}
+
+bool D3D12CommandProcessor::GetGpuFrameTiming(double* microseconds_out) const {
+  return gpu_timing_tracker_ &&
+         gpu_timing_tracker_->GetFrameTiming(microseconds_out);
 }
 
 void D3D12CommandProcessor::RestoreEdramSnapshot(const void* snapshot) {
@@ -762,6 +788,10 @@ void D3D12CommandProcessor::NotifyShaderBindingsLayoutUIDsInvalidated() {
     bindful_textures_written_pixel_ = false;
     bindful_samplers_written_vertex_ = false;
     bindful_samplers_written_pixel_ = false;
+    // The layout UIDs of the written texture sets may be reused.
+    bindful_texture_sets_.clear();
+    bindful_texture_sets_heap_index_ =
+        ui::d3d12::D3D12DescriptorHeapPool::kHeapIndexInvalid;
   }
 }
 
@@ -834,6 +864,25 @@ bool D3D12CommandProcessor::SetupContext() {
     return false;
   }
 
+  AddRegistersToGroup(kRegisterGroupViewportScissor,
+                      XE_GPU_REG_RB_SURFACE_INFO, XE_GPU_REG_RB_SURFACE_INFO);
+  AddRegistersToGroup(kRegisterGroupViewportScissor,
+                      XE_GPU_REG_PA_SC_WINDOW_OFFSET,
+                      XE_GPU_REG_PA_SC_WINDOW_SCISSOR_BR);
+  AddRegistersToGroup(kRegisterGroupViewportScissor,
+                      XE_GPU_REG_PA_CL_VPORT_XSCALE,
+                      XE_GPU_REG_PA_CL_VPORT_ZOFFSET);
+  AddRegistersToGroup(kRegisterGroupViewportScissor,
+                      XE_GPU_REG_PA_SU_SC_MODE_CNTL, XE_GPU_REG_PA_CL_VTE_CNTL);
+  AddRegistersToGroup(kRegisterGroupBlendFactor, XE_GPU_REG_RB_BLEND_RED,
+                      XE_GPU_REG_RB_BLEND_ALPHA);
+  AddRegistersToGroup(kRegisterGroupPipeline, 0,
+                      XE_GPU_REG_SHADER_CONSTANT_000_X - 1);
+  AddRegistersToGroup(kRegisterGroupPipeline,
+                      XE_GPU_REG_SHADER_CONSTANT_LOOP_31 + 1,
+                      RegisterFile::kRegisterCount - 1);
+  last_pipeline_configuration_.valid = false;
+
   auto& provider = GetD3D12Context().GetD3D12Provider();
   auto device = provider.GetDevice();
   auto direct_queue = provider.GetDirectQueue();
@@ -852,6 +901,15 @@ bool D3D12CommandProcessor::SetupContext() {
     XELOGE("Failed to create the submission fence completion event");
     return false;
   }
+  readback_fence_completion_event_ =
+      CreateEvent(nullptr, false, false, nullptr);
+  if (readback_fence_completion_event_ == nullptr) {
+    XELOGE("Failed to create the readback fence completion event");
+    return false;
+  }
+  readback_data_provider_handle_ =
+      memory_->RegisterPhysicalMemoryDataProviderCallback(
+          ReadbackDataProviderThunk, this);
 
   frame_open_ = false;
   frame_current_ = 1;
@@ -885,6 +943,41 @@ bool D3D12CommandProcessor::SetupContext() {
   command_list_->QueryInterface(IID_PPV_ARGS(&command_list_1_));
   deferred_command_list_ = std::make_unique<DeferredCommandList>(*this);
 
+  // Create the command lists and the threads for recording parts of large
+  // submissions in parallel.
+  recording_segment_next_ = 0;
+  recording_segment_count_ = 0;
+  recording_segments_remaining_ = 0;
+  recording_threads_shutdown_ = false;
+  recording_completion_event_ =
+      xe::threading::Event::CreateManualResetEvent(true);
+  if (cvars::d3d12_command_list_recording_threads > 0) {
+    uint32_t recording_thread_count =
+        std::min(uint32_t(cvars::d3d12_command_list_recording_threads),
+                 std::max(xe::threading::logical_processor_count(),
+                          uint32_t(1)));
+    for (uint32_t i = 0; i < recording_thread_count; ++i) {
+      RecordingCommandList recording_command_list;
+      if (FAILED(device->CreateCommandList(
+              0, D3D12_COMMAND_LIST_TYPE_DIRECT, command_allocator, nullptr,
+              IID_PPV_ARGS(&recording_command_list.command_list)))) {
+        XELOGE(
+            "Failed to create a graphics command list for parallel recording");
+        break;
+      }
+      recording_command_list.command_list->Close();
+      recording_command_list.command_list_1 = nullptr;
+      recording_command_list.command_list->QueryInterface(
+          IID_PPV_ARGS(&recording_command_list.command_list_1));
+      recording_command_lists_.push_back(recording_command_list);
+      std::unique_ptr<xe::threading::Thread> recording_thread =
+          xe::threading::Thread::Create(
+              {}, [this]() { CommandListRecordingThread(); });
+      recording_thread->set_name("D3D12 Command List Recording");
+      recording_threads_.push_back(std::move(recording_thread));
+    }
+  }
+
   bindless_resources_used_ =
       cvars::d3d12_bindless &&
       provider.GetResourceBindingTier() >= D3D12_RESOURCE_BINDING_TIER_2;
@@ -1183,12 +1276,32 @@ bool D3D12CommandProcessor::SetupContext() {
   }
 
   primitive_converter_ = std::make_unique<PrimitiveConverter>(
-      *this, *register_file_, *memory_, trace_writer_);
+      *this, *register_file_, *memory_, *shared_memory_, trace_writer_);
   if (!primitive_converter_->Initialize()) {
     XELOGE("Failed to initialize the geometric primitive converter");
     return false;
   }
 
+  if (cvars::d3d12_gpu_timing) {
+    gpu_timing_tracker_ = std::make_unique<GpuTimingTracker>(*this);
+    if (!gpu_timing_tracker_->Initialize()) {
+      XELOGE("Failed to initialize GPU timing");
+      gpu_timing_tracker_.reset();
+    }
+  }
+
+  if (cvars::d3d12_occlusion_queries && !edram_rov_used_) {
+    // With 2x resolution scaling, every guest sample is 4 host samples.
+    occlusion_query_tracker_ = std::make_unique<OcclusionQueryTracker>(
+        *this, *memory_, texture_cache_->IsResolutionScale2X() ? 2 : 0);
+    if (!occlusion_query_tracker_->Initialize()) {
+      XELOGE(
+          "Failed to initialize occlusion queries, using the fake sample "
+          "count");
+      occlusion_query_tracker_.reset();
+    }
+  }
+
   D3D12_HEAP_FLAGS heap_flag_create_not_zeroed =
       provider.GetHeapFlagCreateNotZeroed();
 
@@ -1459,6 +1572,24 @@ bool D3D12CommandProcessor::SetupContext() {
 void D3D12CommandProcessor::ShutdownContext() {
   AwaitAllSubmissionsCompletion();
 
+  // The data not taken by the CPU yet is not needed anymore - unregistering
+  // the data provider first so it's not called with the resources destroyed.
+  if (readback_data_provider_handle_) {
+    memory_->UnregisterPhysicalMemoryDataProviderCallback(
+        readback_data_provider_handle_);
+    readback_data_provider_handle_ = nullptr;
+  }
+  readbacks_.clear();
+  readbacks_unsubmitted_.clear();
+  readback_ring_allocations_.clear();
+  readback_ring_write_ = 0;
+  if (readback_ring_mapping_) {
+    D3D12_RANGE readback_write_range = {};
+    readback_ring_buffer_->Unmap(0, &readback_write_range);
+    readback_ring_mapping_ = nullptr;
+  }
+  ui::d3d12::util::ReleaseAndNull(readback_ring_buffer_);
+
   ui::d3d12::util::ReleaseAndNull(readback_buffer_);
   readback_buffer_size_ = 0;
 
@@ -1495,6 +1626,10 @@ void D3D12CommandProcessor::ShutdownContext() {
   ui::d3d12::util::ReleaseAndNull(gamma_ramp_upload_);
   ui::d3d12::util::ReleaseAndNull(gamma_ramp_texture_);
 
+  gpu_timing_tracker_.reset();
+
+  occlusion_query_tracker_.reset();
+
   primitive_converter_.reset();
 
   pipeline_cache_.reset();
@@ -1535,6 +1670,27 @@ void D3D12CommandProcessor::ShutdownContext() {
   }
   constant_buffer_pool_.reset();
 
+  if (!recording_threads_.empty()) {
+    {
+      std::lock_guard<std::mutex> lock(recording_request_lock_);
+      recording_threads_shutdown_ = true;
+    }
+    recording_request_cond_.notify_all();
+    for (size_t i = 0; i < recording_threads_.size(); ++i) {
+      xe::threading::Wait(recording_threads_[i].get(), false);
+    }
+    recording_threads_.clear();
+  }
+  recording_completion_event_.reset();
+  for (RecordingCommandList& recording_command_list :
+       recording_command_lists_) {
+    ui::d3d12::util::ReleaseAndNull(recording_command_list.command_list_1);
+    ui::d3d12::util::ReleaseAndNull(recording_command_list.command_list);
+  }
+  recording_command_lists_.clear();
+  recording_segments_.clear();
+  recording_command_allocators_.clear();
+
   deferred_command_list_.reset();
   ui::d3d12::util::ReleaseAndNull(command_list_1_);
   ui::d3d12::util::ReleaseAndNull(command_list_);
@@ -1551,6 +1707,10 @@ void D3D12CommandProcessor::ShutdownContext() {
     CloseHandle(submission_fence_completion_event_);
     submission_fence_completion_event_ = nullptr;
   }
+  if (readback_fence_completion_event_) {
+    CloseHandle(readback_fence_completion_event_);
+    readback_fence_completion_event_ = nullptr;
+  }
   submission_open_ = false;
   submission_current_ = 1;
   submission_completed_ = 0;
@@ -1559,11 +1719,15 @@ void D3D12CommandProcessor::ShutdownContext() {
 }
 
 void D3D12CommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
+  // Constants are often rewritten with the same values - no need to update the
+  // constant buffers then.
+  bool changed = index < RegisterFile::kRegisterCount &&
+                 register_file_->values[index].u32 != value;
   CommandProcessor::WriteRegister(index, value);
 
   if (index >= XE_GPU_REG_SHADER_CONSTANT_000_X &&
       index <= XE_GPU_REG_SHADER_CONSTANT_511_W) {
-    if (frame_open_) {
+    if (frame_open_ && changed) {
       uint32_t float_constant_index =
           (index - XE_GPU_REG_SHADER_CONSTANT_000_X) >> 2;
       if (float_constant_index >= 256) {
@@ -1581,7 +1745,9 @@ void D3D12CommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
     }
   } else if (index >= XE_GPU_REG_SHADER_CONSTANT_BOOL_000_031 &&
              index <= XE_GPU_REG_SHADER_CONSTANT_LOOP_31) {
-    cbuffer_binding_bool_loop_.up_to_date = false;
+    if (changed) {
+      cbuffer_binding_bool_loop_.up_to_date = false;
+    }
   } else if (index >= XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0 &&
              index <= XE_GPU_REG_SHADER_CONSTANT_FETCH_31_5) {
     cbuffer_binding_fetch_.up_to_date = false;
@@ -1598,6 +1764,38 @@ void D3D12CommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
   }
 }
 
+void D3D12CommandProcessor::OnShaderConstantsChanged(uint32_t first_index,
+                                                     uint32_t last_index) {
+  if (first_index >= XE_GPU_REG_SHADER_CONSTANT_BOOL_000_031) {
+    cbuffer_binding_bool_loop_.up_to_date = false;
+    return;
+  }
+  if (!frame_open_) {
+    return;
+  }
+  // Check if any of the modified float constants are used by the current
+  // shaders, vertex constants being 0...255, pixel constants 256...511.
+  uint32_t float_constant_first =
+      (first_index - XE_GPU_REG_SHADER_CONSTANT_000_X) >> 2;
+  uint32_t float_constant_last =
+      (last_index - XE_GPU_REG_SHADER_CONSTANT_000_X) >> 2;
+  for (uint32_t i = float_constant_first; i <= float_constant_last; ++i) {
+    const uint64_t* map = i >= 256 ? current_float_constant_map_pixel_
+                                   : current_float_constant_map_vertex_;
+    uint32_t map_index = i & 255;
+    if (map[map_index >> 6] & (1ull << (map_index & 63))) {
+      if (i >= 256) {
+        cbuffer_binding_float_pixel_.up_to_date = false;
+        // No more pixel constants to check, and vertex constants are before.
+        break;
+      }
+      cbuffer_binding_float_vertex_.up_to_date = false;
+      // Skip to the pixel constants.
+      i = std::max(i, uint32_t(255));
+    }
+  }
+}
+
 void D3D12CommandProcessor::PerformSwap(uint32_t frontbuffer_ptr,
                                         uint32_t frontbuffer_width,
                                         uint32_t frontbuffer_height) {
@@ -1610,6 +1808,11 @@ void D3D12CommandProcessor::PerformSwap(uint32_t frontbuffer_ptr,
   // In case the swap command is the only one in the frame.
   BeginSubmission(true);
 
+  // Not counting the presentation draws.
+  if (occlusion_query_tracker_) {
+    occlusion_query_tracker_->EndHostQuery();
+  }
+
   auto device = GetD3D12Context().GetD3D12Provider().GetDevice();
 
   // Upload the new gamma ramps, using the upload buffer for the current frame
@@ -1621,12 +1824,15 @@ void D3D12CommandProcessor::PerformSwap(uint32_t frontbuffer_ptr,
         gamma_ramp_footprints_[gamma_ramp_frame * 2];
     volatile uint32_t* mapping = reinterpret_cast<uint32_t*>(
         gamma_ramp_upload_mapping_ + gamma_ramp_footprint.Offset);
+    gamma_ramp_normal_identity_ = true;
     for (uint32_t i = 0; i < 256; ++i) {
       uint32_t value = gamma_ramp_.normal[i].value;
       // Swap red and blue (Project Sylpheed has settings allowing separate
       // configuration).
       mapping[i] = ((value & 1023) << 20) | (value & (1023 << 10)) |
                    ((value >> 20) & 1023);
+      gamma_ramp_normal_identity_ &=
+          (value & ((1 << 30) - 1)) == GammaRamp::GetLinearNormalValue(i);
     }
     PushTransitionBarrier(gamma_ramp_texture_, gamma_ramp_texture_state_,
                           D3D12_RESOURCE_STATE_COPY_DEST);
@@ -1647,11 +1853,18 @@ void D3D12CommandProcessor::PerformSwap(uint32_t frontbuffer_ptr,
         gamma_ramp_footprints_[gamma_ramp_frame * 2 + 1];
     volatile uint32_t* mapping = reinterpret_cast<uint32_t*>(
         gamma_ramp_upload_mapping_ + gamma_ramp_footprint.Offset);
+    gamma_ramp_pwl_identity_ = true;
     for (uint32_t i = 0; i < 128; ++i) {
       // TODO(Triang3l): Find a game to test if red and blue need to be swapped.
       mapping[i] = (gamma_ramp_.pwl[i].values[0].base >> 6) |
                    (uint32_t(gamma_ramp_.pwl[i].values[1].base >> 6) << 10) |
                    (uint32_t(gamma_ramp_.pwl[i].values[2].base >> 6) << 20);
+      // Both the base and the delta, even though only the base is uploaded.
+      uint32_t linear_value = GammaRamp::GetLinearPWLValue(i);
+      for (uint32_t j = 0; j < 3; ++j) {
+        gamma_ramp_pwl_identity_ &=
+            gamma_ramp_.pwl[i].values[j].value == linear_value;
+      }
     }
     PushTransitionBarrier(gamma_ramp_texture_, gamma_ramp_texture_state_,
                           D3D12_RESOURCE_STATE_COPY_DEST);
@@ -1681,6 +1894,10 @@ void D3D12CommandProcessor::PerformSwap(uint32_t frontbuffer_ptr,
     bool use_pwl_gamma_ramp =
         frontbuffer_format == xenos::TextureFormat::k_2_10_10_10 ||
         frontbuffer_format == xenos::TextureFormat::k_2_10_10_10_AS_16_16_16_16;
+    // Most titles leave the gamma ramp linear, in which case the lookup, its
+    // descriptor and its barriers can be skipped in the presentation pass.
+    bool use_gamma_ramp = use_pwl_gamma_ramp ? !gamma_ramp_pwl_identity_
+                                             : !gamma_ramp_normal_identity_;
 
     bool descriptors_obtained;
     ui::d3d12::util::DescriptorCPUGPUHandlePair descriptor_swap_texture;
@@ -1691,6 +1908,9 @@ void D3D12CommandProcessor::PerformSwap(uint32_t frontbuffer_ptr,
       descriptor_gamma_ramp = GetSystemBindlessViewHandlePair(
           use_pwl_gamma_ramp ? SystemBindlessView::kGammaRampPWLSRV
                              : SystemBindlessView::kGammaRampNormalSRV);
+    } else if (!use_gamma_ramp) {
+      descriptors_obtained =
+          RequestOneUseSingleViewDescriptors(1, &descriptor_swap_texture);
     } else {
       ui::d3d12::util::DescriptorCPUGPUHandlePair descriptors[2];
       descriptors_obtained = RequestOneUseSingleViewDescriptors(2, descriptors);
@@ -1713,9 +1933,11 @@ void D3D12CommandProcessor::PerformSwap(uint32_t frontbuffer_ptr,
       PushTransitionBarrier(swap_texture_,
                             D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
                             D3D12_RESOURCE_STATE_RENDER_TARGET);
-      PushTransitionBarrier(gamma_ramp_texture_, gamma_ramp_texture_state_,
-                            D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-      gamma_ramp_texture_state_ = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+      if (use_gamma_ramp) {
+        PushTransitionBarrier(gamma_ramp_texture_, gamma_ramp_texture_state_,
+                              D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+        gamma_ramp_texture_state_ = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+      }
       SubmitBarriers();
 
       auto swap_texture_size = GetSwapTextureSize();
@@ -1740,7 +1962,8 @@ void D3D12CommandProcessor::PerformSwap(uint32_t frontbuffer_ptr,
       D3D12GraphicsSystem* graphics_system =
           static_cast<D3D12GraphicsSystem*>(graphics_system_);
       graphics_system->StretchTextureToFrontBuffer(
-          descriptor_swap_texture.second, &descriptor_gamma_ramp.second,
+          descriptor_swap_texture.second,
+          use_gamma_ramp ? &descriptor_gamma_ramp.second : nullptr,
           use_pwl_gamma_ramp ? (1.0f / 128.0f) : (1.0f / 256.0f),
           *deferred_command_list_);
       // Ending the current frame anyway, so no need to reset the current render
@@ -1769,6 +1992,22 @@ void D3D12CommandProcessor::OnPrimaryBufferEnd() {
   }
 }
 
+void D3D12CommandProcessor::PrepareForWait() {
+  // The guest may be waiting for the results of occlusion queries, which are
+  // written only when the submissions are checked as completed - nothing to do
+  // anyway, so submit and await them.
+  if (occlusion_query_tracker_) {
+    uint64_t occlusion_query_submission =
+        occlusion_query_tracker_->GetLastPendingSubmission();
+    if (occlusion_query_submission > submission_completed_ &&
+        (occlusion_query_submission < submission_current_ ||
+         CanEndSubmissionImmediately())) {
+      CheckSubmissionFence(occlusion_query_submission);
+    }
+  }
+  CommandProcessor::PrepareForWait();
+}
+
 Shader* D3D12CommandProcessor::LoadShader(xenos::ShaderType shader_type,
                                           uint32_t guest_address,
                                           const uint32_t* host_address,
@@ -1795,6 +2034,9 @@ bool D3D12CommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
   }
   if (enable_mode == xenos::ModeControl::kCopy) {
     // Special copy handling.
+    BenchmarkTimingScope benchmark_timing_scope(
+        benchmark_counters_, benchmark_counters_.resolve_ticks);
+    benchmark_counters_.CountResolve();
     return IssueCopy();
   }
 
@@ -1869,6 +2111,12 @@ bool D3D12CommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
 
   // Set up primitive topology.
   bool indexed = index_buffer_info != nullptr && index_buffer_info->guest_base;
+  // Whether the indices of primitives not supported by Direct3D 12 are loaded
+  // by the vertex shader from the shared memory rather than converted on the
+  // CPU.
+  bool vertex_index_load =
+      indexed && !tessellated &&
+      primitive_converter_->IsIndexLoadInVertexShaderPossible(primitive_type);
   xenos::PrimitiveType primitive_type_converted;
   D3D_PRIMITIVE_TOPOLOGY primitive_topology;
   if (tessellated) {
@@ -1918,11 +2166,13 @@ bool D3D12CommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
     deferred_command_list_->D3DIASetPrimitiveTopology(primitive_topology);
   }
   uint32_t line_loop_closing_index;
-  if (primitive_type == xenos::PrimitiveType::kLineLoop && !indexed &&
-      index_count >= 3) {
+  if (primitive_type == xenos::PrimitiveType::kLineLoop &&
+      (!indexed || vertex_index_load) && index_count >= 3) {
     // Add a vertex to close the loop, and make the vertex shader replace its
     // index (before adding the offset) with 0 to fetch the first vertex again.
-    // For indexed line loops, the primitive converter will add the vertex.
+    // For indexed line loops, the primitive converter will add the vertex,
+    // unless the vertex shader loads the indices, in which case this is the
+    // position of the index in the index buffer.
     line_loop_closing_index = index_count;
     ++index_count;
   } else {
@@ -1948,22 +2198,40 @@ bool D3D12CommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
     early_z = true;
   }
 
-  // Create the pipeline state object if needed and bind it.
-  void* pipeline_state_handle;
-  ID3D12RootSignature* root_signature;
-  if (!pipeline_cache_->ConfigurePipeline(
-          vertex_shader, pixel_shader, primitive_type_converted,
-          indexed ? index_buffer_info->format : xenos::IndexFormat::kInt16,
-          early_z, pipeline_render_targets, &pipeline_state_handle,
-          &root_signature)) {
-    return false;
-  }
-  if (current_cached_pipeline_state_ != pipeline_state_handle) {
-    deferred_command_list_->SetPipelineStateHandle(
-        reinterpret_cast<void*>(pipeline_state_handle));
-    current_cached_pipeline_state_ = pipeline_state_handle;
-    current_external_pipeline_state_ = nullptr;
-  }
+  // Create the pipeline state object if needed and bind it. Runs of draws
+  // with only the constants changed between them are common, skip building
+  // and looking up the pipeline description for them.
+  xenos::IndexFormat pipeline_index_format =
+      indexed ? index_buffer_info->format : xenos::IndexFormat::kInt16;
+  LastPipelineConfiguration& last_pipeline = last_pipeline_configuration_;
+  if (ConsumeRegisterGroupsDirty(uint32_t(1) << kRegisterGroupPipeline) ||
+      !last_pipeline.valid || last_pipeline.vertex_shader != vertex_shader ||
+      last_pipeline.pixel_shader != pixel_shader ||
+      last_pipeline.host_vertex_shader_type != host_vertex_shader_type ||
+      last_pipeline.primitive_type != primitive_type_converted ||
+      last_pipeline.index_format != pipeline_index_format ||
+      last_pipeline.early_z != early_z ||
+      std::memcmp(last_pipeline.render_targets, pipeline_render_targets,
+                  sizeof(last_pipeline.render_targets))) {
+    last_pipeline.valid = false;
+    if (!pipeline_cache_->ConfigurePipeline(
+            vertex_shader, pixel_shader, primitive_type_converted,
+            pipeline_index_format, early_z, pipeline_render_targets,
+            &last_pipeline.pipeline_state_handle,
+            &last_pipeline.root_signature)) {
+      return false;
+    }
+    last_pipeline.valid = true;
+    last_pipeline.vertex_shader = vertex_shader;
+    last_pipeline.pixel_shader = pixel_shader;
+    last_pipeline.host_vertex_shader_type = host_vertex_shader_type;
+    last_pipeline.primitive_type = primitive_type_converted;
+    last_pipeline.index_format = pipeline_index_format;
+    last_pipeline.early_z = early_z;
+    std::memcpy(last_pipeline.render_targets, pipeline_render_targets,
+                sizeof(last_pipeline.render_targets));
+  }
+  ID3D12RootSignature* root_signature = last_pipeline.root_signature;
 
   // Update viewport, scissor, blend factor and stencil reference.
   UpdateFixedFunctionState(primitive_two_faced);
@@ -1972,8 +2240,21 @@ bool D3D12CommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
   UpdateSystemConstantValues(
       memexport_used, primitive_two_faced, line_loop_closing_index,
       indexed ? index_buffer_info->endianness : xenos::Endian::kNone,
-      used_texture_mask, early_z, GetCurrentColorMask(pixel_shader),
-      pipeline_render_targets);
+      vertex_index_load ? index_buffer_info : nullptr, used_texture_mask,
+      early_z, GetCurrentColorMask(pixel_shader), pipeline_render_targets);
+
+  // A version of the pipeline with the bool and loop constants and the ROV
+  // output merger state (from the system constants, thus set after updating
+  // them) folded into the shaders may be used if it has been created - the
+  // bindings are the same, so the root signature is not affected.
+  void* pipeline_state_handle = pipeline_cache_->GetSpecializedPipelineState(
+      last_pipeline.pipeline_state_handle, system_constants_);
+  if (current_cached_pipeline_state_ != pipeline_state_handle) {
+    deferred_command_list_->SetPipelineStateHandle(
+        reinterpret_cast<void*>(pipeline_state_handle));
+    current_cached_pipeline_state_ = pipeline_state_handle;
+    current_external_pipeline_state_ = nullptr;
+  }
 
   // Update constant buffers, descriptors and root parameters.
   if (!UpdateBindings(vertex_shader, pixel_shader, root_signature)) {
@@ -2128,8 +2409,12 @@ bool D3D12CommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
     }
   }
 
+  if (occlusion_query_tracker_) {
+    occlusion_query_tracker_->BeginDraw();
+  }
+
   // Actually draw.
-  if (indexed) {
+  if (indexed && !vertex_index_load) {
     uint32_t index_size =
         index_buffer_info->format == xenos::IndexFormat::kInt32
             ? sizeof(uint32_t)
@@ -2205,12 +2490,31 @@ bool D3D12CommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
     }
     SubmitBarriers();
     deferred_command_list_->D3DIASetIndexBuffer(&index_buffer_view);
+    BeginGpuTiming(GpuTimingCategory::kDraw);
     deferred_command_list_->D3DDrawIndexedInstanced(index_count, 1, 0, 0, 0);
+    EndGpuTiming();
     if (scratch_index_buffer != nullptr) {
       ReleaseScratchGPUBuffer(scratch_index_buffer,
                               D3D12_RESOURCE_STATE_INDEX_BUFFER);
     }
   } else {
+    if (vertex_index_load) {
+      // The vertex shader will load the indices.
+      uint32_t index_size =
+          index_buffer_info->format == xenos::IndexFormat::kInt32
+              ? sizeof(uint32_t)
+              : sizeof(uint16_t);
+      uint32_t index_base =
+          index_buffer_info->guest_base & 0x1FFFFFFF & ~(index_size - 1);
+      uint32_t index_buffer_size = index_buffer_info->count * index_size;
+      if (!shared_memory_->RequestRange(index_base, index_buffer_size)) {
+        XELOGE(
+            "Failed to request index buffer at 0x{:08X} (size {}) in the "
+            "shared memory",
+            index_base, index_buffer_size);
+        return false;
+      }
+    }
     // Check if need to draw using a conversion index buffer.
     uint32_t converted_index_count = 0;
     D3D12_GPU_VIRTUAL_ADDRESS conversion_gpu_address =
@@ -2229,10 +2533,14 @@ bool D3D12CommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
       index_buffer_view.SizeInBytes = converted_index_count * sizeof(uint16_t);
       index_buffer_view.Format = DXGI_FORMAT_R16_UINT;
       deferred_command_list_->D3DIASetIndexBuffer(&index_buffer_view);
+      BeginGpuTiming(GpuTimingCategory::kDraw);
       deferred_command_list_->D3DDrawIndexedInstanced(converted_index_count, 1,
                                                       0, 0, 0);
+      EndGpuTiming();
     } else {
+      BeginGpuTiming(GpuTimingCategory::kDraw);
       deferred_command_list_->D3DDrawInstanced(index_count, 1, 0, 0);
+      EndGpuTiming();
     }
   }
 
@@ -2250,47 +2558,19 @@ bool D3D12CommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
           memexport_range.size_dwords << 2);
     }
     if (cvars::d3d12_readback_memexport) {
-      // Read the exported data on the CPU.
-      uint32_t memexport_total_size = 0;
+      // Read the exported data on the CPU - asynchronously, the guest memory
+      // is updated when it's actually accessed.
+      bool readback_scheduled = false;
       for (uint32_t i = 0; i < memexport_range_count; ++i) {
-        memexport_total_size += memexport_ranges[i].size_dwords << 2;
+        const MemExportRange& memexport_range = memexport_ranges[i];
+        readback_scheduled |= ScheduleSharedMemoryReadback(
+            memexport_range.base_address_dwords << 2,
+            memexport_range.size_dwords << 2);
       }
-      if (memexport_total_size != 0) {
-        ID3D12Resource* readback_buffer =
-            RequestReadbackBuffer(memexport_total_size);
-        if (readback_buffer != nullptr) {
-          shared_memory_->UseAsCopySource();
-          SubmitBarriers();
-          ID3D12Resource* shared_memory_buffer = shared_memory_->GetBuffer();
-          uint32_t readback_buffer_offset = 0;
-          for (uint32_t i = 0; i < memexport_range_count; ++i) {
-            const MemExportRange& memexport_range = memexport_ranges[i];
-            uint32_t memexport_range_size = memexport_range.size_dwords << 2;
-            deferred_command_list_->D3DCopyBufferRegion(
-                readback_buffer, readback_buffer_offset, shared_memory_buffer,
-                memexport_range.base_address_dwords << 2, memexport_range_size);
-            readback_buffer_offset += memexport_range_size;
-          }
-          AwaitAllSubmissionsCompletion();
-          D3D12_RANGE readback_range;
-          readback_range.Begin = 0;
-          readback_range.End = memexport_total_size;
-          void* readback_mapping;
-          if (SUCCEEDED(readback_buffer->Map(0, &readback_range,
-                                             &readback_mapping))) {
-            const uint32_t* readback_dwords =
-                reinterpret_cast<const uint32_t*>(readback_mapping);
-            for (uint32_t i = 0; i < memexport_range_count; ++i) {
-              const MemExportRange& memexport_range = memexport_ranges[i];
-              std::memcpy(memory_->TranslatePhysical(
-                              memexport_range.base_address_dwords << 2),
-                          readback_dwords, memexport_range.size_dwords << 2);
-              readback_dwords += memexport_range.size_dwords;
-            }
-            D3D12_RANGE readback_write_range = {};
-            readback_buffer->Unmap(0, &readback_write_range);
-          }
-        }
+      if (readback_scheduled) {
+        // Only the data from submitted command lists can be provided to the
+        // CPU.
+        EndSubmission(false);
       }
     }
   }
@@ -2327,40 +2607,38 @@ bool D3D12CommandProcessor::IssueCopy() {
 #endif  // FINE_GRAINED_DRAW_SCOPES
   BeginSubmission(true);
   uint32_t written_address, written_length;
-  if (!render_target_cache_->Resolve(*memory_, *shared_memory_, *texture_cache_,
-                                     written_address, written_length)) {
+  BeginGpuTiming(GpuTimingCategory::kResolve);
+  bool resolved =
+      render_target_cache_->Resolve(*memory_, *shared_memory_, *texture_cache_,
+                                    written_address, written_length);
+  EndGpuTiming();
+  if (!resolved) {
     return false;
   }
   if (cvars::d3d12_readback_resolve && !texture_cache_->IsResolutionScale2X() &&
       written_length) {
-    // Read the resolved data on the CPU.
-    ID3D12Resource* readback_buffer = RequestReadbackBuffer(written_length);
-    if (readback_buffer != nullptr) {
-      shared_memory_->UseAsCopySource();
-      SubmitBarriers();
-      ID3D12Resource* shared_memory_buffer = shared_memory_->GetBuffer();
-      deferred_command_list_->D3DCopyBufferRegion(
-          readback_buffer, 0, shared_memory_buffer, written_address,
-          written_length);
-      if (EndSubmission(false)) {
-        AwaitAllSubmissionsCompletion();
-        D3D12_RANGE readback_range;
-        readback_range.Begin = 0;
-        readback_range.End = written_length;
-        void* readback_mapping;
-        if (SUCCEEDED(
-                readback_buffer->Map(0, &readback_range, &readback_mapping))) {
-          std::memcpy(memory_->TranslatePhysical(written_address),
-                      readback_mapping, written_length);
-          D3D12_RANGE readback_write_range = {};
-          readback_buffer->Unmap(0, &readback_write_range);
-        }
-      }
+    // Read the resolved data on the CPU - asynchronously, the guest memory is
+    // updated when it's actually accessed.
+    if (ScheduleSharedMemoryReadback(written_address, written_length)) {
+      // Only the data from submitted command lists can be provided to the CPU.
+      EndSubmission(false);
     }
   }
   return true;
 }
 
+bool D3D12CommandProcessor::IssueOcclusionQueryEvent(
+    uint32_t sample_counts_address, bool is_end) {
+  if (!occlusion_query_tracker_) {
+    return false;
+  }
+  if (!is_end) {
+    occlusion_query_tracker_->BeginGuestQuery(sample_counts_address);
+    return true;
+  }
+  return occlusion_query_tracker_->EndGuestQuery(sample_counts_address);
+}
+
 void D3D12CommandProcessor::CheckSubmissionFence(uint64_t await_submission) {
   assert_true(await_submission <= submission_current_);
   if (await_submission == submission_current_) {
@@ -2427,6 +2705,14 @@ void D3D12CommandProcessor::CheckSubmissionFence(uint64_t await_submission) {
   render_target_cache_->CompletedSubmissionUpdated();
 
   primitive_converter_->CompletedSubmissionUpdated();
+
+  if (occlusion_query_tracker_) {
+    occlusion_query_tracker_->CompletedSubmissionUpdated();
+  }
+
+  if (gpu_timing_tracker_) {
+    gpu_timing_tracker_->CompletedSubmissionUpdated();
+  }
 }
 
 void D3D12CommandProcessor::BeginSubmission(bool is_guest_command) {
@@ -2441,11 +2727,19 @@ void D3D12CommandProcessor::BeginSubmission(bool is_guest_command) {
 
   // Check the fence - needed for all kinds of submissions (to reclaim transient
   // resources early) and specifically for frames (not to queue too many), and
-  // await the availability of the current frame.
-  CheckSubmissionFence(
-      is_opening_frame
-          ? closed_frame_submissions_[frame_current_ % kQueueFrames]
-          : 0);
+  // await the availability of the current frame, or, if fewer frames in flight
+  // are allowed, of a more recent one.
+  uint64_t await_submission = 0;
+  if (is_opening_frame) {
+    uint32_t frames_in_flight = uint32_t(
+        xe::clamp(cvars::gpu_max_frames_in_flight, 1, int32_t(kQueueFrames)));
+    if (frame_current_ >= frames_in_flight) {
+      await_submission =
+          closed_frame_submissions_[(frame_current_ - frames_in_flight) %
+                                    kQueueFrames];
+    }
+  }
+  CheckSubmissionFence(await_submission);
   if (is_opening_frame) {
     // Update the completed frame index, also obtaining the actual completed
     // frame number (since the CPU may be actually less than 3 frames behind)
@@ -2465,6 +2759,10 @@ void D3D12CommandProcessor::BeginSubmission(bool is_guest_command) {
   if (!submission_open_) {
     submission_open_ = true;
 
+    // Invalidate the memory written by the guest since the last submission if
+    // not relying on access violations for this.
+    memory_->PollPhysicalMemoryWriteWatches();
+
     // Start a new deferred command list - will submit it to the real one in the
     // end of the submission (when async pipeline state object creation requests
     // are fulfilled).
@@ -2577,39 +2875,116 @@ bool D3D12CommandProcessor::EndSubmission(bool is_swap) {
 
     pipeline_cache_->EndSubmission();
 
+    if (occlusion_query_tracker_) {
+      occlusion_query_tracker_->EndSubmission();
+    }
+
+    if (gpu_timing_tracker_) {
+      gpu_timing_tracker_->EndSubmission();
+    }
+
     // Submit barriers now because resources with the queued barriers may be
     // destroyed between frames.
     SubmitBarriers();
 
     auto direct_queue = provider.GetDirectQueue();
 
-    // Submit the command list.
-    ID3D12CommandAllocator* command_allocator =
-        command_allocator_writable_first_->command_allocator;
-    command_allocator->Reset();
-    command_list_->Reset(command_allocator, nullptr);
-    deferred_command_list_->Execute(command_list_, command_list_1_);
-    command_list_->Close();
-    ID3D12CommandList* execute_command_lists[] = {command_list_};
-    direct_queue->ExecuteCommandLists(1, execute_command_lists);
-    command_allocator_writable_first_->last_usage_submission =
-        submission_current_;
-    if (command_allocator_submitted_last_) {
-      command_allocator_submitted_last_->next =
-          command_allocator_writable_first_;
+    // Make the direct queue wait for the uploads done on the copy queue.
+    shared_memory_->EndSubmission();
+
+    // Split large submissions into segments recorded in parallel if enabled,
+    // with a command allocator for each segment.
+    recording_segments_.clear();
+    recording_command_allocators_.clear();
+    recording_command_allocators_.push_back(
+        command_allocator_writable_first_->command_allocator);
+    if (!recording_threads_.empty()) {
+      deferred_command_list_->Split(recording_command_lists_.size() + 1,
+                                    kCommandListSegmentMinSize,
+                                    recording_segments_);
+      CommandAllocator* command_allocator =
+          command_allocator_writable_first_->next;
+      while (recording_command_allocators_.size() <
+             recording_segments_.size()) {
+        if (!command_allocator) {
+          ID3D12CommandAllocator* new_command_allocator;
+          if (FAILED(provider.GetDevice()->CreateCommandAllocator(
+                  D3D12_COMMAND_LIST_TYPE_DIRECT,
+                  IID_PPV_ARGS(&new_command_allocator)))) {
+            XELOGE(
+                "Failed to create a command allocator for parallel recording");
+            break;
+          }
+          command_allocator = new CommandAllocator;
+          command_allocator->command_allocator = new_command_allocator;
+          command_allocator->last_usage_submission = 0;
+          command_allocator->next = nullptr;
+          command_allocator_writable_last_->next = command_allocator;
+          command_allocator_writable_last_ = command_allocator;
+        }
+        recording_command_allocators_.push_back(
+            command_allocator->command_allocator);
+        command_allocator = command_allocator->next;
+      }
+      if (recording_command_allocators_.size() < recording_segments_.size()) {
+        // Record the whole submission into one command list.
+        recording_segments_.clear();
+        recording_command_allocators_.resize(1);
+      }
+    }
+
+    // Submit the command lists.
+    size_t segment_count = recording_command_allocators_.size();
+    if (segment_count > 1) {
+      {
+        std::lock_guard<std::mutex> lock(recording_request_lock_);
+        recording_segment_next_ = 1;
+        recording_segment_count_ = segment_count;
+        recording_segments_remaining_ = segment_count - 1;
+        recording_completion_event_->Reset();
+      }
+      recording_request_cond_.notify_all();
+      RecordCommandListSegment(0);
+      xe::threading::Wait(recording_completion_event_.get(), false);
     } else {
-      command_allocator_submitted_first_ = command_allocator_writable_first_;
+      ID3D12CommandAllocator* command_allocator =
+          recording_command_allocators_[0];
+      command_allocator->Reset();
+      command_list_->Reset(command_allocator, nullptr);
+      deferred_command_list_->Execute(command_list_, command_list_1_);
+      command_list_->Close();
+    }
+    recording_execute_command_lists_.clear();
+    recording_execute_command_lists_.push_back(command_list_);
+    for (size_t i = 1; i < segment_count; ++i) {
+      recording_execute_command_lists_.push_back(
+          recording_command_lists_[i - 1].command_list);
     }
-    command_allocator_submitted_last_ = command_allocator_writable_first_;
-    command_allocator_writable_first_ = command_allocator_writable_first_->next;
-    command_allocator_submitted_last_->next = nullptr;
-    if (!command_allocator_writable_first_) {
-      command_allocator_writable_last_ = nullptr;
+    direct_queue->ExecuteCommandLists(UINT(segment_count),
+                                      recording_execute_command_lists_.data());
+    for (size_t i = 0; i < segment_count; ++i) {
+      command_allocator_writable_first_->last_usage_submission =
+          submission_current_;
+      if (command_allocator_submitted_last_) {
+        command_allocator_submitted_last_->next =
+            command_allocator_writable_first_;
+      } else {
+        command_allocator_submitted_first_ = command_allocator_writable_first_;
+      }
+      command_allocator_submitted_last_ = command_allocator_writable_first_;
+      command_allocator_writable_first_ =
+          command_allocator_writable_first_->next;
+      command_allocator_submitted_last_->next = nullptr;
+      if (!command_allocator_writable_first_) {
+        command_allocator_writable_last_ = nullptr;
+      }
     }
 
     direct_queue->Signal(submission_fence_, submission_current_++);
 
     submission_open_ = false;
+
+    SubmitScheduledReadbacks();
   }
 
   if (is_closing_frame) {
@@ -2652,6 +3027,7 @@ bool D3D12CommandProcessor::EndSubmission(bool is_swap) {
       primitive_converter_->ClearCache();
 
       pipeline_cache_->ClearCache();
+      last_pipeline_configuration_.valid = false;
 
       render_target_cache_->ClearCache();
 
@@ -2702,6 +3078,53 @@ void D3D12CommandProcessor::ClearCommandAllocatorCache() {
   command_allocator_writable_last_ = nullptr;
 }
 
+void D3D12CommandProcessor::RecordCommandListSegment(size_t segment_index) {
+  ID3D12GraphicsCommandList* command_list;
+  ID3D12GraphicsCommandList1* command_list_1;
+  if (segment_index) {
+    const RecordingCommandList& recording_command_list =
+        recording_command_lists_[segment_index - 1];
+    command_list = recording_command_list.command_list;
+    command_list_1 = recording_command_list.command_list_1;
+  } else {
+    command_list = command_list_;
+    command_list_1 = command_list_1_;
+  }
+  ID3D12CommandAllocator* command_allocator =
+      recording_command_allocators_[segment_index];
+  command_allocator->Reset();
+  command_list->Reset(command_allocator, nullptr);
+  deferred_command_list_->Execute(command_list, command_list_1,
+                                  recording_segments_[segment_index]);
+  command_list->Close();
+}
+
+void D3D12CommandProcessor::CommandListRecordingThread() {
+  while (true) {
+    size_t segment_index;
+    {
+      std::unique_lock<std::mutex> lock(recording_request_lock_);
+      if (recording_threads_shutdown_) {
+        return;
+      }
+      if (recording_segment_next_ >= recording_segment_count_) {
+        recording_request_cond_.wait(lock);
+        continue;
+      }
+      segment_index = recording_segment_next_++;
+    }
+
+    RecordCommandListSegment(segment_index);
+
+    {
+      std::lock_guard<std::mutex> lock(recording_request_lock_);
+      if (!--recording_segments_remaining_) {
+        recording_completion_event_->Set();
+      }
+    }
+  }
+}
+
 void D3D12CommandProcessor::UpdateFixedFunctionState(bool primitive_two_faced) {
   auto& regs = *register_file_;
 
@@ -2709,126 +3132,134 @@ void D3D12CommandProcessor::UpdateFixedFunctionState(bool primitive_two_faced) {
   SCOPE_profile_cpu_f("gpu");
 #endif  // FINE_GRAINED_DRAW_SCOPES
 
-  // Window parameters.
-  // http://ftp.tku.edu.tw/NetBSD/NetBSD-current/xsrc/external/mit/xf86-video-ati/dist/src/r600_reg_auto_r6xx.h
-  // See r200UpdateWindow:
-  // https://github.com/freedreno/mesa/blob/master/src/mesa/drivers/dri/r200/r200_state.c
-  auto pa_sc_window_offset = regs.Get<reg::PA_SC_WINDOW_OFFSET>();
+  // Viewport and scissor, only if the registers they are calculated from have
+  // been changed or the command list state has been reset.
+  if (ConsumeRegisterGroupsDirty(uint32_t(1)
+                                 << kRegisterGroupViewportScissor) ||
+      ff_viewport_update_needed_ || ff_scissor_update_needed_) {
+    // Window parameters.
+    // http://ftp.tku.edu.tw/NetBSD/NetBSD-current/xsrc/external/mit/xf86-video-ati/dist/src/r600_reg_auto_r6xx.h
+    // See r200UpdateWindow:
+    // https://github.com/freedreno/mesa/blob/master/src/mesa/drivers/dri/r200/r200_state.c
+    auto pa_sc_window_offset = regs.Get<reg::PA_SC_WINDOW_OFFSET>();
+
+    // Supersampling replacing multisampling due to difficulties of emulating
+    // EDRAM with multisampling with RTV/DSV (with ROV, there's MSAA), and also
+    // resolution scale.
+    uint32_t pixel_size_x, pixel_size_y;
+    if (edram_rov_used_) {
+      pixel_size_x = 1;
+      pixel_size_y = 1;
+    } else {
+      xenos::MsaaSamples msaa_samples =
+          regs.Get<reg::RB_SURFACE_INFO>().msaa_samples;
+      pixel_size_x = msaa_samples >= xenos::MsaaSamples::k4X ? 2 : 1;
+      pixel_size_y = msaa_samples >= xenos::MsaaSamples::k2X ? 2 : 1;
+    }
+    if (texture_cache_->IsResolutionScale2X()) {
+      pixel_size_x *= 2;
+      pixel_size_y *= 2;
+    }
 
-  // Supersampling replacing multisampling due to difficulties of emulating
-  // EDRAM with multisampling with RTV/DSV (with ROV, there's MSAA), and also
-  // resolution scale.
-  uint32_t pixel_size_x, pixel_size_y;
-  if (edram_rov_used_) {
-    pixel_size_x = 1;
-    pixel_size_y = 1;
-  } else {
-    xenos::MsaaSamples msaa_samples =
-        regs.Get<reg::RB_SURFACE_INFO>().msaa_samples;
-    pixel_size_x = msaa_samples >= xenos::MsaaSamples::k4X ? 2 : 1;
-    pixel_size_y = msaa_samples >= xenos::MsaaSamples::k2X ? 2 : 1;
-  }
-  if (texture_cache_->IsResolutionScale2X()) {
-    pixel_size_x *= 2;
-    pixel_size_y *= 2;
-  }
+    // Viewport.
+    // PA_CL_VTE_CNTL contains whether offsets and scales are enabled.
+    // http://www.x.org/docs/AMD/old/evergreen_3D_registers_v2.pdf
+    // In games, either all are enabled (for regular drawing) or none are (for
+    // rectangle lists usually).
+    //
+    // If scale/offset is enabled, the Xenos shader is writing (neglecting W
+    // division) position in the NDC (-1, -1, dx_clip_space_def - 1) ->
+    // (1, 1, 1) box. If it's not, the position is in screen space. Since we
+    // can only use the NDC in PC APIs, we use a viewport of the largest
+    // possible size, and divide the position by it in translated shaders.
+    auto pa_cl_vte_cntl = regs.Get<reg::PA_CL_VTE_CNTL>();
+    float viewport_scale_x =
+        pa_cl_vte_cntl.vport_x_scale_ena
+            ? std::abs(regs[XE_GPU_REG_PA_CL_VPORT_XSCALE].f32)
+            : 4096.0f;
+    float viewport_scale_y =
+        pa_cl_vte_cntl.vport_y_scale_ena
+            ? std::abs(regs[XE_GPU_REG_PA_CL_VPORT_YSCALE].f32)
+            : 4096.0f;
+    float viewport_scale_z = pa_cl_vte_cntl.vport_z_scale_ena
+                                 ? regs[XE_GPU_REG_PA_CL_VPORT_ZSCALE].f32
+                                 : 1.0f;
+    float viewport_offset_x = pa_cl_vte_cntl.vport_x_offset_ena
+                                  ? regs[XE_GPU_REG_PA_CL_VPORT_XOFFSET].f32
+                                  : std::abs(viewport_scale_x);
+    float viewport_offset_y = pa_cl_vte_cntl.vport_y_offset_ena
+                                  ? regs[XE_GPU_REG_PA_CL_VPORT_YOFFSET].f32
+                                  : std::abs(viewport_scale_y);
+    float viewport_offset_z = pa_cl_vte_cntl.vport_z_offset_ena
+                                  ? regs[XE_GPU_REG_PA_CL_VPORT_ZOFFSET].f32
+                                  : 0.0f;
+    if (regs.Get<reg::PA_SU_SC_MODE_CNTL>().vtx_window_offset_enable) {
+      viewport_offset_x += float(pa_sc_window_offset.window_x_offset);
+      viewport_offset_y += float(pa_sc_window_offset.window_y_offset);
+    }
+    D3D12_VIEWPORT viewport;
+    viewport.TopLeftX =
+        (viewport_offset_x - viewport_scale_x) * float(pixel_size_x);
+    viewport.TopLeftY =
+        (viewport_offset_y - viewport_scale_y) * float(pixel_size_y);
+    viewport.Width = viewport_scale_x * 2.0f * float(pixel_size_x);
+    viewport.Height = viewport_scale_y * 2.0f * float(pixel_size_y);
+    viewport.MinDepth = viewport_offset_z;
+    viewport.MaxDepth = viewport_offset_z + viewport_scale_z;
+    if (viewport_scale_z < 0.0f) {
+      // MinDepth > MaxDepth doesn't work on Nvidia, emulating it in vertex
+      // shaders and when applying polygon offset.
+      std::swap(viewport.MinDepth, viewport.MaxDepth);
+    }
+    ff_viewport_update_needed_ |= ff_viewport_.TopLeftX != viewport.TopLeftX;
+    ff_viewport_update_needed_ |= ff_viewport_.TopLeftY != viewport.TopLeftY;
+    ff_viewport_update_needed_ |= ff_viewport_.Width != viewport.Width;
+    ff_viewport_update_needed_ |= ff_viewport_.Height != viewport.Height;
+    ff_viewport_update_needed_ |= ff_viewport_.MinDepth != viewport.MinDepth;
+    ff_viewport_update_needed_ |= ff_viewport_.MaxDepth != viewport.MaxDepth;
+    if (ff_viewport_update_needed_) {
+      ff_viewport_ = viewport;
+      deferred_command_list_->RSSetViewport(viewport);
+      ff_viewport_update_needed_ = false;
+    }
 
-  // Viewport.
-  // PA_CL_VTE_CNTL contains whether offsets and scales are enabled.
-  // http://www.x.org/docs/AMD/old/evergreen_3D_registers_v2.pdf
-  // In games, either all are enabled (for regular drawing) or none are (for
-  // rectangle lists usually).
-  //
-  // If scale/offset is enabled, the Xenos shader is writing (neglecting W
-  // division) position in the NDC (-1, -1, dx_clip_space_def - 1) -> (1, 1, 1)
-  // box. If it's not, the position is in screen space. Since we can only use
-  // the NDC in PC APIs, we use a viewport of the largest possible size, and
-  // divide the position by it in translated shaders.
-  auto pa_cl_vte_cntl = regs.Get<reg::PA_CL_VTE_CNTL>();
-  float viewport_scale_x =
-      pa_cl_vte_cntl.vport_x_scale_ena
-          ? std::abs(regs[XE_GPU_REG_PA_CL_VPORT_XSCALE].f32)
-          : 4096.0f;
-  float viewport_scale_y =
-      pa_cl_vte_cntl.vport_y_scale_ena
-          ? std::abs(regs[XE_GPU_REG_PA_CL_VPORT_YSCALE].f32)
-          : 4096.0f;
-  float viewport_scale_z = pa_cl_vte_cntl.vport_z_scale_ena
-                               ? regs[XE_GPU_REG_PA_CL_VPORT_ZSCALE].f32
-                               : 1.0f;
-  float viewport_offset_x = pa_cl_vte_cntl.vport_x_offset_ena
-                                ? regs[XE_GPU_REG_PA_CL_VPORT_XOFFSET].f32
-                                : std::abs(viewport_scale_x);
-  float viewport_offset_y = pa_cl_vte_cntl.vport_y_offset_ena
-                                ? regs[XE_GPU_REG_PA_CL_VPORT_YOFFSET].f32
-                                : std::abs(viewport_scale_y);
-  float viewport_offset_z = pa_cl_vte_cntl.vport_z_offset_ena
-                                ? regs[XE_GPU_REG_PA_CL_VPORT_ZOFFSET].f32
-                                : 0.0f;
-  if (regs.Get<reg::PA_SU_SC_MODE_CNTL>().vtx_window_offset_enable) {
-    viewport_offset_x += float(pa_sc_window_offset.window_x_offset);
-    viewport_offset_y += float(pa_sc_window_offset.window_y_offset);
-  }
-  D3D12_VIEWPORT viewport;
-  viewport.TopLeftX =
-      (viewport_offset_x - viewport_scale_x) * float(pixel_size_x);
-  viewport.TopLeftY =
-      (viewport_offset_y - viewport_scale_y) * float(pixel_size_y);
-  viewport.Width = viewport_scale_x * 2.0f * float(pixel_size_x);
-  viewport.Height = viewport_scale_y * 2.0f * float(pixel_size_y);
-  viewport.MinDepth = viewport_offset_z;
-  viewport.MaxDepth = viewport_offset_z + viewport_scale_z;
-  if (viewport_scale_z < 0.0f) {
-    // MinDepth > MaxDepth doesn't work on Nvidia, emulating it in vertex
-    // shaders and when applying polygon offset.
-    std::swap(viewport.MinDepth, viewport.MaxDepth);
-  }
-  ff_viewport_update_needed_ |= ff_viewport_.TopLeftX != viewport.TopLeftX;
-  ff_viewport_update_needed_ |= ff_viewport_.TopLeftY != viewport.TopLeftY;
-  ff_viewport_update_needed_ |= ff_viewport_.Width != viewport.Width;
-  ff_viewport_update_needed_ |= ff_viewport_.Height != viewport.Height;
-  ff_viewport_update_needed_ |= ff_viewport_.MinDepth != viewport.MinDepth;
-  ff_viewport_update_needed_ |= ff_viewport_.MaxDepth != viewport.MaxDepth;
-  if (ff_viewport_update_needed_) {
-    ff_viewport_ = viewport;
-    deferred_command_list_->RSSetViewport(viewport);
-    ff_viewport_update_needed_ = false;
-  }
-
-  // Scissor.
-  auto pa_sc_window_scissor_tl = regs.Get<reg::PA_SC_WINDOW_SCISSOR_TL>();
-  auto pa_sc_window_scissor_br = regs.Get<reg::PA_SC_WINDOW_SCISSOR_BR>();
-  D3D12_RECT scissor;
-  scissor.left = pa_sc_window_scissor_tl.tl_x;
-  scissor.top = pa_sc_window_scissor_tl.tl_y;
-  scissor.right = pa_sc_window_scissor_br.br_x;
-  scissor.bottom = pa_sc_window_scissor_br.br_y;
-  if (!pa_sc_window_scissor_tl.window_offset_disable) {
-    scissor.left =
-        std::max(scissor.left + pa_sc_window_offset.window_x_offset, LONG(0));
-    scissor.top =
-        std::max(scissor.top + pa_sc_window_offset.window_y_offset, LONG(0));
-    scissor.right =
-        std::max(scissor.right + pa_sc_window_offset.window_x_offset, LONG(0));
-    scissor.bottom =
-        std::max(scissor.bottom + pa_sc_window_offset.window_y_offset, LONG(0));
-  }
-  scissor.left *= pixel_size_x;
-  scissor.top *= pixel_size_y;
-  scissor.right *= pixel_size_x;
-  scissor.bottom *= pixel_size_y;
-  ff_scissor_update_needed_ |= ff_scissor_.left != scissor.left;
-  ff_scissor_update_needed_ |= ff_scissor_.top != scissor.top;
-  ff_scissor_update_needed_ |= ff_scissor_.right != scissor.right;
-  ff_scissor_update_needed_ |= ff_scissor_.bottom != scissor.bottom;
-  if (ff_scissor_update_needed_) {
-    ff_scissor_ = scissor;
-    deferred_command_list_->RSSetScissorRect(scissor);
-    ff_scissor_update_needed_ = false;
+    // Scissor.
+    auto pa_sc_window_scissor_tl = regs.Get<reg::PA_SC_WINDOW_SCISSOR_TL>();
+    auto pa_sc_window_scissor_br = regs.Get<reg::PA_SC_WINDOW_SCISSOR_BR>();
+    D3D12_RECT scissor;
+    scissor.left = pa_sc_window_scissor_tl.tl_x;
+    scissor.top = pa_sc_window_scissor_tl.tl_y;
+    scissor.right = pa_sc_window_scissor_br.br_x;
+    scissor.bottom = pa_sc_window_scissor_br.br_y;
+    if (!pa_sc_window_scissor_tl.window_offset_disable) {
+      scissor.left =
+          std::max(scissor.left + pa_sc_window_offset.window_x_offset, LONG(0));
+      scissor.top =
+          std::max(scissor.top + pa_sc_window_offset.window_y_offset, LONG(0));
+      scissor.right = std::max(
+          scissor.right + pa_sc_window_offset.window_x_offset, LONG(0));
+      scissor.bottom = std::max(
+          scissor.bottom + pa_sc_window_offset.window_y_offset, LONG(0));
+    }
+    scissor.left *= pixel_size_x;
+    scissor.top *= pixel_size_y;
+    scissor.right *= pixel_size_x;
+    scissor.bottom *= pixel_size_y;
+    ff_scissor_update_needed_ |= ff_scissor_.left != scissor.left;
+    ff_scissor_update_needed_ |= ff_scissor_.top != scissor.top;
+    ff_scissor_update_needed_ |= ff_scissor_.right != scissor.right;
+    ff_scissor_update_needed_ |= ff_scissor_.bottom != scissor.bottom;
+    if (ff_scissor_update_needed_) {
+      ff_scissor_ = scissor;
+      deferred_command_list_->RSSetScissorRect(scissor);
+      ff_scissor_update_needed_ = false;
+    }
   }
 
   if (!edram_rov_used_) {
     // Blend factor.
+    ff_blend_factor_update_needed_ |=
+        ConsumeRegisterGroupsDirty(uint32_t(1) << kRegisterGroupBlendFactor);
     ff_blend_factor_update_needed_ |=
         ff_blend_factor_[0] != regs[XE_GPU_REG_RB_BLEND_RED].f32;
     ff_blend_factor_update_needed_ |=
@@ -2871,7 +3302,8 @@ void D3D12CommandProcessor::UpdateFixedFunctionState(bool primitive_two_faced) {
 void D3D12CommandProcessor::UpdateSystemConstantValues(
     bool shared_memory_is_uav, bool primitive_two_faced,
     uint32_t line_loop_closing_index, xenos::Endian index_endian,
-    uint32_t used_texture_mask, bool early_z, uint32_t color_mask,
+    const IndexBufferInfo* vertex_index_load_buffer, uint32_t used_texture_mask,
+    bool early_z, uint32_t color_mask,
     const RenderTargetCache::PipelineRenderTarget render_targets[4]) {
   auto& regs = *register_file_;
 
@@ -2995,6 +3427,13 @@ void D3D12CommandProcessor::UpdateSystemConstantValues(
   if (primitive_two_faced) {
     flags |= DxbcShaderTranslator::kSysFlag_PrimitiveTwoFaced;
   }
+  // Loading the indices of converted primitives in the vertex shader.
+  if (vertex_index_load_buffer) {
+    flags |= DxbcShaderTranslator::kSysFlag_VertexIndexLoad;
+    if (vertex_index_load_buffer->format == xenos::IndexFormat::kInt32) {
+      flags |= DxbcShaderTranslator::kSysFlag_VertexIndexLoad32Bit;
+    }
+  }
   // Primitive killing condition.
   if (pa_cl_clip_cntl.vtx_kill_or) {
     flags |= DxbcShaderTranslator::kSysFlag_KillIfAnyVertexKilled;
@@ -3069,6 +3508,19 @@ void D3D12CommandProcessor::UpdateSystemConstantValues(
   dirty |= system_constants_.vertex_index_endian != index_endian;
   system_constants_.vertex_index_endian = index_endian;
 
+  // Guest index buffer to load the indices from in the vertex shader.
+  uint32_t vertex_index_load_address = 0;
+  if (vertex_index_load_buffer) {
+    vertex_index_load_address =
+        vertex_index_load_buffer->guest_base & 0x1FFFFFFF &
+        (vertex_index_load_buffer->format == xenos::IndexFormat::kInt32
+             ? ~uint32_t(3)
+             : ~uint32_t(1));
+  }
+  dirty |=
+      system_constants_.vertex_index_load_address != vertex_index_load_address;
+  system_constants_.vertex_index_load_address = vertex_index_load_address;
+
   // User clip planes (UCP_ENA_#), when not CLIP_DISABLE.
   if (!pa_cl_clip_cntl.clip_disable) {
     for (uint32_t i = 0; i < 6; ++i) {
@@ -3987,12 +4439,42 @@ bool D3D12CommandProcessor::UpdateBindings(
     bool write_samplers_pixel =
         sampler_count_pixel && !bindful_samplers_written_pixel_;
 
+    // Check if the changed sets have already been written to the current pages
+    // by earlier draws - in this case, if the pages stay the same, only the
+    // descriptor tables need to be changed to point to them.
+    uint64_t texture_set_hash_vertex = 0, texture_set_hash_pixel = 0;
+    uint64_t sampler_set_hash_vertex = 0, sampler_set_hash_pixel = 0;
+    const BindfulTextureSet* texture_set_vertex = nullptr;
+    const BindfulTextureSet* texture_set_pixel = nullptr;
+    const BindfulSamplerSet* sampler_set_vertex = nullptr;
+    const BindfulSamplerSet* sampler_set_pixel = nullptr;
+    if (write_textures_vertex) {
+      texture_set_vertex = FindBindfulTextureSet(
+          draw_view_bindful_heap_index_, texture_layout_uid_vertex,
+          textures_vertex, texture_count_vertex, texture_set_hash_vertex);
+    }
+    if (write_textures_pixel) {
+      texture_set_pixel = FindBindfulTextureSet(
+          draw_view_bindful_heap_index_, texture_layout_uid_pixel,
+          textures_pixel, texture_count_pixel, texture_set_hash_pixel);
+    }
+    if (write_samplers_vertex) {
+      sampler_set_vertex = FindBindfulSamplerSet(
+          draw_sampler_bindful_heap_index_, current_samplers_vertex_.data(),
+          sampler_count_vertex, sampler_set_hash_vertex);
+    }
+    if (write_samplers_pixel) {
+      sampler_set_pixel = FindBindfulSamplerSet(
+          draw_sampler_bindful_heap_index_, current_samplers_pixel_.data(),
+          sampler_count_pixel, sampler_set_hash_pixel);
+    }
+
     // Allocate the descriptors.
     uint32_t view_count_partial_update = 0;
-    if (write_textures_vertex) {
+    if (write_textures_vertex && !texture_set_vertex) {
       view_count_partial_update += texture_count_vertex;
     }
-    if (write_textures_pixel) {
+    if (write_textures_pixel && !texture_set_pixel) {
       view_count_partial_update += texture_count_pixel;
     }
     // All the constants + shared memory SRV and UAV + textures.
@@ -4014,10 +4496,10 @@ bool D3D12CommandProcessor::UpdateBindings(
       return false;
     }
     uint32_t sampler_count_partial_update = 0;
-    if (write_samplers_vertex) {
+    if (write_samplers_vertex && !sampler_set_vertex) {
       sampler_count_partial_update += sampler_count_vertex;
     }
-    if (write_samplers_pixel) {
+    if (write_samplers_pixel && !sampler_set_pixel) {
       sampler_count_partial_update += sampler_count_pixel;
     }
     D3D12_CPU_DESCRIPTOR_HANDLE sampler_cpu_handle = {};
@@ -4042,6 +4524,20 @@ bool D3D12CommandProcessor::UpdateBindings(
       write_textures_pixel = texture_count_pixel != 0;
       bindful_textures_written_vertex_ = false;
       bindful_textures_written_pixel_ = false;
+      // The sets on the previous page can't be referenced anymore, but still
+      // need to be hashed to be added for the new page.
+      texture_set_vertex = nullptr;
+      texture_set_pixel = nullptr;
+      if (write_textures_vertex) {
+        FindBindfulTextureSet(view_heap_index, texture_layout_uid_vertex,
+                              textures_vertex, texture_count_vertex,
+                              texture_set_hash_vertex);
+      }
+      if (write_textures_pixel) {
+        FindBindfulTextureSet(view_heap_index, texture_layout_uid_pixel,
+                              textures_pixel, texture_count_pixel,
+                              texture_set_hash_pixel);
+      }
       // If updating fully, write the shared memory SRV and UAV descriptors and,
       // if needed, the EDRAM descriptor.
       gpu_handle_shared_memory_and_edram_ = view_gpu_handle;
@@ -4067,18 +4563,34 @@ bool D3D12CommandProcessor::UpdateBindings(
       write_samplers_pixel = sampler_count_pixel != 0;
       bindful_samplers_written_vertex_ = false;
       bindful_samplers_written_pixel_ = false;
+      sampler_set_vertex = nullptr;
+      sampler_set_pixel = nullptr;
+      if (write_samplers_vertex) {
+        FindBindfulSamplerSet(sampler_heap_index,
+                              current_samplers_vertex_.data(),
+                              sampler_count_vertex, sampler_set_hash_vertex);
+      }
+      if (write_samplers_pixel) {
+        FindBindfulSamplerSet(sampler_heap_index,
+                              current_samplers_pixel_.data(),
+                              sampler_count_pixel, sampler_set_hash_pixel);
+      }
     }
 
-    // Write the descriptors.
+    // Write the descriptors, or reference the ones already on the page.
     if (write_textures_vertex) {
       assert_true(current_graphics_root_bindful_extras_.textures_vertex !=
                   RootBindfulExtraParameterIndices::kUnavailable);
-      gpu_handle_textures_vertex_ = view_gpu_handle;
-      for (uint32_t i = 0; i < texture_count_vertex; ++i) {
-        texture_cache_->WriteActiveTextureBindfulSRV(textures_vertex[i],
-                                                     view_cpu_handle);
-        view_cpu_handle.ptr += descriptor_size_view;
-        view_gpu_handle.ptr += descriptor_size_view;
+      if (texture_set_vertex) {
+        gpu_handle_textures_vertex_ = texture_set_vertex->gpu_handle;
+      } else {
+        gpu_handle_textures_vertex_ = view_gpu_handle;
+        for (uint32_t i = 0; i < texture_count_vertex; ++i) {
+          texture_cache_->WriteActiveTextureBindfulSRV(textures_vertex[i],
+                                                       view_cpu_handle);
+          view_cpu_handle.ptr += descriptor_size_view;
+          view_gpu_handle.ptr += descriptor_size_view;
+        }
       }
       current_texture_layout_uid_vertex_ = texture_layout_uid_vertex;
       current_texture_srv_keys_vertex_.resize(
@@ -4087,6 +4599,12 @@ bool D3D12CommandProcessor::UpdateBindings(
       texture_cache_->WriteActiveTextureSRVKeys(
           current_texture_srv_keys_vertex_.data(), textures_vertex,
           texture_count_vertex);
+      if (!texture_set_vertex) {
+        AddBindfulTextureSet(view_heap_index, texture_set_hash_vertex,
+                             texture_layout_uid_vertex,
+                             current_texture_srv_keys_vertex_.data(),
+                             texture_count_vertex, gpu_handle_textures_vertex_);
+      }
       bindful_textures_written_vertex_ = true;
       current_graphics_root_up_to_date_ &=
           ~(1u << current_graphics_root_bindful_extras_.textures_vertex);
@@ -4094,12 +4612,16 @@ bool D3D12CommandProcessor::UpdateBindings(
     if (write_textures_pixel) {
       assert_true(current_graphics_root_bindful_extras_.textures_pixel !=
                   RootBindfulExtraParameterIndices::kUnavailable);
-      gpu_handle_textures_pixel_ = view_gpu_handle;
-      for (uint32_t i = 0; i < texture_count_pixel; ++i) {
-        texture_cache_->WriteActiveTextureBindfulSRV(textures_pixel[i],
-                                                     view_cpu_handle);
-        view_cpu_handle.ptr += descriptor_size_view;
-        view_gpu_handle.ptr += descriptor_size_view;
+      if (texture_set_pixel) {
+        gpu_handle_textures_pixel_ = texture_set_pixel->gpu_handle;
+      } else {
+        gpu_handle_textures_pixel_ = view_gpu_handle;
+        for (uint32_t i = 0; i < texture_count_pixel; ++i) {
+          texture_cache_->WriteActiveTextureBindfulSRV(textures_pixel[i],
+                                                       view_cpu_handle);
+          view_cpu_handle.ptr += descriptor_size_view;
+          view_gpu_handle.ptr += descriptor_size_view;
+        }
       }
       current_texture_layout_uid_pixel_ = texture_layout_uid_pixel;
       current_texture_srv_keys_pixel_.resize(std::max(
@@ -4107,6 +4629,12 @@ bool D3D12CommandProcessor::UpdateBindings(
       texture_cache_->WriteActiveTextureSRVKeys(
           current_texture_srv_keys_pixel_.data(), textures_pixel,
           texture_count_pixel);
+      if (!texture_set_pixel) {
+        AddBindfulTextureSet(view_heap_index, texture_set_hash_pixel,
+                             texture_layout_uid_pixel,
+                             current_texture_srv_keys_pixel_.data(),
+                             texture_count_pixel, gpu_handle_textures_pixel_);
+      }
       bindful_textures_written_pixel_ = true;
       current_graphics_root_up_to_date_ &=
           ~(1u << current_graphics_root_bindful_extras_.textures_pixel);
@@ -4114,12 +4642,19 @@ bool D3D12CommandProcessor::UpdateBindings(
     if (write_samplers_vertex) {
       assert_true(current_graphics_root_bindful_extras_.samplers_vertex !=
                   RootBindfulExtraParameterIndices::kUnavailable);
-      gpu_handle_samplers_vertex_ = sampler_gpu_handle;
-      for (uint32_t i = 0; i < sampler_count_vertex; ++i) {
-        texture_cache_->WriteSampler(current_samplers_vertex_[i],
-                                     sampler_cpu_handle);
-        sampler_cpu_handle.ptr += descriptor_size_sampler;
-        sampler_gpu_handle.ptr += descriptor_size_sampler;
+      if (sampler_set_vertex) {
+        gpu_handle_samplers_vertex_ = sampler_set_vertex->gpu_handle;
+      } else {
+        gpu_handle_samplers_vertex_ = sampler_gpu_handle;
+        for (uint32_t i = 0; i < sampler_count_vertex; ++i) {
+          texture_cache_->WriteSampler(current_samplers_vertex_[i],
+                                       sampler_cpu_handle);
+          sampler_cpu_handle.ptr += descriptor_size_sampler;
+          sampler_gpu_handle.ptr += descriptor_size_sampler;
+        }
+        AddBindfulSamplerSet(sampler_heap_index, sampler_set_hash_vertex,
+                             current_samplers_vertex_.data(),
+                             sampler_count_vertex, gpu_handle_samplers_vertex_);
       }
       // Current samplers have already been updated.
       bindful_samplers_written_vertex_ = true;
@@ -4129,12 +4664,19 @@ bool D3D12CommandProcessor::UpdateBindings(
     if (write_samplers_pixel) {
       assert_true(current_graphics_root_bindful_extras_.samplers_pixel !=
                   RootBindfulExtraParameterIndices::kUnavailable);
-      gpu_handle_samplers_pixel_ = sampler_gpu_handle;
-      for (uint32_t i = 0; i < sampler_count_pixel; ++i) {
-        texture_cache_->WriteSampler(current_samplers_pixel_[i],
-                                     sampler_cpu_handle);
-        sampler_cpu_handle.ptr += descriptor_size_sampler;
-        sampler_gpu_handle.ptr += descriptor_size_sampler;
+      if (sampler_set_pixel) {
+        gpu_handle_samplers_pixel_ = sampler_set_pixel->gpu_handle;
+      } else {
+        gpu_handle_samplers_pixel_ = sampler_gpu_handle;
+        for (uint32_t i = 0; i < sampler_count_pixel; ++i) {
+          texture_cache_->WriteSampler(current_samplers_pixel_[i],
+                                       sampler_cpu_handle);
+          sampler_cpu_handle.ptr += descriptor_size_sampler;
+          sampler_gpu_handle.ptr += descriptor_size_sampler;
+        }
+        AddBindfulSamplerSet(sampler_heap_index, sampler_set_hash_pixel,
+                             current_samplers_pixel_.data(),
+                             sampler_count_pixel, gpu_handle_samplers_pixel_);
       }
       // Current samplers have already been updated.
       bindful_samplers_written_pixel_ = true;
@@ -4261,6 +4803,102 @@ bool D3D12CommandProcessor::UpdateBindings(
   return true;
 }
 
+const D3D12CommandProcessor::BindfulTextureSet*
+D3D12CommandProcessor::FindBindfulTextureSet(
+    uint64_t heap_index, size_t layout_uid,
+    const D3D12Shader::TextureBinding* bindings, uint32_t binding_count,
+    uint64_t& hash_out) {
+  bindful_texture_set_srv_keys_temp_.resize(std::max(
+      bindful_texture_set_srv_keys_temp_.size(), size_t(binding_count)));
+  TextureCache::TextureSRVKey* srv_keys =
+      bindful_texture_set_srv_keys_temp_.data();
+  texture_cache_->WriteActiveTextureSRVKeys(srv_keys, bindings, binding_count);
+  // Hashing the fields individually since the key structure has padding.
+  XXH64_state_t hash_state;
+  XXH64_reset(&hash_state, 0);
+  XXH64_update(&hash_state, &layout_uid, sizeof(layout_uid));
+  for (uint32_t i = 0; i < binding_count; ++i) {
+    const TextureCache::TextureSRVKey& srv_key = srv_keys[i];
+    uint32_t key_data[] = {
+        srv_key.key.map_key[0],     srv_key.key.map_key[1],
+        srv_key.key.bucket_key,     uint32_t(srv_key.resource_uid),
+        uint32_t(srv_key.resource_uid >> 32),
+        uint32_t(srv_key.resource_uid_signed),
+        uint32_t(srv_key.resource_uid_signed >> 32),
+        srv_key.host_swizzle,       srv_key.swizzled_signs,
+    };
+    XXH64_update(&hash_state, key_data, sizeof(key_data));
+  }
+  uint64_t hash = XXH64_digest(&hash_state);
+  hash_out = hash;
+  if (bindful_texture_sets_heap_index_ != heap_index) {
+    return nullptr;
+  }
+  auto found_range = bindful_texture_sets_.equal_range(hash);
+  for (auto it = found_range.first; it != found_range.second; ++it) {
+    const BindfulTextureSet& texture_set = it->second;
+    if (texture_set.layout_uid == layout_uid &&
+        texture_set.srv_keys.size() == binding_count &&
+        texture_cache_->AreActiveTextureSRVKeysUpToDate(
+            texture_set.srv_keys.data(), bindings, binding_count)) {
+      return &texture_set;
+    }
+  }
+  return nullptr;
+}
+
+const D3D12CommandProcessor::BindfulSamplerSet*
+D3D12CommandProcessor::FindBindfulSamplerSet(
+    uint64_t heap_index, const TextureCache::SamplerParameters* samplers,
+    uint32_t sampler_count, uint64_t& hash_out) {
+  // SamplerParameters is a single uint32_t with the unused bits cleared.
+  uint64_t hash = XXH64(samplers, sizeof(*samplers) * sampler_count, 0);
+  hash_out = hash;
+  if (bindful_sampler_sets_heap_index_ != heap_index) {
+    return nullptr;
+  }
+  auto found_range = bindful_sampler_sets_.equal_range(hash);
+  for (auto it = found_range.first; it != found_range.second; ++it) {
+    const BindfulSamplerSet& sampler_set = it->second;
+    if (sampler_set.samplers.size() == sampler_count &&
+        std::equal(samplers, samplers + sampler_count,
+                   sampler_set.samplers.cbegin())) {
+      return &sampler_set;
+    }
+  }
+  return nullptr;
+}
+
+void D3D12CommandProcessor::AddBindfulTextureSet(
+    uint64_t heap_index, uint64_t hash, size_t layout_uid,
+    const TextureCache::TextureSRVKey* srv_keys, uint32_t count,
+    D3D12_GPU_DESCRIPTOR_HANDLE gpu_handle) {
+  if (bindful_texture_sets_heap_index_ != heap_index) {
+    // The sets written to the previous page can't be referenced anymore.
+    bindful_texture_sets_.clear();
+    bindful_texture_sets_heap_index_ = heap_index;
+  }
+  BindfulTextureSet& texture_set =
+      bindful_texture_sets_.emplace(hash, BindfulTextureSet())->second;
+  texture_set.layout_uid = layout_uid;
+  texture_set.srv_keys.assign(srv_keys, srv_keys + count);
+  texture_set.gpu_handle = gpu_handle;
+}
+
+void D3D12CommandProcessor::AddBindfulSamplerSet(
+    uint64_t heap_index, uint64_t hash,
+    const TextureCache::SamplerParameters* samplers, uint32_t count,
+    D3D12_GPU_DESCRIPTOR_HANDLE gpu_handle) {
+  if (bindful_sampler_sets_heap_index_ != heap_index) {
+    bindful_sampler_sets_.clear();
+    bindful_sampler_sets_heap_index_ = heap_index;
+  }
+  BindfulSamplerSet& sampler_set =
+      bindful_sampler_sets_.emplace(hash, BindfulSamplerSet())->second;
+  sampler_set.samplers.assign(samplers, samplers + count);
+  sampler_set.gpu_handle = gpu_handle;
+}
+
 uint32_t D3D12CommandProcessor::GetSupportedMemExportFormatSize(
     xenos::ColorFormat format) {
   switch (format) {
@@ -4318,6 +4956,203 @@ ID3D12Resource* D3D12CommandProcessor::RequestReadbackBuffer(uint32_t size) {
   return readback_buffer_;
 }
 
+bool D3D12CommandProcessor::ScheduleSharedMemoryReadback(uint32_t address,
+                                                         uint32_t length) {
+  if (!length) {
+    return false;
+  }
+  if (!readback_ring_buffer_) {
+    auto& provider = GetD3D12Context().GetD3D12Provider();
+    D3D12_RESOURCE_DESC buffer_desc;
+    ui::d3d12::util::FillBufferResourceDesc(buffer_desc, kReadbackRingSize,
+                                            D3D12_RESOURCE_FLAG_NONE);
+    if (FAILED(provider.GetDevice()->CreateCommittedResource(
+            &ui::d3d12::util::kHeapPropertiesReadback,
+            provider.GetHeapFlagCreateNotZeroed(), &buffer_desc,
+            D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
+            IID_PPV_ARGS(&readback_ring_buffer_)))) {
+      XELOGE("Failed to create the {} MB readback ring buffer",
+             kReadbackRingSize >> 20);
+      return false;
+    }
+    // Readback buffers may stay mapped, the data is read from the mapping only
+    // after the GPU has finished writing it.
+    D3D12_RANGE readback_range;
+    readback_range.Begin = 0;
+    readback_range.End = kReadbackRingSize;
+    void* readback_ring_mapping;
+    if (FAILED(readback_ring_buffer_->Map(0, &readback_range,
+                                          &readback_ring_mapping))) {
+      XELOGE("Failed to map the readback ring buffer");
+      ui::d3d12::util::ReleaseAndNull(readback_ring_buffer_);
+      return false;
+    }
+    readback_ring_mapping_ =
+        reinterpret_cast<const uint8_t*>(readback_ring_mapping);
+  }
+  while (length) {
+    uint32_t chunk_length = std::min(length, kReadbackRingSize);
+    // May end the current submission if the ring is full of its readbacks.
+    uint32_t ring_offset = AllocateReadbackRing(chunk_length);
+    BeginSubmission(false);
+    shared_memory_->UseAsCopySource();
+    SubmitBarriers();
+    deferred_command_list_->D3DCopyBufferRegion(
+        readback_ring_buffer_, ring_offset, shared_memory_->GetBuffer(),
+        address, chunk_length);
+    Readback& readback = readbacks_unsubmitted_.emplace_back();
+    readback.submission = submission_current_;
+    readback.ring_offset = ring_offset;
+    readback.address = address;
+    readback.length = chunk_length;
+    address += chunk_length;
+    length -= chunk_length;
+  }
+  return true;
+}
+
+uint32_t D3D12CommandProcessor::AllocateReadbackRing(uint32_t length) {
+  assert_true(length && length <= kReadbackRingSize);
+  while (!readback_ring_allocations_.empty()) {
+    uint32_t ring_head = readback_ring_allocations_.front().offset;
+    if (readback_ring_write_ > ring_head) {
+      if (kReadbackRingSize - readback_ring_write_ >= length) {
+        break;
+      }
+      if (ring_head >= length) {
+        readback_ring_write_ = 0;
+        break;
+      }
+    } else if (readback_ring_write_ < ring_head) {
+      if (ring_head - readback_ring_write_ >= length) {
+        break;
+      }
+    }
+    // The write position is at the head of the ring if it's full.
+    RetireReadbackRingAllocation();
+  }
+  if (readback_ring_allocations_.empty()) {
+    readback_ring_write_ = 0;
+  }
+  ReadbackRingAllocation& allocation =
+      readback_ring_allocations_.emplace_back();
+  allocation.submission = submission_current_;
+  allocation.offset = readback_ring_write_;
+  allocation.length = length;
+  readback_ring_write_ += length;
+  return allocation.offset;
+}
+
+void D3D12CommandProcessor::RetireReadbackRingAllocation() {
+  assert_false(readback_ring_allocations_.empty());
+  ReadbackRingAllocation allocation = readback_ring_allocations_.front();
+  // Submits the readbacks if they are from the current submission.
+  CheckSubmissionFence(allocation.submission);
+  auto is_in_allocation = [&allocation](const Readback& readback) {
+    return readback.ring_offset >= allocation.offset &&
+           readback.ring_offset - allocation.offset < allocation.length;
+  };
+  // Write the data not taken by the CPU yet to the guest memory through the
+  // data providers so the pages are unprotected too. Can't hold the mutex
+  // while doing this since the data provider locks it itself.
+  readback_retire_ranges_.clear();
+  {
+    std::lock_guard<std::mutex> readbacks_lock(readbacks_mutex_);
+    for (const Readback& readback : readbacks_) {
+      if (is_in_allocation(readback)) {
+        readback_retire_ranges_.emplace_back(readback.address,
+                                             readback.length);
+      }
+    }
+  }
+  for (const std::pair<uint32_t, uint32_t>& range : readback_retire_ranges_) {
+    memory_->TriggerPhysicalMemoryDataProviders(range.first, range.second);
+  }
+  {
+    // Drop what hasn't been provided (if the pages have been made inaccessible
+    // to the guest, for instance), the ring space will be reused.
+    std::lock_guard<std::mutex> readbacks_lock(readbacks_mutex_);
+    readbacks_.erase(
+        std::remove_if(readbacks_.begin(), readbacks_.end(), is_in_allocation),
+        readbacks_.end());
+  }
+  readback_ring_allocations_.pop_front();
+}
+
+void D3D12CommandProcessor::SubmitScheduledReadbacks() {
+  if (readbacks_unsubmitted_.empty()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> readbacks_lock(readbacks_mutex_);
+    for (const Readback& readback : readbacks_unsubmitted_) {
+      // The older data not taken by the CPU yet has been overwritten.
+      ApplyReadbacksLocked(readback.address, readback.length, false);
+      readbacks_.push_back(readback);
+    }
+  }
+  // Not holding the mutex while locking the global critical region.
+  for (const Readback& readback : readbacks_unsubmitted_) {
+    memory_->EnablePhysicalMemoryAccessCallbacks(
+        readback.address, readback.length, false, true);
+  }
+  readbacks_unsubmitted_.clear();
+}
+
+void D3D12CommandProcessor::ApplyReadbacksLocked(uint32_t address,
+                                                 uint32_t length,
+                                                 bool write_to_memory) {
+  uint32_t end = address + length;
+  for (size_t i = 0; i < readbacks_.size();) {
+    Readback readback = readbacks_[i];
+    uint32_t readback_end = readback.address + readback.length;
+    if (readback.address >= end || readback_end <= address) {
+      ++i;
+      continue;
+    }
+    uint32_t overlap_start = std::max(readback.address, address);
+    uint32_t overlap_end = std::min(readback_end, end);
+    if (write_to_memory) {
+      // Submitted already, so the fence will be signaled without the command
+      // processor thread doing anything.
+      if (submission_fence_->GetCompletedValue() < readback.submission) {
+        submission_fence_->SetEventOnCompletion(
+            readback.submission, readback_fence_completion_event_);
+        WaitForSingleObject(readback_fence_completion_event_, INFINITE);
+      }
+      std::memcpy(memory_->TranslatePhysical(overlap_start),
+                  readback_ring_mapping_ + readback.ring_offset +
+                      (overlap_start - readback.address),
+                  overlap_end - overlap_start);
+    }
+    // Keep the parts outside the range, appending them to the end where they
+    // will be skipped.
+    readbacks_[i] = readbacks_.back();
+    readbacks_.pop_back();
+    if (readback.address < overlap_start) {
+      Readback& readback_head = readbacks_.emplace_back(readback);
+      readback_head.length = overlap_start - readback.address;
+    }
+    if (overlap_end < readback_end) {
+      Readback& readback_tail = readbacks_.emplace_back(readback);
+      readback_tail.ring_offset += overlap_end - readback.address;
+      readback_tail.address = overlap_end;
+      readback_tail.length = readback_end - overlap_end;
+    }
+  }
+}
+
+void D3D12CommandProcessor::ReadbackDataProviderThunk(
+    void* context_ptr, uint32_t physical_address_start, uint32_t length,
+    bool discard) {
+  auto command_processor =
+      reinterpret_cast<D3D12CommandProcessor*>(context_ptr);
+  std::lock_guard<std::mutex> readbacks_lock(
+      command_processor->readbacks_mutex_);
+  command_processor->ApplyReadbacksLocked(physical_address_start, length,
+                                          !discard);
+}
+
 void D3D12CommandProcessor::WriteGammaRampSRV(
     bool is_pwl, D3D12_CPU_DESCRIPTOR_HANDLE handle) const {
   auto device = GetD3D12Context().GetD3D12Provider().GetDevice();
@@ -11,16 +11,22 @@
 #define XENIA_GPU_D3D12_D3D12_COMMAND_PROCESSOR_H_
 
 #include <atomic>
+#include <condition_variable>
 #include <deque>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "xenia/base/cvar.h"
+#include "xenia/base/threading.h"
 #include "xenia/gpu/command_processor.h"
 #include "xenia/gpu/d3d12/d3d12_graphics_system.h"
 #include "xenia/gpu/d3d12/deferred_command_list.h"
+#include "xenia/gpu/d3d12/gpu_timing_tracker.h"
+#include "xenia/gpu/d3d12/occlusion_query_tracker.h"
 #include "xenia/gpu/d3d12/pipeline_cache.h"
 #include "xenia/gpu/d3d12/primitive_converter.h"
 #include "xenia/gpu/d3d12/render_target_cache.h"
@@ -58,6 +64,21 @@ class D3D12CommandProcessor : public CommandProcessor {
 
   void RestoreEdramSnapshot(const void* snapshot) override;
 
+  bool GetGpuFrameTiming(double* microseconds_out) const override;
+
+  // Measures the GPU time of the commands until EndGpuTiming if GPU timing is
+  // enabled. Must be ended in the same submission.
+  void BeginGpuTiming(GpuTimingCategory category) {
+    if (gpu_timing_tracker_) {
+      gpu_timing_tracker_->BeginScope(category);
+    }
+  }
+  void EndGpuTiming() {
+    if (gpu_timing_tracker_) {
+      gpu_timing_tracker_->EndScope();
+    }
+  }
+
   // Needed by everything that owns transient objects.
   ui::d3d12::D3D12Context& GetD3D12Context() const {
     return static_cast<ui::d3d12::D3D12Context&>(*context_);
@@ -196,12 +217,16 @@ class D3D12CommandProcessor : public CommandProcessor {
   void ShutdownContext() override;
 
   void WriteRegister(uint32_t index, uint32_t value) override;
+  void OnShaderConstantsChanged(uint32_t first_index,
+                                uint32_t last_index) override;
 
   void PerformSwap(uint32_t frontbuffer_ptr, uint32_t frontbuffer_width,
                    uint32_t frontbuffer_height) override;
 
   void OnPrimaryBufferEnd() override;
 
+  void PrepareForWait() override;
+
   Shader* LoadShader(xenos::ShaderType shader_type, uint32_t guest_address,
                      const uint32_t* host_address,
                      uint32_t dword_count) override;
@@ -210,6 +235,8 @@ class D3D12CommandProcessor : public CommandProcessor {
                  IndexBufferInfo* index_buffer_info,
                  bool major_mode_explicit) override;
   bool IssueCopy() override;
+  bool IssueOcclusionQueryEvent(uint32_t sample_counts_address,
+                                bool is_end) override;
 
   void InitializeTrace() override;
   void FinalizeTrace() override;
@@ -314,6 +341,10 @@ class D3D12CommandProcessor : public CommandProcessor {
   void AwaitAllSubmissionsCompletion();
   // Need to await submission completion before calling.
   void ClearCommandAllocatorCache();
+  // Records a segment of the deferred command list of the submission being
+  // ended into its command list.
+  void RecordCommandListSegment(size_t segment_index);
+  void CommandListRecordingThread();
 
   // Request descriptors and automatically rebind the descriptor heap on the
   // draw command list. Refer to D3D12DescriptorHeapPool::Request for partial /
@@ -329,16 +360,60 @@ class D3D12CommandProcessor : public CommandProcessor {
       D3D12_CPU_DESCRIPTOR_HANDLE& cpu_handle_out,
       D3D12_GPU_DESCRIPTOR_HANDLE& gpu_handle_out);
 
+  // Groups of the registers the fixed-function state is derived from.
+  enum RegisterGroup : uint32_t {
+    kRegisterGroupViewportScissor,
+    kRegisterGroupBlendFactor,
+    // All registers other than the shader constants.
+    kRegisterGroupPipeline,
+  };
   void UpdateFixedFunctionState(bool primitive_two_faced);
   void UpdateSystemConstantValues(
       bool shared_memory_is_uav, bool primitive_two_faced,
       uint32_t line_loop_closing_index, xenos::Endian index_endian,
+      const IndexBufferInfo* vertex_index_load_buffer,
       uint32_t used_texture_mask, bool early_z, uint32_t color_mask,
       const RenderTargetCache::PipelineRenderTarget render_targets[4]);
   bool UpdateBindings(const D3D12Shader* vertex_shader,
                       const D3D12Shader* pixel_shader,
                       ID3D12RootSignature* root_signature);
 
+  // Texture and sampler descriptor sets already written to the current bindful
+  // descriptor heap pages, so draws switching between a few binding sets (like
+  // alternating materials) can point the root descriptor tables to the
+  // existing descriptors instead of writing them again. The pages are only
+  // reused after the submissions referencing them have been completed, and
+  // heap indices are never repeated, so the sets stay valid while the draw
+  // heap index (thus the page) is the same as the one they were written to.
+  struct BindfulTextureSet {
+    size_t layout_uid;
+    std::vector<TextureCache::TextureSRVKey> srv_keys;
+    D3D12_GPU_DESCRIPTOR_HANDLE gpu_handle;
+  };
+  struct BindfulSamplerSet {
+    std::vector<TextureCache::SamplerParameters> samplers;
+    D3D12_GPU_DESCRIPTOR_HANDLE gpu_handle;
+  };
+  // Looks up a set written to the page with the specified heap index, always
+  // writing the hash of the set to hash_out so it can be added after writing
+  // if not found.
+  const BindfulTextureSet* FindBindfulTextureSet(
+      uint64_t heap_index, size_t layout_uid,
+      const D3D12Shader::TextureBinding* bindings, uint32_t binding_count,
+      uint64_t& hash_out);
+  const BindfulSamplerSet* FindBindfulSamplerSet(
+      uint64_t heap_index, const TextureCache::SamplerParameters* samplers,
+      uint32_t sampler_count, uint64_t& hash_out);
+  void AddBindfulTextureSet(uint64_t heap_index, uint64_t hash,
+                            size_t layout_uid,
+                            const TextureCache::TextureSRVKey* srv_keys,
+                            uint32_t count,
+                            D3D12_GPU_DESCRIPTOR_HANDLE gpu_handle);
+  void AddBindfulSamplerSet(uint64_t heap_index, uint64_t hash,
+                            const TextureCache::SamplerParameters* samplers,
+                            uint32_t count,
+                            D3D12_GPU_DESCRIPTOR_HANDLE gpu_handle);
+
   // Returns dword count for one element for a memexport format, or 0 if it's
   // not supported by the D3D12 command processor (if it's smaller that 1 dword,
   // for instance).
@@ -350,6 +425,28 @@ class D3D12CommandProcessor : public CommandProcessor {
   // synchronizing immediately after use. Always in COPY_DEST state.
   ID3D12Resource* RequestReadbackBuffer(uint32_t size);
 
+  // Copies a range of the shared memory to the readback ring, to be written to
+  // the guest memory when the CPU accesses it after the submission is ended,
+  // without waiting for the GPU immediately. Returns whether any copy has been
+  // recorded.
+  bool ScheduleSharedMemoryReadback(uint32_t address, uint32_t length);
+  // Allocates readback ring space for the current submission, retiring old
+  // readbacks if there's not enough free space.
+  uint32_t AllocateReadbackRing(uint32_t length);
+  // Waits for the oldest readback ring allocation and writes the data from it
+  // that hasn't been taken by the CPU yet to the guest memory.
+  void RetireReadbackRingAllocation();
+  // Makes the readbacks recorded in the submission that has just been
+  // submitted available to the data provider.
+  void SubmitScheduledReadbacks();
+  // Writes the readback data overlapping the range to the guest memory, waiting
+  // for the GPU if needed, or drops it. readbacks_mutex_ must be locked.
+  void ApplyReadbacksLocked(uint32_t address, uint32_t length,
+                            bool write_to_memory);
+  static void ReadbackDataProviderThunk(void* context_ptr,
+                                        uint32_t physical_address_start,
+                                        uint32_t length, bool discard);
+
   void WriteGammaRampSRV(bool is_pwl, D3D12_CPU_DESCRIPTOR_HANDLE handle) const;
 
   bool cache_clear_requested_ = false;
@@ -382,6 +479,34 @@ class D3D12CommandProcessor : public CommandProcessor {
   ID3D12GraphicsCommandList1* command_list_1_ = nullptr;
   std::unique_ptr<DeferredCommandList> deferred_command_list_;
 
+  // Large submissions are split into segments, with the first recorded into
+  // command_list_ by the command processor thread, and the rest recorded into
+  // additional command lists by the recording threads in parallel, and then
+  // executed in order.
+  static constexpr size_t kCommandListSegmentMinSize = 64 * 1024;
+  struct RecordingCommandList {
+    ID3D12GraphicsCommandList* command_list;
+    ID3D12GraphicsCommandList1* command_list_1;
+  };
+  // Command lists for the segments after the first, one per recording thread.
+  std::vector<RecordingCommandList> recording_command_lists_;
+  // Segments of the submission being ended and the command allocators they
+  // are recorded with, modified only when no segments are being recorded.
+  std::vector<DeferredCommandList::Segment> recording_segments_;
+  std::vector<ID3D12CommandAllocator*> recording_command_allocators_;
+  std::vector<ID3D12CommandList*> recording_execute_command_lists_;
+  std::mutex recording_request_lock_;
+  std::condition_variable recording_request_cond_;
+  // Protected with recording_request_lock_, notify_all recording_request_cond_
+  // when new segments are requested or shutting down.
+  size_t recording_segment_next_ = 0;
+  size_t recording_segment_count_ = 0;
+  size_t recording_segments_remaining_ = 0;
+  bool recording_threads_shutdown_ = false;
+  // Set when all requested segments after the first have been recorded.
+  std::unique_ptr<xe::threading::Event> recording_completion_event_;
+  std::vector<std::unique_ptr<xe::threading::Thread>> recording_threads_;
+
   // Should bindless textures and samplers be used - many times faster
   // UpdateBindings than bindful (that becomes a significant bottleneck with
   // bindful - mainly because of CopyDescriptorsSimple, which takes the majority
@@ -464,10 +589,19 @@ class D3D12CommandProcessor : public CommandProcessor {
 
   std::unique_ptr<PrimitiveConverter> primitive_converter_;
 
+  // Null if the fake sample count is used for occlusion queries.
+  std::unique_ptr<OcclusionQueryTracker> occlusion_query_tracker_;
+
+  // Null if GPU timing instrumentation is disabled.
+  std::unique_ptr<GpuTimingTracker> gpu_timing_tracker_;
+
   // Mip 0 contains the normal gamma ramp (256 entries), mip 1 contains the PWL
   // ramp (128 entries). DXGI_FORMAT_R10G10B10A2_UNORM 1D.
   ID3D12Resource* gamma_ramp_texture_ = nullptr;
   D3D12_RESOURCE_STATES gamma_ramp_texture_state_;
+  // Whether the last uploaded ramps map every value to itself.
+  bool gamma_ramp_normal_identity_ = false;
+  bool gamma_ramp_pwl_identity_ = false;
   // Upload buffer for an image that is the same as gamma_ramp_, but with
   // kQueueFrames array layers.
   ID3D12Resource* gamma_ramp_upload_ = nullptr;
@@ -510,6 +644,40 @@ class D3D12CommandProcessor : public CommandProcessor {
   ID3D12Resource* readback_buffer_ = nullptr;
   uint32_t readback_buffer_size_ = 0;
 
+  // Asynchronous readback of the shared memory for the CPU (memexport and
+  // resolve results). The data is copied to a persistently mapped ring buffer,
+  // and the pages are protected with physical memory data providers, so it's
+  // written to the guest memory only when the CPU accesses it - and if the GPU
+  // writes the same memory again before that, the older data is just dropped.
+  static constexpr uint32_t kReadbackRingSize = 32 * 1024 * 1024;
+  ID3D12Resource* readback_ring_buffer_ = nullptr;
+  const uint8_t* readback_ring_mapping_ = nullptr;
+  uint32_t readback_ring_write_ = 0;
+  struct ReadbackRingAllocation {
+    uint64_t submission;
+    uint32_t offset;
+    uint32_t length;
+  };
+  // Sorted by the submission number.
+  std::deque<ReadbackRingAllocation> readback_ring_allocations_;
+  struct Readback {
+    uint64_t submission;
+    uint32_t ring_offset;
+    uint32_t address;
+    uint32_t length;
+  };
+  // Recorded in the current submission, not available to the data provider
+  // until submitted, so it never waits for the command processor thread.
+  std::vector<Readback> readbacks_unsubmitted_;
+  // Not written to the guest memory yet, non-overlapping. Accessed by the data
+  // provider on any thread, protected by readbacks_mutex_.
+  std::vector<Readback> readbacks_;
+  std::mutex readbacks_mutex_;
+  // Used only with readbacks_mutex_ locked.
+  HANDLE readback_fence_completion_event_ = nullptr;
+  void* readback_data_provider_handle_ = nullptr;
+  std::vector<std::pair<uint32_t, uint32_t>> readback_retire_ranges_;
+
   std::atomic<bool> pix_capture_requested_ = false;
   bool pix_capturing_;
 
@@ -534,6 +702,23 @@ class D3D12CommandProcessor : public CommandProcessor {
   void* current_cached_pipeline_state_;
   ID3D12PipelineState* current_external_pipeline_state_;
 
+  // Arguments and results of the last ConfigurePipeline call, reused for runs
+  // of draws with no register writes other than to the shader constants in
+  // between.
+  struct LastPipelineConfiguration {
+    bool valid;
+    D3D12Shader* vertex_shader;
+    D3D12Shader* pixel_shader;
+    Shader::HostVertexShaderType host_vertex_shader_type;
+    xenos::PrimitiveType primitive_type;
+    xenos::IndexFormat index_format;
+    bool early_z;
+    RenderTargetCache::PipelineRenderTarget render_targets[5];
+    void* pipeline_state_handle;
+    ID3D12RootSignature* root_signature;
+  };
+  LastPipelineConfiguration last_pipeline_configuration_ = {};
+
   // Currently bound graphics root signature.
   ID3D12RootSignature* current_graphics_root_signature_;
   // Extra parameters which may or may not be present.
@@ -591,6 +776,18 @@ class D3D12CommandProcessor : public CommandProcessor {
   std::vector<uint32_t> current_sampler_bindless_indices_vertex_;
   std::vector<uint32_t> current_sampler_bindless_indices_pixel_;
 
+  // Bindful descriptor sets written to the current pages, keyed by the hash of
+  // the contents of the set.
+  std::unordered_multimap<uint64_t, BindfulTextureSet> bindful_texture_sets_;
+  // Heap index the sets in bindful_texture_sets_ have been written to.
+  uint64_t bindful_texture_sets_heap_index_ =
+      ui::d3d12::D3D12DescriptorHeapPool::kHeapIndexInvalid;
+  std::unordered_multimap<uint64_t, BindfulSamplerSet> bindful_sampler_sets_;
+  uint64_t bindful_sampler_sets_heap_index_ =
+      ui::d3d12::D3D12DescriptorHeapPool::kHeapIndexInvalid;
+  // Temporary storage for the keys of the set being looked up.
+  std::vector<TextureCache::TextureSRVKey> bindful_texture_set_srv_keys_temp_;
+
   // Latest bindful descriptor handles used for handling Xenos draw calls.
   D3D12_GPU_DESCRIPTOR_HANDLE gpu_handle_shared_memory_and_edram_;
   D3D12_GPU_DESCRIPTOR_HANDLE gpu_handle_textures_vertex_;
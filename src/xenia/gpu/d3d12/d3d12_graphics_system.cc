@@ -9,6 +9,7 @@
 
 #include "xenia/gpu/d3d12/d3d12_graphics_system.h"
 
+#include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/gpu/d3d12/d3d12_command_processor.h"
@@ -16,6 +17,8 @@
 #include "xenia/ui/d3d12/d3d12_util.h"
 #include "xenia/xbox.h"
 
+DECLARE_path(d3d12_texture_disk_cache_path);
+
 namespace xe {
 namespace gpu {
 namespace d3d12 {
@@ -202,6 +205,10 @@ std::unique_ptr<xe::ui::RawImage> D3D12GraphicsSystem::Capture() {
   return d3d12_command_processor->Capture();
 }
 
+std::filesystem::path D3D12GraphicsSystem::texture_disk_cache_root() const {
+  return cvars::d3d12_texture_disk_cache_path;
+}
+
 void D3D12GraphicsSystem::StretchTextureToFrontBuffer(
     D3D12_GPU_DESCRIPTOR_HANDLE handle,
     D3D12_GPU_DESCRIPTOR_HANDLE* gamma_ramp_handle, float gamma_ramp_inv_size,
@@ -9,8 +9,12 @@
 
 #include "xenia/gpu/d3d12/deferred_command_list.h"
 
+#include <algorithm>
+#include <utility>
+
 #include "xenia/base/assert.h"
 #include "xenia/base/math.h"
+#include "xenia/base/platform.h"
 #include "xenia/gpu/d3d12/d3d12_command_processor.h"
 
 namespace xe {
@@ -20,226 +24,472 @@ namespace d3d12 {
 DeferredCommandList::DeferredCommandList(
     D3D12CommandProcessor& command_processor, size_t initial_size)
     : command_processor_(command_processor) {
-  command_stream_.reserve(initial_size);
+  command_stream_.resize(std::max(initial_size, kCommandStreamBegin));
+}
+
+void DeferredCommandList::Reset() {
+  // Keeping the storage for the next submission.
+  command_stream_size_ = kCommandStreamBegin;
 }
 
-void DeferredCommandList::Reset() { command_stream_.clear(); }
+void DeferredCommandList::Execute(
+    ID3D12GraphicsCommandList* command_list,
+    ID3D12GraphicsCommandList1* command_list_1) const {
+  ID3D12PipelineState* current_pipeline_state = nullptr;
+  ExecuteRange(command_list, command_list_1, kCommandStreamBegin,
+               command_stream_size_, current_pipeline_state);
+}
 
 void DeferredCommandList::Execute(ID3D12GraphicsCommandList* command_list,
-                                  ID3D12GraphicsCommandList1* command_list_1) {
-  const uint8_t* stream = command_stream_.data();
-  size_t stream_remaining = command_stream_.size();
+                                  ID3D12GraphicsCommandList1* command_list_1,
+                                  const Segment& segment) const {
   ID3D12PipelineState* current_pipeline_state = nullptr;
-  while (stream_remaining != 0) {
-    const uint32_t* header = reinterpret_cast<const uint32_t*>(stream);
-    const size_t header_size = xe::align(2 * sizeof(uint32_t), kAlignment);
-    stream += header_size;
-    stream_remaining -= header_size;
-    switch (Command(header[0])) {
-      case Command::kD3DClearUnorderedAccessViewUint: {
-        auto& args =
-            *reinterpret_cast<const ClearUnorderedAccessViewHeader*>(stream);
-        command_list->ClearUnorderedAccessViewUint(
-            args.view_gpu_handle_in_current_heap, args.view_cpu_handle,
-            args.resource, args.values_uint, args.num_rects,
-            args.num_rects ? reinterpret_cast<const D3D12_RECT*>(&args + 1)
-                           : nullptr);
-      } break;
-      case Command::kD3DCopyBufferRegion: {
-        auto& args =
-            *reinterpret_cast<const D3DCopyBufferRegionArguments*>(stream);
-        command_list->CopyBufferRegion(args.dst_buffer, args.dst_offset,
-                                       args.src_buffer, args.src_offset,
-                                       args.num_bytes);
-      } break;
-      case Command::kD3DCopyResource: {
-        auto& args = *reinterpret_cast<const D3DCopyResourceArguments*>(stream);
-        command_list->CopyResource(args.dst_resource, args.src_resource);
-      } break;
-      case Command::kCopyTexture: {
-        auto& args = *reinterpret_cast<const CopyTextureArguments*>(stream);
-        command_list->CopyTextureRegion(&args.dst, 0, 0, 0, &args.src, nullptr);
-      } break;
-      case Command::kCopyTextureRegion: {
-        auto& args =
-            *reinterpret_cast<const CopyTextureRegionArguments*>(stream);
-        command_list->CopyTextureRegion(&args.dst, args.dst_x, args.dst_y,
-                                        args.dst_z, &args.src, &args.src_box);
-      } break;
-      case Command::kD3DDispatch: {
-        if (current_pipeline_state != nullptr) {
-          auto& args = *reinterpret_cast<const D3DDispatchArguments*>(stream);
-          command_list->Dispatch(args.thread_group_count_x,
-                                 args.thread_group_count_y,
-                                 args.thread_group_count_z);
+  // A new command list starts with no state set, restore the state the
+  // segment inherits from the commands before it.
+  for (size_t state_command_offset : segment.state_commands) {
+    ExecuteCommand(command_list, command_list_1, state_command_offset,
+                   current_pipeline_state);
+  }
+  ExecuteRange(command_list, command_list_1, segment.begin, segment.end,
+               current_pipeline_state);
+}
+
+void DeferredCommandList::Split(size_t max_segment_count,
+                                size_t min_segment_size,
+                                std::vector<Segment>& segments) const {
+  segments.clear();
+  const size_t stream_size = command_stream_size_;
+  const size_t segment_size = std::max(
+      (stream_size - kCommandStreamBegin + max_segment_count - 1) /
+          max_segment_count,
+      min_segment_size);
+  auto command_at = [this](size_t offset) {
+    return Command(
+        *reinterpret_cast<const uint32_t*>(command_stream_.data() + offset) &
+        kCommandMask);
+  };
+  auto arguments_at = [this](size_t offset) {
+    return command_stream_.data() + offset + kCommandHeaderSize;
+  };
+
+  // Offsets of the latest commands setting each part of the state.
+  size_t state_commands[size_t(StateCommand::kCount)];
+  std::fill(state_commands, state_commands + size_t(StateCommand::kCount),
+            SIZE_MAX);
+  // Root arguments set since the last root signature change, identified by
+  // the root parameter index and, for root constants, the updated range.
+  std::vector<std::pair<uint64_t, size_t>> root_arguments[2];
+  auto set_root_argument = [&](bool graphics, uint64_t key, size_t offset) {
+    auto& arguments = root_arguments[graphics];
+    for (auto it = arguments.begin(); it != arguments.end(); ++it) {
+      if (it->first == key) {
+        arguments.erase(it);
+        break;
+      }
+    }
+    arguments.emplace_back(key, offset);
+  };
+  auto set_root_signature = [&](bool graphics, size_t offset) {
+    size_t& state_command =
+        state_commands[size_t(graphics ? StateCommand::kGraphicsRootSignature
+                                       : StateCommand::kComputeRootSignature)];
+    auto root_signature =
+        *reinterpret_cast<ID3D12RootSignature* const*>(arguments_at(offset));
+    // Setting the same root signature again keeps the root arguments, and the
+    // older command must be kept so it's restored before them.
+    if (state_command != SIZE_MAX &&
+        *reinterpret_cast<ID3D12RootSignature* const*>(
+            arguments_at(state_command)) == root_signature) {
+      return;
+    }
+    state_command = offset;
+    root_arguments[graphics].clear();
+  };
+
+  // Begin and end of a query must be in the same command list.
+  uint32_t open_queries = 0;
+
+  Segment* segment = &segments.emplace_back();
+  segment->begin = kCommandStreamBegin;
+  size_t offset = kCommandStreamBegin;
+  while (offset < stream_size) {
+    uint32_t header =
+        *reinterpret_cast<const uint32_t*>(command_stream_.data() + offset);
+    Command command = Command(header & kCommandMask);
+    if ((command == Command::kD3DResourceBarrier ||
+         command == Command::kD3DOMSetRenderTargets) &&
+        !open_queries && offset - segment->begin >= segment_size &&
+        segments.size() < max_segment_count) {
+      segment->end = offset;
+      segment = &segments.emplace_back();
+      segment->begin = offset;
+      for (size_t i = 0; i < size_t(StateCommand::kCount); ++i) {
+        if (state_commands[i] != SIZE_MAX) {
+          segment->state_commands.push_back(state_commands[i]);
         }
-      } break;
-      case Command::kD3DDrawIndexedInstanced: {
-        if (current_pipeline_state != nullptr) {
-          auto& args =
-              *reinterpret_cast<const D3DDrawIndexedInstancedArguments*>(
-                  stream);
-          command_list->DrawIndexedInstanced(
-              args.index_count_per_instance, args.instance_count,
-              args.start_index_location, args.base_vertex_location,
-              args.start_instance_location);
+      }
+      for (size_t i = 0; i < 2; ++i) {
+        for (const auto& root_argument : root_arguments[i]) {
+          segment->state_commands.push_back(root_argument.second);
         }
-      } break;
-      case Command::kD3DDrawInstanced: {
-        if (current_pipeline_state != nullptr) {
-          auto& args =
-              *reinterpret_cast<const D3DDrawInstancedArguments*>(stream);
-          command_list->DrawInstanced(
-              args.vertex_count_per_instance, args.instance_count,
-              args.start_vertex_location, args.start_instance_location);
+      }
+      // Restore in the original order, so descriptor heaps and root
+      // signatures are set before the root arguments referencing them.
+      std::sort(segment->state_commands.begin(),
+                segment->state_commands.end());
+    }
+    const uint8_t* arguments = arguments_at(offset);
+    switch (command) {
+      case Command::kD3DBeginQuery:
+        ++open_queries;
+        break;
+      case Command::kD3DEndQuery:
+        // Timestamps are only ended.
+        if (reinterpret_cast<const D3DQueryArguments*>(arguments)->type !=
+                D3D12_QUERY_TYPE_TIMESTAMP &&
+            open_queries) {
+          --open_queries;
         }
-      } break;
-      case Command::kD3DIASetIndexBuffer: {
-        auto view = reinterpret_cast<const D3D12_INDEX_BUFFER_VIEW*>(stream);
-        command_list->IASetIndexBuffer(
-            view->Format != DXGI_FORMAT_UNKNOWN ? view : nullptr);
-      } break;
-      case Command::kD3DIASetPrimitiveTopology: {
-        command_list->IASetPrimitiveTopology(
-            *reinterpret_cast<const D3D12_PRIMITIVE_TOPOLOGY*>(stream));
-      } break;
-      case Command::kD3DOMSetBlendFactor: {
-        command_list->OMSetBlendFactor(reinterpret_cast<const FLOAT*>(stream));
-      } break;
-      case Command::kD3DOMSetRenderTargets: {
-        auto& args =
-            *reinterpret_cast<const D3DOMSetRenderTargetsArguments*>(stream);
-        command_list->OMSetRenderTargets(
-            args.num_render_target_descriptors, args.render_target_descriptors,
-            args.rts_single_handle_to_descriptor_range ? TRUE : FALSE,
-            args.depth_stencil ? &args.depth_stencil_descriptor : nullptr);
-      } break;
-      case Command::kD3DOMSetStencilRef: {
-        command_list->OMSetStencilRef(*reinterpret_cast<const UINT*>(stream));
-      } break;
-      case Command::kD3DResourceBarrier: {
-        command_list->ResourceBarrier(
-            *reinterpret_cast<const UINT*>(stream),
-            reinterpret_cast<const D3D12_RESOURCE_BARRIER*>(
-                stream +
-                xe::align(sizeof(UINT), alignof(D3D12_RESOURCE_BARRIER))));
-      } break;
-      case Command::kRSSetScissorRect: {
-        command_list->RSSetScissorRects(
-            1, reinterpret_cast<const D3D12_RECT*>(stream));
-      } break;
-      case Command::kRSSetViewport: {
-        command_list->RSSetViewports(
-            1, reinterpret_cast<const D3D12_VIEWPORT*>(stream));
-      } break;
-      case Command::kD3DSetComputeRoot32BitConstants: {
-        auto args =
-            reinterpret_cast<const SetRoot32BitConstantsHeader*>(stream);
-        command_list->SetComputeRoot32BitConstants(
-            args->root_parameter_index, args->num_32bit_values_to_set, args + 1,
-            args->dest_offset_in_32bit_values);
-      } break;
+        break;
+      case Command::kD3DIASetIndexBuffer:
+        state_commands[size_t(StateCommand::kIndexBuffer)] = offset;
+        break;
+      case Command::kD3DIASetPrimitiveTopology:
+        state_commands[size_t(StateCommand::kPrimitiveTopology)] = offset;
+        break;
+      case Command::kD3DOMSetBlendFactor:
+        state_commands[size_t(StateCommand::kBlendFactor)] = offset;
+        break;
+      case Command::kD3DOMSetRenderTargets:
+        state_commands[size_t(StateCommand::kRenderTargets)] = offset;
+        break;
+      case Command::kD3DOMSetStencilRef:
+        state_commands[size_t(StateCommand::kStencilRef)] = offset;
+        break;
+      case Command::kRSSetScissorRect:
+        state_commands[size_t(StateCommand::kScissorRect)] = offset;
+        break;
+      case Command::kRSSetViewport:
+        state_commands[size_t(StateCommand::kViewport)] = offset;
+        break;
+      case Command::kD3DSetComputeRoot32BitConstants:
       case Command::kD3DSetGraphicsRoot32BitConstants: {
-        auto args =
-            reinterpret_cast<const SetRoot32BitConstantsHeader*>(stream);
-        command_list->SetGraphicsRoot32BitConstants(
-            args->root_parameter_index, args->num_32bit_values_to_set, args + 1,
-            args->dest_offset_in_32bit_values);
-      } break;
-      case Command::kD3DSetComputeRootConstantBufferView: {
         auto& args =
-            *reinterpret_cast<const SetRootConstantBufferViewArguments*>(
-                stream);
-        command_list->SetComputeRootConstantBufferView(
-            args.root_parameter_index, args.buffer_location);
+            *reinterpret_cast<const SetRoot32BitConstantsHeader*>(arguments);
+        set_root_argument(
+            command == Command::kD3DSetGraphicsRoot32BitConstants,
+            (uint64_t(args.root_parameter_index) << 32) |
+                (uint64_t(args.dest_offset_in_32bit_values) << 16) |
+                args.num_32bit_values_to_set,
+            offset);
       } break;
+      case Command::kD3DSetComputeRootConstantBufferView:
       case Command::kD3DSetGraphicsRootConstantBufferView: {
         auto& args =
             *reinterpret_cast<const SetRootConstantBufferViewArguments*>(
-                stream);
-        command_list->SetGraphicsRootConstantBufferView(
-            args.root_parameter_index, args.buffer_location);
-      } break;
-      case Command::kD3DSetComputeRootDescriptorTable: {
-        auto& args =
-            *reinterpret_cast<const SetRootDescriptorTableArguments*>(stream);
-        command_list->SetComputeRootDescriptorTable(args.root_parameter_index,
-                                                    args.base_descriptor);
+                arguments);
+        set_root_argument(
+            command == Command::kD3DSetGraphicsRootConstantBufferView,
+            uint64_t(args.root_parameter_index) << 32, offset);
       } break;
+      case Command::kD3DSetComputeRootDescriptorTable:
       case Command::kD3DSetGraphicsRootDescriptorTable: {
         auto& args =
-            *reinterpret_cast<const SetRootDescriptorTableArguments*>(stream);
-        command_list->SetGraphicsRootDescriptorTable(args.root_parameter_index,
-                                                     args.base_descriptor);
-      } break;
-      case Command::kD3DSetComputeRootSignature: {
-        command_list->SetComputeRootSignature(
-            *reinterpret_cast<ID3D12RootSignature* const*>(stream));
-      } break;
-      case Command::kD3DSetGraphicsRootSignature: {
-        command_list->SetGraphicsRootSignature(
-            *reinterpret_cast<ID3D12RootSignature* const*>(stream));
-      } break;
-      case Command::kSetDescriptorHeaps: {
-        auto& args =
-            *reinterpret_cast<const SetDescriptorHeapsArguments*>(stream);
-        UINT num_descriptor_heaps = 0;
-        ID3D12DescriptorHeap* descriptor_heaps[2];
-        if (args.cbv_srv_uav_descriptor_heap != nullptr) {
-          descriptor_heaps[num_descriptor_heaps++] =
-              args.cbv_srv_uav_descriptor_heap;
-        }
-        if (args.sampler_descriptor_heap != nullptr) {
-          descriptor_heaps[num_descriptor_heaps++] =
-              args.sampler_descriptor_heap;
-        }
-        command_list->SetDescriptorHeaps(num_descriptor_heaps,
-                                         descriptor_heaps);
-      } break;
-      case Command::kD3DSetPipelineState: {
-        current_pipeline_state =
-            *reinterpret_cast<ID3D12PipelineState* const*>(stream);
-        if (current_pipeline_state) {
-          command_list->SetPipelineState(current_pipeline_state);
-        }
-      } break;
-      case Command::kSetPipelineStateHandle: {
-        current_pipeline_state =
-            command_processor_.GetD3D12PipelineStateByHandle(
-                *reinterpret_cast<void* const*>(stream));
-        if (current_pipeline_state) {
-          command_list->SetPipelineState(current_pipeline_state);
-        }
+            *reinterpret_cast<const SetRootDescriptorTableArguments*>(
+                arguments);
+        set_root_argument(
+            command == Command::kD3DSetGraphicsRootDescriptorTable,
+            uint64_t(args.root_parameter_index) << 32, offset);
       } break;
-      case Command::kD3DSetSamplePositions: {
-        if (command_list_1 != nullptr) {
-          auto& args =
-              *reinterpret_cast<const D3DSetSamplePositionsArguments*>(stream);
-          command_list_1->SetSamplePositions(
-              args.num_samples_per_pixel, args.num_pixels,
-              const_cast<D3D12_SAMPLE_POSITION*>(args.sample_positions));
+      case Command::kD3DSetComputeRootSignature:
+        set_root_signature(false, offset);
+        break;
+      case Command::kD3DSetGraphicsRootSignature:
+        set_root_signature(true, offset);
+        break;
+      case Command::kSetDescriptorHeaps:
+        state_commands[size_t(StateCommand::kDescriptorHeaps)] = offset;
+        // Descriptor tables in the previous heaps can't be restored before
+        // the new heaps are set, and must be set again anyway.
+        for (size_t i = 0; i < 2; ++i) {
+          auto& arguments = root_arguments[i];
+          arguments.erase(
+              std::remove_if(
+                  arguments.begin(), arguments.end(),
+                  [&command_at](const std::pair<uint64_t, size_t>& argument) {
+                    Command argument_command = command_at(argument.second);
+                    return argument_command ==
+                               Command::kD3DSetComputeRootDescriptorTable ||
+                           argument_command ==
+                               Command::kD3DSetGraphicsRootDescriptorTable;
+                  }),
+              arguments.end());
         }
-      } break;
+        break;
+      case Command::kD3DSetPipelineState:
+      case Command::kSetPipelineStateHandle:
+        state_commands[size_t(StateCommand::kPipelineState)] = offset;
+        break;
+      case Command::kD3DSetSamplePositions:
+        state_commands[size_t(StateCommand::kSamplePositions)] = offset;
+        break;
       default:
-        assert_unhandled_case(Command(header[0]));
         break;
     }
-    stream += header[1];
-    stream_remaining -= header[1];
+    offset += kCommandHeaderSize + (header >> kCommandArgumentsSizeShift);
+  }
+  segment->end = stream_size;
+}
+
+void DeferredCommandList::ExecuteRange(
+    ID3D12GraphicsCommandList* command_list,
+    ID3D12GraphicsCommandList1* command_list_1, size_t begin, size_t end,
+    ID3D12PipelineState*& current_pipeline_state) const {
+  // The commands are small and read only once, prefetch the stream ahead of
+  // the command being executed so reading them doesn't stall on cache misses
+  // between the (relatively long) driver calls.
+  const uint8_t* stream = command_stream_.data();
+  size_t prefetch_offset = begin & ~size_t(63);
+  size_t offset = begin;
+  while (offset < end) {
+    size_t prefetch_end = std::min(offset + kExecutePrefetchDistance, end);
+    for (; prefetch_offset < prefetch_end; prefetch_offset += 64) {
+      _mm_prefetch(reinterpret_cast<const char*>(stream + prefetch_offset),
+                   _MM_HINT_T0);
+    }
+    offset = ExecuteCommand(command_list, command_list_1, offset,
+                            current_pipeline_state);
+  }
+}
+
+size_t DeferredCommandList::ExecuteCommand(
+    ID3D12GraphicsCommandList* command_list,
+    ID3D12GraphicsCommandList1* command_list_1, size_t offset,
+    ID3D12PipelineState*& current_pipeline_state) const {
+  const uint8_t* stream = command_stream_.data() + offset;
+  uint32_t header = *reinterpret_cast<const uint32_t*>(stream);
+  stream += kCommandHeaderSize;
+  switch (Command(header & kCommandMask)) {
+    case Command::kD3DBeginQuery: {
+      auto& args = *reinterpret_cast<const D3DQueryArguments*>(stream);
+      command_list->BeginQuery(args.query_heap, args.type, args.index);
+    } break;
+    case Command::kD3DClearUnorderedAccessViewUint: {
+      auto& args =
+          *reinterpret_cast<const ClearUnorderedAccessViewHeader*>(stream);
+      command_list->ClearUnorderedAccessViewUint(
+          args.view_gpu_handle_in_current_heap, args.view_cpu_handle,
+          args.resource, args.values_uint, args.num_rects,
+          args.num_rects ? reinterpret_cast<const D3D12_RECT*>(&args + 1)
+                         : nullptr);
+    } break;
+    case Command::kD3DCopyBufferRegion: {
+      auto& args =
+          *reinterpret_cast<const D3DCopyBufferRegionArguments*>(stream);
+      command_list->CopyBufferRegion(args.dst_buffer, args.dst_offset,
+                                     args.src_buffer, args.src_offset,
+                                     args.num_bytes);
+    } break;
+    case Command::kD3DCopyResource: {
+      auto& args = *reinterpret_cast<const D3DCopyResourceArguments*>(stream);
+      command_list->CopyResource(args.dst_resource, args.src_resource);
+    } break;
+    case Command::kCopyTexture: {
+      auto& args = *reinterpret_cast<const CopyTextureArguments*>(stream);
+      command_list->CopyTextureRegion(&args.dst, 0, 0, 0, &args.src, nullptr);
+    } break;
+    case Command::kCopyTextureRegion: {
+      auto& args = *reinterpret_cast<const CopyTextureRegionArguments*>(stream);
+      command_list->CopyTextureRegion(&args.dst, args.dst_x, args.dst_y,
+                                      args.dst_z, &args.src, &args.src_box);
+    } break;
+    case Command::kD3DDispatch: {
+      if (current_pipeline_state != nullptr) {
+        auto& args = *reinterpret_cast<const D3DDispatchArguments*>(stream);
+        command_list->Dispatch(args.thread_group_count_x,
+                               args.thread_group_count_y,
+                               args.thread_group_count_z);
+      }
+    } break;
+    case Command::kD3DDrawIndexedInstanced: {
+      if (current_pipeline_state != nullptr) {
+        auto& args =
+            *reinterpret_cast<const D3DDrawIndexedInstancedArguments*>(
+                stream);
+        command_list->DrawIndexedInstanced(
+            args.index_count_per_instance, args.instance_count,
+            args.start_index_location, args.base_vertex_location,
+            args.start_instance_location);
+      }
+    } break;
+    case Command::kD3DDrawInstanced: {
+      if (current_pipeline_state != nullptr) {
+        auto& args =
+            *reinterpret_cast<const D3DDrawInstancedArguments*>(stream);
+        command_list->DrawInstanced(
+            args.vertex_count_per_instance, args.instance_count,
+            args.start_vertex_location, args.start_instance_location);
+      }
+    } break;
+    case Command::kD3DEndQuery: {
+      auto& args = *reinterpret_cast<const D3DQueryArguments*>(stream);
+      command_list->EndQuery(args.query_heap, args.type, args.index);
+    } break;
+    case Command::kD3DIASetIndexBuffer: {
+      auto view = reinterpret_cast<const D3D12_INDEX_BUFFER_VIEW*>(stream);
+      command_list->IASetIndexBuffer(
+          view->Format != DXGI_FORMAT_UNKNOWN ? view : nullptr);
+    } break;
+    case Command::kD3DIASetPrimitiveTopology: {
+      command_list->IASetPrimitiveTopology(
+          *reinterpret_cast<const D3D12_PRIMITIVE_TOPOLOGY*>(stream));
+    } break;
+    case Command::kD3DOMSetBlendFactor: {
+      command_list->OMSetBlendFactor(reinterpret_cast<const FLOAT*>(stream));
+    } break;
+    case Command::kD3DOMSetRenderTargets: {
+      auto& args =
+          *reinterpret_cast<const D3DOMSetRenderTargetsArguments*>(stream);
+      command_list->OMSetRenderTargets(
+          args.num_render_target_descriptors, args.render_target_descriptors,
+          args.rts_single_handle_to_descriptor_range ? TRUE : FALSE,
+          args.depth_stencil ? &args.depth_stencil_descriptor : nullptr);
+    } break;
+    case Command::kD3DOMSetStencilRef: {
+      command_list->OMSetStencilRef(*reinterpret_cast<const UINT*>(stream));
+    } break;
+    case Command::kD3DResolveQueryData: {
+      auto& args =
+          *reinterpret_cast<const D3DResolveQueryDataArguments*>(stream);
+      command_list->ResolveQueryData(
+          args.query_heap, args.type, args.start_index, args.num_queries,
+          args.destination_buffer, args.aligned_destination_buffer_offset);
+    } break;
+    case Command::kD3DResourceBarrier: {
+      command_list->ResourceBarrier(
+          *reinterpret_cast<const UINT*>(stream),
+          reinterpret_cast<const D3D12_RESOURCE_BARRIER*>(
+              stream +
+              xe::align(sizeof(UINT), alignof(D3D12_RESOURCE_BARRIER))));
+    } break;
+    case Command::kRSSetScissorRect: {
+      command_list->RSSetScissorRects(
+          1, reinterpret_cast<const D3D12_RECT*>(stream));
+    } break;
+    case Command::kRSSetViewport: {
+      command_list->RSSetViewports(
+          1, reinterpret_cast<const D3D12_VIEWPORT*>(stream));
+    } break;
+    case Command::kD3DSetComputeRoot32BitConstants: {
+      auto args = reinterpret_cast<const SetRoot32BitConstantsHeader*>(stream);
+      command_list->SetComputeRoot32BitConstants(
+          args->root_parameter_index, args->num_32bit_values_to_set, args + 1,
+          args->dest_offset_in_32bit_values);
+    } break;
+    case Command::kD3DSetGraphicsRoot32BitConstants: {
+      auto args = reinterpret_cast<const SetRoot32BitConstantsHeader*>(stream);
+      command_list->SetGraphicsRoot32BitConstants(
+          args->root_parameter_index, args->num_32bit_values_to_set, args + 1,
+          args->dest_offset_in_32bit_values);
+    } break;
+    case Command::kD3DSetComputeRootConstantBufferView: {
+      auto& args =
+          *reinterpret_cast<const SetRootConstantBufferViewArguments*>(
+              stream);
+      command_list->SetComputeRootConstantBufferView(
+          args.root_parameter_index, args.buffer_location);
+    } break;
+    case Command::kD3DSetGraphicsRootConstantBufferView: {
+      auto& args =
+          *reinterpret_cast<const SetRootConstantBufferViewArguments*>(
+              stream);
+      command_list->SetGraphicsRootConstantBufferView(
+          args.root_parameter_index, args.buffer_location);
+    } break;
+    case Command::kD3DSetComputeRootDescriptorTable: {
+      auto& args =
+          *reinterpret_cast<const SetRootDescriptorTableArguments*>(stream);
+      command_list->SetComputeRootDescriptorTable(args.root_parameter_index,
+                                                  args.base_descriptor);
+    } break;
+    case Command::kD3DSetGraphicsRootDescriptorTable: {
+      auto& args =
+          *reinterpret_cast<const SetRootDescriptorTableArguments*>(stream);
+      command_list->SetGraphicsRootDescriptorTable(args.root_parameter_index,
+                                                   args.base_descriptor);
+    } break;
+    case Command::kD3DSetComputeRootSignature: {
+      command_list->SetComputeRootSignature(
+          *reinterpret_cast<ID3D12RootSignature* const*>(stream));
+    } break;
+    case Command::kD3DSetGraphicsRootSignature: {
+      command_list->SetGraphicsRootSignature(
+          *reinterpret_cast<ID3D12RootSignature* const*>(stream));
+    } break;
+    case Command::kSetDescriptorHeaps: {
+      auto& args =
+          *reinterpret_cast<const SetDescriptorHeapsArguments*>(stream);
+      UINT num_descriptor_heaps = 0;
+      ID3D12DescriptorHeap* descriptor_heaps[2];
+      if (args.cbv_srv_uav_descriptor_heap != nullptr) {
+        descriptor_heaps[num_descriptor_heaps++] =
+            args.cbv_srv_uav_descriptor_heap;
+      }
+      if (args.sampler_descriptor_heap != nullptr) {
+        descriptor_heaps[num_descriptor_heaps++] = args.sampler_descriptor_heap;
+      }
+      command_list->SetDescriptorHeaps(num_descriptor_heaps, descriptor_heaps);
+    } break;
+    case Command::kD3DSetPipelineState: {
+      current_pipeline_state =
+          *reinterpret_cast<ID3D12PipelineState* const*>(stream);
+      if (current_pipeline_state) {
+        command_list->SetPipelineState(current_pipeline_state);
+      }
+    } break;
+    case Command::kSetPipelineStateHandle: {
+      current_pipeline_state = command_processor_.GetD3D12PipelineStateByHandle(
+          *reinterpret_cast<void* const*>(stream));
+      if (current_pipeline_state) {
+        command_list->SetPipelineState(current_pipeline_state);
+      }
+    } break;
+    case Command::kD3DSetSamplePositions: {
+      if (command_list_1 != nullptr) {
+        auto& args =
+            *reinterpret_cast<const D3DSetSamplePositionsArguments*>(stream);
+        command_list_1->SetSamplePositions(
+            args.num_samples_per_pixel, args.num_pixels,
+            const_cast<D3D12_SAMPLE_POSITION*>(args.sample_positions));
+      }
+    } break;
+    default:
+      assert_unhandled_case(Command(header & kCommandMask));
+      break;
   }
+  return offset + kCommandHeaderSize + (header >> kCommandArgumentsSizeShift);
 }
 
 void* DeferredCommandList::WriteCommand(Command command,
                                         size_t arguments_size) {
-  arguments_size = xe::align(arguments_size, kAlignment);
-  const size_t header_size = xe::align(2 * sizeof(uint32_t), kAlignment);
-  size_t offset = command_stream_.size();
-  command_stream_.resize(offset + header_size + arguments_size);
-  uint32_t* header =
-      reinterpret_cast<uint32_t*>(command_stream_.data() + offset);
-  header[0] = uint32_t(command);
-  header[1] = uint32_t(arguments_size);
-  return command_stream_.data() + (offset + header_size);
+  // Padding so the next header is also right before an alignment boundary.
+  arguments_size =
+      xe::align(kCommandHeaderSize + arguments_size, kAlignment) -
+      kCommandHeaderSize;
+  assert_true(arguments_size <
+              (size_t(1) << (32 - kCommandArgumentsSizeShift)));
+  size_t offset = command_stream_size_;
+  size_t new_size = offset + kCommandHeaderSize + arguments_size;
+  if (new_size > command_stream_.size()) {
+    // Growing geometrically, the storage is reused by the next submissions.
+    command_stream_.resize(std::max(new_size, command_stream_.size() * 2));
+  }
+  command_stream_size_ = new_size;
+  uint8_t* header = command_stream_.data() + offset;
+  *reinterpret_cast<uint32_t*>(header) =
+      uint32_t(command) |
+      (uint32_t(arguments_size) << kCommandArgumentsSizeShift);
+  return header + kCommandHeaderSize;
 }
 
 }  // namespace d3d12
@@ -28,9 +28,35 @@ class DeferredCommandList {
   DeferredCommandList(D3D12CommandProcessor& command_processor,
                       size_t initial_size = 256 * 1024);
 
+  // A part of the command stream that can be recorded into a separate command
+  // list, with the offsets of the commands restoring the state left by the
+  // commands before it, in the stream order.
+  struct Segment {
+    size_t begin;
+    size_t end;
+    std::vector<size_t> state_commands;
+  };
+
   void Reset();
   void Execute(ID3D12GraphicsCommandList* command_list,
-               ID3D12GraphicsCommandList1* command_list_1);
+               ID3D12GraphicsCommandList1* command_list_1) const;
+  void Execute(ID3D12GraphicsCommandList* command_list,
+               ID3D12GraphicsCommandList1* command_list_1,
+               const Segment& segment) const;
+  // Splits the command stream into at least one and up to max_segment_count
+  // segments of roughly equal size (but not smaller than min_segment_size),
+  // at resource barriers and render target changes.
+  void Split(size_t max_segment_count, size_t min_segment_size,
+             std::vector<Segment>& segments) const;
+
+  inline void D3DBeginQuery(ID3D12QueryHeap* query_heap, D3D12_QUERY_TYPE type,
+                            UINT index) {
+    auto& args = *reinterpret_cast<D3DQueryArguments*>(
+        WriteCommand(Command::kD3DBeginQuery, sizeof(D3DQueryArguments)));
+    args.query_heap = query_heap;
+    args.type = type;
+    args.index = index;
+  }
 
   inline void D3DClearUnorderedAccessViewUint(
       D3D12_GPU_DESCRIPTOR_HANDLE view_gpu_handle_in_current_heap,
@@ -127,6 +153,15 @@ class DeferredCommandList {
     args.start_instance_location = start_instance_location;
   }
 
+  inline void D3DEndQuery(ID3D12QueryHeap* query_heap, D3D12_QUERY_TYPE type,
+                          UINT index) {
+    auto& args = *reinterpret_cast<D3DQueryArguments*>(
+        WriteCommand(Command::kD3DEndQuery, sizeof(D3DQueryArguments)));
+    args.query_heap = query_heap;
+    args.type = type;
+    args.index = index;
+  }
+
   inline void D3DIASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* view) {
     auto& args = *reinterpret_cast<D3D12_INDEX_BUFFER_VIEW*>(WriteCommand(
         Command::kD3DIASetIndexBuffer, sizeof(D3D12_INDEX_BUFFER_VIEW)));
@@ -190,6 +225,22 @@ class DeferredCommandList {
     arg = stencil_ref;
   }
 
+  inline void D3DResolveQueryData(ID3D12QueryHeap* query_heap,
+                                  D3D12_QUERY_TYPE type, UINT start_index,
+                                  UINT num_queries,
+                                  ID3D12Resource* destination_buffer,
+                                  UINT64 aligned_destination_buffer_offset) {
+    auto& args = *reinterpret_cast<D3DResolveQueryDataArguments*>(
+        WriteCommand(Command::kD3DResolveQueryData,
+                     sizeof(D3DResolveQueryDataArguments)));
+    args.query_heap = query_heap;
+    args.type = type;
+    args.start_index = start_index;
+    args.num_queries = num_queries;
+    args.destination_buffer = destination_buffer;
+    args.aligned_destination_buffer_offset = aligned_destination_buffer_offset;
+  }
+
   inline void D3DResourceBarrier(UINT num_barriers,
                                  const D3D12_RESOURCE_BARRIER* barriers) {
     if (num_barriers == 0) {
@@ -333,8 +384,22 @@ class DeferredCommandList {
 
  private:
   static constexpr size_t kAlignment = std::max(sizeof(void*), sizeof(UINT64));
+  // Each command is a single 32-bit header with the command in the low 8 bits
+  // and the size of the arguments in the upper 24 bits, directly followed by
+  // the arguments. Headers are placed kCommandHeaderSize bytes before
+  // kAlignment boundaries, so no padding is needed between the header and the
+  // arguments, and commands with small arguments (like draws) take only one
+  // dword more than their arguments.
+  static constexpr size_t kCommandHeaderSize = sizeof(uint32_t);
+  static constexpr size_t kCommandStreamBegin = kAlignment - kCommandHeaderSize;
+  static constexpr uint32_t kCommandArgumentsSizeShift = 8;
+  static constexpr uint32_t kCommandMask =
+      (uint32_t(1) << kCommandArgumentsSizeShift) - 1;
+  // Distance the command stream is prefetched at during execution.
+  static constexpr size_t kExecutePrefetchDistance = 512;
 
   enum class Command : uint32_t {
+    kD3DBeginQuery,
     kD3DClearUnorderedAccessViewUint,
     kD3DCopyBufferRegion,
     kD3DCopyResource,
@@ -343,11 +408,13 @@ class DeferredCommandList {
     kD3DDispatch,
     kD3DDrawIndexedInstanced,
     kD3DDrawInstanced,
+    kD3DEndQuery,
     kD3DIASetIndexBuffer,
     kD3DIASetPrimitiveTopology,
     kD3DOMSetBlendFactor,
     kD3DOMSetRenderTargets,
     kD3DOMSetStencilRef,
+    kD3DResolveQueryData,
     kD3DResourceBarrier,
     kRSSetScissorRect,
     kRSSetViewport,
@@ -365,6 +432,12 @@ class DeferredCommandList {
     kD3DSetSamplePositions,
   };
 
+  struct D3DQueryArguments {
+    ID3D12QueryHeap* query_heap;
+    D3D12_QUERY_TYPE type;
+    UINT index;
+  };
+
   struct ClearUnorderedAccessViewHeader {
     D3D12_GPU_DESCRIPTOR_HANDLE view_gpu_handle_in_current_heap;
     D3D12_CPU_DESCRIPTOR_HANDLE view_cpu_handle;
@@ -424,6 +497,15 @@ class DeferredCommandList {
     UINT start_instance_location;
   };
 
+  struct D3DResolveQueryDataArguments {
+    ID3D12QueryHeap* query_heap;
+    D3D12_QUERY_TYPE type;
+    UINT start_index;
+    UINT num_queries;
+    ID3D12Resource* destination_buffer;
+    UINT64 aligned_destination_buffer_offset;
+  };
+
   struct D3DOMSetRenderTargetsArguments {
     uint8_t num_render_target_descriptors;
     bool rts_single_handle_to_descriptor_range;
@@ -460,11 +542,43 @@ class DeferredCommandList {
     D3D12_SAMPLE_POSITION sample_positions[16];
   };
 
+  // Parts of the state inherited by segments of the command stream.
+  enum class StateCommand {
+    kDescriptorHeaps,
+    kComputeRootSignature,
+    kGraphicsRootSignature,
+    kPipelineState,
+    kIndexBuffer,
+    kPrimitiveTopology,
+    kBlendFactor,
+    kRenderTargets,
+    kStencilRef,
+    kScissorRect,
+    kViewport,
+    kSamplePositions,
+
+    kCount,
+  };
+
   void* WriteCommand(Command command, size_t arguments_size);
 
+  // Returns the offset of the next command.
+  size_t ExecuteCommand(ID3D12GraphicsCommandList* command_list,
+                        ID3D12GraphicsCommandList1* command_list_1,
+                        size_t offset,
+                        ID3D12PipelineState*& current_pipeline_state) const;
+  void ExecuteRange(ID3D12GraphicsCommandList* command_list,
+                    ID3D12GraphicsCommandList1* command_list_1, size_t begin,
+                    size_t end,
+                    ID3D12PipelineState*& current_pipeline_state) const;
+
   D3D12CommandProcessor& command_processor_;
 
+  // The size of the vector is the allocated capacity, kept between
+  // submissions so the storage is only allocated (and zeroed) while growing,
+  // with command_stream_size_ being the used part.
   std::vector<uint8_t> command_stream_;
+  size_t command_stream_size_ = kCommandStreamBegin;
 };
 
 }  // namespace d3d12
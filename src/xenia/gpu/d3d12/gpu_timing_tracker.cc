@@ -0,0 +1,243 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/d3d12/gpu_timing_tracker.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/profiling.h"
+#include "xenia/gpu/d3d12/d3d12_command_processor.h"
+#include "xenia/ui/d3d12/d3d12_util.h"
+
+namespace xe {
+namespace gpu {
+namespace d3d12 {
+
+GpuTimingTracker::GpuTimingTracker(D3D12CommandProcessor& command_processor)
+    : command_processor_(command_processor) {}
+
+GpuTimingTracker::~GpuTimingTracker() { Shutdown(); }
+
+bool GpuTimingTracker::Initialize() {
+  auto& provider = command_processor_.GetD3D12Context().GetD3D12Provider();
+  auto device = provider.GetDevice();
+
+  if (FAILED(provider.GetDirectQueue()->GetTimestampFrequency(
+          &timestamp_frequency_)) ||
+      !timestamp_frequency_) {
+    XELOGE("Failed to get the GPU timestamp frequency");
+    Shutdown();
+    return false;
+  }
+
+  D3D12_QUERY_HEAP_DESC query_heap_desc;
+  query_heap_desc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+  query_heap_desc.Count = kQueryCount;
+  query_heap_desc.NodeMask = 0;
+  if (FAILED(device->CreateQueryHeap(&query_heap_desc,
+                                     IID_PPV_ARGS(&query_heap_)))) {
+    XELOGE("Failed to create the GPU timestamp query heap");
+    Shutdown();
+    return false;
+  }
+
+  D3D12_RESOURCE_DESC readback_buffer_desc;
+  ui::d3d12::util::FillBufferResourceDesc(readback_buffer_desc,
+                                          kQueryCount * sizeof(uint64_t),
+                                          D3D12_RESOURCE_FLAG_NONE);
+  if (FAILED(device->CreateCommittedResource(
+          &ui::d3d12::util::kHeapPropertiesReadback,
+          provider.GetHeapFlagCreateNotZeroed(), &readback_buffer_desc,
+          D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
+          IID_PPV_ARGS(&readback_buffer_)))) {
+    XELOGE("Failed to create the GPU timestamp readback buffer");
+    Shutdown();
+    return false;
+  }
+
+  query_next_ = 0;
+  queries_pending_ = 0;
+  return true;
+}
+
+void GpuTimingTracker::Shutdown() {
+  submissions_.clear();
+  scope_stack_.clear();
+  queries_pending_ = 0;
+  accumulated_frame_ = UINT64_MAX;
+  frame_timing_available_ = false;
+  ui::d3d12::util::ReleaseAndNull(readback_buffer_);
+  ui::d3d12::util::ReleaseAndNull(query_heap_);
+}
+
+void GpuTimingTracker::CompletedSubmissionUpdated() {
+  uint64_t completed_submission = command_processor_.GetCompletedSubmission();
+  if (submissions_.empty() ||
+      submissions_.front().submission > completed_submission) {
+    return;
+  }
+  D3D12_RANGE readback_range;
+  readback_range.Begin = 0;
+  readback_range.End = kQueryCount * sizeof(uint64_t);
+  void* readback_mapping;
+  if (FAILED(readback_buffer_->Map(0, &readback_range, &readback_mapping))) {
+    readback_mapping = nullptr;
+  }
+  const uint64_t* timestamps =
+      reinterpret_cast<const uint64_t*>(readback_mapping);
+  while (!submissions_.empty() &&
+         submissions_.front().submission <= completed_submission) {
+    const SubmissionTimestamps& submission = submissions_.front();
+    if (submission.frame != accumulated_frame_) {
+      // All the submissions of the previous frame have been read.
+      if (accumulated_frame_ != UINT64_MAX) {
+        PublishFrameTiming();
+      }
+      accumulated_frame_ = submission.frame;
+      std::memset(accumulated_ticks_, 0, sizeof(accumulated_ticks_));
+      accumulated_incomplete_ = false;
+    }
+    if (!timestamps || submission.incomplete) {
+      accumulated_incomplete_ = true;
+    } else {
+      for (uint32_t i = 0; i + 1 < submission.query_count; ++i) {
+        uint32_t query = (submission.first_query + i) % kQueryCount;
+        GpuTimingCategory category = query_categories_[query];
+        if (category == GpuTimingCategory::kCount) {
+          continue;
+        }
+        uint64_t timestamp_begin = timestamps[query];
+        uint64_t timestamp_end = timestamps[(query + 1) % kQueryCount];
+        if (timestamp_end > timestamp_begin) {
+          accumulated_ticks_[size_t(category)] +=
+              timestamp_end - timestamp_begin;
+        }
+      }
+    }
+    queries_pending_ -= submission.query_count;
+    submissions_.pop_front();
+  }
+  if (readback_mapping) {
+    D3D12_RANGE readback_write_range = {};
+    readback_buffer_->Unmap(0, &readback_write_range);
+  }
+}
+
+void GpuTimingTracker::EndSubmission() {
+  if (submissions_.empty() || submissions_.back().submission !=
+                                  command_processor_.GetCurrentSubmission()) {
+    return;
+  }
+  // Stop measuring the category of the last timestamp at the end of the
+  // command list.
+  if (submissions_.back().query_count &&
+      query_categories_[(query_next_ + kQueryCount - 1) % kQueryCount] !=
+          GpuTimingCategory::kCount) {
+    WriteTimestamp(GpuTimingCategory::kCount);
+  }
+  const SubmissionTimestamps& submission = submissions_.back();
+  if (!submission.query_count) {
+    return;
+  }
+  DeferredCommandList& command_list =
+      command_processor_.GetDeferredCommandList();
+  uint32_t first_count =
+      std::min(submission.query_count, kQueryCount - submission.first_query);
+  command_list.D3DResolveQueryData(
+      query_heap_, D3D12_QUERY_TYPE_TIMESTAMP, submission.first_query,
+      first_count, readback_buffer_,
+      submission.first_query * sizeof(uint64_t));
+  if (first_count < submission.query_count) {
+    command_list.D3DResolveQueryData(query_heap_, D3D12_QUERY_TYPE_TIMESTAMP,
+                                     0, submission.query_count - first_count,
+                                     readback_buffer_, 0);
+  }
+}
+
+void GpuTimingTracker::BeginScope(GpuTimingCategory category) {
+  scope_stack_.push_back(category);
+  WriteTimestamp(category);
+}
+
+void GpuTimingTracker::EndScope() {
+  assert_false(scope_stack_.empty());
+  if (scope_stack_.empty()) {
+    return;
+  }
+  scope_stack_.pop_back();
+  WriteTimestamp(scope_stack_.empty() ? GpuTimingCategory::kCount
+                                      : scope_stack_.back());
+}
+
+bool GpuTimingTracker::GetFrameTiming(double* microseconds_out) const {
+  if (!frame_timing_available_) {
+    return false;
+  }
+  std::memcpy(microseconds_out, frame_microseconds_,
+              sizeof(frame_microseconds_));
+  return true;
+}
+
+void GpuTimingTracker::WriteTimestamp(GpuTimingCategory category) {
+  uint64_t current_submission = command_processor_.GetCurrentSubmission();
+  if (submissions_.empty() ||
+      submissions_.back().submission != current_submission) {
+    SubmissionTimestamps& new_submission = submissions_.emplace_back();
+    new_submission.submission = current_submission;
+    new_submission.frame = command_processor_.GetCurrentFrame();
+    new_submission.first_query = query_next_;
+    new_submission.query_count = 0;
+    new_submission.incomplete = false;
+  }
+  SubmissionTimestamps& submission = submissions_.back();
+  if (queries_pending_ >= kQueryCount) {
+    submission.incomplete = true;
+    return;
+  }
+  command_processor_.GetDeferredCommandList().D3DEndQuery(
+      query_heap_, D3D12_QUERY_TYPE_TIMESTAMP, query_next_);
+  query_categories_[query_next_] = category;
+  query_next_ = (query_next_ + 1) % kQueryCount;
+  ++submission.query_count;
+  ++queries_pending_;
+}
+
+void GpuTimingTracker::PublishFrameTiming() {
+  if (accumulated_incomplete_) {
+    // Keep the previous frame's timing rather than showing partial data.
+    return;
+  }
+  for (size_t i = 0; i < size_t(GpuTimingCategory::kCount); ++i) {
+    frame_microseconds_[i] =
+        double(accumulated_ticks_[i]) * 1000000.0 / timestamp_frequency_;
+  }
+  frame_timing_available_ = true;
+  COUNT_profile_set("gpu/timing/draw_us",
+                    int64_t(frame_microseconds_[size_t(
+                        GpuTimingCategory::kDraw)]));
+  COUNT_profile_set("gpu/timing/resolve_us",
+                    int64_t(frame_microseconds_[size_t(
+                        GpuTimingCategory::kResolve)]));
+  COUNT_profile_set("gpu/timing/edram_store_us",
+                    int64_t(frame_microseconds_[size_t(
+                        GpuTimingCategory::kEdramStore)]));
+  COUNT_profile_set("gpu/timing/edram_load_us",
+                    int64_t(frame_microseconds_[size_t(
+                        GpuTimingCategory::kEdramLoad)]));
+  COUNT_profile_set("gpu/timing/texture_load_us",
+                    int64_t(frame_microseconds_[size_t(
+                        GpuTimingCategory::kTextureLoad)]));
+}
+
+}  // namespace d3d12
+}  // namespace gpu
+}  // namespace xe
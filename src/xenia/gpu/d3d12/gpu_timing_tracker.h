@@ -0,0 +1,90 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_D3D12_GPU_TIMING_TRACKER_H_
+#define XENIA_GPU_D3D12_GPU_TIMING_TRACKER_H_
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "xenia/gpu/command_processor.h"
+#include "xenia/ui/d3d12/d3d12_api.h"
+
+namespace xe {
+namespace gpu {
+namespace d3d12 {
+
+class D3D12CommandProcessor;
+
+// Measures the GPU time spent on different categories of work with timestamp
+// queries written whenever the current category changes, so nested scopes (an
+// EDRAM store within a resolve, for instance) are excluded from the outer
+// ones. The timestamps are read back when the submissions are completed and
+// summed per frame.
+class GpuTimingTracker {
+ public:
+  explicit GpuTimingTracker(D3D12CommandProcessor& command_processor);
+  ~GpuTimingTracker();
+
+  bool Initialize();
+  void Shutdown();
+
+  void CompletedSubmissionUpdated();
+  // Closes the scopes for the submission and resolves its timestamps.
+  void EndSubmission();
+
+  // Scopes must be begun and ended within one submission.
+  void BeginScope(GpuTimingCategory category);
+  void EndScope();
+
+  bool GetFrameTiming(double* microseconds_out) const;
+
+ private:
+  struct SubmissionTimestamps {
+    uint64_t submission;
+    uint64_t frame;
+    uint32_t first_query;
+    uint32_t query_count;
+    // Some timestamps were dropped because all the queries were in use.
+    bool incomplete;
+  };
+
+  void WriteTimestamp(GpuTimingCategory category);
+  void PublishFrameTiming();
+
+  D3D12CommandProcessor& command_processor_;
+
+  static constexpr uint32_t kQueryCount = 16384;
+  ID3D12QueryHeap* query_heap_ = nullptr;
+  ID3D12Resource* readback_buffer_ = nullptr;
+  uint64_t timestamp_frequency_ = 0;
+
+  // The category measured from each timestamp until the next one in the same
+  // submission, or kCount if none.
+  GpuTimingCategory query_categories_[kQueryCount];
+  uint32_t query_next_ = 0;
+  uint32_t queries_pending_ = 0;
+  std::deque<SubmissionTimestamps> submissions_;
+
+  std::vector<GpuTimingCategory> scope_stack_;
+
+  // Ticks of the frame whose submissions are being read back.
+  uint64_t accumulated_frame_ = UINT64_MAX;
+  uint64_t accumulated_ticks_[size_t(GpuTimingCategory::kCount)] = {};
+  bool accumulated_incomplete_ = false;
+  double frame_microseconds_[size_t(GpuTimingCategory::kCount)] = {};
+  bool frame_timing_available_ = false;
+};
+
+}  // namespace d3d12
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_D3D12_GPU_TIMING_TRACKER_H_
@@ -0,0 +1,222 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/d3d12/occlusion_query_tracker.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "xenia/base/logging.h"
+#include "xenia/gpu/d3d12/d3d12_command_processor.h"
+#include "xenia/gpu/gpu_flags.h"
+#include "xenia/gpu/xenos.h"
+#include "xenia/ui/d3d12/d3d12_util.h"
+
+namespace xe {
+namespace gpu {
+namespace d3d12 {
+
+OcclusionQueryTracker::OcclusionQueryTracker(
+    D3D12CommandProcessor& command_processor, Memory& memory,
+    uint32_t sample_count_shift)
+    : command_processor_(command_processor),
+      memory_(memory),
+      sample_count_shift_(sample_count_shift) {}
+
+OcclusionQueryTracker::~OcclusionQueryTracker() { Shutdown(); }
+
+bool OcclusionQueryTracker::Initialize() {
+  auto& provider = command_processor_.GetD3D12Context().GetD3D12Provider();
+  auto device = provider.GetDevice();
+
+  D3D12_QUERY_HEAP_DESC query_heap_desc;
+  query_heap_desc.Type = D3D12_QUERY_HEAP_TYPE_OCCLUSION;
+  query_heap_desc.Count = kHostQueryCount;
+  query_heap_desc.NodeMask = 0;
+  if (FAILED(device->CreateQueryHeap(&query_heap_desc,
+                                     IID_PPV_ARGS(&query_heap_)))) {
+    XELOGE("Failed to create the occlusion query heap");
+    Shutdown();
+    return false;
+  }
+
+  D3D12_RESOURCE_DESC readback_buffer_desc;
+  ui::d3d12::util::FillBufferResourceDesc(readback_buffer_desc,
+                                          kHostQueryCount * sizeof(uint64_t),
+                                          D3D12_RESOURCE_FLAG_NONE);
+  if (FAILED(device->CreateCommittedResource(
+          &ui::d3d12::util::kHeapPropertiesReadback,
+          provider.GetHeapFlagCreateNotZeroed(), &readback_buffer_desc,
+          D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
+          IID_PPV_ARGS(&readback_buffer_)))) {
+    XELOGE("Failed to create the occlusion query readback buffer");
+    Shutdown();
+    return false;
+  }
+
+  host_query_next_ = 0;
+  host_query_open_ = false;
+  return true;
+}
+
+void OcclusionQueryTracker::Shutdown() {
+  segments_.clear();
+  guest_query_first_ += guest_queries_.size();
+  guest_queries_.clear();
+  guest_query_last_end_submission_ = 0;
+  host_query_open_ = false;
+  ui::d3d12::util::ReleaseAndNull(readback_buffer_);
+  ui::d3d12::util::ReleaseAndNull(query_heap_);
+}
+
+void OcclusionQueryTracker::CompletedSubmissionUpdated() {
+  uint64_t completed_submission = command_processor_.GetCompletedSubmission();
+
+  if (!segments_.empty() &&
+      segments_.front().submission <= completed_submission) {
+    D3D12_RANGE readback_range;
+    readback_range.Begin = 0;
+    readback_range.End = kHostQueryCount * sizeof(uint64_t);
+    void* readback_mapping;
+    if (SUCCEEDED(readback_buffer_->Map(0, &readback_range,
+                                        &readback_mapping))) {
+      const uint64_t* results =
+          reinterpret_cast<const uint64_t*>(readback_mapping);
+      while (!segments_.empty() &&
+             segments_.front().submission <= completed_submission) {
+        const Segment& segment = segments_.front();
+        guest_queries_[size_t(segment.guest_query - guest_query_first_)]
+            .sample_count += results[segment.host_query];
+        segments_.pop_front();
+      }
+      D3D12_RANGE readback_write_range = {};
+      readback_buffer_->Unmap(0, &readback_write_range);
+    } else {
+      XELOGE("Failed to map the occlusion query readback buffer");
+      while (!segments_.empty() &&
+             segments_.front().submission <= completed_submission) {
+        guest_queries_[size_t(segments_.front().guest_query -
+                              guest_query_first_)]
+            .incomplete = true;
+        segments_.pop_front();
+      }
+    }
+  }
+
+  while (!guest_queries_.empty()) {
+    const GuestQuery& guest_query = guest_queries_.front();
+    if (!guest_query.ended ||
+        guest_query.last_segment_submission > completed_submission) {
+      break;
+    }
+    WriteGuestQueryResult(guest_query);
+    guest_queries_.pop_front();
+    ++guest_query_first_;
+  }
+}
+
+void OcclusionQueryTracker::EndSubmission() { EndHostQuery(); }
+
+void OcclusionQueryTracker::BeginGuestQuery(uint32_t sample_counts_address) {
+  if (!guest_queries_.empty() && !guest_queries_.back().ended) {
+    EndGuestQuery(guest_queries_.back().sample_counts_address);
+  }
+  std::memset(memory_.TranslatePhysical(sample_counts_address), 0,
+              sizeof(xe_gpu_depth_sample_counts));
+  GuestQuery& guest_query = guest_queries_.emplace_back();
+  guest_query.sample_counts_address = sample_counts_address;
+  guest_query.ended = false;
+  guest_query.incomplete = false;
+  guest_query.sample_count = 0;
+  guest_query.last_segment_submission = 0;
+}
+
+bool OcclusionQueryTracker::EndGuestQuery(uint32_t sample_counts_address) {
+  if (guest_queries_.empty() || guest_queries_.back().ended) {
+    return false;
+  }
+  EndHostQuery();
+  GuestQuery& guest_query = guest_queries_.back();
+  guest_query.sample_counts_address = sample_counts_address;
+  guest_query.ended = true;
+  guest_query_last_end_submission_ = std::max(
+      guest_query_last_end_submission_, guest_query.last_segment_submission);
+  // Write the result immediately if there were no draws.
+  CompletedSubmissionUpdated();
+  return true;
+}
+
+void OcclusionQueryTracker::BeginDraw() {
+  if (host_query_open_ || guest_queries_.empty() ||
+      guest_queries_.back().ended) {
+    return;
+  }
+  GuestQuery& guest_query = guest_queries_.back();
+  if (segments_.size() >= kHostQueryCount) {
+    // All host queries are awaiting results.
+    guest_query.incomplete = true;
+    return;
+  }
+  Segment& segment = segments_.emplace_back();
+  segment.host_query = host_query_next_;
+  segment.guest_query = guest_query_first_ + (guest_queries_.size() - 1);
+  segment.submission = command_processor_.GetCurrentSubmission();
+  host_query_next_ = (host_query_next_ + 1) % kHostQueryCount;
+  guest_query.last_segment_submission = segment.submission;
+  command_processor_.GetDeferredCommandList().D3DBeginQuery(
+      query_heap_, D3D12_QUERY_TYPE_OCCLUSION, segment.host_query);
+  host_query_open_ = true;
+}
+
+void OcclusionQueryTracker::EndHostQuery() {
+  if (!host_query_open_) {
+    return;
+  }
+  host_query_open_ = false;
+  uint32_t host_query = segments_.back().host_query;
+  DeferredCommandList& command_list =
+      command_processor_.GetDeferredCommandList();
+  command_list.D3DEndQuery(query_heap_, D3D12_QUERY_TYPE_OCCLUSION,
+                           host_query);
+  command_list.D3DResolveQueryData(query_heap_, D3D12_QUERY_TYPE_OCCLUSION,
+                                   host_query, 1, readback_buffer_,
+                                   host_query * sizeof(uint64_t));
+}
+
+uint64_t OcclusionQueryTracker::GetLastPendingSubmission() const {
+  // Ended guest queries always precede the active one.
+  if (guest_queries_.empty() || !guest_queries_.front().ended) {
+    return 0;
+  }
+  return guest_query_last_end_submission_;
+}
+
+void OcclusionQueryTracker::WriteGuestQueryResult(
+    const GuestQuery& guest_query) const {
+  uint32_t sample_count;
+  if (guest_query.incomplete) {
+    sample_count =
+        uint32_t(std::max(cvars::query_occlusion_fake_sample_count, 0));
+  } else {
+    sample_count = uint32_t(std::min(
+        guest_query.sample_count >> sample_count_shift_, uint64_t(UINT32_MAX)));
+  }
+  // Overwriting the 0xFFFFFEED end marker, which signals the completion of the
+  // query to the guest.
+  auto sample_counts =
+      memory_.TranslatePhysical<xe_gpu_depth_sample_counts*>(
+          guest_query.sample_counts_address);
+  std::memset(sample_counts, 0, sizeof(xe_gpu_depth_sample_counts));
+  sample_counts->ZPass_A = sample_count;
+  sample_counts->Total_A = sample_count;
+}
+
+}  // namespace d3d12
+}  // namespace gpu
+}  // namespace xe
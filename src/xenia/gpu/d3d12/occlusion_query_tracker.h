@@ -0,0 +1,112 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_D3D12_OCCLUSION_QUERY_TRACKER_H_
+#define XENIA_GPU_D3D12_OCCLUSION_QUERY_TRACKER_H_
+
+#include <cstdint>
+#include <deque>
+
+#include "xenia/memory.h"
+#include "xenia/ui/d3d12/d3d12_api.h"
+
+namespace xe {
+namespace gpu {
+namespace d3d12 {
+
+class D3D12CommandProcessor;
+
+// Counts the samples passing the depth / stencil test between the beginning
+// and the end of guest occlusion queries (EVENT_WRITE_ZPD) with host occlusion
+// queries, and writes the results to the guest sample count structures when
+// the submissions containing them are completed, without waiting for the GPU.
+//
+// Host queries can't span multiple command lists, so a guest query is split
+// into segments - one for every submission with draws within it - and the
+// segment results are summed. Only valid when the host depth / stencil buffer
+// is used (not with rasterizer-ordered views).
+class OcclusionQueryTracker {
+ public:
+  OcclusionQueryTracker(D3D12CommandProcessor& command_processor,
+                        Memory& memory, uint32_t sample_count_shift);
+  ~OcclusionQueryTracker();
+
+  bool Initialize();
+  void Shutdown();
+
+  // Writes the results of guest queries whose segments have been completed.
+  void CompletedSubmissionUpdated();
+  void EndSubmission();
+
+  // Zeroes the sample counts at the address, and starts counting samples for a
+  // new guest query, ending the current one if there is one.
+  void BeginGuestQuery(uint32_t sample_counts_address);
+  // Returns false if no guest query was begun, so the result can't be taken
+  // from the host.
+  bool EndGuestQuery(uint32_t sample_counts_address);
+
+  // Must be called before every guest draw within a submission to make sure a
+  // host query is active if needed.
+  void BeginDraw();
+  // Pauses counting until the next BeginDraw, for host draws not visible to
+  // the guest, like presentation.
+  void EndHostQuery();
+
+  // The last submission that needs to be completed for all the results of the
+  // ended guest queries to be written, or 0 if none are pending.
+  uint64_t GetLastPendingSubmission() const;
+
+ private:
+  struct GuestQuery {
+    uint32_t sample_counts_address;
+    bool ended;
+    // Not all samples have been counted because host queries were exhausted -
+    // the fake sample count will be written instead.
+    bool incomplete;
+    uint64_t sample_count;
+    // Submission of the last segment, or 0 if there are no segments.
+    uint64_t last_segment_submission;
+  };
+
+  struct Segment {
+    uint32_t host_query;
+    uint64_t guest_query;
+    uint64_t submission;
+  };
+
+  void WriteGuestQueryResult(const GuestQuery& guest_query) const;
+
+  D3D12CommandProcessor& command_processor_;
+  Memory& memory_;
+  // log2 of the number of host samples per guest sample, for resolution
+  // scaling.
+  uint32_t sample_count_shift_;
+
+  static constexpr uint32_t kHostQueryCount = 8192;
+  ID3D12QueryHeap* query_heap_ = nullptr;
+  // kHostQueryCount 64-bit results at the offsets of the host queries.
+  ID3D12Resource* readback_buffer_ = nullptr;
+  uint32_t host_query_next_ = 0;
+  bool host_query_open_ = false;
+
+  // Ordered by submission, thus using the host queries as a ring.
+  std::deque<Segment> segments_;
+  // Guest queries not written yet, with the active one being the last if it
+  // hasn't been ended. Identified by the sequence number, starting from
+  // guest_query_first_.
+  std::deque<GuestQuery> guest_queries_;
+  uint64_t guest_query_first_ = 0;
+  uint64_t guest_query_last_end_submission_ = 0;
+};
+
+}  // namespace d3d12
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_D3D12_OCCLUSION_QUERY_TRACKER_H_
@@ -19,16 +19,18 @@
 #include <utility>
 
 #include "third_party/fmt/include/fmt/format.h"
-#include "third_party/xxhash/xxhash.h"
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_order.h"
 #include "xenia/base/clock.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/filesystem.h"
+#include "xenia/base/hash.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
+#include "xenia/base/startup_timeline.h"
 #include "xenia/base/string.h"
+#include "xenia/base/threading.h"
 #include "xenia/gpu/d3d12/d3d12_command_processor.h"
 #include "xenia/gpu/gpu_flags.h"
 #include "xenia/ui/d3d12/d3d12_util.h"
@@ -48,6 +50,22 @@ DEFINE_int32(
     "specify the number of threads explicitly (up to the number of logical CPU "
     "cores), 0 to disable multithreaded pipeline state object creation.",
     "D3D12");
+DEFINE_int32(
+    d3d12_shader_specialization_draws, 0,
+    "Number of consecutive draws with the same values of the bool and loop "
+    "constants used by the shaders of a pipeline after which a version of the "
+    "pipeline with those constants folded into the shader code (without "
+    "runtime checks, with loops with constant trip counts) is created in the "
+    "background. The generic pipeline is used until the version is ready. 0 "
+    "to disable. Requires multithreaded pipeline state object creation.",
+    "D3D12");
+DEFINE_bool(
+    d3d12_edram_rov_specialization, true,
+    "With d3d12_shader_specialization_draws and the ROV, also fold the render "
+    "target formats, write masks, blending and the sample count into the "
+    "output merger code of the specialized pixel shaders, so the emulation of "
+    "formats and blending modes not used by the draws is skipped.",
+    "D3D12");
 DEFINE_bool(d3d12_tessellation_wireframe, false,
             "Display tessellated surfaces as wireframe for debugging.",
             "D3D12");
@@ -146,6 +164,9 @@ bool PipelineCache::Initialize() {
       std::unique_ptr<xe::threading::Thread> creation_thread =
           xe::threading::Thread::Create({}, [this, i]() { CreationThread(i); });
       creation_thread->set_name("D3D12 Pipeline States");
+      xe::threading::ApplyThreadRole(
+          creation_thread.get(),
+          xe::threading::ThreadRole::kShaderCompilation);
       creation_threads_.push_back(std::move(creation_thread));
     }
   }
@@ -176,7 +197,7 @@ void PipelineCache::Shutdown() {
 
 void PipelineCache::ClearCache(bool shutting_down) {
   bool reinitialize_shader_storage =
-      !shutting_down && storage_write_thread_ != nullptr;
+      !shutting_down && !shader_storage_root_.empty();
   std::filesystem::path shader_storage_root;
   uint32_t shader_storage_title_id = shader_storage_title_id_;
   if (reinitialize_shader_storage) {
@@ -194,6 +215,8 @@ void PipelineCache::ClearCache(bool shutting_down) {
     bool await_creation_completion_event = false;
     {
       std::lock_guard<std::mutex> lock(creation_request_lock_);
+      command_processor_.benchmark_counters().CountPipelineCreationsDone(
+          uint32_t(creation_queue_.size()));
       creation_queue_.clear();
       await_creation_completion_event = creation_threads_busy_ != 0;
       if (await_creation_completion_event) {
@@ -205,9 +228,22 @@ void PipelineCache::ClearCache(bool shutting_down) {
       creation_request_cond_.notify_one();
       xe::threading::Wait(creation_completion_event_.get(), false);
     }
+    // Specializations reference the pipeline states and the shaders too.
+    {
+      std::unique_lock<std::mutex> lock(creation_request_lock_);
+      specialization_queue_.clear();
+      specialization_idle_cond_.wait(
+          lock, [this]() { return specialization_threads_busy_ == 0; });
+    }
   }
 
   // Destroy all pipeline state objects.
+  for (PipelineState* specialized_pipeline_state :
+       specialized_pipeline_states_) {
+    specialized_pipeline_state->state->Release();
+    delete specialized_pipeline_state;
+  }
+  specialized_pipeline_states_.clear();
   for (auto it : pipeline_states_) {
     it.second->state->Release();
     delete it.second;
@@ -223,6 +259,10 @@ void PipelineCache::ClearCache(bool shutting_down) {
   }
   texture_binding_layout_map_.clear();
   texture_binding_layouts_.clear();
+  for (auto it : specialized_shaders_) {
+    delete it.second;
+  }
+  specialized_shaders_.clear();
   for (auto it : shader_map_) {
     delete it.second;
   }
@@ -268,15 +308,28 @@ void PipelineCache::InitializeShaderStorage(
       xe::Clock::QueryHostTickCount();
   auto shader_storage_file_path =
       shader_storage_shareable_root / fmt::format("{:08X}.xsh", title_id);
+  shader_storage_lock_ =
+      xe::filesystem::FileLock::TryAcquireForStorage(shader_storage_file_path);
+  bool storage_read_only = !shader_storage_lock_;
+  const char* storage_file_mode = storage_read_only ? "rb" : "a+b";
   shader_storage_file_ =
-      xe::filesystem::OpenFile(shader_storage_file_path, "a+b");
+      xe::filesystem::OpenFile(shader_storage_file_path, storage_file_mode);
   if (!shader_storage_file_) {
-    XELOGE(
-        "Failed to open the guest shader storage file for writing, persistent "
-        "shader storage will be disabled: {}",
-        xe::path_to_utf8(shader_storage_file_path));
+    if (!storage_read_only) {
+      XELOGE(
+          "Failed to open the guest shader storage file for writing, "
+          "persistent shader storage will be disabled: {}",
+          xe::path_to_utf8(shader_storage_file_path));
+    }
+    shader_storage_lock_.reset();
     return;
   }
+  if (storage_read_only) {
+    XELOGGPU(
+        "The shader storage is used by another process, loading it read-only: "
+        "{}",
+        xe::path_to_utf8(shader_storage_file_path));
+  }
   shader_storage_file_flush_needed_ = false;
   struct {
     uint32_t magic;
@@ -326,19 +379,20 @@ void PipelineCache::InitializeShaderStorage(
       }
       for (;;) {
         std::pair<ShaderStoredHeader, D3D12Shader*> shader_to_translate;
-        for (;;) {
+        {
           std::unique_lock<std::mutex> lock(shaders_translation_thread_mutex);
-          if (shaders_to_translate.empty()) {
-            if (shader_translation_threads_shutdown) {
-              return;
-            }
+          while (shaders_to_translate.empty() &&
+                 !shader_translation_threads_shutdown) {
             shaders_translation_thread_cond.wait(lock);
-            continue;
+          }
+          if (shaders_to_translate.empty()) {
+            // Shutting down - break rather than return to release the DXIL
+            // objects.
+            break;
           }
           shader_to_translate = shaders_to_translate.front();
           shaders_to_translate.pop_front();
           ++shader_translation_threads_busy;
-          break;
         }
         assert_not_null(shader_to_translate.second);
         if (!TranslateShader(
@@ -394,7 +448,7 @@ void PipelineCache::InitializeShaderStorage(
         break;
       }
       uint64_t ucode_data_hash =
-          XXH64(ucode_dwords.data(), ucode_byte_count, 0);
+          xe::hash::Hash64(ucode_dwords.data(), ucode_byte_count);
       if (shader_header.ucode_data_hash != ucode_data_hash) {
         // Validation failed.
         break;
@@ -419,6 +473,9 @@ void PipelineCache::InitializeShaderStorage(
         shader_translation_threads.push_back(xe::threading::Thread::Create(
             {}, shader_translation_thread_function));
         shader_translation_threads.back()->set_name("Shader Translation");
+        xe::threading::ApplyThreadRole(
+            shader_translation_threads.back().get(),
+            xe::threading::ThreadRole::kShaderCompilation);
       }
       {
         std::lock_guard<std::mutex> lock(shaders_translation_thread_mutex);
@@ -428,12 +485,16 @@ void PipelineCache::InitializeShaderStorage(
       shader_storage_valid_bytes += sizeof(shader_header) + ucode_byte_count;
       ++shaders_translated;
     }
-    if (!shader_translation_threads.empty()) {
+    if (shaders_translated) {
       {
         std::lock_guard<std::mutex> lock(shaders_translation_thread_mutex);
         shader_translation_threads_shutdown = true;
       }
       shaders_translation_thread_cond.notify_all();
+      // Reading is done, so this thread can translate the remaining shaders
+      // too instead of only waiting (this is also the only thread translating
+      // if there's just one logical processor).
+      shader_translation_thread_function();
       for (auto& shader_translation_thread : shader_translation_threads) {
         xe::threading::Wait(shader_translation_thread.get(), false);
       }
@@ -448,9 +509,11 @@ void PipelineCache::InitializeShaderStorage(
              (xe::Clock::QueryHostTickCount() -
               shader_storage_initialization_start) *
                  1000 / xe::Clock::QueryHostTickFrequency());
-    xe::filesystem::TruncateStdioFile(shader_storage_file_,
-                                      shader_storage_valid_bytes);
-  } else {
+    if (!storage_read_only) {
+      xe::filesystem::TruncateStdioFile(shader_storage_file_,
+                                        shader_storage_valid_bytes);
+    }
+  } else if (!storage_read_only) {
     xe::filesystem::TruncateStdioFile(shader_storage_file_, 0);
     shader_storage_file_header.magic = shader_storage_magic;
     shader_storage_file_header.version_swapped =
@@ -470,15 +533,18 @@ void PipelineCache::InitializeShaderStorage(
       shader_storage_shareable_root /
       fmt::format("{:08X}.{}.d3d12.xpso", title_id,
                   edram_rov_used_ ? "rov" : "rtv");
-  pipeline_state_storage_file_ =
-      xe::filesystem::OpenFile(pipeline_state_storage_file_path, "a+b");
+  pipeline_state_storage_file_ = xe::filesystem::OpenFile(
+      pipeline_state_storage_file_path, storage_file_mode);
   if (!pipeline_state_storage_file_) {
-    XELOGE(
-        "Failed to open the Direct3D 12 pipeline state description storage "
-        "file for writing, persistent shader storage will be disabled: {}",
-        xe::path_to_utf8(pipeline_state_storage_file_path));
+    if (!storage_read_only) {
+      XELOGE(
+          "Failed to open the Direct3D 12 pipeline state description storage "
+          "file for writing, persistent shader storage will be disabled: {}",
+          xe::path_to_utf8(pipeline_state_storage_file_path));
+    }
     fclose(shader_storage_file_);
     shader_storage_file_ = nullptr;
+    shader_storage_lock_.reset();
     return;
   }
   pipeline_state_storage_file_flush_needed_ = false;
@@ -523,6 +589,8 @@ void PipelineCache::InitializeShaderStorage(
           sizeof(PipelineStoredDescription), pipeline_state_storage_told_count,
           pipeline_state_storage_file_));
       if (!pipeline_stored_descriptions.empty()) {
+        startup_timeline::ScopedPhase startup_phase(
+            "Pipeline pre-creation from the storage");
         // Launch additional creation threads to use all cores to create
         // pipeline state objects faster. Will also be using the main thread, so
         // minus 1.
@@ -540,6 +608,9 @@ void PipelineCache::InitializeShaderStorage(
                     CreationThread(creation_thread_index);
                   });
           creation_thread->set_name("D3D12 Pipeline States Additional");
+          xe::threading::ApplyThreadRole(
+              creation_thread.get(),
+              xe::threading::ThreadRole::kShaderCompilation);
           creation_threads_.push_back(std::move(creation_thread));
         }
         size_t pipeline_states_created = 0;
@@ -549,9 +620,8 @@ void PipelineCache::InitializeShaderStorage(
               pipeline_stored_description.description;
           // Validate file integrity, stop and truncate the stream if data is
           // corrupted.
-          if (XXH64(&pipeline_stored_description.description,
-                    sizeof(pipeline_stored_description.description),
-                    0) != pipeline_stored_description.description_hash) {
+          if (xe::hash::HashKey(pipeline_stored_description.description) !=
+              pipeline_stored_description.description_hash) {
             break;
           }
           pipeline_state_storage_valid_bytes +=
@@ -622,6 +692,8 @@ void PipelineCache::InitializeShaderStorage(
             {
               std::lock_guard<std::mutex> lock(creation_request_lock_);
               creation_queue_.push_back(new_pipeline_state);
+              command_processor_.benchmark_counters()
+                  .CountPipelineCreationsQueued();
             }
             creation_request_cond_.notify_one();
           } else {
@@ -672,9 +744,11 @@ void PipelineCache::InitializeShaderStorage(
                 1000 / xe::Clock::QueryHostTickFrequency());
       }
     }
-    xe::filesystem::TruncateStdioFile(pipeline_state_storage_file_,
-                                      pipeline_state_storage_valid_bytes);
-  } else {
+    if (!storage_read_only) {
+      xe::filesystem::TruncateStdioFile(pipeline_state_storage_file_,
+                                        pipeline_state_storage_valid_bytes);
+    }
+  } else if (!storage_read_only) {
     xe::filesystem::TruncateStdioFile(pipeline_state_storage_file_, 0);
     pipeline_state_storage_file_header.magic = pipeline_state_storage_magic;
     pipeline_state_storage_file_header.magic_api =
@@ -689,12 +763,24 @@ void PipelineCache::InitializeShaderStorage(
   shader_storage_root_ = storage_root;
   shader_storage_title_id_ = title_id;
 
+  if (storage_read_only) {
+    // Nothing is written, which all the storage writes check through the
+    // files being open.
+    fclose(pipeline_state_storage_file_);
+    pipeline_state_storage_file_ = nullptr;
+    fclose(shader_storage_file_);
+    shader_storage_file_ = nullptr;
+    return;
+  }
+
   // Start the storage writing thread.
   storage_write_flush_shaders_ = false;
   storage_write_flush_pipeline_states_ = false;
   storage_write_thread_shutdown_ = false;
   storage_write_thread_ =
       xe::threading::Thread::Create({}, [this]() { StorageWriteThread(); });
+  xe::threading::ApplyThreadRole(storage_write_thread_.get(),
+                                 xe::threading::ThreadRole::kIo);
 }
 
 void PipelineCache::ShutdownShaderStorage() {
@@ -722,6 +808,8 @@ void PipelineCache::ShutdownShaderStorage() {
     shader_storage_file_flush_needed_ = false;
   }
 
+  shader_storage_lock_.reset();
+
   shader_storage_root_.clear();
   shader_storage_title_id_ = 0;
 }
@@ -778,7 +866,8 @@ D3D12Shader* PipelineCache::LoadShader(xenos::ShaderType shader_type,
                                        const uint32_t* host_address,
                                        uint32_t dword_count) {
   // Hash the input memory and lookup the shader.
-  uint64_t data_hash = XXH64(host_address, dword_count * sizeof(uint32_t), 0);
+  uint64_t data_hash =
+      xe::hash::Hash64(host_address, dword_count * sizeof(uint32_t));
   auto it = shader_map_.find(data_hash);
   if (it != shader_map_.end()) {
     // Shader has been previously loaded.
@@ -955,7 +1044,7 @@ bool PipelineCache::ConfigurePipeline(
   }
 
   // Find an existing pipeline state object in the cache.
-  uint64_t hash = XXH64(&description, sizeof(description), 0);
+  uint64_t hash = xe::hash::HashKey(description);
   auto found_range = pipeline_states_.equal_range(hash);
   for (auto it = found_range.first; it != found_range.second; ++it) {
     PipelineState* found_pipeline_state = it->second;
@@ -987,6 +1076,7 @@ bool PipelineCache::ConfigurePipeline(
     {
       std::lock_guard<std::mutex> lock(creation_request_lock_);
       creation_queue_.push_back(new_pipeline_state);
+      command_processor_.benchmark_counters().CountPipelineCreationsQueued();
     }
     creation_request_cond_.notify_one();
   } else {
@@ -1014,6 +1104,253 @@ bool PipelineCache::ConfigurePipeline(
   return true;
 }
 
+void* PipelineCache::GetSpecializedPipelineState(
+    void* pipeline_state_handle,
+    const DxbcShaderTranslator::SystemConstants& system_constants) {
+  if (cvars::d3d12_shader_specialization_draws <= 0 ||
+      creation_threads_.empty()) {
+    return pipeline_state_handle;
+  }
+  PipelineState* pipeline_state =
+      reinterpret_cast<PipelineState*>(pipeline_state_handle);
+  const D3D12Shader* vertex_shader = pipeline_state->description.vertex_shader;
+  const D3D12Shader* pixel_shader = pipeline_state->description.pixel_shader;
+
+  // Gather the values of the constants that the shaders actually use.
+  const auto& regs = register_file_;
+  SpecializationRequest request;
+  uint32_t loop_bitmap = vertex_shader->constant_register_map().loop_bitmap;
+  if (pixel_shader) {
+    loop_bitmap |= pixel_shader->constant_register_map().loop_bitmap;
+  }
+  uint32_t constants_used = loop_bitmap;
+  for (uint32_t i = 0; i < xe::countof(request.bool_constants); ++i) {
+    uint32_t bool_bitmap =
+        vertex_shader->constant_register_map().bool_bitmap[i];
+    if (pixel_shader) {
+      bool_bitmap |= pixel_shader->constant_register_map().bool_bitmap[i];
+    }
+    constants_used |= bool_bitmap;
+    request.bool_constants[i] =
+        regs[XE_GPU_REG_SHADER_CONSTANT_BOOL_000_031 + i].u32 & bool_bitmap;
+  }
+  request.rov_output_merger_specialized = edram_rov_used_ && pixel_shader &&
+                                          cvars::d3d12_edram_rov_specialization;
+  if (!constants_used && !request.rov_output_merger_specialized) {
+    return pipeline_state_handle;
+  }
+  std::memset(request.loop_constants, 0, sizeof(request.loop_constants));
+  uint32_t loop_index;
+  while (xe::bit_scan_forward(loop_bitmap, &loop_index)) {
+    loop_bitmap &= ~(uint32_t(1) << loop_index);
+    request.loop_constants[loop_index] =
+        regs[XE_GPU_REG_SHADER_CONSTANT_LOOP_00 + loop_index].u32;
+  }
+  uint64_t constants_hash = xe::hash::Hash64(
+      request.bool_constants,
+      sizeof(request.bool_constants) + sizeof(request.loop_constants));
+  if (request.rov_output_merger_specialized) {
+    // Only the state of the render targets actually written, so stale values
+    // of the constants for disabled render targets don't matter.
+    DxbcShaderTranslator::RovOutputMergerSpecialization& output_merger =
+        request.rov_output_merger;
+    std::memset(&output_merger, 0, sizeof(output_merger));
+    output_merger.sample_count_log2[0] = system_constants.sample_count_log2[0];
+    output_merger.sample_count_log2[1] = system_constants.sample_count_log2[1];
+    for (uint32_t i = 0; i < 4; ++i) {
+      if (!pixel_shader->writes_color_target(i) ||
+          (system_constants.edram_rt_keep_mask[i][0] == UINT32_MAX &&
+           system_constants.edram_rt_keep_mask[i][1] == UINT32_MAX)) {
+        output_merger.edram_rt_keep_mask[i][0] = UINT32_MAX;
+        output_merger.edram_rt_keep_mask[i][1] = UINT32_MAX;
+        continue;
+      }
+      output_merger.edram_rt_format_flags[i] =
+          system_constants.edram_rt_format_flags[i];
+      std::memcpy(output_merger.edram_rt_clamp[i],
+                  system_constants.edram_rt_clamp[i],
+                  sizeof(output_merger.edram_rt_clamp[i]));
+      output_merger.edram_rt_keep_mask[i][0] =
+          system_constants.edram_rt_keep_mask[i][0];
+      output_merger.edram_rt_keep_mask[i][1] =
+          system_constants.edram_rt_keep_mask[i][1];
+      output_merger.edram_rt_blend_factors_ops[i] =
+          system_constants.edram_rt_blend_factors_ops[i];
+    }
+    constants_hash =
+        xe::hash::HashKey(output_merger, constants_hash);
+  }
+
+  if (pipeline_state->specialization_constants_hash != constants_hash) {
+    pipeline_state->specialization_constants_hash = constants_hash;
+    pipeline_state->specialization_stable_draws = 0;
+  }
+  if (pipeline_state->specialization_stable_draws < UINT32_MAX) {
+    ++pipeline_state->specialization_stable_draws;
+  }
+  for (const auto& specialization : pipeline_state->specializations) {
+    if (specialization->constants_hash == constants_hash) {
+      PipelineState* specialized_pipeline_state =
+          specialization->pipeline_state.load(std::memory_order_acquire);
+      return specialized_pipeline_state ? specialized_pipeline_state
+                                        : pipeline_state_handle;
+    }
+  }
+  if (pipeline_state->specialization_stable_draws <
+          uint32_t(cvars::d3d12_shader_specialization_draws) ||
+      pipeline_state->specializations.size() >= kMaxPipelineSpecializations) {
+    return pipeline_state_handle;
+  }
+
+  // Request the creation of the specialized pipeline state object, and use
+  // the generic one until it's created.
+  auto specialization = std::make_unique<PipelineSpecialization>();
+  specialization->constants_hash = constants_hash;
+  specialization->pipeline_state.store(nullptr, std::memory_order_relaxed);
+  request.specialization = specialization.get();
+  std::memcpy(&request.description, &pipeline_state->description,
+              sizeof(request.description));
+  request.sq_program_cntl = regs.Get<reg::SQ_PROGRAM_CNTL>();
+  pipeline_state->specializations.push_back(std::move(specialization));
+  {
+    std::lock_guard<std::mutex> lock(creation_request_lock_);
+    specialization_queue_.push_back(request);
+  }
+  creation_request_cond_.notify_one();
+  return pipeline_state_handle;
+}
+
+D3D12Shader* PipelineCache::GetSpecializedShader(
+    DxbcShaderTranslator& translator, const D3D12Shader& shader,
+    const SpecializationRequest& request) {
+  const Shader::ConstantRegisterMap& constant_register_map =
+      shader.constant_register_map();
+  struct {
+    uint64_t ucode_data_hash;
+    uint32_t bool_constants[256 / 32];
+    uint32_t loop_constants[32];
+  } key;
+  key.ucode_data_hash = shader.ucode_data_hash();
+  for (uint32_t i = 0; i < xe::countof(key.bool_constants); ++i) {
+    key.bool_constants[i] =
+        request.bool_constants[i] & constant_register_map.bool_bitmap[i];
+  }
+  for (uint32_t i = 0; i < xe::countof(key.loop_constants); ++i) {
+    key.loop_constants[i] =
+        (constant_register_map.loop_bitmap & (uint32_t(1) << i))
+            ? request.loop_constants[i]
+            : 0;
+  }
+  uint64_t key_hash = xe::hash::HashKey(key);
+  bool rov_output_merger_specialized =
+      shader.type() == xenos::ShaderType::kPixel &&
+      request.rov_output_merger_specialized;
+  if (rov_output_merger_specialized) {
+    key_hash = xe::hash::HashKey(request.rov_output_merger, key_hash);
+  }
+  {
+    std::lock_guard<std::mutex> lock(specializations_mutex_);
+    auto it = specialized_shaders_.find(key_hash);
+    if (it != specialized_shaders_.end()) {
+      return it->second;
+    }
+  }
+
+  // The shader constructor takes the guest ucode, with the original
+  // endianness.
+  std::vector<uint32_t> guest_ucode(shader.ucode_dword_count());
+  xe::copy_and_swap(guest_ucode.data(), shader.ucode_dwords(),
+                    guest_ucode.size());
+  auto specialized_shader = std::make_unique<D3D12Shader>(
+      shader.type(), key_hash, guest_ucode.data(),
+      uint32_t(guest_ucode.size()));
+  translator.SetBoolLoopConstantSpecialization(key.bool_constants,
+                                               key.loop_constants);
+  if (rov_output_merger_specialized) {
+    translator.SetRovOutputMergerSpecialization(&request.rov_output_merger);
+  }
+  bool translated = TranslateShader(translator, *specialized_shader,
+                                    request.sq_program_cntl, nullptr, nullptr,
+                                    nullptr, shader.host_vertex_shader_type());
+  translator.SetBoolLoopConstantSpecialization(nullptr, nullptr);
+  translator.SetRovOutputMergerSpecialization(nullptr);
+  if (!translated) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(specializations_mutex_);
+  // Another thread may have translated the same shader in the meantime.
+  auto it = specialized_shaders_.emplace(key_hash, specialized_shader.get());
+  if (it.second) {
+    specialized_shader.release();
+  }
+  return it.first->second;
+}
+
+void PipelineCache::CreateSpecializedPipelineState(
+    DxbcShaderTranslator& translator, const SpecializationRequest& request) {
+  PipelineRuntimeDescription runtime_description;
+  std::memcpy(&runtime_description, &request.description,
+              sizeof(runtime_description));
+  // Shaders not depending on any specialized state can be shared with the
+  // generic pipeline.
+  auto is_specialization_needed = [&request](const D3D12Shader& shader) {
+    if (shader.type() == xenos::ShaderType::kPixel &&
+        request.rov_output_merger_specialized) {
+      return true;
+    }
+    const Shader::ConstantRegisterMap& constant_register_map =
+        shader.constant_register_map();
+    if (constant_register_map.loop_bitmap) {
+      return true;
+    }
+    for (uint32_t i = 0; i < xe::countof(constant_register_map.bool_bitmap);
+         ++i) {
+      if (constant_register_map.bool_bitmap[i]) {
+        return true;
+      }
+    }
+    return false;
+  };
+  if (is_specialization_needed(*request.description.vertex_shader)) {
+    runtime_description.vertex_shader = GetSpecializedShader(
+        translator, *request.description.vertex_shader, request);
+    if (!runtime_description.vertex_shader) {
+      return;
+    }
+  }
+  if (request.description.pixel_shader &&
+      is_specialization_needed(*request.description.pixel_shader)) {
+    runtime_description.pixel_shader = GetSpecializedShader(
+        translator, *request.description.pixel_shader, request);
+    if (!runtime_description.pixel_shader) {
+      return;
+    }
+  }
+  runtime_description.description.vertex_shader_hash =
+      runtime_description.vertex_shader->ucode_data_hash();
+  if (runtime_description.pixel_shader) {
+    runtime_description.description.pixel_shader_hash =
+        runtime_description.pixel_shader->ucode_data_hash();
+  }
+  // The texture and sampler bindings are gathered from all the instructions
+  // regardless of the flow control, so the root signature and the bindings
+  // of the generic shaders are still valid.
+  ID3D12PipelineState* state = CreateD3D12PipelineState(runtime_description);
+  if (!state) {
+    return;
+  }
+  PipelineState* specialized_pipeline_state = new PipelineState;
+  specialized_pipeline_state->state = state;
+  std::memcpy(&specialized_pipeline_state->description, &runtime_description,
+              sizeof(runtime_description));
+  {
+    std::lock_guard<std::mutex> lock(specializations_mutex_);
+    specialized_pipeline_states_.push_back(specialized_pipeline_state);
+  }
+  request.specialization->pipeline_state.store(specialized_pipeline_state,
+                                               std::memory_order_release);
+}
+
 bool PipelineCache::TranslateShader(
     DxbcShaderTranslator& translator, D3D12Shader& shader,
     reg::SQ_PROGRAM_CNTL cntl, IDxbcConverter* dxbc_converter,
@@ -1079,19 +1416,17 @@ bool PipelineCache::TranslateShader(
   uint64_t texture_binding_layout_hash = 0;
   if (texture_binding_count) {
     texture_binding_layout_hash =
-        XXH64(texture_bindings, texture_binding_layout_bytes, 0);
+        xe::hash::Hash64(texture_bindings, texture_binding_layout_bytes);
   }
   uint32_t bindless_sampler_count =
       bindless_resources_used_ ? sampler_binding_count : 0;
   uint64_t bindless_sampler_layout_hash = 0;
   if (bindless_sampler_count) {
-    XXH64_state_t hash_state;
-    XXH64_reset(&hash_state, 0);
+    xe::hash::StreamingHash64 hash;
     for (uint32_t i = 0; i < bindless_sampler_count; ++i) {
-      XXH64_update(&hash_state, &sampler_bindings[i].bindless_descriptor_index,
-                   sizeof(sampler_bindings[i].bindless_descriptor_index));
+      hash.UpdateKey(sampler_bindings[i].bindless_descriptor_index);
     }
-    bindless_sampler_layout_hash = XXH64_digest(&hash_state);
+    bindless_sampler_layout_hash = hash.Digest();
   }
   // Obtain the unique IDs of binding layouts if there are any texture bindings
   // or bindless samplers, for invalidation in the command processor.
@@ -1911,6 +2246,7 @@ ID3D12PipelineState* PipelineCache::CreateD3D12PipelineState(
     }
     return nullptr;
   }
+  command_processor_.benchmark_counters().CountPipelineCreation();
   std::wstring name;
   if (runtime_description.pixel_shader != nullptr) {
     name = fmt::format(L"VS {:016X}, PS {:016X}",
@@ -2008,40 +2344,73 @@ void PipelineCache::StorageWriteThread() {
 }
 
 void PipelineCache::CreationThread(size_t thread_index) {
+  // Translator for specialized shaders, created when first needed.
+  std::unique_ptr<DxbcShaderTranslator> specialization_translator;
+
   while (true) {
     PipelineState* pipeline_state_to_create = nullptr;
+    SpecializationRequest specialization_request;
+    bool specialization_requested = false;
 
     // Check if need to shut down or set the completion event and dequeue the
     // pipeline state if there is any.
     {
       std::unique_lock<std::mutex> lock(creation_request_lock_);
-      if (thread_index >= creation_threads_shutdown_from_ ||
+      if (creation_completion_set_event_ && creation_threads_busy_ == 0 &&
           creation_queue_.empty()) {
-        if (creation_completion_set_event_ && creation_threads_busy_ == 0) {
-          // Last pipeline state object in the queue created - signal the event
-          // if requested.
-          creation_completion_set_event_ = false;
-          creation_completion_event_->Set();
-        }
-        if (thread_index >= creation_threads_shutdown_from_) {
-          return;
-        }
+        // Last pipeline state object in the queue created - signal the event
+        // if requested. Specializations are not awaited.
+        creation_completion_set_event_ = false;
+        creation_completion_event_->Set();
+      }
+      if (thread_index >= creation_threads_shutdown_from_) {
+        return;
+      }
+      if (creation_queue_.empty() && specialization_queue_.empty()) {
         creation_request_cond_.wait(lock);
         continue;
       }
-      // Take the pipeline state from the queue and increment the busy thread
-      // count until the pipeline state object is created - other threads must
-      // be able to dequeue requests, but can't set the completion event until
-      // the pipeline state objects are fully created (rather than just started
-      // creating).
-      pipeline_state_to_create = creation_queue_.front();
-      creation_queue_.pop_front();
-      ++creation_threads_busy_;
+      if (!creation_queue_.empty()) {
+        // Take the pipeline state from the queue and increment the busy thread
+        // count until the pipeline state object is created - other threads
+        // must be able to dequeue requests, but can't set the completion event
+        // until the pipeline state objects are fully created (rather than just
+        // started creating).
+        pipeline_state_to_create = creation_queue_.front();
+        creation_queue_.pop_front();
+        ++creation_threads_busy_;
+      } else {
+        // Pipeline state objects needed for drawing take priority over
+        // specializations.
+        specialization_request = specialization_queue_.front();
+        specialization_queue_.pop_front();
+        specialization_requested = true;
+        ++specialization_threads_busy_;
+      }
+    }
+
+    if (specialization_requested) {
+      if (!specialization_translator) {
+        auto& provider =
+            command_processor_.GetD3D12Context().GetD3D12Provider();
+        specialization_translator = std::make_unique<DxbcShaderTranslator>(
+            provider.GetAdapterVendorID(), bindless_resources_used_,
+            edram_rov_used_, provider.GetGraphicsAnalysis() != nullptr);
+      }
+      CreateSpecializedPipelineState(*specialization_translator,
+                                     specialization_request);
+      {
+        std::lock_guard<std::mutex> lock(creation_request_lock_);
+        --specialization_threads_busy_;
+      }
+      specialization_idle_cond_.notify_all();
+      continue;
     }
 
     // Create the D3D12 pipeline state object.
     pipeline_state_to_create->state =
         CreateD3D12PipelineState(pipeline_state_to_create->description);
+    command_processor_.benchmark_counters().CountPipelineCreationsDone();
 
     // Pipeline state object created - the thread is not busy anymore, safe to
     // set the completion event if needed (at the next iteration, or in some
@@ -2067,6 +2436,7 @@ void PipelineCache::CreateQueuedPipelineStatesOnProcessorThread() {
     }
     pipeline_state_to_create->state =
         CreateD3D12PipelineState(pipeline_state_to_create->description);
+    command_processor_.benchmark_counters().CountPipelineCreationsDone();
   }
 }
 
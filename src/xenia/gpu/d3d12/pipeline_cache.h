@@ -10,6 +10,7 @@
 #ifndef XENIA_GPU_D3D12_PIPELINE_CACHE_H_
 #define XENIA_GPU_D3D12_PIPELINE_CACHE_H_
 
+#include <atomic>
 #include <condition_variable>
 #include <cstdio>
 #include <deque>
@@ -21,6 +22,7 @@
 #include <utility>
 #include <vector>
 
+#include "xenia/base/filesystem.h"
 #include "xenia/base/hash.h"
 #include "xenia/base/platform.h"
 #include "xenia/base/threading.h"
@@ -76,6 +78,15 @@ class PipelineCache {
       void** pipeline_state_handle_out,
       ID3D12RootSignature** root_signature_out);
 
+  // Returns the handle of a version of the pipeline with the current bool and
+  // loop constants (and, with the ROV, the output merger state from the system
+  // constants) folded into the shaders if one has already been created, or
+  // the original handle. Specializations are requested in the background for
+  // pipelines drawn with the same state many times in a row.
+  void* GetSpecializedPipelineState(
+      void* pipeline_state_handle,
+      const DxbcShaderTranslator::SystemConstants& system_constants);
+
   // Returns a pipeline state object with deferred creation by its handle. May
   // return nullptr if failed to create the pipeline state object.
   inline ID3D12PipelineState* GetD3D12PipelineStateByHandle(
@@ -285,11 +296,46 @@ class PipelineCache {
   // Xenos pixel shader provided.
   std::vector<uint8_t> depth_only_pixel_shader_;
 
+  struct PipelineState;
+  // Version of a pipeline with the bool and loop constants folded.
+  struct PipelineSpecialization {
+    uint64_t constants_hash;
+    // Set by the creation thread when the specialized pipeline state object
+    // has been created, nullptr while it's being created, or if it has failed.
+    std::atomic<PipelineState*> pipeline_state;
+  };
   struct PipelineState {
     // nullptr if creation has failed.
     ID3D12PipelineState* state;
     PipelineRuntimeDescription description;
+    // Specialization state, accessed only by the command processor thread.
+    uint64_t specialization_constants_hash = 0;
+    uint32_t specialization_stable_draws = 0;
+    std::vector<std::unique_ptr<PipelineSpecialization>> specializations;
+  };
+  // Maximum number of specializations of a single pipeline, to avoid
+  // compiling many variants of pipelines drawn with frequently changing
+  // constants.
+  static constexpr size_t kMaxPipelineSpecializations = 4;
+  struct SpecializationRequest {
+    PipelineSpecialization* specialization;
+    PipelineRuntimeDescription description;
+    reg::SQ_PROGRAM_CNTL sq_program_cntl;
+    // Only the constants used by the shaders, the rest are zero.
+    uint32_t bool_constants[256 / 32];
+    uint32_t loop_constants[32];
+    // For pixel shaders with the ROV.
+    bool rov_output_merger_specialized;
+    DxbcShaderTranslator::RovOutputMergerSpecialization rov_output_merger;
   };
+  // Gets or translates the version of the shader with the bool and loop
+  // constants and the output merger state from the request folded. Can be
+  // called from multiple threads.
+  D3D12Shader* GetSpecializedShader(DxbcShaderTranslator& translator,
+                                    const D3D12Shader& shader,
+                                    const SpecializationRequest& request);
+  void CreateSpecializedPipelineState(DxbcShaderTranslator& translator,
+                                      const SpecializationRequest& request);
   // All previously generated pipeline state objects identified by hash and the
   // description.
   std::unordered_multimap<uint64_t, PipelineState*,
@@ -306,6 +352,8 @@ class PipelineCache {
   uint32_t shader_storage_title_id_ = 0;
 
   // Shader storage output stream, for preload in the next emulator runs.
+  // Held while writing to the storage, not taken if another process is.
+  std::unique_ptr<xe::filesystem::FileLock> shader_storage_lock_;
   FILE* shader_storage_file_ = nullptr;
   bool shader_storage_file_flush_needed_ = false;
 
@@ -353,6 +401,21 @@ class PipelineCache {
   // creation_request_cond_ when set.
   size_t creation_threads_shutdown_from_ = SIZE_MAX;
   std::vector<std::unique_ptr<xe::threading::Thread>> creation_threads_;
+  // Specializations are created by the creation threads when they have no
+  // pipeline state objects to create, and aren't awaited at the end of
+  // submissions. Protected with creation_request_lock_, notify_one
+  // creation_request_cond_ when pushed.
+  std::deque<SpecializationRequest> specialization_queue_;
+  // Number of threads currently creating specializations, protected with
+  // creation_request_lock_, specialization_idle_cond_ is notified when it's
+  // decremented.
+  size_t specialization_threads_busy_ = 0;
+  std::condition_variable specialization_idle_cond_;
+  // Specialized shaders and pipeline states, owned by the cache.
+  std::mutex specializations_mutex_;
+  std::unordered_map<uint64_t, D3D12Shader*, xe::hash::IdentityHasher<uint64_t>>
+      specialized_shaders_;
+  std::vector<PipelineState*> specialized_pipeline_states_;
 };
 
 }  // namespace d3d12
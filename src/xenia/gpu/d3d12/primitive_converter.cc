@@ -28,6 +28,12 @@ DEFINE_bool(d3d12_convert_quads_to_triangles, false,
             "shader is used), and this way quads can't be discarded correctly "
             "when the game uses vertex kill functionality.",
             "D3D12");
+DEFINE_bool(d3d12_convert_primitives_on_gpu, true,
+            "Draw indexed triangle fans, line loops and quad lists converted "
+            "to triangle lists without primitive reset using the conversion "
+            "pattern index buffer, loading the guest indices in the vertex "
+            "shader, instead of rewriting the index buffer on the CPU.",
+            "D3D12");
 
 namespace xe {
 namespace gpu {
@@ -36,13 +42,13 @@ namespace d3d12 {
 PrimitiveConverter::PrimitiveConverter(D3D12CommandProcessor& command_processor,
                                        const RegisterFile& register_file,
                                        Memory& memory,
+                                       SharedMemory& shared_memory,
                                        TraceWriter& trace_writer)
     : command_processor_(command_processor),
       register_file_(register_file),
       memory_(memory),
-      trace_writer_(trace_writer) {
-  system_page_size_ = uint32_t(memory::page_size());
-}
+      shared_memory_(shared_memory),
+      trace_writer_(trace_writer) {}
 
 PrimitiveConverter::~PrimitiveConverter() { Shutdown(); }
 
@@ -121,26 +127,22 @@ bool PrimitiveConverter::Initialize() {
   }
   static_ib_gpu_address_ = static_ib_->GetGPUVirtualAddress();
 
-  memory_regions_invalidated_.store(0ull, std::memory_order_relaxed);
-  memory_invalidation_callback_handle_ =
-      memory_.RegisterPhysicalMemoryInvalidationCallback(
-          MemoryInvalidationCallbackThunk, this);
-
   return true;
 }
 
 void PrimitiveConverter::Shutdown() {
-  if (memory_invalidation_callback_handle_ != nullptr) {
-    memory_.UnregisterPhysicalMemoryInvalidationCallback(
-        memory_invalidation_callback_handle_);
-    memory_invalidation_callback_handle_ = nullptr;
-  }
+  RemoveAllConvertedIndices();
+  ReleasePersistentPages();
   ui::d3d12::util::ReleaseAndNull(static_ib_);
   ui::d3d12::util::ReleaseAndNull(static_ib_upload_);
   buffer_pool_.reset();
 }
 
-void PrimitiveConverter::ClearCache() { buffer_pool_->ClearCache(); }
+void PrimitiveConverter::ClearCache() {
+  RemoveAllConvertedIndices();
+  ReleasePersistentPages();
+  buffer_pool_->ClearCache();
+}
 
 void PrimitiveConverter::CompletedSubmissionUpdated() {
   if (static_ib_upload_ && command_processor_.GetCompletedSubmission() >=
@@ -166,8 +168,8 @@ void PrimitiveConverter::BeginSubmission() {
 
 void PrimitiveConverter::BeginFrame() {
   buffer_pool_->Reclaim(command_processor_.GetCompletedFrame());
-  converted_indices_cache_.clear();
-  memory_regions_used_ = 0;
+  // Indices in the buffer pool may be overwritten in the new frame.
+  RemoveOutdatedConvertedIndices(true);
 }
 
 xenos::PrimitiveType PrimitiveConverter::GetReplacementPrimitiveType(
@@ -241,52 +243,71 @@ PrimitiveConverter::ConversionResult PrimitiveConverter::ConvertPrimitives(
     return ConversionResult::kPrimitiveEmpty;
   }
 
-  // Invalidate the cache if data behind any entry was modified.
-  if (memory_regions_invalidated_.exchange(0ull, std::memory_order_acquire) &
-      memory_regions_used_) {
-    converted_indices_cache_.clear();
-    memory_regions_used_ = 0;
+  // Drop the entries for the guest memory modified since the last draw.
+  if (converted_indices_invalidated_.load(std::memory_order_acquire)) {
+    RemoveOutdatedConvertedIndices(false);
   }
 
   address &= index_32bit ? 0x1FFFFFFC : 0x1FFFFFFE;
   uint32_t index_size = index_32bit ? sizeof(uint32_t) : sizeof(uint16_t);
   uint32_t index_buffer_size = index_size * index_count;
-  uint32_t address_last = address + index_size * (index_count - 1);
 
-  // Create the cache entry, currently only for the key.
-  ConvertedIndices converted_indices;
-  converted_indices.key.address = address;
-  converted_indices.key.source_type = source_type;
-  converted_indices.key.format = index_format;
-  converted_indices.key.count = index_count;
-  converted_indices.key.reset = reset ? 1 : 0;
-  converted_indices.reset_index = reset_index;
+  ConvertedIndicesKey key;
+  key.address = address;
+  key.source_type = source_type;
+  key.format = index_format;
+  key.count = index_count;
+  key.reset = reset ? 1 : 0;
 
   // Try to find the previously converted index buffer.
-  auto found_range =
-      converted_indices_cache_.equal_range(converted_indices.key.value);
-  for (auto iter = found_range.first; iter != found_range.second; ++iter) {
-    const ConvertedIndices& found_converted = iter->second;
-    if (reset && found_converted.reset_index != reset_index) {
-      continue;
-    }
-    if (found_converted.converted_index_count == 0) {
-      return ConversionResult::kPrimitiveEmpty;
-    }
-    if (!found_converted.gpu_address) {
-      return ConversionResult::kConversionNotNeeded;
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    auto found_range = converted_indices_cache_.equal_range(key.value);
+    for (auto iter = found_range.first; iter != found_range.second; ++iter) {
+      const ConvertedIndices& found_converted = iter->second;
+      if (!found_converted.in_sync ||
+          (reset && found_converted.reset_index != reset_index)) {
+        continue;
+      }
+      if (found_converted.converted_index_count == 0) {
+        return ConversionResult::kPrimitiveEmpty;
+      }
+      if (!found_converted.gpu_address) {
+        return ConversionResult::kConversionNotNeeded;
+      }
+      if (found_converted.persistent_page != UINT32_MAX) {
+        persistent_pages_[found_converted.persistent_page]
+            .last_usage_submission = command_processor_.GetCurrentSubmission();
+      }
+      gpu_address_out = found_converted.gpu_address;
+      index_count_out = found_converted.converted_index_count;
+      return ConversionResult::kConverted;
     }
-    gpu_address_out = found_converted.gpu_address;
-    index_count_out = found_converted.converted_index_count;
-    return ConversionResult::kConverted;
   }
 
-  // Get the memory usage mask for cache invalidation.
-  // 1 bit = (512 / 64) MB = 8 MB.
-  uint64_t memory_regions_used_bits = ~((1ull << (address >> 23)) - 1);
-  if (address_last < (63 << 23)) {
-    memory_regions_used_bits = (1ull << ((address_last >> 23) + 1)) - 1;
+  // Create the cache entry and start watching the guest indices before reading
+  // them, so if they're modified during the conversion, the entry won't be
+  // reused.
+  auto converted_indices_iter = converted_indices_cache_.end();
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    ConvertedIndices new_converted_indices;
+    new_converted_indices.key = key;
+    new_converted_indices.reset_index = reset_index;
+    new_converted_indices.gpu_address = 0;
+    new_converted_indices.converted_index_count = 0;
+    new_converted_indices.persistent_page = UINT32_MAX;
+    new_converted_indices.transient = false;
+    new_converted_indices.in_sync = true;
+    converted_indices_iter =
+        converted_indices_cache_.emplace(key.value, new_converted_indices);
+    converted_indices_iter->second.watch_handle =
+        shared_memory_.WatchMemoryRange(address, index_buffer_size,
+                                        WatchCallbackThunk, this,
+                                        &converted_indices_iter->second, 0);
   }
+  shared_memory_.WatchRangeForInvalidation(address, index_buffer_size);
+  ConvertedIndices& converted_indices = converted_indices_iter->second;
 
   union {
     const void* source;
@@ -453,10 +474,6 @@ PrimitiveConverter::ConversionResult PrimitiveConverter::ConvertPrimitives(
   // If nothing to convert, store this result so the check won't be happening
   // again and again and exit.
   if (!conversion_needed || converted_index_count == 0) {
-    converted_indices.gpu_address = 0;
-    converted_indices_cache_.insert(
-        std::make_pair(converted_indices.key.value, converted_indices));
-    memory_regions_used_ |= memory_regions_used_bits;
     return converted_index_count == 0 ? ConversionResult::kPrimitiveEmpty
                                       : ConversionResult::kConversionNotNeeded;
   }
@@ -464,11 +481,20 @@ PrimitiveConverter::ConversionResult PrimitiveConverter::ConvertPrimitives(
   // Convert.
 
   D3D12_GPU_VIRTUAL_ADDRESS gpu_address;
-  void* target = AllocateIndices(index_format, converted_index_count,
-                                 simd ? address & 15 : 0, gpu_address);
+  uint32_t persistent_page;
+  void* target =
+      AllocateIndices(index_format, converted_index_count,
+                      simd ? address & 15 : 0, gpu_address, persistent_page);
   if (target == nullptr) {
+    auto global_lock = global_critical_region_.Acquire();
+    if (converted_indices.watch_handle) {
+      shared_memory_.UnwatchMemoryRange(converted_indices.watch_handle);
+    }
+    converted_indices_cache_.erase(converted_indices_iter);
     return ConversionResult::kFailed;
   }
+  converted_indices.persistent_page = persistent_page;
+  converted_indices.transient = persistent_page == UINT32_MAX;
 
   if (source_type == xenos::PrimitiveType::kTriangleFan) {
     // https://docs.microsoft.com/en-us/windows/desktop/direct3d9/triangle-fans
@@ -670,9 +696,6 @@ PrimitiveConverter::ConversionResult PrimitiveConverter::ConvertPrimitives(
 
   // Cache and return the indices.
   converted_indices.gpu_address = gpu_address;
-  converted_indices_cache_.insert(
-      std::make_pair(converted_indices.key.value, converted_indices));
-  memory_regions_used_ |= memory_regions_used_bits;
   gpu_address_out = gpu_address;
   index_count_out = converted_index_count;
   return ConversionResult::kConverted;
@@ -680,7 +703,9 @@ PrimitiveConverter::ConversionResult PrimitiveConverter::ConvertPrimitives(
 
 void* PrimitiveConverter::AllocateIndices(
     xenos::IndexFormat format, uint32_t count, uint32_t simd_offset,
-    D3D12_GPU_VIRTUAL_ADDRESS& gpu_address_out) {
+    D3D12_GPU_VIRTUAL_ADDRESS& gpu_address_out,
+    uint32_t& persistent_page_out) {
+  persistent_page_out = UINT32_MAX;
   if (count == 0) {
     return nullptr;
   }
@@ -699,8 +724,13 @@ void* PrimitiveConverter::AllocateIndices(
   }
   D3D12_GPU_VIRTUAL_ADDRESS gpu_address;
   uint8_t* mapping =
-      buffer_pool_->Request(command_processor_.GetCurrentFrame(), size, 16,
-                            nullptr, nullptr, &gpu_address);
+      AllocatePersistentIndices(size, gpu_address, persistent_page_out);
+  if (mapping == nullptr) {
+    // Out of persistent pages - the indices will have to be converted again in
+    // the next frame.
+    mapping = buffer_pool_->Request(command_processor_.GetCurrentFrame(), size,
+                                    16, nullptr, nullptr, &gpu_address);
+  }
   if (mapping == nullptr) {
     XELOGE("Failed to allocate space for {} converted {}-bit vertex indices",
            count, format == xenos::IndexFormat::kInt32 ? 32 : 16);
@@ -710,25 +740,149 @@ void* PrimitiveConverter::AllocateIndices(
   return mapping + simd_offset;
 }
 
-std::pair<uint32_t, uint32_t> PrimitiveConverter::MemoryInvalidationCallback(
-    uint32_t physical_address_start, uint32_t length, bool exact_range) {
-  // 1 bit = (512 / 64) MB = 8 MB. Invalidate a region of this size.
-  uint32_t bit_index_first = physical_address_start >> 23;
-  uint32_t bit_index_last = (physical_address_start + length - 1) >> 23;
-  uint64_t bits = ~((1ull << bit_index_first) - 1);
-  if (bit_index_last < 63) {
-    bits &= (1ull << (bit_index_last + 1)) - 1;
-  }
-  memory_regions_invalidated_ |= bits;
-  return std::make_pair<uint32_t, uint32_t>(0, UINT32_MAX);
+uint8_t* PrimitiveConverter::AllocatePersistentIndices(
+    uint32_t size, D3D12_GPU_VIRTUAL_ADDRESS& gpu_address_out,
+    uint32_t& persistent_page_out) {
+  if (size > kPersistentPageSize) {
+    return nullptr;
+  }
+  if (persistent_page_current_ == UINT32_MAX ||
+      kPersistentPageSize - persistent_page_current_used_ < size) {
+    // Reuse a page with no entries left that the GPU is done with, or create a
+    // new one.
+    uint64_t completed_submission = command_processor_.GetCompletedSubmission();
+    uint32_t page_index = UINT32_MAX;
+    for (uint32_t i = 0; i < uint32_t(persistent_pages_.size()); ++i) {
+      const PersistentPage& page = persistent_pages_[i];
+      if (i != persistent_page_current_ && !page.entry_count &&
+          page.last_usage_submission <= completed_submission) {
+        page_index = i;
+        break;
+      }
+    }
+    if (page_index == UINT32_MAX) {
+      if (persistent_pages_.size() >= kMaxPersistentPages) {
+        return nullptr;
+      }
+      auto& provider = command_processor_.GetD3D12Context().GetD3D12Provider();
+      D3D12_RESOURCE_DESC buffer_desc;
+      ui::d3d12::util::FillBufferResourceDesc(
+          buffer_desc, kPersistentPageSize, D3D12_RESOURCE_FLAG_NONE);
+      PersistentPage page;
+      if (FAILED(provider.GetDevice()->CreateCommittedResource(
+              &ui::d3d12::util::kHeapPropertiesUpload,
+              provider.GetHeapFlagCreateNotZeroed(), &buffer_desc,
+              D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
+              IID_PPV_ARGS(&page.buffer)))) {
+        XELOGE("Failed to create a persistent converted index buffer page");
+        return nullptr;
+      }
+      D3D12_RANGE read_range;
+      read_range.Begin = 0;
+      read_range.End = 0;
+      void* mapping;
+      if (FAILED(page.buffer->Map(0, &read_range, &mapping))) {
+        XELOGE("Failed to map a persistent converted index buffer page");
+        page.buffer->Release();
+        return nullptr;
+      }
+      page.mapping = reinterpret_cast<uint8_t*>(mapping);
+      page.gpu_address = page.buffer->GetGPUVirtualAddress();
+      page.entry_count = 0;
+      page.last_usage_submission = 0;
+      page_index = uint32_t(persistent_pages_.size());
+      persistent_pages_.push_back(page);
+    }
+    persistent_page_current_ = page_index;
+    persistent_page_current_used_ = 0;
+  }
+  PersistentPage& page = persistent_pages_[persistent_page_current_];
+  uint8_t* mapping = page.mapping + persistent_page_current_used_;
+  gpu_address_out = page.gpu_address + persistent_page_current_used_;
+  // The size is already 16-aligned.
+  persistent_page_current_used_ += size;
+  ++page.entry_count;
+  page.last_usage_submission = command_processor_.GetCurrentSubmission();
+  persistent_page_out = persistent_page_current_;
+  return mapping;
+}
+
+void PrimitiveConverter::WatchCallbackThunk(void* context, void* data,
+                                            uint64_t argument,
+                                            bool invalidated_by_gpu) {
+  reinterpret_cast<PrimitiveConverter*>(context)->WatchCallback(data);
+}
+
+void PrimitiveConverter::WatchCallback(void* data) {
+  // Mutex already locked here.
+  ConvertedIndices& converted_indices =
+      *reinterpret_cast<ConvertedIndices*>(data);
+  converted_indices.in_sync = false;
+  converted_indices.watch_handle = nullptr;
+  converted_indices_invalidated_.store(true, std::memory_order_release);
+}
+
+void PrimitiveConverter::RemoveOutdatedConvertedIndices(bool frame_ended) {
+  auto global_lock = global_critical_region_.Acquire();
+  converted_indices_invalidated_.store(false, std::memory_order_relaxed);
+  for (auto iter = converted_indices_cache_.begin();
+       iter != converted_indices_cache_.end();) {
+    ConvertedIndices& converted_indices = iter->second;
+    if (converted_indices.in_sync &&
+        (!frame_ended || !converted_indices.transient)) {
+      ++iter;
+      continue;
+    }
+    if (converted_indices.watch_handle) {
+      shared_memory_.UnwatchMemoryRange(converted_indices.watch_handle);
+    }
+    if (converted_indices.persistent_page != UINT32_MAX) {
+      --persistent_pages_[converted_indices.persistent_page].entry_count;
+    }
+    iter = converted_indices_cache_.erase(iter);
+  }
 }
 
-std::pair<uint32_t, uint32_t>
-PrimitiveConverter::MemoryInvalidationCallbackThunk(
-    void* context_ptr, uint32_t physical_address_start, uint32_t length,
-    bool exact_range) {
-  return reinterpret_cast<PrimitiveConverter*>(context_ptr)
-      ->MemoryInvalidationCallback(physical_address_start, length, exact_range);
+void PrimitiveConverter::RemoveAllConvertedIndices() {
+  auto global_lock = global_critical_region_.Acquire();
+  for (const auto& converted_indices_pair : converted_indices_cache_) {
+    const ConvertedIndices& converted_indices = converted_indices_pair.second;
+    if (converted_indices.watch_handle) {
+      shared_memory_.UnwatchMemoryRange(converted_indices.watch_handle);
+    }
+  }
+  converted_indices_cache_.clear();
+  converted_indices_invalidated_.store(false, std::memory_order_relaxed);
+  for (PersistentPage& page : persistent_pages_) {
+    page.entry_count = 0;
+  }
+}
+
+void PrimitiveConverter::ReleasePersistentPages() {
+  assert_true(converted_indices_cache_.empty());
+  for (PersistentPage& page : persistent_pages_) {
+    page.buffer->Release();
+  }
+  persistent_pages_.clear();
+  persistent_page_current_ = UINT32_MAX;
+  persistent_page_current_used_ = 0;
+}
+
+bool PrimitiveConverter::IsIndexLoadInVertexShaderPossible(
+    xenos::PrimitiveType source_type) const {
+  if (!cvars::d3d12_convert_primitives_on_gpu ||
+      register_file_.Get<reg::PA_SU_SC_MODE_CNTL>().multi_prim_ib_ena) {
+    return false;
+  }
+  switch (source_type) {
+    case xenos::PrimitiveType::kTriangleFan:
+    case xenos::PrimitiveType::kLineLoop:
+      return true;
+    case xenos::PrimitiveType::kQuadList:
+      return cvars::d3d12_convert_quads_to_triangles;
+    default:
+      return false;
+  }
 }
 
 D3D12_GPU_VIRTUAL_ADDRESS PrimitiveConverter::GetStaticIndexBuffer(
@@ -753,8 +907,7 @@ D3D12_GPU_VIRTUAL_ADDRESS PrimitiveConverter::GetStaticIndexBuffer(
 
 void PrimitiveConverter::InitializeTrace() {
   // WriteMemoryRead must not be skipped.
-  converted_indices_cache_.clear();
-  memory_regions_used_ = 0;
+  RemoveAllConvertedIndices();
 }
 
 }  // namespace d3d12
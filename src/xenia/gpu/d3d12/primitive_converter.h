@@ -13,7 +13,10 @@
 #include <atomic>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
+#include "xenia/base/mutex.h"
+#include "xenia/gpu/d3d12/shared_memory.h"
 #include "xenia/gpu/register_file.h"
 #include "xenia/gpu/trace_writer.h"
 #include "xenia/gpu/xenos.h"
@@ -35,11 +38,13 @@ class D3D12CommandProcessor;
 //   vertex count value).
 // - Quad lists (for debugging since geometry shaders break PIX - as an
 //   alternative to the geometry shader).
+// Converted index buffers are kept across frames until the guest memory they
+// were converted from is modified, so static geometry is converted only once.
 class PrimitiveConverter {
  public:
   PrimitiveConverter(D3D12CommandProcessor& command_processor,
                      const RegisterFile& register_file, Memory& memory,
-                     TraceWriter& trace_writer);
+                     SharedMemory& shared_memory, TraceWriter& trace_writer);
   ~PrimitiveConverter();
 
   bool Initialize();
@@ -55,7 +60,7 @@ class PrimitiveConverter {
       xenos::PrimitiveType type);
 
   enum class ConversionResult {
-    // Converted to a transient buffer.
+    // Converted to a buffer in an upload heap.
     kConverted,
     // Conversion not required - use the index buffer in shared memory.
     kConversionNotNeeded,
@@ -77,6 +82,16 @@ class PrimitiveConverter {
                                      D3D12_GPU_VIRTUAL_ADDRESS& gpu_address_out,
                                      uint32_t& index_count_out);
 
+  // Whether an indexed draw of the primitive type can be done without
+  // ConvertPrimitives, by drawing the conversion pattern from
+  // GetStaticIndexBuffer (or, for line loops, by drawing without an index
+  // buffer, with the closing vertex) with the vertex shader loading the guest
+  // indices from the shared memory (kSysFlag_VertexIndexLoad), so the indices
+  // are neither read nor uploaded by the CPU. Not possible if the primitive
+  // reset index is used since primitives are split there.
+  bool IsIndexLoadInVertexShaderPossible(
+      xenos::PrimitiveType source_type) const;
+
   // Returns the 16-bit index buffer for drawing unsupported non-indexed
   // primitives in INDEX_BUFFER state, for non-indexed drawing. Returns 0 if
   // conversion is not available (can draw natively).
@@ -84,29 +99,45 @@ class PrimitiveConverter {
       xenos::PrimitiveType source_type, uint32_t index_count,
       uint32_t& index_count_out) const;
 
-  // Callback for invalidating buffers mid-frame.
-  std::pair<uint32_t, uint32_t> MemoryInvalidationCallback(
-      uint32_t physical_address_start, uint32_t length, bool exact_range);
-
   void InitializeTrace();
 
  private:
   // simd_offset is source address & 15 - if SIMD is used, the source and the
   // target must have the same alignment within one register. 0 is optimal when
   // not using SIMD.
+  // Tries to allocate space in a persistent page first, falling back to the
+  // per-frame buffer pool (in this case, persistent_page_out is set to
+  // UINT32_MAX).
   void* AllocateIndices(xenos::IndexFormat format, uint32_t count,
                         uint32_t simd_offset,
-                        D3D12_GPU_VIRTUAL_ADDRESS& gpu_address_out);
-
-  static std::pair<uint32_t, uint32_t> MemoryInvalidationCallbackThunk(
-      void* context_ptr, uint32_t physical_address_start, uint32_t length,
-      bool exact_range);
+                        D3D12_GPU_VIRTUAL_ADDRESS& gpu_address_out,
+                        uint32_t& persistent_page_out);
+  uint8_t* AllocatePersistentIndices(uint32_t size,
+                                     D3D12_GPU_VIRTUAL_ADDRESS& gpu_address_out,
+                                     uint32_t& persistent_page_out);
+
+  static void WatchCallbackThunk(void* context, void* data, uint64_t argument,
+                                 bool invalidated_by_gpu);
+  void WatchCallback(void* data);
+
+  // Removes cache entries that are not valid anymore - the ones whose guest
+  // memory has been modified, and, if frame_ended, the ones stored in the
+  // per-frame buffer pool.
+  void RemoveOutdatedConvertedIndices(bool frame_ended);
+  // Removes all entries - the persistent pages can be reused once the GPU has
+  // stopped using them.
+  void RemoveAllConvertedIndices();
+  // The cache must be empty, and the GPU must not be using the pages anymore.
+  void ReleasePersistentPages();
 
   D3D12CommandProcessor& command_processor_;
   const RegisterFile& register_file_;
   Memory& memory_;
+  SharedMemory& shared_memory_;
   TraceWriter& trace_writer_;
 
+  xe::global_critical_region global_critical_region_;
+
   std::unique_ptr<ui::d3d12::D3D12UploadBufferPool> buffer_pool_;
 
   // Static index buffers for emulating unsupported primitive types when drawing
@@ -168,18 +199,41 @@ class PrimitiveConverter {
     // When conversion is not needed, this must be equal to the original index
     // count.
     uint32_t converted_index_count;
+
+    // Index in persistent_pages_ of the page containing the indices, or
+    // UINT32_MAX if there's no index data or if it's in buffer_pool_ (only
+    // usable in the current frame - transient is true in this case).
+    uint32_t persistent_page;
+    bool transient;
+
+    // Cleared by the watch callback when the guest indices are modified, must
+    // be accessed within the global critical region. The watch handle is
+    // invalidated along with it.
+    bool in_sync;
+    SharedMemory::WatchHandle watch_handle;
   };
 
-  // Cache for a single frame.
   std::unordered_multimap<uint64_t, ConvertedIndices> converted_indices_cache_;
-
-  // Very coarse cache invalidation - if something is modified in a 8 MB portion
-  // of the physical memory and converted indices are also there, invalidate all
-  // the cache.
-  uint64_t memory_regions_used_;
-  std::atomic<uint64_t> memory_regions_invalidated_ = 0;
-  void* memory_invalidation_callback_handle_ = nullptr;
-  uint32_t system_page_size_;
+  // Set by the watch callback, checked before looking up the entries to remove
+  // the ones not in sync anymore.
+  std::atomic<bool> converted_indices_invalidated_ = false;
+
+  // Upload heap buffers containing converted indices that may be reused in the
+  // following frames. Indices are allocated linearly in the current page, and
+  // a page is rewritten from the beginning once all its entries have been
+  // removed and the GPU has stopped using it.
+  static constexpr uint32_t kPersistentPageSize = 4 * 1024 * 1024;
+  static constexpr uint32_t kMaxPersistentPages = 16;
+  struct PersistentPage {
+    ID3D12Resource* buffer;
+    uint8_t* mapping;
+    D3D12_GPU_VIRTUAL_ADDRESS gpu_address;
+    uint32_t entry_count;
+    uint64_t last_usage_submission;
+  };
+  std::vector<PersistentPage> persistent_pages_;
+  uint32_t persistent_page_current_ = UINT32_MAX;
+  uint32_t persistent_page_current_used_ = 0;
 };
 
 }  // namespace d3d12
@@ -976,6 +976,13 @@ bool RenderTargetCache::UpdateRenderTargets(const D3D12Shader* pixel_shader) {
         if (render_target == nullptr) {
           continue;
         }
+        // Rebinding the same render target at the same base (very common
+        // after resolves without clearing, for instance) doesn't need the
+        // EDRAM round trip if nothing else has modified those tiles since it
+        // was stored.
+        if (IsRenderTargetEdramMirrorValid(*render_target, edram_bases[i])) {
+          continue;
+        }
         load_render_targets[load_render_target_count] = render_target;
         load_edram_bases[load_render_target_count] = edram_bases[i];
         ++load_render_target_count;
@@ -1137,8 +1144,11 @@ bool RenderTargetCache::Resolve(const Memory& memory,
         copy_dest_resident = texture_cache.EnsureScaledResolveBufferResident(
             resolve_info.copy_dest_base, resolve_info.copy_dest_length);
       } else {
-        copy_dest_resident = shared_memory.RequestRange(
-            resolve_info.copy_dest_base, resolve_info.copy_dest_length);
+        // Full-width resolves don't need the old contents of the destination
+        // to be uploaded.
+        copy_dest_resident = shared_memory.RequestRangeForOverwrite(
+            resolve_info.copy_dest_base, resolve_info.copy_dest_length,
+            resolve_info.copy_dest_overwritten_length);
       }
       if (copy_dest_resident) {
         // Write the descriptors and transition the resources.
@@ -1312,6 +1322,28 @@ bool RenderTargetCache::Resolve(const Memory& memory,
       assert_true(edram_buffer_state_ == D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
       edram_buffer_modified_ = true;
       cleared = true;
+      if (!edram_rov_used_) {
+        // The render targets in the cleared area must be reloaded.
+        auto mark_cleared_tiles =
+            [this, &resolve_info](
+                const draw_util::ResolveEdramPackedInfo& edram_info) {
+              uint32_t height_samples = (resolve_info.address.local_y_div_8 +
+                                         resolve_info.address.height_div_8)
+                                        << 3;
+              if (edram_info.msaa_samples >= xenos::MsaaSamples::k2X) {
+                height_samples <<= 1;
+              }
+              MarkEdramTilesWritten(
+                  edram_info.base_tiles,
+                  ((height_samples + 15) >> 4) * edram_info.pitch_tiles);
+            };
+        if (clear_depth) {
+          mark_cleared_tiles(resolve_info.depth_edram_info);
+        }
+        if (clear_color) {
+          mark_cleared_tiles(resolve_info.color_edram_info);
+        }
+      }
     }
   } else {
     cleared = true;
@@ -1520,6 +1552,7 @@ void RenderTargetCache::RestoreEdramSnapshot(const void* snapshot) {
                                    UINT64(upload_buffer_offset),
                                    xenos::kEdramSizeBytes);
   if (!edram_rov_used_) {
+    MarkEdramTilesWritten(0, xenos::kEdramTileCount);
     // Clear and ignore the old 32-bit float depth - the non-ROV path is
     // inaccurate anyway, and this is backend-specific, not a part of a guest
     // trace.
@@ -1684,6 +1717,52 @@ bool RenderTargetCache::GetResourceDesc(RenderTargetKey key,
   return true;
 }
 
+uint32_t RenderTargetCache::GetRenderTargetEdramTileCount(
+    const RenderTarget& render_target, uint32_t edram_base) {
+  if (edram_base >= xenos::kEdramTileCount) {
+    return 0;
+  }
+  // Same as in LoadRenderTargetsFromEdram.
+  uint32_t edram_pitch_tiles = render_target.key.width_ss_div_80;
+  if (!render_target.key.is_depth &&
+      xenos::IsColorRenderTargetFormat64bpp(
+          xenos::ColorRenderTargetFormat(render_target.key.format))) {
+    edram_pitch_tiles *= 2;
+  }
+  if (edram_pitch_tiles == 0) {
+    return 0;
+  }
+  uint32_t edram_rows =
+      std::min(render_target.key.height_ss_div_16,
+               (xenos::kEdramTileCount - edram_base) / edram_pitch_tiles);
+  return edram_rows * edram_pitch_tiles;
+}
+
+bool RenderTargetCache::IsRenderTargetEdramMirrorValid(
+    const RenderTarget& render_target, uint32_t edram_base) const {
+  if (render_target.edram_mirror_base != edram_base) {
+    return false;
+  }
+  uint32_t edram_tile_count =
+      GetRenderTargetEdramTileCount(render_target, edram_base);
+  for (uint32_t i = 0; i < edram_tile_count; ++i) {
+    if (edram_tile_write_indices_[edram_base + i] >
+        render_target.edram_mirror_write_index) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void RenderTargetCache::MarkEdramTilesWritten(uint32_t base, uint32_t count) {
+  ++edram_write_index_;
+  count = std::min(count, xenos::kEdramTileCount);
+  for (uint32_t i = 0; i < count; ++i) {
+    edram_tile_write_indices_[(base + i) & (xenos::kEdramTileCount - 1)] =
+        edram_write_index_;
+  }
+}
+
 RenderTargetCache::RenderTarget* RenderTargetCache::FindOrCreateRenderTarget(
 #if 0
     RenderTargetKey key, uint32_t heap_page_first
@@ -1816,6 +1895,8 @@ RenderTargetCache::RenderTarget* RenderTargetCache::FindOrCreateRenderTarget(
                                 render_target->footprints, nullptr, nullptr,
                                 &copy_buffer_size);
   render_target->copy_buffer_size = uint32_t(copy_buffer_size);
+  render_target->edram_mirror_base = UINT32_MAX;
+  render_target->edram_mirror_write_index = 0;
   render_targets_.insert(std::make_pair(key.value, render_target));
   COUNT_profile_set("gpu/render_target_cache/render_targets",
                     render_targets_.size());
@@ -1959,7 +2040,7 @@ void RenderTargetCache::StoreRenderTargetsToEdram() {
   // Store each render target.
   for (uint32_t i = 0; i < store_binding_count; ++i) {
     const RenderTargetBinding& binding = current_bindings_[store_bindings[i]];
-    const RenderTarget* render_target = binding.render_target;
+    RenderTarget* render_target = binding.render_target;
     bool is_64bpp = false;
 
     // Transition the copy buffer to copy destination.
@@ -2018,10 +2099,27 @@ void RenderTargetCache::StoreRenderTargetsToEdram() {
     command_processor_.SetComputePipelineState(
         edram_store_pipelines_[size_t(mode)]);
     // 1 group per 80x16 samples.
+    command_processor_.BeginGpuTiming(GpuTimingCategory::kEdramStore);
     command_list.D3DDispatch(surface_pitch_tiles, binding.edram_dirty_rows, 1);
+    command_processor_.EndGpuTiming();
 
     // Commit the UAV write.
     CommitEdramBufferUAVWrites(true);
+
+    // The stored tiles now contain the data of this render target, but not of
+    // others overlapping them. The rows that haven't been stored are still the
+    // same in the render target and in EDRAM only if they were before.
+    if (binding.edram_dirty_rows != 0) {
+      bool mirror_valid =
+          IsRenderTargetEdramMirrorValid(*render_target, binding.edram_base);
+      MarkEdramTilesWritten(binding.edram_base,
+                            binding.edram_dirty_rows * rt_pitch_tiles);
+      if (mirror_valid) {
+        render_target->edram_mirror_write_index = edram_write_index_;
+      } else {
+        render_target->edram_mirror_base = UINT32_MAX;
+      }
+    }
   }
 
   command_processor_.ReleaseScratchGPUBuffer(copy_buffer, copy_buffer_state);
@@ -2097,7 +2195,7 @@ void RenderTargetCache::LoadRenderTargetsFromEdram(
       // Something is wrong with the load.
       continue;
     }
-    const RenderTarget* render_target = render_targets[i];
+    RenderTarget* render_target = render_targets[i];
 
     // Get the number of EDRAM tiles per row.
     uint32_t edram_pitch_tiles = render_target->key.width_ss_div_80;
@@ -2143,7 +2241,11 @@ void RenderTargetCache::LoadRenderTargetsFromEdram(
     command_processor_.SetComputePipelineState(
         edram_load_pipelines_[size_t(mode)]);
     // 1 group per 80x16 samples.
+    command_processor_.BeginGpuTiming(GpuTimingCategory::kEdramLoad);
     command_list.D3DDispatch(render_target->key.width_ss_div_80, edram_rows, 1);
+    command_processor_.EndGpuTiming();
+    render_target->edram_mirror_base = edram_bases[i];
+    render_target->edram_mirror_write_index = edram_write_index_;
 
     // Commit the UAV write and transition the copy buffer to copy source now.
     command_processor_.PushUAVBarrier(copy_buffer);
@@ -384,6 +384,13 @@ class RenderTargetCache {
     D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprints[2];
     // Buffer size needed to copy the render target to the EDRAM buffer.
     uint32_t copy_buffer_size;
+    // EDRAM base the contents of the render target were last loaded from or
+    // stored to, or UINT32_MAX if they are not known to match EDRAM anywhere.
+    // They are still the same as in EDRAM if none of the tiles has been
+    // written since edram_mirror_write_index other than by storing this render
+    // target, so loading can be skipped when rebinding it at the same base.
+    uint32_t edram_mirror_base;
+    uint64_t edram_mirror_write_index;
   };
 
   struct RenderTargetBinding {
@@ -439,6 +446,17 @@ class RenderTargetCache {
 
   void ClearBindings();
 
+  // Number of EDRAM tiles the render target covers when loaded at the base.
+  static uint32_t GetRenderTargetEdramTileCount(
+      const RenderTarget& render_target, uint32_t edram_base);
+  // Whether the contents of the render target are still the same as those of
+  // EDRAM at the base, so it doesn't need to be loaded from the EDRAM buffer.
+  bool IsRenderTargetEdramMirrorValid(const RenderTarget& render_target,
+                                      uint32_t edram_base) const;
+  // Makes render targets mirroring the tiles outdated, wrapping around the end
+  // of EDRAM.
+  void MarkEdramTilesWritten(uint32_t base, uint32_t count);
+
 #if 0
   // Checks if the heap for the render target exists and tries to create it if
   // it's not.
@@ -591,6 +609,12 @@ class RenderTargetCache {
 
   std::unordered_multimap<uint32_t, RenderTarget*> render_targets_;
 
+  // Incremented on every write to EDRAM tiles, with the value at the last
+  // write to each tile, for skipping loads of render targets that still
+  // contain the same data as EDRAM (like after a resolve without clearing).
+  uint64_t edram_write_index_ = 0;
+  uint64_t edram_tile_write_indices_[xenos::kEdramTileCount] = {};
+
   uint32_t current_surface_pitch_ = 0;
   xenos::MsaaSamples current_msaa_samples_ = xenos::MsaaSamples::k1X;
   // current_edram_max_rows_ is for RTV/DSV only (render target texture size).
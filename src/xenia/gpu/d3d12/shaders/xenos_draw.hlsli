@@ -39,6 +39,7 @@ cbuffer xe_system_cbuffer : register(b0) {
   float2 xe_edram_poly_offset_back;
 
   uint xe_edram_depth_base_dwords;
+  uint xe_vertex_index_load_address;
 
   uint4 xe_edram_stencil[2];
 
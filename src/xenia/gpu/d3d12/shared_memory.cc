@@ -21,6 +21,7 @@
 #include "xenia/base/memory.h"
 #include "xenia/base/profiling.h"
 #include "xenia/gpu/d3d12/d3d12_command_processor.h"
+#include "xenia/memory_heatmap.h"
 #include "xenia/ui/d3d12/d3d12_util.h"
 
 DEFINE_bool(d3d12_tiled_shared_memory, true,
@@ -29,6 +30,11 @@ DEFINE_bool(d3d12_tiled_shared_memory, true,
             "created - but allows graphics debuggers that don't support tiled "
             "resources to work.",
             "D3D12");
+DEFINE_bool(d3d12_async_shared_memory_uploads, false,
+            "Upload guest memory not used yet by the current submission on a "
+            "copy queue, so large uploads can overlap with rendering instead "
+            "of being done on the graphics queue before the draws.",
+            "D3D12");
 
 namespace xe {
 namespace gpu {
@@ -86,6 +92,12 @@ bool SharedMemory::Initialize() {
 
   std::memset(heaps_, 0, sizeof(heaps_));
   heap_count_ = 0;
+  tile_heap_slots_used_ = 0;
+  pending_tile_mappings_.clear();
+  if (AreTiledResourcesUsed()) {
+    // Not fatal, will be retried when tiles need to be made resident.
+    CreateTileHeapChunk();
+  }
 
   D3D12_DESCRIPTOR_HEAP_DESC buffer_descriptor_heap_desc;
   buffer_descriptor_heap_desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
@@ -152,11 +164,23 @@ bool SharedMemory::Initialize() {
 
   system_page_flags_.clear();
   system_page_flags_.resize((page_count_ + 63) / 64);
+  valid_block_any_bits_.clear();
+  valid_block_any_bits_.resize((system_page_flags_.size() + 63) / 64);
+  valid_block_all_bits_.clear();
+  valid_block_all_bits_.resize((system_page_flags_.size() + 63) / 64);
 
   upload_buffer_pool_ = std::make_unique<ui::d3d12::D3D12UploadBufferPool>(
       provider, xe::align(ui::d3d12::D3D12UploadBufferPool::kDefaultPageSize,
                           size_t(1) << page_size_log2_));
 
+  if (cvars::d3d12_async_shared_memory_uploads &&
+      !InitializeAsyncUploads()) {
+    XELOGE(
+        "Shared memory: Failed to create the copy queue objects, uploading on "
+        "the direct queue");
+    ShutdownAsyncUploads();
+  }
+
   memory_invalidation_callback_handle_ =
       memory_.RegisterPhysicalMemoryInvalidationCallback(
           MemoryInvalidationCallbackThunk, this);
@@ -166,7 +190,66 @@ bool SharedMemory::Initialize() {
   return true;
 }
 
+bool SharedMemory::InitializeAsyncUploads() {
+  auto device =
+      command_processor_.GetD3D12Context().GetD3D12Provider().GetDevice();
+  D3D12_COMMAND_QUEUE_DESC copy_queue_desc;
+  copy_queue_desc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+  copy_queue_desc.Priority = D3D12_COMMAND_QUEUE_PRIORITY_NORMAL;
+  copy_queue_desc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+  copy_queue_desc.NodeMask = 0;
+  if (FAILED(device->CreateCommandQueue(&copy_queue_desc,
+                                        IID_PPV_ARGS(&copy_queue_)))) {
+    return false;
+  }
+  ID3D12CommandAllocator* copy_command_allocator;
+  if (FAILED(device->CreateCommandAllocator(
+          D3D12_COMMAND_LIST_TYPE_COPY,
+          IID_PPV_ARGS(&copy_command_allocator)))) {
+    return false;
+  }
+  copy_command_allocators_.emplace_back(copy_command_allocator, 0);
+  if (FAILED(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY,
+                                       copy_command_allocator, nullptr,
+                                       IID_PPV_ARGS(&copy_command_list_)))) {
+    return false;
+  }
+  // Created in the open state.
+  copy_command_list_->Close();
+  if (FAILED(device->CreateFence(0, D3D12_FENCE_FLAG_NONE,
+                                 IID_PPV_ARGS(&copy_fence_))) ||
+      FAILED(device->CreateFence(0, D3D12_FENCE_FLAG_NONE,
+                                 IID_PPV_ARGS(&direct_fence_)))) {
+    return false;
+  }
+  submission_used_pages_.resize((page_count_ + 63) / 64);
+  return true;
+}
+
+void SharedMemory::ShutdownAsyncUploads() {
+  if (copy_fence_ && copy_fence_->GetCompletedValue() < copy_fence_current_) {
+    // Blocks until the copies are completed without an event.
+    copy_fence_->SetEventOnCompletion(copy_fence_current_, nullptr);
+  }
+  ui::d3d12::util::ReleaseAndNull(copy_command_list_);
+  copy_command_list_open_ = false;
+  copy_command_list_upload_size_ = 0;
+  for (auto copy_command_allocator : copy_command_allocators_) {
+    copy_command_allocator.first->Release();
+  }
+  copy_command_allocators_.clear();
+  ui::d3d12::util::ReleaseAndNull(copy_fence_);
+  copy_fence_current_ = 0;
+  copy_fence_awaited_by_direct_ = 0;
+  ui::d3d12::util::ReleaseAndNull(direct_fence_);
+  direct_fence_current_ = 0;
+  ui::d3d12::util::ReleaseAndNull(copy_queue_);
+  submission_used_pages_.clear();
+}
+
 void SharedMemory::Shutdown() {
+  ShutdownAsyncUploads();
+
   ResetTraceGPUWrittenBuffer();
 
   FireWatches(0, (kBufferSize - 1) >> page_size_log2_, false);
@@ -200,10 +283,14 @@ void SharedMemory::Shutdown() {
   ui::d3d12::util::ReleaseAndNull(buffer_);
 
   if (AreTiledResourcesUsed()) {
-    for (uint32_t i = 0; i < xe::countof(heaps_); ++i) {
-      ui::d3d12::util::ReleaseAndNull(heaps_[i]);
-    }
+    std::memset(heaps_, 0, sizeof(heaps_));
     heap_count_ = 0;
+    pending_tile_mappings_.clear();
+    for (ID3D12Heap* heap_chunk : tile_heap_chunks_) {
+      heap_chunk->Release();
+    }
+    tile_heap_chunks_.clear();
+    tile_heap_slots_used_ = 0;
     COUNT_profile_set("gpu/shared_memory/used_mb", 0);
   }
 }
@@ -230,8 +317,10 @@ void SharedMemory::ClearCache() {
 
   {
     auto global_lock = global_critical_region_.Acquire();
-    for (SystemPageFlagsBlock& block : system_page_flags_) {
+    for (uint32_t i = 0; i < system_page_flags_.size(); ++i) {
+      SystemPageFlagsBlock& block = system_page_flags_[i];
       block.valid = block.valid_and_gpu_written;
+      UpdateValidBlockSummary(i);
     }
   }
 
@@ -242,6 +331,33 @@ void SharedMemory::CompletedSubmissionUpdated() {
   upload_buffer_pool_->Reclaim(command_processor_.GetCompletedSubmission());
 }
 
+void SharedMemory::EndSubmission() {
+  if (AreTiledResourcesUsed()) {
+    CommitTileMappings();
+    // Keep a whole chunk spare for the next submissions, so large streaming
+    // buffers becoming resident for the first time don't create heaps while
+    // draws are being recorded.
+    if (tile_heap_slots_used_ + kHeapChunkSlots >
+            uint32_t(tile_heap_chunks_.size()) * kHeapChunkSlots &&
+        tile_heap_chunks_.size() < kHeapChunkMaxCount) {
+      CreateTileHeapChunk();
+    }
+  }
+  if (!AreAsyncUploadsUsed()) {
+    return;
+  }
+  SubmitCopyCommandList();
+  if (copy_fence_awaited_by_direct_ < copy_fence_current_) {
+    command_processor_.GetD3D12Context()
+        .GetD3D12Provider()
+        .GetDirectQueue()
+        ->Wait(copy_fence_, copy_fence_current_);
+    copy_fence_awaited_by_direct_ = copy_fence_current_;
+  }
+  std::memset(submission_used_pages_.data(), 0,
+              submission_used_pages_.size() * sizeof(uint64_t));
+}
+
 SharedMemory::GlobalWatchHandle SharedMemory::RegisterGlobalWatch(
     GlobalWatchCallback callback, void* callback_context) {
   GlobalWatch* watch = new GlobalWatch;
@@ -365,43 +481,103 @@ bool SharedMemory::EnsureTilesResident(uint32_t start, uint32_t length) {
     if (heaps_[i] != nullptr) {
       continue;
     }
-    auto& provider = command_processor_.GetD3D12Context().GetD3D12Provider();
-    auto device = provider.GetDevice();
-    auto direct_queue = provider.GetDirectQueue();
-    D3D12_HEAP_DESC heap_desc = {};
-    heap_desc.SizeInBytes = kHeapSize;
-    heap_desc.Properties.Type = D3D12_HEAP_TYPE_DEFAULT;
-    heap_desc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS |
-                      provider.GetHeapFlagCreateNotZeroed();
-    if (FAILED(device->CreateHeap(&heap_desc, IID_PPV_ARGS(&heaps_[i])))) {
-      XELOGE("Shared memory: Failed to create a tile heap");
-      return false;
+    if (tile_heap_slots_used_ >=
+        uint32_t(tile_heap_chunks_.size()) * kHeapChunkSlots) {
+      // Normally a spare chunk is created between submissions.
+      if (!CreateTileHeapChunk()) {
+        return false;
+      }
     }
+    uint32_t slot = tile_heap_slots_used_++;
+    heaps_[i] = tile_heap_chunks_[slot / kHeapChunkSlots];
+    pending_tile_mappings_.emplace_back(i, slot);
     ++heap_count_;
     COUNT_profile_set("gpu/shared_memory/used_mb",
                       heap_count_ << kHeapSizeLog2 >> 20);
-    D3D12_TILED_RESOURCE_COORDINATE region_start_coordinates;
-    region_start_coordinates.X =
-        (i << kHeapSizeLog2) / D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
-    region_start_coordinates.Y = 0;
-    region_start_coordinates.Z = 0;
-    region_start_coordinates.Subresource = 0;
-    D3D12_TILE_REGION_SIZE region_size;
-    region_size.NumTiles = kHeapSize / D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
-    region_size.UseBox = FALSE;
-    D3D12_TILE_RANGE_FLAGS range_flags = D3D12_TILE_RANGE_FLAG_NONE;
-    UINT heap_range_start_offset = 0;
-    UINT range_tile_count = kHeapSize / D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
-    // FIXME(Triang3l): This may cause issues if the emulator is shut down
-    // mid-frame and the heaps are destroyed before tile mappings are updated
-    // (awaiting the fence won't catch this then). Defer this until the actual
-    // command list submission at the end of the frame.
+  }
+  return true;
+}
+
+bool SharedMemory::CreateTileHeapChunk() {
+  auto& provider = command_processor_.GetD3D12Context().GetD3D12Provider();
+  D3D12_HEAP_DESC heap_desc = {};
+  heap_desc.SizeInBytes = UINT64(1) << kHeapChunkSizeLog2;
+  heap_desc.Properties.Type = D3D12_HEAP_TYPE_DEFAULT;
+  heap_desc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS |
+                    provider.GetHeapFlagCreateNotZeroed();
+  ID3D12Heap* heap_chunk;
+  if (FAILED(provider.GetDevice()->CreateHeap(&heap_desc,
+                                              IID_PPV_ARGS(&heap_chunk)))) {
+    XELOGE("Shared memory: Failed to create a tile heap");
+    return false;
+  }
+  tile_heap_chunks_.push_back(heap_chunk);
+  return true;
+}
+
+void SharedMemory::CommitTileMappings() {
+  if (pending_tile_mappings_.empty()) {
+    return;
+  }
+  auto direct_queue =
+      command_processor_.GetD3D12Context().GetD3D12Provider().GetDirectQueue();
+  constexpr uint32_t kHeapTiles =
+      kHeapSize / D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
+  std::vector<D3D12_TILED_RESOURCE_COORDINATE> region_start_coordinates;
+  std::vector<D3D12_TILE_REGION_SIZE> region_sizes;
+  std::vector<D3D12_TILE_RANGE_FLAGS> range_flags;
+  std::vector<UINT> heap_range_start_offsets;
+  std::vector<UINT> range_tile_counts;
+  // Slots are allocated sequentially, so the pending mappings are grouped by
+  // the chunk, and one call is made for each chunk, with heaps consecutive both
+  // in the buffer and in the chunk merged into one region.
+  size_t mapping_index = 0;
+  while (mapping_index < pending_tile_mappings_.size()) {
+    uint32_t chunk_index =
+        pending_tile_mappings_[mapping_index].second / kHeapChunkSlots;
+    region_start_coordinates.clear();
+    region_sizes.clear();
+    range_flags.clear();
+    heap_range_start_offsets.clear();
+    range_tile_counts.clear();
+    uint32_t previous_heap = UINT32_MAX, previous_slot = UINT32_MAX;
+    for (; mapping_index < pending_tile_mappings_.size() &&
+           pending_tile_mappings_[mapping_index].second / kHeapChunkSlots ==
+               chunk_index;
+         ++mapping_index) {
+      uint32_t heap = pending_tile_mappings_[mapping_index].first;
+      uint32_t slot =
+          pending_tile_mappings_[mapping_index].second % kHeapChunkSlots;
+      if (!region_sizes.empty() && heap == previous_heap + 1 &&
+          slot == previous_slot + 1) {
+        region_sizes.back().NumTiles += kHeapTiles;
+        range_tile_counts.back() += kHeapTiles;
+      } else {
+        D3D12_TILED_RESOURCE_COORDINATE& region_start_coordinate =
+            region_start_coordinates.emplace_back();
+        region_start_coordinate.X =
+            (heap << kHeapSizeLog2) / D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
+        region_start_coordinate.Y = 0;
+        region_start_coordinate.Z = 0;
+        region_start_coordinate.Subresource = 0;
+        D3D12_TILE_REGION_SIZE& region_size = region_sizes.emplace_back();
+        region_size.NumTiles = kHeapTiles;
+        region_size.UseBox = FALSE;
+        range_flags.push_back(D3D12_TILE_RANGE_FLAG_NONE);
+        heap_range_start_offsets.push_back(slot * kHeapTiles);
+        range_tile_counts.push_back(kHeapTiles);
+      }
+      previous_heap = heap;
+      previous_slot = slot;
+    }
     direct_queue->UpdateTileMappings(
-        buffer_, 1, &region_start_coordinates, &region_size, heaps_[i], 1,
-        &range_flags, &heap_range_start_offset, &range_tile_count,
+        buffer_, UINT(region_sizes.size()), region_start_coordinates.data(),
+        region_sizes.data(), tile_heap_chunks_[chunk_index],
+        UINT(range_tile_counts.size()), range_flags.data(),
+        heap_range_start_offsets.data(), range_tile_counts.data(),
         D3D12_TILE_MAPPING_FLAG_NONE);
   }
-  return true;
+  pending_tile_mappings_.clear();
 }
 
 bool SharedMemory::RequestRange(uint32_t start, uint32_t length) {
@@ -426,17 +602,40 @@ bool SharedMemory::RequestRange(uint32_t start, uint32_t length) {
   }
 
   // Upload and protect used ranges.
-  GetRangesToUpload(start >> page_size_log2_, last >> page_size_log2_);
+  uint32_t page_first = start >> page_size_log2_;
+  uint32_t page_last = last >> page_size_log2_;
+  GetRangesToUpload(page_first, page_last);
   if (upload_ranges_.size() == 0) {
+    if (AreAsyncUploadsUsed()) {
+      MarkSubmissionUsedPages(page_first, page_last);
+    }
     return true;
   }
-  CommitUAVWritesAndTransitionBuffer(D3D12_RESOURCE_STATE_COPY_DEST);
-  command_processor_.SubmitBarriers();
+  bool direct_uploads_prepared = false;
+  MemoryHeatmap* heatmap = memory_.heatmap();
   for (auto upload_range : upload_ranges_) {
     uint32_t upload_range_start = upload_range.first;
     uint32_t upload_range_length = upload_range.second;
+    // Data already used by the current submission must be replaced after
+    // the commands using it.
+    bool upload_async =
+        AreAsyncUploadsUsed() &&
+        !AreSubmissionUsedPagesAny(
+            upload_range_start,
+            upload_range_start + upload_range_length - 1) &&
+        OpenCopyCommandList();
+    if (!upload_async && !direct_uploads_prepared) {
+      CommitUAVWritesAndTransitionBuffer(D3D12_RESOURCE_STATE_COPY_DEST);
+      command_processor_.SubmitBarriers();
+      direct_uploads_prepared = true;
+    }
     trace_writer_.WriteMemoryRead(upload_range_start << page_size_log2_,
                                   upload_range_length << page_size_log2_);
+    if (heatmap) {
+      heatmap->Add(MemoryHeatmap::Counter::kGpuUpload,
+                   upload_range_start << page_size_log2_,
+                   upload_range_length << page_size_log2_);
+    }
     while (upload_range_length != 0) {
       ID3D12Resource* upload_buffer;
       size_t upload_buffer_offset, upload_buffer_size;
@@ -454,9 +653,18 @@ bool SharedMemory::RequestRange(uint32_t start, uint32_t length) {
           upload_buffer_mapping,
           memory_.TranslatePhysical(upload_range_start << page_size_log2_),
           upload_buffer_size);
-      command_list.D3DCopyBufferRegion(
-          buffer_, upload_range_start << page_size_log2_, upload_buffer,
-          UINT64(upload_buffer_offset), UINT64(upload_buffer_size));
+      if (upload_async) {
+        // Buffers are implicitly promoted from and decay to the common state,
+        // so no barriers are needed on the copy queue.
+        copy_command_list_->CopyBufferRegion(
+            buffer_, upload_range_start << page_size_log2_, upload_buffer,
+            UINT64(upload_buffer_offset), UINT64(upload_buffer_size));
+        copy_command_list_upload_size_ += uint32_t(upload_buffer_size);
+      } else {
+        command_list.D3DCopyBufferRegion(
+            buffer_, upload_range_start << page_size_log2_, upload_buffer,
+            UINT64(upload_buffer_offset), UINT64(upload_buffer_size));
+      }
       uint32_t upload_buffer_pages =
           uint32_t(upload_buffer_size >> page_size_log2_);
       upload_range_start += upload_buffer_pages;
@@ -464,9 +672,143 @@ bool SharedMemory::RequestRange(uint32_t start, uint32_t length) {
     }
   }
 
+  if (AreAsyncUploadsUsed()) {
+    MarkSubmissionUsedPages(page_first, page_last);
+    // Start large uploads right away rather than at the end of the
+    // submission.
+    if (copy_command_list_upload_size_ >= kAsyncUploadSubmitSize) {
+      SubmitCopyCommandList();
+    }
+  }
+
+  return true;
+}
+
+bool SharedMemory::RequestRangeForOverwrite(uint32_t start, uint32_t length,
+                                            uint32_t overwritten_length) {
+  overwritten_length = std::min(overwritten_length, length);
+  uint32_t page_size = uint32_t(1) << page_size_log2_;
+  uint32_t overwritten_start_aligned = xe::align(start, page_size);
+  uint32_t overwritten_end_aligned = (start + overwritten_length) &
+                                     ~(page_size - 1);
+  if (overwritten_end_aligned <= overwritten_start_aligned) {
+    return RequestRange(start, length);
+  }
+  if (start > kBufferSize || (kBufferSize - start) < length) {
+    return false;
+  }
+  if (!EnsureTilesResident(start, length)) {
+    return false;
+  }
+  // Only the partially overwritten pages at the edges need the data from the
+  // CPU.
+  if (!RequestRange(start, overwritten_start_aligned - start) ||
+      !RequestRange(overwritten_end_aligned,
+                    start + length - overwritten_end_aligned)) {
+    return false;
+  }
+  if (AreAsyncUploadsUsed()) {
+    MarkSubmissionUsedPages(overwritten_start_aligned >> page_size_log2_,
+                            (overwritten_end_aligned >> page_size_log2_) - 1);
+  }
+  return true;
+}
+
+bool SharedMemory::OpenCopyCommandList() {
+  if (copy_command_list_open_) {
+    return true;
+  }
+  ID3D12CommandAllocator* copy_command_allocator = nullptr;
+  if (!copy_command_allocators_.empty() &&
+      copy_command_allocators_.front().second <=
+          copy_fence_->GetCompletedValue()) {
+    copy_command_allocator = copy_command_allocators_.front().first;
+    copy_command_allocators_.erase(copy_command_allocators_.begin());
+    copy_command_allocator->Reset();
+  } else {
+    if (FAILED(command_processor_.GetD3D12Context()
+                   .GetD3D12Provider()
+                   .GetDevice()
+                   ->CreateCommandAllocator(
+                       D3D12_COMMAND_LIST_TYPE_COPY,
+                       IID_PPV_ARGS(&copy_command_allocator)))) {
+      XELOGE("Shared memory: Failed to create a copy command allocator");
+      return false;
+    }
+  }
+  // The fence value is set when the command list is submitted.
+  copy_command_allocators_.emplace_back(copy_command_allocator,
+                                        copy_fence_current_);
+  if (FAILED(copy_command_list_->Reset(copy_command_allocator, nullptr))) {
+    XELOGE("Shared memory: Failed to reset the copy command list");
+    return false;
+  }
+  copy_command_list_open_ = true;
   return true;
 }
 
+void SharedMemory::SubmitCopyCommandList() {
+  if (!copy_command_list_open_) {
+    return;
+  }
+  copy_command_list_open_ = false;
+  copy_command_list_upload_size_ = 0;
+  // Not reusing the allocator until the copies are completed even if closing
+  // fails.
+  copy_command_allocators_.back().second = copy_fence_current_ + 1;
+  if (FAILED(copy_command_list_->Close())) {
+    XELOGE("Shared memory: Failed to close the copy command list");
+    copy_queue_->Signal(copy_fence_, ++copy_fence_current_);
+    return;
+  }
+  // Pages being uploaded may still be read by the previous submissions, and
+  // tile mappings are done on the direct queue.
+  CommitTileMappings();
+  command_processor_.GetD3D12Context()
+      .GetD3D12Provider()
+      .GetDirectQueue()
+      ->Signal(direct_fence_, ++direct_fence_current_);
+  copy_queue_->Wait(direct_fence_, direct_fence_current_);
+  ID3D12CommandList* execute_command_lists[] = {copy_command_list_};
+  copy_queue_->ExecuteCommandLists(1, execute_command_lists);
+  copy_queue_->Signal(copy_fence_, ++copy_fence_current_);
+}
+
+bool SharedMemory::AreSubmissionUsedPagesAny(uint32_t page_first,
+                                             uint32_t page_last) const {
+  uint32_t block_first = page_first >> 6;
+  uint32_t block_last = page_last >> 6;
+  for (uint32_t i = block_first; i <= block_last; ++i) {
+    uint64_t block = submission_used_pages_[i];
+    if (i == block_first) {
+      block &= ~((uint64_t(1) << (page_first & 63)) - 1);
+    }
+    if (i == block_last && (page_last & 63) != 63) {
+      block &= (uint64_t(1) << ((page_last & 63) + 1)) - 1;
+    }
+    if (block) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void SharedMemory::MarkSubmissionUsedPages(uint32_t page_first,
+                                           uint32_t page_last) {
+  uint32_t block_first = page_first >> 6;
+  uint32_t block_last = page_last >> 6;
+  for (uint32_t i = block_first; i <= block_last; ++i) {
+    uint64_t mask = ~uint64_t(0);
+    if (i == block_first) {
+      mask &= ~((uint64_t(1) << (page_first & 63)) - 1);
+    }
+    if (i == block_last && (page_last & 63) != 63) {
+      mask &= (uint64_t(1) << ((page_last & 63) + 1)) - 1;
+    }
+    submission_used_pages_[i] |= mask;
+  }
+}
+
 void SharedMemory::FireWatches(uint32_t page_first, uint32_t page_last,
                                bool invalidated_by_gpu) {
   uint32_t address_first = page_first << page_size_log2_;
@@ -516,6 +858,49 @@ void SharedMemory::RangeWrittenByGPU(uint32_t start, uint32_t length) {
   // Mark the range as valid (so pages are not reuploaded until modified by the
   // CPU) and watch it so the CPU can reuse it and this will be caught.
   MakeRangeValid(start, length, true);
+
+  if (AreAsyncUploadsUsed()) {
+    MarkSubmissionUsedPages(page_first, page_last);
+  }
+}
+
+bool SharedMemory::IsRangeWrittenByGPU(uint32_t start, uint32_t length) {
+  if (length == 0 || start >= kBufferSize) {
+    return false;
+  }
+  length = std::min(length, kBufferSize - start);
+  uint32_t page_first = start >> page_size_log2_;
+  uint32_t page_last = (start + length - 1) >> page_size_log2_;
+  uint32_t block_first = page_first >> 6;
+  uint32_t block_last = page_last >> 6;
+
+  auto global_lock = global_critical_region_.Acquire();
+  for (uint32_t i = block_first; i <= block_last; ++i) {
+    uint64_t block_bits = UINT64_MAX;
+    if (i == block_first) {
+      block_bits &= ~((1ull << (page_first & 63)) - 1);
+    }
+    if (i == block_last && (page_last & 63) != 63) {
+      block_bits &= (1ull << ((page_last & 63) + 1)) - 1;
+    }
+    if (system_page_flags_[i].valid_and_gpu_written & block_bits) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void SharedMemory::WatchRangeForInvalidation(uint32_t start, uint32_t length) {
+  if (length == 0 || start >= kBufferSize ||
+      !memory_invalidation_callback_handle_) {
+    return;
+  }
+  length = std::min(length, kBufferSize - start);
+  uint32_t page_first = start >> page_size_log2_;
+  uint32_t page_last = (start + length - 1) >> page_size_log2_;
+  memory_.EnablePhysicalMemoryAccessCallbacks(
+      page_first << page_size_log2_,
+      (page_last - page_first + 1) << page_size_log2_, true, false);
 }
 
 bool SharedMemory::AreTiledResourcesUsed() const {
@@ -560,6 +945,7 @@ void SharedMemory::MakeRangeValid(uint32_t start, uint32_t length,
       } else {
         block.valid_and_gpu_written &= ~valid_bits;
       }
+      UpdateValidBlockSummary(i);
     }
   }
 
@@ -594,6 +980,57 @@ void SharedMemory::UnlinkWatchRange(WatchRange* range) {
   watch_range_first_free_ = range;
 }
 
+void SharedMemory::UpdateValidBlockSummary(uint32_t block) {
+  uint64_t valid = system_page_flags_[block].valid;
+  uint64_t block_bit = uint64_t(1) << (block & 63);
+  if (valid) {
+    valid_block_any_bits_[block >> 6] |= block_bit;
+  } else {
+    valid_block_any_bits_[block >> 6] &= ~block_bit;
+  }
+  if (valid == UINT64_MAX) {
+    valid_block_all_bits_[block >> 6] |= block_bit;
+  } else {
+    valid_block_all_bits_[block >> 6] &= ~block_bit;
+  }
+}
+
+uint32_t SharedMemory::FindValidPage(uint32_t first, uint32_t last,
+                                     bool valid) const {
+  auto page_bits = [this, valid](uint32_t block) {
+    uint64_t bits = system_page_flags_[block].valid;
+    return valid ? bits : ~bits;
+  };
+  auto block_bits = [this, valid](uint32_t summary) {
+    return valid ? valid_block_any_bits_[summary]
+                 : ~valid_block_all_bits_[summary];
+  };
+  uint32_t block = first >> 6;
+  uint32_t block_last = last >> 6;
+  uint64_t bits = page_bits(block) & (UINT64_MAX << (first & 63));
+  while (!bits) {
+    if (block == block_last) {
+      return UINT32_MAX;
+    }
+    ++block;
+    uint64_t summary = block_bits(block >> 6) & (UINT64_MAX << (block & 63));
+    if (!summary) {
+      block |= 63;
+      if (block >= block_last) {
+        return UINT32_MAX;
+      }
+      continue;
+    }
+    block = (block & ~uint32_t(63)) + xe::tzcnt(summary);
+    if (block > block_last) {
+      return UINT32_MAX;
+    }
+    bits = page_bits(block);
+  }
+  uint32_t page = (block << 6) + xe::tzcnt(bits);
+  return page <= last ? page : UINT32_MAX;
+}
+
 void SharedMemory::GetRangesToUpload(uint32_t request_page_first,
                                      uint32_t request_page_last) {
   upload_ranges_.clear();
@@ -601,52 +1038,21 @@ void SharedMemory::GetRangesToUpload(uint32_t request_page_first,
   if (request_page_first > request_page_last) {
     return;
   }
-  uint32_t request_block_first = request_page_first >> 6;
-  uint32_t request_block_last = request_page_last >> 6;
 
   auto global_lock = global_critical_region_.Acquire();
 
-  uint32_t range_start = UINT32_MAX;
-  for (uint32_t i = request_block_first; i <= request_block_last; ++i) {
-    uint64_t block_valid = system_page_flags_[i].valid;
-    // Consider pages in the block outside the requested range valid.
-    if (i == request_block_first) {
-      block_valid |= (1ull << (request_page_first & 63)) - 1;
-    }
-    if (i == request_block_last && (request_page_last & 63) != 63) {
-      block_valid |= ~((1ull << ((request_page_last & 63) + 1)) - 1);
-    }
-
-    while (true) {
-      uint32_t block_page;
-      if (range_start == UINT32_MAX) {
-        // Check if need to open a new range.
-        if (!xe::bit_scan_forward(~block_valid, &block_page)) {
-          break;
-        }
-        range_start = (i << 6) + block_page;
-      } else {
-        // Check if need to close the range.
-        // Ignore the valid pages before the beginning of the range.
-        uint64_t block_valid_from_start = block_valid;
-        if (i == (range_start >> 6)) {
-          block_valid_from_start &= ~((1ull << (range_start & 63)) - 1);
-        }
-        if (!xe::bit_scan_forward(block_valid_from_start, &block_page)) {
-          break;
-        }
-        upload_ranges_.push_back(
-            std::make_pair(range_start, (i << 6) + block_page - range_start));
-        // In the next interation within this block, consider this range valid
-        // since it has been queued for upload.
-        block_valid |= (1ull << block_page) - 1;
-        range_start = UINT32_MAX;
-      }
+  uint32_t range_start =
+      FindValidPage(request_page_first, request_page_last, false);
+  while (range_start != UINT32_MAX) {
+    uint32_t range_end = FindValidPage(range_start, request_page_last, true);
+    if (range_end == UINT32_MAX) {
+      upload_ranges_.push_back(
+          std::make_pair(range_start, request_page_last + 1 - range_start));
+      break;
     }
-  }
-  if (range_start != UINT32_MAX) {
     upload_ranges_.push_back(
-        std::make_pair(range_start, request_page_last + 1 - range_start));
+        std::make_pair(range_start, range_end - range_start));
+    range_start = FindValidPage(range_end, request_page_last, false);
   }
 }
 
@@ -708,6 +1114,7 @@ std::pair<uint32_t, uint32_t> SharedMemory::MemoryInvalidationCallback(
     SystemPageFlagsBlock& block = system_page_flags_[i];
     block.valid &= ~invalidate_bits;
     block.valid_and_gpu_written &= ~invalidate_bits;
+    UpdateValidBlockSummary(i);
   }
 
   FireWatches(page_first, page_last, false);
@@ -820,6 +1227,7 @@ bool SharedMemory::InitializeTraceSubmitDownloads() {
       uint64_t previously_valid_block = page_flags_block.valid;
       uint64_t gpu_written_block = page_flags_block.valid_and_gpu_written;
       page_flags_block.valid = gpu_written_block;
+      UpdateValidBlockSummary(i);
 
       // Fire watches on the invalidated pages.
       uint64_t fire_watches_block = previously_valid_block & ~gpu_written_block;
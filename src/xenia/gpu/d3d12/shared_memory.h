@@ -45,6 +45,10 @@ class SharedMemory {
   }
 
   void CompletedSubmissionUpdated();
+  // Submits the uploads recorded for the copy queue if it's used, and makes
+  // the direct queue wait for them. Must be called before every submission is
+  // executed on the direct queue.
+  void EndSubmission();
 
   typedef void (*GlobalWatchCallback)(void* context, uint32_t address_first,
                                       uint32_t address_last,
@@ -91,6 +95,12 @@ class SharedMemory {
   // UseForWriting. Returns true if the range has been fully updated and is
   // usable.
   bool RequestRange(uint32_t start, uint32_t length);
+  // Same as RequestRange, but for ranges that are about to be written by the
+  // GPU (before RangeWrittenByGPU), with the first overwritten_length bytes
+  // written completely: pages fully within that portion are not uploaded,
+  // since their current contents would be discarded anyway.
+  bool RequestRangeForOverwrite(uint32_t start, uint32_t length,
+                                uint32_t overwritten_length);
 
   // Marks the range and, if not exact_range, potentially its surroundings
   // (to up to the first GPU-written page, as an access violation exception
@@ -108,6 +118,16 @@ class SharedMemory {
   // regions in those pages.
   void RangeWrittenByGPU(uint32_t start, uint32_t length);
 
+  // Whether any page in the range contains data written by the GPU that is not
+  // in the guest memory.
+  bool IsRangeWrittenByGPU(uint32_t start, uint32_t length);
+  // Enables invalidation notifications for the range without uploading it, for
+  // data that is loaded from elsewhere (such as from a disk cache) rather than
+  // from the buffer, but must still be invalidated when the CPU writes to it.
+  void WatchRangeForInvalidation(uint32_t start, uint32_t length);
+
+  Memory& memory() const { return memory_; }
+
   // Makes the buffer usable for vertices, indices and texture untiling.
   inline void UseForReading() {
     // Vertex fetch is also allowed in pixel shaders.
@@ -149,6 +169,7 @@ class SharedMemory {
 
  private:
   bool AreTiledResourcesUsed() const;
+  bool AreAsyncUploadsUsed() const { return copy_queue_ != nullptr; }
 
   // Mark the memory range as updated and protect it.
   void MakeRangeValid(uint32_t start, uint32_t length, bool written_by_gpu);
@@ -172,10 +193,29 @@ class SharedMemory {
   static constexpr uint32_t kHeapSize = 1 << kHeapSizeLog2;
   static_assert((kHeapSize % D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES) == 0,
                 "Heap size must be a multiple of Direct3D tile size");
-  // Resident portions of the tiled buffer.
+  // Heaps backing the resident portions of the tiled buffer, in slots of
+  // larger chunks - not owned, references to tile_heap_chunks_.
   ID3D12Heap* heaps_[kBufferSize >> kHeapSizeLog2] = {};
   // Number of the heaps currently resident, for profiling.
   uint32_t heap_count_ = 0;
+  // The heaps are allocated sequentially from chunks created in advance (one
+  // chunk is kept spare between submissions), so making tiles resident while
+  // recording draws normally doesn't create heaps, and tile mappings for heaps
+  // from the same chunk can be updated in one call.
+  static constexpr uint32_t kHeapChunkSizeLog2 = 24;
+  static constexpr uint32_t kHeapChunkSlots =
+      uint32_t(1) << (kHeapChunkSizeLog2 - kHeapSizeLog2);
+  static constexpr uint32_t kHeapChunkMaxCount =
+      kBufferSize >> kHeapChunkSizeLog2;
+  std::vector<ID3D12Heap*> tile_heap_chunks_;
+  // Slots allocated from tile_heap_chunks_, in order.
+  uint32_t tile_heap_slots_used_ = 0;
+  bool CreateTileHeapChunk();
+  // Heap index (in heaps_) and slot of the heaps made resident since the last
+  // tile mapping update. The mappings are updated in a batch before anything
+  // that may use them is submitted to the direct or the copy queue.
+  std::vector<std::pair<uint32_t, uint32_t>> pending_tile_mappings_;
+  void CommitTileMappings();
 
   // Log2 of invalidation granularity (the system page size, but the dependency
   // on it is not hard - the access callback takes a range as an argument, and
@@ -214,6 +254,38 @@ class SharedMemory {
                          uint32_t request_page_last);
   std::unique_ptr<ui::d3d12::D3D12UploadBufferPool> upload_buffer_pool_;
 
+  // Uploads of pages not used yet by the current submission are done on a
+  // copy queue if enabled, so they can be done while the direct queue is busy
+  // with the previous submissions and while the current one is being
+  // recorded. Pages already used by the current submission must be uploaded
+  // in order with the draws on the direct queue. The copy queue waits for
+  // everything submitted to the direct queue (including tile mappings)
+  // before each copy command list, and the direct queue waits for the copies
+  // before the submission that needs their data.
+  static constexpr uint32_t kAsyncUploadSubmitSize = 4 * 1024 * 1024;
+  ID3D12CommandQueue* copy_queue_ = nullptr;
+  ID3D12GraphicsCommandList* copy_command_list_ = nullptr;
+  bool copy_command_list_open_ = false;
+  uint32_t copy_command_list_upload_size_ = 0;
+  // Command allocators with the copy fence value to await before reusing
+  // them, oldest first. The last one is being written to if the command list
+  // is open.
+  std::vector<std::pair<ID3D12CommandAllocator*, uint64_t>>
+      copy_command_allocators_;
+  ID3D12Fence* copy_fence_ = nullptr;
+  uint64_t copy_fence_current_ = 0;
+  uint64_t copy_fence_awaited_by_direct_ = 0;
+  ID3D12Fence* direct_fence_ = nullptr;
+  uint64_t direct_fence_current_ = 0;
+  // One bit per page read or written by the current submission.
+  std::vector<uint64_t> submission_used_pages_;
+  bool InitializeAsyncUploads();
+  void ShutdownAsyncUploads();
+  bool OpenCopyCommandList();
+  void SubmitCopyCommandList();
+  bool AreSubmissionUsedPagesAny(uint32_t page_first, uint32_t page_last) const;
+  void MarkSubmissionUsedPages(uint32_t page_first, uint32_t page_last);
+
   // GPU-written memory downloading for traces.
   // Start page, length in pages.
   std::vector<std::pair<uint32_t, uint32_t>> trace_gpu_written_ranges_;
@@ -243,6 +315,15 @@ class SharedMemory {
   // Flags for each 64 system pages, interleaved as blocks, so bit scan can be
   // used to quickly extract ranges.
   std::vector<SystemPageFlagsBlock> system_page_flags_;
+  // Summary of the valid bits, one bit per block of 64 pages for whether any
+  // or all of its pages are valid, so long runs of valid or invalid pages are
+  // skipped 4096 pages at a time.
+  std::vector<uint64_t> valid_block_any_bits_;
+  std::vector<uint64_t> valid_block_all_bits_;
+  void UpdateValidBlockSummary(uint32_t block);
+  // Returns the first page within [first, last] that is valid (or invalid if
+  // valid is false), or UINT32_MAX if there are none.
+  uint32_t FindValidPage(uint32_t first, uint32_t last, bool valid) const;
 
   static std::pair<uint32_t, uint32_t> MemoryInvalidationCallbackThunk(
       void* context_ptr, uint32_t physical_address_start, uint32_t length,
@@ -9,15 +9,19 @@
 
 #include "xenia/gpu/d3d12/texture_cache.h"
 
-#include "third_party/xxhash/xxhash.h"
-
 #include <algorithm>
 #include <cfloat>
+#include <cstdio>
 #include <cstring>
+#include <vector>
+
+#include "third_party/fmt/include/fmt/format.h"
 
 #include "xenia/base/assert.h"
 #include "xenia/base/clock.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/hash.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
@@ -32,21 +36,64 @@ DEFINE_int32(d3d12_resolution_scale, 1,
              "Scale of rendering width and height (currently only 1 and 2 "
              "are available).",
              "D3D12");
+DEFINE_path(
+    d3d12_texture_disk_cache_path, "",
+    "Directory to store textures converted to the host format in, to load them "
+    "from instead of converting them again when the same guest data is used, "
+    "including in later runs. Textures containing GPU-written data and "
+    "resolution-scaled textures are not cached. Empty to disable.",
+    "D3D12");
+DEFINE_bool(
+    d3d12_texture_deduplication, false,
+    "Share host resources between textures with identical guest data at "
+    "different addresses, such as copies of font pages and UI atlases, to "
+    "reduce video memory usage and uploading. Resources are copied when the "
+    "data of one of the textures sharing them is modified.",
+    "D3D12");
+DEFINE_bool(
+    d3d12_texture_cache_limits_adaptive, true,
+    "Derive the texture memory limits from the video memory budget given to "
+    "the process by the OS, minus the memory used for purposes other than "
+    "textures, instead of d3d12_texture_cache_limit_soft and "
+    "d3d12_texture_cache_limit_hard, if the budget can be queried. Half of the "
+    "budget for textures is used as the soft limit, seven eighths of it as the "
+    "hard limit.",
+    "D3D12");
+DEFINE_bool(
+    d3d12_texture_cache_residency, true,
+    "When the texture memory limits are exceeded, evict unused textures from "
+    "video memory, letting them be brought back without reloading if they're "
+    "needed again, instead of destroying them. Evicted textures are destroyed "
+    "when their total size exceeds the hard limit.",
+    "D3D12");
 DEFINE_int32(d3d12_texture_cache_limit_soft, 384,
              "Maximum host texture memory usage (in megabytes) above which old "
-             "textures will be destroyed (lifetime configured with "
-             "d3d12_texture_cache_limit_soft_lifetime). If using 2x resolution "
-             "scale, 1.25x of this is used.",
+             "textures will be evicted or destroyed (lifetime configured with "
+             "d3d12_texture_cache_limit_soft_lifetime), if the limits are not "
+             "adaptive. If using 2x resolution scale, 1.25x of this is used.",
              "D3D12");
 DEFINE_int32(d3d12_texture_cache_limit_soft_lifetime, 30,
              "Seconds a texture should be unused to be considered old enough "
-             "to be deleted if texture memory usage exceeds "
-             "d3d12_texture_cache_limit_soft.",
+             "to be evicted or deleted if texture memory usage exceeds the "
+             "soft limit.",
              "D3D12");
 DEFINE_int32(d3d12_texture_cache_limit_hard, 768,
              "Maximum host texture memory usage (in megabytes) above which "
-             "textures will be destroyed as soon as possible. If using 2x "
-             "resolution scale, 1.25x of this is used.",
+             "textures will be evicted or destroyed as soon as possible, if "
+             "the limits are not adaptive. If using 2x resolution scale, 1.25x "
+             "of this is used.",
+             "D3D12");
+DEFINE_bool(
+    d3d12_texture_mip_streaming, false,
+    "Load only the base level of a texture with mipmaps when it's first used, "
+    "and its mipmaps in the following frames, to reduce stuttering when many "
+    "new textures appear at once. Until the mipmaps are loaded, only the base "
+    "level is sampled. Resolution-scaled textures are not streamed.",
+    "D3D12");
+DEFINE_int32(d3d12_texture_mip_streaming_budget, 8,
+             "Maximum guest mipmap data (in megabytes) to load per frame with "
+             "d3d12_texture_mip_streaming, though the mipmaps of at least one "
+             "texture are loaded every frame.",
              "D3D12");
 
 namespace xe {
@@ -1043,6 +1090,10 @@ void TextureCache::Shutdown() {
 }
 
 void TextureCache::ClearCache() {
+  // The GPU is idle when the cache is cleared, so all the disk cache downloads
+  // are complete.
+  ProcessDiskCacheTransfers(true);
+
   // Destroy all the textures.
   for (auto texture_pair : textures_) {
     Texture* texture = texture_pair.second;
@@ -1056,13 +1107,19 @@ void TextureCache::ClearCache() {
             descriptor_pair.second);
       }
     }
-    texture->resource->Release();
+    ReleaseTextureResource(texture->resource);
     delete texture;
   }
   textures_.clear();
+  mip_streaming_textures_.clear();
+  assert_true(resources_by_content_.empty());
+  resources_by_content_.clear();
+  ProcessDeferredReleases(true);
   COUNT_profile_set("gpu/texture_cache/textures", 0);
   textures_total_size_ = 0;
+  textures_evicted_size_ = 0;
   COUNT_profile_set("gpu/texture_cache/total_size_mb", 0);
+  COUNT_profile_set("gpu/texture_cache/evicted_size_mb", 0);
   texture_used_first_ = texture_used_last_ = nullptr;
 
   // Clear texture descriptor cache.
@@ -1084,76 +1141,136 @@ void TextureCache::BeginFrame() {
   // is requested again.
   ClearBindings();
 
+  ProcessDeferredReleases(false);
+  ProcessDiskCacheTransfers(false);
+
   std::memset(unsupported_format_features_used_, 0,
               sizeof(unsupported_format_features_used_));
 
   texture_current_usage_time_ = xe::Clock::QueryHostUptimeMillis();
 
-  // If memory usage is too high, destroy unused textures.
-  uint64_t completed_frame = command_processor_.GetCompletedFrame();
-  uint32_t limit_soft_mb = cvars::d3d12_texture_cache_limit_soft;
-  uint32_t limit_hard_mb = cvars::d3d12_texture_cache_limit_hard;
-  if (IsResolutionScale2X()) {
-    limit_soft_mb += limit_soft_mb >> 2;
-    limit_hard_mb += limit_hard_mb >> 2;
+  // Get the texture memory limits, from the video memory budget of the process
+  // if possible - the memory used by other resources of the process, such as
+  // render targets and the shared memory, is subtracted from it.
+  uint64_t limit_soft, limit_hard;
+  uint64_t textures_resident_size =
+      textures_total_size_ - textures_evicted_size_;
+  DXGI_QUERY_VIDEO_MEMORY_INFO video_memory_info;
+  if (cvars::d3d12_texture_cache_limits_adaptive &&
+      command_processor_.GetD3D12Context()
+          .GetD3D12Provider()
+          .QueryLocalVideoMemoryInfo(video_memory_info)) {
+    uint64_t other_usage =
+        video_memory_info.CurrentUsage -
+        std::min(video_memory_info.CurrentUsage, textures_resident_size);
+    uint64_t textures_budget =
+        video_memory_info.Budget -
+        std::min(video_memory_info.Budget, other_usage);
+    limit_soft = textures_budget >> 1;
+    limit_hard = textures_budget - (textures_budget >> 3);
+  } else {
+    limit_soft =
+        uint64_t(std::max(cvars::d3d12_texture_cache_limit_soft, 0)) << 20;
+    limit_hard =
+        uint64_t(std::max(cvars::d3d12_texture_cache_limit_hard, 0)) << 20;
+    if (IsResolutionScale2X()) {
+      limit_soft += limit_soft >> 2;
+      limit_hard += limit_hard >> 2;
+    }
   }
-  uint32_t limit_soft_lifetime =
-      std::max(cvars::d3d12_texture_cache_limit_soft_lifetime, 0) * 1000;
+  uint64_t limit_soft_lifetime =
+      uint64_t(std::max(cvars::d3d12_texture_cache_limit_soft_lifetime, 0)) *
+      1000;
+  uint64_t completed_frame = command_processor_.GetCompletedFrame();
   bool destroyed_any = false;
-  while (texture_used_first_ != nullptr) {
-    uint64_t total_size_mb = textures_total_size_ >> 20;
-    bool limit_hard_exceeded = total_size_mb >= limit_hard_mb;
-    if (total_size_mb < limit_soft_mb && !limit_hard_exceeded) {
-      break;
-    }
-    Texture* texture = texture_used_first_;
-    if (texture->last_usage_frame > completed_frame) {
-      break;
-    }
-    if (!limit_hard_exceeded &&
-        (texture->last_usage_time + limit_soft_lifetime) >
-            texture_current_usage_time_) {
-      break;
-    }
-    destroyed_any = true;
-    // Remove the texture from the map.
-    auto found_range = textures_.equal_range(texture->key.GetMapKey());
-    for (auto iter = found_range.first; iter != found_range.second; ++iter) {
-      if (iter->second == texture) {
-        textures_.erase(iter);
+
+  // If video memory usage is too high, evict (or destroy) the textures not used
+  // by the GPU anymore - only old ones if the soft limit is exceeded, any ones
+  // if the hard limit is exceeded. Resources shared by multiple textures are
+  // kept resident because other textures sharing them may still be in use.
+  if (textures_resident_size > limit_soft) {
+    bool limit_hard_exceeded = textures_resident_size > limit_hard;
+    eviction_candidates_.clear();
+    for (Texture* texture = texture_used_first_; texture;
+         texture = texture->used_next) {
+      if (texture->last_usage_frame > completed_frame) {
         break;
       }
+      bool old = texture->last_usage_time + limit_soft_lifetime <=
+                 texture_current_usage_time_;
+      if (!old && !limit_hard_exceeded) {
+        break;
+      }
+      if (texture->resource->evicted || texture->resource->texture_count > 1) {
+        continue;
+      }
+      eviction_candidates_.emplace_back(GetEvictionPriority(*texture),
+                                        texture);
     }
-    // Unlink the texture.
-    texture_used_first_ = texture->used_next;
-    if (texture_used_first_ != nullptr) {
-      texture_used_first_->used_previous = nullptr;
-    } else {
-      texture_used_last_ = nullptr;
+    std::sort(eviction_candidates_.begin(), eviction_candidates_.end(),
+              [](const auto& a, const auto& b) { return a.first > b.first; });
+    ID3D12Device* device =
+        command_processor_.GetD3D12Context().GetD3D12Provider().GetDevice();
+    for (const auto& candidate : eviction_candidates_) {
+      Texture* texture = candidate.second;
+      // Textures younger than the soft limit lifetime are only candidates while
+      // the hard limit is exceeded.
+      bool old = texture->last_usage_time + limit_soft_lifetime <=
+                 texture_current_usage_time_;
+      uint64_t limit = old ? limit_soft : limit_hard;
+      if (textures_resident_size <= limit) {
+        if (textures_resident_size <= limit_soft) {
+          break;
+        }
+        continue;
+      }
+      TextureResource& resource = *texture->resource;
+      textures_resident_size -= resource.size;
+      if (cvars::d3d12_texture_cache_residency) {
+        ID3D12Pageable* pageable = resource.resource;
+        if (SUCCEEDED(device->Evict(1, &pageable))) {
+          resource.evicted = true;
+          textures_evicted_size_ += resource.size;
+          continue;
+        }
+      }
+      DestroyTexture(texture);
+      destroyed_any = true;
     }
-    // Exclude the texture from the memory usage counter.
-    textures_total_size_ -= texture->resource_size;
-    // Destroy the texture.
-    shared_memory_.UnwatchMemoryRange(texture->base_watch_handle);
-    shared_memory_.UnwatchMemoryRange(texture->mip_watch_handle);
-    if (bindless_resources_used_) {
-      for (auto descriptor_pair : texture->srv_descriptors) {
-        command_processor_.ReleaseViewBindlessDescriptorImmediately(
-            descriptor_pair.second);
+  }
+
+  // Evicted textures still occupy system memory - destroy them if there are
+  // too many too.
+  if (textures_evicted_size_ > limit_hard) {
+    eviction_candidates_.clear();
+    for (Texture* texture = texture_used_first_; texture;
+         texture = texture->used_next) {
+      if (texture->last_usage_frame > completed_frame) {
+        break;
       }
-    } else {
-      for (auto descriptor_pair : texture->srv_descriptors) {
-        srv_descriptor_cache_free_.push_back(descriptor_pair.second);
+      if (texture->resource->evicted) {
+        eviction_candidates_.emplace_back(GetEvictionPriority(*texture),
+                                          texture);
       }
     }
-    texture->resource->Release();
-    delete texture;
+    std::sort(eviction_candidates_.begin(), eviction_candidates_.end(),
+              [](const auto& a, const auto& b) { return a.first > b.first; });
+    for (const auto& candidate : eviction_candidates_) {
+      if (textures_evicted_size_ <= limit_hard) {
+        break;
+      }
+      DestroyTexture(candidate.second);
+      destroyed_any = true;
+    }
   }
+
+  COUNT_profile_set("gpu/texture_cache/evicted_size_mb",
+                    uint32_t(textures_evicted_size_ >> 20));
   if (destroyed_any) {
     COUNT_profile_set("gpu/texture_cache/textures", textures_.size());
-    COUNT_profile_set("gpu/texture_cache/total_size_mb",
-                      uint32_t(textures_total_size_ >> 20));
   }
+
+  StreamTextureMips();
 }
 
 void TextureCache::EndFrame() {
@@ -1315,22 +1432,25 @@ void TextureCache::RequestTextures(uint32_t used_texture_mask) {
     if (binding.texture != nullptr) {
       // Will be referenced by the command list, so mark as used.
       MarkTextureUsed(binding.texture);
+      TextureResource& resource = *binding.texture->resource;
+      MakeTextureResourceResident(resource);
       command_processor_.PushTransitionBarrier(
-          binding.texture->resource, binding.texture->state,
+          resource.resource, resource.state,
           D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE |
               D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-      binding.texture->state = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE |
-                               D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+      resource.state = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE |
+                       D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
     }
     if (binding.texture_signed != nullptr) {
       MarkTextureUsed(binding.texture_signed);
+      TextureResource& resource = *binding.texture_signed->resource;
+      MakeTextureResourceResident(resource);
       command_processor_.PushTransitionBarrier(
-          binding.texture_signed->resource, binding.texture_signed->state,
+          resource.resource, resource.state,
           D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE |
               D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-      binding.texture_signed->state =
-          D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE |
-          D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+      resource.state = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE |
+                       D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
     }
   }
 }
@@ -1344,7 +1464,10 @@ bool TextureCache::AreActiveTextureSRVKeysUpToDate(
     const TextureBinding& binding =
         texture_bindings_[host_shader_bindings[i].fetch_constant];
     if (key.key != binding.key || key.host_swizzle != binding.host_swizzle ||
-        key.swizzled_signs != binding.swizzled_signs) {
+        key.swizzled_signs != binding.swizzled_signs ||
+        key.resource_uid != GetTextureResourceUID(binding.texture) ||
+        key.resource_uid_signed !=
+            GetTextureResourceUID(binding.texture_signed)) {
       return false;
     }
   }
@@ -1360,6 +1483,8 @@ void TextureCache::WriteActiveTextureSRVKeys(
     const TextureBinding& binding =
         texture_bindings_[host_shader_bindings[i].fetch_constant];
     key.key = binding.key;
+    key.resource_uid = GetTextureResourceUID(binding.texture);
+    key.resource_uid_signed = GetTextureResourceUID(binding.texture_signed);
     key.host_swizzle = binding.host_swizzle;
     key.swizzled_signs = binding.swizzled_signs;
   }
@@ -1721,7 +1846,8 @@ ID3D12Resource* TextureCache::RequestSwapTexture(
     return nullptr;
   }
   Texture* texture = FindOrCreateTexture(key);
-  if (texture == nullptr || !LoadTextureData(texture)) {
+  if (texture == nullptr || !LoadTextureData(texture) ||
+      !MakeTextureResourceResident(*texture->resource)) {
     return nullptr;
   }
   MarkTextureUsed(texture);
@@ -1729,9 +1855,9 @@ ID3D12Resource* TextureCache::RequestSwapTexture(
   // shader, and not during emulation, where it'd be NON_PIXEL_SHADER_RESOURCE |
   // PIXEL_SHADER_RESOURCE.
   command_processor_.PushTransitionBarrier(
-      texture->resource, texture->state,
+      texture->resource->resource, texture->resource->state,
       D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-  texture->state = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+  texture->resource->state = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
   srv_desc_out.Format = GetDXGIUnormFormat(key);
   srv_desc_out.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
   srv_desc_out.Shader4ComponentMapping =
@@ -1742,7 +1868,7 @@ ID3D12Resource* TextureCache::RequestSwapTexture(
   srv_desc_out.Texture2D.PlaneSlice = 0;
   srv_desc_out.Texture2D.ResourceMinLODClamp = 0.0f;
   format_out = key.format;
-  return texture->resource;
+  return texture->resource->resource;
 }
 
 bool TextureCache::IsDecompressionNeeded(xenos::TextureFormat format,
@@ -1926,54 +2052,16 @@ TextureCache::Texture* TextureCache::FindOrCreateTexture(TextureKey key) {
 
   // Create the resource. If failed to create one, don't create a texture object
   // at all so it won't be in indeterminate state.
-  D3D12_RESOURCE_DESC desc;
-  desc.Format = GetDXGIResourceFormat(key);
-  if (desc.Format == DXGI_FORMAT_UNKNOWN) {
-    unsupported_format_features_used_[uint32_t(key.format)] |=
-        kUnsupportedResourceBit;
-    return nullptr;
-  }
-  if (key.dimension == xenos::DataDimension::k3D) {
-    desc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE3D;
-  } else {
-    // 1D textures are treated as 2D for simplicity.
-    desc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
-  }
-  desc.Alignment = 0;
-  desc.Width = key.width;
-  desc.Height = key.height;
-  if (key.scaled_resolve) {
-    desc.Width *= 2;
-    desc.Height *= 2;
-  }
-  desc.DepthOrArraySize = key.depth;
-  desc.MipLevels = key.mip_max_level + 1;
-  desc.SampleDesc.Count = 1;
-  desc.SampleDesc.Quality = 0;
-  desc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
-  // Untiling through a buffer instead of using unordered access because copying
-  // is not done that often.
-  desc.Flags = D3D12_RESOURCE_FLAG_NONE;
-  auto& provider = command_processor_.GetD3D12Context().GetD3D12Provider();
-  auto device = provider.GetDevice();
-  // Assuming untiling will be the next operation.
-  D3D12_RESOURCE_STATES state = D3D12_RESOURCE_STATE_COPY_DEST;
-  ID3D12Resource* resource;
-  if (FAILED(device->CreateCommittedResource(
-          &ui::d3d12::util::kHeapPropertiesDefault,
-          provider.GetHeapFlagCreateNotZeroed(), &desc, state, nullptr,
-          IID_PPV_ARGS(&resource)))) {
-    LogTextureKeyAction(key, "Failed to create");
+  TextureResource* resource = CreateTextureResource(key);
+  if (resource == nullptr) {
     return nullptr;
   }
+  ++resource->texture_count;
 
   // Create the texture object and add it to the map.
   Texture* texture = new Texture;
   texture->key = key;
   texture->resource = resource;
-  texture->resource_size =
-      device->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
-  texture->state = state;
   texture->last_usage_frame = command_processor_.GetCurrentFrame();
   texture->last_usage_time = texture_current_usage_time_;
   texture->used_previous = texture_used_last_;
@@ -2050,16 +2138,252 @@ TextureCache::Texture* TextureCache::FindOrCreateTexture(TextureKey key) {
   }
   texture->base_watch_handle = nullptr;
   texture->mip_watch_handle = nullptr;
+  // Stream the mips unless they're all in the same packed tail as the base,
+  // or the texture is resolution-scaled (its data is already on the GPU).
+  texture->mips_streaming =
+      cvars::d3d12_texture_mip_streaming && key.base_page != 0 &&
+      key.mip_page != 0 && !key.scaled_resolve &&
+      (!key.packed_mips ||
+       texture_util::GetPackedMipLevel(key.width, key.height) != 0);
+  if (texture->mips_streaming) {
+    mip_streaming_textures_.push_back(texture);
+  }
   textures_.insert(std::make_pair(map_key, texture));
   COUNT_profile_set("gpu/texture_cache/textures", textures_.size());
-  textures_total_size_ += texture->resource_size;
-  COUNT_profile_set("gpu/texture_cache/total_size_mb",
-                    uint32_t(textures_total_size_ >> 20));
   LogTextureAction(texture, "Created");
 
   return texture;
 }
 
+TextureCache::TextureResource* TextureCache::CreateTextureResource(
+    TextureKey key) {
+  D3D12_RESOURCE_DESC desc;
+  desc.Format = GetDXGIResourceFormat(key);
+  if (desc.Format == DXGI_FORMAT_UNKNOWN) {
+    unsupported_format_features_used_[uint32_t(key.format)] |=
+        kUnsupportedResourceBit;
+    return nullptr;
+  }
+  if (key.dimension == xenos::DataDimension::k3D) {
+    desc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE3D;
+  } else {
+    // 1D textures are treated as 2D for simplicity.
+    desc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+  }
+  desc.Alignment = 0;
+  desc.Width = key.width;
+  desc.Height = key.height;
+  if (key.scaled_resolve) {
+    desc.Width *= 2;
+    desc.Height *= 2;
+  }
+  desc.DepthOrArraySize = key.depth;
+  desc.MipLevels = key.mip_max_level + 1;
+  desc.SampleDesc.Count = 1;
+  desc.SampleDesc.Quality = 0;
+  desc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+  // Untiling through a buffer instead of using unordered access because copying
+  // is not done that often.
+  desc.Flags = D3D12_RESOURCE_FLAG_NONE;
+  auto& provider = command_processor_.GetD3D12Context().GetD3D12Provider();
+  auto device = provider.GetDevice();
+  // Assuming untiling will be the next operation.
+  D3D12_RESOURCE_STATES state = D3D12_RESOURCE_STATE_COPY_DEST;
+  ID3D12Resource* resource;
+  if (FAILED(device->CreateCommittedResource(
+          &ui::d3d12::util::kHeapPropertiesDefault,
+          provider.GetHeapFlagCreateNotZeroed(), &desc, state, nullptr,
+          IID_PPV_ARGS(&resource)))) {
+    LogTextureKeyAction(key, "Failed to create");
+    return nullptr;
+  }
+
+  TextureResource* texture_resource = new TextureResource;
+  texture_resource->resource = resource;
+  texture_resource->size =
+      device->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+  texture_resource->state = state;
+  texture_resource->uid = texture_resource_next_uid_++;
+  texture_resource->texture_count = 0;
+  texture_resource->content_indexed = false;
+  texture_resource->content_key = {};
+  texture_resource->evicted = false;
+  textures_total_size_ += texture_resource->size;
+  COUNT_profile_set("gpu/texture_cache/total_size_mb",
+                    uint32_t(textures_total_size_ >> 20));
+  return texture_resource;
+}
+
+void TextureCache::ReleaseTextureResource(TextureResource* resource) {
+  assert_not_zero(resource->texture_count);
+  if (--resource->texture_count) {
+    return;
+  }
+  RemoveTextureResourceFromContentIndex(resource);
+  textures_total_size_ -= resource->size;
+  if (resource->evicted) {
+    textures_evicted_size_ -= resource->size;
+  }
+  COUNT_profile_set("gpu/texture_cache/total_size_mb",
+                    uint32_t(textures_total_size_ >> 20));
+  // Other textures that have been sharing the resource may have used it in
+  // submissions that are still executing.
+  resources_for_release_.emplace_back(
+      resource->resource, command_processor_.GetCurrentSubmission());
+  delete resource;
+}
+
+void TextureCache::RemoveTextureResourceFromContentIndex(
+    TextureResource* resource) {
+  if (!resource->content_indexed) {
+    return;
+  }
+  resources_by_content_.erase(resource->content_key);
+  resource->content_indexed = false;
+}
+
+void TextureCache::SetTextureResource(Texture* texture,
+                                      TextureResource* resource) {
+  ++resource->texture_count;
+  ReleaseTextureResource(texture->resource);
+  texture->resource = resource;
+  RecreateTextureDescriptors(texture);
+}
+
+void TextureCache::RecreateTextureDescriptors(Texture* texture) {
+  // The old descriptors may still be used by the GPU, so bindless descriptors
+  // are released later, while cached bindful descriptors are only copied when
+  // drawing and can be reused now.
+  if (texture->srv_descriptors.empty()) {
+    return;
+  }
+  std::vector<uint32_t> descriptor_keys;
+  descriptor_keys.reserve(texture->srv_descriptors.size());
+  for (auto descriptor_pair : texture->srv_descriptors) {
+    descriptor_keys.push_back(descriptor_pair.first);
+    if (bindless_resources_used_) {
+      bindless_descriptors_for_release_.emplace_back(
+          descriptor_pair.second, command_processor_.GetCurrentSubmission());
+    } else {
+      srv_descriptor_cache_free_.push_back(descriptor_pair.second);
+    }
+  }
+  texture->srv_descriptors.clear();
+  for (uint32_t descriptor_key : descriptor_keys) {
+    FindOrCreateTextureDescriptor(*texture, (descriptor_key & 1) != 0,
+                                  descriptor_key >> 1);
+  }
+  for (TextureBinding& binding : texture_bindings_) {
+    if (binding.texture == texture &&
+        binding.descriptor_index != UINT32_MAX) {
+      binding.descriptor_index =
+          FindOrCreateTextureDescriptor(*texture, false, binding.host_swizzle);
+    }
+    if (binding.descriptor_index_signed != UINT32_MAX &&
+        (binding.texture_signed == texture ||
+         (binding.texture_signed == nullptr && binding.texture == texture))) {
+      binding.descriptor_index_signed =
+          FindOrCreateTextureDescriptor(*texture, true, binding.host_swizzle);
+    }
+  }
+}
+
+void TextureCache::ProcessDeferredReleases(bool all_submissions_completed) {
+  uint64_t completed_submission = command_processor_.GetCompletedSubmission();
+  while (!resources_for_release_.empty()) {
+    if (!all_submissions_completed &&
+        resources_for_release_.front().second > completed_submission) {
+      break;
+    }
+    resources_for_release_.front().first->Release();
+    resources_for_release_.pop_front();
+  }
+  while (!bindless_descriptors_for_release_.empty()) {
+    if (!all_submissions_completed &&
+        bindless_descriptors_for_release_.front().second >
+            completed_submission) {
+      break;
+    }
+    command_processor_.ReleaseViewBindlessDescriptorImmediately(
+        bindless_descriptors_for_release_.front().first);
+    bindless_descriptors_for_release_.pop_front();
+  }
+}
+
+void TextureCache::DestroyTexture(Texture* texture) {
+  // Remove the texture from the map.
+  auto found_range = textures_.equal_range(texture->key.GetMapKey());
+  for (auto iter = found_range.first; iter != found_range.second; ++iter) {
+    if (iter->second == texture) {
+      textures_.erase(iter);
+      break;
+    }
+  }
+  // Unlink the texture.
+  if (texture->used_previous != nullptr) {
+    texture->used_previous->used_next = texture->used_next;
+  } else {
+    texture_used_first_ = texture->used_next;
+  }
+  if (texture->used_next != nullptr) {
+    texture->used_next->used_previous = texture->used_previous;
+  } else {
+    texture_used_last_ = texture->used_previous;
+  }
+  if (texture->mips_streaming) {
+    auto it = std::find(mip_streaming_textures_.begin(),
+                        mip_streaming_textures_.end(), texture);
+    if (it != mip_streaming_textures_.end()) {
+      mip_streaming_textures_.erase(it);
+    }
+  }
+  // Destroy the texture.
+  shared_memory_.UnwatchMemoryRange(texture->base_watch_handle);
+  shared_memory_.UnwatchMemoryRange(texture->mip_watch_handle);
+  if (bindless_resources_used_) {
+    for (auto descriptor_pair : texture->srv_descriptors) {
+      command_processor_.ReleaseViewBindlessDescriptorImmediately(
+          descriptor_pair.second);
+    }
+  } else {
+    for (auto descriptor_pair : texture->srv_descriptors) {
+      srv_descriptor_cache_free_.push_back(descriptor_pair.second);
+    }
+  }
+  ReleaseTextureResource(texture->resource);
+  delete texture;
+}
+
+bool TextureCache::MakeTextureResourceResident(TextureResource& resource) {
+  if (!resource.evicted) {
+    return true;
+  }
+  ID3D12Pageable* pageable = resource.resource;
+  if (FAILED(command_processor_.GetD3D12Context()
+                 .GetD3D12Provider()
+                 .GetDevice()
+                 ->MakeResident(1, &pageable))) {
+    XELOGE("Failed to make an evicted texture resource resident");
+    return false;
+  }
+  resource.evicted = false;
+  textures_evicted_size_ -= resource.size;
+  COUNT_profile_set("gpu/texture_cache/evicted_size_mb",
+                    uint32_t(textures_evicted_size_ >> 20));
+  return true;
+}
+
+float TextureCache::GetEvictionPriority(const Texture& texture) const {
+  uint64_t unused_time =
+      texture_current_usage_time_ -
+      std::min(texture.last_usage_time, texture_current_usage_time_);
+  // Reloading involves reading the guest data and writing the host data.
+  uint64_t host_size = texture.resource->size;
+  uint64_t reload_cost =
+      uint64_t(texture.base_size) + texture.mip_size + host_size;
+  return float(unused_time + 1) * float(host_size) / float(reload_cost + 1);
+}
+
 bool TextureCache::LoadTextureData(Texture* texture) {
   // See what we need to upload.
   bool base_in_sync, mips_in_sync;
@@ -2068,6 +2392,12 @@ bool TextureCache::LoadTextureData(Texture* texture) {
     base_in_sync = texture->base_in_sync;
     mips_in_sync = texture->mips_in_sync;
   }
+  // The mips of a texture being streamed are loaded later by
+  // StreamTextureMips, and until then, they're not watched, so invalidation of
+  // them doesn't need to be tracked.
+  if (texture->mips_streaming) {
+    mips_in_sync = true;
+  }
   if (base_in_sync && mips_in_sync) {
     return true;
   }
@@ -2090,34 +2420,33 @@ bool TextureCache::LoadTextureData(Texture* texture) {
   }
   const LoadModeInfo& load_mode_info = load_mode_info_[uint32_t(load_mode)];
 
-  // Request uploading of the texture data to the shared memory.
-  // This is also necessary when resolution scale is used - the texture cache
-  // relies on shared memory for invalidation of both unscaled and scaled
-  // textures! Plus a texture may be unscaled partially, when only a portion of
-  // its pages is invalidated, in this case we'll need the texture from the
-  // shared memory to load the unscaled parts.
-  if (!base_in_sync) {
-    if (!shared_memory_.RequestRange(texture->key.base_page << 12,
-                                     texture->base_size)) {
-      return false;
-    }
-  }
-  if (!mips_in_sync) {
-    if (!shared_memory_.RequestRange(texture->key.mip_page << 12,
-                                     texture->mip_size)) {
-      return false;
-    }
+  if (!MakeTextureResourceResident(*texture->resource)) {
+    return false;
   }
-  if (scaled_resolve) {
-    // Make sure all heaps are created.
-    if (!EnsureScaledResolveBufferResident(texture->key.base_page << 12,
-                                           texture->base_size)) {
+
+  // The data in the host resource is about to be modified - if other
+  // deduplicated textures are sharing it, give this texture its own copy,
+  // otherwise make sure no textures loaded later will share it.
+  if (texture->resource->texture_count > 1) {
+    TextureResource* old_resource = texture->resource;
+    TextureResource* new_resource = CreateTextureResource(texture->key);
+    if (new_resource == nullptr) {
       return false;
     }
-    if (!EnsureScaledResolveBufferResident(texture->key.mip_page << 12,
-                                           texture->mip_size)) {
-      return false;
+    if (base_in_sync || mips_in_sync) {
+      // Only partially reloading, keep the data that is still up to date.
+      command_processor_.PushTransitionBarrier(
+          old_resource->resource, old_resource->state,
+          D3D12_RESOURCE_STATE_COPY_SOURCE);
+      old_resource->state = D3D12_RESOURCE_STATE_COPY_SOURCE;
+      command_processor_.SubmitBarriers();
+      command_list.D3DCopyResource(new_resource->resource,
+                                   old_resource->resource);
     }
+    MarkTextureUsed(texture);
+    SetTextureResource(texture, new_resource);
+  } else {
+    RemoveTextureResourceFromContentIndex(texture->resource);
   }
 
   // Get the guest layout.
@@ -2161,7 +2490,8 @@ bool TextureCache::LoadTextureData(Texture* texture) {
   UINT64 host_layout_packed_mips_offset = 0;
   UINT64 host_slice_size = 0;
   {
-    D3D12_RESOURCE_DESC footprint_resource_desc = texture->resource->GetDesc();
+    D3D12_RESOURCE_DESC footprint_resource_desc =
+        texture->resource->resource->GetDesc();
     if (mip_first < mip_packed) {
       host_slice_size = xe::align(
           host_slice_size, UINT64(D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT));
@@ -2205,13 +2535,6 @@ bool TextureCache::LoadTextureData(Texture* texture) {
       }
     }
   }
-  D3D12_RESOURCE_STATES copy_buffer_state =
-      D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
-  ID3D12Resource* copy_buffer = command_processor_.RequestScratchGPUBuffer(
-      uint32_t(host_slice_size), copy_buffer_state);
-  if (copy_buffer == nullptr) {
-    return false;
-  }
   uint32_t host_block_width = 1;
   uint32_t host_block_height = 1;
   if (host_formats_[uint32_t(guest_format)].dxgi_format_block_aligned &&
@@ -2219,215 +2542,16 @@ bool TextureCache::LoadTextureData(Texture* texture) {
     host_block_width = block_width;
     host_block_height = block_height;
   }
-
-  // Begin loading.
-  // Can't address more than 128 megatexels directly on Nvidia - need two
-  // separate UAV descriptors for base and mips.
-  bool separate_base_and_mips_descriptors =
-      scaled_resolve && mip_first == 0 && mip_last != 0;
-  ui::d3d12::util::DescriptorCPUGPUHandlePair descriptor_dest;
-  ui::d3d12::util::DescriptorCPUGPUHandlePair descriptors_source[2];
-  // Destination.
-  uint32_t descriptor_count = 1;
-  if (scaled_resolve) {
-    // Source - base and mips.
-    descriptor_count += separate_base_and_mips_descriptors ? 2 : 1;
-  } else {
-    // Source - shared memory.
-    if (!bindless_resources_used_) {
-      ++descriptor_count;
-    }
-  }
-  ui::d3d12::util::DescriptorCPUGPUHandlePair descriptors[3];
-  if (!command_processor_.RequestOneUseSingleViewDescriptors(descriptor_count,
-                                                             descriptors)) {
-    return false;
-  }
-  uint32_t descriptor_write_index = 0;
-  uint32_t uav_bpe_log2 = scaled_resolve ? load_mode_info.uav_bpe_log2_2x
-                                         : load_mode_info.uav_bpe_log2;
-  assert_true(descriptor_write_index < descriptor_count);
-  descriptor_dest = descriptors[descriptor_write_index++];
-  ui::d3d12::util::CreateBufferTypedUAV(
-      device, descriptor_dest.first, copy_buffer,
-      ui::d3d12::util::GetUintPow2DXGIFormat(uav_bpe_log2),
-      uint32_t(host_slice_size) >> uav_bpe_log2);
-  if (scaled_resolve) {
-    // TODO(Triang3l): Allow partial invalidation of scaled textures - send a
-    // part of scaled_resolve_pages_ to the shader and choose the source
-    // according to whether a specific page contains scaled texture data. If
-    // it's not, duplicate the texels from the unscaled version - will be
-    // blocky with filtering, but better than nothing.
-    UseScaledResolveBufferForReading();
-    uint32_t descriptor_source_write_index = 0;
-    if (mip_first == 0) {
-      assert_true(descriptor_write_index < descriptor_count);
-      descriptors_source[descriptor_source_write_index] =
-          descriptors[descriptor_write_index++];
-      ui::d3d12::util::CreateBufferTypedSRV(
-          device, descriptors_source[descriptor_source_write_index++].first,
-          scaled_resolve_buffer_,
-          ui::d3d12::util::GetUintPow2DXGIFormat(
-              load_mode_info.srv_bpe_log2_2x),
-          texture->base_size << 2 >> load_mode_info.srv_bpe_log2_2x,
-          uint64_t(texture->key.base_page) << (12 + 2) >>
-              load_mode_info.srv_bpe_log2_2x);
-    }
-    if (mip_last != 0) {
-      assert_true(descriptor_write_index < descriptor_count);
-      descriptors_source[descriptor_source_write_index] =
-          descriptors[descriptor_write_index++];
-      ui::d3d12::util::CreateBufferTypedSRV(
-          device, descriptors_source[descriptor_source_write_index++].first,
-          scaled_resolve_buffer_,
-          ui::d3d12::util::GetUintPow2DXGIFormat(
-              load_mode_info.srv_bpe_log2_2x),
-          texture->mip_size << 2 >> load_mode_info.srv_bpe_log2_2x,
-          uint64_t(texture->key.mip_page) << (12 + 2) >>
-              load_mode_info.srv_bpe_log2_2x);
-    }
-  } else {
-    shared_memory_.UseForReading();
-    if (bindless_resources_used_) {
-      descriptors_source[0] =
-          command_processor_.GetSharedMemoryUintPow2BindlessSRVHandlePair(
-              load_mode_info.srv_bpe_log2);
-    } else {
-      assert_true(descriptor_write_index < descriptor_count);
-      descriptors_source[0] = descriptors[descriptor_write_index++];
-      shared_memory_.WriteUintPow2SRVDescriptor(descriptors_source[0].first,
-                                                load_mode_info.srv_bpe_log2);
-    }
-  }
-  command_processor_.SetComputePipelineState(pipeline_state);
-  command_list.D3DSetComputeRootSignature(load_root_signature_);
-  command_list.D3DSetComputeRootDescriptorTable(2, descriptor_dest.second);
-
-  // Update LRU caching because the texture will be used by the command list.
-  MarkTextureUsed(texture);
-
-  // Submit commands.
-  command_processor_.PushTransitionBarrier(texture->resource, texture->state,
-                                           D3D12_RESOURCE_STATE_COPY_DEST);
-  texture->state = D3D12_RESOURCE_STATE_COPY_DEST;
-  auto& cbuffer_pool = command_processor_.GetConstantBufferPool();
-  LoadConstants load_constants;
-  load_constants.is_3d_endian =
-      uint32_t(is_3d) | (uint32_t(texture->key.endianness) << 1);
-  uint32_t loop_mip_first = std::min(mip_first, mip_packed);
-  uint32_t loop_mip_last = std::min(mip_last, mip_packed);
-  if (host_layout_packed_mips_offset) {
-    assert_zero(mip_packed);
-    // Need to load two different packed mip tails for the base and the mips.
-    // loop_mip == 0 - packed base.
-    // loop_mip == 1 - packed mips.
-    loop_mip_last = 1;
-  }
-  uint32_t descriptor_source_last_index = UINT32_MAX;
-  for (uint32_t slice = 0; slice < slice_count; ++slice) {
-    command_processor_.PushTransitionBarrier(
-        copy_buffer, copy_buffer_state, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-    copy_buffer_state = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
-    for (uint32_t loop_mip = loop_mip_first; loop_mip <= loop_mip_last;
-         ++loop_mip) {
-      // If need to load two different packed mip tails, there will be two
-      // iterations of the loop, but both images will have the size of mip 0.
-      uint32_t mip = (mip_packed != 0 ? loop_mip : 0);
-      bool is_base;
-      if (mip_packed == 0) {
-        is_base = (mip_first == 0 && loop_mip == 0);
-      } else {
-        is_base = (mip == 0);
-      }
-      uint32_t descriptor_source_index = 0;
-      if (scaled_resolve) {
-        // Offset already applied in the buffer because more than 512 MB can't
-        // be directly addresses on Nvidia.
-        load_constants.guest_base = 0;
-        if (separate_base_and_mips_descriptors) {
-          descriptor_source_index = is_base ? 0 : 1;
-        }
-      } else {
-        load_constants.guest_base =
-            (is_base ? texture->key.base_page : texture->key.mip_page) << 12;
-      }
-      load_constants.guest_base +=
-          texture->mip_offsets[mip] + slice * texture->slice_sizes[mip];
-      const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& host_layout =
-          mip == mip_packed ? host_layout_packed
-                            : host_layouts[mip - mip_first];
-      load_constants.guest_pitch = texture->key.tiled
-                                       ? LoadConstants::kGuestPitchTiled
-                                       : texture->pitches[mip];
-      load_constants.host_base = uint32_t(host_layout.Offset);
-      if (mip_packed == 0 && loop_mip) {
-        // Two packed mip tails, but this one is for the mips.
-        load_constants.host_base += uint32_t(host_layout_packed_mips_offset);
-      }
-      load_constants.host_pitch = host_layout.Footprint.RowPitch;
-      uint32_t mip_width, mip_height, mip_depth;
-      if (mip == mip_packed) {
-        // Force power of 2 for both the source and the destination if it's the
-        // mip tail, and it's not on level 0.
-        mip_width = mip_packed_width;
-        mip_height = mip_packed_height;
-        mip_depth = mip_packed_depth;
-      } else {
-        mip_width = std::max(width >> mip, uint32_t(1));
-        mip_height = std::max(height >> mip, uint32_t(1));
-        mip_depth = std::max(depth >> mip, uint32_t(1));
-      }
-      load_constants.size_blocks[0] =
-          (mip_width + (block_width - 1)) / block_width;
-      load_constants.size_blocks[1] =
-          (mip_height + (block_height - 1)) / block_height;
-      load_constants.size_blocks[2] = mip_depth;
-      load_constants.height_texels = mip_height;
-      if (mip == 0) {
-        load_constants.guest_storage_width_height[0] =
-            xe::align(load_constants.size_blocks[0], uint32_t(32));
-        load_constants.guest_storage_width_height[1] =
-            xe::align(load_constants.size_blocks[1], uint32_t(32));
-      } else {
-        load_constants.guest_storage_width_height[0] = xe::align(
-            xe::next_pow2(load_constants.size_blocks[0]), uint32_t(32));
-        load_constants.guest_storage_width_height[1] = xe::align(
-            xe::next_pow2(load_constants.size_blocks[1]), uint32_t(32));
-      }
-      D3D12_GPU_VIRTUAL_ADDRESS cbuffer_gpu_address;
-      uint8_t* cbuffer_mapping = cbuffer_pool.Request(
-          command_processor_.GetCurrentFrame(), sizeof(load_constants),
-          D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, nullptr, nullptr,
-          &cbuffer_gpu_address);
-      if (cbuffer_mapping == nullptr) {
-        command_processor_.ReleaseScratchGPUBuffer(copy_buffer,
-                                                   copy_buffer_state);
-        return false;
-      }
-      std::memcpy(cbuffer_mapping, &load_constants, sizeof(load_constants));
-      if (descriptor_source_last_index != descriptor_source_index) {
-        descriptor_source_last_index = descriptor_source_index;
-        command_list.D3DSetComputeRootDescriptorTable(
-            1, descriptors_source[descriptor_source_index].second);
-      }
-      command_list.D3DSetComputeRootConstantBufferView(0, cbuffer_gpu_address);
-      command_processor_.SubmitBarriers();
-      // Each thread group processes 32x32x1 guest blocks.
-      command_list.D3DDispatch((load_constants.size_blocks[0] + 31) >> 5,
-                               (load_constants.size_blocks[1] + 31) >> 5,
-                               load_constants.size_blocks[2]);
-    }
-    command_processor_.PushUAVBarrier(copy_buffer);
-    command_processor_.PushTransitionBarrier(copy_buffer, copy_buffer_state,
-                                             D3D12_RESOURCE_STATE_COPY_SOURCE);
-    copy_buffer_state = D3D12_RESOURCE_STATE_COPY_SOURCE;
-    command_processor_.SubmitBarriers();
+  // Copies the host layout data of an array slice to the texture from a buffer
+  // in the copy source state.
+  auto copy_slice_to_texture = [&](ID3D12Resource* source,
+                                   UINT64 source_offset, uint32_t slice) {
     UINT slice_first_subresource = slice * texture_mip_count;
     for (uint32_t mip = mip_first; mip <= mip_last; ++mip) {
       D3D12_TEXTURE_COPY_LOCATION location_source, location_dest;
-      location_source.pResource = copy_buffer;
+      location_source.pResource = source;
       location_source.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
-      location_dest.pResource = texture->resource;
+      location_dest.pResource = texture->resource->resource;
       location_dest.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
       location_dest.SubresourceIndex = slice_first_subresource + mip;
       if (mip >= mip_packed) {
@@ -2452,16 +2576,376 @@ bool TextureCache::LoadTextureData(Texture* texture) {
             xe::align(std::max(height >> mip, uint32_t(1)), host_block_height);
         source_box.back =
             source_box.front + std::max(depth >> mip, uint32_t(1));
+        location_source.PlacedFootprint.Offset += source_offset;
         command_list.CopyTextureRegion(location_dest, 0, 0, 0, location_source,
                                        source_box);
       } else {
         location_source.PlacedFootprint = host_layouts[mip - mip_first];
+        location_source.PlacedFootprint.Offset += source_offset;
         command_list.CopyTexture(location_dest, location_source);
       }
     }
+  };
+
+  // Only textures loaded fully from the guest memory can be deduplicated or
+  // cached on disk - not those containing GPU-written data (which is only in
+  // the shared memory) or scaled resolves.
+  bool guest_data_hashable =
+      !scaled_resolve && !texture->mips_streaming &&
+      (!base_in_sync || !texture->base_size) &&
+      (!mips_in_sync || !texture->mip_size) &&
+      !shared_memory_.IsRangeWrittenByGPU(texture->key.base_page << 12,
+                                          texture->base_size) &&
+      !shared_memory_.IsRangeWrittenByGPU(texture->key.mip_page << 12,
+                                          texture->mip_size);
+  bool deduplicate = guest_data_hashable && cvars::d3d12_texture_deduplication;
+  bool disk_cache_used =
+      guest_data_hashable && !cvars::d3d12_texture_disk_cache_path.empty();
+  xe::hash::Hash128 guest_data_hash = {};
+  xe::hash::Hash128 content_key = {};
+  TextureResource* duplicate_resource = nullptr;
+  if (deduplicate || disk_cache_used) {
+    // Enable invalidation before hashing, so CPU writes done after the guest
+    // data has been hashed still invalidate the texture even if it's not
+    // uploaded to the shared memory.
+    shared_memory_.WatchRangeForInvalidation(texture->key.base_page << 12,
+                                             texture->base_size);
+    shared_memory_.WatchRangeForInvalidation(texture->key.mip_page << 12,
+                                             texture->mip_size);
+    guest_data_hash = HashGuestData(*texture);
+    if (deduplicate) {
+      content_key = GetContentKey(texture->key, guest_data_hash);
+      auto it = resources_by_content_.find(content_key);
+      if (it != resources_by_content_.end()) {
+        duplicate_resource = it->second;
+      }
+    }
+  }
+
+  // Try to load the converted data from the disk cache.
+  UINT64 disk_cache_slice_stride = xe::align(
+      host_slice_size, UINT64(D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT));
+  UINT64 disk_cache_data_size = disk_cache_slice_stride * slice_count;
+  DiskCacheFileHeader disk_cache_header;
+  ID3D12Resource* disk_cache_upload_buffer = nullptr;
+  if (disk_cache_used && duplicate_resource == nullptr) {
+    MakeDiskCacheFileHeader(*texture, slice_count, host_slice_size,
+                            guest_data_hash, disk_cache_header);
+    disk_cache_upload_buffer = LoadDiskCacheFile(disk_cache_header);
+  }
+
+  if (duplicate_resource != nullptr) {
+    // Share the resource of a texture with the same data.
+    MarkTextureUsed(texture);
+    SetTextureResource(texture, duplicate_resource);
+  } else if (disk_cache_upload_buffer != nullptr) {
+    MarkTextureUsed(texture);
+    command_processor_.PushTransitionBarrier(texture->resource->resource,
+                                             texture->resource->state,
+                                             D3D12_RESOURCE_STATE_COPY_DEST);
+    texture->resource->state = D3D12_RESOURCE_STATE_COPY_DEST;
+    command_processor_.SubmitBarriers();
+    for (uint32_t slice = 0; slice < slice_count; ++slice) {
+      copy_slice_to_texture(disk_cache_upload_buffer,
+                            slice * disk_cache_slice_stride, slice);
+    }
+    resources_for_release_.emplace_back(
+        disk_cache_upload_buffer, command_processor_.GetCurrentSubmission());
+  } else {
+    // Request uploading of the texture data to the shared memory.
+    // This is also necessary when resolution scale is used - the texture
+    // cache relies on shared memory for invalidation of both unscaled and
+    // scaled textures! Plus a texture may be unscaled partially, when only a
+    // portion of its pages is invalidated, in this case we'll need the texture
+    // from the shared memory to load the unscaled parts.
+    if (!base_in_sync) {
+      if (!shared_memory_.RequestRange(texture->key.base_page << 12,
+                                       texture->base_size)) {
+        return false;
+      }
+    }
+    if (!mips_in_sync) {
+      if (!shared_memory_.RequestRange(texture->key.mip_page << 12,
+                                       texture->mip_size)) {
+        return false;
+      }
+    }
+    if (scaled_resolve) {
+      // Make sure all heaps are created.
+      if (!EnsureScaledResolveBufferResident(texture->key.base_page << 12,
+                                             texture->base_size)) {
+        return false;
+      }
+      if (!EnsureScaledResolveBufferResident(texture->key.mip_page << 12,
+                                             texture->mip_size)) {
+        return false;
+      }
+    }
+
+    D3D12_RESOURCE_STATES copy_buffer_state =
+        D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+    ID3D12Resource* copy_buffer = command_processor_.RequestScratchGPUBuffer(
+        uint32_t(host_slice_size), copy_buffer_state);
+    if (copy_buffer == nullptr) {
+      return false;
+    }
+    // If the texture can be cached on disk, also download the converted data of
+    // all the slices to write it to the file once it's ready. The buffer is
+    // queued right away to be released safely if loading fails midway, and the
+    // file path is only set if loading succeeds.
+    ID3D12Resource* disk_cache_readback_buffer = nullptr;
+    if (disk_cache_used) {
+      auto& provider = command_processor_.GetD3D12Context().GetD3D12Provider();
+      D3D12_RESOURCE_DESC readback_buffer_desc;
+      ui::d3d12::util::FillBufferResourceDesc(readback_buffer_desc,
+                                              disk_cache_data_size,
+                                              D3D12_RESOURCE_FLAG_NONE);
+      if (SUCCEEDED(device->CreateCommittedResource(
+              &ui::d3d12::util::kHeapPropertiesReadback,
+              provider.GetHeapFlagCreateNotZeroed(), &readback_buffer_desc,
+              D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
+              IID_PPV_ARGS(&disk_cache_readback_buffer)))) {
+        DiskCacheTransfer& transfer = disk_cache_transfers_.emplace_back();
+        transfer.buffer = disk_cache_readback_buffer;
+        transfer.submission = command_processor_.GetCurrentSubmission();
+        transfer.header = disk_cache_header;
+      } else {
+        XELOGE(
+            "Texture cache: Failed to create a {} KB buffer for downloading a "
+            "texture to the disk cache",
+            disk_cache_data_size >> 10);
+        disk_cache_readback_buffer = nullptr;
+      }
+    }
+
+    // Begin loading.
+    // Can't address more than 128 megatexels directly on Nvidia - need two
+    // separate UAV descriptors for base and mips.
+    bool separate_base_and_mips_descriptors =
+        scaled_resolve && mip_first == 0 && mip_last != 0;
+    ui::d3d12::util::DescriptorCPUGPUHandlePair descriptor_dest;
+    ui::d3d12::util::DescriptorCPUGPUHandlePair descriptors_source[2];
+    // Destination.
+    uint32_t descriptor_count = 1;
+    if (scaled_resolve) {
+      // Source - base and mips.
+      descriptor_count += separate_base_and_mips_descriptors ? 2 : 1;
+    } else {
+      // Source - shared memory.
+      if (!bindless_resources_used_) {
+        ++descriptor_count;
+      }
+    }
+    ui::d3d12::util::DescriptorCPUGPUHandlePair descriptors[3];
+    if (!command_processor_.RequestOneUseSingleViewDescriptors(descriptor_count,
+                                                               descriptors)) {
+      return false;
+    }
+    uint32_t descriptor_write_index = 0;
+    uint32_t uav_bpe_log2 = scaled_resolve ? load_mode_info.uav_bpe_log2_2x
+                                           : load_mode_info.uav_bpe_log2;
+    assert_true(descriptor_write_index < descriptor_count);
+    descriptor_dest = descriptors[descriptor_write_index++];
+    ui::d3d12::util::CreateBufferTypedUAV(
+        device, descriptor_dest.first, copy_buffer,
+        ui::d3d12::util::GetUintPow2DXGIFormat(uav_bpe_log2),
+        uint32_t(host_slice_size) >> uav_bpe_log2);
+    if (scaled_resolve) {
+      // TODO(Triang3l): Allow partial invalidation of scaled textures - send a
+      // part of scaled_resolve_pages_ to the shader and choose the source
+      // according to whether a specific page contains scaled texture data. If
+      // it's not, duplicate the texels from the unscaled version - will be
+      // blocky with filtering, but better than nothing.
+      UseScaledResolveBufferForReading();
+      uint32_t descriptor_source_write_index = 0;
+      if (mip_first == 0) {
+        assert_true(descriptor_write_index < descriptor_count);
+        descriptors_source[descriptor_source_write_index] =
+            descriptors[descriptor_write_index++];
+        ui::d3d12::util::CreateBufferTypedSRV(
+            device, descriptors_source[descriptor_source_write_index++].first,
+            scaled_resolve_buffer_,
+            ui::d3d12::util::GetUintPow2DXGIFormat(
+                load_mode_info.srv_bpe_log2_2x),
+            texture->base_size << 2 >> load_mode_info.srv_bpe_log2_2x,
+            uint64_t(texture->key.base_page) << (12 + 2) >>
+                load_mode_info.srv_bpe_log2_2x);
+      }
+      if (mip_last != 0) {
+        assert_true(descriptor_write_index < descriptor_count);
+        descriptors_source[descriptor_source_write_index] =
+            descriptors[descriptor_write_index++];
+        ui::d3d12::util::CreateBufferTypedSRV(
+            device, descriptors_source[descriptor_source_write_index++].first,
+            scaled_resolve_buffer_,
+            ui::d3d12::util::GetUintPow2DXGIFormat(
+                load_mode_info.srv_bpe_log2_2x),
+            texture->mip_size << 2 >> load_mode_info.srv_bpe_log2_2x,
+            uint64_t(texture->key.mip_page) << (12 + 2) >>
+                load_mode_info.srv_bpe_log2_2x);
+      }
+    } else {
+      shared_memory_.UseForReading();
+      if (bindless_resources_used_) {
+        descriptors_source[0] =
+            command_processor_.GetSharedMemoryUintPow2BindlessSRVHandlePair(
+                load_mode_info.srv_bpe_log2);
+      } else {
+        assert_true(descriptor_write_index < descriptor_count);
+        descriptors_source[0] = descriptors[descriptor_write_index++];
+        shared_memory_.WriteUintPow2SRVDescriptor(descriptors_source[0].first,
+                                                  load_mode_info.srv_bpe_log2);
+      }
+    }
+    command_processor_.SetComputePipelineState(pipeline_state);
+    command_list.D3DSetComputeRootSignature(load_root_signature_);
+    command_list.D3DSetComputeRootDescriptorTable(2, descriptor_dest.second);
+
+    // Update LRU caching because the texture will be used by the command list.
+    MarkTextureUsed(texture);
+
+    // Submit commands.
+    command_processor_.PushTransitionBarrier(texture->resource->resource,
+                                             texture->resource->state,
+                                             D3D12_RESOURCE_STATE_COPY_DEST);
+    texture->resource->state = D3D12_RESOURCE_STATE_COPY_DEST;
+    auto& cbuffer_pool = command_processor_.GetConstantBufferPool();
+    LoadConstants load_constants;
+    load_constants.is_3d_endian =
+        uint32_t(is_3d) | (uint32_t(texture->key.endianness) << 1);
+    uint32_t loop_mip_first = std::min(mip_first, mip_packed);
+    uint32_t loop_mip_last = std::min(mip_last, mip_packed);
+    if (host_layout_packed_mips_offset) {
+      assert_zero(mip_packed);
+      // Need to load two different packed mip tails for the base and the mips.
+      // loop_mip == 0 - packed base.
+      // loop_mip == 1 - packed mips.
+      loop_mip_last = 1;
+    }
+    uint32_t descriptor_source_last_index = UINT32_MAX;
+    for (uint32_t slice = 0; slice < slice_count; ++slice) {
+      command_processor_.PushTransitionBarrier(
+          copy_buffer, copy_buffer_state,
+          D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+      copy_buffer_state = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+      for (uint32_t loop_mip = loop_mip_first; loop_mip <= loop_mip_last;
+           ++loop_mip) {
+        // If need to load two different packed mip tails, there will be two
+        // iterations of the loop, but both images will have the size of mip 0.
+        uint32_t mip = (mip_packed != 0 ? loop_mip : 0);
+        bool is_base;
+        if (mip_packed == 0) {
+          is_base = (mip_first == 0 && loop_mip == 0);
+        } else {
+          is_base = (mip == 0);
+        }
+        uint32_t descriptor_source_index = 0;
+        if (scaled_resolve) {
+          // Offset already applied in the buffer because more than 512 MB can't
+          // be directly addresses on Nvidia.
+          load_constants.guest_base = 0;
+          if (separate_base_and_mips_descriptors) {
+            descriptor_source_index = is_base ? 0 : 1;
+          }
+        } else {
+          load_constants.guest_base =
+              (is_base ? texture->key.base_page : texture->key.mip_page) << 12;
+        }
+        load_constants.guest_base +=
+            texture->mip_offsets[mip] + slice * texture->slice_sizes[mip];
+        const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& host_layout =
+            mip == mip_packed ? host_layout_packed
+                              : host_layouts[mip - mip_first];
+        load_constants.guest_pitch = texture->key.tiled
+                                         ? LoadConstants::kGuestPitchTiled
+                                         : texture->pitches[mip];
+        load_constants.host_base = uint32_t(host_layout.Offset);
+        if (mip_packed == 0 && loop_mip) {
+          // Two packed mip tails, but this one is for the mips.
+          load_constants.host_base += uint32_t(host_layout_packed_mips_offset);
+        }
+        load_constants.host_pitch = host_layout.Footprint.RowPitch;
+        uint32_t mip_width, mip_height, mip_depth;
+        if (mip == mip_packed) {
+          // Force power of 2 for both the source and the destination if it's
+          // the mip tail, and it's not on level 0.
+          mip_width = mip_packed_width;
+          mip_height = mip_packed_height;
+          mip_depth = mip_packed_depth;
+        } else {
+          mip_width = std::max(width >> mip, uint32_t(1));
+          mip_height = std::max(height >> mip, uint32_t(1));
+          mip_depth = std::max(depth >> mip, uint32_t(1));
+        }
+        load_constants.size_blocks[0] =
+            (mip_width + (block_width - 1)) / block_width;
+        load_constants.size_blocks[1] =
+            (mip_height + (block_height - 1)) / block_height;
+        load_constants.size_blocks[2] = mip_depth;
+        load_constants.height_texels = mip_height;
+        if (mip == 0) {
+          load_constants.guest_storage_width_height[0] =
+              xe::align(load_constants.size_blocks[0], uint32_t(32));
+          load_constants.guest_storage_width_height[1] =
+              xe::align(load_constants.size_blocks[1], uint32_t(32));
+        } else {
+          load_constants.guest_storage_width_height[0] = xe::align(
+              xe::next_pow2(load_constants.size_blocks[0]), uint32_t(32));
+          load_constants.guest_storage_width_height[1] = xe::align(
+              xe::next_pow2(load_constants.size_blocks[1]), uint32_t(32));
+        }
+        D3D12_GPU_VIRTUAL_ADDRESS cbuffer_gpu_address;
+        uint8_t* cbuffer_mapping = cbuffer_pool.Request(
+            command_processor_.GetCurrentFrame(), sizeof(load_constants),
+            D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, nullptr, nullptr,
+            &cbuffer_gpu_address);
+        if (cbuffer_mapping == nullptr) {
+          command_processor_.ReleaseScratchGPUBuffer(copy_buffer,
+                                                     copy_buffer_state);
+          return false;
+        }
+        std::memcpy(cbuffer_mapping, &load_constants, sizeof(load_constants));
+        if (descriptor_source_last_index != descriptor_source_index) {
+          descriptor_source_last_index = descriptor_source_index;
+          command_list.D3DSetComputeRootDescriptorTable(
+              1, descriptors_source[descriptor_source_index].second);
+        }
+        command_list.D3DSetComputeRootConstantBufferView(0,
+                                                         cbuffer_gpu_address);
+        command_processor_.SubmitBarriers();
+        // Each thread group processes 32x32x1 guest blocks.
+        command_processor_.BeginGpuTiming(GpuTimingCategory::kTextureLoad);
+        command_list.D3DDispatch((load_constants.size_blocks[0] + 31) >> 5,
+                                 (load_constants.size_blocks[1] + 31) >> 5,
+                                 load_constants.size_blocks[2]);
+        command_processor_.EndGpuTiming();
+      }
+      command_processor_.PushUAVBarrier(copy_buffer);
+      command_processor_.PushTransitionBarrier(
+          copy_buffer, copy_buffer_state, D3D12_RESOURCE_STATE_COPY_SOURCE);
+      copy_buffer_state = D3D12_RESOURCE_STATE_COPY_SOURCE;
+      command_processor_.SubmitBarriers();
+      copy_slice_to_texture(copy_buffer, 0, slice);
+      if (disk_cache_readback_buffer != nullptr) {
+        command_list.D3DCopyBufferRegion(disk_cache_readback_buffer,
+                                         slice * disk_cache_slice_stride,
+                                         copy_buffer, 0, host_slice_size);
+      }
+    }
+
+    command_processor_.ReleaseScratchGPUBuffer(copy_buffer, copy_buffer_state);
+    if (disk_cache_readback_buffer != nullptr) {
+      disk_cache_transfers_.back().path =
+          GetDiskCacheFilePath(disk_cache_header);
+    }
   }
 
-  command_processor_.ReleaseScratchGPUBuffer(copy_buffer, copy_buffer_state);
+  // Let textures with the same data loaded later share the resource.
+  if (deduplicate && duplicate_resource == nullptr) {
+    texture->resource->content_key = content_key;
+    texture->resource->content_indexed = true;
+    resources_by_content_.emplace(content_key, texture->resource);
+  }
 
   // Mark the ranges as uploaded and watch them. This is needed for scaled
   // resolves as well to detect when the CPU wants to reuse the memory for a
@@ -2470,7 +2954,9 @@ bool TextureCache::LoadTextureData(Texture* texture) {
   {
     auto global_lock = global_critical_region_.Acquire();
     texture->base_in_sync = true;
-    texture->mips_in_sync = true;
+    if (!texture->mips_streaming) {
+      texture->mips_in_sync = true;
+    }
     if (!base_in_sync) {
       texture->base_watch_handle = shared_memory_.WatchMemoryRange(
           texture->key.base_page << 12, texture->base_size, WatchCallbackThunk,
@@ -2483,10 +2969,183 @@ bool TextureCache::LoadTextureData(Texture* texture) {
     }
   }
 
+  command_processor_.benchmark_counters().CountTextureUpload(
+      uint64_t(base_in_sync ? 0 : texture->base_size) +
+      (mips_in_sync ? 0 : texture->mip_size));
+
   LogTextureAction(texture, "Loaded");
   return true;
 }
 
+void TextureCache::StreamTextureMips() {
+  uint64_t budget =
+      uint64_t(std::max(cvars::d3d12_texture_mip_streaming_budget, 0)) << 20;
+  uint64_t loaded_size = 0;
+  size_t texture_count = mip_streaming_textures_.size();
+  for (size_t i = 0; i < texture_count; ++i) {
+    if (i && loaded_size >= budget) {
+      break;
+    }
+    Texture* texture = mip_streaming_textures_.front();
+    mip_streaming_textures_.pop_front();
+    assert_true(texture->mips_streaming);
+    texture->mips_streaming = false;
+    // If the base has been invalidated meanwhile, it's reloaded too.
+    if (!LoadTextureData(texture)) {
+      // Keep sampling only the base, and retry later.
+      texture->mips_streaming = true;
+      mip_streaming_textures_.push_back(texture);
+      continue;
+    }
+    loaded_size += texture->mip_size;
+    // Expose all the mips in the descriptors, and give the resource a new UID
+    // so bindings using it are updated.
+    texture->resource->uid = texture_resource_next_uid_++;
+    RecreateTextureDescriptors(texture);
+  }
+}
+
+xe::hash::Hash128 TextureCache::HashGuestData(const Texture& texture) const {
+  const Memory& memory = shared_memory_.memory();
+  xe::hash::StreamingHash128 hash;
+  if (texture.base_size) {
+    hash.Update(memory.TranslatePhysical(texture.key.base_page << 12),
+                texture.base_size);
+  }
+  if (texture.mip_size) {
+    hash.Update(memory.TranslatePhysical(texture.key.mip_page << 12),
+                texture.mip_size);
+  }
+  return hash.Digest();
+}
+
+xe::hash::Hash128 TextureCache::GetContentKey(
+    TextureKey key, const xe::hash::Hash128& guest_data_hash) {
+  // Only whether the base and the mips are present matters for the host data.
+  key.base_page = key.base_page ? 1 : 0;
+  key.mip_page = key.mip_page ? 1 : 0;
+  struct {
+    uint32_t map_key[2];
+    uint32_t bucket_key;
+    uint32_t padding;
+    xe::hash::Hash128 guest_data_hash;
+  } content;
+  content.map_key[0] = key.map_key[0];
+  content.map_key[1] = key.map_key[1];
+  content.bucket_key = key.bucket_key;
+  content.padding = 0;
+  content.guest_data_hash = guest_data_hash;
+  return xe::hash::ContentHash128(&content, sizeof(content));
+}
+
+void TextureCache::MakeDiskCacheFileHeader(
+    const Texture& texture, uint32_t slice_count, uint64_t slice_size,
+    const xe::hash::Hash128& guest_data_hash,
+    DiskCacheFileHeader& header_out) const {
+  header_out.magic = DiskCacheFileHeader::kMagic;
+  header_out.version = DiskCacheFileHeader::kVersion;
+  header_out.map_key[0] = texture.key.map_key[0];
+  header_out.map_key[1] = texture.key.map_key[1];
+  header_out.bucket_key = texture.key.bucket_key;
+  header_out.slice_count = slice_count;
+  header_out.slice_size = slice_size;
+  header_out.data_hash = guest_data_hash;
+}
+
+std::filesystem::path TextureCache::GetDiskCacheFilePath(
+    const DiskCacheFileHeader& header) {
+  return cvars::d3d12_texture_disk_cache_path /
+         fmt::format("{:016X}{:016X}_{:08X}{:08X}{:08X}.xtex",
+                     header.data_hash.high, header.data_hash.low,
+                     header.map_key[1], header.map_key[0], header.bucket_key);
+}
+
+ID3D12Resource* TextureCache::LoadDiskCacheFile(
+    const DiskCacheFileHeader& header) {
+  FILE* file = xe::filesystem::OpenFile(GetDiskCacheFilePath(header), "rb");
+  if (!file) {
+    return nullptr;
+  }
+  // The header contains no padding, so it can be compared as a whole.
+  DiskCacheFileHeader file_header;
+  if (std::fread(&file_header, sizeof(file_header), 1, file) != 1 ||
+      std::memcmp(&file_header, &header, sizeof(header))) {
+    std::fclose(file);
+    return nullptr;
+  }
+  UINT64 data_size =
+      xe::align(header.slice_size,
+                uint64_t(D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT)) *
+      header.slice_count;
+  auto& provider = command_processor_.GetD3D12Context().GetD3D12Provider();
+  auto device = provider.GetDevice();
+  D3D12_RESOURCE_DESC buffer_desc;
+  ui::d3d12::util::FillBufferResourceDesc(buffer_desc, data_size,
+                                          D3D12_RESOURCE_FLAG_NONE);
+  ID3D12Resource* buffer;
+  if (FAILED(device->CreateCommittedResource(
+          &ui::d3d12::util::kHeapPropertiesUpload,
+          provider.GetHeapFlagCreateNotZeroed(), &buffer_desc,
+          D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&buffer)))) {
+    XELOGE(
+        "Texture cache: Failed to create a {} KB buffer for uploading a "
+        "texture from the disk cache",
+        data_size >> 10);
+    std::fclose(file);
+    return nullptr;
+  }
+  bool data_read = false;
+  D3D12_RANGE read_range = {};
+  void* mapping;
+  if (SUCCEEDED(buffer->Map(0, &read_range, &mapping))) {
+    data_read = std::fread(mapping, 1, size_t(data_size), file) == data_size;
+    buffer->Unmap(0, nullptr);
+  }
+  std::fclose(file);
+  if (!data_read) {
+    buffer->Release();
+    return nullptr;
+  }
+  return buffer;
+}
+
+void TextureCache::ProcessDiskCacheTransfers(bool all_submissions_completed) {
+  uint64_t completed_submission = command_processor_.GetCompletedSubmission();
+  while (!disk_cache_transfers_.empty()) {
+    DiskCacheTransfer& transfer = disk_cache_transfers_.front();
+    if (!all_submissions_completed &&
+        transfer.submission > completed_submission) {
+      break;
+    }
+    if (!transfer.path.empty()) {
+      size_t data_size =
+          size_t(xe::align(transfer.header.slice_size,
+                           uint64_t(D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT)) *
+                 transfer.header.slice_count);
+      D3D12_RANGE read_range;
+      read_range.Begin = 0;
+      read_range.End = data_size;
+      void* mapping;
+      if (SUCCEEDED(transfer.buffer->Map(0, &read_range, &mapping))) {
+        xe::filesystem::CreateParentFolder(transfer.path);
+        FILE* file = xe::filesystem::OpenFile(transfer.path, "wb");
+        if (file) {
+          std::fwrite(&transfer.header, sizeof(transfer.header), 1, file);
+          std::fwrite(mapping, 1, data_size, file);
+          std::fclose(file);
+        } else {
+          XELOGE("Texture cache: Failed to create the disk cache file {}",
+                 xe::path_to_utf8(transfer.path));
+        }
+        D3D12_RANGE written_range = {};
+        transfer.buffer->Unmap(0, &written_range);
+      }
+    }
+    transfer.buffer->Release();
+    disk_cache_transfers_.pop_front();
+  }
+}
+
 uint32_t TextureCache::FindOrCreateTextureDescriptor(Texture& texture,
                                                      bool is_signed,
                                                      uint32_t host_swizzle) {
@@ -2520,7 +3179,9 @@ uint32_t TextureCache::FindOrCreateTextureDescriptor(Texture& texture,
     return UINT32_MAX;
   }
 
-  uint32_t mip_levels = texture.key.mip_max_level + 1;
+  // Only the base is loaded while the mips are being streamed.
+  uint32_t mip_levels =
+      texture.mips_streaming ? 1 : texture.key.mip_max_level + 1;
   switch (texture.key.dimension) {
     case xenos::DataDimension::k1D:
     case xenos::DataDimension::k2DOrStacked:
@@ -2599,7 +3260,8 @@ uint32_t TextureCache::FindOrCreateTextureDescriptor(Texture& texture,
     }
   }
   device->CreateShaderResourceView(
-      texture.resource, &desc, GetTextureDescriptorCPUHandle(descriptor_index));
+      texture.resource->resource, &desc,
+      GetTextureDescriptorCPUHandle(descriptor_index));
   texture.srv_descriptors.insert({descriptor_key, descriptor_index});
   return descriptor_index;
 }
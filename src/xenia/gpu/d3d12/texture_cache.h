@@ -12,9 +12,12 @@
 
 #include <atomic>
 #include <cstring>
+#include <deque>
+#include <filesystem>
 #include <unordered_map>
 #include <utility>
 
+#include "xenia/base/hash.h"
 #include "xenia/base/mutex.h"
 #include "xenia/gpu/d3d12/d3d12_shader.h"
 #include "xenia/gpu/d3d12/shared_memory.h"
@@ -129,6 +132,10 @@ class TextureCache {
   // shader bindings are up to date.
   struct TextureSRVKey {
     TextureKey key;
+    // Host resources may be replaced without changing the key when texture
+    // deduplication is enabled.
+    uint64_t resource_uid;
+    uint64_t resource_uid_signed;
     uint32_t host_swizzle;
     uint8_t swizzled_signs;
   };
@@ -338,11 +345,28 @@ class TextureCache {
     uint8_t swizzle[4];
   };
 
-  struct Texture {
-    TextureKey key;
+  // Host resource of a texture, shared by textures with identical guest data
+  // if texture deduplication is enabled.
+  struct TextureResource {
     ID3D12Resource* resource;
-    uint64_t resource_size;
+    uint64_t size;
     D3D12_RESOURCE_STATES state;
+    // Unique among all the resources ever created, for checking whether
+    // bindings are up to date.
+    uint64_t uid;
+    uint32_t texture_count;
+    // Whether the resource is in resources_by_content_ under content_key - only
+    // while its data is not modified.
+    bool content_indexed;
+    xe::hash::Hash128 content_key;
+    // Whether the resource has been evicted from video memory with
+    // ID3D12Device::Evict and needs MakeResident before being used again.
+    bool evicted;
+  };
+
+  struct Texture {
+    TextureKey key;
+    TextureResource* resource;
 
     uint64_t last_usage_frame;
     uint64_t last_usage_time;
@@ -377,6 +401,10 @@ class TextureCache {
     bool base_in_sync;
     // Whether the recent mip data has been loaded from the memory.
     bool mips_in_sync;
+
+    // Whether the mips are in mip_streaming_textures_, not loaded yet, and the
+    // descriptors only expose the base level.
+    bool mips_streaming;
   };
 
   struct SRVDescriptorCachePage {
@@ -407,6 +435,34 @@ class TextureCache {
     static constexpr uint32_t kGuestPitchTiled = UINT32_MAX;
   };
 
+  // Header of a file in the converted texture disk cache, followed by the
+  // host layout data of all the array slices.
+  struct DiskCacheFileHeader {
+    static constexpr uint32_t kMagic = 0x43544558;
+    // Update if the layout of the converted data is changed!
+    static constexpr uint32_t kVersion = 0x20201020;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t map_key[2];
+    uint32_t bucket_key;
+    uint32_t slice_count;
+    uint64_t slice_size;
+    // 128-bit hash of the guest base and mip data, as the files are looked up
+    // only by it and the key, without comparing the guest data.
+    xe::hash::Hash128 data_hash;
+  };
+
+  // Readback buffer with converted texture data to write to the disk cache
+  // when the submission using it is completed.
+  struct DiskCacheTransfer {
+    ID3D12Resource* buffer;
+    uint64_t submission;
+    // Empty if loading has failed and the buffer only needs to be released.
+    std::filesystem::path path;
+    DiskCacheFileHeader header;
+  };
+
   struct TextureBinding {
     TextureKey key;
     // Destination swizzle merged with guest->host format swizzle.
@@ -501,6 +557,61 @@ class TextureCache {
   // Writes data from the shared memory to the texture. This binds pipelines,
   // allocates descriptors and copies!
   bool LoadTextureData(Texture* texture);
+  // Loads the mips of textures in mip_streaming_textures_ within the per-frame
+  // budget and makes their descriptors expose all the mips.
+  void StreamTextureMips();
+
+  // Creates a host resource for a texture with the key, referenced by no
+  // textures yet, or returns nullptr in case of a failure.
+  TextureResource* CreateTextureResource(TextureKey key);
+  // Dereferences the host resource of a texture, destroying it once it's not
+  // used by the GPU anymore if no textures are referencing it.
+  void ReleaseTextureResource(TextureResource* resource);
+  void RemoveTextureResourceFromContentIndex(TextureResource* resource);
+  // Replaces the host resource of the texture, recreating its descriptors and
+  // updating the bindings.
+  void SetTextureResource(Texture* texture, TextureResource* resource);
+  // Recreates the existing descriptors of the texture and updates the
+  // bindings using them.
+  void RecreateTextureDescriptors(Texture* texture);
+  // Releases the resources and the bindless descriptors not used by the GPU
+  // anymore, or all of them if the GPU is known to be idle.
+  void ProcessDeferredReleases(bool all_submissions_completed);
+  // Removes the texture from the cache and destroys it. Its bindless
+  // descriptors are released immediately, so the texture must not be used by
+  // submissions that haven't been completed yet.
+  void DestroyTexture(Texture* texture);
+  // Returns false if failed to bring an evicted resource back to video memory.
+  bool MakeTextureResourceResident(TextureResource& resource);
+  // Higher for textures that are better to evict or destroy first - unused for
+  // longer, and occupying more host memory relatively to the cost of loading
+  // them again.
+  float GetEvictionPriority(const Texture& texture) const;
+  static uint64_t GetTextureResourceUID(const Texture* texture) {
+    return texture ? texture->resource->uid : 0;
+  }
+
+  // 128-bit hash of the current guest base and mip data of the texture, which
+  // must not contain GPU-written pages.
+  xe::hash::Hash128 HashGuestData(const Texture& texture) const;
+  // Key for deduplicating textures that have the same host data - the guest
+  // data hash combined with the properties of the texture other than its
+  // addresses.
+  static xe::hash::Hash128 GetContentKey(
+      TextureKey key, const xe::hash::Hash128& guest_data_hash);
+
+  void MakeDiskCacheFileHeader(const Texture& texture, uint32_t slice_count,
+                               uint64_t slice_size,
+                               const xe::hash::Hash128& guest_data_hash,
+                               DiskCacheFileHeader& header_out) const;
+  static std::filesystem::path GetDiskCacheFilePath(
+      const DiskCacheFileHeader& header);
+  // Returns an upload buffer with the data of all the array slices from the
+  // disk cache, or nullptr if the texture is not cached.
+  ID3D12Resource* LoadDiskCacheFile(const DiskCacheFileHeader& header);
+  // Writes the readback buffers of completed submissions, or of all
+  // submissions if the GPU is known to be idle.
+  void ProcessDiskCacheTransfers(bool all_submissions_completed);
 
   // Returns the index of an existing of a newly created non-shader-visible
   // cached (for bindful) or a shader-visible global (for bindless) descriptor,
@@ -556,9 +667,16 @@ class TextureCache {
 
   std::unordered_multimap<uint64_t, Texture*> textures_;
   uint64_t textures_total_size_ = 0;
+  // Part of textures_total_size_ evicted from video memory.
+  uint64_t textures_evicted_size_ = 0;
+  // Reused between frames to avoid allocations.
+  std::vector<std::pair<float, Texture*>> eviction_candidates_;
   Texture* texture_used_first_ = nullptr;
   Texture* texture_used_last_ = nullptr;
   uint64_t texture_current_usage_time_;
+  // Textures with only the base loaded, in the order of creation, for loading
+  // the mips later.
+  std::deque<Texture*> mip_streaming_textures_;
 
   std::vector<SRVDescriptorCachePage> srv_descriptor_cache_;
   uint32_t srv_descriptor_cache_allocated_;
@@ -587,6 +705,21 @@ class TextureCache {
   // been changed.
   std::atomic<bool> texture_invalidated_ = false;
 
+  // Host resources of textures with data loaded fully from the guest memory,
+  // by their content key, for deduplication. The key is 128-bit because the
+  // data of the textures found by it isn't compared.
+  std::unordered_map<xe::hash::Hash128, TextureResource*,
+                     xe::hash::Hash128Hasher>
+      resources_by_content_;
+  uint64_t texture_resource_next_uid_ = 1;
+  // Resources and bindless descriptors to release when the submissions that
+  // may be using them are completed.
+  std::deque<std::pair<ID3D12Resource*, uint64_t>> resources_for_release_;
+  std::deque<std::pair<uint32_t, uint64_t>> bindless_descriptors_for_release_;
+
+  // Disk cache readback buffers in the order of submissions using them.
+  std::deque<DiskCacheTransfer> disk_cache_transfers_;
+
   // Unsupported texture formats used during this frame (for research and
   // testing).
   enum : uint8_t {
@@ -365,6 +365,7 @@ bool GetResolveInfo(const RegisterFile& regs, const Memory& memory,
   uint32_t rb_copy_dest_base = regs[XE_GPU_REG_RB_COPY_DEST_BASE].u32;
   uint32_t copy_dest_base_adjusted = rb_copy_dest_base;
   uint32_t copy_dest_length;
+  uint32_t copy_dest_overwritten_length = 0;
   auto rb_copy_dest_pitch = regs.Get<reg::RB_COPY_DEST_PITCH>();
   info_out.rb_copy_dest_pitch = rb_copy_dest_pitch;
   const FormatInfo& dest_format_info = *FormatInfo::Get(dest_format);
@@ -412,6 +413,22 @@ bool GetResolveInfo(const RegisterFile& regs, const Memory& memory,
     }
     copy_dest_length = texture_util::GetGuestMipSliceStorageSize(
         dest_width, dest_height, dest_depth, true, dest_format, nullptr, false);
+    // Full-width resolves, like most full-screen ones, overwrite all the 32x32
+    // tiles in every row of tiles they fully cover.
+    uint32_t dest_pitch_aligned =
+        xe::align(uint32_t(rb_copy_dest_pitch.copy_dest_pitch),
+                  xenos::kTextureTileWidthHeight);
+    if (!rb_copy_dest_info.copy_dest_array && x0 == 0 &&
+        !(y0 & int32_t(xenos::kTextureTileWidthHeight - 1)) &&
+        uint32_t(x1) >= dest_pitch_aligned) {
+      uint32_t overwritten_tile_rows =
+          uint32_t(y1 - y0) / xenos::kTextureTileWidthHeight;
+      copy_dest_overwritten_length = std::min(
+          (overwritten_tile_rows * xenos::kTextureTileWidthHeight *
+           dest_pitch_aligned)
+              << bpp_log2,
+          copy_dest_length);
+    }
   } else {
     XELOGE("Tried to resolve to format {}, which is not a ColorFormat",
            dest_format_info.name);
@@ -419,6 +436,7 @@ bool GetResolveInfo(const RegisterFile& regs, const Memory& memory,
   }
   info_out.copy_dest_base = copy_dest_base_adjusted;
   info_out.copy_dest_length = copy_dest_length;
+  info_out.copy_dest_overwritten_length = copy_dest_overwritten_length;
 
   // Offset to 160x32 (a multiple of both the EDRAM tile size and the texture
   // tile size), so the whole offset can be stored in a very small number of
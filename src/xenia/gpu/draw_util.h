@@ -187,6 +187,12 @@ struct ResolveInfo {
   // May be zero if something is wrong with the destination, in this case,
   // clearing may still be done, but copying must be dropped.
   uint32_t copy_dest_length;
+  // How much of the range starting at copy_dest_base is fully overwritten by
+  // copying (whole 32-row stripes of 32x32 tiles, which are contiguous in
+  // memory, for resolves covering the whole pitch), so it doesn't need to be
+  // loaded from the guest memory beforehand. The rest may be partially
+  // preserved.
+  uint32_t copy_dest_overwritten_length;
 
   // The clear shaders always write to a uint4 view of EDRAM.
   uint32_t rb_depth_clear;
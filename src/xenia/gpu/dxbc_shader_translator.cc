@@ -125,6 +125,26 @@ std::vector<uint8_t> DxbcShaderTranslator::ForceEarlyDepthStencil(
   return std::move(new_shader);
 }
 
+void DxbcShaderTranslator::SetBoolLoopConstantSpecialization(
+    const uint32_t* bool_constants, const uint32_t* loop_constants) {
+  bool_loop_constants_specialized_ = bool_constants && loop_constants;
+  if (bool_loop_constants_specialized_) {
+    std::memcpy(specialized_bool_constants_, bool_constants,
+                sizeof(specialized_bool_constants_));
+    std::memcpy(specialized_loop_constants_, loop_constants,
+                sizeof(specialized_loop_constants_));
+  }
+}
+
+void DxbcShaderTranslator::SetRovOutputMergerSpecialization(
+    const RovOutputMergerSpecialization* specialization) {
+  rov_output_merger_specialized_ = specialization != nullptr;
+  if (rov_output_merger_specialized_) {
+    std::memcpy(&rov_output_merger_specialization_, specialization,
+                sizeof(rov_output_merger_specialization_));
+  }
+}
+
 std::vector<uint8_t> DxbcShaderTranslator::CreateDepthOnlyPixelShader() {
   Reset();
   is_depth_only_pixel_shader_ = true;
@@ -162,6 +182,7 @@ void DxbcShaderTranslator::Reset() {
   cf_exec_predicated_ = false;
   cf_instruction_predicate_if_open_ = false;
   cf_exec_predicate_written_ = false;
+  cf_structured_if_depth_ = 0;
 
   srv_count_ = 0;
   srv_index_shared_memory_ = kBindingIndexUnallocated;
@@ -387,6 +408,73 @@ void DxbcShaderTranslator::StartVertexShader_LoadVertexIndex() {
       DxbcSrc::V(uint32_t(InOutRegister::kVSInVertexIndex), DxbcSrc::kXXXX),
       index_src);
 
+  {
+    // If the host vertex index is the position in the guest index buffer (when
+    // drawing primitives converted via a pattern index buffer), load the guest
+    // index from the shared memory.
+    system_constants_used_ |= 1ull << kSysConst_Flags_Index;
+    DxbcSrc flags_src(DxbcSrc::CB(cbuffer_index_system_constants_,
+                                  uint32_t(CbufferRegister::kSystemConstants),
+                                  kSysConst_Flags_Vec)
+                          .Select(kSysConst_Flags_Comp));
+    DxbcDest load_temp_dest(DxbcDest::R(reg, 0b0010));
+    DxbcSrc load_temp_src(DxbcSrc::R(reg, DxbcSrc::kYYYY));
+    DxbcDest flag_temp_dest(DxbcDest::R(reg, 0b0100));
+    DxbcSrc flag_temp_src(DxbcSrc::R(reg, DxbcSrc::kZZZZ));
+    DxbcOpAnd(load_temp_dest, flags_src,
+              DxbcSrc::LU(kSysFlag_VertexIndexLoad));
+    DxbcOpIf(true, load_temp_src);
+    // Get log2 of the index size.
+    DxbcOpAnd(load_temp_dest, flags_src,
+              DxbcSrc::LU(kSysFlag_VertexIndexLoad32Bit));
+    DxbcOpMovC(load_temp_dest, load_temp_src, DxbcSrc::LU(2), DxbcSrc::LU(1));
+    // Get the byte address of the index.
+    DxbcOpIShL(index_dest, index_src, load_temp_src);
+    system_constants_used_ |= 1ull << kSysConst_VertexIndexLoadAddress_Index;
+    DxbcOpIAdd(index_dest, index_src,
+               DxbcSrc::CB(cbuffer_index_system_constants_,
+                           uint32_t(CbufferRegister::kSystemConstants),
+                           kSysConst_VertexIndexLoadAddress_Vec)
+                   .Select(kSysConst_VertexIndexLoadAddress_Comp));
+    // Get the bit offset of the index in its dword (always 0 for 32-bit
+    // indices since they are aligned), and the byte address of the dword.
+    DxbcOpAnd(load_temp_dest, index_src, DxbcSrc::LU(2));
+    DxbcOpIShL(load_temp_dest, load_temp_src, DxbcSrc::LU(3));
+    DxbcOpAnd(index_dest, index_src, DxbcSrc::LU(~uint32_t(3)));
+    // Load the dword from the shared memory, bound as an SRV or as a UAV
+    // depending on whether memexport is used, like in vertex fetching.
+    DxbcOpAnd(flag_temp_dest, flags_src,
+              DxbcSrc::LU(kSysFlag_SharedMemoryIsUAV));
+    DxbcOpIf(false, flag_temp_src);
+    if (srv_index_shared_memory_ == kBindingIndexUnallocated) {
+      srv_index_shared_memory_ = srv_count_++;
+    }
+    if (uav_index_shared_memory_ == kBindingIndexUnallocated) {
+      uav_index_shared_memory_ = uav_count_++;
+    }
+    DxbcOpLdRaw(index_dest, index_src,
+                DxbcSrc::T(srv_index_shared_memory_,
+                           uint32_t(SRVMainRegister::kSharedMemory)));
+    DxbcOpElse();
+    DxbcOpLdRaw(index_dest, index_src,
+                DxbcSrc::U(uav_index_shared_memory_,
+                           uint32_t(UAVRegister::kSharedMemory)));
+    DxbcOpEndIf();
+    // Extract the index from the dword (before swapping, like the input
+    // assembler does).
+    DxbcOpUShR(index_dest, index_src, load_temp_src);
+    DxbcOpAnd(flag_temp_dest, flags_src,
+              DxbcSrc::LU(kSysFlag_VertexIndexLoad32Bit));
+    DxbcOpMovC(flag_temp_dest, flag_temp_src, DxbcSrc::LU(UINT32_MAX),
+               DxbcSrc::LU(0xFFFF));
+    DxbcOpAnd(index_dest, index_src, flag_temp_src);
+    if (!uses_register_dynamic_addressing()) {
+      // Break register dependency (Y is also cleared after swapping).
+      DxbcOpMov(flag_temp_dest, DxbcSrc::LF(0.0f));
+    }
+    DxbcOpEndIf();
+  }
+
   {
     // Swap the vertex index's endianness.
     system_constants_used_ |= 1ull << kSysConst_VertexIndexEndian_Index;
@@ -957,8 +1045,9 @@ void DxbcShaderTranslator::StartTranslation() {
     StartPixelShader();
   }
 
-  // If not translating anything, don't start the main loop.
-  if (is_depth_only_pixel_shader_) {
+  // If not translating anything, or if the control flow doesn't need a program
+  // counter, don't start the main loop.
+  if (is_depth_only_pixel_shader_ || is_control_flow_structured()) {
     return;
   }
 
@@ -1131,7 +1220,13 @@ void DxbcShaderTranslator::CompleteVertexOrDomainShader() {
 }
 
 void DxbcShaderTranslator::CompleteShaderCode() {
-  if (!is_depth_only_pixel_shader_) {
+  if (!is_depth_only_pixel_shader_ && is_control_flow_structured()) {
+    CloseExecConditionals();
+    // Close the `if` blocks of the jumps to the end of the shader.
+    for (; cf_structured_if_depth_; --cf_structured_if_depth_) {
+      DxbcOpEndIf();
+    }
+  } else if (!is_depth_only_pixel_shader_) {
     // Close the last exec, there's nothing to merge it with anymore, and we're
     // closing upper-level flow control blocks.
     CloseExecConditionals();
@@ -1629,21 +1724,7 @@ void DxbcShaderTranslator::UpdateExecConditionalsAndEmitDisassembly(
   EmitInstructionDisassembly();
 
   if (type == ParsedExecInstruction::Type::kConditional) {
-    uint32_t bool_constant_test_temp = PushSystemTemp();
-    // Check the bool constant value.
-    if (cbuffer_index_bool_loop_constants_ == kBindingIndexUnallocated) {
-      cbuffer_index_bool_loop_constants_ = cbuffer_count_++;
-    }
-    DxbcOpAnd(DxbcDest::R(bool_constant_test_temp, 0b0001),
-              DxbcSrc::CB(cbuffer_index_bool_loop_constants_,
-                          uint32_t(CbufferRegister::kBoolLoopConstants),
-                          bool_constant_index >> 7)
-                  .Select((bool_constant_index >> 5) & 3),
-              DxbcSrc::LU(uint32_t(1) << (bool_constant_index & 31)));
-    // Open the new `if`.
-    DxbcOpIf(condition, DxbcSrc::R(bool_constant_test_temp, DxbcSrc::kXXXX));
-    // Release bool_constant_test_temp.
-    PopSystemTemp();
+    OpenBoolConstantConditional(bool_constant_index, condition);
     cf_exec_bool_constant_ = bool_constant_index;
     cf_exec_bool_constant_condition_ = condition;
   } else if (type == ParsedExecInstruction::Type::kPredicated) {
@@ -1708,6 +1789,48 @@ void DxbcShaderTranslator::CloseInstructionPredication() {
   }
 }
 
+void DxbcShaderTranslator::OpenBoolConstantConditional(
+    uint32_t bool_constant_index, bool condition) {
+  if (bool_loop_constants_specialized_) {
+    // Trivially foldable by the host shader compiler.
+    uint32_t bool_constant =
+        specialized_bool_constants_[bool_constant_index >> 5];
+    DxbcOpIf(condition,
+             DxbcSrc::LU((bool_constant >> (bool_constant_index & 31)) & 1));
+    return;
+  }
+  uint32_t bool_constant_test_temp = PushSystemTemp();
+  // Check the bool constant value.
+  if (cbuffer_index_bool_loop_constants_ == kBindingIndexUnallocated) {
+    cbuffer_index_bool_loop_constants_ = cbuffer_count_++;
+  }
+  DxbcOpAnd(DxbcDest::R(bool_constant_test_temp, 0b0001),
+            DxbcSrc::CB(cbuffer_index_bool_loop_constants_,
+                        uint32_t(CbufferRegister::kBoolLoopConstants),
+                        bool_constant_index >> 7)
+                .Select((bool_constant_index >> 5) & 3),
+            DxbcSrc::LU(uint32_t(1) << (bool_constant_index & 31)));
+  // Open the new `if`.
+  DxbcOpIf(condition, DxbcSrc::R(bool_constant_test_temp, DxbcSrc::kXXXX));
+  // Release bool_constant_test_temp.
+  PopSystemTemp();
+}
+
+DxbcShaderTranslator::DxbcSrc DxbcShaderTranslator::LoopConstantSrc(
+    uint32_t loop_constant_index) {
+  if (bool_loop_constants_specialized_) {
+    return DxbcSrc::LU(specialized_loop_constants_[loop_constant_index]);
+  }
+  // Starting from vector 2 because of bool constants.
+  if (cbuffer_index_bool_loop_constants_ == kBindingIndexUnallocated) {
+    cbuffer_index_bool_loop_constants_ = cbuffer_count_++;
+  }
+  return DxbcSrc::CB(cbuffer_index_bool_loop_constants_,
+                     uint32_t(CbufferRegister::kBoolLoopConstants),
+                     2 + (loop_constant_index >> 2))
+      .Select(loop_constant_index & 3);
+}
+
 void DxbcShaderTranslator::JumpToLabel(uint32_t address) {
   DxbcOpMov(DxbcDest::R(system_temp_ps_pc_p0_a0_, 0b0010),
             DxbcSrc::LU(address));
@@ -1722,7 +1845,14 @@ void DxbcShaderTranslator::ProcessLabel(uint32_t cf_index) {
   // Close flow control on the deeper levels below - prevent attempts to merge
   // execs across labels.
   CloseExecConditionals();
-  if (UseSwitchForControlFlow()) {
+  if (is_control_flow_structured()) {
+    // Close the `if` blocks of the jumps to this label.
+    for (uint32_t i = GetStructuredIfEndCount(cf_index); i; --i) {
+      assert_not_zero(cf_structured_if_depth_);
+      DxbcOpEndIf();
+      --cf_structured_if_depth_;
+    }
+  } else if (UseSwitchForControlFlow()) {
     // Fallthrough to the label from the previous one on the next iteration if
     // no `continue` was done. Can't simply fallthrough because in DXBC, a
     // non-empty switch case must end with a break.
@@ -1756,7 +1886,9 @@ void DxbcShaderTranslator::ProcessExecInstructionBegin(
 
 void DxbcShaderTranslator::ProcessExecInstructionEnd(
     const ParsedExecInstruction& instr) {
-  if (instr.is_end) {
+  // In structured control flow, only no-op instructions may be after the end,
+  // so there's nothing to skip.
+  if (instr.is_end && !is_control_flow_structured()) {
     // Break out of the main loop.
     CloseInstructionPredication();
     if (UseSwitchForControlFlow()) {
@@ -1785,15 +1917,8 @@ void DxbcShaderTranslator::ProcessLoopStartInstruction(
   }
 
   // Count (unsigned) in bits 0:7 of the loop constant, initial aL (unsigned) in
-  // 8:15. Starting from vector 2 because of bool constants.
-  if (cbuffer_index_bool_loop_constants_ == kBindingIndexUnallocated) {
-    cbuffer_index_bool_loop_constants_ = cbuffer_count_++;
-  }
-  DxbcSrc loop_constant_src(
-      DxbcSrc::CB(cbuffer_index_bool_loop_constants_,
-                  uint32_t(CbufferRegister::kBoolLoopConstants),
-                  2 + (instr.loop_constant_index >> 2))
-          .Select(instr.loop_constant_index & 3));
+  // 8:15.
+  DxbcSrc loop_constant_src(LoopConstantSrc(instr.loop_constant_index));
 
   // Push the count to the loop count stack - move XYZ to YZW and set X to this
   // loop count.
@@ -1812,9 +1937,15 @@ void DxbcShaderTranslator::ProcessLoopStartInstruction(
   }
 
   // Break if the loop counter is 0 (since the condition is checked in the end).
-  DxbcOpIf(false, DxbcSrc::R(system_temp_loop_count_, DxbcSrc::kXXXX));
-  JumpToLabel(instr.loop_skip_address);
-  DxbcOpEndIf();
+  if (is_control_flow_structured()) {
+    // The loop_end right before loop_skip_address closes both.
+    DxbcOpIf(true, DxbcSrc::R(system_temp_loop_count_, DxbcSrc::kXXXX));
+    DxbcOpLoop();
+  } else {
+    DxbcOpIf(false, DxbcSrc::R(system_temp_loop_count_, DxbcSrc::kXXXX));
+    JumpToLabel(instr.loop_skip_address);
+    DxbcOpEndIf();
+  }
 }
 
 void DxbcShaderTranslator::ProcessLoopEndInstruction(
@@ -1866,6 +1997,9 @@ void DxbcShaderTranslator::ProcessLoopEndInstruction(
     DxbcOpMov(DxbcDest::R(system_temp_loop_count_, 0b0111),
               DxbcSrc::R(system_temp_loop_count_, 0b111001));
     DxbcOpMov(DxbcDest::R(system_temp_loop_count_, 0b1000), DxbcSrc::LU(0));
+    if (is_control_flow_structured()) {
+      DxbcOpBreak();
+    }
     // Now going to fall through to the next exec (no need to jump).
   }
   DxbcOpElse();
@@ -1873,16 +2007,9 @@ void DxbcShaderTranslator::ProcessLoopEndInstruction(
     // Continue case.
     uint32_t aL_add_temp = PushSystemTemp();
     // Extract the value to add to aL (signed, in bits 16:23 of the loop
-    // constant). Starting from vector 2 because of bool constants.
-    if (cbuffer_index_bool_loop_constants_ == kBindingIndexUnallocated) {
-      cbuffer_index_bool_loop_constants_ = cbuffer_count_++;
-    }
+    // constant).
     DxbcOpIBFE(DxbcDest::R(aL_add_temp, 0b0001), DxbcSrc::LU(8),
-               DxbcSrc::LU(16),
-               DxbcSrc::CB(cbuffer_index_bool_loop_constants_,
-                           uint32_t(CbufferRegister::kBoolLoopConstants),
-                           2 + (instr.loop_constant_index >> 2))
-                   .Select(instr.loop_constant_index & 3));
+               DxbcSrc::LU(16), LoopConstantSrc(instr.loop_constant_index));
     // Add the needed value to aL.
     DxbcOpIAdd(DxbcDest::R(system_temp_aL_, 0b0001),
                DxbcSrc::R(system_temp_aL_, DxbcSrc::kXXXX),
@@ -1890,9 +2017,16 @@ void DxbcShaderTranslator::ProcessLoopEndInstruction(
     // Release aL_add_temp.
     PopSystemTemp();
     // Jump back to the beginning of the loop body.
-    JumpToLabel(instr.loop_body_address);
+    if (!is_control_flow_structured()) {
+      JumpToLabel(instr.loop_body_address);
+    }
   }
   DxbcOpEndIf();
+  if (is_control_flow_structured()) {
+    // Close the loop and the loop count check opened by the loop_start.
+    DxbcOpEndLoop();
+    DxbcOpEndIf();
+  }
 }
 
 void DxbcShaderTranslator::ProcessJumpInstruction(
@@ -1902,6 +2036,26 @@ void DxbcShaderTranslator::ProcessJumpInstruction(
     instr.Disassemble(&instruction_disassembly_buffer_);
   }
 
+  if (is_control_flow_structured()) {
+    // The jump closes the exec, and opens an `if` for the code it skips.
+    CloseExecConditionals();
+    EmitInstructionDisassembly();
+    if (IsStructuredElseJump(instr.dword_index)) {
+      // The `if` is closed at the target of this jump instead.
+      DxbcOpElse();
+      return;
+    }
+    if (instr.type == ParsedJumpInstruction::Type::kConditional) {
+      OpenBoolConstantConditional(instr.bool_constant_index, !instr.condition);
+    } else {
+      assert_true(instr.type == ParsedJumpInstruction::Type::kPredicated);
+      DxbcOpIf(!instr.condition,
+               DxbcSrc::R(system_temp_ps_pc_p0_a0_, DxbcSrc::kZZZZ));
+    }
+    ++cf_structured_if_depth_;
+    return;
+  }
+
   // Treat like exec, merge with execs if possible, since it's an if too.
   ParsedExecInstruction::Type type;
   if (instr.type == ParsedJumpInstruction::Type::kConditional) {
@@ -2045,8 +2199,9 @@ const DxbcShaderTranslator::SystemConstantRdef DxbcShaderTranslator::
         {"xe_edram_poly_offset_back", RdefTypeIndex::kFloat2,
          sizeof(float) * 2},
 
-        {"xe_edram_depth_base_dwords", RdefTypeIndex::kUint, sizeof(uint32_t),
-         sizeof(float) * 3},
+        {"xe_edram_depth_base_dwords", RdefTypeIndex::kUint, sizeof(uint32_t)},
+        {"xe_vertex_index_load_address", RdefTypeIndex::kUint,
+         sizeof(uint32_t), sizeof(float) * 2},
 
         {"xe_edram_stencil", RdefTypeIndex::kUint4Array2,
          sizeof(uint32_t) * 4 * 2},
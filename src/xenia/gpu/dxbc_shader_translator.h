@@ -129,6 +129,12 @@ class DxbcShaderTranslator : public ShaderTranslator {
     kSysFlag_ReverseZ_Shift,
     kSysFlag_KillIfAnyVertexKilled_Shift,
     kSysFlag_PrimitiveTwoFaced_Shift,
+    // Whether the host vertex index is the position in the guest index buffer
+    // at vertex_index_load_address rather than the index itself, for drawing
+    // primitive types not supported by Direct3D 12 with a conversion pattern
+    // index buffer without converting the guest indices on the CPU.
+    kSysFlag_VertexIndexLoad_Shift,
+    kSysFlag_VertexIndexLoad32Bit_Shift,
     kSysFlag_AlphaPassIfLess_Shift,
     kSysFlag_AlphaPassIfEqual_Shift,
     kSysFlag_AlphaPassIfGreater_Shift,
@@ -171,6 +177,8 @@ class DxbcShaderTranslator : public ShaderTranslator {
     kSysFlag_ReverseZ = 1u << kSysFlag_ReverseZ_Shift,
     kSysFlag_KillIfAnyVertexKilled = 1u << kSysFlag_KillIfAnyVertexKilled_Shift,
     kSysFlag_PrimitiveTwoFaced = 1u << kSysFlag_PrimitiveTwoFaced_Shift,
+    kSysFlag_VertexIndexLoad = 1u << kSysFlag_VertexIndexLoad_Shift,
+    kSysFlag_VertexIndexLoad32Bit = 1u << kSysFlag_VertexIndexLoad32Bit_Shift,
     kSysFlag_AlphaPassIfLess = 1u << kSysFlag_AlphaPassIfLess_Shift,
     kSysFlag_AlphaPassIfEqual = 1u << kSysFlag_AlphaPassIfEqual_Shift,
     kSysFlag_AlphaPassIfGreater = 1u << kSysFlag_AlphaPassIfGreater_Shift,
@@ -279,7 +287,11 @@ class DxbcShaderTranslator : public ShaderTranslator {
     };
 
     uint32_t edram_depth_base_dwords;
-    uint32_t padding_edram_depth_base_dwords[3];
+    // Byte address of the guest index buffer in the shared memory with
+    // kSysFlag_VertexIndexLoad (placed in the padding to keep the layout of
+    // the rest of the constants).
+    uint32_t vertex_index_load_address;
+    uint32_t padding_vertex_index_load_address[2];
 
     // In stencil function/operations (they match the layout of the
     // function/operations in RB_DEPTHCONTROL):
@@ -450,6 +462,30 @@ class DxbcShaderTranslator : public ShaderTranslator {
   // state of the translator.
   std::vector<uint8_t> CreateDepthOnlyPixelShader();
 
+  // Makes the following translations use the specified values of the bool
+  // (256 bits) and loop (32 dwords) constants as literals rather than reading
+  // them from the constant buffer, for building specialized versions of
+  // shaders, or, if the pointers are nullptr, read the constants at runtime.
+  void SetBoolLoopConstantSpecialization(const uint32_t* bool_constants,
+                                         const uint32_t* loop_constants);
+
+  // Output merger state baked into the pixel shader code with the ROV, with the
+  // same layout and meaning as the respective system constants. Render targets
+  // with both keep mask dwords set to UINT32_MAX are not written at all.
+  struct RovOutputMergerSpecialization {
+    uint32_t sample_count_log2[2];
+    uint32_t edram_rt_format_flags[4];
+    float edram_rt_clamp[4][4];
+    uint32_t edram_rt_keep_mask[4][2];
+    uint32_t edram_rt_blend_factors_ops[4];
+  };
+  // Makes the following pixel shader translations with the ROV use the
+  // specified output merger state instead of the system constants, skipping
+  // the code for render target formats, blending modes and samples that can't
+  // be used, or, if nullptr, read the state at runtime.
+  void SetRovOutputMergerSpecialization(
+      const RovOutputMergerSpecialization* specialization);
+
  protected:
   void Reset() override;
 
@@ -2014,8 +2050,12 @@ class DxbcShaderTranslator : public ShaderTranslator {
         kSysConst_EdramPolyOffsetBack_Index + 1,
     kSysConst_EdramDepthBaseDwords_Vec = kSysConst_EdramPolyOffsetBack_Vec + 1,
     kSysConst_EdramDepthBaseDwords_Comp = 0,
+    kSysConst_VertexIndexLoadAddress_Index =
+        kSysConst_EdramDepthBaseDwords_Index + 1,
+    kSysConst_VertexIndexLoadAddress_Vec = kSysConst_EdramDepthBaseDwords_Vec,
+    kSysConst_VertexIndexLoadAddress_Comp = 1,
 
-    kSysConst_EdramStencil_Index = kSysConst_EdramDepthBaseDwords_Index + 1,
+    kSysConst_EdramStencil_Index = kSysConst_VertexIndexLoadAddress_Index + 1,
     // 2 vectors.
     kSysConst_EdramStencil_Vec = kSysConst_EdramDepthBaseDwords_Vec + 1,
     kSysConst_EdramStencil_Front_Vec = kSysConst_EdramStencil_Vec,
@@ -2208,6 +2248,13 @@ class DxbcShaderTranslator : public ShaderTranslator {
   // unchanged or known that it's safe not to await kills/alphatest/AtoC),
   // returns from the shader.
   void ROV_DepthStencilTest();
+  // Sources of the system constant vectors containing the output merger state,
+  // or literals with the same layout if the state is specialized.
+  DxbcSrc ROV_SampleCountLog2Src();
+  DxbcSrc ROV_RTFormatFlagsSrc();
+  DxbcSrc ROV_RTClampSrc(uint32_t rt_index);
+  DxbcSrc ROV_RTKeepMaskSrc(uint32_t rt_index);
+  DxbcSrc ROV_RTBlendFactorsOpsSrc();
   // Unpacks a 32bpp or a 64bpp color in packed_temp.packed_temp_components to
   // color_temp, using 2 temporary VGPRs.
   void ROV_UnpackColor(uint32_t rt_index, uint32_t packed_temp,
@@ -2329,6 +2376,12 @@ class DxbcShaderTranslator : public ShaderTranslator {
   // control instruction needs to do some code which needs to respect the exec's
   // conditional, but can't itself be predicated.
   void CloseInstructionPredication();
+  // Opens an `if` executed when the bool constant has the expected value.
+  void OpenBoolConstantConditional(uint32_t bool_constant_index,
+                                   bool condition);
+  // Returns the source operand for the loop constant, from the constant buffer
+  // or a literal if specialized.
+  DxbcSrc LoopConstantSrc(uint32_t loop_constant_index);
   void JumpToLabel(uint32_t address);
 
   uint32_t FindOrAddTextureBinding(uint32_t fetch_constant,
@@ -2402,6 +2455,17 @@ class DxbcShaderTranslator : public ShaderTranslator {
   // Whether the output merger should be emulated in pixel shaders.
   bool edram_rov_used_;
 
+  // Whether the bool and loop constants are folded into the shader code, with
+  // the values in specialized_bool_constants_ and specialized_loop_constants_.
+  bool bool_loop_constants_specialized_ = false;
+  uint32_t specialized_bool_constants_[256 / 32];
+  uint32_t specialized_loop_constants_[32];
+
+  // Whether the ROV output merger state is known at translation time, from
+  // rov_output_merger_specialization_.
+  bool rov_output_merger_specialized_ = false;
+  RovOutputMergerSpecialization rov_output_merger_specialization_;
+
   // Is currently writing the empty depth-only pixel shader, for
   // CompleteTranslation.
   bool is_depth_only_pixel_shader_;
@@ -2584,6 +2648,9 @@ class DxbcShaderTranslator : public ShaderTranslator {
   // the exec-level predicate value, and can't merge two execs with the same
   // predicate condition anymore.
   bool cf_exec_predicate_written_;
+  // Number of `if` blocks opened by jumps in structured control flow and not
+  // closed yet.
+  uint32_t cf_structured_if_depth_;
 
   // Number of SRV resources used in this shader - also used for generation of
   // indices of SRV resources that are optional.
@@ -143,6 +143,73 @@ void DxbcShaderTranslator::ROV_GetColorFormatSystemConstants(
   }
 }
 
+DxbcShaderTranslator::DxbcSrc DxbcShaderTranslator::ROV_SampleCountLog2Src() {
+  if (rov_output_merger_specialized_) {
+    uint32_t sample_count_log2[4] = {};
+    sample_count_log2[kSysConst_SampleCountLog2_Comp] =
+        rov_output_merger_specialization_.sample_count_log2[0];
+    sample_count_log2[kSysConst_SampleCountLog2_Comp + 1] =
+        rov_output_merger_specialization_.sample_count_log2[1];
+    return DxbcSrc::LP(sample_count_log2);
+  }
+  system_constants_used_ |= 1ull << kSysConst_SampleCountLog2_Index;
+  return DxbcSrc::CB(cbuffer_index_system_constants_,
+                     uint32_t(CbufferRegister::kSystemConstants),
+                     kSysConst_SampleCountLog2_Vec);
+}
+
+DxbcShaderTranslator::DxbcSrc DxbcShaderTranslator::ROV_RTFormatFlagsSrc() {
+  if (rov_output_merger_specialized_) {
+    return DxbcSrc::LP(rov_output_merger_specialization_.edram_rt_format_flags);
+  }
+  system_constants_used_ |= 1ull << kSysConst_EdramRTFormatFlags_Index;
+  return DxbcSrc::CB(cbuffer_index_system_constants_,
+                     uint32_t(CbufferRegister::kSystemConstants),
+                     kSysConst_EdramRTFormatFlags_Vec);
+}
+
+DxbcShaderTranslator::DxbcSrc DxbcShaderTranslator::ROV_RTClampSrc(
+    uint32_t rt_index) {
+  if (rov_output_merger_specialized_) {
+    return DxbcSrc::LP(
+        rov_output_merger_specialization_.edram_rt_clamp[rt_index]);
+  }
+  system_constants_used_ |= 1ull << kSysConst_EdramRTClamp_Index;
+  return DxbcSrc::CB(cbuffer_index_system_constants_,
+                     uint32_t(CbufferRegister::kSystemConstants),
+                     kSysConst_EdramRTClamp_Vec + rt_index);
+}
+
+DxbcShaderTranslator::DxbcSrc DxbcShaderTranslator::ROV_RTKeepMaskSrc(
+    uint32_t rt_index) {
+  // Two render targets per vector.
+  if (rov_output_merger_specialized_) {
+    const uint32_t(&keep_mask)[4][2] =
+        rov_output_merger_specialization_.edram_rt_keep_mask;
+    uint32_t rt_pair_index = rt_index & ~uint32_t(1);
+    return DxbcSrc::LU(keep_mask[rt_pair_index][0],
+                       keep_mask[rt_pair_index][1],
+                       keep_mask[rt_pair_index + 1][0],
+                       keep_mask[rt_pair_index + 1][1]);
+  }
+  system_constants_used_ |= 1ull << kSysConst_EdramRTKeepMask_Index;
+  return DxbcSrc::CB(cbuffer_index_system_constants_,
+                     uint32_t(CbufferRegister::kSystemConstants),
+                     kSysConst_EdramRTKeepMask_Vec + (rt_index >> 1));
+}
+
+DxbcShaderTranslator::DxbcSrc
+DxbcShaderTranslator::ROV_RTBlendFactorsOpsSrc() {
+  if (rov_output_merger_specialized_) {
+    return DxbcSrc::LP(
+        rov_output_merger_specialization_.edram_rt_blend_factors_ops);
+  }
+  system_constants_used_ |= 1ull << kSysConst_EdramRTBlendFactorsOps_Index;
+  return DxbcSrc::CB(cbuffer_index_system_constants_,
+                     uint32_t(CbufferRegister::kSystemConstants),
+                     kSysConst_EdramRTBlendFactorsOps_Vec);
+}
+
 void DxbcShaderTranslator::StartPixelShader_LoadROVParameters() {
   bool color_targets_written = writes_any_color_target();
 
@@ -180,14 +247,11 @@ void DxbcShaderTranslator::StartPixelShader_LoadROVParameters() {
   // Convert the position from pixels to samples.
   // system_temp_rov_params_.z = X guest sample 0 position
   // system_temp_rov_params_.w = Y guest sample 0 position
-  system_constants_used_ |= 1ull << kSysConst_SampleCountLog2_Index;
   DxbcOpIShL(DxbcDest::R(system_temp_rov_params_, 0b1100),
              DxbcSrc::R(system_temp_rov_params_),
-             DxbcSrc::CB(cbuffer_index_system_constants_,
-                         uint32_t(CbufferRegister::kSystemConstants),
-                         kSysConst_SampleCountLog2_Vec,
-                         (kSysConst_SampleCountLog2_Comp << 4) |
-                             ((kSysConst_SampleCountLog2_Comp + 1) << 6)));
+             ROV_SampleCountLog2Src().Swizzle(
+                 (kSysConst_SampleCountLog2_Comp << 4) |
+                 ((kSysConst_SampleCountLog2_Comp + 1) << 6)));
   // Get 80x16 samples tile index - start dividing X by 80 by getting the high
   // part of the result of multiplication of X by 0xCCCCCCCD into X.
   // system_temp_rov_params_.x = (X * 0xCCCCCCCD) >> 32, or X / 80 * 64
@@ -349,11 +413,8 @@ void DxbcShaderTranslator::StartPixelShader_LoadROVParameters() {
   // MSAA, handling samples 0 and 3 (upper-left and lower-right) as 0 and 1.
 
   // Check if 4x MSAA is enabled.
-  system_constants_used_ |= 1ull << kSysConst_SampleCountLog2_Index;
-  DxbcOpIf(true, DxbcSrc::CB(cbuffer_index_system_constants_,
-                             uint32_t(CbufferRegister::kSystemConstants),
-                             kSysConst_SampleCountLog2_Vec)
-                     .Select(kSysConst_SampleCountLog2_Comp));
+  DxbcOpIf(true,
+           ROV_SampleCountLog2Src().Select(kSysConst_SampleCountLog2_Comp));
   {
     // Copy the 4x AA coverage to system_temp_rov_params_.x, making top-right
     // the sample [2] and bottom-left the sample [1] (the opposite of Direct3D
@@ -570,12 +631,9 @@ void DxbcShaderTranslator::ROV_DepthStencilTest() {
         // temp.z = viewport maximum depth if not writing to oDepth
         // temp.w = sample's clip space W
         if (i == 1) {
-          system_constants_used_ |= 1ull << kSysConst_SampleCountLog2_Index;
           DxbcOpMovC(sample_depth_stencil_dest,
-                     DxbcSrc::CB(cbuffer_index_system_constants_,
-                                 uint32_t(CbufferRegister::kSystemConstants),
-                                 kSysConst_SampleCountLog2_Vec)
-                         .Select(kSysConst_SampleCountLog2_Comp),
+                     ROV_SampleCountLog2Src().Select(
+                         kSysConst_SampleCountLog2_Comp),
                      DxbcSrc::LU(3), DxbcSrc::LU(2));
           DxbcOpEvalSampleIndex(
               DxbcDest::R(temp, 0b1001),
@@ -1128,11 +1186,7 @@ void DxbcShaderTranslator::ROV_UnpackColor(
             DxbcSrc::LF(0.0f, 0.0f, 0.0f, 1.0f));
 
   // Choose the packing based on the render target's format.
-  system_constants_used_ |= 1ull << kSysConst_EdramRTFormatFlags_Index;
-  DxbcOpSwitch(DxbcSrc::CB(cbuffer_index_system_constants_,
-                           uint32_t(CbufferRegister::kSystemConstants),
-                           kSysConst_EdramRTFormatFlags_Vec)
-                   .Select(rt_index));
+  DxbcOpSwitch(ROV_RTFormatFlagsSrc().Select(rt_index));
 
   // ***************************************************************************
   // k_8_8_8_8
@@ -1335,11 +1389,7 @@ void DxbcShaderTranslator::ROV_PackPreClampedColor(
             DxbcSrc::LU(0));
 
   // Choose the packing based on the render target's format.
-  system_constants_used_ |= 1ull << kSysConst_EdramRTFormatFlags_Index;
-  DxbcOpSwitch(DxbcSrc::CB(cbuffer_index_system_constants_,
-                           uint32_t(CbufferRegister::kSystemConstants),
-                           kSysConst_EdramRTFormatFlags_Vec)
-                   .Select(rt_index));
+  DxbcOpSwitch(ROV_RTFormatFlagsSrc().Select(rt_index));
 
   // ***************************************************************************
   // k_8_8_8_8
@@ -1980,18 +2030,12 @@ void DxbcShaderTranslator::CompletePixelShader_ROV_AlphaToMask() {
   // all.
 
   // Check if MSAA is enabled.
-  system_constants_used_ |= 1ull << kSysConst_SampleCountLog2_Index;
-  DxbcOpIf(true, DxbcSrc::CB(cbuffer_index_system_constants_,
-                             uint32_t(CbufferRegister::kSystemConstants),
-                             kSysConst_SampleCountLog2_Vec)
-                     .Select(kSysConst_SampleCountLog2_Comp + 1));
+  DxbcOpIf(true,
+           ROV_SampleCountLog2Src().Select(kSysConst_SampleCountLog2_Comp + 1));
   {
     // Check if MSAA is 4x or 2x.
-    system_constants_used_ |= 1ull << kSysConst_SampleCountLog2_Index;
-    DxbcOpIf(true, DxbcSrc::CB(cbuffer_index_system_constants_,
-                               uint32_t(CbufferRegister::kSystemConstants),
-                               kSysConst_SampleCountLog2_Vec)
-                       .Select(kSysConst_SampleCountLog2_Comp));
+    DxbcOpIf(true,
+             ROV_SampleCountLog2Src().Select(kSysConst_SampleCountLog2_Comp));
     // 4x MSAA.
     CompletePixelShader_ROV_AlphaToMaskSample(0, 0.75f, temp_x_src,
                                               1.0f / 16.0f, temp, 1);
@@ -2099,16 +2143,32 @@ void DxbcShaderTranslator::CompletePixelShader_WriteToROV() {
     DxbcOpRetC(false, temp_x_src);
   }
 
+  // With the output merger state known, only the samples that can be covered
+  // need to be written (using ForcedSampleCount of 1 for 1x, and for 2x, the
+  // samples 0 and 3 are moved to 0 and 1).
+  uint32_t color_sample_count = 4;
+  if (rov_output_merger_specialized_) {
+    color_sample_count =
+        uint32_t(1)
+        << (rov_output_merger_specialization_.sample_count_log2[0] +
+            rov_output_merger_specialization_.sample_count_log2[1]);
+  }
+
   // Write color values.
   for (uint32_t i = 0; i < 4; ++i) {
     if (!writes_color_target(i)) {
       continue;
     }
+    if (rov_output_merger_specialized_ &&
+        rov_output_merger_specialization_.edram_rt_keep_mask[i][0] ==
+            UINT32_MAX &&
+        rov_output_merger_specialization_.edram_rt_keep_mask[i][1] ==
+            UINT32_MAX) {
+      // Known to have an empty write mask.
+      continue;
+    }
 
-    DxbcSrc keep_mask_vec_src(
-        DxbcSrc::CB(cbuffer_index_system_constants_,
-                    uint32_t(CbufferRegister::kSystemConstants),
-                    kSysConst_EdramRTKeepMask_Vec + (i >> 1)));
+    DxbcSrc keep_mask_vec_src(ROV_RTKeepMaskSrc(i));
     uint32_t keep_mask_component = (i & 1) * 2;
     uint32_t keep_mask_swizzle = keep_mask_component * 0b0101 + 0b0100;
 
@@ -2157,15 +2217,8 @@ void DxbcShaderTranslator::CompletePixelShader_WriteToROV() {
                            kSysConst_EdramRTBaseDwordsScaled_Vec)
                    .Select(i));
 
-    DxbcSrc rt_blend_factors_ops_src(
-        DxbcSrc::CB(cbuffer_index_system_constants_,
-                    uint32_t(CbufferRegister::kSystemConstants),
-                    kSysConst_EdramRTBlendFactorsOps_Vec)
-            .Select(i));
-    DxbcSrc rt_clamp_vec_src(
-        DxbcSrc::CB(cbuffer_index_system_constants_,
-                    uint32_t(CbufferRegister::kSystemConstants),
-                    kSysConst_EdramRTClamp_Vec + i));
+    DxbcSrc rt_blend_factors_ops_src(ROV_RTBlendFactorsOpsSrc().Select(i));
+    DxbcSrc rt_clamp_vec_src(ROV_RTClampSrc(i));
     // Get if not blending to pack the color once for all 4 samples.
     // temp.x = whether blending is disabled.
     system_constants_used_ |= 1ull << kSysConst_EdramRTBlendFactorsOps_Index;
@@ -2194,11 +2247,7 @@ void DxbcShaderTranslator::CompletePixelShader_WriteToROV() {
       // Get if the blending source color is fixed-point for clamping if it is.
       // temp.x = whether color is fixed-point.
       system_constants_used_ |= 1ull << kSysConst_EdramRTFormatFlags_Index;
-      DxbcOpAnd(temp_x_dest,
-                DxbcSrc::CB(cbuffer_index_system_constants_,
-                            uint32_t(CbufferRegister::kSystemConstants),
-                            kSysConst_EdramRTFormatFlags_Vec)
-                    .Select(i),
+      DxbcOpAnd(temp_x_dest, ROV_RTFormatFlagsSrc().Select(i),
                 DxbcSrc::LU(kRTFormatFlag_FixedPointColor));
       // Check if the blending source color is fixed-point and needs clamping.
       // temp.x = free.
@@ -2219,11 +2268,7 @@ void DxbcShaderTranslator::CompletePixelShader_WriteToROV() {
       // Get if the blending source alpha is fixed-point for clamping if it is.
       // temp.x = whether alpha is fixed-point.
       system_constants_used_ |= 1ull << kSysConst_EdramRTFormatFlags_Index;
-      DxbcOpAnd(temp_x_dest,
-                DxbcSrc::CB(cbuffer_index_system_constants_,
-                            uint32_t(CbufferRegister::kSystemConstants),
-                            kSysConst_EdramRTFormatFlags_Vec)
-                    .Select(i),
+      DxbcOpAnd(temp_x_dest, ROV_RTFormatFlagsSrc().Select(i),
                 DxbcSrc::LU(kRTFormatFlag_FixedPointAlpha));
       // Check if the blending source alpha is fixed-point and needs clamping.
       // temp.x = free.
@@ -2246,14 +2291,10 @@ void DxbcShaderTranslator::CompletePixelShader_WriteToROV() {
     }
     DxbcOpEndIf();
 
-    DxbcSrc rt_format_flags_src(
-        DxbcSrc::CB(cbuffer_index_system_constants_,
-                    uint32_t(CbufferRegister::kSystemConstants),
-                    kSysConst_EdramRTFormatFlags_Vec)
-            .Select(i));
+    DxbcSrc rt_format_flags_src(ROV_RTFormatFlagsSrc().Select(i));
 
     // Blend, mask and write all samples.
-    for (uint32_t j = 0; j < 4; ++j) {
+    for (uint32_t j = 0; j < color_sample_count; ++j) {
       // Get if the sample is covered.
       // temp.z = whether the sample is covered.
       DxbcOpAnd(temp_z_dest,
@@ -2948,11 +2989,25 @@ void DxbcShaderTranslator::CompletePixelShader_WriteToROV() {
 
       // Go to the next sample (samples are at +0, +80, +1, +81, so need to do
       // +80, -79, +80 and -81 after each sample).
+      if (j + 1 < color_sample_count || color_sample_count == 4) {
+        system_constants_used_ |=
+            1ull << kSysConst_EdramResolutionSquareScale_Index;
+        DxbcOpIMAd(DxbcDest::R(system_temp_rov_params_, 0b1100),
+                   DxbcSrc::LI(0, 0, (j & 1) ? -78 - j : 80,
+                               ((j & 1) ? -78 - j : 80) * 2),
+                   DxbcSrc::CB(cbuffer_index_system_constants_,
+                               uint32_t(CbufferRegister::kSystemConstants),
+                               kSysConst_EdramResolutionSquareScale_Vec)
+                       .Select(kSysConst_EdramResolutionSquareScale_Comp),
+                   DxbcSrc::R(system_temp_rov_params_));
+      }
+    }
+    if (color_sample_count == 2) {
+      // Go back from the sample at +80 to the first one.
       system_constants_used_ |= 1ull
                                 << kSysConst_EdramResolutionSquareScale_Index;
       DxbcOpIMAd(DxbcDest::R(system_temp_rov_params_, 0b1100),
-                 DxbcSrc::LI(0, 0, (j & 1) ? -78 - j : 80,
-                             ((j & 1) ? -78 - j : 80) * 2),
+                 DxbcSrc::LI(0, 0, -80, -80 * 2),
                  DxbcSrc::CB(cbuffer_index_system_constants_,
                              uint32_t(CbufferRegister::kSystemConstants),
                              kSysConst_EdramResolutionSquareScale_Vec)
@@ -20,6 +20,21 @@ DEFINE_path(
 
 DEFINE_bool(vsync, true, "Enable VSYNC.", "GPU");
 
+DEFINE_int32(
+    gpu_max_frames_in_flight, 3,
+    "Maximum number of frames submitted to the host GPU before the emulation "
+    "waits for the oldest of them to be completed (1 to 3). Lower values "
+    "reduce the input latency and make the frame times more consistent at the "
+    "cost of less overlap of the CPU and the GPU work.",
+    "GPU");
+
+DEFINE_bool(
+    gpu_parser_thread, false,
+    "Parse the ring buffer on a separate thread, validating the packets and "
+    "expanding predicates and indirect buffers ahead of execution, so the "
+    "command processor thread only has to execute the parsed commands.",
+    "GPU");
+
 DEFINE_bool(
     gpu_allow_invalid_fetch_constants, false,
     "Allow texture and vertex fetch constants with invalid type - generally "
@@ -18,6 +18,10 @@ DECLARE_path(dump_shaders);
 
 DECLARE_bool(vsync);
 
+DECLARE_int32(gpu_max_frames_in_flight);
+
+DECLARE_bool(gpu_parser_thread);
+
 DECLARE_bool(gpu_allow_invalid_fetch_constants);
 
 DECLARE_bool(half_pixel_offset);
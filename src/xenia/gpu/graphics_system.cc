@@ -11,6 +11,7 @@
 
 #include "xenia/base/byte_stream.h"
 #include "xenia/base/clock.h"
+#include "xenia/base/input_latency.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
@@ -99,8 +100,10 @@ X_STATUS GraphicsSystem::Setup(cpu::Processor* processor,
         [this]() { target_window_->Invalidate(); });
 
     // Watch for paint requests to do our swap.
-    target_window->on_painting.AddListener(
-        [this](xe::ui::UIEvent* e) { Swap(e); });
+    target_window->on_painting.AddListener([this](xe::ui::UIEvent* e) {
+      input_latency::RecordFrameTaken();
+      Swap(e);
+    });
 
     // Watch for context lost events.
     target_window->on_context_lost.AddListener(
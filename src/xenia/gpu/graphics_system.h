@@ -11,6 +11,7 @@
 #define XENIA_GPU_GRAPHICS_SYSTEM_H_
 
 #include <atomic>
+#include <filesystem>
 #include <memory>
 #include <string>
 #include <thread>
@@ -63,6 +64,12 @@ class GraphicsSystem {
 
   virtual void ClearCaches();
 
+  // Directory where host textures converted from guest data are stored across
+  // runs, or empty if they aren't.
+  virtual std::filesystem::path texture_disk_cache_root() const {
+    return std::filesystem::path();
+  }
+
   void InitializeShaderStorage(const std::filesystem::path& storage_root,
                                uint32_t title_id, bool blocking);
 
@@ -9,25 +9,119 @@
 
 #include "xenia/gpu/null/null_command_processor.h"
 
+#include <algorithm>
+#include <cstring>
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/hash.h"
+#include "xenia/base/math.h"
+#include "xenia/base/memory.h"
+#include "xenia/gpu/gpu_flags.h"
+#include "xenia/gpu/sampler_info.h"
+#include "xenia/gpu/texture_info.h"
+
+DEFINE_bool(null_gpu_process_draws, false,
+            "Process the state and resources of draws with the null GPU "
+            "backend as the host backends do on the CPU, without making any "
+            "host graphics API calls, for measuring the CPU cost of the "
+            "emulated GPU apart from the driver.",
+            "GPU");
+
 namespace xe {
 namespace gpu {
 namespace null {
 
+namespace {
+
+// Only gathers the bindings of the shaders, there's no host shader code.
+class NullShaderTranslator : public ShaderTranslator {};
+
+// Registers the host backends derive pipeline state objects from.
+constexpr uint32_t kPipelineRegisters[] = {
+    XE_GPU_REG_RB_SURFACE_INFO,  XE_GPU_REG_RB_COLOR_INFO,
+    XE_GPU_REG_RB_DEPTH_INFO,    XE_GPU_REG_RB_COLOR1_INFO,
+    XE_GPU_REG_RB_COLOR2_INFO,   XE_GPU_REG_RB_COLOR3_INFO,
+    XE_GPU_REG_RB_COLOR_MASK,    XE_GPU_REG_SQ_PROGRAM_CNTL,
+    XE_GPU_REG_SQ_CONTEXT_MISC,  XE_GPU_REG_RB_DEPTHCONTROL,
+    XE_GPU_REG_RB_BLENDCONTROL0, XE_GPU_REG_RB_COLORCONTROL,
+    XE_GPU_REG_PA_CL_CLIP_CNTL,  XE_GPU_REG_PA_SU_SC_MODE_CNTL,
+    XE_GPU_REG_PA_CL_VTE_CNTL,   XE_GPU_REG_RB_MODECONTROL,
+    XE_GPU_REG_RB_BLENDCONTROL1, XE_GPU_REG_RB_BLENDCONTROL2,
+    XE_GPU_REG_RB_BLENDCONTROL3, XE_GPU_REG_VGT_HOS_CNTL,
+};
+
+// Bits of the pages from page_first to page_last in the 64-page block.
+uint64_t GetBlockPageBits(uint32_t block, uint32_t page_first,
+                          uint32_t page_last) {
+  uint64_t bits = UINT64_MAX;
+  if (block == (page_first >> 6)) {
+    bits &= ~((uint64_t(1) << (page_first & 63)) - 1);
+  }
+  if (block == (page_last >> 6) && (page_last & 63) != 63) {
+    bits &= (uint64_t(1) << ((page_last & 63) + 1)) - 1;
+  }
+  return bits;
+}
+
+}  // namespace
+
 NullCommandProcessor::NullCommandProcessor(NullGraphicsSystem* graphics_system,
                                            kernel::KernelState* kernel_state)
     : CommandProcessor(graphics_system, kernel_state) {}
 NullCommandProcessor::~NullCommandProcessor() = default;
 
 void NullCommandProcessor::TracePlaybackWroteMemory(uint32_t base_ptr,
-                                                    uint32_t length) {}
+                                                    uint32_t length) {
+  if (process_draws_) {
+    MemoryInvalidationCallback(base_ptr, length, true);
+  }
+}
 
 void NullCommandProcessor::RestoreEdramSnapshot(const void* snapshot) {}
 
 bool NullCommandProcessor::SetupContext() {
-  return CommandProcessor::SetupContext();
+  if (!CommandProcessor::SetupContext()) {
+    return false;
+  }
+
+  process_draws_ = cvars::null_gpu_process_draws;
+  if (!process_draws_) {
+    return true;
+  }
+
+  shader_translator_ = std::make_unique<NullShaderTranslator>();
+
+  page_size_log2_ = xe::log2_ceil(uint32_t(xe::memory::page_size()));
+  valid_pages_.clear();
+  valid_pages_.resize(((kBufferSize >> page_size_log2_) + 63) >> 6);
+  memory_invalidation_callback_handle_ =
+      memory_->RegisterPhysicalMemoryInvalidationCallback(
+          MemoryInvalidationCallbackThunk, this);
+
+  for (uint32_t pipeline_register : kPipelineRegisters) {
+    AddRegistersToGroup(kRegisterGroupPipeline, pipeline_register,
+                        pipeline_register);
+  }
+  last_pipeline_.valid = false;
+
+  return true;
 }
 
 void NullCommandProcessor::ShutdownContext() {
+  if (memory_invalidation_callback_handle_) {
+    memory_->UnregisterPhysicalMemoryInvalidationCallback(
+        memory_invalidation_callback_handle_);
+    memory_invalidation_callback_handle_ = nullptr;
+  }
+  valid_pages_.clear();
+
+  samplers_.clear();
+  textures_.clear();
+  pipelines_.clear();
+  last_pipeline_.valid = false;
+  shaders_.clear();
+  shader_translator_.reset();
+
   return CommandProcessor::ShutdownContext();
 }
 
@@ -39,13 +133,71 @@ Shader* NullCommandProcessor::LoadShader(xenos::ShaderType shader_type,
                                          uint32_t guest_address,
                                          const uint32_t* host_address,
                                          uint32_t dword_count) {
-  return nullptr;
+  if (!process_draws_) {
+    return nullptr;
+  }
+  uint64_t data_hash =
+      xe::hash::Hash64(host_address, dword_count * sizeof(uint32_t));
+  auto it = shaders_.find(data_hash);
+  if (it != shaders_.end()) {
+    return it->second.get();
+  }
+  auto shader = std::make_unique<Shader>(shader_type, data_hash, host_address,
+                                         dword_count);
+  shader_translator_->GatherAllBindingInformation(shader.get());
+  Shader* shader_ptr = shader.get();
+  shaders_.emplace(data_hash, std::move(shader));
+  return shader_ptr;
 }
 
 bool NullCommandProcessor::IssueDraw(xenos::PrimitiveType prim_type,
                                      uint32_t index_count,
                                      IndexBufferInfo* index_buffer_info,
                                      bool major_mode_explicit) {
+  if (!process_draws_) {
+    return true;
+  }
+  auto& regs = *register_file_;
+
+  xenos::ModeControl enable_mode = regs.Get<reg::RB_MODECONTROL>().edram_mode;
+  if (enable_mode == xenos::ModeControl::kIgnore) {
+    return true;
+  }
+  if (enable_mode == xenos::ModeControl::kCopy) {
+    BenchmarkTimingScope benchmark_timing_scope(
+        benchmark_counters_, benchmark_counters_.resolve_ticks);
+    benchmark_counters_.CountResolve();
+    return IssueCopy();
+  }
+
+  Shader* vertex_shader = active_vertex_shader();
+  Shader* pixel_shader = active_pixel_shader();
+  if (!vertex_shader) {
+    return false;
+  }
+  if (enable_mode == xenos::ModeControl::kDepth) {
+    pixel_shader = nullptr;
+  } else if (!pixel_shader) {
+    return false;
+  }
+
+  bool indexed = index_buffer_info != nullptr && index_buffer_info->guest_base;
+  if (!UpdatePipeline(
+          vertex_shader, pixel_shader, prim_type,
+          indexed ? index_buffer_info->format : xenos::IndexFormat::kInt16)) {
+    return false;
+  }
+  if (!UpdateTextures(vertex_shader) ||
+      (pixel_shader && !UpdateTextures(pixel_shader))) {
+    return false;
+  }
+  if (!UpdateVertexBuffers(vertex_shader)) {
+    return false;
+  }
+  if (indexed) {
+    RequestRange(index_buffer_info->guest_base & 0x1FFFFFFF,
+                 uint32_t(index_buffer_info->length));
+  }
   return true;
 }
 
@@ -55,6 +207,161 @@ void NullCommandProcessor::InitializeTrace() {}
 
 void NullCommandProcessor::FinalizeTrace() {}
 
+bool NullCommandProcessor::UpdatePipeline(Shader* vertex_shader,
+                                          Shader* pixel_shader,
+                                          xenos::PrimitiveType primitive_type,
+                                          xenos::IndexFormat index_format) {
+  // Runs of draws with only the constants changed between them are common,
+  // like in the host backends, the key is only rebuilt when it may change.
+  LastPipeline& last_pipeline = last_pipeline_;
+  if (!ConsumeRegisterGroupsDirty(uint32_t(1) << kRegisterGroupPipeline) &&
+      last_pipeline.valid && last_pipeline.vertex_shader == vertex_shader &&
+      last_pipeline.pixel_shader == pixel_shader &&
+      last_pipeline.primitive_type == primitive_type &&
+      last_pipeline.index_format == index_format) {
+    return true;
+  }
+
+  struct PipelineKey {
+    uint64_t vertex_shader_hash;
+    uint64_t pixel_shader_hash;
+    uint32_t primitive_type;
+    uint32_t index_format;
+    uint32_t registers[xe::countof(kPipelineRegisters)];
+  };
+  PipelineKey key;
+  std::memset(&key, 0, sizeof(key));
+  key.vertex_shader_hash = vertex_shader->ucode_data_hash();
+  key.pixel_shader_hash = pixel_shader ? pixel_shader->ucode_data_hash() : 0;
+  key.primitive_type = uint32_t(primitive_type);
+  key.index_format = uint32_t(index_format);
+  const RegisterFile& regs = *register_file_;
+  for (size_t i = 0; i < xe::countof(kPipelineRegisters); ++i) {
+    key.registers[i] = regs.values[kPipelineRegisters[i]].u32;
+  }
+  if (pipelines_.insert(xe::hash::Hash64(&key, sizeof(key))).second) {
+    benchmark_counters_.CountPipelineCreation();
+  }
+
+  last_pipeline.valid = true;
+  last_pipeline.vertex_shader = vertex_shader;
+  last_pipeline.pixel_shader = pixel_shader;
+  last_pipeline.primitive_type = primitive_type;
+  last_pipeline.index_format = index_format;
+  return true;
+}
+
+bool NullCommandProcessor::UpdateTextures(const Shader* shader) {
+  const RegisterFile& regs = *register_file_;
+  for (const Shader::TextureBinding& binding : shader->texture_bindings()) {
+    const auto& fetch = regs.Get<xenos::xe_gpu_texture_fetch_t>(
+        XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0 + binding.fetch_constant * 6);
+    // The host backends bind a null texture for invalid fetch constants.
+    if (fetch.type != xenos::FetchConstantType::kTexture &&
+        (fetch.type != xenos::FetchConstantType::kInvalidTexture ||
+         !cvars::gpu_allow_invalid_fetch_constants)) {
+      continue;
+    }
+    TextureInfo texture_info;
+    SamplerInfo sampler_info;
+    if (!TextureInfo::Prepare(fetch, &texture_info) ||
+        !SamplerInfo::Prepare(fetch, binding.fetch_instr, &sampler_info)) {
+      continue;
+    }
+    samplers_.insert(sampler_info.hash());
+    const TextureMemoryInfo& texture_memory = texture_info.memory;
+    uint32_t modified_bytes =
+        RequestRange(texture_memory.base_address, texture_memory.base_size) +
+        RequestRange(texture_memory.mip_address, texture_memory.mip_size);
+    // Textures are loaded when they're first used and when their memory has
+    // been modified since that.
+    if (textures_.insert(texture_info.hash()).second || modified_bytes) {
+      benchmark_counters_.CountTextureUpload(
+          uint64_t(texture_memory.base_size) + texture_memory.mip_size);
+    }
+  }
+  return true;
+}
+
+bool NullCommandProcessor::UpdateVertexBuffers(const Shader* vertex_shader) {
+  const RegisterFile& regs = *register_file_;
+  uint64_t vertex_buffers_requested[2] = {};
+  for (const auto& vertex_binding : vertex_shader->vertex_bindings()) {
+    uint32_t vfetch_index = vertex_binding.fetch_constant;
+    if (vertex_buffers_requested[vfetch_index >> 6] &
+        (uint64_t(1) << (vfetch_index & 63))) {
+      continue;
+    }
+    vertex_buffers_requested[vfetch_index >> 6] |= uint64_t(1)
+                                                   << (vfetch_index & 63);
+    const auto& vfetch_constant = regs.Get<xenos::xe_gpu_vertex_fetch_t>(
+        XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0 + vfetch_index * 2);
+    switch (vfetch_constant.type) {
+      case xenos::FetchConstantType::kVertex:
+        break;
+      case xenos::FetchConstantType::kInvalidVertex:
+        if (cvars::gpu_allow_invalid_fetch_constants) {
+          break;
+        }
+        return false;
+      default:
+        return false;
+    }
+    RequestRange(vfetch_constant.address << 2, vfetch_constant.size << 2);
+  }
+  return true;
+}
+
+uint32_t NullCommandProcessor::RequestRange(uint32_t start, uint32_t length) {
+  if (length == 0 || start >= kBufferSize) {
+    return 0;
+  }
+  length = std::min(length, kBufferSize - start);
+  uint32_t page_first = start >> page_size_log2_;
+  uint32_t page_last = (start + length - 1) >> page_size_log2_;
+  uint32_t modified_pages = 0;
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    for (uint32_t i = page_first >> 6; i <= (page_last >> 6); ++i) {
+      uint64_t page_bits = GetBlockPageBits(i, page_first, page_last);
+      modified_pages += xe::bit_count(page_bits & ~valid_pages_[i]);
+      valid_pages_[i] |= page_bits;
+    }
+  }
+  if (!modified_pages) {
+    return 0;
+  }
+  memory_->EnablePhysicalMemoryAccessCallbacks(
+      page_first << page_size_log2_,
+      (page_last - page_first + 1) << page_size_log2_, true, false);
+  return modified_pages << page_size_log2_;
+}
+
+std::pair<uint32_t, uint32_t>
+NullCommandProcessor::MemoryInvalidationCallbackThunk(
+    void* context_ptr, uint32_t physical_address_start, uint32_t length,
+    bool exact_range) {
+  return reinterpret_cast<NullCommandProcessor*>(context_ptr)
+      ->MemoryInvalidationCallback(physical_address_start, length, exact_range);
+}
+
+std::pair<uint32_t, uint32_t> NullCommandProcessor::MemoryInvalidationCallback(
+    uint32_t physical_address_start, uint32_t length, bool exact_range) {
+  if (length == 0 || physical_address_start >= kBufferSize) {
+    return std::make_pair(uint32_t(0), UINT32_MAX);
+  }
+  length = std::min(length, kBufferSize - physical_address_start);
+  uint32_t page_first = physical_address_start >> page_size_log2_;
+  uint32_t page_last =
+      (physical_address_start + length - 1) >> page_size_log2_;
+  auto global_lock = global_critical_region_.Acquire();
+  for (uint32_t i = page_first >> 6; i <= (page_last >> 6); ++i) {
+    valid_pages_[i] &= ~GetBlockPageBits(i, page_first, page_last);
+  }
+  return std::make_pair(page_first << page_size_log2_,
+                        (page_last - page_first + 1) << page_size_log2_);
+}
+
 }  // namespace null
 }  // namespace gpu
-}  // namespace xe
\ No newline at end of file
+}  // namespace xe
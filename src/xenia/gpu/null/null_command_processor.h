@@ -10,8 +10,18 @@
 #ifndef XENIA_GPU_NULL_NULL_COMMAND_PROCESSOR_H_
 #define XENIA_GPU_NULL_NULL_COMMAND_PROCESSOR_H_
 
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "xenia/base/mutex.h"
 #include "xenia/gpu/command_processor.h"
 #include "xenia/gpu/null/null_graphics_system.h"
+#include "xenia/gpu/shader.h"
+#include "xenia/gpu/shader_translator.h"
 #include "xenia/gpu/xenos.h"
 #include "xenia/kernel/kernel_state.h"
 
@@ -19,6 +29,12 @@ namespace xe {
 namespace gpu {
 namespace null {
 
+// Without --null_gpu_process_draws, draws and resolves are dropped. With it,
+// the state and resources of every draw are processed the way the host
+// backends do it on the CPU - shaders are analyzed, pipeline and texture keys
+// are computed and looked up, and the guest memory used by the draw is
+// watched for invalidation - but no host graphics API calls are made, so the
+// CPU cost of the emulated GPU can be measured apart from the driver cost.
 class NullCommandProcessor : public CommandProcessor {
  public:
   NullCommandProcessor(NullGraphicsSystem* graphics_system,
@@ -47,6 +63,56 @@ class NullCommandProcessor : public CommandProcessor {
 
   void InitializeTrace() override;
   void FinalizeTrace() override;
+
+  // Groups of the registers the pipeline key is derived from.
+  enum RegisterGroup : uint32_t {
+    kRegisterGroupPipeline,
+  };
+
+  bool UpdatePipeline(Shader* vertex_shader, Shader* pixel_shader,
+                      xenos::PrimitiveType primitive_type,
+                      xenos::IndexFormat index_format);
+  bool UpdateTextures(const Shader* shader);
+  bool UpdateVertexBuffers(const Shader* vertex_shader);
+
+  // Makes the pages of the physical memory range valid, watching the ones that
+  // weren't for invalidation, and returns the number of bytes that would have
+  // to be uploaded to a host copy of the memory.
+  uint32_t RequestRange(uint32_t start, uint32_t length);
+
+  static std::pair<uint32_t, uint32_t> MemoryInvalidationCallbackThunk(
+      void* context_ptr, uint32_t physical_address_start, uint32_t length,
+      bool exact_range);
+  std::pair<uint32_t, uint32_t> MemoryInvalidationCallback(
+      uint32_t physical_address_start, uint32_t length, bool exact_range);
+
+  bool process_draws_ = false;
+
+  std::unique_ptr<ShaderTranslator> shader_translator_;
+  std::unordered_map<uint64_t, std::unique_ptr<Shader>> shaders_;
+
+  struct LastPipeline {
+    bool valid = false;
+    Shader* vertex_shader;
+    Shader* pixel_shader;
+    xenos::PrimitiveType primitive_type;
+    xenos::IndexFormat index_format;
+  };
+  LastPipeline last_pipeline_;
+  std::unordered_set<uint64_t> pipelines_;
+
+  std::unordered_set<uint64_t> textures_;
+  std::unordered_set<uint64_t> samplers_;
+
+  // Physical memory validity, one bit per system page, as in the shared memory
+  // of the host backends.
+  static constexpr uint32_t kBufferSizeLog2 = 29;
+  static constexpr uint32_t kBufferSize = 1 << kBufferSizeLog2;
+  uint32_t page_size_log2_ = 0;
+  xe::global_critical_region global_critical_region_;
+  // Protected by global_critical_region_.
+  std::vector<uint64_t> valid_pages_;
+  void* memory_invalidation_callback_handle_ = nullptr;
 };
 
 }  // namespace null
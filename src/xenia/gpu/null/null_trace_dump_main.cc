@@ -0,0 +1,42 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/logging.h"
+#include "xenia/base/main.h"
+#include "xenia/gpu/null/null_graphics_system.h"
+#include "xenia/gpu/trace_dump.h"
+
+namespace xe {
+namespace gpu {
+namespace null {
+
+// Nothing is rendered, only useful with --trace_dump_benchmark_iterations and
+// --null_gpu_process_draws for measuring the CPU cost of command processing.
+class NullTraceDump : public TraceDump {
+ public:
+  std::unique_ptr<gpu::GraphicsSystem> CreateGraphicsSystem() override {
+    return std::unique_ptr<gpu::GraphicsSystem>(new NullGraphicsSystem());
+  }
+
+  void BeginHostCapture() override {}
+
+  void EndHostCapture() override {}
+};
+
+int trace_dump_main(const std::vector<std::string>& args) {
+  NullTraceDump trace_dump;
+  return trace_dump.Main(args);
+}
+
+}  // namespace null
+}  // namespace gpu
+}  // namespace xe
+
+DEFINE_ENTRY_POINT("xenia-gpu-null-trace-dump", xe::gpu::null::trace_dump_main,
+                   "some.trace", "target_trace_file");
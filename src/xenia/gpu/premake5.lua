@@ -39,6 +39,7 @@ project("xenia-gpu-shader-compiler")
     "xenia-base",
     "xenia-gpu",
     "xenia-ui-spirv",
+    "xxhash",
   })
   defines({
   })
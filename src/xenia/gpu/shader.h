@@ -760,6 +760,7 @@ class Shader {
 
  protected:
   friend class ShaderTranslator;
+  friend class SpirvShaderBinaryCache;
 
   xenos::ShaderType shader_type_;
   HostVertexShaderType host_vertex_shader_type_ = HostVertexShaderType::kVertex;
@@ -7,18 +7,29 @@
  ******************************************************************************
  */
 
+#include <algorithm>
+#include <atomic>
 #include <cinttypes>
 #include <cstring>
+#include <filesystem>
+#include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "third_party/fmt/include/fmt/format.h"
+#include "third_party/xxhash/xxhash.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/main.h"
 #include "xenia/base/platform.h"
 #include "xenia/base/string.h"
+#include "xenia/base/threading.h"
 #include "xenia/gpu/dxbc_shader_translator.h"
 #include "xenia/gpu/shader_translator.h"
+#include "xenia/gpu/spirv_shader_binary_cache.h"
 #include "xenia/gpu/spirv_shader_translator.h"
 #include "xenia/ui/spirv/spirv_disassembler.h"
 
@@ -27,11 +38,18 @@
 #include "xenia/ui/d3d12/d3d12_api.h"
 #endif  // XE_PLATFORM_WIN32
 
-DEFINE_path(shader_input, "", "Input shader binary file path.", "GPU");
+DEFINE_path(shader_input, "",
+            "Input shader binary file path, or a directory to translate all "
+            "the .vs and .ps files in (recursively) in batch mode.",
+            "GPU");
 DEFINE_string(shader_input_type, "",
               "'vs', 'ps', or unspecified to infer from the given filename.",
               "GPU");
-DEFINE_path(shader_output, "", "Output shader file path.", "GPU");
+DEFINE_path(shader_output, "",
+            "Output shader file path, or the directory to write the "
+            "translations to in batch mode (with the --shader_output_type "
+            "appended to the input file names).",
+            "GPU");
 DEFINE_string(shader_output_type, "ucode",
               "Translator to use: [ucode, spirv, spirvtext, dxbc, dxbctext].",
               "GPU");
@@ -46,105 +64,128 @@ DEFINE_bool(shader_output_bindless_resources, false,
 DEFINE_bool(shader_output_dxbc_rov, false,
             "Output ROV-based output-merger code in DXBC pixel shaders.",
             "GPU");
+DEFINE_path(shader_spirv_cache, "",
+            "Directory of the SPIR-V shader binary cache to look up and add "
+            "SPIR-V translations in, such as shaders/spirv in the Vulkan "
+            "backend's storage root.",
+            "GPU");
+DEFINE_int32(shader_compiler_threads, -1,
+             "Number of threads translating the shaders in batch mode, or -1 "
+             "to use all logical processors.",
+             "GPU");
+DEFINE_path(shader_compiler_report, "",
+            "CSV file to write the translation time, the output size and the "
+            "status of every shader to in batch mode.",
+            "GPU");
 
 namespace xe {
 namespace gpu {
 
-int shader_compiler_main(const std::vector<std::string>& args) {
-  xenos::ShaderType shader_type;
+static bool GetShaderType(const std::filesystem::path& path,
+                          xenos::ShaderType& shader_type_out) {
   if (!cvars::shader_input_type.empty()) {
     if (cvars::shader_input_type == "vs") {
-      shader_type = xenos::ShaderType::kVertex;
-    } else if (cvars::shader_input_type == "ps") {
-      shader_type = xenos::ShaderType::kPixel;
-    } else {
-      XELOGE("Invalid --shader_input_type; must be 'vs' or 'ps'.");
-      return 1;
+      shader_type_out = xenos::ShaderType::kVertex;
+      return true;
     }
-  } else {
-    bool valid_type = false;
-    if (cvars::shader_input.has_extension()) {
-      auto extension = cvars::shader_input.extension();
-      if (extension == ".vs") {
-        shader_type = xenos::ShaderType::kVertex;
-        valid_type = true;
-      } else if (extension == ".ps") {
-        shader_type = xenos::ShaderType::kPixel;
-        valid_type = true;
-      }
+    if (cvars::shader_input_type == "ps") {
+      shader_type_out = xenos::ShaderType::kPixel;
+      return true;
     }
-    if (!valid_type) {
-      XELOGE(
-          "File type not recognized (use .vs, .ps or "
-          "--shader_input_type=vs|ps).");
-      return 1;
+    return false;
+  }
+  if (path.has_extension()) {
+    auto extension = path.extension();
+    if (extension == ".vs") {
+      shader_type_out = xenos::ShaderType::kVertex;
+      return true;
+    }
+    if (extension == ".ps") {
+      shader_type_out = xenos::ShaderType::kPixel;
+      return true;
     }
   }
+  return false;
+}
 
-  auto input_file = filesystem::OpenFile(cvars::shader_input, "rb");
+static bool ReadUcode(const std::filesystem::path& path,
+                      std::vector<uint32_t>& ucode_dwords_out) {
+  auto input_file = filesystem::OpenFile(path, "rb");
   if (!input_file) {
-    XELOGE("Unable to open input file: {}",
-           xe::path_to_utf8(cvars::shader_input));
-    return 1;
+    return false;
   }
   fseek(input_file, 0, SEEK_END);
   size_t input_file_size = ftell(input_file);
   fseek(input_file, 0, SEEK_SET);
-  std::vector<uint32_t> ucode_dwords(input_file_size / 4);
-  fread(ucode_dwords.data(), 4, ucode_dwords.size(), input_file);
+  ucode_dwords_out.resize(input_file_size / 4);
+  fread(ucode_dwords_out.data(), 4, ucode_dwords_out.size(), input_file);
   fclose(input_file);
+  return true;
+}
 
-  XELOGI("Opened {} as a {} shader, {} words ({} bytes).",
-         xe::path_to_utf8(cvars::shader_input),
-         shader_type == xenos::ShaderType::kVertex ? "vertex" : "pixel",
-         ucode_dwords.size(), ucode_dwords.size() * 4);
-
-  // TODO(benvanik): hash? need to return the data to big-endian format first.
-  uint64_t ucode_data_hash = 0;
-  auto shader = std::make_unique<Shader>(
-      shader_type, ucode_data_hash, ucode_dwords.data(), ucode_dwords.size());
+static bool IsSpirvOutput() {
+  return cvars::shader_output_type == "spirv" ||
+         cvars::shader_output_type == "spirvtext";
+}
 
-  std::unique_ptr<ShaderTranslator> translator;
-  if (cvars::shader_output_type == "spirv" ||
-      cvars::shader_output_type == "spirvtext") {
-    translator = std::make_unique<SpirvShaderTranslator>();
-  } else if (cvars::shader_output_type == "dxbc" ||
-             cvars::shader_output_type == "dxbctext") {
-    translator = std::make_unique<DxbcShaderTranslator>(
+static std::unique_ptr<ShaderTranslator> CreateTranslator() {
+  if (IsSpirvOutput()) {
+    return std::make_unique<SpirvShaderTranslator>();
+  }
+  if (cvars::shader_output_type == "dxbc" ||
+      cvars::shader_output_type == "dxbctext") {
+    return std::make_unique<DxbcShaderTranslator>(
         0, cvars::shader_output_bindless_resources,
         cvars::shader_output_dxbc_rov);
-  } else {
-    translator = std::make_unique<UcodeShaderTranslator>();
   }
+  return std::make_unique<UcodeShaderTranslator>();
+}
 
-  Shader::HostVertexShaderType host_vertex_shader_type =
-      Shader::HostVertexShaderType::kVertex;
+static Shader::HostVertexShaderType GetHostVertexShaderType(
+    xenos::ShaderType shader_type) {
   if (shader_type == xenos::ShaderType::kVertex) {
     if (cvars::vertex_shader_output_type == "linedomaincp") {
-      host_vertex_shader_type =
-          Shader::HostVertexShaderType::kLineDomainCPIndexed;
+      return Shader::HostVertexShaderType::kLineDomainCPIndexed;
     } else if (cvars::vertex_shader_output_type == "linedomainpatch") {
-      host_vertex_shader_type =
-          Shader::HostVertexShaderType::kLineDomainPatchIndexed;
+      return Shader::HostVertexShaderType::kLineDomainPatchIndexed;
     } else if (cvars::vertex_shader_output_type == "triangledomaincp") {
-      host_vertex_shader_type =
-          Shader::HostVertexShaderType::kTriangleDomainCPIndexed;
+      return Shader::HostVertexShaderType::kTriangleDomainCPIndexed;
     } else if (cvars::vertex_shader_output_type == "triangledomainpatch") {
-      host_vertex_shader_type =
-          Shader::HostVertexShaderType::kTriangleDomainPatchIndexed;
+      return Shader::HostVertexShaderType::kTriangleDomainPatchIndexed;
     } else if (cvars::vertex_shader_output_type == "quaddomaincp") {
-      host_vertex_shader_type =
-          Shader::HostVertexShaderType::kQuadDomainCPIndexed;
+      return Shader::HostVertexShaderType::kQuadDomainCPIndexed;
     } else if (cvars::vertex_shader_output_type == "quaddomainpatch") {
-      host_vertex_shader_type =
-          Shader::HostVertexShaderType::kQuadDomainPatchIndexed;
+      return Shader::HostVertexShaderType::kQuadDomainPatchIndexed;
     }
   }
+  return Shader::HostVertexShaderType::kVertex;
+}
 
-  translator->Translate(shader.get(), host_vertex_shader_type);
+// Translates the shader and, for the text output types, disassembles the
+// result, returning whether the translation has succeeded. The output is
+// written even if it hasn't. Thread-safe as long as different translators are
+// used on different threads.
+static bool TranslateShader(
+    ShaderTranslator& translator, SpirvShaderBinaryCache* spirv_cache,
+    Shader& shader, Shader::HostVertexShaderType host_vertex_shader_type,
+    std::vector<uint8_t>& output_out,
+    uint64_t* translation_ticks_out = nullptr) {
+  uint64_t translation_start_ticks = Clock::QueryHostTickCount();
+  bool translated;
+  if (spirv_cache) {
+    translated =
+        spirv_cache->Translate(static_cast<SpirvShaderTranslator&>(translator),
+                               &shader, host_vertex_shader_type);
+  } else {
+    translated = translator.Translate(&shader, host_vertex_shader_type);
+  }
+  if (translation_ticks_out) {
+    *translation_ticks_out =
+        Clock::QueryHostTickCount() - translation_start_ticks;
+  }
 
-  const void* source_data = shader->translated_binary().data();
-  size_t source_data_size = shader->translated_binary().size();
+  const void* source_data = shader.translated_binary().data();
+  size_t source_data_size = shader.translated_binary().size();
 
   std::unique_ptr<xe::ui::spirv::SpirvDisassembler::Result> spirv_disasm_result;
   if (cvars::shader_output_type == "spirvtext") {
@@ -183,11 +224,8 @@ int shader_compiler_main(const std::vector<std::string>& args) {
   }
 #endif  // XE_PLATFORM_WIN32
 
-  if (!cvars::shader_output.empty()) {
-    auto output_file = filesystem::OpenFile(cvars::shader_output, "wb");
-    fwrite(source_data, 1, source_data_size, output_file);
-    fclose(output_file);
-  }
+  const uint8_t* source_bytes = reinterpret_cast<const uint8_t*>(source_data);
+  output_out.assign(source_bytes, source_bytes + source_data_size);
 
 #if XE_PLATFORM_WIN32
   if (dxbc_disasm_blob != nullptr) {
@@ -195,6 +233,235 @@ int shader_compiler_main(const std::vector<std::string>& args) {
   }
 #endif  // XE_PLATFORM_WIN32
 
+  return translated;
+}
+
+static bool WriteOutput(const std::filesystem::path& path,
+                        const std::vector<uint8_t>& output) {
+  auto output_file = filesystem::OpenFile(path, "wb");
+  if (!output_file) {
+    return false;
+  }
+  fwrite(output.data(), 1, output.size(), output_file);
+  fclose(output_file);
+  return true;
+}
+
+static int shader_compiler_batch_main() {
+  std::vector<std::filesystem::path> input_paths;
+  std::error_code error_code;
+  for (auto it = std::filesystem::recursive_directory_iterator(
+           cvars::shader_input, error_code);
+       !error_code && it != std::filesystem::recursive_directory_iterator();
+       it.increment(error_code)) {
+    xenos::ShaderType shader_type;
+    if (it->is_regular_file() && GetShaderType(it->path(), shader_type)) {
+      input_paths.push_back(it->path());
+    }
+  }
+  if (error_code) {
+    XELOGE("Failed to enumerate the shaders in {}",
+           xe::path_to_utf8(cvars::shader_input));
+    return 1;
+  }
+  // Deterministic report order.
+  std::sort(input_paths.begin(), input_paths.end());
+
+  struct Result {
+    bool read = false;
+    bool translated = false;
+    bool written = false;
+    uint64_t translation_ticks = 0;
+    size_t output_size = 0;
+  };
+  std::vector<Result> results(input_paths.size());
+
+  std::unique_ptr<SpirvShaderBinaryCache> spirv_cache;
+  if (!cvars::shader_spirv_cache.empty() && IsSpirvOutput()) {
+    spirv_cache =
+        std::make_unique<SpirvShaderBinaryCache>(cvars::shader_spirv_cache);
+  }
+
+  size_t thread_count;
+  if (cvars::shader_compiler_threads < 0) {
+    thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+  } else {
+    thread_count = std::max(uint32_t(cvars::shader_compiler_threads), 1u);
+  }
+  thread_count = std::max(std::min(thread_count, input_paths.size()),
+                          size_t(1));
+  XELOGI("Translating {} shaders on {} threads", input_paths.size(),
+         thread_count);
+
+  std::atomic<size_t> next_input{0};
+  auto translate_thread = [&]() {
+    // The translator is reused for all the shaders on the thread.
+    std::unique_ptr<ShaderTranslator> translator = CreateTranslator();
+    std::vector<uint32_t> ucode_dwords;
+    std::vector<uint8_t> output;
+    while (true) {
+      size_t input_index = next_input.fetch_add(1, std::memory_order_relaxed);
+      if (input_index >= input_paths.size()) {
+        break;
+      }
+      const std::filesystem::path& input_path = input_paths[input_index];
+      Result& result = results[input_index];
+      xenos::ShaderType shader_type;
+      GetShaderType(input_path, shader_type);
+      if (!ReadUcode(input_path, ucode_dwords)) {
+        XELOGE("Unable to open input file: {}", xe::path_to_utf8(input_path));
+        continue;
+      }
+      result.read = true;
+      uint64_t ucode_data_hash =
+          XXH64(ucode_dwords.data(), ucode_dwords.size() * sizeof(uint32_t), 0);
+      Shader shader(shader_type, ucode_data_hash, ucode_dwords.data(),
+                    ucode_dwords.size());
+      result.translated = TranslateShader(
+          *translator, spirv_cache.get(), shader,
+          GetHostVertexShaderType(shader_type), output,
+          &result.translation_ticks);
+      result.output_size = output.size();
+      if (!result.translated) {
+        XELOGE("Failed to translate {}", xe::path_to_utf8(input_path));
+      }
+      if (!cvars::shader_output.empty()) {
+        std::filesystem::path output_path =
+            cvars::shader_output /
+            std::filesystem::relative(input_path, cvars::shader_input);
+        output_path +=
+            xe::to_path("." + std::string(cvars::shader_output_type));
+        xe::filesystem::CreateParentFolder(output_path);
+        result.written = WriteOutput(output_path, output);
+        if (!result.written) {
+          XELOGE("Unable to write output file: {}",
+                 xe::path_to_utf8(output_path));
+        }
+      }
+    }
+  };
+
+  uint64_t batch_start_ticks = Clock::QueryHostTickCount();
+  std::vector<std::unique_ptr<xe::threading::Thread>> threads;
+  for (size_t i = 1; i < thread_count; ++i) {
+    std::unique_ptr<xe::threading::Thread> thread =
+        xe::threading::Thread::Create({}, translate_thread);
+    if (!thread) {
+      break;
+    }
+    thread->set_name("Shader Translation");
+    threads.push_back(std::move(thread));
+  }
+  translate_thread();
+  for (auto& thread : threads) {
+    xe::threading::Wait(thread.get(), false);
+  }
+  uint64_t batch_ticks = Clock::QueryHostTickCount() - batch_start_ticks;
+
+  uint64_t tick_frequency = Clock::QueryHostTickFrequency();
+  size_t failure_count = 0;
+  uint64_t translation_ticks = 0;
+  size_t output_size = 0;
+  FILE* report_file = nullptr;
+  if (!cvars::shader_compiler_report.empty()) {
+    report_file = filesystem::OpenFile(cvars::shader_compiler_report, "wb");
+    if (report_file) {
+      fputs("input,status,translation_us,output_bytes\n", report_file);
+    } else {
+      XELOGE("Unable to open the report file: {}",
+             xe::path_to_utf8(cvars::shader_compiler_report));
+    }
+  }
+  for (size_t i = 0; i < input_paths.size(); ++i) {
+    const Result& result = results[i];
+    const char* status;
+    if (!result.read) {
+      status = "unreadable";
+    } else if (!result.translated) {
+      status = "failed";
+    } else if (!cvars::shader_output.empty() && !result.written) {
+      status = "unwritable";
+    } else {
+      status = "ok";
+    }
+    if (!result.read || !result.translated ||
+        (!cvars::shader_output.empty() && !result.written)) {
+      ++failure_count;
+    }
+    translation_ticks += result.translation_ticks;
+    output_size += result.output_size;
+    if (report_file) {
+      fmt::print(report_file, "\"{}\",{},{},{}\n",
+                 xe::path_to_utf8(std::filesystem::relative(
+                     input_paths[i], cvars::shader_input)),
+                 status, result.translation_ticks * 1000000 / tick_frequency,
+                 result.output_size);
+    }
+  }
+  if (report_file) {
+    fclose(report_file);
+  }
+
+  XELOGI(
+      "Translated {} shaders ({} failed) in {} ms, {} ms of translation, {} "
+      "bytes of output",
+      input_paths.size(), failure_count, batch_ticks * 1000 / tick_frequency,
+      translation_ticks * 1000 / tick_frequency, output_size);
+  return failure_count ? 1 : 0;
+}
+
+int shader_compiler_main(const std::vector<std::string>& args) {
+  if (std::filesystem::is_directory(cvars::shader_input)) {
+    return shader_compiler_batch_main();
+  }
+
+  xenos::ShaderType shader_type;
+  if (!GetShaderType(cvars::shader_input, shader_type)) {
+    if (!cvars::shader_input_type.empty()) {
+      XELOGE("Invalid --shader_input_type; must be 'vs' or 'ps'.");
+    } else {
+      XELOGE(
+          "File type not recognized (use .vs, .ps or "
+          "--shader_input_type=vs|ps).");
+    }
+    return 1;
+  }
+
+  std::vector<uint32_t> ucode_dwords;
+  if (!ReadUcode(cvars::shader_input, ucode_dwords)) {
+    XELOGE("Unable to open input file: {}",
+           xe::path_to_utf8(cvars::shader_input));
+    return 1;
+  }
+
+  XELOGI("Opened {} as a {} shader, {} words ({} bytes).",
+         xe::path_to_utf8(cvars::shader_input),
+         shader_type == xenos::ShaderType::kVertex ? "vertex" : "pixel",
+         ucode_dwords.size(), ucode_dwords.size() * 4);
+
+  // The file contains the ucode in guest endianness, like the guest memory the
+  // hash is calculated for in the emulator.
+  uint64_t ucode_data_hash =
+      XXH64(ucode_dwords.data(), ucode_dwords.size() * sizeof(uint32_t), 0);
+  auto shader = std::make_unique<Shader>(
+      shader_type, ucode_data_hash, ucode_dwords.data(), ucode_dwords.size());
+
+  std::unique_ptr<ShaderTranslator> translator = CreateTranslator();
+
+  std::unique_ptr<SpirvShaderBinaryCache> spirv_cache;
+  if (!cvars::shader_spirv_cache.empty() && IsSpirvOutput()) {
+    spirv_cache =
+        std::make_unique<SpirvShaderBinaryCache>(cvars::shader_spirv_cache);
+  }
+
+  std::vector<uint8_t> output;
+  TranslateShader(*translator, spirv_cache.get(), *shader,
+                  GetHostVertexShaderType(shader_type), output);
+
+  if (!cvars::shader_output.empty()) {
+    WriteOutput(cvars::shader_output, output);
+  }
+
   return 0;
 }
 
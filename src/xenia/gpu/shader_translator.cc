@@ -10,13 +10,22 @@
 
 #include "xenia/gpu/shader_translator.h"
 
+#include <algorithm>
 #include <cstdarg>
 #include <set>
 #include <string>
 
+#include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 
+DEFINE_bool(shader_structured_control_flow, true,
+            "Translate the control flow of guest shaders to host if/else "
+            "blocks and loops when possible, rather than to a switch on the "
+            "program counter inside a loop, which host GPUs execute poorly. "
+            "Shaders with irreducible control flow always use the switch.",
+            "GPU");
+
 namespace xe {
 namespace gpu {
 
@@ -68,6 +77,9 @@ void ShaderTranslator::Reset() {
   memexport_eA_written_ = 0;
   std::memset(&memexport_eM_written_, 0, sizeof(memexport_eM_written_));
   memexport_stream_constants_.clear();
+  control_flow_structured_ = false;
+  structured_if_end_counts_.clear();
+  structured_else_jumps_.clear();
 }
 
 bool ShaderTranslator::GatherAllBindingInformation(Shader* shader) {
@@ -133,6 +145,7 @@ bool ShaderTranslator::TranslateInternal(
   // Run through and gather all binding, operand addressing and export
   // information. Translators may need this before they start codegen.
   uint32_t max_cf_dword_index = static_cast<uint32_t>(ucode_dword_count_);
+  std::vector<ControlFlowInstruction> cf_instructions;
   for (uint32_t i = 0; i < max_cf_dword_index; i += 3) {
     ControlFlowInstruction cf_a;
     ControlFlowInstruction cf_b;
@@ -148,6 +161,13 @@ bool ShaderTranslator::TranslateInternal(
 
     GatherInstructionInformation(cf_a);
     GatherInstructionInformation(cf_b);
+    cf_instructions.push_back(cf_a);
+    cf_instructions.push_back(cf_b);
+  }
+  // The same instructions as those that TranslateBlocks will process.
+  cf_instructions.resize(max_cf_dword_index / 3 * 2);
+  if (cvars::shader_structured_control_flow) {
+    AnalyzeControlFlowStructure(cf_instructions);
   }
 
   if (constant_register_map_.float_dynamic_addressing) {
@@ -556,6 +576,130 @@ void AddControlFlowTargetLabel(const ControlFlowInstruction& cf,
   }
 }
 
+void ShaderTranslator::AnalyzeControlFlowStructure(
+    const std::vector<ControlFlowInstruction>& cf_instructions) {
+  control_flow_structured_ = false;
+  structured_if_end_counts_.clear();
+  structured_else_jumps_.clear();
+
+  // A block in the control flow, from the instruction opening it to the index
+  // of the instruction it ends before.
+  struct StructuredBlock {
+    uint32_t begin;
+    uint32_t end;
+    // For `if` blocks with an alternative branch, the index of the jump that
+    // begins `else`, UINT32_MAX otherwise.
+    uint32_t else_jump;
+    bool is_loop;
+  };
+  std::vector<StructuredBlock> blocks;
+  std::set<uint32_t> loop_ends;
+  std::set<uint32_t> else_jumps;
+
+  uint32_t cf_count = uint32_t(cf_instructions.size());
+  bool shader_ended = false;
+  for (uint32_t i = 0; i < cf_count; ++i) {
+    const ControlFlowInstruction& cf = cf_instructions[i];
+    ControlFlowOpcode opcode = cf.opcode();
+    if (shader_ended && opcode != ControlFlowOpcode::kNop) {
+      // Can't break out of everything in the middle of the shader without a
+      // loop around the whole shader.
+      return;
+    }
+    switch (opcode) {
+      case ControlFlowOpcode::kLoopStart: {
+        // The loop must exit right after its loop_end, which must go back to
+        // right after the loop_start.
+        uint32_t loop_end = cf.loop_start.address() - 1;
+        if (cf.loop_start.address() <= i + 1 || loop_end >= cf_count ||
+            cf_instructions[loop_end].opcode() != ControlFlowOpcode::kLoopEnd ||
+            cf_instructions[loop_end].loop_end.address() != i + 1) {
+          return;
+        }
+        blocks.push_back({i, loop_end + 1, UINT32_MAX, true});
+        loop_ends.insert(loop_end);
+      } break;
+      case ControlFlowOpcode::kLoopEnd:
+        if (!loop_ends.count(i)) {
+          return;
+        }
+        break;
+      case ControlFlowOpcode::kCondJmp: {
+        if (else_jumps.count(i)) {
+          break;
+        }
+        uint32_t target = cf.cond_jmp.address();
+        if (cf.cond_jmp.is_unconditional() || target <= i ||
+            target > cf_count) {
+          // Backward jumps are loops not expressible as loop_start/loop_end,
+          // and unconditional jumps not skipping an alternative branch make
+          // the code after them reachable only through labels.
+          return;
+        }
+        // An unconditional forward jump right before the target skips the
+        // alternative branch.
+        uint32_t else_jump = UINT32_MAX;
+        uint32_t end = target;
+        if (target >= i + 2) {
+          const ControlFlowInstruction& cf_else = cf_instructions[target - 1];
+          if (cf_else.opcode() == ControlFlowOpcode::kCondJmp &&
+              cf_else.cond_jmp.is_unconditional() &&
+              cf_else.cond_jmp.address() > target &&
+              cf_else.cond_jmp.address() <= cf_count) {
+            else_jump = target - 1;
+            end = cf_else.cond_jmp.address();
+            else_jumps.insert(else_jump);
+          }
+        }
+        blocks.push_back({i, end, else_jump, false});
+      } break;
+      case ControlFlowOpcode::kCondCall:
+      case ControlFlowOpcode::kReturn:
+        // Subroutines need a return address stack.
+        return;
+      default:
+        break;
+    }
+    if (DoesControlFlowOpcodeEndShader(opcode)) {
+      shader_ended = true;
+    }
+  }
+
+  // The blocks are sorted by their beginning. Check that they are nested,
+  // with the blocks inside a loop ending before its loop_end, and the blocks
+  // inside an `if` with an alternative branch being entirely on one side of
+  // the `else` jump.
+  std::vector<const StructuredBlock*> block_stack;
+  for (const StructuredBlock& block : blocks) {
+    while (!block_stack.empty() && block_stack.back()->end <= block.begin) {
+      block_stack.pop_back();
+    }
+    if (!block_stack.empty()) {
+      const StructuredBlock& parent = *block_stack.back();
+      uint32_t parent_end = parent.end;
+      if (parent.is_loop) {
+        parent_end = parent.end - 1;
+      } else if (parent.else_jump != UINT32_MAX &&
+                 block.begin < parent.else_jump) {
+        parent_end = parent.else_jump;
+      }
+      if (block.end > parent_end) {
+        return;
+      }
+    }
+    block_stack.push_back(&block);
+  }
+
+  structured_if_end_counts_.resize(cf_count + 1, 0);
+  for (const StructuredBlock& block : blocks) {
+    if (!block.is_loop) {
+      ++structured_if_end_counts_[block.end];
+    }
+  }
+  structured_else_jumps_ = std::move(else_jumps);
+  control_flow_structured_ = true;
+}
+
 bool ShaderTranslator::TranslateBlocks() {
   // Control flow instructions come paired in blocks of 3 dwords and all are
   // listed at the top of the ucode.
@@ -113,6 +113,30 @@ class ShaderTranslator {
     return memexport_stream_constants_;
   }
 
+  // True if the control flow of the current shader has been recovered as
+  // nested if/else blocks (from forward conditional jumps, with unconditional
+  // jumps over the alternative branch becoming `else`) and loops (from
+  // loop_start/loop_end pairs not entered or exited by jumps), so it can be
+  // translated using structured host control flow instead of a program counter
+  // inside a loop. Determined before translation.
+  bool is_control_flow_structured() const { return control_flow_structured_; }
+  // In structured control flow, the number of `if` blocks, opened by jumps,
+  // closed right before the control flow instruction with the index, which is
+  // always a label if not zero. The `if` blocks ending after the last control
+  // flow instruction are closed at the end of the shader.
+  uint32_t GetStructuredIfEndCount(uint32_t cf_index) const {
+    return cf_index < structured_if_end_counts_.size()
+               ? structured_if_end_counts_[cf_index]
+               : 0;
+  }
+  // In structured control flow, whether the jump is the unconditional jump
+  // skipping the alternative branch of an `if`, translated as `else`. Other
+  // jumps in structured control flow open an `if` executed when the jump
+  // condition is not met.
+  bool IsStructuredElseJump(uint32_t cf_index) const {
+    return structured_else_jumps_.count(cf_index) != 0;
+  }
+
   // Current line number in the ucode disassembly.
   size_t ucode_disasm_line_number() const { return ucode_disasm_line_number_; }
   // Ucode disassembly buffer accumulated during translation.
@@ -200,6 +224,11 @@ class ShaderTranslator {
   void AppendUcodeDisasm(const char* value);
   void AppendUcodeDisasmFormat(const char* format, ...);
 
+  // Tries to recover structured control flow from the control flow
+  // instructions, setting control_flow_structured_ if successful.
+  void AnalyzeControlFlowStructure(
+      const std::vector<ucode::ControlFlowInstruction>& cf_instructions);
+
   bool TranslateBlocks();
   void GatherInstructionInformation(const ucode::ControlFlowInstruction& cf);
   void GatherVertexFetchInformation(const ucode::VertexFetchInstruction& op);
@@ -294,6 +323,11 @@ class ShaderTranslator {
   uint8_t memexport_eM_written_[kMaxMemExports] = {0};
   std::set<uint32_t> memexport_stream_constants_;
 
+  // Structured control flow info is gathered before translation.
+  bool control_flow_structured_ = false;
+  std::vector<uint32_t> structured_if_end_counts_;
+  std::set<uint32_t> structured_else_jumps_;
+
   static const AluOpcodeInfo alu_vector_opcode_infos_[0x20];
   static const AluOpcodeInfo alu_scalar_opcode_infos_[0x40];
 };
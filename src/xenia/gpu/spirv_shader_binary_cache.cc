@@ -0,0 +1,184 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/spirv_shader_binary_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <system_error>
+#include <utility>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/hash.h"
+#include "xenia/base/logging.h"
+#include "xenia/gpu/shader_translator.h"
+
+namespace xe {
+namespace gpu {
+
+namespace {
+
+struct BinaryHeader {
+  uint32_t magic;
+  uint32_t version;
+  // XXH64 of the SPIR-V following the header, to reject partially written
+  // files.
+  uint64_t binary_hash;
+};
+// 'XSPV'.
+constexpr uint32_t kBinaryMagic = 0x56505358;
+
+}  // namespace
+
+SpirvShaderBinaryCache::SpirvShaderBinaryCache(
+    const std::filesystem::path& directory)
+    : directory_(directory) {
+  std::error_code error_code;
+  std::filesystem::create_directories(directory_, error_code);
+  if (error_code) {
+    XELOGE("Failed to create the SPIR-V shader binary cache directory: {}",
+           xe::path_to_utf8(directory_));
+  }
+}
+
+bool SpirvShaderBinaryCache::Translate(
+    SpirvShaderTranslator& translator, Shader* shader,
+    reg::SQ_PROGRAM_CNTL cntl,
+    Shader::HostVertexShaderType host_vertex_shader_type) {
+  return TranslateInternal(translator, shader, &cntl, host_vertex_shader_type);
+}
+
+bool SpirvShaderBinaryCache::Translate(
+    SpirvShaderTranslator& translator, Shader* shader,
+    Shader::HostVertexShaderType host_vertex_shader_type) {
+  return TranslateInternal(translator, shader, nullptr,
+                           host_vertex_shader_type);
+}
+
+bool SpirvShaderBinaryCache::TranslateInternal(
+    SpirvShaderTranslator& translator, Shader* shader,
+    const reg::SQ_PROGRAM_CNTL* cntl,
+    Shader::HostVertexShaderType host_vertex_shader_type) {
+  std::filesystem::path binary_path = GetBinaryPath(
+      shader, cntl, host_vertex_shader_type, translator.bindless_textures(),
+      translator.optimization_level());
+
+  std::vector<uint8_t> binary;
+  if (LoadBinary(binary_path, binary)) {
+    // The shader information is gathered by the common translator code, so
+    // the ucode translator, which doesn't build any host code, is enough.
+    UcodeShaderTranslator ucode_translator;
+    bool gathered =
+        cntl ? ucode_translator.Translate(shader, *cntl,
+                                          host_vertex_shader_type)
+             : ucode_translator.Translate(shader, host_vertex_shader_type);
+    if (gathered) {
+      shader->translated_binary_ = std::move(binary);
+      return true;
+    }
+  }
+
+  bool translated =
+      cntl ? translator.Translate(shader, *cntl, host_vertex_shader_type)
+           : translator.Translate(shader, host_vertex_shader_type);
+  if (translated) {
+    StoreBinary(binary_path, shader->translated_binary());
+  }
+  return translated;
+}
+
+std::filesystem::path SpirvShaderBinaryCache::GetBinaryPath(
+    const Shader* shader, const reg::SQ_PROGRAM_CNTL* cntl,
+    Shader::HostVertexShaderType host_vertex_shader_type,
+    bool bindless_textures, uint32_t optimization_level) const {
+  struct {
+    uint64_t ucode_data_hash;
+    uint32_t version;
+    uint32_t shader_type;
+    uint32_t register_count;
+    uint32_t host_vertex_shader_type;
+    uint32_t bindless_textures;
+    uint32_t optimization_level;
+    uint32_t padding;
+  } key;
+  std::memset(&key, 0, sizeof(key));
+  key.ucode_data_hash = shader->ucode_data_hash();
+  key.version = kVersion;
+  key.shader_type = uint32_t(shader->type());
+  // Same as in ShaderTranslator::Translate.
+  key.register_count = 64;
+  if (cntl) {
+    uint32_t cntl_num_reg = shader->type() == xenos::ShaderType::kVertex
+                                ? cntl->vs_num_reg
+                                : cntl->ps_num_reg;
+    key.register_count = (cntl_num_reg & 0x80) ? 0 : (cntl_num_reg + 1);
+  }
+  key.host_vertex_shader_type = uint32_t(host_vertex_shader_type);
+  key.bindless_textures = uint32_t(bindless_textures);
+  key.optimization_level = optimization_level;
+  // The binary is found only by the name, so the key hash is 128-bit.
+  xe::hash::Hash128 key_hash = xe::hash::ContentHash128(&key, sizeof(key));
+  return directory_ /
+         fmt::format("{:016X}{:016X}.spv", key_hash.high, key_hash.low);
+}
+
+bool SpirvShaderBinaryCache::LoadBinary(const std::filesystem::path& path,
+                                        std::vector<uint8_t>& binary_out) {
+  std::error_code error_code;
+  uintmax_t file_size = std::filesystem::file_size(path, error_code);
+  if (error_code || file_size <= sizeof(BinaryHeader) ||
+      (file_size - sizeof(BinaryHeader)) % sizeof(uint32_t)) {
+    return false;
+  }
+  FILE* file = xe::filesystem::OpenFile(path, "rb");
+  if (!file) {
+    return false;
+  }
+  BinaryHeader header;
+  binary_out.resize(size_t(file_size - sizeof(BinaryHeader)));
+  bool read = fread(&header, sizeof(header), 1, file) &&
+              fread(binary_out.data(), binary_out.size(), 1, file);
+  fclose(file);
+  return read && header.magic == kBinaryMagic && header.version == kVersion &&
+         header.binary_hash ==
+             xe::hash::Hash64(binary_out.data(), binary_out.size());
+}
+
+void SpirvShaderBinaryCache::StoreBinary(const std::filesystem::path& path,
+                                         const std::vector<uint8_t>& binary) {
+  if (binary.empty()) {
+    return;
+  }
+  // Write to a temporary file first so other processes don't see a partial
+  // binary (which would only be rejected by the hash check anyway).
+  std::filesystem::path temp_path = path;
+  temp_path += ".tmp";
+  FILE* file = xe::filesystem::OpenFile(temp_path, "wb");
+  if (!file) {
+    return;
+  }
+  BinaryHeader header;
+  header.magic = kBinaryMagic;
+  header.version = kVersion;
+  header.binary_hash = xe::hash::Hash64(binary.data(), binary.size());
+  bool written = fwrite(&header, sizeof(header), 1, file) &&
+                 fwrite(binary.data(), binary.size(), 1, file);
+  fclose(file);
+  std::error_code error_code;
+  if (written) {
+    std::filesystem::rename(temp_path, path, error_code);
+  }
+  if (!written || error_code) {
+    std::filesystem::remove(temp_path, error_code);
+  }
+}
+
+}  // namespace gpu
+}  // namespace xe
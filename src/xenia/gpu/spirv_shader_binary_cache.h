@@ -0,0 +1,68 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_SPIRV_SHADER_BINARY_CACHE_H_
+#define XENIA_GPU_SPIRV_SHADER_BINARY_CACHE_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "xenia/gpu/registers.h"
+#include "xenia/gpu/shader.h"
+#include "xenia/gpu/spirv_shader_translator.h"
+
+namespace xe {
+namespace gpu {
+
+// Content-addressed storage of SpirvShaderTranslator output, one file per
+// translation named after the hash of the guest ucode and the translation
+// options. On a hit, the shader information is still gathered from the ucode,
+// but without building the SPIR-V, which is taken from the file instead.
+// Thread-safe as long as different translators are used on different threads.
+class SpirvShaderBinaryCache {
+ public:
+  // Must be changed whenever the SPIR-V produced for the same ucode and
+  // options may change.
+  static constexpr uint32_t kVersion = 0x20261014;
+
+  explicit SpirvShaderBinaryCache(const std::filesystem::path& directory);
+
+  // Same as SpirvShaderTranslator::Translate, but with the binary from the
+  // cache if available. New valid binaries are written to the cache.
+  bool Translate(SpirvShaderTranslator& translator, Shader* shader,
+                 reg::SQ_PROGRAM_CNTL cntl,
+                 Shader::HostVertexShaderType host_vertex_shader_type =
+                     Shader::HostVertexShaderType::kVertex);
+  // Translates with no register count limit.
+  bool Translate(SpirvShaderTranslator& translator, Shader* shader,
+                 Shader::HostVertexShaderType host_vertex_shader_type =
+                     Shader::HostVertexShaderType::kVertex);
+
+ private:
+  bool TranslateInternal(SpirvShaderTranslator& translator, Shader* shader,
+                         const reg::SQ_PROGRAM_CNTL* cntl,
+                         Shader::HostVertexShaderType host_vertex_shader_type);
+
+  std::filesystem::path GetBinaryPath(
+      const Shader* shader, const reg::SQ_PROGRAM_CNTL* cntl,
+      Shader::HostVertexShaderType host_vertex_shader_type,
+      bool bindless_textures, uint32_t optimization_level) const;
+  static bool LoadBinary(const std::filesystem::path& path,
+                         std::vector<uint8_t>& binary_out);
+  static void StoreBinary(const std::filesystem::path& path,
+                          const std::vector<uint8_t>& binary);
+
+  std::filesystem::path directory_;
+};
+
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_SPIRV_SHADER_BINARY_CACHE_H_
@@ -16,6 +16,7 @@
 #include <vector>
 
 #include "third_party/fmt/include/fmt/format.h"
+#include "third_party/spirv-tools/include/spirv-tools/optimizer.hpp"
 #include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
@@ -24,6 +25,17 @@ DEFINE_bool(spv_validate, false, "Validate SPIR-V shaders after generation",
             "GPU");
 DEFINE_bool(spv_disasm, false, "Disassemble SPIR-V shaders after generation",
             "GPU");
+DEFINE_int32(spv_optimization_level, 2,
+             "Level of the optimization of the translated SPIR-V shaders. The "
+             "Xenos control flow is emulated with a loop over a switch with "
+             "local variables for the program counter, the predicate and the "
+             "loop state, which host drivers often compile poorly.\n"
+             " 0 = no optimization.\n"
+             " 1 = promote local variables to registers and remove dead "
+             "branches and code.\n"
+             " 2 = the above, plus inlining, loop unrolling and the "
+             "spirv-tools performance passes.",
+             "GPU");
 
 namespace xe {
 namespace gpu {
@@ -36,7 +48,12 @@ using spv::GLSLstd450;
 using spv::Id;
 using spv::Op;
 
-SpirvShaderTranslator::SpirvShaderTranslator() {}
+SpirvShaderTranslator::SpirvShaderTranslator(bool bindless_textures,
+                                             uint32_t resolution_scale)
+    : bindless_textures_(bindless_textures),
+      resolution_scale_(std::max(resolution_scale, uint32_t(1))),
+      optimization_level_(
+          uint32_t(std::min(std::max(cvars::spv_optimization_level, 0), 2))) {}
 SpirvShaderTranslator::~SpirvShaderTranslator() = default;
 
 void SpirvShaderTranslator::StartTranslation() {
@@ -133,9 +150,20 @@ void SpirvShaderTranslator::StartTranslation() {
                   4 * sizeof(uint32_t));
   b.addDecoration(bool_consts_type, spv::Decoration::DecorationArrayStride,
                   4 * sizeof(uint32_t));
-
-  Id consts_struct_type = b.makeStructType(
-      {float_consts_type, loop_consts_type, bool_consts_type}, "consts_type");
+  std::vector<Id> consts_member_types = {float_consts_type, loop_consts_type,
+                                         bool_consts_type};
+  if (bindless_textures_) {
+    // Descriptor indices for the 32 fetch constants.
+    Id texture_indices_type =
+        b.makeArrayType(vec4_uint_type_, b.makeUintConstant(8), 1);
+    b.addDecoration(texture_indices_type,
+                    spv::Decoration::DecorationArrayStride,
+                    4 * sizeof(uint32_t));
+    consts_member_types.push_back(texture_indices_type);
+  }
+
+  Id consts_struct_type =
+      b.makeStructType(consts_member_types, "consts_type");
   b.addDecoration(consts_struct_type, spv::Decoration::DecorationBlock);
 
   // Constants member decorations.
@@ -153,6 +181,13 @@ void SpirvShaderTranslator::StartTranslation() {
                         512 * 4 * sizeof(float) + 32 * sizeof(uint32_t));
   b.addMemberName(consts_struct_type, 2, "bool_consts");
 
+  if (bindless_textures_) {
+    b.addMemberDecoration(
+        consts_struct_type, 3, spv::Decoration::DecorationOffset,
+        512 * 4 * sizeof(float) + 32 * sizeof(uint32_t) + 8 * sizeof(uint32_t));
+    b.addMemberName(consts_struct_type, 3, "texture_indices");
+  }
+
   consts_ = b.createVariable(spv::StorageClass::StorageClassUniform,
                              consts_struct_type, "consts");
 
@@ -220,10 +255,14 @@ void SpirvShaderTranslator::StartTranslation() {
                   b.makeSampledImageType(image_cube_type_)};
 
     uint32_t num_tex_bindings = 0;
-    for (const auto& binding : texture_bindings()) {
-      // Calculate the highest binding index.
-      num_tex_bindings =
-          std::max(num_tex_bindings, uint32_t(binding.binding_index + 1));
+    if (bindless_textures_) {
+      num_tex_bindings = kSpirvBindlessTextureCount;
+    } else {
+      for (const auto& binding : texture_bindings()) {
+        // Calculate the highest binding index.
+        num_tex_bindings =
+            std::max(num_tex_bindings, uint32_t(binding.binding_index + 1));
+      }
     }
 
     Id tex_a_t[] = {
@@ -405,9 +444,22 @@ void SpirvShaderTranslator::StartTranslation() {
 
     interface_ids_.push_back(frag_coord);
 
+    spv::Id frag_coord_value = b.createLoad(frag_coord);
+    if (resolution_scale_ > 1) {
+      // The shader expects the position in guest pixels.
+      float inv_scale = 1.0f / float(resolution_scale_);
+      frag_coord_value = b.createBinOp(
+          spv::Op::OpFMul, vec4_float_type_, frag_coord_value,
+          b.makeCompositeConstant(
+              vec4_float_type_,
+              std::vector<Id>({b.makeFloatConstant(inv_scale),
+                               b.makeFloatConstant(inv_scale),
+                               b.makeFloatConstant(1.0f),
+                               b.makeFloatConstant(1.0f)})));
+    }
     auto param = b.createOp(
         spv::Op::OpVectorShuffle, vec4_float_type_,
-        {b.createLoad(frag_coord), b.createLoad(point_coord_), 0, 1, 4, 5});
+        {frag_coord_value, b.createLoad(point_coord_), 0, 1, 4, 5});
     /*
     // TODO: gl_FrontFacing
     auto param_x = b.createCompositeExtract(param, float_type_, 0);
@@ -648,6 +700,7 @@ std::vector<uint8_t> SpirvShaderTranslator::CompleteTranslation() {
 
   std::vector<uint32_t> spirv_words;
   b.dump(spirv_words);
+  OptimizeSpirv(spirv_words);
 
   // Cleanup builder.
   cf_blocks_.clear();
@@ -667,6 +720,53 @@ std::vector<uint8_t> SpirvShaderTranslator::CompleteTranslation() {
   return spirv_bytes;
 }
 
+void SpirvShaderTranslator::OptimizeSpirv(
+    std::vector<uint32_t>& spirv_words) const {
+  if (!optimization_level_) {
+    return;
+  }
+  spvtools::Optimizer optimizer(SPV_ENV_VULKAN_1_0);
+  optimizer.SetMessageConsumer(
+      [](spv_message_level_t level, const char* source,
+         const spv_position_t& position, const char* message) {
+        if (level <= SPV_MSG_ERROR) {
+          XELOGE("SPIR-V optimizer error at {}: {}", position.index, message);
+        }
+      });
+  if (optimization_level_ >= 2) {
+    // The cube and bitfield helpers are separate functions, inline them so the
+    // other passes can work on the whole shader.
+    optimizer.RegisterPass(spvtools::CreateMergeReturnPass())
+        .RegisterPass(spvtools::CreateInlineExhaustivePass());
+  }
+  // The program counter, predicate, loop counters and registers are function
+  // variables. Promote the ones that can be promoted to SSA values (like
+  // mem2reg), fold the constant program counter jumps, and drop the branches
+  // and instructions that become dead.
+  optimizer.RegisterPass(spvtools::CreateLocalAccessChainConvertPass())
+      .RegisterPass(spvtools::CreateLocalSingleBlockLoadStoreElimPass())
+      .RegisterPass(spvtools::CreateLocalSingleStoreElimPass())
+      .RegisterPass(spvtools::CreateLocalMultiStoreElimPass())
+      .RegisterPass(spvtools::CreateCCPPass())
+      .RegisterPass(spvtools::CreateDeadBranchElimPass())
+      .RegisterPass(spvtools::CreateAggressiveDCEPass())
+      .RegisterPass(spvtools::CreateCFGCleanupPass());
+  if (optimization_level_ >= 2) {
+    // Fully unroll the loops with constant trip counts (the loop over the
+    // control flow itself is never unrolled as its exit isn't constant), then
+    // clean up with the regular performance passes.
+    optimizer.RegisterPass(spvtools::CreateLoopUnrollPass(true))
+        .RegisterPerformancePasses();
+  }
+  std::vector<uint32_t> optimized_words;
+  if (!optimizer.Run(spirv_words.data(), spirv_words.size(),
+                     &optimized_words)) {
+    XELOGE("Failed to optimize a SPIR-V shader, using the unoptimized one");
+    return;
+  }
+  spirv_words = std::move(optimized_words);
+}
+
 void SpirvShaderTranslator::PostTranslation(Shader* shader) {
   // Validation.
   if (cvars::spv_validate) {
@@ -1831,12 +1931,7 @@ void SpirvShaderTranslator::ProcessTextureFetchInstruction(
 
   switch (instr.opcode) {
     case FetchOpcode::kTextureFetch: {
-      auto texture_index =
-          b.makeUintConstant(tex_binding_map_[instr.operands[1].storage_index]);
-      auto texture_ptr =
-          b.createAccessChain(spv::StorageClass::StorageClassUniformConstant,
-                              tex_[dim_idx], std::vector<Id>({texture_index}));
-      auto texture = b.createLoad(texture_ptr);
+      auto texture = LoadTexture(instr.operands[1].storage_index, dim_idx);
 
       if (instr.dimension == xenos::FetchOpDimension::k1D) {
         // Upgrade 1D src coordinate into 2D
@@ -1916,12 +2011,7 @@ void SpirvShaderTranslator::ProcessTextureFetchInstruction(
 
     case FetchOpcode::kGetTextureWeights: {
       // fract(src0 * textureSize);
-      auto texture_index =
-          b.makeUintConstant(tex_binding_map_[instr.operands[1].storage_index]);
-      auto texture_ptr =
-          b.createAccessChain(spv::StorageClass::StorageClassUniformConstant,
-                              tex_[dim_idx], std::vector<Id>({texture_index}));
-      auto texture = b.createLoad(texture_ptr);
+      auto texture = LoadTexture(instr.operands[1].storage_index, dim_idx);
       auto image =
           b.createUnaryOp(spv::OpImage, b.getImageType(texture), texture);
 
@@ -1959,12 +2049,7 @@ void SpirvShaderTranslator::ProcessTextureFetchInstruction(
       // This is only valid in pixel shaders.
       assert_true(is_pixel_shader());
 
-      auto texture_index =
-          b.makeUintConstant(tex_binding_map_[instr.operands[1].storage_index]);
-      auto texture_ptr =
-          b.createAccessChain(spv::StorageClass::StorageClassUniformConstant,
-                              tex_[dim_idx], std::vector<Id>({texture_index}));
-      auto texture = b.createLoad(texture_ptr);
+      auto texture = LoadTexture(instr.operands[1].storage_index, dim_idx);
 
       if (instr.dimension == xenos::FetchOpDimension::k1D) {
         // Upgrade 1D src coordinate into 2D
@@ -3083,6 +3168,28 @@ Id SpirvShaderTranslator::CreateGlslStd450InstructionCall(
                                      args);
 }
 
+Id SpirvShaderTranslator::LoadTexture(uint32_t fetch_constant,
+                                      uint32_t dim_idx) {
+  auto& b = *builder_;
+  Id texture_index;
+  if (bindless_textures_) {
+    // The index is the same for all invocations of the draw, so dynamic
+    // indexing of the descriptor array doesn't need to be non-uniform.
+    auto texture_index_ptr = b.createAccessChain(
+        spv::StorageClass::StorageClassUniform, consts_,
+        std::vector<Id>({b.makeUintConstant(3),
+                         b.makeUintConstant(fetch_constant >> 2),
+                         b.makeUintConstant(fetch_constant & 3)}));
+    texture_index = b.createLoad(texture_index_ptr);
+  } else {
+    texture_index = b.makeUintConstant(tex_binding_map_[fetch_constant]);
+  }
+  auto texture_ptr =
+      b.createAccessChain(spv::StorageClass::StorageClassUniformConstant,
+                          tex_[dim_idx], std::vector<Id>({texture_index}));
+  return b.createLoad(texture_ptr);
+}
+
 Id SpirvShaderTranslator::LoadFromOperand(const InstructionOperand& op) {
   auto& b = *builder_;
 
@@ -53,11 +53,24 @@ constexpr uint32_t kSpirvPushConstantFragmentRangeSize =
     (sizeof(float) * 4) + sizeof(uint32_t);
 constexpr uint32_t kSpirvPushConstantsSize = sizeof(SpirvPushConstants);
 
+// Size of the texture descriptor array in the bindless mode, in which the
+// shaders take the index of the descriptor for each fetch constant from the
+// texture_indices member of the constant register uniform block.
+constexpr uint32_t kSpirvBindlessTextureCount = 8192;
+
 class SpirvShaderTranslator : public ShaderTranslator {
  public:
-  SpirvShaderTranslator();
+  // resolution_scale is the multiplier of the host render target size relative
+  // to the guest one, so pixel positions are converted back to guest pixels.
+  explicit SpirvShaderTranslator(bool bindless_textures = false,
+                                 uint32_t resolution_scale = 1);
   ~SpirvShaderTranslator() override;
 
+  bool bindless_textures() const { return bindless_textures_; }
+  // Level of the spirv-tools optimization of the translated shaders, taken
+  // from the spv_optimization_level cvar when the translator is created.
+  uint32_t optimization_level() const { return optimization_level_; }
+
  protected:
   void StartTranslation() override;
   std::vector<uint8_t> CompleteTranslation() override;
@@ -104,6 +117,10 @@ class SpirvShaderTranslator : public ShaderTranslator {
                                           spv::GLSLstd450 instruction_ordinal,
                                           std::vector<spv::Id> args);
 
+  // Loads the combined image sampler for the fetch constant from the texture
+  // array of the dimension.
+  spv::Id LoadTexture(uint32_t fetch_constant, uint32_t dim_idx);
+
   // Loads an operand into a value.
   // The value returned will be in the form described in the operand (number of
   // components, etc).
@@ -113,6 +130,14 @@ class SpirvShaderTranslator : public ShaderTranslator {
   // the proper components will be selected.
   void StoreToResult(spv::Id source_value_id, const InstructionResult& result);
 
+  // Runs the spirv-tools optimizer passes of the optimization level over the
+  // module, keeping the original code if optimization fails.
+  void OptimizeSpirv(std::vector<uint32_t>& spirv_words) const;
+
+  bool bindless_textures_;
+  uint32_t resolution_scale_;
+  uint32_t optimization_level_;
+
   xe::ui::spirv::SpirvDisassembler disassembler_;
   xe::ui::spirv::SpirvValidator validator_;
 
@@ -17,6 +17,7 @@
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
+#include "xenia/base/platform.h"
 #include "xenia/base/profiling.h"
 
 #include "third_party/xxhash/xxhash.h"
@@ -90,6 +91,86 @@ void ConvertTexelDXT3AToDXT3(xenos::Endian endian, void* output,
   std::memset(&output_bytes[8], 0, 8);
 }
 
+// Encodes a component of a CTX1 block as a BC4 block. CTX1 has 4 values in
+// sixths of the way from the first endpoint to the second - 0 (index 0), 6
+// (index 1), 2 (index 2) and 4 (index 3), while BC4 has 8 values in sevenths
+// between its endpoints. Extending the range by a sixth on one side puts the
+// CTX1 values on every other BC4 value.
+static void EncodeCTX1ComponentAsBC4(uint8_t end0, uint8_t end1,
+                                     uint32_t ctx1_indices, uint8_t* output) {
+  if (end0 == end1) {
+    // 6-value mode with everything at the first endpoint.
+    output[0] = end0;
+    output[1] = end1;
+    std::memset(&output[2], 0, 6);
+    return;
+  }
+  static const uint32_t kCTX1Sixths[4] = {0, 6, 2, 4};
+  float sixth = (float(end1) - float(end0)) * (1.0f / 6.0f);
+  int32_t start, end;
+  // Offset of the CTX1 sixths in BC4 sevenths if on the even grid points.
+  int32_t grid_offset;
+  int32_t extended_end = int32_t(std::lround(float(end0) + 7.0f * sixth));
+  int32_t extended_start = int32_t(std::lround(float(end0) - sixth));
+  if (extended_end >= 0 && extended_end <= 255) {
+    start = end0;
+    end = extended_end;
+    grid_offset = 0;
+  } else if (extended_start >= 0 && extended_start <= 255) {
+    start = extended_start;
+    end = end1;
+    grid_offset = 1;
+  } else {
+    // Nearly the whole range - round to the closest BC4 values instead.
+    start = end0;
+    end = end1;
+    grid_offset = -1;
+  }
+  // The 8-value mode requires the first endpoint to be greater.
+  bool reverse = start < end;
+  output[0] = uint8_t(reverse ? end : start);
+  output[1] = uint8_t(reverse ? start : end);
+  uint64_t bc4_indices = 0;
+  for (uint32_t i = 0; i < 16; ++i) {
+    uint32_t sixths = kCTX1Sixths[(ctx1_indices >> (i * 2)) & 3];
+    uint32_t sevenths = grid_offset >= 0 ? sixths + uint32_t(grid_offset)
+                                         : (sixths * 7 + 3) / 6;
+    if (reverse) {
+      sevenths = 7 - sevenths;
+    }
+    // Index 0 is the first endpoint, 1 is the second, 2 to 7 are in between.
+    uint64_t bc4_index =
+        sevenths == 0 ? 0 : (sevenths == 7 ? 1 : sevenths + 1);
+    bc4_indices |= bc4_index << (i * 3);
+  }
+  for (uint32_t i = 0; i < 6; ++i) {
+    output[2 + i] = uint8_t(bc4_indices >> (i * 8));
+  }
+}
+
+void ConvertTexelCTX1ToBC5(xenos::Endian endian, void* output,
+                           const void* input, size_t length) {
+  union {
+    uint8_t data[8];
+    struct {
+      uint8_t g0, r0, g1, r1;
+      uint32_t xx;
+    };
+  } block;
+  static_assert(sizeof(block) == 8, "CTX1 block mismatch");
+
+  auto output_bytes = static_cast<uint8_t*>(output);
+  auto input_bytes = static_cast<const uint8_t*>(input);
+  size_t block_count = std::max(length / 16, size_t(1));
+  for (size_t i = 0; i < block_count; ++i) {
+    CopySwapBlock(endian, block.data, input_bytes + i * 8, 8);
+    EncodeCTX1ComponentAsBC4(block.r0, block.r1, block.xx,
+                             output_bytes + i * 16);
+    EncodeCTX1ComponentAsBC4(block.g0, block.g1, block.xx,
+                             output_bytes + i * 16 + 8);
+  }
+}
+
 // https://github.com/BinomialLLC/crunch/blob/ea9b8d8c00c8329791256adafa8cf11e4e7942a2/inc/crn_decomp.h#L4108
 static uint32_t TiledOffset2DRow(uint32_t y, uint32_t width,
                                  uint32_t log2_bpp) {
@@ -109,6 +190,87 @@ static uint32_t TiledOffset2DColumn(uint32_t x, uint32_t y, uint32_t log2_bpp,
          ((y & 16) << 7) + (((((y & 8) >> 2) + (x >> 3)) & 3) << 6);
 }
 
+// Horizontally adjacent blocks in groups of 8, or of 16 bytes for larger
+// blocks, aligned to the group size, are stored contiguously in the tiled
+// layout, so they are copied and swapped together.
+template <uint32_t kLog2Bpb>
+static void UntileCopySwap(uint8_t* output_buffer, const uint8_t* input_buffer,
+                           const UntileInfo* untile_info) {
+  constexpr uint32_t kRunBytes = kLog2Bpb ? 16 : 8;
+  constexpr uint32_t kRunBlocks = kRunBytes >> kLog2Bpb;
+  xenos::Endian endian = untile_info->endian;
+  uint32_t output_pitch = untile_info->output_pitch << kLog2Bpb;
+  uint32_t x_first = untile_info->offset_x;
+  uint32_t x_end = x_first + untile_info->width;
+
+#if XE_ARCH_AMD64
+  __m128i swap_shuffle;
+  switch (endian) {
+    case xenos::Endian::k8in16:
+      swap_shuffle =
+          _mm_set_epi8(0x0E, 0x0F, 0x0C, 0x0D, 0x0A, 0x0B, 0x08, 0x09, 0x06,
+                       0x07, 0x04, 0x05, 0x02, 0x03, 0x00, 0x01);
+      break;
+    case xenos::Endian::k8in32:
+      swap_shuffle =
+          _mm_set_epi8(0x0C, 0x0D, 0x0E, 0x0F, 0x08, 0x09, 0x0A, 0x0B, 0x04,
+                       0x05, 0x06, 0x07, 0x00, 0x01, 0x02, 0x03);
+      break;
+    case xenos::Endian::k16in32:
+      swap_shuffle =
+          _mm_set_epi8(0x0D, 0x0C, 0x0F, 0x0E, 0x09, 0x08, 0x0B, 0x0A, 0x05,
+                       0x04, 0x07, 0x06, 0x01, 0x00, 0x03, 0x02);
+      break;
+    default:
+      swap_shuffle =
+          _mm_set_epi8(0x0F, 0x0E, 0x0D, 0x0C, 0x0B, 0x0A, 0x09, 0x08, 0x07,
+                       0x06, 0x05, 0x04, 0x03, 0x02, 0x01, 0x00);
+      break;
+  }
+#endif  // XE_ARCH_AMD64
+
+  for (uint32_t y = 0; y < untile_info->height; y++) {
+    uint32_t tiled_y = untile_info->offset_y + y;
+    uint32_t input_row_offset =
+        TiledOffset2DRow(tiled_y, untile_info->input_pitch, kLog2Bpb);
+    uint8_t* output_row = &output_buffer[y * output_pitch];
+    for (uint32_t x = x_first & ~(kRunBlocks - 1); x < x_end;
+         x += kRunBlocks) {
+      uint32_t input_offset =
+          TiledOffset2DColumn(x, tiled_y, kLog2Bpb, input_row_offset);
+      const uint8_t* input = &input_buffer[input_offset];
+      // Partial runs at the edges are swapped into a temporary buffer.
+      uint32_t run_first = std::max(x, x_first);
+      uint32_t run_end = std::min(x + kRunBlocks, x_end);
+      bool run_partial = run_end - run_first != kRunBlocks;
+      alignas(16) uint8_t run_buffer[kRunBytes];
+      uint8_t* output = run_partial
+                            ? run_buffer
+                            : &output_row[(x - x_first) << kLog2Bpb];
+#if XE_ARCH_AMD64
+      if (kRunBytes == 16) {
+        __m128i run = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(input)),
+            swap_shuffle);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output), run);
+      } else {
+        __m128i run = _mm_shuffle_epi8(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(input)),
+            swap_shuffle);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(output), run);
+      }
+#else
+      CopySwapBlock(endian, output, input, kRunBytes);
+#endif  // XE_ARCH_AMD64
+      if (run_partial) {
+        std::memcpy(&output_row[(run_first - x_first) << kLog2Bpb],
+                    &run_buffer[(run_first - x) << kLog2Bpb],
+                    (run_end - run_first) << kLog2Bpb);
+      }
+    }
+  }
+}
+
 void Untile(uint8_t* output_buffer, const uint8_t* input_buffer,
             const UntileInfo* untile_info) {
   SCOPE_profile_cpu_f("gpu");
@@ -116,6 +278,31 @@ void Untile(uint8_t* output_buffer, const uint8_t* input_buffer,
   assert_not_null(untile_info->input_format_info);
   assert_not_null(untile_info->output_format_info);
 
+  if (!untile_info->copy_callback) {
+    assert_true(untile_info->input_format_info->bytes_per_block() ==
+                untile_info->output_format_info->bytes_per_block());
+    switch (untile_info->input_format_info->bytes_per_block()) {
+      case 1:
+        UntileCopySwap<0>(output_buffer, input_buffer, untile_info);
+        return;
+      case 2:
+        UntileCopySwap<1>(output_buffer, input_buffer, untile_info);
+        return;
+      case 4:
+        UntileCopySwap<2>(output_buffer, input_buffer, untile_info);
+        return;
+      case 8:
+        UntileCopySwap<3>(output_buffer, input_buffer, untile_info);
+        return;
+      case 16:
+        UntileCopySwap<4>(output_buffer, input_buffer, untile_info);
+        return;
+      default:
+        assert_always();
+        return;
+    }
+  }
+
   uint32_t input_bytes_per_block =
       untile_info->input_format_info->bytes_per_block();
   uint32_t output_bytes_per_block =
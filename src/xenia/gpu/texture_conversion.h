@@ -31,6 +31,14 @@ void ConvertTexelCTX1ToR8G8(xenos::Endian endian, void* output,
                             const void* input, size_t length);
 void ConvertTexelDXT3AToDXT3(xenos::Endian endian, void* output,
                              const void* input, size_t length);
+// Transcodes CTX1 blocks to BC5 blocks (twice as large) with the red
+// component in the first channel - length is the size of the output, one or
+// more blocks. The CTX1 endpoints are reproduced exactly, the values at 1/3
+// and 2/3 between them within rounding, except for blocks where the endpoints
+// of a component are 0 and 255 or close, where they're up to 1/21 of the range
+// off.
+void ConvertTexelCTX1ToBC5(xenos::Endian endian, void* output,
+                           const void* input, size_t length);
 
 typedef std::function<void(void*, const void*, size_t)> UntileCopyBlockCallback;
 
@@ -43,7 +51,11 @@ typedef struct UntileInfo {
   uint32_t output_pitch;
   const FormatInfo* input_format_info;
   const FormatInfo* output_format_info;
+  // If empty, the blocks are copied with CopySwapBlock using the endianness
+  // below, in contiguous runs rather than one by one. The input and the output
+  // formats must have the same block size in this case.
   UntileCopyBlockCallback copy_callback;
+  xenos::Endian endian;
 } UntileInfo;
 
 void Untile(uint8_t* output_buffer, const uint8_t* input_buffer,
@@ -9,7 +9,14 @@
 
 #include "xenia/gpu/trace_dump.h"
 
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "third_party/fmt/include/fmt/format.h"
 #include "third_party/stb/stb_image_write.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/string.h"
@@ -28,6 +35,17 @@
 
 DEFINE_path(target_trace_file, "", "Specifies the trace file to load.", "GPU");
 DEFINE_path(trace_dump_path, "", "Output path for dumped files.", "GPU");
+DEFINE_int32(trace_dump_benchmark_iterations, 0,
+             "If not 0, replays all the frames of the trace the specified "
+             "number of times and writes the performance statistics as JSON "
+             "(to the output path with the .json extension) instead of dumping "
+             "the image. GPU time is reported only if the backend measures it, "
+             "such as with --d3d12_gpu_timing.",
+             "GPU");
+DEFINE_bool(trace_dump_benchmark_paced, false,
+            "Submit at most 60 frames per second in the benchmark instead of "
+            "as fast as possible.",
+            "GPU");
 
 namespace xe {
 namespace gpu {
@@ -87,6 +105,9 @@ int TraceDump::Main(const std::vector<std::string>& args) {
   // Ensure output path exists.
   xe::filesystem::CreateParentFolder(base_output_path_);
 
+  if (cvars::trace_dump_benchmark_iterations > 0) {
+    return RunBenchmark();
+  }
   return Run();
 }
 
@@ -147,5 +168,173 @@ int TraceDump::Run() {
   return result;
 }
 
+int TraceDump::RunBenchmark() {
+  CommandProcessor* command_processor = graphics_system_->command_processor();
+  BenchmarkCounters& counters = command_processor->benchmark_counters();
+  int frame_count = player_->frame_count();
+  uint32_t iterations = uint32_t(cvars::trace_dump_benchmark_iterations);
+  XELOGI("Benchmarking {} frames, {} iterations", frame_count, iterations);
+
+  uint64_t tick_frequency = Clock::QueryHostTickFrequency();
+  uint64_t paced_frame_ticks = cvars::trace_dump_benchmark_paced
+                                   ? tick_frequency / 60
+                                   : uint64_t(0);
+  std::vector<double> frame_times_ms;
+  frame_times_ms.reserve(size_t(frame_count) * iterations);
+  double gpu_microseconds[size_t(GpuTimingCategory::kCount)] = {};
+  double gpu_frame_microseconds[size_t(GpuTimingCategory::kCount)];
+  uint32_t gpu_frames = 0;
+
+  counters.Reset();
+  counters.timing_enabled = true;
+  uint64_t benchmark_start_ticks = Clock::QueryHostTickCount();
+  for (uint32_t i = 0; i < iterations; ++i) {
+    for (int frame = 0; frame < frame_count; ++frame) {
+      uint64_t frame_start_ticks = Clock::QueryHostTickCount();
+      player_->PlayFrame(frame);
+      player_->WaitOnPlayback();
+      uint64_t frame_end_ticks = Clock::QueryHostTickCount();
+      frame_times_ms.push_back(double(frame_end_ticks - frame_start_ticks) *
+                               1000.0 / tick_frequency);
+      // The latest frame with all the GPU timing data available.
+      if (command_processor->GetGpuFrameTiming(gpu_frame_microseconds)) {
+        for (size_t j = 0; j < size_t(GpuTimingCategory::kCount); ++j) {
+          gpu_microseconds[j] += gpu_frame_microseconds[j];
+        }
+        ++gpu_frames;
+      }
+      if (frame_end_ticks - frame_start_ticks < paced_frame_ticks) {
+        xe::threading::Sleep(std::chrono::microseconds(
+            (paced_frame_ticks - (frame_end_ticks - frame_start_ticks)) *
+            1000000 / tick_frequency));
+      }
+    }
+  }
+  uint64_t benchmark_ticks =
+      Clock::QueryHostTickCount() - benchmark_start_ticks;
+  counters.timing_enabled = false;
+
+  std::vector<double> sorted_frame_times_ms(frame_times_ms);
+  std::sort(sorted_frame_times_ms.begin(), sorted_frame_times_ms.end());
+  auto percentile = [&sorted_frame_times_ms](double fraction) {
+    if (sorted_frame_times_ms.empty()) {
+      return 0.0;
+    }
+    size_t index = std::min(
+        size_t(fraction * double(sorted_frame_times_ms.size())),
+        sorted_frame_times_ms.size() - 1);
+    return sorted_frame_times_ms[index];
+  };
+  double frame_time_sum_ms = 0.0;
+  for (double frame_time_ms : frame_times_ms) {
+    frame_time_sum_ms += frame_time_ms;
+  }
+  size_t played_frames = std::max(frame_times_ms.size(), size_t(1));
+  auto ticks_to_ms = [tick_frequency](uint64_t ticks) {
+    return double(ticks) * 1000.0 / tick_frequency;
+  };
+  // Approximate, the swap at the end of each frame is issued by the player
+  // outside the packets.
+  uint64_t other_ticks =
+      counters.packet_ticks -
+      std::min(counters.packet_ticks,
+               counters.draw_ticks + counters.swap_ticks);
+
+  std::string json;
+  json += "{\n";
+  json += fmt::format("  \"trace\": \"{}\",\n",
+                      xe::path_to_utf8(trace_file_path_.filename()));
+  json += fmt::format("  \"frames\": {},\n", frame_count);
+  json += fmt::format("  \"iterations\": {},\n", iterations);
+  json += fmt::format("  \"paced\": {},\n",
+                      cvars::trace_dump_benchmark_paced ? "true" : "false");
+  json += fmt::format("  \"total_ms\": {:.3f},\n",
+                      ticks_to_ms(benchmark_ticks));
+  json += "  \"frame_time_ms\": {\n";
+  json += fmt::format("    \"mean\": {:.3f},\n",
+                      frame_time_sum_ms / double(played_frames));
+  json += fmt::format("    \"min\": {:.3f},\n", percentile(0.0));
+  json += fmt::format("    \"p50\": {:.3f},\n", percentile(0.5));
+  json += fmt::format("    \"p90\": {:.3f},\n", percentile(0.9));
+  json += fmt::format("    \"p99\": {:.3f},\n", percentile(0.99));
+  json += fmt::format("    \"max\": {:.3f}\n", percentile(1.0));
+  json += "  },\n";
+  // Per frame averages of the CPU time on the command processor thread.
+  json += "  \"cpu_ms_per_frame\": {\n";
+  json += fmt::format("    \"packets\": {:.4f},\n",
+                      ticks_to_ms(counters.packet_ticks) / played_frames);
+  json += fmt::format("    \"draw\": {:.4f},\n",
+                      ticks_to_ms(counters.draw_ticks - std::min(
+                          counters.draw_ticks, counters.resolve_ticks)) /
+                          played_frames);
+  json += fmt::format("    \"resolve\": {:.4f},\n",
+                      ticks_to_ms(counters.resolve_ticks) / played_frames);
+  json += fmt::format("    \"swap\": {:.4f},\n",
+                      ticks_to_ms(counters.swap_ticks) / played_frames);
+  json += fmt::format("    \"other\": {:.4f}\n",
+                      ticks_to_ms(other_ticks) / played_frames);
+  json += "  },\n";
+  // Separates the CPU cost of the emulated GPU from the host driver cost when
+  // comparing backends, especially against the null one.
+  uint64_t draw_count =
+      counters.draw_count.load() - counters.resolve_count.load();
+  uint64_t resolve_count = counters.resolve_count.load();
+  json += "  \"cpu_us_per_call\": {\n";
+  json += fmt::format(
+      "    \"draw\": {:.3f},\n",
+      draw_count ? ticks_to_ms(counters.draw_ticks -
+                               std::min(counters.draw_ticks,
+                                        counters.resolve_ticks)) *
+                       1000.0 / double(draw_count)
+                 : 0.0);
+  json += fmt::format(
+      "    \"resolve\": {:.3f}\n",
+      resolve_count
+          ? ticks_to_ms(counters.resolve_ticks) * 1000.0 / double(resolve_count)
+          : 0.0);
+  json += "  },\n";
+  if (gpu_frames) {
+    static const char* const kGpuTimingCategoryNames[] = {
+        "draw", "resolve", "edram_store", "edram_load", "texture_load",
+    };
+    static_assert(xe::countof(kGpuTimingCategoryNames) ==
+                      size_t(GpuTimingCategory::kCount),
+                  "GPU timing category names must match the categories");
+    json += "  \"gpu_ms_per_frame\": {\n";
+    for (size_t i = 0; i < size_t(GpuTimingCategory::kCount); ++i) {
+      json += fmt::format(
+          "    \"{}\": {:.4f}{}\n", kGpuTimingCategoryNames[i],
+          gpu_microseconds[i] / 1000.0 / gpu_frames,
+          i + 1 < size_t(GpuTimingCategory::kCount) ? "," : "");
+    }
+    json += "  },\n";
+  }
+  json += fmt::format("  \"draws\": {},\n", draw_count);
+  json += fmt::format("  \"resolves\": {},\n", resolve_count);
+  json += fmt::format("  \"pipeline_creations\": {},\n",
+                      counters.pipeline_creations.load());
+  json += fmt::format("  \"texture_uploads\": {},\n",
+                      counters.texture_uploads.load());
+  json += fmt::format("  \"texture_upload_bytes\": {}\n",
+                      counters.texture_upload_bytes.load());
+  json += "}\n";
+
+  int result = 0;
+  auto json_path = base_output_path_.replace_extension(".json");
+  FILE* json_file = filesystem::OpenFile(json_path, "wb");
+  if (json_file) {
+    fwrite(json.data(), 1, json.size(), json_file);
+    fclose(json_file);
+    XELOGI("Benchmark results written to {}", xe::path_to_utf8(json_path));
+  } else {
+    XELOGE("Failed to open {} for writing", xe::path_to_utf8(json_path));
+    result = 1;
+  }
+
+  player_.reset();
+  emulator_.reset();
+  return result;
+}
+
 }  //  namespace gpu
 }  //  namespace xe
@@ -9,11 +9,20 @@
 
 #include "xenia/gpu/trace_player.h"
 
+#include <algorithm>
+
+#include "xenia/base/cvar.h"
 #include "xenia/gpu/command_processor.h"
 #include "xenia/gpu/graphics_system.h"
 #include "xenia/gpu/xenos.h"
 #include "xenia/memory.h"
 
+DEFINE_int32(trace_seek_snapshot_interval, 32,
+             "Number of commands between the snapshots of the GPU state "
+             "recorded while playing a trace frame, so seeking back to a "
+             "command only replays the commands from the nearest snapshot.",
+             "GPU");
+
 namespace xe {
 namespace gpu {
 
@@ -46,13 +55,32 @@ void TracePlayer::SeekFrame(int target_frame) {
   if (current_frame_index_ == target_frame) {
     return;
   }
+  const uint8_t* memory_restore_start = nullptr;
+  if (target_frame != current_frame_index_ + 1) {
+    // Not continuing from the previous frame, reconstruct the memory contents
+    // left by the reads in the frames being skipped.
+    const TraceIndexKeyframe* keyframe = FindMemoryKeyframe(target_frame);
+    memory_restore_start = keyframe ? trace_data_ + keyframe->command_offset
+                                    : trace_data_ + sizeof(TraceHeader);
+  }
   current_frame_index_ = target_frame;
   auto frame = current_frame();
   current_command_index_ = int(frame->commands.size()) - 1;
 
   assert_true(frame->start_ptr <= frame->end_ptr);
   PlayTrace(frame->start_ptr, frame->end_ptr - frame->start_ptr,
-            TracePlaybackMode::kBreakOnSwap, false);
+            TracePlaybackMode::kBreakOnSwap, false, current_frame_index_,
+            memory_restore_start);
+}
+
+void TracePlayer::PlayFrame(int target_frame) {
+  current_frame_index_ = target_frame;
+  auto frame = current_frame();
+  current_command_index_ = int(frame->commands.size()) - 1;
+
+  assert_true(frame->start_ptr <= frame->end_ptr);
+  PlayTrace(frame->start_ptr, frame->end_ptr - frame->start_ptr,
+            TracePlaybackMode::kBreakOnSwap, false, -1);
 }
 
 void TracePlayer::SeekCommand(int target_command) {
@@ -72,11 +100,15 @@ void TracePlayer::SeekCommand(int target_command) {
     const auto& previous_command = frame->commands[previous_command_index];
     PlayTrace(previous_command.end_ptr,
               command.end_ptr - previous_command.end_ptr,
-              TracePlaybackMode::kBreakOnSwap, false);
+              TracePlaybackMode::kBreakOnSwap, false, current_frame_index_);
   } else {
-    // Full playback from frame start.
-    PlayTrace(frame->start_ptr, command.end_ptr - frame->start_ptr,
-              TracePlaybackMode::kBreakOnSwap, true);
+    // Playback from the nearest snapshot or the frame start.
+    playing_trace_ = true;
+    int frame_index = current_frame_index_;
+    graphics_system_->command_processor()->CallInThread(
+        [this, frame_index, target_command]() {
+          SeekCommandOnThread(frame_index, target_command);
+        });
   }
 }
 
@@ -85,23 +117,146 @@ void TracePlayer::WaitOnPlayback() {
 }
 
 void TracePlayer::PlayTrace(const uint8_t* trace_data, size_t trace_size,
-                            TracePlaybackMode playback_mode,
-                            bool clear_caches) {
+                            TracePlaybackMode playback_mode, bool clear_caches,
+                            int snapshot_frame_index,
+                            const uint8_t* memory_restore_start) {
   playing_trace_ = true;
   graphics_system_->command_processor()->CallInThread([=]() {
-    PlayTraceOnThread(trace_data, trace_size, playback_mode, clear_caches);
+    if (memory_restore_start) {
+      RestoreMemoryOnThread(memory_restore_start, trace_data);
+    }
+    PlayTraceOnThread(trace_data, trace_size, playback_mode, clear_caches,
+                      snapshot_frame_index);
   });
 }
 
+void TracePlayer::RestoreMemoryOnThread(const uint8_t* restore_start,
+                                        const uint8_t* restore_end) {
+  // The keyframe is at the beginning of a frame, possibly the target one.
+  auto trace_ptr = restore_start;
+  if (trace_ptr < commands_end_ &&
+      static_cast<TraceCommandType>(xe::load<uint32_t>(trace_ptr)) ==
+          TraceCommandType::kMemoryKeyframe) {
+    auto cmd = reinterpret_cast<const MemoryKeyframeCommand*>(trace_ptr);
+    const uint8_t* offsets = trace_ptr + sizeof(*cmd);
+    for (uint32_t i = 0; i < cmd->command_count; ++i) {
+      uint64_t command_offset =
+          xe::load<uint64_t>(offsets + sizeof(uint64_t) * i);
+      ApplyMemoryRead(
+          reinterpret_cast<const MemoryCommand*>(trace_data_ + command_offset));
+    }
+    trace_ptr = SkipCommand(trace_ptr);
+  }
+  // Replay the reads between the keyframe and the frame.
+  while (trace_ptr && trace_ptr < restore_end) {
+    auto type = static_cast<TraceCommandType>(xe::load<uint32_t>(trace_ptr));
+    if (type == TraceCommandType::kMemoryRead) {
+      ApplyMemoryRead(reinterpret_cast<const MemoryCommand*>(trace_ptr));
+    }
+    trace_ptr = SkipCommand(trace_ptr);
+  }
+}
+
+void TracePlayer::ApplyMemoryRead(const MemoryCommand* cmd) {
+  DecompressMemory(
+      cmd->encoding_format, reinterpret_cast<const uint8_t*>(cmd + 1),
+      cmd->encoded_length,
+      graphics_system_->memory()->TranslatePhysical(cmd->base_ptr),
+      cmd->decoded_length);
+  graphics_system_->command_processor()->TracePlaybackWroteMemory(
+      cmd->base_ptr, cmd->decoded_length);
+}
+
+void TracePlayer::SeekCommandOnThread(int frame_index, int target_command) {
+  const Frame* target_frame = frame(frame_index);
+  const uint8_t* target_end = target_frame->commands[target_command].end_ptr;
+
+  size_t snapshot_count = 0;
+  if (snapshot_frame_index_ == frame_index) {
+    while (snapshot_count < snapshots_.size() &&
+           snapshots_[snapshot_count].command_index <= target_command) {
+      ++snapshot_count;
+    }
+  }
+  if (!snapshot_count) {
+    // Full playback from frame start.
+    PlayTraceOnThread(target_frame->start_ptr,
+                      target_end - target_frame->start_ptr,
+                      TracePlaybackMode::kBreakOnSwap, true, frame_index);
+    return;
+  }
+
+  // The later commands may have overwritten the memory read before the
+  // snapshot.
+  for (size_t i = 0; i < snapshot_count; ++i) {
+    for (uint64_t command_offset : snapshots_[i].memory_reads) {
+      ApplyMemoryRead(
+          reinterpret_cast<const MemoryCommand*>(trace_data_ + command_offset));
+    }
+  }
+  const CommandSnapshot& snapshot = snapshots_[snapshot_count - 1];
+  graphics_system_->command_processor()->RestoreTracePlaybackState(
+      *snapshot.state);
+  const uint8_t* snapshot_end =
+      target_frame->commands[snapshot.command_index].end_ptr;
+  PlayTraceOnThread(snapshot_end, target_end - snapshot_end,
+                    TracePlaybackMode::kBreakOnSwap, false, frame_index);
+}
+
+const uint8_t* TracePlayer::GetNextSnapshotPtr(const Frame& frame) const {
+  size_t interval = size_t(std::max(cvars::trace_seek_snapshot_interval, 1));
+  size_t command_index = (snapshots_.size() + 1) * interval - 1;
+  if (command_index >= frame.commands.size()) {
+    return nullptr;
+  }
+  return frame.commands[command_index].end_ptr;
+}
+
+void TracePlayer::RecordSnapshotOnThread(const Frame& frame) {
+  size_t interval = size_t(std::max(cvars::trace_seek_snapshot_interval, 1));
+  CommandSnapshot snapshot;
+  snapshot.command_index = int((snapshots_.size() + 1) * interval - 1);
+  // Only the reads since the previous snapshot are stored.
+  const uint8_t* trace_ptr =
+      snapshots_.empty()
+          ? frame.start_ptr
+          : frame.commands[snapshots_.back().command_index].end_ptr;
+  const uint8_t* trace_end = frame.commands[snapshot.command_index].end_ptr;
+  while (trace_ptr && trace_ptr < trace_end) {
+    auto type = static_cast<TraceCommandType>(xe::load<uint32_t>(trace_ptr));
+    if (type == TraceCommandType::kMemoryRead) {
+      snapshot.memory_reads.push_back(uint64_t(trace_ptr - trace_data_));
+    }
+    trace_ptr = SkipCommand(trace_ptr);
+  }
+  snapshot.state = std::make_unique<CommandProcessor::TracePlaybackState>();
+  graphics_system_->command_processor()->SaveTracePlaybackState(
+      *snapshot.state);
+  snapshots_.push_back(std::move(snapshot));
+}
+
 void TracePlayer::PlayTraceOnThread(const uint8_t* trace_data,
                                     size_t trace_size,
                                     TracePlaybackMode playback_mode,
-                                    bool clear_caches) {
+                                    bool clear_caches,
+                                    int snapshot_frame_index) {
   auto memory = graphics_system_->memory();
   auto command_processor = graphics_system_->command_processor();
 
   if (clear_caches) {
     command_processor->ClearCaches();
+    snapshots_.clear();
+  }
+
+  const Frame* snapshot_frame = nullptr;
+  const uint8_t* next_snapshot_ptr = nullptr;
+  if (snapshot_frame_index >= 0) {
+    if (snapshot_frame_index_ != snapshot_frame_index) {
+      snapshot_frame_index_ = snapshot_frame_index;
+      snapshots_.clear();
+    }
+    snapshot_frame = frame(snapshot_frame_index);
+    next_snapshot_ptr = GetNextSnapshotPtr(*snapshot_frame);
   }
 
   command_processor->set_swap_mode(SwapMode::kIgnored);
@@ -162,6 +317,10 @@ void TracePlayer::PlayTraceOnThread(const uint8_t* trace_data,
                                            pending_packet->count);
           pending_packet = nullptr;
         }
+        if (next_snapshot_ptr && trace_ptr == next_snapshot_ptr) {
+          RecordSnapshotOnThread(*snapshot_frame);
+          next_snapshot_ptr = GetNextSnapshotPtr(*snapshot_frame);
+        }
         if (pending_break) {
           playing_trace_ = false;
           return;
@@ -170,13 +329,8 @@ void TracePlayer::PlayTraceOnThread(const uint8_t* trace_data,
       }
       case TraceCommandType::kMemoryRead: {
         auto cmd = reinterpret_cast<const MemoryCommand*>(trace_ptr);
-        trace_ptr += sizeof(*cmd);
-        DecompressMemory(cmd->encoding_format, trace_ptr, cmd->encoded_length,
-                         memory->TranslatePhysical(cmd->base_ptr),
-                         cmd->decoded_length);
-        trace_ptr += cmd->encoded_length;
-        command_processor->TracePlaybackWroteMemory(cmd->base_ptr,
-                                                    cmd->decoded_length);
+        ApplyMemoryRead(cmd);
+        trace_ptr += sizeof(*cmd) + cmd->encoded_length;
         break;
       }
       case TraceCommandType::kMemoryWrite: {
@@ -212,6 +366,11 @@ void TracePlayer::PlayTraceOnThread(const uint8_t* trace_data,
         }
         break;
       }
+      case TraceCommandType::kMemoryKeyframe: {
+        // Only needed for seeking.
+        trace_ptr = SkipCommand(trace_ptr);
+        break;
+      }
     }
   }
 
@@ -11,9 +11,12 @@
 #define XENIA_GPU_TRACE_PLAYER_H_
 
 #include <atomic>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "xenia/base/threading.h"
+#include "xenia/gpu/command_processor.h"
 #include "xenia/gpu/trace_protocol.h"
 #include "xenia/gpu/trace_reader.h"
 #include "xenia/ui/loop.h"
@@ -44,15 +47,46 @@ class TracePlayer : public TraceReader {
   uint32_t playback_percent() const { return playback_percent_; }
 
   void SeekFrame(int target_frame);
+  // Plays the whole frame even if it's the current one, without restoring the
+  // memory contents, for measuring repeated playback.
+  void PlayFrame(int target_frame);
   void SeekCommand(int target_command);
 
   void WaitOnPlayback();
 
  private:
+  // Playback state at the end of a command of the current frame.
+  struct CommandSnapshot {
+    int command_index;
+    // Offsets from the beginning of the file of the kMemoryRead commands since
+    // the previous snapshot (or the frame start), in playback order - the
+    // memory state at the snapshot is the one at the frame start with the reads
+    // of this and all the earlier snapshots applied.
+    std::vector<uint64_t> memory_reads;
+    std::unique_ptr<CommandProcessor::TracePlaybackState> state;
+  };
+
+  // If snapshot_frame_index is not negative, the data is from that frame, and
+  // snapshots are recorded at the commands the playback passes. If
+  // memory_restore_start is not null, replays the memory keyframe at it (if
+  // there is one) and the memory reads from it to trace_data first.
   void PlayTrace(const uint8_t* trace_data, size_t trace_size,
-                 TracePlaybackMode playback_mode, bool clear_caches);
+                 TracePlaybackMode playback_mode, bool clear_caches,
+                 int snapshot_frame_index,
+                 const uint8_t* memory_restore_start = nullptr);
+  void RestoreMemoryOnThread(const uint8_t* restore_start,
+                             const uint8_t* restore_end);
+  void ApplyMemoryRead(const MemoryCommand* cmd);
+  // Replays the current frame up to the command from the nearest snapshot
+  // before it, or from the frame start if there's none.
+  void SeekCommandOnThread(int frame_index, int target_command);
+  // Returns where the next snapshot of the frame should be recorded, or nullptr
+  // if the frame has no more snapshot points.
+  const uint8_t* GetNextSnapshotPtr(const Frame& frame) const;
+  void RecordSnapshotOnThread(const Frame& frame);
   void PlayTraceOnThread(const uint8_t* trace_data, size_t trace_size,
-                         TracePlaybackMode playback_mode, bool clear_caches);
+                         TracePlaybackMode playback_mode, bool clear_caches,
+                         int snapshot_frame_index);
 
   xe::ui::Loop* loop_;
   GraphicsSystem* graphics_system_;
@@ -62,6 +96,11 @@ class TracePlayer : public TraceReader {
   std::atomic<uint32_t> playback_percent_ = {0};
   std::unique_ptr<xe::threading::Event> playback_event_;
   uint8_t* edram_snapshot_ = nullptr;
+
+  // Only accessed on the command processor thread. The snapshots reference
+  // the shaders, so they are dropped when the caches are cleared.
+  int snapshot_frame_index_ = -1;
+  std::vector<CommandSnapshot> snapshots_;
 };
 
 }  // namespace gpu
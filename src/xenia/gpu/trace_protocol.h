@@ -23,7 +23,7 @@ static const char kTraceExtension[] = "xtr";
 // Other changes besides the file format may require bumps, such as
 // anything that changes what is recorded into the files (new GPU
 // command processor commands, etc).
-constexpr uint32_t kTraceFormatVersion = 1;
+constexpr uint32_t kTraceFormatVersion = 3;
 
 // Trace file header identifying information about the trace.
 // This must be positioned at the start of the file and must only occur once.
@@ -53,6 +53,7 @@ enum class TraceCommandType : uint32_t {
   kMemoryWrite,
   kEdramSnapshot,
   kEvent,
+  kMemoryKeyframe,
 };
 
 struct PrimaryBufferStartCommand {
@@ -93,6 +94,10 @@ enum class MemoryEncodingFormat {
   kNone,
   // Data is compressed with third_party/snappy.
   kSnappy,
+  // Data is the same as that of an earlier kMemoryRead command, and is encoded
+  // as a uint64_t offset of that MemoryCommand from the beginning of the file.
+  // The referenced command never uses kReference itself.
+  kReference,
 };
 
 // Represents the GPU reading or writing data from or to memory.
@@ -134,6 +139,42 @@ struct EventCommand {
   Type event_type;
 };
 
+// Lists the memory reads that, when replayed in order, reconstruct the
+// contents of all the memory read so far, allowing seeking without replaying
+// the preceding frames. Followed by command_count uint64_t offsets of
+// kMemoryRead MemoryCommands from the beginning of the file, in ascending
+// order. Written at the beginning of some frames.
+struct MemoryKeyframeCommand {
+  TraceCommandType type;
+  uint32_t command_count;
+};
+
+// Identifies the TraceIndexFooter at the end of a trace written completely.
+constexpr uint32_t kTraceIndexMagic = 0x49525458;  // 'XTRI'
+
+struct TraceIndexKeyframe {
+  // Offset of the MemoryKeyframeCommand from the beginning of the file.
+  uint64_t command_offset;
+  // Index of the frame the keyframe is at the beginning of.
+  uint32_t frame;
+  uint32_t padding;
+};
+
+// The command stream is followed by the index, which is frame_count uint64_t
+// offsets of the beginnings of the frames at frame_table_offset, then
+// keyframe_count TraceIndexKeyframe entries sorted by the frame at
+// keyframe_table_offset, and then by this footer. The command stream ends at
+// frame_table_offset. Traces not closed properly have no index.
+struct TraceIndexFooter {
+  uint64_t frame_table_offset;
+  uint64_t keyframe_table_offset;
+  uint32_t frame_count;
+  uint32_t keyframe_count;
+  // Set to kTraceIndexMagic.
+  uint32_t magic;
+  uint32_t padding;
+};
+
 }  // namespace gpu
 }  // namespace xe
 
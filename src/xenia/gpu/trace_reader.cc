@@ -9,7 +9,10 @@
 
 #include "xenia/gpu/trace_reader.h"
 
+#include <algorithm>
 #include <cinttypes>
+#include <cstring>
+#include <iterator>
 
 #include "third_party/snappy/snappy.h"
 #include "xenia/base/filesystem.h"
@@ -33,6 +36,7 @@ bool TraceReader::Open(const std::filesystem::path& path) {
 
   trace_data_ = reinterpret_cast<const uint8_t*>(mmap_->data());
   trace_size_ = mmap_->size();
+  commands_end_ = trace_data_ + trace_size_;
 
   // Verify version.
   auto header = reinterpret_cast<const TraceHeader*>(trace_data_);
@@ -61,15 +65,148 @@ void TraceReader::Close() {
   mmap_.reset();
   trace_data_ = nullptr;
   trace_size_ = 0;
+  commands_end_ = nullptr;
+  frames_.clear();
+  keyframes_.clear();
 }
 
 void TraceReader::ParseTrace() {
-  // Skip file header.
-  auto trace_ptr = trace_data_;
-  trace_ptr += sizeof(TraceHeader);
+  if (ParseIndex()) {
+    return;
+  }
+  // No index, parse everything to locate the frames.
+  auto trace_ptr = trace_data_ + sizeof(TraceHeader);
+  while (trace_ptr < commands_end_) {
+    Frame frame;
+    trace_ptr = ParseFrame(trace_ptr, commands_end_, frame);
+    if (!frame.command_count) {
+      break;
+    }
+    frames_.push_back(std::move(frame));
+  }
+}
+
+bool TraceReader::ParseIndex() {
+  if (trace_size_ < sizeof(TraceHeader) + sizeof(TraceIndexFooter)) {
+    return false;
+  }
+  TraceIndexFooter footer;
+  std::memcpy(&footer, trace_data_ + trace_size_ - sizeof(footer),
+              sizeof(footer));
+  if (footer.magic != kTraceIndexMagic ||
+      footer.frame_table_offset < sizeof(TraceHeader) ||
+      footer.frame_table_offset + sizeof(uint64_t) * footer.frame_count >
+          footer.keyframe_table_offset ||
+      footer.keyframe_table_offset +
+              sizeof(TraceIndexKeyframe) * footer.keyframe_count >
+          trace_size_ - sizeof(footer)) {
+    return false;
+  }
+  commands_end_ = trace_data_ + footer.frame_table_offset;
+  frames_.resize(footer.frame_count);
+  for (uint32_t i = 0; i < footer.frame_count; ++i) {
+    uint64_t frame_offset = xe::load<uint64_t>(
+        trace_data_ + footer.frame_table_offset + sizeof(uint64_t) * i);
+    if (frame_offset < sizeof(TraceHeader) ||
+        frame_offset > footer.frame_table_offset) {
+      XELOGE("Trace index is corrupted, ignoring it");
+      frames_.clear();
+      commands_end_ = trace_data_ + trace_size_;
+      return false;
+    }
+    frames_[i].start_ptr = trace_data_ + frame_offset;
+    if (i) {
+      frames_[i - 1].end_ptr = frames_[i].start_ptr;
+    }
+  }
+  if (!frames_.empty()) {
+    frames_.back().end_ptr = commands_end_;
+  }
+  keyframes_.resize(footer.keyframe_count);
+  if (footer.keyframe_count) {
+    std::memcpy(keyframes_.data(),
+                trace_data_ + footer.keyframe_table_offset,
+                sizeof(TraceIndexKeyframe) * footer.keyframe_count);
+  }
+  XELOGI("    Frames: {} (indexed, {} keyframes)", frames_.size(),
+         keyframes_.size());
+  return true;
+}
+
+const TraceReader::Frame* TraceReader::frame(int n) const {
+  Frame& frame = frames_[n];
+  if (!frame.command_tree) {
+    // Frame located via the index, parse its commands on the first access.
+    const uint8_t* start_ptr = frame.start_ptr;
+    const uint8_t* end_ptr = frame.end_ptr;
+    ParseFrame(start_ptr, end_ptr, frame);
+    frame.end_ptr = end_ptr;
+  }
+  return &frame;
+}
 
-  Frame current_frame;
+const TraceIndexKeyframe* TraceReader::FindMemoryKeyframe(int frame) const {
+  auto it = std::upper_bound(keyframes_.cbegin(), keyframes_.cend(),
+                             uint32_t(frame),
+                             [](uint32_t frame, const TraceIndexKeyframe& k) {
+                               return frame < k.frame;
+                             });
+  if (it == keyframes_.cbegin()) {
+    return nullptr;
+  }
+  return &*std::prev(it);
+}
+
+const uint8_t* TraceReader::SkipCommand(const uint8_t* trace_ptr) {
+  auto type = static_cast<TraceCommandType>(xe::load<uint32_t>(trace_ptr));
+  switch (type) {
+    case TraceCommandType::kPrimaryBufferStart: {
+      auto cmd = reinterpret_cast<const PrimaryBufferStartCommand*>(trace_ptr);
+      return trace_ptr + sizeof(*cmd) + cmd->count * 4;
+    }
+    case TraceCommandType::kPrimaryBufferEnd:
+      return trace_ptr + sizeof(PrimaryBufferEndCommand);
+    case TraceCommandType::kIndirectBufferStart: {
+      auto cmd = reinterpret_cast<const IndirectBufferStartCommand*>(trace_ptr);
+      return trace_ptr + sizeof(*cmd) + cmd->count * 4;
+    }
+    case TraceCommandType::kIndirectBufferEnd:
+      return trace_ptr + sizeof(IndirectBufferEndCommand);
+    case TraceCommandType::kPacketStart: {
+      auto cmd = reinterpret_cast<const PacketStartCommand*>(trace_ptr);
+      return trace_ptr + sizeof(*cmd) + cmd->count * 4;
+    }
+    case TraceCommandType::kPacketEnd:
+      return trace_ptr + sizeof(PacketEndCommand);
+    case TraceCommandType::kMemoryRead:
+    case TraceCommandType::kMemoryWrite: {
+      auto cmd = reinterpret_cast<const MemoryCommand*>(trace_ptr);
+      return trace_ptr + sizeof(*cmd) + cmd->encoded_length;
+    }
+    case TraceCommandType::kEdramSnapshot: {
+      auto cmd = reinterpret_cast<const EdramSnapshotCommand*>(trace_ptr);
+      return trace_ptr + sizeof(*cmd) + cmd->encoded_length;
+    }
+    case TraceCommandType::kEvent:
+      return trace_ptr + sizeof(EventCommand);
+    case TraceCommandType::kMemoryKeyframe: {
+      auto cmd = reinterpret_cast<const MemoryKeyframeCommand*>(trace_ptr);
+      return trace_ptr + sizeof(*cmd) + sizeof(uint64_t) * cmd->command_count;
+    }
+    default:
+      // Broken trace file?
+      assert_unhandled_case(type);
+      return nullptr;
+  }
+}
+
+const uint8_t* TraceReader::ParseFrame(const uint8_t* trace_ptr,
+                                       const uint8_t* trace_end,
+                                       Frame& current_frame) const {
   current_frame.start_ptr = trace_ptr;
+  current_frame.end_ptr = nullptr;
+  current_frame.command_count = 0;
+  current_frame.commands.clear();
   const PacketStartCommand* packet_start = nullptr;
   const uint8_t* packet_start_ptr = nullptr;
   const uint8_t* last_ptr = trace_ptr;
@@ -78,7 +215,7 @@ void TraceReader::ParseTrace() {
   current_frame.command_tree =
       std::unique_ptr<CommandBuffer>(current_command_buffer);
 
-  while (trace_ptr < trace_data_ + trace_size_) {
+  while (trace_ptr < trace_end) {
     ++current_frame.command_count;
     auto type = static_cast<TraceCommandType>(xe::load<uint32_t>(trace_ptr));
     switch (type) {
@@ -168,14 +305,7 @@ void TraceReader::ParseTrace() {
         }
         if (pending_break) {
           current_frame.end_ptr = trace_ptr;
-          frames_.push_back(std::move(current_frame));
-          current_command_buffer = new CommandBuffer();
-          current_frame.command_tree =
-              std::unique_ptr<CommandBuffer>(current_command_buffer);
-          current_frame.start_ptr = trace_ptr;
-          current_frame.end_ptr = nullptr;
-          current_frame.command_count = 0;
-          pending_break = false;
+          return trace_ptr;
         }
         break;
       }
@@ -205,16 +335,19 @@ void TraceReader::ParseTrace() {
         }
         break;
       }
+      case TraceCommandType::kMemoryKeyframe: {
+        trace_ptr = SkipCommand(trace_ptr);
+        break;
+      }
       default:
         // Broken trace file?
         assert_unhandled_case(type);
-        break;
+        current_frame.end_ptr = trace_end;
+        return trace_end;
     }
   }
-  if (pending_break || current_frame.command_count) {
-    current_frame.end_ptr = trace_ptr;
-    frames_.push_back(std::move(current_frame));
-  }
+  current_frame.end_ptr = trace_ptr;
+  return trace_ptr;
 }
 
 bool TraceReader::DecompressMemory(MemoryEncodingFormat encoding_format,
@@ -228,6 +361,25 @@ bool TraceReader::DecompressMemory(MemoryEncodingFormat encoding_format,
     case MemoryEncodingFormat::kSnappy:
       return snappy::RawUncompress(reinterpret_cast<const char*>(src), src_size,
                                    reinterpret_cast<char*>(dest));
+    case MemoryEncodingFormat::kReference: {
+      assert_true(src_size == sizeof(uint64_t));
+      uint64_t command_offset;
+      std::memcpy(&command_offset, src, sizeof(command_offset));
+      if (command_offset + sizeof(MemoryCommand) > trace_size_) {
+        assert_always();
+        return false;
+      }
+      auto cmd =
+          reinterpret_cast<const MemoryCommand*>(trace_data_ + command_offset);
+      if (cmd->encoding_format == MemoryEncodingFormat::kReference ||
+          cmd->decoded_length != dest_size) {
+        assert_always();
+        return false;
+      }
+      return DecompressMemory(cmd->encoding_format,
+                              trace_data_ + command_offset + sizeof(*cmd),
+                              cmd->encoded_length, dest, dest_size);
+    }
     default:
       assert_unhandled_case(encoding_format);
       return false;
@@ -126,15 +126,29 @@ class TraceReader {
     return reinterpret_cast<const TraceHeader*>(trace_data_);
   }
 
-  const Frame* frame(int n) const { return &frames_[n]; }
+  // Commands of the frames located via the index are parsed on first access.
+  const Frame* frame(int n) const;
   int frame_count() const { return int(frames_.size()); }
 
+  // Returns the last memory keyframe at or before the frame, or nullptr if
+  // there's none and the memory state can only be reconstructed by replaying
+  // the memory reads from the beginning.
+  const TraceIndexKeyframe* FindMemoryKeyframe(int frame) const;
+
   bool Open(const std::filesystem::path& path);
 
   void Close();
 
  protected:
   void ParseTrace();
+  bool ParseIndex();
+  // Parses the commands until the end of the frame, returning where the next
+  // frame starts.
+  const uint8_t* ParseFrame(const uint8_t* trace_ptr, const uint8_t* trace_end,
+                            Frame& current_frame) const;
+  // Returns the pointer to the command after the one at trace_ptr, or nullptr
+  // if the command is invalid.
+  static const uint8_t* SkipCommand(const uint8_t* trace_ptr);
   bool DecompressMemory(MemoryEncodingFormat encoding_format,
                         const uint8_t* src, size_t src_size, uint8_t* dest,
                         size_t dest_size);
@@ -142,7 +156,10 @@ class TraceReader {
   std::unique_ptr<MappedMemory> mmap_;
   const uint8_t* trace_data_ = nullptr;
   size_t trace_size_ = 0;
-  std::vector<Frame> frames_;
+  // The index, if present, follows the command stream.
+  const uint8_t* commands_end_ = nullptr;
+  mutable std::vector<Frame> frames_;
+  std::vector<TraceIndexKeyframe> keyframes_;
 };
 
 }  // namespace gpu
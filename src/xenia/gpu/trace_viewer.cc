@@ -198,6 +198,7 @@ void TraceViewer::DrawUI() {
   DrawCommandListUI();
   DrawStateUI();
   DrawPacketDisassemblerUI();
+  DrawGpuTimingUI();
 }
 
 void TraceViewer::DrawControllerUI() {
@@ -248,6 +249,30 @@ void TraceViewer::DrawControllerUI() {
   ImGui::End();
 }
 
+void TraceViewer::DrawGpuTimingUI() {
+  double timing[size_t(GpuTimingCategory::kCount)];
+  if (!graphics_system_->command_processor()->GetGpuFrameTiming(timing)) {
+    return;
+  }
+  ImGui::SetNextWindowCollapsed(true, ImGuiCond_FirstUseEver);
+  ImGui::SetNextWindowPos(ImVec2(345 + 5, 5), ImGuiCond_FirstUseEver);
+  ImGui::SetNextWindowSize(ImVec2(240, 140));
+  if (!ImGui::Begin("GPU Timing", nullptr)) {
+    ImGui::End();
+    return;
+  }
+  static const char* const kCategoryNames[] = {
+      "Draws", "Resolves", "EDRAM stores", "EDRAM loads", "Texture loads",
+  };
+  static_assert(
+      xe::countof(kCategoryNames) == size_t(GpuTimingCategory::kCount),
+      "GPU timing category names must match the categories");
+  for (size_t i = 0; i < size_t(GpuTimingCategory::kCount); ++i) {
+    ImGui::Text("%s: %.3f ms", kCategoryNames[i], timing[i] * 0.001);
+  }
+  ImGui::End();
+}
+
 void TraceViewer::DrawPacketDisassemblerUI() {
   ImGui::SetNextWindowCollapsed(true, ImGuiCond_FirstUseEver);
   ImGui::SetNextWindowPos(ImVec2(float(window_->width()) - 500 - 5, 5),
@@ -380,6 +405,11 @@ void TraceViewer::DrawPacketDisassemblerUI() {
         // ImGui::BulletText("EdramSnapshot");
         break;
       }
+      case TraceCommandType::kMemoryKeyframe: {
+        auto cmd = reinterpret_cast<const MemoryKeyframeCommand*>(trace_ptr);
+        trace_ptr += sizeof(*cmd) + sizeof(uint64_t) * cmd->command_count;
+        break;
+      }
       case TraceCommandType::kEvent: {
         auto cmd = reinterpret_cast<const EventCommand*>(trace_ptr);
         trace_ptr += sizeof(*cmd);
@@ -84,6 +84,7 @@ class TraceViewer {
                                    TraceReader::CommandBuffer* buffer);
   void DrawCommandListUI();
   void DrawStateUI();
+  void DrawGpuTimingUI();
 
   ShaderDisplayType DrawShaderTypeUI();
   void DrawShaderUI(Shader* shader, ShaderDisplayType display_type);
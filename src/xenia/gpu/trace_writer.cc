@@ -10,9 +10,10 @@
 #include "xenia/gpu/trace_writer.h"
 
 #include <cstring>
+#include <iterator>
 
-#include "third_party/snappy/snappy-sinksource.h"
 #include "third_party/snappy/snappy.h"
+#include "third_party/xxhash/xxhash.h"
 
 #include "build/version.h"
 #include "xenia/base/assert.h"
@@ -27,7 +28,7 @@ namespace gpu {
 TraceWriter::TraceWriter(uint8_t* membase)
     : membase_(membase), file_(nullptr) {}
 
-TraceWriter::~TraceWriter() = default;
+TraceWriter::~TraceWriter() { Close(); }
 
 bool TraceWriter::Open(const std::filesystem::path& path, uint32_t title_id) {
   Close();
@@ -50,20 +51,68 @@ bool TraceWriter::Open(const std::filesystem::path& path, uint32_t title_id) {
               sizeof(header.build_commit_sha));
   header.title_id = title_id;
   fwrite(&header, sizeof(header), 1, file_);
+  file_offset_ = sizeof(header);
 
   cached_memory_reads_.clear();
+  written_memory_reads_.clear();
+  frame_end_pending_ = false;
+  frame_offsets_.clear();
+  frame_offsets_.push_back(file_offset_);
+  keyframes_.clear();
+  frames_since_keyframe_ = 0;
+  live_memory_ranges_.clear();
+  live_memory_read_refs_.clear();
+
+  write_queue_bytes_ = 0;
+  write_flush_ = false;
+  write_thread_shutdown_ = false;
+  write_thread_ =
+      xe::threading::Thread::Create({}, [this]() { WriteThread(); });
+  if (!write_thread_) {
+    XELOGE("Failed to create the GPU trace write thread");
+    fclose(file_);
+    file_ = nullptr;
+    return false;
+  }
+  write_thread_->set_name("GPU Trace Writer");
   return true;
 }
 
 void TraceWriter::Flush() {
-  if (file_) {
-    fflush(file_);
+  if (!file_) {
+    return;
   }
+  SubmitRaw();
+  {
+    std::lock_guard<std::mutex> lock(write_lock_);
+    write_flush_ = true;
+  }
+  write_request_cond_.notify_one();
 }
 
 void TraceWriter::Close() {
   if (file_) {
+    SubmitRaw();
+    // The thread writes everything remaining in the queue before exiting.
+    {
+      std::lock_guard<std::mutex> lock(write_lock_);
+      write_thread_shutdown_ = true;
+    }
+    write_request_cond_.notify_all();
+    xe::threading::Wait(write_thread_.get(), false);
+    write_thread_.reset();
+
+    WriteIndex();
+
     cached_memory_reads_.clear();
+    written_memory_reads_.clear();
+    frame_offsets_.clear();
+    keyframes_.clear();
+    live_memory_ranges_.clear();
+    live_memory_read_refs_.clear();
+    free_buffers_.clear();
+    compression_buffer_.clear();
+    compression_buffer_.shrink_to_fit();
 
     fflush(file_);
     fclose(file_);
@@ -80,7 +129,7 @@ void TraceWriter::WritePrimaryBufferStart(uint32_t base_ptr, uint32_t count) {
       base_ptr,
       0,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  AppendRaw(&cmd, sizeof(cmd));
 }
 
 void TraceWriter::WritePrimaryBufferEnd() {
@@ -90,7 +139,7 @@ void TraceWriter::WritePrimaryBufferEnd() {
   PrimaryBufferEndCommand cmd = {
       TraceCommandType::kPrimaryBufferEnd,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  AppendRaw(&cmd, sizeof(cmd));
 }
 
 void TraceWriter::WriteIndirectBufferStart(uint32_t base_ptr, uint32_t count) {
@@ -102,7 +151,7 @@ void TraceWriter::WriteIndirectBufferStart(uint32_t base_ptr, uint32_t count) {
       base_ptr,
       0,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  AppendRaw(&cmd, sizeof(cmd));
 }
 
 void TraceWriter::WriteIndirectBufferEnd() {
@@ -112,7 +161,7 @@ void TraceWriter::WriteIndirectBufferEnd() {
   IndirectBufferEndCommand cmd = {
       TraceCommandType::kIndirectBufferEnd,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  AppendRaw(&cmd, sizeof(cmd));
 }
 
 void TraceWriter::WritePacketStart(uint32_t base_ptr, uint32_t count) {
@@ -124,8 +173,8 @@ void TraceWriter::WritePacketStart(uint32_t base_ptr, uint32_t count) {
       base_ptr,
       count,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
-  fwrite(membase_ + base_ptr, 4, count, file_);
+  AppendRaw(&cmd, sizeof(cmd));
+  AppendRaw(membase_ + base_ptr, sizeof(uint32_t) * count);
 }
 
 void TraceWriter::WritePacketEnd() {
@@ -135,7 +184,13 @@ void TraceWriter::WritePacketEnd() {
   PacketEndCommand cmd = {
       TraceCommandType::kPacketEnd,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  AppendRaw(&cmd, sizeof(cmd));
+  if (frame_end_pending_) {
+    frame_end_pending_ = false;
+    SubmitRaw();
+    QueueBlock(WriteBlock::Type::kFrameEnd, TraceCommandType::kEvent, 0,
+               std::vector<uint8_t>());
+  }
 }
 
 void TraceWriter::WriteMemoryRead(uint32_t base_ptr, size_t length,
@@ -180,96 +235,291 @@ void TraceWriter::WriteMemoryWrite(uint32_t base_ptr, size_t length,
                      host_ptr);
 }
 
-class SnappySink : public snappy::Sink {
- public:
-  SnappySink(FILE* file) : file_(file) {}
+void TraceWriter::WriteMemoryCommand(TraceCommandType type, uint32_t base_ptr,
+                                     size_t length, const void* host_ptr) {
+  if (!host_ptr) {
+    host_ptr = membase_ + base_ptr;
+  }
+  // Take a copy of the data now since the guest may modify it afterwards,
+  // hashing and compression are done on the write thread.
+  SubmitRaw();
+  std::vector<uint8_t> data = AcquireBuffer();
+  const uint8_t* host_bytes = reinterpret_cast<const uint8_t*>(host_ptr);
+  data.assign(host_bytes, host_bytes + length);
+  QueueBlock(WriteBlock::Type::kMemory, type, base_ptr, std::move(data));
+}
 
-  void Append(const char* bytes, size_t n) override {
-    fwrite(bytes, 1, n, file_);
+void TraceWriter::WriteEdramSnapshot(const void* snapshot) {
+  if (!file_) {
+    return;
   }
+  SubmitRaw();
+  std::vector<uint8_t> data = AcquireBuffer();
+  const uint8_t* snapshot_bytes = reinterpret_cast<const uint8_t*>(snapshot);
+  data.assign(snapshot_bytes, snapshot_bytes + xenos::kEdramSizeBytes);
+  QueueBlock(WriteBlock::Type::kEdramSnapshot, TraceCommandType::kEdramSnapshot,
+             0, std::move(data));
+}
 
- private:
-  FILE* file_ = nullptr;
-};
+void TraceWriter::WriteEvent(EventCommand::Type event_type) {
+  if (!file_) {
+    return;
+  }
+  EventCommand cmd = {
+      TraceCommandType::kEvent,
+      event_type,
+  };
+  AppendRaw(&cmd, sizeof(cmd));
+  if (event_type == EventCommand::Type::kSwap) {
+    // Same as TraceReader, the frame includes the rest of the swap packet.
+    frame_end_pending_ = true;
+  }
+}
+
+void TraceWriter::AppendRaw(const void* data, size_t length) {
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+  pending_raw_.insert(pending_raw_.end(), bytes, bytes + length);
+  if (pending_raw_.size() >= kRawBlockSize) {
+    SubmitRaw();
+  }
+}
+
+void TraceWriter::SubmitRaw() {
+  if (pending_raw_.empty()) {
+    return;
+  }
+  QueueBlock(WriteBlock::Type::kRaw, TraceCommandType::kPacketStart, 0,
+             std::move(pending_raw_));
+  pending_raw_ = AcquireBuffer();
+}
+
+std::vector<uint8_t> TraceWriter::AcquireBuffer() {
+  std::lock_guard<std::mutex> lock(write_lock_);
+  if (free_buffers_.empty()) {
+    return std::vector<uint8_t>();
+  }
+  std::vector<uint8_t> buffer = std::move(free_buffers_.back());
+  free_buffers_.pop_back();
+  return buffer;
+}
+
+void TraceWriter::QueueBlock(WriteBlock::Type type,
+                             TraceCommandType memory_command_type,
+                             uint32_t base_ptr, std::vector<uint8_t>&& data) {
+  size_t size = data.size();
+  {
+    std::unique_lock<std::mutex> lock(write_lock_);
+    // Let a block bigger than the limit through when the queue is empty.
+    while (write_queue_bytes_ && write_queue_bytes_ + size > kMaxQueuedBytes) {
+      write_space_cond_.wait(lock);
+    }
+    WriteBlock& block = write_queue_.emplace_back();
+    block.type = type;
+    block.memory_command_type = memory_command_type;
+    block.base_ptr = base_ptr;
+    block.data = std::move(data);
+    write_queue_bytes_ += size;
+  }
+  write_request_cond_.notify_one();
+}
+
+void TraceWriter::WriteThread() {
+  while (true) {
+    WriteBlock block;
+    {
+      std::unique_lock<std::mutex> lock(write_lock_);
+      while (write_queue_.empty() && !write_flush_ && !write_thread_shutdown_) {
+        write_request_cond_.wait(lock);
+      }
+      if (write_queue_.empty()) {
+        if (write_thread_shutdown_) {
+          return;
+        }
+        write_flush_ = false;
+        lock.unlock();
+        fflush(file_);
+        continue;
+      }
+      block = std::move(write_queue_.front());
+      write_queue_.pop_front();
+    }
+
+    switch (block.type) {
+      case WriteBlock::Type::kRaw:
+        WriteEncoded(nullptr, 0, block.data.data(), block.data.size());
+        break;
+      case WriteBlock::Type::kMemory:
+        WriteMemoryBlock(block);
+        break;
+      case WriteBlock::Type::kEdramSnapshot: {
+        EdramSnapshotCommand cmd;
+        cmd.type = TraceCommandType::kEdramSnapshot;
+        if (compress_output_) {
+          snappy::Compress(reinterpret_cast<const char*>(block.data.data()),
+                           block.data.size(), &compression_buffer_);
+          cmd.encoding_format = MemoryEncodingFormat::kSnappy;
+          cmd.encoded_length = uint32_t(compression_buffer_.size());
+          WriteEncoded(&cmd, sizeof(cmd), compression_buffer_.data(),
+                       compression_buffer_.size());
+        } else {
+          cmd.encoding_format = MemoryEncodingFormat::kNone;
+          cmd.encoded_length = uint32_t(block.data.size());
+          WriteEncoded(&cmd, sizeof(cmd), block.data.data(),
+                       block.data.size());
+        }
+      } break;
+      case WriteBlock::Type::kFrameEnd:
+        EndFrame();
+        break;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(write_lock_);
+      write_queue_bytes_ -= block.data.size();
+      if (free_buffers_.size() < kMaxFreeBuffers &&
+          block.data.capacity() <= kMaxFreeBufferSize) {
+        block.data.clear();
+        free_buffers_.push_back(std::move(block.data));
+      }
+    }
+    write_space_cond_.notify_one();
+  }
+}
+
+void TraceWriter::WriteMemoryBlock(const WriteBlock& block) {
+  const uint8_t* data = block.data.data();
+  size_t length = block.data.size();
 
-void TraceWriter::WriteMemoryCommand(TraceCommandType type, uint32_t base_ptr,
-                                     size_t length, const void* host_ptr) {
   MemoryCommand cmd;
-  cmd.type = type;
-  cmd.base_ptr = base_ptr;
-  cmd.encoding_format = MemoryEncodingFormat::kNone;
-  cmd.encoded_length = cmd.decoded_length = static_cast<uint32_t>(length);
+  cmd.type = block.memory_command_type;
+  cmd.base_ptr = block.base_ptr;
+  cmd.decoded_length = static_cast<uint32_t>(length);
 
-  if (!host_ptr) {
-    host_ptr = membase_ + cmd.base_ptr;
+  if (cmd.type == TraceCommandType::kMemoryRead) {
+    UpdateLiveMemoryReads(cmd.base_ptr, cmd.decoded_length, file_offset_);
+  }
+
+  // Only reads are replayed, so only they may be referenced.
+  if (deduplicate_memory_reads_ && cmd.type == TraceCommandType::kMemoryRead &&
+      length > kDeduplicationThreshold) {
+    uint64_t hash = XXH64(data, length, 0);
+    auto it = written_memory_reads_.find(hash);
+    if (it != written_memory_reads_.end() && it->second.length == length) {
+      cmd.encoding_format = MemoryEncodingFormat::kReference;
+      cmd.encoded_length = sizeof(uint64_t);
+      WriteEncoded(&cmd, sizeof(cmd), &it->second.command_offset,
+                   sizeof(uint64_t));
+      return;
+    }
+    WrittenMemoryRead& written_memory_read = written_memory_reads_[hash];
+    written_memory_read.length = cmd.decoded_length;
+    written_memory_read.command_offset = file_offset_;
   }
 
-  bool compress = compress_output_ && length > compression_threshold_;
-  if (compress) {
-    // Write the header now so we reserve space in the buffer.
-    long header_position = std::ftell(file_);
+  if (compress_output_ && length > compression_threshold_) {
+    snappy::Compress(reinterpret_cast<const char*>(data), length,
+                     &compression_buffer_);
     cmd.encoding_format = MemoryEncodingFormat::kSnappy;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-
-    // Stream the content right to the buffer.
-    snappy::ByteArraySource snappy_source(
-        reinterpret_cast<const char*>(host_ptr), cmd.decoded_length);
-    SnappySink snappy_sink(file_);
-    cmd.encoded_length =
-        static_cast<uint32_t>(snappy::Compress(&snappy_source, &snappy_sink));
-
-    // Seek back and overwrite the header with our final size.
-    std::fseek(file_, header_position, SEEK_SET);
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    std::fseek(file_, header_position + sizeof(cmd) + cmd.encoded_length,
-               SEEK_SET);
+    cmd.encoded_length = static_cast<uint32_t>(compression_buffer_.size());
+    WriteEncoded(&cmd, sizeof(cmd), compression_buffer_.data(),
+                 compression_buffer_.size());
   } else {
     // Uncompressed - write buffer directly to the file.
     cmd.encoding_format = MemoryEncodingFormat::kNone;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    fwrite(host_ptr, 1, cmd.decoded_length, file_);
+    cmd.encoded_length = cmd.decoded_length;
+    WriteEncoded(&cmd, sizeof(cmd), data, length);
   }
 }
 
-void TraceWriter::WriteEdramSnapshot(const void* snapshot) {
-  EdramSnapshotCommand cmd;
-  cmd.type = TraceCommandType::kEdramSnapshot;
-  if (compress_output_) {
-    // Write the header now so we reserve space in the buffer.
-    long header_position = std::ftell(file_);
-    cmd.encoding_format = MemoryEncodingFormat::kSnappy;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-
-    // Stream the content right to the buffer.
-    snappy::ByteArraySource snappy_source(
-        reinterpret_cast<const char*>(snapshot), xenos::kEdramSizeBytes);
-    SnappySink snappy_sink(file_);
-    cmd.encoded_length =
-        static_cast<uint32_t>(snappy::Compress(&snappy_source, &snappy_sink));
-
-    // Seek back and overwrite the header with our final size.
-    std::fseek(file_, header_position, SEEK_SET);
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    std::fseek(file_, header_position + sizeof(cmd) + cmd.encoded_length,
-               SEEK_SET);
-  } else {
-    // Uncompressed - write buffer directly to the file.
-    cmd.encoding_format = MemoryEncodingFormat::kNone;
-    cmd.encoded_length = xenos::kEdramSizeBytes;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    fwrite(snapshot, 1, xenos::kEdramSizeBytes, file_);
+void TraceWriter::WriteEncoded(const void* header, size_t header_size,
+                               const void* data, size_t data_size) {
+  if (header_size) {
+    fwrite(header, 1, header_size, file_);
+  }
+  if (data_size) {
+    fwrite(data, 1, data_size, file_);
   }
+  file_offset_ += header_size + data_size;
 }
 
-void TraceWriter::WriteEvent(EventCommand::Type event_type) {
-  if (!file_) {
+void TraceWriter::EndFrame() {
+  frame_offsets_.push_back(file_offset_);
+  if (++frames_since_keyframe_ < kMemoryKeyframeInterval) {
     return;
   }
-  EventCommand cmd = {
-      TraceCommandType::kEvent,
-      event_type,
-  };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  frames_since_keyframe_ = 0;
+  TraceIndexKeyframe& keyframe = keyframes_.emplace_back();
+  keyframe.command_offset = file_offset_;
+  keyframe.frame = uint32_t(frame_offsets_.size() - 1);
+  keyframe.padding = 0;
+  MemoryKeyframeCommand cmd;
+  cmd.type = TraceCommandType::kMemoryKeyframe;
+  cmd.command_count = uint32_t(live_memory_read_refs_.size());
+  WriteEncoded(&cmd, sizeof(cmd), nullptr, 0);
+  for (const auto& live_memory_read : live_memory_read_refs_) {
+    WriteEncoded(nullptr, 0, &live_memory_read.first, sizeof(uint64_t));
+  }
+}
+
+void TraceWriter::UpdateLiveMemoryReads(uint32_t base_ptr, uint32_t length,
+                                        uint64_t command_offset) {
+  if (!length) {
+    return;
+  }
+  uint64_t end = uint64_t(base_ptr) + length;
+  auto it = live_memory_ranges_.lower_bound(base_ptr);
+  if (it != live_memory_ranges_.begin()) {
+    auto previous = std::prev(it);
+    if (previous->second.end > base_ptr) {
+      if (previous->second.end > end) {
+        // The new range is in the middle of the previous one.
+        live_memory_ranges_.emplace_hint(it, uint32_t(end), previous->second);
+        ++live_memory_read_refs_[previous->second.command_offset];
+      }
+      previous->second.end = base_ptr;
+    }
+  }
+  while (it != live_memory_ranges_.end() && it->first < end) {
+    if (it->second.end > end) {
+      // Keep the tail of the last overlapping range.
+      LiveMemoryRange tail = it->second;
+      it = live_memory_ranges_.erase(it);
+      it = live_memory_ranges_.emplace_hint(it, uint32_t(end), tail);
+      break;
+    }
+    ReleaseLiveMemoryRead(it->second.command_offset);
+    it = live_memory_ranges_.erase(it);
+  }
+  live_memory_ranges_.emplace_hint(it, base_ptr,
+                                   LiveMemoryRange{end, command_offset});
+  ++live_memory_read_refs_[command_offset];
+}
+
+void TraceWriter::ReleaseLiveMemoryRead(uint64_t command_offset) {
+  auto it = live_memory_read_refs_.find(command_offset);
+  assert_true(it != live_memory_read_refs_.end());
+  if (it != live_memory_read_refs_.end() && !--it->second) {
+    live_memory_read_refs_.erase(it);
+  }
+}
+
+void TraceWriter::WriteIndex() {
+  // Drop the empty frame after the last swap.
+  if (frame_offsets_.size() > 1 && frame_offsets_.back() == file_offset_) {
+    frame_offsets_.pop_back();
+  }
+  TraceIndexFooter footer;
+  footer.frame_table_offset = file_offset_;
+  footer.frame_count = uint32_t(frame_offsets_.size());
+  WriteEncoded(nullptr, 0, frame_offsets_.data(),
+               sizeof(uint64_t) * frame_offsets_.size());
+  footer.keyframe_table_offset = file_offset_;
+  footer.keyframe_count = uint32_t(keyframes_.size());
+  WriteEncoded(nullptr, 0, keyframes_.data(),
+               sizeof(TraceIndexKeyframe) * keyframes_.size());
+  footer.magic = kTraceIndexMagic;
+  footer.padding = 0;
+  WriteEncoded(&footer, sizeof(footer), nullptr, 0);
 }
 
 }  //  namespace gpu
@@ -10,10 +10,19 @@
 #ifndef XENIA_GPU_TRACE_WRITER_H_
 #define XENIA_GPU_TRACE_WRITER_H_
 
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
+#include "xenia/base/threading.h"
 #include "xenia/gpu/trace_protocol.h"
 
 namespace xe {
@@ -46,15 +55,110 @@ class TraceWriter {
   void WriteEvent(EventCommand::Type event_type);
 
  private:
+  // Part of the trace stream handed over to the write thread. Commands that
+  // are written as is are batched into kRaw blocks, memory and EDRAM contents
+  // are copied into their own blocks so they can be hashed and compressed
+  // without stalling the command processor.
+  struct WriteBlock {
+    enum class Type {
+      kRaw,
+      kMemory,
+      kEdramSnapshot,
+      // No data, the next command starts a new frame.
+      kFrameEnd,
+    };
+    Type type;
+    // For kMemory blocks only.
+    TraceCommandType memory_command_type;
+    uint32_t base_ptr;
+    std::vector<uint8_t> data;
+  };
+
+  // A memory read payload already in the file, for deduplication.
+  struct WrittenMemoryRead {
+    uint32_t length;
+    // Offset of the MemoryCommand from the beginning of the file.
+    uint64_t command_offset;
+  };
+
+  // Blocks the producer while too much data is waiting to be written.
+  static constexpr size_t kMaxQueuedBytes = 64 * 1024 * 1024;
+  // Size after which the raw commands are submitted to the write thread
+  // without waiting for a memory command or a flush.
+  static constexpr size_t kRawBlockSize = 64 * 1024;
+  // Payloads not larger than a reference aren't deduplicated.
+  static constexpr size_t kDeduplicationThreshold = 64;
+  // Recycled buffers, bigger ones are freed to avoid holding onto memory.
+  static constexpr size_t kMaxFreeBuffers = 16;
+  static constexpr size_t kMaxFreeBufferSize = 4 * 1024 * 1024;
+  // Number of frames between memory keyframes allowing seeking.
+  static constexpr uint32_t kMemoryKeyframeInterval = 60;
+
+  // A range of memory whose latest contents were written by a memory read.
+  struct LiveMemoryRange {
+    uint64_t end;
+    uint64_t command_offset;
+  };
+
   void WriteMemoryCommand(TraceCommandType type, uint32_t base_ptr,
                           size_t length, const void* host_ptr = nullptr);
 
+  void AppendRaw(const void* data, size_t length);
+  // Moves the pending raw commands to the write queue.
+  void SubmitRaw();
+  std::vector<uint8_t> AcquireBuffer();
+  void QueueBlock(WriteBlock::Type type, TraceCommandType memory_command_type,
+                  uint32_t base_ptr, std::vector<uint8_t>&& data);
+
+  void WriteThread();
+  void WriteMemoryBlock(const WriteBlock& block);
+  void WriteEncoded(const void* header, size_t header_size, const void* data,
+                    size_t data_size);
+  void EndFrame();
+  void UpdateLiveMemoryReads(uint32_t base_ptr, uint32_t length,
+                             uint64_t command_offset);
+  void ReleaseLiveMemoryRead(uint64_t command_offset);
+  void WriteIndex();
+
   std::set<uint64_t> cached_memory_reads_;
   uint8_t* membase_;
   FILE* file_;
 
   bool compress_output_ = true;
   size_t compression_threshold_ = 1024;  // Min. number of bytes to compress.
+  bool deduplicate_memory_reads_ = true;
+
+  // Commands not submitted to the write thread yet, only accessed by the
+  // producer.
+  std::vector<uint8_t> pending_raw_;
+  // A swap event has been written, the frame ends at the end of the packet.
+  bool frame_end_pending_ = false;
+
+  // Write thread input is protected with write_lock_, the thread is notified
+  // about new blocks via write_request_cond_, and the producer is notified
+  // about freed queue space via write_space_cond_.
+  std::mutex write_lock_;
+  std::condition_variable write_request_cond_;
+  std::condition_variable write_space_cond_;
+  std::deque<WriteBlock> write_queue_;
+  size_t write_queue_bytes_ = 0;
+  std::vector<std::vector<uint8_t>> free_buffers_;
+  bool write_flush_ = false;
+  bool write_thread_shutdown_ = false;
+  std::unique_ptr<xe::threading::Thread> write_thread_;
+
+  // Only accessed by the write thread while it's running.
+  uint64_t file_offset_ = 0;
+  // Keyed by the XXH64 of the payload.
+  std::unordered_map<uint64_t, WrittenMemoryRead> written_memory_reads_;
+  std::string compression_buffer_;
+  std::vector<uint64_t> frame_offsets_;
+  std::vector<TraceIndexKeyframe> keyframes_;
+  uint32_t frames_since_keyframe_ = 0;
+  // Non-overlapping, keyed by the start address.
+  std::map<uint32_t, LiveMemoryRange> live_memory_ranges_;
+  // Number of live_memory_ranges_ referencing each memory read command.
+  std::map<uint64_t, uint32_t> live_memory_read_refs_;
 };
 
 }  // namespace gpu
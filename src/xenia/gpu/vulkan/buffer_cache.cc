@@ -9,6 +9,9 @@
 
 #include "xenia/gpu/vulkan/buffer_cache.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
@@ -93,8 +96,37 @@ void copy_and_swap_32_unaligned(void* dest_ptr, const void* src_ptr,
 
 using xe::ui::vulkan::CheckResult;
 
+// Registers followed by bindless texture descriptor indices.
 constexpr VkDeviceSize kConstantRegisterUniformRange =
-    512 * 4 * 4 + 8 * 4 + 32 * 4;
+    512 * 4 * 4 + 8 * 4 + 32 * 4 + 32 * 4;
+
+// Large enough for nearly all index and vertex buffers, bigger ones are placed
+// in the transient buffer.
+constexpr size_t kUploadBufferPageSize = 32 * 1024 * 1024;
+// Satisfies minStorageBufferOffsetAlignment on all devices.
+constexpr size_t kUploadBufferAlignment = 256;
+
+// Cached vertex buffers invalidated within this many submissions after being
+// converted this many times in a row are considered dynamic, and are uploaded
+// to the transient buffers instead, trying to cache them again periodically.
+constexpr uint64_t kVertexBufferEarlyInvalidationSubmissions = 4;
+constexpr uint32_t kVertexBufferDynamicInvalidations = 2;
+constexpr uint64_t kVertexBufferDynamicRetrySubmissions = 600;
+// Vertex buffers without a converted copy, unused for this long, are
+// forgotten.
+constexpr uint64_t kVertexBufferForgetSubmissions = 600;
+
+static void CopyAndSwapVertexData(void* dest, const void* source,
+                                  uint32_t length, xenos::Endian endian) {
+  if (endian == xenos::Endian::k8in32) {
+    // Endian::k8in32, swap words.
+    xe::copy_and_swap_32_unaligned(dest, source, length / 4);
+  } else if (endian == xenos::Endian::k16in32) {
+    xe::copy_and_swap_16_in_32_unaligned(dest, source, length / 4);
+  } else {
+    assert_always();
+  }
+}
 
 BufferCache::BufferCache(RegisterFile* register_file, Memory* memory,
                          ui::vulkan::VulkanDevice* device, size_t capacity)
@@ -104,6 +136,10 @@ BufferCache::BufferCache(RegisterFile* register_file, Memory* memory,
       VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
           VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
       capacity, 256);
+  upload_buffer_pool_ = std::make_unique<ui::vulkan::VulkanUploadBufferPool>(
+      device_,
+      VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      kUploadBufferPageSize);
 }
 
 BufferCache::~BufferCache() { Shutdown(); }
@@ -131,6 +167,10 @@ VkResult BufferCache::Initialize() {
     return status;
   }
 
+  memory_invalidation_callback_handle_ =
+      memory_->RegisterPhysicalMemoryInvalidationCallback(
+          MemoryInvalidationCallbackThunk, this);
+
   status = CreateConstantDescriptorSet();
   if (status != VK_SUCCESS) {
     return status;
@@ -305,7 +345,13 @@ void BufferCache::FreeConstantDescriptorSet() {
 }
 
 void BufferCache::Shutdown() {
+  if (memory_invalidation_callback_handle_ != nullptr) {
+    memory_->UnregisterPhysicalMemoryInvalidationCallback(
+        memory_invalidation_callback_handle_);
+    memory_invalidation_callback_handle_ = nullptr;
+  }
   if (mem_allocator_) {
+    ClearVertexBufferCache();
     vmaDestroyAllocator(mem_allocator_);
     mem_allocator_ = nullptr;
   }
@@ -313,6 +359,8 @@ void BufferCache::Shutdown() {
   FreeConstantDescriptorSet();
   FreeVertexDescriptorPool();
 
+  upload_buffer_pool_->ClearCache();
+  submissions_in_flight_.clear();
   transient_buffer_->Shutdown();
   VK_SAFE_DESTROY(vkFreeMemory, *device_, gpu_memory_pool_, nullptr);
 }
@@ -321,12 +369,13 @@ std::pair<VkDeviceSize, VkDeviceSize> BufferCache::UploadConstantRegisters(
     VkCommandBuffer command_buffer,
     const Shader::ConstantRegisterMap& vertex_constant_register_map,
     const Shader::ConstantRegisterMap& pixel_constant_register_map,
-    VkFence fence) {
+    VkFence fence, const uint32_t* bindless_texture_indices) {
   // Fat struct, including all registers:
   // struct {
   //   vec4 float[512];
   //   uint bool[8];
   //   uint loop[32];
+  //   uint texture_indices[32];
   // };
   auto offset = AllocateTransientData(kConstantRegisterUniformRange, fence);
   if (offset == VK_WHOLE_SIZE) {
@@ -346,6 +395,10 @@ std::pair<VkDeviceSize, VkDeviceSize> BufferCache::UploadConstantRegisters(
   std::memcpy(dest_ptr, &values[XE_GPU_REG_SHADER_CONSTANT_LOOP_00].u32,
               32 * 4);
   dest_ptr += 32 * 4;
+  if (bindless_texture_indices) {
+    std::memcpy(dest_ptr, bindless_texture_indices, 32 * 4);
+  }
+  dest_ptr += 32 * 4;
 
   transient_buffer_->Flush(offset, kConstantRegisterUniformRange);
 
@@ -422,8 +475,11 @@ std::pair<VkBuffer, VkDeviceSize> BufferCache::UploadIndexBuffer(
     VkCommandBuffer command_buffer, uint32_t source_addr,
     uint32_t source_length, xenos::IndexFormat format, VkFence fence) {
   // Allocate space in the buffer for our data.
-  auto offset = AllocateTransientData(source_length, fence);
-  if (offset == VK_WHOLE_SIZE) {
+  VkBuffer buffer;
+  VkDeviceSize offset;
+  uint8_t* dest_ptr =
+      AllocateUploadData(source_length, fence, &buffer, &offset);
+  if (!dest_ptr) {
     // OOM.
     return {nullptr, VK_WHOLE_SIZE};
   }
@@ -441,28 +497,25 @@ std::pair<VkBuffer, VkDeviceSize> BufferCache::UploadIndexBuffer(
   if (prim_reset_enabled) {
     if (format == xenos::IndexFormat::kInt16) {
       // Endian::k8in16, swap half-words.
-      copy_cmp_swap_16_unaligned(
-          transient_buffer_->host_base() + offset, source_ptr,
-          static_cast<uint16_t>(prim_reset_index), source_length / 2);
+      copy_cmp_swap_16_unaligned(dest_ptr, source_ptr,
+                                 static_cast<uint16_t>(prim_reset_index),
+                                 source_length / 2);
     } else if (format == xenos::IndexFormat::kInt32) {
       // Endian::k8in32, swap words.
-      copy_cmp_swap_32_unaligned(transient_buffer_->host_base() + offset,
-                                 source_ptr, prim_reset_index,
+      copy_cmp_swap_32_unaligned(dest_ptr, source_ptr, prim_reset_index,
                                  source_length / 4);
     }
   } else {
     if (format == xenos::IndexFormat::kInt16) {
       // Endian::k8in16, swap half-words.
-      xe::copy_and_swap_16_unaligned(transient_buffer_->host_base() + offset,
-                                     source_ptr, source_length / 2);
+      xe::copy_and_swap_16_unaligned(dest_ptr, source_ptr, source_length / 2);
     } else if (format == xenos::IndexFormat::kInt32) {
       // Endian::k8in32, swap words.
-      xe::copy_and_swap_32_unaligned(transient_buffer_->host_base() + offset,
-                                     source_ptr, source_length / 4);
+      xe::copy_and_swap_32_unaligned(dest_ptr, source_ptr, source_length / 4);
     }
   }
 
-  transient_buffer_->Flush(offset, source_length);
+  FlushUploadData(buffer, offset, source_length);
 
   // Append a barrier to the command buffer.
   VkBufferMemoryBarrier barrier = {
@@ -472,7 +525,7 @@ std::pair<VkBuffer, VkDeviceSize> BufferCache::UploadIndexBuffer(
       VK_ACCESS_INDEX_READ_BIT,
       VK_QUEUE_FAMILY_IGNORED,
       VK_QUEUE_FAMILY_IGNORED,
-      transient_buffer_->gpu_buffer(),
+      buffer,
       offset,
       source_length,
   };
@@ -480,15 +533,23 @@ std::pair<VkBuffer, VkDeviceSize> BufferCache::UploadIndexBuffer(
                        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1,
                        &barrier, 0, nullptr);
 
-  return {transient_buffer_->gpu_buffer(), offset};
+  return {buffer, offset};
 }
 
 std::pair<VkBuffer, VkDeviceSize> BufferCache::UploadVertexBuffer(
     VkCommandBuffer command_buffer, uint32_t source_addr,
     uint32_t source_length, xenos::Endian endian, VkFence fence) {
-  auto offset = FindCachedTransientData(source_addr, source_length);
-  if (offset != VK_WHOLE_SIZE) {
-    return {transient_buffer_->gpu_buffer(), offset};
+  if (cvars::vulkan_vertex_buffer_cache) {
+    auto cached_buffer = RequestCachedVertexBuffer(
+        command_buffer, source_addr, source_length, endian, fence);
+    if (cached_buffer.second != VK_WHOLE_SIZE) {
+      return cached_buffer;
+    }
+  }
+
+  auto cached = FindCachedTransientData(source_addr, source_length);
+  if (cached.second != VK_WHOLE_SIZE) {
+    return cached;
   }
 
   // Slow path :)
@@ -504,8 +565,10 @@ std::pair<VkBuffer, VkDeviceSize> BufferCache::UploadVertexBuffer(
   uint32_t source_offset = source_addr - upload_base;
 
   // Allocate space in the buffer for our data.
-  offset = AllocateTransientData(upload_size, fence);
-  if (offset == VK_WHOLE_SIZE) {
+  VkBuffer buffer;
+  VkDeviceSize offset;
+  uint8_t* dest_ptr = AllocateUploadData(upload_size, fence, &buffer, &offset);
+  if (!dest_ptr) {
     // OOM.
     XELOGW(
         "Failed to allocate transient data for vertex buffer! Wanted to "
@@ -518,18 +581,9 @@ std::pair<VkBuffer, VkDeviceSize> BufferCache::UploadVertexBuffer(
 
   // Copy data into the buffer.
   // TODO(benvanik): memcpy then use compute shaders to swap?
-  if (endian == xenos::Endian::k8in32) {
-    // Endian::k8in32, swap words.
-    xe::copy_and_swap_32_unaligned(transient_buffer_->host_base() + offset,
-                                   upload_ptr, source_length / 4);
-  } else if (endian == xenos::Endian::k16in32) {
-    xe::copy_and_swap_16_in_32_unaligned(
-        transient_buffer_->host_base() + offset, upload_ptr, source_length / 4);
-  } else {
-    assert_always();
-  }
+  CopyAndSwapVertexData(dest_ptr, upload_ptr, source_length, endian);
 
-  transient_buffer_->Flush(offset, upload_size);
+  FlushUploadData(buffer, offset, upload_size);
 
   // Append a barrier to the command buffer.
   VkBufferMemoryBarrier barrier = {
@@ -539,7 +593,7 @@ std::pair<VkBuffer, VkDeviceSize> BufferCache::UploadVertexBuffer(
       VK_ACCESS_SHADER_READ_BIT,
       VK_QUEUE_FAMILY_IGNORED,
       VK_QUEUE_FAMILY_IGNORED,
-      transient_buffer_->gpu_buffer(),
+      buffer,
       offset,
       upload_size,
   };
@@ -547,8 +601,193 @@ std::pair<VkBuffer, VkDeviceSize> BufferCache::UploadVertexBuffer(
                        VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 0, nullptr, 1,
                        &barrier, 0, nullptr);
 
-  CacheTransientData(upload_base, upload_size, offset);
-  return {transient_buffer_->gpu_buffer(), offset + source_offset};
+  CacheTransientData(upload_base, upload_size, buffer, offset);
+  return {buffer, offset + source_offset};
+}
+
+std::pair<VkBuffer, VkDeviceSize> BufferCache::RequestCachedVertexBuffer(
+    VkCommandBuffer command_buffer, uint32_t source_addr,
+    uint32_t source_length, xenos::Endian endian, VkFence fence) {
+  uint64_t submission = GetSubmissionIndex(fence);
+  uint64_t key = uint64_t(source_addr) | (uint64_t(source_length) << 32);
+  VertexBuffer* vertex_buffer;
+  bool watched;
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    auto it = vertex_buffers_.find(key);
+    if (it != vertex_buffers_.end()) {
+      vertex_buffer = it->second;
+    } else {
+      vertex_buffer = new VertexBuffer;
+      vertex_buffer->guest_address = source_addr;
+      vertex_buffer->size = source_length;
+      vertex_buffer->endian = endian;
+      vertex_buffer->buffer = nullptr;
+      vertex_buffer->alloc = nullptr;
+      vertex_buffer->conversion_submission = 0;
+      vertex_buffer->early_invalidation_count = 0;
+      vertex_buffer->watched = false;
+      vertex_buffers_.emplace(key, vertex_buffer);
+    }
+    watched = vertex_buffer->watched;
+  }
+  vertex_buffer->last_usage_submission = submission;
+
+  if (vertex_buffer->buffer) {
+    if (watched && vertex_buffer->endian == endian) {
+      return {vertex_buffer->buffer, 0};
+    }
+    if (!watched) {
+      // Written by the guest - detect vertex buffers rewritten every frame.
+      if (submission - vertex_buffer->conversion_submission <=
+          kVertexBufferEarlyInvalidationSubmissions) {
+        ++vertex_buffer->early_invalidation_count;
+      } else {
+        vertex_buffer->early_invalidation_count = 0;
+      }
+    }
+    RetireVertexBuffer(vertex_buffer);
+  }
+  if (vertex_buffer->early_invalidation_count >=
+          kVertexBufferDynamicInvalidations &&
+      submission - vertex_buffer->conversion_submission <
+          kVertexBufferDynamicRetrySubmissions) {
+    return {nullptr, VK_WHOLE_SIZE};
+  }
+
+  VkBufferCreateInfo buffer_info;
+  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.pNext = nullptr;
+  buffer_info.flags = 0;
+  buffer_info.size = VkDeviceSize(source_length);
+  buffer_info.usage =
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  buffer_info.queueFamilyIndexCount = 0;
+  buffer_info.pQueueFamilyIndices = nullptr;
+  VmaAllocationCreateInfo vma_create_info = {
+      0, VMA_MEMORY_USAGE_GPU_ONLY, 0, 0, 0, nullptr, nullptr,
+  };
+  VkBuffer buffer;
+  VmaAllocation alloc;
+  if (vmaCreateBuffer(mem_allocator_, &buffer_info, &vma_create_info, &buffer,
+                      &alloc, nullptr) != VK_SUCCESS) {
+    return {nullptr, VK_WHOLE_SIZE};
+  }
+  VkBuffer upload_buffer;
+  VkDeviceSize upload_offset;
+  uint8_t* upload_ptr = AllocateUploadData(source_length, fence,
+                                           &upload_buffer, &upload_offset);
+  if (!upload_ptr) {
+    vmaDestroyBuffer(mem_allocator_, buffer, alloc);
+    return {nullptr, VK_WHOLE_SIZE};
+  }
+
+  // Start watching before reading the guest data, so writes done after it has
+  // been read invalidate the copy.
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    vertex_buffer->watched = true;
+  }
+  memory_->EnablePhysicalMemoryAccessCallbacks(source_addr, source_length,
+                                               true, false);
+  CopyAndSwapVertexData(upload_ptr, memory_->TranslatePhysical(source_addr),
+                        source_length, endian);
+  FlushUploadData(upload_buffer, upload_offset, source_length);
+
+  VkBufferCopy copy_region;
+  copy_region.srcOffset = upload_offset;
+  copy_region.dstOffset = 0;
+  copy_region.size = VkDeviceSize(source_length);
+  vkCmdCopyBuffer(command_buffer, upload_buffer, buffer, 1, &copy_region);
+  VkBufferMemoryBarrier barrier;
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.pNext = nullptr;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = buffer;
+  barrier.offset = 0;
+  barrier.size = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 0, nullptr, 1,
+                       &barrier, 0, nullptr);
+
+  vertex_buffer->endian = endian;
+  vertex_buffer->buffer = buffer;
+  vertex_buffer->alloc = alloc;
+  vertex_buffer->conversion_submission = submission;
+  vertex_buffers_total_size_ += source_length;
+  return {buffer, 0};
+}
+
+void BufferCache::RetireVertexBuffer(VertexBuffer* vertex_buffer) {
+  if (!vertex_buffer->buffer) {
+    return;
+  }
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    vertex_buffer->watched = false;
+  }
+  vertex_buffers_retired_.push_back({vertex_buffer->buffer,
+                                     vertex_buffer->alloc,
+                                     vertex_buffer->last_usage_submission});
+  vertex_buffers_total_size_ -= vertex_buffer->size;
+  vertex_buffer->buffer = nullptr;
+  vertex_buffer->alloc = nullptr;
+}
+
+void BufferCache::ClearVertexBufferCache() {
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    for (auto& vertex_buffer_pair : vertex_buffers_) {
+      VertexBuffer* vertex_buffer = vertex_buffer_pair.second;
+      if (vertex_buffer->buffer) {
+        vmaDestroyBuffer(mem_allocator_, vertex_buffer->buffer,
+                         vertex_buffer->alloc);
+      }
+      delete vertex_buffer;
+    }
+    vertex_buffers_.clear();
+  }
+  vertex_buffers_total_size_ = 0;
+  for (const RetiredVertexBuffer& retired : vertex_buffers_retired_) {
+    vmaDestroyBuffer(mem_allocator_, retired.buffer, retired.alloc);
+  }
+  vertex_buffers_retired_.clear();
+}
+
+std::pair<uint32_t, uint32_t> BufferCache::MemoryInvalidationCallback(
+    uint32_t physical_address_start, uint32_t length, bool exact_range) {
+  auto global_lock = global_critical_region_.Acquire();
+  // Invalidate all the vertex buffers in the range, and get the gap between
+  // the remaining ones around it that can be safely unwatched.
+  uint32_t written_range_end = physical_address_start + length;
+  uint32_t previous_end = 0, next_start = UINT32_MAX;
+  for (auto& vertex_buffer_pair : vertex_buffers_) {
+    VertexBuffer* vertex_buffer = vertex_buffer_pair.second;
+    if (!vertex_buffer->watched) {
+      continue;
+    }
+    uint32_t vertex_buffer_end =
+        vertex_buffer->guest_address + vertex_buffer->size;
+    if (vertex_buffer->guest_address >= written_range_end) {
+      next_start = std::min(next_start, vertex_buffer->guest_address);
+    } else if (vertex_buffer_end <= physical_address_start) {
+      previous_end = std::max(previous_end, vertex_buffer_end);
+    } else {
+      vertex_buffer->watched = false;
+    }
+  }
+  return std::make_pair(previous_end, next_start - previous_end);
+}
+
+std::pair<uint32_t, uint32_t> BufferCache::MemoryInvalidationCallbackThunk(
+    void* context_ptr, uint32_t physical_address_start, uint32_t length,
+    bool exact_range) {
+  return reinterpret_cast<BufferCache*>(context_ptr)
+      ->MemoryInvalidationCallback(physical_address_start, length, exact_range);
 }
 
 void BufferCache::HashVertexBindings(
@@ -720,11 +959,47 @@ VkDeviceSize BufferCache::TryAllocateTransientData(VkDeviceSize length,
   return VK_WHOLE_SIZE;
 }
 
-VkDeviceSize BufferCache::FindCachedTransientData(uint32_t guest_address,
-                                                  uint32_t guest_length) {
+uint8_t* BufferCache::AllocateUploadData(VkDeviceSize length, VkFence fence,
+                                         VkBuffer* buffer_out,
+                                         VkDeviceSize* offset_out) {
+  if (length <= kUploadBufferPageSize) {
+    return upload_buffer_pool_->Request(GetSubmissionIndex(fence),
+                                        size_t(length), kUploadBufferAlignment,
+                                        buffer_out, offset_out);
+  }
+  VkDeviceSize offset = AllocateTransientData(length, fence);
+  if (offset == VK_WHOLE_SIZE) {
+    return nullptr;
+  }
+  *buffer_out = transient_buffer_->gpu_buffer();
+  *offset_out = offset;
+  return transient_buffer_->host_base() + offset;
+}
+
+void BufferCache::FlushUploadData(VkBuffer buffer, VkDeviceSize offset,
+                                  VkDeviceSize length) {
+  if (buffer == transient_buffer_->gpu_buffer()) {
+    transient_buffer_->Flush(offset, length);
+  } else {
+    upload_buffer_pool_->FlushWrites();
+  }
+}
+
+uint64_t BufferCache::GetSubmissionIndex(VkFence fence) {
+  // A fence may be reused for a later submission only after it has been
+  // signaled and removed from the list in Scavenge.
+  if (submissions_in_flight_.empty() ||
+      submissions_in_flight_.back().fence != fence) {
+    submissions_in_flight_.push_back({fence, ++submission_current_});
+  }
+  return submission_current_;
+}
+
+std::pair<VkBuffer, VkDeviceSize> BufferCache::FindCachedTransientData(
+    uint32_t guest_address, uint32_t guest_length) {
   if (transient_cache_.empty()) {
     // Short-circuit exit.
-    return VK_WHOLE_SIZE;
+    return {nullptr, VK_WHOLE_SIZE};
   }
 
   // Find the first element > guest_address
@@ -733,25 +1008,27 @@ VkDeviceSize BufferCache::FindCachedTransientData(uint32_t guest_address,
     // it = first element <= guest_address
     --it;
 
-    if ((it->first + it->second.first) >= (guest_address + guest_length)) {
+    if ((it->first + it->second.guest_length) >=
+        (guest_address + guest_length)) {
       // This data is contained within some existing transient data.
       auto source_offset = static_cast<VkDeviceSize>(guest_address - it->first);
-      return it->second.second + source_offset;
+      return {it->second.buffer, it->second.offset + source_offset};
     }
   }
 
-  return VK_WHOLE_SIZE;
+  return {nullptr, VK_WHOLE_SIZE};
 }
 
 void BufferCache::CacheTransientData(uint32_t guest_address,
-                                     uint32_t guest_length,
+                                     uint32_t guest_length, VkBuffer buffer,
                                      VkDeviceSize offset) {
-  transient_cache_[guest_address] = {guest_length, offset};
+  transient_cache_[guest_address] = {guest_length, buffer, offset};
 
   // Erase any entries contained within
   auto it = transient_cache_.upper_bound(guest_address);
   while (it != transient_cache_.end()) {
-    if ((guest_address + guest_length) >= (it->first + it->second.first)) {
+    if ((guest_address + guest_length) >=
+        (it->first + it->second.guest_length)) {
       it = transient_cache_.erase(it);
     } else {
       break;
@@ -769,6 +1046,8 @@ void BufferCache::Flush(VkCommandBuffer command_buffer) {
     //              VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
   }
 
+  upload_buffer_pool_->FlushWrites();
+
   // Flush memory.
   // TODO(benvanik): subrange.
   VkMappedMemoryRange dirty_range;
@@ -786,7 +1065,10 @@ void BufferCache::InvalidateCache() {
   transient_cache_.clear();
 }
 
-void BufferCache::ClearCache() { transient_cache_.clear(); }
+void BufferCache::ClearCache() {
+  transient_cache_.clear();
+  ClearVertexBufferCache();
+}
 
 void BufferCache::Scavenge() {
   SCOPE_profile_cpu_f("gpu");
@@ -794,6 +1076,64 @@ void BufferCache::Scavenge() {
   transient_cache_.clear();
   transient_buffer_->Scavenge();
 
+  while (!submissions_in_flight_.empty()) {
+    const SubmissionFence& submission = submissions_in_flight_.front();
+    VkResult status = vkGetFenceStatus(*device_, submission.fence);
+    if (status != VK_SUCCESS && status != VK_ERROR_DEVICE_LOST) {
+      break;
+    }
+    submission_completed_ = submission.submission_index;
+    submissions_in_flight_.pop_front();
+  }
+  upload_buffer_pool_->Reclaim(submission_completed_);
+
+  // Destroy the least recently used vertex buffers not in use by the GPU if
+  // over the limit, and forget about the ones without a converted copy
+  // unused for a long time.
+  uint64_t vertex_buffer_limit =
+      uint64_t(std::max(cvars::vulkan_vertex_buffer_cache_limit, 0)) << 20;
+  if (vertex_buffers_total_size_ > vertex_buffer_limit) {
+    std::vector<VertexBuffer*> eviction_candidates;
+    for (auto& vertex_buffer_pair : vertex_buffers_) {
+      VertexBuffer* vertex_buffer = vertex_buffer_pair.second;
+      if (vertex_buffer->buffer &&
+          vertex_buffer->last_usage_submission <= submission_completed_) {
+        eviction_candidates.push_back(vertex_buffer);
+      }
+    }
+    std::sort(eviction_candidates.begin(), eviction_candidates.end(),
+              [](const VertexBuffer* a, const VertexBuffer* b) {
+                return a->last_usage_submission < b->last_usage_submission;
+              });
+    for (VertexBuffer* vertex_buffer : eviction_candidates) {
+      if (vertex_buffers_total_size_ <= vertex_buffer_limit) {
+        break;
+      }
+      RetireVertexBuffer(vertex_buffer);
+    }
+  }
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    for (auto it = vertex_buffers_.begin(); it != vertex_buffers_.end();) {
+      VertexBuffer* vertex_buffer = it->second;
+      if (!vertex_buffer->buffer &&
+          vertex_buffer->last_usage_submission +
+                  kVertexBufferForgetSubmissions <
+              submission_current_) {
+        delete vertex_buffer;
+        it = vertex_buffers_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+  while (!vertex_buffers_retired_.empty() &&
+         vertex_buffers_retired_.front().submission <= submission_completed_) {
+    const RetiredVertexBuffer& retired = vertex_buffers_retired_.front();
+    vmaDestroyBuffer(mem_allocator_, retired.buffer, retired.alloc);
+    vertex_buffers_retired_.pop_front();
+  }
+
   // TODO(DrChat): These could persist across frames, we just need a smart way
   // to delete unused ones.
   vertex_sets_.clear();
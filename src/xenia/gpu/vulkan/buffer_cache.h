@@ -10,6 +10,7 @@
 #ifndef XENIA_GPU_VULKAN_BUFFER_CACHE_H_
 #define XENIA_GPU_VULKAN_BUFFER_CACHE_H_
 
+#include "xenia/base/mutex.h"
 #include "xenia/gpu/register_file.h"
 #include "xenia/gpu/shader.h"
 #include "xenia/gpu/xenos.h"
@@ -18,11 +19,14 @@
 #include "xenia/ui/vulkan/fenced_pools.h"
 #include "xenia/ui/vulkan/vulkan.h"
 #include "xenia/ui/vulkan/vulkan_device.h"
+#include "xenia/ui/vulkan/vulkan_upload_buffer_pool.h"
 
 #include "third_party/vulkan/vk_mem_alloc.h"
 #include "third_party/xxhash/xxhash.h"
 
+#include <deque>
 #include <map>
+#include <memory>
 #include <unordered_map>
 
 namespace xe {
@@ -66,11 +70,13 @@ class BufferCache {
   // Returns an offset that can be used with the transient_descriptor_set or
   // VK_WHOLE_SIZE if the constants could not be uploaded (OOM).
   // The returned offsets may alias.
+  // If bindless_texture_indices is not null, the 32 texture descriptor indices
+  // for the fetch constants are appended to the registers.
   std::pair<VkDeviceSize, VkDeviceSize> UploadConstantRegisters(
       VkCommandBuffer command_buffer,
       const Shader::ConstantRegisterMap& vertex_constant_register_map,
       const Shader::ConstantRegisterMap& pixel_constant_register_map,
-      VkFence fence);
+      VkFence fence, const uint32_t* bindless_texture_indices = nullptr);
 
   // Uploads index buffer data from guest memory, possibly eliding with
   // recently uploaded data or cached copies.
@@ -111,13 +117,31 @@ class BufferCache {
   void Scavenge();
 
  private:
-  // This represents an uploaded vertex buffer.
+  // This represents an endian-swapped copy of a vertex buffer kept in video
+  // memory across frames.
   struct VertexBuffer {
     uint32_t guest_address;
     uint32_t size;
+    xenos::Endian endian;
 
+    // nullptr if not converted currently (invalidated, evicted or rewritten
+    // too often to be cached).
+    VkBuffer buffer;
     VmaAllocation alloc;
-    VmaAllocationInfo alloc_info;
+
+    uint64_t last_usage_submission;
+    uint64_t conversion_submission;
+    // Number of consecutive invalidations soon after the conversion.
+    uint32_t early_invalidation_count;
+
+    // Accessed under the global critical region - whether the guest memory
+    // is watched and hasn't been written to since the conversion.
+    bool watched;
+  };
+  struct RetiredVertexBuffer {
+    VkBuffer buffer;
+    VmaAllocation alloc;
+    uint64_t submission;
   };
 
   VkResult CreateVertexDescriptorPool();
@@ -130,6 +154,23 @@ class BufferCache {
       XXH64_state_t* hash_state,
       const std::vector<Shader::VertexBinding>& vertex_bindings);
 
+  // Returns the cached converted copy of the vertex buffer, converting it if
+  // needed, or VK_WHOLE_SIZE as the offset if it should be uploaded to the
+  // transient buffers instead.
+  std::pair<VkBuffer, VkDeviceSize> RequestCachedVertexBuffer(
+      VkCommandBuffer command_buffer, uint32_t source_addr,
+      uint32_t source_length, xenos::Endian endian, VkFence fence);
+  // Queues the converted copy of the vertex buffer for destruction when the
+  // GPU is done with it.
+  void RetireVertexBuffer(VertexBuffer* vertex_buffer);
+  // Destroys all the cached vertex buffers - the GPU must be idle.
+  void ClearVertexBufferCache();
+  std::pair<uint32_t, uint32_t> MemoryInvalidationCallback(
+      uint32_t physical_address_start, uint32_t length, bool exact_range);
+  static std::pair<uint32_t, uint32_t> MemoryInvalidationCallbackThunk(
+      void* context_ptr, uint32_t physical_address_start, uint32_t length,
+      bool exact_range);
+
   // Allocates a block of memory in the transient buffer.
   // When memory is not available fences are checked and space is reclaimed.
   // Returns VK_WHOLE_SIZE if requested amount of memory is not available.
@@ -137,13 +178,24 @@ class BufferCache {
   // Tries to allocate a block of memory in the transient buffer.
   // Returns VK_WHOLE_SIZE if requested amount of memory is not available.
   VkDeviceSize TryAllocateTransientData(VkDeviceSize length, VkFence fence);
-  // Finds a block of data in the transient buffer sourced from the specified
+  // Allocates a block of memory in the upload buffer pool, creating a new page
+  // if needed rather than waiting for the GPU. Returns the mapping, or nullptr
+  // if out of memory.
+  // Data larger than a page is placed in the transient buffer.
+  uint8_t* AllocateUploadData(VkDeviceSize length, VkFence fence,
+                              VkBuffer* buffer_out, VkDeviceSize* offset_out);
+  // Makes the data written to the allocation visible to the GPU.
+  void FlushUploadData(VkBuffer buffer, VkDeviceSize offset,
+                       VkDeviceSize length);
+  // Returns the index of the submission the fence will be signaled for.
+  uint64_t GetSubmissionIndex(VkFence fence);
+  // Finds a block of data in the upload buffers sourced from the specified
   // guest address and length.
-  VkDeviceSize FindCachedTransientData(uint32_t guest_address,
-                                       uint32_t guest_length);
+  std::pair<VkBuffer, VkDeviceSize> FindCachedTransientData(
+      uint32_t guest_address, uint32_t guest_length);
   // Adds a block of data to the frame cache.
   void CacheTransientData(uint32_t guest_address, uint32_t guest_length,
-                          VkDeviceSize offset);
+                          VkBuffer buffer, VkDeviceSize offset);
 
   RegisterFile* register_file_ = nullptr;
   Memory* memory_ = nullptr;
@@ -152,10 +204,36 @@ class BufferCache {
   VkDeviceMemory gpu_memory_pool_ = nullptr;
   VmaAllocator mem_allocator_ = nullptr;
 
-  // Staging ringbuffer we cycle through fast. Used for data we don't
-  // plan on keeping past the current frame.
+  // Staging ringbuffer we cycle through fast. Used for constants, which must
+  // be in a single buffer for the dynamic uniform buffer descriptors.
   std::unique_ptr<ui::vulkan::CircularBuffer> transient_buffer_ = nullptr;
-  std::map<uint32_t, std::pair<uint32_t, VkDeviceSize>> transient_cache_;
+
+  // Pages for index and vertex data, reclaimed by submission index.
+  std::unique_ptr<ui::vulkan::VulkanUploadBufferPool> upload_buffer_pool_;
+  struct SubmissionFence {
+    VkFence fence;
+    uint64_t submission_index;
+  };
+  // Submissions that may still be executed on the GPU, in submission order.
+  std::deque<SubmissionFence> submissions_in_flight_;
+  uint64_t submission_current_ = 0;
+  uint64_t submission_completed_ = 0;
+
+  struct CachedTransientData {
+    uint32_t guest_length;
+    VkBuffer buffer;
+    VkDeviceSize offset;
+  };
+  std::map<uint32_t, CachedTransientData> transient_cache_;
+
+  // Vertex buffers converted and kept across frames, by guest address in the
+  // low 32 bits and size in the high 32 bits. Modified under the global
+  // critical region, since the invalidation callback iterates them.
+  std::unordered_map<uint64_t, VertexBuffer*> vertex_buffers_;
+  uint64_t vertex_buffers_total_size_ = 0;
+  std::deque<RetiredVertexBuffer> vertex_buffers_retired_;
+  void* memory_invalidation_callback_handle_ = nullptr;
+  xe::global_critical_region global_critical_region_;
 
   // Vertex buffer descriptors
   std::unique_ptr<ui::vulkan::DescriptorPool> vertex_descriptor_pool_ = nullptr;
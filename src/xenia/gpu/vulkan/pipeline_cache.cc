@@ -9,16 +9,27 @@
 
 #include "xenia/gpu/vulkan/pipeline_cache.h"
 
-#include "third_party/xxhash/xxhash.h"
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/hash.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/profiling.h"
+#include "xenia/base/threading.h"
 #include "xenia/gpu/gpu_flags.h"
 #include "xenia/gpu/vulkan/vulkan_gpu_flags.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cinttypes>
+#include <cstring>
+#include <functional>
 #include <string>
+#include <system_error>
 
 namespace xe {
 namespace gpu {
@@ -33,10 +44,71 @@ using xe::ui::vulkan::CheckResult;
 #include "xenia/gpu/vulkan/shaders/bin/quad_list_geom.h"
 #include "xenia/gpu/vulkan/shaders/bin/rect_list_geom.h"
 
+namespace {
+
+// Runs the function on the calling thread and on additional threads until all
+// of them return.
+void RunOnThreads(size_t thread_count, const char* thread_name,
+                  const std::function<void()>& function) {
+  std::vector<std::unique_ptr<xe::threading::Thread>> threads;
+  for (size_t i = 1; i < thread_count; ++i) {
+    threads.push_back(xe::threading::Thread::Create({}, function));
+    threads.back()->set_name(thread_name);
+    xe::threading::ApplyThreadRole(
+        threads.back().get(), xe::threading::ThreadRole::kShaderCompilation);
+  }
+  function();
+  for (auto& thread : threads) {
+    xe::threading::Wait(thread.get(), false);
+  }
+}
+
+}  // namespace
+
+const uint32_t PipelineCache::kPipelineStoredRegisters[] = {
+    XE_GPU_REG_RB_COLOR_INFO,
+    XE_GPU_REG_RB_DEPTH_INFO,
+    XE_GPU_REG_RB_COLOR1_INFO,
+    XE_GPU_REG_RB_COLOR2_INFO,
+    XE_GPU_REG_RB_COLOR3_INFO,
+    XE_GPU_REG_PA_SU_SC_MODE_CNTL,
+    XE_GPU_REG_SQ_PROGRAM_CNTL,
+    XE_GPU_REG_VGT_MULTI_PRIM_IB_RESET_INDX,
+    XE_GPU_REG_PA_CL_CLIP_CNTL,
+    XE_GPU_REG_PA_SC_SCREEN_SCISSOR_TL,
+    XE_GPU_REG_PA_SC_SCREEN_SCISSOR_BR,
+    XE_GPU_REG_PA_SC_VIZ_QUERY,
+    XE_GPU_REG_PA_SU_POLY_OFFSET_FRONT_SCALE,
+    XE_GPU_REG_PA_SU_POLY_OFFSET_FRONT_OFFSET,
+    XE_GPU_REG_PA_SU_POLY_OFFSET_BACK_SCALE,
+    XE_GPU_REG_PA_SU_POLY_OFFSET_BACK_OFFSET,
+    XE_GPU_REG_PA_SC_AA_CONFIG,
+    XE_GPU_REG_RB_SURFACE_INFO,
+    XE_GPU_REG_RB_DEPTHCONTROL,
+    XE_GPU_REG_RB_STENCILREFMASK,
+    XE_GPU_REG_RB_COLOR_MASK,
+    XE_GPU_REG_RB_BLENDCONTROL0,
+    XE_GPU_REG_RB_BLENDCONTROL1,
+    XE_GPU_REG_RB_BLENDCONTROL2,
+    XE_GPU_REG_RB_BLENDCONTROL3,
+    XE_GPU_REG_RB_MODECONTROL,
+};
+
 PipelineCache::PipelineCache(RegisterFile* register_file,
-                             ui::vulkan::VulkanDevice* device)
-    : register_file_(register_file), device_(device) {
-  shader_translator_.reset(new SpirvShaderTranslator());
+                             ui::vulkan::VulkanDevice* device,
+                             RenderCache* render_cache,
+                             bool bindless_textures,
+                             BenchmarkCounters* benchmark_counters)
+    : register_file_(register_file),
+      device_(device),
+      render_cache_(render_cache),
+      benchmark_counters_(benchmark_counters),
+      bindless_textures_(bindless_textures) {
+  static_assert(xe::countof(kPipelineStoredRegisters) ==
+                    kPipelineStoredRegisterCount,
+                "Stored pipeline register count mismatch");
+  shader_translator_.reset(new SpirvShaderTranslator(
+      bindless_textures_, render_cache_->resolution_scale()));
 }
 
 PipelineCache::~PipelineCache() { Shutdown(); }
@@ -47,10 +119,8 @@ VkResult PipelineCache::Initialize(
     VkDescriptorSetLayout vertex_descriptor_set_layout) {
   VkResult status;
 
-  // Initialize the shared driver pipeline cache.
-  // We'll likely want to serialize this and reuse it, if that proves to be
-  // useful. If the shaders are expensive and this helps we could do it per
-  // game, otherwise a single shared cache for render state/etc.
+  // Initialize the shared driver pipeline cache, replaced with the one from
+  // the storage when it's initialized for a title.
   VkPipelineCacheCreateInfo pipeline_cache_info;
   pipeline_cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
   pipeline_cache_info.pNext = nullptr;
@@ -165,11 +235,54 @@ VkResult PipelineCache::Initialize(
                             VK_DEBUG_REPORT_OBJECT_TYPE_SHADER_MODULE_EXT,
                             "S(p): Dummy");
 
+  // Start the pipeline creation threads.
+  creation_threads_busy_ = 0;
+  creation_threads_shutdown_ = false;
+  if (cvars::vulkan_pipeline_creation_threads != 0) {
+    uint32_t logical_processor_count =
+        xe::threading::logical_processor_count();
+    if (!logical_processor_count) {
+      // Pick some reasonable amount if couldn't determine the number of cores.
+      logical_processor_count = 6;
+    }
+    size_t creation_thread_count;
+    if (cvars::vulkan_pipeline_creation_threads < 0) {
+      creation_thread_count =
+          std::max(logical_processor_count * 3 / 4, uint32_t(1));
+    } else {
+      creation_thread_count =
+          std::min(uint32_t(cvars::vulkan_pipeline_creation_threads),
+                   logical_processor_count);
+    }
+    for (size_t i = 0; i < creation_thread_count; ++i) {
+      std::unique_ptr<xe::threading::Thread> creation_thread =
+          xe::threading::Thread::Create({}, [this]() { CreationThread(); });
+      creation_thread->set_name("Vulkan Pipelines");
+      xe::threading::ApplyThreadRole(
+          creation_thread.get(),
+          xe::threading::ThreadRole::kShaderCompilation);
+      creation_threads_.push_back(std::move(creation_thread));
+    }
+  }
+
   return VK_SUCCESS;
 }
 
 void PipelineCache::Shutdown() {
-  ClearCache();
+  ClearCache(true);
+
+  // Shut down the pipeline creation threads.
+  if (!creation_threads_.empty()) {
+    {
+      std::lock_guard<std::mutex> lock(creation_request_lock_);
+      creation_threads_shutdown_ = true;
+    }
+    creation_request_cond_.notify_all();
+    for (auto& creation_thread : creation_threads_) {
+      xe::threading::Wait(creation_thread.get(), false);
+    }
+    creation_threads_.clear();
+  }
 
   // Destroy geometry shaders.
   if (geometry_shaders_.line_quad_list) {
@@ -208,7 +321,8 @@ VulkanShader* PipelineCache::LoadShader(xenos::ShaderType shader_type,
                                         const uint32_t* host_address,
                                         uint32_t dword_count) {
   // Hash the input memory and lookup the shader.
-  uint64_t data_hash = XXH64(host_address, dword_count * sizeof(uint32_t), 0);
+  uint64_t data_hash =
+      xe::hash::Hash64(host_address, dword_count * sizeof(uint32_t));
   auto it = shader_map_.find(data_hash);
   if (it != shader_map_.end()) {
     // Shader has been previously loaded.
@@ -252,6 +366,7 @@ PipelineCache::UpdateStatus PipelineCache::ConfigurePipeline(
       current_pipeline_ = nullptr;
       break;
     case UpdateStatus::kError:
+    case UpdateStatus::kNotReady:
       // Error updating state - bail out.
       // We are in an indeterminate state, so reset things for the next attempt.
       current_pipeline_ = nullptr;
@@ -259,20 +374,52 @@ PipelineCache::UpdateStatus PipelineCache::ConfigurePipeline(
   }
   if (!pipeline) {
     // Should have a hash key produced by the UpdateState pass.
-    uint64_t hash_key = XXH64_digest(&hash_state_);
-    pipeline = GetPipeline(render_state, hash_key);
+    uint64_t hash_key = hash_state_.Digest();
+    bool pipeline_ready;
+    pipeline = GetPipeline(render_state, hash_key, pipeline_ready);
     current_pipeline_ = pipeline;
+    if (!pipeline_ready) {
+      return UpdateStatus::kNotReady;
+    }
     if (!pipeline) {
       // Unable to create pipeline.
       return UpdateStatus::kError;
     }
+    // The pipeline bound previously may be different if the current one has
+    // been reset after a skipped or a failed draw.
+    update_status = UpdateStatus::kMismatch;
   }
 
   *pipeline_out = pipeline;
   return update_status;
 }
 
-void PipelineCache::ClearCache() {
+void PipelineCache::ClearCache(bool shutting_down) {
+  // Drop the pipeline creation requests and wait for the pipelines being
+  // created, which may still be using the shaders.
+  if (!creation_threads_.empty()) {
+    std::unique_lock<std::mutex> lock(creation_request_lock_);
+    creation_queue_.clear();
+    creation_completion_cond_.wait(
+        lock, [this]() { return creation_threads_busy_ == 0; });
+    for (const auto& request : creation_completed_) {
+      if (request->pipeline) {
+        vkDestroyPipeline(*device_, request->pipeline, nullptr);
+      }
+    }
+    creation_completed_.clear();
+  }
+  creation_pending_.clear();
+
+  bool reinitialize_shader_storage =
+      !shutting_down && !shader_storage_root_.empty();
+  std::filesystem::path shader_storage_root;
+  uint32_t shader_storage_title_id = shader_storage_title_id_;
+  if (reinitialize_shader_storage) {
+    shader_storage_root = shader_storage_root_;
+  }
+  ShutdownShaderStorage();
+
   // Destroy all pipelines.
   for (auto it : cached_pipelines_) {
     vkDestroyPipeline(*device_, it.second, nullptr);
@@ -280,15 +427,539 @@ void PipelineCache::ClearCache() {
   cached_pipelines_.clear();
   COUNT_profile_set("gpu/pipeline_cache/pipelines", 0);
 
-  // Destroy all shaders.
+  // Destroy all shaders, and drop the references to them from the shadow
+  // registers.
   for (auto it : shader_map_) {
     delete it.second;
   }
   shader_map_.clear();
+  update_shader_stages_regs_.Reset();
+  update_vertex_input_state_regs_.Reset();
+  current_pipeline_ = nullptr;
+
+  if (reinitialize_shader_storage) {
+    InitializeShaderStorage(shader_storage_root, shader_storage_title_id,
+                            false);
+  }
+}
+
+void PipelineCache::InitializeShaderStorage(
+    const std::filesystem::path& storage_root, uint32_t title_id,
+    bool blocking) {
+  ShutdownShaderStorage();
+
+  auto shader_storage_root = storage_root / "shaders";
+  // For files that can be moved between different hosts.
+  auto shader_storage_shareable_root = shader_storage_root / "shareable";
+  // For the driver pipeline cache, only usable with the same device and
+  // driver.
+  auto shader_storage_local_root = shader_storage_root / "local";
+  for (const std::filesystem::path& shader_storage_subdirectory :
+       {shader_storage_shareable_root, shader_storage_local_root}) {
+    if (!std::filesystem::exists(shader_storage_subdirectory) &&
+        !std::filesystem::create_directories(shader_storage_subdirectory)) {
+      XELOGE(
+          "Failed to create a shader storage directory, persistent shader "
+          "storage will be disabled: {}",
+          xe::path_to_utf8(shader_storage_subdirectory));
+      return;
+    }
+  }
+
+  size_t logical_processor_count = xe::threading::logical_processor_count();
+  if (!logical_processor_count) {
+    // Pick some reasonable amount if couldn't determine the number of cores.
+    logical_processor_count = 6;
+  }
+
+  // Translated SPIR-V shared between titles, for both the stored shaders and
+  // the new ones.
+  spirv_binary_cache_ =
+      std::make_unique<SpirvShaderBinaryCache>(shader_storage_root / "spirv");
+
+  // Replace the empty driver pipeline cache with the stored one if it was
+  // created for this device and driver (drivers are supposed to validate the
+  // data too, but not all of them do that reliably).
+  {
+    auto pipeline_cache_file_path =
+        shader_storage_local_root /
+        fmt::format("{:08X}.vulkan.cache", title_id);
+    std::error_code pipeline_cache_file_size_error;
+    uintmax_t pipeline_cache_file_size = std::filesystem::file_size(
+        pipeline_cache_file_path, pipeline_cache_file_size_error);
+    FILE* pipeline_cache_file =
+        pipeline_cache_file_size_error
+            ? nullptr
+            : xe::filesystem::OpenFile(pipeline_cache_file_path, "rb");
+    if (pipeline_cache_file) {
+      std::vector<uint8_t> pipeline_cache_data(
+          size_t(pipeline_cache_file_size));
+      bool pipeline_cache_data_read =
+          !pipeline_cache_data.empty() &&
+          fread(pipeline_cache_data.data(), pipeline_cache_data.size(), 1,
+                pipeline_cache_file);
+      fclose(pipeline_cache_file);
+      // VkPipelineCacheHeaderVersionOne.
+      const size_t header_size = sizeof(uint32_t) * 4 + VK_UUID_SIZE;
+      const VkPhysicalDeviceProperties& device_properties =
+          device_->device_info().properties;
+      uint32_t header[4];
+      if (pipeline_cache_data_read &&
+          pipeline_cache_data.size() >= header_size) {
+        std::memcpy(header, pipeline_cache_data.data(), sizeof(header));
+      }
+      if (pipeline_cache_data_read &&
+          pipeline_cache_data.size() >= header_size &&
+          header[0] >= header_size &&
+          header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+          header[2] == device_properties.vendorID &&
+          header[3] == device_properties.deviceID &&
+          !std::memcmp(pipeline_cache_data.data() + sizeof(header),
+                       device_properties.pipelineCacheUUID, VK_UUID_SIZE)) {
+        VkPipelineCacheCreateInfo pipeline_cache_info;
+        pipeline_cache_info.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        pipeline_cache_info.pNext = nullptr;
+        pipeline_cache_info.flags = 0;
+        pipeline_cache_info.initialDataSize = pipeline_cache_data.size();
+        pipeline_cache_info.pInitialData = pipeline_cache_data.data();
+        VkPipelineCache pipeline_cache;
+        if (vkCreatePipelineCache(*device_, &pipeline_cache_info, nullptr,
+                                  &pipeline_cache) == VK_SUCCESS) {
+          if (pipeline_cache_) {
+            vkDestroyPipelineCache(*device_, pipeline_cache_, nullptr);
+          }
+          pipeline_cache_ = pipeline_cache;
+        } else {
+          XELOGE("Failed to load the Vulkan pipeline cache from the storage");
+        }
+      }
+    }
+  }
+
+  // Initialize the Xenos shader storage stream.
+  uint64_t shader_storage_initialization_start =
+      xe::Clock::QueryHostTickCount();
+  auto shader_storage_file_path =
+      shader_storage_shareable_root /
+      fmt::format("{:08X}.vulkan.xsh", title_id);
+  shader_storage_lock_ =
+      xe::filesystem::FileLock::TryAcquireForStorage(shader_storage_file_path);
+  bool storage_read_only = !shader_storage_lock_;
+  const char* storage_file_mode = storage_read_only ? "rb" : "a+b";
+  shader_storage_file_ =
+      xe::filesystem::OpenFile(shader_storage_file_path, storage_file_mode);
+  if (!shader_storage_file_) {
+    if (!storage_read_only) {
+      XELOGE(
+          "Failed to open the guest shader storage file for writing, "
+          "persistent shader storage will be disabled: {}",
+          xe::path_to_utf8(shader_storage_file_path));
+    }
+    shader_storage_lock_.reset();
+    return;
+  }
+  if (storage_read_only) {
+    XELOGGPU(
+        "The shader storage is used by another process, loading it read-only: "
+        "{}",
+        xe::path_to_utf8(shader_storage_file_path));
+  }
+  shader_storage_file_flush_needed_ = false;
+  struct {
+    uint32_t magic;
+    uint32_t version_swapped;
+  } shader_storage_file_header;
+  // 'XESH'.
+  const uint32_t shader_storage_magic = 0x48534558;
+  if (fread(&shader_storage_file_header, sizeof(shader_storage_file_header), 1,
+            shader_storage_file_) &&
+      shader_storage_file_header.magic == shader_storage_magic &&
+      xe::byte_swap(shader_storage_file_header.version_swapped) ==
+          ShaderStoredHeader::kVersion) {
+    uint64_t shader_storage_valid_bytes = sizeof(shader_storage_file_header);
+    // Load shaders written by previous Xenia executions until the end of the
+    // file or until a corrupted one is detected.
+    ShaderStoredHeader shader_header;
+    std::vector<uint32_t> ucode_dwords;
+    ucode_dwords.reserve(0xFFFF);
+    std::vector<std::pair<VulkanShader*, reg::SQ_PROGRAM_CNTL>>
+        shaders_to_translate;
+    while (true) {
+      if (!fread(&shader_header, sizeof(shader_header), 1,
+                 shader_storage_file_)) {
+        break;
+      }
+      size_t ucode_byte_count =
+          shader_header.ucode_dword_count * sizeof(uint32_t);
+      if (shader_map_.find(shader_header.ucode_data_hash) !=
+          shader_map_.end()) {
+        // Already added.
+        if (!xe::filesystem::Seek(shader_storage_file_,
+                                  int64_t(ucode_byte_count), SEEK_CUR)) {
+          break;
+        }
+        shader_storage_valid_bytes += sizeof(shader_header) + ucode_byte_count;
+        continue;
+      }
+      ucode_dwords.resize(shader_header.ucode_dword_count);
+      if (shader_header.ucode_dword_count &&
+          !fread(ucode_dwords.data(), ucode_byte_count, 1,
+                 shader_storage_file_)) {
+        break;
+      }
+      uint64_t ucode_data_hash =
+          xe::hash::Hash64(ucode_dwords.data(), ucode_byte_count);
+      if (shader_header.ucode_data_hash != ucode_data_hash) {
+        // Validation failed.
+        break;
+      }
+      VulkanShader* shader = new VulkanShader(
+          device_, shader_header.type, ucode_data_hash, ucode_dwords.data(),
+          shader_header.ucode_dword_count);
+      shader_map_.insert({ucode_data_hash, shader});
+      shaders_to_translate.emplace_back(shader, shader_header.sq_program_cntl);
+      shader_storage_valid_bytes += sizeof(shader_header) + ucode_byte_count;
+    }
+    if (!shaders_to_translate.empty()) {
+      // Translate the shaders and create the shader modules on all cores.
+      std::atomic<size_t> shader_translation_next(0);
+      std::vector<uint8_t> shaders_failed_to_translate(
+          shaders_to_translate.size(), 0);
+      RunOnThreads(
+          std::min(shaders_to_translate.size(), logical_processor_count),
+          "Shader Translation", [&]() {
+            SpirvShaderTranslator translator(
+                bindless_textures_, render_cache_->resolution_scale());
+            for (;;) {
+              size_t shader_index = shader_translation_next++;
+              if (shader_index >= shaders_to_translate.size()) {
+                return;
+              }
+              const auto& shader_to_translate =
+                  shaders_to_translate[shader_index];
+              if (!TranslateShader(translator, shader_to_translate.first,
+                                   shader_to_translate.second)) {
+                shaders_failed_to_translate[shader_index] = 1;
+              }
+            }
+          });
+      for (size_t i = 0; i < shaders_to_translate.size(); ++i) {
+        if (shaders_failed_to_translate[i]) {
+          VulkanShader* shader = shaders_to_translate[i].first;
+          shader_map_.erase(shader->ucode_data_hash());
+          delete shader;
+        }
+      }
+    }
+    XELOGGPU("Translated {} shaders from the storage in {} milliseconds",
+             shaders_to_translate.size(),
+             (xe::Clock::QueryHostTickCount() -
+              shader_storage_initialization_start) *
+                 1000 / xe::Clock::QueryHostTickFrequency());
+    if (!storage_read_only) {
+      xe::filesystem::TruncateStdioFile(shader_storage_file_,
+                                        shader_storage_valid_bytes);
+    }
+  } else if (!storage_read_only) {
+    xe::filesystem::TruncateStdioFile(shader_storage_file_, 0);
+    shader_storage_file_header.magic = shader_storage_magic;
+    shader_storage_file_header.version_swapped =
+        xe::byte_swap(ShaderStoredHeader::kVersion);
+    fwrite(&shader_storage_file_header, sizeof(shader_storage_file_header), 1,
+           shader_storage_file_);
+  }
+
+  // Initialize the pipeline storage stream.
+  uint64_t pipeline_storage_initialization_start =
+      xe::Clock::QueryHostTickCount();
+  auto pipeline_storage_file_path =
+      shader_storage_shareable_root /
+      fmt::format("{:08X}.vulkan.xpso", title_id);
+  pipeline_storage_file_ =
+      xe::filesystem::OpenFile(pipeline_storage_file_path, storage_file_mode);
+  if (!pipeline_storage_file_) {
+    if (!storage_read_only) {
+      XELOGE(
+          "Failed to open the Vulkan pipeline description storage file for "
+          "writing, persistent shader storage will be disabled: {}",
+          xe::path_to_utf8(pipeline_storage_file_path));
+    }
+    fclose(shader_storage_file_);
+    shader_storage_file_ = nullptr;
+    shader_storage_lock_.reset();
+    return;
+  }
+  pipeline_storage_file_flush_needed_ = false;
+  // 'XEPS'.
+  const uint32_t pipeline_storage_magic = 0x53504558;
+  // 'VKRT'.
+  const uint32_t pipeline_storage_magic_api = 0x54524B56;
+  struct {
+    uint32_t magic;
+    uint32_t magic_api;
+    uint32_t version_swapped;
+  } pipeline_storage_file_header;
+  if (fread(&pipeline_storage_file_header, sizeof(pipeline_storage_file_header),
+            1, pipeline_storage_file_) &&
+      pipeline_storage_file_header.magic == pipeline_storage_magic &&
+      pipeline_storage_file_header.magic_api == pipeline_storage_magic_api &&
+      xe::byte_swap(pipeline_storage_file_header.version_swapped) ==
+          PipelineStoredDescription::kVersion) {
+    uint64_t pipeline_storage_valid_bytes =
+        sizeof(pipeline_storage_file_header);
+    std::vector<PipelineStoredDescription> pipeline_stored_descriptions;
+    PipelineStoredDescription pipeline_stored_description;
+    while (fread(&pipeline_stored_description,
+                 sizeof(pipeline_stored_description), 1,
+                 pipeline_storage_file_)) {
+      pipeline_stored_descriptions.push_back(pipeline_stored_description);
+    }
+
+    // Configure the state of every stored pipeline the same way as for a draw,
+    // but with the registers from the storage, to get the hash keys and the
+    // creation states of the pipelines.
+    std::vector<PipelineCreationState> pipelines_to_create;
+    if (!pipeline_stored_descriptions.empty()) {
+      auto stored_register_file = std::make_unique<RegisterFile>();
+      RegisterFile* register_file = register_file_;
+      register_file_ = stored_register_file.get();
+      for (const PipelineStoredDescription& pipeline_stored_description :
+           pipeline_stored_descriptions) {
+        // Validate file integrity, stop and truncate the stream if data is
+        // corrupted.
+        if (xe::hash::Hash64(reinterpret_cast<const uint8_t*>(
+                                 &pipeline_stored_description) +
+                                 sizeof(uint64_t),
+                             sizeof(pipeline_stored_description) -
+                                 sizeof(uint64_t)) !=
+            pipeline_stored_description.description_hash) {
+          break;
+        }
+        pipeline_storage_valid_bytes += sizeof(PipelineStoredDescription);
+        auto vertex_shader_it =
+            shader_map_.find(pipeline_stored_description.vertex_shader_hash);
+        if (vertex_shader_it == shader_map_.end() ||
+            !vertex_shader_it->second->is_valid()) {
+          continue;
+        }
+        VulkanShader* pixel_shader = nullptr;
+        if (pipeline_stored_description.pixel_shader_hash) {
+          auto pixel_shader_it =
+              shader_map_.find(pipeline_stored_description.pixel_shader_hash);
+          if (pixel_shader_it == shader_map_.end() ||
+              !pixel_shader_it->second->is_valid()) {
+            continue;
+          }
+          pixel_shader = pixel_shader_it->second;
+        }
+        for (size_t i = 0; i < kPipelineStoredRegisterCount; ++i) {
+          stored_register_file->values[kPipelineStoredRegisters[i]].u32 =
+              pipeline_stored_description.registers[i];
+        }
+        if (UpdateState(vertex_shader_it->second, pixel_shader,
+                        pipeline_stored_description.primitive_type) ==
+            UpdateStatus::kError) {
+          continue;
+        }
+        uint64_t hash_key = hash_state_.Digest();
+        if (cached_pipelines_.find(hash_key) != cached_pipelines_.end()) {
+          continue;
+        }
+        RenderConfiguration render_configuration;
+        std::memcpy(&render_configuration,
+                    &pipeline_stored_description.render_configuration,
+                    sizeof(render_configuration));
+        VkRenderPass render_pass =
+            render_cache_->GetRenderPass(render_configuration);
+        if (!render_pass) {
+          continue;
+        }
+        // Reserve the hash key for the pipeline being created to skip
+        // duplicate descriptions.
+        cached_pipelines_.insert({hash_key, nullptr});
+        pipelines_to_create.emplace_back();
+        GetPipelineCreationState(render_pass, hash_key,
+                                 pipelines_to_create.back());
+      }
+      register_file_ = register_file;
+      // The shadow registers now contain the stored state, and the state built
+      // from them is still valid, but it's not the state of the current
+      // pipeline.
+      current_pipeline_ = nullptr;
+    }
+
+    if (!pipelines_to_create.empty()) {
+      // Create the pipelines on all cores.
+      std::atomic<size_t> pipeline_creation_next(0);
+      std::vector<VkPipeline> pipelines_created(pipelines_to_create.size(),
+                                                nullptr);
+      RunOnThreads(
+          std::min(pipelines_to_create.size(), logical_processor_count),
+          "Vulkan Pipelines", [&]() {
+            for (;;) {
+              size_t pipeline_index = pipeline_creation_next++;
+              if (pipeline_index >= pipelines_to_create.size()) {
+                return;
+              }
+              pipelines_created[pipeline_index] =
+                  CreatePipeline(pipelines_to_create[pipeline_index]);
+            }
+          });
+      for (size_t i = 0; i < pipelines_to_create.size(); ++i) {
+        uint64_t hash_key = pipelines_to_create[i].hash_key;
+        if (pipelines_created[i]) {
+          cached_pipelines_[hash_key] = pipelines_created[i];
+        } else {
+          cached_pipelines_.erase(hash_key);
+        }
+      }
+      COUNT_profile_set("gpu/pipeline_cache/pipelines",
+                        cached_pipelines_.size());
+    }
+    XELOGGPU("Created {} pipelines from the storage in {} milliseconds",
+             pipelines_to_create.size(),
+             (xe::Clock::QueryHostTickCount() -
+              pipeline_storage_initialization_start) *
+                 1000 / xe::Clock::QueryHostTickFrequency());
+    if (!storage_read_only) {
+      xe::filesystem::TruncateStdioFile(pipeline_storage_file_,
+                                        pipeline_storage_valid_bytes);
+    }
+  } else if (!storage_read_only) {
+    xe::filesystem::TruncateStdioFile(pipeline_storage_file_, 0);
+    pipeline_storage_file_header.magic = pipeline_storage_magic;
+    pipeline_storage_file_header.magic_api = pipeline_storage_magic_api;
+    pipeline_storage_file_header.version_swapped =
+        xe::byte_swap(PipelineStoredDescription::kVersion);
+    fwrite(&pipeline_storage_file_header, sizeof(pipeline_storage_file_header),
+           1, pipeline_storage_file_);
+  }
+
+  shader_storage_root_ = storage_root;
+  shader_storage_title_id_ = title_id;
+
+  if (storage_read_only) {
+    // Nothing is written, which all the storage writes check through the
+    // files being open.
+    fclose(pipeline_storage_file_);
+    pipeline_storage_file_ = nullptr;
+    fclose(shader_storage_file_);
+    shader_storage_file_ = nullptr;
+    return;
+  }
+
+  // Start the storage writing thread.
+  storage_write_flush_shaders_ = false;
+  storage_write_flush_pipelines_ = false;
+  storage_write_thread_shutdown_ = false;
+  storage_write_thread_ =
+      xe::threading::Thread::Create({}, [this]() { StorageWriteThread(); });
+  xe::threading::ApplyThreadRole(storage_write_thread_.get(),
+                                 xe::threading::ThreadRole::kIo);
+}
+
+void PipelineCache::ShutdownShaderStorage() {
+  if (storage_write_thread_) {
+    {
+      std::lock_guard<std::mutex> lock(storage_write_request_lock_);
+      storage_write_thread_shutdown_ = true;
+    }
+    storage_write_request_cond_.notify_all();
+    xe::threading::Wait(storage_write_thread_.get(), false);
+    storage_write_thread_.reset();
+  }
+  storage_write_shader_queue_.clear();
+  storage_write_pipeline_queue_.clear();
+
+  if (pipeline_storage_file_) {
+    fclose(pipeline_storage_file_);
+    pipeline_storage_file_ = nullptr;
+    pipeline_storage_file_flush_needed_ = false;
+  }
+
+  if (shader_storage_file_) {
+    fclose(shader_storage_file_);
+    shader_storage_file_ = nullptr;
+    shader_storage_file_flush_needed_ = false;
+  }
+
+  // Save the driver pipeline cache, including the pipelines created during
+  // this execution, unless another process owns the storage.
+  if (!shader_storage_root_.empty() && shader_storage_lock_ &&
+      pipeline_cache_) {
+    size_t pipeline_cache_data_size = 0;
+    if (vkGetPipelineCacheData(*device_, pipeline_cache_,
+                               &pipeline_cache_data_size,
+                               nullptr) == VK_SUCCESS &&
+        pipeline_cache_data_size) {
+      std::vector<uint8_t> pipeline_cache_data(pipeline_cache_data_size);
+      if (vkGetPipelineCacheData(*device_, pipeline_cache_,
+                                 &pipeline_cache_data_size,
+                                 pipeline_cache_data.data()) == VK_SUCCESS) {
+        auto pipeline_cache_file_path =
+            shader_storage_root_ / "shaders" / "local" /
+            fmt::format("{:08X}.vulkan.cache", shader_storage_title_id_);
+        // Write to a temporary file first so processes starting meanwhile
+        // don't load a partial cache.
+        auto pipeline_cache_temp_file_path = pipeline_cache_file_path;
+        pipeline_cache_temp_file_path += ".tmp";
+        FILE* pipeline_cache_file =
+            xe::filesystem::OpenFile(pipeline_cache_temp_file_path, "wb");
+        if (pipeline_cache_file) {
+          bool pipeline_cache_written =
+              fwrite(pipeline_cache_data.data(), pipeline_cache_data_size, 1,
+                     pipeline_cache_file) != 0;
+          pipeline_cache_written &= fclose(pipeline_cache_file) == 0;
+          std::error_code rename_error;
+          if (pipeline_cache_written) {
+            std::filesystem::rename(pipeline_cache_temp_file_path,
+                                    pipeline_cache_file_path, rename_error);
+          }
+          if (!pipeline_cache_written || rename_error) {
+            std::filesystem::remove(pipeline_cache_temp_file_path,
+                                    rename_error);
+            XELOGE("Failed to save the Vulkan pipeline cache: {}",
+                   xe::path_to_utf8(pipeline_cache_file_path));
+          }
+        } else {
+          XELOGE("Failed to save the Vulkan pipeline cache: {}",
+                 xe::path_to_utf8(pipeline_cache_file_path));
+        }
+      }
+    }
+  }
+
+  spirv_binary_cache_.reset();
+
+  shader_storage_lock_.reset();
+
+  shader_storage_root_.clear();
+  shader_storage_title_id_ = 0;
+}
+
+void PipelineCache::EndFrame() {
+  if (shader_storage_file_flush_needed_ ||
+      pipeline_storage_file_flush_needed_) {
+    {
+      std::lock_guard<std::mutex> lock(storage_write_request_lock_);
+      if (shader_storage_file_flush_needed_) {
+        storage_write_flush_shaders_ = true;
+      }
+      if (pipeline_storage_file_flush_needed_) {
+        storage_write_flush_pipelines_ = true;
+      }
+    }
+    storage_write_request_cond_.notify_one();
+    shader_storage_file_flush_needed_ = false;
+    pipeline_storage_file_flush_needed_ = false;
+  }
 }
 
 VkPipeline PipelineCache::GetPipeline(const RenderState* render_state,
-                                      uint64_t hash_key) {
+                                      uint64_t hash_key, bool& ready_out) {
+  ready_out = true;
+
   // Lookup the pipeline in the cache.
   auto it = cached_pipelines_.find(hash_key);
   if (it != cached_pipelines_.end()) {
@@ -296,6 +967,199 @@ VkPipeline PipelineCache::GetPipeline(const RenderState* render_state,
     return it->second;
   }
 
+  if (creation_threads_.empty()) {
+    PipelineCreationRequest request;
+    GetPipelineCreationRequest(render_state, hash_key, request);
+    request.pipeline = CreatePipeline(request.state);
+    assert_not_null(request.pipeline);
+    AddCreatedPipeline(request);
+    return request.pipeline;
+  }
+
+  // Request asynchronous creation if not requested yet.
+  if (creation_pending_.insert(hash_key).second) {
+    auto request = std::make_unique<PipelineCreationRequest>();
+    GetPipelineCreationRequest(render_state, hash_key, *request);
+    {
+      std::lock_guard<std::mutex> lock(creation_request_lock_);
+      creation_queue_.push_back(std::move(request));
+    }
+    creation_request_cond_.notify_one();
+  }
+
+  // Wait for the pipeline within the budget, and take all pipelines created
+  // by now.
+  std::vector<std::unique_ptr<PipelineCreationRequest>> created;
+  {
+    std::unique_lock<std::mutex> lock(creation_request_lock_);
+    auto pipeline_created = [this, hash_key]() {
+      for (const auto& request : creation_completed_) {
+        if (request->state.hash_key == hash_key) {
+          return true;
+        }
+      }
+      return false;
+    };
+    int32_t wait_ms = cvars::vulkan_pipeline_creation_wait_ms;
+    if (wait_ms < 0) {
+      creation_completion_cond_.wait(lock, pipeline_created);
+    } else if (wait_ms > 0) {
+      creation_completion_cond_.wait_for(
+          lock, std::chrono::milliseconds(wait_ms), pipeline_created);
+    }
+    created.swap(creation_completed_);
+  }
+  for (const auto& request : created) {
+    AddCreatedPipeline(*request);
+  }
+
+  it = cached_pipelines_.find(hash_key);
+  if (it == cached_pipelines_.end()) {
+    // Skip the draw until the pipeline is created.
+    ready_out = false;
+    return nullptr;
+  }
+  return it->second;
+}
+
+void PipelineCache::GetPipelineCreationRequest(
+    const RenderState* render_state, uint64_t hash_key,
+    PipelineCreationRequest& request_out) const {
+  GetPipelineCreationState(render_state->render_pass_handle, hash_key,
+                           request_out.state);
+  request_out.pipeline = nullptr;
+
+  request_out.store = pipeline_storage_file_ != nullptr;
+  if (!request_out.store) {
+    return;
+  }
+  const auto& shader_stages_regs = update_shader_stages_regs_;
+  PipelineStoredDescription& pipeline_stored_description =
+      request_out.stored_description;
+  // Zero the padding of the render configuration too.
+  std::memset(&pipeline_stored_description, 0,
+              sizeof(pipeline_stored_description));
+  pipeline_stored_description.vertex_shader_hash =
+      shader_stages_regs.vertex_shader->ucode_data_hash();
+  pipeline_stored_description.pixel_shader_hash =
+      shader_stages_regs.pixel_shader
+          ? shader_stages_regs.pixel_shader->ucode_data_hash()
+          : 0;
+  pipeline_stored_description.primitive_type =
+      shader_stages_regs.primitive_type;
+  const RenderConfiguration& render_configuration = render_state->config;
+  RenderConfiguration& stored_render_configuration =
+      pipeline_stored_description.render_configuration;
+  stored_render_configuration.mode_control = render_configuration.mode_control;
+  stored_render_configuration.surface_pitch_px =
+      render_configuration.surface_pitch_px;
+  stored_render_configuration.surface_height_px =
+      render_configuration.surface_height_px;
+  stored_render_configuration.surface_msaa = render_configuration.surface_msaa;
+  for (size_t i = 0; i < xe::countof(render_configuration.color); ++i) {
+    stored_render_configuration.color[i].used =
+        render_configuration.color[i].used;
+    stored_render_configuration.color[i].edram_base =
+        render_configuration.color[i].edram_base;
+    stored_render_configuration.color[i].format =
+        render_configuration.color[i].format;
+  }
+  stored_render_configuration.depth_stencil.used =
+      render_configuration.depth_stencil.used;
+  stored_render_configuration.depth_stencil.edram_base =
+      render_configuration.depth_stencil.edram_base;
+  stored_render_configuration.depth_stencil.format =
+      render_configuration.depth_stencil.format;
+  for (size_t i = 0; i < kPipelineStoredRegisterCount; ++i) {
+    pipeline_stored_description.registers[i] =
+        register_file_->values[kPipelineStoredRegisters[i]].u32;
+  }
+  pipeline_stored_description.description_hash =
+      xe::hash::Hash64(
+          reinterpret_cast<const uint8_t*>(&pipeline_stored_description) +
+              sizeof(uint64_t),
+          sizeof(pipeline_stored_description) - sizeof(uint64_t));
+}
+
+void PipelineCache::AddCreatedPipeline(
+    const PipelineCreationRequest& request) {
+  uint64_t hash_key = request.state.hash_key;
+  creation_pending_.erase(hash_key);
+  if (cached_pipelines_.find(hash_key) != cached_pipelines_.end()) {
+    // Already created from the storage while this one was being created.
+    if (request.pipeline) {
+      vkDestroyPipeline(*device_, request.pipeline, nullptr);
+    }
+    return;
+  }
+
+  // Add to cache with the hash key for reuse. Failures are cached too so the
+  // creation is not retried for every draw.
+  cached_pipelines_.insert({hash_key, request.pipeline});
+  COUNT_profile_set("gpu/pipeline_cache/pipelines", cached_pipelines_.size());
+
+  if (request.pipeline && request.store && pipeline_storage_file_) {
+    {
+      std::lock_guard<std::mutex> lock(storage_write_request_lock_);
+      storage_write_pipeline_queue_.push_back(request.stored_description);
+    }
+    storage_write_request_cond_.notify_all();
+    pipeline_storage_file_flush_needed_ = true;
+  }
+}
+
+void PipelineCache::CreationThread() {
+  while (true) {
+    std::unique_ptr<PipelineCreationRequest> request;
+    {
+      std::unique_lock<std::mutex> lock(creation_request_lock_);
+      if (creation_threads_shutdown_) {
+        return;
+      }
+      if (creation_queue_.empty()) {
+        creation_request_cond_.wait(lock);
+        continue;
+      }
+      // Count the thread as busy until the pipeline is created so the cache
+      // can be cleared safely.
+      request = std::move(creation_queue_.front());
+      creation_queue_.pop_front();
+      ++creation_threads_busy_;
+    }
+
+    request->pipeline = CreatePipeline(request->state);
+
+    {
+      std::lock_guard<std::mutex> lock(creation_request_lock_);
+      creation_completed_.push_back(std::move(request));
+      --creation_threads_busy_;
+    }
+    creation_completion_cond_.notify_all();
+  }
+}
+
+void PipelineCache::GetPipelineCreationState(
+    VkRenderPass render_pass, uint64_t hash_key,
+    PipelineCreationState& state_out) const {
+  state_out.hash_key = hash_key;
+  state_out.shader_stage_count = update_shader_stages_stage_count_;
+  std::memcpy(state_out.shader_stages, update_shader_stages_info_,
+              sizeof(VkPipelineShaderStageCreateInfo) *
+                  update_shader_stages_stage_count_);
+  state_out.vertex_input_state = update_vertex_input_state_info_;
+  state_out.input_assembly_state = update_input_assembly_state_info_;
+  state_out.viewport_state = update_viewport_state_info_;
+  state_out.rasterization_state = update_rasterization_state_info_;
+  state_out.multisample_state = update_multisample_state_info_;
+  state_out.depth_stencil_state = update_depth_stencil_state_info_;
+  state_out.color_blend_state = update_color_blend_state_info_;
+  std::memcpy(state_out.color_blend_attachment_states,
+              update_color_blend_attachment_states_,
+              sizeof(update_color_blend_attachment_states_));
+  state_out.render_pass = render_pass;
+}
+
+VkPipeline PipelineCache::CreatePipeline(const PipelineCreationState& state) {
   VkPipelineDynamicStateCreateInfo dynamic_state_info;
   dynamic_state_info.sType =
       VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
@@ -316,23 +1180,28 @@ VkPipeline PipelineCache::GetPipeline(const RenderState* render_state,
       static_cast<uint32_t>(xe::countof(dynamic_states));
   dynamic_state_info.pDynamicStates = dynamic_states;
 
+  // The attachment states are owned by the creation state copy.
+  VkPipelineColorBlendStateCreateInfo color_blend_state =
+      state.color_blend_state;
+  color_blend_state.pAttachments = state.color_blend_attachment_states;
+
   VkGraphicsPipelineCreateInfo pipeline_info;
   pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
   pipeline_info.pNext = nullptr;
   pipeline_info.flags = VK_PIPELINE_CREATE_DISABLE_OPTIMIZATION_BIT;
-  pipeline_info.stageCount = update_shader_stages_stage_count_;
-  pipeline_info.pStages = update_shader_stages_info_;
-  pipeline_info.pVertexInputState = &update_vertex_input_state_info_;
-  pipeline_info.pInputAssemblyState = &update_input_assembly_state_info_;
+  pipeline_info.stageCount = state.shader_stage_count;
+  pipeline_info.pStages = state.shader_stages;
+  pipeline_info.pVertexInputState = &state.vertex_input_state;
+  pipeline_info.pInputAssemblyState = &state.input_assembly_state;
   pipeline_info.pTessellationState = nullptr;
-  pipeline_info.pViewportState = &update_viewport_state_info_;
-  pipeline_info.pRasterizationState = &update_rasterization_state_info_;
-  pipeline_info.pMultisampleState = &update_multisample_state_info_;
-  pipeline_info.pDepthStencilState = &update_depth_stencil_state_info_;
-  pipeline_info.pColorBlendState = &update_color_blend_state_info_;
+  pipeline_info.pViewportState = &state.viewport_state;
+  pipeline_info.pRasterizationState = &state.rasterization_state;
+  pipeline_info.pMultisampleState = &state.multisample_state;
+  pipeline_info.pDepthStencilState = &state.depth_stencil_state;
+  pipeline_info.pColorBlendState = &color_blend_state;
   pipeline_info.pDynamicState = &dynamic_state_info;
   pipeline_info.layout = pipeline_layout_;
-  pipeline_info.renderPass = render_state->render_pass_handle;
+  pipeline_info.renderPass = state.render_pass;
   pipeline_info.subpass = 0;
   pipeline_info.basePipelineHandle = nullptr;
   pipeline_info.basePipelineIndex = -1;
@@ -341,9 +1210,9 @@ VkPipeline PipelineCache::GetPipeline(const RenderState* render_state,
                                           &pipeline_info, nullptr, &pipeline);
   if (result != VK_SUCCESS) {
     XELOGE("vkCreateGraphicsPipelines failed with code {}", result);
-    assert_always();
     return nullptr;
   }
+  benchmark_counters_->CountPipelineCreation();
 
   // Dump shader disassembly.
   if (cvars::vulkan_dump_disasm) {
@@ -355,18 +1224,17 @@ VkPipeline PipelineCache::GetPipeline(const RenderState* render_state,
     }
   }
 
-  // Add to cache with the hash key for reuse.
-  cached_pipelines_.insert({hash_key, pipeline});
-  COUNT_profile_set("gpu/pipeline_cache/pipelines", cached_pipelines_.size());
-
   return pipeline;
 }
 
-bool PipelineCache::TranslateShader(VulkanShader* shader,
+bool PipelineCache::TranslateShader(SpirvShaderTranslator& translator,
+                                    VulkanShader* shader,
                                     reg::SQ_PROGRAM_CNTL cntl) {
-  // Perform translation.
+  // Perform translation, or take the SPIR-V from the cache.
   // If this fails the shader will be marked as invalid and ignored later.
-  if (!shader_translator_->Translate(shader, cntl)) {
+  if (!(spirv_binary_cache_
+            ? spirv_binary_cache_->Translate(translator, shader, cntl)
+            : translator.Translate(shader, cntl))) {
     XELOGE("Shader translation failed; marking shader as ignored");
     return false;
   }
@@ -393,6 +1261,102 @@ bool PipelineCache::TranslateShader(VulkanShader* shader,
   return shader->is_valid();
 }
 
+void PipelineCache::StoreShader(VulkanShader* shader,
+                                reg::SQ_PROGRAM_CNTL cntl) {
+  if (!shader_storage_file_) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(storage_write_request_lock_);
+    storage_write_shader_queue_.push_back(
+        std::make_pair(static_cast<const Shader*>(shader), cntl));
+  }
+  storage_write_request_cond_.notify_all();
+  shader_storage_file_flush_needed_ = true;
+}
+
+void PipelineCache::StorageWriteThread() {
+  ShaderStoredHeader shader_header;
+  // Don't leak anything in unused bits.
+  std::memset(&shader_header, 0, sizeof(shader_header));
+
+  std::vector<uint32_t> ucode_guest_endian;
+  ucode_guest_endian.reserve(0xFFFF);
+
+  bool flush_shaders = false;
+  bool flush_pipelines = false;
+
+  while (true) {
+    if (flush_shaders) {
+      flush_shaders = false;
+      assert_not_null(shader_storage_file_);
+      fflush(shader_storage_file_);
+    }
+    if (flush_pipelines) {
+      flush_pipelines = false;
+      assert_not_null(pipeline_storage_file_);
+      fflush(pipeline_storage_file_);
+    }
+
+    std::pair<const Shader*, reg::SQ_PROGRAM_CNTL> shader_pair = {};
+    PipelineStoredDescription pipeline_description;
+    bool write_pipeline = false;
+    {
+      std::unique_lock<std::mutex> lock(storage_write_request_lock_);
+      if (storage_write_thread_shutdown_) {
+        return;
+      }
+      if (!storage_write_shader_queue_.empty()) {
+        shader_pair = storage_write_shader_queue_.front();
+        storage_write_shader_queue_.pop_front();
+      } else if (storage_write_flush_shaders_) {
+        storage_write_flush_shaders_ = false;
+        flush_shaders = true;
+      }
+      if (!storage_write_pipeline_queue_.empty()) {
+        std::memcpy(&pipeline_description,
+                    &storage_write_pipeline_queue_.front(),
+                    sizeof(pipeline_description));
+        storage_write_pipeline_queue_.pop_front();
+        write_pipeline = true;
+      } else if (storage_write_flush_pipelines_) {
+        storage_write_flush_pipelines_ = false;
+        flush_pipelines = true;
+      }
+      if (!shader_pair.first && !write_pipeline) {
+        storage_write_request_cond_.wait(lock);
+        continue;
+      }
+    }
+
+    const Shader* shader = shader_pair.first;
+    if (shader) {
+      shader_header.ucode_data_hash = shader->ucode_data_hash();
+      shader_header.ucode_dword_count = shader->ucode_dword_count();
+      shader_header.type = shader->type();
+      shader_header.sq_program_cntl = shader_pair.second;
+      assert_not_null(shader_storage_file_);
+      fwrite(&shader_header, sizeof(shader_header), 1, shader_storage_file_);
+      if (shader_header.ucode_dword_count) {
+        ucode_guest_endian.resize(shader_header.ucode_dword_count);
+        // Need to swap because the hash is calculated for the shader with guest
+        // endianness.
+        xe::copy_and_swap(ucode_guest_endian.data(), shader->ucode_dwords(),
+                          shader_header.ucode_dword_count);
+        fwrite(ucode_guest_endian.data(),
+               shader_header.ucode_dword_count * sizeof(uint32_t), 1,
+               shader_storage_file_);
+      }
+    }
+
+    if (write_pipeline) {
+      assert_not_null(pipeline_storage_file_);
+      fwrite(&pipeline_description, sizeof(pipeline_description), 1,
+             pipeline_storage_file_);
+    }
+  }
+}
+
 static void DumpShaderStatisticsAMD(const VkShaderStatisticsInfoAMD& stats) {
   XELOGI(" - resource usage:");
   XELOGI("   numUsedVgprs: {}", stats.resourceUsage.numUsedVgprs);
@@ -610,11 +1574,14 @@ bool PipelineCache::SetDynamicState(VkCommandBuffer command_buffer,
     int32_t adj_x = ws_x - std::max(ws_x, 0);
     int32_t adj_y = ws_y - std::max(ws_y, 0);
 
+    int32_t resolution_scale = int32_t(render_cache_->resolution_scale());
     VkRect2D scissor_rect;
-    scissor_rect.offset.x = ws_x - adj_x;
-    scissor_rect.offset.y = ws_y - adj_y;
-    scissor_rect.extent.width = std::max(ws_w + adj_x, 0);
-    scissor_rect.extent.height = std::max(ws_h + adj_y, 0);
+    scissor_rect.offset.x = (ws_x - adj_x) * resolution_scale;
+    scissor_rect.offset.y = (ws_y - adj_y) * resolution_scale;
+    scissor_rect.extent.width =
+        uint32_t(std::max(ws_w + adj_x, 0) * resolution_scale);
+    scissor_rect.extent.height =
+        uint32_t(std::max(ws_h + adj_y, 0) * resolution_scale);
     vkCmdSetScissor(command_buffer, 0, 1, &scissor_rect);
   }
 
@@ -694,12 +1661,15 @@ bool PipelineCache::SetDynamicState(VkCommandBuffer command_buffer,
   }
 
   if (viewport_state_dirty) {
+    // The vertex shader works in guest pixels, scaling is only done by the
+    // viewport.
+    float resolution_scale = float(render_cache_->resolution_scale());
     VkViewport viewport_rect;
     std::memset(&viewport_rect, 0, sizeof(VkViewport));
-    viewport_rect.x = vpx;
-    viewport_rect.y = vpy;
-    viewport_rect.width = vpw;
-    viewport_rect.height = vph;
+    viewport_rect.x = vpx * resolution_scale;
+    viewport_rect.y = vpy * resolution_scale;
+    viewport_rect.width = vpw * resolution_scale;
+    viewport_rect.height = vph * resolution_scale;
 
     float voz = vport_zoffset_enable ? regs.pa_cl_vport_zoffset : 0;
     float vsz = vport_zscale_enable ? regs.pa_cl_vport_zscale : 1;
@@ -958,7 +1928,7 @@ PipelineCache::UpdateStatus PipelineCache::UpdateState(
   bool mismatch = false;
 
   // Reset hash so we can build it up.
-  XXH64_reset(&hash_state_, 0);
+  hash_state_.Reset();
 
 #define CHECK_UPDATE_STATUS(status, mismatch, error_message) \
   {                                                          \
@@ -1025,7 +1995,7 @@ PipelineCache::UpdateStatus PipelineCache::UpdateRenderTargetState() {
   regs.rb_color1_info.color_format = cur_regs->rb_color1_info.color_format;
   regs.rb_color2_info.color_format = cur_regs->rb_color2_info.color_format;
   regs.rb_color3_info.color_format = cur_regs->rb_color3_info.color_format;
-  XXH64_update(&hash_state_, &regs, sizeof(regs));
+  hash_state_.UpdateKey(regs);
   if (!dirty) {
     return UpdateStatus::kCompatible;
   }
@@ -1058,21 +2028,27 @@ PipelineCache::UpdateStatus PipelineCache::UpdateShaderStages(
   regs.vertex_shader = vertex_shader;
   regs.pixel_shader = pixel_shader;
   regs.primitive_type = primitive_type;
-  XXH64_update(&hash_state_, &regs, sizeof(regs));
+  hash_state_.UpdateKey(regs);
   if (!dirty) {
     return UpdateStatus::kCompatible;
   }
 
-  if (!vertex_shader->is_translated() &&
-      !TranslateShader(vertex_shader, regs.sq_program_cntl)) {
-    XELOGE("Failed to translate the vertex shader!");
-    return UpdateStatus::kError;
+  if (!vertex_shader->is_translated()) {
+    if (!TranslateShader(*shader_translator_, vertex_shader,
+                         regs.sq_program_cntl)) {
+      XELOGE("Failed to translate the vertex shader!");
+      return UpdateStatus::kError;
+    }
+    StoreShader(vertex_shader, regs.sq_program_cntl);
   }
 
-  if (pixel_shader && !pixel_shader->is_translated() &&
-      !TranslateShader(pixel_shader, regs.sq_program_cntl)) {
-    XELOGE("Failed to translate the pixel shader!");
-    return UpdateStatus::kError;
+  if (pixel_shader && !pixel_shader->is_translated()) {
+    if (!TranslateShader(*shader_translator_, pixel_shader,
+                         regs.sq_program_cntl)) {
+      XELOGE("Failed to translate the pixel shader!");
+      return UpdateStatus::kError;
+    }
+    StoreShader(pixel_shader, regs.sq_program_cntl);
   }
 
   update_shader_stages_stage_count_ = 0;
@@ -1132,7 +2108,7 @@ PipelineCache::UpdateStatus PipelineCache::UpdateVertexInputState(
   bool dirty = false;
   dirty |= vertex_shader != regs.vertex_shader;
   regs.vertex_shader = vertex_shader;
-  XXH64_update(&hash_state_, &regs, sizeof(regs));
+  hash_state_.UpdateKey(regs);
   if (!dirty) {
     return UpdateStatus::kCompatible;
   }
@@ -1161,7 +2137,7 @@ PipelineCache::UpdateStatus PipelineCache::UpdateInputAssemblyState(
   dirty |= SetShadowRegister(&regs.multi_prim_ib_reset_index,
                              XE_GPU_REG_VGT_MULTI_PRIM_IB_RESET_INDX);
   regs.primitive_type = primitive_type;
-  XXH64_update(&hash_state_, &regs, sizeof(regs));
+  hash_state_.UpdateKey(regs);
   if (!dirty) {
     return UpdateStatus::kCompatible;
   }
@@ -1287,7 +2263,7 @@ PipelineCache::UpdateStatus PipelineCache::UpdateRasterizationState(
     dirty = true;
   }
 
-  XXH64_update(&hash_state_, &regs, sizeof(regs));
+  hash_state_.UpdateKey(regs);
   if (!dirty) {
     return UpdateStatus::kCompatible;
   }
@@ -1369,7 +2345,7 @@ PipelineCache::UpdateStatus PipelineCache::UpdateMultisampleState() {
   dirty |= SetShadowRegister(&regs.pa_su_sc_mode_cntl,
                              XE_GPU_REG_PA_SU_SC_MODE_CNTL);
   dirty |= SetShadowRegister(&regs.rb_surface_info, XE_GPU_REG_RB_SURFACE_INFO);
-  XXH64_update(&hash_state_, &regs, sizeof(regs));
+  hash_state_.UpdateKey(regs);
   if (!dirty) {
     return UpdateStatus::kCompatible;
   }
@@ -1421,7 +2397,7 @@ PipelineCache::UpdateStatus PipelineCache::UpdateDepthStencilState() {
   dirty |= SetShadowRegister(&regs.rb_depthcontrol, XE_GPU_REG_RB_DEPTHCONTROL);
   dirty |=
       SetShadowRegister(&regs.rb_stencilrefmask, XE_GPU_REG_RB_STENCILREFMASK);
-  XXH64_update(&hash_state_, &regs, sizeof(regs));
+  hash_state_.UpdateKey(regs);
   if (!dirty) {
     return UpdateStatus::kCompatible;
   }
@@ -1510,7 +2486,7 @@ PipelineCache::UpdateStatus PipelineCache::UpdateColorBlendState() {
   dirty |=
       SetShadowRegister(&regs.rb_blendcontrol[3], XE_GPU_REG_RB_BLENDCONTROL3);
   dirty |= SetShadowRegister(&regs.rb_modecontrol, XE_GPU_REG_RB_MODECONTROL);
-  XXH64_update(&hash_state_, &regs, sizeof(regs));
+  hash_state_.UpdateKey(regs);
   if (!dirty) {
     return UpdateStatus::kCompatible;
   }
@@ -10,11 +10,25 @@
 #ifndef XENIA_GPU_VULKAN_PIPELINE_CACHE_H_
 #define XENIA_GPU_VULKAN_PIPELINE_CACHE_H_
 
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
-#include "third_party/xxhash/xxhash.h"
 
+#include "xenia/base/filesystem.h"
+#include "xenia/base/hash.h"
+#include "xenia/base/platform.h"
+#include "xenia/base/threading.h"
+#include "xenia/gpu/benchmark_counters.h"
 #include "xenia/gpu/register_file.h"
+#include "xenia/gpu/spirv_shader_binary_cache.h"
 #include "xenia/gpu/spirv_shader_translator.h"
 #include "xenia/gpu/vulkan/render_cache.h"
 #include "xenia/gpu/vulkan/vulkan_shader.h"
@@ -36,9 +50,14 @@ class PipelineCache {
     kCompatible,
     kMismatch,
     kError,
+    // The pipeline is being created asynchronously, and the draw should be
+    // skipped.
+    kNotReady,
   };
 
-  PipelineCache(RegisterFile* register_file, ui::vulkan::VulkanDevice* device);
+  PipelineCache(RegisterFile* register_file, ui::vulkan::VulkanDevice* device,
+                RenderCache* render_cache, bool bindless_textures,
+                BenchmarkCounters* benchmark_counters);
   ~PipelineCache();
 
   VkResult Initialize(VkDescriptorSetLayout uniform_descriptor_set_layout,
@@ -46,6 +65,17 @@ class PipelineCache {
                       VkDescriptorSetLayout vertex_descriptor_set_layout);
   void Shutdown();
 
+  // Loads the driver pipeline cache, translates the stored guest shaders and
+  // creates the stored pipelines on multiple threads, and starts storing new
+  // ones. Everything is loaded before returning regardless of blocking.
+  void InitializeShaderStorage(const std::filesystem::path& storage_root,
+                               uint32_t title_id, bool blocking);
+  // Saves the driver pipeline cache and stops storing shaders and pipelines.
+  void ShutdownShaderStorage();
+
+  // Flushes the shaders and the pipelines stored during the frame.
+  void EndFrame();
+
   // Loads a shader from the cache, possibly translating it.
   VulkanShader* LoadShader(xenos::ShaderType shader_type,
                            uint32_t guest_address, const uint32_t* host_address,
@@ -72,14 +102,86 @@ class PipelineCache {
   VkPipelineLayout pipeline_layout() const { return pipeline_layout_; }
 
   // Clears all cached content.
-  void ClearCache();
+  void ClearCache(bool shutting_down = false);
 
  private:
-  // Creates or retrieves an existing pipeline for the currently configured
-  // state.
-  VkPipeline GetPipeline(const RenderState* render_state, uint64_t hash_key);
+  XEPACKEDSTRUCT(ShaderStoredHeader, {
+    uint64_t ucode_data_hash;
+
+    uint32_t ucode_dword_count : 16;
+    xenos::ShaderType type : 1;
+
+    reg::SQ_PROGRAM_CNTL sq_program_cntl;
+
+    static constexpr uint32_t kVersion = 0x20201014;
+  });
+
+  // Registers UpdateState reads, stored with each pipeline so it can be
+  // configured again at startup.
+  static const uint32_t kPipelineStoredRegisters[];
+  static constexpr size_t kPipelineStoredRegisterCount = 26;
 
-  bool TranslateShader(VulkanShader* shader, reg::SQ_PROGRAM_CNTL cntl);
+  XEPACKEDSTRUCT(PipelineStoredDescription, {
+    // XXH64 of everything after this field.
+    uint64_t description_hash;
+
+    uint64_t vertex_shader_hash;
+    // 0 if drawing without a pixel shader.
+    uint64_t pixel_shader_hash;
+    xenos::PrimitiveType primitive_type;
+    // For a compatible render pass.
+    RenderConfiguration render_configuration;
+    uint32_t registers[kPipelineStoredRegisterCount];
+
+    static constexpr uint32_t kVersion = 0x20201014;
+  });
+
+  // Everything needed to create a pipeline, independent from the state being
+  // configured, so pipelines can be created on other threads.
+  struct PipelineCreationState {
+    uint64_t hash_key;
+    VkPipelineShaderStageCreateInfo shader_stages[3];
+    uint32_t shader_stage_count;
+    VkPipelineVertexInputStateCreateInfo vertex_input_state;
+    VkPipelineInputAssemblyStateCreateInfo input_assembly_state;
+    VkPipelineViewportStateCreateInfo viewport_state;
+    VkPipelineRasterizationStateCreateInfo rasterization_state;
+    VkPipelineMultisampleStateCreateInfo multisample_state;
+    VkPipelineDepthStencilStateCreateInfo depth_stencil_state;
+    VkPipelineColorBlendStateCreateInfo color_blend_state;
+    VkPipelineColorBlendAttachmentState color_blend_attachment_states[4];
+    VkRenderPass render_pass;
+  };
+
+  struct PipelineCreationRequest {
+    PipelineCreationState state;
+    // Written to the storage if the pipeline is created successfully.
+    bool store;
+    PipelineStoredDescription stored_description;
+    VkPipeline pipeline;
+  };
+
+  // Creates or retrieves an existing pipeline for the currently configured
+  // state. With the creation threads, ready_out is set to false if the
+  // pipeline is still being created after the wait budget.
+  VkPipeline GetPipeline(const RenderState* render_state, uint64_t hash_key,
+                         bool& ready_out);
+  void GetPipelineCreationRequest(const RenderState* render_state,
+                                  uint64_t hash_key,
+                                  PipelineCreationRequest& request_out) const;
+  // Adds a created or failed pipeline to the cache and to the storage.
+  void AddCreatedPipeline(const PipelineCreationRequest& request);
+  // Copies the currently configured state for creating a pipeline with it.
+  void GetPipelineCreationState(VkRenderPass render_pass, uint64_t hash_key,
+                                PipelineCreationState& state_out) const;
+  // May be called from any thread. Returns nullptr if failed.
+  VkPipeline CreatePipeline(const PipelineCreationState& state);
+
+  // May be called from any thread with different translators.
+  bool TranslateShader(SpirvShaderTranslator& translator,
+                       VulkanShader* shader, reg::SQ_PROGRAM_CNTL cntl);
+  // Queues a translated shader for writing to the storage if it's enabled.
+  void StoreShader(VulkanShader* shader, reg::SQ_PROGRAM_CNTL cntl);
 
   void DumpShaderDisasmAMD(VkPipeline pipeline);
   void DumpShaderDisasmNV(const VkGraphicsPipelineCreateInfo& info);
@@ -91,16 +193,21 @@ class PipelineCache {
 
   RegisterFile* register_file_ = nullptr;
   ui::vulkan::VulkanDevice* device_ = nullptr;
+  RenderCache* render_cache_ = nullptr;
+  BenchmarkCounters* benchmark_counters_ = nullptr;
+  // Whether the shaders take texture descriptor indices from the constants.
+  bool bindless_textures_;
 
   // Reusable shader translator.
-  std::unique_ptr<ShaderTranslator> shader_translator_ = nullptr;
+  std::unique_ptr<SpirvShaderTranslator> shader_translator_ = nullptr;
+  // Translations shared between titles, created with the shader storage.
+  std::unique_ptr<SpirvShaderBinaryCache> spirv_binary_cache_;
   // Disassembler used to get the SPIRV disasm. Only used in debug.
   xe::ui::spirv::SpirvDisassembler disassembler_;
   // All loaded shaders mapped by their guest hash key.
   std::unordered_map<uint64_t, VulkanShader*> shader_map_;
 
-  // Vulkan pipeline cache, which in theory helps us out.
-  // This can be serialized to disk and reused, if we want.
+  // Vulkan pipeline cache, saved to the storage for the title if it's enabled.
   VkPipelineCache pipeline_cache_ = nullptr;
   // Layout used for all pipelines describing our uniforms, textures, and push
   // constants.
@@ -120,7 +227,7 @@ class PipelineCache {
   // Hash state used to incrementally produce pipeline hashes during update.
   // By the time the full update pass has run the hash will represent the
   // current state in a way that can uniquely identify the produced VkPipeline.
-  XXH64_state_t hash_state_;
+  xe::hash::StreamingHash64 hash_state_;
   // All previously generated pipelines mapped by hash.
   std::unordered_map<uint64_t, VkPipeline> cached_pipelines_;
 
@@ -129,6 +236,46 @@ class PipelineCache {
   // changed.
   VkPipeline current_pipeline_ = nullptr;
 
+  // Shader and pipeline storage, with the files written by a separate thread.
+  std::filesystem::path shader_storage_root_;
+  uint32_t shader_storage_title_id_ = 0;
+  // Held while writing to the storage, not taken if another process is.
+  std::unique_ptr<xe::filesystem::FileLock> shader_storage_lock_;
+  FILE* shader_storage_file_ = nullptr;
+  bool shader_storage_file_flush_needed_ = false;
+  FILE* pipeline_storage_file_ = nullptr;
+  bool pipeline_storage_file_flush_needed_ = false;
+  void StorageWriteThread();
+  std::mutex storage_write_request_lock_;
+  std::condition_variable storage_write_request_cond_;
+  // Storage thread input is protected with storage_write_request_lock_, and the
+  // thread is notified about its change via storage_write_request_cond_.
+  std::deque<std::pair<const Shader*, reg::SQ_PROGRAM_CNTL>>
+      storage_write_shader_queue_;
+  std::deque<PipelineStoredDescription> storage_write_pipeline_queue_;
+  bool storage_write_flush_shaders_ = false;
+  bool storage_write_flush_pipelines_ = false;
+  bool storage_write_thread_shutdown_ = false;
+  std::unique_ptr<xe::threading::Thread> storage_write_thread_;
+
+  // Asynchronous pipeline creation.
+  void CreationThread();
+  std::vector<std::unique_ptr<xe::threading::Thread>> creation_threads_;
+  // Hash keys of the pipelines requested but not added to the cache yet.
+  std::unordered_set<uint64_t> creation_pending_;
+  // The creation thread input and output are protected with
+  // creation_request_lock_. The threads are notified about new requests via
+  // creation_request_cond_, and they notify about completed ones via
+  // creation_completion_cond_.
+  std::mutex creation_request_lock_;
+  std::condition_variable creation_request_cond_;
+  std::condition_variable creation_completion_cond_;
+  std::deque<std::unique_ptr<PipelineCreationRequest>> creation_queue_;
+  std::vector<std::unique_ptr<PipelineCreationRequest>> creation_completed_;
+  // Number of threads currently creating a pipeline.
+  size_t creation_threads_busy_ = 0;
+  bool creation_threads_shutdown_ = false;
+
  private:
   UpdateStatus UpdateState(VulkanShader* vertex_shader,
                            VulkanShader* pixel_shader,
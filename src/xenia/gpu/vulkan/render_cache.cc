@@ -10,6 +10,7 @@
 #include "xenia/gpu/vulkan/render_cache.h"
 
 #include <algorithm>
+#include <mutex>
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/logging.h"
@@ -86,6 +87,29 @@ VkFormat DepthRenderTargetFormatToVkFormat(
   }
 }
 
+// Size of the framebuffer for the configuration in host pixels, with MSAA
+// emulated by enlarging the surface, and with resolution scaling applied.
+VkExtent2D GetFramebufferExtent(const RenderConfiguration& config,
+                                uint32_t resolution_scale) {
+  uint32_t width = config.surface_msaa != xenos::MsaaSamples::k4X
+                       ? config.surface_pitch_px
+                       : config.surface_pitch_px * 2;
+  uint32_t height = config.surface_msaa == xenos::MsaaSamples::k1X
+                        ? config.surface_height_px
+                        : config.surface_height_px * 2;
+  return {std::min(width, 2560u) * resolution_scale,
+          std::min(height, 2560u) * resolution_scale};
+}
+
+// Number of 5120-byte EDRAM tiles covered by 80x16 host pixels of a view.
+uint32_t GetTileViewEdramTilesPerHostTile(const TileViewKey& key) {
+  return key.color_or_depth && xenos::IsColorRenderTargetFormat64bpp(
+                                   xenos::ColorRenderTargetFormat(
+                                       key.edram_format))
+             ? 2
+             : 1;
+}
+
 // Cached framebuffer referencing tile attachments.
 // Each framebuffer is specific to a render pass. Ugh.
 class CachedFramebuffer {
@@ -113,7 +137,8 @@ class CachedFramebuffer {
 
   VkResult Initialize();
 
-  bool IsCompatible(const RenderConfiguration& desired_config) const;
+  bool IsCompatible(const RenderConfiguration& desired_config,
+                    uint32_t resolution_scale) const;
 
  private:
   VkDevice device_ = nullptr;
@@ -146,8 +171,13 @@ class CachedRenderPass {
 
 CachedTileView::CachedTileView(ui::vulkan::VulkanDevice* device,
                                VkDeviceMemory edram_memory,
-                               TileViewKey view_key)
-    : device_(device), key(std::move(view_key)) {}
+                               TileViewKey view_key,
+                               uint32_t view_resolution_scale, bool try_sparse)
+    : device_(device),
+      key(std::move(view_key)),
+      resolution_scale(view_resolution_scale),
+      edram_tile_versions(xenos::kEdramTileCount, 0),
+      try_sparse_(try_sparse) {}
 
 CachedTileView::~CachedTileView() {
   VK_SAFE_DESTROY(vkDestroyImageView, *device_, image_view, nullptr);
@@ -155,6 +185,9 @@ CachedTileView::~CachedTileView() {
   VK_SAFE_DESTROY(vkDestroyImageView, *device_, image_view_stencil, nullptr);
   VK_SAFE_DESTROY(vkDestroyImage, *device_, image, nullptr);
   VK_SAFE_DESTROY(vkFreeMemory, *device_, memory, nullptr);
+  for (VkDeviceMemory sparse_memory : sparse_memory_) {
+    vkFreeMemory(*device_, sparse_memory, nullptr);
+  }
 }
 
 VkResult CachedTileView::Initialize(VkCommandBuffer command_buffer) {
@@ -195,8 +228,8 @@ VkResult CachedTileView::Initialize(VkCommandBuffer command_buffer) {
   image_info.flags = 0;
   image_info.imageType = VK_IMAGE_TYPE_2D;
   image_info.format = vulkan_format;
-  image_info.extent.width = key.tile_width * 80;
-  image_info.extent.height = key.tile_height * 16;
+  image_info.extent.width = key.tile_width * 80 * resolution_scale;
+  image_info.extent.height = key.tile_height * 16 * resolution_scale;
   image_info.extent.depth = 1;
   image_info.mipLevels = 1;
   image_info.arrayLayers = 1;
@@ -230,9 +263,68 @@ VkResult CachedTileView::Initialize(VkCommandBuffer command_buffer) {
   image_info.queueFamilyIndexCount = 0;
   image_info.pQueueFamilyIndices = nullptr;
   image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  status = vkCreateImage(*device_, &image_info, nullptr, &image);
-  if (status != VK_SUCCESS) {
-    return status;
+
+  // The height of render targets is not known, so they're created with the
+  // maximum one - with resolution scaling, that may be hundreds of megabytes
+  // per render target, while usually only the top part is drawn to. Only
+  // single-sampled color targets are made sparse, as depth/stencil may need
+  // separate bindings for the aspects, and multisampled sparse images need
+  // additional features.
+  sparse = false;
+  if (try_sparse_ && key.color_or_depth &&
+      image_info.samples == VK_SAMPLE_COUNT_1_BIT) {
+    uint32_t sparse_format_property_count = 0;
+    vkGetPhysicalDeviceSparseImageFormatProperties(
+        *device_, image_info.format, image_info.imageType, image_info.samples,
+        image_info.usage, image_info.tiling, &sparse_format_property_count,
+        nullptr);
+    if (sparse_format_property_count) {
+      image_info.flags |= VK_IMAGE_CREATE_SPARSE_BINDING_BIT |
+                          VK_IMAGE_CREATE_SPARSE_RESIDENCY_BIT;
+      status = vkCreateImage(*device_, &image_info, nullptr, &image);
+      if (status == VK_SUCCESS) {
+        uint32_t sparse_requirement_count = 0;
+        vkGetImageSparseMemoryRequirements(*device_, image,
+                                           &sparse_requirement_count, nullptr);
+        std::vector<VkSparseImageMemoryRequirements> sparse_requirements(
+            sparse_requirement_count);
+        vkGetImageSparseMemoryRequirements(*device_, image,
+                                           &sparse_requirement_count,
+                                           sparse_requirements.data());
+        // Only one aspect without metadata and without the mip tail in the
+        // single mip is supported.
+        if (sparse_requirement_count == 1 &&
+            !(sparse_requirements[0].formatProperties.aspectMask &
+              VK_IMAGE_ASPECT_METADATA_BIT) &&
+            sparse_requirements[0].imageMipTailFirstLod >= 1) {
+          VkMemoryRequirements memory_requirements;
+          vkGetImageMemoryRequirements(*device_, image, &memory_requirements);
+          sparse = true;
+          sparse_memory_type_bits_ = memory_requirements.memoryTypeBits;
+          sparse_block_size_ = memory_requirements.alignment;
+          sparse_block_extent_ =
+              sparse_requirements[0].formatProperties.imageGranularity;
+          sparse_aspect_mask_ =
+              sparse_requirements[0].formatProperties.aspectMask;
+          sparse_resident_block_rows_ = 0;
+        } else {
+          vkDestroyImage(*device_, image, nullptr);
+          image = nullptr;
+        }
+      }
+      if (!sparse) {
+        image_info.flags &= ~VkImageCreateFlags(
+            VK_IMAGE_CREATE_SPARSE_BINDING_BIT |
+            VK_IMAGE_CREATE_SPARSE_RESIDENCY_BIT);
+      }
+    }
+  }
+
+  if (!sparse) {
+    status = vkCreateImage(*device_, &image_info, nullptr, &image);
+    if (status != VK_SUCCESS) {
+      return status;
+    }
   }
 
   device_->DbgSetObjectName(
@@ -243,15 +335,17 @@ VkResult CachedTileView::Initialize(VkCommandBuffer command_buffer) {
                   uint32_t(key.tile_height), uint32_t(key.color_or_depth),
                   uint32_t(key.msaa_samples), uint32_t(key.edram_format)));
 
-  VkMemoryRequirements memory_requirements;
-  vkGetImageMemoryRequirements(*device_, image, &memory_requirements);
+  if (!sparse) {
+    VkMemoryRequirements memory_requirements;
+    vkGetImageMemoryRequirements(*device_, image, &memory_requirements);
 
-  // Bind to a newly allocated chunk.
-  // TODO: Alias from a really big buffer?
-  memory = device_->AllocateMemory(memory_requirements, 0);
-  status = vkBindImageMemory(*device_, image, memory, 0);
-  if (status != VK_SUCCESS) {
-    return status;
+    // Bind to a newly allocated chunk.
+    // TODO: Alias from a really big buffer?
+    memory = device_->AllocateMemory(memory_requirements, 0);
+    status = vkBindImageMemory(*device_, image, memory, 0);
+    if (status != VK_SUCCESS) {
+      return status;
+    }
   }
 
   // Create the image view we'll use to attach it to a framebuffer.
@@ -329,6 +423,103 @@ VkResult CachedTileView::Initialize(VkCommandBuffer command_buffer) {
   return VK_SUCCESS;
 }
 
+VkResult CachedTileView::EnsureResident(uint32_t height) {
+  if (!sparse) {
+    return VK_SUCCESS;
+  }
+  VkExtent2D size = GetSize();
+  height = std::min(height, size.height);
+  uint32_t block_rows = xe::round_up(height, sparse_block_extent_.height) /
+                        sparse_block_extent_.height;
+  if (block_rows <= sparse_resident_block_rows_) {
+    return VK_SUCCESS;
+  }
+  uint32_t blocks_per_row =
+      xe::round_up(size.width, sparse_block_extent_.width) /
+      sparse_block_extent_.width;
+  uint32_t new_block_rows = block_rows - sparse_resident_block_rows_;
+
+  // Allocate all the new blocks at once, but bind every 64 KB block
+  // separately, as blocks are not laid out linearly in the image.
+  VkMemoryRequirements memory_requirements;
+  memory_requirements.size =
+      sparse_block_size_ * blocks_per_row * new_block_rows;
+  memory_requirements.alignment = sparse_block_size_;
+  memory_requirements.memoryTypeBits = sparse_memory_type_bits_;
+  VkDeviceMemory new_memory = device_->AllocateMemory(memory_requirements, 0);
+  if (!new_memory) {
+    return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+  }
+
+  std::vector<VkSparseImageMemoryBind> binds;
+  binds.reserve(blocks_per_row * new_block_rows);
+  VkDeviceSize memory_offset = 0;
+  for (uint32_t y = sparse_resident_block_rows_; y < block_rows; ++y) {
+    uint32_t block_y = y * sparse_block_extent_.height;
+    for (uint32_t x = 0; x < blocks_per_row; ++x) {
+      uint32_t block_x = x * sparse_block_extent_.width;
+      VkSparseImageMemoryBind& bind = binds.emplace_back();
+      bind.subresource.aspectMask = sparse_aspect_mask_;
+      bind.subresource.mipLevel = 0;
+      bind.subresource.arrayLayer = 0;
+      bind.offset = {int32_t(block_x), int32_t(block_y), 0};
+      // Blocks on the edges may be partial.
+      bind.extent.width =
+          std::min(sparse_block_extent_.width, size.width - block_x);
+      bind.extent.height =
+          std::min(sparse_block_extent_.height, size.height - block_y);
+      bind.extent.depth = 1;
+      bind.memory = new_memory;
+      bind.memoryOffset = memory_offset;
+      bind.flags = 0;
+      memory_offset += sparse_block_size_;
+    }
+  }
+
+  VkSparseImageMemoryBindInfo image_bind_info;
+  image_bind_info.image = image;
+  image_bind_info.bindCount = uint32_t(binds.size());
+  image_bind_info.pBinds = binds.data();
+  VkBindSparseInfo bind_sparse_info = {};
+  bind_sparse_info.sType = VK_STRUCTURE_TYPE_BIND_SPARSE_INFO;
+  bind_sparse_info.imageBindCount = 1;
+  bind_sparse_info.pImageBinds = &image_bind_info;
+
+  // The commands using the new rows are submitted later, possibly to another
+  // queue, so the binding must be complete before returning. This only
+  // happens when a render target grows, so waiting here is rare.
+  VkFenceCreateInfo fence_info;
+  fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fence_info.pNext = nullptr;
+  fence_info.flags = 0;
+  VkFence fence;
+  VkResult status = vkCreateFence(*device_, &fence_info, nullptr, &fence);
+  if (status != VK_SUCCESS) {
+    vkFreeMemory(*device_, new_memory, nullptr);
+    return status;
+  }
+  {
+    std::lock_guard<std::mutex> lock(device_->primary_queue_mutex());
+    status = vkQueueBindSparse(device_->primary_queue(), 1, &bind_sparse_info,
+                               fence);
+  }
+  if (status != VK_SUCCESS) {
+    vkDestroyFence(*device_, fence, nullptr);
+    vkFreeMemory(*device_, new_memory, nullptr);
+    return status;
+  }
+  // Even if waiting fails, the memory may be bound already, so keep it until
+  // the image is destroyed.
+  sparse_memory_.push_back(new_memory);
+  status = vkWaitForFences(*device_, 1, &fence, VK_TRUE, UINT64_MAX);
+  vkDestroyFence(*device_, fence, nullptr);
+  if (status != VK_SUCCESS) {
+    return status;
+  }
+  sparse_resident_block_rows_ = block_rows;
+  return VK_SUCCESS;
+}
+
 CachedFramebuffer::CachedFramebuffer(
     VkDevice device, VkRenderPass render_pass, uint32_t surface_width,
     uint32_t surface_height, CachedTileView* target_color_attachments[4],
@@ -372,21 +563,12 @@ VkResult CachedFramebuffer::Initialize() {
   return vkCreateFramebuffer(device_, &framebuffer_info, nullptr, &handle);
 }
 
-bool CachedFramebuffer::IsCompatible(
-    const RenderConfiguration& desired_config) const {
+bool CachedFramebuffer::IsCompatible(const RenderConfiguration& desired_config,
+                                     uint32_t resolution_scale) const {
   // We already know all render pass things line up, so let's verify dimensions,
   // edram offsets, etc. We need an exact match.
-  uint32_t surface_pitch_px =
-      desired_config.surface_msaa != xenos::MsaaSamples::k4X
-          ? desired_config.surface_pitch_px
-          : desired_config.surface_pitch_px * 2;
-  uint32_t surface_height_px =
-      desired_config.surface_msaa == xenos::MsaaSamples::k1X
-          ? desired_config.surface_height_px
-          : desired_config.surface_height_px * 2;
-  surface_pitch_px = std::min(surface_pitch_px, 2560u);
-  surface_height_px = std::min(surface_height_px, 2560u);
-  if (surface_pitch_px != width || surface_height_px != height) {
+  VkExtent2D extent = GetFramebufferExtent(desired_config, resolution_scale);
+  if (extent.width != width || extent.height != height) {
     return false;
   }
   // TODO(benvanik): separate image views from images in tiles and store in fb?
@@ -561,7 +743,29 @@ bool CachedRenderPass::IsCompatible(
 
 RenderCache::RenderCache(RegisterFile* register_file,
                          ui::vulkan::VulkanDevice* device)
-    : register_file_(register_file), device_(device) {}
+    : register_file_(register_file), device_(device) {
+  resolution_scale_ =
+      uint32_t(std::min(std::max(cvars::vulkan_resolution_scale, 1), 3));
+  // Tile views of 4x MSAA surfaces are up to 5120 pixels wide, and
+  // framebuffers are up to 2560x2560.
+  const VkPhysicalDeviceLimits& limits =
+      device_->device_info().properties.limits;
+  while (resolution_scale_ > 1 &&
+         (5120 * resolution_scale_ > limits.maxImageDimension2D ||
+          2560 * resolution_scale_ > limits.maxFramebufferWidth ||
+          2560 * resolution_scale_ > limits.maxFramebufferHeight)) {
+    --resolution_scale_;
+  }
+  if (resolution_scale_ != uint32_t(cvars::vulkan_resolution_scale)) {
+    XELOGW("Vulkan resolution scale {} is not supported, using {}",
+           cvars::vulkan_resolution_scale, resolution_scale_);
+  }
+  sparse_tile_views_ = resolution_scale_ > 1 &&
+                       device_->sparse_residency_image_2d_supported();
+  edram_tile_versions_.fill(0);
+  edram_buffer_tile_versions_.fill(0);
+  edram_tile_owners_.fill(nullptr);
+}
 
 RenderCache::~RenderCache() { Shutdown(); }
 
@@ -573,7 +777,9 @@ VkResult RenderCache::Initialize() {
   buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
   buffer_info.pNext = nullptr;
   buffer_info.flags = 0;
-  buffer_info.size = kEdramBufferCapacity;
+  // Tiles are stored with the resolution scale applied.
+  buffer_info.size =
+      kEdramBufferCapacity * resolution_scale_ * resolution_scale_;
   buffer_info.usage =
       VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
   buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
@@ -589,7 +795,7 @@ VkResult RenderCache::Initialize() {
   // It should be 1:1.
   VkMemoryRequirements buffer_requirements;
   vkGetBufferMemoryRequirements(*device_, edram_buffer_, &buffer_requirements);
-  assert_true(buffer_requirements.size == kEdramBufferCapacity);
+  assert_true(buffer_requirements.size == buffer_info.size);
 
   // Allocate EDRAM memory.
   // TODO(benvanik): do we need it host visible?
@@ -638,6 +844,9 @@ void RenderCache::Shutdown() {
     delete tile_view;
   }
   cached_tile_views_.clear();
+  edram_tile_versions_.fill(0);
+  edram_buffer_tile_versions_.fill(0);
+  edram_tile_owners_.fill(nullptr);
 
   // Release underlying EDRAM memory.
   if (edram_buffer_) {
@@ -667,6 +876,11 @@ bool RenderCache::dirty() const {
            regs[XE_GPU_REG_PA_SC_WINDOW_SCISSOR_TL].u32;
   dirty |= cur_regs.pa_sc_window_scissor_br !=
            regs[XE_GPU_REG_PA_SC_WINDOW_SCISSOR_BR].u32;
+  if (sparse_tile_views_) {
+    // The resident area of the render targets depends on the window offset.
+    dirty |= cur_regs.pa_sc_window_offset !=
+             regs[XE_GPU_REG_PA_SC_WINDOW_OFFSET].u32;
+  }
   return dirty;
 }
 
@@ -704,6 +918,10 @@ const RenderState* RenderCache::BeginRenderPass(VkCommandBuffer command_buffer,
                              XE_GPU_REG_PA_SC_WINDOW_SCISSOR_TL);
   dirty |= SetShadowRegister(&regs.pa_sc_window_scissor_br,
                              XE_GPU_REG_PA_SC_WINDOW_SCISSOR_BR);
+  if (sparse_tile_views_) {
+    dirty |= SetShadowRegister(&regs.pa_sc_window_offset,
+                               XE_GPU_REG_PA_SC_WINDOW_OFFSET);
+  }
   if (!dirty && current_state_.render_pass) {
     // No registers have changed so we can reuse the previous render pass -
     // just begin with what we had.
@@ -725,28 +943,121 @@ const RenderState* RenderCache::BeginRenderPass(VkCommandBuffer command_buffer,
     current_state_.render_pass_handle = render_pass->handle;
     current_state_.framebuffer = framebuffer;
     current_state_.framebuffer_handle = framebuffer->handle;
+  }
+  if (!render_pass) {
+    return nullptr;
+  }
 
-    // TODO(DrChat): Determine if we actually need an EDRAM buffer.
-    /*
-    // Depth
-    auto depth_target = current_state_.framebuffer->depth_stencil_attachment;
-    if (depth_target && current_state_.config.depth_stencil.used) {
-      UpdateTileView(command_buffer, depth_target, true);
+  if (sparse_tile_views_) {
+    // Make the rows that may be drawn to until the scissor changes resident.
+    int32_t scissor_bottom = (regs.pa_sc_window_scissor_br >> 16) & 0x7FFF;
+    if (!(regs.pa_sc_window_scissor_tl & 0x80000000)) {
+      // ! WINDOW_OFFSET_DISABLE
+      int16_t window_offset_y = (regs.pa_sc_window_offset >> 16) & 0x7FFF;
+      if (window_offset_y & 0x4000) {
+        window_offset_y |= 0x8000;
+      }
+      scissor_bottom += window_offset_y;
     }
-
-    // Color
-    for (int i = 0; i < 4; i++) {
-      auto target = current_state_.framebuffer->color_attachments[i];
-      if (!target || !current_state_.config.color[i].used) {
+    uint32_t resident_height =
+        uint32_t(std::min(std::max(scissor_bottom, 0), 2560));
+    if (config->surface_msaa != xenos::MsaaSamples::k1X) {
+      resident_height = std::min(resident_height * 2, 2560u);
+    }
+    resident_height *= resolution_scale_;
+    CachedTileView* attachments[] = {
+        framebuffer->color_attachments[0], framebuffer->color_attachments[1],
+        framebuffer->color_attachments[2], framebuffer->color_attachments[3],
+        framebuffer->depth_stencil_attachment,
+    };
+    for (CachedTileView* attachment : attachments) {
+      if (!attachment) {
         continue;
       }
-
-      UpdateTileView(command_buffer, target, true);
+      VkResult status = attachment->EnsureResident(resident_height);
+      if (status != VK_SUCCESS) {
+        XELOGE("{}: Failed to make a render target resident, status {}",
+               __func__, ui::vulkan::to_string(status));
+      }
     }
-    */
   }
-  if (!render_pass) {
-    return nullptr;
+
+  // Bring the tiles within the window scissor that have been drawn to through
+  // other views into the attachments, and take ownership of them in the ones
+  // that may be written to.
+  {
+    int32_t scissor_left = regs.pa_sc_window_scissor_tl & 0x7FFF;
+    int32_t scissor_top = (regs.pa_sc_window_scissor_tl >> 16) & 0x7FFF;
+    int32_t scissor_right = regs.pa_sc_window_scissor_br & 0x7FFF;
+    int32_t scissor_bottom = (regs.pa_sc_window_scissor_br >> 16) & 0x7FFF;
+    if (!(regs.pa_sc_window_scissor_tl & 0x80000000)) {
+      // ! WINDOW_OFFSET_DISABLE
+      uint32_t window_offset = register_file_->values[
+          XE_GPU_REG_PA_SC_WINDOW_OFFSET].u32;
+      int16_t window_offset_x = window_offset & 0x7FFF;
+      int16_t window_offset_y = (window_offset >> 16) & 0x7FFF;
+      if (window_offset_x & 0x4000) {
+        window_offset_x |= 0x8000;
+      }
+      if (window_offset_y & 0x4000) {
+        window_offset_y |= 0x8000;
+      }
+      scissor_left += window_offset_x;
+      scissor_top += window_offset_y;
+      scissor_right += window_offset_x;
+      scissor_bottom += window_offset_y;
+    }
+    uint32_t sync_left = uint32_t(std::min(std::max(scissor_left, 0), 2560));
+    uint32_t sync_top = uint32_t(std::min(std::max(scissor_top, 0), 2560));
+    uint32_t sync_right = uint32_t(std::min(std::max(scissor_right, 0), 2560));
+    uint32_t sync_bottom =
+        uint32_t(std::min(std::max(scissor_bottom, 0), 2560));
+    if (config->surface_msaa == xenos::MsaaSamples::k4X) {
+      sync_left *= 2;
+      sync_right *= 2;
+    }
+    if (config->surface_msaa != xenos::MsaaSamples::k1X) {
+      sync_top *= 2;
+      sync_bottom *= 2;
+    }
+    if (sync_right > sync_left && sync_bottom > sync_top) {
+      // Only the attachments that the draws may write to are claimed, so
+      // unused render targets aliasing the used ones don't take the tiles.
+      auto color_mask = register_file_->Get<reg::RB_COLOR_MASK>();
+      auto depth_control = register_file_->Get<reg::RB_DEPTHCONTROL>();
+      CachedTileView* written_views[5];
+      uint32_t written_view_count = 0;
+      CachedTileView* read_views[5];
+      uint32_t read_view_count = 0;
+      for (uint32_t i = 0; i < 4; ++i) {
+        CachedTileView* view = framebuffer->color_attachments[i];
+        if (!view || config->mode_control != ModeControl::kColorDepth) {
+          continue;
+        }
+        if (pixel_shader && pixel_shader->writes_color_target(i) &&
+            (color_mask.value >> (i * 4)) & 0xF) {
+          written_views[written_view_count++] = view;
+        } else {
+          read_views[read_view_count++] = view;
+        }
+      }
+      CachedTileView* depth_view = framebuffer->depth_stencil_attachment;
+      if (depth_view && (config->mode_control == ModeControl::kColorDepth ||
+                         config->mode_control == ModeControl::kDepth)) {
+        if ((depth_control.z_enable && depth_control.z_write_enable) ||
+            depth_control.stencil_enable) {
+          written_views[written_view_count++] = depth_view;
+        } else {
+          read_views[read_view_count++] = depth_view;
+        }
+      }
+      SyncTileViews(command_buffer, read_views, read_view_count, sync_left,
+                    sync_top, sync_right - sync_left, sync_bottom - sync_top,
+                    false);
+      SyncTileViews(command_buffer, written_views, written_view_count,
+                    sync_left, sync_top, sync_right - sync_left,
+                    sync_bottom - sync_top, true);
+    }
   }
 
   // Setup render pass in command buffer.
@@ -763,17 +1074,8 @@ const RenderState* RenderCache::BeginRenderPass(VkCommandBuffer command_buffer,
   // the docs warn anything but the full framebuffer may be slow.
   render_pass_begin_info.renderArea.offset.x = 0;
   render_pass_begin_info.renderArea.offset.y = 0;
-  render_pass_begin_info.renderArea.extent.width = config->surface_pitch_px;
-  render_pass_begin_info.renderArea.extent.height = config->surface_height_px;
-
-  if (config->surface_msaa == xenos::MsaaSamples::k2X) {
-    render_pass_begin_info.renderArea.extent.height =
-        std::min(config->surface_height_px * 2, 2560u);
-  } else if (config->surface_msaa == xenos::MsaaSamples::k4X) {
-    render_pass_begin_info.renderArea.extent.width *= 2;
-    render_pass_begin_info.renderArea.extent.height =
-        std::min(config->surface_height_px * 2, 2560u);
-  }
+  render_pass_begin_info.renderArea.extent =
+      GetFramebufferExtent(*config, resolution_scale_);
 
   // Configure clear color, if clearing.
   // TODO(benvanik): enable clearing here during resolve?
@@ -848,43 +1150,53 @@ bool RenderCache::ParseConfiguration(RenderConfiguration* config) {
   return true;
 }
 
-bool RenderCache::ConfigureRenderPass(VkCommandBuffer command_buffer,
-                                      RenderConfiguration* config,
-                                      CachedRenderPass** out_render_pass,
-                                      CachedFramebuffer** out_framebuffer) {
-  *out_render_pass = nullptr;
-  *out_framebuffer = nullptr;
+VkRenderPass RenderCache::GetRenderPass(const RenderConfiguration& config) {
+  CachedRenderPass* render_pass = FindOrCreateRenderPass(config);
+  return render_pass ? render_pass->handle : nullptr;
+}
 
+CachedRenderPass* RenderCache::FindOrCreateRenderPass(
+    const RenderConfiguration& config) {
   // TODO(benvanik): better lookup.
   // Attempt to find the render pass in our cache.
-  CachedRenderPass* render_pass = nullptr;
   for (auto cached_render_pass : cached_render_passes_) {
-    if (cached_render_pass->IsCompatible(*config)) {
+    if (cached_render_pass->IsCompatible(config)) {
       // Found a match.
-      render_pass = cached_render_pass;
-      break;
+      return cached_render_pass;
     }
   }
 
   // If no render pass was found in the cache create a new one.
-  if (!render_pass) {
-    render_pass = new CachedRenderPass(*device_, *config);
-    VkResult status = render_pass->Initialize();
-    if (status != VK_SUCCESS) {
-      XELOGE("{}: Failed to create render pass, status {}", __func__,
-             ui::vulkan::to_string(status));
-      delete render_pass;
-      return false;
-    }
+  auto render_pass = new CachedRenderPass(*device_, config);
+  VkResult status = render_pass->Initialize();
+  if (status != VK_SUCCESS) {
+    XELOGE("{}: Failed to create render pass, status {}", __func__,
+           ui::vulkan::to_string(status));
+    delete render_pass;
+    return nullptr;
+  }
+
+  cached_render_passes_.push_back(render_pass);
+  return render_pass;
+}
+
+bool RenderCache::ConfigureRenderPass(VkCommandBuffer command_buffer,
+                                      RenderConfiguration* config,
+                                      CachedRenderPass** out_render_pass,
+                                      CachedFramebuffer** out_framebuffer) {
+  *out_render_pass = nullptr;
+  *out_framebuffer = nullptr;
 
-    cached_render_passes_.push_back(render_pass);
+  CachedRenderPass* render_pass = FindOrCreateRenderPass(*config);
+  if (!render_pass) {
+    return false;
   }
 
   // TODO(benvanik): better lookup.
   // Attempt to find the framebuffer in the render pass cache.
   CachedFramebuffer* framebuffer = nullptr;
   for (auto cached_framebuffer : render_pass->cached_framebuffers) {
-    if (cached_framebuffer->IsCompatible(*config)) {
+    if (cached_framebuffer->IsCompatible(*config, resolution_scale_)) {
       // Found a match.
       framebuffer = cached_framebuffer;
       break;
@@ -939,17 +1251,12 @@ bool RenderCache::ConfigureRenderPass(VkCommandBuffer command_buffer,
       return false;
     }
 
-    uint32_t surface_pitch_px = config->surface_msaa != xenos::MsaaSamples::k4X
-                                    ? config->surface_pitch_px
-                                    : config->surface_pitch_px * 2;
-    uint32_t surface_height_px = config->surface_msaa == xenos::MsaaSamples::k1X
-                                     ? config->surface_height_px
-                                     : config->surface_height_px * 2;
-    surface_pitch_px = std::min(surface_pitch_px, 2560u);
-    surface_height_px = std::min(surface_height_px, 2560u);
+    VkExtent2D framebuffer_extent =
+        GetFramebufferExtent(*config, resolution_scale_);
     framebuffer = new CachedFramebuffer(
-        *device_, render_pass->handle, surface_pitch_px, surface_height_px,
-        target_color_attachments, target_depth_stencil_attachment);
+        *device_, render_pass->handle, framebuffer_extent.width,
+        framebuffer_extent.height, target_color_attachments,
+        target_depth_stencil_attachment);
     VkResult status = framebuffer->Initialize();
     if (status != VK_SUCCESS) {
       XELOGE("{}: Failed to create framebuffer, status {}", __func__,
@@ -1002,7 +1309,8 @@ CachedTileView* RenderCache::FindOrCreateTileView(
   }
 
   // Create a new tile and add to the cache.
-  tile_view = new CachedTileView(device_, edram_memory_, view_key);
+  tile_view = new CachedTileView(device_, edram_memory_, view_key,
+                                 resolution_scale_, sparse_tile_views_);
   VkResult status = tile_view->Initialize(command_buffer);
   if (status != VK_SUCCESS) {
     XELOGE("{}: Failed to create tile view, status {}", __func__,
@@ -1016,59 +1324,218 @@ CachedTileView* RenderCache::FindOrCreateTileView(
   return tile_view;
 }
 
-void RenderCache::UpdateTileView(VkCommandBuffer command_buffer,
-                                 CachedTileView* view, bool load,
-                                 bool insert_barrier) {
-  uint32_t tile_width =
-      view->key.msaa_samples == uint16_t(xenos::MsaaSamples::k4X) ? 40 : 80;
-  uint32_t tile_height =
-      view->key.msaa_samples != uint16_t(xenos::MsaaSamples::k1X) ? 8 : 16;
-
-  if (insert_barrier) {
-    VkBufferMemoryBarrier barrier;
-    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+void RenderCache::SyncTileViews(VkCommandBuffer command_buffer,
+                                CachedTileView* const* views,
+                                uint32_t view_count, uint32_t x, uint32_t y,
+                                uint32_t width, uint32_t height, bool claim) {
+  if (!width || !height) {
+    return;
+  }
+  uint32_t scale = resolution_scale_;
+  VkDeviceSize edram_buffer_tile_size = 5120 * scale * scale;
+  auto make_region = [&](const CachedTileView* view, uint32_t tile_x,
+                         uint32_t tile_y, uint32_t edram_tile) {
+    // TODO(DrChat): Stencil copies.
+    VkBufferImageCopy region;
+    region.bufferOffset = edram_tile * edram_buffer_tile_size;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource = {0, 0, 0, 1};
+    region.imageSubresource.aspectMask = view->key.color_or_depth
+                                             ? VK_IMAGE_ASPECT_COLOR_BIT
+                                             : VK_IMAGE_ASPECT_DEPTH_BIT;
+    region.imageOffset = {int32_t(tile_x * 80 * scale),
+                          int32_t(tile_y * 16 * scale), 0};
+    region.imageExtent = {80 * scale, 16 * scale, 1};
+    return region;
+  };
+
+  // Find the stale tiles, and store the latest contents of them from the
+  // views owning them to the EDRAM buffer if it doesn't have them already.
+  tile_stores_.clear();
+  tile_loads_.clear();
+  uint32_t tile_x_first = x / 80, tile_y_first = y / 16;
+  for (uint32_t i = 0; i < view_count; ++i) {
+    CachedTileView* view = views[i];
+    // Multisampled images can't be copied to and from buffers.
+    if (view->sample_count != VK_SAMPLE_COUNT_1_BIT) {
+      continue;
+    }
+    uint32_t tiles_per_host_tile = GetTileViewEdramTilesPerHostTile(view->key);
+    uint32_t tile_x_end =
+        std::min((x + width + 79) / 80, uint32_t(view->key.tile_width));
+    uint32_t tile_y_end =
+        std::min((y + height + 15) / 16, uint32_t(view->key.tile_height));
+    for (uint32_t tile_y = tile_y_first; tile_y < tile_y_end; ++tile_y) {
+      for (uint32_t tile_x = tile_x_first; tile_x < tile_x_end; ++tile_x) {
+        uint32_t edram_tile =
+            view->key.tile_offset +
+            (tile_y * view->key.tile_width + tile_x) * tiles_per_host_tile;
+        if (edram_tile + tiles_per_host_tile > xenos::kEdramTileCount) {
+          // Outside the EDRAM - the rest of the rows are too.
+          tile_y = tile_y_end;
+          break;
+        }
+        bool stale = false;
+        for (uint32_t j = 0; j < tiles_per_host_tile; ++j) {
+          uint32_t tile = edram_tile + j;
+          if (view->edram_tile_versions[tile] == edram_tile_versions_[tile]) {
+            continue;
+          }
+          stale = true;
+          if (edram_buffer_tile_versions_[tile] == edram_tile_versions_[tile]) {
+            continue;
+          }
+          CachedTileView* owner = edram_tile_owners_[tile];
+          if (!owner) {
+            continue;
+          }
+          uint32_t owner_tiles_per_host_tile =
+              GetTileViewEdramTilesPerHostTile(owner->key);
+          uint32_t owner_host_tile =
+              (tile - owner->key.tile_offset) / owner_tiles_per_host_tile;
+          uint32_t owner_edram_tile =
+              owner->key.tile_offset +
+              owner_host_tile * owner_tiles_per_host_tile;
+          TileCopy& store = tile_stores_.emplace_back();
+          store.view = owner;
+          store.region = make_region(
+              owner, owner_host_tile % owner->key.tile_width,
+              owner_host_tile / owner->key.tile_width, owner_edram_tile);
+          for (uint32_t k = 0; k < owner_tiles_per_host_tile; ++k) {
+            edram_buffer_tile_versions_[owner_edram_tile + k] =
+                owner->edram_tile_versions[owner_edram_tile + k];
+          }
+        }
+        if (stale) {
+          TileCopy& load = tile_loads_.emplace_back();
+          load.view = view;
+          load.region = make_region(view, tile_x, tile_y, edram_tile);
+        }
+      }
+    }
+  }
+
+  if (!tile_loads_.empty()) {
+    // Wait for the draws and the previous copies, and for the reads before
+    // the loaded tiles are overwritten.
+    VkMemoryBarrier barrier;
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
     barrier.pNext = nullptr;
-    if (load) {
+    barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+                            VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask =
+        VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0,
+        nullptr);
+
+    auto copy_tiles = [&](std::vector<TileCopy>& copies, bool load) {
+      std::stable_sort(copies.begin(), copies.end(),
+                       [](const TileCopy& a, const TileCopy& b) {
+                         return a.view < b.view;
+                       });
+      for (size_t i = 0; i < copies.size();) {
+        CachedTileView* view = copies[i].view;
+        tile_copy_regions_.clear();
+        for (; i < copies.size() && copies[i].view == view; ++i) {
+          tile_copy_regions_.push_back(copies[i].region);
+        }
+        if (load) {
+          vkCmdCopyBufferToImage(command_buffer, edram_buffer_, view->image,
+                                 VK_IMAGE_LAYOUT_GENERAL,
+                                 uint32_t(tile_copy_regions_.size()),
+                                 tile_copy_regions_.data());
+        } else {
+          vkCmdCopyImageToBuffer(command_buffer, view->image,
+                                 VK_IMAGE_LAYOUT_GENERAL, edram_buffer_,
+                                 uint32_t(tile_copy_regions_.size()),
+                                 tile_copy_regions_.data());
+        }
+      }
+    };
+
+    if (!tile_stores_.empty()) {
+      copy_tiles(tile_stores_, false);
       barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-      barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-    } else {
-      barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-      barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                           VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0,
+                           nullptr, 0, nullptr);
     }
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.buffer = edram_buffer_;
-    barrier.offset = view->key.tile_offset * 5120;
-    barrier.size = view->key.tile_width * tile_width * view->key.tile_height *
-                           tile_height * view->key.color_or_depth
-                       ? 4
-                       : 1;
-    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                         VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, 0, nullptr, 1,
-                         &barrier, 0, nullptr);
+
+    copy_tiles(tile_loads_, true);
+    for (const TileCopy& load : tile_loads_) {
+      uint32_t edram_tile =
+          uint32_t(load.region.bufferOffset / edram_buffer_tile_size);
+      uint32_t tiles_per_host_tile =
+          GetTileViewEdramTilesPerHostTile(load.view->key);
+      for (uint32_t j = 0; j < tiles_per_host_tile; ++j) {
+        load.view->edram_tile_versions[edram_tile + j] =
+            edram_buffer_tile_versions_[edram_tile + j];
+      }
+    }
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+                            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+                            VK_ACCESS_SHADER_READ_BIT |
+                            VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(
+        command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        1, &barrier, 0, nullptr, 0, nullptr);
   }
 
-  // TODO(DrChat): Stencil copies.
-  VkBufferImageCopy region;
-  region.bufferOffset = view->key.tile_offset * 5120;
-  region.bufferRowLength = 0;
-  region.bufferImageHeight = 0;
-  region.imageSubresource = {0, 0, 0, 1};
-  region.imageSubresource.aspectMask = view->key.color_or_depth
-                                           ? VK_IMAGE_ASPECT_COLOR_BIT
-                                           : VK_IMAGE_ASPECT_DEPTH_BIT;
-  region.imageOffset = {0, 0, 0};
-  region.imageExtent = {view->key.tile_width * tile_width,
-                        view->key.tile_height * tile_height, 1};
-  if (load) {
-    vkCmdCopyBufferToImage(command_buffer, edram_buffer_, view->image,
-                           VK_IMAGE_LAYOUT_GENERAL, 1, &region);
-  } else {
-    vkCmdCopyImageToBuffer(command_buffer, view->image, VK_IMAGE_LAYOUT_GENERAL,
-                           edram_buffer_, 1, &region);
+  if (claim) {
+    for (uint32_t i = 0; i < view_count; ++i) {
+      ClaimTileViewTiles(views[i], x, y, width, height);
+    }
   }
 }
 
+void RenderCache::ClaimTileViewTiles(CachedTileView* view, uint32_t x,
+                                     uint32_t y, uint32_t width,
+                                     uint32_t height) {
+  if (!width || !height || view->sample_count != VK_SAMPLE_COUNT_1_BIT) {
+    return;
+  }
+  uint32_t tiles_per_host_tile = GetTileViewEdramTilesPerHostTile(view->key);
+  uint32_t tile_x_end =
+      std::min((x + width + 79) / 80, uint32_t(view->key.tile_width));
+  uint32_t tile_y_end =
+      std::min((y + height + 15) / 16, uint32_t(view->key.tile_height));
+  for (uint32_t tile_y = y / 16; tile_y < tile_y_end; ++tile_y) {
+    uint32_t edram_tile_row =
+        view->key.tile_offset + tile_y * view->key.tile_width *
+                                    tiles_per_host_tile;
+    uint32_t edram_tile_first = edram_tile_row + x / 80 * tiles_per_host_tile;
+    uint32_t edram_tile_end = std::min(
+        edram_tile_row + tile_x_end * tiles_per_host_tile,
+        xenos::kEdramTileCount);
+    if (edram_tile_first >= edram_tile_end) {
+      break;
+    }
+    ++edram_tile_version_last_;
+    for (uint32_t tile = edram_tile_first; tile < edram_tile_end; ++tile) {
+      edram_tile_versions_[tile] = edram_tile_version_last_;
+      view->edram_tile_versions[tile] = edram_tile_version_last_;
+      edram_tile_owners_[tile] = view;
+    }
+  }
+}
+
+void RenderCache::LoadTileViewTiles(VkCommandBuffer command_buffer,
+                                    CachedTileView* view, uint32_t x,
+                                    uint32_t y, uint32_t width,
+                                    uint32_t height) {
+  SyncTileViews(command_buffer, &view, 1, x, y, width, height, false);
+}
+
 CachedTileView* RenderCache::FindTileView(const TileViewKey& view_key) const {
   // Check the cache.
   // TODO(benvanik): better lookup.
@@ -1087,44 +1554,8 @@ void RenderCache::EndRenderPass() {
   // End the render pass.
   vkCmdEndRenderPass(current_command_buffer_);
 
-  // Copy all render targets back into our EDRAM buffer.
-  // Don't bother waiting on this command to complete, as next render pass may
-  // reuse previous framebuffer attachments. If they need this, they will wait.
-  // TODO: Should we bother re-tiling the images on copy back?
-  //
-  // FIXME: There's a case where we may have a really big render target (as we
-  // can't get the correct height atm) and we may end up overwriting the valid
-  // contents of another render target by mistake! Need to reorder copy commands
-  // to avoid this.
-
-  // TODO(DrChat): Determine if we actually need an EDRAM buffer.
-  /*
-  std::vector<CachedTileView*> cached_views;
-
-  // Depth
-  auto depth_target = current_state_.framebuffer->depth_stencil_attachment;
-  if (depth_target && current_state_.config.depth_stencil.used) {
-    cached_views.push_back(depth_target);
-  }
-
-  // Color
-  for (int i = 0; i < 4; i++) {
-    auto target = current_state_.framebuffer->color_attachments[i];
-    if (!target || !current_state_.config.color[i].used) {
-      continue;
-    }
-
-    cached_views.push_back(target);
-  }
-
-  std::sort(
-      cached_views.begin(), cached_views.end(),
-      [](CachedTileView const* a, CachedTileView const* b) { return *a < *b; });
-
-  for (auto view : cached_views) {
-    UpdateTileView(current_command_buffer_, view, false, false);
-  }
-  */
+  // The tiles drawn to are copied to other views overlapping them in EDRAM
+  // only when those are used, in SyncTileViews.
 
   current_command_buffer_ = nullptr;
 }
@@ -1232,7 +1663,8 @@ void RenderCache::BlitToImage(VkCommandBuffer command_buffer,
   assert_not_null(tile_view);
 
   // Update the view with the latest contents.
-  // UpdateTileView(command_buffer, tile_view, true, true);
+  LoadTileViewTiles(command_buffer, tile_view, 0, 0, extents.width,
+                    extents.height);
 
   // Put a barrier on the tile view.
   VkImageMemoryBarrier image_barrier;
@@ -1260,6 +1692,13 @@ void RenderCache::BlitToImage(VkCommandBuffer command_buffer,
   // assert_true(extents.width <= key.tile_width * tile_width);
   // assert_true(extents.height <= key.tile_height * tile_height);
 
+  // The destination is expected to be a resolve texture with the same
+  // resolution scale as the tile view.
+  offset.x *= int32_t(resolution_scale_);
+  offset.y *= int32_t(resolution_scale_);
+  extents.width *= resolution_scale_;
+  extents.height *= resolution_scale_;
+
   // Now issue the blit to the destination.
   if (tile_view->sample_count == VK_SAMPLE_COUNT_1_BIT) {
     VkImageBlit image_blit;
@@ -1342,8 +1781,11 @@ void RenderCache::ClearEDRAMColor(VkCommandBuffer command_buffer,
   vkCmdClearColorImage(command_buffer, tile_view->image,
                        VK_IMAGE_LAYOUT_GENERAL, &clear_value, 1, &range);
 
-  // Copy image back into EDRAM buffer
-  // UpdateTileView(command_buffer, tile_view, false, false);
+  // The whole image is cleared, but only the cleared area is guaranteed to be
+  // needed by the guest.
+  ClaimTileViewTiles(
+      tile_view, 0, 0, key.tile_width * 80u,
+      num_samples != xenos::MsaaSamples::k1X ? height * 2 : height);
 }
 
 void RenderCache::ClearEDRAMDepthStencil(VkCommandBuffer command_buffer,
@@ -1381,8 +1823,11 @@ void RenderCache::ClearEDRAMDepthStencil(VkCommandBuffer command_buffer,
   vkCmdClearDepthStencilImage(command_buffer, tile_view->image,
                               VK_IMAGE_LAYOUT_GENERAL, &clear_value, 1, &range);
 
-  // Copy image back into EDRAM buffer
-  // UpdateTileView(command_buffer, tile_view, false, false);
+  // The whole image is cleared, but only the cleared area is guaranteed to be
+  // needed by the guest.
+  ClaimTileViewTiles(
+      tile_view, 0, 0, key.tile_width * 80u,
+      num_samples != xenos::MsaaSamples::k1X ? height * 2 : height);
 }
 
 void RenderCache::FillEDRAM(VkCommandBuffer command_buffer, uint32_t value) {
@@ -10,6 +10,9 @@
 #ifndef XENIA_GPU_VULKAN_RENDER_CACHE_H_
 #define XENIA_GPU_VULKAN_RENDER_CACHE_H_
 
+#include <array>
+#include <vector>
+
 #include "xenia/gpu/register_file.h"
 #include "xenia/gpu/registers.h"
 #include "xenia/gpu/shader.h"
@@ -68,12 +71,30 @@ class CachedTileView {
   // (if a depth view) Image view of stencil aspect
   VkImageView image_view_stencil = nullptr;
 
+  // Multiplier of the width and the height of the image relative to the guest
+  // pixels.
+  uint32_t resolution_scale = 1;
+  // Whether the image has sparse residency, with memory bound on demand to
+  // rows of sparse blocks from the top by EnsureResident.
+  bool sparse = false;
+
+  // Version of the contents of each EDRAM tile last copied to or drawn into
+  // this view, compared to the RenderCache versions to find stale tiles.
+  std::vector<uint64_t> edram_tile_versions;
+
   CachedTileView(ui::vulkan::VulkanDevice* device, VkDeviceMemory edram_memory,
-                 TileViewKey view_key);
+                 TileViewKey view_key, uint32_t view_resolution_scale = 1,
+                 bool try_sparse = false);
   ~CachedTileView();
 
   VkResult Initialize(VkCommandBuffer command_buffer);
 
+  // Makes sure the image has memory for the rows from the top to the specified
+  // height in host pixels, binding new sparse blocks if needed. The binding is
+  // complete when this returns, so commands recorded before it may write to the
+  // new rows. Does nothing for images that don't have sparse residency.
+  VkResult EnsureResident(uint32_t height);
+
   bool IsEqual(const TileViewKey& other_key) const {
     auto a = reinterpret_cast<const uint64_t*>(&key);
     auto b = reinterpret_cast<const uint64_t*>(&other_key);
@@ -85,11 +106,25 @@ class CachedTileView {
   }
 
   VkExtent2D GetSize() const {
-    return {key.tile_width * 80u, key.tile_height * 16u};
+    return {key.tile_width * 80u * resolution_scale,
+            key.tile_height * 16u * resolution_scale};
   }
 
  private:
   ui::vulkan::VulkanDevice* device_ = nullptr;
+  bool try_sparse_ = false;
+
+  // Sparse residency state, valid if sparse is true.
+  // Allocations backing the resident rows, one for each EnsureResident call
+  // that has grown the resident area.
+  std::vector<VkDeviceMemory> sparse_memory_;
+  uint32_t sparse_memory_type_bits_ = 0;
+  // Size of a sparse block in bytes (usually 64 KB).
+  VkDeviceSize sparse_block_size_ = 0;
+  VkExtent3D sparse_block_extent_ = {};
+  VkImageAspectFlags sparse_aspect_mask_ = 0;
+  // Number of rows of sparse blocks bound from the top of the image.
+  uint32_t sparse_resident_block_rows_ = 0;
 };
 
 // Parsed render configuration from the current render state.
@@ -284,6 +319,10 @@ class RenderCache {
   // with an already open pass.
   bool dirty() const;
 
+  // Multiplier of the width and the height of the render targets, and of the
+  // resolve destinations.
+  uint32_t resolution_scale() const { return resolution_scale_; }
+
   CachedTileView* FindTileView(uint32_t base, uint32_t pitch,
                                xenos::MsaaSamples samples, bool color_or_depth,
                                uint32_t format);
@@ -298,9 +337,22 @@ class RenderCache {
   // The command buffer will be transitioned out of the render pass phase.
   void EndRenderPass();
 
+  // Returns a render pass compatible with the configuration, creating it if
+  // needed, so pipelines can be created outside the draws using them.
+  VkRenderPass GetRenderPass(const RenderConfiguration& config);
+
   // Clears all cached content.
   void ClearCache();
 
+  // Queues commands to copy the tiles overlapping the rectangle (in host pixels
+  // of the view without resolution scaling) that have been written through
+  // other views since this view was last updated into the view, through the
+  // EDRAM buffer.
+  // The command buffer must not be inside of a render pass when calling this.
+  void LoadTileViewTiles(VkCommandBuffer command_buffer, CachedTileView* view,
+                         uint32_t x, uint32_t y, uint32_t width,
+                         uint32_t height);
+
   // Queues commands to copy EDRAM contents into an image.
   // The command buffer must not be inside of a render pass when calling this.
   void RawCopyToImage(VkCommandBuffer command_buffer, uint32_t edram_base,
@@ -346,8 +398,23 @@ class RenderCache {
   CachedTileView* FindOrCreateTileView(VkCommandBuffer command_buffer,
                                        const TileViewKey& view_key);
 
-  void UpdateTileView(VkCommandBuffer command_buffer, CachedTileView* view,
-                      bool load, bool insert_barrier = true);
+  // Copies the stale tiles of the views overlapping the rectangle (in host
+  // pixels without resolution scaling) from the views holding their latest
+  // contents, storing them to the EDRAM buffer and loading them from it. If
+  // claim is true, the views are marked as having the latest contents of the
+  // tiles in the rectangle afterwards, as they're going to be drawn to.
+  void SyncTileViews(VkCommandBuffer command_buffer,
+                     CachedTileView* const* views, uint32_t view_count,
+                     uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+                     bool claim);
+  // Marks the view as having the latest contents of the tiles overlapping the
+  // rectangle, without copying anything, for when they're fully overwritten.
+  void ClaimTileViewTiles(CachedTileView* view, uint32_t x, uint32_t y,
+                          uint32_t width, uint32_t height);
+
+  // Gets or creates a render pass for the given configuration. Returns nullptr
+  // if failed to create it.
+  CachedRenderPass* FindOrCreateRenderPass(const RenderConfiguration& config);
 
   // Gets or creates a render pass and frame buffer for the given configuration.
   // This attempts to reuse as much as possible across render passes and
@@ -360,11 +427,35 @@ class RenderCache {
   RegisterFile* register_file_ = nullptr;
   ui::vulkan::VulkanDevice* device_ = nullptr;
 
+  uint32_t resolution_scale_ = 1;
+  // Whether to create render targets with sparse residency.
+  bool sparse_tile_views_ = false;
+
   // Entire 10MiB of EDRAM.
   VkDeviceMemory edram_memory_ = nullptr;
   // Buffer overlayed 1:1 with edram_memory_ to allow raw access.
   VkBuffer edram_buffer_ = nullptr;
 
+  // Per-tile tracking of the EDRAM contents, so only the tiles drawn through
+  // one view and then accessed through another are copied between them, via
+  // the 80x16-pixel (multiplied by the resolution scale) regions of 5120-byte
+  // tiles in the EDRAM buffer.
+  // Version of the latest contents of each EDRAM tile, 0 if never drawn to.
+  std::array<uint64_t, xenos::kEdramTileCount> edram_tile_versions_;
+  // Version of the contents of each tile stored in the EDRAM buffer.
+  std::array<uint64_t, xenos::kEdramTileCount> edram_buffer_tile_versions_;
+  // View holding the latest contents of each tile.
+  std::array<CachedTileView*, xenos::kEdramTileCount> edram_tile_owners_;
+  uint64_t edram_tile_version_last_ = 0;
+  struct TileCopy {
+    CachedTileView* view;
+    VkBufferImageCopy region;
+  };
+  // Temporary storage for SyncTileViews.
+  std::vector<TileCopy> tile_stores_;
+  std::vector<TileCopy> tile_loads_;
+  std::vector<VkBufferImageCopy> tile_copy_regions_;
+
   // Cache of VkImage and VkImageView's for all of our EDRAM tilings.
   // TODO(benvanik): non-linear lookup? Should only be a small number of these.
   std::vector<CachedTileView*> cached_tile_views_;
@@ -385,6 +476,7 @@ class RenderCache {
     reg::RB_DEPTH_INFO rb_depth_info;
     uint32_t pa_sc_window_scissor_tl;
     uint32_t pa_sc_window_scissor_br;
+    uint32_t pa_sc_window_offset;
 
     ShadowRegisters() { Reset(); }
     void Reset() { std::memset(this, 0, sizeof(*this)); }
@@ -12,12 +12,14 @@
 #include <algorithm>
 
 #include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/profiling.h"
 #include "xenia/gpu/gpu_flags.h"
 #include "xenia/gpu/sampler_info.h"
+#include "xenia/gpu/spirv_shader_translator.h"
 #include "xenia/gpu/texture_conversion.h"
 #include "xenia/gpu/texture_info.h"
 #include "xenia/gpu/vulkan/texture_config.h"
@@ -54,12 +56,16 @@ const char* get_dimension_name(xenos::DataDimension dimension) {
 
 TextureCache::TextureCache(Memory* memory, RegisterFile* register_file,
                            TraceWriter* trace_writer,
-                           ui::vulkan::VulkanDevice* device)
+                           ui::vulkan::VulkanDevice* device,
+                           BenchmarkCounters* benchmark_counters)
     : memory_(memory),
       register_file_(register_file),
       trace_writer_(trace_writer),
+      benchmark_counters_(benchmark_counters),
       device_(device),
-      staging_buffer_(device, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      staging_buffer_(device,
+                      VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
                       kStagingBufferSize),
       wb_staging_buffer_(device, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
                          kStagingBufferSize) {}
@@ -69,14 +75,6 @@ TextureCache::~TextureCache() { Shutdown(); }
 VkResult TextureCache::Initialize() {
   VkResult status = VK_SUCCESS;
 
-  // Descriptor pool used for all of our cached descriptors.
-  VkDescriptorPoolSize pool_sizes[1];
-  pool_sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-  pool_sizes[0].descriptorCount = 32768;
-  descriptor_pool_ = std::make_unique<ui::vulkan::DescriptorPool>(
-      *device_, 32768,
-      std::vector<VkDescriptorPoolSize>(pool_sizes, std::end(pool_sizes)));
-
   wb_command_pool_ = std::make_unique<ui::vulkan::CommandBufferPool>(
       *device_, device_->queue_family_index());
 
@@ -95,30 +93,55 @@ VkResult TextureCache::Initialize() {
     // assert_always();
   }
 
-  // Create the descriptor set layout used for rendering.
-  // We always have the same number of samplers but only some are used.
-  // The shaders will alias the bindings to the 4 dimensional types.
-  VkDescriptorSetLayoutBinding bindings[1];
-  bindings[0].binding = 0;
-  bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-  bindings[0].descriptorCount = kMaxTextureSamplers;
-  bindings[0].stageFlags =
-      VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-  bindings[0].pImmutableSamplers = nullptr;
+  if (cvars::vulkan_bindless) {
+    if (device_->descriptor_indexing_bindless_supported() &&
+        device_->max_update_after_bind_sampled_images() >=
+            kSpirvBindlessTextureCount) {
+      status = InitializeBindless();
+      if (status != VK_SUCCESS) {
+        return status;
+      }
+    } else {
+      XELOGI(
+          "Vulkan device doesn't support the descriptor indexing features "
+          "needed for bindless textures");
+    }
+  }
 
-  VkDescriptorSetLayoutCreateInfo descriptor_set_layout_info;
-  descriptor_set_layout_info.sType =
-      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-  descriptor_set_layout_info.pNext = nullptr;
-  descriptor_set_layout_info.flags = 0;
-  descriptor_set_layout_info.bindingCount =
-      static_cast<uint32_t>(xe::countof(bindings));
-  descriptor_set_layout_info.pBindings = bindings;
-  status =
-      vkCreateDescriptorSetLayout(*device_, &descriptor_set_layout_info,
-                                  nullptr, &texture_descriptor_set_layout_);
-  if (status != VK_SUCCESS) {
-    return status;
+  if (!bindless_textures()) {
+    // Descriptor pool used for all of our cached descriptors.
+    VkDescriptorPoolSize pool_sizes[1];
+    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pool_sizes[0].descriptorCount = 32768;
+    descriptor_pool_ = std::make_unique<ui::vulkan::DescriptorPool>(
+        *device_, 32768,
+        std::vector<VkDescriptorPoolSize>(pool_sizes, std::end(pool_sizes)));
+
+    // Create the descriptor set layout used for rendering.
+    // We always have the same number of samplers but only some are used.
+    // The shaders will alias the bindings to the 4 dimensional types.
+    VkDescriptorSetLayoutBinding bindings[1];
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].descriptorCount = kMaxTextureSamplers;
+    bindings[0].stageFlags =
+        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    bindings[0].pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutCreateInfo descriptor_set_layout_info;
+    descriptor_set_layout_info.sType =
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptor_set_layout_info.pNext = nullptr;
+    descriptor_set_layout_info.flags = 0;
+    descriptor_set_layout_info.bindingCount =
+        static_cast<uint32_t>(xe::countof(bindings));
+    descriptor_set_layout_info.pBindings = bindings;
+    status =
+        vkCreateDescriptorSetLayout(*device_, &descriptor_set_layout_info,
+                                    nullptr, &texture_descriptor_set_layout_);
+    if (status != VK_SUCCESS) {
+      return status;
+    }
   }
 
   status = staging_buffer_.Initialize();
@@ -126,6 +149,14 @@ VkResult TextureCache::Initialize() {
     return status;
   }
 
+  if (cvars::vulkan_untile_textures_on_gpu) {
+    status = InitializeUntilePipelines();
+    if (status != VK_SUCCESS) {
+      XELOGE("Failed to create the texture untiling pipelines");
+      ShutdownUntilePipelines();
+    }
+  }
+
   status = wb_staging_buffer_.Initialize();
   if (status != VK_SUCCESS) {
     return status;
@@ -158,6 +189,256 @@ VkResult TextureCache::Initialize() {
   return VK_SUCCESS;
 }
 
+VkResult TextureCache::InitializeBindless() {
+  VkResult status;
+
+  // The whole array is written lazily, and descriptors not used by pending
+  // submissions are updated while the set is bound.
+  VkDescriptorSetLayoutBinding binding;
+  binding.binding = 0;
+  binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  binding.descriptorCount = kSpirvBindlessTextureCount;
+  binding.stageFlags =
+      VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+  binding.pImmutableSamplers = nullptr;
+  VkDescriptorBindingFlagsEXT binding_flags =
+      VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT |
+      VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT |
+      VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT;
+  VkDescriptorSetLayoutBindingFlagsCreateInfoEXT binding_flags_info;
+  binding_flags_info.sType =
+      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+  binding_flags_info.pNext = nullptr;
+  binding_flags_info.bindingCount = 1;
+  binding_flags_info.pBindingFlags = &binding_flags;
+  VkDescriptorSetLayoutCreateInfo descriptor_set_layout_info;
+  descriptor_set_layout_info.sType =
+      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  descriptor_set_layout_info.pNext = &binding_flags_info;
+  descriptor_set_layout_info.flags =
+      VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+  descriptor_set_layout_info.bindingCount = 1;
+  descriptor_set_layout_info.pBindings = &binding;
+  status =
+      vkCreateDescriptorSetLayout(*device_, &descriptor_set_layout_info,
+                                  nullptr, &texture_descriptor_set_layout_);
+  if (status != VK_SUCCESS) {
+    return status;
+  }
+
+  VkDescriptorPoolSize pool_size;
+  pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  pool_size.descriptorCount = kSpirvBindlessTextureCount;
+  VkDescriptorPoolCreateInfo pool_info;
+  pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  pool_info.pNext = nullptr;
+  pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+  pool_info.maxSets = 1;
+  pool_info.poolSizeCount = 1;
+  pool_info.pPoolSizes = &pool_size;
+  status = vkCreateDescriptorPool(*device_, &pool_info, nullptr,
+                                  &bindless_descriptor_pool_);
+  if (status != VK_SUCCESS) {
+    return status;
+  }
+
+  VkDescriptorSetAllocateInfo set_info;
+  set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  set_info.pNext = nullptr;
+  set_info.descriptorPool = bindless_descriptor_pool_;
+  set_info.descriptorSetCount = 1;
+  set_info.pSetLayouts = &texture_descriptor_set_layout_;
+  status =
+      vkAllocateDescriptorSets(*device_, &set_info, &bindless_descriptor_set_);
+  if (status != VK_SUCCESS) {
+    bindless_descriptor_set_ = nullptr;
+    return status;
+  }
+
+  // Allocated from the lowest index.
+  bindless_descriptors_free_.reserve(kSpirvBindlessTextureCount);
+  for (uint32_t i = kSpirvBindlessTextureCount; i > 0; --i) {
+    bindless_descriptors_free_.push_back(i - 1);
+  }
+  XELOGI("Using bindless textures with {} descriptors",
+         kSpirvBindlessTextureCount);
+  return VK_SUCCESS;
+}
+
+VkResult TextureCache::InitializeUntilePipelines() {
+  VkResult status;
+
+  VkDescriptorSetLayoutBinding binding;
+  binding.binding = 0;
+  binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  binding.descriptorCount = 1;
+  binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  binding.pImmutableSamplers = nullptr;
+  VkDescriptorSetLayoutCreateInfo descriptor_set_layout_info;
+  descriptor_set_layout_info.sType =
+      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  descriptor_set_layout_info.pNext = nullptr;
+  descriptor_set_layout_info.flags = 0;
+  descriptor_set_layout_info.bindingCount = 1;
+  descriptor_set_layout_info.pBindings = &binding;
+  status =
+      vkCreateDescriptorSetLayout(*device_, &descriptor_set_layout_info,
+                                  nullptr, &untile_descriptor_set_layout_);
+  if (status != VK_SUCCESS) {
+    return status;
+  }
+
+  VkPushConstantRange push_constant_range;
+  push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  push_constant_range.offset = 0;
+  push_constant_range.size = sizeof(TextureUntileConstants);
+  VkPipelineLayoutCreateInfo pipeline_layout_info;
+  pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipeline_layout_info.pNext = nullptr;
+  pipeline_layout_info.flags = 0;
+  pipeline_layout_info.setLayoutCount = 1;
+  pipeline_layout_info.pSetLayouts = &untile_descriptor_set_layout_;
+  pipeline_layout_info.pushConstantRangeCount = 1;
+  pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+  status = vkCreatePipelineLayout(*device_, &pipeline_layout_info, nullptr,
+                                  &untile_pipeline_layout_);
+  if (status != VK_SUCCESS) {
+    return status;
+  }
+
+  for (uint32_t i = 0; i < xe::countof(untile_pipelines_); ++i) {
+    std::vector<uint32_t> spirv = BuildTextureUntileShader(i + 2);
+    VkShaderModuleCreateInfo shader_module_info;
+    shader_module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shader_module_info.pNext = nullptr;
+    shader_module_info.flags = 0;
+    shader_module_info.codeSize = spirv.size() * sizeof(uint32_t);
+    shader_module_info.pCode = spirv.data();
+    VkShaderModule shader_module;
+    status = vkCreateShaderModule(*device_, &shader_module_info, nullptr,
+                                  &shader_module);
+    if (status != VK_SUCCESS) {
+      return status;
+    }
+    VkComputePipelineCreateInfo pipeline_info;
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.pNext = nullptr;
+    pipeline_info.flags = 0;
+    pipeline_info.stage.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.pNext = nullptr;
+    pipeline_info.stage.flags = 0;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = shader_module;
+    pipeline_info.stage.pName = "main";
+    pipeline_info.stage.pSpecializationInfo = nullptr;
+    pipeline_info.layout = untile_pipeline_layout_;
+    pipeline_info.basePipelineHandle = nullptr;
+    pipeline_info.basePipelineIndex = -1;
+    status = vkCreateComputePipelines(*device_, nullptr, 1, &pipeline_info,
+                                      nullptr, &untile_pipelines_[i]);
+    vkDestroyShaderModule(*device_, shader_module, nullptr);
+    if (status != VK_SUCCESS) {
+      untile_pipelines_[i] = nullptr;
+      return status;
+    }
+  }
+
+  VkDescriptorPoolSize pool_size;
+  pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  pool_size.descriptorCount = 1;
+  VkDescriptorPoolCreateInfo pool_info;
+  pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  pool_info.pNext = nullptr;
+  pool_info.flags = 0;
+  pool_info.maxSets = 1;
+  pool_info.poolSizeCount = 1;
+  pool_info.pPoolSizes = &pool_size;
+  status = vkCreateDescriptorPool(*device_, &pool_info, nullptr,
+                                  &untile_descriptor_pool_);
+  if (status != VK_SUCCESS) {
+    return status;
+  }
+  VkDescriptorSetAllocateInfo set_info;
+  set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  set_info.pNext = nullptr;
+  set_info.descriptorPool = untile_descriptor_pool_;
+  set_info.descriptorSetCount = 1;
+  set_info.pSetLayouts = &untile_descriptor_set_layout_;
+  status =
+      vkAllocateDescriptorSets(*device_, &set_info, &untile_descriptor_set_);
+  if (status != VK_SUCCESS) {
+    untile_descriptor_set_ = nullptr;
+    return status;
+  }
+  VkDescriptorBufferInfo buffer_info;
+  buffer_info.buffer = staging_buffer_.gpu_buffer();
+  buffer_info.offset = 0;
+  buffer_info.range = VK_WHOLE_SIZE;
+  VkWriteDescriptorSet write;
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.pNext = nullptr;
+  write.dstSet = untile_descriptor_set_;
+  write.dstBinding = 0;
+  write.dstArrayElement = 0;
+  write.descriptorCount = 1;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  write.pImageInfo = nullptr;
+  write.pBufferInfo = &buffer_info;
+  write.pTexelBufferView = nullptr;
+  vkUpdateDescriptorSets(*device_, 1, &write, 0, nullptr);
+
+  return VK_SUCCESS;
+}
+
+void TextureCache::ShutdownUntilePipelines() {
+  untile_descriptor_set_ = nullptr;
+  if (untile_descriptor_pool_) {
+    vkDestroyDescriptorPool(*device_, untile_descriptor_pool_, nullptr);
+    untile_descriptor_pool_ = nullptr;
+  }
+  for (uint32_t i = 0; i < xe::countof(untile_pipelines_); ++i) {
+    if (untile_pipelines_[i]) {
+      vkDestroyPipeline(*device_, untile_pipelines_[i], nullptr);
+      untile_pipelines_[i] = nullptr;
+    }
+  }
+  if (untile_pipeline_layout_) {
+    vkDestroyPipelineLayout(*device_, untile_pipeline_layout_, nullptr);
+    untile_pipeline_layout_ = nullptr;
+  }
+  if (untile_descriptor_set_layout_) {
+    vkDestroyDescriptorSetLayout(*device_, untile_descriptor_set_layout_,
+                                 nullptr);
+    untile_descriptor_set_layout_ = nullptr;
+  }
+}
+
+bool TextureCache::CanUntileOnGpu(const TextureInfo& src) const {
+  if (!untile_descriptor_set_ || !src.is_tiled || cvars::texture_dump) {
+    return false;
+  }
+  // Formats with a copy block callback other than CopySwapBlock are converted.
+  if (src.format == xenos::TextureFormat::k_CTX1 ||
+      src.format == xenos::TextureFormat::k_DXT3A) {
+    return false;
+  }
+  uint32_t bytes_per_block = src.format_info()->bytes_per_block();
+  if (GetFormatInfo(src.format)->bytes_per_block() != bytes_per_block) {
+    return false;
+  }
+  return bytes_per_block == 4 || bytes_per_block == 8 ||
+         bytes_per_block == 16;
+}
+
+uint32_t TextureCache::ComputeTiledMipLength(const TextureInfo& src,
+                                             uint32_t mip) {
+  auto src_extent = src.GetMipExtent(mip, true);
+  auto dst_extent = GetMipExtent(src, mip);
+  return src_extent.block_pitch_h * src_extent.block_pitch_v *
+         src.format_info()->bytes_per_block() * dst_extent.depth;
+}
+
 void TextureCache::Shutdown() {
   if (memory_invalidation_callback_handle_ != nullptr) {
     memory_->UnregisterPhysicalMemoryInvalidationCallback(
@@ -173,21 +454,35 @@ void TextureCache::Shutdown() {
   ClearCache();
   Scavenge();
 
+  ShutdownUntilePipelines();
+
   if (mem_allocator_ != nullptr) {
     vmaDestroyAllocator(mem_allocator_);
     mem_allocator_ = nullptr;
   }
+  bindless_descriptors_retired_.clear();
+  bindless_descriptors_free_.clear();
+  bindless_descriptor_set_ = nullptr;
+  if (bindless_descriptor_pool_) {
+    vkDestroyDescriptorPool(*device_, bindless_descriptor_pool_, nullptr);
+    bindless_descriptor_pool_ = nullptr;
+  }
   vkDestroyDescriptorSetLayout(*device_, texture_descriptor_set_layout_,
                                nullptr);
 }
 
 TextureCache::Texture* TextureCache::AllocateTexture(
-    const TextureInfo& texture_info, VkFormatFeatureFlags required_flags) {
+    const TextureInfo& texture_info, VkFormatFeatureFlags required_flags,
+    uint32_t resolution_scale) {
   auto format_info = texture_info.format_info();
   assert_not_null(format_info);
 
   auto& config = texture_configs[int(format_info->format)];
   VkFormat format = config.host_format;
+  if (format_info->format == xenos::TextureFormat::k_CTX1 &&
+      cvars::vulkan_ctx1_as_bc5) {
+    format = VK_FORMAT_BC5_UNORM_BLOCK;
+  }
   if (format == VK_FORMAT_UNDEFINED) {
     XELOGE(
         "Texture Cache: Attempted to allocate texture format {}, which is "
@@ -264,8 +559,8 @@ TextureCache::Texture* TextureCache::AllocateTexture(
   // TODO(DrChat): Actually check the image properties.
 
   image_info.format = format;
-  image_info.extent.width = texture_info.width + 1;
-  image_info.extent.height = texture_info.height + 1;
+  image_info.extent.width = (texture_info.width + 1) * resolution_scale;
+  image_info.extent.height = (texture_info.height + 1) * resolution_scale;
   image_info.extent.depth = !is_cube ? 1 + texture_info.depth : 1;
   image_info.mipLevels = texture_info.mip_min_level + texture_info.mip_levels();
   image_info.arrayLayers = !is_cube ? 1 : 1 + texture_info.depth;
@@ -302,8 +597,11 @@ TextureCache::Texture* TextureCache::AllocateTexture(
   texture->alloc_info = vma_info;
   texture->framebuffer = nullptr;
   texture->usage_flags = image_info.usage;
+  texture->resolution_scale = resolution_scale;
   texture->is_watched = false;
   texture->texture_info = texture_info;
+  texture->last_usage_frame = current_frame_;
+  texture->last_usage_time = current_usage_time_;
   return texture;
 }
 
@@ -321,6 +619,7 @@ bool TextureCache::FreeTexture(Texture* texture) {
   }
 
   for (auto it = texture->views.begin(); it != texture->views.end();) {
+    ReleaseBindlessDescriptors(it->get());
     vkDestroyImageView(*device_, (*it)->view, nullptr);
     it = texture->views.erase(it);
   }
@@ -345,6 +644,58 @@ bool TextureCache::FreeTexture(Texture* texture) {
   return true;
 }
 
+void TextureCache::MarkTextureUsed(Texture* texture) {
+  // This is called very frequently, don't relink unless needed for caching.
+  if (texture->last_usage_frame == current_frame_ &&
+      (texture->used_previous || texture_used_first_ == texture)) {
+    return;
+  }
+  texture->last_usage_frame = current_frame_;
+  texture->last_usage_time = current_usage_time_;
+  if (texture == texture_used_last_) {
+    return;
+  }
+  UnlinkUsedTexture(texture);
+  texture->used_previous = texture_used_last_;
+  if (texture_used_last_) {
+    texture_used_last_->used_next = texture;
+  } else {
+    texture_used_first_ = texture;
+  }
+  texture_used_last_ = texture;
+}
+
+void TextureCache::UnlinkUsedTexture(Texture* texture) {
+  if (texture->used_previous) {
+    texture->used_previous->used_next = texture->used_next;
+  } else if (texture_used_first_ == texture) {
+    texture_used_first_ = texture->used_next;
+  } else {
+    // Not in the list.
+    return;
+  }
+  if (texture->used_next) {
+    texture->used_next->used_previous = texture->used_previous;
+  } else {
+    texture_used_last_ = texture->used_previous;
+  }
+  texture->used_previous = nullptr;
+  texture->used_next = nullptr;
+}
+
+void TextureCache::QueueTextureFree(Texture* texture) {
+  auto it = textures_.find(texture->texture_info.hash());
+  if (it != textures_.end() && it->second == texture) {
+    textures_.erase(it);
+  }
+  // All the cached textures are in the list, and their size is counted.
+  if (texture->used_previous || texture_used_first_ == texture) {
+    textures_total_size_ -= texture->alloc_info.size;
+    UnlinkUsedTexture(texture);
+  }
+  pending_delete_textures_.push_back({texture, texture->in_flight_fence});
+}
+
 void TextureCache::WatchTexture(Texture* texture) {
   uint32_t address, size;
 
@@ -477,7 +828,7 @@ std::pair<uint32_t, uint32_t> TextureCache::MemoryInvalidationCallbackThunk(
 }
 
 TextureCache::Texture* TextureCache::DemandResolveTexture(
-    const TextureInfo& texture_info) {
+    const TextureInfo& texture_info, uint32_t resolution_scale) {
   auto texture_hash = texture_info.hash();
   for (auto it = textures_.find(texture_hash); it != textures_.end(); ++it) {
     if (it->second->texture_info == texture_info) {
@@ -497,6 +848,7 @@ TextureCache::Texture* TextureCache::DemandResolveTexture(
                                              texture_info.memory.mip_size);
       }
 
+      MarkTextureUsed(it->second);
       return it->second;
     }
   }
@@ -510,7 +862,8 @@ TextureCache::Texture* TextureCache::DemandResolveTexture(
   }
 
   // No texture at this location. Make a new one.
-  auto texture = AllocateTexture(texture_info, required_flags);
+  auto texture =
+      AllocateTexture(texture_info, required_flags, resolution_scale);
   if (!texture) {
     // Failed to allocate texture (out of memory)
     XELOGE("Vulkan Texture Cache: Failed to allocate texture!");
@@ -531,6 +884,8 @@ TextureCache::Texture* TextureCache::DemandResolveTexture(
   WatchTexture(texture);
 
   textures_[texture_hash] = texture;
+  textures_total_size_ += texture->alloc_info.size;
+  MarkTextureUsed(texture);
   COUNT_profile_set("gpu/texture_cache/textures", textures_.size());
   return texture;
 }
@@ -556,6 +911,7 @@ TextureCache::Texture* TextureCache::Demand(const TextureInfo& texture_info,
         trace_writer_->WriteMemoryReadCached(texture_info.memory.mip_address,
                                              texture_info.memory.mip_size);
       }
+      MarkTextureUsed(it->second);
       return it->second;
     }
   }
@@ -611,6 +967,8 @@ TextureCache::Texture* TextureCache::Demand(const TextureInfo& texture_info,
           get_dimension_name(texture_info.dimension)));
 
   textures_[texture_hash] = texture;
+  textures_total_size_ += texture->alloc_info.size;
+  MarkTextureUsed(texture);
   COUNT_profile_set("gpu/texture_cache/textures", textures_.size());
 
   // Okay. Put a writewatch on it to tell us if it's been modified from the
@@ -982,7 +1340,8 @@ void TextureCache::FlushPendingCommands(VkCommandBuffer command_buffer,
 }
 
 bool TextureCache::ConvertTexture(uint8_t* dest, VkBufferImageCopy* copy_region,
-                                  uint32_t mip, const TextureInfo& src) {
+                                  uint32_t mip, const TextureInfo& src,
+                                  GpuUntile* gpu_untile) {
 #if FINE_GRAINED_DRAW_SCOPES
   SCOPE_profile_cpu_f("gpu");
 #endif  // FINE_GRAINED_DRAW_SCOPES
@@ -1018,9 +1377,27 @@ bool TextureCache::ConvertTexture(uint8_t* dest, VkBufferImageCopy* copy_region,
       src_mem += src_pitch * src_extent.block_pitch_v;
       dest += dst_pitch * dst_extent.block_pitch_v;
     }
+  } else if (gpu_untile) {
+    // Untiled in a compute shader after the raw data is copied.
+    gpu_untile->source = src_mem;
+    gpu_untile->source_length = ComputeTiledMipLength(src, mip);
+    gpu_untile->face_count = dst_extent.depth;
+    TextureUntileConstants& constants = gpu_untile->constants;
+    constants.source_offset = 0;
+    constants.source_face_stride =
+        src_pitch * src_extent.block_pitch_v / sizeof(uint32_t);
+    constants.dest_offset = 0;
+    constants.dest_face_stride =
+        dst_pitch * dst_extent.block_pitch_v / sizeof(uint32_t);
+    constants.dest_pitch = dst_extent.block_pitch_h;
+    constants.source_pitch = src_extent.block_pitch_h;
+    constants.offset_x = offset_x;
+    constants.offset_y = offset_y;
+    constants.width = src_extent.block_width;
+    constants.height = src_extent.block_height;
+    constants.endianness = uint32_t(src.endianness);
   } else {
     // Untile image.
-    // We could do this in a shader to speed things up, as this is pretty slow.
     for (uint32_t face = 0; face < dst_extent.depth; face++) {
       texture_conversion::UntileInfo untile_info;
       std::memset(&untile_info, 0, sizeof(untile_info));
@@ -1032,9 +1409,17 @@ bool TextureCache::ConvertTexture(uint8_t* dest, VkBufferImageCopy* copy_region,
       untile_info.output_pitch = dst_extent.block_pitch_h;
       untile_info.input_format_info = src.format_info();
       untile_info.output_format_info = GetFormatInfo(src.format);
-      untile_info.copy_callback = [=](auto o, auto i, auto l) {
-        copy_block(src.endianness, o, i, l);
-      };
+      if (src.format == xenos::TextureFormat::k_CTX1 ||
+          src.format == xenos::TextureFormat::k_DXT3A ||
+          untile_info.input_format_info->bytes_per_block() !=
+              untile_info.output_format_info->bytes_per_block()) {
+        untile_info.copy_callback = [=](auto o, auto i, auto l) {
+          copy_block(src.endianness, o, i, l);
+        };
+      } else {
+        untile_info.copy_callback = nullptr;
+        untile_info.endian = src.endianness;
+      }
       texture_conversion::Untile(dest, src_mem, &untile_info);
       src_mem += src_pitch * src_extent.block_pitch_v;
       dest += dst_pitch * dst_extent.block_pitch_v;
@@ -1082,25 +1467,35 @@ bool TextureCache::UploadTexture(VkCommandBuffer command_buffer,
     return false;
   }
 
-  if (!staging_buffer_.CanAcquire(unpack_length)) {
+  // The raw tiled data is placed after the untiled data if untiling on the
+  // GPU.
+  bool untile_on_gpu = CanUntileOnGpu(src);
+  size_t staging_length = unpack_length;
+  if (untile_on_gpu) {
+    for (uint32_t mip = src.mip_min_level; mip <= src.mip_max_level; mip++) {
+      staging_length += xe::align(ComputeTiledMipLength(src, mip), 4u);
+    }
+  }
+
+  if (!staging_buffer_.CanAcquire(staging_length)) {
     // Need to have unique memory for every upload for at least one frame. If we
     // run out of memory, we need to flush all queued upload commands to the
     // GPU.
     FlushPendingCommands(command_buffer, completion_fence);
 
     // Uploads have been flushed. Continue.
-    if (!staging_buffer_.CanAcquire(unpack_length)) {
+    if (!staging_buffer_.CanAcquire(staging_length)) {
       // The staging buffer isn't big enough to hold this texture.
       XELOGE(
           "TextureCache staging buffer is too small! (uploading 0x{:X} bytes)",
-          unpack_length);
+          staging_length);
       assert_always();
       return false;
     }
   }
 
   // Grab some temporary memory for staging.
-  auto alloc = staging_buffer_.Acquire(unpack_length, completion_fence);
+  auto alloc = staging_buffer_.Acquire(staging_length, completion_fence);
   assert_not_null(alloc);
   if (!alloc) {
     XELOGE("{}: Failed to acquire staging memory!", __func__);
@@ -1122,22 +1517,34 @@ bool TextureCache::UploadTexture(VkCommandBuffer command_buffer,
   }
 
   // Upload texture into GPU memory.
-  // TODO: If the GPU supports it, we can submit a compute batch to convert the
-  // texture and copy it to its destination. Otherwise, fallback to conversion
-  // on the CPU.
+  // Tiled textures without format conversion are copied as is and untiled by
+  // a compute shader, others are converted on the CPU.
   uint32_t copy_region_count = src.mip_levels();
   std::vector<VkBufferImageCopy> copy_regions(copy_region_count);
+  std::vector<GpuUntile> gpu_untiles;
 
   // Upload all mips.
   auto unpack_buffer = reinterpret_cast<uint8_t*>(alloc->host_ptr);
   VkDeviceSize unpack_offset = 0;
+  VkDeviceSize tiled_offset = unpack_length;
   for (uint32_t mip = src.mip_min_level, region = 0; mip <= src.mip_max_level;
        mip++, region++) {
+    GpuUntile gpu_untile;
     if (!ConvertTexture(&unpack_buffer[unpack_offset], &copy_regions[region],
-                        mip, src)) {
+                        mip, src, untile_on_gpu ? &gpu_untile : nullptr)) {
       XELOGW("Failed to convert texture mip {}!", mip);
       return false;
     }
+    if (untile_on_gpu) {
+      std::memcpy(&unpack_buffer[tiled_offset], gpu_untile.source,
+                  gpu_untile.source_length);
+      gpu_untile.constants.source_offset =
+          uint32_t((alloc->offset + tiled_offset) / sizeof(uint32_t));
+      gpu_untile.constants.dest_offset =
+          uint32_t((alloc->offset + unpack_offset) / sizeof(uint32_t));
+      gpu_untiles.push_back(gpu_untile);
+      tiled_offset += xe::align(gpu_untile.source_length, 4u);
+    }
     copy_regions[region].bufferOffset = alloc->offset + unpack_offset;
     copy_regions[region].imageOffset = {0, 0, 0};
 
@@ -1155,6 +1562,44 @@ bool TextureCache::UploadTexture(VkCommandBuffer command_buffer,
     TextureDump(src, unpack_buffer, unpack_length);
   }
 
+  if (!gpu_untiles.empty()) {
+    uint32_t bytes_per_block = src.format_info()->bytes_per_block();
+    uint32_t bytes_per_block_log2 = bytes_per_block >= 16  ? 4
+                                    : bytes_per_block >= 8 ? 3
+                                                           : 2;
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      untile_pipelines_[bytes_per_block_log2 - 2]);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            untile_pipeline_layout_, 0, 1,
+                            &untile_descriptor_set_, 0, nullptr);
+    for (const GpuUntile& gpu_untile : gpu_untiles) {
+      vkCmdPushConstants(command_buffer, untile_pipeline_layout_,
+                         VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                         sizeof(gpu_untile.constants), &gpu_untile.constants);
+      uint32_t group_size_mask = (1 << kTextureUntileGroupSizeLog2) - 1;
+      vkCmdDispatch(
+          command_buffer,
+          (gpu_untile.constants.width + group_size_mask) >>
+              kTextureUntileGroupSizeLog2,
+          (gpu_untile.constants.height + group_size_mask) >>
+              kTextureUntileGroupSizeLog2,
+          gpu_untile.face_count);
+    }
+    VkBufferMemoryBarrier untile_barrier;
+    untile_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    untile_barrier.pNext = nullptr;
+    untile_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    untile_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    untile_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    untile_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    untile_barrier.buffer = staging_buffer_.gpu_buffer();
+    untile_barrier.offset = alloc->offset;
+    untile_barrier.size = unpack_length;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1,
+                         &untile_barrier, 0, nullptr);
+  }
+
   // Transition the texture into a transfer destination layout.
   VkImageMemoryBarrier barrier;
   barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -1210,13 +1655,17 @@ bool TextureCache::UploadTexture(VkCommandBuffer command_buffer,
                        0, 0, nullptr, 0, nullptr, 1, &barrier);
 
   dest->image_layout = barrier.newLayout;
+  benchmark_counters_->CountTextureUpload(unpack_length);
   return true;
 }
 
 const FormatInfo* TextureCache::GetFormatInfo(xenos::TextureFormat format) {
   switch (format) {
     case xenos::TextureFormat::k_CTX1:
-      return FormatInfo::Get(xenos::TextureFormat::k_8_8);
+      // BC5 has the same block size as DXN.
+      return FormatInfo::Get(cvars::vulkan_ctx1_as_bc5
+                                 ? xenos::TextureFormat::k_DXN
+                                 : xenos::TextureFormat::k_8_8);
     case xenos::TextureFormat::k_DXT3A:
       return FormatInfo::Get(xenos::TextureFormat::k_DXT2_3);
     default:
@@ -1228,7 +1677,9 @@ texture_conversion::CopyBlockCallback TextureCache::GetFormatCopyBlock(
     xenos::TextureFormat format) {
   switch (format) {
     case xenos::TextureFormat::k_CTX1:
-      return texture_conversion::ConvertTexelCTX1ToR8G8;
+      return cvars::vulkan_ctx1_as_bc5
+                 ? texture_conversion::ConvertTexelCTX1ToBC5
+                 : texture_conversion::ConvertTexelCTX1ToR8G8;
     case xenos::TextureFormat::k_DXT3A:
       return texture_conversion::ConvertTexelDXT3AToDXT3;
     default:
@@ -1487,6 +1938,48 @@ bool TextureCache::SetupTextureBinding(VkCommandBuffer command_buffer,
   SCOPE_profile_cpu_f("gpu");
 #endif  // FINE_GRAINED_DRAW_SCOPES
 
+  Texture* texture;
+  TextureView* view;
+  Sampler* sampler;
+  if (!DemandTextureBinding(command_buffer, completion_fence, binding,
+                            &texture, &view, &sampler)) {
+    return false;
+  }
+
+  auto image_info =
+      &update_set_info->image_infos[update_set_info->image_write_count];
+  auto image_write =
+      &update_set_info->image_writes[update_set_info->image_write_count];
+  update_set_info->image_write_count++;
+
+  // Sanity check, we only have 32 binding slots.
+  assert(binding.binding_index < 32);
+
+  image_write->sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  image_write->pNext = nullptr;
+  // image_write->dstSet is set later...
+  image_write->dstBinding = 0;
+  image_write->dstArrayElement = uint32_t(binding.binding_index);
+  image_write->descriptorCount = 1;
+  image_write->descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  image_write->pImageInfo = image_info;
+  image_write->pBufferInfo = nullptr;
+  image_write->pTexelBufferView = nullptr;
+
+  image_info->imageView = view->view;
+  image_info->imageLayout = texture->image_layout;
+  image_info->sampler = sampler->sampler;
+  texture->in_flight_fence = completion_fence;
+
+  return true;
+}
+
+bool TextureCache::DemandTextureBinding(VkCommandBuffer command_buffer,
+                                        VkFence completion_fence,
+                                        const Shader::TextureBinding& binding,
+                                        Texture** texture_out,
+                                        TextureView** view_out,
+                                        Sampler** sampler_out) {
   auto& regs = *register_file_;
   int r = XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0 + binding.fetch_constant * 6;
   auto group =
@@ -1544,33 +2037,126 @@ bool TextureCache::SetupTextureBinding(VkCommandBuffer command_buffer,
 
   uint16_t swizzle = static_cast<uint16_t>(fetch.swizzle);
   auto view = DemandView(texture, swizzle);
+  if (view == nullptr) {
+    return false;
+  }
 
-  auto image_info =
-      &update_set_info->image_infos[update_set_info->image_write_count];
-  auto image_write =
-      &update_set_info->image_writes[update_set_info->image_write_count];
-  update_set_info->image_write_count++;
+  *texture_out = texture;
+  *view_out = view;
+  *sampler_out = sampler;
+  return true;
+}
 
-  // Sanity check, we only have 32 binding slots.
-  assert(binding.binding_index < 32);
+void TextureCache::PrepareBindlessTextures(
+    VkCommandBuffer command_buffer, VkFence completion_fence,
+    const std::vector<Shader::TextureBinding>& vertex_bindings,
+    const std::vector<Shader::TextureBinding>& pixel_bindings,
+    uint32_t* texture_indices_out) {
+  assert_true(bindless_textures());
+  std::memset(texture_indices_out, 0, sizeof(uint32_t) * 32);
+  uint32_t fetch_mask = 0;
+  bool any_failed = false;
+  for (const std::vector<Shader::TextureBinding>* bindings :
+       {&vertex_bindings, &pixel_bindings}) {
+    for (const Shader::TextureBinding& binding : *bindings) {
+      uint32_t fetch_bit = 1 << binding.fetch_constant;
+      if (fetch_mask & fetch_bit) {
+        continue;
+      }
+      fetch_mask |= fetch_bit;
+      Texture* texture;
+      TextureView* view;
+      Sampler* sampler;
+      if (!DemandTextureBinding(command_buffer, completion_fence, binding,
+                                &texture, &view, &sampler)) {
+        any_failed = true;
+        continue;
+      }
+      uint32_t descriptor_index = RequestBindlessDescriptor(view, sampler);
+      if (descriptor_index == UINT32_MAX) {
+        any_failed = true;
+        continue;
+      }
+      texture_indices_out[binding.fetch_constant] = descriptor_index;
+      texture->in_flight_fence = completion_fence;
+    }
+  }
+  if (any_failed) {
+    XELOGW("Failed to setup one or more texture bindings!");
+  }
+}
 
-  image_write->sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-  image_write->pNext = nullptr;
-  // image_write->dstSet is set later...
-  image_write->dstBinding = 0;
-  image_write->dstArrayElement = uint32_t(binding.binding_index);
-  image_write->descriptorCount = 1;
-  image_write->descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-  image_write->pImageInfo = image_info;
-  image_write->pBufferInfo = nullptr;
-  image_write->pTexelBufferView = nullptr;
+uint32_t TextureCache::RequestBindlessDescriptor(TextureView* view,
+                                                 Sampler* sampler) {
+  Texture* texture = view->texture;
+  auto& descriptors = view->bindless_descriptors;
+  for (auto it = descriptors.begin(); it != descriptors.end(); ++it) {
+    if (it->sampler != sampler->sampler) {
+      continue;
+    }
+    if (it->image_layout == texture->image_layout) {
+      return it->index;
+    }
+    // The layout has changed since the descriptor was written, but it may
+    // still be in use by the last submission that referenced the texture.
+    bindless_descriptors_retired_.push_back(
+        {it->index, texture->in_flight_fence});
+    descriptors.erase(it);
+    break;
+  }
+
+  if (bindless_descriptors_free_.empty()) {
+    ReclaimRetiredBindlessDescriptors();
+    if (bindless_descriptors_free_.empty()) {
+      XELOGE("Out of bindless texture descriptors");
+      return UINT32_MAX;
+    }
+  }
+  uint32_t index = bindless_descriptors_free_.back();
+  bindless_descriptors_free_.pop_back();
+
+  VkDescriptorImageInfo image_info;
+  image_info.sampler = sampler->sampler;
+  image_info.imageView = view->view;
+  image_info.imageLayout = texture->image_layout;
+  VkWriteDescriptorSet write;
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.pNext = nullptr;
+  write.dstSet = bindless_descriptor_set_;
+  write.dstBinding = 0;
+  write.dstArrayElement = index;
+  write.descriptorCount = 1;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  write.pImageInfo = &image_info;
+  write.pBufferInfo = nullptr;
+  write.pTexelBufferView = nullptr;
+  vkUpdateDescriptorSets(*device_, 1, &write, 0, nullptr);
+
+  descriptors.push_back({sampler->sampler, texture->image_layout, index});
+  return index;
+}
 
-  image_info->imageView = view->view;
-  image_info->imageLayout = texture->image_layout;
-  image_info->sampler = sampler->sampler;
-  texture->in_flight_fence = completion_fence;
+void TextureCache::ReleaseBindlessDescriptors(TextureView* view) {
+  // Only called when the texture is not in use by the GPU anymore.
+  for (const auto& descriptor : view->bindless_descriptors) {
+    bindless_descriptors_free_.push_back(descriptor.index);
+  }
+  view->bindless_descriptors.clear();
+}
 
-  return true;
+void TextureCache::ReclaimRetiredBindlessDescriptors() {
+  for (auto it = bindless_descriptors_retired_.begin();
+       it != bindless_descriptors_retired_.end();) {
+    if (it->fence) {
+      VkResult status = vkGetFenceStatus(*device_, it->fence);
+      if (status != VK_SUCCESS && status != VK_ERROR_DEVICE_LOST) {
+        ++it;
+        continue;
+      }
+    }
+    bindless_descriptors_free_.push_back(it->index);
+    it = bindless_descriptors_retired_.erase(it);
+  }
 }
 
 void TextureCache::RemoveInvalidatedTextures() {
@@ -1591,8 +2177,7 @@ void TextureCache::RemoveInvalidatedTextures() {
   if (!invalidated_textures.empty()) {
     for (auto it = invalidated_textures.begin();
          it != invalidated_textures.end(); ++it) {
-      pending_delete_textures_.push_back(*it);
-      textures_.erase((*it)->texture_info.hash());
+      QueueTextureFree(*it);
     }
 
     COUNT_profile_set("gpu/texture_cache/textures", textures_.size());
@@ -1611,8 +2196,20 @@ void TextureCache::ClearCache() {
     }
   }
   textures_.clear();
+  texture_used_first_ = nullptr;
+  texture_used_last_ = nullptr;
+  textures_total_size_ = 0;
   COUNT_profile_set("gpu/texture_cache/textures", 0);
 
+  for (const PendingFreeTexture& pending_free : pending_delete_textures_) {
+    while (!FreeTexture(pending_free.texture)) {
+      // Texture still in use. Busy loop.
+      xe::threading::MaybeYield();
+    }
+  }
+  pending_delete_textures_.clear();
+  COUNT_profile_set("gpu/texture_cache/pending_deletes", 0);
+
   for (auto it = samplers_.begin(); it != samplers_.end(); ++it) {
     vkDestroySampler(*device_, it->second->sampler, nullptr);
     delete it->second;
@@ -1623,33 +2220,99 @@ void TextureCache::ClearCache() {
 void TextureCache::Scavenge() {
   SCOPE_profile_cpu_f("gpu");
 
-  // Close any open descriptor pool batches
-  if (descriptor_pool_->has_open_batch()) {
-    descriptor_pool_->EndBatch();
-  }
+  if (descriptor_pool_) {
+    // Close any open descriptor pool batches
+    if (descriptor_pool_->has_open_batch()) {
+      descriptor_pool_->EndBatch();
+    }
 
-  // Free unused descriptor sets
-  // TODO(DrChat): These sets could persist across frames, we just need a smart
-  // way to detect if they're unused and free them.
-  texture_sets_.clear();
-  descriptor_pool_->Scavenge();
+    // Free unused descriptor sets
+    // TODO(DrChat): These sets could persist across frames, we just need a
+    // smart way to detect if they're unused and free them.
+    texture_sets_.clear();
+    descriptor_pool_->Scavenge();
+  }
+  ReclaimRetiredBindlessDescriptors();
   staging_buffer_.Scavenge();
 
-  // Kill all pending delete textures.
   RemoveInvalidatedTextures();
-  if (!pending_delete_textures_.empty()) {
-    for (auto it = pending_delete_textures_.begin();
-         it != pending_delete_textures_.end();) {
-      if (!FreeTexture(*it)) {
-        break;
-      }
 
-      it = pending_delete_textures_.erase(it);
+  // Destroying textures may take a long time when many are invalidated at
+  // once, so only as many as fit in the time budget are destroyed per frame.
+  uint64_t budget_ticks =
+      cvars::vulkan_texture_scavenge_budget_us > 0
+          ? uint64_t(cvars::vulkan_texture_scavenge_budget_us) *
+                xe::Clock::QueryHostTickFrequency() / 1000000
+          : UINT64_MAX;
+  uint64_t start_ticks = xe::Clock::QueryHostTickCount();
+  auto budget_exceeded = [&]() {
+    return budget_ticks != UINT64_MAX &&
+           xe::Clock::QueryHostTickCount() - start_ticks >= budget_ticks;
+  };
+
+  // Queue the textures that haven't been used for a long time for destruction
+  // if using too much memory. Textures that have been resolved to (that have a
+  // framebuffer) are kept as their contents may not be in the guest memory.
+  current_usage_time_ = xe::Clock::QueryHostUptimeMillis();
+  VkDeviceSize limit_soft =
+      VkDeviceSize(std::max(cvars::vulkan_texture_cache_limit_soft, 0)) << 20;
+  uint64_t lifetime_ms =
+      uint64_t(std::max(cvars::vulkan_texture_cache_limit_soft_lifetime, 0)) *
+      1000;
+  if (limit_soft) {
+    Texture* texture = texture_used_first_;
+    while (texture && textures_total_size_ > limit_soft &&
+           texture->last_usage_frame < current_frame_ &&
+           texture->last_usage_time + lifetime_ms <= current_usage_time_ &&
+           !budget_exceeded()) {
+      Texture* texture_next = texture->used_next;
+      if (!texture->framebuffer) {
+        auto global_lock = global_critical_region_.Acquire();
+        // Invalidated textures are queued by RemoveInvalidatedTextures.
+        if (!texture->pending_invalidation) {
+          if (texture->is_watched) {
+            for (auto it = watched_textures_.begin();
+                 it != watched_textures_.end(); ++it) {
+              if (it->texture == texture) {
+                watched_textures_.erase(it);
+                break;
+              }
+            }
+            texture->is_watched = false;
+          }
+          texture->pending_invalidation = true;
+          QueueTextureFree(texture);
+        }
+      }
+      texture = texture_next;
     }
+    COUNT_profile_set("gpu/texture_cache/textures", textures_.size());
+  }
 
-    COUNT_profile_set("gpu/texture_cache/pending_deletes",
-                      pending_delete_textures_.size());
+  // Destroy the textures whose last usage has been completed, in the order
+  // they were removed from the cache, checking each fence only once.
+  VkFence signaled_fence = nullptr;
+  while (!pending_delete_textures_.empty()) {
+    const PendingFreeTexture& pending_free = pending_delete_textures_.front();
+    if (pending_free.fence && pending_free.fence != signaled_fence) {
+      VkResult status = vkGetFenceStatus(*device_, pending_free.fence);
+      if (status != VK_SUCCESS && status != VK_ERROR_DEVICE_LOST) {
+        break;
+      }
+      signaled_fence = pending_free.fence;
+    }
+    if (!FreeTexture(pending_free.texture)) {
+      break;
+    }
+    pending_delete_textures_.pop_front();
+    if (budget_exceeded()) {
+      break;
+    }
   }
+  COUNT_profile_set("gpu/texture_cache/pending_deletes",
+                    pending_delete_textures_.size());
+
+  ++current_frame_;
 }
 
 }  // namespace vulkan
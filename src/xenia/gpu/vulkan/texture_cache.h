@@ -11,17 +11,20 @@
 #define XENIA_GPU_VULKAN_TEXTURE_CACHE_H_
 
 #include <algorithm>
+#include <deque>
 #include <list>
 #include <unordered_map>
 #include <unordered_set>
 
 #include "xenia/base/mutex.h"
+#include "xenia/gpu/benchmark_counters.h"
 #include "xenia/gpu/register_file.h"
 #include "xenia/gpu/sampler_info.h"
 #include "xenia/gpu/shader.h"
 #include "xenia/gpu/texture_conversion.h"
 #include "xenia/gpu/texture_info.h"
 #include "xenia/gpu/trace_writer.h"
+#include "xenia/gpu/vulkan/texture_untile_shader.h"
 #include "xenia/gpu/vulkan/vulkan_command_processor.h"
 #include "xenia/gpu/xenos.h"
 #include "xenia/ui/vulkan/circular_buffer.h"
@@ -52,18 +55,37 @@ class TextureCache {
     VmaAllocationInfo alloc_info;
     VkFramebuffer framebuffer;  // Blit target frame buffer.
     VkImageUsageFlags usage_flags;
+    // Multiplier of the width and the height of the image relative to
+    // texture_info, greater than 1 for resolution-scaled resolve destinations.
+    uint32_t resolution_scale;
 
     bool is_watched;
     bool pending_invalidation;
 
     // Pointer to the latest usage fence.
     VkFence in_flight_fence;
+
+    // Position in the least recently used list of the cached textures, for
+    // evicting the ones that haven't been used for a long time.
+    Texture* used_previous;
+    Texture* used_next;
+    uint64_t last_usage_frame;
+    uint64_t last_usage_time;
   };
 
   struct TextureView {
     Texture* texture;
     VkImageView view;
 
+    // Descriptors of the view with different samplers in the bindless texture
+    // descriptor set.
+    struct BindlessDescriptor {
+      VkSampler sampler;
+      VkImageLayout image_layout;
+      uint32_t index;
+    };
+    std::vector<BindlessDescriptor> bindless_descriptors;
+
     union {
       struct {
         // FIXME: This only applies on little-endian platforms!
@@ -79,18 +101,38 @@ class TextureCache {
   };
 
   TextureCache(Memory* memory, RegisterFile* register_file,
-               TraceWriter* trace_writer, ui::vulkan::VulkanDevice* device);
+               TraceWriter* trace_writer, ui::vulkan::VulkanDevice* device,
+               BenchmarkCounters* benchmark_counters);
   ~TextureCache();
 
   VkResult Initialize();
   void Shutdown();
 
   // Descriptor set layout containing all possible texture bindings.
-  // The set contains one descriptor for each texture sampler [0-31].
+  // The set contains one descriptor for each texture sampler [0-31], or
+  // kSpirvBindlessTextureCount descriptors if bindless textures are used.
   VkDescriptorSetLayout texture_descriptor_set_layout() const {
     return texture_descriptor_set_layout_;
   }
 
+  // Whether textures are bound through the persistent descriptor set with the
+  // indices in the constants rather than with PrepareTextureSet.
+  bool bindless_textures() const {
+    return bindless_descriptor_set_ != nullptr;
+  }
+  VkDescriptorSet bindless_descriptor_set() const {
+    return bindless_descriptor_set_;
+  }
+
+  // Bindless version of PrepareTextureSet - writes the indices of the
+  // descriptors for the 32 fetch constants (0 for unused ones), creating the
+  // descriptors if needed.
+  void PrepareBindlessTextures(
+      VkCommandBuffer setup_command_buffer, VkFence completion_fence,
+      const std::vector<Shader::TextureBinding>& vertex_bindings,
+      const std::vector<Shader::TextureBinding>& pixel_bindings,
+      uint32_t* texture_indices_out);
+
   // Prepares a descriptor set containing the samplers and images for all
   // bindings. The textures will be uploaded/converted/etc as needed.
   // Requires a fence to be provided that will be signaled when finished
@@ -116,13 +158,17 @@ class TextureCache {
   TextureView* DemandView(Texture* texture, uint16_t swizzle);
 
   // Demands a texture for the purpose of resolving from EDRAM. This either
-  // creates a new texture or returns a previously created texture.
-  Texture* DemandResolveTexture(const TextureInfo& texture_info);
+  // creates a new texture or returns a previously created texture. New textures
+  // are created with the resolution scale, but an existing texture may have a
+  // different one.
+  Texture* DemandResolveTexture(const TextureInfo& texture_info,
+                                uint32_t resolution_scale = 1);
 
   // Clears all cached content.
   void ClearCache();
 
-  // Frees any unused resources
+  // Frees any unused resources, spending at most the time budget on
+  // destroying textures, with the rest left for the next calls.
   void Scavenge();
 
  private:
@@ -142,8 +188,16 @@ class TextureCache {
   // Allocates a new texture and memory to back it on the GPU.
   Texture* AllocateTexture(const TextureInfo& texture_info,
                            VkFormatFeatureFlags required_flags =
-                               VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+                               VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT,
+                           uint32_t resolution_scale = 1);
   bool FreeTexture(Texture* texture);
+  // Moves the texture to the end of the least recently used list.
+  void MarkTextureUsed(Texture* texture);
+  // Removes the texture from the least recently used list if it's in it.
+  void UnlinkUsedTexture(Texture* texture);
+  // Removes the texture from the cache and queues it to be destroyed when its
+  // last usage has been completed.
+  void QueueTextureFree(Texture* texture);
 
   void WatchTexture(Texture* texture);
   void TextureTouched(Texture* texture);
@@ -163,8 +217,28 @@ class TextureCache {
   void FlushPendingCommands(VkCommandBuffer command_buffer,
                             VkFence completion_fence);
 
+  // Tiled texture mip to untile with a compute shader instead of on the CPU.
+  struct GpuUntile {
+    // Guest data of the mip, copied to the staging buffer as is.
+    const void* source;
+    uint32_t source_length;
+    uint32_t face_count;
+    TextureUntileConstants constants;
+  };
+
+  // If gpu_untile is not null and the texture is tiled, only fills it and the
+  // copy region without writing to dest - see CanUntileOnGpu.
   bool ConvertTexture(uint8_t* dest, VkBufferImageCopy* copy_region,
-                      uint32_t mip, const TextureInfo& src);
+                      uint32_t mip, const TextureInfo& src,
+                      GpuUntile* gpu_untile = nullptr);
+
+  VkResult InitializeUntilePipelines();
+  void ShutdownUntilePipelines();
+  // Whether the mips of the texture can be untiled on the GPU, which is
+  // possible for tiled textures with 4, 8 or 16 byte blocks without format
+  // conversion.
+  bool CanUntileOnGpu(const TextureInfo& src) const;
+  static uint32_t ComputeTiledMipLength(const TextureInfo& src, uint32_t mip);
 
   static const FormatInfo* GetFormatInfo(xenos::TextureFormat format);
   static texture_conversion::CopyBlockCallback GetFormatCopyBlock(
@@ -196,6 +270,20 @@ class TextureCache {
                            VkFence completion_fence,
                            UpdateSetInfo* update_set_info,
                            const Shader::TextureBinding& binding);
+  // Demands the texture, the view and the sampler for the binding.
+  bool DemandTextureBinding(VkCommandBuffer command_buffer,
+                            VkFence completion_fence,
+                            const Shader::TextureBinding& binding,
+                            Texture** texture_out, TextureView** view_out,
+                            Sampler** sampler_out);
+
+  VkResult InitializeBindless();
+  // Returns the index of the bindless descriptor for the view in its current
+  // layout with the sampler, or UINT32_MAX if out of descriptors.
+  uint32_t RequestBindlessDescriptor(TextureView* view, Sampler* sampler);
+  void ReleaseBindlessDescriptors(TextureView* view);
+  // Makes descriptors whose last usage has been completed available again.
+  void ReclaimRetiredBindlessDescriptors();
 
   // Removes invalidated textures from the cache, queues them for delete.
   void RemoveInvalidatedTextures();
@@ -204,6 +292,7 @@ class TextureCache {
 
   RegisterFile* register_file_ = nullptr;
   TraceWriter* trace_writer_ = nullptr;
+  BenchmarkCounters* benchmark_counters_ = nullptr;
   ui::vulkan::VulkanDevice* device_ = nullptr;
   VkQueue device_queue_ = nullptr;
 
@@ -212,13 +301,48 @@ class TextureCache {
   std::unordered_map<uint64_t, VkDescriptorSet> texture_sets_;
   VkDescriptorSetLayout texture_descriptor_set_layout_ = nullptr;
 
+  // Persistent bindless texture descriptors, if used.
+  VkDescriptorPool bindless_descriptor_pool_ = nullptr;
+  VkDescriptorSet bindless_descriptor_set_ = nullptr;
+  std::vector<uint32_t> bindless_descriptors_free_;
+  // Descriptors of views whose layout has changed, which may still be used by
+  // submissions until the fence is signaled.
+  struct RetiredBindlessDescriptor {
+    uint32_t index;
+    VkFence fence;
+  };
+  std::vector<RetiredBindlessDescriptor> bindless_descriptors_retired_;
+
   VmaAllocator mem_allocator_ = nullptr;
 
+  // Compute shaders untiling textures in the staging buffer, for 4, 8 and 16
+  // byte blocks, if enabled.
+  VkDescriptorSetLayout untile_descriptor_set_layout_ = nullptr;
+  VkPipelineLayout untile_pipeline_layout_ = nullptr;
+  VkPipeline untile_pipelines_[3] = {};
+  VkDescriptorPool untile_descriptor_pool_ = nullptr;
+  // The staging buffer as a storage buffer.
+  VkDescriptorSet untile_descriptor_set_ = nullptr;
+
   ui::vulkan::CircularBuffer staging_buffer_;
   ui::vulkan::CircularBuffer wb_staging_buffer_;
   std::unordered_map<uint64_t, Texture*> textures_;
   std::unordered_map<uint64_t, Sampler*> samplers_;
-  std::list<Texture*> pending_delete_textures_;
+  // Textures removed from the cache, destroyed by Scavenge in the order they
+  // were removed once the fences of their last usage are signaled.
+  struct PendingFreeTexture {
+    Texture* texture;
+    VkFence fence;
+  };
+  std::deque<PendingFreeTexture> pending_delete_textures_;
+
+  // Least recently used list of the textures in textures_.
+  Texture* texture_used_first_ = nullptr;
+  Texture* texture_used_last_ = nullptr;
+  uint64_t current_frame_ = 0;
+  uint64_t current_usage_time_ = 0;
+  // Total size of the allocations of the textures in textures_.
+  VkDeviceSize textures_total_size_ = 0;
 
   void* memory_invalidation_callback_handle_ = nullptr;
 
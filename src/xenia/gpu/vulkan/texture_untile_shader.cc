@@ -0,0 +1,202 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/vulkan/texture_untile_shader.h"
+
+#include <cstddef>
+#include <memory>
+
+#include "third_party/glslang-spirv/SpvBuilder.h"
+#include "xenia/base/assert.h"
+#include "xenia/base/math.h"
+#include "xenia/gpu/xenos.h"
+
+namespace xe {
+namespace gpu {
+namespace vulkan {
+
+std::vector<uint32_t> BuildTextureUntileShader(uint32_t bytes_per_block_log2) {
+  assert_true(bytes_per_block_log2 >= 2 && bytes_per_block_log2 <= 4);
+  const uint32_t log2_bpb = bytes_per_block_log2;
+
+  auto builder = std::make_unique<spv::Builder>(0x10000, 0xFFFFFFFF, nullptr);
+  spv::Builder& b = *builder;
+  b.setSource(spv::SourceLanguage::SourceLanguageUnknown, 0);
+  b.setMemoryModel(spv::AddressingModel::AddressingModelLogical,
+                   spv::MemoryModel::MemoryModelGLSL450);
+  b.addCapability(spv::Capability::CapabilityShader);
+
+  spv::Id uint_type = b.makeUintType(32);
+  spv::Id bool_type = b.makeBoolType();
+  spv::Id uvec3_type = b.makeVectorType(uint_type, 3);
+
+  // Push constants.
+  constexpr uint32_t kConstantCount =
+      sizeof(TextureUntileConstants) / sizeof(uint32_t);
+  std::vector<spv::Id> constants_member_types(kConstantCount, uint_type);
+  spv::Id constants_type =
+      b.makeStructType(constants_member_types, "TextureUntileConstants");
+  b.addDecoration(constants_type, spv::Decoration::DecorationBlock);
+  for (uint32_t i = 0; i < kConstantCount; ++i) {
+    b.addMemberDecoration(constants_type, i, spv::Decoration::DecorationOffset,
+                          int(i * sizeof(uint32_t)));
+  }
+  spv::Id constants = b.createVariable(
+      spv::StorageClass::StorageClassPushConstant, constants_type, "c");
+
+  // Storage buffer with both the source and the destination.
+  spv::Id data_array_type = b.makeRuntimeArray(uint_type);
+  b.addDecoration(data_array_type, spv::Decoration::DecorationArrayStride,
+                  int(sizeof(uint32_t)));
+  spv::Id data_struct_type = b.makeStructType({data_array_type}, "Data");
+  b.addDecoration(data_struct_type, spv::Decoration::DecorationBufferBlock);
+  b.addMemberDecoration(data_struct_type, 0, spv::Decoration::DecorationOffset,
+                        0);
+  spv::Id data = b.createVariable(spv::StorageClass::StorageClassUniform,
+                                  data_struct_type, "data");
+  b.addDecoration(data, spv::Decoration::DecorationDescriptorSet, 0);
+  b.addDecoration(data, spv::Decoration::DecorationBinding, 0);
+
+  spv::Id global_invocation_id =
+      b.createVariable(spv::StorageClass::StorageClassInput, uvec3_type,
+                       "gl_GlobalInvocationID");
+  b.addDecoration(global_invocation_id, spv::Decoration::DecorationBuiltIn,
+                  spv::BuiltIn::BuiltInGlobalInvocationId);
+
+  spv::Block* entry_block;
+  spv::Function* main_function = b.makeFunctionEntry(
+      spv::NoPrecision, b.makeVoidType(), "main", {}, {}, &entry_block);
+  spv::Instruction* entry_point = b.addEntryPoint(
+      spv::ExecutionModel::ExecutionModelGLCompute, main_function, "main");
+  entry_point->addIdOperand(global_invocation_id);
+  b.addExecutionMode(main_function, spv::ExecutionMode::ExecutionModeLocalSize,
+                     1 << kTextureUntileGroupSizeLog2,
+                     1 << kTextureUntileGroupSizeLog2, 1);
+
+  auto u = [&](uint32_t value) { return b.makeUintConstant(value); };
+  auto op = [&](spv::Op opcode, spv::Id a, spv::Id c) {
+    return b.createBinOp(opcode, uint_type, a, c);
+  };
+  auto shl = [&](spv::Id a, uint32_t shift) {
+    return op(spv::Op::OpShiftLeftLogical, a, u(shift));
+  };
+  auto shr = [&](spv::Id a, uint32_t shift) {
+    return op(spv::Op::OpShiftRightLogical, a, u(shift));
+  };
+  auto band = [&](spv::Id a, uint32_t mask) {
+    return op(spv::Op::OpBitwiseAnd, a, u(mask));
+  };
+  auto add = [&](spv::Id a, spv::Id c) { return op(spv::Op::OpIAdd, a, c); };
+  auto load_constant = [&](size_t offset) {
+    return b.createLoad(b.createAccessChain(
+        spv::StorageClass::StorageClassPushConstant, constants,
+        {u(uint32_t(offset / sizeof(uint32_t)))}));
+  };
+
+  spv::Id block_index = b.createLoad(global_invocation_id);
+  spv::Id block_x = b.createCompositeExtract(block_index, uint_type, 0);
+  spv::Id block_y = b.createCompositeExtract(block_index, uint_type, 1);
+  spv::Id face = b.createCompositeExtract(block_index, uint_type, 2);
+
+  spv::Id in_bounds = b.createBinOp(
+      spv::Op::OpLogicalAnd, bool_type,
+      b.createBinOp(spv::Op::OpULessThan, bool_type, block_x,
+                    load_constant(offsetof(TextureUntileConstants, width))),
+      b.createBinOp(spv::Op::OpULessThan, bool_type, block_y,
+                    load_constant(offsetof(TextureUntileConstants, height))));
+  spv::Builder::If in_bounds_if(in_bounds, 0, b);
+  {
+    spv::Id x = add(block_x,
+                    load_constant(offsetof(TextureUntileConstants, offset_x)));
+    spv::Id y = add(block_y,
+                    load_constant(offsetof(TextureUntileConstants, offset_y)));
+
+    // TiledOffset2DRow.
+    spv::Id source_pitch =
+        load_constant(offsetof(TextureUntileConstants, source_pitch));
+    spv::Id row_macro = shl(
+        op(spv::Op::OpIMul, shr(y, 5), shr(source_pitch, 5)), log2_bpb + 7);
+    spv::Id row_micro = shl(shl(band(y, 6), 2), log2_bpb);
+    spv::Id row_offset =
+        add(add(add(add(row_macro, shl(band(row_micro, ~0xFu), 1)),
+                    band(row_micro, 0xF)),
+                shl(band(y, 8), 3 + log2_bpb)),
+            shl(band(y, 1), 4));
+
+    // TiledOffset2DColumn.
+    spv::Id column_macro = shl(shr(x, 5), log2_bpb + 7);
+    spv::Id column_micro = shl(band(x, 7), log2_bpb);
+    spv::Id offset =
+        add(add(row_offset, column_macro),
+            add(shl(band(column_micro, ~0xFu), 1), band(column_micro, 0xF)));
+    offset = add(
+        add(add(shl(band(offset, ~0x1FFu), 3), shl(band(offset, 0x1C0), 2)),
+            add(band(offset, 0x3F), shl(band(y, 16), 7))),
+        shl(band(add(shr(band(y, 8), 2), shr(x, 3)), 3), 6));
+
+    spv::Id source = add(
+        add(load_constant(offsetof(TextureUntileConstants, source_offset)),
+            op(spv::Op::OpIMul, face,
+               load_constant(
+                   offsetof(TextureUntileConstants, source_face_stride)))),
+        shl(shr(offset, log2_bpb), log2_bpb - 2));
+    spv::Id dest = add(
+        add(load_constant(offsetof(TextureUntileConstants, dest_offset)),
+            op(spv::Op::OpIMul, face,
+               load_constant(
+                   offsetof(TextureUntileConstants, dest_face_stride)))),
+        shl(add(op(spv::Op::OpIMul, block_y,
+                   load_constant(offsetof(TextureUntileConstants, dest_pitch))),
+                block_x),
+            log2_bpb - 2));
+
+    // 8-in-32 is 8-in-16 followed by 16-in-32.
+    spv::Id endianness =
+        load_constant(offsetof(TextureUntileConstants, endianness));
+    spv::Id swap_8_in_16 = b.createBinOp(
+        spv::Op::OpLogicalOr, bool_type,
+        b.createBinOp(spv::Op::OpIEqual, bool_type, endianness,
+                      u(uint32_t(xenos::Endian::k8in16))),
+        b.createBinOp(spv::Op::OpIEqual, bool_type, endianness,
+                      u(uint32_t(xenos::Endian::k8in32))));
+    spv::Id swap_16_in_32 = b.createBinOp(
+        spv::Op::OpLogicalOr, bool_type,
+        b.createBinOp(spv::Op::OpIEqual, bool_type, endianness,
+                      u(uint32_t(xenos::Endian::k8in32))),
+        b.createBinOp(spv::Op::OpIEqual, bool_type, endianness,
+                      u(uint32_t(xenos::Endian::k16in32))));
+
+    for (uint32_t i = 0; i < (1u << (log2_bpb - 2)); ++i) {
+      spv::Id word = b.createLoad(
+          b.createAccessChain(spv::StorageClass::StorageClassUniform, data,
+                              {u(0), add(source, u(i))}));
+      word = b.createTriOp(
+          spv::Op::OpSelect, uint_type, swap_8_in_16,
+          op(spv::Op::OpBitwiseOr, shl(band(word, 0x00FF00FF), 8),
+             band(shr(word, 8), 0x00FF00FF)),
+          word);
+      word = b.createTriOp(
+          spv::Op::OpSelect, uint_type, swap_16_in_32,
+          op(spv::Op::OpBitwiseOr, shl(word, 16), shr(word, 16)), word);
+      b.createStore(word, b.createAccessChain(
+                              spv::StorageClass::StorageClassUniform, data,
+                              {u(0), add(dest, u(i))}));
+    }
+  }
+  in_bounds_if.makeEndIf();
+  b.makeReturn(false);
+
+  std::vector<uint32_t> spirv;
+  b.dump(spirv);
+  return spirv;
+}
+
+}  // namespace vulkan
+}  // namespace gpu
+}  // namespace xe
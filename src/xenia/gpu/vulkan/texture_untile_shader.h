@@ -0,0 +1,72 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_VULKAN_TEXTURE_UNTILE_SHADER_H_
+#define XENIA_GPU_VULKAN_TEXTURE_UNTILE_SHADER_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace xe {
+namespace gpu {
+namespace vulkan {
+
+// Push constants of the texture untiling compute shader. Offsets and strides
+// are in 32-bit words within the storage buffer, sizes and pitches are in
+// blocks.
+struct TextureUntileConstants {
+  uint32_t source_offset;
+  uint32_t source_face_stride;
+  uint32_t dest_offset;
+  uint32_t dest_face_stride;
+  // Linear pitch of the destination rows.
+  uint32_t dest_pitch;
+  // Pitch of the guest texture used for tiling.
+  uint32_t source_pitch;
+  // Position of the texture within the tiled source (for packed mips).
+  uint32_t offset_x;
+  uint32_t offset_y;
+  uint32_t width;
+  uint32_t height;
+  // xenos::Endian.
+  uint32_t endianness;
+};
+
+constexpr uint32_t kTextureUntileGroupSizeLog2 = 3;
+
+// Builds the SPIR-V of the compute shader untiling 2D textures with 4, 8 or 16
+// byte blocks (bytes_per_block_log2 of 2, 3 or 4) from the source to the
+// destination in a single storage buffer at set 0, binding 0, and swapping the
+// endianness of every 32-bit word. One invocation is dispatched per block,
+// with the face (or the array layer) in the Z dimension. Equivalent to
+// texture_conversion::Untile with CopySwapBlock, and to the following GLSL:
+//
+// layout(local_size_x = 8, local_size_y = 8) in;
+// layout(push_constant) uniform Constants { TextureUntileConstants c; };
+// layout(set = 0, binding = 0) buffer Data { uint data[]; };
+// void main() {
+//   uvec3 block = gl_GlobalInvocationID;
+//   if (block.x >= c.width || block.y >= c.height) return;
+//   uint x = c.offset_x + block.x, y = c.offset_y + block.y;
+//   uint source = c.source_offset + block.z * c.source_face_stride +
+//       ((TiledOffset2DColumn(x, y, log2_bpb,
+//            TiledOffset2DRow(y, c.source_pitch, log2_bpb)) >> log2_bpb)
+//        << (log2_bpb - 2));
+//   uint dest = c.dest_offset + block.z * c.dest_face_stride +
+//       ((block.y * c.dest_pitch + block.x) << (log2_bpb - 2));
+//   for (uint i = 0; i < (1 << (log2_bpb - 2)); ++i)
+//     data[dest + i] = Swap(data[source + i], c.endianness);
+// }
+std::vector<uint32_t> BuildTextureUntileShader(uint32_t bytes_per_block_log2);
+
+}  // namespace vulkan
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_VULKAN_TEXTURE_UNTILE_SHADER_H_
@@ -38,6 +38,13 @@ VulkanCommandProcessor::VulkanCommandProcessor(
 
 VulkanCommandProcessor::~VulkanCommandProcessor() = default;
 
+void VulkanCommandProcessor::InitializeShaderStorage(
+    const std::filesystem::path& storage_root, uint32_t title_id,
+    bool blocking) {
+  CommandProcessor::InitializeShaderStorage(storage_root, title_id, blocking);
+  pipeline_cache_->InitializeShaderStorage(storage_root, title_id, blocking);
+}
+
 void VulkanCommandProcessor::RequestFrameTrace(
     const std::filesystem::path& root_path) {
   // Override traces if renderdoc is attached.
@@ -100,8 +107,8 @@ bool VulkanCommandProcessor::SetupContext() {
     return false;
   }
 
-  texture_cache_ = std::make_unique<TextureCache>(memory_, register_file_,
-                                                  &trace_writer_, device_);
+  texture_cache_ = std::make_unique<TextureCache>(
+      memory_, register_file_, &trace_writer_, device_, &benchmark_counters_);
   status = texture_cache_->Initialize();
   if (status != VK_SUCCESS) {
     XELOGE("Unable to initialize texture cache");
@@ -109,7 +116,17 @@ bool VulkanCommandProcessor::SetupContext() {
     return false;
   }
 
-  pipeline_cache_ = std::make_unique<PipelineCache>(register_file_, device_);
+  render_cache_ = std::make_unique<RenderCache>(register_file_, device_);
+  status = render_cache_->Initialize();
+  if (status != VK_SUCCESS) {
+    XELOGE("Unable to initialize render cache");
+    render_cache_->Shutdown();
+    return false;
+  }
+
+  pipeline_cache_ = std::make_unique<PipelineCache>(
+      register_file_, device_, render_cache_.get(),
+      texture_cache_->bindless_textures(), &benchmark_counters_);
   status = pipeline_cache_->Initialize(
       buffer_cache_->constant_descriptor_set_layout(),
       texture_cache_->texture_descriptor_set_layout(),
@@ -120,14 +137,6 @@ bool VulkanCommandProcessor::SetupContext() {
     return false;
   }
 
-  render_cache_ = std::make_unique<RenderCache>(register_file_, device_);
-  status = render_cache_->Initialize();
-  if (status != VK_SUCCESS) {
-    XELOGE("Unable to initialize render cache");
-    render_cache_->Shutdown();
-    return false;
-  }
-
   return true;
 }
 
@@ -235,6 +244,29 @@ void VulkanCommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
   }
 }
 
+void VulkanCommandProcessor::OnShaderConstantsChanged(uint32_t first_index,
+                                                      uint32_t last_index) {
+  for (uint32_t index = first_index; index <= last_index; ++index) {
+    if (index <= XE_GPU_REG_SHADER_CONSTANT_511_W) {
+      uint32_t offset = index - XE_GPU_REG_SHADER_CONSTANT_000_X;
+      offset /= 4 * 4;
+      offset ^= 0x3F;
+
+      dirty_float_constants_ |= (1ull << offset);
+    } else if (index <= XE_GPU_REG_SHADER_CONSTANT_BOOL_224_255) {
+      uint32_t offset = index - XE_GPU_REG_SHADER_CONSTANT_BOOL_000_031;
+      offset ^= 0x7;
+
+      dirty_bool_constants_ |= (1 << offset);
+    } else if (index >= XE_GPU_REG_SHADER_CONSTANT_LOOP_00) {
+      uint32_t offset = index - XE_GPU_REG_SHADER_CONSTANT_LOOP_00;
+      offset ^= 0x1F;
+
+      dirty_loop_constants_ |= (1 << offset);
+    }
+  }
+}
+
 void VulkanCommandProcessor::CreateSwapImage(VkCommandBuffer setup_buffer,
                                              VkExtent2D extents) {
   VkImageCreateInfo image_info;
@@ -337,6 +369,10 @@ void VulkanCommandProcessor::DestroySwapImage() {
 void VulkanCommandProcessor::BeginFrame() {
   assert_false(frame_open_);
 
+  // Invalidate the memory written by the guest since the last frame if not
+  // relying on access violations for this.
+  memory_->PollPhysicalMemoryWriteWatches();
+
   // TODO(benvanik): bigger batches.
   // TODO(DrChat): Decouple setup buffer from current batch.
   // Begin a new batch, and allocate and begin a command buffer and setup
@@ -385,6 +421,8 @@ void VulkanCommandProcessor::EndFrame() {
     current_render_state_ = nullptr;
   }
 
+  pipeline_cache_->EndFrame();
+
   VkResult status = VK_SUCCESS;
   status = vkEndCommandBuffer(current_setup_buffer_);
   CheckResult(status, "vkEndCommandBuffer");
@@ -428,8 +466,13 @@ void VulkanCommandProcessor::PerformSwap(uint32_t frontbuffer_ptr,
     frontbuffer_ptr = last_copy_base_;
   }
 
+  // The guest frontbuffer is presented at the render resolution.
+  uint32_t resolution_scale = render_cache_->resolution_scale();
+  uint32_t scaled_frontbuffer_width = frontbuffer_width * resolution_scale;
+  uint32_t scaled_frontbuffer_height = frontbuffer_height * resolution_scale;
   if (!swap_state_.front_buffer_texture) {
-    CreateSwapImage(copy_commands, {frontbuffer_width, frontbuffer_height});
+    CreateSwapImage(copy_commands,
+                    {scaled_frontbuffer_width, scaled_frontbuffer_height});
   }
   auto swap_fb = reinterpret_cast<VkImage>(swap_state_.front_buffer_texture);
 
@@ -479,25 +522,31 @@ void VulkanCommandProcessor::PerformSwap(uint32_t frontbuffer_ptr,
                          nullptr, 0, nullptr, 1, &barrier);
 
     // Part of the source image that we want to blit from.
-    VkRect2D src_rect = {
-        {0, 0},
-        {texture->texture_info.width + 1, texture->texture_info.height + 1},
+    VkExtent2D texture_extent = {
+        (texture->texture_info.width + 1) * texture->resolution_scale,
+        (texture->texture_info.height + 1) * texture->resolution_scale,
     };
-    VkRect2D dst_rect = {{0, 0}, {frontbuffer_width, frontbuffer_height}};
+    VkRect2D src_rect = {{0, 0}, texture_extent};
+    VkRect2D dst_rect = {
+        {0, 0}, {scaled_frontbuffer_width, scaled_frontbuffer_height}};
 
     VkViewport viewport = {
-        0.f, 0.f, float(frontbuffer_width), float(frontbuffer_height),
-        0.f, 1.f};
+        0.f,
+        0.f,
+        float(scaled_frontbuffer_width),
+        float(scaled_frontbuffer_height),
+        0.f,
+        1.f};
 
-    VkRect2D scissor = {{0, 0}, {frontbuffer_width, frontbuffer_height}};
+    VkRect2D scissor = {
+        {0, 0}, {scaled_frontbuffer_width, scaled_frontbuffer_height}};
 
     blitter_->BlitTexture2D(
         copy_commands, current_batch_fence_,
         texture_cache_->DemandView(texture, 0x688)->view, src_rect,
-        {texture->texture_info.width + 1, texture->texture_info.height + 1},
-        VK_FORMAT_R8G8B8A8_UNORM, dst_rect,
-        {frontbuffer_width, frontbuffer_height}, fb_framebuffer_, viewport,
-        scissor, VK_FILTER_LINEAR, true, true);
+        texture_extent, VK_FORMAT_R8G8B8A8_UNORM, dst_rect,
+        {scaled_frontbuffer_width, scaled_frontbuffer_height}, fb_framebuffer_,
+        viewport, scissor, VK_FILTER_LINEAR, true, true);
 
     std::swap(barrier.oldLayout, barrier.newLayout);
     barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
@@ -507,8 +556,8 @@ void VulkanCommandProcessor::PerformSwap(uint32_t frontbuffer_ptr,
         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
 
     std::lock_guard<std::mutex> lock(swap_state_.mutex);
-    swap_state_.width = frontbuffer_width;
-    swap_state_.height = frontbuffer_height;
+    swap_state_.width = scaled_frontbuffer_width;
+    swap_state_.height = scaled_frontbuffer_height;
   }
 
   status = vkEndCommandBuffer(copy_commands);
@@ -614,6 +663,9 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
     return true;
   } else if (enable_mode == ModeControl::kCopy) {
     // Special copy handling.
+    BenchmarkTimingScope benchmark_timing_scope(
+        benchmark_counters_, benchmark_counters_.resolve_ticks);
+    benchmark_counters_.CountResolve();
     return IssueCopy();
   }
 
@@ -673,6 +725,9 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
       primitive_type, &pipeline);
   if (pipeline_status == PipelineCache::UpdateStatus::kError) {
     return false;
+  } else if (pipeline_status == PipelineCache::UpdateStatus::kNotReady) {
+    // Skipped until the pipeline is created.
+    return true;
   } else if (pipeline_status == PipelineCache::UpdateStatus::kMismatch ||
              full_update) {
     vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
@@ -680,6 +735,16 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
   }
   pipeline_cache_->SetDynamicState(command_buffer, full_update);
 
+  // Bind samplers/textures.
+  // Uploads all textures that need it.
+  // Setup buffer may be flushed to GPU if the texture cache needs it.
+  // Done before uploading the constants, which contain the bindless texture
+  // descriptor indices.
+  if (!PopulateSamplers(command_buffer, setup_buffer, vertex_shader,
+                        pixel_shader)) {
+    return false;
+  }
+
   // Pass registers to the shaders.
   if (!PopulateConstants(command_buffer, vertex_shader, pixel_shader)) {
     return false;
@@ -695,14 +760,6 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
     return false;
   }
 
-  // Bind samplers/textures.
-  // Uploads all textures that need it.
-  // Setup buffer may be flushed to GPU if the texture cache needs it.
-  if (!PopulateSamplers(command_buffer, setup_buffer, vertex_shader,
-                        pixel_shader)) {
-    return false;
-  }
-
   // Actually issue the draw.
   if (!index_buffer_info) {
     // Auto-indexed draw.
@@ -741,7 +798,9 @@ bool VulkanCommandProcessor::PopulateConstants(VkCommandBuffer command_buffer,
   auto constant_offsets = buffer_cache_->UploadConstantRegisters(
       current_setup_buffer_, vertex_shader->constant_register_map(),
       pixel_shader ? pixel_shader->constant_register_map() : dummy_map,
-      current_batch_fence_);
+      current_batch_fence_,
+      texture_cache_->bindless_textures() ? bindless_texture_indices_
+                                          : nullptr);
   if (constant_offsets.first == VK_WHOLE_SIZE ||
       constant_offsets.second == VK_WHOLE_SIZE) {
     // Shader wants constants but we couldn't upload them.
@@ -850,9 +909,19 @@ bool VulkanCommandProcessor::PopulateSamplers(VkCommandBuffer command_buffer,
 #endif  // FINE_GRAINED_DRAW_SCOPES
 
   std::vector<xe::gpu::Shader::TextureBinding> dummy_bindings;
-  auto descriptor_set = texture_cache_->PrepareTextureSet(
-      setup_buffer, current_batch_fence_, vertex_shader->texture_bindings(),
-      pixel_shader ? pixel_shader->texture_bindings() : dummy_bindings);
+  VkDescriptorSet descriptor_set;
+  if (texture_cache_->bindless_textures()) {
+    // The set is persistent, only the indices in the constants change.
+    texture_cache_->PrepareBindlessTextures(
+        setup_buffer, current_batch_fence_, vertex_shader->texture_bindings(),
+        pixel_shader ? pixel_shader->texture_bindings() : dummy_bindings,
+        bindless_texture_indices_);
+    descriptor_set = texture_cache_->bindless_descriptor_set();
+  } else {
+    descriptor_set = texture_cache_->PrepareTextureSet(
+        setup_buffer, current_batch_fence_, vertex_shader->texture_bindings(),
+        pixel_shader ? pixel_shader->texture_bindings() : dummy_bindings);
+  }
   if (!descriptor_set) {
     // Unable to bind set.
     XELOGW("Failed to prepare texture set!");
@@ -1041,7 +1110,8 @@ bool VulkanCommandProcessor::IssueCopy() {
       copy_dest_base, copy_dest_format, resolve_endian, copy_dest_pitch,
       dest_logical_width, std::max(1u, dest_logical_height), 1, &texture_info);
 
-  auto texture = texture_cache_->DemandResolveTexture(texture_info);
+  auto texture = texture_cache_->DemandResolveTexture(
+      texture_info, render_cache_->resolution_scale());
   if (!texture) {
     // Out of memory.
     XELOGD("Failed to demand resolve texture!");
@@ -1155,6 +1225,9 @@ bool VulkanCommandProcessor::IssueCopy() {
         XELOGGPU("Failed to find tile view!");
         break;
       }
+      render_cache_->LoadTileViewTiles(command_buffer, view, 0, 0,
+                                       resolve_extent.width,
+                                       resolve_extent.height);
 
       // Convert the tile view to a sampled image.
       // Put a barrier on the tile view.
@@ -1195,8 +1268,8 @@ bool VulkanCommandProcessor::IssueCopy() {
             render_pass,
             1,
             &texture_view->view,
-            texture->texture_info.width + 1,
-            texture->texture_info.height + 1,
+            (texture->texture_info.width + 1) * texture->resolution_scale,
+            (texture->texture_info.height + 1) * texture->resolution_scale,
             1,
         };
 
@@ -1236,8 +1309,24 @@ bool VulkanCommandProcessor::IssueCopy() {
       src_rect.extent.width -= dst_adj_x;
       src_rect.extent.height -= dst_adj_y;
 
+      // The source rectangle is in the tile view, and the rest is in the
+      // destination texture, which may have a different resolution scale.
+      int32_t source_scale = int32_t(view->resolution_scale);
+      int32_t dest_scale = int32_t(texture->resolution_scale);
+      src_rect.extent.width *= source_scale;
+      src_rect.extent.height *= source_scale;
+      dst_rect.offset.x *= dest_scale;
+      dst_rect.offset.y *= dest_scale;
+      dst_rect.extent.width *= dest_scale;
+      dst_rect.extent.height *= dest_scale;
+
       VkViewport viewport = {
-          0.f, 0.f, float(copy_dest_pitch), float(copy_dest_height), 0.f, 1.f,
+          0.f,
+          0.f,
+          float(copy_dest_pitch * dest_scale),
+          float(copy_dest_height * dest_scale),
+          0.f,
+          1.f,
       };
 
       uint32_t scissor_tl_x = window_regs->window_scissor_tl.tl_x;
@@ -1252,16 +1341,18 @@ bool VulkanCommandProcessor::IssueCopy() {
       scissor_br_y = std::min(scissor_br_y, copy_dest_height);
 
       VkRect2D scissor = {
-          {int32_t(scissor_tl_x), int32_t(scissor_tl_y)},
-          {scissor_br_x - scissor_tl_x, scissor_br_y - scissor_tl_y},
+          {int32_t(scissor_tl_x) * dest_scale,
+           int32_t(scissor_tl_y) * dest_scale},
+          {(scissor_br_x - scissor_tl_x) * dest_scale,
+           (scissor_br_y - scissor_tl_y) * dest_scale},
       };
 
       blitter_->BlitTexture2D(
           command_buffer, current_batch_fence_,
           is_color_source ? view->image_view : view->image_view_depth, src_rect,
           view->GetSize(), texture->format, dst_rect,
-          {copy_dest_pitch, copy_dest_height}, texture->framebuffer, viewport,
-          scissor, filter, is_color_source,
+          {copy_dest_pitch * dest_scale, copy_dest_height * dest_scale},
+          texture->framebuffer, viewport, scissor, filter, is_color_source,
           copy_regs->copy_dest_info.copy_dest_swap != 0);
 
       // Pull the tile view back to a color/depth attachment.
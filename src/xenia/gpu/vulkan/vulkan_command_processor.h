@@ -55,6 +55,9 @@ class VulkanCommandProcessor : public CommandProcessor {
   void RestoreEdramSnapshot(const void* snapshot) override;
   void ClearCaches() override;
 
+  void InitializeShaderStorage(const std::filesystem::path& storage_root,
+                               uint32_t title_id, bool blocking) override;
+
   RenderCache* render_cache() { return render_cache_.get(); }
 
  private:
@@ -66,6 +69,8 @@ class VulkanCommandProcessor : public CommandProcessor {
   void ReturnFromWait() override;
 
   void WriteRegister(uint32_t index, uint32_t value) override;
+  void OnShaderConstantsChanged(uint32_t first_index,
+                                uint32_t last_index) override;
 
   void BeginFrame();
   void EndFrame();
@@ -143,6 +148,10 @@ class VulkanCommandProcessor : public CommandProcessor {
   VkCommandBuffer current_command_buffer_ = nullptr;
   VkCommandBuffer current_setup_buffer_ = nullptr;
   VkFence current_batch_fence_;
+
+  // Bindless texture descriptor indices for the fetch constants, prepared
+  // before the constants are uploaded.
+  uint32_t bindless_texture_indices_[32] = {};
 };
 
 }  // namespace vulkan
@@ -14,3 +14,71 @@ DEFINE_bool(vulkan_renderdoc_capture_all, false,
 DEFINE_bool(vulkan_native_msaa, false, "Use native MSAA", "Vulkan");
 DEFINE_bool(vulkan_dump_disasm, false,
             "Dump shader disassembly. NVIDIA only supported.", "Vulkan");
+DEFINE_int32(
+    vulkan_pipeline_creation_threads, -1,
+    "Number of threads used for graphics pipeline creation. -1 to calculate "
+    "automatically (75% of logical CPU cores), a positive number to specify "
+    "the number of threads explicitly (up to the number of logical CPU cores), "
+    "0 to create pipelines on the GPU thread when they're needed.",
+    "Vulkan");
+DEFINE_int32(
+    vulkan_pipeline_creation_wait_ms, -1,
+    "Maximum time in milliseconds a draw waits for its pipeline to be created "
+    "on the pipeline creation threads before being skipped. -1 to always wait "
+    "(accurate, but may stutter), 0 to skip draws until their pipelines are "
+    "created (no stutter, but objects may be missing for a few frames).",
+    "Vulkan");
+DEFINE_bool(
+    vulkan_bindless, true,
+    "Use a persistent descriptor set with descriptor indexing "
+    "(VK_EXT_descriptor_indexing) for textures and samplers instead of writing "
+    "a descriptor set for each combination of textures bound to draws, if "
+    "supported by the device.",
+    "Vulkan");
+DEFINE_bool(
+    vulkan_untile_textures_on_gpu, true,
+    "Untile textures that don't need format conversion in a compute shader "
+    "instead of on the CPU.",
+    "Vulkan");
+DEFINE_int32(
+    vulkan_resolution_scale, 1,
+    "Scale of rendering width and height (currently only 1 to 3 are "
+    "supported). Render targets are created with sparse residency if the "
+    "device supports it, so only the parts that are actually drawn to are "
+    "backed by memory.",
+    "Vulkan");
+DEFINE_int32(
+    vulkan_texture_scavenge_budget_us, 1000,
+    "Maximum time in microseconds spent on destroying invalidated and old "
+    "textures at the end of a frame. The remaining ones are destroyed in the "
+    "following frames, so invalidating many textures at once doesn't cause a "
+    "long frame. 0 or below to destroy all of them immediately.",
+    "Vulkan");
+DEFINE_int32(vulkan_texture_cache_limit_soft, 384,
+             "Maximum host texture memory usage (in megabytes) above which "
+             "textures that haven't been used for "
+             "vulkan_texture_cache_limit_soft_lifetime seconds will be "
+             "destroyed. 0 to keep all textures until they're invalidated.",
+             "Vulkan");
+DEFINE_int32(vulkan_texture_cache_limit_soft_lifetime, 30,
+             "Seconds a texture should be unused to be considered old enough "
+             "to be destroyed if texture memory usage exceeds the soft limit.",
+             "Vulkan");
+DEFINE_bool(
+    vulkan_ctx1_as_bc5, false,
+    "Transcode CTX1 textures to BC5 on the host instead of decompressing them "
+    "to R8G8, taking half of the memory. The endpoints are exact, values "
+    "between them may be slightly off.",
+    "Vulkan");
+DEFINE_bool(
+    vulkan_vertex_buffer_cache, false,
+    "Keep endian-swapped copies of vertex buffers in video memory across "
+    "frames, converting each one only once until the guest writes to its "
+    "memory, instead of swapping all vertex data every frame. Vertex buffers "
+    "that are rewritten repeatedly are still swapped every frame.",
+    "Vulkan");
+DEFINE_int32(vulkan_vertex_buffer_cache_limit, 128,
+             "Maximum video memory usage (in megabytes) of "
+             "vulkan_vertex_buffer_cache, above which the least recently used "
+             "vertex buffers are destroyed.",
+             "Vulkan");
@@ -16,5 +16,16 @@
 DECLARE_bool(vulkan_renderdoc_capture_all);
 DECLARE_bool(vulkan_native_msaa);
 DECLARE_bool(vulkan_dump_disasm);
+DECLARE_int32(vulkan_pipeline_creation_threads);
+DECLARE_int32(vulkan_pipeline_creation_wait_ms);
+DECLARE_bool(vulkan_bindless);
+DECLARE_bool(vulkan_untile_textures_on_gpu);
+DECLARE_int32(vulkan_resolution_scale);
+DECLARE_int32(vulkan_texture_scavenge_budget_us);
+DECLARE_int32(vulkan_texture_cache_limit_soft);
+DECLARE_int32(vulkan_texture_cache_limit_soft_lifetime);
+DECLARE_bool(vulkan_ctx1_as_bc5);
+DECLARE_bool(vulkan_vertex_buffer_cache);
+DECLARE_int32(vulkan_vertex_buffer_cache_limit);
 
 #endif  // XENIA_GPU_VULKAN_VULKAN_GPU_FLAGS_H_
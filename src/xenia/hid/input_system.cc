@@ -9,16 +9,44 @@
 
 #include "xenia/hid/input_system.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/input_latency.h"
 #include "xenia/base/profiling.h"
 #include "xenia/hid/hid_flags.h"
 #include "xenia/hid/input_driver.h"
 
+DEFINE_int32(input_poll_rate, 1000,
+             "Rate in Hz at which the controller state is polled in the "
+             "background for the guest to read, or 0 to poll it on every "
+             "guest request.",
+             "HID");
+
 namespace xe {
 namespace hid {
 
+// Users not requested for this long aren't polled in the background anymore.
+constexpr uint64_t kStatePollIdleTimeoutMs = 1000;
+// Probing a disconnected slot may take milliseconds with XInput.
+constexpr uint64_t kDisconnectedProbeIntervalMs = 500;
+
 InputSystem::InputSystem(xe::ui::Window* window) : window_(window) {}
 
-InputSystem::~InputSystem() = default;
+InputSystem::~InputSystem() {
+  if (state_poller_thread_) {
+    {
+      std::lock_guard<std::mutex> lock(state_poller_mutex_);
+      state_poller_shutting_down_ = true;
+    }
+    state_poller_cond_.notify_all();
+    xe::threading::Wait(state_poller_thread_.get(), false);
+  }
+}
 
 X_STATUS InputSystem::Setup() { return X_STATUS_SUCCESS; }
 
@@ -46,6 +74,48 @@ X_RESULT InputSystem::GetCapabilities(uint32_t user_index, uint32_t flags,
 X_RESULT InputSystem::GetState(uint32_t user_index, X_INPUT_STATE* out_state) {
   SCOPE_profile_cpu_f("hid");
 
+  if (cvars::input_poll_rate <= 0 || user_index >= kMaxUsers) {
+    if (!input_latency::IsEnabled() || user_index >= kMaxUsers) {
+      return PollState(user_index, out_state);
+    }
+    // Only for detecting the changes.
+    StateSnapshot snapshot = {};
+    snapshot.result = PollState(user_index, &snapshot.state);
+    snapshot.poll_time_ms = Clock::QueryHostUptimeMillis();
+    {
+      std::lock_guard<std::mutex> lock(state_write_mutex_);
+      WriteStateSnapshot(user_index, snapshot);
+    }
+    if (out_state && snapshot.result == X_ERROR_SUCCESS) {
+      *out_state = snapshot.state;
+    }
+    return snapshot.result;
+  }
+
+  uint64_t now_ms = Clock::QueryHostUptimeMillis();
+  state_query_times_ms_[user_index].store(now_ms, std::memory_order_relaxed);
+  StartStatePoller();
+
+  // Fall back to polling directly if the poller hasn't caught up with the
+  // user yet after a period without requests.
+  uint64_t poll_interval_ms = 1000 / uint64_t(cvars::input_poll_rate);
+  uint64_t max_age_ms = std::max(uint64_t(100), poll_interval_ms * 4);
+  StateSnapshot snapshot = {};
+  if (!ReadStateSnapshot(user_index, snapshot) ||
+      now_ms - snapshot.poll_time_ms > max_age_ms) {
+    snapshot.result = PollState(user_index, &snapshot.state);
+    snapshot.poll_time_ms = now_ms;
+    std::lock_guard<std::mutex> lock(state_write_mutex_);
+    WriteStateSnapshot(user_index, snapshot);
+  }
+  if (out_state && snapshot.result == X_ERROR_SUCCESS) {
+    *out_state = snapshot.state;
+  }
+  return snapshot.result;
+}
+
+X_RESULT InputSystem::PollState(uint32_t user_index,
+                                X_INPUT_STATE* out_state) {
   bool any_connected = false;
   for (auto& driver : drivers_) {
     X_RESULT result = driver->GetState(user_index, out_state);
@@ -93,5 +163,124 @@ X_RESULT InputSystem::GetKeystroke(uint32_t user_index, uint32_t flags,
   return any_connected ? X_ERROR_EMPTY : X_ERROR_DEVICE_NOT_CONNECTED;
 }
 
+bool InputSystem::IsInputChanged(const X_INPUT_GAMEPAD& previous,
+                                 const X_INPUT_GAMEPAD& current) {
+  // Ignoring the noise of the analog controls.
+  const int kTriggerThreshold = 32;
+  const int kThumbThreshold = 4096;
+  return previous.buttons != current.buttons ||
+         std::abs(int(previous.left_trigger) - int(current.left_trigger)) >=
+             kTriggerThreshold ||
+         std::abs(int(previous.right_trigger) - int(current.right_trigger)) >=
+             kTriggerThreshold ||
+         std::abs(int(previous.thumb_lx) - int(current.thumb_lx)) >=
+             kThumbThreshold ||
+         std::abs(int(previous.thumb_ly) - int(current.thumb_ly)) >=
+             kThumbThreshold ||
+         std::abs(int(previous.thumb_rx) - int(current.thumb_rx)) >=
+             kThumbThreshold ||
+         std::abs(int(previous.thumb_ry) - int(current.thumb_ry)) >=
+             kThumbThreshold;
+}
+
+bool InputSystem::ReadStateSnapshot(uint32_t user_index,
+                                    StateSnapshot& snapshot_out) {
+  StateSnapshotSlot& slot = state_snapshots_[user_index];
+  uint64_t words[StateSnapshotSlot::kWordCount];
+  while (true) {
+    uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (!sequence) {
+      return false;
+    }
+    if (sequence & 1) {
+      xe::threading::MaybeYield();
+      continue;
+    }
+    for (size_t i = 0; i < StateSnapshotSlot::kWordCount; ++i) {
+      words[i] = slot.words[i].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) == sequence) {
+      break;
+    }
+  }
+  std::memcpy(&snapshot_out, words, sizeof(StateSnapshot));
+  return true;
+}
+
+void InputSystem::WriteStateSnapshot(uint32_t user_index,
+                                     const StateSnapshot& snapshot) {
+  StateSnapshotSlot& slot = state_snapshots_[user_index];
+  uint64_t words[StateSnapshotSlot::kWordCount] = {};
+  uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+  if (input_latency::IsEnabled() && sequence &&
+      snapshot.result == X_ERROR_SUCCESS) {
+    // The words can't change while the writer lock is held.
+    for (size_t i = 0; i < StateSnapshotSlot::kWordCount; ++i) {
+      words[i] = slot.words[i].load(std::memory_order_relaxed);
+    }
+    StateSnapshot previous;
+    std::memcpy(&previous, words, sizeof(StateSnapshot));
+    if (previous.result != X_ERROR_SUCCESS ||
+        IsInputChanged(previous.state.gamepad, snapshot.state.gamepad)) {
+      input_latency::RecordInputChange();
+    }
+  }
+  std::memcpy(words, &snapshot, sizeof(StateSnapshot));
+  slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (size_t i = 0; i < StateSnapshotSlot::kWordCount; ++i) {
+    slot.words[i].store(words[i], std::memory_order_relaxed);
+  }
+  slot.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void InputSystem::StartStatePoller() {
+  std::call_once(state_poller_started_, [this]() {
+    xe::threading::Thread::CreationParameters params;
+    params.stack_size = 256 * 1024;
+    state_poller_thread_ = xe::threading::Thread::Create(
+        params, [this]() { StatePollerMain(); });
+    assert_not_null(state_poller_thread_);
+    state_poller_thread_->set_name("Input State Poller");
+  });
+}
+
+void InputSystem::StatePollerMain() {
+  auto poll_interval =
+      std::chrono::microseconds(1000000 / cvars::input_poll_rate);
+  uint64_t next_probe_times_ms[kMaxUsers] = {};
+  std::unique_lock<std::mutex> poller_lock(state_poller_mutex_);
+  while (!state_poller_shutting_down_) {
+    poller_lock.unlock();
+    for (uint32_t user_index = 0; user_index < kMaxUsers; ++user_index) {
+      uint64_t now_ms = Clock::QueryHostUptimeMillis();
+      if (now_ms - state_query_times_ms_[user_index].load(
+                       std::memory_order_relaxed) >
+          kStatePollIdleTimeoutMs) {
+        continue;
+      }
+      StateSnapshot snapshot = {};
+      if (!ReadStateSnapshot(user_index, snapshot) ||
+          snapshot.result != X_ERROR_DEVICE_NOT_CONNECTED ||
+          now_ms >= next_probe_times_ms[user_index]) {
+        snapshot.result = PollState(user_index, &snapshot.state);
+        if (snapshot.result == X_ERROR_DEVICE_NOT_CONNECTED) {
+          next_probe_times_ms[user_index] =
+              now_ms + kDisconnectedProbeIntervalMs;
+        }
+      }
+      // Otherwise still considered disconnected until the next probe.
+      snapshot.poll_time_ms = now_ms;
+      std::lock_guard<std::mutex> write_lock(state_write_mutex_);
+      WriteStateSnapshot(user_index, snapshot);
+    }
+    poller_lock.lock();
+    state_poller_cond_.wait_for(poller_lock, poll_interval, [this]() {
+      return state_poller_shutting_down_;
+    });
+  }
+}
+
 }  // namespace hid
 }  // namespace xe
@@ -10,9 +10,14 @@
 #ifndef XENIA_HID_INPUT_SYSTEM_H_
 #define XENIA_HID_INPUT_SYSTEM_H_
 
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
 #include <memory>
+#include <mutex>
 #include <vector>
 
+#include "xenia/base/threading.h"
 #include "xenia/hid/input.h"
 #include "xenia/hid/input_driver.h"
 #include "xenia/xbox.h"
@@ -45,9 +50,53 @@ class InputSystem {
                         X_INPUT_KEYSTROKE* out_keystroke);
 
  private:
+  static constexpr uint32_t kMaxUsers = 4;
+
+  struct StateSnapshot {
+    X_RESULT result;
+    X_INPUT_STATE state;
+    // Host uptime.
+    uint64_t poll_time_ms;
+  };
+  // State of a user published by a single writer at a time through a seqlock,
+  // the data words are atomic only so readers racing with the writer are
+  // well-defined.
+  struct StateSnapshotSlot {
+    static constexpr size_t kWordCount =
+        (sizeof(StateSnapshot) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    // Odd while being written, 0 if never written.
+    std::atomic<uint32_t> sequence{0};
+    std::atomic<uint64_t> words[kWordCount] = {};
+  };
+
+  // Queries the drivers directly.
+  X_RESULT PollState(uint32_t user_index, X_INPUT_STATE* out_state);
+
+  // Whether the change is significant for the latency instrumentation.
+  static bool IsInputChanged(const X_INPUT_GAMEPAD& previous,
+                             const X_INPUT_GAMEPAD& current);
+
+  bool ReadStateSnapshot(uint32_t user_index, StateSnapshot& snapshot_out);
+  // Must be called with state_write_mutex_ held.
+  void WriteStateSnapshot(uint32_t user_index, const StateSnapshot& snapshot);
+  void StartStatePoller();
+  void StatePollerMain();
+
   xe::ui::Window* window_ = nullptr;
 
   std::vector<std::unique_ptr<InputDriver>> drivers_;
+
+  StateSnapshotSlot state_snapshots_[kMaxUsers];
+  std::mutex state_write_mutex_;
+  // Host uptime of the last guest query of each user, only the users queried
+  // recently are polled in the background.
+  std::atomic<uint64_t> state_query_times_ms_[kMaxUsers] = {};
+
+  std::once_flag state_poller_started_;
+  std::mutex state_poller_mutex_;
+  std::condition_variable state_poller_cond_;
+  bool state_poller_shutting_down_ = false;
+  std::unique_ptr<xe::threading::Thread> state_poller_thread_;
 };
 
 }  // namespace hid
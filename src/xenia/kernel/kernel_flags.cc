@@ -9,8 +9,49 @@
 
 #include "xenia/kernel/kernel_flags.h"
 
+#include "xenia/base/logging.h"
+
 DEFINE_bool(headless, false,
             "Don't display any UI, using defaults for prompts as needed.",
             "UI");
+DEFINE_bool(headless_unthrottled, false,
+            "With headless, run as fast as possible for automated testing: "
+            "guest swaps are counted but not waited for or presented (see "
+            "headless_present_interval), and audio is discarded as soon as "
+            "it's submitted unless a specific apu is chosen. Use time_scalar "
+            "to also run the guest clock faster than real time.",
+            "UI");
+DEFINE_int32(headless_present_interval, 0,
+             "With headless_unthrottled, present only every Nth guest swap, or "
+             "none if 0.",
+             "UI");
 DEFINE_bool(log_high_frequency_kernel_calls, false,
             "Log kernel calls with the kHighFrequency tag.", "Kernel");
+DEFINE_bool(profile_kernel_calls, false,
+            "Count the calls and the host time spent in every kernel export, "
+            "per export and per calling thread, and log a report of the most "
+            "expensive ones on shutdown.",
+            "Kernel");
+
+DECLARE_int32(log_level);
+
+namespace xe {
+namespace kernel {
+
+KernelCallFlags kernel_call_flags;
+
+static void UpdateKernelCallFlags() {
+  kernel_call_flags.log_calls =
+      cvars::log_level >= int32_t(xe::LogLevel::Debug);
+  kernel_call_flags.log_important_calls =
+      cvars::log_level >= int32_t(xe::LogLevel::Info);
+  kernel_call_flags.log_high_frequency_calls =
+      cvars::log_high_frequency_kernel_calls;
+  kernel_call_flags.profile_calls = cvars::profile_kernel_calls;
+}
+
+static const bool kernel_call_flags_updater_added_ =
+    (cvar::AddSnapshotUpdater(UpdateKernelCallFlags), true);
+
+}  // namespace kernel
+}  // namespace xe
@@ -12,6 +12,25 @@
 #include "xenia/base/cvar.h"
 
 DECLARE_bool(headless);
+DECLARE_bool(headless_unthrottled);
+DECLARE_int32(headless_present_interval);
 DECLARE_bool(log_high_frequency_kernel_calls);
+DECLARE_bool(profile_kernel_calls);
+
+namespace xe {
+namespace kernel {
+
+// Snapshot of the cvars tested on every kernel call.
+struct alignas(64) KernelCallFlags {
+  // Whether calls would be logged at the log level they're logged at.
+  bool log_calls;
+  bool log_important_calls;
+  bool log_high_frequency_calls;
+  bool profile_calls;
+};
+extern KernelCallFlags kernel_call_flags;
+
+}  // namespace kernel
+}  // namespace xe
 
 #endif  // XENIA_KERNEL_KERNEL_FLAGS_H_
@@ -55,6 +55,12 @@ KernelState::KernelState(Emulator* emulator)
   content_root = std::filesystem::absolute(content_root);
   content_manager_ = std::make_unique<xam::ContentManager>(this, content_root);
 
+  // Two threads, so a read from slow storage doesn't hold up one to an
+  // already cached file.
+  io_worker_pool_ = std::make_unique<util::IoWorkerPool>(2);
+  socket_reactor_ = std::make_unique<util::SocketReactor>();
+  thread_block_pool_ = std::make_unique<util::ThreadBlockPool>(memory_);
+
   assert_null(shared_kernel_state_);
   shared_kernel_state_ = this;
 
@@ -77,9 +83,18 @@ KernelState::~KernelState() {
   user_modules_.clear();
   kernel_modules_.clear();
 
+  // Finish the pending I/O, which holds references to objects.
+  io_worker_pool_.reset();
+  socket_reactor_.reset();
+
   // Delete all objects.
   object_table_.Reset();
 
+  // After the threads have returned their memory to it.
+  thread_block_pool_.reset();
+
+  shim::LogKernelCallProfile();
+
   // Shutdown apps.
   app_manager_.reset();
 
@@ -805,6 +820,10 @@ bool KernelState::Restore(ByteStream* stream) {
     return false;
   }
 
+  // The pooled thread memory belongs to whatever the restored guest memory
+  // has there now.
+  thread_block_pool_->Reset();
+
   // Restore the object table
   object_table_.Restore(stream);
 
@@ -815,6 +834,7 @@ bool KernelState::Restore(ByteStream* stream) {
   for (uint32_t i = 0; i < num_bitmap_entries; i++) {
     tls_bitmap[i] = stream->Read<uint64_t>();
   }
+  tls_bitmap_.UpdateSummary();
 
   uint32_t num_threads = stream->Read<uint32_t>();
   XELOGD("Loading {} threads...", num_threads);
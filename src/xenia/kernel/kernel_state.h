@@ -21,8 +21,11 @@
 #include "xenia/base/cvar.h"
 #include "xenia/base/mutex.h"
 #include "xenia/cpu/export_resolver.h"
+#include "xenia/kernel/util/io_worker_pool.h"
 #include "xenia/kernel/util/native_list.h"
 #include "xenia/kernel/util/object_table.h"
+#include "xenia/kernel/util/socket_reactor.h"
+#include "xenia/kernel/util/thread_block_pool.h"
 #include "xenia/kernel/xam/app_manager.h"
 #include "xenia/kernel/xam/content_manager.h"
 #include "xenia/kernel/xam/user_profile.h"
@@ -107,6 +110,17 @@ class KernelState {
   // Access must be guarded by the global critical region.
   util::ObjectTable* object_table() { return &object_table_; }
 
+  // Threads completing asynchronous file I/O.
+  util::IoWorkerPool* io_worker_pool() { return io_worker_pool_.get(); }
+
+  // Thread completing asynchronous socket operations.
+  util::SocketReactor* socket_reactor() { return socket_reactor_.get(); }
+
+  // Guest memory of exited threads to reuse for new ones.
+  util::ThreadBlockPool* thread_block_pool() {
+    return thread_block_pool_.get();
+  }
+
   uint32_t process_type() const;
   void set_process_type(uint32_t value);
   uint32_t process_info_block_address() const {
@@ -199,6 +213,10 @@ class KernelState {
   std::vector<object_ref<XNotifyListener>> notify_listeners_;
   bool has_notified_startup_ = false;
 
+  std::unique_ptr<util::IoWorkerPool> io_worker_pool_;
+  std::unique_ptr<util::SocketReactor> socket_reactor_;
+  std::unique_ptr<util::ThreadBlockPool> thread_block_pool_;
+
   uint32_t process_type_ = X_PROCTYPE_USER;
   object_ref<UserModule> executable_module_;
   std::vector<object_ref<KernelModule>> kernel_modules_;
@@ -0,0 +1,212 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "xenia/kernel/util/crypto_accel.h"
+
+#include "third_party/catch/include/catch.hpp"
+#include "third_party/crypto/TinySHA1.hpp"
+#include "third_party/crypto/sha256.cpp"
+
+extern "C" {
+#include "third_party/aes_128/aes.h"
+}
+
+namespace xe::kernel::test {
+
+namespace {
+
+std::vector<uint8_t> FromHex(const char* hex) {
+  std::vector<uint8_t> bytes;
+  for (size_t i = 0; hex[i] && hex[i + 1]; i += 2) {
+    bytes.push_back(uint8_t(std::stoul(std::string(hex + i, 2), nullptr, 16)));
+  }
+  return bytes;
+}
+
+// Message padding of FIPS-180, for feeding the block functions directly.
+std::vector<uint8_t> PadShaMessage(const std::string& message) {
+  std::vector<uint8_t> blocks(message.begin(), message.end());
+  blocks.push_back(0x80);
+  while (blocks.size() % 64 != 56) {
+    blocks.push_back(0);
+  }
+  uint64_t bit_length = uint64_t(message.size()) * 8;
+  for (int i = 7; i >= 0; --i) {
+    blocks.push_back(uint8_t(bit_length >> (i * 8)));
+  }
+  return blocks;
+}
+
+template <size_t N>
+std::vector<uint8_t> ShaStateToDigest(const uint32_t (&state)[N]) {
+  std::vector<uint8_t> digest;
+  for (uint32_t value : state) {
+    for (int i = 3; i >= 0; --i) {
+      digest.push_back(uint8_t(value >> (i * 8)));
+    }
+  }
+  return digest;
+}
+
+// FIPS-197 appendix C.1.
+const char kAesEcbKey[] = "000102030405060708090a0b0c0d0e0f";
+const char kAesEcbPlaintext[] = "00112233445566778899aabbccddeeff";
+const char kAesEcbCiphertext[] = "69c4e0d86a7b0430d8cdb78070b4c55a";
+
+// SP 800-38A F.2.1 and F.2.2, the key is also the one of FIPS-197 appendix A.1.
+const char kAesCbcKey[] = "2b7e151628aed2a6abf7158809cf4f3c";
+const char kAesCbcLastRoundKey[] = "d014f9a8c9ee2589e13f0cc8b6630ca6";
+const char kAesCbcIv[] = "000102030405060708090a0b0c0d0e0f";
+const char kAesCbcPlaintext[] =
+    "6bc1bee22e409f96e93d7e117393172a"
+    "ae2d8a571e03ac9c9eb76fac45af8e51"
+    "30c81c46a35ce411e5fbc1191a0a52ef"
+    "f69f2445df4f9b17ad2b417be66c3710";
+const char kAesCbcCiphertext[] =
+    "7649abac8119b246cee98e9b12e9197d"
+    "5086cb9b507219ee95db113a917678b2"
+    "73bed6b8e3c1743b7116e69e22229516"
+    "3ff1caa1681fac09120eca307586e1a7";
+
+struct ShaKnownAnswer {
+  const char* message;
+  const char* digest;
+};
+
+// FIPS-180 examples, one and two blocks long after padding.
+const ShaKnownAnswer kSha1KnownAnswers[] = {
+    {"abc", "a9993e364706816aba3e25717850c26c9cd0d89d"},
+    {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+     "84983e441c3bd26ebaae4aa1f95129e5e54670f1"},
+};
+const ShaKnownAnswer kSha256KnownAnswers[] = {
+    {"abc",
+     "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+    {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+     "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+};
+
+std::vector<uint8_t> ExpandAesKey(const char* key_hex) {
+  std::vector<uint8_t> key = FromHex(key_hex);
+  std::vector<uint8_t> round_keys(11 * 16);
+  aes_key_schedule_128(key.data(), round_keys.data());
+  return round_keys;
+}
+
+}  // namespace
+
+TEST_CASE("AES-128 ECB known answer", "[crypto]") {
+  std::vector<uint8_t> round_keys = ExpandAesKey(kAesEcbKey);
+  std::vector<uint8_t> plaintext = FromHex(kAesEcbPlaintext);
+  std::vector<uint8_t> ciphertext = FromHex(kAesEcbCiphertext);
+  std::vector<uint8_t> output(16);
+
+  aes_encrypt_128(round_keys.data(), plaintext.data(), output.data());
+  REQUIRE(output == ciphertext);
+  aes_decrypt_128(round_keys.data(), ciphertext.data(), output.data());
+  REQUIRE(output == plaintext);
+
+  if (util::HasAesAcceleration()) {
+    util::AesEncryptEcbAccelerated(round_keys.data(), plaintext.data(),
+                                   output.data(), 1);
+    REQUIRE(output == ciphertext);
+    util::AesDecryptEcbAccelerated(round_keys.data(), ciphertext.data(),
+                                   output.data(), 1);
+    REQUIRE(output == plaintext);
+  }
+}
+
+TEST_CASE("AES-128 CBC known answer", "[crypto]") {
+  std::vector<uint8_t> round_keys = ExpandAesKey(kAesCbcKey);
+  // The accelerated functions take the FIPS-197 key schedule as is.
+  REQUIRE(std::vector<uint8_t>(round_keys.end() - 16, round_keys.end()) ==
+          FromHex(kAesCbcLastRoundKey));
+  std::vector<uint8_t> iv = FromHex(kAesCbcIv);
+  std::vector<uint8_t> plaintext = FromHex(kAesCbcPlaintext);
+  std::vector<uint8_t> ciphertext = FromHex(kAesCbcCiphertext);
+  std::vector<uint8_t> last_ciphertext_block(ciphertext.end() - 16,
+                                             ciphertext.end());
+  size_t block_count = plaintext.size() / 16;
+
+  std::vector<uint8_t> feed = iv;
+  for (size_t i = 0; i < block_count; ++i) {
+    for (size_t j = 0; j < 16; ++j) {
+      feed[j] ^= plaintext[i * 16 + j];
+    }
+    aes_encrypt_128(round_keys.data(), feed.data(), feed.data());
+    REQUIRE(std::memcmp(feed.data(), &ciphertext[i * 16], 16) == 0);
+  }
+
+  if (util::HasAesAcceleration()) {
+    std::vector<uint8_t> output(plaintext.size());
+    feed = iv;
+    util::AesEncryptCbcAccelerated(round_keys.data(), plaintext.data(),
+                                   output.data(), block_count, feed.data());
+    REQUIRE(output == ciphertext);
+    REQUIRE(feed == last_ciphertext_block);
+
+    // In place, as the guest may pass the same buffer.
+    output = ciphertext;
+    feed = iv;
+    util::AesDecryptCbcAccelerated(round_keys.data(), output.data(),
+                                   output.data(), block_count, feed.data());
+    REQUIRE(output == plaintext);
+    REQUIRE(feed == last_ciphertext_block);
+  }
+}
+
+TEST_CASE("SHA-1 known answer", "[crypto]") {
+  for (const ShaKnownAnswer& known_answer : kSha1KnownAnswers) {
+    std::string message = known_answer.message;
+    std::vector<uint8_t> expected_digest = FromHex(known_answer.digest);
+
+    sha1::SHA1 sha;
+    sha.processBytes(message.data(), message.size());
+    uint8_t digest[20];
+    sha.finalize(digest);
+    REQUIRE(std::vector<uint8_t>(digest, digest + 20) == expected_digest);
+
+    if (util::HasShaAcceleration()) {
+      std::vector<uint8_t> blocks = PadShaMessage(message);
+      uint32_t state[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476,
+                           0xC3D2E1F0};
+      util::Sha1CompressAccelerated(state, blocks.data(), blocks.size() / 64);
+      REQUIRE(ShaStateToDigest(state) == expected_digest);
+    }
+  }
+}
+
+TEST_CASE("SHA-256 known answer", "[crypto]") {
+  for (const ShaKnownAnswer& known_answer : kSha256KnownAnswers) {
+    std::string message = known_answer.message;
+    std::vector<uint8_t> expected_digest = FromHex(known_answer.digest);
+
+    sha256::SHA256 sha;
+    sha.add(message.data(), message.size());
+    uint8_t digest[32];
+    sha.getHash(digest);
+    REQUIRE(std::vector<uint8_t>(digest, digest + 32) == expected_digest);
+
+    if (util::HasShaAcceleration()) {
+      std::vector<uint8_t> blocks = PadShaMessage(message);
+      uint32_t state[8] = {0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+                           0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19};
+      util::Sha256CompressAccelerated(state, blocks.data(),
+                                      blocks.size() / 64);
+      REQUIRE(ShaStateToDigest(state) == expected_digest);
+    }
+  }
+}
+
+}  // namespace xe::kernel::test
@@ -0,0 +1,11 @@
+project_root = "../../../.."
+include(project_root.."/tools/build")
+
+test_suite("xenia-kernel-tests", project_root, ".", {
+  links = {
+    "aes_128",
+    "fmt",
+    "xenia-base",
+    "xenia-kernel",
+  },
+})
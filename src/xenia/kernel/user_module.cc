@@ -22,6 +22,11 @@
 #include "xenia/vfs/devices/stfs_container_device.h"
 
 DEFINE_bool(xex_apply_patches, true, "Apply XEX patches.", "Kernel");
+DEFINE_bool(xex_cache_images, false,
+            "Store the decrypted, decompressed and patched images of the "
+            "loaded XEX files in the storage root, and load them from there "
+            "on later runs of the same files.",
+            "Kernel");
 
 namespace xe {
 namespace kernel {
@@ -194,6 +199,10 @@ X_STATUS UserModule::LoadFromMemory(const void* addr, const size_t length) {
     // Runtime takes ownership.
     auto xex_module =
         std::make_unique<cpu::XexModule>(processor, kernel_state());
+    if (cvars::xex_cache_images) {
+      xex_module->set_image_cache_dir(
+          kernel_state()->emulator()->storage_root() / "xex");
+    }
     if (!xex_module->Load(name_, path_, addr, length)) {
       return X_STATUS_UNSUCCESSFUL;
     }
@@ -771,6 +780,11 @@ void UserModule::Dump() {
                       library->min_version.build(), library->min_version.qfe());
       sb.AppendFormat("\n");
 
+      bool is_kernel_library = kernel_state_->IsKernelModule(library->name);
+      const cpu::ExportResolver::Table* kernel_table =
+          is_kernel_library ? export_resolver->GetTable(library->name)
+                            : nullptr;
+
       // Counts.
       int known_count = 0;
       int unknown_count = 0;
@@ -780,9 +794,10 @@ void UserModule::Dump() {
       for (std::vector<cpu::XexModule::ImportLibraryFn>::const_iterator info =
                library->imports.begin();
            info != library->imports.end(); ++info) {
-        if (kernel_state_->IsKernelModule(library->name)) {
+        if (is_kernel_library) {
           auto kernel_export =
-              export_resolver->GetExportByOrdinal(library->name, info->ordinal);
+              kernel_table ? kernel_table->GetExportByOrdinal(info->ordinal)
+                           : nullptr;
           if (kernel_export) {
             known_count++;
             if (kernel_export->is_implemented()) {
@@ -830,9 +845,10 @@ void UserModule::Dump() {
         bool implemented = false;
 
         cpu::Export* kernel_export = nullptr;
-        if (kernel_state_->IsKernelModule(library->name)) {
-          kernel_export =
-              export_resolver->GetExportByOrdinal(library->name, info->ordinal);
+        if (is_kernel_library) {
+          if (kernel_table) {
+            kernel_export = kernel_table->GetExportByOrdinal(info->ordinal);
+          }
           if (kernel_export) {
             name = kernel_export->name;
             implemented = kernel_export->is_implemented();
@@ -0,0 +1,426 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/util/crypto_accel.h"
+
+#include <utility>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/platform.h"
+
+#if XE_ARCH_AMD64 && !XE_COMPILER_MSVC
+#include <cpuid.h>
+#endif  // XE_ARCH_AMD64 && !XE_COMPILER_MSVC
+
+namespace xe {
+namespace kernel {
+namespace util {
+
+#if XE_ARCH_AMD64
+
+#if XE_COMPILER_MSVC
+#define XE_TARGET_AES
+#define XE_TARGET_SHA
+#else
+#define XE_TARGET_AES __attribute__((target("aes,sse4.1")))
+#define XE_TARGET_SHA __attribute__((target("sha,sse4.1")))
+#endif  // XE_COMPILER_MSVC
+
+namespace {
+
+struct CryptoExtensions {
+  bool aes = false;
+  bool sha = false;
+};
+
+CryptoExtensions GetSupportedCryptoExtensions() {
+  CryptoExtensions extensions;
+  int registers[4];
+#if XE_COMPILER_MSVC
+  __cpuid(registers, 0);
+#else
+  __cpuid(0, registers[0], registers[1], registers[2], registers[3]);
+#endif  // XE_COMPILER_MSVC
+  int max_leaf = registers[0];
+  if (max_leaf < 1) {
+    return extensions;
+  }
+#if XE_COMPILER_MSVC
+  __cpuid(registers, 1);
+#else
+  __cpuid(1, registers[0], registers[1], registers[2], registers[3]);
+#endif  // XE_COMPILER_MSVC
+  // SSE4.1 is used for the inserts, extracts and blends around the rounds.
+  bool sse4_1 = (registers[2] & (1 << 19)) != 0;
+  extensions.aes = sse4_1 && (registers[2] & (1 << 25));
+  if (sse4_1 && max_leaf >= 7) {
+#if XE_COMPILER_MSVC
+    __cpuidex(registers, 7, 0);
+#else
+    __cpuid_count(7, 0, registers[0], registers[1], registers[2],
+                  registers[3]);
+#endif  // XE_COMPILER_MSVC
+    extensions.sha = (registers[1] & (1 << 29)) != 0;
+  }
+  return extensions;
+}
+
+const CryptoExtensions& GetCryptoExtensions() {
+  static const CryptoExtensions extensions = GetSupportedCryptoExtensions();
+  return extensions;
+}
+
+XE_TARGET_AES void LoadAesEncryptionKeys(const uint8_t* round_keys,
+                                         __m128i keys[11]) {
+  for (uint32_t i = 0; i < 11; ++i) {
+    keys[i] =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(round_keys + i * 16));
+  }
+}
+
+// The equivalent inverse cipher of aesdec needs the middle round keys passed
+// through InvMixColumns, in the reverse order.
+XE_TARGET_AES void LoadAesDecryptionKeys(const uint8_t* round_keys,
+                                         __m128i keys[11]) {
+  __m128i encryption_keys[11];
+  LoadAesEncryptionKeys(round_keys, encryption_keys);
+  keys[0] = encryption_keys[10];
+  for (uint32_t i = 1; i < 10; ++i) {
+    keys[i] = _mm_aesimc_si128(encryption_keys[10 - i]);
+  }
+  keys[10] = encryption_keys[0];
+}
+
+XE_TARGET_AES inline __m128i AesEncryptBlock(const __m128i keys[11],
+                                             __m128i block) {
+  block = _mm_xor_si128(block, keys[0]);
+  for (uint32_t i = 1; i < 10; ++i) {
+    block = _mm_aesenc_si128(block, keys[i]);
+  }
+  return _mm_aesenclast_si128(block, keys[10]);
+}
+
+XE_TARGET_AES inline __m128i AesDecryptBlock(const __m128i keys[11],
+                                             __m128i block) {
+  block = _mm_xor_si128(block, keys[0]);
+  for (uint32_t i = 1; i < 10; ++i) {
+    block = _mm_aesdec_si128(block, keys[i]);
+  }
+  return _mm_aesdeclast_si128(block, keys[10]);
+}
+
+// Decrypts 4 independent blocks at once to hide the latency of aesdec.
+XE_TARGET_AES inline void AesDecryptBlocks4(const __m128i keys[11],
+                                            __m128i blocks[4]) {
+  for (uint32_t j = 0; j < 4; ++j) {
+    blocks[j] = _mm_xor_si128(blocks[j], keys[0]);
+  }
+  for (uint32_t i = 1; i < 10; ++i) {
+    for (uint32_t j = 0; j < 4; ++j) {
+      blocks[j] = _mm_aesdec_si128(blocks[j], keys[i]);
+    }
+  }
+  for (uint32_t j = 0; j < 4; ++j) {
+    blocks[j] = _mm_aesdeclast_si128(blocks[j], keys[10]);
+  }
+}
+
+XE_TARGET_AES void AesEncryptEcb(const uint8_t* round_keys,
+                                 const uint8_t* input, uint8_t* output,
+                                 size_t block_count) {
+  __m128i keys[11];
+  LoadAesEncryptionKeys(round_keys, keys);
+  for (size_t i = 0; i < block_count; ++i) {
+    __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i * 16));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i * 16),
+                     AesEncryptBlock(keys, block));
+  }
+}
+
+XE_TARGET_AES void AesDecryptEcb(const uint8_t* round_keys,
+                                 const uint8_t* input, uint8_t* output,
+                                 size_t block_count) {
+  __m128i keys[11];
+  LoadAesDecryptionKeys(round_keys, keys);
+  size_t i = 0;
+  for (; i + 4 <= block_count; i += 4) {
+    __m128i blocks[4];
+    for (uint32_t j = 0; j < 4; ++j) {
+      blocks[j] = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(input + (i + j) * 16));
+    }
+    AesDecryptBlocks4(keys, blocks);
+    for (uint32_t j = 0; j < 4; ++j) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + (i + j) * 16),
+                       blocks[j]);
+    }
+  }
+  for (; i < block_count; ++i) {
+    __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i * 16));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i * 16),
+                     AesDecryptBlock(keys, block));
+  }
+}
+
+XE_TARGET_AES void AesEncryptCbc(const uint8_t* round_keys,
+                                 const uint8_t* input, uint8_t* output,
+                                 size_t block_count, uint8_t* feed) {
+  __m128i keys[11];
+  LoadAesEncryptionKeys(round_keys, keys);
+  __m128i chain = _mm_loadu_si128(reinterpret_cast<const __m128i*>(feed));
+  for (size_t i = 0; i < block_count; ++i) {
+    __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i * 16));
+    chain = AesEncryptBlock(keys, _mm_xor_si128(block, chain));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i * 16), chain);
+  }
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(feed), chain);
+}
+
+// Unlike encryption, CBC decryption of the blocks is independent, only the
+// XOR with the previous ciphertext block chains them.
+XE_TARGET_AES void AesDecryptCbc(const uint8_t* round_keys,
+                                 const uint8_t* input, uint8_t* output,
+                                 size_t block_count, uint8_t* feed) {
+  __m128i keys[11];
+  LoadAesDecryptionKeys(round_keys, keys);
+  __m128i chain = _mm_loadu_si128(reinterpret_cast<const __m128i*>(feed));
+  size_t i = 0;
+  for (; i + 4 <= block_count; i += 4) {
+    // Loaded before storing anything in case input and output are the same.
+    __m128i ciphertext[4], blocks[4];
+    for (uint32_t j = 0; j < 4; ++j) {
+      ciphertext[j] = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(input + (i + j) * 16));
+      blocks[j] = ciphertext[j];
+    }
+    AesDecryptBlocks4(keys, blocks);
+    for (uint32_t j = 0; j < 4; ++j) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + (i + j) * 16),
+                       _mm_xor_si128(blocks[j], chain));
+      chain = ciphertext[j];
+    }
+  }
+  for (; i < block_count; ++i) {
+    __m128i ciphertext =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i * 16));
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(output + i * 16),
+        _mm_xor_si128(AesDecryptBlock(keys, ciphertext), chain));
+    chain = ciphertext;
+  }
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(feed), chain);
+}
+
+// SHA-1 rounds 4 * g to 4 * g + 3. The message words for them are computed
+// from the 4 previous groups, which are kept in a ring of 4 registers.
+template <uint32_t g>
+XE_TARGET_SHA inline void Sha1Rounds4(__m128i& abcd, __m128i& e,
+                                      __m128i& previous_abcd, __m128i w[4]) {
+  if constexpr (g >= 4) {
+    w[g & 3] = _mm_sha1msg2_epu32(
+        _mm_xor_si128(_mm_sha1msg1_epu32(w[g & 3], w[(g + 1) & 3]),
+                      w[(g + 2) & 3]),
+        w[(g + 3) & 3]);
+  }
+  if constexpr (g != 0) {
+    e = _mm_sha1nexte_epu32(previous_abcd, w[g & 3]);
+  } else {
+    e = _mm_add_epi32(e, w[0]);
+  }
+  previous_abcd = abcd;
+  abcd = _mm_sha1rnds4_epu32(abcd, e, g / 5);
+}
+
+template <uint32_t... kGroups>
+XE_TARGET_SHA inline void Sha1Rounds(__m128i& abcd, __m128i& e,
+                                     __m128i& previous_abcd, __m128i w[4],
+                                     std::integer_sequence<uint32_t,
+                                                           kGroups...>) {
+  (Sha1Rounds4<kGroups>(abcd, e, previous_abcd, w), ...);
+}
+
+XE_TARGET_SHA void Sha1Compress(uint32_t state[5], const uint8_t* blocks,
+                                size_t block_count) {
+  const __m128i byte_swap_mask =
+      _mm_set_epi64x(0x0001020304050607ULL, 0x08090A0B0C0D0E0FULL);
+  __m128i abcd = _mm_shuffle_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1B);
+  __m128i e0 = _mm_set_epi32(int(state[4]), 0, 0, 0);
+  for (size_t i = 0; i < block_count; ++i) {
+    const uint8_t* block = blocks + i * 64;
+    __m128i abcd_save = abcd;
+    __m128i e0_save = e0;
+    __m128i w[4];
+    for (uint32_t j = 0; j < 4; ++j) {
+      w[j] = _mm_shuffle_epi8(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + j * 16)),
+          byte_swap_mask);
+    }
+    __m128i e = e0;
+    __m128i previous_abcd = abcd;
+    Sha1Rounds(abcd, e, previous_abcd, w,
+               std::make_integer_sequence<uint32_t, 20>());
+    // E after the last rounds is derived from A before them.
+    e0 = _mm_sha1nexte_epu32(previous_abcd, e0_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+  }
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state),
+                   _mm_shuffle_epi32(abcd, 0x1B));
+  state[4] = uint32_t(_mm_extract_epi32(e0, 3));
+}
+
+alignas(16) const uint32_t kSha256RoundConstants[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1,
+    0x923F82A4, 0xAB1C5ED5, 0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3,
+    0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174, 0xE49B69C1, 0xEFBE4786,
+    0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147,
+    0x06CA6351, 0x14292967, 0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13,
+    0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85, 0xA2BFE8A1, 0xA81A664B,
+    0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A,
+    0x5B9CCA4F, 0x682E6FF3, 0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208,
+    0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+
+XE_TARGET_SHA void Sha256Compress(uint32_t state[8], const uint8_t* blocks,
+                                  size_t block_count) {
+  const __m128i byte_swap_mask =
+      _mm_set_epi64x(0x0C0D0E0F08090A0BULL, 0x0405060700010203ULL);
+  // The rounds work on the state as ABEF and CDGH.
+  __m128i dcba = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state));
+  __m128i hgfe = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4));
+  __m128i cdab = _mm_shuffle_epi32(dcba, 0xB1);
+  __m128i efgh = _mm_shuffle_epi32(hgfe, 0x1B);
+  __m128i abef = _mm_alignr_epi8(cdab, efgh, 8);
+  __m128i cdgh = _mm_blend_epi16(efgh, cdab, 0xF0);
+  for (size_t i = 0; i < block_count; ++i) {
+    const uint8_t* block = blocks + i * 64;
+    __m128i abef_save = abef;
+    __m128i cdgh_save = cdgh;
+    __m128i w[4];
+    for (uint32_t g = 0; g < 16; ++g) {
+      if (g < 4) {
+        w[g] = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + g * 16)),
+            byte_swap_mask);
+      } else {
+        w[g & 3] = _mm_sha256msg2_epu32(
+            _mm_add_epi32(_mm_sha256msg1_epu32(w[g & 3], w[(g + 1) & 3]),
+                          _mm_alignr_epi8(w[(g + 3) & 3], w[(g + 2) & 3], 4)),
+            w[(g + 3) & 3]);
+      }
+      __m128i message = _mm_add_epi32(
+          w[g & 3], _mm_load_si128(reinterpret_cast<const __m128i*>(
+                        kSha256RoundConstants + g * 4)));
+      cdgh = _mm_sha256rnds2_epu32(cdgh, abef, message);
+      abef = _mm_sha256rnds2_epu32(abef, cdgh,
+                                   _mm_shuffle_epi32(message, 0x0E));
+    }
+    abef = _mm_add_epi32(abef, abef_save);
+    cdgh = _mm_add_epi32(cdgh, cdgh_save);
+  }
+  __m128i feba = _mm_shuffle_epi32(abef, 0x1B);
+  __m128i dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state),
+                   _mm_blend_epi16(feba, dchg, 0xF0));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4),
+                   _mm_alignr_epi8(dchg, feba, 8));
+}
+
+}  // namespace
+
+bool HasAesAcceleration() { return GetCryptoExtensions().aes; }
+
+void AesEncryptEcbAccelerated(const uint8_t* round_keys, const uint8_t* input,
+                              uint8_t* output, size_t block_count) {
+  assert_true(HasAesAcceleration());
+  AesEncryptEcb(round_keys, input, output, block_count);
+}
+
+void AesDecryptEcbAccelerated(const uint8_t* round_keys, const uint8_t* input,
+                              uint8_t* output, size_t block_count) {
+  assert_true(HasAesAcceleration());
+  AesDecryptEcb(round_keys, input, output, block_count);
+}
+
+void AesEncryptCbcAccelerated(const uint8_t* round_keys, const uint8_t* input,
+                              uint8_t* output, size_t block_count,
+                              uint8_t* feed) {
+  assert_true(HasAesAcceleration());
+  AesEncryptCbc(round_keys, input, output, block_count, feed);
+}
+
+void AesDecryptCbcAccelerated(const uint8_t* round_keys, const uint8_t* input,
+                              uint8_t* output, size_t block_count,
+                              uint8_t* feed) {
+  assert_true(HasAesAcceleration());
+  AesDecryptCbc(round_keys, input, output, block_count, feed);
+}
+
+bool HasShaAcceleration() { return GetCryptoExtensions().sha; }
+
+void Sha1CompressAccelerated(uint32_t state[5], const uint8_t* blocks,
+                             size_t block_count) {
+  assert_true(HasShaAcceleration());
+  Sha1Compress(state, blocks, block_count);
+}
+
+void Sha256CompressAccelerated(uint32_t state[8], const uint8_t* blocks,
+                               size_t block_count) {
+  assert_true(HasShaAcceleration());
+  Sha256Compress(state, blocks, block_count);
+}
+
+#else
+
+bool HasAesAcceleration() { return false; }
+
+void AesEncryptEcbAccelerated(const uint8_t* round_keys, const uint8_t* input,
+                              uint8_t* output, size_t block_count) {
+  assert_always();
+}
+
+void AesDecryptEcbAccelerated(const uint8_t* round_keys, const uint8_t* input,
+                              uint8_t* output, size_t block_count) {
+  assert_always();
+}
+
+void AesEncryptCbcAccelerated(const uint8_t* round_keys, const uint8_t* input,
+                              uint8_t* output, size_t block_count,
+                              uint8_t* feed) {
+  assert_always();
+}
+
+void AesDecryptCbcAccelerated(const uint8_t* round_keys, const uint8_t* input,
+                              uint8_t* output, size_t block_count,
+                              uint8_t* feed) {
+  assert_always();
+}
+
+bool HasShaAcceleration() { return false; }
+
+void Sha1CompressAccelerated(uint32_t state[5], const uint8_t* blocks,
+                             size_t block_count) {
+  assert_always();
+}
+
+void Sha256CompressAccelerated(uint32_t state[8], const uint8_t* blocks,
+                               size_t block_count) {
+  assert_always();
+}
+
+#endif  // XE_ARCH_AMD64
+
+}  // namespace util
+}  // namespace kernel
+}  // namespace xe
@@ -0,0 +1,53 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_KERNEL_UTIL_CRYPTO_ACCEL_H_
+#define XENIA_KERNEL_UTIL_CRYPTO_ACCEL_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace xe {
+namespace kernel {
+namespace util {
+
+// AES-128 and SHA block functions using the AES-NI and SHA extensions of the
+// host CPU. They may only be called if the respective Has*Acceleration()
+// returns true, otherwise the portable implementations must be used.
+
+bool HasAesAcceleration();
+
+// round_keys is the AES-128 encryption key schedule, 11 round keys of 16 bytes
+// in the byte order of FIPS-197. The decryption functions derive the inverse
+// key schedule from it themselves. Input and output may be the same.
+void AesEncryptEcbAccelerated(const uint8_t* round_keys, const uint8_t* input,
+                              uint8_t* output, size_t block_count);
+void AesDecryptEcbAccelerated(const uint8_t* round_keys, const uint8_t* input,
+                              uint8_t* output, size_t block_count);
+// feed is the IV on entry and the last ciphertext block on return.
+void AesEncryptCbcAccelerated(const uint8_t* round_keys, const uint8_t* input,
+                              uint8_t* output, size_t block_count,
+                              uint8_t* feed);
+void AesDecryptCbcAccelerated(const uint8_t* round_keys, const uint8_t* input,
+                              uint8_t* output, size_t block_count,
+                              uint8_t* feed);
+
+bool HasShaAcceleration();
+
+// Updates the hash values (in host byte order) with whole 64-byte blocks.
+void Sha1CompressAccelerated(uint32_t state[5], const uint8_t* blocks,
+                             size_t block_count);
+void Sha256CompressAccelerated(uint32_t state[8], const uint8_t* blocks,
+                               size_t block_count);
+
+}  // namespace util
+}  // namespace kernel
+}  // namespace xe
+
+#endif  // XENIA_KERNEL_UTIL_CRYPTO_ACCEL_H_
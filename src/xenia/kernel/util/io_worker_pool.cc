@@ -0,0 +1,77 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/util/io_worker_pool.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/assert.h"
+
+namespace xe {
+namespace kernel {
+namespace util {
+
+IoWorkerPool::IoWorkerPool(uint32_t thread_count)
+    : thread_count_(std::max(thread_count, uint32_t(1))) {}
+
+IoWorkerPool::~IoWorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutting_down_ = true;
+  }
+  cond_.notify_all();
+  for (auto& thread : threads_) {
+    xe::threading::Wait(thread.get(), false);
+  }
+  assert_true(queue_.empty());
+}
+
+void IoWorkerPool::Queue(std::function<void()> work) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    assert_false(shutting_down_);
+    queue_.push_back(std::move(work));
+    if (threads_.empty()) {
+      for (uint32_t i = 0; i < thread_count_; ++i) {
+        xe::threading::Thread::CreationParameters params;
+        params.stack_size = 256 * 1024;
+        auto thread = xe::threading::Thread::Create(
+            params, [this]() { WorkerMain(); });
+        assert_not_null(thread);
+        thread->set_name(fmt::format("I/O Worker {}", i));
+        xe::threading::ApplyThreadRole(thread.get(),
+                                       xe::threading::ThreadRole::kIo);
+        threads_.push_back(std::move(thread));
+      }
+    }
+  }
+  cond_.notify_one();
+}
+
+void IoWorkerPool::WorkerMain() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cond_.wait(lock, [this]() { return shutting_down_ || !queue_.empty(); });
+    if (queue_.empty()) {
+      // Shutting down with nothing left to do.
+      return;
+    }
+    std::function<void()> work = std::move(queue_.front());
+    queue_.pop_front();
+    lock.unlock();
+    work();
+    lock.lock();
+  }
+}
+
+}  // namespace util
+}  // namespace kernel
+}  // namespace xe
@@ -0,0 +1,57 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_KERNEL_UTIL_IO_WORKER_POOL_H_
+#define XENIA_KERNEL_UTIL_IO_WORKER_POOL_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace kernel {
+namespace util {
+
+// Host threads performing the I/O requested by the guest on handles opened for
+// asynchronous access, so guest threads don't block on host storage latency.
+// Work items are started in the order they're queued, but with more than one
+// thread they may complete in any order.
+class IoWorkerPool {
+ public:
+  explicit IoWorkerPool(uint32_t thread_count);
+  // Completes all the queued work before returning.
+  ~IoWorkerPool();
+
+  // Runs the function on one of the worker threads, which are created on the
+  // first use.
+  void Queue(std::function<void()> work);
+
+ private:
+  void WorkerMain();
+
+  uint32_t thread_count_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<std::function<void()>> queue_;
+  bool shutting_down_ = false;
+  std::vector<std::unique_ptr<xe::threading::Thread>> threads_;
+};
+
+}  // namespace util
+}  // namespace kernel
+}  // namespace xe
+
+#endif  // XENIA_KERNEL_UTIL_IO_WORKER_POOL_H_
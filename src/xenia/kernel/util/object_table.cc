@@ -11,9 +11,11 @@
 
 #include <algorithm>
 #include <cstring>
+#include <new>
 
 #include "xenia/base/byte_stream.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/threading.h"
 #include "xenia/kernel/xobject.h"
 #include "xenia/kernel/xthread.h"
 
@@ -28,32 +30,39 @@ ObjectTable::~ObjectTable() { Reset(); }
 void ObjectTable::Reset() {
   auto global_lock = global_critical_region_.Acquire();
 
+  Table* table = table_.exchange(nullptr);
+  last_free_entry_ = 0;
+  if (!table) {
+    return;
+  }
+  WaitForLookups();
+
   // Release all objects.
-  for (uint32_t n = 0; n < table_capacity_; n++) {
-    ObjectTableEntry& entry = table_[n];
-    if (entry.object) {
-      entry.object->Release();
+  for (uint32_t n = 0; n < table->capacity; n++) {
+    XObject* object = table->entries[n].object.load(std::memory_order_relaxed);
+    if (object) {
+      object->Release();
     }
   }
 
-  table_capacity_ = 0;
-  last_free_entry_ = 0;
-  free(table_);
-  table_ = nullptr;
+  delete table;
 }
 
 X_STATUS ObjectTable::FindFreeSlot(uint32_t* out_slot) {
+  Table* table = table_.load(std::memory_order_relaxed);
+  uint32_t table_capacity = table ? table->capacity : 0;
+
   // Find a free slot.
   uint32_t slot = last_free_entry_;
   uint32_t scan_count = 0;
-  while (scan_count < table_capacity_) {
-    ObjectTableEntry& entry = table_[slot];
-    if (!entry.object) {
+  while (scan_count < table_capacity) {
+    ObjectTableEntry& entry = table->entries[slot];
+    if (!entry.object.load(std::memory_order_relaxed)) {
       *out_slot = slot;
       return X_STATUS_SUCCESS;
     }
     scan_count++;
-    slot = (slot + 1) % table_capacity_;
+    slot = (slot + 1) % table_capacity;
     if (slot == 0) {
       // Never allow 0 handles.
       scan_count++;
@@ -62,7 +71,7 @@ X_STATUS ObjectTable::FindFreeSlot(uint32_t* out_slot) {
   }
 
   // Table out of slots, expand.
-  uint32_t new_table_capacity = std::max(16 * 1024u, table_capacity_ * 2);
+  uint32_t new_table_capacity = std::max(16 * 1024u, table_capacity * 2);
   if (!Resize(new_table_capacity)) {
     return X_STATUS_NO_MEMORY;
   }
@@ -75,27 +84,52 @@ X_STATUS ObjectTable::FindFreeSlot(uint32_t* out_slot) {
 }
 
 bool ObjectTable::Resize(uint32_t new_capacity) {
-  uint32_t new_size = new_capacity * sizeof(ObjectTableEntry);
-  uint32_t old_size = table_capacity_ * sizeof(ObjectTableEntry);
-  auto new_table =
-      reinterpret_cast<ObjectTableEntry*>(realloc(table_, new_size));
+  Table* old_table = table_.load(std::memory_order_relaxed);
+  uint32_t old_capacity = old_table ? old_table->capacity : 0;
+
+  auto new_table = new (std::nothrow) Table;
   if (!new_table) {
     return false;
   }
+  new_table->capacity = new_capacity;
+  new_table->entries.reset(new (std::nothrow) ObjectTableEntry[new_capacity]);
+  if (!new_table->entries) {
+    delete new_table;
+    return false;
+  }
+  uint32_t copy_count = std::min(old_capacity, new_capacity);
+  for (uint32_t i = 0; i < copy_count; ++i) {
+    const ObjectTableEntry& old_entry = old_table->entries[i];
+    ObjectTableEntry& new_entry = new_table->entries[i];
+    new_entry.handle_ref_count = old_entry.handle_ref_count;
+    new_entry.object.store(old_entry.object.load(std::memory_order_relaxed),
+                           std::memory_order_relaxed);
+  }
 
-  // Zero out new entries.
-  if (new_size > old_size) {
-    std::memset(reinterpret_cast<uint8_t*>(new_table) + old_size, 0,
-                new_size - old_size);
+  table_.store(new_table, std::memory_order_seq_cst);
+  if (old_table) {
+    // Removals after this will only be done in the new table, so lookups must
+    // not be able to see the old one anymore.
+    WaitForLookups();
+    delete old_table;
   }
 
-  last_free_entry_ = table_capacity_;
-  table_capacity_ = new_capacity;
-  table_ = new_table;
+  last_free_entry_ = old_capacity;
 
   return true;
 }
 
+void ObjectTable::WaitForLookups() {
+  // Lookups entering from now on will see the current state of the table, and
+  // will be counted for the new epoch, so only the ones counted for the
+  // previous epoch need to be waited for.
+  uint32_t epoch = lookup_epoch_.load(std::memory_order_relaxed);
+  lookup_epoch_.store(epoch + 1, std::memory_order_seq_cst);
+  while (lookup_counts_[epoch & 1].load(std::memory_order_seq_cst)) {
+    xe::threading::MaybeYield();
+  }
+}
+
 X_STATUS ObjectTable::AddHandle(XObject* object, X_HANDLE* out_handle) {
   X_STATUS result = X_STATUS_SUCCESS;
 
@@ -109,14 +143,15 @@ X_STATUS ObjectTable::AddHandle(XObject* object, X_HANDLE* out_handle) {
 
     // Stash.
     if (XSUCCEEDED(result)) {
-      ObjectTableEntry& entry = table_[slot];
-      entry.object = object;
+      ObjectTableEntry& entry =
+          table_.load(std::memory_order_relaxed)->entries[slot];
       entry.handle_ref_count = 1;
       handle = XObject::kHandleBase + (slot << 2);
       object->handles().push_back(handle);
 
       // Retain so long as the object is in the table.
       object->Retain();
+      entry.object.store(object, std::memory_order_release);
 
       XELOGI("Added handle:{:08X} for {}", handle, typeid(*object).name());
     }
@@ -135,7 +170,7 @@ X_STATUS ObjectTable::DuplicateHandle(X_HANDLE handle, X_HANDLE* out_handle) {
   X_STATUS result = X_STATUS_SUCCESS;
   handle = TranslateHandle(handle);
 
-  XObject* object = LookupObject(handle, false);
+  XObject* object = LookupAndRetainObject(handle);
   if (object) {
     result = AddHandle(object, out_handle);
     object->Release();  // Release the ref that LookupObject took
@@ -184,15 +219,15 @@ X_STATUS ObjectTable::RemoveHandle(X_HANDLE handle) {
     return X_STATUS_INVALID_HANDLE;
   }
 
+  auto global_lock = global_critical_region_.Acquire();
   ObjectTableEntry* entry = LookupTable(handle);
   if (!entry) {
     return X_STATUS_INVALID_HANDLE;
   }
 
-  auto global_lock = global_critical_region_.Acquire();
-  if (entry->object) {
-    auto object = entry->object;
-    entry->object = nullptr;
+  auto object = entry->object.load(std::memory_order_relaxed);
+  if (object) {
+    entry->object.store(nullptr, std::memory_order_seq_cst);
     assert_zero(entry->handle_ref_count);
     entry->handle_ref_count = 0;
 
@@ -205,7 +240,9 @@ X_STATUS ObjectTable::RemoveHandle(X_HANDLE handle) {
 
     XELOGI("Removed handle:{:08X} for {}", handle, typeid(*object).name());
 
-    // Release now that the object has been removed from the table.
+    // Release now that the object has been removed from the table, and no
+    // lookup can be retaining it anymore.
+    WaitForLookups();
     object->Release();
   }
 
@@ -216,12 +253,15 @@ std::vector<object_ref<XObject>> ObjectTable::GetAllObjects() {
   auto lock = global_critical_region_.Acquire();
   std::vector<object_ref<XObject>> results;
 
-  for (uint32_t slot = 0; slot < table_capacity_; slot++) {
-    auto& entry = table_[slot];
-    if (entry.object && std::find(results.begin(), results.end(),
-                                  entry.object) == results.end()) {
-      entry.object->Retain();
-      results.push_back(object_ref<XObject>(entry.object));
+  Table* table = table_.load(std::memory_order_relaxed);
+  uint32_t table_capacity = table ? table->capacity : 0;
+  for (uint32_t slot = 0; slot < table_capacity; slot++) {
+    XObject* object =
+        table->entries[slot].object.load(std::memory_order_relaxed);
+    if (object &&
+        std::find(results.begin(), results.end(), object) == results.end()) {
+      object->Retain();
+      results.push_back(object_ref<XObject>(object));
     }
   }
 
@@ -230,13 +270,23 @@ std::vector<object_ref<XObject>> ObjectTable::GetAllObjects() {
 
 void ObjectTable::PurgeAllObjects() {
   auto lock = global_critical_region_.Acquire();
-  for (uint32_t slot = 0; slot < table_capacity_; slot++) {
-    auto& entry = table_[slot];
-    if (entry.object && !entry.object->is_host_object()) {
+  Table* table = table_.load(std::memory_order_relaxed);
+  uint32_t table_capacity = table ? table->capacity : 0;
+  std::vector<XObject*> purged_objects;
+  for (uint32_t slot = 0; slot < table_capacity; slot++) {
+    auto& entry = table->entries[slot];
+    XObject* object = entry.object.load(std::memory_order_relaxed);
+    if (object && !object->is_host_object()) {
       entry.handle_ref_count = 0;
-      entry.object->Release();
+      entry.object.store(nullptr, std::memory_order_seq_cst);
+      purged_objects.push_back(object);
+    }
+  }
 
-      entry.object = nullptr;
+  if (!purged_objects.empty()) {
+    WaitForLookups();
+    for (XObject* object : purged_objects) {
+      object->Release();
     }
   }
 }
@@ -251,8 +301,9 @@ ObjectTable::ObjectTableEntry* ObjectTable::LookupTable(X_HANDLE handle) {
 
   // Lower 2 bits are ignored.
   uint32_t slot = GetHandleSlot(handle);
-  if (slot <= table_capacity_) {
-    return &table_[slot];
+  Table* table = table_.load(std::memory_order_relaxed);
+  if (table && slot < table->capacity) {
+    return &table->entries[slot];
   }
 
   return nullptr;
@@ -261,31 +312,45 @@ ObjectTable::ObjectTableEntry* ObjectTable::LookupTable(X_HANDLE handle) {
 // Generic lookup
 template <>
 object_ref<XObject> ObjectTable::LookupObject<XObject>(X_HANDLE handle) {
-  auto object = ObjectTable::LookupObject(handle, false);
+  auto object = ObjectTable::LookupAndRetainObject(handle);
   auto result = object_ref<XObject>(reinterpret_cast<XObject*>(object));
   return result;
 }
 
-XObject* ObjectTable::LookupObject(X_HANDLE handle, bool already_locked) {
+XObject* ObjectTable::LookupAndRetainObject(X_HANDLE handle) {
   handle = TranslateHandle(handle);
   if (!handle) {
     return nullptr;
   }
 
-  XObject* object = nullptr;
-  if (!already_locked) {
-    global_critical_region_.mutex().lock();
+  // This is done on nearly every kernel call taking a handle, so instead of
+  // locking, the lookup is counted for the current epoch, and removals wait
+  // for the count to drop to zero before releasing the objects and the tables
+  // that were removed.
+  // If the epoch was switched between reading it and counting the lookup,
+  // WaitForLookups may already have seen the count of the previous epoch
+  // without this lookup, so it's counted again for the new one.
+  uint32_t epoch_index = lookup_epoch_.load(std::memory_order_relaxed) & 1;
+  while (true) {
+    lookup_counts_[epoch_index].fetch_add(1, std::memory_order_seq_cst);
+    uint32_t current_epoch_index =
+        lookup_epoch_.load(std::memory_order_seq_cst) & 1;
+    if (current_epoch_index == epoch_index) {
+      break;
+    }
+    lookup_counts_[epoch_index].fetch_sub(1, std::memory_order_release);
+    epoch_index = current_epoch_index;
   }
 
+  XObject* object = nullptr;
+
   // Lower 2 bits are ignored.
   uint32_t slot = GetHandleSlot(handle);
 
   // Verify slot.
-  if (slot < table_capacity_) {
-    ObjectTableEntry& entry = table_[slot];
-    if (entry.object) {
-      object = entry.object;
-    }
+  Table* table = table_.load(std::memory_order_seq_cst);
+  if (table && slot < table->capacity) {
+    object = table->entries[slot].object.load(std::memory_order_seq_cst);
   }
 
   // Retain the object pointer.
@@ -293,9 +358,7 @@ XObject* ObjectTable::LookupObject(X_HANDLE handle, bool already_locked) {
     object->Retain();
   }
 
-  if (!already_locked) {
-    global_critical_region_.mutex().unlock();
-  }
+  lookup_counts_[epoch_index].fetch_sub(1, std::memory_order_release);
 
   return object;
 }
@@ -303,12 +366,15 @@ XObject* ObjectTable::LookupObject(X_HANDLE handle, bool already_locked) {
 void ObjectTable::GetObjectsByType(XObject::Type type,
                                    std::vector<object_ref<XObject>>* results) {
   auto global_lock = global_critical_region_.Acquire();
-  for (uint32_t slot = 0; slot < table_capacity_; ++slot) {
-    auto& entry = table_[slot];
-    if (entry.object) {
-      if (entry.object->type() == type) {
-        entry.object->Retain();
-        results->push_back(object_ref<XObject>(entry.object));
+  Table* table = table_.load(std::memory_order_relaxed);
+  uint32_t table_capacity = table ? table->capacity : 0;
+  for (uint32_t slot = 0; slot < table_capacity; ++slot) {
+    XObject* object =
+        table->entries[slot].object.load(std::memory_order_relaxed);
+    if (object) {
+      if (object->type() == type) {
+        object->Retain();
+        results->push_back(object_ref<XObject>(object));
       }
     }
   }
@@ -358,7 +424,7 @@ X_STATUS ObjectTable::GetObjectByName(const std::string_view name,
   *out_handle = it->second;
 
   // We need to ref the handle. I think.
-  auto obj = LookupObject(it->second, true);
+  auto obj = LookupAndRetainObject(it->second);
   if (obj) {
     obj->RetainHandle();
     obj->Release();
@@ -368,9 +434,12 @@ X_STATUS ObjectTable::GetObjectByName(const std::string_view name,
 }
 
 bool ObjectTable::Save(ByteStream* stream) {
-  stream->Write<uint32_t>(table_capacity_);
-  for (uint32_t i = 0; i < table_capacity_; i++) {
-    auto& entry = table_[i];
+  auto global_lock = global_critical_region_.Acquire();
+  Table* table = table_.load(std::memory_order_relaxed);
+  uint32_t table_capacity = table ? table->capacity : 0;
+  stream->Write<uint32_t>(table_capacity);
+  for (uint32_t i = 0; i < table_capacity; i++) {
+    auto& entry = table->entries[i];
     stream->Write<int32_t>(entry.handle_ref_count);
   }
 
@@ -378,9 +447,12 @@ bool ObjectTable::Save(ByteStream* stream) {
 }
 
 bool ObjectTable::Restore(ByteStream* stream) {
+  auto global_lock = global_critical_region_.Acquire();
   Resize(stream->Read<uint32_t>());
-  for (uint32_t i = 0; i < table_capacity_; i++) {
-    auto& entry = table_[i];
+  Table* table = table_.load(std::memory_order_relaxed);
+  uint32_t table_capacity = table ? table->capacity : 0;
+  for (uint32_t i = 0; i < table_capacity; i++) {
+    auto& entry = table->entries[i];
     // entry.object = nullptr;
     entry.handle_ref_count = stream->Read<int32_t>();
   }
@@ -389,13 +461,16 @@ bool ObjectTable::Restore(ByteStream* stream) {
 }
 
 X_STATUS ObjectTable::RestoreHandle(X_HANDLE handle, XObject* object) {
+  auto global_lock = global_critical_region_.Acquire();
   uint32_t slot = GetHandleSlot(handle);
-  assert_true(table_capacity_ >= slot);
+  Table* table = table_.load(std::memory_order_relaxed);
+  uint32_t table_capacity = table ? table->capacity : 0;
+  assert_true(table_capacity > slot);
 
-  if (table_capacity_ >= slot) {
-    auto& entry = table_[slot];
-    entry.object = object;
+  if (table_capacity > slot) {
+    auto& entry = table->entries[slot];
     object->Retain();
+    entry.object.store(object, std::memory_order_release);
   }
 
   return X_STATUS_SUCCESS;
@@ -10,6 +10,8 @@
 #ifndef XENIA_KERNEL_UTIL_OBJECT_TABLE_H_
 #define XENIA_KERNEL_UTIL_OBJECT_TABLE_H_
 
+#include <atomic>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -49,7 +51,7 @@ class ObjectTable {
 
   template <typename T>
   object_ref<T> LookupObject(X_HANDLE handle) {
-    auto object = LookupObject(handle, false);
+    auto object = LookupAndRetainObject(handle);
     if (object) {
       assert_true(object->type() == T::kType);
     }
@@ -83,11 +85,19 @@ class ObjectTable {
  private:
   struct ObjectTableEntry {
     int handle_ref_count = 0;
-    XObject* object = nullptr;
+    // Published atomically for lookups done without the lock.
+    std::atomic<XObject*> object = {nullptr};
+  };
+
+  // Lookups read the table without locking, so it's never modified in place
+  // when resizing - a new one is swapped in instead.
+  struct Table {
+    uint32_t capacity;
+    std::unique_ptr<ObjectTableEntry[]> entries;
   };
 
   ObjectTableEntry* LookupTable(X_HANDLE handle);
-  XObject* LookupObject(X_HANDLE handle, bool already_locked);
+  XObject* LookupAndRetainObject(X_HANDLE handle);
   void GetObjectsByType(XObject::Type type,
                         std::vector<object_ref<XObject>>* results);
 
@@ -98,10 +108,19 @@ class ObjectTable {
   X_STATUS FindFreeSlot(uint32_t* out_slot);
   bool Resize(uint32_t new_capacity);
 
+  // Waits until the lookups that may still be using objects or tables removed
+  // before the call are done, so they can be released. Lookups entered after
+  // the call won't see them. Must be called with the lock held.
+  void WaitForLookups();
+
   xe::global_critical_region global_critical_region_;
-  uint32_t table_capacity_ = 0;
-  ObjectTableEntry* table_ = nullptr;
+  // Modified only with the lock held.
+  std::atomic<Table*> table_ = {nullptr};
   uint32_t last_free_entry_ = 0;
+  // Lookups in progress, counted separately for the two most recent values of
+  // the epoch switched by WaitForLookups.
+  std::atomic<uint32_t> lookup_epoch_ = {0};
+  std::atomic<uint32_t> lookup_counts_[2] = {};
   std::unordered_map<string_key_case, X_HANDLE> name_table_;
 };
 
@@ -9,6 +9,14 @@
 
 #include "xenia/kernel/util/shim_utils.h"
 
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/kernel/xthread.h"
+
 namespace xe {
 namespace kernel {
 namespace shim {
@@ -17,6 +25,105 @@ thread_local StringBuffer string_buffer_;
 
 StringBuffer* thread_local_string_buffer() { return &string_buffer_; }
 
+namespace {
+
+struct KernelCallStats {
+  uint64_t call_count = 0;
+  uint64_t total_host_ticks = 0;
+  uint64_t max_host_ticks = 0;
+
+  void Add(const KernelCallStats& other) {
+    call_count += other.call_count;
+    total_host_ticks += other.total_host_ticks;
+    max_host_ticks = std::max(max_host_ticks, other.max_host_ticks);
+  }
+};
+
+// Calls made by one thread, only modified by that thread, but locked so the
+// report can be made while threads are still running.
+struct ThreadKernelCallStats {
+  std::string thread_name;
+  std::mutex mutex;
+  std::unordered_map<const cpu::Export*, KernelCallStats> exports;
+};
+
+std::mutex thread_kernel_call_stats_mutex_;
+// Kept after the threads exit for the report.
+std::vector<std::unique_ptr<ThreadKernelCallStats>> thread_kernel_call_stats_;
+thread_local ThreadKernelCallStats* current_thread_kernel_call_stats_ =
+    nullptr;
+
+double HostTicksToMilliseconds(uint64_t host_ticks) {
+  return double(host_ticks) * 1000.0 /
+         double(Clock::QueryHostTickFrequency());
+}
+
+void LogKernelCallStats(
+    std::vector<std::pair<const cpu::Export*, KernelCallStats>>& exports,
+    size_t max_count) {
+  std::sort(exports.begin(), exports.end(), [](const auto& a, const auto& b) {
+    return a.second.total_host_ticks > b.second.total_host_ticks;
+  });
+  for (size_t i = 0; i < std::min(exports.size(), max_count); ++i) {
+    const KernelCallStats& stats = exports[i].second;
+    XELOGI("  {:<40} {:>10} calls {:>10.3f} ms {:>8.3f} us/call "
+           "{:>10.3f} us max",
+           exports[i].first->name, stats.call_count,
+           HostTicksToMilliseconds(stats.total_host_ticks),
+           HostTicksToMilliseconds(stats.total_host_ticks) * 1000.0 /
+               double(stats.call_count),
+           HostTicksToMilliseconds(stats.max_host_ticks) * 1000.0);
+  }
+}
+
+}  // namespace
+
+void KernelCallProfileScope::RecordKernelCall(cpu::Export* export_entry,
+                                              uint64_t host_ticks) {
+  ThreadKernelCallStats* thread_stats = current_thread_kernel_call_stats_;
+  if (!thread_stats) {
+    auto new_thread_stats = std::make_unique<ThreadKernelCallStats>();
+    if (XThread::IsInThread()) {
+      XThread* thread = XThread::GetCurrentThread();
+      new_thread_stats->thread_name =
+          fmt::format("{:08X} {}", thread->thread_id(), thread->name());
+    } else {
+      new_thread_stats->thread_name = "host";
+    }
+    thread_stats = new_thread_stats.get();
+    current_thread_kernel_call_stats_ = thread_stats;
+    std::lock_guard<std::mutex> lock(thread_kernel_call_stats_mutex_);
+    thread_kernel_call_stats_.push_back(std::move(new_thread_stats));
+  }
+  std::lock_guard<std::mutex> lock(thread_stats->mutex);
+  KernelCallStats& stats = thread_stats->exports[export_entry];
+  ++stats.call_count;
+  stats.total_host_ticks += host_ticks;
+  stats.max_host_ticks = std::max(stats.max_host_ticks, host_ticks);
+}
+
+void LogKernelCallProfile() {
+  std::lock_guard<std::mutex> lock(thread_kernel_call_stats_mutex_);
+  if (thread_kernel_call_stats_.empty()) {
+    return;
+  }
+  std::unordered_map<const cpu::Export*, KernelCallStats> total_stats;
+  std::vector<std::pair<const cpu::Export*, KernelCallStats>> exports;
+  XELOGI("Kernel call profile, by thread:");
+  for (const auto& thread_stats : thread_kernel_call_stats_) {
+    std::lock_guard<std::mutex> thread_lock(thread_stats->mutex);
+    exports.assign(thread_stats->exports.begin(), thread_stats->exports.end());
+    for (const auto& export_stats : exports) {
+      total_stats[export_stats.first].Add(export_stats.second);
+    }
+    XELOGI(" {}:", thread_stats->thread_name);
+    LogKernelCallStats(exports, 10);
+  }
+  XELOGI("Kernel call profile, all threads:");
+  exports.assign(total_stats.begin(), total_stats.end());
+  LogKernelCallStats(exports, 50);
+}
+
 }  // namespace shim
 }  // namespace kernel
 }  // namespace xe
@@ -15,8 +15,10 @@
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/memory.h"
+#include "xenia/base/profiling.h"
 #include "xenia/base/string_buffer.h"
 #include "xenia/cpu/export_resolver.h"
 #include "xenia/cpu/ppc/ppc_context.h"
@@ -502,6 +504,49 @@ void PrintKernelCall(cpu::Export* export_entry, const Tuple& params) {
   }
 }
 
+// Checked before formatting the parameters, which is much more expensive than
+// discarding the line in the logger.
+inline bool ShouldPrintKernelCall(const cpu::Export* export_entry) {
+  const KernelCallFlags& flags = kernel_call_flags;
+  if (!(export_entry->tags & xe::cpu::ExportTag::kLog)) {
+    return false;
+  }
+  if ((export_entry->tags & xe::cpu::ExportTag::kHighFrequency) &&
+      !flags.log_high_frequency_calls) {
+    return false;
+  }
+  return (export_entry->tags & xe::cpu::ExportTag::kImportant)
+             ? flags.log_important_calls
+             : flags.log_calls;
+}
+
+// Records the host time of a kernel call with --profile_kernel_calls.
+class KernelCallProfileScope {
+ public:
+  explicit KernelCallProfileScope(cpu::Export* export_entry) {
+    if (kernel_call_flags.profile_calls) {
+      export_entry_ = export_entry;
+      start_host_ticks_ = Clock::QueryHostTickCount();
+    }
+  }
+  ~KernelCallProfileScope() {
+    if (export_entry_) {
+      RecordKernelCall(export_entry_,
+                       Clock::QueryHostTickCount() - start_host_ticks_);
+    }
+  }
+
+ private:
+  static void RecordKernelCall(cpu::Export* export_entry, uint64_t host_ticks);
+
+  cpu::Export* export_entry_ = nullptr;
+  uint64_t start_host_ticks_ = 0;
+};
+
+// Logs the exports with the most host time spent in them, in total and on
+// every thread, if --profile_kernel_calls is enabled.
+void LogKernelCallProfile();
+
 template <typename F, typename Tuple, std::size_t... I>
 auto KernelTrampoline(F&& f, Tuple&& t, std::index_sequence<I...>) {
   return std::forward<F>(f)(std::get<I>(std::forward<Tuple>(t))...);
@@ -517,15 +562,15 @@ xe::cpu::Export* RegisterExport(R (*fn)(Ps&...), const char* name,
   struct X {
     static void Trampoline(PPCContext* ppc_context) {
       ++export_entry->function_data.call_count;
+      SCOPE_profile_cpu_i("kernel", export_entry->name);
+      KernelCallProfileScope profile_scope(export_entry);
       Param::Init init = {
           ppc_context,
           sizeof...(Ps),
           0,
       };
       auto params = std::make_tuple<Ps...>(Ps(init)...);
-      if (export_entry->tags & xe::cpu::ExportTag::kLog &&
-          (!(export_entry->tags & xe::cpu::ExportTag::kHighFrequency) ||
-           cvars::log_high_frequency_kernel_calls)) {
+      if (ShouldPrintKernelCall(export_entry)) {
         PrintKernelCall(export_entry, params);
       }
       auto result =
@@ -552,14 +597,14 @@ xe::cpu::Export* RegisterExport(void (*fn)(Ps&...), const char* name,
   struct X {
     static void Trampoline(PPCContext* ppc_context) {
       ++export_entry->function_data.call_count;
+      SCOPE_profile_cpu_i("kernel", export_entry->name);
+      KernelCallProfileScope profile_scope(export_entry);
       Param::Init init = {
           ppc_context,
           sizeof...(Ps),
       };
       auto params = std::make_tuple<Ps...>(Ps(init)...);
-      if (export_entry->tags & xe::cpu::ExportTag::kLog &&
-          (!(export_entry->tags & xe::cpu::ExportTag::kHighFrequency) ||
-           cvars::log_high_frequency_kernel_calls)) {
+      if (ShouldPrintKernelCall(export_entry)) {
         PrintKernelCall(export_entry, params);
       }
       KernelTrampoline(FN, std::forward<std::tuple<Ps...>>(params),
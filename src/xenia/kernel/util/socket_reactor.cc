@@ -0,0 +1,266 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/util/socket_reactor.h"
+
+#include <utility>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/platform.h"
+
+#ifdef XE_PLATFORM_WIN32
+// clang-format off
+#include "xenia/base/platform_win.h"
+#include <WS2tcpip.h>
+#include <WinSock2.h>
+// clang-format on
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace xe {
+namespace kernel {
+namespace util {
+
+namespace {
+
+#ifdef XE_PLATFORM_WIN32
+typedef WSAPOLLFD NativePollFd;
+typedef SOCKET NativeSocket;
+int NativePoll(NativePollFd* fds, size_t count, int timeout_ms) {
+  return WSAPoll(fds, ULONG(count), timeout_ms);
+}
+void CloseNativeSocket(NativeSocket native_socket) {
+  closesocket(native_socket);
+}
+#else
+typedef pollfd NativePollFd;
+typedef int NativeSocket;
+int NativePoll(NativePollFd* fds, size_t count, int timeout_ms) {
+  return poll(fds, nfds_t(count), timeout_ms);
+}
+void CloseNativeSocket(NativeSocket native_socket) { close(native_socket); }
+#endif
+
+short GetPollEvents(SocketReactor::Readiness readiness) {
+  return readiness == SocketReactor::Readiness::kRead ? POLLIN : POLLOUT;
+}
+
+}  // namespace
+
+SocketReactor::~SocketReactor() {
+  if (thread_) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      shutting_down_ = true;
+    }
+    Wake();
+    xe::threading::Wait(thread_.get(), false);
+  }
+  // Either cancelled by the reactor thread or never started.
+  assert_true(pending_.empty());
+  if (wake_socket_ != kInvalidSocket) {
+    CloseNativeSocket(NativeSocket(wake_socket_));
+    wake_socket_ = kInvalidSocket;
+  }
+}
+
+bool SocketReactor::IsReady(uint64_t native_socket, Readiness readiness) {
+  NativePollFd poll_fd = {};
+  poll_fd.fd = NativeSocket(native_socket);
+  poll_fd.events = GetPollEvents(readiness);
+  // Errors and hangups are reported as ready too, so the operation fails
+  // right away rather than waiting forever.
+  return NativePoll(&poll_fd, 1, 0) > 0;
+}
+
+bool SocketReactor::Wait(uint64_t native_socket, Readiness readiness,
+                         Operation operation) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    assert_false(shutting_down_);
+    if (!EnsureStarted()) {
+      return false;
+    }
+    PendingOperation& pending_operation = pending_.emplace_back();
+    pending_operation.id = next_id_++;
+    pending_operation.native_socket = native_socket;
+    pending_operation.readiness = readiness;
+    pending_operation.operation = std::move(operation);
+  }
+  Wake();
+  return true;
+}
+
+void SocketReactor::Cancel(uint64_t native_socket) {
+  std::vector<Operation> cancelled_operations;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // The socket may be closed by an operation on the reactor thread itself,
+    // when the operation releases the last reference to it.
+    if (!thread_ ||
+        xe::threading::Thread::GetCurrentThread() != thread_.get()) {
+      performing_cond_.wait(lock, [this, native_socket]() {
+        return performing_socket_ != native_socket;
+      });
+    }
+    for (auto it = pending_.begin(); it != pending_.end();) {
+      if (it->native_socket == native_socket) {
+        cancelled_operations.push_back(std::move(it->operation));
+        it = pending_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+  if (cancelled_operations.empty()) {
+    return;
+  }
+  // Don't keep polling the socket that is about to be closed.
+  Wake();
+  for (Operation& operation : cancelled_operations) {
+    operation(true);
+  }
+}
+
+bool SocketReactor::EnsureStarted() {
+  // Called with the mutex locked.
+  if (thread_) {
+    return true;
+  }
+
+  if (wake_socket_ == kInvalidSocket) {
+    NativeSocket wake_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (wake_socket == NativeSocket(-1)) {
+      XELOGE("Socket reactor: Failed to create the wake socket");
+      return false;
+    }
+    sockaddr_in wake_address = {};
+    wake_address.sin_family = AF_INET;
+    wake_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    wake_address.sin_port = 0;
+    socklen_t wake_address_length = sizeof(wake_address);
+    if (bind(wake_socket, reinterpret_cast<const sockaddr*>(&wake_address),
+             sizeof(wake_address)) != 0 ||
+        getsockname(wake_socket, reinterpret_cast<sockaddr*>(&wake_address),
+                    &wake_address_length) != 0 ||
+        connect(wake_socket, reinterpret_cast<const sockaddr*>(&wake_address),
+                sizeof(wake_address)) != 0) {
+      XELOGE("Socket reactor: Failed to set up the wake socket");
+      CloseNativeSocket(wake_socket);
+      return false;
+    }
+    wake_socket_ = uint64_t(wake_socket);
+  }
+
+  xe::threading::Thread::CreationParameters params;
+  params.stack_size = 256 * 1024;
+  thread_ =
+      xe::threading::Thread::Create(params, [this]() { ReactorMain(); });
+  if (!thread_) {
+    XELOGE("Socket reactor: Failed to create the thread");
+    return false;
+  }
+  thread_->set_name("Socket Reactor");
+  xe::threading::ApplyThreadRole(thread_.get(),
+                                 xe::threading::ThreadRole::kIo);
+  return true;
+}
+
+void SocketReactor::Wake() {
+  char wake_byte = 0;
+  send(NativeSocket(wake_socket_), &wake_byte, 1, 0);
+}
+
+void SocketReactor::ReactorMain() {
+  std::vector<NativePollFd> poll_fds;
+  std::vector<uint64_t> poll_ids;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!shutting_down_) {
+    poll_fds.clear();
+    poll_ids.clear();
+    NativePollFd& wake_poll_fd = poll_fds.emplace_back();
+    wake_poll_fd.fd = NativeSocket(wake_socket_);
+    wake_poll_fd.events = POLLIN;
+    wake_poll_fd.revents = 0;
+    poll_ids.push_back(0);
+    for (const PendingOperation& pending_operation : pending_) {
+      NativePollFd& poll_fd = poll_fds.emplace_back();
+      poll_fd.fd = NativeSocket(pending_operation.native_socket);
+      poll_fd.events = GetPollEvents(pending_operation.readiness);
+      poll_fd.revents = 0;
+      poll_ids.push_back(pending_operation.id);
+    }
+    lock.unlock();
+
+    int ready_count = NativePoll(poll_fds.data(), poll_fds.size(), -1);
+    if (ready_count > 0 && poll_fds[0].revents) {
+      // Drain the wake datagrams, one is sent for each update.
+      while (IsReady(wake_socket_, Readiness::kRead)) {
+        char wake_bytes[64];
+        if (recv(NativeSocket(wake_socket_), wake_bytes, sizeof(wake_bytes),
+                 0) <= 0) {
+          break;
+        }
+      }
+    }
+
+    lock.lock();
+    if (ready_count <= 0) {
+      continue;
+    }
+    for (size_t i = 1; i < poll_fds.size() && !shutting_down_; ++i) {
+      if (!poll_fds[i].revents) {
+        continue;
+      }
+      // The operation may have been cancelled while polling.
+      auto it = pending_.begin();
+      for (; it != pending_.end() && it->id != poll_ids[i]; ++it) {
+      }
+      if (it == pending_.end()) {
+        continue;
+      }
+      PendingOperation pending_operation = std::move(*it);
+      pending_.erase(it);
+      performing_socket_ = pending_operation.native_socket;
+      lock.unlock();
+      bool completed = pending_operation.operation(false);
+      if (completed) {
+        // Release the references held by the operation without the lock,
+        // destroying the objects referenced may close sockets.
+        pending_operation.operation = nullptr;
+      }
+      lock.lock();
+      performing_socket_ = kInvalidSocket;
+      performing_cond_.notify_all();
+      if (!completed) {
+        // Spurious readiness - keeping the original ID, new sockets are not
+        // polled until the next iteration anyway.
+        pending_.push_back(std::move(pending_operation));
+      }
+    }
+  }
+
+  // Shutting down.
+  std::vector<PendingOperation> cancelled_operations = std::move(pending_);
+  pending_.clear();
+  lock.unlock();
+  for (PendingOperation& pending_operation : cancelled_operations) {
+    pending_operation.operation(true);
+  }
+}
+
+}  // namespace util
+}  // namespace kernel
+}  // namespace xe
@@ -0,0 +1,96 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_KERNEL_UTIL_SOCKET_REACTOR_H_
+#define XENIA_KERNEL_UTIL_SOCKET_REACTOR_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace kernel {
+namespace util {
+
+// A host thread waiting for host sockets to become ready for the asynchronous
+// (overlapped) socket operations requested by the guest, so the operations can
+// be completed and the guest notified without guest threads blocking on
+// network latency. Readiness of all the sockets with pending operations is
+// waited for at once with poll (WSAPoll on Windows).
+class SocketReactor {
+ public:
+  enum class Readiness {
+    kRead,
+    kWrite,
+  };
+
+  // Performed on the reactor thread when the socket is ready, or with
+  // cancelled being true when the operations on the socket are cancelled or
+  // the reactor is shutting down. Must not block. Returns false if the
+  // operation still can't be completed without blocking, to wait for the
+  // socket again.
+  using Operation = std::function<bool(bool cancelled)>;
+
+  SocketReactor() = default;
+  // Cancels all the pending operations before returning.
+  ~SocketReactor();
+
+  // Returns whether an operation on the socket can be done without blocking
+  // right now.
+  static bool IsReady(uint64_t native_socket, Readiness readiness);
+
+  // Performs the operation when the socket is ready. The reactor thread is
+  // created on the first use. Returns false (without calling the operation) if
+  // the reactor couldn't be started.
+  bool Wait(uint64_t native_socket, Readiness readiness, Operation operation);
+  // Cancels the pending operations on the socket, which must be done before
+  // closing it. Operations on the socket being performed at the moment of the
+  // call are completed before returning.
+  void Cancel(uint64_t native_socket);
+
+ private:
+  struct PendingOperation {
+    uint64_t id;
+    uint64_t native_socket;
+    Readiness readiness;
+    Operation operation;
+  };
+
+  static constexpr uint64_t kInvalidSocket = UINT64_MAX;
+
+  bool EnsureStarted();
+  // Interrupts the current poll so the set of sockets is updated.
+  void Wake();
+  void ReactorMain();
+
+  std::mutex mutex_;
+  std::vector<PendingOperation> pending_;
+  uint64_t next_id_ = 1;
+  // The socket the operation of which is being performed on the reactor
+  // thread, for Cancel to wait for it.
+  uint64_t performing_socket_ = kInvalidSocket;
+  std::condition_variable performing_cond_;
+  bool shutting_down_ = false;
+
+  // A loopback UDP socket connected to itself, datagrams to which interrupt
+  // the poll.
+  uint64_t wake_socket_ = kInvalidSocket;
+  std::unique_ptr<xe::threading::Thread> thread_;
+};
+
+}  // namespace util
+}  // namespace kernel
+}  // namespace xe
+
+#endif  // XENIA_KERNEL_UTIL_SOCKET_REACTOR_H_
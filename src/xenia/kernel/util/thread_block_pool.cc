@@ -0,0 +1,99 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/util/thread_block_pool.h"
+
+#include "xenia/memory.h"
+
+namespace xe {
+namespace kernel {
+namespace util {
+
+uint32_t ThreadBlockPool::Acquire(
+    std::unordered_map<uint32_t, std::vector<uint32_t>>& blocks,
+    uint32_t size) {
+  auto it = blocks.find(size);
+  if (it == blocks.end() || it->second.empty()) {
+    return 0;
+  }
+  uint32_t address = it->second.back();
+  it->second.pop_back();
+  return address;
+}
+
+uint32_t ThreadBlockPool::AcquireStack(uint32_t alloc_size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return Acquire(stacks_, alloc_size);
+}
+
+uint32_t ThreadBlockPool::AcquireSystemHeapBlock(uint32_t size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return Acquire(system_heap_blocks_, size);
+}
+
+void ThreadBlockPool::ReleaseStack(uint32_t alloc_base, uint32_t alloc_size) {
+  if (!alloc_base) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& blocks = stacks_[alloc_size];
+    if (blocks.size() < kMaxBlocksPerSize) {
+      blocks.push_back(alloc_base);
+      return;
+    }
+  }
+  memory_->LookupHeap(alloc_base)->Release(alloc_base);
+}
+
+void ThreadBlockPool::ReleaseSystemHeapBlock(uint32_t address,
+                                             uint32_t size) {
+  if (!address) {
+    return;
+  }
+  if (size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& blocks = system_heap_blocks_[size];
+    if (blocks.size() < kMaxBlocksPerSize) {
+      blocks.push_back(address);
+      return;
+    }
+  }
+  memory_->SystemHeapFree(address);
+}
+
+void ThreadBlockPool::Trim() {
+  std::unordered_map<uint32_t, std::vector<uint32_t>> stacks;
+  std::unordered_map<uint32_t, std::vector<uint32_t>> system_heap_blocks;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stacks.swap(stacks_);
+    system_heap_blocks.swap(system_heap_blocks_);
+  }
+  for (auto& size_stacks : stacks) {
+    for (uint32_t alloc_base : size_stacks.second) {
+      memory_->LookupHeap(alloc_base)->Release(alloc_base);
+    }
+  }
+  for (auto& size_blocks : system_heap_blocks) {
+    for (uint32_t address : size_blocks.second) {
+      memory_->SystemHeapFree(address);
+    }
+  }
+}
+
+void ThreadBlockPool::Reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stacks_.clear();
+  system_heap_blocks_.clear();
+}
+
+}  // namespace util
+}  // namespace kernel
+}  // namespace xe
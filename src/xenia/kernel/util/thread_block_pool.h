@@ -0,0 +1,70 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_KERNEL_UTIL_THREAD_BLOCK_POOL_H_
+#define XENIA_KERNEL_UTIL_THREAD_BLOCK_POOL_H_
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace xe {
+class Memory;
+}  // namespace xe
+
+namespace xe {
+namespace kernel {
+namespace util {
+
+// Guest memory of exited threads - stacks with their guard pages, and system
+// heap blocks too large for the system heap pools, like TLS - kept for reuse
+// by new threads, so titles creating short-lived threads constantly don't go
+// through the heap allocator and page protection for each of them. Blocks are
+// reused only with the exact same size, and their contents must be
+// reinitialized.
+class ThreadBlockPool {
+ public:
+  explicit ThreadBlockPool(Memory* memory) : memory_(memory) {}
+  // Frees the pooled blocks.
+  ~ThreadBlockPool() { Trim(); }
+
+  // Return the base address of a pooled allocation of the size, or 0 if there
+  // are none.
+  uint32_t AcquireStack(uint32_t alloc_size);
+  uint32_t AcquireSystemHeapBlock(uint32_t size);
+  // Pool the allocation, or free it if there are already enough of the size.
+  void ReleaseStack(uint32_t alloc_base, uint32_t alloc_size);
+  void ReleaseSystemHeapBlock(uint32_t address, uint32_t size);
+
+  // Frees all the pooled blocks.
+  void Trim();
+  // Forgets the pooled blocks without freeing them, for when the guest memory
+  // has been replaced, such as when restoring a saved state.
+  void Reset();
+
+ private:
+  static constexpr size_t kMaxBlocksPerSize = 16;
+
+  static uint32_t Acquire(
+      std::unordered_map<uint32_t, std::vector<uint32_t>>& blocks,
+      uint32_t size);
+
+  Memory* memory_;
+  std::mutex mutex_;
+  // Base addresses by allocation size.
+  std::unordered_map<uint32_t, std::vector<uint32_t>> stacks_;
+  std::unordered_map<uint32_t, std::vector<uint32_t>> system_heap_blocks_;
+};
+
+}  // namespace util
+}  // namespace kernel
+}  // namespace xe
+
+#endif  // XENIA_KERNEL_UTIL_THREAD_BLOCK_POOL_H_
@@ -9,6 +9,7 @@
 
 #include "xenia/kernel/xam/content_manager.h"
 
+#include <cstdlib>
 #include <string>
 
 #include "third_party/fmt/include/fmt/format.h"
@@ -76,59 +77,160 @@ std::filesystem::path ContentManager::ResolvePackagePath(
 
 std::vector<XCONTENT_DATA> ContentManager::ListContent(uint32_t device_id,
                                                        uint32_t content_type) {
-  std::vector<XCONTENT_DATA> result;
-
-  // StfsHeader is a huge class - alloc on heap instead of stack
-  vfs::StfsHeader* header = new vfs::StfsHeader();
-
   // Search path:
   // content_root/title_id/type_name/*
   auto package_root = ResolvePackageRoot(content_type);
-  auto file_infos = xe::filesystem::ListFiles(package_root);
+  uint64_t index_key = uint64_t(title_id()) << 32 | content_type;
+
+  std::vector<XCONTENT_DATA> result;
+  bool is_indexed = false;
+  {
+    std::lock_guard<std::mutex> lock(content_index_mutex_);
+    if (!content_watch_attempted_ && std::filesystem::exists(root_path_)) {
+      content_watch_attempted_ = true;
+      content_watcher_ = xe::filesystem::DirectoryWatcher::Create(
+          root_path_, [this](const std::filesystem::path& changed_path) {
+            OnContentRootChange(changed_path);
+          });
+    }
+    if (content_watcher_) {
+      auto it = content_index_.find(index_key);
+      if (it != content_index_.end()) {
+        result = it->second;
+        is_indexed = true;
+      }
+    }
+  }
+
+  if (!is_indexed) {
+    result = ScanContent(package_root, content_type);
+    std::lock_guard<std::mutex> lock(content_index_mutex_);
+    if (content_watcher_) {
+      content_index_[index_key] = result;
+    }
+  }
+
+  for (XCONTENT_DATA& content_data : result) {
+    content_data.device_id = device_id;
+  }
+  return result;
+}
+
+std::vector<XCONTENT_DATA> ContentManager::ScanContent(
+    const std::filesystem::path& root, uint32_t content_type) {
+  std::vector<XCONTENT_DATA> result;
+  auto file_infos = xe::filesystem::ListFiles(root);
   for (const auto& file_info : file_infos) {
     XCONTENT_DATA content_data;
-    content_data.device_id = device_id;
+    content_data.device_id = 0;
     content_data.content_type = content_type;
     content_data.display_name = xe::path_to_utf16(file_info.name);
     content_data.file_name = xe::path_to_utf8(file_info.name);
 
     auto headers_path = file_info.path / file_info.name;
-    if (file_info.type == xe::filesystem::FileInfo::Type::kDirectory) {
+    bool is_directory =
+        file_info.type == xe::filesystem::FileInfo::Type::kDirectory;
+    if (is_directory) {
       headers_path = headers_path / ContentManager::kStfsHeadersExtension;
     }
 
-    filesystem::FileInfo entry;
-    filesystem::GetInfo(headers_path, &entry);
+    if (!ReadPackageHeader(headers_path, is_directory, content_data)) {
+      continue;
+    }
+    result.emplace_back(std::move(content_data));
+  }
+  return result;
+}
 
-    if (std::filesystem::exists(headers_path)) {
-      // File is either package or directory that has .headers file
+bool ContentManager::ReadPackageHeader(
+    const std::filesystem::path& headers_path, bool is_directory,
+    XCONTENT_DATA& content_data) {
+  filesystem::FileInfo entry;
+  if (!filesystem::GetInfo(headers_path, &entry)) {
+    // Folder without a .headers file, listed with the defaults.
+    return true;
+  }
 
-      if (file_info.type != xe::filesystem::FileInfo::Type::kDirectory) {
-        // Not a directory so must be a package, verify size to make sure
-        if (file_info.total_size <= vfs::StfsHeader::kHeaderLength) {
-          continue;  // Invalid package (maybe .headers.bin)
-        }
+  // File is either package or directory that has .headers file
+  std::string key = xe::path_to_utf8(headers_path);
+  {
+    std::lock_guard<std::mutex> lock(content_index_mutex_);
+    auto it = package_headers_.find(key);
+    if (it != package_headers_.end() &&
+        it->second.size == entry.total_size &&
+        it->second.write_timestamp == entry.write_timestamp) {
+      if (it->second.is_valid) {
+        content_data.content_type = it->second.content_type;
+        content_data.display_name = it->second.display_name;
       }
+      return true;
+    }
+  }
 
-      auto map = MappedMemory::Open(headers_path, MappedMemory::Mode::kRead, 0,
-                                    vfs::StfsHeader::kHeaderLength);
-      if (map) {
-        if (header->Read(map->data())) {
-          content_data.content_type =
-              static_cast<uint32_t>(header->content_type);
-          content_data.display_name = header->display_names;
-          // TODO: select localized display name
-          // some games may expect different ones depending on language setting.
+  if (!is_directory) {
+    // Not a directory so must be a package, verify size to make sure
+    if (entry.total_size <= vfs::StfsHeader::kHeaderLength) {
+      return false;  // Invalid package (maybe .headers.bin)
+    }
+  }
+
+  PackageHeaderInfo info = {};
+  info.size = entry.total_size;
+  info.write_timestamp = entry.write_timestamp;
+  auto map = MappedMemory::Open(headers_path, MappedMemory::Mode::kRead, 0,
+                                vfs::StfsHeader::kHeaderLength);
+  if (map) {
+    // StfsHeader is a huge class - alloc on heap instead of stack
+    auto header = std::make_unique<vfs::StfsHeader>();
+    if (header->Read(map->data())) {
+      info.is_valid = true;
+      info.content_type = static_cast<uint32_t>(header->content_type);
+      info.display_name = header->display_names;
+      // TODO: select localized display name
+      // some games may expect different ones depending on language setting.
+      content_data.content_type = info.content_type;
+      content_data.display_name = info.display_name;
+    }
+    map->Close();
+  }
+
+  std::lock_guard<std::mutex> lock(content_index_mutex_);
+  package_headers_[key] = std::move(info);
+  return true;
+}
+
+void ContentManager::OnContentRootChange(
+    const std::filesystem::path& changed_path) {
+  // Changes below content_root/title_id/type_name/ only affect that listing.
+  std::lock_guard<std::mutex> lock(content_index_mutex_);
+  if (!changed_path.empty()) {
+    auto relative_path = changed_path.lexically_relative(root_path_);
+    auto it = relative_path.begin();
+    if (it != relative_path.end() && *it != "..") {
+      std::string title_id_str = xe::path_to_utf8(*it);
+      if (++it != relative_path.end()) {
+        std::string content_type_str = xe::path_to_utf8(*it);
+        char* title_id_end;
+        char* content_type_end;
+        uint64_t title_id =
+            std::strtoul(title_id_str.c_str(), &title_id_end, 16);
+        uint64_t content_type =
+            std::strtoul(content_type_str.c_str(), &content_type_end, 16);
+        if (!*title_id_end && !*content_type_end) {
+          content_index_.erase(title_id << 32 | content_type);
+          return;
         }
-        map->Close();
       }
     }
-    result.emplace_back(std::move(content_data));
   }
+  content_index_.clear();
+}
 
-  delete header;
-
-  return result;
+void ContentManager::InvalidateContentIndex() {
+  // The watcher reports changes made by the emulator itself too, but only
+  // after a while, and titles may enumerate right after creating content.
+  std::lock_guard<std::mutex> lock(content_index_mutex_);
+  content_index_.clear();
 }
 
 ContentPackage* ContentManager::ResolvePackage(const XCONTENT_DATA& data) {
@@ -197,6 +299,7 @@ X_RESULT ContentManager::CreateContent(const std::string_view root_name,
   }
 
   open_packages_.push_back(package);
+  InvalidateContentIndex();
   return X_ERROR_SUCCESS;
 }
 
@@ -228,6 +331,7 @@ X_RESULT ContentManager::CloseContent(const std::string_view root_name) {
         delete *it;
         open_packages_.erase(it);
       }
+      InvalidateContentIndex();
       return X_ERROR_SUCCESS;
     }
   }
@@ -256,6 +360,7 @@ X_RESULT ContentManager::SetContentThumbnail(const XCONTENT_DATA& data,
     return X_ERROR_FILE_NOT_FOUND;
   }
 
+  InvalidateContentIndex();
   return package->SetThumbnail(buffer);
 }
 
@@ -277,6 +382,7 @@ X_RESULT ContentManager::DeleteContent(const XCONTENT_DATA& data) {
     delete package;
   }
 
+  InvalidateContentIndex();
   return result;
 }
 
@@ -11,10 +11,12 @@
 #define XENIA_KERNEL_XAM_CONTENT_MANAGER_H_
 
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "xenia/base/filesystem.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/mutex.h"
 #include "xenia/base/string_key.h"
@@ -64,6 +66,9 @@ class ContentManager {
                  const std::filesystem::path& root_path);
   ~ContentManager();
 
+  // Listings are cached per title and content type until the host directory
+  // watcher reports a change in them, and package headers are only reread
+  // when their size or modification time changes.
   std::vector<XCONTENT_DATA> ListContent(uint32_t device_id,
                                          uint32_t content_type);
 
@@ -90,6 +95,22 @@ class ContentManager {
 
   uint32_t title_id();
 
+  struct PackageHeaderInfo {
+    size_t size;
+    uint64_t write_timestamp;
+    bool is_valid;
+    uint32_t content_type;
+    std::u16string display_name;
+  };
+  std::vector<XCONTENT_DATA> ScanContent(const std::filesystem::path& root,
+                                         uint32_t content_type);
+  // Reads the type and the display name from the header of a package into
+  // content_data, returns false if it's not a valid package.
+  bool ReadPackageHeader(const std::filesystem::path& headers_path,
+                         bool is_directory, XCONTENT_DATA& content_data);
+  void OnContentRootChange(const std::filesystem::path& changed_path);
+  void InvalidateContentIndex();
+
   KernelState* kernel_state_;
   std::filesystem::path root_path_;
 
@@ -97,6 +118,15 @@ class ContentManager {
   xe::global_critical_region global_critical_region_;
   std::vector<ContentPackage*> open_packages_;
 
+  std::mutex content_index_mutex_;
+  bool content_watch_attempted_ = false;
+  std::unique_ptr<xe::filesystem::DirectoryWatcher> content_watcher_;
+  // Listings by title ID << 32 | content type, without the device ID. Only
+  // kept while content_watcher_ is active.
+  std::unordered_map<uint64_t, std::vector<XCONTENT_DATA>> content_index_;
+  // By path of the package header.
+  std::unordered_map<std::string, PackageHeaderInfo> package_headers_;
+
   uint32_t title_id_override_ =
       0;  // can be used for games/apps that request content for other IDs
 };
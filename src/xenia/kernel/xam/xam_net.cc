@@ -7,11 +7,14 @@
  ******************************************************************************
  */
 
+#include <algorithm>
 #include <cstring>
+#include <vector>
 
 #include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/kernel/kernel_state.h"
+#include "xenia/kernel/util/socket_reactor.h"
 #include "xenia/kernel/util/shim_utils.h"
 #include "xenia/kernel/xam/xam_module.h"
 #include "xenia/kernel/xam/xam_private.h"
@@ -271,27 +274,218 @@ DECLARE_XAM_EXPORT1(NetDll_WSACleanup, kNetworking, kImplemented);
 dword_result_t NetDll_WSAGetLastError() { return XThread::GetLastError(); }
 DECLARE_XAM_EXPORT1(NetDll_WSAGetLastError, kNetworking, kImplemented);
 
-dword_result_t NetDll_WSARecvFrom(dword_t caller, dword_t socket,
+// Receives into the guest buffers, with the source written to the guest if
+// requested. Usable from the socket reactor thread.
+int RecvFromWSABuffers(XSocket* socket, const std::vector<XWSABUF>& buffers,
+                       uint32_t flags, uint32_t from_ptr,
+                       uint32_t from_len_ptr) {
+  uint32_t total_len = 0;
+  for (const XWSABUF& buffer : buffers) {
+    total_len += buffer.len;
+  }
+  std::vector<uint8_t> received(total_len);
+  N_XSOCKADDR_IN native_from;
+  uint32_t native_from_len =
+      from_len_ptr ? xe::load_and_swap<uint32_t>(
+                         kernel_memory()->TranslateVirtual(from_len_ptr))
+                   : 0;
+  int ret = socket->RecvFrom(received.data(), total_len, flags,
+                             from_ptr ? &native_from : nullptr,
+                             from_len_ptr ? &native_from_len : nullptr);
+  if (ret < 0) {
+    return ret;
+  }
+
+  uint32_t received_offset = 0;
+  for (const XWSABUF& buffer : buffers) {
+    if (received_offset >= uint32_t(ret)) {
+      break;
+    }
+    uint32_t copy_len = std::min(uint32_t(buffer.len), ret - received_offset);
+    std::memcpy(kernel_memory()->TranslateVirtual(buffer.buf_ptr),
+                received.data() + received_offset, copy_len);
+    received_offset += copy_len;
+  }
+  if (from_ptr) {
+    auto from = kernel_memory()->TranslateVirtual<XSOCKADDR_IN*>(from_ptr);
+    from->sin_family = native_from.sin_family;
+    from->sin_port = native_from.sin_port;
+    from->sin_addr = native_from.sin_addr;
+    std::memset(from->sin_zero, 0, 8);
+  }
+  if (from_len_ptr) {
+    xe::store_and_swap<uint32_t>(
+        kernel_memory()->TranslateVirtual(from_len_ptr), native_from_len);
+  }
+  return ret;
+}
+
+// Writes the result of an overlapped operation and signals its event.
+void CompleteWSAOverlapped(uint32_t overlapped_ptr, uint32_t error,
+                           uint32_t bytes_transferred, uint32_t flags,
+                           XEvent* event) {
+  auto overlapped =
+      kernel_memory()->TranslateVirtual<XWSAOVERLAPPED*>(overlapped_ptr);
+  overlapped->internal_high = bytes_transferred;
+  // Returned by WSAGetOverlappedResult.
+  overlapped->offset = flags;
+  // Written last - no longer X_STATUS_PENDING means completion.
+  overlapped->internal = error;
+  if (event) {
+    event->Set(0, false);
+  }
+}
+
+dword_result_t NetDll_WSARecvFrom(dword_t caller, dword_t socket_handle,
                                   pointer_t<XWSABUF> buffers_ptr,
                                   dword_t buffer_count,
                                   lpdword_t num_bytes_recv, lpdword_t flags_ptr,
-                                  pointer_t<XSOCKADDR_IN> from_addr,
+                                  pointer_t<XSOCKADDR_IN> from_ptr,
+                                  lpdword_t from_len_ptr,
                                   pointer_t<XWSAOVERLAPPED> overlapped_ptr,
                                   lpvoid_t completion_routine_ptr) {
+  assert(!completion_routine_ptr);
+
+  auto socket =
+      kernel_state()->object_table()->LookupObject<XSocket>(socket_handle);
+  if (!socket) {
+    // WSAENOTSOCK
+    XThread::SetLastError(0x2736);
+    return -1;
+  }
+
+  std::vector<XWSABUF> buffers(buffer_count);
+  for (uint32_t i = 0; i < buffer_count; i++) {
+    buffers[i] = buffers_ptr[i];
+  }
+  uint32_t flags = flags_ptr ? uint32_t(*flags_ptr) : 0;
+  uint32_t from_guest = from_ptr.guest_address();
+  uint32_t from_len_guest = from_len_ptr.guest_address();
+
+  object_ref<XEvent> event;
   if (overlapped_ptr) {
-    // auto evt = kernel_state()->object_table()->LookupObject<XEvent>(
-    //    overlapped_ptr->event_handle);
+    event = kernel_state()->object_table()->LookupObject<XEvent>(
+        overlapped_ptr->event_handle);
+  }
 
-    // if (evt) {
-    //  //evt->Set(0, false);
-    //}
+  if (!overlapped_ptr || util::SocketReactor::IsReady(
+                             socket->native_handle(),
+                             util::SocketReactor::Readiness::kRead)) {
+    int ret = RecvFromWSABuffers(socket.get(), buffers, flags, from_guest,
+                                 from_len_guest);
+    if (ret < 0) {
+      XThread::SetLastError(XSocket::GetLastWSAError());
+      return -1;
+    }
+    if (num_bytes_recv) {
+      *num_bytes_recv = uint32_t(ret);
+    }
+    if (overlapped_ptr) {
+      CompleteWSAOverlapped(overlapped_ptr.guest_address(), 0, uint32_t(ret),
+                            flags, event.get());
+    }
+    return 0;
   }
 
-  // we're not going to be receiving packets any time soon
-  // return error so we don't wait on that - Cancerous
+  // Nothing to receive yet - complete the operation on the socket reactor
+  // thread when the data arrives, rather than blocking the guest thread.
+  if (event) {
+    event->Reset();
+  }
+  overlapped_ptr->internal = X_STATUS_PENDING;
+  overlapped_ptr->internal_high = 0;
+  uint32_t overlapped_guest = overlapped_ptr.guest_address();
+  bool waiting = kernel_state()->socket_reactor()->Wait(
+      socket->native_handle(), util::SocketReactor::Readiness::kRead,
+      [socket, buffers = std::move(buffers), flags, from_guest,
+       from_len_guest, overlapped_guest, event](bool cancelled) {
+        if (cancelled) {
+          // WSA_OPERATION_ABORTED
+          CompleteWSAOverlapped(overlapped_guest, 995, 0, 0, event.get());
+          return true;
+        }
+        int ret = RecvFromWSABuffers(socket.get(), buffers, flags, from_guest,
+                                     from_len_guest);
+        if (ret < 0) {
+          uint32_t error_code = XSocket::GetLastWSAError();
+          // WSAEWOULDBLOCK
+          if (error_code == 10035) {
+            return false;
+          }
+          CompleteWSAOverlapped(overlapped_guest, error_code, 0, 0,
+                                event.get());
+          return true;
+        }
+        CompleteWSAOverlapped(overlapped_guest, 0, uint32_t(ret), flags,
+                              event.get());
+        return true;
+      });
+  if (!waiting) {
+    overlapped_ptr->internal = 0;
+    // WSAENOBUFS
+    XThread::SetLastError(10055);
+    return -1;
+  }
+  // WSA_IO_PENDING
+  XThread::SetLastError(997);
   return -1;
 }
-DECLARE_XAM_EXPORT1(NetDll_WSARecvFrom, kNetworking, kStub);
+DECLARE_XAM_EXPORT1(NetDll_WSARecvFrom, kNetworking, kImplemented);
+
+dword_result_t NetDll_WSAGetOverlappedResult(
+    dword_t caller, dword_t socket_handle,
+    pointer_t<XWSAOVERLAPPED> overlapped_ptr, lpdword_t bytes_transferred_ptr,
+    dword_t wait, lpdword_t flags_ptr) {
+  if (!overlapped_ptr) {
+    // WSAEFAULT
+    XThread::SetLastError(10014);
+    return 0;
+  }
+  if (overlapped_ptr->internal == X_STATUS_PENDING) {
+    if (!wait) {
+      // WSA_IO_INCOMPLETE
+      XThread::SetLastError(996);
+      return 0;
+    }
+    auto event = kernel_state()->object_table()->LookupObject<XEvent>(
+        overlapped_ptr->event_handle);
+    if (!event) {
+      // WSA_INVALID_HANDLE
+      XThread::SetLastError(6);
+      return 0;
+    }
+    while (overlapped_ptr->internal == X_STATUS_PENDING) {
+      event->Wait(0, 0, false, nullptr);
+    }
+  }
+  if (bytes_transferred_ptr) {
+    *bytes_transferred_ptr = overlapped_ptr->internal_high;
+  }
+  if (flags_ptr) {
+    *flags_ptr = overlapped_ptr->offset;
+  }
+  uint32_t error_code = overlapped_ptr->internal;
+  if (error_code) {
+    XThread::SetLastError(error_code);
+    return 0;
+  }
+  return 1;
+}
+DECLARE_XAM_EXPORT1(NetDll_WSAGetOverlappedResult, kNetworking, kImplemented);
+
+dword_result_t NetDll_WSACancelOverlappedIO(dword_t caller,
+                                            dword_t socket_handle) {
+  auto socket =
+      kernel_state()->object_table()->LookupObject<XSocket>(socket_handle);
+  if (!socket) {
+    // WSAENOTSOCK
+    XThread::SetLastError(0x2736);
+    return -1;
+  }
+  kernel_state()->socket_reactor()->Cancel(socket->native_handle());
+  return 0;
+}
+DECLARE_XAM_EXPORT1(NetDll_WSACancelOverlappedIO, kNetworking, kImplemented);
 
 // If the socket is a VDP socket, buffer 0 is the game data length, and buffer 1
 // is the unencrypted game data.
@@ -301,7 +495,6 @@ dword_result_t NetDll_WSASendTo(dword_t caller, dword_t socket_handle,
                                 pointer_t<XSOCKADDR_IN> to_ptr, dword_t to_len,
                                 pointer_t<XWSAOVERLAPPED> overlapped,
                                 lpvoid_t completion_routine) {
-  assert(!overlapped);
   assert(!completion_routine);
 
   auto socket =
@@ -329,10 +522,23 @@ dword_result_t NetDll_WSASendTo(dword_t caller, dword_t socket_handle,
   }
 
   N_XSOCKADDR_IN native_to(to_ptr);
-  socket->SendTo(combined_buffer_mem.data(), combined_buffer_size, flags,
-                 &native_to, to_len);
+  int ret = socket->SendTo(combined_buffer_mem.data(), combined_buffer_size,
+                           flags, &native_to, to_len);
+  if (ret < 0) {
+    XThread::SetLastError(XSocket::GetLastWSAError());
+    return -1;
+  }
+  if (num_bytes_sent) {
+    *num_bytes_sent = uint32_t(ret);
+  }
 
-  // TODO: Instantly complete overlapped
+  // Datagrams are sent right away, so overlapped sends complete instantly.
+  if (overlapped) {
+    auto event = kernel_state()->object_table()->LookupObject<XEvent>(
+        overlapped->event_handle);
+    CompleteWSAOverlapped(overlapped.guest_address(), 0, uint32_t(ret), 0,
+                          event.get());
+  }
 
   return 0;
 }
@@ -35,14 +35,29 @@ bool XdbfFile::Read(const uint8_t* data, size_t data_size) {
   auto* data_ptr =
       (uint8_t*)free_ptr + (sizeof(X_XDBF_FILELOC) * header_.free_count);
 
+  size_t tables_size =
+      sizeof(X_XDBF_HEADER) + sizeof(X_XDBF_ENTRY) * header_.entry_count +
+      sizeof(X_XDBF_FILELOC) * header_.free_count;
+  if (header_.entry_used > header_.entry_count ||
+      header_.free_used > header_.free_count || tables_size > data_size) {
+    return false;
+  }
+  size_t data_region_size = data_size - tables_size;
+
+  entries_.reserve(header_.entry_used);
+  entry_indices_.reserve(header_.entry_used);
   for (uint32_t i = 0; i < header_.entry_used; i++) {
     Entry entry;
     memcpy(&entry.info, ptr, sizeof(X_XDBF_ENTRY));
-    entry.data.resize(entry.info.size);
-    memcpy(entry.data.data(), data_ptr + entry.info.offset, entry.info.size);
-    entries_.push_back(entry);
-
     ptr += sizeof(X_XDBF_ENTRY);
+    if (uint64_t(entry.info.offset) + entry.info.size > data_region_size) {
+      return false;
+    }
+    entry.data.assign(data_ptr + entry.info.offset,
+                      data_ptr + entry.info.offset + entry.info.size);
+    entry_indices_.emplace(EntryKey{entry.info.section, entry.info.id},
+                           entries_.size());
+    entries_.push_back(std::move(entry));
   }
 
   for (uint32_t i = 0; i < header_.free_used; i++) {
@@ -112,28 +127,18 @@ bool XdbfFile::Write(uint8_t* data, size_t* data_size) {
 }
 
 Entry* XdbfFile::GetEntry(uint16_t section, uint64_t id) const {
-  for (size_t i = 0; i < entries_.size(); i++) {
-    auto* entry = (Entry*)&entries_[i];
-    if (entry->info.section != section || entry->info.id != id) {
-      continue;
-    }
-
-    return entry;
+  auto it = entry_indices_.find(EntryKey{section, id});
+  if (it == entry_indices_.end()) {
+    return nullptr;
   }
-
-  return nullptr;
+  return (Entry*)&entries_[it->second];
 }
 
 bool XdbfFile::UpdateEntry(Entry entry) {
-  for (size_t i = 0; i < entries_.size(); i++) {
-    auto* ent = (Entry*)&entries_[i];
-    if (ent->info.section != entry.info.section ||
-        ent->info.id != entry.info.id) {
-      continue;
-    }
-
-    ent->data = entry.data;
-    ent->info.size = (uint32_t)entry.data.size();
+  auto* ent = GetEntry(entry.info.section, entry.info.id);
+  if (ent) {
+    ent->data = std::move(entry.data);
+    ent->info.size = (uint32_t)ent->data.size();
     return true;
   }
 
@@ -141,9 +146,11 @@ bool XdbfFile::UpdateEntry(Entry entry) {
   new_entry.info.section = entry.info.section;
   new_entry.info.id = entry.info.id;
   new_entry.info.size = (uint32_t)entry.data.size();
-  new_entry.data = entry.data;
+  new_entry.data = std::move(entry.data);
 
-  entries_.push_back(new_entry);
+  entry_indices_.emplace(EntryKey{new_entry.info.section, new_entry.info.id},
+                         entries_.size());
+  entries_.push_back(std::move(new_entry));
   return true;
 }
 
@@ -179,6 +186,41 @@ std::string SpaFile::GetStringTableEntry(Locale locale,
   return GetStringTableEntry_(ptr, string_id, xstr_head->count);
 }
 
+std::unordered_map<uint16_t, std::string_view> SpaFile::GetStringTable(
+    Locale locale) const {
+  std::unordered_map<uint16_t, std::string_view> strings;
+  auto xstr_table = GetEntry(static_cast<uint16_t>(SpaSection::kStringTable),
+                             static_cast<uint64_t>(locale));
+  if (!xstr_table || xstr_table->data.size() < sizeof(X_XDBF_TABLE_HEADER)) {
+    return strings;
+  }
+
+  auto xstr_head =
+      reinterpret_cast<const X_XDBF_TABLE_HEADER*>(xstr_table->data.data());
+  assert_true(xstr_head->magic == static_cast<uint32_t>(SpaID::Xstr));
+  assert_true(xstr_head->version == 1);
+
+  const uint8_t* ptr = xstr_table->data.data() + sizeof(X_XDBF_TABLE_HEADER);
+  const uint8_t* end = xstr_table->data.data() + xstr_table->data.size();
+  strings.reserve(xstr_head->count);
+  for (uint16_t i = 0; i < xstr_head->count; ++i) {
+    if (end - ptr < ptrdiff_t(sizeof(XdbfStringTableEntry))) {
+      break;
+    }
+    auto entry = reinterpret_cast<const XdbfStringTableEntry*>(ptr);
+    ptr += sizeof(XdbfStringTableEntry);
+    if (end - ptr < ptrdiff_t(entry->string_length)) {
+      break;
+    }
+    // The first one of an ID wins, like in a linear search.
+    strings.emplace(
+        entry->id, std::string_view(reinterpret_cast<const char*>(ptr),
+                                    entry->string_length));
+    ptr += entry->string_length;
+  }
+  return strings;
+}
+
 uint32_t SpaFile::GetAchievements(
     Locale locale, std::vector<Achievement>* achievements) const {
   auto xach_table = GetEntry(static_cast<uint16_t>(SpaSection::kMetadata),
@@ -192,21 +234,18 @@ uint32_t SpaFile::GetAchievements(
   assert_true(xach_head->magic == static_cast<uint32_t>(SpaID::Xach));
   assert_true(xach_head->version == 1);
 
-  auto xstr_table = GetEntry(static_cast<uint16_t>(SpaSection::kStringTable),
-                             static_cast<uint64_t>(locale));
-  if (!xstr_table) {
+  if (!GetEntry(static_cast<uint16_t>(SpaSection::kStringTable),
+                static_cast<uint64_t>(locale))) {
     return 0;
   }
 
-  auto xstr_head =
-      reinterpret_cast<const X_XDBF_TABLE_HEADER*>(xstr_table->data.data());
-  assert_true(xstr_head->magic == static_cast<uint32_t>(SpaID::Xstr));
-  assert_true(xstr_head->version == 1);
-
-  const uint8_t* xstr_ptr =
-      xstr_table->data.data() + sizeof(X_XDBF_TABLE_HEADER);
-
   if (achievements) {
+    // Indexed once rather than searched for each string.
+    auto strings = GetStringTable(locale);
+    auto get_string = [&strings](uint16_t string_id) {
+      auto it = strings.find(string_id);
+      return it != strings.end() ? to_utf16(it->second) : std::u16string();
+    };
     auto* ach_data =
         reinterpret_cast<const X_XDBF_SPA_ACHIEVEMENT*>(xach_head + 1);
     for (uint32_t i = 0; i < xach_head->count; i++) {
@@ -216,11 +255,9 @@ uint32_t SpaFile::GetAchievements(
       ach.gamerscore = ach_data->gamerscore;
       ach.flags = ach_data->flags;
 
-      ach.label = to_utf16(GetStringTableEntry_(xstr_ptr, ach_data->label_id, xstr_head->count));
-      ach.description = to_utf16(GetStringTableEntry_(
-          xstr_ptr, ach_data->description_id, xstr_head->count));
-      ach.unachieved_desc = to_utf16(GetStringTableEntry_(
-          xstr_ptr, ach_data->unachieved_id, xstr_head->count));
+      ach.label = get_string(ach_data->label_id);
+      ach.description = get_string(ach_data->description_id);
+      ach.unachieved_desc = get_string(ach_data->unachieved_id);
 
       achievements->push_back(ach);
       ach_data++;
@@ -267,24 +304,19 @@ uint32_t SpaFile::GetTitleId() const {
 }
 
 bool GpdFile::GetAchievement(uint16_t id, Achievement* dest) {
-  for (size_t i = 0; i < entries_.size(); i++) {
-    auto* entry = (Entry*)&entries_[i];
-    if (entry->info.section !=
-            static_cast<uint16_t>(GpdSection::kAchievement) ||
-        entry->info.id != id) {
-      continue;
-    }
+  auto* entry =
+      GetEntry(static_cast<uint16_t>(GpdSection::kAchievement), id);
+  if (!entry) {
+    return false;
+  }
 
-    auto* ach_data =
-        reinterpret_cast<const X_XDBF_GPD_ACHIEVEMENT*>(entry->data.data());
+  auto* ach_data =
+      reinterpret_cast<const X_XDBF_GPD_ACHIEVEMENT*>(entry->data.data());
 
-    if (dest) {
-      dest->ReadGPD(ach_data);
-    }
-    return true;
+  if (dest) {
+    dest->ReadGPD(ach_data);
   }
-
-  return false;
+  return true;
 }
 
 uint32_t GpdFile::GetAchievements(
@@ -318,22 +350,17 @@ uint32_t GpdFile::GetAchievements(
 }
 
 bool GpdFile::GetTitle(uint32_t title_id, TitlePlayed* dest) {
-  for (size_t i = 0; i < entries_.size(); i++) {
-    auto* entry = (Entry*)&entries_[i];
-    if (entry->info.section != static_cast<uint16_t>(GpdSection::kTitle) ||
-        entry->info.id != title_id) {
-      continue;
-    }
-
-    auto* title_data =
-        reinterpret_cast<const X_XDBF_GPD_TITLEPLAYED*>(entry->data.data());
+  auto* entry = GetEntry(static_cast<uint16_t>(GpdSection::kTitle), title_id);
+  if (!entry) {
+    return false;
+  }
 
-    dest->ReadGPD(title_data);
+  auto* title_data =
+      reinterpret_cast<const X_XDBF_GPD_TITLEPLAYED*>(entry->data.data());
 
-    return true;
-  }
+  dest->ReadGPD(title_data);
 
-  return false;
+  return true;
 }
 
 uint32_t GpdFile::GetTitles(std::vector<TitlePlayed>* titles) const {
@@ -11,6 +11,8 @@
 #define XENIA_KERNEL_XAM_XDBF_XDBF_H_
 
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 #include "xenia/base/clock.h"
@@ -63,13 +65,10 @@ enum class Locale : uint32_t {
 };
 
 inline std::u16string ReadNullTermString(const char16_t* ptr) {
-  std::u16string retval;
-  wchar_t data = xe::byte_swap(*ptr);
-  while (data != 0) {
-    retval += data;
-    ptr++;
-    data = xe::byte_swap(*ptr);
-  }
+  auto src = reinterpret_cast<const uint16_t*>(ptr);
+  std::u16string retval(xe::find_zero_16(src, SIZE_MAX), u'\0');
+  xe::copy_and_swap(reinterpret_cast<uint16_t*>(&retval[0]), src,
+                    retval.size());
   return retval;
 }
 
@@ -214,20 +213,40 @@ class XdbfFile {
   bool Read(const uint8_t* data, size_t data_size);
   bool Write(uint8_t* data, size_t* data_size);
 
+  // Constant time, through an index of the entries by section and ID.
   Entry* GetEntry(uint16_t section, uint64_t id) const;
 
   // Updates (or adds) an entry
   bool UpdateEntry(Entry entry);
 
  protected:
+  struct EntryKey {
+    uint16_t section;
+    uint64_t id;
+    bool operator==(const EntryKey& other) const {
+      return section == other.section && id == other.id;
+    }
+  };
+  struct EntryKeyHasher {
+    size_t operator()(const EntryKey& key) const {
+      return xe::memory::hash_combine(0, key.section, key.id);
+    }
+  };
+
   X_XDBF_HEADER header_;
   std::vector<Entry> entries_;
+  // Indices in entries_.
+  std::unordered_map<EntryKey, size_t, EntryKeyHasher> entry_indices_;
   std::vector<X_XDBF_FILELOC> free_entries_;
 };
 
 class SpaFile : public XdbfFile {
  public:
   std::string GetStringTableEntry(Locale locale, uint16_t string_id) const;
+  // Views of the strings of the locale by ID, into the data of the string
+  // table entry, valid until it's updated.
+  std::unordered_map<uint16_t, std::string_view> GetStringTable(
+      Locale locale) const;
 
   uint32_t GetAchievements(Locale locale,
                            std::vector<Achievement>* achievements) const;
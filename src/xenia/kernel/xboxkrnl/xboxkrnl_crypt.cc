@@ -9,6 +9,7 @@
 
 #include "xenia/base/logging.h"
 #include "xenia/kernel/kernel_state.h"
+#include "xenia/kernel/util/crypto_accel.h"
 #include "xenia/kernel/util/crypto_utils.h"
 #include "xenia/kernel/util/shim_utils.h"
 #include "xenia/kernel/xboxkrnl/xboxkrnl_private.h"
@@ -101,8 +102,40 @@ void StoreSha1(const sha1::SHA1* sha, XECRYPT_SHA_STATE* state) {
   std::copy_n(sha->getBlock(), sha->getBlockByteIndex(), state->buffer);
 }
 
-void XeCryptShaInit(pointer_t<XECRYPT_SHA_STATE> sha_state) {
-  sha_state.Zero();
+// Updates the hash values and the buffer of a SHA-1 or SHA-256 state with the
+// SHA extensions of the host CPU, consistently with the portable code: the
+// buffered bytes are completed to a block, the whole blocks are hashed
+// directly from the input, and the rest is buffered. The count is not updated.
+template <size_t kHashValueCount>
+void ShaUpdateAccelerated(xe::be<uint32_t>* hash_values, uint8_t* buffer,
+                          uint32_t count, const uint8_t* input,
+                          uint32_t input_size,
+                          void (*compress)(uint32_t* state,
+                                           const uint8_t* blocks,
+                                           size_t block_count)) {
+  uint32_t buffered = count & 63;
+  if (buffered) {
+    uint32_t fill = std::min(64 - buffered, input_size);
+    std::memcpy(buffer + buffered, input, fill);
+    input += fill;
+    input_size -= fill;
+    if (buffered + fill < 64) {
+      return;
+    }
+  }
+  uint32_t state[kHashValueCount];
+  std::copy_n(hash_values, kHashValueCount, state);
+  if (buffered) {
+    compress(state, buffer, 1);
+  }
+  uint32_t block_count = input_size / 64;
+  compress(state, input, block_count);
+  std::memcpy(buffer, input + block_count * 64, input_size & 63);
+  std::copy_n(state, kHashValueCount, hash_values);
+}
+
+void ShaInit(XECRYPT_SHA_STATE* sha_state) {
+  std::memset(sha_state, 0, sizeof(*sha_state));
 
   sha_state->state[0] = 0x67452301;
   sha_state->state[1] = 0xEFCDAB89;
@@ -110,10 +143,17 @@ void XeCryptShaInit(pointer_t<XECRYPT_SHA_STATE> sha_state) {
   sha_state->state[3] = 0x10325476;
   sha_state->state[4] = 0xC3D2E1F0;
 }
-DECLARE_XBOXKRNL_EXPORT1(XeCryptShaInit, kNone, kImplemented);
 
-void XeCryptShaUpdate(pointer_t<XECRYPT_SHA_STATE> sha_state, lpvoid_t input,
-                      dword_t input_size) {
+void ShaUpdate(XECRYPT_SHA_STATE* sha_state, const uint8_t* input,
+               uint32_t input_size) {
+  if (util::HasShaAcceleration()) {
+    ShaUpdateAccelerated<5>(sha_state->state, sha_state->buffer,
+                            sha_state->count, input, input_size,
+                            util::Sha1CompressAccelerated);
+    sha_state->count = sha_state->count + input_size;
+    return;
+  }
+
   sha1::SHA1 sha;
   InitSha1(&sha, sha_state);
 
@@ -121,6 +161,16 @@ void XeCryptShaUpdate(pointer_t<XECRYPT_SHA_STATE> sha_state, lpvoid_t input,
 
   StoreSha1(&sha, sha_state);
 }
+
+void XeCryptShaInit(pointer_t<XECRYPT_SHA_STATE> sha_state) {
+  ShaInit(sha_state);
+}
+DECLARE_XBOXKRNL_EXPORT1(XeCryptShaInit, kNone, kImplemented);
+
+void XeCryptShaUpdate(pointer_t<XECRYPT_SHA_STATE> sha_state, lpvoid_t input,
+                      dword_t input_size) {
+  ShaUpdate(sha_state, input, input_size);
+}
 DECLARE_XBOXKRNL_EXPORT1(XeCryptShaUpdate, kNone, kImplemented);
 
 void XeCryptShaFinal(pointer_t<XECRYPT_SHA_STATE> sha_state,
@@ -140,18 +190,21 @@ DECLARE_XBOXKRNL_EXPORT1(XeCryptShaFinal, kNone, kImplemented);
 void XeCryptSha(lpvoid_t input_1, dword_t input_1_size, lpvoid_t input_2,
                 dword_t input_2_size, lpvoid_t input_3, dword_t input_3_size,
                 lpvoid_t output, dword_t output_size) {
-  sha1::SHA1 sha;
+  XECRYPT_SHA_STATE sha_state;
+  ShaInit(&sha_state);
 
   if (input_1 && input_1_size) {
-    sha.processBytes(input_1, input_1_size);
+    ShaUpdate(&sha_state, input_1, input_1_size);
   }
   if (input_2 && input_2_size) {
-    sha.processBytes(input_2, input_2_size);
+    ShaUpdate(&sha_state, input_2, input_2_size);
   }
   if (input_3 && input_3_size) {
-    sha.processBytes(input_3, input_3_size);
+    ShaUpdate(&sha_state, input_3, input_3_size);
   }
 
+  sha1::SHA1 sha;
+  InitSha1(&sha, &sha_state);
   uint8_t digest[0x14];
   sha.finalize(digest);
   std::copy_n(digest, std::min<size_t>(xe::countof(digest), output_size),
@@ -182,6 +235,14 @@ DECLARE_XBOXKRNL_EXPORT1(XeCryptSha256Init, kNone, kImplemented);
 
 void XeCryptSha256Update(pointer_t<XECRYPT_SHA256_STATE> sha_state,
                          lpvoid_t input, dword_t input_size) {
+  if (util::HasShaAcceleration()) {
+    ShaUpdateAccelerated<8>(sha_state->state, sha_state->buffer,
+                            sha_state->count, input, input_size,
+                            util::Sha256CompressAccelerated);
+    sha_state->count = sha_state->count + input_size;
+    return;
+  }
+
   sha256::SHA256 sha;
   std::copy(std::begin(sha_state->state), std::end(sha_state->state),
             sha.getHashValues());
@@ -387,6 +448,14 @@ void XeCryptAesEcb(pointer_t<XECRYPT_AES_STATE> state_ptr, lpvoid_t inp_ptr,
                    lpvoid_t out_ptr, dword_t encrypt) {
   const uint8_t* keytab =
       reinterpret_cast<const uint8_t*>(state_ptr->keytabenc);
+  if (util::HasAesAcceleration()) {
+    if (encrypt) {
+      util::AesEncryptEcbAccelerated(keytab, inp_ptr, out_ptr, 1);
+    } else {
+      util::AesDecryptEcbAccelerated(keytab, inp_ptr, out_ptr, 1);
+    }
+    return;
+  }
   if (encrypt) {
     aes_encrypt_128(keytab, inp_ptr, out_ptr);
   } else {
@@ -403,6 +472,16 @@ void XeCryptAesCbc(pointer_t<XECRYPT_AES_STATE> state_ptr, lpvoid_t inp_ptr,
   const uint8_t* inp = inp_ptr.as<const uint8_t*>();
   uint8_t* out = out_ptr.as<uint8_t*>();
   uint8_t* feed = feed_ptr.as<uint8_t*>();
+  if (util::HasAesAcceleration()) {
+    // Same as below, a partial last block is processed as a whole one.
+    uint32_t block_count = (inp_size + 15) / 16;
+    if (encrypt) {
+      util::AesEncryptCbcAccelerated(keytab, inp, out, block_count, feed);
+    } else {
+      util::AesDecryptCbcAccelerated(keytab, inp, out, block_count, feed);
+    }
+    return;
+  }
   if (encrypt) {
     for (uint32_t i = 0; i < inp_size; i += 16) {
       for (uint32_t j = 0; j < 16; ++j) {
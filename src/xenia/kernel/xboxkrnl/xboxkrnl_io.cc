@@ -7,6 +7,7 @@
  ******************************************************************************
  */
 
+#include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/mutex.h"
@@ -23,6 +24,12 @@
 #include "xenia/vfs/device.h"
 #include "xenia/xbox.h"
 
+DEFINE_bool(async_file_reads, true,
+            "Complete reads from files opened for asynchronous access on host "
+            "I/O threads, returning STATUS_PENDING to the game, instead of "
+            "reading on the calling thread.",
+            "Kernel");
+
 namespace xe {
 namespace kernel {
 namespace xboxkrnl {
@@ -165,7 +172,45 @@ dword_result_t NtReadFile(dword_t file_handle, dword_t event_handle,
   }
 
   if (XSUCCEEDED(result)) {
-    if (true || file->is_synchronous()) {
+    if (cvars::async_file_reads && !file->is_synchronous()) {
+      // Completed on an I/O worker, which fills the status block, signals the
+      // event and queues the APC to this thread once the data has landed.
+      uint32_t apc_routine = static_cast<uint32_t>(apc_routine_ptr) & ~1u;
+      object_ref<XThread> apc_thread;
+      if (apc_routine && apc_context) {
+        apc_thread = retain_object(XThread::GetCurrentThread());
+      }
+      if (ev) {
+        ev->Reset();
+      }
+      if (io_status_block) {
+        io_status_block->status = X_STATUS_PENDING;
+        io_status_block->information = 0;
+      }
+      uint32_t io_status_block_ptr = io_status_block.guest_address();
+      uint32_t apc_context_ptr = apc_context.guest_address();
+      result = file->ReadAsync(
+          buffer.guest_address(), buffer_length,
+          byte_offset_ptr ? static_cast<uint64_t>(*byte_offset_ptr) : -1,
+          apc_context_ptr,
+          [ev, apc_thread, apc_routine, apc_context_ptr, io_status_block_ptr](
+              X_STATUS read_result, uint32_t bytes_read) {
+            if (io_status_block_ptr) {
+              auto status_block =
+                  kernel_memory()->TranslateVirtual<X_IO_STATUS_BLOCK*>(
+                      io_status_block_ptr);
+              status_block->status = read_result;
+              status_block->information = bytes_read;
+            }
+            if (ev) {
+              ev->Set(0, false);
+            }
+            if (apc_thread) {
+              apc_thread->EnqueueApc(apc_routine, apc_context_ptr,
+                                     io_status_block_ptr, 0);
+            }
+          });
+    } else {
       // Synchronous.
       uint32_t bytes_read = 0;
       result = file->Read(
@@ -195,25 +240,6 @@ dword_result_t NtReadFile(dword_t file_handle, dword_t event_handle,
       // Mark that we should signal the event now. We do this after
       // we have written the info out.
       signal_event = true;
-    } else {
-      // TODO(benvanik): async.
-
-      // X_STATUS_PENDING if not returning immediately.
-      // XFile is waitable and signalled after each async req completes.
-      // reset the input event (->Reset())
-      /*xeNtReadFileState* call_state = new xeNtReadFileState();
-      XAsyncRequest* request = new XAsyncRequest(
-      state, file,
-      (XAsyncRequest::CompletionCallback)xeNtReadFileCompleted,
-      call_state);*/
-      // result = file->Read(buffer.guest_address(), buffer_length, byte_offset,
-      //                     request);
-      if (io_status_block) {
-        io_status_block->status = X_STATUS_PENDING;
-        io_status_block->information = 0;
-      }
-
-      result = X_STATUS_PENDING;
     }
   }
 
@@ -14,6 +14,7 @@
 
 #include "xenia/base/atomic.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/memory.h"
 #include "xenia/base/string.h"
 #include "xenia/base/threading.h"
 #include "xenia/kernel/kernel_state.h"
@@ -38,21 +39,10 @@ namespace xboxkrnl {
 // https://msdn.microsoft.com/en-us/library/ff561778
 dword_result_t RtlCompareMemory(lpvoid_t source1, lpvoid_t source2,
                                 dword_t length) {
-  uint8_t* p1 = source1;
-  uint8_t* p2 = source2;
-
-  // Note that the return value is the number of bytes that match, so it's best
-  // we just do this ourselves vs. using memcmp.
-  // On Windows we could use the builtin function.
-
-  uint32_t c = 0;
-  for (uint32_t n = 0; n < length; n++, p1++, p2++) {
-    if (*p1 == *p2) {
-      c++;
-    }
-  }
-
-  return c;
+  // The return value is the number of bytes that match before the first
+  // difference, which memcmp doesn't give.
+  return uint32_t(xe::find_first_difference(
+      source1.as<const uint8_t*>(), source2.as<const uint8_t*>(), length));
 }
 DECLARE_XBOXKRNL_EXPORT1(RtlCompareMemory, kMemory, kImplemented);
 
@@ -64,29 +54,19 @@ dword_result_t RtlCompareMemoryUlong(lpvoid_t source, dword_t length,
     return 0;
   }
 
-  uint32_t n = 0;
-  for (uint32_t i = 0; i < (length / 4); i++) {
-    // FIXME: This assumes as_array returns xe::be
-    uint32_t val = source.as_array<uint32_t>()[i];
-    if (val == pattern) {
-      n++;
-    }
-  }
-
-  return n;
+  // The number of bytes matching the pattern before the first mismatch.
+  size_t count = xe::count_leading_equal_32(
+      source.as<const uint32_t*>(), xe::byte_swap(pattern.value()),
+      length / 4);
+  return uint32_t(count * 4);
 }
 DECLARE_XBOXKRNL_EXPORT1(RtlCompareMemoryUlong, kMemory, kImplemented);
 
 // https://msdn.microsoft.com/en-us/library/ff552263
 void RtlFillMemoryUlong(lpvoid_t destination, dword_t length, dword_t pattern) {
   // NOTE: length must be % 4, so we can work on uint32s.
-  uint32_t count = length >> 2;
-
-  uint32_t* p = destination.as<uint32_t*>();
-  uint32_t swapped_pattern = xe::byte_swap(pattern.value());
-  for (uint32_t n = 0; n < count; n++, p++) {
-    *p = swapped_pattern;
-  }
+  xe::fill_32(destination.as<uint32_t*>(), xe::byte_swap(pattern.value()),
+              length >> 2);
 }
 DECLARE_XBOXKRNL_EXPORT1(RtlFillMemoryUlong, kMemory, kImplemented);
 
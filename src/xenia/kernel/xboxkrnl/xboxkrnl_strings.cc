@@ -8,10 +8,16 @@
  */
 
 #include <cstring>
-#include <iomanip>
-#include <sstream>
-
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/memory.h"
 #include "xenia/kernel/kernel_state.h"
 #include "xenia/kernel/user_module.h"
 #include "xenia/kernel/util/shim_utils.h"
@@ -52,19 +58,44 @@ enum FormatFlags {
   FF_InvertWide = 1 << 12,
 };
 
-enum ArgumentSize {
-  AS_Default = 0,
-  AS_Short,
-  AS_Long,
-  AS_LongLong,
-};
-
+// Receives the formatted text. put returns false if the character can't be
+// represented in the output.
 class FormatData {
  public:
-  virtual uint16_t get() = 0;
-  virtual uint16_t peek(int32_t offset) = 0;
-  virtual void skip(int32_t count) = 0;
+  virtual bool is_wide_format() const = 0;
   virtual bool put(uint16_t c) = 0;
+  virtual bool put(const char16_t* text, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+      if (!put(uint16_t(text[i]))) {
+        return false;
+      }
+    }
+    return true;
+  }
+  virtual bool put(const uint8_t* text, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+      if (!put(text[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+  virtual bool put_swapped(const uint16_t* text, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+      if (!put(xe::byte_swap(text[i]))) {
+        return false;
+      }
+    }
+    return true;
+  }
+  virtual bool fill(uint16_t c, int32_t count) {
+    while (count-- > 0) {
+      if (!put(c)) {
+        return false;
+      }
+    }
+    return true;
+  }
 };
 
 class ArgList {
@@ -80,83 +111,143 @@ class ArgList {
 // "Format Specification Syntax: printf and wprintf Functions"
 // https://msdn.microsoft.com/en-us/library/56e442dc.aspx
 
-std::string format_double(double value, int32_t precision, uint16_t c,
-                          uint32_t flags) {
+void format_double(fmt::memory_buffer& buffer, double value, int32_t precision,
+                   uint16_t c, uint32_t flags) {
+  auto out = std::back_inserter(buffer);
+  if (c == 'a' || c == 'A') {
+    // Without a precision, as many digits as the value needs.
+    if (precision < 0) {
+      c == 'a' ? fmt::format_to(out, "{:a}", value)
+               : fmt::format_to(out, "{:A}", value);
+    } else {
+      c == 'a' ? fmt::format_to(out, "{:.{}a}", value, precision)
+               : fmt::format_to(out, "{:.{}A}", value, precision);
+    }
+    return;
+  }
+
   if (precision < 0) {
     precision = 6;
   } else if (precision == 0 && c == 'g') {
     precision = 1;
   }
 
-  std::ostringstream temp;
-  temp << std::setprecision(precision);
-
-  if (c == 'f') {
-    temp << std::fixed;
-  } else if (c == 'e' || c == 'E') {
-    temp << std::scientific;
-  } else if (c == 'a' || c == 'A') {
-    temp << std::hexfloat;
-  } else if (c == 'g' || c == 'G') {
-    temp << std::defaultfloat;
+  bool alternate = (flags & FF_AddPrefix) != 0;
+  switch (c) {
+    case 'e':
+      alternate ? fmt::format_to(out, "{:#.{}e}", value, precision)
+                : fmt::format_to(out, "{:.{}e}", value, precision);
+      break;
+    case 'E':
+      alternate ? fmt::format_to(out, "{:#.{}E}", value, precision)
+                : fmt::format_to(out, "{:.{}E}", value, precision);
+      break;
+    case 'g':
+      alternate ? fmt::format_to(out, "{:#.{}g}", value, precision)
+                : fmt::format_to(out, "{:.{}g}", value, precision);
+      break;
+    case 'G':
+      alternate ? fmt::format_to(out, "{:#.{}G}", value, precision)
+                : fmt::format_to(out, "{:.{}G}", value, precision);
+      break;
+    default:
+      alternate ? fmt::format_to(out, "{:#.{}f}", value, precision)
+                : fmt::format_to(out, "{:.{}f}", value, precision);
+      break;
   }
+}
 
-  if (c == 'E' || c == 'G' || c == 'A') {
-    temp << std::uppercase;
+// Digits of an integer conversion, returns the end of them.
+char* format_integer(char* out, uint64_t value, uint16_t c) {
+  switch (c) {
+    case 'o':
+      return fmt::format_to(out, "{:o}", value);
+    case 'x':
+      return fmt::format_to(out, "{:x}", value);
+    case 'X':
+    case 'p':
+      return fmt::format_to(out, "{:X}", value);
+    default:
+      return fmt::format_to(out, "{}", value);
   }
+}
+
+// A conversion specification with the literal text preceding it. The last
+// one of a format string has type 0 and only holds the trailing text.
+struct FormatSpec {
+  // Range of ParsedFormat::literals.
+  uint32_t literal_offset;
+  uint32_t literal_length;
+  uint16_t type;
+  uint32_t flags;
+  int32_t width;
+  int32_t precision;
+  // '*' in place of the width or the precision.
+  bool width_from_args;
+  bool precision_from_args;
+};
+
+struct ParsedFormat {
+  // The format string as stored in guest memory, with the terminator, to
+  // check whether the string at the address is still the same.
+  std::vector<uint8_t> source;
+  std::u16string literals;
+  std::vector<FormatSpec> specs;
+  // Whether the string ends in the middle of a specification, which is an
+  // error once the formatting reaches it.
+  bool truncated = false;
+};
 
-  if (flags & FF_AddPrefix) {
-    temp << std::showpoint;
+template <typename T>
+class FormatInput {
+ public:
+  explicit FormatInput(const T* input) : input_(input) {}
+
+  uint16_t get() {
+    T result = *input_;
+    if (result) {
+      input_++;
+    }
+    return convert(result);
   }
 
-  temp << value;
-  return temp.str();
-}
+  uint16_t peek(int32_t offset) { return convert(input_[offset]); }
 
-int32_t format_core(PPCContext* ppc_context, FormatData& data, ArgList& args,
-                    const bool wide) {
-  int32_t count = 0;
+  void skip(int32_t count) {
+    while (count-- > 0) {
+      if (!get()) {
+        break;
+      }
+    }
+  }
 
-  char work8[512];
-  char16_t work16[4];
+ private:
+  static uint16_t convert(T c) {
+    return sizeof(T) == 2 ? xe::byte_swap(uint16_t(c)) : uint16_t(c);
+  }
 
-  struct {
-    const void* buffer;
-    int32_t length;
-    bool is_wide;
-    bool swap_wide;
-  } text;
+  const T* input_;
+};
 
-  struct {
-    char buffer[2];
-    int32_t length;
-  } prefix;
+template <typename T>
+std::shared_ptr<ParsedFormat> parse_format(const T* format, size_t length) {
+  auto parsed = std::make_shared<ParsedFormat>();
+  auto source = reinterpret_cast<const uint8_t*>(format);
+  parsed->source.assign(source, source + (length + 1) * sizeof(T));
+  FormatInput<T> data(format);
 
+  FormatSpec spec = {};
   auto state = FS_Unknown;
-  uint32_t flags = 0;
-  int32_t width = 0;
-  int32_t precision = -1;
-  ArgumentSize size = AS_Default;
-  int32_t radix = 0;
-  const char* digits = nullptr;
-
-  text.buffer = nullptr;
-  text.is_wide = false;
-  text.swap_wide = true;
-  text.length = 0;
-  prefix.buffer[0] = '\0';
-  prefix.length = 0;
-
   for (uint16_t c = data.get();; c = data.get()) {
     if (state == FS_Unknown) {
       if (!c) {  // the end
-        return count;
+        spec.type = 0;
+        parsed->specs.push_back(spec);
+        return parsed;
       } else if (c != '%') {
       output:
-        if (!data.put(c)) {
-          return -1;
-        }
-        ++count;
+        parsed->literals.push_back(char16_t(c));
+        ++spec.literal_length;
         continue;
       }
 
@@ -167,7 +258,10 @@ int32_t format_core(PPCContext* ppc_context, FormatData& data, ArgList& args,
 
     // in any state, if c is \0, it's bad
     if (!c) {
-      return -1;
+      spec.type = 0;
+      parsed->specs.push_back(spec);
+      parsed->truncated = true;
+      return parsed;
     }
 
   restart:
@@ -188,19 +282,11 @@ int32_t format_core(PPCContext* ppc_context, FormatData& data, ArgList& args,
         state = FS_Flags;
 
         // reset to defaults
-        flags = 0;
-        width = 0;
-        precision = -1;
-        size = AS_Default;
-        radix = 0;
-        digits = nullptr;
-
-        text.buffer = nullptr;
-        text.is_wide = false;
-        text.swap_wide = true;
-        text.length = 0;
-        prefix.buffer[0] = '\0';
-        prefix.length = 0;
+        spec.flags = 0;
+        spec.width = 0;
+        spec.precision = -1;
+        spec.width_from_args = false;
+        spec.precision_from_args = false;
 
         // fall through, don't need to goto restart
       }
@@ -208,19 +294,19 @@ int32_t format_core(PPCContext* ppc_context, FormatData& data, ArgList& args,
       // https://msdn.microsoft.com/en-us/library/8aky45ct.aspx
       case FS_Flags: {
         if (c == '-') {
-          flags |= FF_LeftJustify;
+          spec.flags |= FF_LeftJustify;
           continue;
         } else if (c == '+') {
-          flags |= FF_AddPositive;
+          spec.flags |= FF_AddPositive;
           continue;
         } else if (c == '0') {
-          flags |= FF_AddLeadingZeros;
+          spec.flags |= FF_AddLeadingZeros;
           continue;
         } else if (c == ' ') {
-          flags |= FF_AddPositiveAsSpace;
+          spec.flags |= FF_AddPositiveAsSpace;
           continue;
         } else if (c == '#') {
-          flags |= FF_AddPrefix;
+          spec.flags |= FF_AddPrefix;
           continue;
         }
         state = FS_Width;
@@ -230,16 +316,12 @@ int32_t format_core(PPCContext* ppc_context, FormatData& data, ArgList& args,
       // https://msdn.microsoft.com/en-us/library/25366k66.aspx
       case FS_Width: {
         if (c == '*') {
-          width = (int32_t)args.get32();
-          if (width < 0) {
-            flags |= FF_LeftJustify;
-            width = -width;
-          }
+          spec.width_from_args = true;
           state = FS_PrecisionStart;
           continue;
         } else if (c >= '0' && c <= '9') {
-          width *= 10;
-          width += c - '0';
+          spec.width *= 10;
+          spec.width += c - '0';
           continue;
         }
         state = FS_PrecisionStart;
@@ -250,7 +332,7 @@ int32_t format_core(PPCContext* ppc_context, FormatData& data, ArgList& args,
       case FS_PrecisionStart: {
         if (c == '.') {
           state = FS_Precision;
-          precision = 0;
+          spec.precision = 0;
           continue;
         }
         state = FS_Size;
@@ -260,15 +342,12 @@ int32_t format_core(PPCContext* ppc_context, FormatData& data, ArgList& args,
       // https://msdn.microsoft.com/en-us/library/0ecbz014.aspx
       case FS_Precision: {
         if (c == '*') {
-          precision = (int32_t)args.get32();
-          if (precision < 0) {
-            precision = -1;
-          }
+          spec.precision_from_args = true;
           state = FS_Size;
           continue;
         } else if (c >= '0' && c <= '9') {
-          precision *= 10;
-          precision += c - '0';
+          spec.precision *= 10;
+          spec.precision += c - '0';
           continue;
         }
         state = FS_Size;
@@ -280,24 +359,24 @@ int32_t format_core(PPCContext* ppc_context, FormatData& data, ArgList& args,
         if (c == 'l') {
           if (data.peek(0) == 'l') {
             data.skip(1);
-            flags |= FF_IsLongLong;
+            spec.flags |= FF_IsLongLong;
           } else {
-            flags |= FF_IsLong;
+            spec.flags |= FF_IsLong;
           }
           state = FS_Type;
           continue;
         } else if (c == 'h') {
-          flags |= FF_IsShort;
+          spec.flags |= FF_IsShort;
           state = FS_Type;
           continue;
         } else if (c == 'w') {
-          flags |= FF_IsWide;
+          spec.flags |= FF_IsWide;
           state = FS_Type;
           continue;
         } else if (c == 'I') {
           if (data.peek(0) == '6' && data.peek(1) == '4') {
             data.skip(2);
-            flags |= FF_IsLongLong;
+            spec.flags |= FF_IsLongLong;
             state = FS_Type;
             continue;
           } else if (data.peek(0) == '3' && data.peek(1) == '2') {
@@ -314,271 +393,369 @@ int32_t format_core(PPCContext* ppc_context, FormatData& data, ArgList& args,
 
       // https://msdn.microsoft.com/en-us/library/hf4y5e3w.aspx
       case FS_Type: {
-        // wide character
-        switch (c) {
-          case 'C': {
-            flags |= FF_InvertWide;
-            // fall through
-          }
+        spec.type = c;
+        parsed->specs.push_back(spec);
+        spec.literal_offset = uint32_t(parsed->literals.size());
+        spec.literal_length = 0;
+        state = FS_Unknown;
+        continue;
+      }
+    }
+  }
+}
 
-          // character
-          case 'c': {
-            bool is_wide;
-            if (flags & (FF_IsLong | FF_IsWide)) {
-              // "An lc, lC, wc or wC type specifier is synonymous with C in
-              // printf functions and with c in wprintf functions."
-              is_wide = true;
-            } else if (flags & FF_IsShort) {
-              // "An hc or hC type specifier is synonymous with c in printf
-              // functions and with C in wprintf functions."
-              is_wide = false;
-            } else {
-              is_wide = ((flags & FF_InvertWide) != 0) ^ wide;
-            }
-
-            auto value = args.get32();
-
-            if (!is_wide) {
-              work8[0] = (uint8_t)value;
-              text.buffer = &work8[0];
-              text.length = 1;
-              text.is_wide = false;
-            } else {
-              work16[0] = (uint16_t)value;
-              text.buffer = &work16[0];
-              text.length = 1;
-              text.is_wide = true;
-              text.swap_wide = false;
-            }
-
-            break;
-          }
+// Parsed format strings by guest address. Titles format mostly with string
+// literals, so each is parsed only once. The string at the address is
+// compared with the one parsed, as it may be in a reused buffer.
+class FormatCache {
+ public:
+  std::shared_ptr<const ParsedFormat> Get(uint32_t guest_address,
+                                          const void* format,
+                                          bool is_wide_format) {
+    size_t length;
+    size_t source_length;
+    if (is_wide_format) {
+      length = xe::find_zero_16(static_cast<const uint16_t*>(format),
+                                SIZE_MAX);
+      source_length = (length + 1) * sizeof(uint16_t);
+    } else {
+      length = std::strlen(static_cast<const char*>(format));
+      source_length = length + 1;
+    }
 
-          // signed decimal integer
-          case 'd':
-          case 'i': {
-            flags |= FF_IsSigned;
-            digits = "0123456789";
-            radix = 10;
-
-          integer:
-            assert_not_null(digits);
-            assert_not_zero(radix);
-
-            int64_t value;
-
-            if (flags & FF_IsLongLong) {
-              value = (int64_t)args.get64();
-            } else if (flags & FF_IsLong) {
-              value = (int32_t)args.get32();
-            } else if (flags & FF_IsShort) {
-              value = (int16_t)args.get32();
-            } else {
-              value = (int32_t)args.get32();
-            }
-
-            if (precision >= 0) {
-              precision = std::min(precision, (int32_t)xe::countof(work8));
-            } else {
-              precision = 1;
-            }
-
-            if ((flags & FF_IsSigned) && value < 0) {
-              value = -value;
-              flags |= FF_AddNegative;
-            }
-
-            if (!(flags & FF_IsLongLong)) {
-              value &= UINT32_MAX;
-            }
-
-            if (value == 0) {
-              prefix.length = 0;
-            }
-
-            char* end = &work8[xe::countof(work8) - 1];
-            char* start = end;
-            start[0] = '\0';
-
-            while (precision-- > 0 || value != 0) {
-              auto digit = (int32_t)(value % radix);
-              value /= radix;
-              assert_true(digit < strlen(digits));
-              *--start = digits[digit];
-            }
-
-            if ((flags & FF_ForceLeadingZero) &&
-                (start == end || *start != '0')) {
-              *--start = '0';
-            }
-
-            text.buffer = start;
-            text.length = (int32_t)(end - start);
-            text.is_wide = false;
-            break;
-          }
+    uint64_t key = uint64_t(guest_address) << 1 | uint64_t(is_wide_format);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = entries_.find(key);
+      if (it != entries_.end() &&
+          it->second->source.size() == source_length &&
+          !std::memcmp(it->second->source.data(), format, source_length)) {
+        return it->second;
+      }
+    }
 
-          // unsigned octal integer
-          case 'o': {
-            digits = "01234567";
-            radix = 8;
-            if (flags & FF_AddPrefix) {
-              flags |= FF_ForceLeadingZero;
-            }
-            goto integer;
-          }
+    std::shared_ptr<const ParsedFormat> parsed =
+        is_wide_format
+            ? parse_format(static_cast<const uint16_t*>(format), length)
+            : parse_format(static_cast<const uint8_t*>(format), length);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_.size() >= kMaxEntries) {
+      entries_.clear();
+    }
+    entries_[key] = parsed;
+    return parsed;
+  }
 
-          // unsigned decimal integer
-          case 'u': {
-            digits = "0123456789";
-            radix = 10;
-            goto integer;
-          }
+ private:
+  // Strings built at runtime may each get an entry, keep their count bounded.
+  static constexpr size_t kMaxEntries = 4096;
 
-          // unsigned hexadecimal integer
-          case 'x':
-          case 'X': {
-            digits = c == 'x' ? "0123456789abcdef" : "0123456789ABCDEF";
-            radix = 16;
+  std::mutex mutex_;
+  std::unordered_map<uint64_t, std::shared_ptr<const ParsedFormat>> entries_;
+};
 
-            if (flags & FF_AddPrefix) {
-              prefix.buffer[0] = '0';
-              prefix.buffer[1] = c == 'x' ? 'x' : 'X';
-              prefix.length = 2;
-            }
+FormatCache format_cache;
 
-            goto integer;
-          }
+int32_t format_core(PPCContext* ppc_context, uint32_t format_ptr,
+                    FormatData& data, ArgList& args, const bool wide) {
+  std::shared_ptr<const ParsedFormat> format = format_cache.Get(
+      format_ptr, SHIM_MEM_ADDR(format_ptr), data.is_wide_format());
 
-          // floating-point with exponent
-          case 'e':
-          case 'E': {
-            // fall through
-          }
+  int32_t count = 0;
 
-          // floating-point without exponent
-          case 'f': {
-          floatingpoint:
-            flags |= FF_IsSigned;
+  char work8[512];
+  char16_t work16[4];
+  fmt::memory_buffer float_text;
 
-            int64_t dummy = args.get64();
-            double value = *(double*)&dummy;
+  struct {
+    const void* buffer;
+    int32_t length;
+    bool is_wide;
+    bool swap_wide;
+  } text;
 
-            if (value < 0) {
-              value = -value;
-              flags |= FF_AddNegative;
-            }
+  struct {
+    char buffer[2];
+    int32_t length;
+  } prefix;
 
-            auto s = format_double(value, precision, c, flags);
-            auto length = (int32_t)s.size();
-            assert_true(length < xe::countof(work8));
+  for (const FormatSpec& spec : format->specs) {
+    if (spec.literal_length) {
+      if (!data.put(&format->literals[spec.literal_offset],
+                    spec.literal_length)) {
+        return -1;
+      }
+      count += spec.literal_length;
+    }
+    if (!spec.type) {
+      return format->truncated ? -1 : count;
+    }
 
-            auto start = &work8[0];
-            auto end = &start[length];
+    uint16_t c = spec.type;
+    uint32_t flags = spec.flags;
+    int32_t width = spec.width;
+    int32_t precision = spec.precision;
+    if (spec.width_from_args) {
+      width = (int32_t)args.get32();
+      if (width < 0) {
+        flags |= FF_LeftJustify;
+        width = -width;
+      }
+    }
+    if (spec.precision_from_args) {
+      precision = (int32_t)args.get32();
+      if (precision < 0) {
+        precision = -1;
+      }
+    }
 
-            std::memcpy(start, s.c_str(), length);
-            end[0] = '\0';
+    text.buffer = nullptr;
+    text.is_wide = false;
+    text.swap_wide = true;
+    text.length = 0;
+    prefix.buffer[0] = '\0';
+    prefix.length = 0;
+
+    // https://msdn.microsoft.com/en-us/library/hf4y5e3w.aspx
+    switch (c) {
+      // wide character
+      case 'C': {
+        flags |= FF_InvertWide;
+        // fall through
+      }
 
-            text.buffer = start;
-            text.length = (int32_t)(end - start);
-            text.is_wide = false;
-            break;
-          }
+      // character
+      case 'c': {
+        bool is_wide;
+        if (flags & (FF_IsLong | FF_IsWide)) {
+          // "An lc, lC, wc or wC type specifier is synonymous with C in
+          // printf functions and with c in wprintf functions."
+          is_wide = true;
+        } else if (flags & FF_IsShort) {
+          // "An hc or hC type specifier is synonymous with c in printf
+          // functions and with C in wprintf functions."
+          is_wide = false;
+        } else {
+          is_wide = ((flags & FF_InvertWide) != 0) ^ wide;
+        }
 
-          // floating-point with or without exponent
-          case 'g':
-          case 'G': {
-            goto floatingpoint;
-          }
+        auto value = args.get32();
+
+        if (!is_wide) {
+          work8[0] = (uint8_t)value;
+          text.buffer = &work8[0];
+          text.length = 1;
+          text.is_wide = false;
+        } else {
+          work16[0] = (uint16_t)value;
+          text.buffer = &work16[0];
+          text.length = 1;
+          text.is_wide = true;
+          text.swap_wide = false;
+        }
 
-          // floating-point in hexadecimal
-          case 'a':
-          case 'A': {
-            goto floatingpoint;
-          }
+        break;
+      }
 
-          // pointer to integer
-          case 'n': {
-            auto pointer = (uint32_t)args.get32();
-            if (flags & FF_IsShort) {
-              SHIM_SET_MEM_16(pointer, (uint16_t)count);
-            } else {
-              SHIM_SET_MEM_32(pointer, (uint32_t)count);
-            }
-            continue;
-          }
+      // signed decimal integer
+      case 'd':
+      case 'i': {
+        flags |= FF_IsSigned;
+
+      integer:
+        int64_t value;
+
+        if (flags & FF_IsLongLong) {
+          value = (int64_t)args.get64();
+        } else if (flags & FF_IsLong) {
+          value = (int32_t)args.get32();
+        } else if (flags & FF_IsShort) {
+          value = (int16_t)args.get32();
+        } else {
+          value = (int32_t)args.get32();
+        }
 
-          // pointer
-          case 'p': {
-            digits = "0123456789ABCDEF";
-            radix = 16;
-            precision = 8;
-            flags &= ~(FF_IsLongLong | FF_IsShort);
-            flags |= FF_IsLong;
-            goto integer;
-          }
+        // Leave space for the leading zero of octal numbers.
+        if (precision >= 0) {
+          precision = std::min(precision, (int32_t)xe::countof(work8) - 2);
+        } else {
+          precision = 1;
+        }
 
-          // wide string
-          case 'S': {
-            flags |= FF_InvertWide;
-            // fall through
-          }
+        uint64_t magnitude = uint64_t(value);
+        if ((flags & FF_IsSigned) && value < 0) {
+          magnitude = 0 - magnitude;
+          flags |= FF_AddNegative;
+        }
 
-          // string
-          case 's': {
-            uint32_t pointer = args.get32();
-            int32_t cap = precision < 0 ? INT32_MAX : precision;
-
-            if (pointer == 0) {
-              auto nullstr = "(null)";
-              text.buffer = nullstr;
-              text.length = std::min((int32_t)strlen(nullstr), cap);
-              text.is_wide = false;
-            } else {
-              void* str = SHIM_MEM_ADDR(pointer);
-              bool is_wide;
-              if (flags & (FF_IsLong | FF_IsWide)) {
-                // "An ls, lS, ws or wS type specifier is synonymous with S in
-                // printf functions and with s in wprintf functions."
-                is_wide = true;
-              } else if (flags & FF_IsShort) {
-                // "An hs or hS type specifier is synonymous with s in printf
-                // functions and with S in wprintf functions."
-                is_wide = false;
-              } else {
-                is_wide = ((flags & FF_InvertWide) != 0) ^ wide;
-              }
-              int32_t length;
-
-              if (!is_wide) {
-                length = 0;
-                for (auto s = (const uint8_t*)str; cap > 0 && *s; ++s, cap--) {
-                  length++;
-                }
-              } else {
-                length = 0;
-                for (auto s = (const uint16_t*)str; cap > 0 && *s; ++s, cap--) {
-                  length++;
-                }
-              }
-
-              text.buffer = str;
-              text.length = length;
-              text.is_wide = is_wide;
-            }
-            break;
-          }
+        if (!(flags & FF_IsLongLong)) {
+          magnitude &= UINT32_MAX;
+        }
 
-          // ANSI_STRING / UNICODE_STRING
-          case 'Z': {
-            assert_always();
-            break;
-          }
+        if (magnitude == 0) {
+          prefix.length = 0;
+        }
+
+        // At least precision digits, none for zero with a zero precision.
+        char number[24];
+        int32_t number_length = 0;
+        if (magnitude != 0 || precision > 0) {
+          number_length =
+              int32_t(format_integer(number, magnitude, c) - number);
+        }
+
+        char* end = &work8[xe::countof(work8) - 1];
+        end[0] = '\0';
+        char* start = end - number_length;
+        std::memcpy(start, number, number_length);
+        if (precision > number_length) {
+          start -= precision - number_length;
+          std::memset(start, '0', precision - number_length);
+        }
+
+        if ((flags & FF_ForceLeadingZero) &&
+            (start == end || *start != '0')) {
+          *--start = '0';
+        }
+
+        text.buffer = start;
+        text.length = (int32_t)(end - start);
+        text.is_wide = false;
+        break;
+      }
+
+      // unsigned octal integer
+      case 'o': {
+        if (flags & FF_AddPrefix) {
+          flags |= FF_ForceLeadingZero;
+        }
+        goto integer;
+      }
+
+      // unsigned decimal integer
+      case 'u': {
+        goto integer;
+      }
+
+      // unsigned hexadecimal integer
+      case 'x':
+      case 'X': {
+        if (flags & FF_AddPrefix) {
+          prefix.buffer[0] = '0';
+          prefix.buffer[1] = c == 'x' ? 'x' : 'X';
+          prefix.length = 2;
+        }
+
+        goto integer;
+      }
+
+      // floating-point with exponent
+      case 'e':
+      case 'E':
+      // floating-point without exponent
+      case 'f':
+      // floating-point with or without exponent
+      case 'g':
+      case 'G':
+      // floating-point in hexadecimal
+      case 'a':
+      case 'A': {
+        flags |= FF_IsSigned;
+
+        int64_t dummy = args.get64();
+        double value = *(double*)&dummy;
+
+        if (value < 0) {
+          value = -value;
+          flags |= FF_AddNegative;
+        }
+
+        float_text.clear();
+        format_double(float_text, value, precision, c, flags);
 
-          default: {
-            assert_always();
+        text.buffer = float_text.data();
+        text.length = (int32_t)float_text.size();
+        text.is_wide = false;
+        break;
+      }
+
+      // pointer to integer
+      case 'n': {
+        auto pointer = (uint32_t)args.get32();
+        if (flags & FF_IsShort) {
+          SHIM_SET_MEM_16(pointer, (uint16_t)count);
+        } else {
+          SHIM_SET_MEM_32(pointer, (uint32_t)count);
+        }
+        continue;
+      }
+
+      // pointer
+      case 'p': {
+        precision = 8;
+        flags &= ~(FF_IsLongLong | FF_IsShort);
+        flags |= FF_IsLong;
+        goto integer;
+      }
+
+      // wide string
+      case 'S': {
+        flags |= FF_InvertWide;
+        // fall through
+      }
+
+      // string
+      case 's': {
+        uint32_t pointer = args.get32();
+        int32_t cap = precision < 0 ? INT32_MAX : precision;
+
+        if (pointer == 0) {
+          auto nullstr = "(null)";
+          text.buffer = nullstr;
+          text.length = std::min((int32_t)strlen(nullstr), cap);
+          text.is_wide = false;
+        } else {
+          void* str = SHIM_MEM_ADDR(pointer);
+          bool is_wide;
+          if (flags & (FF_IsLong | FF_IsWide)) {
+            // "An ls, lS, ws or wS type specifier is synonymous with S in
+            // printf functions and with s in wprintf functions."
+            is_wide = true;
+          } else if (flags & FF_IsShort) {
+            // "An hs or hS type specifier is synonymous with s in printf
+            // functions and with S in wprintf functions."
+            is_wide = false;
+          } else {
+            is_wide = ((flags & FF_InvertWide) != 0) ^ wide;
+          }
+          int32_t length;
+
+          if (!is_wide) {
+            // memchr stops reading at the terminator.
+            auto end = std::memchr(str, 0, size_t(cap));
+            length = end ? int32_t(static_cast<const char*>(end) -
+                                   static_cast<const char*>(str))
+                         : cap;
+          } else {
+            length = int32_t(xe::find_zero_16(
+                static_cast<const uint16_t*>(str), size_t(cap)));
           }
+
+          text.buffer = str;
+          text.length = length;
+          text.is_wide = is_wide;
         }
+        break;
+      }
+
+      // ANSI_STRING / UNICODE_STRING
+      case 'Z': {
+        assert_always();
+        break;
+      }
+
+      default: {
+        assert_always();
       }
     }
 
@@ -599,73 +776,52 @@ int32_t format_core(PPCContext* ppc_context, FormatData& data, ArgList& args,
 
     if (!(flags & (FF_LeftJustify | FF_AddLeadingZeros)) && padding > 0) {
       count += padding;
-      while (padding-- > 0) {
-        if (!data.put(' ')) {
-          return -1;
-        }
+      if (!data.fill(' ', padding)) {
+        return -1;
       }
     }
 
     if (prefix.length > 0) {
-      int32_t remaining = prefix.length;
       count += prefix.length;
-      auto b = &prefix.buffer[0];
-      while (remaining-- > 0) {
-        if (!data.put(*b++)) {
-          return -1;
-        }
+      if (!data.put(reinterpret_cast<const uint8_t*>(prefix.buffer),
+                    prefix.length)) {
+        return -1;
       }
     }
 
     if ((flags & FF_AddLeadingZeros) && !(flags & (FF_LeftJustify)) &&
         padding > 0) {
       count += padding;
-      while (padding-- > 0) {
-        if (!data.put('0')) {
-          return -1;
-        }
+      if (!data.fill('0', padding)) {
+        return -1;
       }
     }
 
-    int32_t remaining = text.length;
+    bool put_text;
     if (!text.is_wide) {
       // it's a const char*
-      auto b = (const uint8_t*)text.buffer;
-      while (remaining-- > 0) {
-        if (!data.put(*b++)) {
-          return -1;
-        }
-      }
+      put_text = data.put(static_cast<const uint8_t*>(text.buffer),
+                          text.length);
+    } else if (text.swap_wide) {
+      // it's a big-endian const char16_t*
+      put_text = data.put_swapped(static_cast<const uint16_t*>(text.buffer),
+                                  text.length);
     } else {
-      // it's a const char16_t*
-      auto b = (const uint16_t*)text.buffer;
-      if (text.swap_wide) {
-        while (remaining-- > 0) {
-          if (!data.put(xe::byte_swap(*b++))) {
-            return -1;
-          }
-        }
-      } else {
-        while (remaining-- > 0) {
-          if (!data.put(*b++)) {
-            return -1;
-          }
-        }
-      }
+      put_text = data.put(static_cast<const char16_t*>(text.buffer),
+                          text.length);
+    }
+    if (!put_text) {
+      return -1;
     }
     count += text.length;
 
     // right padding
     if ((flags & FF_LeftJustify) && padding > 0) {
       count += padding;
-      while (padding-- > 0) {
-        if (!data.put(' ')) {
-          return -1;
-        }
+      if (!data.fill(' ', padding)) {
+        return -1;
       }
     }
-
-    state = FS_Unknown;
   }
 
   return count;
@@ -710,107 +866,116 @@ class ArrayArgList : public ArgList {
 
 class StringFormatData : public FormatData {
  public:
-  StringFormatData(const uint8_t* input) : input_(input) {}
+  bool is_wide_format() const override { return false; }
 
-  uint16_t get() {
-    uint16_t result = *input_;
-    if (result) {
-      input_++;
+  bool put(uint16_t c) override {
+    if (c >= 0x100) {
+      return false;
     }
-    return result;
+    output_.push_back(char(c));
+    return true;
   }
 
-  uint16_t peek(int32_t offset) { return input_[offset]; }
-
-  void skip(int32_t count) {
-    while (count-- > 0) {
-      if (!get()) {
-        break;
+  bool put(const char16_t* text, size_t length) override {
+    for (size_t i = 0; i < length; ++i) {
+      if (text[i] >= 0x100) {
+        return false;
       }
     }
+    output_.append(text, text + length);
+    return true;
   }
 
-  bool put(uint16_t c) {
+  bool put(const uint8_t* text, size_t length) override {
+    output_.append(reinterpret_cast<const char*>(text), length);
+    return true;
+  }
+
+  bool fill(uint16_t c, int32_t count) override {
     if (c >= 0x100) {
       return false;
     }
-    output_ << (char)c;
+    output_.append(size_t(count), char(c));
     return true;
   }
 
-  std::string str() const { return output_.str(); }
+  const std::string& str() const { return output_; }
 
  private:
-  const uint8_t* input_;
-  std::ostringstream output_;
+  std::string output_;
 };
 
 class WideStringFormatData : public FormatData {
  public:
-  WideStringFormatData(const uint16_t* input) : input_(input) {}
+  bool is_wide_format() const override { return true; }
 
-  uint16_t get() {
-    uint16_t result = *input_;
-    if (result) {
-      input_++;
-    }
-    return xe::byte_swap(result);
+  bool put(uint16_t c) override {
+    output_.push_back(char16_t(c));
+    return true;
   }
 
-  uint16_t peek(int32_t offset) { return xe::byte_swap(input_[offset]); }
+  bool put(const char16_t* text, size_t length) override {
+    output_.append(text, length);
+    return true;
+  }
 
-  void skip(int32_t count) {
-    while (count-- > 0) {
-      if (!get()) {
-        break;
-      }
-    }
+  bool put(const uint8_t* text, size_t length) override {
+    output_.append(text, text + length);
+    return true;
   }
 
-  bool put(uint16_t c) {
-    output_ << (char16_t)c;
+  bool put_swapped(const uint16_t* text, size_t length) override {
+    size_t offset = output_.size();
+    output_.resize(offset + length);
+    xe::copy_and_swap(reinterpret_cast<uint16_t*>(&output_[offset]), text,
+                      length);
     return true;
   }
 
-  std::u16string wstr() const { return output_.str(); }
+  bool fill(uint16_t c, int32_t count) override {
+    output_.append(size_t(count), char16_t(c));
+    return true;
+  }
+
+  const std::u16string& wstr() const { return output_; }
 
  private:
-  const uint16_t* input_;
-  std::basic_stringstream<char16_t> output_;
+  std::u16string output_;
 };
 
 class WideCountFormatData : public FormatData {
  public:
-  WideCountFormatData(const uint16_t* input) : input_(input), count_(0) {}
+  bool is_wide_format() const override { return true; }
 
-  uint16_t get() {
-    uint16_t result = *input_;
-    if (result) {
-      input_++;
-    }
-    return xe::byte_swap(result);
+  bool put(uint16_t c) override {
+    ++count_;
+    return true;
   }
 
-  uint16_t peek(int32_t offset) { return xe::byte_swap(input_[offset]); }
+  bool put(const char16_t* text, size_t length) override {
+    count_ += int32_t(length);
+    return true;
+  }
 
-  void skip(int32_t count) {
-    while (count-- > 0) {
-      if (!get()) {
-        break;
-      }
-    }
+  bool put(const uint8_t* text, size_t length) override {
+    count_ += int32_t(length);
+    return true;
   }
 
-  bool put(uint16_t c) {
-    ++count_;
+  bool put_swapped(const uint16_t* text, size_t length) override {
+    count_ += int32_t(length);
+    return true;
+  }
+
+  bool fill(uint16_t c, int32_t count) override {
+    count_ += count;
     return true;
   }
 
   const int32_t count() const { return count_; }
 
  private:
-  const uint16_t* input_;
-  int32_t count_;
+  int32_t count_ = 0;
 };
 
 SHIM_CALL DbgPrint_shim(PPCContext* ppc_context, KernelState* kernel_state) {
@@ -819,12 +984,11 @@ SHIM_CALL DbgPrint_shim(PPCContext* ppc_context, KernelState* kernel_state) {
     SHIM_SET_RETURN_32(X_STATUS_INVALID_PARAMETER);
     return;
   }
-  auto format = (const uint8_t*)SHIM_MEM_ADDR(format_ptr);
 
   StackArgList args(ppc_context, 1);
-  StringFormatData data(format);
+  StringFormatData data;
 
-  int32_t count = format_core(ppc_context, data, args, false);
+  int32_t count = format_core(ppc_context, format_ptr, data, args, false);
   if (count <= 0) {
     SHIM_SET_RETURN_32(X_STATUS_SUCCESS);
     return;
@@ -850,12 +1014,11 @@ SHIM_CALL _snprintf_shim(PPCContext* ppc_context, KernelState* kernel_state) {
   }
 
   auto buffer = (uint8_t*)SHIM_MEM_ADDR(buffer_ptr);
-  auto format = (const uint8_t*)SHIM_MEM_ADDR(format_ptr);
 
   StackArgList args(ppc_context, 3);
-  StringFormatData data(format);
+  StringFormatData data;
 
-  int32_t count = format_core(ppc_context, data, args, false);
+  int32_t count = format_core(ppc_context, format_ptr, data, args, false);
   if (count < 0) {
     if (buffer_count > 0) {
       buffer[0] = '\0';  // write a null, just to be safe
@@ -885,12 +1048,11 @@ SHIM_CALL sprintf_shim(PPCContext* ppc_context, KernelState* kernel_state) {
   }
 
   auto buffer = (uint8_t*)SHIM_MEM_ADDR(buffer_ptr);
-  auto format = (const uint8_t*)SHIM_MEM_ADDR(format_ptr);
 
   StackArgList args(ppc_context, 2);
-  StringFormatData data(format);
+  StringFormatData data;
 
-  int32_t count = format_core(ppc_context, data, args, false);
+  int32_t count = format_core(ppc_context, format_ptr, data, args, false);
   if (count <= 0) {
     buffer[0] = '\0';
   } else {
@@ -915,12 +1077,11 @@ SHIM_CALL _snwprintf_shim(PPCContext* ppc_context, KernelState* kernel_state) {
   }
 
   auto buffer = (uint16_t*)SHIM_MEM_ADDR(buffer_ptr);
-  auto format = (const uint16_t*)SHIM_MEM_ADDR(format_ptr);
 
   StackArgList args(ppc_context, 3);
-  WideStringFormatData data(format);
+  WideStringFormatData data;
 
-  int32_t count = format_core(ppc_context, data, args, true);
+  int32_t count = format_core(ppc_context, format_ptr, data, args, true);
   if (count < 0) {
     if (buffer_count > 0) {
       buffer[0] = '\0';  // write a null, just to be safe
@@ -950,12 +1111,11 @@ SHIM_CALL swprintf_shim(PPCContext* ppc_context, KernelState* kernel_state) {
   }
 
   auto buffer = (uint16_t*)SHIM_MEM_ADDR(buffer_ptr);
-  auto format = (const uint16_t*)SHIM_MEM_ADDR(format_ptr);
 
   StackArgList args(ppc_context, 2);
-  WideStringFormatData data(format);
+  WideStringFormatData data;
 
-  int32_t count = format_core(ppc_context, data, args, false);
+  int32_t count = format_core(ppc_context, format_ptr, data, args, false);
   if (count <= 0) {
     buffer[0] = '\0';
   } else {
@@ -981,12 +1141,11 @@ SHIM_CALL _vsnprintf_shim(PPCContext* ppc_context, KernelState* kernel_state) {
   }
 
   auto buffer = (uint8_t*)SHIM_MEM_ADDR(buffer_ptr);
-  auto format = (const uint8_t*)SHIM_MEM_ADDR(format_ptr);
 
   ArrayArgList args(ppc_context, arg_ptr);
-  StringFormatData data(format);
+  StringFormatData data;
 
-  int32_t count = format_core(ppc_context, data, args, false);
+  int32_t count = format_core(ppc_context, format_ptr, data, args, false);
   if (count < 0) {
     // Error.
     if (buffer_count > 0) {
@@ -1021,12 +1180,11 @@ SHIM_CALL _vsnwprintf_shim(PPCContext* ppc_context, KernelState* kernel_state) {
   }
 
   auto buffer = (uint16_t*)SHIM_MEM_ADDR(buffer_ptr);
-  auto format = (const uint16_t*)SHIM_MEM_ADDR(format_ptr);
 
   ArrayArgList args(ppc_context, arg_ptr);
-  WideStringFormatData data(format);
+  WideStringFormatData data;
 
-  int32_t count = format_core(ppc_context, data, args, true);
+  int32_t count = format_core(ppc_context, format_ptr, data, args, true);
   if (count < 0) {
     // Error.
     if (buffer_count > 0) {
@@ -1059,12 +1217,11 @@ SHIM_CALL vsprintf_shim(PPCContext* ppc_context, KernelState* kernel_state) {
   }
 
   auto buffer = (uint8_t*)SHIM_MEM_ADDR(buffer_ptr);
-  auto format = (const uint8_t*)SHIM_MEM_ADDR(format_ptr);
 
   ArrayArgList args(ppc_context, arg_ptr);
-  StringFormatData data(format);
+  StringFormatData data;
 
-  int32_t count = format_core(ppc_context, data, args, false);
+  int32_t count = format_core(ppc_context, format_ptr, data, args, false);
   if (count <= 0) {
     buffer[0] = '\0';
   } else {
@@ -1086,12 +1243,11 @@ SHIM_CALL _vscwprintf_shim(PPCContext* ppc_context, KernelState* kernel_state) {
     return;
   }
 
-  auto format = (const uint16_t*)SHIM_MEM_ADDR(format_ptr);
 
   ArrayArgList args(ppc_context, arg_ptr);
-  WideCountFormatData data(format);
+  WideCountFormatData data;
 
-  int32_t count = format_core(ppc_context, data, args, true);
+  int32_t count = format_core(ppc_context, format_ptr, data, args, true);
   assert_true(count < 0 || data.count() == count);
   SHIM_SET_RETURN_32(count);
 }
@@ -1110,12 +1266,11 @@ SHIM_CALL vswprintf_shim(PPCContext* ppc_context, KernelState* kernel_state) {
   }
 
   auto buffer = (uint16_t*)SHIM_MEM_ADDR(buffer_ptr);
-  auto format = (const uint16_t*)SHIM_MEM_ADDR(format_ptr);
 
   ArrayArgList args(ppc_context, arg_ptr);
-  WideStringFormatData data(format);
+  WideStringFormatData data;
 
-  int32_t count = format_core(ppc_context, data, args, true);
+  int32_t count = format_core(ppc_context, format_ptr, data, args, true);
   if (count <= 0) {
     buffer[0] = '\0';
   } else {
@@ -8,7 +8,6 @@
  */
 
 #include <algorithm>
-#include <vector>
 
 #include "xenia/base/atomic.h"
 #include "xenia/base/clock.h"
@@ -792,22 +791,22 @@ dword_result_t KeWaitForMultipleObjects(dword_t count, lpdword_t objects_ptr,
                                         lpqword_t timeout_ptr,
                                         lpvoid_t wait_block_array_ptr) {
   assert_true(wait_type <= 1);
+  if (count > XObject::kMaxWaitObjects) {
+    return X_STATUS_INVALID_PARAMETER;
+  }
 
-  std::vector<object_ref<XObject>> objects;
+  // Job systems wait for many objects every frame - don't allocate.
+  object_ref<XObject> objects[XObject::kMaxWaitObjects];
   for (uint32_t n = 0; n < count; n++) {
     auto object_ptr = kernel_memory()->TranslateVirtual(objects_ptr[n]);
-    auto object_ref =
-        XObject::GetNativeObject<XObject>(kernel_state(), object_ptr);
-    if (!object_ref) {
+    objects[n] = XObject::GetNativeObject<XObject>(kernel_state(), object_ptr);
+    if (!objects[n]) {
       return X_STATUS_INVALID_PARAMETER;
     }
-
-    objects.push_back(std::move(object_ref));
   }
 
   uint64_t timeout = timeout_ptr ? static_cast<uint64_t>(*timeout_ptr) : 0u;
-  return XObject::WaitMultiple(uint32_t(objects.size()),
-                               reinterpret_cast<XObject**>(objects.data()),
+  return XObject::WaitMultiple(count, reinterpret_cast<XObject**>(objects),
                                wait_type, wait_reason, processor_mode,
                                alertable, timeout_ptr ? &timeout : nullptr);
 }
@@ -819,20 +818,21 @@ uint32_t xeNtWaitForMultipleObjectsEx(uint32_t count, xe::be<uint32_t>* handles,
                                       uint32_t alertable,
                                       uint64_t* timeout_ptr) {
   assert_true(wait_type <= 1);
+  if (count > XObject::kMaxWaitObjects) {
+    return X_STATUS_INVALID_PARAMETER;
+  }
 
-  std::vector<object_ref<XObject>> objects;
+  object_ref<XObject> objects[XObject::kMaxWaitObjects];
   for (uint32_t n = 0; n < count; n++) {
     uint32_t object_handle = handles[n];
-    auto object =
+    objects[n] =
         kernel_state()->object_table()->LookupObject<XObject>(object_handle);
-    if (!object) {
+    if (!objects[n]) {
       return X_STATUS_INVALID_PARAMETER;
     }
-    objects.push_back(std::move(object));
   }
 
-  return XObject::WaitMultiple(count,
-                               reinterpret_cast<XObject**>(objects.data()),
+  return XObject::WaitMultiple(count, reinterpret_cast<XObject**>(objects),
                                wait_type, 6, wait_mode, alertable, timeout_ptr);
 }
 
@@ -56,11 +56,13 @@ void XEvent::InitializeNative(void* native_ptr, X_DISPATCH_HEADER* header) {
 
 int32_t XEvent::Set(uint32_t priority_increment, bool wait) {
   event_->Set();
+  NotifySignaled();
   return 1;
 }
 
 int32_t XEvent::Pulse(uint32_t priority_increment, bool wait) {
   event_->Pulse();
+  NotifySignaled();
   return 1;
 }
 
@@ -89,90 +89,165 @@ X_STATUS XFile::QueryDirectory(X_FILE_DIRECTORY_INFORMATION* out_info,
   return X_STATUS_SUCCESS;
 }
 
-X_STATUS XFile::Read(uint32_t buffer_guest_address, uint32_t buffer_length,
-                     uint64_t byte_offset, uint32_t* out_bytes_read,
-                     uint32_t apc_context) {
-  if (byte_offset == uint64_t(-1)) {
-    // Read from current position.
-    byte_offset = position_;
-  }
-
-  size_t bytes_read = 0;
-  X_STATUS result = X_STATUS_SUCCESS;
+X_STATUS XFile::PrepareReadBuffer(uint32_t buffer_guest_address,
+                                  uint32_t buffer_length,
+                                  ReadBuffer& buffer_out) {
+  buffer_out.guest_address = buffer_guest_address;
+  buffer_out.length = buffer_length;
+  buffer_out.host_address = nullptr;
+  buffer_out.physical_heap = nullptr;
   // Zero length means success for a valid file object according to Windows
   // tests.
-  if (buffer_length) {
-    if (UINT32_MAX - buffer_guest_address < buffer_length) {
-      result = X_STATUS_ACCESS_VIOLATION;
-    } else {
-      // Games often read directly to texture/vertex buffer memory - in this
-      // case, invalidation notifications must be sent. However, having any
-      // memory callbacks in the range will result in STATUS_ACCESS_VIOLATION at
-      // least on Windows, without anything being read or any callbacks being
-      // triggered. So for physical memory, host protection must be bypassed,
-      // and invalidation callbacks must be triggered manually (it's also wrong
-      // to trigger invalidation callbacks before reading in this case, because
-      // during the read, the guest may still access the data around the buffer
-      // that is located in the same host pages as the buffer's start and end,
-      // on the GPU - and that must not trigger a race condition).
-      uint32_t buffer_guest_high_address =
-          buffer_guest_address + buffer_length - 1;
-      xe::BaseHeap* buffer_start_heap =
-          memory()->LookupHeap(buffer_guest_address);
-      const xe::BaseHeap* buffer_end_heap =
-          memory()->LookupHeap(buffer_guest_high_address);
-      if (!buffer_start_heap || !buffer_end_heap ||
-          (buffer_start_heap->heap_type() == HeapType::kGuestPhysical) !=
-              (buffer_end_heap->heap_type() == HeapType::kGuestPhysical) ||
-          (buffer_start_heap->heap_type() == HeapType::kGuestPhysical &&
-           buffer_start_heap != buffer_end_heap)) {
-        result = X_STATUS_ACCESS_VIOLATION;
-      } else {
-        xe::PhysicalHeap* buffer_physical_heap =
-            buffer_start_heap->heap_type() == HeapType::kGuestPhysical
-                ? static_cast<xe::PhysicalHeap*>(buffer_start_heap)
-                : nullptr;
-        if (buffer_physical_heap &&
-            buffer_physical_heap->QueryRangeAccess(buffer_guest_address,
-                                                   buffer_guest_high_address) !=
-                memory::PageAccess::kReadWrite) {
-          result = X_STATUS_ACCESS_VIOLATION;
-        } else {
-          result = file_->ReadSync(
-              buffer_physical_heap
-                  ? memory()->TranslatePhysical(
-                        buffer_physical_heap->GetPhysicalAddress(
-                            buffer_guest_address))
-                  : memory()->TranslateVirtual(buffer_guest_address),
-              buffer_length, size_t(byte_offset), &bytes_read);
-          if (XSUCCEEDED(result)) {
-            if (buffer_physical_heap) {
-              buffer_physical_heap->TriggerCallbacks(
-                  xe::global_critical_region::AcquireDirect(),
-                  buffer_guest_address, buffer_length, true, true);
-            }
-            position_ += bytes_read;
-          }
-        }
-      }
+  if (!buffer_length) {
+    return X_STATUS_SUCCESS;
+  }
+  if (UINT32_MAX - buffer_guest_address < buffer_length) {
+    return X_STATUS_ACCESS_VIOLATION;
+  }
+  // Games often read directly to texture/vertex buffer memory - in this
+  // case, invalidation notifications must be sent. However, having any
+  // memory callbacks in the range will result in STATUS_ACCESS_VIOLATION at
+  // least on Windows, without anything being read or any callbacks being
+  // triggered. So for physical memory, host protection must be bypassed,
+  // and invalidation callbacks must be triggered manually (it's also wrong
+  // to trigger invalidation callbacks before reading in this case, because
+  // during the read, the guest may still access the data around the buffer
+  // that is located in the same host pages as the buffer's start and end,
+  // on the GPU - and that must not trigger a race condition).
+  uint32_t buffer_guest_high_address = buffer_guest_address + buffer_length - 1;
+  xe::BaseHeap* buffer_start_heap = memory()->LookupHeap(buffer_guest_address);
+  const xe::BaseHeap* buffer_end_heap =
+      memory()->LookupHeap(buffer_guest_high_address);
+  if (!buffer_start_heap || !buffer_end_heap ||
+      (buffer_start_heap->heap_type() == HeapType::kGuestPhysical) !=
+          (buffer_end_heap->heap_type() == HeapType::kGuestPhysical) ||
+      (buffer_start_heap->heap_type() == HeapType::kGuestPhysical &&
+       buffer_start_heap != buffer_end_heap)) {
+    return X_STATUS_ACCESS_VIOLATION;
+  }
+  xe::PhysicalHeap* buffer_physical_heap =
+      buffer_start_heap->heap_type() == HeapType::kGuestPhysical
+          ? static_cast<xe::PhysicalHeap*>(buffer_start_heap)
+          : nullptr;
+  if (buffer_physical_heap &&
+      buffer_physical_heap->QueryRangeAccess(buffer_guest_address,
+                                             buffer_guest_high_address) !=
+          memory::PageAccess::kReadWrite) {
+    return X_STATUS_ACCESS_VIOLATION;
+  }
+  buffer_out.host_address =
+      buffer_physical_heap
+          ? memory()->TranslatePhysical(
+                buffer_physical_heap->GetPhysicalAddress(buffer_guest_address))
+          : memory()->TranslateVirtual(buffer_guest_address);
+  buffer_out.physical_heap = buffer_physical_heap;
+  return X_STATUS_SUCCESS;
+}
+
+X_STATUS XFile::ReadToBuffer(const ReadBuffer& buffer, uint64_t byte_offset,
+                             size_t* out_bytes_read) {
+  *out_bytes_read = 0;
+  if (!buffer.length) {
+    return X_STATUS_SUCCESS;
+  }
+  // Data in memory-mapped containers is copied to the guest buffer directly,
+  // in as few copies as the layout of the container allows.
+  std::vector<vfs::MappedSpan> spans;
+  X_STATUS result =
+      file_->GetMappedSpans(size_t(byte_offset), buffer.length, spans);
+  if (result == X_STATUS_NOT_IMPLEMENTED) {
+    result = file_->ReadSync(buffer.host_address, buffer.length,
+                             size_t(byte_offset), out_bytes_read);
+  } else if (XSUCCEEDED(result)) {
+    uint8_t* dest = reinterpret_cast<uint8_t*>(buffer.host_address);
+    for (const vfs::MappedSpan& span : spans) {
+      std::memcpy(dest, span.data, span.length);
+      dest += span.length;
     }
+    *out_bytes_read = dest - reinterpret_cast<uint8_t*>(buffer.host_address);
   }
+  // The invalidation callbacks are triggered once for the whole request.
+  if (XSUCCEEDED(result)) {
+    if (buffer.physical_heap) {
+      buffer.physical_heap->TriggerCallbacks(
+          xe::global_critical_region::AcquireDirect(), buffer.guest_address,
+          buffer.length, true, true);
+    }
+    position_ += *out_bytes_read;
+    kernel_state()->file_system()->RecordRead(file_->entry(), byte_offset,
+                                              *out_bytes_read);
+  }
+  return result;
+}
 
+void XFile::CompleteIO(uint32_t apc_context, X_STATUS result,
+                       uint32_t bytes_transferred) {
   XIOCompletion::IONotification notify;
   notify.apc_context = apc_context;
-  notify.num_bytes = uint32_t(bytes_read);
+  notify.num_bytes = bytes_transferred;
   notify.status = result;
 
   NotifyIOCompletionPorts(notify);
 
+  async_event_->Set();
+}
+
+X_STATUS XFile::Read(uint32_t buffer_guest_address, uint32_t buffer_length,
+                     uint64_t byte_offset, uint32_t* out_bytes_read,
+                     uint32_t apc_context) {
+  if (byte_offset == uint64_t(-1)) {
+    // Read from current position.
+    byte_offset = position_;
+  }
+
+  size_t bytes_read = 0;
+  ReadBuffer buffer;
+  X_STATUS result =
+      PrepareReadBuffer(buffer_guest_address, buffer_length, buffer);
+  if (XSUCCEEDED(result)) {
+    result = ReadToBuffer(buffer, byte_offset, &bytes_read);
+  }
+
   if (out_bytes_read) {
     *out_bytes_read = uint32_t(bytes_read);
   }
 
-  async_event_->Set();
+  CompleteIO(apc_context, result, uint32_t(bytes_read));
   return result;
 }
 
+X_STATUS XFile::ReadAsync(uint32_t buffer_guest_address,
+                          uint32_t buffer_length, uint64_t byte_offset,
+                          uint32_t apc_context,
+                          ReadCompletionCallback completion_callback) {
+  if (byte_offset == uint64_t(-1)) {
+    // Read from current position.
+    byte_offset = position_;
+  }
+
+  // Invalid buffers are reported right away, like on Windows.
+  ReadBuffer buffer;
+  X_STATUS result =
+      PrepareReadBuffer(buffer_guest_address, buffer_length, buffer);
+  if (XFAILED(result)) {
+    CompleteIO(apc_context, result, 0);
+    return result;
+  }
+
+  async_event_->Reset();
+  kernel_state()->io_worker_pool()->Queue(
+      [file = retain_object(this), buffer, byte_offset, apc_context,
+       completion_callback = std::move(completion_callback)]() {
+        size_t bytes_read = 0;
+        X_STATUS result = file->ReadToBuffer(buffer, byte_offset, &bytes_read);
+        if (completion_callback) {
+          completion_callback(result, uint32_t(bytes_read));
+        }
+        file->CompleteIO(apc_context, result, uint32_t(bytes_read));
+      });
+  return X_STATUS_PENDING;
+}
+
 X_STATUS XFile::Write(uint32_t buffer_guest_address, uint32_t buffer_length,
                       uint64_t byte_offset, uint32_t* out_bytes_written,
                       uint32_t apc_context) {
@@ -189,18 +264,11 @@ X_STATUS XFile::Write(uint32_t buffer_guest_address, uint32_t buffer_length,
     position_ += bytes_written;
   }
 
-  XIOCompletion::IONotification notify;
-  notify.apc_context = apc_context;
-  notify.num_bytes = uint32_t(bytes_written);
-  notify.status = result;
-
-  NotifyIOCompletionPorts(notify);
-
   if (out_bytes_written) {
     *out_bytes_written = uint32_t(bytes_written);
   }
 
-  async_event_->Set();
+  CompleteIO(apc_context, result, uint32_t(bytes_written));
   return result;
 }
 
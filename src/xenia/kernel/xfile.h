@@ -10,6 +10,7 @@
 #ifndef XENIA_KERNEL_XFILE_H_
 #define XENIA_KERNEL_XFILE_H_
 
+#include <functional>
 #include <string>
 
 #include "xenia/kernel/xevent.h"
@@ -101,6 +102,17 @@ class XFile : public XObject {
                 uint64_t byte_offset, uint32_t* out_bytes_read,
                 uint32_t apc_context);
 
+  // Called on an I/O worker thread once the data has landed in the buffer,
+  // before the file object is signaled and the completion ports are notified.
+  using ReadCompletionCallback =
+      std::function<void(X_STATUS result, uint32_t bytes_read)>;
+  // Queues the read to the kernel I/O worker threads, returning
+  // X_STATUS_PENDING, or the error if the buffer is invalid, in which case
+  // completion_callback is not called.
+  X_STATUS ReadAsync(uint32_t buffer_guest_address, uint32_t buffer_length,
+                     uint64_t byte_offset, uint32_t apc_context,
+                     ReadCompletionCallback completion_callback);
+
   X_STATUS Write(uint32_t buffer_guess_address, uint32_t buffer_length,
                  uint64_t byte_offset, uint32_t* out_bytes_written,
                  uint32_t apc_context);
@@ -118,14 +130,32 @@ class XFile : public XObject {
 
  protected:
   void NotifyIOCompletionPorts(XIOCompletion::IONotification& notification);
+  // Notifies the completion ports and signals the file object.
+  void CompleteIO(uint32_t apc_context, X_STATUS result,
+                  uint32_t bytes_transferred);
 
   xe::threading::WaitHandle* GetWaitHandle() override {
     return async_event_.get();
   }
 
  private:
+  struct ReadBuffer {
+    uint32_t guest_address;
+    uint32_t length;
+    void* host_address;
+    // For triggering the invalidation callbacks after reading to physical
+    // memory, null if the buffer is not in physical memory.
+    xe::PhysicalHeap* physical_heap;
+  };
+
   XFile();
 
+  // Validates the guest buffer and gets where to read to on the host.
+  X_STATUS PrepareReadBuffer(uint32_t buffer_guest_address,
+                             uint32_t buffer_length, ReadBuffer& buffer_out);
+  X_STATUS ReadToBuffer(const ReadBuffer& buffer, uint64_t byte_offset,
+                        size_t* out_bytes_read);
+
   vfs::File* file_ = nullptr;
   std::unique_ptr<threading::Event> async_event_ = nullptr;
 
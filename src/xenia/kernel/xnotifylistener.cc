@@ -16,7 +16,11 @@ namespace xe {
 namespace kernel {
 
 XNotifyListener::XNotifyListener(KernelState* kernel_state)
-    : XObject(kernel_state, kType) {}
+    : XObject(kernel_state, kType) {
+  for (uint32_t i = 0; i < kRingSize; ++i) {
+    ring_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
 
 XNotifyListener::~XNotifyListener() {}
 
@@ -36,56 +40,126 @@ void XNotifyListener::EnqueueNotification(XNotificationID id, uint32_t data) {
     return;
   }
 
-  auto global_lock = global_critical_region_.Acquire();
-  notifications_.push_back(std::pair<XNotificationID, uint32_t>(id, data));
-  wait_handle_->Set();
+  bool enqueued = false;
+  if (!overflowed_.load(std::memory_order_acquire)) {
+    uint32_t position = ring_enqueue_position_.load(std::memory_order_relaxed);
+    for (;;) {
+      RingCell& cell = ring_[position & (kRingSize - 1)];
+      int32_t difference =
+          int32_t(cell.sequence.load(std::memory_order_acquire) - position);
+      if (!difference) {
+        if (ring_enqueue_position_.compare_exchange_weak(
+                position, position + 1, std::memory_order_relaxed)) {
+          cell.notification = Notification(id, data);
+          cell.sequence.store(position + 1, std::memory_order_release);
+          enqueued = true;
+          break;
+        }
+      } else if (difference < 0) {
+        // Full.
+        break;
+      } else {
+        position = ring_enqueue_position_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+  if (!enqueued) {
+    std::lock_guard<std::mutex> lock(overflow_mutex_);
+    overflow_.emplace_back(id, data);
+    overflowed_.store(true, std::memory_order_release);
+  }
+
+  AddPendingCount(1);
+}
+
+void XNotifyListener::CollectNotifications() {
+  for (;;) {
+    RingCell& cell = ring_[ring_dequeue_position_ & (kRingSize - 1)];
+    if (cell.sequence.load(std::memory_order_acquire) !=
+        ring_dequeue_position_ + 1) {
+      break;
+    }
+    notifications_.push_back(cell.notification);
+    cell.sequence.store(ring_dequeue_position_ + kRingSize,
+                        std::memory_order_release);
+    ++ring_dequeue_position_;
+  }
+  if (overflowed_.load(std::memory_order_acquire)) {
+    std::lock_guard<std::mutex> lock(overflow_mutex_);
+    notifications_.insert(notifications_.end(), overflow_.begin(),
+                          overflow_.end());
+    overflow_.clear();
+    overflowed_.store(false, std::memory_order_release);
+  }
+}
+
+void XNotifyListener::AddPendingCount(int32_t delta) {
+  uint32_t old_count =
+      pending_count_.fetch_add(uint32_t(delta), std::memory_order_acq_rel);
+  uint32_t new_count = old_count + uint32_t(delta);
+  if (bool(old_count) == bool(new_count)) {
+    return;
+  }
+  // Whichever transition takes the lock last sees the final count, so the
+  // state of the handle can't go stale.
+  std::lock_guard<std::mutex> lock(wait_handle_mutex_);
+  if (pending_count_.load(std::memory_order_acquire)) {
+    wait_handle_->Set();
+  } else {
+    wait_handle_->Reset();
+  }
 }
 
 bool XNotifyListener::DequeueNotification(XNotificationID* out_id,
                                           uint32_t* out_data) {
-  auto global_lock = global_critical_region_.Acquire();
-  bool dequeued = false;
-  if (notifications_.size()) {
-    dequeued = true;
-    auto it = notifications_.begin();
-    *out_id = it->first;
-    *out_data = it->second;
-    notifications_.erase(it);
-    if (!notifications_.size()) {
-      wait_handle_->Reset();
+  if (!pending_count_.load(std::memory_order_acquire)) {
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(dequeue_mutex_);
+    CollectNotifications();
+    if (notifications_.empty()) {
+      // Enqueued, but not written to the ring yet.
+      return false;
     }
+    *out_id = notifications_.front().first;
+    *out_data = notifications_.front().second;
+    notifications_.pop_front();
   }
-  return dequeued;
+  AddPendingCount(-1);
+  return true;
 }
 
 bool XNotifyListener::DequeueNotification(XNotificationID id,
                                           uint32_t* out_data) {
-  auto global_lock = global_critical_region_.Acquire();
-  bool dequeued = false;
-  if (!notifications_.size()) {
-    return dequeued;
+  if (!pending_count_.load(std::memory_order_acquire)) {
+    return false;
   }
-
-  for (auto it = notifications_.begin(); it != notifications_.end(); ++it) {
-    if (it->first != id) {
-      continue;
+  {
+    std::lock_guard<std::mutex> lock(dequeue_mutex_);
+    CollectNotifications();
+    auto it = notifications_.begin();
+    for (; it != notifications_.end(); ++it) {
+      if (it->first == id) {
+        break;
+      }
+    }
+    if (it == notifications_.end()) {
+      return false;
     }
-
-    dequeued = true;
     *out_data = it->second;
     notifications_.erase(it);
-    if (!notifications_.size()) {
-      wait_handle_->Reset();
-    }
-    break;
   }
-  return dequeued;
+  AddPendingCount(-1);
+  return true;
 }
 
 bool XNotifyListener::Save(ByteStream* stream) {
   SaveObject(stream);
 
   stream->Write(mask_);
+  std::lock_guard<std::mutex> lock(dequeue_mutex_);
+  CollectNotifications();
   stream->Write(notifications_.size());
   if (notifications_.size()) {
     for (auto pair : notifications_) {
@@ -111,6 +185,7 @@ object_ref<XNotifyListener> XNotifyListener::Restore(KernelState* kernel_state,
     pair.first = stream->Read<uint32_t>();
     pair.second = stream->Read<uint32_t>();
     notify->notifications_.push_back(pair);
+    notify->AddPendingCount(1);
   }
 
   return object_ref<XNotifyListener>(notify);
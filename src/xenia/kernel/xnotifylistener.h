@@ -10,8 +10,13 @@
 #ifndef XENIA_KERNEL_XNOTIFYLISTENER_H_
 #define XENIA_KERNEL_XNOTIFYLISTENER_H_
 
+#include <atomic>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "xenia/base/mutex.h"
 #include "xenia/base/threading.h"
@@ -33,6 +38,8 @@ class XNotifyListener : public XObject {
   void Initialize(uint64_t mask);
 
   void EnqueueNotification(XNotificationID id, uint32_t data);
+  // Returns false without taking any lock if nothing is queued, so titles can
+  // poll cheaply.
   bool DequeueNotification(XNotificationID* out_id, uint32_t* out_data);
   bool DequeueNotification(XNotificationID id, uint32_t* out_data);
 
@@ -46,9 +53,44 @@ class XNotifyListener : public XObject {
   }
 
  private:
+  using Notification = std::pair<XNotificationID, uint32_t>;
+
+  // Moves everything enqueued so far to notifications_, with dequeue_mutex_
+  // held.
+  void CollectNotifications();
+  // Adjusts the count of queued notifications, setting the wait handle when it
+  // becomes non-zero and resetting it when it becomes zero.
+  void AddPendingCount(int32_t delta);
+
   std::unique_ptr<xe::threading::Event> wait_handle_;
-  xe::global_critical_region global_critical_region_;
-  std::vector<std::pair<XNotificationID, uint32_t>> notifications_;
+  // Serializes the wait handle updates, only taken on empty to non-empty
+  // transitions and back.
+  std::mutex wait_handle_mutex_;
+  std::atomic<uint32_t> pending_count_ = {0};
+
+  // Notifications are enqueued into a bounded lock-free multi-producer ring,
+  // drained by the dequeuing thread.
+  static const uint32_t kRingSize = 256;
+  static_assert(!(kRingSize & (kRingSize - 1)));
+  struct RingCell {
+    // Equal to the position when the cell is free for enqueueing at it,
+    // position + 1 when the notification has been written at it.
+    std::atomic<uint32_t> sequence;
+    Notification notification;
+  };
+  RingCell ring_[kRingSize];
+  std::atomic<uint32_t> ring_enqueue_position_ = {0};
+  // Notifications enqueued while the ring is full, and all notifications after
+  // them until they're drained to keep the order.
+  std::mutex overflow_mutex_;
+  std::vector<Notification> overflow_;
+  std::atomic<bool> overflowed_ = {false};
+
+  // Consumer side, notifications can be dequeued by id out of order.
+  std::mutex dequeue_mutex_;
+  uint32_t ring_dequeue_position_ = 0;
+  std::deque<Notification> notifications_;
+
   uint64_t mask_ = 0;
 };
 
@@ -9,10 +9,9 @@
 
 #include "xenia/kernel/xobject.h"
 
-#include <vector>
-
 #include "xenia/base/byte_stream.h"
 #include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
 #include "xenia/kernel/kernel_state.h"
 #include "xenia/kernel/util/shim_utils.h"
 #include "xenia/kernel/xboxkrnl/xboxkrnl_private.h"
@@ -26,6 +25,13 @@
 #include "xenia/kernel/xsymboliclink.h"
 #include "xenia/kernel/xthread.h"
 
+DEFINE_int32(kernel_wait_spin_count, 1000,
+             "Number of pause instructions a wait on guest dispatcher objects "
+             "spins for before blocking the thread, so objects signaled by "
+             "another thread shortly after the wait starts don't cost a sleep "
+             "and a wake-up. 0 to always block right away.",
+             "Kernel");
+
 namespace xe {
 namespace kernel {
 
@@ -191,6 +197,47 @@ uint32_t XObject::TimeoutTicksToMs(int64_t timeout_ticks) {
   }
 }
 
+namespace {
+
+bool IsWaitTimeout(xe::threading::WaitResult result) {
+  return result == xe::threading::WaitResult::kTimeout;
+}
+bool IsWaitTimeout(const std::pair<xe::threading::WaitResult, size_t>& result) {
+  return result.first == xe::threading::WaitResult::kTimeout;
+}
+
+// Calls wait(timeout) once any of the objects may have been signaled, or
+// spinning in user space gave up on it, as most signals are expected to arrive
+// soon after the wait in producer-consumer patterns.
+template <typename F>
+auto SpinAndWait(XObject* const* objects, uint32_t count,
+                 std::chrono::milliseconds timeout, F wait) {
+  if (!timeout.count() || cvars::kernel_wait_spin_count <= 0 ||
+      xe::threading::logical_processor_count() <= 1) {
+    return wait(timeout);
+  }
+  // Taken before polling, so signals after the poll aren't missed.
+  uint32_t signal_counts[XObject::kMaxWaitObjects];
+  for (uint32_t i = 0; i < count; ++i) {
+    signal_counts[i] = objects[i]->signal_count();
+  }
+  auto result = wait(std::chrono::milliseconds(0));
+  if (!IsWaitTimeout(result)) {
+    return result;
+  }
+  for (int32_t n = 0; n < cvars::kernel_wait_spin_count; ++n) {
+    for (uint32_t i = 0; i < count; ++i) {
+      if (objects[i]->signal_count() != signal_counts[i]) {
+        return wait(timeout);
+      }
+    }
+    xe::threading::SpinPause();
+  }
+  return wait(timeout);
+}
+
+}  // namespace
+
 X_STATUS XObject::Wait(uint32_t wait_reason, uint32_t processor_mode,
                        uint32_t alertable, uint64_t* opt_timeout) {
   auto wait_handle = GetWaitHandle();
@@ -204,8 +251,12 @@ X_STATUS XObject::Wait(uint32_t wait_reason, uint32_t processor_mode,
                         TimeoutTicksToMs(*opt_timeout)))
                   : std::chrono::milliseconds::max();
 
+  XObject* self = this;
   auto result =
-      xe::threading::Wait(wait_handle, alertable ? true : false, timeout_ms);
+      SpinAndWait(&self, 1, timeout_ms, [&](std::chrono::milliseconds timeout) {
+        return xe::threading::Wait(wait_handle, alertable ? true : false,
+                                   timeout);
+      });
   switch (result) {
     case xe::threading::WaitResult::kSuccess:
       WaitCallback();
@@ -255,7 +306,12 @@ X_STATUS XObject::WaitMultiple(uint32_t count, XObject** objects,
                                uint32_t wait_type, uint32_t wait_reason,
                                uint32_t processor_mode, uint32_t alertable,
                                uint64_t* opt_timeout) {
-  std::vector<xe::threading::WaitHandle*> wait_handles(count);
+  static_assert(kMaxWaitObjects <= xe::threading::kMaxWaitHandles,
+                "Guest multiple-object waits must fit in a single host wait");
+  if (count > kMaxWaitObjects) {
+    return X_STATUS_INVALID_PARAMETER;
+  }
+  xe::threading::WaitHandle* wait_handles[kMaxWaitObjects];
   for (size_t i = 0; i < count; ++i) {
     wait_handles[i] = objects[i]->GetWaitHandle();
     assert_not_null(wait_handles[i]);
@@ -267,8 +323,13 @@ X_STATUS XObject::WaitMultiple(uint32_t count, XObject** objects,
                   : std::chrono::milliseconds::max();
 
   if (wait_type) {
-    auto result = xe::threading::WaitAny(std::move(wait_handles),
-                                         alertable ? true : false, timeout_ms);
+    auto result =
+        SpinAndWait(objects, count, timeout_ms,
+                    [&](std::chrono::milliseconds timeout) {
+                      return xe::threading::WaitAny(wait_handles, count,
+                                                    alertable ? true : false,
+                                                    timeout);
+                    });
     switch (result.first) {
       case xe::threading::WaitResult::kSuccess:
         objects[result.second]->WaitCallback();
@@ -287,8 +348,13 @@ X_STATUS XObject::WaitMultiple(uint32_t count, XObject** objects,
         return X_STATUS_UNSUCCESSFUL;
     }
   } else {
-    auto result = xe::threading::WaitAll(std::move(wait_handles),
-                                         alertable ? true : false, timeout_ms);
+    auto result =
+        SpinAndWait(objects, count, timeout_ms,
+                    [&](std::chrono::milliseconds timeout) {
+                      return xe::threading::WaitAll(wait_handles, count,
+                                                    alertable ? true : false,
+                                                    timeout);
+                    });
     switch (result) {
       case xe::threading::WaitResult::kSuccess:
         for (uint32_t i = 0; i < count; i++) {
@@ -183,11 +183,19 @@ class XObject {
   static X_STATUS SignalAndWait(XObject* signal_object, XObject* wait_object,
                                 uint32_t wait_reason, uint32_t processor_mode,
                                 uint32_t alertable, uint64_t* opt_timeout);
+  // MAXIMUM_WAIT_OBJECTS of the guest kernel.
+  static constexpr uint32_t kMaxWaitObjects = 64;
   static X_STATUS WaitMultiple(uint32_t count, XObject** objects,
                                uint32_t wait_type, uint32_t wait_reason,
                                uint32_t processor_mode, uint32_t alertable,
                                uint64_t* opt_timeout);
 
+  // Changes when the object may have been signaled, for waits to spin on
+  // before blocking. Only a hint, not every way of signaling changes it.
+  uint32_t signal_count() const {
+    return signal_count_.load(std::memory_order_acquire);
+  }
+
   static object_ref<XObject> GetNativeObject(KernelState* kernel_state,
                                              void* native_ptr,
                                              int32_t as_type = -1);
@@ -199,6 +207,11 @@ class XObject {
   bool SaveObject(ByteStream* stream);
   bool RestoreObject(ByteStream* stream);
 
+  // Called after the host object is signaled.
+  void NotifySignaled() {
+    signal_count_.fetch_add(1, std::memory_order_release);
+  }
+
   // Called on successful wait.
   virtual void WaitCallback() {}
   virtual xe::threading::WaitHandle* GetWaitHandle() { return nullptr; }
@@ -227,6 +240,7 @@ class XObject {
 
  private:
   std::atomic<int32_t> pointer_ref_count_;
+  std::atomic<uint32_t> signal_count_ = {0};
 
   Type type_;
   std::vector<X_HANDLE> handles_;
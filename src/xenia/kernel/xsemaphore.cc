@@ -41,6 +41,7 @@ void XSemaphore::InitializeNative(void* native_ptr, X_DISPATCH_HEADER* header) {
 int32_t XSemaphore::ReleaseSemaphore(int32_t release_count) {
   int32_t previous_count = 0;
   semaphore_->Release(release_count, &previous_count);
+  NotifySignaled();
   return previous_count;
 }
 
@@ -11,6 +11,7 @@
 
 #include "xenia/base/platform.h"
 #include "xenia/kernel/kernel_state.h"
+#include "xenia/kernel/util/socket_reactor.h"
 #include "xenia/kernel/xam/xam_module.h"
 // #include "xenia/kernel/xnet.h"
 
@@ -22,10 +23,14 @@
 // clang-format on
 #else
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <unistd.h>
+
+#include <cerrno>
 #endif
 
 namespace xe {
@@ -57,11 +62,21 @@ X_STATUS XSocket::Initialize(AddressFamily af, Type type, Protocol proto) {
 }
 
 X_STATUS XSocket::Close() {
+  if (native_handle_ == uint64_t(-1)) {
+    // Already closed explicitly, don't close a reused handle number.
+    return X_STATUS_SUCCESS;
+  }
+  // Complete the pending asynchronous operations as aborted.
+  util::SocketReactor* socket_reactor = kernel_state_->socket_reactor();
+  if (socket_reactor) {
+    socket_reactor->Cancel(native_handle_);
+  }
 #if XE_PLATFORM_WIN32
   int ret = closesocket(native_handle_);
 #elif XE_PLATFORM_LINUX
   int ret = close(native_handle_);
 #endif
+  native_handle_ = uint64_t(-1);
 
   if (ret != 0) {
     return X_STATUS_UNSUCCESSFUL;
@@ -103,7 +118,35 @@ X_STATUS XSocket::IOControl(uint32_t cmd, uint8_t* arg_ptr) {
 
   return X_STATUS_SUCCESS;
 #elif XE_PLATFORM_LINUX
-  return X_STATUS_UNSUCCESSFUL;
+  switch (cmd) {
+    case 0x8004667E: {
+      // FIONBIO.
+      int flags = fcntl(native_handle_, F_GETFL, 0);
+      if (flags < 0) {
+        return X_STATUS_UNSUCCESSFUL;
+      }
+      if (xe::load_and_swap<uint32_t>(arg_ptr)) {
+        flags |= O_NONBLOCK;
+      } else {
+        flags &= ~O_NONBLOCK;
+      }
+      if (fcntl(native_handle_, F_SETFL, flags) < 0) {
+        return X_STATUS_UNSUCCESSFUL;
+      }
+      return X_STATUS_SUCCESS;
+    }
+    case 0x4004667F: {
+      // FIONREAD.
+      int bytes_available = 0;
+      if (ioctl(native_handle_, FIONREAD, &bytes_available) < 0) {
+        return X_STATUS_UNSUCCESSFUL;
+      }
+      xe::store_and_swap<uint32_t>(arg_ptr, uint32_t(bytes_available));
+      return X_STATUS_SUCCESS;
+    }
+    default:
+      return X_STATUS_UNSUCCESSFUL;
+  }
 #endif
 }
 
@@ -238,6 +281,45 @@ int XSocket::SendTo(uint8_t* buf, uint32_t buf_len, uint32_t flags,
                 to ? (sockaddr*)&nto : nullptr, to_len);
 }
 
+uint32_t XSocket::GetLastWSAError() {
+#ifdef XE_PLATFORM_WIN32
+  return uint32_t(WSAGetLastError());
+#else
+  switch (errno) {
+    case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+    case EWOULDBLOCK:
+#endif
+      return 10035;  // WSAEWOULDBLOCK
+    case EINPROGRESS:
+      return 10036;  // WSAEINPROGRESS
+    case EBADF:
+    case ENOTSOCK:
+      return 10038;  // WSAENOTSOCK
+    case EMSGSIZE:
+      return 10040;  // WSAEMSGSIZE
+    case EADDRINUSE:
+      return 10048;  // WSAEADDRINUSE
+    case ENETUNREACH:
+      return 10051;  // WSAENETUNREACH
+    case ECONNABORTED:
+      return 10053;  // WSAECONNABORTED
+    case ECONNRESET:
+      return 10054;  // WSAECONNRESET
+    case ENOTCONN:
+      return 10057;  // WSAENOTCONN
+    case ETIMEDOUT:
+      return 10060;  // WSAETIMEDOUT
+    case ECONNREFUSED:
+      return 10061;  // WSAECONNREFUSED
+    case EHOSTUNREACH:
+      return 10065;  // WSAEHOSTUNREACH
+    default:
+      return 10022;  // WSAEINVAL
+  }
+#endif
+}
+
 bool XSocket::QueuePacket(uint32_t src_ip, uint16_t src_port,
                           const uint8_t* buf, size_t len) {
   packet* pkt = reinterpret_cast<packet*>(new uint8_t[sizeof(packet) + len]);
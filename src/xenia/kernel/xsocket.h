@@ -114,6 +114,10 @@ class XSocket : public XObject {
   int SendTo(uint8_t* buf, uint32_t buf_len, uint32_t flags, N_XSOCKADDR_IN* to,
              uint32_t to_len);
 
+  // Returns the error of the last failed host socket call on this thread as a
+  // WSA error code.
+  static uint32_t GetLastWSAError();
+
   struct packet {
     // These values are in network byte order.
     xe::be<uint16_t> src_port;
@@ -36,6 +36,8 @@ DEFINE_bool(ignore_thread_priorities, true,
 DEFINE_bool(ignore_thread_affinities, true,
             "Ignores game-specified thread affinities.", "Kernel");
 
+DECLARE_bool(pin_guest_hardware_threads);
+
 namespace xe {
 namespace kernel {
 
@@ -95,7 +97,8 @@ XThread::~XThread() {
     delete thread_state_;
   }
   kernel_state()->memory()->SystemHeapFree(scratch_address_);
-  kernel_state()->memory()->SystemHeapFree(tls_static_address_);
+  kernel_state()->thread_block_pool()->ReleaseSystemHeapBlock(
+      tls_static_address_, tls_total_size_);
   kernel_state()->memory()->SystemHeapFree(pcr_address_);
   FreeStack();
 
@@ -227,8 +230,12 @@ bool XThread::AllocateStack(uint32_t size) {
   size = xe::round_up(size, alignment);
   auto actual_size = size + padding;
 
-  uint32_t address = 0;
-  if (!heap->AllocRange(
+  // Stacks of exited threads still have their guard pages set up.
+  uint32_t address = kernel_state()->thread_block_pool()->AcquireStack(
+      actual_size);
+  bool recycled = address != 0;
+  if (!recycled &&
+      !heap->AllocRange(
           kStackAddressRangeBegin, kStackAddressRangeEnd, actual_size,
           alignment, kMemoryAllocationReserve | kMemoryAllocationCommit,
           kMemoryProtectRead | kMemoryProtectWrite, false, &address)) {
@@ -241,19 +248,23 @@ bool XThread::AllocateStack(uint32_t size) {
   stack_base_ = stack_limit_ + size;
 
   // Initialize the stack with junk
-  memory()->Fill(stack_alloc_base_, actual_size, 0xBE);
+  if (recycled) {
+    memory()->Fill(stack_limit_, size, 0xBE);
+  } else {
+    memory()->Fill(stack_alloc_base_, actual_size, 0xBE);
 
-  // Setup the guard pages
-  heap->Protect(stack_alloc_base_, padding / 2, kMemoryProtectNoAccess);
-  heap->Protect(stack_base_, padding / 2, kMemoryProtectNoAccess);
+    // Setup the guard pages
+    heap->Protect(stack_alloc_base_, padding / 2, kMemoryProtectNoAccess);
+    heap->Protect(stack_base_, padding / 2, kMemoryProtectNoAccess);
+  }
 
   return true;
 }
 
 void XThread::FreeStack() {
   if (stack_alloc_base_) {
-    auto heap = memory()->LookupHeap(kStackAddressRangeBegin);
-    heap->Release(stack_alloc_base_);
+    kernel_state()->thread_block_pool()->ReleaseStack(stack_alloc_base_,
+                                                      stack_alloc_size_);
 
     stack_alloc_base_ = 0;
     stack_alloc_size_ = 0;
@@ -300,7 +311,12 @@ X_STATUS XThread::Create() {
   // will directly access those through 0(r13).
   uint32_t tls_slot_size = tls_slots * 4;
   tls_total_size_ = tls_slot_size + tls_extended_size;
-  tls_static_address_ = memory()->SystemHeapAlloc(tls_total_size_);
+  tls_static_address_ =
+      kernel_state()->thread_block_pool()->AcquireSystemHeapBlock(
+          tls_total_size_);
+  if (!tls_static_address_) {
+    tls_static_address_ = memory()->SystemHeapAlloc(tls_total_size_);
+  }
   tls_dynamic_address_ = tls_static_address_ + tls_extended_size;
   if (!tls_static_address_) {
     XELOGW("Unable to allocate thread local storage block");
@@ -416,8 +432,18 @@ X_STATUS XThread::Create() {
     return X_STATUS_NO_MEMORY;
   }
 
-  if (!cvars::ignore_thread_affinities) {
-    thread_->set_affinity_mask(proc_mask);
+  if (guest_thread_) {
+    uint32_t guest_affinity_mask;
+    if (cvars::pin_guest_hardware_threads) {
+      guest_affinity_mask = uint32_t(1) << active_cpu();
+    } else {
+      guest_affinity_mask = cvars::ignore_thread_affinities ? 0 : proc_mask;
+    }
+    uint64_t host_affinity_mask =
+        xe::threading::GetGuestThreadAffinityMask(guest_affinity_mask);
+    if (host_affinity_mask) {
+      thread_->set_affinity_mask(host_affinity_mask);
+    }
   }
 
   // Set the thread name based on host ID (for easier debugging).
@@ -508,7 +534,7 @@ void XThread::Execute() {
   int exit_code = 0;
 
   // Dispatch any APCs that were queued before the thread was created first.
-  DeliverAPCs();
+  CheckApcs();
 
   // If a XapiThreadStartup value is present, we use that as a trampoline.
   // Otherwise, we are a raw thread.
@@ -557,15 +583,24 @@ uint32_t XThread::RaiseIrql(uint32_t new_irql) {
 
 void XThread::LowerIrql(uint32_t new_irql) { irql_ = new_irql; }
 
-void XThread::CheckApcs() { DeliverAPCs(); }
+void XThread::CheckApcs() {
+  if (apc_pending_.load(std::memory_order_acquire)) {
+    DeliverAPCs();
+  }
+}
 
-void XThread::LockApc() { EnterCriticalRegion(); }
+void XThread::LockApc() { apc_lock_.lock(); }
 
 void XThread::UnlockApc(bool queue_delivery) {
   bool needs_apc = apc_list_.HasPending();
-  LeaveCriticalRegion();
-  if (needs_apc && queue_delivery) {
-    thread_->QueueUserCallback([this]() { DeliverAPCs(); });
+  apc_pending_.store(needs_apc, std::memory_order_release);
+  apc_lock_.unlock();
+  if (needs_apc && queue_delivery &&
+      !apc_delivery_queued_.exchange(true, std::memory_order_acq_rel)) {
+    thread_->QueueUserCallback([this]() {
+      apc_delivery_queued_.store(false, std::memory_order_release);
+      CheckApcs();
+    });
   }
 }
 
@@ -629,8 +664,12 @@ void XThread::DeliverAPCs() {
           scratch_address_ + 8,
           scratch_address_ + 12,
       };
+      // The routine may queue APCs or take locks held by threads queueing
+      // APCs to this one.
+      UnlockApc(false);
       processor->Execute(thread_state_, apc->kernel_routine, kernel_args,
                          xe::countof(kernel_args));
+      LockApc();
     }
     uint32_t normal_routine = xe::load_and_swap<uint32_t>(scratch_ptr + 0);
     uint32_t normal_context = xe::load_and_swap<uint32_t>(scratch_ptr + 4);
@@ -678,8 +717,10 @@ void XThread::RundownAPCs() {
     } else if (apc->rundown_routine) {
       // rundown_routine(apc)
       uint64_t args[] = {apc_ptr};
+      UnlockApc(false);
       kernel_state()->processor()->Execute(thread_state(), apc->rundown_routine,
                                            args, xe::countof(args));
+      LockApc();
     }
 
     // If special, free it.
@@ -727,8 +768,13 @@ void XThread::SetAffinity(uint32_t affinity) {
   }
   SetActiveCpu(GetFakeCpuNumber(affinity));
   affinity_ = affinity;
-  if (!cvars::ignore_thread_affinities) {
-    thread_->set_affinity_mask(affinity);
+  if (!cvars::ignore_thread_affinities && !cvars::pin_guest_hardware_threads &&
+      guest_thread_) {
+    uint64_t host_affinity_mask =
+        xe::threading::GetGuestThreadAffinityMask(affinity);
+    if (host_affinity_mask) {
+      thread_->set_affinity_mask(host_affinity_mask);
+    }
   }
 }
 
@@ -740,7 +786,16 @@ uint32_t XThread::active_cpu() const {
 void XThread::SetActiveCpu(uint32_t cpu_index) {
   assert_true(cpu_index < 6);
   uint8_t* pcr = memory()->TranslateVirtual(pcr_address_);
+  bool cpu_changed = xe::load_and_swap<uint8_t>(pcr + 0x10C) != cpu_index;
   xe::store_and_swap<uint8_t>(pcr + 0x10C, cpu_index);
+  if (cpu_changed && cvars::pin_guest_hardware_threads && guest_thread_ &&
+      thread_) {
+    uint64_t host_affinity_mask =
+        xe::threading::GetGuestThreadAffinityMask(uint32_t(1) << cpu_index);
+    if (host_affinity_mask) {
+      thread_->set_affinity_mask(host_affinity_mask);
+    }
+  }
 }
 
 bool XThread::GetTLSValue(uint32_t slot, uint32_t* value_out) {
@@ -797,22 +852,25 @@ X_STATUS XThread::Suspend(uint32_t* out_suspend_count) {
 X_STATUS XThread::Delay(uint32_t processor_mode, uint32_t alertable,
                         uint64_t interval) {
   int64_t timeout_ticks = interval;
-  uint32_t timeout_ms;
+  uint64_t timeout_us;
   if (timeout_ticks > 0) {
     // Absolute time, based on January 1, 1601.
     // TODO(benvanik): convert time to relative time.
     assert_always();
-    timeout_ms = 0;
+    timeout_us = 0;
   } else if (timeout_ticks < 0) {
-    // Relative time.
-    timeout_ms = uint32_t(-timeout_ticks / 10000);  // Ticks -> MS
+    // Relative time. Kept in microseconds rather than milliseconds, as titles
+    // use delays much shorter than 1 ms in frame loops.
+    timeout_us = uint64_t(-timeout_ticks / 10);  // Ticks -> us
   } else {
-    timeout_ms = 0;
+    timeout_us = 0;
+  }
+  if (!cvars::clock_no_scaling && timeout_us) {
+    timeout_us = uint64_t(timeout_us * Clock::guest_time_scalar());
   }
-  timeout_ms = Clock::ScaleGuestDurationMillis(timeout_ms);
   if (alertable) {
     auto result =
-        xe::threading::AlertableSleep(std::chrono::milliseconds(timeout_ms));
+        xe::threading::AlertableSleep(std::chrono::microseconds(timeout_us));
     switch (result) {
       default:
       case xe::threading::SleepResult::kSuccess:
@@ -821,7 +879,7 @@ X_STATUS XThread::Delay(uint32_t processor_mode, uint32_t alertable,
         return X_STATUS_USER_APC;
     }
   } else {
-    xe::threading::Sleep(std::chrono::milliseconds(timeout_ms));
+    xe::threading::Sleep(std::chrono::microseconds(timeout_us));
     return X_STATUS_SUCCESS;
   }
 }
@@ -952,6 +1010,7 @@ object_ref<XThread> XThread::Restore(KernelState* kernel_state,
   thread->main_thread_ = state.is_main_thread;
   thread->running_ = state.is_running;
   thread->apc_list_.set_head(state.apc_head);
+  thread->apc_pending_ = thread->apc_list_.HasPending();
   thread->tls_static_address_ = state.tls_static_address;
   thread->tls_dynamic_address_ = state.tls_dynamic_address;
   thread->tls_total_size_ = state.tls_total_size;
@@ -11,6 +11,7 @@
 #define XENIA_KERNEL_XTHREAD_H_
 
 #include <atomic>
+#include <mutex>
 #include <string>
 
 #include "xenia/base/mutex.h"
@@ -161,7 +162,10 @@ class XThread : public XObject, public cpu::Thread {
   uint32_t RaiseIrql(uint32_t new_irql);
   void LowerIrql(uint32_t new_irql);
 
+  // Delivers the pending APCs, only an atomic load if there are none.
   void CheckApcs();
+  // Guards apc_list() and the enqueued flags of the APCs in it. Never held
+  // while guest code runs.
   void LockApc();
   void UnlockApc(bool queue_delivery);
   util::NativeList* apc_list() { return &apc_list_; }
@@ -230,7 +234,13 @@ class XThread : public XObject, public cpu::Thread {
 
   xe::global_critical_region global_critical_region_;
   std::atomic<uint32_t> irql_ = {0};
+  std::mutex apc_lock_;
   util::NativeList apc_list_;
+  // Whether apc_list_ was non-empty when apc_lock_ was last released.
+  std::atomic<bool> apc_pending_ = {false};
+  // Whether a user callback to deliver the APCs is queued on the thread and
+  // hasn't started yet, so only one is queued at a time.
+  std::atomic<bool> apc_delivery_queued_ = {false};
 };
 
 class XHostThread : public XThread {
@@ -9,6 +9,8 @@
 
 #include "xenia/kernel/xtimer.h"
 
+#include <algorithm>
+
 #include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/cpu/processor.h"
@@ -17,18 +19,25 @@
 namespace xe {
 namespace kernel {
 
-XTimer::XTimer(KernelState* kernel_state) : XObject(kernel_state, kType) {}
+XTimer::XTimer(KernelState* kernel_state)
+    : XObject(kernel_state, kType), state_(std::make_shared<State>()) {}
 
-XTimer::~XTimer() = default;
+XTimer::~XTimer() {
+  // Released with the global lock held, a running callback queueing an APC
+  // would never return if waited for.
+  if (timer_id_ != xe::threading::TimerWheel::kInvalidTimerId) {
+    xe::threading::TimerWheel::Get().Cancel(timer_id_, false);
+  }
+}
 
 void XTimer::Initialize(uint32_t timer_type) {
-  assert_false(timer_);
+  assert_false(state_->event);
   switch (timer_type) {
     case 0:  // NotificationTimer
-      timer_ = xe::threading::Timer::CreateManualResetTimer();
+      state_->event = xe::threading::Event::CreateManualResetEvent(false);
       break;
     case 1:  // SynchronizationTimer
-      timer_ = xe::threading::Timer::CreateSynchronizationTimer();
+      state_->event = xe::threading::Event::CreateAutoResetEvent(false);
       break;
     default:
       assert_always();
@@ -46,43 +55,66 @@ X_STATUS XTimer::SetTimer(int64_t due_time, uint32_t period_ms,
   due_time = Clock::ScaleGuestDurationFileTime(due_time);
   period_ms = Clock::ScaleGuestDurationMillis(period_ms);
 
-  // Stash routine for callback.
-  callback_thread_ = XThread::GetCurrentThread();
-  callback_routine_ = routine;
-  callback_routine_arg_ = routine_arg;
-
-  // This callback will only be issued when the timer is fired.
-  std::function<void()> callback = nullptr;
-  if (callback_routine_) {
-    callback = [this]() {
-      // Queue APC to call back routine with (arg, low, high).
-      // It'll be executed on the thread that requested the timer.
-      uint64_t time = xe::Clock::QueryGuestSystemTime();
-      uint32_t time_low = static_cast<uint32_t>(time);
-      uint32_t time_high = static_cast<uint32_t>(time >> 32);
-      XELOGI(
-          "XTimer enqueuing timer callback to {:08X}({:08X}, {:08X}, {:08X})",
-          callback_routine_, callback_routine_arg_, time_low, time_high);
-      callback_thread_->EnqueueApc(callback_routine_, callback_routine_arg_,
-                                   time_low, time_high);
-    };
-  }
-
-  bool result;
-  if (!period_ms) {
-    result = timer_->SetOnce(std::chrono::nanoseconds(due_time * 100),
-                             std::move(callback));
-  } else {
-    result = timer_->SetRepeating(std::chrono::nanoseconds(due_time * 100),
-                                  std::chrono::milliseconds(period_ms),
-                                  std::move(callback));
+  // Setting the timer again replaces the previous due time and routine, after
+  // this returns the previous routine is not going to be queued anymore unless
+  // its callback was already past the generation check.
+  auto& timer_wheel = xe::threading::TimerWheel::Get();
+  if (timer_id_ != xe::threading::TimerWheel::kInvalidTimerId) {
+    timer_wheel.Cancel(timer_id_, false);
   }
+  uint32_t generation =
+      state_->generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+  state_->event->Reset();
 
-  return result ? X_STATUS_SUCCESS : X_STATUS_UNSUCCESSFUL;
+  // Positive due times are absolute guest system times, negative ones are
+  // relative, both in 100ns units.
+  int64_t relative_time =
+      due_time > 0
+          ? due_time - static_cast<int64_t>(Clock::QueryGuestSystemTime())
+          : -due_time;
+  auto due =
+      xe::threading::TimerWheel::clock::now() +
+      std::chrono::nanoseconds(std::max(relative_time, int64_t(0)) * 100);
+  // The callback keeps the requesting thread alive until it's cancelled.
+  timer_id_ = timer_wheel.Schedule(
+      due, std::chrono::milliseconds(period_ms),
+      [state = state_, generation,
+       thread = retain_object(XThread::GetCurrentThread()), routine,
+       routine_arg]() {
+        Fire(state, generation, thread.get(), routine, routine_arg);
+      });
+  return X_STATUS_SUCCESS;
 }
 
 X_STATUS XTimer::Cancel() {
-  return timer_->Cancel() ? X_STATUS_SUCCESS : X_STATUS_UNSUCCESSFUL;
+  if (timer_id_ != xe::threading::TimerWheel::kInvalidTimerId) {
+    xe::threading::TimerWheel::Get().Cancel(timer_id_, false);
+    state_->generation.fetch_add(1, std::memory_order_acq_rel);
+    timer_id_ = xe::threading::TimerWheel::kInvalidTimerId;
+  }
+  return X_STATUS_SUCCESS;
+}
+
+void XTimer::Fire(const std::shared_ptr<State>& state, uint32_t generation,
+                  XThread* callback_thread, uint32_t callback_routine,
+                  uint32_t callback_routine_arg) {
+  // Called on the timer wheel thread.
+  if (state->generation.load(std::memory_order_acquire) != generation) {
+    return;
+  }
+  state->event->Set();
+  if (!callback_routine) {
+    return;
+  }
+  // Queue APC to call back routine with (arg, low, high).
+  // It'll be executed on the thread that requested the timer.
+  uint64_t time = xe::Clock::QueryGuestSystemTime();
+  uint32_t time_low = static_cast<uint32_t>(time);
+  uint32_t time_high = static_cast<uint32_t>(time >> 32);
+  XELOGI("XTimer enqueuing timer callback to {:08X}({:08X}, {:08X}, {:08X})",
+         callback_routine, callback_routine_arg, time_low, time_high);
+  callback_thread->EnqueueApc(callback_routine, callback_routine_arg,
+                              time_low, time_high);
 }
 
 }  // namespace kernel
@@ -10,7 +10,11 @@
 #ifndef XENIA_KERNEL_XTIMER_H_
 #define XENIA_KERNEL_XTIMER_H_
 
+#include <atomic>
+#include <memory>
+
 #include "xenia/base/threading.h"
+#include "xenia/base/timer_wheel.h"
 #include "xenia/kernel/xobject.h"
 #include "xenia/xbox.h"
 
@@ -33,14 +37,31 @@ class XTimer : public XObject {
   X_STATUS Cancel();
 
  protected:
-  xe::threading::WaitHandle* GetWaitHandle() override { return timer_.get(); }
+  xe::threading::WaitHandle* GetWaitHandle() override {
+    return state_->event.get();
+  }
 
  private:
-  std::unique_ptr<xe::threading::Timer> timer_;
+  // Everything the timer wheel callback accesses. The callback owns a
+  // reference to it rather than to the timer, so the timer can be cancelled
+  // without waiting for a running callback, which may be waiting for locks
+  // held by whoever is releasing or setting the timer.
+  struct State {
+    // Signaled from the shared timer wheel rather than by a host timer object
+    // per guest timer.
+    std::unique_ptr<xe::threading::Event> event;
+    // Incremented when the timer is set or cancelled, so a callback of the
+    // previous due time still running doesn't signal or queue anything.
+    std::atomic<uint32_t> generation{0};
+  };
+
+  static void Fire(const std::shared_ptr<State>& state, uint32_t generation,
+                   XThread* callback_thread, uint32_t callback_routine,
+                   uint32_t callback_routine_arg);
 
-  XThread* callback_thread_ = nullptr;
-  uint32_t callback_routine_ = 0;
-  uint32_t callback_routine_arg_ = 0;
+  std::shared_ptr<State> state_;
+  xe::threading::TimerWheel::TimerId timer_id_ =
+      xe::threading::TimerWheel::kInvalidTimerId;
 };
 
 }  // namespace kernel
@@ -14,14 +14,19 @@
 #include <utility>
 
 #include "third_party/fmt/include/fmt/format.h"
+#include "third_party/snappy/snappy.h"
+#include "third_party/xxhash/xxhash.h"
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_stream.h"
 #include "xenia/base/clock.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/mapped_memory.h"
 #include "xenia/base/math.h"
+#include "xenia/base/platform.h"
 #include "xenia/base/threading.h"
 #include "xenia/cpu/mmio_handler.h"
+#include "xenia/memory_heatmap.h"
 
 // TODO(benvanik): move xbox.h out
 #include "xenia/xbox.h"
@@ -32,6 +37,34 @@ DEFINE_bool(protect_on_release, false,
             "Protect released memory to prevent accesses.", "Memory");
 DEFINE_bool(scribble_heap, false,
             "Scribble 0xCD into all allocated heap memory.", "Memory");
+DEFINE_bool(system_heap_pools, true,
+            "Allocate small kernel objects from pools of fixed size blocks "
+            "instead of taking a page for each.",
+            "Memory");
+DEFINE_bool(physical_memory_large_pages, false,
+            "Ask the OS to back the guest physical memory and its views with "
+            "large pages to reduce TLB misses. Only supported on Linux with "
+            "transparent huge pages enabled.",
+            "Memory");
+DEFINE_bool(
+    physical_memory_write_watch, false,
+    "Detect guest writes to memory cached by the GPU with OS write tracking "
+    "polled once per GPU submission rather than with access violations. "
+    "Avoids a fault on the first write to every watched page, such as of "
+    "vertex buffers rewritten every frame, but writes made while a submission "
+    "is being recorded may only be seen by the next one. Requires Linux 6.7 or "
+    "newer.",
+    "Memory");
+DEFINE_bool(memory_heatmap, false,
+            "Count GPU uploads, invalidations of GPU-cached data and CPU "
+            "writes in every 64 KB of guest physical memory, and write the "
+            "counts to memory_heatmap_path every memory_heatmap_frames frames.",
+            "Memory");
+DEFINE_path(memory_heatmap_path, "scratch/gpu/",
+            "Directory to write the memory heatmap files to.", "Memory");
+DEFINE_int32(memory_heatmap_frames, 60,
+             "Number of frames covered by each memory heatmap file.",
+             "Memory");
 
 namespace xe {
 uint32_t get_page_count(uint32_t value, uint32_t page_size) {
@@ -99,9 +132,16 @@ Memory::~Memory() {
   // requests.
   mmio_handler_.reset();
 
+  EndLazyRestore();
+
   for (auto invalidation_callback : physical_memory_invalidation_callbacks_) {
     delete invalidation_callback;
   }
+  for (auto data_provider_callback : physical_memory_data_provider_callbacks_) {
+    delete data_provider_callback;
+  }
+  xe::memory::CloseWriteWatch(physical_memory_write_watch_);
+  physical_memory_write_watch_ = nullptr;
 
   heaps_.v00000000.Dispose();
   heaps_.v40000000.Dispose();
@@ -128,6 +168,12 @@ bool Memory::Initialize() {
   file_name_ =
       fmt::format("Local\\xenia_memory_{}", Clock::QueryHostTickCount());
 
+  // Take the guest memory from the NUMA node the guest hardware threads and
+  // the GPU command processor run on rather than from the node of whichever
+  // thread touches a page first. Also applies to the host allocations made
+  // after this, such as the code cache.
+  xe::memory::set_preferred_numa_node(xe::threading::GetEmulationNumaNode());
+
   // Create main page file-backed mapping. This is all reserved but
   // uncommitted (so it shouldn't expand page file).
   mapping_ = xe::memory::CreateFileMappingHandle(
@@ -158,6 +204,23 @@ bool Memory::Initialize() {
   virtual_membase_ = mapping_base_;
   physical_membase_ = mapping_base_ + 0x100000000ull;
 
+  if (cvars::physical_memory_large_pages && !AdvisePhysicalLargePages()) {
+    XELOGW(
+        "Large pages are not supported for the guest physical memory, using "
+        "normal pages");
+  }
+
+  code_watch_bits_.resize((kCodeWatchSize / system_page_size_ + 63) / 64);
+
+  if (cvars::physical_memory_write_watch) {
+    physical_memory_write_watch_ = xe::memory::CreateWriteWatch();
+    if (!physical_memory_write_watch_) {
+      XELOGW(
+          "OS write watches are not supported, using page protection for GPU "
+          "memory invalidation");
+    }
+  }
+
   // Prepare virtual heaps.
   heaps_.v00000000.Initialize(this, virtual_membase_, HeapType::kGuestVirtual,
                               0x00000000, 0x40000000, 4096);
@@ -179,6 +242,7 @@ bool Memory::Initialize() {
                               &heaps_.physical);
   heaps_.vE0000000.Initialize(this, virtual_membase_, HeapType::kGuestPhysical,
                               0xE0000000, 0x1FD00000, 4096, &heaps_.physical);
+  ResetSystemHeapPools();
 
   // Protect the first and last 64kb of memory.
   heaps_.v00000000.AllocFixed(
@@ -206,6 +270,12 @@ bool Memory::Initialize() {
     return false;
   }
 
+  if (cvars::memory_heatmap) {
+    heatmap_ = std::make_unique<MemoryHeatmap>(
+        cvars::memory_heatmap_path,
+        uint32_t(std::max(cvars::memory_heatmap_frames, 1)));
+  }
+
   // ?
   uint32_t unk_phys_alloc;
   heaps_.vA0000000.Alloc(0x340000, 64 * 1024, kMemoryAllocationReserve,
@@ -304,12 +374,27 @@ void Memory::UnmapViews() {
   }
 }
 
+bool Memory::AdvisePhysicalLargePages() {
+  bool advised = true;
+  for (size_t n = 0; n < xe::countof(map_info); n++) {
+    // Only the views of the physical memory.
+    if (map_info[n].target_address < 0x100000000ull) {
+      continue;
+    }
+    advised &= xe::memory::AdviseLargePages(
+        views_.all_views[n], map_info[n].virtual_address_end -
+                                 map_info[n].virtual_address_start + 1);
+  }
+  return advised;
+}
+
 void Memory::Reset() {
   heaps_.v00000000.Reset();
   heaps_.v40000000.Reset();
   heaps_.v80000000.Reset();
   heaps_.v90000000.Reset();
   heaps_.physical.Reset();
+  ResetSystemHeapPools();
 }
 
 const BaseHeap* Memory::LookupHeap(uint32_t address) const {
@@ -451,6 +536,17 @@ bool Memory::AccessViolationCallback(
     return false;
   }
   uint32_t virtual_address = HostToGuestVirtual(host_address);
+  if (lazy_restore_map_) {
+    BaseHeap* lazy_heap = LookupHeap(virtual_address);
+    if ((lazy_heap == &heaps_.v00000000 || lazy_heap == &heaps_.v40000000) &&
+        lazy_heap->RestoreLazyPage(virtual_address)) {
+      return true;
+    }
+  }
+  if (is_write && TriggerCodeWatches(virtual_address, 1, true)) {
+    watch_access_violation_count_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
   BaseHeap* heap = LookupHeap(virtual_address);
   if (heap->heap_type() != HeapType::kGuestPhysical) {
     return false;
@@ -462,8 +558,12 @@ bool Memory::AccessViolationCallback(
   // Will be rounded to physical page boundaries internally, so just pass 1 as
   // the length - guranteed not to cross page boundaries also.
   auto physical_heap = static_cast<PhysicalHeap*>(heap);
-  return physical_heap->TriggerCallbacks(std::move(global_lock_locked_once),
-                                         virtual_address, 1, is_write, false);
+  if (!physical_heap->TriggerCallbacks(std::move(global_lock_locked_once),
+                                       virtual_address, 1, is_write, false)) {
+    return false;
+  }
+  watch_access_violation_count_.fetch_add(1, std::memory_order_relaxed);
+  return true;
 }
 
 bool Memory::AccessViolationCallbackThunk(
@@ -513,6 +613,32 @@ void Memory::UnregisterPhysicalMemoryInvalidationCallback(
   delete entry;
 }
 
+void* Memory::RegisterPhysicalMemoryDataProviderCallback(
+    PhysicalMemoryDataProviderCallback callback, void* callback_context) {
+  auto entry = new std::pair<PhysicalMemoryDataProviderCallback, void*>(
+      callback, callback_context);
+  auto lock = global_critical_region_.Acquire();
+  physical_memory_data_provider_callbacks_.push_back(entry);
+  return entry;
+}
+
+void Memory::UnregisterPhysicalMemoryDataProviderCallback(
+    void* callback_handle) {
+  auto entry =
+      reinterpret_cast<std::pair<PhysicalMemoryDataProviderCallback, void*>*>(
+          callback_handle);
+  {
+    auto lock = global_critical_region_.Acquire();
+    auto it = std::find(physical_memory_data_provider_callbacks_.begin(),
+                        physical_memory_data_provider_callbacks_.end(), entry);
+    assert_true(it != physical_memory_data_provider_callbacks_.end());
+    if (it != physical_memory_data_provider_callbacks_.end()) {
+      physical_memory_data_provider_callbacks_.erase(it);
+    }
+  }
+  delete entry;
+}
+
 void Memory::EnablePhysicalMemoryAccessCallbacks(
     uint32_t physical_address, uint32_t length,
     bool enable_invalidation_notifications, bool enable_data_providers) {
@@ -527,10 +653,142 @@ void Memory::EnablePhysicalMemoryAccessCallbacks(
                                          enable_data_providers);
 }
 
+void Memory::TriggerPhysicalMemoryDataProviders(uint32_t physical_address,
+                                                uint32_t length) {
+  heaps_.vA0000000.TriggerDataProviders(physical_address, length);
+  heaps_.vC0000000.TriggerDataProviders(physical_address, length);
+  heaps_.vE0000000.TriggerDataProviders(physical_address, length);
+}
+
+void Memory::PollPhysicalMemoryWriteWatches() {
+  if (!physical_memory_write_watch_) {
+    return;
+  }
+  heaps_.vA0000000.PollWriteWatches();
+  heaps_.vC0000000.PollWriteWatches();
+  heaps_.vE0000000.PollWriteWatches();
+}
+
+void Memory::SetCodeModificationCallback(CodeModificationCallback callback,
+                                         void* callback_context) {
+  auto lock = global_critical_region_.Acquire();
+  code_modification_callback_ = callback;
+  code_modification_callback_context_ = callback_context;
+}
+
+bool Memory::GetCodeWatchPageRange(uint32_t virtual_address, uint32_t length,
+                                   uint32_t* page_first,
+                                   uint32_t* page_last) const {
+  if (!length || virtual_address < kCodeWatchBase ||
+      virtual_address - kCodeWatchBase >= kCodeWatchSize) {
+    return false;
+  }
+  uint32_t offset = virtual_address - kCodeWatchBase;
+  length = std::min(length, kCodeWatchSize - offset);
+  *page_first = offset / system_page_size_;
+  *page_last = (offset + length - 1) / system_page_size_;
+  return true;
+}
+
+void Memory::WatchCodeRange(uint32_t virtual_address, uint32_t length) {
+  uint32_t page_first, page_last;
+  if (!GetCodeWatchPageRange(virtual_address, length, &page_first,
+                             &page_last)) {
+    return;
+  }
+  auto lock = global_critical_region_.Acquire();
+  for (uint32_t i = page_first; i <= page_last; ++i) {
+    uint64_t page_bit = uint64_t(1) << (i & 63);
+    if (code_watch_bits_[i >> 6] & page_bit) {
+      continue;
+    }
+    uint32_t page_address = kCodeWatchBase + i * system_page_size_;
+    BaseHeap* heap = LookupHeap(page_address);
+    if (!heap || heap->QueryRangeAccess(page_address,
+                                        page_address + system_page_size_ - 1) !=
+                     xe::memory::PageAccess::kReadWrite) {
+      // Not writable by the guest, or not committed.
+      continue;
+    }
+    if (xe::memory::Protect(TranslateVirtual(page_address), system_page_size_,
+                            xe::memory::PageAccess::kReadOnly, nullptr)) {
+      code_watch_bits_[i >> 6] |= page_bit;
+    }
+  }
+}
+
+bool Memory::TriggerCodeWatches(uint32_t virtual_address, uint32_t length,
+                                bool restore_protection) {
+  uint32_t page_first, page_last;
+  if (!GetCodeWatchPageRange(virtual_address, length, &page_first,
+                             &page_last)) {
+    return false;
+  }
+  bool any_watched = false;
+  for (uint32_t i = page_first; i <= page_last; ++i) {
+    uint64_t page_bit = uint64_t(1) << (i & 63);
+    if (!(code_watch_bits_[i >> 6] & page_bit)) {
+      continue;
+    }
+    code_watch_bits_[i >> 6] &= ~page_bit;
+    any_watched = true;
+    uint32_t page_address = kCodeWatchBase + i * system_page_size_;
+    if (restore_protection) {
+      BaseHeap* heap = LookupHeap(page_address);
+      xe::memory::Protect(
+          TranslateVirtual(page_address), system_page_size_,
+          heap->QueryRangeAccess(page_address,
+                                 page_address + system_page_size_ - 1),
+          nullptr);
+    }
+    if (code_modification_callback_) {
+      code_modification_callback_(code_modification_callback_context_,
+                                  page_address, system_page_size_);
+    }
+  }
+  return any_watched;
+}
+
+void Memory::ReapplyCodeWatches(uint32_t virtual_address, uint32_t length) {
+  uint32_t page_first, page_last;
+  if (!GetCodeWatchPageRange(virtual_address, length, &page_first,
+                             &page_last)) {
+    return;
+  }
+  for (uint32_t i = page_first; i <= page_last; ++i) {
+    uint64_t page_bit = uint64_t(1) << (i & 63);
+    if (!(code_watch_bits_[i >> 6] & page_bit)) {
+      continue;
+    }
+    uint32_t page_address = kCodeWatchBase + i * system_page_size_;
+    BaseHeap* heap = LookupHeap(page_address);
+    if (heap->QueryRangeAccess(page_address,
+                               page_address + system_page_size_ - 1) ==
+        xe::memory::PageAccess::kReadWrite) {
+      xe::memory::Protect(TranslateVirtual(page_address), system_page_size_,
+                          xe::memory::PageAccess::kReadOnly, nullptr);
+    } else {
+      // No longer writable, so the code can't be modified anymore.
+      code_watch_bits_[i >> 6] &= ~page_bit;
+    }
+  }
+}
+
 uint32_t Memory::SystemHeapAlloc(uint32_t size, uint32_t alignment,
                                  uint32_t system_heap_flags) {
-  // TODO(benvanik): lightweight pool.
   bool is_physical = !!(system_heap_flags & kSystemHeapPhysical);
+  // Blocks in the pools are aligned to their size.
+  uint32_t block_size = std::max(size, alignment);
+  if (cvars::system_heap_pools && block_size &&
+      block_size <= (uint32_t(1) << kSystemHeapMaxBlockSizeLog2)) {
+    uint32_t block_size_log2 =
+        std::max(xe::log2_ceil(block_size), kSystemHeapMinBlockSizeLog2);
+    uint32_t address = SystemHeapPoolAlloc(is_physical, block_size_log2);
+    if (address) {
+      Zero(address, size);
+      return address;
+    }
+  }
   auto heap = LookupHeapByType(is_physical, 4096);
   uint32_t address;
   if (!heap->Alloc(size, alignment,
@@ -546,11 +804,119 @@ void Memory::SystemHeapFree(uint32_t address) {
   if (!address) {
     return;
   }
-  // TODO(benvanik): lightweight pool.
+  uint8_t slab = system_heap_slabs_[address >> kSystemHeapSlabSizeLog2];
+  if (slab) {
+    SystemHeapPool& pool =
+        system_heap_pools_[(slab & kSystemHeapSlabPhysical) ? 1 : 0]
+                          [(slab & ~kSystemHeapSlabPhysical) -
+                           kSystemHeapMinBlockSizeLog2];
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    pool.free_blocks.push_back(address);
+    return;
+  }
   auto heap = LookupHeap(address);
   heap->Release(address);
 }
 
+uint32_t Memory::SystemHeapPoolAlloc(bool is_physical,
+                                     uint32_t block_size_log2) {
+  SystemHeapPool& pool =
+      system_heap_pools_[is_physical ? 1 : 0]
+                        [block_size_log2 - kSystemHeapMinBlockSizeLog2];
+  std::lock_guard<std::mutex> lock(pool.mutex);
+  if (pool.free_blocks.empty()) {
+    uint32_t slab_size = uint32_t(1) << kSystemHeapSlabSizeLog2;
+    uint32_t slab_address;
+    if (!LookupHeapByType(is_physical, 4096)
+             ->Alloc(slab_size, slab_size,
+                     kMemoryAllocationReserve | kMemoryAllocationCommit,
+                     kMemoryProtectRead | kMemoryProtectWrite, false,
+                     &slab_address)) {
+      return 0;
+    }
+    system_heap_slabs_[slab_address >> kSystemHeapSlabSizeLog2] =
+        uint8_t(block_size_log2) | (is_physical ? kSystemHeapSlabPhysical : 0);
+    // Handed out from the beginning of the slab.
+    uint32_t block_size = uint32_t(1) << block_size_log2;
+    for (uint32_t offset = slab_size; offset;) {
+      offset -= block_size;
+      pool.free_blocks.push_back(slab_address + offset);
+    }
+  }
+  uint32_t address = pool.free_blocks.back();
+  pool.free_blocks.pop_back();
+  return address;
+}
+
+void Memory::SaveSystemHeapPools(std::vector<uint32_t>& data) {
+  data.clear();
+  for (auto& heap_pools : system_heap_pools_) {
+    for (SystemHeapPool& pool : heap_pools) {
+      std::lock_guard<std::mutex> lock(pool.mutex);
+      data.push_back(uint32_t(pool.free_blocks.size()));
+      data.insert(data.end(), pool.free_blocks.cbegin(),
+                  pool.free_blocks.cend());
+    }
+  }
+  size_t slab_count_index = data.size();
+  data.push_back(0);
+  for (uint32_t i = 0; i < uint32_t(system_heap_slabs_.size()); ++i) {
+    if (system_heap_slabs_[i]) {
+      data.push_back((i << 8) | system_heap_slabs_[i]);
+      ++data[slab_count_index];
+    }
+  }
+}
+
+bool Memory::RestoreSystemHeapPools(const uint32_t* data, size_t count) {
+  ResetSystemHeapPools();
+  const uint32_t* data_end = data + count;
+  for (auto& heap_pools : system_heap_pools_) {
+    for (SystemHeapPool& pool : heap_pools) {
+      if (data == data_end || *data > size_t(data_end - data - 1)) {
+        return false;
+      }
+      std::lock_guard<std::mutex> lock(pool.mutex);
+      pool.free_blocks.assign(data + 1, data + 1 + *data);
+      data += 1 + *data;
+    }
+  }
+  if (data == data_end || *data != size_t(data_end - data - 1)) {
+    return false;
+  }
+  for (++data; data != data_end; ++data) {
+    system_heap_slabs_[*data >> 8] = uint8_t(*data);
+  }
+  return true;
+}
+
+void Memory::SaveSystemHeapPools(ByteStream* stream) {
+  std::vector<uint32_t> data;
+  SaveSystemHeapPools(data);
+  stream->Write(uint32_t(data.size()));
+  stream->Write(data.data(), data.size() * sizeof(uint32_t));
+}
+
+bool Memory::RestoreSystemHeapPools(ByteStream* stream) {
+  uint32_t count = stream->Read<uint32_t>();
+  if (count > (stream->data_length() - stream->offset()) / sizeof(uint32_t)) {
+    return false;
+  }
+  std::vector<uint32_t> data(count);
+  stream->Read(data.data(), count * sizeof(uint32_t));
+  return RestoreSystemHeapPools(data.data(), count);
+}
+
+void Memory::ResetSystemHeapPools() {
+  for (auto& heap_pools : system_heap_pools_) {
+    for (SystemHeapPool& pool : heap_pools) {
+      std::lock_guard<std::mutex> lock(pool.mutex);
+      pool.free_blocks.clear();
+    }
+  }
+  system_heap_slabs_.assign(size_t(1) << (32 - kSystemHeapSlabSizeLog2), 0);
+}
+
 void Memory::DumpMap() {
   XELOGE("==================================================================");
   XELOGE("Memory Dump");
@@ -588,6 +954,7 @@ bool Memory::Save(ByteStream* stream) {
   heaps_.v80000000.Save(stream);
   heaps_.v90000000.Save(stream);
   heaps_.physical.Save(stream);
+  SaveSystemHeapPools(stream);
 
   return true;
 }
@@ -600,9 +967,204 @@ bool Memory::Restore(ByteStream* stream) {
   heaps_.v90000000.Restore(stream);
   heaps_.physical.Restore(stream);
 
+  return RestoreSystemHeapPools(stream);
+}
+
+void Memory::CaptureCheckpoint(MemoryCheckpoint* checkpoint) {
+  XELOGD("Capturing memory checkpoint...");
+  heaps_.v00000000.CaptureCheckpoint(&checkpoint->heaps[0]);
+  heaps_.v40000000.CaptureCheckpoint(&checkpoint->heaps[1]);
+  heaps_.v80000000.CaptureCheckpoint(&checkpoint->heaps[2]);
+  heaps_.v90000000.CaptureCheckpoint(&checkpoint->heaps[3]);
+  heaps_.physical.CaptureCheckpoint(&checkpoint->heaps[4]);
+  SaveSystemHeapPools(checkpoint->system_heap_pools);
+}
+
+bool Memory::RestoreCheckpoint(ByteStream* stream) {
+  XELOGD("Restoring memory checkpoint...");
+  return heaps_.v00000000.RestoreCheckpoint(stream) &&
+         heaps_.v40000000.RestoreCheckpoint(stream) &&
+         heaps_.v80000000.RestoreCheckpoint(stream) &&
+         heaps_.v90000000.RestoreCheckpoint(stream) &&
+         heaps_.physical.RestoreCheckpoint(stream) &&
+         RestoreSystemHeapPools(stream);
+}
+
+void Memory::ResetCheckpoints() {
+  heaps_.v00000000.ResetCheckpoint();
+  heaps_.v40000000.ResetCheckpoint();
+  heaps_.v80000000.ResetCheckpoint();
+  heaps_.v90000000.ResetCheckpoint();
+  heaps_.physical.ResetCheckpoint();
+}
+
+// The virtual memory heaps restored lazily, 0x00000000-0x7EFFFFFF, are at
+// the same offsets in the mapping.
+constexpr size_t kLazyRestoreViewSize = 0x7F000000;
+
+bool Memory::SaveStreaming(ByteStream* stream) {
+  XELOGD("Serializing memory for a streaming save state...");
+  if (!heaps_.v00000000.SaveStreaming(stream) ||
+      !heaps_.v40000000.SaveStreaming(stream) ||
+      !heaps_.v80000000.SaveStreaming(stream) ||
+      !heaps_.v90000000.SaveStreaming(stream) ||
+      !heaps_.physical.SaveStreaming(stream)) {
+    return false;
+  }
+  SaveSystemHeapPools(stream);
   return true;
 }
 
+bool Memory::RestoreStreaming(std::unique_ptr<MappedMemory> map,
+                              size_t offset) {
+  XELOGD("Restoring memory from a streaming save state...");
+  auto global_lock = global_critical_region_.Acquire();
+  // Finish restoring the previous state before its pages are replaced.
+  while (RestoreLazyPages(UINT32_MAX)) {
+  }
+
+  ByteStream stream(map->data(), map->size(), offset);
+  uint8_t* lazy_view = nullptr;
+#if XE_PLATFORM_WIN32
+  // Views of the mapping don't share the memory on other platforms yet, so
+  // the pages couldn't be restored without making them accessible first.
+  lazy_view = reinterpret_cast<uint8_t*>(
+      xe::memory::MapFileView(mapping_, nullptr, kLazyRestoreViewSize,
+                              xe::memory::PageAccess::kReadWrite, 0));
+#endif  // XE_PLATFORM_WIN32
+  if (lazy_view) {
+    lazy_restore_map_ = std::move(map);
+    lazy_restore_view_ = lazy_view;
+  }
+  bool restored =
+      heaps_.v00000000.RestoreStreaming(&stream, lazy_view) &&
+      heaps_.v40000000.RestoreStreaming(
+          &stream, lazy_view ? lazy_view + heaps_.v40000000.heap_base()
+                             : nullptr) &&
+      heaps_.v80000000.RestoreStreaming(&stream, nullptr) &&
+      heaps_.v90000000.RestoreStreaming(&stream, nullptr) &&
+      heaps_.physical.RestoreStreaming(&stream, nullptr) &&
+      RestoreSystemHeapPools(&stream);
+  if (!restored) {
+    // Don't leave the pages restored so far inaccessible.
+    while (RestoreLazyPages(UINT32_MAX)) {
+    }
+  }
+  if (lazy_restore_map_ && !heaps_.v00000000.RestoreLazyPages(0) &&
+      !heaps_.v40000000.RestoreLazyPages(0)) {
+    EndLazyRestore();
+  }
+  return restored;
+}
+
+bool Memory::RestoreLazyPages(uint32_t page_count) {
+  auto global_lock = global_critical_region_.Acquire();
+  if (!lazy_restore_map_) {
+    return false;
+  }
+  if (heaps_.v00000000.RestoreLazyPages(page_count) ||
+      heaps_.v40000000.RestoreLazyPages(page_count)) {
+    return true;
+  }
+  EndLazyRestore();
+  return false;
+}
+
+void Memory::EndLazyRestore() {
+  if (lazy_restore_view_) {
+    xe::memory::UnmapFileView(mapping_, lazy_restore_view_,
+                              kLazyRestoreViewSize);
+    lazy_restore_view_ = nullptr;
+  }
+  lazy_restore_map_.reset();
+}
+
+namespace {
+
+// Captured runs of pages are split so they're compressed in chunks of at most
+// this size.
+constexpr uint32_t kCheckpointChunkSize = 1024 * 1024;
+
+// Chunks are compressed directly into the stream, prefixed with their
+// uncompressed and compressed sizes.
+void WriteCheckpointChunk(ByteStream* stream, const void* data, size_t size) {
+  size_t header_offset = stream->offset();
+  size_t compressed_offset = header_offset + sizeof(uint32_t) * 2;
+  assert_true(compressed_offset + snappy::MaxCompressedLength(size) <=
+              stream->data_length());
+  size_t compressed_size;
+  snappy::RawCompress(
+      reinterpret_cast<const char*>(data), size,
+      reinterpret_cast<char*>(stream->data() + compressed_offset),
+      &compressed_size);
+  stream->Write(uint32_t(size));
+  stream->Write(uint32_t(compressed_size));
+  stream->set_offset(compressed_offset + compressed_size);
+}
+
+bool ReadCheckpointChunk(ByteStream* stream, void* data, size_t size) {
+  uint32_t uncompressed_size = stream->Read<uint32_t>();
+  uint32_t compressed_size = stream->Read<uint32_t>();
+  if (uncompressed_size != size ||
+      compressed_size > stream->data_length() - stream->offset()) {
+    return false;
+  }
+  auto compressed =
+      reinterpret_cast<const char*>(stream->data() + stream->offset());
+  stream->Advance(compressed_size);
+  size_t length;
+  return snappy::GetUncompressedLength(compressed, compressed_size,
+                                       &length) &&
+         length == size &&
+         snappy::RawUncompress(compressed, compressed_size,
+                               reinterpret_cast<char*>(data));
+}
+
+// Calls the function for every run of committed pages with the same current
+// protection, with the first page, the page count and the protection.
+template <typename F>
+void ForEachCommittedPageRange(const std::vector<PageEntry>& page_table,
+                               F function) {
+  uint32_t page_count = uint32_t(page_table.size());
+  for (uint32_t i = 0; i < page_count;) {
+    if (!(page_table[i].state & kMemoryAllocationCommit)) {
+      ++i;
+      continue;
+    }
+    uint32_t protect = page_table[i].current_protect;
+    uint32_t end = i + 1;
+    while (end < page_count &&
+           (page_table[end].state & kMemoryAllocationCommit) &&
+           page_table[end].current_protect == protect) {
+      ++end;
+    }
+    function(i, end - i, protect);
+    i = end;
+  }
+}
+
+}  // namespace
+
+void MemoryCheckpoint::Write(ByteStream* stream) const {
+  for (const Heap& heap : heaps) {
+    stream->Write(uint32_t(heap.page_table.size()));
+    WriteCheckpointChunk(stream, heap.page_table.data(),
+                         heap.page_table.size() * sizeof(uint64_t));
+    stream->Write(uint32_t(heap.page_runs.size()));
+    const uint8_t* data = heap.data.data();
+    for (const auto& run : heap.page_runs) {
+      size_t run_size = size_t(run.second) * heap.page_size;
+      stream->Write(run.first);
+      stream->Write(run.second);
+      WriteCheckpointChunk(stream, data, run_size);
+      data += run_size;
+    }
+  }
+  stream->Write(uint32_t(system_heap_pools.size()));
+  stream->Write(system_heap_pools.data(),
+                system_heap_pools.size() * sizeof(uint32_t));
+}
+
 xe::memory::PageAccess ToPageAccess(uint32_t protect) {
   if ((protect & kMemoryProtectRead) && !(protect & kMemoryProtectWrite)) {
     return xe::memory::PageAccess::kReadOnly;
@@ -632,7 +1194,15 @@ uint32_t FromPageAccess(xe::memory::PageAccess protect) {
 }
 
 BaseHeap::BaseHeap()
-    : membase_(nullptr), heap_base_(0), heap_size_(0), page_size_(0) {}
+    : membase_(nullptr),
+      heap_base_(0),
+      heap_size_(0),
+      page_size_(0),
+      lazy_restore_data_(nullptr),
+      lazy_restore_view_(nullptr),
+      lazy_restore_page_count_(0),
+      lazy_restore_next_page_(0),
+      page_table_sequence_(0) {}
 
 BaseHeap::~BaseHeap() = default;
 
@@ -647,6 +1217,164 @@ void BaseHeap::Initialize(Memory* memory, uint8_t* membase, HeapType heap_type,
   page_size_ = page_size;
   host_address_offset_ = host_address_offset;
   page_table_.resize(heap_size / page_size);
+  ResetUnreservedPageIndex();
+}
+
+void BaseHeap::BeginPageTableWrite() {
+  uint32_t sequence = page_table_sequence_.load(std::memory_order_relaxed);
+  assert_zero(sequence & 1);
+  page_table_sequence_.store(sequence + 1, std::memory_order_relaxed);
+  // Keep the page table stores after the sequence becoming odd.
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+void BaseHeap::EndPageTableWrite() {
+  page_table_sequence_.store(
+      page_table_sequence_.load(std::memory_order_relaxed) + 1,
+      std::memory_order_release);
+}
+
+template <typename F>
+void BaseHeap::ReadPageTable(F&& read) const {
+  while (true) {
+    uint32_t sequence = page_table_sequence_.load(std::memory_order_acquire);
+    if (!(sequence & 1)) {
+      read();
+      // Keep the page table loads before checking the sequence again.
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (page_table_sequence_.load(std::memory_order_relaxed) == sequence) {
+        return;
+      }
+    }
+    xe::threading::MaybeYield();
+  }
+}
+
+void BaseHeap::ResetUnreservedPageIndex() {
+  uint32_t page_count = uint32_t(page_table_.size());
+  uint32_t block_count = (page_count + 63) / 64;
+  unreserved_page_bits_.assign(block_count, 0);
+  unreserved_block_any_bits_.assign((block_count + 63) / 64, 0);
+  unreserved_block_all_bits_.assign((block_count + 63) / 64, 0);
+  for (uint32_t i = 0; i < page_count; ++i) {
+    if (!page_table_[i].state) {
+      unreserved_page_bits_[i >> 6] |= uint64_t(1) << (i & 63);
+    }
+  }
+  for (uint32_t i = 0; i < block_count; ++i) {
+    UpdateUnreservedBlockSummary(i);
+  }
+}
+
+void BaseHeap::SetPagesReserved(uint32_t first, uint32_t last, bool reserved) {
+  assert_true(first <= last && last < page_table_.size());
+  uint32_t block_first = first >> 6;
+  uint32_t block_last = last >> 6;
+  for (uint32_t i = block_first; i <= block_last; ++i) {
+    uint64_t mask = ~uint64_t(0);
+    if (i == block_first) {
+      mask &= ~uint64_t(0) << (first & 63);
+    }
+    if (i == block_last) {
+      mask &= ~uint64_t(0) >> (63 - (last & 63));
+    }
+    if (reserved) {
+      unreserved_page_bits_[i] &= ~mask;
+    } else {
+      unreserved_page_bits_[i] |= mask;
+    }
+    UpdateUnreservedBlockSummary(i);
+  }
+}
+
+void BaseHeap::UpdateUnreservedBlockSummary(uint32_t block) {
+  uint64_t page_bits = unreserved_page_bits_[block];
+  uint64_t block_bit = uint64_t(1) << (block & 63);
+  if (page_bits) {
+    unreserved_block_any_bits_[block >> 6] |= block_bit;
+  } else {
+    unreserved_block_any_bits_[block >> 6] &= ~block_bit;
+  }
+  if (page_bits == ~uint64_t(0)) {
+    unreserved_block_all_bits_[block >> 6] |= block_bit;
+  } else {
+    unreserved_block_all_bits_[block >> 6] &= ~block_bit;
+  }
+}
+
+uint32_t BaseHeap::FindPage(uint32_t first, uint32_t last,
+                            bool unreserved) const {
+  // Bits past the last page of the heap are never set in the index, so they
+  // are seen as reserved, but never returned as they're out of [first, last].
+  auto page_bits = [this, unreserved](uint32_t block) {
+    uint64_t bits = unreserved_page_bits_[block];
+    return unreserved ? bits : ~bits;
+  };
+  auto block_bits = [this, unreserved](uint32_t summary) {
+    return unreserved ? unreserved_block_any_bits_[summary]
+                      : ~unreserved_block_all_bits_[summary];
+  };
+  uint32_t block = first >> 6;
+  uint32_t block_last = last >> 6;
+  uint64_t bits = page_bits(block) & (~uint64_t(0) << (first & 63));
+  while (!bits) {
+    if (block == block_last) {
+      return UINT32_MAX;
+    }
+    ++block;
+    uint64_t summary = block_bits(block >> 6) & (~uint64_t(0) << (block & 63));
+    if (!summary) {
+      block |= 63;
+      if (block >= block_last) {
+        return UINT32_MAX;
+      }
+      continue;
+    }
+    block = (block & ~uint32_t(63)) + xe::tzcnt(summary);
+    if (block > block_last) {
+      return UINT32_MAX;
+    }
+    bits = page_bits(block);
+  }
+  uint32_t page = (block << 6) + xe::tzcnt(bits);
+  return page <= last ? page : UINT32_MAX;
+}
+
+uint32_t BaseHeap::FindPageReverse(uint32_t first, uint32_t last,
+                                   bool unreserved) const {
+  auto page_bits = [this, unreserved](uint32_t block) {
+    uint64_t bits = unreserved_page_bits_[block];
+    return unreserved ? bits : ~bits;
+  };
+  auto block_bits = [this, unreserved](uint32_t summary) {
+    return unreserved ? unreserved_block_any_bits_[summary]
+                      : ~unreserved_block_all_bits_[summary];
+  };
+  uint32_t block = last >> 6;
+  uint32_t block_first = first >> 6;
+  uint64_t bits = page_bits(block) & (~uint64_t(0) >> (63 - (last & 63)));
+  while (!bits) {
+    if (block == block_first) {
+      return UINT32_MAX;
+    }
+    --block;
+    uint64_t summary =
+        block_bits(block >> 6) & (~uint64_t(0) >> (63 - (block & 63)));
+    if (!summary) {
+      block &= ~uint32_t(63);
+      if (block <= block_first) {
+        return UINT32_MAX;
+      }
+      continue;
+    }
+    block = (block & ~uint32_t(63)) + (63 - xe::lzcnt(summary));
+    if (block < block_first) {
+      return UINT32_MAX;
+    }
+    bits = page_bits(block);
+  }
+  uint32_t page = (block << 6) + (63 - xe::lzcnt(bits));
+  return page >= first ? page : UINT32_MAX;
 }
 
 void BaseHeap::Dispose() {
@@ -718,26 +1446,8 @@ uint32_t BaseHeap::GetTotalPageCount() { return uint32_t(page_table_.size()); }
 uint32_t BaseHeap::GetUnreservedPageCount() {
   auto global_lock = global_critical_region_.Acquire();
   uint32_t count = 0;
-  bool is_empty_span = false;
-  uint32_t empty_span_start = 0;
-  uint32_t size = uint32_t(page_table_.size());
-  for (uint32_t i = 0; i < size; ++i) {
-    auto& page = page_table_[i];
-    if (!page.state) {
-      if (!is_empty_span) {
-        is_empty_span = true;
-        empty_span_start = i;
-      }
-      continue;
-    }
-    if (is_empty_span) {
-      is_empty_span = false;
-      count += i - empty_span_start;
-    }
-    i += page.region_page_count - 1;
-  }
-  if (is_empty_span) {
-    count += size - empty_span_start;
+  for (uint64_t bits : unreserved_page_bits_) {
+    count += xe::bit_count(bits);
   }
   return count;
 }
@@ -773,9 +1483,12 @@ bool BaseHeap::Save(ByteStream* stream) {
 bool BaseHeap::Restore(ByteStream* stream) {
   XELOGD("Heap {:08X}-{:08X}", heap_base_, heap_base_ + (heap_size_ - 1));
 
+  auto global_lock = global_critical_region_.Acquire();
   for (size_t i = 0; i < page_table_.size(); i++) {
     auto& page = page_table_[i];
+    BeginPageTableWrite();
     page.qword = stream->Read<uint64_t>();
+    EndPageTableWrite();
     if (!page.state) {
       // Unallocated.
       continue;
@@ -810,13 +1523,312 @@ bool BaseHeap::Restore(ByteStream* stream) {
       xe::memory::Protect(addr, page_size_, page_access, nullptr);
     }
   }
+  ResetUnreservedPageIndex();
+
+  return true;
+}
+
+void BaseHeap::CaptureCheckpoint(MemoryCheckpoint::Heap* checkpoint) {
+  XELOGD("Heap {:08X}-{:08X}", heap_base_, heap_base_ + (heap_size_ - 1));
+
+  auto global_lock = global_critical_region_.Acquire();
+  uint32_t page_count = uint32_t(page_table_.size());
+  if (checkpoint_page_hashes_.empty()) {
+    checkpoint_page_hashes_.resize(page_count, 0);
+  }
+  uint32_t max_run_page_count =
+      std::max(kCheckpointChunkSize / page_size_, uint32_t(1));
+  checkpoint->page_size = page_size_;
+  checkpoint->page_table.resize(page_count);
+  checkpoint->page_runs.clear();
+  checkpoint->data.clear();
+  for (uint32_t i = 0; i < page_count; ++i) {
+    const PageEntry& page = page_table_[i];
+    checkpoint->page_table[i] = page.qword;
+    uint64_t& page_hash = checkpoint_page_hashes_[i];
+    if (!(page.state & kMemoryAllocationCommit)) {
+      // Capture the contents again if the page is committed later.
+      page_hash = 0;
+      continue;
+    }
+
+    auto addr = TranslateRelative(size_t(i) * page_size_);
+    // Guard pages need to be made readable temporarily.
+    bool readable = (page.current_protect & kMemoryProtectRead) != 0;
+    memory::PageAccess old_access;
+    if (!readable) {
+      memory::Protect(addr, page_size_, memory::PageAccess::kReadOnly,
+                      &old_access);
+    }
+    uint64_t hash = XXH64(addr, page_size_, 0);
+    if (hash != page_hash) {
+      page_hash = hash;
+      if (!checkpoint->page_runs.empty() &&
+          checkpoint->page_runs.back().first +
+                  checkpoint->page_runs.back().second ==
+              i &&
+          checkpoint->page_runs.back().second < max_run_page_count) {
+        ++checkpoint->page_runs.back().second;
+      } else {
+        checkpoint->page_runs.emplace_back(i, 1);
+      }
+      size_t data_offset = checkpoint->data.size();
+      checkpoint->data.resize(data_offset + page_size_);
+      std::memcpy(checkpoint->data.data() + data_offset, addr, page_size_);
+    }
+    if (!readable) {
+      memory::Protect(addr, page_size_, old_access, nullptr);
+    }
+  }
+}
+
+bool BaseHeap::RestoreCheckpoint(ByteStream* stream) {
+  XELOGD("Heap {:08X}-{:08X}", heap_base_, heap_base_ + (heap_size_ - 1));
+
+  auto global_lock = global_critical_region_.Acquire();
+  uint32_t page_count = uint32_t(page_table_.size());
+  if (stream->Read<uint32_t>() != page_count) {
+    return false;
+  }
+  std::vector<uint64_t> page_qwords(page_count);
+  if (!ReadCheckpointChunk(stream, page_qwords.data(),
+                           page_count * sizeof(uint64_t))) {
+    return false;
+  }
+  BeginPageTableWrite();
+  for (uint32_t i = 0; i < page_count; ++i) {
+    page_table_[i].qword = page_qwords[i];
+  }
+  EndPageTableWrite();
+  // The captured pages no longer match the memory they were hashed from.
+  checkpoint_page_hashes_.clear();
+  ResetUnreservedPageIndex();
+
+  // Commit the memory if it isn't already, with R/W protection until the
+  // modified pages are read. We do not need to reserve any memory, as the
+  // mapping has already taken care of that.
+  ForEachCommittedPageRange(
+      page_table_, [this](uint32_t first, uint32_t count, uint32_t protect) {
+        xe::memory::AllocFixed(TranslateRelative(size_t(first) * page_size_),
+                               size_t(count) * page_size_,
+                               memory::AllocationType::kCommit,
+                               memory::PageAccess::kReadWrite);
+      });
+
+  uint32_t run_count = stream->Read<uint32_t>();
+  for (uint32_t i = 0; i < run_count; ++i) {
+    uint32_t first_page = stream->Read<uint32_t>();
+    uint32_t run_page_count = stream->Read<uint32_t>();
+    if (first_page >= page_count ||
+        run_page_count > page_count - first_page) {
+      return false;
+    }
+    for (uint32_t j = 0; j < run_page_count; ++j) {
+      if (!(page_table_[first_page + j].state & kMemoryAllocationCommit)) {
+        return false;
+      }
+    }
+    if (!ReadCheckpointChunk(stream,
+                             TranslateRelative(size_t(first_page) * page_size_),
+                             size_t(run_page_count) * page_size_)) {
+      return false;
+    }
+  }
+
+  ForEachCommittedPageRange(
+      page_table_, [this](uint32_t first, uint32_t count, uint32_t protect) {
+        xe::memory::Protect(TranslateRelative(size_t(first) * page_size_),
+                            size_t(count) * page_size_, ToPageAccess(protect),
+                            nullptr);
+      });
+
+  return true;
+}
+
+void BaseHeap::ResetCheckpoint() {
+  auto global_lock = global_critical_region_.Acquire();
+  checkpoint_page_hashes_.clear();
+}
+
+bool BaseHeap::SaveStreaming(ByteStream* stream) {
+  XELOGD("Heap {:08X}-{:08X}", heap_base_, heap_base_ + (heap_size_ - 1));
+
+  auto global_lock = global_critical_region_.Acquire();
+  uint32_t page_count = uint32_t(page_table_.size());
+  stream->Write(page_count);
+  stream->Write(page_size_);
+  for (const PageEntry& page : page_table_) {
+    stream->Write(page.qword);
+  }
+  // Committed pages are stored in order, and have the index of their
+  // contents in the page data.
+  uint32_t data_page_count = 0;
+  for (const PageEntry& page : page_table_) {
+    stream->Write((page.state & kMemoryAllocationCommit) ? data_page_count++
+                                                         : UINT32_MAX);
+  }
+  size_t data_offset = xe::align(stream->offset(), size_t(page_size_));
+  if (data_offset + size_t(data_page_count) * page_size_ >
+      stream->data_length()) {
+    return false;
+  }
+  stream->set_offset(data_offset);
+  for (uint32_t i = 0; i < page_count; ++i) {
+    const PageEntry& page = page_table_[i];
+    if (!(page.state & kMemoryAllocationCommit)) {
+      continue;
+    }
+    auto addr = TranslateRelative(size_t(i) * page_size_);
+    // Guard pages need to be made readable temporarily.
+    bool readable = (page.current_protect & kMemoryProtectRead) != 0;
+    memory::PageAccess old_access;
+    if (!readable) {
+      memory::Protect(addr, page_size_, memory::PageAccess::kReadOnly,
+                      &old_access);
+    }
+    stream->Write(addr, page_size_);
+    if (!readable) {
+      memory::Protect(addr, page_size_, old_access, nullptr);
+    }
+  }
+  return true;
+}
+
+bool BaseHeap::RestoreStreaming(ByteStream* stream, uint8_t* lazy_view) {
+  XELOGD("Heap {:08X}-{:08X}", heap_base_, heap_base_ + (heap_size_ - 1));
+
+  auto global_lock = global_critical_region_.Acquire();
+  uint32_t page_count = uint32_t(page_table_.size());
+  if (stream->Read<uint32_t>() != page_count ||
+      stream->Read<uint32_t>() != page_size_) {
+    return false;
+  }
+  std::vector<uint64_t> page_qwords(page_count);
+  std::vector<uint32_t> data_indices(page_count);
+  stream->Read(page_qwords.data(), page_count * sizeof(uint64_t));
+  stream->Read(data_indices.data(), page_count * sizeof(uint32_t));
+  uint32_t data_page_count = 0;
+  for (uint32_t i = 0; i < page_count; ++i) {
+    PageEntry page;
+    page.qword = page_qwords[i];
+    if (data_indices[i] != ((page.state & kMemoryAllocationCommit)
+                                ? data_page_count++
+                                : UINT32_MAX)) {
+      return false;
+    }
+  }
+  size_t data_offset = xe::align(stream->offset(), size_t(page_size_));
+  size_t data_size = size_t(data_page_count) * page_size_;
+  if (data_offset + data_size > stream->data_length()) {
+    return false;
+  }
+  const uint8_t* data = stream->data() + data_offset;
+  stream->set_offset(data_offset + data_size);
+
+  BeginPageTableWrite();
+  for (uint32_t i = 0; i < page_count; ++i) {
+    page_table_[i].qword = page_qwords[i];
+  }
+  EndPageTableWrite();
+  checkpoint_page_hashes_.clear();
+  ResetUnreservedPageIndex();
+
+  // Commit the memory if it isn't already. We do not need to reserve any
+  // memory, as the mapping has already taken care of that.
+  ForEachCommittedPageRange(
+      page_table_,
+      [this, lazy_view](uint32_t first, uint32_t count, uint32_t protect) {
+        xe::memory::AllocFixed(TranslateRelative(size_t(first) * page_size_),
+                               size_t(count) * page_size_,
+                               memory::AllocationType::kCommit,
+                               lazy_view ? memory::PageAccess::kNoAccess
+                                         : memory::PageAccess::kReadWrite);
+      });
+
+  if (lazy_view) {
+    lazy_restore_indices_ = std::move(data_indices);
+    lazy_restore_data_ = data;
+    lazy_restore_view_ = lazy_view;
+    lazy_restore_page_count_ = data_page_count;
+    lazy_restore_next_page_ = 0;
+    if (!data_page_count) {
+      lazy_restore_indices_.clear();
+    }
+    return true;
+  }
+
+  for (uint32_t i = 0; i < page_count; ++i) {
+    if (data_indices[i] != UINT32_MAX) {
+      std::memcpy(TranslateRelative(size_t(i) * page_size_),
+                  data + size_t(data_indices[i]) * page_size_, page_size_);
+    }
+  }
+  ForEachCommittedPageRange(
+      page_table_, [this](uint32_t first, uint32_t count, uint32_t protect) {
+        xe::memory::Protect(TranslateRelative(size_t(first) * page_size_),
+                            size_t(count) * page_size_, ToPageAccess(protect),
+                            nullptr);
+      });
+  return true;
+}
+
+bool BaseHeap::RestoreLazyPage(uint32_t address) {
+  auto global_lock = global_critical_region_.Acquire();
+  if (!lazy_restore_page_count_ || address < heap_base_ ||
+      address - heap_base_ >= heap_size_) {
+    return false;
+  }
+  return RestoreLazyPageNumber((address - heap_base_) / page_size_);
+}
+
+uint32_t BaseHeap::RestoreLazyPages(uint32_t page_count) {
+  auto global_lock = global_critical_region_.Acquire();
+  while (page_count && lazy_restore_page_count_) {
+    if (RestoreLazyPageNumber(lazy_restore_next_page_++)) {
+      --page_count;
+    }
+  }
+  return lazy_restore_page_count_;
+}
+
+void BaseHeap::RestoreLazyPages(uint32_t first, uint32_t last) {
+  for (uint32_t i = first; lazy_restore_page_count_ && i <= last; ++i) {
+    RestoreLazyPageNumber(i);
+  }
+}
 
+bool BaseHeap::RestoreLazyPageNumber(uint32_t page_number) {
+  if (!lazy_restore_page_count_ ||
+      lazy_restore_indices_[page_number] == UINT32_MAX) {
+    return false;
+  }
+  // Written through the other view, so other threads can't see the page
+  // before it's complete.
+  std::memcpy(lazy_restore_view_ + size_t(page_number) * page_size_,
+              lazy_restore_data_ +
+                  size_t(lazy_restore_indices_[page_number]) * page_size_,
+              page_size_);
+  xe::memory::Protect(TranslateRelative(size_t(page_number) * page_size_),
+                      page_size_,
+                      ToPageAccess(page_table_[page_number].current_protect),
+                      nullptr);
+  lazy_restore_indices_[page_number] = UINT32_MAX;
+  if (!--lazy_restore_page_count_) {
+    lazy_restore_indices_.clear();
+    lazy_restore_indices_.shrink_to_fit();
+    lazy_restore_data_ = nullptr;
+    lazy_restore_view_ = nullptr;
+  }
   return true;
 }
 
 void BaseHeap::Reset() {
   // TODO(DrChat): protect pages.
+  auto global_lock = global_critical_region_.Acquire();
+  BeginPageTableWrite();
   std::memset(page_table_.data(), 0, sizeof(PageEntry) * page_table_.size());
+  EndPageTableWrite();
+  ResetUnreservedPageIndex();
   // TODO(Triang3l): Remove access callbacks from pages if this is a physical
   // memory heap.
 }
@@ -878,6 +1890,7 @@ bool BaseHeap::AllocFixed(uint32_t base_address, uint32_t size,
   if (allocation_type == kMemoryAllocationReserve) {
     // Reserve is not needed, as we are mapped already.
   } else {
+    RestoreLazyPages(start_page_number, end_page_number);
     auto alloc_type = (allocation_type & kMemoryAllocationCommit)
                           ? xe::memory::AllocationType::kCommit
                           : xe::memory::AllocationType::kReserve;
@@ -895,6 +1908,7 @@ bool BaseHeap::AllocFixed(uint32_t base_address, uint32_t size,
   }
 
   // Set page state.
+  BeginPageTableWrite();
   for (uint32_t page_number = start_page_number; page_number <= end_page_number;
        ++page_number) {
     auto& page_entry = page_table_[page_number];
@@ -907,6 +1921,8 @@ bool BaseHeap::AllocFixed(uint32_t base_address, uint32_t size,
     page_entry.current_protect = protect;
     page_entry.state = kMemoryAllocationReserve | allocation_type;
   }
+  EndPageTableWrite();
+  SetPagesReserved(start_page_number, end_page_number, true);
 
   return true;
 }
@@ -936,83 +1952,61 @@ bool BaseHeap::AllocRange(uint32_t low_address, uint32_t high_address,
   auto global_lock = global_critical_region_.Acquire();
 
   // Find a free page range.
-  // The base page must match the requested alignment, so we first scan for
-  // a free aligned page and only then check for continuous free pages.
-  // TODO(benvanik): optimized searching (free list buckets, bitmap, etc).
+  // The base page must match the requested alignment, so candidates are only
+  // checked at multiples of it, and the unreserved page index is used to skip
+  // to the next unreserved page after every reserved one found within a
+  // candidate range.
   uint32_t start_page_number = UINT_MAX;
   uint32_t end_page_number = UINT_MAX;
   uint32_t page_scan_stride = alignment / page_size_;
   high_page_number = high_page_number - (high_page_number % page_scan_stride);
   if (top_down) {
-    for (int64_t base_page_number =
-             high_page_number - xe::round_up(page_count, page_scan_stride);
-         base_page_number >= low_page_number;
-         base_page_number -= page_scan_stride) {
-      if (page_table_[base_page_number].state != 0) {
-        // Base page not free, skip to next usable page.
-        continue;
-      }
-      // Check requested range to ensure free.
-      start_page_number = uint32_t(base_page_number);
-      end_page_number = uint32_t(base_page_number) + page_count - 1;
-      assert_true(end_page_number < page_table_.size());
-      bool any_taken = false;
-      for (uint32_t page_number = uint32_t(base_page_number);
-           !any_taken && page_number <= end_page_number; ++page_number) {
-        bool is_free = page_table_[page_number].state == 0;
-        if (!is_free) {
-          // At least one page in the range is used, skip to next.
-          // We know we'll be starting at least before this page.
-          any_taken = true;
-          if (page_count > page_number) {
-            // Not enough space left to fit entire page range. Breaks outer
-            // loop.
-            base_page_number = -1;
-          } else {
-            base_page_number = page_number - page_count;
-            base_page_number -= base_page_number % page_scan_stride;
-            base_page_number += page_scan_stride;  // cancel out loop logic
-          }
-          break;
-        }
-      }
-      if (!any_taken) {
+    int64_t base_page_number =
+        int64_t(high_page_number) - xe::round_up(page_count, page_scan_stride);
+    while (base_page_number >= low_page_number) {
+      uint32_t reserved_page_number =
+          FindPageReverse(uint32_t(base_page_number),
+                          uint32_t(base_page_number) + page_count - 1, false);
+      if (reserved_page_number == UINT32_MAX) {
         // Found our place.
+        start_page_number = uint32_t(base_page_number);
+        end_page_number = start_page_number + page_count - 1;
+        break;
+      }
+      // The range must end before the last unreserved page preceding the
+      // reserved one.
+      uint32_t unreserved_page_number =
+          reserved_page_number > low_page_number
+              ? FindPageReverse(low_page_number, reserved_page_number - 1,
+                                true)
+              : UINT32_MAX;
+      if (unreserved_page_number == UINT32_MAX ||
+          unreserved_page_number + 1 < page_count) {
+        // Not enough space left to fit entire page range.
         break;
       }
-      // Retry.
-      start_page_number = end_page_number = UINT_MAX;
+      base_page_number = unreserved_page_number + 1 - page_count;
+      base_page_number -= base_page_number % page_scan_stride;
     }
   } else {
-    for (uint32_t base_page_number = low_page_number;
-         base_page_number <= high_page_number - page_count;
-         base_page_number += page_scan_stride) {
-      if (page_table_[base_page_number].state != 0) {
-        // Base page not free, skip to next usable page.
-        continue;
-      }
-      // Check requested range to ensure free.
-      start_page_number = base_page_number;
-      end_page_number = base_page_number + page_count - 1;
-      bool any_taken = false;
-      for (uint32_t page_number = base_page_number;
-           !any_taken && page_number <= end_page_number; ++page_number) {
-        bool is_free = page_table_[page_number].state == 0;
-        if (!is_free) {
-          // At least one page in the range is used, skip to next.
-          // We know we'll be starting at least after this page.
-          any_taken = true;
-          base_page_number = xe::round_up(page_number + 1, page_scan_stride);
-          base_page_number -= page_scan_stride;  // cancel out loop logic
-          break;
-        }
-      }
-      if (!any_taken) {
+    uint32_t base_page_number = low_page_number;
+    while (base_page_number <= high_page_number - page_count) {
+      uint32_t reserved_page_number = FindPage(
+          base_page_number, base_page_number + page_count - 1, false);
+      if (reserved_page_number == UINT32_MAX) {
         // Found our place.
+        start_page_number = base_page_number;
+        end_page_number = base_page_number + page_count - 1;
+        break;
+      }
+      // The range must start after the first unreserved page following the
+      // reserved one.
+      uint32_t unreserved_page_number =
+          FindPage(reserved_page_number, high_page_number, true);
+      if (unreserved_page_number == UINT32_MAX) {
         break;
       }
-      // Retry.
-      start_page_number = end_page_number = UINT_MAX;
+      base_page_number = xe::round_up(unreserved_page_number, page_scan_stride);
     }
   }
   if (start_page_number == UINT_MAX || end_page_number == UINT_MAX) {
@@ -1043,6 +2037,7 @@ bool BaseHeap::AllocRange(uint32_t low_address, uint32_t high_address,
   }
 
   // Set page state.
+  BeginPageTableWrite();
   for (uint32_t page_number = start_page_number; page_number <= end_page_number;
        ++page_number) {
     auto& page_entry = page_table_[page_number];
@@ -1052,6 +2047,8 @@ bool BaseHeap::AllocRange(uint32_t low_address, uint32_t high_address,
     page_entry.current_protect = protect;
     page_entry.state = kMemoryAllocationReserve | allocation_type;
   }
+  EndPageTableWrite();
+  SetPagesReserved(start_page_number, end_page_number, true);
 
   *out_address = heap_base_ + (start_page_number * page_size_);
   return true;
@@ -1067,6 +2064,14 @@ bool BaseHeap::Decommit(uint32_t address, uint32_t size) {
 
   auto global_lock = global_critical_region_.Acquire();
 
+  if (heap_type_ == HeapType::kGuestXex) {
+    memory_->TriggerCodeWatches(heap_base_ + start_page_number * page_size_,
+                                (end_page_number - start_page_number + 1) *
+                                    page_size_,
+                                true);
+  }
+  RestoreLazyPages(start_page_number, end_page_number);
+
   // Release from host.
   // TODO(benvanik): find a way to actually decommit memory;
   //     mapped memory cannot be decommitted.
@@ -1079,11 +2084,13 @@ bool BaseHeap::Decommit(uint32_t address, uint32_t size) {
   }*/
 
   // Perform table change.
+  BeginPageTableWrite();
   for (uint32_t page_number = start_page_number; page_number <= end_page_number;
        ++page_number) {
     auto& page_entry = page_table_[page_number];
     page_entry.state &= ~kMemoryAllocationCommit;
   }
+  EndPageTableWrite();
 
   return true;
 }
@@ -1108,6 +2115,14 @@ bool BaseHeap::Release(uint32_t base_address, uint32_t* out_region_size) {
     *out_region_size = (base_page_entry.region_page_count * page_size_);
   }
 
+  if (heap_type_ == HeapType::kGuestXex) {
+    memory_->TriggerCodeWatches(base_address,
+                                base_page_entry.region_page_count * page_size_,
+                                true);
+  }
+  RestoreLazyPages(base_page_number,
+                   base_page_number + base_page_entry.region_page_count - 1);
+
   // Release from host not needed as mapping reserves the range for us.
   // TODO(benvanik): protect with NOACCESS?
   /*BOOL result = VirtualFree(
@@ -1137,11 +2152,14 @@ bool BaseHeap::Release(uint32_t base_address, uint32_t* out_region_size) {
   // Perform table change.
   uint32_t end_page_number =
       base_page_number + base_page_entry.region_page_count - 1;
+  BeginPageTableWrite();
   for (uint32_t page_number = base_page_number; page_number <= end_page_number;
        ++page_number) {
     auto& page_entry = page_table_[page_number];
     page_entry.qword = 0;
   }
+  EndPageTableWrite();
+  SetPagesReserved(base_page_number, end_page_number, false);
 
   return true;
 }
@@ -1200,6 +2218,8 @@ bool BaseHeap::Protect(uint32_t address, uint32_t size, uint32_t protect,
     }
   }
 
+  RestoreLazyPages(start_page_number, end_page_number);
+
   // Attempt host change (hopefully won't fail).
   // We can only do this if our size matches system page granularity.
   uint32_t page_count = end_page_number - start_page_number + 1;
@@ -1215,7 +2235,13 @@ bool BaseHeap::Protect(uint32_t address, uint32_t size, uint32_t protect,
     }
 
     if (old_protect) {
-      *old_protect = FromPageAccess(old_protect_access);
+      if (heap_type_ == HeapType::kGuestXex) {
+        // The host protection is weaker for pages watched for code
+        // modification.
+        *old_protect = page_table_[start_page_number].current_protect;
+      } else {
+        *old_protect = FromPageAccess(old_protect_access);
+      }
     }
   } else {
     XELOGW("BaseHeap::Protect: ignoring request as not 4k page aligned");
@@ -1223,11 +2249,18 @@ bool BaseHeap::Protect(uint32_t address, uint32_t size, uint32_t protect,
   }
 
   // Perform table change.
+  BeginPageTableWrite();
   for (uint32_t page_number = start_page_number; page_number <= end_page_number;
        ++page_number) {
     auto& page_entry = page_table_[page_number];
     page_entry.current_protect = protect;
   }
+  EndPageTableWrite();
+
+  if (heap_type_ == HeapType::kGuestXex) {
+    memory_->ReapplyCodeWatches(heap_base_ + start_page_number * page_size_,
+                                page_count * page_size_);
+  }
 
   return true;
 }
@@ -1235,80 +2268,84 @@ bool BaseHeap::Protect(uint32_t address, uint32_t size, uint32_t protect,
 bool BaseHeap::QueryRegionInfo(uint32_t base_address,
                                HeapAllocationInfo* out_info) {
   uint32_t start_page_number = (base_address - heap_base_) / page_size_;
-  if (start_page_number > page_table_.size()) {
+  if (start_page_number >= page_table_.size()) {
     XELOGE("BaseHeap::QueryRegionInfo base page out of range");
     return false;
   }
 
-  auto global_lock = global_critical_region_.Acquire();
-
-  auto start_page_entry = page_table_[start_page_number];
-  out_info->base_address = base_address;
-  out_info->allocation_base = 0;
-  out_info->allocation_protect = 0;
-  out_info->region_size = 0;
-  out_info->state = 0;
-  out_info->protect = 0;
-  if (start_page_entry.state) {
-    // Committed/reserved region.
-    out_info->allocation_base = start_page_entry.base_address * page_size_;
-    out_info->allocation_protect = start_page_entry.allocation_protect;
-    out_info->allocation_size = start_page_entry.region_page_count * page_size_;
-    out_info->state = start_page_entry.state;
-    out_info->protect = start_page_entry.current_protect;
-
-    // Scan forward and report the size of the region matching the initial
-    // base address's attributes.
-    for (uint32_t page_number = start_page_number;
-         page_number <
-         start_page_entry.base_address + start_page_entry.region_page_count;
-         ++page_number) {
-      auto page_entry = page_table_[page_number];
-      if (page_entry.base_address != start_page_entry.base_address ||
-          page_entry.state != start_page_entry.state ||
-          page_entry.current_protect != start_page_entry.current_protect) {
-        // Different region or different properties within the region; done.
-        break;
+  ReadPageTable([&]() {
+    auto start_page_entry = page_table_[start_page_number];
+    out_info->base_address = base_address;
+    out_info->allocation_base = 0;
+    out_info->allocation_protect = 0;
+    out_info->region_size = 0;
+    out_info->state = 0;
+    out_info->protect = 0;
+    if (start_page_entry.state) {
+      // Committed/reserved region.
+      out_info->allocation_base = start_page_entry.base_address * page_size_;
+      out_info->allocation_protect = start_page_entry.allocation_protect;
+      out_info->allocation_size =
+          start_page_entry.region_page_count * page_size_;
+      out_info->state = start_page_entry.state;
+      out_info->protect = start_page_entry.current_protect;
+
+      // Scan forward and report the size of the region matching the initial
+      // base address's attributes. The bound is clamped as the entry may be
+      // torn by a concurrent modification until it's validated.
+      uint32_t end_page_number =
+          std::min(uint32_t(start_page_entry.base_address +
+                            start_page_entry.region_page_count),
+                   uint32_t(page_table_.size()));
+      for (uint32_t page_number = start_page_number;
+           page_number < end_page_number; ++page_number) {
+        auto page_entry = page_table_[page_number];
+        if (page_entry.base_address != start_page_entry.base_address ||
+            page_entry.state != start_page_entry.state ||
+            page_entry.current_protect != start_page_entry.current_protect) {
+          // Different region or different properties within the region; done.
+          break;
+        }
+        out_info->region_size += page_size_;
       }
-      out_info->region_size += page_size_;
-    }
-  } else {
-    // Free region.
-    for (uint32_t page_number = start_page_number;
-         page_number < page_table_.size(); ++page_number) {
-      auto page_entry = page_table_[page_number];
-      if (page_entry.state) {
-        // First non-free page; done with region.
-        break;
+    } else {
+      // Free region.
+      for (uint32_t page_number = start_page_number;
+           page_number < page_table_.size(); ++page_number) {
+        auto page_entry = page_table_[page_number];
+        if (page_entry.state) {
+          // First non-free page; done with region.
+          break;
+        }
+        out_info->region_size += page_size_;
       }
-      out_info->region_size += page_size_;
     }
-  }
+  });
   return true;
 }
 
 bool BaseHeap::QuerySize(uint32_t address, uint32_t* out_size) {
   uint32_t page_number = (address - heap_base_) / page_size_;
-  if (page_number > page_table_.size()) {
+  if (page_number >= page_table_.size()) {
     XELOGE("BaseHeap::QuerySize base page out of range");
     *out_size = 0;
     return false;
   }
-  auto global_lock = global_critical_region_.Acquire();
-  auto page_entry = page_table_[page_number];
+  PageEntry page_entry;
+  ReadPageTable([&]() { page_entry = page_table_[page_number]; });
   *out_size = (page_entry.region_page_count * page_size_);
   return true;
 }
 
 bool BaseHeap::QueryBaseAndSize(uint32_t* in_out_address, uint32_t* out_size) {
   uint32_t page_number = (*in_out_address - heap_base_) / page_size_;
-  if (page_number > page_table_.size()) {
+  if (page_number >= page_table_.size()) {
     XELOGE("BaseHeap::QuerySize base page out of range");
     *out_size = 0;
     return false;
   }
-  auto global_lock = global_critical_region_.Acquire();
-  auto page_entry = page_table_[page_number];
+  PageEntry page_entry;
+  ReadPageTable([&]() { page_entry = page_table_[page_number]; });
   *in_out_address = (page_entry.base_address * page_size_);
   *out_size = (page_entry.region_page_count * page_size_);
   return true;
@@ -1316,13 +2353,13 @@ bool BaseHeap::QueryBaseAndSize(uint32_t* in_out_address, uint32_t* out_size) {
 
 bool BaseHeap::QueryProtect(uint32_t address, uint32_t* out_protect) {
   uint32_t page_number = (address - heap_base_) / page_size_;
-  if (page_number > page_table_.size()) {
+  if (page_number >= page_table_.size()) {
     XELOGE("BaseHeap::QueryProtect base page out of range");
     *out_protect = 0;
     return false;
   }
-  auto global_lock = global_critical_region_.Acquire();
-  auto page_entry = page_table_[page_number];
+  PageEntry page_entry;
+  ReadPageTable([&]() { page_entry = page_table_[page_number]; });
   *out_protect = page_entry.current_protect;
   return true;
 }
@@ -1335,13 +2372,13 @@ xe::memory::PageAccess BaseHeap::QueryRangeAccess(uint32_t low_address,
   }
   uint32_t low_page_number = (low_address - heap_base_) / page_size_;
   uint32_t high_page_number = (high_address - heap_base_) / page_size_;
-  uint32_t protect = kMemoryProtectRead | kMemoryProtectWrite;
-  {
-    auto global_lock = global_critical_region_.Acquire();
+  uint32_t protect;
+  ReadPageTable([&]() {
+    protect = kMemoryProtectRead | kMemoryProtectWrite;
     for (uint32_t i = low_page_number; protect && i <= high_page_number; ++i) {
       protect &= page_table_[i].current_protect;
     }
-  }
+  });
   return ToPageAccess(protect);
 }
 
@@ -1504,6 +2541,13 @@ bool PhysicalHeap::AllocRange(uint32_t low_address, uint32_t high_address,
 bool PhysicalHeap::Decommit(uint32_t address, uint32_t size) {
   auto global_lock = global_critical_region_.Acquire();
 
+  // Not caring about the data not written to the guest memory yet either, and
+  // it can't be written after decommitting.
+  uint32_t system_page_first, system_page_last;
+  if (GetSystemPageRange(address, size, system_page_first, system_page_last)) {
+    TriggerDataProvidersLocked(system_page_first, system_page_last, true);
+  }
+
   uint32_t parent_address = GetPhysicalAddress(address);
   if (!parent_heap_->Decommit(parent_address, size)) {
     XELOGE("PhysicalHeap::Decommit failed due to parent heap failure");
@@ -1519,6 +2563,16 @@ bool PhysicalHeap::Decommit(uint32_t address, uint32_t size) {
 bool PhysicalHeap::Release(uint32_t base_address, uint32_t* out_region_size) {
   auto global_lock = global_critical_region_.Acquire();
 
+  // Drop the data not written to the guest memory yet while the memory is
+  // still committed.
+  uint32_t discard_region_size;
+  uint32_t system_page_first, system_page_last;
+  if (QuerySize(base_address, &discard_region_size) &&
+      GetSystemPageRange(base_address, discard_region_size, system_page_first,
+                         system_page_last)) {
+    TriggerDataProvidersLocked(system_page_first, system_page_last, true);
+  }
+
   uint32_t parent_base_address = GetPhysicalAddress(base_address);
   if (!parent_heap_->Release(parent_base_address, out_region_size)) {
     XELOGE("PhysicalHeap::Release failed due to parent heap failure");
@@ -1547,6 +2601,13 @@ bool PhysicalHeap::Protect(uint32_t address, uint32_t size, uint32_t protect,
                            uint32_t* old_protect) {
   auto global_lock = global_critical_region_.Acquire();
 
+  // The new protection will replace the one used for data providers, so the
+  // guest memory must have the latest data.
+  uint32_t system_page_first, system_page_last;
+  if (GetSystemPageRange(address, size, system_page_first, system_page_last)) {
+    TriggerDataProvidersLocked(system_page_first, system_page_last, false);
+  }
+
   // Only invalidate if making writable again, for simplicity - not when simply
   // marking some range as immutable, for instance.
   if (protect & kMemoryProtectWrite) {
@@ -1566,8 +2627,6 @@ void PhysicalHeap::EnableAccessCallbacks(uint32_t physical_address,
                                          uint32_t length,
                                          bool enable_invalidation_notifications,
                                          bool enable_data_providers) {
-  // TODO(Triang3l): Implement data providers.
-  assert_false(enable_data_providers);
   if (!enable_invalidation_notifications && !enable_data_providers) {
     return;
   }
@@ -1603,6 +2662,21 @@ void PhysicalHeap::EnableAccessCallbacks(uint32_t physical_address,
                             : xe::memory::PageAccess::kReadOnly;
   uint8_t* protect_base = membase_ + heap_base_;
   uint32_t protect_system_page_first = UINT32_MAX;
+  // Data providers need reads to fault as well.
+  xe::memory::WriteWatchHandle write_watch =
+      enable_data_providers ? nullptr : memory_->physical_memory_write_watch_;
+  auto protect_system_pages = [&](uint32_t first, uint32_t count) {
+    uint8_t* address = protect_base + first * system_page_size_;
+    size_t length = size_t(count) * system_page_size_;
+    if (write_watch &&
+        xe::memory::ResetWriteWatch(write_watch, address, length)) {
+      for (uint32_t i = first; i < first + count; ++i) {
+        system_page_flags_[i >> 6].write_watched |= uint64_t(1) << (i & 63);
+      }
+      return;
+    }
+    xe::memory::Protect(address, length, protect_access);
+  };
   auto global_lock = global_critical_region_.Acquire();
   for (uint32_t i = system_page_first; i <= system_page_last; ++i) {
     // Check if need to enable callbacks for the page and raise its protection.
@@ -1638,14 +2712,20 @@ void PhysicalHeap::EnableAccessCallbacks(uint32_t physical_address,
     // enable invalidation notifications for read-only pages for the same
     // reason.
     if (current_page_access != xe::memory::PageAccess::kNoAccess) {
-      // TODO(Triang3l): Enable data providers.
+      if (enable_data_providers) {
+        if ((page_flags_block.provide_data & page_flags_bit) == 0) {
+          protect_system_page = true;
+          page_flags_block.provide_data |= page_flags_bit;
+        }
+      }
       if (enable_invalidation_notifications) {
         if (current_page_access != xe::memory::PageAccess::kReadOnly &&
             (page_flags_block.notify_on_invalidation & page_flags_bit) == 0) {
-          // TODO(Triang3l): Check if data providers are already enabled.
           // If data providers are already enabled for the page, it has even
           // stricter protection.
-          protect_system_page = true;
+          if ((page_flags_block.provide_data & page_flags_bit) == 0) {
+            protect_system_page = true;
+          }
           page_flags_block.notify_on_invalidation |= page_flags_bit;
         }
       }
@@ -1656,19 +2736,15 @@ void PhysicalHeap::EnableAccessCallbacks(uint32_t physical_address,
       }
     } else {
       if (protect_system_page_first != UINT32_MAX) {
-        xe::memory::Protect(
-            protect_base + protect_system_page_first * system_page_size_,
-            (i - protect_system_page_first) * system_page_size_,
-            protect_access);
+        protect_system_pages(protect_system_page_first,
+                             i - protect_system_page_first);
         protect_system_page_first = UINT32_MAX;
       }
     }
   }
   if (protect_system_page_first != UINT32_MAX) {
-    xe::memory::Protect(
-        protect_base + protect_system_page_first * system_page_size_,
-        (system_page_last + 1 - protect_system_page_first) * system_page_size_,
-        protect_access);
+    protect_system_pages(protect_system_page_first,
+                         system_page_last + 1 - protect_system_page_first);
   }
 }
 
@@ -1676,12 +2752,39 @@ bool PhysicalHeap::TriggerCallbacks(
     std::unique_lock<std::recursive_mutex> global_lock_locked_once,
     uint32_t virtual_address, uint32_t length, bool is_write,
     bool unwatch_exact_range, bool unprotect) {
-  // TODO(Triang3l): Support read watches.
-  assert_true(is_write);
-  if (!is_write) {
-    return false;
+  return TriggerCallbacksLocked(virtual_address, length, is_write,
+                                unwatch_exact_range, unprotect);
+}
+
+void PhysicalHeap::TriggerCallbacks(
+    std::unique_lock<std::recursive_mutex> global_lock_locked_once,
+    std::vector<std::pair<uint32_t, uint32_t>>& virtual_ranges) {
+  // Merge overlapping and adjacent ranges, so the callbacks are called once
+  // for every contiguous written region rather than for every page run.
+  std::sort(virtual_ranges.begin(), virtual_ranges.end());
+  size_t merged_count = 0;
+  for (const auto& range : virtual_ranges) {
+    if (merged_count) {
+      auto& last = virtual_ranges[merged_count - 1];
+      if (range.first <= last.first + last.second) {
+        last.second = std::max(last.first + last.second,
+                               range.first + range.second) -
+                      last.first;
+        continue;
+      }
+    }
+    virtual_ranges[merged_count++] = range;
+  }
+  virtual_ranges.resize(merged_count);
+  for (const auto& range : virtual_ranges) {
+    TriggerCallbacksLocked(range.first, range.second, true, true, false);
   }
+}
 
+bool PhysicalHeap::TriggerCallbacksLocked(uint32_t virtual_address,
+                                          uint32_t length, bool is_write,
+                                          bool unwatch_exact_range,
+                                          bool unprotect) {
   if (virtual_address < heap_base_) {
     if (heap_base_ - virtual_address >= length) {
       return false;
@@ -1698,6 +2801,12 @@ bool PhysicalHeap::TriggerCallbacks(
     return false;
   }
 
+  MemoryHeatmap* heatmap = memory_->heatmap();
+  if (heatmap && is_write) {
+    heatmap->Add(MemoryHeatmap::Counter::kCpuWrite,
+                 GetPhysicalAddress(virtual_address), length);
+  }
+
   uint32_t system_page_first =
       (heap_relative_address + host_address_offset()) / system_page_size_;
   uint32_t system_page_last =
@@ -1705,6 +2814,15 @@ bool PhysicalHeap::TriggerCallbacks(
       system_page_size_;
   system_page_last = std::min(system_page_last, system_page_count_ - 1);
   assert_true(system_page_first <= system_page_last);
+
+  // Give the pages their latest data before the guest accesses them or the
+  // data in them is invalidated.
+  bool data_provided =
+      TriggerDataProvidersLocked(system_page_first, system_page_last, false);
+  if (!is_write) {
+    return data_provided;
+  }
+
   uint32_t block_index_first = system_page_first >> 6;
   uint32_t block_index_last = system_page_last >> 6;
 
@@ -1743,6 +2861,10 @@ bool PhysicalHeap::TriggerCallbacks(
                   host_address_offset()) +
           physical_address_offset - physical_address_start,
       heap_size_ - (physical_address_start - physical_address_offset));
+  if (heatmap) {
+    heatmap->Add(MemoryHeatmap::Counter::kInvalidation, physical_address_start,
+                 physical_length);
+  }
   uint32_t unwatch_first = 0;
   uint32_t unwatch_last = UINT32_MAX;
   for (auto invalidation_callback :
@@ -1794,9 +2916,15 @@ bool PhysicalHeap::TriggerCallbacks(
     uint8_t* protect_base = membase_ + heap_base_;
     uint32_t unprotect_system_page_first = UINT32_MAX;
     for (uint32_t i = system_page_first; i <= system_page_last; ++i) {
-      // Check if need to allow writing to this page.
-      bool unprotect_page = (system_page_flags_[i >> 6].notify_on_invalidation &
-                             (uint64_t(1) << (i & 63))) != 0;
+      // Check if need to allow writing to this page. Pages watched with the
+      // OS write watch are writable already, and pages with data providers
+      // must stay inaccessible until the data is provided.
+      const SystemPageFlagsBlock& page_flags_block = system_page_flags_[i >> 6];
+      uint64_t page_flags_bit = uint64_t(1) << (i & 63);
+      bool unprotect_page =
+          (page_flags_block.notify_on_invalidation &
+           ~page_flags_block.write_watched & ~page_flags_block.provide_data &
+           page_flags_bit) != 0;
       if (unprotect_page) {
         uint32_t guest_page_number =
             xe::sat_sub(i * system_page_size_, host_address_offset()) /
@@ -1839,11 +2967,222 @@ bool PhysicalHeap::TriggerCallbacks(
       mask |= ~((uint64_t(1) << ((system_page_last & 63) + 1)) - 1);
     }
     system_page_flags_[i].notify_on_invalidation &= mask;
+    system_page_flags_[i].write_watched &= mask;
   }
 
   return true;
 }
 
+bool PhysicalHeap::GetSystemPageRange(uint32_t virtual_address,
+                                      uint32_t length,
+                                      uint32_t& system_page_first,
+                                      uint32_t& system_page_last) const {
+  if (virtual_address < heap_base_) {
+    if (heap_base_ - virtual_address >= length) {
+      return false;
+    }
+    length -= heap_base_ - virtual_address;
+    virtual_address = heap_base_;
+  }
+  uint32_t heap_relative_address = virtual_address - heap_base_;
+  if (heap_relative_address >= heap_size_) {
+    return false;
+  }
+  length = std::min(length, heap_size_ - heap_relative_address);
+  if (length == 0) {
+    return false;
+  }
+  system_page_first =
+      (heap_relative_address + host_address_offset()) / system_page_size_;
+  system_page_last =
+      (heap_relative_address + length - 1 + host_address_offset()) /
+      system_page_size_;
+  system_page_last = std::min(system_page_last, system_page_count_ - 1);
+  return system_page_first <= system_page_last;
+}
+
+void PhysicalHeap::TriggerDataProviders(uint32_t physical_address,
+                                        uint32_t length) {
+  uint32_t physical_address_offset = GetPhysicalAddress(heap_base_);
+  if (physical_address < physical_address_offset) {
+    if (physical_address_offset - physical_address >= length) {
+      return;
+    }
+    length -= physical_address_offset - physical_address;
+    physical_address = physical_address_offset;
+  }
+  uint32_t heap_relative_address = physical_address - physical_address_offset;
+  if (heap_relative_address >= heap_size_) {
+    return;
+  }
+  uint32_t system_page_first, system_page_last;
+  auto global_lock = global_critical_region_.Acquire();
+  if (GetSystemPageRange(heap_base_ + heap_relative_address,
+                         std::min(length, heap_size_ - heap_relative_address),
+                         system_page_first, system_page_last)) {
+    TriggerDataProvidersLocked(system_page_first, system_page_last, false);
+  }
+}
+
+bool PhysicalHeap::TriggerDataProvidersLocked(uint32_t system_page_first,
+                                              uint32_t system_page_last,
+                                              bool discard) {
+  uint32_t block_index_first = system_page_first >> 6;
+  uint32_t block_index_last = system_page_last >> 6;
+
+  // Quickly check if any page has data providers - this is done for every
+  // access violation.
+  bool any_provided = false;
+  for (uint32_t i = block_index_first; i <= block_index_last; ++i) {
+    uint64_t block = system_page_flags_[i].provide_data;
+    if (i == block_index_first) {
+      block &= ~((uint64_t(1) << (system_page_first & 63)) - 1);
+    }
+    if (i == block_index_last && (system_page_last & 63) != 63) {
+      block &= (uint64_t(1) << ((system_page_last & 63) + 1)) - 1;
+    }
+    if (block) {
+      any_provided = true;
+      break;
+    }
+  }
+  if (!any_provided) {
+    return false;
+  }
+
+  uint32_t physical_address_offset = GetPhysicalAddress(heap_base_);
+  uint8_t* protect_base = membase_ + heap_base_;
+  auto provide_system_pages = [&](uint32_t first, uint32_t count) {
+    uint32_t physical_address_start =
+        xe::sat_sub(first * system_page_size_, host_address_offset()) +
+        physical_address_offset;
+    uint32_t physical_length = std::min(
+        xe::sat_sub((first + count) * system_page_size_,
+                    host_address_offset()) +
+            physical_address_offset - physical_address_start,
+        heap_size_ - (physical_address_start - physical_address_offset));
+    for (auto data_provider_callback :
+         memory_->physical_memory_data_provider_callbacks_) {
+      data_provider_callback->first(data_provider_callback->second,
+                                    physical_address_start, physical_length,
+                                    discard);
+    }
+    for (uint32_t i = first; i < first + count; ++i) {
+      SystemPageFlagsBlock& page_flags_block = system_page_flags_[i >> 6];
+      uint64_t page_flags_bit = uint64_t(1) << (i & 63);
+      page_flags_block.provide_data &= ~page_flags_bit;
+      if (discard) {
+        continue;
+      }
+      // Restore the protection requested by the guest, but keep watching for
+      // writes if invalidation notifications are enabled for the page.
+      uint32_t guest_page_number =
+          xe::sat_sub(i * system_page_size_, host_address_offset()) /
+          page_size_;
+      xe::memory::PageAccess page_access =
+          ToPageAccess(page_table_[guest_page_number].current_protect);
+      if (page_access == xe::memory::PageAccess::kReadWrite &&
+          (page_flags_block.notify_on_invalidation &
+           ~page_flags_block.write_watched & page_flags_bit)) {
+        page_access = xe::memory::PageAccess::kReadOnly;
+      }
+      xe::memory::Protect(protect_base + i * system_page_size_,
+                          system_page_size_, page_access);
+    }
+  };
+  uint32_t provide_system_page_first = UINT32_MAX;
+  for (uint32_t i = system_page_first; i <= system_page_last; ++i) {
+    if (system_page_flags_[i >> 6].provide_data & (uint64_t(1) << (i & 63))) {
+      if (provide_system_page_first == UINT32_MAX) {
+        provide_system_page_first = i;
+      }
+    } else {
+      if (provide_system_page_first != UINT32_MAX) {
+        provide_system_pages(provide_system_page_first,
+                             i - provide_system_page_first);
+        provide_system_page_first = UINT32_MAX;
+      }
+    }
+  }
+  if (provide_system_page_first != UINT32_MAX) {
+    provide_system_pages(provide_system_page_first,
+                         system_page_last + 1 - provide_system_page_first);
+  }
+  return true;
+}
+
+void PhysicalHeap::PollWriteWatches() {
+  xe::memory::WriteWatchHandle write_watch =
+      memory_->physical_memory_write_watch_;
+  if (!write_watch) {
+    return;
+  }
+
+  // Gather the runs of watched pages, but don't hold the lock while asking the
+  // OS about them. Pages unwatched meanwhile may be reported spuriously, and
+  // pages watched meanwhile will be checked during the next poll.
+  std::vector<std::pair<uint32_t, uint32_t>> watched_runs;
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    uint32_t run_first = UINT32_MAX;
+    for (uint32_t i = 0; i < system_page_count_; ++i) {
+      bool watched = (system_page_flags_[i >> 6].write_watched &
+                      (uint64_t(1) << (i & 63))) != 0;
+      if (watched) {
+        if (run_first == UINT32_MAX) {
+          run_first = i;
+        }
+      } else {
+        if (run_first != UINT32_MAX) {
+          watched_runs.emplace_back(run_first, i - run_first);
+          run_first = UINT32_MAX;
+        }
+        // Skip blocks without watched pages quickly.
+        if (!(i & 63) && !system_page_flags_[i >> 6].write_watched) {
+          i |= 63;
+        }
+      }
+    }
+    if (run_first != UINT32_MAX) {
+      watched_runs.emplace_back(run_first, system_page_count_ - run_first);
+    }
+  }
+  if (watched_runs.empty()) {
+    return;
+  }
+
+  uint8_t* watch_base = membase_ + heap_base_;
+  std::vector<std::pair<void*, size_t>> written_ranges;
+  for (auto run : watched_runs) {
+    uint8_t* run_address = watch_base + run.first * system_page_size_;
+    size_t run_length = size_t(run.second) * system_page_size_;
+    if (!xe::memory::GetAndResetWriteWatch(write_watch, run_address,
+                                           run_length, written_ranges)) {
+      // The pages are not tracked anymore (remapped, for instance), so they
+      // may have been written to.
+      written_ranges.emplace_back(run_address, run_length);
+    }
+  }
+
+  std::vector<std::pair<uint32_t, uint32_t>> virtual_ranges;
+  virtual_ranges.reserve(written_ranges.size());
+  for (auto range : written_ranges) {
+    uint32_t host_offset =
+        uint32_t(static_cast<uint8_t*>(range.first) - watch_base);
+    uint32_t start = xe::sat_sub(host_offset, host_address_offset());
+    uint32_t end = std::min(
+        xe::sat_sub(host_offset + uint32_t(range.second),
+                    host_address_offset()),
+        heap_size_);
+    if (start < end) {
+      virtual_ranges.emplace_back(heap_base_ + start, end - start);
+    }
+  }
+  if (!virtual_ranges.empty()) {
+    TriggerCallbacks(global_critical_region_.Acquire(), virtual_ranges);
+  }
+}
+
 uint32_t PhysicalHeap::GetPhysicalAddress(uint32_t address) const {
   assert_true(address >= heap_base_);
   address -= heap_base_;
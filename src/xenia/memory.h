@@ -10,6 +10,7 @@
 #ifndef XENIA_MEMORY_H_
 #define XENIA_MEMORY_H_
 
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <mutex>
@@ -23,6 +24,8 @@
 
 namespace xe {
 class ByteStream;
+class MappedMemory;
+class MemoryHeatmap;
 }  // namespace xe
 
 namespace xe {
@@ -98,6 +101,26 @@ union PageEntry {
   uint64_t qword;
 };
 
+// Memory state captured for an incremental save state checkpoint: the page
+// tables of all heaps, but only the contents of the committed pages that have
+// changed since the previous checkpoint. Capturing only copies the pages, so
+// the emulator needs to be paused only for that; compression with snappy and
+// writing happens in Write, which may be called from any thread afterwards.
+struct MemoryCheckpoint {
+  struct Heap {
+    uint32_t page_size;
+    std::vector<uint64_t> page_table;
+    // (first page, page count) runs of changed pages, with their contents
+    // stored consecutively in data.
+    std::vector<std::pair<uint32_t, uint32_t>> page_runs;
+    std::vector<uint8_t> data;
+  };
+  Heap heaps[5];
+  std::vector<uint32_t> system_heap_pools;
+
+  void Write(ByteStream* stream) const;
+};
+
 // Heap abstraction for page-based allocation.
 class BaseHeap {
  public:
@@ -169,7 +192,9 @@ class BaseHeap {
   virtual bool Protect(uint32_t address, uint32_t size, uint32_t protect,
                        uint32_t* old_protect = nullptr);
 
-  // Queries information about the given region of pages.
+  // Queries information about the given region of pages. Like the other
+  // queries, doesn't take the global lock, so it doesn't wait for guest threads
+  // allocating or protecting memory.
   bool QueryRegionInfo(uint32_t base_address, HeapAllocationInfo* out_info);
 
   // Queries the size of the region containing the given address.
@@ -190,6 +215,30 @@ class BaseHeap {
   bool Save(ByteStream* stream);
   bool Restore(ByteStream* stream);
 
+  // Captures the page table and the committed pages whose contents differ
+  // from when they were last captured.
+  void CaptureCheckpoint(MemoryCheckpoint::Heap* checkpoint);
+  // Applies a heap checkpoint written by MemoryCheckpoint::Write.
+  bool RestoreCheckpoint(ByteStream* stream);
+  // Makes the next checkpoint capture every committed page.
+  void ResetCheckpoint();
+
+  // Streaming save states, in which the committed pages are stored
+  // uncompressed and aligned to the page size, so they can be used in place
+  // from a mapped file.
+  bool SaveStreaming(ByteStream* stream);
+  // If lazy_view is not null, the committed pages are left inaccessible until
+  // they're accessed for the first time or restored by RestoreLazyPages,
+  // through lazy_view, a writable view of the memory of the heap. The stream
+  // data must stay valid until all the pages have been restored.
+  bool RestoreStreaming(ByteStream* stream, uint8_t* lazy_view);
+  // Restores the page containing the address if it's waiting to be restored
+  // lazily, returns whether it was.
+  bool RestoreLazyPage(uint32_t address);
+  // Restores up to page_count of the pages waiting to be restored lazily,
+  // returns how many remain.
+  uint32_t RestoreLazyPages(uint32_t page_count);
+
   void Reset();
 
  protected:
@@ -199,6 +248,31 @@ class BaseHeap {
                   uint32_t heap_base, uint32_t heap_size, uint32_t page_size,
                   uint32_t host_address_offset = 0);
 
+  // Rebuilds the unreserved page index from the page table.
+  void ResetUnreservedPageIndex();
+  // Updates the unreserved page index for pages [first, last] after their
+  // reservation state has been changed.
+  void SetPagesReserved(uint32_t first, uint32_t last, bool reserved);
+  void UpdateUnreservedBlockSummary(uint32_t block);
+  // Returns the first or the last page within [first, last] that is
+  // unreserved (or reserved if unreserved is false), or UINT32_MAX if there
+  // are none.
+  uint32_t FindPage(uint32_t first, uint32_t last, bool unreserved) const;
+  uint32_t FindPageReverse(uint32_t first, uint32_t last,
+                           bool unreserved) const;
+  // The page table is modified only with the global lock held, between
+  // BeginPageTableWrite and EndPageTableWrite, so the queries can read it
+  // without locking through ReadPageTable. read is called again if the page
+  // table was modified meanwhile, and must only copy out of it.
+  void BeginPageTableWrite();
+  void EndPageTableWrite();
+  template <typename F>
+  void ReadPageTable(F&& read) const;
+  // Restores the pages within [first, last] waiting to be restored lazily,
+  // before their host protection is changed.
+  void RestoreLazyPages(uint32_t first, uint32_t last);
+  bool RestoreLazyPageNumber(uint32_t page_number);
+
   Memory* memory_;
   uint8_t* membase_;
   HeapType heap_type_;
@@ -208,6 +282,27 @@ class BaseHeap {
   uint32_t host_address_offset_;
   xe::global_critical_region global_critical_region_;
   std::vector<PageEntry> page_table_;
+  // Index of the unreserved pages kept in sync with the page table, so free
+  // ranges can be found without walking it. One bit per page set if it's
+  // unreserved, plus a summary bit per 64 pages for whether any or all of
+  // them are unreserved, so long runs of reserved or unreserved pages are
+  // skipped 4096 pages at a time.
+  std::vector<uint64_t> unreserved_page_bits_;
+  std::vector<uint64_t> unreserved_block_any_bits_;
+  std::vector<uint64_t> unreserved_block_all_bits_;
+  // Hashes of the contents of every page as of the last checkpoint, zero if
+  // the page wasn't captured (or needs to be captured again).
+  std::vector<uint64_t> checkpoint_page_hashes_;
+  // Index of the contents of every page waiting to be restored lazily in
+  // lazy_restore_data_, or UINT32_MAX if it has been restored already.
+  std::vector<uint32_t> lazy_restore_indices_;
+  const uint8_t* lazy_restore_data_;
+  uint8_t* lazy_restore_view_;
+  uint32_t lazy_restore_page_count_;
+  uint32_t lazy_restore_next_page_;
+  // Sequence number of the page table modifications, odd while one is in
+  // progress.
+  std::atomic<uint32_t> page_table_sequence_;
 };
 
 // Normal heap allowing allocations from guest virtual address ranges.
@@ -255,15 +350,44 @@ class PhysicalHeap : public BaseHeap {
   void EnableAccessCallbacks(uint32_t physical_address, uint32_t length,
                              bool enable_invalidation_notifications,
                              bool enable_data_providers);
+  // Triggers data providers for the pages in the physical address range that
+  // have them enabled, restoring the protection of the pages.
+  void TriggerDataProviders(uint32_t physical_address, uint32_t length);
   // Returns true if any page in the range was watched.
   bool TriggerCallbacks(
       std::unique_lock<std::recursive_mutex> global_lock_locked_once,
       uint32_t virtual_address, uint32_t length, bool is_write,
       bool unwatch_exact_range, bool unprotect = true);
+  // Triggers callbacks for written virtual address (start, length) ranges,
+  // unwatching exactly them without changing the protection. The ranges are
+  // sorted and coalesced in place first, so every callback is called once per
+  // contiguous region.
+  void TriggerCallbacks(
+      std::unique_lock<std::recursive_mutex> global_lock_locked_once,
+      std::vector<std::pair<uint32_t, uint32_t>>& virtual_ranges);
+  // Triggers callbacks for pages watched with the OS write watch that have
+  // been written to. Must be called without the global critical region
+  // locked.
+  void PollWriteWatches();
 
   uint32_t GetPhysicalAddress(uint32_t address) const;
 
  protected:
+  bool TriggerCallbacksLocked(uint32_t virtual_address, uint32_t length,
+                              bool is_write, bool unwatch_exact_range,
+                              bool unprotect);
+  // Converts a virtual address range to the range of system pages, returning
+  // false if it's outside the heap.
+  bool GetSystemPageRange(uint32_t virtual_address, uint32_t length,
+                          uint32_t& system_page_first,
+                          uint32_t& system_page_last) const;
+  // Calls data providers for the pages in the system page range that have
+  // them enabled and disables them. If discarding, the data is not needed
+  // anymore (such as when the memory is being released), and the protection
+  // of the pages is not touched. Returns whether any page had data providers.
+  bool TriggerDataProvidersLocked(uint32_t system_page_first,
+                                  uint32_t system_page_last, bool discard);
+
   VirtualHeap* parent_heap_;
 
   uint32_t system_page_size_;
@@ -273,6 +397,12 @@ class PhysicalHeap : public BaseHeap {
     // Whether writing to each page should result trigger invalidation
     // callbacks.
     uint64_t notify_on_invalidation;
+    // Whether writes to each page with invalidation notifications are
+    // detected by the OS write watch rather than by protecting the page.
+    uint64_t write_watched;
+    // Whether any access to each page should result in data providers being
+    // called - such pages are protected from both reading and writing.
+    uint64_t provide_data;
   };
   // Protected by global_critical_region. Flags for each 64 system pages,
   // interleaved as blocks, so bit scan can be used to quickly extract ranges.
@@ -371,6 +501,19 @@ class Memory {
   // Gets the defined MMIO range for the given virtual address, if any.
   cpu::MMIORange* LookupVirtualMappedRange(uint32_t virtual_address);
 
+  // The handler servicing the MMIO ranges.
+  cpu::MMIOHandler* mmio_handler() const { return mmio_handler_.get(); }
+
+  // Access counters of the guest physical memory if enabled with
+  // --memory_heatmap, or null.
+  MemoryHeatmap* heatmap() const { return heatmap_.get(); }
+
+  // Number of access violations handled by triggering the code modification
+  // watches or the physical memory access callbacks.
+  uint64_t watch_access_violation_count() const {
+    return watch_access_violation_count_.load(std::memory_order_relaxed);
+  }
+
   // Physical memory access callbacks, two types of them.
   //
   // This is simple per-system-page protection without reference counting or
@@ -415,8 +558,17 @@ class Memory {
   //
   // - Data providers:
   //
-  // TODO(Triang3l): Implement data providers - more complicated because they
-  // will need to be able to release the global lock.
+  // Protecting from any access. One-shot callbacks for pages whose latest data
+  // is not in the guest memory yet, but can be obtained on demand (such as
+  // data written by the GPU that is being read back asynchronously). Invoked
+  // before the page is read or written by the guest, or before invalidation
+  // notifications are triggered for it, and when the protection or the
+  // allocation of the page is changed (with discarding requested when the data
+  // is not needed anymore).
+  //
+  // Data providers are called with the global critical region locked, so they
+  // must not wait for anything that may require it (though waiting for the GPU
+  // finishing work that has already been submitted is fine).
 
   // Returns start and length of the smallest physical memory region surrounding
   // the watched region that can be safely unwatched, if it doesn't matter,
@@ -432,6 +584,19 @@ class Memory {
   // RegisterPhysicalMemoryInvalidationCallback.
   void UnregisterPhysicalMemoryInvalidationCallback(void* callback_handle);
 
+  // Must write the latest data for the physical memory range (or only forget
+  // about the pending data if discard is true) to the host physical memory
+  // directly, not through the guest virtual memory views.
+  typedef void (*PhysicalMemoryDataProviderCallback)(
+      void* context_ptr, uint32_t physical_address_start, uint32_t length,
+      bool discard);
+  // Returns a handle for unregistering.
+  void* RegisterPhysicalMemoryDataProviderCallback(
+      PhysicalMemoryDataProviderCallback callback, void* callback_context);
+  // Unregisters a physical memory data provider callback previously added with
+  // RegisterPhysicalMemoryDataProviderCallback.
+  void UnregisterPhysicalMemoryDataProviderCallback(void* callback_handle);
+
   // Enables physical memory access callbacks for the specified memory range,
   // snapped to system page boundaries.
   void EnablePhysicalMemoryAccessCallbacks(
@@ -448,10 +613,45 @@ class Memory {
       uint32_t virtual_address, uint32_t length, bool is_write,
       bool unwatch_exact_range, bool unprotect = true);
 
+  // Forces triggering of data providers for a physical address range in all
+  // guest views of physical memory, so the latest data is placed in the guest
+  // memory and the pages are accessible again without access violations. Must
+  // not be called from a data provider callback.
+  void TriggerPhysicalMemoryDataProviders(uint32_t physical_address,
+                                          uint32_t length);
+
+  // With --physical_memory_write_watch, invalidation notifications for writes
+  // by the guest are not triggered by access violations, but by this, which
+  // must be called before using the data. Must be called without the global
+  // critical region locked.
+  void PollPhysicalMemoryWriteWatches();
+
+  // Guest code write watches.
+  //
+  // Host pages of the XEX heaps that guest code has been compiled from are
+  // protected from writing like pages with physical memory invalidation
+  // notifications, and the first write to such a page (by the guest, or by the
+  // host, like when a file is read into it) unwatches it and calls the code
+  // modification callback, which must invalidate all code compiled from the
+  // page. Releasing or decommitting memory triggers the callback too. Pages the
+  // guest can't write to aren't watched.
+
+  typedef void (*CodeModificationCallback)(void* context_ptr,
+                                           uint32_t virtual_address,
+                                           uint32_t length);
+  void SetCodeModificationCallback(CodeModificationCallback callback,
+                                   void* callback_context);
+
+  // Watches the host pages containing the virtual address range for writes, if
+  // it's in a XEX heap.
+  void WatchCodeRange(uint32_t virtual_address, uint32_t length);
+
   // Allocates virtual memory from the 'system' heap.
   // System memory is kept separate from game memory but is still accessible
   // using normal guest virtual addresses. Kernel structures and other internal
   // 'system' allocations should come from this heap when possible.
+  // Small allocations are made from pools of fixed size blocks rather than
+  // taking whole pages.
   uint32_t SystemHeapAlloc(uint32_t size, uint32_t alignment = 0x20,
                            uint32_t system_heap_flags = kSystemHeapDefault);
 
@@ -478,9 +678,40 @@ class Memory {
   bool Save(ByteStream* stream);
   bool Restore(ByteStream* stream);
 
+  // Incremental save states. The first checkpoint after ResetCheckpoints
+  // contains all of the memory, and each following one only what has been
+  // modified since the previous one, detected by comparing page hashes, so a
+  // state is restored by applying the whole chain of checkpoints in order.
+  // Must be called while the emulator is paused.
+  void CaptureCheckpoint(MemoryCheckpoint* checkpoint);
+  bool RestoreCheckpoint(ByteStream* stream);
+  void ResetCheckpoints();
+
+  // Streaming save states, which can be restored straight from a mapped file.
+  // Where possible, the virtual memory heaps are restored lazily, each page
+  // when it's accessed for the first time, so the title can be resumed without
+  // copying all the memory, and the file is kept mapped until RestoreLazyPages
+  // reports that no pages remain.
+  bool SaveStreaming(ByteStream* stream);
+  bool RestoreStreaming(std::unique_ptr<MappedMemory> map, size_t offset);
+  // Restores up to page_count pages waiting to be restored lazily, returns
+  // whether any pages remain.
+  bool RestoreLazyPages(uint32_t page_count);
+
  private:
   int MapViews(uint8_t* mapping_base);
   void UnmapViews();
+  bool AdvisePhysicalLargePages();
+  void EndLazyRestore();
+
+  uint32_t SystemHeapPoolAlloc(bool is_physical, uint32_t block_size_log2);
+  // The pools are saved with the memory, as the guest memory contains the
+  // blocks allocated from them.
+  void SaveSystemHeapPools(std::vector<uint32_t>& data);
+  bool RestoreSystemHeapPools(const uint32_t* data, size_t count);
+  void SaveSystemHeapPools(ByteStream* stream);
+  bool RestoreSystemHeapPools(ByteStream* stream);
+  void ResetSystemHeapPools();
 
   static uint32_t HostToGuestVirtualThunk(const void* context,
                                           const void* host_address);
@@ -492,6 +723,21 @@ class Memory {
       std::unique_lock<std::recursive_mutex> global_lock_locked_once,
       void* context, void* host_address, bool is_write);
 
+  // Guest code pages are only in the XEX heaps.
+  static constexpr uint32_t kCodeWatchBase = 0x80000000;
+  static constexpr uint32_t kCodeWatchSize = 0x20000000;
+  // Returns the host pages in the XEX heaps the range touches, if any.
+  bool GetCodeWatchPageRange(uint32_t virtual_address, uint32_t length,
+                             uint32_t* page_first, uint32_t* page_last) const;
+  // Unwatches watched pages in the range, calling the code modification
+  // callback for them. Must be called with the global critical region locked.
+  // Returns whether any page was watched.
+  bool TriggerCodeWatches(uint32_t virtual_address, uint32_t length,
+                          bool restore_protection);
+  // Protects watched pages in the range again after their protection has been
+  // changed by the guest.
+  void ReapplyCodeWatches(uint32_t virtual_address, uint32_t length);
+
   std::filesystem::path file_name_;
   uint32_t system_page_size_ = 0;
   uint32_t system_allocation_granularity_ = 0;
@@ -516,6 +762,8 @@ class Memory {
   } views_ = {{0}};
 
   std::unique_ptr<cpu::MMIOHandler> mmio_handler_;
+  std::unique_ptr<MemoryHeatmap> heatmap_;
+  std::atomic<uint64_t> watch_access_violation_count_{0};
 
   struct {
     VirtualHeap v00000000;
@@ -535,6 +783,43 @@ class Memory {
   xe::global_critical_region global_critical_region_;
   std::vector<std::pair<PhysicalMemoryInvalidationCallback, void*>*>
       physical_memory_invalidation_callbacks_;
+  std::vector<std::pair<PhysicalMemoryDataProviderCallback, void*>*>
+      physical_memory_data_provider_callbacks_;
+  // Used by the physical heaps instead of page protection for invalidation
+  // notifications if enabled and supported by the OS.
+  xe::memory::WriteWatchHandle physical_memory_write_watch_ = nullptr;
+
+  CodeModificationCallback code_modification_callback_ = nullptr;
+  void* code_modification_callback_context_ = nullptr;
+  // One bit per host page in the XEX heaps, set for pages protected to watch
+  // for code modification.
+  std::vector<uint64_t> code_watch_bits_;
+
+  // System heap blocks of up to 2 KB are allocated from 64 KB slabs, each
+  // holding blocks of a single power of two size.
+  static constexpr uint32_t kSystemHeapSlabSizeLog2 = 16;
+  static constexpr uint32_t kSystemHeapMinBlockSizeLog2 = 4;
+  static constexpr uint32_t kSystemHeapMaxBlockSizeLog2 = 11;
+  static constexpr uint32_t kSystemHeapPoolCount =
+      kSystemHeapMaxBlockSizeLog2 - kSystemHeapMinBlockSizeLog2 + 1;
+  static constexpr uint8_t kSystemHeapSlabPhysical = 0x80;
+  struct SystemHeapPool {
+    // Locked instead of the global critical region, so allocations only
+    // contend with those of the same size from the same heap.
+    std::mutex mutex;
+    std::vector<uint32_t> free_blocks;
+  };
+  // Virtual and physical pools.
+  SystemHeapPool system_heap_pools_[2][kSystemHeapPoolCount];
+  // Block size log2 of the slab in every 64 KB of the address space, ORed
+  // with kSystemHeapSlabPhysical for physical memory, or 0 if not a slab.
+  std::vector<uint8_t> system_heap_slabs_;
+
+  // Streaming save state the virtual memory heaps are being restored from
+  // lazily, and the writable view of their memory the pages are restored
+  // through while they're still inaccessible in the guest views.
+  std::unique_ptr<MappedMemory> lazy_restore_map_;
+  uint8_t* lazy_restore_view_ = nullptr;
 };
 
 }  // namespace xe
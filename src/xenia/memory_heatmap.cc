@@ -0,0 +1,90 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/memory_heatmap.h"
+
+#include <algorithm>
+#include <string>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+
+namespace xe {
+
+MemoryHeatmap::MemoryHeatmap(const std::filesystem::path& directory,
+                             uint32_t window_frames)
+    : directory_(directory),
+      window_frames_(std::max(window_frames, uint32_t(1))),
+      counts_(new std::atomic<uint32_t>[kRegionCount *
+                                        size_t(Counter::kCount)]) {
+  for (size_t i = 0; i < kRegionCount * size_t(Counter::kCount); ++i) {
+    counts_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+void MemoryHeatmap::Add(Counter counter, uint32_t physical_address,
+                        uint32_t length) {
+  physical_address &= 0x1FFFFFFF;
+  length = std::min(std::max(length, uint32_t(1)),
+                    uint32_t(0x20000000) - physical_address);
+  uint32_t region_first = physical_address >> kRegionSizeLog2;
+  uint32_t region_last = (physical_address + length - 1) >> kRegionSizeLog2;
+  for (uint32_t i = region_first; i <= region_last; ++i) {
+    counts_[i * size_t(Counter::kCount) + size_t(counter)].fetch_add(
+        1, std::memory_order_relaxed);
+  }
+}
+
+void MemoryHeatmap::EndFrame() {
+  if (++frame_ < window_frames_) {
+    return;
+  }
+  frame_ = 0;
+  Dump();
+  ++window_index_;
+}
+
+void MemoryHeatmap::Dump() {
+  // Counts are reset even if they can't be written, so every file covers a
+  // single window.
+  std::string csv = fmt::format(
+      "# Frames {}-{}, {} KB regions\n"
+      "address,invalidations,gpu_uploads,cpu_writes\n",
+      window_index_ * window_frames_, (window_index_ + 1) * window_frames_ - 1,
+      (1 << kRegionSizeLog2) >> 10);
+  for (uint32_t i = 0; i < kRegionCount; ++i) {
+    uint32_t counts[size_t(Counter::kCount)];
+    uint32_t any_counts = 0;
+    for (size_t j = 0; j < size_t(Counter::kCount); ++j) {
+      counts[j] = counts_[i * size_t(Counter::kCount) + j].exchange(
+          0, std::memory_order_relaxed);
+      any_counts |= counts[j];
+    }
+    if (any_counts) {
+      csv += fmt::format("{:08X},{},{},{}\n", i << kRegionSizeLog2,
+                         counts[size_t(Counter::kInvalidation)],
+                         counts[size_t(Counter::kGpuUpload)],
+                         counts[size_t(Counter::kCpuWrite)]);
+    }
+  }
+
+  auto path =
+      directory_ / fmt::format("memory_heatmap_{:05}.csv", window_index_);
+  xe::filesystem::CreateParentFolder(path);
+  FILE* file = xe::filesystem::OpenFile(path, "wb");
+  if (!file) {
+    XELOGE("Unable to open memory heatmap file {}", xe::path_to_utf8(path));
+    return;
+  }
+  std::fwrite(csv.data(), 1, csv.size(), file);
+  std::fclose(file);
+}
+
+}  // namespace xe
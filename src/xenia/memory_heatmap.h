@@ -0,0 +1,62 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_MEMORY_HEATMAP_H_
+#define XENIA_MEMORY_HEATMAP_H_
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+
+namespace xe {
+
+// Counts the events making guest physical memory expensive to emulate in
+// every 64 KB region, to help choose cache sizes and watch granularity.
+// The counts are written to a CSV file and reset every few frames.
+class MemoryHeatmap {
+ public:
+  enum class Counter {
+    // Ranges cached by the GPU or elsewhere invalidated by CPU writes.
+    kInvalidation,
+    // Ranges uploaded from guest memory by the GPU.
+    kGpuUpload,
+    // CPU writes reported to the physical heaps: to watched pages, through
+    // OS write tracking, and by the kernel.
+    kCpuWrite,
+    kCount,
+  };
+
+  static constexpr uint32_t kRegionSizeLog2 = 16;
+  static constexpr uint32_t kRegionCount = (512 * 1024 * 1024) >>
+                                           kRegionSizeLog2;
+
+  MemoryHeatmap(const std::filesystem::path& directory,
+                uint32_t window_frames);
+
+  // May be called from any thread.
+  void Add(Counter counter, uint32_t physical_address, uint32_t length);
+
+  // Writes the counts to the next file and resets them at the end of every
+  // window.
+  void EndFrame();
+
+ private:
+  void Dump();
+
+  std::filesystem::path directory_;
+  uint32_t window_frames_;
+  uint32_t frame_ = 0;
+  uint32_t window_index_ = 0;
+  std::unique_ptr<std::atomic<uint32_t>[]> counts_;
+};
+
+}  // namespace xe
+
+#endif  // XENIA_MEMORY_HEATMAP_H_
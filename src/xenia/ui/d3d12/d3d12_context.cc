@@ -9,6 +9,9 @@
 
 #include "xenia/ui/d3d12/d3d12_context.h"
 
+#include <algorithm>
+
+#include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/ui/d3d12/d3d12_immediate_drawer.h"
@@ -16,6 +19,14 @@
 #include "xenia/ui/d3d12/d3d12_util.h"
 #include "xenia/ui/window.h"
 
+DEFINE_int32(
+    d3d12_swap_chain_max_frame_latency, 2,
+    "Maximum number of frames queued in the swap chain for presentation - "
+    "composition of a new frame waits until the swap chain can accept it. 1 "
+    "gives the lowest latency, 0 disables the frame latency waitable object "
+    "and lets up to 3 frames be queued.",
+    "D3D12");
+
 namespace xe {
 namespace ui {
 namespace d3d12 {
@@ -68,7 +79,13 @@ bool D3D12Context::Initialize() {
   swap_chain_desc.Scaling = DXGI_SCALING_STRETCH;
   swap_chain_desc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
   swap_chain_desc.AlphaMode = DXGI_ALPHA_MODE_IGNORE;
-  swap_chain_desc.Flags = 0;
+  uint32_t max_frame_latency = uint32_t(
+      std::min(cvars::d3d12_swap_chain_max_frame_latency,
+               int32_t(DXGI_MAX_SWAP_CHAIN_BUFFERS)));
+  swap_chain_flags_ = max_frame_latency
+                          ? DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT
+                          : 0;
+  swap_chain_desc.Flags = swap_chain_flags_;
   IDXGISwapChain1* swap_chain_1;
   if (FAILED(dxgi_factory->CreateSwapChainForHwnd(
           provider.GetDirectQueue(),
@@ -85,6 +102,14 @@ bool D3D12Context::Initialize() {
     return false;
   }
   swap_chain_1->Release();
+  if (max_frame_latency) {
+    if (FAILED(swap_chain_->SetMaximumFrameLatency(max_frame_latency))) {
+      XELOGW("Failed to set the maximum frame latency of the swap chain to {}",
+             max_frame_latency);
+    }
+    swap_chain_frame_latency_waitable_object_ =
+        swap_chain_->GetFrameLatencyWaitableObject();
+  }
 
   // Create a heap for RTV descriptors of swap chain buffers.
   D3D12_DESCRIPTOR_HEAP_DESC rtv_heap_desc;
@@ -201,6 +226,11 @@ void D3D12Context::Shutdown() {
 
     util::ReleaseAndNull(swap_chain_rtv_heap_);
 
+    if (swap_chain_frame_latency_waitable_object_) {
+      CloseHandle(swap_chain_frame_latency_waitable_object_);
+      swap_chain_frame_latency_waitable_object_ = nullptr;
+    }
+
     swap_chain_->Release();
     swap_chain_ = nullptr;
   }
@@ -248,7 +278,7 @@ bool D3D12Context::BeginSwap() {
     }
     if (FAILED(swap_chain_->ResizeBuffers(
             kSwapChainBufferCount, target_window_width, target_window_height,
-            kSwapChainFormat, 0))) {
+            kSwapChainFormat, swap_chain_flags_))) {
       context_lost_ = true;
       return false;
     }
@@ -260,6 +290,14 @@ bool D3D12Context::BeginSwap() {
     }
   }
 
+  // Pace the frames - wait until the swap chain can accept a new frame. With a
+  // timeout in case presentation is blocked (such as while the window is
+  // occluded) so the UI doesn't freeze completely.
+  if (swap_chain_frame_latency_waitable_object_) {
+    WaitForSingleObjectEx(swap_chain_frame_latency_waitable_object_, 1000,
+                          TRUE);
+  }
+
   // Wait for a swap command allocator to become free.
   // Command allocator 0 is used when swap_fence_current_value_ is 1, 4, 7...
   swap_fence_completed_value_ = swap_fence_->GetCompletedValue();
@@ -328,6 +366,7 @@ void D3D12Context::EndSwap() {
     context_lost_ = true;
     return;
   }
+  RecordPresent();
 
   // Signal the fence to wait for frame resources to become free again.
   direct_queue->Signal(swap_fence_, swap_fence_current_value_++);
@@ -80,6 +80,11 @@ class D3D12Context : public GraphicsContext {
 
   static constexpr uint32_t kSwapChainBufferCount = 3;
   IDXGISwapChain3* swap_chain_ = nullptr;
+  // DXGI_SWAP_CHAIN_FLAG, must be the same when resizing.
+  UINT swap_chain_flags_ = 0;
+  // Signaled when the swap chain can accept a new frame without exceeding the
+  // maximum frame latency, nullptr if the latency is not limited.
+  HANDLE swap_chain_frame_latency_waitable_object_ = nullptr;
   uint32_t swap_chain_width_ = 0, swap_chain_height_ = 0;
   ID3D12Resource* swap_chain_buffers_[kSwapChainBufferCount] = {};
   uint32_t swap_chain_back_buffer_index_ = 0;
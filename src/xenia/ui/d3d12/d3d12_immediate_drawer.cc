@@ -501,6 +501,7 @@ void D3D12ImmediateDrawer::Begin(int render_target_width,
   current_primitive_topology_ = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
   current_texture_ = nullptr;
   current_sampler_index_ = SamplerIndex::kInvalid;
+  current_restrict_texture_samples_ = UINT32_MAX;
 }
 
 void D3D12ImmediateDrawer::BeginDrawBatch(const ImmediateDrawBatch& batch) {
@@ -654,9 +655,12 @@ void D3D12ImmediateDrawer::Draw(const ImmediateDraw& draw) {
 
   // Set whether texture coordinates need to be restricted.
   uint32_t restrict_texture_samples = draw.restrict_texture_samples ? 1 : 0;
-  current_command_list_->SetGraphicsRoot32BitConstants(
-      UINT(RootParameter::kRestrictTextureSamples), 1,
-      &restrict_texture_samples, 0);
+  if (current_restrict_texture_samples_ != restrict_texture_samples) {
+    current_restrict_texture_samples_ = restrict_texture_samples;
+    current_command_list_->SetGraphicsRoot32BitConstants(
+        UINT(RootParameter::kRestrictTextureSamples), 1,
+        &restrict_texture_samples, 0);
+  }
 
   // Set the primitive type and the pipeline for it.
   D3D_PRIMITIVE_TOPOLOGY primitive_topology;
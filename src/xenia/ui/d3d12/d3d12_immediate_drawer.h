@@ -99,6 +99,7 @@ class D3D12ImmediateDrawer : public ImmediateDrawer {
   D3D_PRIMITIVE_TOPOLOGY current_primitive_topology_;
   ImmediateTexture* current_texture_;
   SamplerIndex current_sampler_index_;
+  uint32_t current_restrict_texture_samples_;
 };
 
 }  // namespace d3d12
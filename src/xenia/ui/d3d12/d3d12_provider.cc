@@ -74,6 +74,9 @@ D3D12Provider::~D3D12Provider() {
   if (device_ != nullptr) {
     device_->Release();
   }
+  if (adapter3_ != nullptr) {
+    adapter3_->Release();
+  }
   if (dxgi_factory_ != nullptr) {
     dxgi_factory_->Release();
   }
@@ -296,6 +299,10 @@ bool D3D12Provider::Initialize() {
     dxgi_factory->Release();
     return false;
   }
+  // Available since Windows 10, for querying the video memory budget.
+  if (FAILED(adapter->QueryInterface(IID_PPV_ARGS(&adapter3_)))) {
+    adapter3_ = nullptr;
+  }
   adapter->Release();
 
   // Configure the Direct3D 12 debug info queue.
@@ -439,6 +446,13 @@ bool D3D12Provider::Initialize() {
   return true;
 }
 
+bool D3D12Provider::QueryLocalVideoMemoryInfo(
+    DXGI_QUERY_VIDEO_MEMORY_INFO& info_out) const {
+  return adapter3_ != nullptr &&
+         SUCCEEDED(adapter3_->QueryVideoMemoryInfo(
+             0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &info_out));
+}
+
 std::unique_ptr<GraphicsContext> D3D12Provider::CreateContext(
     Window* target_window) {
   auto new_context =
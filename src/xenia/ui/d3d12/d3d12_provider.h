@@ -66,6 +66,9 @@ class D3D12Provider : public GraphicsProvider {
 
   // Adapter info.
   uint32_t GetAdapterVendorID() const { return adapter_vendor_id_; }
+  // Gets the current budget and usage of the dedicated video memory (or of all
+  // memory on UMA adapters) for this process. Returns false if not supported.
+  bool QueryLocalVideoMemoryInfo(DXGI_QUERY_VIDEO_MEMORY_INFO& info_out) const;
 
   // Device features.
   D3D12_HEAP_FLAGS GetHeapFlagCreateNotZeroed() const {
@@ -151,6 +154,8 @@ class D3D12Provider : public GraphicsProvider {
   DxcCreateInstanceProc pfn_dxcompiler_dxc_create_instance_ = nullptr;
 
   IDXGIFactory2* dxgi_factory_ = nullptr;
+  // nullptr if the OS doesn't support IDXGIAdapter3.
+  IDXGIAdapter3* adapter3_ = nullptr;
   IDXGraphicsAnalysis* graphics_analysis_ = nullptr;
   ID3D12Device* device_ = nullptr;
   ID3D12CommandQueue* direct_queue_ = nullptr;
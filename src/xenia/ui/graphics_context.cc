@@ -9,9 +9,15 @@
 
 #include "xenia/ui/graphics_context.h"
 
+#include <algorithm>
+#include <cmath>
 #include <cstdlib>
 
+#include "xenia/base/clock.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/input_latency.h"
+#include "xenia/base/profiling.h"
+#include "xenia/base/startup_timeline.h"
 #include "xenia/ui/graphics_provider.h"
 
 DEFINE_bool(random_clear_color, false, "Randomize window clear color.", "UI");
@@ -44,5 +50,57 @@ void GraphicsContext::GetClearColor(float* rgba) {
   rgba[3] = 1.0f;
 }
 
+void GraphicsContext::RecordPresent() {
+  uint64_t host_ticks = Clock::QueryHostTickCount();
+  if (presented_) {
+    double interval_ms = double(host_ticks - last_present_host_ticks_) *
+                         1000.0 / double(Clock::QueryHostTickFrequency());
+    present_intervals_ms_[present_interval_next_] = interval_ms;
+    present_interval_next_ =
+        (present_interval_next_ + 1) % kPresentIntervalHistoryLength;
+    present_interval_count_ =
+        std::min(present_interval_count_ + 1, kPresentIntervalHistoryLength);
+    COUNT_profile_set("ui/present/interval_us", int64_t(interval_ms * 1000.0));
+  }
+  presented_ = true;
+  last_present_host_ticks_ = host_ticks;
+  input_latency::RecordPresent();
+  startup_timeline::RecordPresent();
+}
+
+void GraphicsContext::GetPresentIntervalStatistics(
+    PresentIntervalStatistics& statistics_out) const {
+  statistics_out.interval_count = present_interval_count_;
+  if (!present_interval_count_) {
+    statistics_out.last_ms = 0.0;
+    statistics_out.average_ms = 0.0;
+    statistics_out.min_ms = 0.0;
+    statistics_out.max_ms = 0.0;
+    statistics_out.deviation_ms = 0.0;
+    return;
+  }
+  statistics_out.last_ms =
+      present_intervals_ms_[(present_interval_next_ +
+                             kPresentIntervalHistoryLength - 1) %
+                            kPresentIntervalHistoryLength];
+  double sum = 0.0;
+  statistics_out.min_ms = present_intervals_ms_[0];
+  statistics_out.max_ms = present_intervals_ms_[0];
+  for (uint32_t i = 0; i < present_interval_count_; ++i) {
+    double interval_ms = present_intervals_ms_[i];
+    sum += interval_ms;
+    statistics_out.min_ms = std::min(statistics_out.min_ms, interval_ms);
+    statistics_out.max_ms = std::max(statistics_out.max_ms, interval_ms);
+  }
+  statistics_out.average_ms = sum / double(present_interval_count_);
+  double variance_sum = 0.0;
+  for (uint32_t i = 0; i < present_interval_count_; ++i) {
+    double deviation = present_intervals_ms_[i] - statistics_out.average_ms;
+    variance_sum += deviation * deviation;
+  }
+  statistics_out.deviation_ms =
+      std::sqrt(variance_sum / double(present_interval_count_));
+}
+
 }  // namespace ui
 }  // namespace xe
@@ -57,13 +57,39 @@ class GraphicsContext {
 
   virtual std::unique_ptr<RawImage> Capture() = 0;
 
+  // Statistics of the intervals between the latest presentations, for
+  // measuring the consistency of the frame pacing. Interval count is 0 if
+  // nothing has been presented twice yet.
+  struct PresentIntervalStatistics {
+    uint32_t interval_count;
+    double last_ms;
+    double average_ms;
+    double min_ms;
+    double max_ms;
+    // Standard deviation of the intervals.
+    double deviation_ms;
+  };
+  void GetPresentIntervalStatistics(
+      PresentIntervalStatistics& statistics_out) const;
+
  protected:
   explicit GraphicsContext(GraphicsProvider* provider, Window* target_window);
 
   static void GetClearColor(float* rgba);
 
+  // To be called by the implementations after every successful presentation.
+  void RecordPresent();
+
   GraphicsProvider* provider_ = nullptr;
   Window* target_window_ = nullptr;
+
+ private:
+  static constexpr uint32_t kPresentIntervalHistoryLength = 120;
+  uint64_t last_present_host_ticks_ = 0;
+  bool presented_ = false;
+  double present_intervals_ms_[kPresentIntervalHistoryLength];
+  uint32_t present_interval_count_ = 0;
+  uint32_t present_interval_next_ = 0;
 };
 
 struct GraphicsContextLock {
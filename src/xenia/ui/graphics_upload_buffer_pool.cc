@@ -36,6 +36,38 @@ void GraphicsUploadBufferPool::Reclaim(uint64_t completed_submission_index) {
   if (!submitted_first_) {
     submitted_last_ = nullptr;
   }
+
+  // Destroy the free pages that have been idle for long, keeping the current
+  // one if anything has been written to it.
+  Page* page_previous = nullptr;
+  Page* page = writable_first_;
+  if (page && current_page_used_) {
+    page_previous = page;
+    page = page->next_;
+  }
+  while (page) {
+    Page* page_next = page->next_;
+    if (page->last_submission_index_ + idle_submissions_before_trim_ >
+        completed_submission_index) {
+      page_previous = page;
+      page = page_next;
+      continue;
+    }
+    if (page_previous) {
+      page_previous->next_ = page_next;
+    } else {
+      writable_first_ = page_next;
+      current_page_used_ = 0;
+      current_page_flushed_ = 0;
+    }
+    if (writable_last_ == page) {
+      writable_last_ = page_previous;
+    }
+    delete page;
+    --statistics_.page_count;
+    ++statistics_.pages_trimmed;
+    page = page_next;
+  }
 }
 
 void GraphicsUploadBufferPool::ClearCache() {
@@ -54,6 +86,7 @@ void GraphicsUploadBufferPool::ClearCache() {
     writable_first_ = next_;
   }
   writable_last_ = nullptr;
+  statistics_.page_count = 0;
 }
 
 GraphicsUploadBufferPool::Page::~Page() {}
@@ -110,8 +143,12 @@ GraphicsUploadBufferPool::Page* GraphicsUploadBufferPool::Request(
       writable_first_->last_submission_index_ = submission_index;
       writable_first_->next_ = nullptr;
       writable_last_ = writable_first_;
+      ++statistics_.page_count;
+      ++statistics_.pages_created;
       // After CreatePageImplementation (more specifically, the first successful
       // call), page_size_ may grow - but this doesn't matter here.
+    } else {
+      ++statistics_.pages_reused;
     }
     current_page_used_ = 0;
     current_page_used_aligned = 0;
@@ -24,12 +24,27 @@ class GraphicsUploadBufferPool {
   // Taken from the Direct3D 12 MiniEngine sample (LinearAllocator
   // kCpuAllocatorPageSize). Large enough for most cases.
   static constexpr size_t kDefaultPageSize = 2 * 1024 * 1024;
+  // Free pages not used in this many submissions are destroyed on Reclaim, so
+  // the pool shrinks back after bursts of uploads.
+  static constexpr uint64_t kDefaultIdleSubmissionsBeforeTrim = 256;
+
+  struct Statistics {
+    // Pages currently existing, either in use or free.
+    size_t page_count;
+    // Totals since the creation of the pool.
+    uint64_t pages_created;
+    // Switches to a free page that already existed.
+    uint64_t pages_reused;
+    uint64_t pages_trimmed;
+  };
 
   virtual ~GraphicsUploadBufferPool();
 
   void Reclaim(uint64_t completed_submission_index);
   void ClearCache();
 
+  const Statistics& statistics() const { return statistics_; }
+
   // Should be called before submitting anything using this pool, unless the
   // implementation doesn't require explicit flushing.
   void FlushWrites();
@@ -42,7 +57,11 @@ class GraphicsUploadBufferPool {
     Page* next_;
   };
 
-  GraphicsUploadBufferPool(size_t page_size) : page_size_(page_size) {}
+  GraphicsUploadBufferPool(
+      size_t page_size,
+      uint64_t idle_submissions_before_trim = kDefaultIdleSubmissionsBeforeTrim)
+      : page_size_(page_size),
+        idle_submissions_before_trim_(idle_submissions_before_trim) {}
 
   // Request to write data in a single piece, creating a new page if the current
   // one doesn't have enough free space.
@@ -61,6 +80,8 @@ class GraphicsUploadBufferPool {
   // the specified page size.
   size_t page_size_;
 
+  uint64_t idle_submissions_before_trim_;
+
   // A list of buffers with free space, with the first buffer being the one
   // currently being filled.
   Page* writable_first_ = nullptr;
@@ -72,6 +93,8 @@ class GraphicsUploadBufferPool {
 
   size_t current_page_used_ = 0;
   size_t current_page_flushed_ = 0;
+
+  Statistics statistics_ = {};
 };
 
 }  // namespace ui
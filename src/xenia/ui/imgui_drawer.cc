@@ -9,9 +9,12 @@
 
 #include "xenia/ui/imgui_drawer.h"
 
+#include <algorithm>
+
 #include "third_party/imgui/imgui.h"
 #include "xenia/base/assert.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/math.h"
 #include "xenia/ui/window.h"
 
 namespace xe {
@@ -179,18 +182,31 @@ void ImGuiDrawer::RenderDrawLists(ImDrawData* data) {
   const float height = io.DisplaySize.y;
   drawer->Begin(static_cast<int>(width), static_cast<int>(height));
 
+  // Merge the lists into as few batches as possible so the geometry is
+  // uploaded and bound once, with each list addressed by its base vertex since
+  // the indices are 16-bit. The storage is kept between frames to avoid
+  // reallocating it.
   for (int i = 0; i < data->CmdListsCount; ++i) {
     const auto cmd_list = data->CmdLists[i];
+    if (!merged_draws_.empty() &&
+        (sizeof(ImmediateVertex) *
+                 (merged_vertices_.size() + cmd_list->VtxBuffer.size()) >
+             kMaxMergedBatchSize ||
+         sizeof(uint16_t) *
+                 (merged_indices_.size() + cmd_list->IdxBuffer.size()) >
+             kMaxMergedBatchSize)) {
+      DrawMergedBatch();
+    }
+    int base_vertex = int(merged_vertices_.size());
+    int index_offset = int(merged_indices_.size());
+    auto vertices =
+        reinterpret_cast<const ImmediateVertex*>(cmd_list->VtxBuffer.Data);
+    merged_vertices_.insert(merged_vertices_.end(), vertices,
+                            vertices + cmd_list->VtxBuffer.size());
+    merged_indices_.insert(
+        merged_indices_.end(), cmd_list->IdxBuffer.Data,
+        cmd_list->IdxBuffer.Data + cmd_list->IdxBuffer.size());
 
-    ImmediateDrawBatch batch;
-    batch.vertices =
-        reinterpret_cast<ImmediateVertex*>(cmd_list->VtxBuffer.Data);
-    batch.vertex_count = cmd_list->VtxBuffer.size();
-    batch.indices = cmd_list->IdxBuffer.Data;
-    batch.index_count = cmd_list->IdxBuffer.size();
-    drawer->BeginDrawBatch(batch);
-
-    int index_offset = 0;
     for (int j = 0; j < cmd_list->CmdBuffer.size(); ++j) {
       const auto& cmd = cmd_list->CmdBuffer[j];
 
@@ -198,6 +214,7 @@ void ImGuiDrawer::RenderDrawLists(ImDrawData* data) {
       draw.primitive_type = ImmediatePrimitiveType::kTriangles;
       draw.count = cmd.ElemCount;
       draw.index_offset = index_offset;
+      draw.base_vertex = base_vertex;
       draw.texture_handle =
           reinterpret_cast<uintptr_t>(cmd.TextureId) & ~kIgnoreAlpha;
       draw.alpha_blend =
@@ -208,17 +225,50 @@ void ImGuiDrawer::RenderDrawLists(ImDrawData* data) {
       draw.scissor_rect[1] = static_cast<int>(height - cmd.ClipRect.w);
       draw.scissor_rect[2] = static_cast<int>(cmd.ClipRect.z - cmd.ClipRect.x);
       draw.scissor_rect[3] = static_cast<int>(cmd.ClipRect.w - cmd.ClipRect.y);
-      drawer->Draw(draw);
-
       index_offset += cmd.ElemCount;
-    }
 
-    drawer->EndDrawBatch();
+      // Commands following each other with the same state are drawn at once.
+      if (!merged_draws_.empty()) {
+        ImmediateDraw& last_draw = merged_draws_.back();
+        if (last_draw.index_offset + last_draw.count == draw.index_offset &&
+            last_draw.base_vertex == draw.base_vertex &&
+            last_draw.texture_handle == draw.texture_handle &&
+            last_draw.alpha_blend == draw.alpha_blend &&
+            std::equal(last_draw.scissor_rect,
+                       last_draw.scissor_rect + xe::countof(draw.scissor_rect),
+                       draw.scissor_rect)) {
+          last_draw.count += draw.count;
+          continue;
+        }
+      }
+      merged_draws_.push_back(draw);
+    }
   }
 
+  DrawMergedBatch();
+
   drawer->End();
 }
 
+void ImGuiDrawer::DrawMergedBatch() {
+  if (!merged_draws_.empty()) {
+    auto drawer = graphics_context_->immediate_drawer();
+    ImmediateDrawBatch batch;
+    batch.vertices = merged_vertices_.data();
+    batch.vertex_count = int(merged_vertices_.size());
+    batch.indices = merged_indices_.data();
+    batch.index_count = int(merged_indices_.size());
+    drawer->BeginDrawBatch(batch);
+    for (const ImmediateDraw& draw : merged_draws_) {
+      drawer->Draw(draw);
+    }
+    drawer->EndDrawBatch();
+  }
+  merged_vertices_.clear();
+  merged_indices_.clear();
+  merged_draws_.clear();
+}
+
 ImGuiIO& ImGuiDrawer::GetIO() {
   ImGui::SetCurrentContext(internal_state_);
   return ImGui::GetIO();
@@ -43,6 +43,8 @@ class ImGuiDrawer : public WindowListener {
   void SetupFont();
 
   void RenderDrawLists(ImDrawData* data);
+  // Draws and clears the merged draw lists.
+  void DrawMergedBatch();
 
   void OnKeyDown(KeyEvent* e) override;
   void OnKeyUp(KeyEvent* e) override;
@@ -59,6 +61,13 @@ class ImGuiDrawer : public WindowListener {
 
   ImGuiContext* internal_state_ = nullptr;
   std::unique_ptr<ImmediateTexture> font_texture_;
+
+  // Fits in one page of the upload buffers of the immediate drawers.
+  static constexpr size_t kMaxMergedBatchSize = 1024 * 1024;
+  // Draw lists of a frame merged into one batch.
+  std::vector<ImmediateVertex> merged_vertices_;
+  std::vector<uint16_t> merged_indices_;
+  std::vector<ImmediateDraw> merged_draws_;
 };
 
 }  // namespace ui
@@ -185,7 +185,9 @@ void VulkanContext::EndSwap() {
     // Notify the presentation engine the image is ready.
     // The contents must be in a coherent state.
     status = swap_chain_->End();
-    if (status == VK_ERROR_DEVICE_LOST) {
+    if (status == VK_SUCCESS) {
+      RecordPresent();
+    } else if (status == VK_ERROR_DEVICE_LOST) {
       context_lost_ = true;
     }
   }
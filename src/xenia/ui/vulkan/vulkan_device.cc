@@ -9,6 +9,7 @@
 
 #include "xenia/ui/vulkan/vulkan_device.h"
 
+#include <algorithm>
 #include <cinttypes>
 #include <climits>
 #include <mutex>
@@ -64,6 +65,13 @@ VulkanDevice::VulkanDevice(VulkanInstance* instance) : instance_(instance) {
 
   DeclareRequiredExtension(VK_KHR_SAMPLER_MIRROR_CLAMP_TO_EDGE_EXTENSION_NAME,
                            Version::Make(0, 0, 0), false);
+
+  // Descriptor indexing for bindless textures (optional). Maintenance3 is its
+  // dependency, which is core since Vulkan 1.1.
+  DeclareRequiredExtension(VK_KHR_MAINTENANCE3_EXTENSION_NAME,
+                           Version::Make(0, 0, 0), true);
+  DeclareRequiredExtension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME,
+                           Version::Make(0, 0, 0), true);
 }
 
 VulkanDevice::~VulkanDevice() {
@@ -121,6 +129,40 @@ bool VulkanDevice::Initialize(DeviceInfo device_info) {
     return false;
   }
 
+  // Descriptor indexing features needed for a persistent texture descriptor
+  // set updated while it's in use by submitted command buffers.
+  VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptor_indexing_features =
+      {};
+  descriptor_indexing_features.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+  bool descriptor_indexing_bindless_supported = false;
+  if (HasEnabledExtension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) &&
+      vkGetPhysicalDeviceFeatures2) {
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT
+        supported_descriptor_indexing_features = {};
+    supported_descriptor_indexing_features.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    VkPhysicalDeviceFeatures2 supported_features2 = {};
+    supported_features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported_features2.pNext = &supported_descriptor_indexing_features;
+    vkGetPhysicalDeviceFeatures2(device_info.handle, &supported_features2);
+    if (supported_features.shaderSampledImageArrayDynamicIndexing &&
+        supported_descriptor_indexing_features
+            .descriptorBindingSampledImageUpdateAfterBind &&
+        supported_descriptor_indexing_features
+            .descriptorBindingUpdateUnusedWhilePending &&
+        supported_descriptor_indexing_features
+            .descriptorBindingPartiallyBound) {
+      enabled_features.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+      descriptor_indexing_features
+          .descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+      descriptor_indexing_features.descriptorBindingUpdateUnusedWhilePending =
+          VK_TRUE;
+      descriptor_indexing_features.descriptorBindingPartiallyBound = VK_TRUE;
+      descriptor_indexing_bindless_supported = true;
+    }
+  }
+
   // Pick a queue.
   // Any queue we use must support both graphics and presentation.
   // TODO(benvanik): use multiple queues (DMA-only, compute-only, etc).
@@ -147,6 +189,20 @@ bool VulkanDevice::Initialize(DeviceInfo device_info) {
     return false;
   }
 
+  // Sparse residency of render targets, so the parts of large (such as
+  // resolution-scaled) images that are never drawn to don't need memory. The
+  // bindings are done on the primary queue, so it must support them.
+  bool sparse_residency_image_2d_supported = false;
+  if (supported_features.sparseBinding &&
+      supported_features.sparseResidencyImage2D &&
+      (device_info.queue_family_properties[ideal_queue_family_index]
+           .queueFlags &
+       VK_QUEUE_SPARSE_BINDING_BIT)) {
+    enabled_features.sparseBinding = VK_TRUE;
+    enabled_features.sparseResidencyImage2D = VK_TRUE;
+    sparse_residency_image_2d_supported = true;
+  }
+
   // Some tools *cough* renderdoc *cough* can't handle multiple queues.
   if (cvars::vulkan_primary_queue_only) {
     queue_count = 1;
@@ -178,7 +234,9 @@ bool VulkanDevice::Initialize(DeviceInfo device_info) {
 
   VkDeviceCreateInfo create_info;
   create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-  create_info.pNext = nullptr;
+  create_info.pNext = descriptor_indexing_bindless_supported
+                          ? &descriptor_indexing_features
+                          : nullptr;
   create_info.flags = 0;
   create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_infos.size());
   create_info.pQueueCreateInfos = queue_infos.data();
@@ -230,6 +288,26 @@ bool VulkanDevice::Initialize(DeviceInfo device_info) {
     }
   }
 
+  descriptor_indexing_bindless_supported_ =
+      descriptor_indexing_bindless_supported;
+  if (descriptor_indexing_bindless_supported_) {
+    VkPhysicalDeviceDescriptorIndexingPropertiesEXT
+        descriptor_indexing_properties = {};
+    descriptor_indexing_properties.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+    VkPhysicalDeviceProperties2 properties2 = {};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &descriptor_indexing_properties;
+    vkGetPhysicalDeviceProperties2(device_info.handle, &properties2);
+    max_update_after_bind_sampled_images_ = std::min(
+        descriptor_indexing_properties
+            .maxPerStageDescriptorUpdateAfterBindSampledImages,
+        descriptor_indexing_properties
+            .maxPerStageDescriptorUpdateAfterBindSamplers);
+  }
+
+  sparse_residency_image_2d_supported_ = sparse_residency_image_2d_supported;
+
   device_info_ = std::move(device_info);
   queue_family_index_ = ideal_queue_family_index;
 
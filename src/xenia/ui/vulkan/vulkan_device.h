@@ -59,6 +59,22 @@ class VulkanDevice {
 
   bool HasEnabledExtension(const char* name);
 
+  // Whether VK_EXT_descriptor_indexing has been enabled with the features
+  // needed for a persistent sampled image array updated while in use.
+  bool descriptor_indexing_bindless_supported() const {
+    return descriptor_indexing_bindless_supported_;
+  }
+  // Per-stage limit of update-after-bind combined image samplers, valid if
+  // descriptor_indexing_bindless_supported.
+  uint32_t max_update_after_bind_sampled_images() const {
+    return max_update_after_bind_sampled_images_;
+  }
+  // Whether sparse binding and sparse residency of 2D images are enabled, and
+  // the primary queue supports sparse binding operations.
+  bool sparse_residency_image_2d_supported() const {
+    return sparse_residency_image_2d_supported_;
+  }
+
   uint32_t queue_family_index() const { return queue_family_index_; }
   std::mutex& primary_queue_mutex() { return queue_mutex_; }
   // Access to the primary queue must be synchronized with primary_queue_mutex.
@@ -110,6 +126,10 @@ class VulkanDevice {
   std::vector<Requirement> required_extensions_;
   std::vector<const char*> enabled_extensions_;
 
+  bool descriptor_indexing_bindless_supported_ = false;
+  uint32_t max_update_after_bind_sampled_images_ = 0;
+  bool sparse_residency_image_2d_supported_ = false;
+
   bool debug_marker_ena_ = false;
   PFN_vkDebugMarkerSetObjectNameEXT pfn_vkDebugMarkerSetObjectNameEXT_ =
       nullptr;
@@ -92,9 +92,9 @@ class LightweightCircularBuffer {
   // Allocates space for data and copies it into the buffer.
   // Returns the offset in the buffer of the data or VK_WHOLE_SIZE if the buffer
   // is full.
-  VkDeviceSize Emplace(const void* source_data, size_t source_length) {
+  VkDeviceSize Emplace(const void* source_data, size_t data_length) {
     // TODO(benvanik): query actual alignment.
-    source_length = xe::round_up(source_length, 256);
+    size_t source_length = xe::round_up(data_length, size_t(256));
 
     // Run down old fences to free up space.
 
@@ -111,7 +111,7 @@ class LightweightCircularBuffer {
 
     // Copy data.
     auto dest_ptr = reinterpret_cast<uint8_t*>(buffer_data_) + offset;
-    std::memcpy(dest_ptr, source_data, source_length);
+    std::memcpy(dest_ptr, source_data, data_length);
 
     // Insert fence.
     // TODO(benvanik): coarse-grained fences, these may be too fine.
@@ -785,6 +785,11 @@ void VulkanImmediateDrawer::Begin(int render_target_width,
   vkCmdPushConstants(current_cmd_buffer_, pipeline_layout_,
                      VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(float) * 16,
                      ortho_projection);
+
+  current_pipeline_ = nullptr;
+  current_texture_ = nullptr;
+  current_restrict_texture_samples_ = -1;
+  current_scissor_valid_ = false;
 }
 
 void VulkanImmediateDrawer::BeginDrawBatch(const ImmediateDrawBatch& batch) {
@@ -817,20 +822,27 @@ void VulkanImmediateDrawer::BeginDrawBatch(const ImmediateDrawBatch& batch) {
 }
 
 void VulkanImmediateDrawer::Draw(const ImmediateDraw& draw) {
+  // Only the state different from the previous draw is set, consecutive draws
+  // usually differ only in the scissor.
+  VkPipeline pipeline = nullptr;
   switch (draw.primitive_type) {
     case ImmediatePrimitiveType::kLines:
-      vkCmdBindPipeline(current_cmd_buffer_, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                        line_pipeline_);
+      pipeline = line_pipeline_;
       break;
     case ImmediatePrimitiveType::kTriangles:
-      vkCmdBindPipeline(current_cmd_buffer_, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                        triangle_pipeline_);
+      pipeline = triangle_pipeline_;
       break;
   }
+  if (current_pipeline_ != pipeline) {
+    current_pipeline_ = pipeline;
+    vkCmdBindPipeline(current_cmd_buffer_, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                      pipeline);
+  }
 
   // Setup texture binding.
   auto texture = reinterpret_cast<VulkanImmediateTexture*>(draw.texture_handle);
-  if (texture) {
+  if (texture && current_texture_ != texture) {
+    current_texture_ = texture;
     if (texture->layout() != VK_IMAGE_LAYOUT_GENERAL) {
       texture->TransitionLayout(current_cmd_buffer_, VK_IMAGE_LAYOUT_GENERAL);
     }
@@ -848,9 +860,12 @@ void VulkanImmediateDrawer::Draw(const ImmediateDraw& draw) {
   // Use push constants for our per-draw changes.
   // Here, the restrict_texture_samples uniform.
   int restrict_texture_samples = draw.restrict_texture_samples ? 1 : 0;
-  vkCmdPushConstants(current_cmd_buffer_, pipeline_layout_,
-                     VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(float) * 16,
-                     sizeof(int), &restrict_texture_samples);
+  if (current_restrict_texture_samples_ != restrict_texture_samples) {
+    current_restrict_texture_samples_ = restrict_texture_samples;
+    vkCmdPushConstants(current_cmd_buffer_, pipeline_layout_,
+                       VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(float) * 16,
+                       sizeof(int), &restrict_texture_samples);
+  }
 
   // Scissor, if enabled.
   // Scissor can be disabled by making it the full screen.
@@ -867,7 +882,15 @@ void VulkanImmediateDrawer::Draw(const ImmediateDraw& draw) {
     scissor.extent.width = current_render_target_width_;
     scissor.extent.height = current_render_target_height_;
   }
-  vkCmdSetScissor(current_cmd_buffer_, 0, 1, &scissor);
+  if (!current_scissor_valid_ ||
+      current_scissor_.offset.x != scissor.offset.x ||
+      current_scissor_.offset.y != scissor.offset.y ||
+      current_scissor_.extent.width != scissor.extent.width ||
+      current_scissor_.extent.height != scissor.extent.height) {
+    current_scissor_ = scissor;
+    current_scissor_valid_ = true;
+    vkCmdSetScissor(current_cmd_buffer_, 0, 1, &scissor);
+  }
 
   // Issue draw.
   if (batch_has_index_buffer_) {
@@ -21,6 +21,7 @@ namespace vulkan {
 
 class LightweightCircularBuffer;
 class VulkanContext;
+class VulkanImmediateTexture;
 
 class VulkanImmediateDrawer : public ImmediateDrawer {
  public:
@@ -71,6 +72,12 @@ class VulkanImmediateDrawer : public ImmediateDrawer {
   VkCommandBuffer current_cmd_buffer_ = nullptr;
   int current_render_target_width_ = 0;
   int current_render_target_height_ = 0;
+  // State set by the previous draws since Begin.
+  VkPipeline current_pipeline_ = nullptr;
+  VulkanImmediateTexture* current_texture_ = nullptr;
+  int current_restrict_texture_samples_ = -1;
+  bool current_scissor_valid_ = false;
+  VkRect2D current_scissor_ = {};
 };
 
 }  // namespace vulkan
@@ -9,6 +9,7 @@
 
 #include "xenia/ui/vulkan/vulkan_swap_chain.h"
 
+#include <algorithm>
 #include <mutex>
 #include <string>
 
@@ -23,6 +24,16 @@
 
 DEFINE_bool(vulkan_random_clear_color, false,
             "Randomizes framebuffer clear color.", "Vulkan");
+DEFINE_string(
+    vulkan_present_mode, "mailbox",
+    "Preferred presentation mode.\n"
+    " mailbox: No tearing, the newest frame replaces the queued one - low "
+    "latency, but frames may be dropped.\n"
+    " fifo: Vertical sync - the most consistent frame pacing and the least "
+    "stutter, but higher latency.\n"
+    " immediate: Tearing, the lowest latency.\n"
+    "If the mode is not supported by the surface, fifo is used.",
+    "Vulkan");
 
 namespace xe {
 namespace ui {
@@ -143,18 +154,19 @@ VkResult VulkanSwapChain::Initialize(VkSurfaceKHR surface) {
   surface_width_ = extent.width;
   surface_height_ = extent.height;
 
-  // Always prefer mailbox mode (non-tearing, low-latency).
-  // If it's not available we'll use immediate (tearing, low-latency).
-  // If not even that we fall back to FIFO, which sucks.
+  // FIFO is the only mode that is always supported.
+  VkPresentModeKHR present_mode_preferred;
+  if (cvars::vulkan_present_mode == "immediate") {
+    present_mode_preferred = VK_PRESENT_MODE_IMMEDIATE_KHR;
+  } else if (cvars::vulkan_present_mode == "fifo") {
+    present_mode_preferred = VK_PRESENT_MODE_FIFO_KHR;
+  } else {
+    present_mode_preferred = VK_PRESENT_MODE_MAILBOX_KHR;
+  }
   VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
-  for (size_t i = 0; i < present_modes.size(); ++i) {
-    if (present_modes[i] == VK_PRESENT_MODE_MAILBOX_KHR) {
-      // This is the best, so early-out.
-      present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
-      break;
-    } else if (present_modes[i] == VK_PRESENT_MODE_IMMEDIATE_KHR) {
-      present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
-    }
+  if (std::find(present_modes.cbegin(), present_modes.cend(),
+                present_mode_preferred) != present_modes.cend()) {
+    present_mode = present_mode_preferred;
   }
 
   // Determine the number of images (1 + number queued).
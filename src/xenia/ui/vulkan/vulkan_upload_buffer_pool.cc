@@ -0,0 +1,146 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/ui/vulkan/vulkan_upload_buffer_pool.h"
+
+#include <algorithm>
+
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+
+namespace xe {
+namespace ui {
+namespace vulkan {
+
+// Align to nonCoherentAtomSize so whole pages can be flushed without going out
+// of bounds of the allocation.
+VulkanUploadBufferPool::VulkanUploadBufferPool(VulkanDevice* device,
+                                               VkBufferUsageFlags usage,
+                                               size_t page_size)
+    : GraphicsUploadBufferPool(xe::align(
+          page_size,
+          size_t(std::max(
+              device->device_info().properties.limits.nonCoherentAtomSize,
+              VkDeviceSize(1))))),
+      device_(device),
+      usage_(usage) {}
+
+uint8_t* VulkanUploadBufferPool::Request(uint64_t submission_index,
+                                         size_t size, size_t alignment,
+                                         VkBuffer* buffer_out,
+                                         VkDeviceSize* offset_out) {
+  size_t offset;
+  const VulkanPage* page =
+      static_cast<const VulkanPage*>(GraphicsUploadBufferPool::Request(
+          submission_index, size, alignment, offset));
+  if (!page) {
+    return nullptr;
+  }
+  if (buffer_out) {
+    *buffer_out = page->buffer_;
+  }
+  if (offset_out) {
+    *offset_out = VkDeviceSize(offset);
+  }
+  return reinterpret_cast<uint8_t*>(page->mapping_) + offset;
+}
+
+uint8_t* VulkanUploadBufferPool::RequestPartial(
+    uint64_t submission_index, size_t size, size_t alignment,
+    VkBuffer* buffer_out, VkDeviceSize* offset_out, VkDeviceSize* size_out) {
+  size_t offset, size_obtained;
+  const VulkanPage* page =
+      static_cast<const VulkanPage*>(GraphicsUploadBufferPool::RequestPartial(
+          submission_index, size, alignment, offset, size_obtained));
+  if (!page) {
+    return nullptr;
+  }
+  if (buffer_out) {
+    *buffer_out = page->buffer_;
+  }
+  if (offset_out) {
+    *offset_out = VkDeviceSize(offset);
+  }
+  if (size_out) {
+    *size_out = VkDeviceSize(size_obtained);
+  }
+  return reinterpret_cast<uint8_t*>(page->mapping_) + offset;
+}
+
+GraphicsUploadBufferPool::Page*
+VulkanUploadBufferPool::CreatePageImplementation() {
+  VkBufferCreateInfo buffer_info;
+  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.pNext = nullptr;
+  buffer_info.flags = 0;
+  buffer_info.size = VkDeviceSize(page_size_);
+  buffer_info.usage = usage_;
+  buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  buffer_info.queueFamilyIndexCount = 0;
+  buffer_info.pQueueFamilyIndices = nullptr;
+  VkBuffer buffer;
+  if (vkCreateBuffer(*device_, &buffer_info, nullptr, &buffer) != VK_SUCCESS) {
+    XELOGE("Failed to create a Vulkan upload buffer with {} bytes",
+           page_size_);
+    return nullptr;
+  }
+
+  VkMemoryRequirements memory_requirements;
+  vkGetBufferMemoryRequirements(*device_, buffer, &memory_requirements);
+  VkDeviceMemory memory = device_->AllocateMemory(memory_requirements);
+  if (!memory) {
+    XELOGE("Failed to allocate {} bytes of Vulkan upload buffer memory",
+           page_size_);
+    vkDestroyBuffer(*device_, buffer, nullptr);
+    return nullptr;
+  }
+  if (vkBindBufferMemory(*device_, buffer, memory, 0) != VK_SUCCESS) {
+    XELOGE("Failed to bind the memory to a Vulkan upload buffer");
+    vkDestroyBuffer(*device_, buffer, nullptr);
+    vkFreeMemory(*device_, memory, nullptr);
+    return nullptr;
+  }
+  void* mapping;
+  if (vkMapMemory(*device_, memory, 0, VK_WHOLE_SIZE, 0, &mapping) !=
+      VK_SUCCESS) {
+    XELOGE("Failed to map a Vulkan upload buffer with {} bytes", page_size_);
+    vkDestroyBuffer(*device_, buffer, nullptr);
+    vkFreeMemory(*device_, memory, nullptr);
+    return nullptr;
+  }
+  return new VulkanPage(*device_, buffer, memory, mapping);
+}
+
+void VulkanUploadBufferPool::FlushPageWrites(Page* page, size_t offset,
+                                             size_t size) {
+  // The memory type is not required to be host-coherent.
+  VkDeviceSize atom_size = std::max(
+      device_->device_info().properties.limits.nonCoherentAtomSize,
+      VkDeviceSize(1));
+  VkDeviceSize flush_start = VkDeviceSize(offset) / atom_size * atom_size;
+  VkDeviceSize flush_end = xe::round_up(VkDeviceSize(offset + size), atom_size);
+  VkMappedMemoryRange range;
+  range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+  range.pNext = nullptr;
+  range.memory = static_cast<const VulkanPage*>(page)->memory_;
+  range.offset = flush_start;
+  range.size = flush_end >= VkDeviceSize(page_size_) ? VK_WHOLE_SIZE
+                                                     : flush_end - flush_start;
+  vkFlushMappedMemoryRanges(*device_, 1, &range);
+}
+
+VulkanUploadBufferPool::VulkanPage::~VulkanPage() {
+  // Unmapping is done implicitly when the memory is freed.
+  vkDestroyBuffer(device_, buffer_, nullptr);
+  vkFreeMemory(device_, memory_, nullptr);
+}
+
+}  // namespace vulkan
+}  // namespace ui
+}  // namespace xe
@@ -0,0 +1,63 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_UI_VULKAN_VULKAN_UPLOAD_BUFFER_POOL_H_
+#define XENIA_UI_VULKAN_VULKAN_UPLOAD_BUFFER_POOL_H_
+
+#include "xenia/ui/graphics_upload_buffer_pool.h"
+#include "xenia/ui/vulkan/vulkan.h"
+#include "xenia/ui/vulkan/vulkan_device.h"
+
+namespace xe {
+namespace ui {
+namespace vulkan {
+
+// Pool of persistently mapped host-visible buffers, created as needed instead
+// of waiting for the GPU when all the existing ones are in use.
+class VulkanUploadBufferPool : public GraphicsUploadBufferPool {
+ public:
+  VulkanUploadBufferPool(VulkanDevice* device, VkBufferUsageFlags usage,
+                         size_t page_size = kDefaultPageSize);
+
+  uint8_t* Request(uint64_t submission_index, size_t size, size_t alignment,
+                   VkBuffer* buffer_out, VkDeviceSize* offset_out);
+  uint8_t* RequestPartial(uint64_t submission_index, size_t size,
+                          size_t alignment, VkBuffer* buffer_out,
+                          VkDeviceSize* offset_out, VkDeviceSize* size_out);
+
+ protected:
+  Page* CreatePageImplementation() override;
+
+  void FlushPageWrites(Page* page, size_t offset, size_t size) override;
+
+ private:
+  struct VulkanPage : public Page {
+    // Takes ownership of the buffer and the memory.
+    VulkanPage(VkDevice device, VkBuffer buffer, VkDeviceMemory memory,
+               void* mapping)
+        : device_(device),
+          buffer_(buffer),
+          memory_(memory),
+          mapping_(mapping) {}
+    ~VulkanPage() override;
+    VkDevice device_;
+    VkBuffer buffer_;
+    VkDeviceMemory memory_;
+    void* mapping_;
+  };
+
+  VulkanDevice* device_;
+  VkBufferUsageFlags usage_;
+};
+
+}  // namespace vulkan
+}  // namespace ui
+}  // namespace xe
+
+#endif  // XENIA_UI_VULKAN_VULKAN_UPLOAD_BUFFER_POOL_H_
@@ -0,0 +1,164 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/vfs/access_trace.h"
+
+#include <algorithm>
+#include <cinttypes>
+
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/vfs/virtual_file_system.h"
+
+namespace xe {
+namespace vfs {
+
+// Limits for titles streaming data for as long as they run.
+constexpr size_t kMaxRecordedExtents = 65536;
+constexpr uint64_t kMaxReplayBytes = uint64_t(1) << 30;
+
+AccessTrace::AccessTrace(VirtualFileSystem* file_system)
+    : file_system_(file_system) {}
+
+AccessTrace::~AccessTrace() {
+  StopReplay();
+  if (record_file_) {
+    std::lock_guard<std::mutex> lock(record_mutex_);
+    FlushPendingExtent();
+    fclose(record_file_);
+  }
+}
+
+bool AccessTrace::Open(const std::filesystem::path& path) {
+  FILE* replay_file = xe::filesystem::OpenFile(path, "r");
+  if (!replay_file) {
+    xe::filesystem::CreateParentFolder(path);
+    record_file_ = xe::filesystem::OpenFile(path, "w");
+    if (!record_file_) {
+      XELOGW("Unable to create the file access trace {}",
+             xe::path_to_utf8(path));
+      return false;
+    }
+    XELOGI("Recording file accesses to {}", xe::path_to_utf8(path));
+    return true;
+  }
+
+  char line[1024];
+  uint64_t replay_bytes = 0;
+  while (replay_bytes < kMaxReplayBytes &&
+         fgets(line, sizeof(line), replay_file)) {
+    Extent extent;
+    int path_start;
+    if (sscanf(line, "%" SCNx64 " %" SCNx64 " %n", &extent.offset,
+               &extent.length, &path_start) != 2) {
+      continue;
+    }
+    extent.path = line + path_start;
+    while (!extent.path.empty() &&
+           (extent.path.back() == '\n' || extent.path.back() == '\r')) {
+      extent.path.pop_back();
+    }
+    extent.length = std::min(extent.length, kMaxReplayBytes - replay_bytes);
+    replay_bytes += extent.length;
+    replay_extents_.push_back(std::move(extent));
+  }
+  fclose(replay_file);
+  if (replay_extents_.empty()) {
+    return true;
+  }
+  XELOGI("Prefetching {} MB of files read by the previous boot from {}",
+         replay_bytes >> 20, xe::path_to_utf8(path));
+  xe::threading::Thread::CreationParameters params;
+  params.stack_size = 256 * 1024;
+  replay_thread_ =
+      xe::threading::Thread::Create(params, [this]() { ReplayThreadMain(); });
+  if (!replay_thread_) {
+    return false;
+  }
+  replay_thread_->set_name("VFS Prefetch");
+  xe::threading::ApplyThreadRole(replay_thread_.get(),
+                                 xe::threading::ThreadRole::kIo);
+  return true;
+}
+
+void AccessTrace::RecordRead(const std::string& path, uint64_t offset,
+                             uint64_t length) {
+  if (!record_file_ || !length) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(record_mutex_);
+  if (has_pending_extent_ && pending_extent_.path == path &&
+      offset == pending_extent_.offset + pending_extent_.length) {
+    pending_extent_.length += length;
+    return;
+  }
+  FlushPendingExtent();
+  if (recorded_extent_count_ >= kMaxRecordedExtents) {
+    return;
+  }
+  pending_extent_.path = path;
+  pending_extent_.offset = offset;
+  pending_extent_.length = length;
+  has_pending_extent_ = true;
+}
+
+void AccessTrace::FlushPendingExtent() {
+  if (!has_pending_extent_) {
+    return;
+  }
+  fprintf(record_file_, "%" PRIX64 " %" PRIX64 " %s\n",
+          pending_extent_.offset, pending_extent_.length,
+          pending_extent_.path.c_str());
+  fflush(record_file_);
+  has_pending_extent_ = false;
+  ++recorded_extent_count_;
+}
+
+void AccessTrace::StopReplay() {
+  if (!replay_thread_) {
+    return;
+  }
+  replay_cancelled_ = true;
+  xe::threading::Wait(replay_thread_.get(), false);
+  replay_thread_.reset();
+}
+
+void AccessTrace::ReplayThreadMain() {
+  const size_t kChunkSize = 1024 * 1024;
+  std::vector<uint8_t> buffer(kChunkSize);
+  for (const Extent& extent : replay_extents_) {
+    if (replay_cancelled_) {
+      return;
+    }
+    Entry* entry = file_system_->ResolvePath(extent.path);
+    File* file = nullptr;
+    if (!entry ||
+        entry->Open(FileAccess::kFileReadData, &file) != X_STATUS_SUCCESS) {
+      continue;
+    }
+    // The data only needs to pass through the caches, it's discarded.
+    for (uint64_t offset = extent.offset;
+         offset < extent.offset + extent.length && !replay_cancelled_;) {
+      size_t bytes_read = 0;
+      if (file->ReadSync(
+              buffer.data(),
+              size_t(std::min(uint64_t(kChunkSize),
+                              extent.offset + extent.length - offset)),
+              size_t(offset), &bytes_read) != X_STATUS_SUCCESS ||
+          !bytes_read) {
+        break;
+      }
+      offset += bytes_read;
+    }
+    file->Destroy();
+  }
+}
+
+}  // namespace vfs
+}  // namespace xe
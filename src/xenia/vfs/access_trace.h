@@ -0,0 +1,78 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_VFS_ACCESS_TRACE_H_
+#define XENIA_VFS_ACCESS_TRACE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace vfs {
+
+class VirtualFileSystem;
+
+// Ordered log of the ranges of files read by a title. The first boot records
+// it, and later boots read the same ranges on a background thread ahead of the
+// title, so the data is in the host page cache or the caches of the devices by
+// the time it's requested, while the title is still being loaded and
+// translated.
+class AccessTrace {
+ public:
+  explicit AccessTrace(VirtualFileSystem* file_system);
+  ~AccessTrace();
+
+  // Starts reading the ranges in the trace at the path if it exists, or
+  // otherwise recording to it.
+  bool Open(const std::filesystem::path& path);
+
+  bool is_recording() const { return record_file_ != nullptr; }
+  void RecordRead(const std::string& path, uint64_t offset, uint64_t length);
+
+  // Waits for the replay thread to stop, must be called before the devices
+  // the ranges are on are destroyed.
+  void StopReplay();
+
+ private:
+  struct Extent {
+    std::string path;
+    uint64_t offset;
+    uint64_t length;
+  };
+
+  // Must be called with the mutex held.
+  void FlushPendingExtent();
+  void ReplayThreadMain();
+
+  VirtualFileSystem* file_system_;
+
+  std::mutex record_mutex_;
+  FILE* record_file_ = nullptr;
+  // Consecutive reads of a file are merged into one extent.
+  Extent pending_extent_;
+  bool has_pending_extent_ = false;
+  size_t recorded_extent_count_ = 0;
+
+  std::vector<Extent> replay_extents_;
+  std::atomic<bool> replay_cancelled_ = {false};
+  std::unique_ptr<xe::threading::Thread> replay_thread_;
+};
+
+}  // namespace vfs
+}  // namespace xe
+
+#endif  // XENIA_VFS_ACCESS_TRACE_H_
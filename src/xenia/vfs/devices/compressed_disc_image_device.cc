@@ -0,0 +1,385 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/vfs/devices/compressed_disc_image_device.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "third_party/snappy/snappy.h"
+#include "xenia/base/assert.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/base/memory.h"
+#include "xenia/vfs/devices/compressed_disc_image_entry.h"
+
+DEFINE_int32(compressed_disc_cache_size, 64,
+             "Size in MB of the cache of decompressed blocks of compressed "
+             "disc images.",
+             "Storage");
+
+namespace xe {
+namespace vfs {
+
+const size_t kXESectorSize = 2048;
+
+CompressedDiscImageDevice::CompressedDiscImageDevice(
+    const std::string_view mount_path, const std::filesystem::path& host_path)
+    : Device(mount_path), name_("GDFX"), host_path_(host_path) {}
+
+CompressedDiscImageDevice::~CompressedDiscImageDevice() {
+  {
+    std::lock_guard<std::mutex> lock(read_ahead_mutex_);
+    read_ahead_shutting_down_ = true;
+    read_ahead_queue_.clear();
+  }
+  read_ahead_cond_.notify_all();
+  for (auto& thread : read_ahead_threads_) {
+    xe::threading::Wait(thread.get(), false);
+  }
+}
+
+bool CompressedDiscImageDevice::Initialize() {
+  mmap_ = MappedMemory::Open(host_path_, MappedMemory::Mode::kRead);
+  if (!mmap_) {
+    XELOGE("Compressed disc image could not be mapped");
+    return false;
+  }
+  if (mmap_->size() < sizeof(header_)) {
+    XELOGE("Compressed disc image is too small");
+    return false;
+  }
+  std::memcpy(&header_, mmap_->data(), sizeof(header_));
+  if (header_.magic != CompressedDiscImageHeader::kMagic ||
+      header_.version != CompressedDiscImageHeader::kVersion) {
+    XELOGE("Not a supported compressed disc image");
+    return false;
+  }
+  if (header_.compression !=
+      CompressedDiscImageHeader::Compression::kSnappy) {
+    XELOGE("Unsupported compressed disc image compression {}",
+           uint32_t(header_.compression));
+    return false;
+  }
+  if (!header_.block_size || !xe::is_pow2(header_.block_size) ||
+      uint64_t(header_.block_count()) * header_.block_size <
+          header_.image_size) {
+    XELOGE("Invalid compressed disc image block size {}", header_.block_size);
+    return false;
+  }
+
+  // Loading the index, with the offsets validated once so reading a block can
+  // take them as is.
+  size_t block_count = header_.block_count();
+  size_t index_size = (block_count + 1) * sizeof(uint64_t);
+  if (header_.index_offset > mmap_->size() ||
+      mmap_->size() - header_.index_offset < index_size) {
+    XELOGE("Compressed disc image index is out of bounds");
+    return false;
+  }
+  block_offsets_.resize(block_count + 1);
+  std::memcpy(block_offsets_.data(), mmap_->data() + header_.index_offset,
+              index_size);
+  if (block_offsets_[0] < sizeof(header_) ||
+      block_offsets_[block_count] > header_.index_offset ||
+      !std::is_sorted(block_offsets_.begin(), block_offsets_.end())) {
+    XELOGE("Compressed disc image index is damaged");
+    return false;
+  }
+
+  cache_capacity_ = std::max(
+      (size_t(std::max(cvars::compressed_disc_cache_size, int32_t(0))) << 20) /
+          header_.block_size,
+      size_t(2));
+
+  size_t game_offset;
+  std::vector<uint8_t> root_buffer;
+  if (!VerifyGdfx(game_offset, root_buffer)) {
+    XELOGE("Failed to verify compressed disc image GDFX header");
+    return false;
+  }
+
+  auto root_entry = new CompressedDiscImageEntry(this, nullptr, "");
+  root_entry->attributes_ = kFileAttributeDirectory;
+  root_entry_ = std::unique_ptr<Entry>(root_entry);
+  if (!ReadEntry(game_offset, root_buffer, 0, root_entry)) {
+    XELOGE("Failed to read all GDFX entries of the compressed disc image");
+    return false;
+  }
+
+  return true;
+}
+
+void CompressedDiscImageDevice::Dump(StringBuffer* string_buffer) {
+  auto global_lock = global_critical_region_.Acquire();
+  root_entry_->Dump(string_buffer, 0);
+}
+
+Entry* CompressedDiscImageDevice::ResolvePath(const std::string_view path) {
+  XELOGFS("CompressedDiscImageDevice::ResolvePath({})", path);
+  return root_entry_->ResolvePath(path);
+}
+
+bool CompressedDiscImageDevice::Read(size_t offset, void* buffer,
+                                     size_t length) {
+  if (offset > header_.image_size || header_.image_size - offset < length) {
+    return false;
+  }
+  auto buffer_bytes = reinterpret_cast<uint8_t*>(buffer);
+  while (length) {
+    uint32_t block_index = uint32_t(offset / header_.block_size);
+    size_t block_offset = offset % header_.block_size;
+    std::shared_ptr<CachedBlock> block = GetBlock(block_index);
+    if (block->state != CachedBlock::State::kReady) {
+      return false;
+    }
+    size_t block_length = std::min(length, block->data.size() - block_offset);
+    std::memcpy(buffer_bytes, block->data.data() + block_offset, block_length);
+    buffer_bytes += block_length;
+    offset += block_length;
+    length -= block_length;
+  }
+  return true;
+}
+
+void CompressedDiscImageDevice::ReadAhead(size_t offset, size_t length) {
+  if (offset >= header_.image_size || !length) {
+    return;
+  }
+  length = std::min(length, size_t(header_.image_size - offset));
+  uint32_t first_block = uint32_t(offset / header_.block_size);
+  uint32_t last_block = uint32_t((offset + length - 1) / header_.block_size);
+  // Not evicting the blocks being read now to make room for the read-ahead.
+  last_block = std::min(last_block,
+                        first_block + uint32_t(cache_capacity_ / 2) - 1);
+
+  std::vector<uint32_t> blocks;
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    for (uint32_t i = first_block; i <= last_block; ++i) {
+      if (cache_blocks_.find(i) == cache_blocks_.end()) {
+        blocks.push_back(i);
+      }
+    }
+  }
+  if (blocks.empty()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(read_ahead_mutex_);
+    if (read_ahead_shutting_down_) {
+      return;
+    }
+    for (uint32_t block : blocks) {
+      if (std::find(read_ahead_queue_.cbegin(), read_ahead_queue_.cend(),
+                    block) == read_ahead_queue_.cend()) {
+        read_ahead_queue_.push_back(block);
+      }
+    }
+    if (read_ahead_threads_.empty()) {
+      uint32_t thread_count = std::clamp(
+          xe::threading::logical_processor_count() / 2, uint32_t(1),
+          uint32_t(4));
+      for (uint32_t i = 0; i < thread_count; ++i) {
+        xe::threading::Thread::CreationParameters params;
+        params.stack_size = 256 * 1024;
+        auto thread = xe::threading::Thread::Create(
+            params, [this]() { ReadAheadWorkerMain(); });
+        assert_not_null(thread);
+        thread->set_name(fmt::format("Disc Decompression {}", i));
+        xe::threading::ApplyThreadRole(thread.get(),
+                                       xe::threading::ThreadRole::kIo);
+        read_ahead_threads_.push_back(std::move(thread));
+      }
+    }
+  }
+  read_ahead_cond_.notify_all();
+}
+
+void CompressedDiscImageDevice::ReadAheadWorkerMain() {
+  std::unique_lock<std::mutex> lock(read_ahead_mutex_);
+  while (true) {
+    read_ahead_cond_.wait(lock, [this]() {
+      return read_ahead_shutting_down_ || !read_ahead_queue_.empty();
+    });
+    if (read_ahead_shutting_down_) {
+      return;
+    }
+    uint32_t block_index = read_ahead_queue_.front();
+    read_ahead_queue_.pop_front();
+    lock.unlock();
+    GetBlock(block_index);
+    lock.lock();
+  }
+}
+
+std::shared_ptr<CompressedDiscImageDevice::CachedBlock>
+CompressedDiscImageDevice::GetBlock(uint32_t index) {
+  std::unique_lock<std::mutex> lock(cache_mutex_);
+  auto it = cache_blocks_.find(index);
+  if (it != cache_blocks_.end()) {
+    std::shared_ptr<CachedBlock> block = *it->second;
+    cache_lru_.splice(cache_lru_.begin(), cache_lru_, it->second);
+    cache_cond_.wait(lock, [&block]() {
+      return block->state != CachedBlock::State::kPending;
+    });
+    return block;
+  }
+
+  auto block = std::make_shared<CachedBlock>();
+  block->index = index;
+  cache_lru_.push_front(block);
+  cache_blocks_.emplace(index, cache_lru_.begin());
+  while (cache_lru_.size() > cache_capacity_) {
+    cache_blocks_.erase(cache_lru_.back()->index);
+    cache_lru_.pop_back();
+  }
+  lock.unlock();
+
+  bool decompressed = DecompressBlock(index, block->data);
+
+  lock.lock();
+  block->state = decompressed ? CachedBlock::State::kReady
+                              : CachedBlock::State::kFailed;
+  if (!decompressed) {
+    XELOGE("Compressed disc image block {} is damaged", index);
+    // Not keeping the failure cached.
+    it = cache_blocks_.find(index);
+    if (it != cache_blocks_.end() && *it->second == block) {
+      cache_lru_.erase(it->second);
+      cache_blocks_.erase(it);
+    }
+  }
+  cache_cond_.notify_all();
+  return block;
+}
+
+bool CompressedDiscImageDevice::DecompressBlock(
+    uint32_t index, std::vector<uint8_t>& data_out) const {
+  size_t block_start = size_t(index) * header_.block_size;
+  size_t block_size =
+      std::min(size_t(header_.block_size), header_.image_size - block_start);
+  auto compressed = reinterpret_cast<const char*>(mmap_->data()) +
+                    block_offsets_[index];
+  size_t compressed_size =
+      size_t(block_offsets_[index + 1] - block_offsets_[index]);
+  data_out.resize(block_size);
+  if (compressed_size == block_size) {
+    std::memcpy(data_out.data(), compressed, block_size);
+    return true;
+  }
+  size_t decompressed_size;
+  return snappy::GetUncompressedLength(compressed, compressed_size,
+                                       &decompressed_size) &&
+         decompressed_size == block_size &&
+         snappy::RawUncompress(compressed, compressed_size,
+                               reinterpret_cast<char*>(data_out.data()));
+}
+
+bool CompressedDiscImageDevice::VerifyGdfx(size_t& game_offset_out,
+                                           std::vector<uint8_t>& root_out) {
+  // Find sector 32 of the game partition - try at a few points, like for
+  // uncompressed images.
+  static const size_t likely_offsets[] = {
+      0x00000000, 0x0000FB20, 0x00020600, 0x02080000, 0x0FD90000,
+  };
+  uint8_t fs_sector[28];
+  bool magic_found = false;
+  for (size_t n = 0; n < xe::countof(likely_offsets); n++) {
+    game_offset_out = likely_offsets[n];
+    if (Read(game_offset_out + 32 * kXESectorSize, fs_sector,
+             sizeof(fs_sector)) &&
+        !std::memcmp(fs_sector, "MICROSOFT*XBOX*MEDIA", 20)) {
+      magic_found = true;
+      break;
+    }
+  }
+  if (!magic_found) {
+    return false;
+  }
+  size_t root_sector = xe::load<uint32_t>(fs_sector + 20);
+  size_t root_size = xe::load<uint32_t>(fs_sector + 24);
+  if (root_size < 13 || root_size > 32 * 1024 * 1024) {
+    return false;
+  }
+  root_out.resize(root_size);
+  return Read(game_offset_out + root_sector * kXESectorSize, root_out.data(),
+              root_size);
+}
+
+bool CompressedDiscImageDevice::ReadEntry(size_t game_offset,
+                                          const std::vector<uint8_t>& table,
+                                          uint16_t entry_ordinal,
+                                          CompressedDiscImageEntry* parent) {
+  size_t entry_offset = size_t(entry_ordinal) * 4;
+  if (entry_offset + 14 > table.size() ||
+      entry_offset + 14 + table[entry_offset + 13] > table.size()) {
+    return false;
+  }
+  const uint8_t* p = table.data() + entry_offset;
+
+  uint16_t node_l = xe::load<uint16_t>(p + 0);
+  uint16_t node_r = xe::load<uint16_t>(p + 2);
+  size_t sector = xe::load<uint32_t>(p + 4);
+  size_t length = xe::load<uint32_t>(p + 8);
+  uint8_t attributes = xe::load<uint8_t>(p + 12);
+  uint8_t name_length = xe::load<uint8_t>(p + 13);
+  auto name_buffer = reinterpret_cast<const char*>(p + 14);
+
+  if (node_l && !ReadEntry(game_offset, table, node_l, parent)) {
+    return false;
+  }
+
+  auto name = std::string(name_buffer, name_length);
+
+  auto entry = CompressedDiscImageEntry::Create(this, parent, name);
+  entry->attributes_ = attributes | kFileAttributeReadOnly;
+  entry->size_ = length;
+  entry->allocation_size_ = xe::round_up(length, bytes_per_sector());
+
+  // Set to January 1, 1970 (UTC) in 100-nanosecond intervals
+  entry->create_timestamp_ = 10000 * 11644473600000LL;
+  entry->access_timestamp_ = 10000 * 11644473600000LL;
+  entry->write_timestamp_ = 10000 * 11644473600000LL;
+
+  if (attributes & kFileAttributeDirectory) {
+    entry->data_offset_ = 0;
+    entry->data_size_ = 0;
+    if (length) {
+      // Not a leaf - read in children.
+      std::vector<uint8_t> folder_table(length);
+      if (!Read(game_offset + sector * kXESectorSize, folder_table.data(),
+                length) ||
+          !ReadEntry(game_offset, folder_table, 0, entry.get())) {
+        return false;
+      }
+    }
+  } else {
+    entry->data_offset_ = game_offset + sector * kXESectorSize;
+    entry->data_size_ = length;
+    if (entry->data_offset_ > header_.image_size ||
+        header_.image_size - entry->data_offset_ < length) {
+      return false;
+    }
+  }
+
+  parent->children_.emplace_back(std::move(entry));
+
+  if (node_r && !ReadEntry(game_offset, table, node_r, parent)) {
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace vfs
+}  // namespace xe
@@ -0,0 +1,140 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_VFS_DEVICES_COMPRESSED_DISC_IMAGE_DEVICE_H_
+#define XENIA_VFS_DEVICES_COMPRESSED_DISC_IMAGE_DEVICE_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/base/mapped_memory.h"
+#include "xenia/base/threading.h"
+#include "xenia/vfs/device.h"
+
+namespace xe {
+namespace vfs {
+
+class CompressedDiscImageEntry;
+
+// GDFX disc image split into fixed-size blocks compressed independently, so
+// any part of the image can be read by decompressing only the blocks it's in.
+// File layout (little-endian):
+// - CompressedDiscImageHeader.
+// - The compressed blocks.
+// - At index_offset, block count + 1 uint64_t offsets of the blocks in the
+//   file, block i spanning [offset i, offset i + 1). A block with the stored
+//   size equal to its decompressed size is stored uncompressed.
+struct CompressedDiscImageHeader {
+  static constexpr uint32_t kMagic = 0x49444358;  // 'XCDI'
+  static constexpr uint32_t kVersion = 1;
+
+  enum class Compression : uint32_t {
+    kSnappy = 1,
+  };
+
+  uint32_t magic;
+  uint32_t version;
+  Compression compression;
+  // Power of two, the last block may be shorter.
+  uint32_t block_size;
+  uint64_t image_size;
+  uint64_t index_offset;
+
+  uint32_t block_count() const {
+    return uint32_t((image_size + block_size - 1) / block_size);
+  }
+};
+static_assert(sizeof(CompressedDiscImageHeader) == 32);
+
+class CompressedDiscImageDevice : public Device {
+ public:
+  CompressedDiscImageDevice(const std::string_view mount_path,
+                            const std::filesystem::path& host_path);
+  ~CompressedDiscImageDevice() override;
+
+  bool Initialize() override;
+  void Dump(StringBuffer* string_buffer) override;
+  Entry* ResolvePath(const std::string_view path) override;
+
+  const std::string& name() const override { return name_; }
+  uint32_t attributes() const override { return 0; }
+  uint32_t component_name_max_length() const override { return 255; }
+
+  uint32_t total_allocation_units() const override {
+    return uint32_t(header_.image_size / sectors_per_allocation_unit() /
+                    bytes_per_sector());
+  }
+  uint32_t available_allocation_units() const override { return 0; }
+  uint32_t sectors_per_allocation_unit() const override { return 1; }
+  uint32_t bytes_per_sector() const override { return 0x200; }
+
+  // Reads a range of the decompressed image. Returns false if it's out of
+  // bounds or the blocks it's in are damaged.
+  bool Read(size_t offset, void* buffer, size_t length);
+  // Starts decompressing the blocks of the range of the decompressed image on
+  // the worker threads if they're not cached yet.
+  void ReadAhead(size_t offset, size_t length);
+
+ private:
+  struct CachedBlock {
+    enum class State {
+      kPending,
+      kReady,
+      kFailed,
+    };
+    uint32_t index;
+    State state = State::kPending;
+    std::vector<uint8_t> data;
+  };
+
+  // Returns the block from the cache, or decompresses it, waiting for another
+  // thread if it's already decompressing it.
+  std::shared_ptr<CachedBlock> GetBlock(uint32_t index);
+  bool DecompressBlock(uint32_t index, std::vector<uint8_t>& data_out) const;
+  void ReadAheadWorkerMain();
+
+  bool VerifyGdfx(size_t& game_offset_out, std::vector<uint8_t>& root_out);
+  bool ReadEntry(size_t game_offset, const std::vector<uint8_t>& table,
+                 uint16_t entry_ordinal, CompressedDiscImageEntry* parent);
+
+  std::string name_;
+  std::filesystem::path host_path_;
+  std::unique_ptr<Entry> root_entry_;
+  std::unique_ptr<MappedMemory> mmap_;
+  CompressedDiscImageHeader header_ = {};
+  std::vector<uint64_t> block_offsets_;
+
+  // LRU list of the decompressed blocks, most recently used first. Blocks
+  // evicted while being read stay alive until their readers are done.
+  std::mutex cache_mutex_;
+  std::condition_variable cache_cond_;
+  size_t cache_capacity_ = 0;
+  std::list<std::shared_ptr<CachedBlock>> cache_lru_;
+  std::unordered_map<uint32_t,
+                     std::list<std::shared_ptr<CachedBlock>>::iterator>
+      cache_blocks_;
+
+  std::mutex read_ahead_mutex_;
+  std::condition_variable read_ahead_cond_;
+  bool read_ahead_shutting_down_ = false;
+  std::deque<uint32_t> read_ahead_queue_;
+  std::vector<std::unique_ptr<xe::threading::Thread>> read_ahead_threads_;
+};
+
+}  // namespace vfs
+}  // namespace xe
+
+#endif  // XENIA_VFS_DEVICES_COMPRESSED_DISC_IMAGE_DEVICE_H_
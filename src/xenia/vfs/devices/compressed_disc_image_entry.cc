@@ -0,0 +1,37 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/vfs/devices/compressed_disc_image_entry.h"
+
+#include "xenia/vfs/devices/compressed_disc_image_file.h"
+
+namespace xe {
+namespace vfs {
+
+CompressedDiscImageEntry::CompressedDiscImageEntry(Device* device,
+                                                   Entry* parent,
+                                                   const std::string_view path)
+    : Entry(device, parent, path), data_offset_(0), data_size_(0) {}
+
+CompressedDiscImageEntry::~CompressedDiscImageEntry() = default;
+
+std::unique_ptr<CompressedDiscImageEntry> CompressedDiscImageEntry::Create(
+    Device* device, Entry* parent, const std::string_view name) {
+  auto path = xe::utf8::join_guest_paths(parent->path(), name);
+  return std::make_unique<CompressedDiscImageEntry>(device, parent, path);
+}
+
+X_STATUS CompressedDiscImageEntry::Open(uint32_t desired_access,
+                                        File** out_file) {
+  *out_file = new CompressedDiscImageFile(desired_access, this);
+  return X_STATUS_SUCCESS;
+}
+
+}  // namespace vfs
+}  // namespace xe
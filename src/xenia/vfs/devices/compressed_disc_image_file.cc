@@ -0,0 +1,76 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/vfs/devices/compressed_disc_image_file.h"
+
+#include <algorithm>
+
+#include "xenia/base/cvar.h"
+#include "xenia/vfs/devices/compressed_disc_image_device.h"
+#include "xenia/vfs/devices/compressed_disc_image_entry.h"
+
+DECLARE_int32(disc_read_ahead_size);
+
+namespace xe {
+namespace vfs {
+
+CompressedDiscImageFile::CompressedDiscImageFile(
+    uint32_t file_access, CompressedDiscImageEntry* entry)
+    : File(file_access, entry), entry_(entry) {}
+
+CompressedDiscImageFile::~CompressedDiscImageFile() = default;
+
+void CompressedDiscImageFile::Destroy() { delete this; }
+
+X_STATUS CompressedDiscImageFile::ReadSync(void* buffer, size_t buffer_length,
+                                           size_t byte_offset,
+                                           size_t* out_bytes_read) {
+  if (byte_offset >= entry_->size()) {
+    return X_STATUS_END_OF_FILE;
+  }
+  auto device = static_cast<CompressedDiscImageDevice*>(entry_->device());
+  size_t real_length =
+      std::min(buffer_length, entry_->data_size() - byte_offset);
+
+  // Queueing the read-ahead before reading so it's decompressed in parallel
+  // with the blocks of this read.
+  size_t max_read_ahead_size =
+      size_t(std::max(cvars::disc_read_ahead_size, int32_t(0))) << 20;
+  if (max_read_ahead_size) {
+    std::lock_guard<std::mutex> lock(read_ahead_mutex_);
+    if (byte_offset == next_sequential_offset_) {
+      read_ahead_size_ =
+          std::min(std::max(read_ahead_size_ * 2, real_length * 2),
+                   max_read_ahead_size);
+    } else {
+      read_ahead_size_ = 0;
+      read_ahead_end_ = 0;
+    }
+    next_sequential_offset_ = byte_offset + real_length;
+    size_t read_ahead_start =
+        std::max(next_sequential_offset_, read_ahead_end_);
+    size_t read_ahead_end = std::min(
+        next_sequential_offset_ + read_ahead_size_, entry_->data_size());
+    if (read_ahead_end > read_ahead_start) {
+      device->ReadAhead(entry_->data_offset() + read_ahead_start,
+                        read_ahead_end - read_ahead_start);
+      read_ahead_end_ = read_ahead_end;
+    }
+  }
+
+  if (!device->Read(entry_->data_offset() + byte_offset, buffer,
+                    real_length)) {
+    return X_STATUS_FILE_CORRUPT_ERROR;
+  }
+  *out_bytes_read = real_length;
+  return X_STATUS_SUCCESS;
+}
+
+}  // namespace vfs
+}  // namespace xe
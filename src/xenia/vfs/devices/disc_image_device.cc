@@ -9,10 +9,23 @@
 
 #include "xenia/vfs/devices/disc_image_device.h"
 
+#include <algorithm>
+#include <cinttypes>
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
+#include "xenia/base/memory.h"
 #include "xenia/vfs/devices/disc_image_entry.h"
 
+DEFINE_path(disc_access_log_path, "",
+            "Directory for logs of the parts of disc images read by games. If "
+            "a log for the image exists when it's mounted, the parts read by "
+            "the previous run are prefetched from storage, which speeds up "
+            "loading from hard drives and network storage.",
+            "Storage");
+
 namespace xe {
 namespace vfs {
 
@@ -22,7 +35,12 @@ DiscImageDevice::DiscImageDevice(const std::string_view mount_path,
                                  const std::filesystem::path& host_path)
     : Device(mount_path), name_("GDFX"), host_path_(host_path) {}
 
-DiscImageDevice::~DiscImageDevice() = default;
+DiscImageDevice::~DiscImageDevice() {
+  if (access_log_file_) {
+    FlushAccessLog();
+    fclose(access_log_file_);
+  }
+}
 
 bool DiscImageDevice::Initialize() {
   mmap_ = MappedMemory::Open(host_path_, MappedMemory::Mode::kRead);
@@ -46,9 +64,79 @@ bool DiscImageDevice::Initialize() {
     return false;
   }
 
+  if (!cvars::disc_access_log_path.empty()) {
+    std::filesystem::path log_path = cvars::disc_access_log_path;
+    log_path /= host_path_.filename();
+    log_path += ".access.log";
+    PrewarmFromAccessLog(log_path);
+    // Recording this run from scratch.
+    std::filesystem::create_directories(cvars::disc_access_log_path);
+    access_log_file_ = xe::filesystem::OpenFile(log_path, "w");
+    if (!access_log_file_) {
+      XELOGW("Unable to create the disc access log {}",
+             xe::path_to_utf8(log_path));
+    }
+  }
+
   return true;
 }
 
+void DiscImageDevice::Prefetch(size_t offset, size_t length) {
+  if (offset >= mmap_->size()) {
+    return;
+  }
+  length = std::min(length, mmap_->size() - offset);
+  if (length) {
+    xe::memory::AdvisePrefetch(mmap_->data() + offset, length);
+  }
+}
+
+void DiscImageDevice::RecordRead(size_t offset, size_t length) {
+  if (!access_log_file_ || !length) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(access_log_mutex_);
+  if (access_log_length_ &&
+      offset == access_log_offset_ + access_log_length_) {
+    access_log_length_ += length;
+    return;
+  }
+  FlushAccessLog();
+  access_log_offset_ = offset;
+  access_log_length_ = length;
+}
+
+void DiscImageDevice::FlushAccessLog() {
+  if (!access_log_length_) {
+    return;
+  }
+  fprintf(access_log_file_, "%" PRIX64 " %" PRIX64 "\n",
+          uint64_t(access_log_offset_), uint64_t(access_log_length_));
+  fflush(access_log_file_);
+  access_log_length_ = 0;
+}
+
+void DiscImageDevice::PrewarmFromAccessLog(
+    const std::filesystem::path& log_path) {
+  FILE* log_file = xe::filesystem::OpenFile(log_path, "r");
+  if (!log_file) {
+    return;
+  }
+  // Not filling the whole host memory with a huge image.
+  const size_t kMaxPrewarmSize = size_t(512) * 1024 * 1024;
+  size_t prewarm_size = 0;
+  uint64_t offset, length;
+  while (prewarm_size < kMaxPrewarmSize &&
+         fscanf(log_file, "%" SCNx64 " %" SCNx64, &offset, &length) == 2) {
+    length = std::min(uint64_t(kMaxPrewarmSize - prewarm_size), length);
+    Prefetch(size_t(offset), size_t(length));
+    prewarm_size += size_t(length);
+  }
+  fclose(log_file);
+  XELOGI("Prefetching {} MB of the disc image read by the previous run",
+         prewarm_size >> 20);
+}
+
 void DiscImageDevice::Dump(StringBuffer* string_buffer) {
   auto global_lock = global_critical_region_.Acquire();
   root_entry_->Dump(string_buffer, 0);
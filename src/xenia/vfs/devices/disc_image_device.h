@@ -10,7 +10,9 @@
 #ifndef XENIA_VFS_DEVICES_DISC_IMAGE_DEVICE_H_
 #define XENIA_VFS_DEVICES_DISC_IMAGE_DEVICE_H_
 
+#include <cstdio>
 #include <memory>
+#include <mutex>
 #include <string>
 
 #include "xenia/base/mapped_memory.h"
@@ -43,6 +45,11 @@ class DiscImageDevice : public Device {
   uint32_t sectors_per_allocation_unit() const override { return 1; }
   uint32_t bytes_per_sector() const override { return 0x200; }
 
+  // Starts reading the range of the image from storage in the background.
+  void Prefetch(size_t offset, size_t length);
+  // Records a read of the range of the image by the game to the access log.
+  void RecordRead(size_t offset, size_t length);
+
  private:
   enum class Error {
     kSuccess = 0,
@@ -57,6 +64,17 @@ class DiscImageDevice : public Device {
   std::unique_ptr<Entry> root_entry_;
   std::unique_ptr<MappedMemory> mmap_;
 
+  // Ranges of the image read by the game, saved for prefetching them on the
+  // next run, with the range being extended by consecutive reads not written
+  // yet.
+  std::mutex access_log_mutex_;
+  FILE* access_log_file_ = nullptr;
+  size_t access_log_offset_ = 0;
+  size_t access_log_length_ = 0;
+
+  void PrewarmFromAccessLog(const std::filesystem::path& log_path);
+  void FlushAccessLog();
+
   typedef struct {
     uint8_t* ptr;
     size_t size;         // Size (bytes) of total image.
@@ -11,8 +11,15 @@
 
 #include <algorithm>
 
+#include "xenia/base/cvar.h"
+#include "xenia/vfs/devices/disc_image_device.h"
 #include "xenia/vfs/devices/disc_image_entry.h"
 
+DEFINE_int32(disc_read_ahead_size, 8,
+             "Maximum amount of data in MB to prefetch from disc images ahead "
+             "of sequential reads of a file. 0 to disable.",
+             "Storage");
+
 namespace xe {
 namespace vfs {
 
@@ -33,8 +40,58 @@ X_STATUS DiscImageFile::ReadSync(void* buffer, size_t buffer_length,
       std::min(buffer_length, entry_->data_size() - byte_offset);
   std::memcpy(buffer, entry_->mmap()->data() + real_offset, real_length);
   *out_bytes_read = real_length;
+  OnRead(byte_offset, real_length);
+  return X_STATUS_SUCCESS;
+}
+
+X_STATUS DiscImageFile::GetMappedSpans(size_t byte_offset,
+                                       size_t buffer_length,
+                                       std::vector<MappedSpan>& spans_out) {
+  spans_out.clear();
+  if (byte_offset >= entry_->size()) {
+    return X_STATUS_END_OF_FILE;
+  }
+  // Disc image files are always contiguous.
+  size_t length = std::min(buffer_length, entry_->data_size() - byte_offset);
+  spans_out.push_back(
+      {entry_->mmap()->data() + entry_->data_offset() + byte_offset, length});
+  // The caller reads the data right after this.
+  OnRead(byte_offset, length);
   return X_STATUS_SUCCESS;
 }
 
+void DiscImageFile::OnRead(size_t byte_offset, size_t length) {
+  auto device = static_cast<DiscImageDevice*>(entry_->device());
+  device->RecordRead(entry_->data_offset() + byte_offset, length);
+
+  size_t max_read_ahead_size =
+      size_t(std::max(cvars::disc_read_ahead_size, int32_t(0))) << 20;
+  if (!max_read_ahead_size) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(read_ahead_mutex_);
+  if (byte_offset == next_sequential_offset_) {
+    // Start with twice the read size and double further as long as the file
+    // is read sequentially.
+    read_ahead_size_ = std::min(
+        std::max(read_ahead_size_ * 2, length * 2), max_read_ahead_size);
+  } else {
+    read_ahead_size_ = 0;
+    read_ahead_end_ = 0;
+  }
+  next_sequential_offset_ = byte_offset + length;
+  if (!read_ahead_size_) {
+    return;
+  }
+  size_t prefetch_start = std::max(next_sequential_offset_, read_ahead_end_);
+  size_t prefetch_end = std::min(next_sequential_offset_ + read_ahead_size_,
+                                 entry_->data_size());
+  if (prefetch_end > prefetch_start) {
+    device->Prefetch(entry_->data_offset() + prefetch_start,
+                     prefetch_end - prefetch_start);
+    read_ahead_end_ = prefetch_end;
+  }
+}
+
 }  // namespace vfs
 }  // namespace xe
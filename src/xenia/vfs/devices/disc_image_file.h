@@ -10,6 +10,8 @@
 #ifndef XENIA_VFS_DEVICES_DISC_IMAGE_FILE_H_
 #define XENIA_VFS_DEVICES_DISC_IMAGE_FILE_H_
 
+#include <mutex>
+
 #include "xenia/vfs/file.h"
 
 namespace xe {
@@ -26,6 +28,8 @@ class DiscImageFile : public File {
 
   X_STATUS ReadSync(void* buffer, size_t buffer_length, size_t byte_offset,
                     size_t* out_bytes_read) override;
+  X_STATUS GetMappedSpans(size_t byte_offset, size_t buffer_length,
+                          std::vector<MappedSpan>& spans_out) override;
   X_STATUS WriteSync(const void* buffer, size_t buffer_length,
                      size_t byte_offset, size_t* out_bytes_written) override {
     return X_STATUS_ACCESS_DENIED;
@@ -33,7 +37,19 @@ class DiscImageFile : public File {
   X_STATUS SetLength(size_t length) override { return X_STATUS_ACCESS_DENIED; }
 
  private:
+  // Records the read and prefetches the following data if the file is being
+  // read sequentially.
+  void OnRead(size_t byte_offset, size_t length);
+
   DiscImageEntry* entry_;
+
+  std::mutex read_ahead_mutex_;
+  // Where the next read starts if it's sequential.
+  size_t next_sequential_offset_ = SIZE_MAX;
+  // The end of the range prefetched so far, and how far ahead of the reads to
+  // prefetch, growing while the reads are sequential.
+  size_t read_ahead_end_ = 0;
+  size_t read_ahead_size_ = 0;
 };
 
 }  // namespace vfs
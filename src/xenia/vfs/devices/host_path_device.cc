@@ -9,12 +9,19 @@
 
 #include "xenia/vfs/devices/host_path_device.h"
 
+#include "xenia/base/cvar.h"
 #include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/kernel/xfile.h"
 #include "xenia/vfs/devices/host_path_entry.h"
 
+DEFINE_bool(host_path_watch_changes, true,
+            "Watch host directories mounted as devices for changes made by "
+            "other programs, so the metadata of their files is served from "
+            "memory instead of being queried from the host every time.",
+            "Storage");
+
 namespace xe {
 namespace vfs {
 
@@ -26,7 +33,10 @@ HostPathDevice::HostPathDevice(const std::string_view mount_path,
       host_path_(host_path),
       read_only_(read_only) {}
 
-HostPathDevice::~HostPathDevice() = default;
+HostPathDevice::~HostPathDevice() {
+  // Before the entries referenced by the callback are destroyed.
+  watcher_.reset();
+}
 
 bool HostPathDevice::Initialize() {
   if (!std::filesystem::exists(host_path_)) {
@@ -44,10 +54,23 @@ bool HostPathDevice::Initialize() {
   root_entry_ = std::unique_ptr<Entry>(root_entry);
   PopulateEntry(root_entry);
 
+  if (cvars::host_path_watch_changes) {
+    watcher_ = xe::filesystem::DirectoryWatcher::Create(
+        host_path_, [this](const std::filesystem::path& changed_path) {
+          OnHostChange(changed_path);
+        });
+    if (!watcher_) {
+      XELOGW("Unable to watch {} for changes, querying file metadata from "
+             "the host instead",
+             xe::path_to_utf8(host_path_));
+    }
+  }
+
   return true;
 }
 
 void HostPathDevice::Dump(StringBuffer* string_buffer) {
+  ApplyHostChanges();
   auto global_lock = global_critical_region_.Acquire();
   root_entry_->Dump(string_buffer, 0);
 }
@@ -57,6 +80,7 @@ Entry* HostPathDevice::ResolvePath(const std::string_view path) {
   // be in the form:
   // some\PATH.foo
   XELOGFS("HostPathDevice::ResolvePath({})", path);
+  ApplyHostChanges();
   return root_entry_->ResolvePath(path);
 }
 
@@ -74,5 +98,92 @@ void HostPathDevice::PopulateEntry(HostPathEntry* parent_entry) {
   }
 }
 
+void HostPathDevice::OnHostChange(const std::filesystem::path& changed_path) {
+  {
+    std::lock_guard<std::mutex> lock(host_changes_mutex_);
+    if (host_changes_.size() >= 4096) {
+      // Too many to apply one by one, rescan everything instead.
+      host_changes_.clear();
+      host_changes_.emplace_back();
+    } else if (host_changes_.empty() || !host_changes_.front().empty()) {
+      host_changes_.push_back(changed_path);
+    }
+  }
+  // Once until the changes are applied, not to drop cached paths on every
+  // write to a file.
+  if (!host_changes_pending_.exchange(true, std::memory_order_acq_rel)) {
+    HostPathEntry::InvalidateResolvedPaths();
+  }
+}
+
+void HostPathDevice::ApplyHostChanges() {
+  if (!host_changes_pending_.load(std::memory_order_acquire)) {
+    return;
+  }
+  auto global_lock = global_critical_region_.Acquire();
+  std::vector<std::filesystem::path> changes;
+  {
+    std::lock_guard<std::mutex> lock(host_changes_mutex_);
+    changes.swap(host_changes_);
+    host_changes_pending_.store(false, std::memory_order_release);
+  }
+  for (const auto& changed_path : changes) {
+    ApplyHostChange(changed_path);
+  }
+}
+
+void HostPathDevice::ApplyHostChange(
+    const std::filesystem::path& changed_path) {
+  auto root_entry = static_cast<HostPathEntry*>(root_entry_.get());
+  if (changed_path.empty()) {
+    // Some changes were lost.
+    RefreshEntry(root_entry);
+    return;
+  }
+  auto relative_path = changed_path.lexically_relative(host_path_);
+  if (relative_path.empty() || *relative_path.begin() == "..") {
+    return;
+  }
+  auto entry = static_cast<HostPathEntry*>(
+      root_entry->ResolvePath(xe::path_to_utf8(relative_path)));
+  if (entry) {
+    entry->MarkStale();
+    return;
+  }
+  // Created or renamed to. Entries of files removed on the host are kept
+  // since the guest may be referencing them, opening them will fail.
+  auto parent = static_cast<HostPathEntry*>(root_entry->ResolvePath(
+      xe::path_to_utf8(relative_path.parent_path())));
+  xe::filesystem::FileInfo file_info;
+  if (!parent || !(parent->attributes() & kFileAttributeDirectory) ||
+      !xe::filesystem::GetInfo(changed_path, &file_info)) {
+    return;
+  }
+  auto child = parent->AddHostChild(file_info);
+  if (file_info.type == xe::filesystem::FileInfo::Type::kDirectory) {
+    PopulateEntry(child);
+  }
+}
+
+void HostPathDevice::RefreshEntry(HostPathEntry* entry) {
+  entry->MarkStale();
+  if (!(entry->attributes() & kFileAttributeDirectory)) {
+    return;
+  }
+  for (auto& child_info : xe::filesystem::ListFiles(entry->host_path())) {
+    if (child_info.name == "." || child_info.name == ".." ||
+        entry->GetChild(xe::path_to_utf8(child_info.name))) {
+      continue;
+    }
+    auto child = entry->AddHostChild(child_info);
+    if (child_info.type == xe::filesystem::FileInfo::Type::kDirectory) {
+      PopulateEntry(child);
+    }
+  }
+  for (auto& child : entry->children()) {
+    RefreshEntry(static_cast<HostPathEntry*>(child.get()));
+  }
+}
+
 }  // namespace vfs
 }  // namespace xe
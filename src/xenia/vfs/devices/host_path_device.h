@@ -10,8 +10,13 @@
 #ifndef XENIA_VFS_DEVICES_HOST_PATH_DEVICE_H_
 #define XENIA_VFS_DEVICES_HOST_PATH_DEVICE_H_
 
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
+#include "xenia/base/filesystem.h"
 #include "xenia/vfs/device.h"
 
 namespace xe {
@@ -40,13 +45,30 @@ class HostPathDevice : public Device {
   uint32_t sectors_per_allocation_unit() const override { return 1; }
   uint32_t bytes_per_sector() const override { return 0x200; }
 
+  // Whether changes made on the host are reported to the cached entries, so
+  // their metadata doesn't need to be queried from the host every time.
+  bool is_watching_changes() const { return watcher_ != nullptr; }
+  // Updates the entries for the changes reported by the watcher so far.
+  void ApplyHostChanges();
+
  private:
   void PopulateEntry(HostPathEntry* parent_entry);
+  // Called on the watcher thread. Only queues the change, the watcher thread
+  // must not wait for the global critical region since the device may be
+  // destroyed with it held.
+  void OnHostChange(const std::filesystem::path& changed_path);
+  void ApplyHostChange(const std::filesystem::path& changed_path);
+  // Marks all entries in the directory tree stale and adds the missing ones.
+  void RefreshEntry(HostPathEntry* entry);
 
   std::string name_;
   std::filesystem::path host_path_;
   std::unique_ptr<Entry> root_entry_;
   bool read_only_;
+  std::mutex host_changes_mutex_;
+  std::vector<std::filesystem::path> host_changes_;
+  std::atomic<bool> host_changes_pending_ = {false};
+  std::unique_ptr<xe::filesystem::DirectoryWatcher> watcher_;
 };
 
 }  // namespace vfs
@@ -15,6 +15,7 @@
 #include "xenia/base/math.h"
 #include "xenia/base/string.h"
 #include "xenia/vfs/device.h"
+#include "xenia/vfs/devices/host_path_device.h"
 #include "xenia/vfs/devices/host_path_file.h"
 
 namespace xe {
@@ -107,11 +108,31 @@ bool HostPathEntry::DeleteEntryInternal(Entry* entry) {
   }
 }
 
+HostPathEntry* HostPathEntry::AddHostChild(
+    const xe::filesystem::FileInfo& file_info) {
+  auto global_lock = global_critical_region_.Acquire();
+  auto child = HostPathEntry::Create(device_, this, host_path_ / file_info.name,
+                                     file_info);
+  children_.push_back(std::unique_ptr<Entry>(child));
+  tree_generation_.fetch_add(1, std::memory_order_acq_rel);
+  return child;
+}
+
 void HostPathEntry::update() {
+  auto host_path_device = static_cast<HostPathDevice*>(device());
+  host_path_device->ApplyHostChanges();
+  if (!stale_.exchange(false, std::memory_order_acq_rel) &&
+      host_path_device->is_watching_changes()) {
+    // Any change since the last query would have been reported.
+    return;
+  }
   xe::filesystem::FileInfo file_info;
   if (!xe::filesystem::GetInfo(host_path_, &file_info)) {
     return;
   }
+  create_timestamp_ = file_info.create_timestamp;
+  access_timestamp_ = file_info.access_timestamp;
+  write_timestamp_ = file_info.write_timestamp;
   if (file_info.type == xe::filesystem::FileInfo::Type::kFile) {
     size_ = file_info.total_size;
     allocation_size_ =
@@ -10,6 +10,7 @@
 #ifndef XENIA_VFS_DEVICES_HOST_PATH_ENTRY_H_
 #define XENIA_VFS_DEVICES_HOST_PATH_ENTRY_H_
 
+#include <atomic>
 #include <string>
 
 #include "xenia/base/filesystem.h"
@@ -40,6 +41,9 @@ class HostPathEntry : public Entry {
                                            size_t length) override;
   void update() override;
 
+  // Makes the next update() query the host for the size and the timestamps.
+  void MarkStale() { stale_.store(true, std::memory_order_release); }
+
  private:
   friend class HostPathDevice;
 
@@ -47,7 +51,18 @@ class HostPathEntry : public Entry {
                                              uint32_t attributes) override;
   bool DeleteEntryInternal(Entry* entry) override;
 
+  // Adds an entry for a file created on the host by another program.
+  HostPathEntry* AddHostChild(const xe::filesystem::FileInfo& file_info);
+  // Makes path lookups go to the devices again instead of being served from
+  // caches, so pending host changes are applied.
+  static void InvalidateResolvedPaths() {
+    tree_generation_.fetch_add(1, std::memory_order_acq_rel);
+  }
+
   std::filesystem::path host_path_;
+  // Whether the cached metadata may be out of date. Always queried if the
+  // device doesn't watch for changes on the host.
+  std::atomic<bool> stale_ = {false};
 };
 
 }  // namespace vfs
@@ -46,6 +46,8 @@ X_STATUS HostPathFile::WriteSync(const void* buffer, size_t buffer_length,
 
   if (file_handle_->Write(byte_offset, buffer, buffer_length,
                           out_bytes_written)) {
+    // The write may have extended the file.
+    static_cast<HostPathEntry*>(entry())->MarkStale();
     return X_STATUS_SUCCESS;
   } else {
     return X_STATUS_END_OF_FILE;
@@ -58,6 +60,7 @@ X_STATUS HostPathFile::SetLength(size_t length) {
   }
 
   if (file_handle_->SetLength(length)) {
+    static_cast<HostPathEntry*>(entry())->MarkStale();
     return X_STATUS_SUCCESS;
   } else {
     return X_STATUS_END_OF_FILE;
@@ -91,16 +91,39 @@ bool StfsContainerDevice::Initialize() {
 
   switch (header_.descriptor_type) {
     case StfsDescriptorType::kStfs:
-      return ReadSTFS() == Error::kSuccess;
-      break;
     case StfsDescriptorType::kSvod:
-      return ReadSVOD() == Error::kSuccess;
+      return true;
     default:
       XELOGE("Unknown STFS Descriptor Type: {}", header_.descriptor_type);
       return false;
   }
 }
 
+void StfsContainerDevice::ReadEntriesOnce() {
+  std::call_once(entries_read_once_, [this]() {
+    Error result = Error::kSuccess;
+    if (header_.descriptor_type == StfsDescriptorType::kSvod) {
+      if (!data_fragment_paths_.empty()) {
+        result = MapDataFragments();
+      }
+      if (result == Error::kSuccess) {
+        result = ReadSVOD();
+      }
+    } else {
+      result = ReadSTFS();
+    }
+    if (result != Error::kSuccess) {
+      XELOGE("Failed to read the entries of STFS container {}: {}",
+             xe::path_to_utf8(host_path_), result);
+    }
+    if (!root_entry_) {
+      auto root_entry = new StfsContainerEntry(this, nullptr, "", &mmap_);
+      root_entry->attributes_ = kFileAttributeDirectory;
+      root_entry_ = std::unique_ptr<Entry>(root_entry);
+    }
+  });
+}
+
 StfsContainerDevice::Error StfsContainerDevice::MapFiles() {
   // Map the file containing the STFS Header and read it.
   XELOGI("Mapping STFS Header file: {}", xe::path_to_utf8(host_path_));
@@ -149,9 +172,16 @@ StfsContainerDevice::Error StfsContainerDevice::MapFiles() {
     return Error::kErrorFileMismatch;
   }
 
-  for (size_t i = 0; i < fragment_files.size(); i++) {
-    auto file = fragment_files.at(i);
-    auto path = file.path / file.name;
+  data_fragment_paths_.clear();
+  for (const auto& file : fragment_files) {
+    data_fragment_paths_.push_back(file.path / file.name);
+  }
+  return Error::kSuccess;
+}
+
+StfsContainerDevice::Error StfsContainerDevice::MapDataFragments() {
+  for (size_t i = 0; i < data_fragment_paths_.size(); i++) {
+    const auto& path = data_fragment_paths_[i];
     auto data = MappedMemory::Open(path, MappedMemory::Mode::kRead);
     if (!data) {
       XELOGI("Failed to map SVOD file {}.", xe::path_to_utf8(path));
@@ -160,11 +190,12 @@ StfsContainerDevice::Error StfsContainerDevice::MapFiles() {
     }
     mmap_.emplace(std::make_pair(i, std::move(data)));
   }
-  XELOGI("SVOD successfully mapped {} files.", fragment_files.size());
+  XELOGI("SVOD successfully mapped {} files.", data_fragment_paths_.size());
   return Error::kSuccess;
 }
 
 void StfsContainerDevice::Dump(StringBuffer* string_buffer) {
+  ReadEntriesOnce();
   auto global_lock = global_critical_region_.Acquire();
   root_entry_->Dump(string_buffer, 0);
 }
@@ -174,6 +205,7 @@ Entry* StfsContainerDevice::ResolvePath(const std::string_view path) {
   // be in the form:
   // some\PATH.foo
   XELOGFS("StfsContainerDevice::ResolvePath({})", path);
+  ReadEntriesOnce();
   return root_entry_->ResolvePath(path);
 }
 
@@ -413,6 +445,7 @@ StfsContainerDevice::Error StfsContainerDevice::ReadEntrySVOD(
         last_record = entry->block_list_.size() - 1;
         last_offset = offset;
       }
+      entry->BuildExtents();
     }
   }
 
@@ -573,6 +606,7 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSTFS() {
           block_index = block_hash.next_block_index;
           info = block_hash.info;
         }
+        entry->BuildExtents();
       }
 
       parent_entry->children_.emplace_back(std::move(entry));
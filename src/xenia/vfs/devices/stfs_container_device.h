@@ -12,7 +12,9 @@
 
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include "xenia/base/mapped_memory.h"
 #include "xenia/vfs/device.h"
@@ -210,6 +212,11 @@ class StfsContainerDevice : public Device {
   bool ResolveFromFolder(const std::filesystem::path& path);
 
   Error MapFiles();
+  Error MapDataFragments();
+  // Parses the file table and maps the SVOD data fragments on the first
+  // lookup rather than at mount, since content packages are mounted in bulk
+  // often only for their header.
+  void ReadEntriesOnce();
   static Error ReadPackageType(const uint8_t* map_ptr, size_t map_size,
                                StfsPackageType* package_type_out);
   Error ReadHeaderAndVerify(const uint8_t* map_ptr, size_t map_size);
@@ -229,6 +236,8 @@ class StfsContainerDevice : public Device {
   std::filesystem::path host_path_;
   std::map<size_t, std::unique_ptr<MappedMemory>> mmap_;
   size_t mmap_total_size_;
+  std::vector<std::filesystem::path> data_fragment_paths_;
+  std::once_flag entries_read_once_;
 
   size_t base_offset_;
   size_t magic_offset_;
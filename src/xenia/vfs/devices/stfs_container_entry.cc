@@ -36,6 +36,22 @@ std::unique_ptr<StfsContainerEntry> StfsContainerEntry::Create(
   return std::move(entry);
 }
 
+void StfsContainerEntry::BuildExtents() {
+  extents_.clear();
+  size_t file_offset = 0;
+  for (const BlockRecord& record : block_list_) {
+    const uint8_t* data = mmap_->at(record.file)->data() + record.offset;
+    if (!extents_.empty() &&
+        extents_.back().data + extents_.back().length == data) {
+      extents_.back().length += record.length;
+    } else {
+      extents_.push_back({file_offset, data, record.length});
+    }
+    file_offset += record.length;
+  }
+  extents_.shrink_to_fit();
+}
+
 X_STATUS StfsContainerEntry::Open(uint32_t desired_access, File** out_file) {
   *out_file = new StfsContainerFile(desired_access, this);
   return X_STATUS_SUCCESS;
@@ -49,14 +49,28 @@ class StfsContainerEntry : public Entry {
   };
   const std::vector<BlockRecord>& block_list() const { return block_list_; }
 
+  // Runs of the data of the file contiguous in the host mappings, with the
+  // offset in the file where each begins, so reads only need a binary search
+  // and a copy per run instead of walking the blocks.
+  struct Extent {
+    size_t file_offset;
+    const uint8_t* data;
+    size_t length;
+  };
+  const std::vector<Extent>& extents() const { return extents_; }
+
  private:
   friend class StfsContainerDevice;
 
+  // Called once the block list is complete.
+  void BuildExtents();
+
   MultifileMemoryMap* mmap_;
   size_t data_offset_;
   size_t data_size_;
   size_t block_;
   std::vector<BlockRecord> block_list_;
+  std::vector<Extent> extents_;
 };
 
 }  // namespace vfs
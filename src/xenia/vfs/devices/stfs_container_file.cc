@@ -29,38 +29,52 @@ void StfsContainerFile::Destroy() { delete this; }
 X_STATUS StfsContainerFile::ReadSync(void* buffer, size_t buffer_length,
                                      size_t byte_offset,
                                      size_t* out_bytes_read) {
+  std::vector<MappedSpan> spans;
+  X_STATUS result = GetMappedSpans(byte_offset, buffer_length, spans);
+  if (XFAILED(result)) {
+    return result;
+  }
+  uint8_t* p = reinterpret_cast<uint8_t*>(buffer);
+  for (const MappedSpan& span : spans) {
+    std::memcpy(p, span.data, span.length);
+    p += span.length;
+  }
+  *out_bytes_read = p - reinterpret_cast<uint8_t*>(buffer);
+  return X_STATUS_SUCCESS;
+}
+
+X_STATUS StfsContainerFile::GetMappedSpans(size_t byte_offset,
+                                           size_t buffer_length,
+                                           std::vector<MappedSpan>& spans_out) {
+  spans_out.clear();
   if (byte_offset >= entry_->size()) {
     return X_STATUS_END_OF_FILE;
   }
 
-  size_t src_offset = 0;
-  uint8_t* p = reinterpret_cast<uint8_t*>(buffer);
   size_t remaining_length =
       std::min(buffer_length, entry_->size() - byte_offset);
-  *out_bytes_read = remaining_length;
-
-  for (size_t i = 0; i < entry_->block_list().size(); i++) {
-    auto& record = entry_->block_list()[i];
-    if (src_offset + record.length <= byte_offset) {
-      // Doesn't begin in this region. Skip it.
-      src_offset += record.length;
-      continue;
-    }
-
-    uint8_t* src = entry_->mmap()->at(record.file)->data();
 
+  // Starting from the last extent beginning at or before the offset. Extents
+  // may end before the file size if the block chain is broken.
+  const auto& extents = entry_->extents();
+  auto it = std::upper_bound(
+      extents.cbegin(), extents.cend(), byte_offset,
+      [](size_t offset, const StfsContainerEntry::Extent& extent) {
+        return offset < extent.file_offset;
+      });
+  if (it == extents.cbegin()) {
+    return X_STATUS_SUCCESS;
+  }
+  --it;
+  for (; it != extents.cend() && remaining_length; ++it) {
     size_t read_offset =
-        (byte_offset > src_offset) ? byte_offset - src_offset : 0;
-    size_t read_length =
-        std::min(record.length - read_offset, remaining_length);
-    std::memcpy(p, src + record.offset + read_offset, read_length);
-
-    p += read_length;
-    src_offset += record.length;
-    remaining_length -= read_length;
-    if (remaining_length == 0) {
+        byte_offset > it->file_offset ? byte_offset - it->file_offset : 0;
+    if (read_offset >= it->length) {
       break;
     }
+    size_t read_length = std::min(it->length - read_offset, remaining_length);
+    spans_out.push_back({it->data + read_offset, read_length});
+    remaining_length -= read_length;
   }
 
   return X_STATUS_SUCCESS;
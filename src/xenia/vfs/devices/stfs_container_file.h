@@ -28,6 +28,8 @@ class StfsContainerFile : public File {
 
   X_STATUS ReadSync(void* buffer, size_t buffer_length, size_t byte_offset,
                     size_t* out_bytes_read) override;
+  X_STATUS GetMappedSpans(size_t byte_offset, size_t buffer_length,
+                          std::vector<MappedSpan>& spans_out) override;
   X_STATUS WriteSync(const void* buffer, size_t buffer_length,
                      size_t byte_offset, size_t* out_bytes_written) override {
     return X_STATUS_ACCESS_DENIED;
@@ -16,6 +16,8 @@
 namespace xe {
 namespace vfs {
 
+std::atomic<uint64_t> Entry::tree_generation_ = {0};
+
 Entry::Entry(Device* device, Entry* parent, const std::string_view path)
     : device_(device),
       parent_(parent),
@@ -98,6 +100,7 @@ Entry* Entry::CreateEntry(const std::string_view name, uint32_t attributes) {
     return nullptr;
   }
   children_.push_back(std::move(entry));
+  tree_generation_.fetch_add(1, std::memory_order_acq_rel);
   // TODO(benvanik): resort? would break iteration?
   Touch();
   return children_.back().get();
@@ -114,6 +117,8 @@ bool Entry::Delete(Entry* entry) {
   if (!DeleteEntryInternal(entry)) {
     return false;
   }
+  // Before the entry is destroyed, so it's not returned from caches anymore.
+  tree_generation_.fetch_add(1, std::memory_order_acq_rel);
   for (auto it = children_.begin(); it != children_.end(); ++it) {
     if (it->get() == entry) {
       children_.erase(it);
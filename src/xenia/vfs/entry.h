@@ -10,6 +10,7 @@
 #ifndef XENIA_VFS_ENTRY_H_
 #define XENIA_VFS_ENTRY_H_
 
+#include <atomic>
 #include <memory>
 #include <string>
 #include <vector>
@@ -111,6 +112,12 @@ class Entry {
   bool Delete();
   void Touch();
 
+  // Changes whenever an entry is added to or removed from a directory of any
+  // device, for dropping cached path resolution results.
+  static uint64_t tree_generation() {
+    return tree_generation_.load(std::memory_order_acquire);
+  }
+
   // If successful, out_file points to a new file. When finished, call
   // file->Destroy()
   virtual X_STATUS Open(uint32_t desired_access, File** out_file) = 0;
@@ -132,6 +139,8 @@ class Entry {
   }
   virtual bool DeleteEntryInternal(Entry* entry) { return false; }
 
+  static std::atomic<uint64_t> tree_generation_;
+
   xe::global_critical_region global_critical_region_;
   Device* device_;
   Entry* parent_;
@@ -11,6 +11,7 @@
 #define XENIA_VFS_FILE_H_
 
 #include <cstdint>
+#include <vector>
 
 #include "xenia/xbox.h"
 
@@ -31,6 +32,13 @@ struct CreateOptions {
 
 class Entry;
 
+// Host memory, such as a view of a memory-mapped host file, holding a part of
+// the data of a file.
+struct MappedSpan {
+  const uint8_t* data;
+  size_t length;
+};
+
 class File {
  public:
   File(uint32_t file_access, Entry* entry)
@@ -44,6 +52,16 @@ class File {
   virtual X_STATUS WriteSync(const void* buffer, size_t buffer_length,
                              size_t byte_offset, size_t* out_bytes_written) = 0;
 
+  // For files stored in memory-mapped host files, gets the host memory holding
+  // the data from byte_offset, up to buffer_length bytes or the end of the
+  // file, so it can be copied straight to where it's needed. Returns
+  // X_STATUS_NOT_IMPLEMENTED if the file is not memory-mapped and ReadSync
+  // must be used instead. The memory stays valid while the file is open.
+  virtual X_STATUS GetMappedSpans(size_t byte_offset, size_t buffer_length,
+                                  std::vector<MappedSpan>& spans_out) {
+    return X_STATUS_NOT_IMPLEMENTED;
+  }
+
   // TODO: Parameters
   virtual X_STATUS ReadAsync(void* buffer, size_t buffer_length,
                              size_t byte_offset, size_t* out_bytes_read) {
@@ -7,12 +7,13 @@ project("xenia-vfs")
   kind("StaticLib")
   language("C++")
   links({
+    "snappy",
     "xenia-base",
   })
   defines({
   })
   recursive_platform_files()
-  removefiles({"vfs_dump.cc"})
+  removefiles({"vfs_compress.cc", "vfs_dump.cc"})
 
 project("xenia-vfs-dump")
   uuid("2EF270C7-41A8-4D0E-ACC5-59693A9CCE32")
@@ -33,3 +34,23 @@ project("xenia-vfs-dump")
     project_root,
   })
 
+project("xenia-vfs-compress")
+  uuid("6d3c6ab2-8a6f-4e0c-9a57-2e7c1f0b4d91")
+  kind("ConsoleApp")
+  language("C++")
+  links({
+    "fmt",
+    "snappy",
+    "xenia-base",
+    "xenia-vfs",
+  })
+  defines({})
+
+  files({
+    "vfs_compress.cc",
+    project_root.."/src/xenia/base/main_"..platform_suffix..".cc",
+  })
+  resincludedirs({
+    project_root,
+  })
+
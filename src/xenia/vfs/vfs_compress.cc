@@ -0,0 +1,111 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "third_party/snappy/snappy.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/main.h"
+#include "xenia/base/mapped_memory.h"
+#include "xenia/base/math.h"
+#include "xenia/vfs/devices/compressed_disc_image_device.h"
+
+namespace xe {
+namespace vfs {
+
+DEFINE_transient_path(source, "", "Specifies the disc image to compress.",
+                      "General");
+
+DEFINE_transient_path(target, "",
+                      "Specifies the compressed disc image to write.",
+                      "General");
+
+DEFINE_int32(block_size, 64,
+             "Size of the independently compressed blocks in KB, a power of "
+             "two. Smaller blocks are faster to read randomly, larger blocks "
+             "compress better.",
+             "General");
+
+int vfs_compress_main(const std::vector<std::string>& args) {
+  if (cvars::source.empty() || cvars::target.empty()) {
+    XELOGE("Usage: {} [source] [target]", xe::path_to_utf8(args[0]));
+    return 1;
+  }
+  if (cvars::block_size <= 0 || !xe::is_pow2(uint32_t(cvars::block_size))) {
+    XELOGE("The block size must be a power of two");
+    return 1;
+  }
+
+  auto source = MappedMemory::Open(cvars::source, MappedMemory::Mode::kRead);
+  if (!source) {
+    XELOGE("Unable to open {}", xe::path_to_utf8(cvars::source));
+    return 1;
+  }
+  auto file = xe::filesystem::OpenFile(cvars::target, "wb");
+  if (!file) {
+    XELOGE("Unable to create {}", xe::path_to_utf8(cvars::target));
+    return 1;
+  }
+
+  CompressedDiscImageHeader header = {};
+  header.magic = CompressedDiscImageHeader::kMagic;
+  header.version = CompressedDiscImageHeader::kVersion;
+  header.compression = CompressedDiscImageHeader::Compression::kSnappy;
+  header.block_size = uint32_t(cvars::block_size) * 1024;
+  header.image_size = source->size();
+  // Rewritten with the index offset at the end.
+  fwrite(&header, sizeof(header), 1, file);
+
+  uint32_t block_count = header.block_count();
+  std::vector<uint64_t> block_offsets;
+  block_offsets.reserve(block_count + 1);
+  uint64_t offset = sizeof(header);
+  std::string compressed;
+  for (uint32_t i = 0; i < block_count; ++i) {
+    size_t block_start = size_t(i) * header.block_size;
+    size_t block_size =
+        std::min(size_t(header.block_size), source->size() - block_start);
+    auto block = reinterpret_cast<const char*>(source->data()) + block_start;
+    snappy::Compress(block, block_size, &compressed);
+    block_offsets.push_back(offset);
+    // Stored as is if it doesn't compress, which the reader detects by the
+    // size being the decompressed size.
+    if (compressed.size() < block_size) {
+      fwrite(compressed.data(), compressed.size(), 1, file);
+      offset += compressed.size();
+    } else {
+      fwrite(block, block_size, 1, file);
+      offset += block_size;
+    }
+  }
+  block_offsets.push_back(offset);
+  header.index_offset = offset;
+  fwrite(block_offsets.data(), sizeof(uint64_t), block_offsets.size(), file);
+  fseek(file, 0, SEEK_SET);
+  fwrite(&header, sizeof(header), 1, file);
+  bool failed = ferror(file) != 0;
+  fclose(file);
+  if (failed) {
+    XELOGE("Unable to write {}", xe::path_to_utf8(cvars::target));
+    return 1;
+  }
+
+  XELOGI("Compressed {} MB to {} MB", header.image_size >> 20,
+         (offset + block_offsets.size() * sizeof(uint64_t)) >> 20);
+  return 0;
+}
+
+}  // namespace vfs
+}  // namespace xe
+
+DEFINE_ENTRY_POINT("xenia-vfs-compress", xe::vfs::vfs_compress_main,
+                   "[source] [target]", "source", "target");
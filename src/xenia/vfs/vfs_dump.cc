@@ -7,13 +7,19 @@
  ******************************************************************************
  */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <queue>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "xenia/base/logging.h"
 #include "xenia/base/main.h"
 #include "xenia/base/math.h"
+#include "xenia/base/threading.h"
 
 #include "xenia/vfs/devices/stfs_container_device.h"
 #include "xenia/vfs/file.h"
@@ -27,6 +33,75 @@ DEFINE_transient_path(source, "", "Specifies the file to dump from.",
 DEFINE_transient_path(dump_path, "",
                       "Specifies the directory to dump files to.", "General");
 
+DEFINE_int32(dump_threads, 0,
+             "Number of files to extract in parallel. 0 to use the number of "
+             "logical processors.",
+             "General");
+
+// Files are copied in chunks of this size rather than whole, so memory use
+// doesn't depend on the size of the files.
+const size_t kCopyChunkSize = 16 * 1024 * 1024;
+
+struct DumpProgress {
+  std::atomic<size_t> files_done = {0};
+  std::atomic<uint64_t> bytes_done = {0};
+  std::atomic<size_t> files_failed = {0};
+};
+
+bool DumpFile(Entry* entry, const std::filesystem::path& dest_name,
+              std::vector<uint8_t>& buffer, DumpProgress& progress) {
+  vfs::File* in_file = nullptr;
+  if (entry->Open(FileAccess::kFileReadData, &in_file) != X_STATUS_SUCCESS) {
+    XELOGE("Unable to open {}", entry->path());
+    return false;
+  }
+  auto file = xe::filesystem::OpenFile(dest_name, "wb");
+  if (!file) {
+    XELOGE("Unable to create {}", xe::path_to_utf8(dest_name));
+    in_file->Destroy();
+    return false;
+  }
+
+  bool succeeded = true;
+  std::unique_ptr<MappedMemory> map;
+  if (entry->can_map()) {
+    map = entry->OpenMapped(xe::MappedMemory::Mode::kRead);
+  }
+  for (size_t offset = 0; offset < entry->size();) {
+    size_t chunk_size = std::min(kCopyChunkSize, entry->size() - offset);
+    const uint8_t* chunk;
+    if (map) {
+      chunk = map->data() + offset;
+    } else {
+      // Can't map the file into memory. Read it into a temporary buffer.
+      buffer.resize(kCopyChunkSize);
+      if (in_file->ReadSync(buffer.data(), chunk_size, offset, &chunk_size) !=
+              X_STATUS_SUCCESS ||
+          !chunk_size) {
+        succeeded = false;
+        break;
+      }
+      chunk = buffer.data();
+    }
+    if (fwrite(chunk, chunk_size, 1, file) != 1) {
+      succeeded = false;
+      break;
+    }
+    offset += chunk_size;
+    progress.bytes_done += chunk_size;
+  }
+  if (!succeeded) {
+    XELOGE("Failed to copy {}", entry->path());
+  }
+
+  if (map) {
+    map->Close();
+  }
+  fclose(file);
+  in_file->Destroy();
+  return succeeded;
+}
+
 int vfs_dump_main(const std::vector<std::string>& args) {
   if (cvars::source.empty() || cvars::dump_path.empty()) {
     XELOGE("Usage: {} [source] [dump_path]", xe::path_to_utf8(args[0]));
@@ -43,15 +118,13 @@ int vfs_dump_main(const std::vector<std::string>& args) {
     return 1;
   }
 
-  // Run through all the files, breadth-first style.
+  // Run through all the entries, breadth-first style, creating the
+  // directories and gathering the files to extract in parallel.
   std::queue<vfs::Entry*> queue;
   auto root = device->ResolvePath("/");
   queue.push(root);
-
-  // Allocate a buffer when needed.
-  size_t buffer_size = 0;
-  uint8_t* buffer = nullptr;
-
+  std::vector<vfs::Entry*> files;
+  uint64_t total_bytes = 0;
   while (!queue.empty()) {
     auto entry = queue.front();
     queue.pop();
@@ -65,48 +138,62 @@ int vfs_dump_main(const std::vector<std::string>& args) {
       std::filesystem::create_directories(dest_name);
       continue;
     }
+    files.push_back(entry);
+    total_bytes += entry->size();
+  }
 
-    vfs::File* in_file = nullptr;
-    if (entry->Open(FileAccess::kFileReadData, &in_file) != X_STATUS_SUCCESS) {
-      continue;
-    }
-
-    auto file = xe::filesystem::OpenFile(dest_name, "wb");
-    if (!file) {
-      in_file->Destroy();
-      continue;
-    }
-
-    if (entry->can_map()) {
-      auto map = entry->OpenMapped(xe::MappedMemory::Mode::kRead);
-      fwrite(map->data(), map->size(), 1, file);
-      map->Close();
-    } else {
-      // Can't map the file into memory. Read it into a temporary buffer.
-      if (!buffer || entry->size() > buffer_size) {
-        // Resize the buffer.
-        if (buffer) {
-          delete[] buffer;
+  uint32_t thread_count =
+      cvars::dump_threads > 0 ? uint32_t(cvars::dump_threads)
+                              : xe::threading::logical_processor_count();
+  thread_count = std::max(std::min(thread_count, uint32_t(files.size())),
+                          uint32_t(1));
+  DumpProgress progress;
+  std::atomic<size_t> next_file = {0};
+  std::vector<std::thread> threads;
+  auto start_time = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    threads.emplace_back([&]() {
+      std::vector<uint8_t> buffer;
+      size_t file_index;
+      while ((file_index = next_file++) < files.size()) {
+        Entry* entry = files[file_index];
+        if (!DumpFile(entry, base_path / xe::to_path(entry->path()), buffer,
+                      progress)) {
+          ++progress.files_failed;
         }
-
-        // Allocate a buffer rounded up to the nearest 512MB.
-        buffer_size = xe::round_up(entry->size(), 512 * 1024 * 1024);
-        buffer = new uint8_t[buffer_size];
+        ++progress.files_done;
       }
+    });
+  }
 
-      size_t bytes_read = 0;
-      in_file->ReadSync(buffer, entry->size(), 0, &bytes_read);
-      fwrite(buffer, bytes_read, 1, file);
+  auto log_progress = [&]() {
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start_time)
+                         .count();
+    uint64_t bytes_done = progress.bytes_done;
+    XELOGI("{}/{} files, {}/{} MB, {:.1f} MB/s", size_t(progress.files_done),
+           files.size(), bytes_done >> 20, total_bytes >> 20,
+           seconds > 0.0 ? double(bytes_done) / (1024.0 * 1024.0) / seconds
+                         : 0.0);
+  };
+  auto last_log_time = start_time;
+  while (progress.files_done < files.size()) {
+    xe::threading::Sleep(std::chrono::milliseconds(100));
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_log_time >= std::chrono::seconds(1)) {
+      log_progress();
+      last_log_time = now;
     }
-
-    fclose(file);
-    in_file->Destroy();
   }
-
-  if (buffer) {
-    delete[] buffer;
+  for (auto& thread : threads) {
+    thread.join();
   }
+  log_progress();
 
+  if (progress.files_failed) {
+    XELOGE("Failed to extract {} files", size_t(progress.files_failed));
+    return 1;
+  }
   return 0;
 }
 
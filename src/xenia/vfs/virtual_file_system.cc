@@ -14,6 +14,11 @@
 #include "xenia/kernel/xfile.h"
 
 DEFINE_bool(mount_cache, false, "Enable cache mount", "Storage");
+DEFINE_int32(vfs_path_cache_size, 4096,
+             "Maximum number of resolved guest paths to remember, so opening "
+             "the same files again doesn't walk the directory trees. 0 to "
+             "disable.",
+             "Storage");
 
 namespace xe {
 namespace vfs {
@@ -21,6 +26,8 @@ namespace vfs {
 VirtualFileSystem::VirtualFileSystem() {}
 
 VirtualFileSystem::~VirtualFileSystem() {
+  // Reading from the devices.
+  access_trace_.reset();
   // Delete all devices.
   // This will explode if anyone is still using data from them.
   devices_.clear();
@@ -30,25 +37,47 @@ VirtualFileSystem::~VirtualFileSystem() {
 bool VirtualFileSystem::RegisterDevice(std::unique_ptr<Device> device) {
   auto global_lock = global_critical_region_.Acquire();
   devices_.emplace_back(std::move(device));
+  RebuildDeviceTrie();
+  ClearPathCache();
   return true;
 }
 
 bool VirtualFileSystem::UnregisterDevice(const std::string_view path) {
+  // The device may be being read by the replay thread, which also needs the
+  // global critical region, so not waiting for it with the region held.
+  if (access_trace_) {
+    access_trace_->StopReplay();
+  }
   auto global_lock = global_critical_region_.Acquire();
   for (auto it = devices_.begin(); it != devices_.end(); ++it) {
     if ((*it)->mount_path() == path) {
       XELOGD("Unregistered device: {}", (*it)->mount_path());
       devices_.erase(it);
+      RebuildDeviceTrie();
+      ClearPathCache();
       return true;
     }
   }
   return false;
 }
 
+void VirtualFileSystem::StartAccessTrace(
+    const std::filesystem::path& trace_path) {
+  if (access_trace_) {
+    // Already recording or replaying for the current title.
+    return;
+  }
+  access_trace_ = std::make_unique<AccessTrace>(this);
+  if (!access_trace_->Open(trace_path)) {
+    access_trace_.reset();
+  }
+}
+
 bool VirtualFileSystem::RegisterSymbolicLink(const std::string_view path,
                                              const std::string_view target) {
   auto global_lock = global_critical_region_.Acquire();
   symlinks_.insert({std::string(path), std::string(target)});
+  ClearPathCache();
   XELOGD("Registered symbolic link: {} => {}", path, target);
 
   return true;
@@ -65,9 +94,58 @@ bool VirtualFileSystem::UnregisterSymbolicLink(const std::string_view path) {
   XELOGD("Unregistered symbolic link: {} => {}", it->first, it->second);
 
   symlinks_.erase(it);
+  ClearPathCache();
   return true;
 }
 
+void VirtualFileSystem::RebuildDeviceTrie() {
+  device_trie_.device = nullptr;
+  device_trie_.children.clear();
+  for (const auto& device : devices_) {
+    DeviceTrieNode* node = &device_trie_;
+    for (std::string_view part : xe::utf8::split_path(device->mount_path())) {
+      std::unique_ptr<DeviceTrieNode>& child =
+          node->children[std::string(part)];
+      if (!child) {
+        child = std::make_unique<DeviceTrieNode>();
+      }
+      node = child.get();
+    }
+    // The first registered device wins if mounted at the same path.
+    if (!node->device) {
+      node->device = device.get();
+    }
+  }
+}
+
+Device* VirtualFileSystem::FindDevice(const std::string_view path) const {
+  const DeviceTrieNode* node = &device_trie_;
+  Device* device = node->device;
+  std::string part_string;
+  for (std::string_view part : xe::utf8::split_path(path)) {
+    part_string = part;
+    auto it = node->children.find(part_string);
+    if (it == node->children.cend()) {
+      break;
+    }
+    node = it->second.get();
+    if (node->device) {
+      device = node->device;
+    }
+  }
+  // The relative path is taken after the mount path, make sure it's exactly
+  // in the beginning (not with repeated separators).
+  if (device && !xe::utf8::starts_with(path, device->mount_path())) {
+    return nullptr;
+  }
+  return device;
+}
+
+void VirtualFileSystem::ClearPathCache() {
+  std::unique_lock<std::shared_mutex> cache_lock(path_cache_mutex_);
+  path_cache_.clear();
+}
+
 bool VirtualFileSystem::FindSymbolicLink(const std::string_view path,
                                          std::string& target) {
   auto it = std::find_if(
@@ -102,7 +180,24 @@ bool VirtualFileSystem::ResolveSymbolicLink(const std::string_view path,
 }
 
 Entry* VirtualFileSystem::ResolvePath(const std::string_view path) {
+  // Fast path not needing the global critical region.
+  uint64_t generation = Entry::tree_generation();
+  bool use_cache = cvars::vfs_path_cache_size > 0;
+  std::string path_string;
+  if (use_cache) {
+    path_string = path;
+    std::shared_lock<std::shared_mutex> cache_lock(path_cache_mutex_);
+    if (path_cache_generation_ == generation) {
+      auto it = path_cache_.find(path_string);
+      if (it != path_cache_.cend()) {
+        return it->second;
+      }
+    }
+  }
+
   auto global_lock = global_critical_region_.Acquire();
+  // Entries are added and removed with the global critical region held.
+  generation = Entry::tree_generation();
 
   // Resolve relative paths
   auto normalized_path(xe::utf8::canonicalize_guest_path(path));
@@ -114,18 +209,32 @@ Entry* VirtualFileSystem::ResolvePath(const std::string_view path) {
   }
 
   // Find the device.
-  auto it =
-      std::find_if(devices_.cbegin(), devices_.cend(), [&](const auto& d) {
-        return xe::utf8::starts_with(normalized_path, d->mount_path());
-      });
-  if (it == devices_.cend()) {
+  Device* device = FindDevice(normalized_path);
+  if (!device) {
     XELOGE("ResolvePath({}) failed - device not found", path);
     return nullptr;
   }
 
-  const auto& device = *it;
   auto relative_path = normalized_path.substr(device->mount_path().size());
-  return device->ResolvePath(relative_path);
+  Entry* entry = device->ResolvePath(relative_path);
+
+  // Not caching failures, the entry may be created through a different path.
+  if (entry && use_cache) {
+    std::unique_lock<std::shared_mutex> cache_lock(path_cache_mutex_);
+    if (generation > path_cache_generation_) {
+      path_cache_.clear();
+      path_cache_generation_ = generation;
+    }
+    if (generation == path_cache_generation_) {
+      if (path_cache_.size() >= size_t(cvars::vfs_path_cache_size)) {
+        // Too many files to remember, start over rather than tracking the
+        // use of every entry.
+        path_cache_.clear();
+      }
+      path_cache_.emplace(std::move(path_string), entry);
+    }
+  }
+  return entry;
 }
 
 Entry* VirtualFileSystem::CreatePath(const std::string_view path,
@@ -11,12 +11,14 @@
 #define XENIA_VFS_VIRTUAL_FILE_SYSTEM_H_
 
 #include <memory>
+#include <shared_mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 #include "xenia/base/cvar.h"
 #include "xenia/base/mutex.h"
+#include "xenia/vfs/access_trace.h"
 #include "xenia/vfs/device.h"
 #include "xenia/vfs/entry.h"
 #include "xenia/vfs/file.h"
@@ -49,12 +51,46 @@ class VirtualFileSystem {
                     uint32_t desired_access, uint32_t create_options,
                     File** out_file, FileAction* out_action);
 
+  // Records the file reads of the guest to the trace at the path, or replays
+  // it ahead of the guest if it was recorded by a previous boot. Must be
+  // called before the guest starts reading files.
+  void StartAccessTrace(const std::filesystem::path& trace_path);
+  void RecordRead(Entry* entry, uint64_t offset, uint64_t length) {
+    if (access_trace_ && access_trace_->is_recording()) {
+      access_trace_->RecordRead(entry->absolute_path(), offset, length);
+    }
+  }
+
  private:
+  // Mount paths split into their components, for finding the device of a path
+  // without comparing it to the mount paths of all devices.
+  struct DeviceTrieNode {
+    Device* device = nullptr;
+    std::unordered_map<std::string, std::unique_ptr<DeviceTrieNode>> children;
+  };
+
   xe::global_critical_region global_critical_region_;
   std::vector<std::unique_ptr<Device>> devices_;
   std::unordered_map<std::string, std::string> symlinks_;
+  DeviceTrieNode device_trie_;
+
+  // Entries of successfully resolved paths, as passed to ResolvePath, valid
+  // while path_cache_generation_ is the Entry::tree_generation(). Modified
+  // only with the global critical region held as well, so results of
+  // resolutions are never stored after a change of the devices or the
+  // symbolic links they depend on.
+  std::shared_mutex path_cache_mutex_;
+  std::unordered_map<std::string, Entry*> path_cache_;
+  uint64_t path_cache_generation_ = 0;
+
+  std::unique_ptr<AccessTrace> access_trace_;
 
   bool ResolveSymbolicLink(const std::string_view path, std::string& result);
+  void RebuildDeviceTrie();
+  // Returns the device with the longest mount path the path starts with.
+  Device* FindDevice(const std::string_view path) const;
+  // Must be called with the global critical region held.
+  void ClearPathCache();
 };
 
 }  // namespace vfs
@@ -23,6 +23,9 @@ project("spirv-tools")
     "spirv-tools/source/val/function.h",
     "spirv-tools/source/val/validation_state.cpp",
     "spirv-tools/source/val/validation_state.h",
+    "spirv-tools/include/spirv-tools/optimizer.hpp",
+    "spirv-tools/source/opt/*.cpp",
+    "spirv-tools/source/opt/*.h",
     "spirv-tools/source/util/*.cpp",
     "spirv-tools/source/util/*.h",
     "spirv-tools/source/val/*.cpp",